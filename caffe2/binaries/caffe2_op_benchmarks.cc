@@ -0,0 +1,536 @@
+// Micro-benchmarks of the hot operators at common shapes, on every device and
+// engine that they are registered for in this build.
+//
+// Every benchmark is named <case>/<device>/<engine> and times Run() of a
+// single operator on random inputs, which waits for the device. The FLOPs and
+// bytes that the cost function of the operator's schema estimates for one run
+// are reported as items and bytes per second, so that
+//
+//   caffe2_op_benchmarks --benchmark_out=ops.json --benchmark_out_format=json
+//
+// gives the time, GFLOP/s and GB/s of every case in a form that can be
+// compared across releases. --benchmark_filter selects cases, e.g.
+// --benchmark_filter='^Conv/.*/CUDA/'.
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/operator_schema.h"
+#include "caffe2/utils/proto_utils.h"
+
+using namespace caffe2;
+
+namespace {
+
+// How the values of an input are generated.
+enum class Fill {
+  kFloat, // Uniform in [0, 1).
+  kIndex, // int64 uniform in [0, value).
+  kLengths, // int32 lengths of the dims[0] segments of `value` rows.
+  kInt32, // int32, all `value`.
+  kInt64, // int64, all `value`.
+};
+
+struct InputSpec {
+  string name;
+  vector<TIndex> dims;
+  Fill fill;
+  int value;
+  // Inputs that operators always read on the CPU, such as the timestep of
+  // LSTMUnit, are not copied to the device.
+  bool cpu_only;
+};
+
+struct OpCase {
+  string name;
+  string type;
+  vector<InputSpec> inputs;
+  vector<string> outputs;
+  vector<Argument> args;
+};
+
+InputSpec Float(const string& name, const vector<TIndex>& dims) {
+  return InputSpec{name, dims, Fill::kFloat, 0, false};
+}
+
+InputSpec Index(const string& name, TIndex size, int range) {
+  return InputSpec{name, {size}, Fill::kIndex, range, false};
+}
+
+InputSpec Lengths(const string& name, TIndex segments, int rows) {
+  return InputSpec{name, {segments}, Fill::kLengths, rows, false};
+}
+
+string ShapeName(const vector<TIndex>& dims) {
+  string name;
+  for (auto d : dims) {
+    name += (name.empty() ? "" : "x") + caffe2::to_string(d);
+  }
+  return name;
+}
+
+vector<OpCase> ConvCases() {
+  vector<OpCase> cases;
+  // N, C, H, W, M, kernel, stride: ResNet-50 layers at batch 1 and 32.
+  const vector<vector<int>> shapes = {{1, 3, 224, 224, 64, 7, 2},
+                                      {1, 64, 56, 56, 64, 3, 1},
+                                      {1, 256, 56, 56, 64, 1, 1},
+                                      {1, 128, 28, 28, 128, 3, 1},
+                                      {1, 512, 7, 7, 2048, 1, 1},
+                                      {32, 64, 56, 56, 64, 3, 1},
+                                      {32, 256, 14, 14, 256, 3, 1}};
+  for (const auto& s : shapes) {
+    const int kernel = s[5];
+    cases.push_back(OpCase{
+        "Conv/" + ShapeName({s[0], s[1], s[2], s[3]}) + "_M" +
+            caffe2::to_string(s[4]) + "_k" + caffe2::to_string(kernel) +
+            "_s" + caffe2::to_string(s[6]),
+        "Conv",
+        {Float("X", {s[0], s[1], s[2], s[3]}),
+         Float("W", {s[4], s[1], kernel, kernel}),
+         Float("b", {s[4]})},
+        {"Y"},
+        {MakeArgument<int>("kernel", kernel),
+         MakeArgument<int>("stride", s[6]),
+         MakeArgument<int>("pad", kernel / 2),
+         MakeArgument<string>("order", "NCHW")}});
+  }
+  // The 2x upsampling of a decoder, with a 4x4 kernel, in both orders.
+  const int N = 8, M = 128, C = 64, H = 32;
+  for (const string order : {"NCHW", "NHWC"}) {
+    const vector<TIndex> X = order == "NCHW" ? vector<TIndex>{N, M, H, H}
+                                             : vector<TIndex>{N, H, H, M};
+    const vector<TIndex> W = order == "NCHW" ? vector<TIndex>{M, C, 4, 4}
+                                             : vector<TIndex>{M, 4, 4, C};
+    cases.push_back(OpCase{
+        "ConvTranspose/" + ShapeName(X) + "_" + order + "_C" +
+            caffe2::to_string(C) + "_k4_s2",
+        "ConvTranspose",
+        {Float("X", X), Float("W", W), Float("b", {C})},
+        {"Y"},
+        {MakeArgument<int>("kernel", 4),
+         MakeArgument<int>("stride", 2),
+         MakeArgument<int>("pad", 1),
+         MakeArgument<string>("order", order)}});
+  }
+  return cases;
+}
+
+vector<OpCase> FCCases() {
+  vector<OpCase> cases;
+  // M, K, N.
+  for (const auto& s : vector<vector<int>>{
+           {1, 1024, 1024}, {64, 1024, 1024}, {256, 4096, 1024}}) {
+    cases.push_back(OpCase{"FC/" + ShapeName({s[0], s[1], s[2]}),
+                           "FC",
+                           {Float("X", {s[0], s[1]}),
+                            Float("W", {s[2], s[1]}),
+                            Float("b", {s[2]})},
+                           {"Y"},
+                           {}});
+  }
+  return cases;
+}
+
+vector<OpCase> SparseCases() {
+  // An embedding table of 100000 rows of 64, looked up in 256 bags of 40.
+  const int rows = 100000, dim = 64, bags = 256, indices = bags * 40;
+  return {
+      OpCase{"Gather/" + ShapeName({rows, dim}),
+             "Gather",
+             {Float("data", {rows, dim}), Index("indices", indices, rows)},
+             {"out"},
+             {}},
+      OpCase{"SparseLengthsSum/" + ShapeName({rows, dim}),
+             "SparseLengthsSum",
+             {Float("data", {rows, dim}),
+              Index("indices", indices, rows),
+              Lengths("lengths", bags, indices)},
+             {"out"},
+             {}},
+      OpCase{"SparseLengthsWeightedSum/" + ShapeName({rows, dim}),
+             "SparseLengthsWeightedSum",
+             {Float("data", {rows, dim}),
+              Float("weights", {indices}),
+              Index("indices", indices, rows),
+              Lengths("lengths", bags, indices)},
+             {"out"},
+             {}},
+  };
+}
+
+vector<OpCase> SegmentCases() {
+  // The dense reductions of 256 segments of 40 slices, at the block sizes that
+  // the reducers are compiled for and one that they are not.
+  const int segments = 256, rows = segments * 40;
+  vector<OpCase> cases;
+  for (const int dim : {16, 32, 64, 100, 128}) {
+    const string shape = ShapeName({rows, dim});
+    cases.push_back(OpCase{"LengthsSum/" + shape,
+                           "LengthsSum",
+                           {Float("data", {rows, dim}),
+                            Lengths("lengths", segments, rows)},
+                           {"out"},
+                           {}});
+    cases.push_back(OpCase{"LengthsWeightedSum/" + shape,
+                           "LengthsWeightedSum",
+                           {Float("data", {rows, dim}),
+                            Float("weights", {rows}),
+                            Lengths("lengths", segments, rows)},
+                           {"out"},
+                           {}});
+    cases.push_back(OpCase{"LengthsMeanGradient/" + shape,
+                           "LengthsMeanGradient",
+                           {Float("segment_grads", {segments, dim}),
+                            Lengths("lengths", segments, rows)},
+                           {"data_grads"},
+                           {}});
+  }
+  return cases;
+}
+
+vector<OpCase> DenseCases() {
+  vector<OpCase> cases;
+  for (const auto& dims :
+       vector<vector<TIndex>>{{64, 1000}, {256, 10000}}) {
+    cases.push_back(OpCase{"Softmax/" + ShapeName(dims),
+                           "Softmax",
+                           {Float("X", dims)},
+                           {"Y"},
+                           {}});
+  }
+  // An LSTM step of a batch of 64 with 512 hidden units.
+  const int N = 64, D = 512;
+  cases.push_back(OpCase{
+      "LSTMUnit/" + ShapeName({N, D}),
+      "LSTMUnit",
+      {Float("hidden", {1, N, D}),
+       Float("cell", {1, N, D}),
+       Float("gates", {1, N, 4 * D}),
+       InputSpec{"seq_lengths", {N}, Fill::kInt32, 1, false},
+       InputSpec{"timestep", {1}, Fill::kInt32, 0, true}},
+      {"hidden_out", "cell_out"},
+      {}});
+  cases.push_back(OpCase{"Transpose/" + ShapeName({32, 64, 56, 56}),
+                         "Transpose",
+                         {Float("X", {32, 64, 56, 56})},
+                         {"Y"},
+                         {MakeArgument<vector<int>>("axes", {0, 2, 3, 1})}});
+  cases.push_back(OpCase{"Transpose/" + ShapeName({4096, 4096}),
+                         "Transpose",
+                         {Float("X", {4096, 4096})},
+                         {"Y"},
+                         {}});
+  const vector<TIndex> size = {1 << 22};
+  for (const string type : {"Add", "Mul"}) {
+    cases.push_back(OpCase{type + "/" + ShapeName(size),
+                           type,
+                           {Float("A", size), Float("B", size)},
+                           {"C"},
+                           {}});
+  }
+  for (const string type : {"Relu", "Sigmoid", "Tanh"}) {
+    cases.push_back(OpCase{
+        type + "/" + ShapeName(size), type, {Float("X", size)}, {"Y"}, {}});
+  }
+  return cases;
+}
+
+// The operators whose CUDA kernels split every output index into
+// coordinates: pooling, im2col and col2im through Conv and ConvGradient, and
+// the space to batch rearrangements.
+vector<OpCase> IndexingCases() {
+  vector<OpCase> cases;
+  // A ResNet-50 stem pooling, 3x3 with stride 2, in both orders.
+  const int N = 32, C = 64, H = 112, P = 56;
+  for (const string order : {"NCHW", "NHWC"}) {
+    const vector<TIndex> X = order == "NCHW" ? vector<TIndex>{N, C, H, H}
+                                             : vector<TIndex>{N, H, H, C};
+    const vector<TIndex> Y = order == "NCHW" ? vector<TIndex>{N, C, P, P}
+                                             : vector<TIndex>{N, P, P, C};
+    const vector<Argument> args = {MakeArgument<int>("kernel", 3),
+                                   MakeArgument<int>("stride", 2),
+                                   MakeArgument<int>("pad", 1),
+                                   MakeArgument<string>("order", order)};
+    for (const string type : {"MaxPool", "AveragePool"}) {
+      cases.push_back(OpCase{type + "/" + ShapeName(X) + "_" + order,
+                             type,
+                             {Float("X", X)},
+                             {"Y"},
+                             args});
+      cases.push_back(OpCase{type + "Gradient/" + ShapeName(X) + "_" + order,
+                             type + "Gradient",
+                             {Float("X", X), Float("Y", Y), Float("dY", Y)},
+                             {"dX"},
+                             args});
+    }
+    const vector<TIndex> conv_X = order == "NCHW"
+        ? vector<TIndex>{N, C, P, P}
+        : vector<TIndex>{N, P, P, C};
+    const vector<TIndex> conv_W = order == "NCHW"
+        ? vector<TIndex>{C, C, 3, 3}
+        : vector<TIndex>{C, 3, 3, C};
+    const vector<Argument> conv_args = {MakeArgument<int>("kernel", 3),
+                                        MakeArgument<int>("pad", 1),
+                                        MakeArgument<string>("order", order)};
+    if (order == "NHWC") {
+      cases.push_back(OpCase{"Conv/" + ShapeName(conv_X) + "_NHWC_k3",
+                             "Conv",
+                             {Float("X", conv_X), Float("W", conv_W)},
+                             {"Y"},
+                             conv_args});
+    }
+    cases.push_back(OpCase{
+        "ConvGradient/" + ShapeName(conv_X) + "_" + order + "_k3",
+        "ConvGradient",
+        {Float("X", conv_X), Float("W", conv_W), Float("dY", conv_X)},
+        {"dW", "db", "dX"},
+        conv_args});
+  }
+  cases.push_back(OpCase{"SpaceToBatch/" + ShapeName({N, C, P, P}),
+                         "SpaceToBatch",
+                         {Float("X", {N, C, P, P})},
+                         {"Y"},
+                         {MakeArgument<int>("block_size", 2)}});
+  cases.push_back(OpCase{"BatchToSpace/" + ShapeName({4 * N, C, P / 2, P / 2}),
+                         "BatchToSpace",
+                         {Float("X", {4 * N, C, P / 2, P / 2})},
+                         {"Y"},
+                         {MakeArgument<int>("block_size", 2)}});
+  return cases;
+}
+
+vector<OpCase> SGDCases() {
+  // The optimizers update their parameters and moments in place.
+  const vector<TIndex> size = {1 << 22};
+  const int rows = 100000, dim = 64, indices = 10240;
+  return {
+      OpCase{"MomentumSGDUpdate/" + ShapeName(size),
+             "MomentumSGDUpdate",
+             {Float("grad", size),
+              Float("moment", size),
+              Float("lr", {1}),
+              Float("param", size)},
+             {"grad", "moment", "param"},
+             {}},
+      OpCase{"Adagrad/" + ShapeName(size),
+             "Adagrad",
+             {Float("param", size),
+              Float("moment", size),
+              Float("grad", size),
+              Float("lr", {1})},
+             {"param", "moment"},
+             {}},
+      OpCase{"Adam/" + ShapeName(size),
+             "Adam",
+             {Float("param", size),
+              Float("moment_1", size),
+              Float("moment_2", size),
+              Float("grad", size),
+              Float("lr", {1}),
+              InputSpec{"iter", {1}, Fill::kInt64, 1, true}},
+             {"param", "moment_1", "moment_2"},
+             {}},
+      OpCase{"SparseAdagrad/" + ShapeName({rows, dim}),
+             "SparseAdagrad",
+             {Float("param", {rows, dim}),
+              Float("moment", {rows, dim}),
+              Index("indices", indices, rows),
+              Float("grad", {indices, dim}),
+              Float("lr", {1})},
+             {"param", "moment"},
+             {}},
+  };
+}
+
+void FillInput(const InputSpec& spec, std::mt19937* gen, TensorCPU* tensor) {
+  tensor->Resize(spec.dims);
+  switch (spec.fill) {
+    case Fill::kFloat: {
+      std::uniform_real_distribution<float> dist(0, 1);
+      auto* data = tensor->mutable_data<float>();
+      for (TIndex i = 0; i < tensor->size(); ++i) {
+        data[i] = dist(*gen);
+      }
+      break;
+    }
+    case Fill::kIndex: {
+      std::uniform_int_distribution<int64_t> dist(0, spec.value - 1);
+      auto* data = tensor->mutable_data<int64_t>();
+      for (TIndex i = 0; i < tensor->size(); ++i) {
+        data[i] = dist(*gen);
+      }
+      break;
+    }
+    case Fill::kLengths: {
+      auto* data = tensor->mutable_data<int>();
+      for (TIndex i = 0; i < tensor->size(); ++i) {
+        data[i] = spec.value / tensor->size() +
+            (i < spec.value % tensor->size() ? 1 : 0);
+      }
+      break;
+    }
+    case Fill::kInt32:
+      std::fill_n(tensor->mutable_data<int>(), tensor->size(), spec.value);
+      break;
+    case Fill::kInt64:
+      std::fill_n(
+          tensor->mutable_data<int64_t>(), tensor->size(), spec.value);
+      break;
+  }
+}
+
+void CreateInputs(
+    const OpCase& op_case,
+    const DeviceOption& device,
+    Workspace* ws) {
+  std::mt19937 gen(1701);
+  for (const auto& spec : op_case.inputs) {
+    const bool copy = device.device_type() != CPU && !spec.cpu_only;
+    const string cpu_name = copy ? spec.name + "_cpu" : spec.name;
+    FillInput(spec, &gen, ws->CreateBlob(cpu_name)->GetMutable<TensorCPU>());
+    if (copy) {
+      OperatorDef def = CreateOperatorDef(
+          "CopyCPUToGPU",
+          "",
+          vector<string>{cpu_name},
+          vector<string>{spec.name});
+      def.mutable_device_option()->CopyFrom(device);
+      CAFFE_ENFORCE(ws->RunOperatorOnce(def));
+    }
+  }
+}
+
+OperatorDef MakeOperatorDef(
+    const OpCase& op_case,
+    const DeviceOption& device,
+    const string& engine) {
+  vector<string> inputs;
+  for (const auto& spec : op_case.inputs) {
+    inputs.push_back(spec.name);
+  }
+  return CreateOperatorDef(
+      op_case.type, "", inputs, op_case.outputs, op_case.args, device, engine);
+}
+
+void RunOpBenchmark(
+    benchmark::State& state,
+    const OpCase& op_case,
+    const DeviceOption& device,
+    const string& engine) {
+  Workspace ws;
+  const OperatorDef def = MakeOperatorDef(op_case, device, engine);
+  unique_ptr<OperatorBase> op;
+  try {
+    CreateInputs(op_case, device, &ws);
+    op = CreateOperator(def, &ws);
+    // Also allocates the outputs ahead of the timed runs.
+    CAFFE_ENFORCE(op->Run(), "The operator failed.");
+  } catch (const std::exception& e) {
+    state.SkipWithError(e.what());
+    return;
+  }
+  while (state.KeepRunning()) {
+    if (!op->Run()) {
+      state.SkipWithError("The operator failed.");
+      break;
+    }
+  }
+
+  const OpSchema* schema = OpSchemaRegistry::Schema(op_case.type);
+  if (schema && schema->HasCostInferenceFunction()) {
+    vector<TensorShape> shapes;
+    for (const auto& spec : op_case.inputs) {
+      TensorShape shape;
+      for (auto d : spec.dims) {
+        shape.add_dims(d);
+      }
+      shape.set_data_type(
+          spec.fill == Fill::kFloat
+              ? TensorProto::FLOAT
+              : spec.fill == Fill::kIndex || spec.fill == Fill::kInt64
+                  ? TensorProto::INT64
+                  : TensorProto::INT32);
+      shapes.push_back(shape);
+    }
+    const auto cost = schema->InferCost(def, shapes);
+    state.SetItemsProcessed(state.iterations() * cost.flops);
+    state.SetBytesProcessed(state.iterations() * cost.bytes_moved);
+  }
+}
+
+// The engines that `type` is registered with on the device of `registry`,
+// with "" for the default one.
+template <class Registry>
+vector<string> Engines(Registry* registry, const string& type) {
+  vector<string> engines;
+  const string prefix = type + "_ENGINE_";
+  for (const auto& key : registry->Keys()) {
+    if (key == type) {
+      engines.push_back("");
+    } else if (key.compare(0, prefix.size(), prefix) == 0) {
+      engines.push_back(key.substr(prefix.size()));
+    }
+  }
+  std::sort(engines.begin(), engines.end());
+  return engines;
+}
+
+void RegisterOpBenchmarks() {
+  vector<OpCase> cases;
+  for (const auto& group :
+       {ConvCases(),
+        FCCases(),
+        SparseCases(),
+        SegmentCases(),
+        DenseCases(),
+        IndexingCases(),
+        SGDCases()}) {
+    cases.insert(cases.end(), group.begin(), group.end());
+  }
+  DeviceOption cpu;
+  cpu.set_device_type(CPU);
+  DeviceOption cuda;
+  cuda.set_device_type(CUDA);
+  // The CUDA operators are only registered in builds with CUDA.
+  const bool has_cuda = CUDAOperatorRegistry()->Has("CopyCPUToGPU");
+  for (const auto& op_case : cases) {
+    vector<std::pair<string, DeviceOption>> devices = {{"CPU", cpu}};
+    if (has_cuda) {
+      devices.emplace_back("CUDA", cuda);
+    }
+    for (const auto& device : devices) {
+      const auto engines = device.first == "CPU"
+          ? Engines(CPUOperatorRegistry(), op_case.type)
+          : Engines(CUDAOperatorRegistry(), op_case.type);
+      for (const auto& engine : engines) {
+        const string name = op_case.name + "/" + device.first + "/" +
+            (engine.empty() ? "DEFAULT" : engine);
+        const DeviceOption device_option = device.second;
+        benchmark::RegisterBenchmark(
+            name.c_str(),
+            [op_case, device_option, engine](benchmark::State& state) {
+              RunOpBenchmark(state, op_case, device_option, engine);
+            })
+            ->Unit(benchmark::kMicrosecond);
+      }
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  // Takes out the --benchmark_* flags before caffe2 parses the rest.
+  benchmark::Initialize(&argc, argv);
+  caffe2::GlobalInit(&argc, &argv);
+  RegisterOpBenchmarks();
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,389 @@
+// Measures the latency and bandwidth that the collective operators achieve,
+// operator overhead included. Run it with one process per node, or per GPU
+// group, under mpirun:
+//
+//   mpirun -np 4 collective_benchmark --implementations=mpi_allreduce,\
+//       mpi_allreduce_bucketed --min_bytes=1024 --max_bytes=67108864
+//
+// For every implementation, message size and blob count it runs a net with
+// the operators of one collective step over the blobs, and rank 0 prints the
+// time of a step (the slowest rank's), the algorithm bandwidth (bytes of all
+// the blobs over that time) and the bus bandwidth. The bus bandwidth scales
+// the algorithm bandwidth by the share of the data that crosses the slowest
+// link, 2 (n - 1) / n for an allreduce among n participants and 1 for a
+// broadcast, so that it is comparable across participant counts and with the
+// peak bandwidth of the links.
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/mpi/mpi_common.h"
+#include "caffe2/utils/proto_utils.h"
+#include "caffe2/utils/string_utils.h"
+
+CAFFE2_DEFINE_string(
+    implementations,
+    "mpi_allreduce,mpi_allreduce_bucketed",
+    "Comma-separated collectives to measure: mpi_allreduce, "
+    "mpi_allreduce_bucketed, mpi_allreduce_cuda, mpi_broadcast, "
+    "fbcollective_allreduce, fbcollective_allreduce_bucketed, "
+    "fbcollective_broadcast, nccl_allreduce, nccl_allreduce_bucketed, "
+    "nccl_hierarchical_allreduce, nccl_broadcast.");
+CAFFE2_DEFINE_int(min_bytes, 1024, "The smallest message size, in bytes.");
+CAFFE2_DEFINE_int(
+    max_bytes,
+    64 << 20,
+    "The largest message size, in bytes. Messages are split evenly over the "
+    "blobs.");
+CAFFE2_DEFINE_int(size_step, 4, "The factor between message sizes.");
+CAFFE2_DEFINE_string(
+    blob_counts,
+    "1,16",
+    "Comma-separated numbers of blobs to split every message in.");
+CAFFE2_DEFINE_int(num_gpus, 1, "The number of GPUs per process to use.");
+CAFFE2_DEFINE_int(warmup, 5, "The number of steps to warm up with.");
+CAFFE2_DEFINE_int(iter, 20, "The number of steps to time.");
+CAFFE2_DEFINE_string(
+    store_path,
+    "",
+    "A directory shared by all the processes, for the rendezvous of the "
+    "fbcollective common world.");
+
+namespace caffe2 {
+namespace {
+
+enum class Device { kCPU, kCUDA };
+
+// The operators of one collective step over the blobs, one list per GPU for
+// the multi-GPU collectives, with the common world in the blob "comm".
+using StepBuilder = std::function<vector<OperatorDef>(
+    const vector<vector<string>>& blobs)>;
+
+struct Implementation {
+  string name;
+  bool allreduce;
+  Device device;
+  // Whether the collective spans the GPUs of every process, or the GPUs of
+  // one process only, rather than one blob per process.
+  bool multi_gpu;
+  bool local_only;
+  // The common world it needs: "mpi", "fbcollective" or "".
+  string world;
+  // The registry key of its operator, to skip it if not built in.
+  string key;
+  StepBuilder build;
+};
+
+DeviceOption MakeDevice(Device device, int gpu) {
+  DeviceOption option;
+  option.set_device_type(device == Device::kCUDA ? CUDA : CPU);
+  if (device == Device::kCUDA) {
+    option.set_cuda_gpu_id(gpu);
+  }
+  return option;
+}
+
+OperatorDef MakeOp(
+    const string& type,
+    const vector<string>& inputs,
+    const vector<string>& outputs,
+    const string& engine,
+    Device device,
+    const vector<Argument>& args = vector<Argument>()) {
+  return CreateOperatorDef(
+      type, "", inputs, outputs, args, MakeDevice(device, 0), engine);
+}
+
+// One operator per blob.
+StepBuilder PerBlob(
+    const string& type,
+    const string& engine,
+    Device device,
+    const vector<Argument>& args = vector<Argument>()) {
+  return [type, engine, device, args](const vector<vector<string>>& blobs) {
+    vector<OperatorDef> ops;
+    for (const auto& blob : blobs[0]) {
+      ops.push_back(MakeOp(type, {"comm", blob}, {blob}, engine, device, args));
+    }
+    return ops;
+  };
+}
+
+// Packs the blobs into one bucket, reduces it, and unpacks it.
+StepBuilder Bucketed(const string& engine, Device device) {
+  return [engine, device](const vector<vector<string>>& blobs) {
+    vector<string> unpack_inputs = {"bucket"};
+    unpack_inputs.insert(unpack_inputs.end(), blobs[0].begin(), blobs[0].end());
+    return vector<OperatorDef>{
+        MakeOp("PackBucket", blobs[0], {"bucket"}, "", device),
+        MakeOp("Allreduce", {"comm", "bucket"}, {"bucket"}, engine, device),
+        MakeOp("UnpackBucket", unpack_inputs, blobs[0], "", device)};
+  };
+}
+
+// One operator per blob over its copies on all the GPUs.
+StepBuilder AcrossGPUs(const string& type, bool with_comm) {
+  return [type, with_comm](const vector<vector<string>>& blobs) {
+    vector<OperatorDef> ops;
+    for (int i = 0; i < blobs[0].size(); ++i) {
+      vector<string> inputs;
+      if (with_comm) {
+        inputs.push_back("comm");
+      }
+      vector<string> outputs;
+      for (const auto& gpu_blobs : blobs) {
+        inputs.push_back(gpu_blobs[i]);
+        outputs.push_back(gpu_blobs[i]);
+      }
+      ops.push_back(MakeOp(type, inputs, outputs, "", Device::kCUDA));
+    }
+    return ops;
+  };
+}
+
+// Packs the blobs of every GPU into a bucket, reduces the buckets across the
+// GPUs, and unpacks them.
+StepBuilder BucketedAcrossGPUs() {
+  return [](const vector<vector<string>>& blobs) {
+    vector<OperatorDef> ops;
+    vector<string> buckets;
+    for (int gpu = 0; gpu < blobs.size(); ++gpu) {
+      buckets.push_back("bucket_gpu" + caffe2::to_string(gpu));
+      ops.push_back(CreateOperatorDef(
+          "PackBucket",
+          "",
+          blobs[gpu],
+          vector<string>{buckets.back()},
+          vector<Argument>(),
+          MakeDevice(Device::kCUDA, gpu),
+          ""));
+    }
+    ops.push_back(
+        MakeOp("NCCLAllreduce", buckets, buckets, "", Device::kCUDA));
+    for (int gpu = 0; gpu < blobs.size(); ++gpu) {
+      vector<string> inputs = {buckets[gpu]};
+      inputs.insert(inputs.end(), blobs[gpu].begin(), blobs[gpu].end());
+      ops.push_back(CreateOperatorDef(
+          "UnpackBucket",
+          "",
+          inputs,
+          blobs[gpu],
+          vector<Argument>(),
+          MakeDevice(Device::kCUDA, gpu),
+          ""));
+    }
+    return ops;
+  };
+}
+
+vector<Implementation> Implementations() {
+  const vector<Argument> root = {MakeArgument<int>("root", 0)};
+  return {
+      {"mpi_allreduce", true, Device::kCPU, false, false, "mpi",
+       "Allreduce_ENGINE_MPI", PerBlob("Allreduce", "MPI", Device::kCPU)},
+      {"mpi_allreduce_bucketed", true, Device::kCPU, false, false, "mpi",
+       "Allreduce_ENGINE_MPI", Bucketed("MPI", Device::kCPU)},
+      {"mpi_allreduce_cuda", true, Device::kCUDA, false, false, "mpi",
+       "Allreduce_ENGINE_MPI", PerBlob("Allreduce", "MPI", Device::kCUDA)},
+      {"mpi_broadcast", false, Device::kCPU, false, false, "mpi",
+       "Broadcast_ENGINE_MPI",
+       PerBlob("Broadcast", "MPI", Device::kCPU, root)},
+      {"fbcollective_allreduce", true, Device::kCPU, false, false,
+       "fbcollective", "Allreduce_ENGINE_FBCOLLECTIVE",
+       PerBlob("Allreduce", "FBCOLLECTIVE", Device::kCPU)},
+      {"fbcollective_allreduce_bucketed", true, Device::kCPU, false, false,
+       "fbcollective", "Allreduce_ENGINE_FBCOLLECTIVE",
+       Bucketed("FBCOLLECTIVE", Device::kCPU)},
+      {"fbcollective_broadcast", false, Device::kCPU, false, false,
+       "fbcollective", "Broadcast_ENGINE_FBCOLLECTIVE",
+       PerBlob("Broadcast", "FBCOLLECTIVE", Device::kCPU, root)},
+      {"nccl_allreduce", true, Device::kCUDA, true, true, "",
+       "NCCLAllreduce", AcrossGPUs("NCCLAllreduce", false)},
+      {"nccl_allreduce_bucketed", true, Device::kCUDA, true, true, "",
+       "NCCLAllreduce", BucketedAcrossGPUs()},
+      {"nccl_hierarchical_allreduce", true, Device::kCUDA, true, false, "mpi",
+       "NCCLHierarchicalAllreduce",
+       AcrossGPUs("NCCLHierarchicalAllreduce", true)},
+      {"nccl_broadcast", false, Device::kCUDA, true, true, "",
+       "NCCLBroadcast", AcrossGPUs("NCCLBroadcast", false)},
+  };
+}
+
+bool IsRegistered(const Implementation& impl) {
+  return impl.device == Device::kCUDA
+      ? CUDAOperatorRegistry()->Has(impl.key)
+      : CPUOperatorRegistry()->Has(impl.key);
+}
+
+// Creates the common world of the given kind in the workspace, as "comm".
+void CreateCommonWorld(const string& world, int rank, int size, Workspace* ws) {
+  if (world == "mpi") {
+    CAFFE_ENFORCE(ws->RunOperatorOnce(
+        MakeOp("CreateCommonWorld", {}, {"comm"}, "MPI", Device::kCPU)));
+  } else if (world == "fbcollective") {
+    CAFFE_ENFORCE(
+        !FLAGS_store_path.empty(),
+        "--store_path is required for the fbcollective collectives.");
+    CAFFE_ENFORCE(ws->RunOperatorOnce(MakeOp(
+        "FileStoreHandlerCreate",
+        {},
+        {"store"},
+        "",
+        Device::kCPU,
+        {MakeArgument<string>("path", FLAGS_store_path)})));
+    OperatorDef def = MakeOp(
+        "CreateCommonWorld",
+        {"store"},
+        {"comm"},
+        "FBCOLLECTIVE",
+        Device::kCPU,
+        {MakeArgument<int>("size", size), MakeArgument<int>("rank", rank)});
+    def.set_name("collective_benchmark");
+    CAFFE_ENFORCE(ws->RunOperatorOnce(def));
+  }
+}
+
+// Returns the seconds per step of the slowest process.
+double TimeStep(
+    const Implementation& impl,
+    TIndex blob_bytes,
+    int num_blobs,
+    Workspace* parent) {
+  Workspace ws(parent);
+  const int num_gpus = impl.multi_gpu ? FLAGS_num_gpus : 1;
+  vector<vector<string>> blobs(num_gpus);
+  for (int gpu = 0; gpu < num_gpus; ++gpu) {
+    for (int i = 0; i < num_blobs; ++i) {
+      blobs[gpu].push_back(
+          "blob_" + caffe2::to_string(i) + "_gpu" + caffe2::to_string(gpu));
+      CAFFE_ENFORCE(ws.RunOperatorOnce(CreateOperatorDef(
+          "ConstantFill",
+          "",
+          vector<string>{},
+          vector<string>{blobs[gpu].back()},
+          vector<Argument>{
+              MakeArgument<vector<TIndex>>(
+                  "shape", {std::max<TIndex>(1, blob_bytes / 4)}),
+              MakeArgument<float>("value", 1)},
+          MakeDevice(impl.device, gpu),
+          "")));
+    }
+  }
+  NetDef net_def;
+  net_def.set_name(impl.name);
+  for (const auto& op : impl.build(blobs)) {
+    net_def.add_op()->CopyFrom(op);
+  }
+  NetBase* net = ws.CreateNet(net_def);
+  CAFFE_ENFORCE(net);
+  for (int i = 0; i < FLAGS_warmup; ++i) {
+    CAFFE_ENFORCE(net->Run());
+  }
+  MPI_Barrier(GlobalMPIComm());
+  Timer timer;
+  for (int i = 0; i < FLAGS_iter; ++i) {
+    CAFFE_ENFORCE(net->Run());
+  }
+  double seconds = timer.Seconds() / FLAGS_iter;
+  MPI_Allreduce(
+      MPI_IN_PLACE, &seconds, 1, MPI_DOUBLE, MPI_MAX, GlobalMPIComm());
+  return seconds;
+}
+
+void RunBenchmarks(int rank, int size) {
+  vector<int> blob_counts;
+  for (const auto& count : split(',', FLAGS_blob_counts)) {
+    blob_counts.push_back(std::stoi(count));
+  }
+  CAFFE_ENFORCE_GT(FLAGS_size_step, 1);
+  std::map<string, Implementation> implementations;
+  for (const auto& impl : Implementations()) {
+    implementations.emplace(impl.name, impl);
+  }
+  std::map<string, std::unique_ptr<Workspace>> worlds;
+
+  if (rank == 0) {
+    printf(
+        "%-32s %12s %6s %12s %12s %12s\n",
+        "implementation",
+        "bytes",
+        "blobs",
+        "latency(us)",
+        "algbw(GB/s)",
+        "busbw(GB/s)");
+  }
+  for (const auto& name : split(',', FLAGS_implementations)) {
+    auto it = implementations.find(name);
+    CAFFE_ENFORCE(it != implementations.end(), "Unknown collective ", name);
+    const Implementation& impl = it->second;
+    if (!IsRegistered(impl)) {
+      if (rank == 0) {
+        printf("%-32s not built in, skipped\n", name.c_str());
+      }
+      continue;
+    }
+    auto& world = worlds[impl.world];
+    if (!world) {
+      world.reset(new Workspace());
+      CreateCommonWorld(impl.world, rank, size, world.get());
+    }
+    const int gpus = impl.multi_gpu ? FLAGS_num_gpus : 1;
+    const int participants = (impl.local_only ? 1 : size) * gpus;
+    const double bus_factor = impl.allreduce && participants > 1
+        ? 2.0 * (participants - 1) / participants
+        : 1.0;
+    for (TIndex bytes = FLAGS_min_bytes; bytes <= FLAGS_max_bytes;
+         bytes *= FLAGS_size_step) {
+      for (int num_blobs : blob_counts) {
+        const TIndex blob_bytes = std::max<TIndex>(4, bytes / num_blobs);
+        const double seconds =
+            TimeStep(impl, blob_bytes, num_blobs, world.get());
+        const double algbw = blob_bytes * num_blobs / seconds / 1e9;
+        if (rank == 0) {
+          printf(
+              "%-32s %12lld %6d %12.1f %12.3f %12.3f\n",
+              name.c_str(),
+              static_cast<long long>(blob_bytes * num_blobs),
+              num_blobs,
+              seconds * 1e6,
+              algbw,
+              algbw * bus_factor);
+          fflush(stdout);
+        }
+      }
+    }
+  }
+}
+
+} // namespace
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::SetUsageMessage(
+      "Measures the latency and bandwidth of the collective operators.");
+  int mpi_ret;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mpi_ret);
+  if (mpi_ret != MPI_THREAD_MULTIPLE && mpi_ret != MPI_THREAD_SERIALIZED) {
+    std::cerr << "Caffe2 MPI requires the underlying MPI to support the "
+                 "MPI_THREAD_SERIALIZED or MPI_THREAD_MULTIPLE mode.\n";
+    return 1;
+  }
+  caffe2::GlobalInit(&argc, &argv);
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  caffe2::RunBenchmarks(rank, size);
+  MPI_Finalize();
+  return 0;
+}
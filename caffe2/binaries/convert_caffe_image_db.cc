@@ -1,3 +1,9 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include "caffe2/core/db.h"
 #include "caffe2/core/init.h"
 #include "caffe2/proto/caffe2.pb.h"
@@ -9,6 +15,7 @@ CAFFE2_DEFINE_string(input_db_type, "", "The input db type.");
 CAFFE2_DEFINE_string(output_db, "", "The output db.");
 CAFFE2_DEFINE_string(output_db_type, "", "The output db type.");
 CAFFE2_DEFINE_int(batch_size, 1000, "The write batch size.");
+CAFFE2_DEFINE_int(num_threads, 4, "The number of threads that convert items.");
 
 using caffe2::db::Cursor;
 using caffe2::db::DB;
@@ -16,8 +23,49 @@ using caffe2::db::Transaction;
 using caffe2::TensorProto;
 using caffe2::TensorProtos;
 
+// Converts a serialized caffe Datum into serialized TensorProtos.
+std::string ConvertDatum(const std::string& value) {
+  caffe::Datum datum;
+  CAFFE_ENFORCE(datum.ParseFromString(value));
+  TensorProtos protos;
+  TensorProto* data = protos.add_protos();
+  TensorProto* label = protos.add_protos();
+  label->set_data_type(TensorProto::INT32);
+  label->add_dims(1);
+  label->add_int32_data(datum.label());
+  if (datum.encoded()) {
+    // This is an encoded image. we will copy over the data directly.
+    data->set_data_type(TensorProto::STRING);
+    data->add_dims(1);
+    data->add_string_data(datum.data());
+  } else {
+    // float data not supported right now.
+    CAFFE_ENFORCE_EQ(datum.float_data_size(), 0);
+    std::string buffer(datum.data().size(), 0);
+    // swap order from CHW to HWC
+    int channels = datum.channels();
+    int size = datum.height() * datum.width();
+    CAFFE_ENFORCE_EQ(datum.data().size(), channels * size);
+    for (int c = 0; c < channels; ++c) {
+      char* dst = &buffer[c];
+      const char* src = datum.data().c_str() + c * size;
+      for (int n = 0; n < size; ++n) {
+        dst[n*channels] = src[n];
+      }
+    }
+    data->set_data_type(TensorProto::BYTE);
+    data->add_dims(datum.height());
+    data->add_dims(datum.width());
+    data->add_dims(datum.channels());
+    data->set_byte_data(buffer);
+  }
+  return protos.SerializeAsString();
+}
+
 int main(int argc, char** argv) {
   caffe2::GlobalInit(&argc, &argv);
+  CAFFE_ENFORCE_GT(caffe2::FLAGS_batch_size, 0);
+  CAFFE_ENFORCE_GT(caffe2::FLAGS_num_threads, 0);
 
   std::unique_ptr<DB> in_db(caffe2::db::CreateDB(
       caffe2::FLAGS_input_db_type, caffe2::FLAGS_input_db, caffe2::db::READ));
@@ -26,48 +74,35 @@ int main(int argc, char** argv) {
   std::unique_ptr<Cursor> cursor(in_db->NewCursor());
   std::unique_ptr<Transaction> transaction(out_db->NewTransaction());
   int count = 0;
-  for (; cursor->Valid(); cursor->Next()) {
-    caffe::Datum datum;
-    CAFFE_ENFORCE(datum.ParseFromString(cursor->value()));
-    TensorProtos protos;
-    TensorProto* data = protos.add_protos();
-    TensorProto* label = protos.add_protos();
-    label->set_data_type(TensorProto::INT32);
-    label->add_dims(1);
-    label->add_int32_data(datum.label());
-    if (datum.encoded()) {
-      // This is an encoded image. we will copy over the data directly.
-      data->set_data_type(TensorProto::STRING);
-      data->add_dims(1);
-      data->add_string_data(datum.data());
-    } else {
-      // float data not supported right now.
-      CAFFE_ENFORCE_EQ(datum.float_data_size(), 0);
-      char buffer[datum.data().size()];
-      // swap order from CHW to HWC
-      int channels = datum.channels();
-      int size = datum.height() * datum.width();
-      CAFFE_ENFORCE_EQ(datum.data().size(), channels * size);
-      for (int c = 0; c < channels; ++c) {
-        char* dst = buffer + c;
-        const char* src = datum.data().c_str() + c * size;
-        for (int n = 0; n < size; ++n) {
-          dst[n*channels] = src[n];
+  std::vector<std::pair<std::string, std::string>> items;
+  while (cursor->Valid()) {
+    // The cursor is read sequentially, a batch at a time; the conversion of
+    // the batch is split among the threads, and the results are written in
+    // the order they were read.
+    items.clear();
+    const size_t batch_size = caffe2::FLAGS_batch_size;
+    for (; cursor->Valid() && items.size() < batch_size; cursor->Next()) {
+      items.emplace_back(cursor->key(), cursor->value());
+    }
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < caffe2::FLAGS_num_threads; ++i) {
+      threads.emplace_back([&]() {
+        for (size_t j = next++; j < items.size(); j = next++) {
+          items[j].second = ConvertDatum(items[j].second);
         }
-      }
-      data->set_data_type(TensorProto::BYTE);
-      data->add_dims(datum.height());
-      data->add_dims(datum.width());
-      data->add_dims(datum.channels());
-      data->set_byte_data(buffer, datum.data().size());
+      });
     }
-    transaction->Put(cursor->key(), protos.SerializeAsString());
-    if (++count % caffe2::FLAGS_batch_size == 0) {
-      transaction->Commit();
-      LOG(INFO) << "Converted " << count << " items so far.";
+    for (auto& thread : threads) {
+      thread.join();
     }
+    for (const auto& item : items) {
+      transaction->Put(item.first, item.second);
+    }
+    transaction->Commit();
+    count += items.size();
+    LOG(INFO) << "Converted " << count << " items so far.";
   }
   LOG(INFO) << "A total of " << count << " items processed.";
   return 0;
 }
-
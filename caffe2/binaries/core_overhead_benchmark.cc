@@ -2,6 +2,7 @@
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/context_gpu.h"
+#include "caffe2/core/net.h"
 #include "caffe2/core/operator.h"
 
 #define CAFFE2_SKIP_IF_NO_GPU                                      \
@@ -150,4 +151,56 @@ static void BM_OperatorCreationCUDA(benchmark::State& state) {
 }
 BENCHMARK(BM_OperatorCreationCUDA);
 
+// Runs a simple net of many DummyEmpty operators, with per-operator device
+// switches and syncs (range 0), or with batched dispatch (range 1).
+static void RunDummyEmptyNet(benchmark::State& state, DeviceType device_type) {
+  const int kNumOps = 100;
+  NetDef def;
+  Workspace ws;
+  def.mutable_device_option()->set_device_type(device_type);
+  for (int i = 0; i < kNumOps; ++i) {
+    def.add_op()->set_type("DummyEmpty");
+  }
+  auto* arg = def.add_arg();
+  arg->set_name("batched_dispatch");
+  arg->set_i(state.range_x());
+  std::unique_ptr<NetBase> net = CreateNet(def, &ws);
+  while (state.KeepRunning()) {
+    CAFFE_ENFORCE(net->Run());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumOps);
+}
+
+static void BM_SimpleNetDispatchCPU(benchmark::State& state) {
+  RunDummyEmptyNet(state, CPU);
+}
+BENCHMARK(BM_SimpleNetDispatchCPU)->Arg(0)->Arg(1);
+
+static void BM_SimpleNetDispatchCUDA(benchmark::State& state) {
+  CAFFE2_SKIP_IF_NO_GPU;
+  RunDummyEmptyNet(state, CUDA);
+}
+BENCHMARK(BM_SimpleNetDispatchCUDA)->Arg(0)->Arg(1);
+
+// Creates a simple net of many DummyEmpty operators, with the operators on
+// the heap (range 0) or in an arena of the net (range 1).
+static void BM_CreateNet(benchmark::State& state) {
+  const int kNumOps = 1000;
+  NetDef def;
+  Workspace ws;
+  for (int i = 0; i < kNumOps; ++i) {
+    auto* op = def.add_op();
+    op->set_type("DummyEmpty");
+    op->add_output("out" + caffe2::to_string(i));
+  }
+  auto* arg = def.add_arg();
+  arg->set_name("arena");
+  arg->set_i(state.range_x());
+  while (state.KeepRunning()) {
+    CAFFE_ENFORCE(CreateNet(def, &ws));
+  }
+  state.SetItemsProcessed(state.iterations() * kNumOps);
+}
+BENCHMARK(BM_CreateNet)->Arg(0)->Arg(1);
+
 BENCHMARK_MAIN()
@@ -0,0 +1,273 @@
+// Measures the throughput of a whole input pipeline, from the db to the
+// consumer of the batches:
+//
+//   db cursor -> input op (TensorProtosDBInput or ImageInput)
+//             -> EnqueueBlobs -> BlobsQueue -> DequeueBlobs -> consumer
+//
+// Every --report_interval seconds, it prints the items consumed per second,
+// and for every stage how busy its threads were and how long they stalled:
+//
+//   - input: the producer threads running the input op, which waits for the
+//     batch that the op prefetches and decodes in the background;
+//   - enqueue: the producer threads blocked on a full queue;
+//   - dequeue: the consumer threads blocked on an empty queue;
+//   - consume: the consumer threads working on a batch, for --consume_ms.
+//
+// and how full the queue was, sampled every millisecond. A pipeline that keeps
+// up has consumers that rarely stall on dequeue and a queue that is mostly
+// full; raise --decode_threads, --num_producers or --queue_capacity until it
+// does.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_string(input_db, "", "The input db.");
+CAFFE2_DEFINE_string(input_db_type, "lmdb", "The input db type.");
+CAFFE2_DEFINE_string(
+    input_op,
+    "TensorProtosDBInput",
+    "The input operator: TensorProtosDBInput or ImageInput.");
+CAFFE2_DEFINE_int(
+    num_outputs,
+    2,
+    "The number of blobs that the input operator outputs per batch.");
+CAFFE2_DEFINE_int(batch_size, 32, "The number of items per batch.");
+CAFFE2_DEFINE_int(
+    decode_threads,
+    4,
+    "The number of decode threads of every ImageInput operator.");
+CAFFE2_DEFINE_int(scale, 256, "The size ImageInput scales images to.");
+CAFFE2_DEFINE_int(crop, 224, "The size ImageInput crops images to.");
+CAFFE2_DEFINE_int(color, 1, "Whether ImageInput decodes color images.");
+CAFFE2_DEFINE_int(
+    num_producers,
+    1,
+    "The number of producer threads, each with an input operator of its "
+    "own.");
+CAFFE2_DEFINE_int(
+    num_cursors,
+    1,
+    "The number of db cursors shared by the producers, for the db types "
+    "that can be read with several at once.");
+CAFFE2_DEFINE_int(
+    queue_capacity,
+    4,
+    "The number of batches the queue holds, i.e. the prefetch depth.");
+CAFFE2_DEFINE_int(num_consumers, 1, "The number of consumer threads.");
+CAFFE2_DEFINE_double(
+    consume_ms,
+    0,
+    "The time every consumer spends on a batch, standing in for the model.");
+CAFFE2_DEFINE_int(seconds, 30, "How long to run the pipeline for.");
+CAFFE2_DEFINE_int(report_interval, 5, "The report interval, in seconds.");
+
+namespace caffe2 {
+namespace {
+
+// Nanoseconds spent by the threads of a stage, and the batches they are done
+// with.
+struct StageStats {
+  std::atomic<uint64_t> busy_ns{0};
+  std::atomic<uint64_t> stall_ns{0};
+  std::atomic<uint64_t> batches{0};
+};
+
+struct PipelineStats {
+  StageStats producers;
+  StageStats consumers;
+  // Batches in the queue, as far as the producers and consumers are done with
+  // them.
+  std::atomic<int64_t> queued{0};
+  std::atomic<uint64_t> occupancy_samples{0};
+  std::atomic<uint64_t> occupancy_sum{0};
+  std::atomic<uint64_t> full_samples{0};
+  std::atomic<uint64_t> empty_samples{0};
+};
+
+uint64_t Elapsed(Timer* timer) {
+  const uint64_t ns = timer->NanoSeconds();
+  timer->Start();
+  return ns;
+}
+
+vector<string> BatchBlobs() {
+  vector<string> blobs;
+  for (int i = 0; i < FLAGS_num_outputs; ++i) {
+    blobs.push_back("batch_" + caffe2::to_string(i));
+  }
+  return blobs;
+}
+
+OperatorDef InputOpDef() {
+  vector<Argument> args = {MakeArgument<int>("batch_size", FLAGS_batch_size)};
+  if (FLAGS_input_op == "ImageInput") {
+    args.push_back(MakeArgument<int>("decode_threads", FLAGS_decode_threads));
+    args.push_back(MakeArgument<int>("scale", FLAGS_scale));
+    args.push_back(MakeArgument<int>("crop", FLAGS_crop));
+    args.push_back(MakeArgument<int>("color", FLAGS_color));
+    args.push_back(MakeArgument<int>("is_test", 1));
+  }
+  return CreateOperatorDef(
+      FLAGS_input_op, "", vector<string>{"db"}, BatchBlobs(), args);
+}
+
+void Produce(Workspace* parent, PipelineStats* stats) {
+  Workspace ws(parent);
+  auto input = CreateOperator(InputOpDef(), &ws);
+  vector<string> enqueue_inputs = {"queue"};
+  const auto blobs = BatchBlobs();
+  enqueue_inputs.insert(enqueue_inputs.end(), blobs.begin(), blobs.end());
+  auto enqueue = CreateOperator(
+      CreateOperatorDef("EnqueueBlobs", "", enqueue_inputs, blobs), &ws);
+  Timer timer;
+  while (true) {
+    if (!input->Run()) {
+      LOG(ERROR) << "The input operator failed.";
+      return;
+    }
+    stats->producers.busy_ns += Elapsed(&timer);
+    // Fails once the queue is closed.
+    if (!enqueue->Run()) {
+      return;
+    }
+    ++stats->queued;
+    stats->producers.stall_ns += Elapsed(&timer);
+  }
+}
+
+void Consume(Workspace* parent, PipelineStats* stats) {
+  Workspace ws(parent);
+  auto dequeue = CreateOperator(
+      CreateOperatorDef(
+          "DequeueBlobs", "", vector<string>{"queue"}, BatchBlobs()),
+      &ws);
+  const auto consume_time = std::chrono::microseconds(
+      static_cast<int64_t>(FLAGS_consume_ms * 1000));
+  Timer timer;
+  while (true) {
+    if (!dequeue->Run()) {
+      return;
+    }
+    --stats->queued;
+    stats->consumers.stall_ns += Elapsed(&timer);
+    if (consume_time.count() > 0) {
+      std::this_thread::sleep_for(consume_time);
+    }
+    stats->consumers.busy_ns += Elapsed(&timer);
+    ++stats->consumers.batches;
+  }
+}
+
+void SampleOccupancy(std::atomic<bool>* done, PipelineStats* stats) {
+  while (!*done) {
+    const int64_t queued =
+        std::max<int64_t>(0, std::min<int64_t>(
+                                 stats->queued, FLAGS_queue_capacity));
+    stats->occupancy_sum += queued;
+    ++stats->occupancy_samples;
+    if (queued == FLAGS_queue_capacity) {
+      ++stats->full_samples;
+    } else if (queued == 0) {
+      ++stats->empty_samples;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+template <typename T>
+T Exchange(std::atomic<T>* value) {
+  return value->exchange(0);
+}
+
+void Report(double seconds, PipelineStats* stats) {
+  const double producer_ns = 1e9 * seconds * FLAGS_num_producers;
+  const double consumer_ns = 1e9 * seconds * FLAGS_num_consumers;
+  const uint64_t batches = Exchange(&stats->consumers.batches);
+  const uint64_t samples = std::max<uint64_t>(
+      1, Exchange(&stats->occupancy_samples));
+  printf(
+      "%8.1f items/s | input %5.1f%% busy | enqueue %5.1f%% stalled | "
+      "dequeue %5.1f%% stalled | consume %5.1f%% busy | queue %4.2f/%d "
+      "batches, %5.1f%% full, %5.1f%% empty\n",
+      batches * FLAGS_batch_size / seconds,
+      100 * Exchange(&stats->producers.busy_ns) / producer_ns,
+      100 * Exchange(&stats->producers.stall_ns) / producer_ns,
+      100 * Exchange(&stats->consumers.stall_ns) / consumer_ns,
+      100 * Exchange(&stats->consumers.busy_ns) / consumer_ns,
+      static_cast<double>(Exchange(&stats->occupancy_sum)) / samples,
+      FLAGS_queue_capacity,
+      100.0 * Exchange(&stats->full_samples) / samples,
+      100.0 * Exchange(&stats->empty_samples) / samples);
+  fflush(stdout);
+}
+
+void RunPipeline() {
+  CAFFE_ENFORCE(!FLAGS_input_db.empty(), "--input_db is required.");
+  CAFFE_ENFORCE_GT(FLAGS_num_producers, 0);
+  CAFFE_ENFORCE_GT(FLAGS_num_consumers, 0);
+  CAFFE_ENFORCE_GT(FLAGS_report_interval, 0);
+  Workspace ws;
+  CAFFE_ENFORCE(ws.RunOperatorOnce(CreateOperatorDef(
+      "CreateDB",
+      "",
+      vector<string>{},
+      vector<string>{"db"},
+      vector<Argument>{
+          MakeArgument<string>("db", FLAGS_input_db),
+          MakeArgument<string>("db_type", FLAGS_input_db_type),
+          MakeArgument<int>("num_cursors", FLAGS_num_cursors)})));
+  CAFFE_ENFORCE(ws.RunOperatorOnce(CreateOperatorDef(
+      "CreateBlobsQueue",
+      "",
+      vector<string>{},
+      vector<string>{"queue"},
+      vector<Argument>{MakeArgument<int>("capacity", FLAGS_queue_capacity),
+                       MakeArgument<int>("num_blobs", FLAGS_num_outputs)})));
+
+  PipelineStats stats;
+  std::atomic<bool> done{false};
+  vector<std::thread> threads;
+  for (int i = 0; i < FLAGS_num_producers; ++i) {
+    threads.emplace_back(Produce, &ws, &stats);
+  }
+  for (int i = 0; i < FLAGS_num_consumers; ++i) {
+    threads.emplace_back(Consume, &ws, &stats);
+  }
+  std::thread sampler(SampleOccupancy, &done, &stats);
+
+  Timer total;
+  Timer interval;
+  while (total.Seconds() < FLAGS_seconds) {
+    std::this_thread::sleep_for(std::chrono::seconds(
+        std::min<int>(FLAGS_report_interval, FLAGS_seconds)));
+    Report(interval.Seconds(), &stats);
+    interval.Start();
+  }
+
+  done = true;
+  CAFFE_ENFORCE(ws.RunOperatorOnce(CreateOperatorDef(
+      "CloseBlobsQueue", "", vector<string>{"queue"}, vector<string>{})));
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  sampler.join();
+}
+
+} // namespace
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  caffe2::RunPipeline();
+  return 0;
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdio>
 #include <thread>
 #include <vector>
@@ -6,6 +7,7 @@
 #include "caffe2/core/init.h"
 #include "caffe2/core/timer.h"
 #include "caffe2/core/logging.h"
+#include "caffe2/utils/string_utils.h"
 
 CAFFE2_DEFINE_string(input_db, "", "The input db.");
 CAFFE2_DEFINE_string(input_db_type, "", "The input db type.");
@@ -14,52 +16,109 @@ CAFFE2_DEFINE_int(repeat, 10, "The number to repeat the throughput test.");
 CAFFE2_DEFINE_bool(use_reader, false, "If true, use the reader interface.");
 CAFFE2_DEFINE_int(num_read_threads, 1,
                    "The number of concurrent reading threads.");
+CAFFE2_DEFINE_int(batch_size, 0,
+                  "If positive, read batches of this many items at once.");
+CAFFE2_DEFINE_int(num_cursors, 1,
+                  "The number of cursors of the reader.");
+CAFFE2_DEFINE_string(output_db, "",
+                     "If set, the input db is first copied to a new db of the "
+                     "same type, which is then read, to time the writes, e.g. "
+                     "with --caffe2_rocksdb_bulk_load.");
+CAFFE2_DEFINE_int(commit_interval, 1000,
+                  "The number of records of each commit to the output db.");
+CAFFE2_DEFINE_string(queue_depths, "",
+                     "If set, a comma separated list of the recorddb queue "
+                     "depths to repeat the throughput test with.");
+
+CAFFE2_DECLARE_int(caffe2_recorddb_queue_depth);
 
 using caffe2::db::Cursor;
 using caffe2::db::DB;
 using caffe2::db::DBReader;
+using caffe2::db::StringView;
 using caffe2::string;
+using caffe2::vector;
 
 void TestThroughputWithDB() {
   std::unique_ptr<DB> in_db(caffe2::db::CreateDB(
       caffe2::FLAGS_input_db_type, caffe2::FLAGS_input_db, caffe2::db::READ));
   std::unique_ptr<Cursor> cursor(in_db->NewCursor());
+  vector<StringView> keys, values;
   for (int iter_id = 0; iter_id < caffe2::FLAGS_repeat; ++iter_id) {
     caffe2::Timer timer;
-    for (int i = 0; i < caffe2::FLAGS_report_interval; ++i) {
-      string key = cursor->key();
-      string value = cursor->value();
-      //VLOG(1) << "Key " << key;
-      cursor->Next();
-      if (!cursor->Valid()) {
-        cursor->SeekToFirst();
+    size_t num_bytes = 0;
+    if (caffe2::FLAGS_batch_size > 0) {
+      for (int i = 0; i < caffe2::FLAGS_report_interval;) {
+        const size_t n = cursor->NextBatch(
+            std::min(
+                caffe2::FLAGS_batch_size, caffe2::FLAGS_report_interval - i),
+            &keys,
+            &values);
+        for (size_t j = 0; j < n; ++j) {
+          num_bytes += keys[j].size + values[j].size;
+        }
+        i += n;
+        if (!cursor->Valid()) {
+          cursor->SeekToFirst();
+        }
+      }
+    } else {
+      for (int i = 0; i < caffe2::FLAGS_report_interval; ++i) {
+        string key = cursor->key();
+        string value = cursor->value();
+        num_bytes += key.size() + value.size();
+        //VLOG(1) << "Key " << key;
+        cursor->Next();
+        if (!cursor->Valid()) {
+          cursor->SeekToFirst();
+        }
       }
     }
     double elapsed_seconds = timer.Seconds();
-    printf("Iteration %03d, took %4.5f seconds, throughput %f items/sec.\n",
+    printf("Iteration %03d, took %4.5f seconds, throughput %f items/sec, "
+           "%f MB/sec.\n",
            iter_id, elapsed_seconds,
-           caffe2::FLAGS_report_interval / elapsed_seconds);
+           caffe2::FLAGS_report_interval / elapsed_seconds,
+           num_bytes / elapsed_seconds / (1 << 20));
   }
 }
 
 void TestThroughputWithReaderWorker(const DBReader* reader, int thread_id) {
   string key, value;
+  vector<string> values;
   for (int iter_id = 0; iter_id < caffe2::FLAGS_repeat; ++iter_id) {
     caffe2::Timer timer;
-    for (int i = 0; i < caffe2::FLAGS_report_interval; ++i) {
-      reader->Read(&key, &value);
+    size_t num_bytes = 0;
+    if (caffe2::FLAGS_batch_size > 0) {
+      for (int i = 0; i < caffe2::FLAGS_report_interval;
+           i += caffe2::FLAGS_batch_size) {
+        reader->ReadBatch(caffe2::FLAGS_batch_size, nullptr, &values);
+        for (const string& v : values) {
+          num_bytes += v.size();
+        }
+      }
+    } else {
+      for (int i = 0; i < caffe2::FLAGS_report_interval; ++i) {
+        reader->Read(&key, &value);
+        num_bytes += key.size() + value.size();
+      }
     }
     double elapsed_seconds = timer.Seconds();
     printf("Thread %03d iteration %03d, took %4.5f seconds, "
-           "throughput %f items/sec.\n",
+           "throughput %f items/sec, %f MB/sec.\n",
            thread_id, iter_id, elapsed_seconds,
-           caffe2::FLAGS_report_interval / elapsed_seconds);
+           caffe2::FLAGS_report_interval / elapsed_seconds,
+           num_bytes / elapsed_seconds / (1 << 20));
   }
 }
 
 void TestThroughputWithReader() {
   caffe2::db::DBReader reader(
-      caffe2::FLAGS_input_db_type, caffe2::FLAGS_input_db);
+      caffe2::FLAGS_input_db_type,
+      caffe2::FLAGS_input_db,
+      1,
+      0,
+      caffe2::FLAGS_num_cursors);
   std::vector<std::unique_ptr<std::thread>> reading_threads(
       caffe2::FLAGS_num_read_threads);
   for (int i = 0; i < reading_threads.size(); ++i) {
@@ -71,12 +130,59 @@ void TestThroughputWithReader() {
   }
 }
 
-int main(int argc, char** argv) {
-  caffe2::GlobalInit(&argc, &argv);
+void TestWriteThroughput() {
+  std::unique_ptr<DB> in_db(caffe2::db::CreateDB(
+      caffe2::FLAGS_input_db_type, caffe2::FLAGS_input_db, caffe2::db::READ));
+  std::unique_ptr<DB> out_db(caffe2::db::CreateDB(
+      caffe2::FLAGS_input_db_type, caffe2::FLAGS_output_db, caffe2::db::NEW));
+  std::unique_ptr<Cursor> cursor(in_db->NewCursor());
+  caffe2::Timer timer;
+  size_t num_records = 0;
+  size_t num_bytes = 0;
+  {
+    std::unique_ptr<caffe2::db::Transaction> transaction(
+        out_db->NewTransaction());
+    for (; cursor->Valid(); cursor->Next()) {
+      string key = cursor->key();
+      string value = cursor->value();
+      num_bytes += key.size() + value.size();
+      transaction->Put(key, value);
+      if (++num_records % caffe2::FLAGS_commit_interval == 0) {
+        transaction->Commit();
+      }
+    }
+    // The transaction commits the rest when it is destroyed.
+  }
+  out_db->Close();
+  double elapsed_seconds = timer.Seconds();
+  printf("Wrote %zu items in %4.5f seconds, throughput %f items/sec, "
+         "%f MB/sec.\n",
+         num_records, elapsed_seconds, num_records / elapsed_seconds,
+         num_bytes / elapsed_seconds / (1 << 20));
+}
+
+void TestThroughput() {
   if (caffe2::FLAGS_use_reader) {
     TestThroughputWithReader();
   } else {
     TestThroughputWithDB();
   }
+}
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  if (!caffe2::FLAGS_output_db.empty()) {
+    TestWriteThroughput();
+    caffe2::FLAGS_input_db = caffe2::FLAGS_output_db;
+  }
+  if (caffe2::FLAGS_queue_depths.empty()) {
+    TestThroughput();
+    return 0;
+  }
+  for (const string& depth : caffe2::split(',', caffe2::FLAGS_queue_depths)) {
+    caffe2::FLAGS_caffe2_recorddb_queue_depth = std::stoi(depth);
+    printf("Queue depth %d:\n", caffe2::FLAGS_caffe2_recorddb_queue_depth);
+    TestThroughput();
+  }
   return 0;
 }
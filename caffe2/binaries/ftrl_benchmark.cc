@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_int64(rows, 1000000, "The number of rows of the weights.");
+CAFFE2_DEFINE_int64(batch, 200000, "The number of ids per batch.");
+CAFFE2_DEFINE_int(repeat, 3, "The number of times to repeat each test.");
+
+using caffe2::string;
+using caffe2::TensorCPU;
+
+namespace {
+
+const float kAlpha = 0.005, kBeta = 1, kLambda1 = 0.001, kLambda2 = 0.001;
+
+// The scalar loop SparseFtrl ran before, kept as the baseline.
+void ScalarSparseFtrl(
+    const std::vector<int64_t>& ids,
+    const float* g,
+    int block,
+    float* w,
+    float* nz) {
+  const float alpha_inv = 1 / kAlpha;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    for (int k = 0; k < block; ++k) {
+      const int64_t x = ids[i] * block + k;
+      const float gi = g[i * block + k];
+      const float n = nz[x * 2], z = nz[x * 2 + 1];
+      const float new_n = n + gi * gi;
+      const float sigma = (std::sqrt(new_n) - std::sqrt(n)) * alpha_inv;
+      const float new_z = z + gi - sigma * w[x];
+      nz[x * 2] = new_n;
+      nz[x * 2 + 1] = new_z;
+      if (std::abs(new_z) > kLambda1) {
+        w[x] = (kLambda1 * (new_z < 0 ? -1 : 1) - new_z) /
+            ((kBeta + std::sqrt(new_n)) * alpha_inv + kLambda2);
+      } else {
+        w[x] = 0;
+      }
+    }
+  }
+}
+
+// Ids of an online logistic regression batch: a power law with exponent 1.1
+// over the rows, so that the popular features repeat within a batch.
+std::vector<int64_t> MakeIds(int64_t n, int64_t rows) {
+  std::mt19937_64 gen(1);
+  std::uniform_real_distribution<double> u(0, 1);
+  std::vector<int64_t> ids(n);
+  for (auto& id : ids) {
+    const double x = std::pow(1 - u(gen), -1 / 0.1);
+    id = static_cast<int64_t>(std::min(x, 1e18)) % rows;
+  }
+  return ids;
+}
+
+void Fill(caffe2::Workspace* ws, const string& name, std::vector<int> dims) {
+  std::mt19937 gen(2);
+  std::uniform_real_distribution<float> u(0, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  float* data = tensor->mutable_data<float>();
+  for (int64_t i = 0; i < tensor->size(); ++i) {
+    data[i] = u(gen);
+  }
+}
+
+void Benchmark(int block) {
+  const int64_t rows = caffe2::FLAGS_rows / block;
+  const auto ids = MakeIds(caffe2::FLAGS_batch, rows);
+  caffe2::Workspace ws;
+  Fill(&ws, "var", {static_cast<int>(rows), block});
+  Fill(&ws, "nz", {static_cast<int>(rows), block, 2});
+  Fill(&ws, "grad", {static_cast<int>(ids.size()), block});
+  auto* indices = ws.CreateBlob("indices")->GetMutable<TensorCPU>();
+  indices->Resize(ids.size());
+  std::copy(ids.begin(), ids.end(), indices->mutable_data<int64_t>());
+  const float* g = ws.GetBlob("grad")->Get<TensorCPU>().data<float>();
+  const auto& var = ws.GetBlob("var")->Get<TensorCPU>();
+  const auto& n_z = ws.GetBlob("nz")->Get<TensorCPU>();
+  std::vector<float> w(var.data<float>(), var.data<float>() + var.size());
+  std::vector<float> nz(n_z.data<float>(), n_z.data<float>() + n_z.size());
+
+  std::vector<std::unique_ptr<caffe2::OperatorBase>> ops;
+  for (int hogwild = 0; hogwild < 2; ++hogwild) {
+    ops.push_back(caffe2::CreateOperator(
+        caffe2::CreateOperatorDef(
+            "SparseFtrl",
+            "",
+            std::vector<string>{"var", "nz", "indices", "grad"},
+            std::vector<string>{"var", "nz"},
+            std::vector<caffe2::Argument>{
+                caffe2::MakeArgument<float>("alpha", kAlpha),
+                caffe2::MakeArgument<int>("hogwild", hogwild)}),
+        &ws));
+  }
+
+  for (int iter = 0; iter < caffe2::FLAGS_repeat; ++iter) {
+    caffe2::Timer timer;
+    ScalarSparseFtrl(ids, g, block, w.data(), nz.data());
+    const double scalar_seconds = timer.Seconds();
+    timer.Start();
+    CAFFE_ENFORCE(ops[0]->Run());
+    const double ordered_seconds = timer.Seconds();
+    timer.Start();
+    CAFFE_ENFORCE(ops[1]->Run());
+    const double hogwild_seconds = timer.Seconds();
+    printf(
+        "block %3d %d: scalar %7.4f s, SparseFtrl %7.4f s, hogwild %7.4f s\n",
+        block,
+        iter,
+        scalar_seconds,
+        ordered_seconds,
+        hogwild_seconds);
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  Benchmark(1);
+  Benchmark(16);
+  Benchmark(64);
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include <set>
+
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/flags.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/operators/int8_calibration.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_string(init_net, "", "The given path to the init protobuffer.");
+CAFFE2_DEFINE_string(
+    predict_net,
+    "",
+    "The given path to the predict protobuffer.");
+CAFFE2_DEFINE_string(
+    inputs,
+    "",
+    "The given path to a TensorProtos protobuffer of calibration inputs. Each "
+    "tensor is fed to the blob of its name, and the predict net runs once per "
+    "group of as many tensors as there are distinct names. If empty, the "
+    "predict net runs once on the inputs created by the init net.");
+CAFFE2_DEFINE_string(
+    output,
+    "",
+    "The path to write the quantized predict protobuffer to.");
+
+namespace caffe2 {
+
+void run() {
+  if (FLAGS_init_net.empty()) {
+    LOG(FATAL) << "No init net specified. Use --init_net=/path/to/net.";
+  }
+  if (FLAGS_predict_net.empty()) {
+    LOG(FATAL) << "No predict net specified. Use --predict_net=/path/to/net.";
+  }
+  if (FLAGS_output.empty()) {
+    LOG(FATAL) << "No output specified. Use --output=/path/to/net.";
+  }
+  caffe2::NetDef init_net, predict_net;
+  CAFFE_ENFORCE(ReadProtoFromFile(FLAGS_init_net, &init_net));
+  CAFFE_ENFORCE(ReadProtoFromFile(FLAGS_predict_net, &predict_net));
+  // Can be large due to constant fills
+  VLOG(1) << "Init net: " << ProtoDebugString(init_net);
+  LOG(INFO) << "Predict net: " << ProtoDebugString(predict_net);
+
+  Workspace ws;
+  CAFFE_ENFORCE(ws.RunNetOnce(init_net));
+  Int8Calibrator calibrator(predict_net, &ws);
+  if (FLAGS_inputs.empty()) {
+    LOG(INFO) << "Calibrating on a null forward-pass";
+    CAFFE_ENFORCE(calibrator.RunAndObserve());
+  } else {
+    TensorProtos inputs;
+    CAFFE_ENFORCE(ReadProtoFromFile(FLAGS_inputs, &inputs));
+    std::set<string> names;
+    for (const auto& input : inputs.protos()) {
+      names.insert(input.name());
+    }
+    CAFFE_ENFORCE_GT(inputs.protos_size(), 0);
+    CAFFE_ENFORCE_EQ(
+        inputs.protos_size() % names.size(),
+        0,
+        "Each sample must feed all of the ",
+        names.size(),
+        " inputs.");
+    TensorDeserializer<CPUContext> deserializer;
+    for (int i = 0; i < inputs.protos_size(); ++i) {
+      const auto& input = inputs.protos(i);
+      deserializer.Deserialize(
+          input, ws.CreateBlob(input.name())->GetMutable<TensorCPU>());
+      if ((i + 1) % names.size() == 0) {
+        CAFFE_ENFORCE(calibrator.RunAndObserve());
+      }
+    }
+    LOG(INFO) << "Calibrated on " << inputs.protos_size() / names.size()
+              << " samples";
+  }
+  const auto quantized = calibrator.QuantizedNet();
+  LOG(INFO) << "Quantized predict net: " << ProtoDebugString(quantized);
+  WriteProtoToBinaryFile(quantized, FLAGS_output);
+}
+}
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  caffe2::run();
+  // This is to allow us to use memory leak checks.
+  google::protobuf::ShutdownProtobufLibrary();
+  return 0;
+}
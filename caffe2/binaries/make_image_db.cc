@@ -9,9 +9,12 @@
 #include <opencv2/opencv.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <fstream>  // NOLINT(readability/streams)
 #include <random>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "caffe2/core/common.h"
 #include "caffe2/core/db.h"
@@ -32,10 +35,73 @@ CAFFE2_DEFINE_int(scale, 256,
     "If caffe2::FLAGS_raw is set, scale all the images' shorter edge to the given "
     "value.");
 CAFFE2_DEFINE_bool(warp, false, "If warp is set, warp the images to square.");
+CAFFE2_DEFINE_int(shuffle_seed, 1701, "The seed that the shuffle uses.");
+CAFFE2_DEFINE_int(num_threads, 4,
+    "The number of threads that read and encode the images.");
+CAFFE2_DEFINE_int(batch_size, 1000,
+    "The number of images encoded in parallel and committed together.");
 
 
 namespace caffe2 {
 
+// Reads an image and returns the serialized TensorProtos of it and its label,
+// or an empty string if the image cannot be read.
+string EncodeImage(
+    const string& input_folder,
+    const std::pair<std::string, int>& line) {
+  TensorProtos protos;
+  TensorProto* data = protos.add_protos();
+  TensorProto* label = protos.add_protos();
+  label->set_data_type(TensorProto::INT32);
+  label->add_dims(1);
+  label->add_int32_data(line.second);
+  if (!caffe2::FLAGS_raw) {
+    std::ifstream image_file_stream(input_folder + line.first);
+    if (!image_file_stream) {
+      return "";
+    }
+    data->set_data_type(TensorProto::STRING);
+    data->add_dims(1);
+    data->add_string_data(string(
+        (std::istreambuf_iterator<char>(image_file_stream)),
+        std::istreambuf_iterator<char>()));
+  } else {
+    // Need to do some opencv magic.
+    cv::Mat img = cv::imread(
+        input_folder + line.first,
+        caffe2::FLAGS_color ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+    if (img.empty()) {
+      return "";
+    }
+    // Do resizing.
+    cv::Mat resized_img;
+    int scaled_width, scaled_height;
+    if (caffe2::FLAGS_warp) {
+      scaled_width = caffe2::FLAGS_scale;
+      scaled_height = caffe2::FLAGS_scale;
+    } else if (img.rows > img.cols) {
+      scaled_width = caffe2::FLAGS_scale;
+      scaled_height = static_cast<float>(img.rows) * caffe2::FLAGS_scale / img.cols;
+    } else {
+      scaled_height = caffe2::FLAGS_scale;
+      scaled_width = static_cast<float>(img.cols) * caffe2::FLAGS_scale / img.rows;
+    }
+    cv::resize(img, resized_img, cv::Size(scaled_width, scaled_height), 0, 0,
+                 cv::INTER_LINEAR);
+    data->set_data_type(TensorProto::BYTE);
+    data->add_dims(scaled_height);
+    data->add_dims(scaled_width);
+    if (caffe2::FLAGS_color) {
+      data->add_dims(3);
+    }
+    DCHECK(resized_img.isContinuous());
+    data->set_byte_data(
+        resized_img.ptr(),
+        scaled_height * scaled_width * (caffe2::FLAGS_color ? 3 : 1));
+  }
+  return protos.SerializeAsString();
+}
+
 void ConvertImageDataset(
     const string& input_folder, const string& list_filename,
     const string& output_db_name, const bool shuffle) {
@@ -50,89 +116,56 @@ void ConvertImageDataset(
     // randomly shuffle data
     LOG(INFO) << "Shuffling data";
     std::shuffle(lines.begin(), lines.end(),
-                 std::default_random_engine(1701));
+                 std::default_random_engine(caffe2::FLAGS_shuffle_seed));
   }
   LOG(INFO) << "A total of " << lines.size() << " images.";
+  CAFFE_ENFORCE_GT(caffe2::FLAGS_num_threads, 0);
+  CAFFE_ENFORCE_GT(caffe2::FLAGS_batch_size, 0);
 
 
   LOG(INFO) << "Opening db " << output_db_name;
   std::unique_ptr<db::DB> db(db::CreateDB(caffe2::FLAGS_db, output_db_name, db::NEW));
   std::unique_ptr<db::Transaction> transaction(db->NewTransaction());
 
-  TensorProtos protos;
-  TensorProto* data = protos.add_protos();
-  TensorProto* label = protos.add_protos();
-  if (caffe2::FLAGS_raw) {
-    data->set_data_type(TensorProto::BYTE);
-    data->add_dims(0);
-    data->add_dims(0);
-    if (caffe2::FLAGS_color) {
-      data->add_dims(3);
-    }
-  } else {
-    data->set_data_type(TensorProto::STRING);
-    data->add_dims(1);
-    data->add_string_data("");
-  }
-  label->set_data_type(TensorProto::INT32);
-  label->add_dims(1);
-  label->add_int32_data(0);
   const int kMaxKeyLength = 256;
   char key_cstr[kMaxKeyLength];
-  string value;
+  std::vector<string> values(caffe2::FLAGS_batch_size);
   int count = 0;
 
-  for (int item_id = 0; item_id < lines.size(); ++item_id) {
-    // First, set label.
-    label->set_int32_data(0, lines[item_id].second);
-    if (!caffe2::FLAGS_raw) {
-      // Second, read images.
-      std::ifstream image_file_stream(input_folder + lines[item_id].first);
-      if (!image_file_stream) {
+  for (size_t begin = 0; begin < lines.size();
+       begin += caffe2::FLAGS_batch_size) {
+    const size_t end =
+        std::min(lines.size(), begin + caffe2::FLAGS_batch_size);
+    // The images of a batch are read and encoded by all the threads, and
+    // then written in order, so the db is the same for any number of
+    // threads.
+    std::atomic<size_t> next(begin);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < caffe2::FLAGS_num_threads; ++i) {
+      threads.emplace_back([&]() {
+        for (size_t item_id = next++; item_id < end; item_id = next++) {
+          values[item_id - begin] = EncodeImage(input_folder, lines[item_id]);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    for (size_t item_id = begin; item_id < end; ++item_id) {
+      if (values[item_id - begin].empty()) {
         LOG(ERROR) << "Cannot open " << input_folder << lines[item_id].first
                    << ". Skipping.";
-      } else {
-        data->mutable_string_data(0)->assign(
-            (std::istreambuf_iterator<char>(image_file_stream)),
-            std::istreambuf_iterator<char>());
-      }
-    } else {
-      // Need to do some opencv magic.
-      cv::Mat img = cv::imread(
-          input_folder + lines[item_id].first,
-          caffe2::FLAGS_color ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
-      // Do resizing.
-      cv::Mat resized_img;
-      int scaled_width, scaled_height;
-      if (caffe2::FLAGS_warp) {
-        scaled_width = caffe2::FLAGS_scale;
-        scaled_height = caffe2::FLAGS_scale;
-      } else if (img.rows > img.cols) {
-        scaled_width = caffe2::FLAGS_scale;
-        scaled_height = static_cast<float>(img.rows) * caffe2::FLAGS_scale / img.cols;
-      } else {
-        scaled_height = caffe2::FLAGS_scale;
-        scaled_width = static_cast<float>(img.cols) * caffe2::FLAGS_scale / img.rows;
+        continue;
       }
-      cv::resize(img, resized_img, cv::Size(scaled_width, scaled_height), 0, 0,
-                   cv::INTER_LINEAR);
-      data->set_dims(0, scaled_height);
-      data->set_dims(1, scaled_width);
-      DCHECK(resized_img.isContinuous());
-      data->set_byte_data(
-          resized_img.ptr(),
-          scaled_height * scaled_width * (caffe2::FLAGS_color ? 3 : 1));
-    }
-    snprintf(key_cstr, kMaxKeyLength, "%08d_%s", item_id,
-             lines[item_id].first.c_str());
-    protos.SerializeToString(&value);
-    // Put in db
-    transaction->Put(string(key_cstr), value);
-    if (++count % 1000 == 0) {
-      // Commit the current writes.
-      transaction->Commit();
-      LOG(INFO) << "Processed " << count << " files.";
+      snprintf(key_cstr, kMaxKeyLength, "%08d_%s", static_cast<int>(item_id),
+               lines[item_id].first.c_str());
+      // Put in db
+      transaction->Put(string(key_cstr), values[item_id - begin]);
+      ++count;
     }
+    // Commit the current writes.
+    transaction->Commit();
+    LOG(INFO) << "Processed " << count << " files.";
   }
   LOG(INFO) << "Processed a total of " << count << " files.";
 }
@@ -0,0 +1,165 @@
+#include <mpi.h>
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/mpi/mpi_compression.h"
+#include "caffe2/utils/string_utils.h"
+
+CAFFE2_DEFINE_string(
+    compression,
+    "none,fp16,topk,1bit",
+    "The comma separated compressions to compare.");
+CAFFE2_DEFINE_int(dim, 10000, "The number of parameters of the model.");
+CAFFE2_DEFINE_int(examples, 200, "The number of examples on each node.");
+CAFFE2_DEFINE_int(iters, 500, "The number of SGD iterations.");
+CAFFE2_DEFINE_int(report_every, 50, "How often to print the loss.");
+CAFFE2_DEFINE_double(lr, 0.5, "The learning rate.");
+CAFFE2_DEFINE_double(
+    topk_ratio,
+    0.01,
+    "The fraction of the gradient that topk sends.");
+
+using caffe2::MPICompression;
+using caffe2::string;
+using std::vector;
+
+// Each node holds a slice of a least squares problem with sparse examples.
+// The nodes run synchronous SGD on it, summing their gradients with the
+// given compression, and the benchmark prints the loss against the bytes
+// that each node sent so far.
+struct Problem {
+  // Example e has the features index[e * kNonZeros + j] with the values
+  // value[e * kNonZeros + j].
+  static constexpr int kNonZeros = 20;
+  vector<int> index;
+  vector<float> value;
+  vector<float> target;
+};
+
+Problem MakeProblem(int rank) {
+  const int dim = caffe2::FLAGS_dim;
+  // The solution is the same on all nodes, the examples are not.
+  std::mt19937 solution_gen(0);
+  std::normal_distribution<float> normal;
+  vector<float> solution(dim);
+  for (auto& w : solution) {
+    w = normal(solution_gen);
+  }
+  std::mt19937 gen(rank + 1);
+  std::uniform_int_distribution<int> feature(0, dim - 1);
+  Problem problem;
+  for (int e = 0; e < caffe2::FLAGS_examples; ++e) {
+    float target = 0;
+    for (int j = 0; j < Problem::kNonZeros; ++j) {
+      const int i = feature(gen);
+      const float v = normal(gen) / std::sqrt(float(Problem::kNonZeros));
+      problem.index.push_back(i);
+      problem.value.push_back(v);
+      target += v * solution[i];
+    }
+    problem.target.push_back(target);
+  }
+  return problem;
+}
+
+// Returns the loss on the examples of this node and sets grad to its
+// gradient.
+double LossAndGradient(
+    const Problem& problem,
+    const vector<float>& w,
+    vector<float>* grad) {
+  std::fill(grad->begin(), grad->end(), 0.f);
+  double loss = 0;
+  const int examples = problem.target.size();
+  for (int e = 0; e < examples; ++e) {
+    const int* index = problem.index.data() + e * Problem::kNonZeros;
+    const float* value = problem.value.data() + e * Problem::kNonZeros;
+    float error = -problem.target[e];
+    for (int j = 0; j < Problem::kNonZeros; ++j) {
+      error += value[j] * w[index[j]];
+    }
+    loss += 0.5 * error * error / examples;
+    for (int j = 0; j < Problem::kNonZeros; ++j) {
+      (*grad)[index[j]] += error * value[j] / examples;
+    }
+  }
+  return loss;
+}
+
+void Train(const Problem& problem, const string& name, int size) {
+  const int dim = caffe2::FLAGS_dim;
+  const MPICompression compression = caffe2::ParseMPICompression(name);
+  const int k = std::max<int>(1, std::ceil(caffe2::FLAGS_topk_ratio * dim));
+  vector<float> w(dim, 0.f);
+  vector<float> grad(dim);
+  vector<float> residual(dim, 0.f);
+  size_t bytes_sent = 0;
+  for (int iter = 0; iter <= caffe2::FLAGS_iters; ++iter) {
+    double loss = LossAndGradient(problem, w, &grad);
+    if (iter % caffe2::FLAGS_report_every == 0 ||
+        iter == caffe2::FLAGS_iters) {
+      MPI_Allreduce(
+          MPI_IN_PLACE, &loss, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+      int rank;
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+      if (rank == 0) {
+        printf(
+            "%-6s iter %6d: loss %12.6f, %12zu bytes sent per node\n",
+            name.c_str(),
+            iter,
+            loss / size,
+            bytes_sent);
+      }
+    }
+    if (iter == caffe2::FLAGS_iters) {
+      break;
+    }
+    switch (compression) {
+      case MPICompression::NONE:
+        MPI_Allreduce(
+            MPI_IN_PLACE, grad.data(), dim, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+        bytes_sent += dim * sizeof(float);
+        break;
+      case MPICompression::FP16:
+        bytes_sent += caffe2::Fp16Allreduce(
+            grad.data(), grad.data(), dim, MPI_COMM_WORLD);
+        break;
+      case MPICompression::TOP_K:
+        bytes_sent += caffe2::TopKAllreduce(
+            grad.data(), grad.data(), dim, k, residual.data(), MPI_COMM_WORLD);
+        break;
+      case MPICompression::ONE_BIT:
+        bytes_sent += caffe2::OneBitAllreduce(
+            grad.data(), grad.data(), dim, residual.data(), MPI_COMM_WORLD);
+        break;
+    }
+    for (int i = 0; i < dim; ++i) {
+      w[i] -= caffe2::FLAGS_lr * grad[i] / size;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  caffe2::SetUsageMessage(
+      "Compares the convergence of SGD against the bytes sent with the "
+      "compressions of the MPI Allreduce operator. Run it with mpirun.");
+  int mpi_ret;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mpi_ret);
+  caffe2::GlobalInit(&argc, &argv);
+  int rank;
+  int size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  const Problem problem = MakeProblem(rank);
+  for (const string& name : caffe2::split(',', caffe2::FLAGS_compression)) {
+    Train(problem, name, size);
+  }
+  MPI_Finalize();
+  return 0;
+}
@@ -1,5 +1,17 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 #include "caffe2/core/init.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/operator_schema.h"
 #include "caffe2/proto/caffe2.pb.h"
 #include "caffe2/utils/proto_utils.h"
 #include "caffe2/core/logging.h"
@@ -10,18 +22,411 @@ CAFFE2_DEFINE_string(init_net, "",
 CAFFE2_DEFINE_int(warmup, 0, "The number of iterations to warm up.");
 CAFFE2_DEFINE_int(iter, 10, "The number of iterations to run.");
 CAFFE2_DEFINE_bool(run_individual, false, "Whether to benchmark individual operators.");
+CAFFE2_DEFINE_string(
+    input,
+    "",
+    "Comma-separated names of input blobs to create before running, for nets "
+    "whose init net does not create their inputs, e.g. on a device.");
+CAFFE2_DEFINE_string(
+    input_dims,
+    "",
+    "Semicolon-separated dimensions of the blobs in --input, each a "
+    "comma-separated list, e.g. 1,3,224,224.");
+CAFFE2_DEFINE_string(
+    input_type,
+    "float",
+    "The type of the blobs in --input: float or uint8_t. They are filled "
+    "with ones.");
+CAFFE2_DEFINE_double(
+    peak_gflops,
+    0,
+    "The peak GFLOP/s of the machine. If set, --run_individual also reports "
+    "the share of it that every operator achieves.");
+CAFFE2_DEFINE_double(
+    peak_gbps,
+    0,
+    "The peak memory bandwidth of the machine, in GB/s. If set, "
+    "--run_individual also reports the share of it that every operator "
+    "achieves.");
+CAFFE2_DEFINE_int(
+    trials,
+    0,
+    "If positive, runs --iter iterations that many times, and reports the "
+    "median time per iteration over the trials with a 95% confidence "
+    "interval, for the net and, with --run_individual, every operator.");
+CAFFE2_DEFINE_string(
+    cpu_affinity,
+    "",
+    "Comma-separated CPUs to pin the benchmark and the threads it starts to.");
+CAFFE2_DEFINE_string(
+    cpu_governor,
+    "",
+    "If set, e.g. to performance, the cpufreq governor to set on the CPUs of "
+    "--cpu_affinity, or on all CPUs, before running. Needs root.");
+CAFFE2_DEFINE_string(
+    save_json,
+    "",
+    "If set, the file to write the results of --trials to, as JSON, to be "
+    "used as a --baseline_json later.");
+CAFFE2_DEFINE_string(
+    baseline_json,
+    "",
+    "If set, results of --trials written by --save_json to compare against. "
+    "The benchmark exits with status 1 if the net regressed.");
+CAFFE2_DEFINE_double(
+    regression_threshold,
+    0.05,
+    "The slowdown over --baseline_json, as a fraction, from which a net or "
+    "operator counts as regressed, provided that the lower bound of its "
+    "confidence interval is also slower than the baseline.");
+
+namespace {
+
+std::vector<std::string> Split(char separator, const std::string& string) {
+  std::vector<std::string> pieces;
+  size_t begin = 0;
+  while (true) {
+    const size_t end = string.find(separator, begin);
+    pieces.push_back(string.substr(begin, end - begin));
+    if (end == std::string::npos) {
+      return pieces;
+    }
+    begin = end + 1;
+  }
+}
+
+void CreateInputs(caffe2::Workspace* workspace) {
+  if (caffe2::FLAGS_input.empty()) {
+    return;
+  }
+  const auto names = Split(',', caffe2::FLAGS_input);
+  const auto dims = Split(';', caffe2::FLAGS_input_dims);
+  CAFFE_ENFORCE_EQ(
+      names.size(),
+      dims.size(),
+      "--input and --input_dims must list as many blobs.");
+  for (size_t i = 0; i < names.size(); ++i) {
+    std::vector<caffe2::TIndex> shape;
+    for (const auto& dim : Split(',', dims[i])) {
+      shape.push_back(std::stoi(dim));
+    }
+    auto* tensor =
+        workspace->CreateBlob(names[i])->GetMutable<caffe2::TensorCPU>();
+    tensor->Resize(shape);
+    if (caffe2::FLAGS_input_type == "float") {
+      std::fill_n(tensor->mutable_data<float>(), tensor->size(), 1.f);
+    } else if (caffe2::FLAGS_input_type == "uint8_t") {
+      std::fill_n(tensor->mutable_data<uint8_t>(), tensor->size(), 1);
+    } else {
+      CAFFE_THROW("Unsupported input type: ", caffe2::FLAGS_input_type);
+    }
+  }
+}
+
+bool GetShape(
+    caffe2::Workspace* workspace,
+    const std::string& name,
+    caffe2::TensorShape* shape) {
+  if (!workspace->HasBlob(name)) {
+    return false;
+  }
+  caffe2::Blob* blob = workspace->GetBlob(name);
+  caffe2::ShapeCall shape_fun = caffe2::GetShapeCallFunction(blob->meta().id());
+  if (!shape_fun) {
+    return false;
+  }
+  for (auto d : shape_fun(blob->GetRaw())) {
+    shape->add_dims(d);
+  }
+  if (blob->IsType<caffe2::TensorCPU>()) {
+    shape->set_data_type(
+        caffe2::TypeMetaToDataType(blob->Get<caffe2::TensorCPU>().meta()));
+  }
+  return true;
+}
+
+// Reports the GFLOP/s and GB/s that every operator achieved in the
+// individual runs of the benchmark, from the cost functions of their schemas
+// and the shapes of their inputs after the runs.
+void ReportThroughput(
+    caffe2::Workspace* workspace,
+    const caffe2::NetDef& net_def,
+    const std::vector<float>& times) {
+  if (times.size() != net_def.op_size() + 1) {
+    LOG(WARNING) << "Cannot match the operator timings to the operators of "
+                 << "the net, not reporting their throughput.";
+    return;
+  }
+  LOG(INFO) << "Throughput per operator:";
+  for (int idx = 0; idx < net_def.op_size(); ++idx) {
+    const caffe2::OperatorDef& op_def = net_def.op(idx);
+    const caffe2::OpSchema* schema =
+        caffe2::OpSchemaRegistry::Schema(op_def.type());
+    const float millis = times[idx + 1];
+    if (!schema || !schema->HasCostInferenceFunction() || millis <= 0) {
+      continue;
+    }
+    std::vector<caffe2::TensorShape> shapes(op_def.input_size());
+    bool known = true;
+    for (int i = 0; i < op_def.input_size() && known; ++i) {
+      known = GetShape(workspace, op_def.input(i), &shapes[i]);
+    }
+    if (!known) {
+      continue;
+    }
+    caffe2::OpSchema::Cost cost;
+    try {
+      cost = schema->InferCost(op_def, shapes);
+    } catch (const caffe2::EnforceNotMet& e) {
+      LOG(WARNING) << "Cannot infer the cost of operator #" << idx << ": "
+                   << e.msg();
+      continue;
+    }
+    const double gflops = cost.flops / (millis * 1e6);
+    const double gbps = cost.bytes_moved / (millis * 1e6);
+    std::ostringstream line;
+    line << "Operator #" << idx << " (" << op_def.type() << ") " << gflops
+         << " GFLOP/s, " << gbps << " GB/s";
+    if (caffe2::FLAGS_peak_gflops > 0) {
+      line << ", " << 100 * gflops / caffe2::FLAGS_peak_gflops
+           << "% of peak compute";
+    }
+    if (caffe2::FLAGS_peak_gbps > 0) {
+      line << ", " << 100 * gbps / caffe2::FLAGS_peak_gbps
+           << "% of peak bandwidth";
+    }
+    LOG(INFO) << line.str();
+  }
+}
+
+void PinCPUs() {
+  std::vector<int> cpus;
+  if (!caffe2::FLAGS_cpu_affinity.empty()) {
+    for (const auto& cpu : Split(',', caffe2::FLAGS_cpu_affinity)) {
+      cpus.push_back(std::stoi(cpu));
+    }
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      CPU_SET(cpu, &set);
+    }
+    CAFFE_ENFORCE_EQ(
+        sched_setaffinity(0, sizeof(set), &set),
+        0,
+        "Cannot pin the benchmark to CPUs ",
+        caffe2::FLAGS_cpu_affinity);
+#else
+    LOG(WARNING) << "--cpu_affinity is only supported on Linux.";
+#endif
+  }
+  if (caffe2::FLAGS_cpu_governor.empty()) {
+    return;
+  }
+  if (cpus.empty()) {
+    for (int cpu = 0;
+         std::ifstream("/sys/devices/system/cpu/cpu" + caffe2::to_string(cpu) +
+                       "/cpufreq/scaling_governor")
+             .good();
+         ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  for (int cpu : cpus) {
+    std::ofstream governor(
+        "/sys/devices/system/cpu/cpu" + caffe2::to_string(cpu) +
+        "/cpufreq/scaling_governor");
+    governor << caffe2::FLAGS_cpu_governor;
+    governor.flush();
+    if (!governor.good()) {
+      LOG(WARNING) << "Cannot set the cpufreq governor of CPU " << cpu
+                   << "; the frequency may vary between trials.";
+    }
+  }
+}
+
+// The median of the samples and a 95% confidence interval for it, from the
+// order statistics around the median, which holds whatever the distribution
+// of the samples.
+struct Summary {
+  double median = 0;
+  double low = 0;
+  double high = 0;
+};
+
+Summary Summarize(std::vector<double> samples) {
+  CAFFE_ENFORCE(!samples.empty());
+  std::sort(samples.begin(), samples.end());
+  const int n = samples.size();
+  const double half_width = 0.98 * std::sqrt(n);
+  Summary summary;
+  summary.median = n % 2 ? samples[n / 2]
+                         : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+  summary.low = samples[std::max<int>(0, std::floor(n / 2.0 - half_width))];
+  summary.high =
+      samples[std::min<int>(n - 1, std::ceil(n / 2.0 + half_width) - 1)];
+  return summary;
+}
+
+std::string Describe(const Summary& summary) {
+  std::ostringstream description;
+  description << summary.median << " ms/iter, 95% CI [" << summary.low << ", "
+              << summary.high << "]";
+  return description.str();
+}
+
+void WriteJSON(
+    const caffe2::NetDef& net_def,
+    const Summary& net,
+    const std::vector<Summary>& ops) {
+  std::ofstream out(caffe2::FLAGS_save_json);
+  CAFFE_ENFORCE(out.good(), "Cannot open ", caffe2::FLAGS_save_json);
+  out << "{\"trials\":" << caffe2::FLAGS_trials
+      << ",\"iter\":" << caffe2::FLAGS_iter
+      << ",\"net_median_ms\":" << net.median
+      << ",\"net_ci_low_ms\":" << net.low
+      << ",\"net_ci_high_ms\":" << net.high << ",\"ops\":[";
+  for (int idx = 0; idx < ops.size(); ++idx) {
+    out << (idx ? ",\n" : "\n") << "{\"index\":" << idx << ",\"type\":\""
+        << net_def.op(idx).type() << "\",\"median_ms\":" << ops[idx].median
+        << ",\"ci_low_ms\":" << ops[idx].low
+        << ",\"ci_high_ms\":" << ops[idx].high << "}";
+  }
+  out << "]}\n";
+  CAFFE_ENFORCE(out.good(), "Cannot write ", caffe2::FLAGS_save_json);
+}
+
+// The numbers that follow every "key": in a JSON file written by
+// WriteJSON(), in order.
+std::vector<double> ReadJSONNumbers(
+    const std::string& json,
+    const std::string& key) {
+  std::vector<double> numbers;
+  const std::string pattern = "\"" + key + "\":";
+  for (size_t pos = json.find(pattern); pos != std::string::npos;
+       pos = json.find(pattern, pos + 1)) {
+    numbers.push_back(std::stod(json.substr(pos + pattern.size())));
+  }
+  return numbers;
+}
+
+bool Regressed(const Summary& current, double baseline) {
+  return current.median >
+      baseline * (1 + caffe2::FLAGS_regression_threshold) &&
+      current.low > baseline;
+}
+
+// Compares the results against --baseline_json, and returns false if the net
+// regressed. Operator regressions are reported, but do not fail the
+// comparison, since they are noisier and may move between operators.
+bool CompareToBaseline(
+    const caffe2::NetDef& net_def,
+    const Summary& net,
+    const std::vector<Summary>& ops) {
+  std::ifstream in(caffe2::FLAGS_baseline_json);
+  CAFFE_ENFORCE(in.good(), "Cannot open ", caffe2::FLAGS_baseline_json);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  const auto net_baseline = ReadJSONNumbers(contents.str(), "net_median_ms");
+  const auto op_baselines = ReadJSONNumbers(contents.str(), "median_ms");
+  CAFFE_ENFORCE_EQ(
+      net_baseline.size(), 1, "No net time in ", caffe2::FLAGS_baseline_json);
+  if (!ops.empty() && op_baselines.size() == ops.size()) {
+    for (int idx = 0; idx < ops.size(); ++idx) {
+      if (Regressed(ops[idx], op_baselines[idx])) {
+        LOG(WARNING) << "Operator #" << idx << " (" << net_def.op(idx).type()
+                     << ") regressed: " << Describe(ops[idx])
+                     << ", baseline " << op_baselines[idx] << " ms/iter.";
+      }
+    }
+  } else if (!ops.empty()) {
+    LOG(WARNING) << "The baseline has " << op_baselines.size()
+                 << " operators and the net " << ops.size()
+                 << ", not comparing them.";
+  }
+  const double change = net.median / net_baseline[0] - 1;
+  if (Regressed(net, net_baseline[0])) {
+    LOG(ERROR) << "The net regressed by " << 100 * change << "%: "
+               << Describe(net) << ", baseline " << net_baseline[0]
+               << " ms/iter.";
+    return false;
+  }
+  LOG(INFO) << "The net changed by " << 100 * change << "% over the baseline "
+            << net_baseline[0] << " ms/iter, within the threshold of "
+            << 100 * caffe2::FLAGS_regression_threshold << "% or the noise.";
+  return true;
+}
+
+// Runs --trials trials of --iter iterations, reports their statistics, and
+// compares them against the baseline if any. Returns the exit status.
+int RunTrials(
+    caffe2::Workspace* workspace,
+    caffe2::NetBase* net,
+    const caffe2::NetDef& net_def) {
+  std::vector<double> net_samples;
+  std::vector<std::vector<double>> op_samples;
+  for (int trial = 0; trial < caffe2::FLAGS_trials; ++trial) {
+    const auto times = net->TEST_Benchmark(
+        trial ? 0 : caffe2::FLAGS_warmup,
+        caffe2::FLAGS_iter,
+        caffe2::FLAGS_run_individual);
+    CAFFE_ENFORCE(!times.empty(), "The net type does not support benchmarks.");
+    net_samples.push_back(times[0]);
+    op_samples.resize(times.size() - 1);
+    for (int idx = 1; idx < times.size(); ++idx) {
+      op_samples[idx - 1].push_back(times[idx]);
+    }
+  }
+  const Summary net_summary = Summarize(net_samples);
+  LOG(INFO) << "Net over " << caffe2::FLAGS_trials
+            << " trials: " << Describe(net_summary);
+  std::vector<Summary> op_summaries;
+  std::vector<float> op_medians = {static_cast<float>(net_summary.median)};
+  for (int idx = 0; idx < op_samples.size(); ++idx) {
+    op_summaries.push_back(Summarize(op_samples[idx]));
+    op_medians.push_back(op_summaries.back().median);
+    LOG(INFO) << "Operator #" << idx << " ("
+              << (idx < net_def.op_size() ? net_def.op(idx).type() : "?")
+              << ") " << Describe(op_summaries.back());
+  }
+  if (caffe2::FLAGS_run_individual) {
+    ReportThroughput(workspace, net_def, op_medians);
+  }
+  if (op_summaries.size() != net_def.op_size()) {
+    op_summaries.clear();
+  }
+  if (!caffe2::FLAGS_save_json.empty()) {
+    WriteJSON(net_def, net_summary, op_summaries);
+  }
+  if (!caffe2::FLAGS_baseline_json.empty() &&
+      !CompareToBaseline(net_def, net_summary, op_summaries)) {
+    return 1;
+  }
+  return 0;
+}
+
+} // namespace
 
 int main(int argc, char** argv) {
   caffe2::GlobalInit(&argc, &argv);
+  PinCPUs();
   std::unique_ptr<caffe2::Workspace> workspace(new caffe2::Workspace());
   // Run initialization network.
   caffe2::NetDef net_def;
   CAFFE_ENFORCE(ReadProtoFromFile(caffe2::FLAGS_init_net, &net_def));
   CAFFE_ENFORCE(workspace->RunNetOnce(net_def));
+  CreateInputs(workspace.get());
   CAFFE_ENFORCE(ReadProtoFromFile(caffe2::FLAGS_net, &net_def));
   caffe2::NetBase* net = workspace->CreateNet(net_def);
   CHECK_NOTNULL(net);
   CAFFE_ENFORCE(net->Run());
-  net->TEST_Benchmark(caffe2::FLAGS_warmup, caffe2::FLAGS_iter, caffe2::FLAGS_run_individual);
+  if (caffe2::FLAGS_trials > 0) {
+    return RunTrials(workspace.get(), net, net_def);
+  }
+  const auto times = net->TEST_Benchmark(
+      caffe2::FLAGS_warmup, caffe2::FLAGS_iter, caffe2::FLAGS_run_individual);
+  if (caffe2::FLAGS_run_individual) {
+    ReportThroughput(workspace.get(), net_def, times);
+  }
   return 0;
 }
@@ -1,5 +1,7 @@
 #include <string>
 #include <sstream>
+#include <thread>
+#include <utility>
 
 #include "caffe2/core/db.h"
 #include "caffe2/core/init.h"
@@ -40,15 +42,32 @@ static int Split(int argc, char** argv) {
         transactions.back().get(), "Cannot get transaction for output db #", i);
   }
 
+  // Items are read a batch at a time and dealt to the splits round robin;
+  // every split then writes and commits its share on its own thread.
   int count = 0;
-  for (; cursor->Valid(); cursor->Next()) {
-    transactions[count % FLAGS_splits]->Put(cursor->key(), cursor->value());
-    if (++count % FLAGS_batch_size == 0) {
-      for (int i = 0; i < FLAGS_splits; ++i) {
+  vector<vector<std::pair<string, string>>> shards(FLAGS_splits);
+  while (cursor->Valid()) {
+    for (auto& shard : shards) {
+      shard.clear();
+    }
+    for (int i = 0; cursor->Valid() && i < FLAGS_batch_size;
+         ++i, cursor->Next()) {
+      shards[count++ % FLAGS_splits].emplace_back(
+          cursor->key(), cursor->value());
+    }
+    vector<std::thread> threads;
+    for (int i = 0; i < FLAGS_splits; ++i) {
+      threads.emplace_back([&transactions, &shards, i]() {
+        for (const auto& item : shards[i]) {
+          transactions[i]->Put(item.first, item.second);
+        }
         transactions[i]->Commit();
-      }
-      LOG(INFO) << "Split " << count << " items so far.";
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
     }
+    LOG(INFO) << "Split " << count << " items so far.";
   }
   LOG(INFO) << "A total of " << count << " items processed.";
   return 0;
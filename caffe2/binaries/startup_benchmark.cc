@@ -0,0 +1,123 @@
+/**
+ * Measures the startup time of a binary that links in the operators, the way
+ * short lived tools such as run_plan pay it: the benchmark runs itself as a
+ * child process a number of times, and reports the time from fork to exit,
+ * split into the time spent outside of main (mostly loading and static
+ * initialization, where the operators and their schemas register) and in main
+ * (running a small net, which looks up a few operators and schemas).
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/operator_schema.h"
+#include "caffe2/core/timer.h"
+
+CAFFE2_DEFINE_int(runs, 20, "The number of times to start the binary.");
+CAFFE2_DEFINE_bool(child, false, "Run as the started binary.");
+
+namespace {
+
+// Runs a small net.
+void RunChild() {
+  caffe2::NetDef net;
+  net.set_name("startup");
+  {
+    auto* op = net.add_op();
+    op->set_type("ConstantFill");
+    op->add_output("X");
+    caffe2::AddArgument<std::vector<int>>("shape", {16, 16}, op);
+    caffe2::AddArgument<float>("value", 1.0f, op);
+  }
+  for (const char* type : {"Relu", "Sigmoid", "Sum"}) {
+    auto* op = net.add_op();
+    op->set_type(type);
+    op->add_input("X");
+    op->add_output("X");
+  }
+  caffe2::Workspace ws;
+  CAFFE_ENFORCE(ws.RunNetOnce(net));
+  CAFFE_ENFORCE(caffe2::OpSchemaRegistry::Schema("Relu"));
+}
+
+// Starts this binary as a child, and returns the microseconds until it exits
+// and the ones that it spent in main.
+std::pair<double, double> StartChild(const char* binary) {
+  int fds[2];
+  CAFFE_ENFORCE_EQ(pipe(fds), 0);
+  caffe2::Timer timer;
+  const pid_t pid = fork();
+  CAFFE_ENFORCE_GE(pid, 0, "fork failed.");
+  if (pid == 0) {
+    close(fds[0]);
+    CAFFE_ENFORCE_GE(dup2(fds[1], STDOUT_FILENO), 0);
+    execl(binary, binary, "--child=true", nullptr);
+    _exit(127);
+  }
+  close(fds[1]);
+  std::string output;
+  char buffer[64];
+  ssize_t size;
+  while ((size = read(fds[0], buffer, sizeof(buffer))) > 0) {
+    output.append(buffer, size);
+  }
+  close(fds[0]);
+  int status = 0;
+  CAFFE_ENFORCE_EQ(waitpid(pid, &status, 0), pid);
+  const double total = timer.MicroSeconds();
+  CAFFE_ENFORCE(
+      WIFEXITED(status) && WEXITSTATUS(status) == 0,
+      "The child exited with status ",
+      status);
+  return {total, std::atof(output.c_str())};
+}
+
+void PrintStats(const char* name, std::vector<double> times) {
+  std::sort(times.begin(), times.end());
+  double sum = 0;
+  for (double time : times) {
+    sum += time;
+  }
+  printf(
+      "%-12s min %9.1f us, median %9.1f us, mean %9.1f us\n",
+      name,
+      times.front(),
+      times[times.size() / 2],
+      sum / times.size());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  caffe2::Timer timer;
+  caffe2::GlobalInit(&argc, &argv);
+  if (caffe2::FLAGS_child) {
+    RunChild();
+    printf("%f\n", timer.MicroSeconds());
+    return 0;
+  }
+  CAFFE_ENFORCE_GT(caffe2::FLAGS_runs, 0);
+  printf(
+      "%zu CPU operators, %zu schemas\n",
+      caffe2::CPUOperatorRegistry()->Keys().size(),
+      caffe2::OpSchemaRegistry::Keys().size());
+  std::vector<double> totals, outside_main, in_main;
+  for (int run = 0; run < caffe2::FLAGS_runs; ++run) {
+    const auto times = StartChild(argv[0]);
+    totals.push_back(times.first);
+    outside_main.push_back(times.first - times.second);
+    in_main.push_back(times.second);
+  }
+  PrintStats("total", totals);
+  PrintStats("outside main", outside_main);
+  PrintStats("in main", in_main);
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe2/core/blob.h"
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/tensor.h"
+#include "caffe2/core/timer.h"
+
+CAFFE2_DEFINE_int64(size, 100000000, "The number of elements of the tensor.");
+CAFFE2_DEFINE_int(repeat, 3, "The number of times to repeat each test.");
+
+using caffe2::Blob;
+using caffe2::TensorCPU;
+using caffe2::string;
+
+template <typename T>
+void BenchmarkEncoding(const char* name, bool raw_bytes, bool float16) {
+  caffe2::FLAGS_caffe2_tensor_raw_bytes_encoding = raw_bytes;
+  caffe2::FLAGS_caffe2_tensor_float16_encoding = float16;
+  Blob blob;
+  TensorCPU* tensor = blob.GetMutable<TensorCPU>();
+  tensor->Resize(caffe2::FLAGS_size);
+  T* data = tensor->mutable_data<T>();
+  for (int64_t i = 0; i < tensor->size(); ++i) {
+    data[i] = static_cast<T>(i % 1000003);
+  }
+
+  for (int iter = 0; iter < caffe2::FLAGS_repeat; ++iter) {
+    std::vector<std::pair<string, string>> chunks;
+    std::mutex mutex;
+    size_t total_bytes = 0;
+    caffe2::Timer timer;
+    blob.Serialize(
+        "benchmark", [&](const string& key, const string& value) {
+          std::lock_guard<std::mutex> guard(mutex);
+          total_bytes += value.size();
+          chunks.emplace_back(key, value);
+        });
+    const double serialize_seconds = timer.Seconds();
+
+    Blob loaded;
+    timer.Start();
+    for (const auto& chunk : chunks) {
+      loaded.Deserialize(chunk.second);
+    }
+    const double deserialize_seconds = timer.Seconds();
+    CAFFE_ENFORCE_EQ(loaded.Get<TensorCPU>().size(), tensor->size());
+    printf(
+        "%-24s %3d: %12zu bytes, serialize %8.4f s, deserialize %8.4f s\n",
+        name,
+        iter,
+        total_bytes,
+        serialize_seconds,
+        deserialize_seconds);
+  }
+}
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  BenchmarkEncoding<float>("float, typed fields", false, false);
+  BenchmarkEncoding<float>("float, raw bytes", true, false);
+  BenchmarkEncoding<float>("float, raw float16", false, true);
+  BenchmarkEncoding<int64_t>("int64, typed fields", false, false);
+  BenchmarkEncoding<int64_t>("int64, raw bytes", true, false);
+  BenchmarkEncoding<int>("int32, typed fields", false, false);
+  BenchmarkEncoding<int>("int32, raw bytes", true, false);
+  return 0;
+}
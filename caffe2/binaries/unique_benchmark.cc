@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
+
+CAFFE2_DEFINE_int64(size, 10000000, "The number of ids per batch.");
+CAFFE2_DEFINE_int(repeat, 3, "The number of times to repeat each test.");
+
+using caffe2::string;
+using caffe2::TensorCPU;
+
+namespace {
+
+// The comparison sort that Unique used before, kept as the baseline.
+void SortUnique(
+    const std::vector<int64_t>& ids,
+    std::vector<int64_t>* unique,
+    std::vector<int>* remapping) {
+  std::vector<int> order(ids.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&ids](int x, int y) {
+    return ids[x] < ids[y];
+  });
+  unique->clear();
+  remapping->resize(ids.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    if (i == 0 || ids[order[i]] != unique->back()) {
+      unique->push_back(ids[order[i]]);
+    }
+    (*remapping)[order[i]] = unique->size() - 1;
+  }
+}
+
+// The hash map FindDuplicateElements used before.
+void HashDuplicates(
+    const std::vector<int64_t>& ids,
+    std::vector<int64_t>* duplicates) {
+  std::unordered_map<int64_t, int64_t> dict;
+  duplicates->clear();
+  for (int64_t j = 0; j < ids.size(); ++j) {
+    if (!dict.insert({ids[j], j}).second) {
+      duplicates->push_back(j);
+    }
+  }
+}
+
+// Sparse feature ids as seen by the embedding lookups: hashed ids spread over
+// the whole int64 range, power law ids over a vocabulary of a million, and
+// dense small ids.
+std::vector<int64_t> MakeIds(const string& distribution, int64_t n) {
+  std::mt19937_64 gen(1);
+  std::vector<int64_t> ids(n);
+  if (distribution == "hashed") {
+    std::uniform_int_distribution<int64_t> vocab(0, 1 << 20);
+    for (auto& id : ids) {
+      id = static_cast<int64_t>(vocab(gen) * 0x9e3779b97f4a7c15ULL);
+    }
+  } else if (distribution == "zipf") {
+    std::uniform_real_distribution<double> u(0, 1);
+    for (auto& id : ids) {
+      // Inverse CDF of a continuous power law with exponent 1.1.
+      const double x = std::pow(1 - u(gen), -1 / 0.1);
+      id = static_cast<int64_t>(std::min(x, 1e18)) % 1000000;
+    }
+  } else {
+    std::uniform_int_distribution<int64_t> small(0, 100000);
+    for (auto& id : ids) {
+      id = small(gen);
+    }
+  }
+  return ids;
+}
+
+void Benchmark(const string& distribution) {
+  const auto ids = MakeIds(distribution, caffe2::FLAGS_size);
+  caffe2::Workspace ws;
+  auto* input = ws.CreateBlob("ids")->GetMutable<TensorCPU>();
+  input->Resize(ids.size());
+  std::copy(ids.begin(), ids.end(), input->mutable_data<int64_t>());
+
+  caffe2::OperatorDef unique_def;
+  unique_def.set_type("Unique");
+  unique_def.add_input("ids");
+  unique_def.add_output("unique");
+  unique_def.add_output("remapping");
+  auto unique_op = caffe2::CreateOperator(unique_def, &ws);
+  caffe2::OperatorDef dup_def;
+  dup_def.set_type("FindDuplicateElements");
+  dup_def.add_input("ids");
+  dup_def.add_output("duplicates");
+  auto dup_op = caffe2::CreateOperator(dup_def, &ws);
+
+  std::vector<int64_t> unique, duplicates;
+  std::vector<int> remapping;
+  for (int iter = 0; iter < caffe2::FLAGS_repeat; ++iter) {
+    caffe2::Timer timer;
+    SortUnique(ids, &unique, &remapping);
+    const double sort_seconds = timer.Seconds();
+    timer.Start();
+    CAFFE_ENFORCE(unique_op->Run());
+    const double radix_seconds = timer.Seconds();
+    CAFFE_ENFORCE_EQ(
+        ws.GetBlob("unique")->Get<TensorCPU>().size(), unique.size());
+
+    timer.Start();
+    HashDuplicates(ids, &duplicates);
+    const double hash_seconds = timer.Seconds();
+    timer.Start();
+    CAFFE_ENFORCE(dup_op->Run());
+    const double dup_seconds = timer.Seconds();
+    CAFFE_ENFORCE_EQ(
+        ws.GetBlob("duplicates")->Get<TensorCPU>().size(), duplicates.size());
+
+    printf(
+        "%-8s %d: %9zu unique, Unique sort %7.4f s radix %7.4f s, "
+        "FindDuplicateElements hash %7.4f s radix %7.4f s\n",
+        distribution.c_str(),
+        iter,
+        unique.size(),
+        sort_seconds,
+        radix_seconds,
+        hash_seconds,
+        dup_seconds);
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  Benchmark("hashed");
+  Benchmark("zipf");
+  Benchmark("small");
+  return 0;
+}
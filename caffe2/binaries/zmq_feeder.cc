@@ -1,20 +1,94 @@
 // This binary provides an easy way to open a zeromq server and feeds data to
 // clients connect to it. It uses the Caffe2 db as the backend, thus allowing
 // one to convert any db-compliant storage to a zeromq service.
+//
+// Records are sent in batches of --batch_size, one multipart message each,
+// from one thread per address of --server. A zmqdb reader connecting to all
+// of the addresses receives from them in parallel.
+
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "caffe2/core/db.h"
 #include "caffe2/core/init.h"
 #include "caffe2/core/logging.h"
+#include "caffe2/utils/string_utils.h"
 #include "caffe2/utils/zmq_helper.h"
 
-CAFFE2_DEFINE_string(server, "tcp://*:5555", "The server address.");
+CAFFE2_DEFINE_string(
+    server,
+    "tcp://*:5555",
+    "The server address, or a comma separated list of addresses to send "
+    "from in parallel.");
 CAFFE2_DEFINE_string(input_db, "", "The input db.");
 CAFFE2_DEFINE_string(input_db_type, "", "The input db type.");
+CAFFE2_DEFINE_int(
+    batch_size,
+    64,
+    "The number of records per message. If 0, records are sent one by one "
+    "as a key and a value, which older readers expect.");
 
 using caffe2::db::DB;
 using caffe2::db::Cursor;
+using caffe2::db::StringView;
 using caffe2::string;
 
+namespace {
+
+// Reads the next batch of records into writer. The cursor wraps around at
+// the end of the db.
+void ReadBatch(
+    Cursor* cursor,
+    std::mutex* mutex,
+    caffe2::ZmqBatchWriter* writer) {
+  std::vector<StringView> keys, values;
+  std::lock_guard<std::mutex> lock(*mutex);
+  while (writer->size() < caffe2::FLAGS_batch_size) {
+    const size_t n = cursor->NextBatch(
+        caffe2::FLAGS_batch_size - writer->size(), &keys, &values);
+    for (size_t i = 0; i < n; ++i) {
+      writer->Add(keys[i].data, keys[i].size, values[i].data, values[i].size);
+    }
+    if (!cursor->Valid()) {
+      cursor->SeekToFirst();
+    }
+  }
+}
+
+void Feed(const string& address, Cursor* cursor, std::mutex* mutex) {
+  //  Socket to talk to clients
+  caffe2::ZmqSocket sender(ZMQ_PUSH);
+  sender.Bind(address);
+  LOG(INFO) << "Server created at " << address;
+
+  caffe2::ZmqBatchWriter writer;
+  while (1) {
+    if (caffe2::FLAGS_batch_size > 0) {
+      ReadBatch(cursor, mutex, &writer);
+      VLOG(1) << "Sending " << writer.size() << " records of "
+              << writer.payload_bytes() << " bytes";
+      writer.Send(&sender);
+      continue;
+    }
+    string key, value;
+    {
+      std::lock_guard<std::mutex> lock(*mutex);
+      key = cursor->key();
+      value = cursor->value();
+      cursor->Next();
+      if (!cursor->Valid()) {
+        cursor->SeekToFirst();
+      }
+    }
+    VLOG(1) << "Sending " << key;
+    sender.SendTillSuccess(key, ZMQ_SNDMORE);
+    sender.SendTillSuccess(value, 0);
+  }
+}
+
+} // namespace
+
 int main(int argc, char** argv) {
   caffe2::GlobalInit(&argc, &argv);
 
@@ -29,22 +103,16 @@ int main(int argc, char** argv) {
   LOG(INFO) << "DB opened.";
 
   LOG(INFO) << "Starting ZeroMQ server...";
-
-  //  Socket to talk to clients
-  caffe2::ZmqSocket sender(ZMQ_PUSH);
-  sender.Bind(caffe2::FLAGS_server);
-  LOG(INFO) << "Server created at " << caffe2::FLAGS_server;
-
-  while (1) {
-    VLOG(1) << "Sending " << cursor->key();
-    sender.SendTillSuccess(cursor->key(), ZMQ_SNDMORE);
-    sender.SendTillSuccess(cursor->value(), 0);
-    cursor->Next();
-    if (!cursor->Valid()) {
-      cursor->SeekToFirst();
-    }
+  // Each address gets its own socket, and with it its own zmq I/O thread.
+  std::mutex mutex;
+  std::vector<std::thread> threads;
+  for (const auto& address : caffe2::split(',', caffe2::FLAGS_server)) {
+    threads.emplace_back(Feed, address, cursor.get(), &mutex);
   }
   // We do not do an elegant quit since this binary is going to be terminated by
   // control+C.
+  for (auto& thread : threads) {
+    thread.join();
+  }
   return 0;
 }
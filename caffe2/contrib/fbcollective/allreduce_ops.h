@@ -25,7 +25,13 @@ class AllreduceOp final : public Operator<Context> {
   virtual ~AllreduceOp() {}
 
   bool RunOnDevice() override {
-    std::call_once(once_, [&] { initialize(); });
+    // The algorithm is bound to a context, which JoinCommonWorld can replace.
+    const auto& context =
+        OperatorBase::Input<std::shared_ptr<::fbcollective::Context>>(COMM);
+    if (context != comm_) {
+      initialize();
+      comm_ = context;
+    }
     algorithm_->Run();
     return true;
   }
@@ -76,7 +82,7 @@ class AllreduceOp final : public Operator<Context> {
         context, ptrs, output->size()));
   }
 
-  std::once_flag once_;
+  std::shared_ptr<::fbcollective::Context> comm_;
   std::unique_ptr<::fbcollective::Algorithm> algorithm_;
 
   INPUT_TAGS(COMM, INPUT);
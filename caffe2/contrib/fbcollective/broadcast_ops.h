@@ -22,7 +22,13 @@ class BroadcastOp final : public Operator<Context> {
   virtual ~BroadcastOp() {}
 
   bool RunOnDevice() override {
-    std::call_once(once_, [&] { initialize(); });
+    // The algorithm is bound to a context, which JoinCommonWorld can replace.
+    const auto& context =
+        OperatorBase::Input<std::shared_ptr<::fbcollective::Context>>(COMM);
+    if (context != comm_) {
+      initialize();
+      comm_ = context;
+    }
     algorithm_->Run();
     return true;
   }
@@ -49,7 +55,7 @@ class BroadcastOp final : public Operator<Context> {
   }
 
   const int root_;
-  std::once_flag once_;
+  std::shared_ptr<::fbcollective::Context> comm_;
   std::unique_ptr<::fbcollective::Algorithm> algorithm_;
 
   INPUT_TAGS(COMM, INPUT);
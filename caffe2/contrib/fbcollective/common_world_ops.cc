@@ -1,5 +1,11 @@
 #include "common_world_ops.h"
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "caffe2/distributed/topology.h"
+
 #include "fbcollective/transport/tcp/device.h"
 
 namespace caffe2 {
@@ -8,9 +14,9 @@ CAFFE_KNOWN_TYPE(std::shared_ptr<::fbcollective::Context>);
 
 namespace fbcollective {
 
-template <>
-std::shared_ptr<::fbcollective::transport::Device>
-CreateCommonWorld<CPUContext>::createDevice() {
+namespace {
+
+std::shared_ptr<::fbcollective::transport::Device> sharedTcpDevice() {
   // Share single device between all common worlds.
   // This should be made configurable, for varying transports, and
   // transport options (e.g. tcp socket options, ibverbs device).
@@ -19,10 +25,118 @@ CreateCommonWorld<CPUContext>::createDevice() {
   return sharedDevice;
 }
 
+void sleepForPoll() {
+  /* sleep override */
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+
+} // namespace
+
+template <>
+std::shared_ptr<::fbcollective::transport::Device>
+CreateCommonWorld<CPUContext>::createDevice() {
+  return sharedTcpDevice();
+}
+
+template <>
+std::shared_ptr<::fbcollective::transport::Device>
+JoinCommonWorld<CPUContext>::createDevice() {
+  return sharedTcpDevice();
+}
+
+int topologyRank(
+    StoreHandler& handler,
+    const std::string& name,
+    int rank,
+    int size,
+    const std::string& rack) {
+  const std::string prefix = name + "/placement/";
+  handler.set(
+      prefix + caffe2::to_string(rank),
+      serializePlacement(localPlacement(rack)));
+  std::vector<std::string> keys;
+  for (int i = 0; i < size; ++i) {
+    keys.push_back(prefix + caffe2::to_string(i));
+  }
+  std::vector<Placement> placements;
+  for (const auto& data : handler.multiGet(keys)) {
+    placements.push_back(parsePlacement(data));
+  }
+  const auto order = topologyOrder(placements);
+  const int ringRank =
+      std::find(order.begin(), order.end(), rank) - order.begin();
+  VLOG(1) << "Common world " << name << ": rank " << rank << " is at "
+          << ringRank << " in topology order";
+  return ringRank;
+}
+
+int64_t joinElasticWorld(
+    StoreHandler& handler,
+    const std::string& name,
+    int min_size,
+    int max_size,
+    int settle_ms,
+    int* rank,
+    int* size) {
+  // The number of rendezvous that are closed, which is also the number of
+  // the one that is open.
+  const std::string closedKey = name + "/closed";
+  while (true) {
+    const int64_t epoch = handler.add(closedKey, 0);
+    const std::string prefix = name + "/" + caffe2::to_string(epoch);
+    const std::string joinedKey = prefix + "/joined";
+    const std::string sizeKey = prefix + "/size";
+    const int64_t ticket = handler.add(joinedKey, 1);
+
+    if (ticket == 1) {
+      // Wait for the others to show up. Whoever joins after the count is
+      // read gets a ticket past the size, and waits for the next rendezvous.
+      auto count = handler.add(joinedKey, 0);
+      auto changed = std::chrono::steady_clock::now();
+      while (max_size <= 0 || count < max_size) {
+        sleepForPoll();
+        const auto now = std::chrono::steady_clock::now();
+        const auto current = handler.add(joinedKey, 0);
+        if (current != count) {
+          count = current;
+          changed = now;
+        } else if (
+            count >= min_size &&
+            now - changed >= std::chrono::milliseconds(settle_ms)) {
+          break;
+        }
+      }
+      if (max_size > 0) {
+        count = std::min<int64_t>(count, max_size);
+      }
+      handler.set(sizeKey, caffe2::to_string(count));
+      handler.add(closedKey, 1);
+    }
+
+    *size = std::stoi(handler.get(sizeKey));
+    if (ticket <= *size) {
+      *rank = ticket - 1;
+      LOG(INFO) << "Joined common world " << name << " #" << epoch
+                << " as rank " << *rank << " of " << *size;
+      return epoch;
+    }
+    LOG(INFO) << "Common world " << name << " #" << epoch
+              << " was full, waiting for the next one";
+    while (handler.add(closedKey, 0) <= epoch) {
+      sleepForPoll();
+    }
+  }
+}
+
 REGISTER_CPU_OPERATOR_WITH_ENGINE(
     CreateCommonWorld,
     FBCOLLECTIVE,
     CreateCommonWorld<CPUContext>);
 
+REGISTER_CPU_OPERATOR_WITH_ENGINE(
+    JoinCommonWorld,
+    FBCOLLECTIVE,
+    JoinCommonWorld<CPUContext>);
+
 } // namespace fbcollective
 } // namespace caffe2
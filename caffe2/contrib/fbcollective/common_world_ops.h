@@ -11,6 +11,16 @@
 namespace caffe2 {
 namespace fbcollective {
 
+// Exchanges the placements of the processes of the common world named name
+// through handler, and returns the rank of this process in topology order
+// (see topologyOrder), given its rank argument.
+int topologyRank(
+    StoreHandler& handler,
+    const std::string& name,
+    int rank,
+    int size,
+    const std::string& rack);
+
 template <class Context>
 class CreateCommonWorld final : public Operator<Context> {
  public:
@@ -19,7 +29,13 @@ class CreateCommonWorld final : public Operator<Context> {
   CreateCommonWorld(const OperatorDef& operator_def, Workspace* ws)
       : Operator<Context>(operator_def, ws),
         size_(OperatorBase::template GetSingleArgument<int>("size", 0)),
-        rank_(OperatorBase::template GetSingleArgument<int>("rank", 0)) {
+        rank_(OperatorBase::template GetSingleArgument<int>("rank", 0)),
+        topologyAware_(OperatorBase::template GetSingleArgument<bool>(
+            "topology_aware",
+            false)),
+        rack_(OperatorBase::template GetSingleArgument<std::string>(
+            "rack",
+            "")) {
     CAFFE_ENFORCE(def().has_name(), "CreateCommonWorld operator requires name");
     CAFFE_ENFORCE(rank_ >= 0 && rank_ < size_);
     name_ = def().name();
@@ -36,8 +52,14 @@ class CreateCommonWorld final : public Operator<Context> {
         new StoreHandlerWrapper(*handler));
     ::fbcollective::rendezvous::PrefixStore store(name_, wrapper);
 
+    // The rings of the algorithms go through the ranks of the context in
+    // order, which can be made to follow the topology.
+    const int rank = topologyAware_
+        ? topologyRank(*handler, name_, rank_, size_, rack_)
+        : rank_;
+
     // Create context and connect everyone to everyone
-    auto context = std::make_shared<::fbcollective::Context>(rank_, size_);
+    auto context = std::make_shared<::fbcollective::Context>(rank, size_);
     context->connectFullMesh(store, device_);
     *OperatorBase::Output<std::shared_ptr<::fbcollective::Context>>(COMM) =
         std::move(context);
@@ -49,6 +71,8 @@ class CreateCommonWorld final : public Operator<Context> {
 
   const int size_;
   const int rank_;
+  const bool topologyAware_;
+  const std::string rack_;
 
   std::string name_;
   std::shared_ptr<::fbcollective::transport::Device> device_;
@@ -57,5 +81,90 @@ class CreateCommonWorld final : public Operator<Context> {
   OUTPUT_TAGS(COMM);
 };
 
+// Runs one rendezvous of an elastic common world named name: joins the
+// first one that is not closed yet, waiting for the next one if this process
+// arrived too late. The first process to arrive closes it once at least
+// min_size processes have joined and no other one did for settle_ms, or once
+// max_size have, if positive. Returns the rendezvous number, and sets the
+// rank of this process, in order of arrival, and the size of the world.
+int64_t joinElasticWorld(
+    StoreHandler& handler,
+    const std::string& name,
+    int min_size,
+    int max_size,
+    int settle_ms,
+    int* rank,
+    int* size);
+
+// Creates a common world out of whichever processes run it at about the same
+// time, instead of a fixed number of them. Running it again on all the
+// processes that are left, plus any new ones, rebuilds it without restarting
+// the job, for example after a node failed or was preempted.
+template <class Context>
+class JoinCommonWorld final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+
+  JoinCommonWorld(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        min_size_(OperatorBase::template GetSingleArgument<int>("min_size", 1)),
+        max_size_(OperatorBase::template GetSingleArgument<int>("max_size", 0)),
+        settle_ms_(
+            OperatorBase::template GetSingleArgument<int>("settle_ms", 1000)) {
+    CAFFE_ENFORCE(def().has_name(), "JoinCommonWorld operator requires name");
+    CAFFE_ENFORCE_GE(min_size_, 1);
+    CAFFE_ENFORCE(max_size_ <= 0 || max_size_ >= min_size_);
+    name_ = def().name();
+    device_ = createDevice();
+  }
+
+  virtual ~JoinCommonWorld() {}
+
+  bool RunOnDevice() override {
+    const auto& handler =
+        OperatorBase::Input<std::unique_ptr<StoreHandler>>(STORE_HANDLER);
+    int rank = 0;
+    int size = 0;
+    const auto epoch = joinElasticWorld(
+        *handler, name_, min_size_, max_size_, settle_ms_, &rank, &size);
+
+    // Every rendezvous connects under its own prefix, as keys are set once.
+    auto wrapper = std::unique_ptr<::fbcollective::rendezvous::Store>(
+        new StoreHandlerWrapper(*handler));
+    ::fbcollective::rendezvous::PrefixStore store(
+        name_ + "/" + caffe2::to_string(epoch), wrapper);
+    auto context = std::make_shared<::fbcollective::Context>(rank, size);
+    context->connectFullMesh(store, device_);
+    // Replacing the context drops the connections of the previous world.
+    *OperatorBase::Output<std::shared_ptr<::fbcollective::Context>>(COMM) =
+        std::move(context);
+
+    if (OutputSize() > RANK) {
+      auto* output = OperatorBase::Output<TensorCPU>(RANK);
+      output->Resize();
+      output->template mutable_data<int>()[0] = rank;
+    }
+    if (OutputSize() > SIZE) {
+      auto* output = OperatorBase::Output<TensorCPU>(SIZE);
+      output->Resize();
+      output->template mutable_data<int>()[0] = size;
+    }
+    return true;
+  }
+
+ private:
+  std::shared_ptr<::fbcollective::transport::Device> createDevice();
+
+  const int min_size_;
+  const int max_size_;
+  const int settle_ms_;
+
+  std::string name_;
+  std::shared_ptr<::fbcollective::transport::Device> device_;
+
+  INPUT_TAGS(STORE_HANDLER);
+  OUTPUT_TAGS(COMM, RANK, SIZE);
+};
+
 } // namespace fbcollective
 } // namespace caffe2
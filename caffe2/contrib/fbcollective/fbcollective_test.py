@@ -231,6 +231,64 @@ class TestCase(hu.HypothesisTestCase):
                     tmpdir=tmpdir)
 
 
+    def _test_elastic(self,
+                      comm_rank=None,
+                      comm_size=None,
+                      tmpdir=None,
+                      ):
+        store_handler, _ = self.create_common_world(
+            comm_rank=comm_rank,
+            comm_size=comm_size,
+            tmpdir=tmpdir)
+
+        # The same net runs in both worlds, so that Allreduce has to drop the
+        # algorithm it set up for the first one.
+        net = core.Net("elastic_{}".format(TestCase.test_counter))
+        net.Allreduce(["elastic_world", "blob"], ["blob"], engine=op_engine)
+
+        def join(min_size):
+            workspace.RunOperatorOnce(
+                core.CreateOperator(
+                    "JoinCommonWorld",
+                    [store_handler],
+                    ["elastic_world", "rank", "size"],
+                    name="elastic",
+                    min_size=min_size,
+                    settle_ms=100,
+                    engine=op_engine))
+            return (int(workspace.FetchBlob("rank")),
+                    int(workspace.FetchBlob("size")))
+
+        rank, size = join(comm_size)
+        self.assertEqual(size, comm_size)
+        workspace.FeedBlob("blob", np.full(10, rank, np.float32))
+        workspace.CreateNet(net)
+        workspace.RunNet(net.Name())
+        np.testing.assert_array_equal(
+            workspace.FetchBlob("blob"), size * (size - 1) / 2)
+
+        # One process leaves, and the others carry on in a smaller world.
+        if rank == size - 1:
+            return
+        rank, size = join(comm_size - 1)
+        self.assertEqual(size, comm_size - 1)
+        workspace.FeedBlob("blob", np.full(10, rank, np.float32))
+        workspace.RunNet(net.Name())
+        np.testing.assert_array_equal(
+            workspace.FetchBlob("blob"), size * (size - 1) / 2)
+
+    @given(comm_size=st.integers(min_value=3, max_value=6))
+    def test_elastic(self, comm_size):
+        TestCase.test_counter += 1
+        if os.getenv('COMM_RANK') is not None:
+            self.run_test_distributed(self._test_elastic)
+        else:
+            with TemporaryDirectory() as tmpdir:
+                self.run_test_locally(
+                    self._test_elastic,
+                    comm_size=comm_size,
+                    tmpdir=tmpdir)
+
 if __name__ == "__main__":
     import unittest
     unittest.main()
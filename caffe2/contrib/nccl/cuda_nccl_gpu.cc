@@ -231,6 +231,57 @@ void NCCL<T>::AllGather(const NCCLExecution& ex) {
       });
 }
 
+template <typename T>
+void NCCL<T>::ReduceScatter(const NCCLExecution& ex) {
+  const auto n = ex.elements.size();
+  return runNCCL<T>(
+      ex,
+      [&ex, n](const NCCLElement& ctx, ncclComm_t comm, cudaStream_t stream) {
+        const auto size = ctx.src->size();
+        const auto shard = (size + n - 1) / n;
+        CAFFE_ENFORCE_EQ(ctx.dst->size(), shard * n);
+        T* dst = ctx.dst->template mutable_data<T>();
+        if (dst != ctx.src->template data<T>()) {
+          CUDA_CHECK(cudaMemcpyAsync(
+              dst,
+              ctx.src->raw_data(),
+              ctx.src->nbytes(),
+              cudaMemcpyDeviceToDevice,
+              stream));
+        }
+        CUDA_CHECK(cudaMemsetAsync(
+            dst + size, 0, (shard * n - size) * sizeof(T), stream));
+        const auto rank = &ctx - ex.elements.data();
+        CAFFE_NCCL_CHECK(ncclReduceScatter(
+            dst,
+            dst + rank * shard,
+            shard,
+            ncclTypeWrapper<T>::type,
+            ncclSum,
+            comm,
+            stream));
+      });
+}
+
+template <typename T>
+void NCCL<T>::AllGatherShards(const NCCLExecution& ex) {
+  const auto n = ex.elements.size();
+  return runNCCL<T>(
+      ex,
+      [&ex, n](const NCCLElement& ctx, ncclComm_t comm, cudaStream_t stream) {
+        const auto shard = ctx.dst->size() / n;
+        T* dst = ctx.dst->template mutable_data<T>();
+        const auto rank = &ctx - ex.elements.data();
+        CAFFE_NCCL_CHECK(ncclAllGather(
+            dst + rank * shard,
+            shard,
+            ncclTypeWrapper<T>::type,
+            dst,
+            comm,
+            stream));
+      });
+}
+
 // Explicit instantiation
 template class NCCL<float>;
 #ifdef CUDA_HAS_HALF
@@ -47,6 +47,15 @@ class NCCL {
   static void Broadcast(const NCCLExecution& ex);
   static void Reduce(const NCCLExecution& ex);
   static void AllGather(const NCCLExecution& ex);
+  // Sums the srcs and leaves the i-th of n equal shards of the sum in the
+  // dst of element i, at the same offset as in the sum, where n is the
+  // number of elements. Each dst must already be allocated with src->size()
+  // elements rounded up to a multiple of n; the src is copied into it and
+  // padded with zeros before the reduction.
+  static void ReduceScatter(const NCCLExecution& ex);
+  // Copies the i-th shard of the dst of each element i into the same shard
+  // of every other dst, undoing the split of ReduceScatter.
+  static void AllGatherShards(const NCCLExecution& ex);
 };
 }
 }
@@ -0,0 +1,90 @@
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/mpi/mpi_common.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+// Fills X_i with a distinct value on each GPU of each node, and checks that
+// every Y_i gets the sum over all of them. The size is not a multiple of the
+// number of GPUs, and the small chunks make the shards go through the host in
+// several steps.
+TEST(NCCLHierarchicalAllreduceTest, Sum) {
+  const int gpus = NumCudaDevices();
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  const int n = 1001;
+
+  NetDef net_def;
+  net_def.set_name("hierarchical_allreduce");
+  DeviceOption gpu0;
+  gpu0.set_device_type(CUDA);
+  net_def.add_op()->CopyFrom(CreateOperatorDef(
+      "CreateCommonWorld",
+      "",
+      vector<string>{},
+      vector<string>{"comm"},
+      vector<Argument>{},
+      gpu0,
+      "MPI"));
+  vector<string> inputs{"comm"};
+  vector<string> outputs;
+  for (int i = 0; i < gpus; ++i) {
+    DeviceOption gpu;
+    gpu.set_device_type(CUDA);
+    gpu.set_cuda_gpu_id(i);
+    const string x = "X_" + caffe2::to_string(i);
+    net_def.add_op()->CopyFrom(CreateOperatorDef(
+        "ConstantFill",
+        "",
+        vector<string>{},
+        vector<string>{x},
+        vector<Argument>{
+            MakeArgument<vector<int>>("shape", {n}),
+            MakeArgument<float>("value", rank * gpus + i + 1)},
+        gpu,
+        ""));
+    inputs.push_back(x);
+    outputs.push_back("Y_" + caffe2::to_string(i));
+  }
+  net_def.add_op()->CopyFrom(CreateOperatorDef(
+      "NCCLHierarchicalAllreduce",
+      "",
+      inputs,
+      outputs,
+      vector<Argument>{MakeArgument<int>("chunk_bytes", 256)},
+      gpu0,
+      ""));
+
+  Workspace ws;
+  unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+  ASSERT_NE(nullptr, net.get());
+  const float total = size * gpus;
+  for (int run = 0; run < 2; ++run) {
+    EXPECT_TRUE(net->Run());
+    for (const auto& output : outputs) {
+      TensorCPU Y(ws.GetBlob(output)->Get<TensorCUDA>());
+      EXPECT_EQ(Y.size(), n);
+      for (int j = 0; j < Y.size(); ++j) {
+        EXPECT_EQ(Y.data<float>()[j], total * (total + 1) / 2);
+      }
+    }
+  }
+}
+
+} // namespace caffe2
+
+GTEST_API_ int main(int argc, char** argv) {
+  int mpi_ret;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mpi_ret);
+  testing::InitGoogleTest(&argc, argv);
+  caffe2::GlobalInit(&argc, &argv);
+  int test_result = RUN_ALL_TESTS();
+  MPI_Finalize();
+  return test_result;
+}
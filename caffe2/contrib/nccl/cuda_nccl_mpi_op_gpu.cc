@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/mpi/mpi_common.h"
+
+#include "cuda_nccl_gpu.h"
+
+namespace caffe2 {
+
+// Sums tensors over the GPUs of all the nodes in three steps:
+//
+// 1. A NCCL reduce-scatter leaves the i-th shard of the sum of the node on
+//    its i-th GPU.
+// 2. The i-th GPUs of all the nodes allreduce their shard over MPI. Each GPU
+//    has its own communicator, the ring it leads for its shard, and runs in
+//    its own thread when MPI supports MPI_THREAD_MULTIPLE, so that the
+//    shards are on the wire at the same time and MPI can spread the rings
+//    over the NICs of the node. A shard is copied through pinned host memory
+//    in chunks, copying the next chunk while the current one is reduced.
+// 3. A NCCL allgather of the shards leaves the whole sum on every GPU.
+//
+// Every node sends and receives about 2 * (nodes - 1) / nodes of the tensor
+// once, instead of once per GPU as with a flat allreduce over all the GPUs.
+template <typename T>
+class NCCLHierarchicalAllreduceOp final : public Operator<CUDAContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CUDAContext);
+  NCCLHierarchicalAllreduceOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CUDAContext>(operator_def, ws),
+        chunk_bytes_(
+            OperatorBase::GetSingleArgument<int>("chunk_bytes", 1 << 20)) {
+    CAFFE_ENFORCE_GE(chunk_bytes_, sizeof(T));
+    CAFFE_ENFORCE_EQ(InputSize(), OutputSize() + 1);
+  }
+
+  ~NCCLHierarchicalAllreduceOp() {
+    for (auto& ring : rings_) {
+      DeviceGuard guard(ring.device);
+      CUDA_CHECK(cudaFreeHost(ring.host));
+      CUDA_CHECK(cudaStreamDestroy(ring.stream));
+      CUDA_CHECK(cudaEventDestroy(ring.copied[0]));
+      CUDA_CHECK(cudaEventDestroy(ring.copied[1]));
+      CUDA_CHECK(cudaEventDestroy(ring.done));
+      int finalized;
+      MPI_Finalized(&finalized);
+      if (!finalized) {
+        MPI_Comm_free(&ring.comm);
+      }
+    }
+    if (!rings_.empty()) {
+      DeviceGuard guard(context_.cuda_gpu_id());
+      CUDA_CHECK(cudaEventDestroy(scattered_));
+    }
+  }
+
+  bool RunOnDevice() override {
+    const int n = OutputSize();
+    const auto size = Input(1).size();
+    const auto shard = (size + n - 1) / n;
+    nccl::NCCLExecution ex;
+    ex.stream_gpu_id = context_.cuda_gpu_id();
+    ex.stream = context_.cuda_stream();
+    ex.elements.resize(n);
+    scratch_.resize(n);
+    for (int i = 0; i < n; ++i) {
+      CAFFE_ENFORCE_EQ(Input(i + 1).size(), size);
+      auto& el = ex.elements[i];
+      el.src = &Input(i + 1);
+      el.dst = &scratch_[i];
+      el.device = GetGPUIDForPointer(Input(i + 1).raw_data());
+      // Allocated here, as NCCL launches lock out allocations.
+      DeviceGuard guard(el.device);
+      scratch_[i].Resize(shard * n);
+      scratch_[i].template mutable_data<T>();
+      Output(i)->ResizeLike(Input(i + 1));
+      Output(i)->template mutable_data<T>();
+    }
+    if (rings_.empty()) {
+      CreateRings(ex);
+    }
+    CAFFE_ENFORCE_EQ(rings_.size(), n);
+    for (int i = 0; i < n; ++i) {
+      CAFFE_ENFORCE_EQ(
+          rings_[i].device,
+          ex.elements[i].device,
+          "The inputs moved to other GPUs since the first run.");
+    }
+
+    nccl::NCCL<T>::ReduceScatter(ex);
+    CUDA_CHECK(cudaEventRecord(scattered_, context_.cuda_stream()));
+    int thread_level;
+    MPI_CHECK(MPI_Query_thread(&thread_level));
+    if (thread_level == MPI_THREAD_MULTIPLE && n > 1) {
+      std::vector<std::exception_ptr> errors(n);
+      std::vector<std::thread> threads;
+      for (int i = 0; i < n; ++i) {
+        threads.emplace_back([this, i, shard, size, &errors] {
+          try {
+            AllreduceShard(i, shard, size, false);
+          } catch (...) {
+            errors[i] = std::current_exception();
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      for (auto& error : errors) {
+        if (error) {
+          std::rethrow_exception(error);
+        }
+      }
+    } else {
+      for (int i = 0; i < n; ++i) {
+        AllreduceShard(i, shard, size, true);
+      }
+    }
+    for (const auto& ring : rings_) {
+      CUDA_CHECK(cudaStreamWaitEvent(context_.cuda_stream(), ring.done, 0));
+    }
+    nccl::NCCL<T>::AllGatherShards(ex);
+
+    for (int i = 0; i < n; ++i) {
+      CUDA_CHECK(cudaMemcpyAsync(
+          Output(i)->template mutable_data<T>(),
+          scratch_[i].template data<T>(),
+          size * sizeof(T),
+          cudaMemcpyDefault,
+          context_.cuda_stream()));
+    }
+    return true;
+  }
+
+ private:
+  // The state of the inter-node ring of one local GPU.
+  struct Ring {
+    int device;
+    MPI_Comm comm;
+    cudaStream_t stream;
+    // Two halves of chunk_bytes_ each: one is reduced over MPI while the
+    // other is copied to or from the GPU.
+    T* host;
+    cudaEvent_t copied[2];
+    cudaEvent_t done;
+  };
+
+  void CreateRings(const nccl::NCCLExecution& ex) {
+    MPI_Comm comm = OperatorBase::Input<MPICommonWorldWrapper>(0).comm();
+    {
+      DeviceGuard guard(context_.cuda_gpu_id());
+      CUDA_CHECK(cudaEventCreateWithFlags(
+          &scattered_, cudaEventDefault | cudaEventDisableTiming));
+    }
+    rings_.resize(ex.elements.size());
+    for (int i = 0; i < rings_.size(); ++i) {
+      auto& ring = rings_[i];
+      ring.device = ex.elements[i].device;
+      MPI_CHECK(MPI_Comm_dup(comm, &ring.comm));
+      DeviceGuard guard(ring.device);
+      CUDA_CHECK(
+          cudaStreamCreateWithFlags(&ring.stream, cudaStreamNonBlocking));
+      CUDA_CHECK(cudaMallocHost(&ring.host, 2 * chunk_bytes_));
+      for (auto* event : {&ring.copied[0], &ring.copied[1], &ring.done}) {
+        CUDA_CHECK(cudaEventCreateWithFlags(
+            event, cudaEventDefault | cudaEventDisableTiming));
+      }
+    }
+  }
+
+  // Allreduces the part of shard i that is in the tensor.
+  void AllreduceShard(int i, TIndex shard, TIndex size, bool serialized) {
+    auto& ring = rings_[i];
+    DeviceGuard guard(ring.device);
+    CUDA_CHECK(cudaStreamWaitEvent(ring.stream, scattered_, 0));
+    T* data = scratch_[i].template mutable_data<T>() + i * shard;
+    const TIndex count = std::max<TIndex>(
+        0, std::min<TIndex>(shard, size - i * shard));
+    const TIndex chunk = std::max<TIndex>(1, chunk_bytes_ / sizeof(T));
+    const TIndex chunks = (count + chunk - 1) / chunk;
+    auto copy_in = [&](TIndex c) {
+      const TIndex len = std::min(chunk, count - c * chunk);
+      CUDA_CHECK(cudaMemcpyAsync(
+          ring.host + (c % 2) * chunk,
+          data + c * chunk,
+          len * sizeof(T),
+          cudaMemcpyDeviceToHost,
+          ring.stream));
+      CUDA_CHECK(cudaEventRecord(ring.copied[c % 2], ring.stream));
+    };
+    if (chunks > 0) {
+      copy_in(0);
+    }
+    for (TIndex c = 0; c < chunks; ++c) {
+      // The stream copies the other half back before copying it in again.
+      if (c + 1 < chunks) {
+        copy_in(c + 1);
+      }
+      T* host = ring.host + (c % 2) * chunk;
+      const TIndex len = std::min(chunk, count - c * chunk);
+      CUDA_CHECK(cudaEventSynchronize(ring.copied[c % 2]));
+      if (serialized) {
+        MPI_CHECK(MPI_Allreduce(
+            MPI_IN_PLACE,
+            host,
+            len,
+            MPIDataTypeWrapper<T>::type(),
+            MPI_SUM,
+            ring.comm));
+      } else {
+        // MPI_THREAD_MULTIPLE: the rings do not take the MPI mutex, so that
+        // they run concurrently on their own communicators.
+        CAFFE_ENFORCE_EQ(
+            MPI_Allreduce(
+                MPI_IN_PLACE,
+                host,
+                len,
+                MPIDataTypeWrapper<T>::type(),
+                MPI_SUM,
+                ring.comm),
+            MPI_SUCCESS);
+      }
+      CUDA_CHECK(cudaMemcpyAsync(
+          data + c * chunk,
+          host,
+          len * sizeof(T),
+          cudaMemcpyHostToDevice,
+          ring.stream));
+    }
+    CUDA_CHECK(cudaEventRecord(ring.done, ring.stream));
+  }
+
+  const int chunk_bytes_;
+  // The padded sums on each GPU, split in shards.
+  std::vector<TensorCUDA> scratch_;
+  std::vector<Ring> rings_;
+  cudaEvent_t scattered_;
+};
+
+namespace {
+REGISTER_CUDA_OPERATOR(
+    NCCLHierarchicalAllreduce,
+    NCCLHierarchicalAllreduceOp<float>);
+OPERATOR_SCHEMA(NCCLHierarchicalAllreduce)
+    .NumInputs(2, CAFFE2_COMPILE_TIME_MAX_GPUS + 1)
+    .NumOutputs(1, CAFFE2_COMPILE_TIME_MAX_GPUS)
+    .NumInputsOutputs([](int in, int out) { return in == out + 1; })
+    .AllowInplace([](int in, int out) { return in == out + 1; })
+    .SetDoc(R"DOC(
+Sums the tensors X_i, one per local GPU, over all the GPUs of all the nodes
+of the MPI common world, and writes the sum to every Y_i. Within a node the
+sum is computed with NCCL, and each GPU allreduces a shard of it across the
+nodes over MPI, so that all the shards are on the wire at once.
+)DOC")
+    .Arg(
+        "chunk_bytes",
+        "(int, default 1MB) The size of the chunks in which the shards are "
+        "copied through the host, overlapping the copies and MPI.")
+    .Input(0, "comm_world", "The MPI common world.")
+    .Input(1, "X_0", "The tensor on the first GPU; more follow, one per GPU.")
+    .Output(0, "Y_0", "The sum on the first GPU; more follow, one per GPU.");
+SHOULD_NOT_DO_GRADIENT(NCCLHierarchicalAllreduce);
+} // namespace
+
+} // namespace caffe2
@@ -1,11 +1,18 @@
-#include <mkl_service.h>
+#include <memory>
+#include <mutex>
+
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel_for.h"
 #include "caffe2/operators/conv_pool_op_base.h"
 #include "caffe2/utils/math.h"
 #include "nnpack.h"
 
+#if CAFFE2_MOBILE
+#include "caffe2/utils/threadpool/pthreadpool_impl.h"
+#endif // CAFFE2_MOBILE
+
 namespace caffe2 {
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -46,20 +53,48 @@ nnp_convolution_transform_strategy get_nnp_convolution_transform_strategy(
 // Thread Pool
 ////////////////////////////////////////////////////////////////////////////////
 
-static pthreadpool_t nnpack_threadpool_ = nullptr;
-
-pthreadpool_t nnpack_threadpool() {
-  if (nnpack_threadpool_ == nullptr) {
+void nnpack_initialize() {
+  static std::once_flag once;
+  std::call_once(once, []() {
     enum nnp_status nnpack_status = nnp_initialize();
     CAFFE_ENFORCE(
         nnpack_status == nnp_status_success, "NNPack is not supported here!");
-    auto num_mkl_threads = mkl_get_max_threads();
-    nnpack_threadpool_ = pthreadpool_create(num_mkl_threads);
-  }
-  return nnpack_threadpool_;
-}
+  });
 }
 
+// The threads that the NNPACK ops run on. On mobile, this wraps the thread
+// pool of the workspace, which ParallelFor() runs the other CPU ops on, so
+// that NNPACK does not start threads of its own. Elsewhere the other ops run
+// on OpenMP threads, and the NNPACK ops share one pthreadpool of as many
+// threads.
+class NNPACKThreadPool {
+ public:
+  explicit NNPACKThreadPool(Workspace* ws) {
+    nnpack_initialize();
+#if CAFFE2_MOBILE
+    wrapper_.reset(new pthreadpool(ws->GetThreadPool()));
+#else
+    (void)ws;
+#endif // CAFFE2_MOBILE
+  }
+
+  pthreadpool_t get() const {
+#if CAFFE2_MOBILE
+    return wrapper_.get();
+#else
+    static pthreadpool_t threadpool =
+        pthreadpool_create(ParallelForNumThreads(nullptr));
+    return threadpool;
+#endif // CAFFE2_MOBILE
+  }
+
+ private:
+#if CAFFE2_MOBILE
+  std::unique_ptr<pthreadpool> wrapper_;
+#endif // CAFFE2_MOBILE
+};
+} // namespace
+
 ////////////////////////////////////////////////////////////////////////////////
 // Definitions
 ////////////////////////////////////////////////////////////////////////////////
@@ -71,7 +106,8 @@ class NNPACKConvOp final : public ConvPoolOpBase<CPUContext> {
         algo_(get_nnp_convolution_algorithm(
             OperatorBase::GetSingleArgument<std::string>("algo", "AUTO"))),
         kts_(get_nnp_convolution_transform_strategy(
-            OperatorBase::GetSingleArgument<std::string>("kts", "TUPLE"))) {
+            OperatorBase::GetSingleArgument<std::string>("kts", "TUPLE"))),
+        threadpool_(ws) {
     OPERATOR_NEEDS_FEATURE(
         this->order_ == StorageOrder::NCHW,
         "NNPack only supports NCHW order. Please consider adding "
@@ -85,6 +121,7 @@ class NNPACKConvOp final : public ConvPoolOpBase<CPUContext> {
  private:
   const nnp_convolution_algorithm algo_;
   const nnp_convolution_transform_strategy kts_;
+  NNPACKThreadPool threadpool_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -145,7 +182,7 @@ bool NNPACKConvOp::RunOnDeviceWithOrderNCHW() {
         filter.template data<float>(),
         bias.template data<float>(),
         Y->template mutable_data<float>(),
-        nnpack_threadpool(),
+        threadpool_.get(),
         nullptr);
     CAFFE_ENFORCE(nnp_status_success == status, "");
   } else {
@@ -162,7 +199,7 @@ bool NNPACKConvOp::RunOnDeviceWithOrderNCHW() {
         filter.template data<float>(),
         bias.template data<float>(),
         Y->template mutable_data<float>(),
-        nnpack_threadpool(),
+        threadpool_.get(),
         nullptr);
     CAFFE_ENFORCE(nnp_status_success == status, "");
   }
@@ -176,7 +213,7 @@ bool NNPACKConvOp::RunOnDeviceWithOrderNCHW() {
 class NNPACKMaxPoolOp final : public ConvPoolOpBase<CPUContext> {
  public:
   NNPACKMaxPoolOp(const OperatorDef& operator_def, Workspace* ws)
-      : ConvPoolOpBase<CPUContext>(operator_def, ws) {
+      : ConvPoolOpBase<CPUContext>(operator_def, ws), threadpool_(ws) {
     OPERATOR_NEEDS_FEATURE(
         this->order_ == StorageOrder::NCHW,
         "NNPack only supports NCHW order. Please consider add "
@@ -207,6 +244,7 @@ class NNPACKMaxPoolOp final : public ConvPoolOpBase<CPUContext> {
   bool RunOnDeviceWithOrderNCHW() override;
 
  private:
+  NNPACKThreadPool threadpool_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -249,12 +287,112 @@ bool NNPACKMaxPoolOp::RunOnDeviceWithOrderNCHW() {
       pooling_stride,
       X.template data<float>(),
       Y->template mutable_data<float>(),
-      nnpack_threadpool());
+      threadpool_.get());
+  CAFFE_ENFORCE(nnp_status_success == status, "");
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////////////////////////
+
+class NNPACKFullyConnectedOp final : public Operator<CPUContext> {
+ public:
+  NNPACKFullyConnectedOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        axis_(OperatorBase::GetSingleArgument<int32_t>("axis", 1)),
+        threadpool_(ws) {
+    OPERATOR_NEEDS_FEATURE(
+        __builtin_cpu_supports("avx2"), "NNPack requires AVX2");
+  }
+  bool RunOnDevice() override;
+
+ private:
+  const int axis_;
+  NNPACKThreadPool threadpool_;
+};
+
+class NNPACKReluOp final : public Operator<CPUContext> {
+ public:
+  NNPACKReluOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws), threadpool_(ws) {
+    OPERATOR_NEEDS_FEATURE(
+        __builtin_cpu_supports("avx2"), "NNPack requires AVX2");
+  }
+  bool RunOnDevice() override;
+
+ private:
+  NNPACKThreadPool threadpool_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementations
+////////////////////////////////////////////////////////////////////////////////
+
+bool NNPACKFullyConnectedOp::RunOnDevice() {
+  auto& X = Input(0);
+  auto& W = Input(1);
+  auto& b = Input(2);
+  auto* Y = Output(0);
+  CAFFE_ENFORCE(b.ndim() == 1, b.ndim());
+  // batch size
+  const auto canonical_axis = X.canonical_axis_index(axis_);
+  const int M = X.size_to_dim(canonical_axis);
+  const int K = X.size_from_dim(canonical_axis);
+  const int N = W.dim32(0);
+  CAFFE_ENFORCE(M * K == X.size());
+  CAFFE_ENFORCE(K == W.size() / W.dim32(0));
+  CAFFE_ENFORCE(N == b.dim32(0));
+  Y->Resize(M, N);
+
+  // The weights are N x K, which is the kernel layout NNPACK wants.
+  if (M == 1) {
+    VLOG(1) << "Running inference mode";
+    const auto status = nnp_fully_connected_inference(
+        K,
+        N,
+        X.template data<float>(),
+        W.template data<float>(),
+        Y->template mutable_data<float>(),
+        threadpool_.get());
+    CAFFE_ENFORCE(nnp_status_success == status, "");
+  } else {
+    VLOG(1) << "Running batched mode";
+    const auto status = nnp_fully_connected_output(
+        M,
+        K,
+        N,
+        X.template data<float>(),
+        W.template data<float>(),
+        Y->template mutable_data<float>(),
+        threadpool_.get(),
+        nullptr);
+    CAFFE_ENFORCE(nnp_status_success == status, "");
+  }
+  // NNPACK has no bias, so it is added to every row.
+  EigenMatrixMap<float>(Y->template mutable_data<float>(), N, M).colwise() +=
+      ConstEigenVectorMap<float>(b.template data<float>(), N);
+  return true;
+}
+
+bool NNPACKReluOp::RunOnDevice() {
+  auto& X = Input(0);
+  auto* Y = Output(0);
+  Y->ResizeLike(X);
+  const auto status = nnp_relu_output(
+      1,
+      X.size(),
+      X.template data<float>(),
+      Y->template mutable_data<float>(),
+      0.0f,
+      threadpool_.get());
   CAFFE_ENFORCE(nnp_status_success == status, "");
   return true;
 }
 
 REGISTER_CPU_OPERATOR_WITH_ENGINE(Conv, NNPACK, NNPACKConvOp);
 REGISTER_CPU_OPERATOR_WITH_ENGINE(MaxPool, NNPACK, NNPACKMaxPoolOp);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(FC, NNPACK, NNPACKFullyConnectedOp);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(Relu, NNPACK, NNPACKReluOp);
 
 } // namespace caffe2
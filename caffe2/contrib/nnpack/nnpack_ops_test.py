@@ -121,6 +121,58 @@ class NNPackOpsTest(hu.HypothesisTestCase):
             atol=1e-4,
             rtol=1e-4)
 
+    @given(input_channels=st.integers(1, 64),
+           output_channels=st.integers(1, 64),
+           batch_size=st.integers(1, 5))
+    def test_fully_connected_correctness(self, input_channels, output_channels,
+                                         batch_size):
+        X = np.random.rand(
+            batch_size, input_channels).astype(np.float32) - 0.5
+        w = np.random.rand(
+            output_channels, input_channels).astype(np.float32) - 0.5
+        b = np.random.rand(output_channels).astype(np.float32) - 0.5
+        outputs = {}
+        for engine in ["", "NNPACK"]:
+            op = core.CreateOperator(
+                "FC",
+                ["X", "w", "b"],
+                ["Y"],
+                engine=engine,
+            )
+            self.ws.create_blob("X").feed(X)
+            self.ws.create_blob("w").feed(w)
+            self.ws.create_blob("b").feed(b)
+            self.ws.run(op)
+            outputs[engine] = self.ws.blobs["Y"].fetch()
+        np.testing.assert_allclose(
+            outputs[""],
+            outputs["NNPACK"],
+            atol=1e-4,
+            rtol=1e-4)
+
+    @given(size=st.integers(1, 10),
+           input_channels=st.integers(1, 8),
+           batch_size=st.integers(1, 5))
+    def test_relu_correctness(self, size, input_channels, batch_size):
+        X = np.random.rand(
+            batch_size, input_channels, size, size).astype(np.float32) - 0.5
+        outputs = {}
+        for engine in ["", "NNPACK"]:
+            op = core.CreateOperator(
+                "Relu",
+                ["X"],
+                ["Y"],
+                engine=engine,
+            )
+            self.ws.create_blob("X").feed(X)
+            self.ws.run(op)
+            outputs[engine] = self.ws.blobs["Y"].fetch()
+        np.testing.assert_allclose(
+            outputs[""],
+            outputs["NNPACK"],
+            atol=1e-4,
+            rtol=1e-4)
+
     @settings(timeout=3600)
     @unittest.skipIf(not os.environ.get("CAFFE2_BENCHMARK"), "Benchmark")
     @given(stride=st.integers(1, 1),
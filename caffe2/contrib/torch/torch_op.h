@@ -28,6 +28,32 @@ struct TyTraits<CPUContext> {
   using Tensor = THFloatTensor;
 };
 
+// Torch storages that wrap Caffe2 tensors, e.g. the inputs, parameters and
+// outputs of a module, share the data of the tensor instead of copying it.
+// The allocator context of such a storage is a tensor that shares the data,
+// and keeps it alive until Torch frees the storage, even if the blob is
+// resized or freed in the meantime. The storages cannot be resized, so a
+// module cannot move a wrapped tensor to a buffer of its own without Caffe2
+// knowing.
+inline void freeSharedTensor(void* context, void* /* data */) {
+  delete static_cast<Tensor<CPUContext>*>(context);
+}
+
+inline THFloatStorage* newSharedStorage(Tensor<CPUContext>* tc) {
+  static THAllocator allocator = [] {
+    THAllocator allocator = {};
+    allocator.free = &freeSharedTensor;
+    return allocator;
+  }();
+  auto* shared = new Tensor<CPUContext>();
+  shared->ResizeLike(*tc);
+  shared->ShareData(*tc);
+  THFloatStorage* storage = THFloatStorage_newWithDataAndAllocator(
+      tc->template mutable_data<float>(), tc->size(), &allocator, shared);
+  THFloatStorage_clearFlag(storage, TH_STORAGE_RESIZABLE);
+  return storage;
+}
+
 template <typename Context>
 class Torch final {
  public:
@@ -62,9 +88,7 @@ class Torch final {
     CAFFE_ENFORCE_EQ(tensorTy(*blob), Traits::tensorTy);
     auto* tc = blob->template GetMutable<Tensor<Context>>();
     CAFFE_ENFORCE_EQ(THFloatTensor_nElement(t), tc->size());
-    THFloatStorage* storage = THFloatStorage_newWithData(
-        tc->template mutable_data<float>(), tc->size());
-    THFloatStorage_clearFlag(storage, TH_STORAGE_FREEMEM);
+    THFloatStorage* storage = newSharedStorage(tc);
     THFloatStorage* original = t->storage;
     t->storage = storage;
     THFloatStorage_free(original);
@@ -89,14 +113,11 @@ class Torch final {
     CAFFE_ENFORCE_EQ(tensorTy(*blob), Traits::tensorTy);
     auto* tc = blob->template GetMutable<Tensor<Context>>();
 
-    size_t size = tc->size();
     THLongStorage* thshape = THLongStorage_newWithSize(tc->ndim());
     for (int i = 0; i < tc->ndim(); ++i) {
       THLongStorage_set(thshape, i, tc->dim(i));
     }
-    THFloatStorage* storage =
-        THFloatStorage_newWithData(tc->template mutable_data<float>(), size);
-    THFloatStorage_clearFlag(storage, TH_STORAGE_FREEMEM);
+    THFloatStorage* storage = newSharedStorage(tc);
     auto* th = THFloatTensor_newWithStorage(storage, 0, thshape, nullptr);
     THFloatStorage_free(storage);
     THLongStorage_free(thshape);
@@ -130,26 +151,48 @@ class Torch final {
     return res;
   }
 
-  void verifyOutput(Blob* dst, typename Traits::Tensor* torchDst) {
-    if (!luaT_isudata(L(), -1, Traits::tensorTy)) {
-      LOG(FATAL) << "Unsupported Torch tensor type " << luaT_typename(L(), -1);
-    }
-
-    // Invariant: dst has the same size as src, and has the same data
-    // values as src.
+  // Makes the blob hold the output of the module, on top of the Lua stack.
+  // That is the tensor that pushTable() gave the module, unless the module
+  // replaced it, e.g. with a view of its input. The blob then shares the
+  // storage of the Torch tensor, or copies it if it is not contiguous.
+  void adoptOutput(Blob* dst, typename Traits::Tensor* torchDst) {
+    CAFFE_ENFORCE(
+        luaT_isudata(L(), -1, Traits::tensorTy),
+        "Unsupported Torch tensor type ",
+        luaT_typename(L(), -1));
     auto* src = static_cast<typename Traits::Tensor*>(
         luaT_toudata(L(), -1, Traits::tensorTy));
-    auto* thDst = static_cast<typename Traits::Tensor*>(torchDst);
     auto* tcDst = dst->template GetMutable<Tensor<Context>>();
-    CAFFE_ENFORCE(src->storage->data);
-    CAFFE_ENFORCE(src->storage->size);
-    CAFFE_ENFORCE_EQ(src->storage->data, thDst->storage->data);
-    CAFFE_ENFORCE_EQ(src->storage->data, tcDst->template data<float>());
-    CAFFE_ENFORCE_EQ(src->storage->size, thDst->storage->size);
-    CAFFE_ENFORCE_EQ(src->storage->size, tcDst->size());
+    const auto shape = tensorShape(src);
+    const bool contiguous = THFloatTensor_isContiguous(src);
+    if (contiguous && THFloatTensor_nElement(src) == tcDst->size() &&
+        THFloatTensor_data(src) == tcDst->template data<float>()) {
+      // The module wrote to the tensor that it was given.
+      tcDst->Reshape(shape);
+      return;
+    }
+    VLOG(1) << "Torch module output is not the tensor of the blob, "
+            << (contiguous ? "sharing" : "copying") << " it";
+    tcDst->Resize(shape);
+    if (tcDst->size() == 0) {
+      tcDst->template mutable_data<float>();
+      return;
+    }
+    if (contiguous) {
+      THFloatStorage* storage = src->storage;
+      THFloatStorage_retain(storage);
+      tcDst->ShareExternalPointer(
+          THFloatTensor_data(src),
+          0,
+          [storage](void*) { THFloatStorage_free(storage); });
+      return;
+    }
+    auto* wrapped = blobToTensor(dst);
+    THFloatTensor_copy(wrapped, src);
+    THFloatTensor_free(wrapped);
   }
 
-  void verifyOutputs(
+  void adoptOutputs(
       const std::vector<Blob*>& blobs,
       const std::vector<typename Traits::Tensor*>& tensors) {
     CAFFE_ENFORCE_EQ(tensors.size(), blobs.size());
@@ -159,7 +202,7 @@ class Torch final {
     }
 
     if (blobs.size() == 1) {
-      verifyOutput(blobs[0], tensors[0]);
+      adoptOutput(blobs[0], tensors[0]);
       return;
     }
 
@@ -167,7 +210,7 @@ class Torch final {
     lua_pushnil(L());
     for (auto i = 0; i < blobs.size(); ++i) {
       CAFFE_ENFORCE(lua_next(L(), -2));
-      verifyOutput(blobs[i], tensors[i]);
+      adoptOutput(blobs[i], tensors[i]);
       lua_pop(L(), 1);
     }
     lua_pop(L(), 1);
@@ -413,7 +456,7 @@ class TorchOp : public TorchOpBase<Context> {
     // | self | updateOutput | self | inputs
     int err = lua_pcall(L, 2, 1, 0); // doesn't need the output
     CAFFE_ENFORCE_EQ(err, 0, lua_tostring(L, -1));
-    state_.verifyOutputs(Outputs(), torchOutputs);
+    state_.adoptOutputs(Outputs(), torchOutputs);
     lua_pop(L, 2);
     CAFFE_ENFORCE_EQ(lua_gettop(L), 0);
     return true;
@@ -566,7 +609,7 @@ class TorchGradientOp : public TorchOpBase<Context> {
     lua_pushvalue(L, -4);
     err = lua_pcall(L, 3, 1, 0); // doesn't need the output
     CAFFE_ENFORCE_EQ(err, 0, lua_tostring(L, -1));
-    state_.verifyOutputs(gradInputBlobs, torchGradInputs);
+    state_.adoptOutputs(gradInputBlobs, torchGradInputs);
     lua_pop(L, 4);
     CAFFE_ENFORCE_EQ(lua_gettop(L), 0);
     return true;
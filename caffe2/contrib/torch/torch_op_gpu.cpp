@@ -38,6 +38,27 @@ THCState* cudaState(Torch<CUDAContext>* t) {
   return state;
 }
 
+// The CUDA counterpart of newSharedStorage() in torch_op.h.
+cudaError_t freeSharedTensor(void* context, void* /* data */) {
+  delete static_cast<Tensor<CUDAContext>*>(context);
+  return cudaSuccess;
+}
+
+THCudaStorage* newSharedStorage(THCState* cs, Tensor<CUDAContext>* tc) {
+  static THCDeviceAllocator allocator = [] {
+    THCDeviceAllocator allocator = {};
+    allocator.free = &freeSharedTensor;
+    return allocator;
+  }();
+  auto* shared = new Tensor<CUDAContext>();
+  shared->ResizeLike(*tc);
+  shared->ShareData(*tc);
+  THCudaStorage* storage = THCudaStorage_newWithDataAndAllocator(
+      cs, tc->template mutable_data<float>(), tc->size(), &allocator, shared);
+  THCudaStorage_clearFlag(cs, storage, TH_STORAGE_RESIZABLE);
+  return storage;
+}
+
 template <>
 void Torch<CUDAContext>::setContext(CUDAContext* context) {
   THCState *state = cudaState(this);
@@ -52,9 +73,7 @@ void Torch<CUDAContext>::setTensor(typename Traits::Tensor* t, Blob* blob) {
   auto* cs = cudaState(this);
   auto* tc = blob->template GetMutable<Tensor<CUDAContext>>();
   CAFFE_ENFORCE_EQ(THCudaTensor_nElement(cs, t), tc->size());
-  THCudaStorage* storage = THCudaStorage_newWithData(
-      cs, tc->template mutable_data<float>(), tc->size());
-  THCudaStorage_clearFlag(cs, storage, TH_STORAGE_FREEMEM);
+  THCudaStorage* storage = newSharedStorage(cs, tc);
   THCudaStorage* original = t->storage;
   t->storage = storage;
   THCudaStorage_free(cs, original);
@@ -67,14 +86,11 @@ typename Torch<CUDAContext>::Traits::Tensor* Torch<CUDAContext>::blobToTensor(
   auto* cs = cudaState(this);
   auto* tc = blob->template GetMutable<Tensor<CUDAContext>>();
 
-  size_t size = tc->size();
   THLongStorage* thshape = THLongStorage_newWithSize(tc->ndim());
   for (int i = 0; i < tc->ndim(); ++i) {
     THLongStorage_set(thshape, i, tc->dim(i));
   }
-  THCudaStorage* storage =
-      THCudaStorage_newWithData(cs, tc->template mutable_data<float>(), size);
-  THCudaStorage_clearFlag(cs, storage, TH_STORAGE_FREEMEM);
+  THCudaStorage* storage = newSharedStorage(cs, tc);
   auto* th = THCudaTensor_newWithStorage(cs, storage, 0, thshape, nullptr);
   THCudaStorage_free(cs, storage);
   THLongStorage_free(thshape);
@@ -103,6 +119,40 @@ typename Torch<CUDAContext>::Traits::Tensor* Torch<CUDAContext>::newTensorAs(
   THLongStorage_free(thshape);
   return d;
 }
+
+// Unlike on the CPU, outputs that the module replaced are copied: freeing a
+// THCudaStorage needs the THCState of the Lua state, which may be gone before
+// the blob.
+template <>
+void Torch<CUDAContext>::adoptOutput(
+    Blob* dst,
+    typename Traits::Tensor* torchDst) {
+  CAFFE_ENFORCE(
+      luaT_isudata(L(), -1, Traits::tensorTy),
+      "Unsupported Torch tensor type ",
+      luaT_typename(L(), -1));
+  auto* cs = cudaState(this);
+  auto* src = static_cast<typename Traits::Tensor*>(
+      luaT_toudata(L(), -1, Traits::tensorTy));
+  auto* tcDst = dst->template GetMutable<Tensor<CUDAContext>>();
+  const auto shape = tensorShape(src);
+  if (THCudaTensor_isContiguous(cs, src) &&
+      THCudaTensor_nElement(cs, src) == tcDst->size() &&
+      THCudaTensor_data(cs, src) == tcDst->template data<float>()) {
+    tcDst->Reshape(shape);
+    return;
+  }
+  VLOG(1) << "Torch module output is not the tensor of the blob, copying it";
+  tcDst->Resize(shape);
+  tcDst->template mutable_data<float>();
+  if (tcDst->size() == 0) {
+    return;
+  }
+  // The copy runs on the stream of the operator, see setContext().
+  auto* wrapped = blobToTensor(dst);
+  THCudaTensor_copy(cs, wrapped, src);
+  THCudaTensor_free(cs, wrapped);
+}
 }
 
 namespace {
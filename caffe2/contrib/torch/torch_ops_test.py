@@ -98,6 +98,28 @@ class TorchOpTest(hu.HypothesisTestCase):
         y = y.reshape((n, h))
         np.testing.assert_allclose(y, np.dot(x, W.T) + b, atol=1e-4, rtol=1e-4)
 
+    @given(n=st.integers(min_value=1, max_value=10),
+           i=st.integers(min_value=1, max_value=10))
+    def test_replaced_output(self, n, i):
+        # nn.Identity returns its input, and nn.Transpose a view of it that is
+        # not contiguous, instead of writing to the output that they are given.
+        for init, expected in [
+                (b"nn.Identity()", lambda x: x),
+                (b"nn.Transpose({1, 2})", lambda x: x.T)]:
+            op = core.CreateOperator(
+                "Torch", ["x"], ["y"],
+                init=init,
+                num_inputs=1,
+                num_params=0,
+                num_outputs=1
+            )
+            x = np.random.randn(n, i).astype(np.float32)
+            self.ws.create_blob("x").feed(x)
+            for _ in range(2):
+                self.ws.run(op)
+                np.testing.assert_array_equal(
+                    self.ws.blobs["y"].fetch(), expected(x))
+
     def test_leakage_torch(self):
         n = 1
         i = 100
@@ -0,0 +1,114 @@
+#include "caffe2/core/arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "caffe2/core/logging.h"
+
+CAFFE2_DEFINE_bool(
+    caffe2_arena_allocation,
+    false,
+    "If set, workspaces allocate their blobs and nets allocate their "
+    "operators from arenas, which are released all at once when the "
+    "workspace or the net is destroyed.");
+
+namespace caffe2 {
+
+constexpr size_t Arena::kAlignment;
+constexpr size_t Arena::kMinBlockBytes;
+constexpr size_t Arena::kMaxBlockBytes;
+
+Arena::~Arena() {
+  for (char* block : blocks_) {
+    free(block);
+  }
+}
+
+void* Arena::Allocate(size_t nbytes) {
+  nbytes = (nbytes + kAlignment - 1) / kAlignment * kAlignment;
+  if (nbytes > remaining_) {
+    const size_t block_bytes = std::max(nbytes, next_block_bytes_);
+    next_block_bytes_ = std::min(next_block_bytes_ * 2, kMaxBlockBytes);
+    // malloc returns memory aligned for any fundamental type, which is
+    // kAlignment on the platforms we care about.
+    char* block = static_cast<char*>(malloc(block_bytes));
+    if (!block) {
+      throw std::bad_alloc();
+    }
+    blocks_.push_back(block);
+    current_ = block;
+    remaining_ = block_bytes;
+    bytes_reserved_ += block_bytes;
+  }
+  void* ptr = current_;
+  current_ += nbytes;
+  remaining_ -= nbytes;
+  bytes_allocated_ += nbytes;
+  return ptr;
+}
+
+namespace {
+thread_local Arena* current_arena = nullptr;
+
+// Objects are preceded by the arena they live in, or nullptr if they live on
+// the heap, padded to keep the object aligned.
+constexpr size_t kHeaderBytes = Arena::kAlignment;
+static_assert(sizeof(Arena*) <= kHeaderBytes, "The header is too small.");
+
+inline void* PlaceHeader(void* base, Arena* arena) {
+  *static_cast<Arena**>(base) = arena;
+  return static_cast<char*>(base) + kHeaderBytes;
+}
+
+inline void* BaseOf(void* ptr) {
+  return static_cast<char*>(ptr) - kHeaderBytes;
+}
+} // namespace
+
+ArenaScope::ArenaScope(Arena* arena) : previous_(current_arena) {
+  current_arena = arena;
+}
+
+ArenaScope::~ArenaScope() {
+  current_arena = previous_;
+}
+
+Arena* ArenaScope::Current() {
+  return current_arena;
+}
+
+void* ArenaAllocated::operator new(size_t nbytes) {
+  void* base = malloc(nbytes + kHeaderBytes);
+  if (!base) {
+    throw std::bad_alloc();
+  }
+  return PlaceHeader(base, nullptr);
+}
+
+void* ArenaAllocated::operator new(size_t nbytes, Arena* arena) {
+  if (!arena) {
+    return operator new(nbytes);
+  }
+  return PlaceHeader(arena->Allocate(nbytes + kHeaderBytes), arena);
+}
+
+void ArenaAllocated::operator delete(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  void* base = BaseOf(ptr);
+  if (*static_cast<Arena**>(base) == nullptr) {
+    free(base);
+  }
+}
+
+void ArenaAllocated::operator delete(void* ptr, Arena* /* unused */) {
+  operator delete(ptr);
+}
+
+void* ArenaAllocated::NewInCurrentArena(size_t nbytes) {
+  return operator new(nbytes, current_arena);
+}
+
+} // namespace caffe2
@@ -0,0 +1,105 @@
+#ifndef CAFFE2_CORE_ARENA_H_
+#define CAFFE2_CORE_ARENA_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/flags.h"
+
+CAFFE2_DECLARE_bool(caffe2_arena_allocation);
+
+namespace caffe2 {
+
+/**
+ * Arena hands out memory from large blocks, and releases all of it at once
+ * when it is destroyed. Allocating from an arena is a pointer bump, which
+ * makes it suited for the many small objects that are created together and
+ * live exactly as long as their owner, like the operators of a net or the
+ * blobs of a workspace.
+ *
+ * Arenas are not thread safe.
+ */
+class Arena {
+ public:
+  // The alignment of the memory returned by Allocate(), which is the one of
+  // operator new.
+  static constexpr size_t kAlignment = 16;
+
+  Arena() {}
+  ~Arena();
+
+  void* Allocate(size_t nbytes);
+
+  // The bytes handed out by Allocate(), and the bytes of the blocks.
+  size_t bytes_allocated() const {
+    return bytes_allocated_;
+  }
+  size_t bytes_reserved() const {
+    return bytes_reserved_;
+  }
+
+ private:
+  // Blocks start small, since most workspaces and nets are small, and
+  // double up to the maximum size.
+  static constexpr size_t kMinBlockBytes = 4096;
+  static constexpr size_t kMaxBlockBytes = 1 << 20;
+
+  std::vector<char*> blocks_;
+  char* current_ = nullptr;
+  size_t remaining_ = 0;
+  size_t next_block_bytes_ = kMinBlockBytes;
+  size_t bytes_allocated_ = 0;
+  size_t bytes_reserved_ = 0;
+
+  DISABLE_COPY_AND_ASSIGN(Arena);
+};
+
+/**
+ * While an ArenaScope is alive, operators that the calling thread creates are
+ * allocated from the given arena, which must outlive them. Nets use this to
+ * allocate their operators from an arena of their own, when
+ * --caffe2_arena_allocation or the "arena" argument of the net is set.
+ * Scopes can be nested, and a nullptr arena restores heap allocation.
+ */
+class ArenaScope {
+ public:
+  explicit ArenaScope(Arena* arena);
+  ~ArenaScope();
+
+  static Arena* Current();
+
+ private:
+  Arena* previous_;
+
+  DISABLE_COPY_AND_ASSIGN(ArenaScope);
+};
+
+/**
+ * Classes derived from ArenaAllocated can be placed in an arena with
+ * new (arena) T(...), and otherwise go to the heap. A class whose operator new
+ * calls NewInCurrentArena() goes to the arena of the current ArenaScope
+ * instead. Either way, objects are deleted as usual: deleting an object that
+ * lives in an arena runs its destructor, and its memory is released with the
+ * arena.
+ */
+struct ArenaAllocated {
+  static void* operator new(size_t nbytes);
+  static void* operator new(size_t nbytes, Arena* arena);
+  static void operator delete(void* ptr);
+  // Called if the constructor of an object placed in an arena throws.
+  static void operator delete(void* ptr, Arena* arena);
+  // Placement new, e.g. by std containers, is not affected.
+  static void* operator new(size_t /* unused */, void* ptr) {
+    return ptr;
+  }
+  static void operator delete(void* /* unused */, void* /* unused */) {}
+
+ protected:
+  // Allocates from the arena of the current ArenaScope, if any.
+  static void* NewInCurrentArena(size_t nbytes);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_ARENA_H_
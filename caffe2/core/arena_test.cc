@@ -0,0 +1,115 @@
+#include "caffe2/core/arena.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+struct ArenaTestObject : public ArenaAllocated {
+  explicit ArenaTestObject(int* destroyed) : destroyed(destroyed) {}
+  ~ArenaTestObject() {
+    ++*destroyed;
+  }
+  int* destroyed;
+  char payload[100];
+};
+
+Arena* arena_at_construction = nullptr;
+int num_destroyed_ops = 0;
+
+class ArenaTestOp final : public OperatorBase {
+ public:
+  ArenaTestOp(const OperatorDef& def, Workspace* ws) : OperatorBase(def, ws) {
+    arena_at_construction = ArenaScope::Current();
+  }
+  ~ArenaTestOp() {
+    ++num_destroyed_ops;
+  }
+  bool Run() override {
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(ArenaTest, ArenaTestOp);
+OPERATOR_SCHEMA(ArenaTest);
+
+} // namespace
+
+TEST(ArenaTest, Allocate) {
+  Arena arena;
+  void* first = arena.Allocate(1);
+  void* second = arena.Allocate(20);
+  EXPECT_EQ(reinterpret_cast<size_t>(first) % Arena::kAlignment, 0);
+  EXPECT_EQ(static_cast<char*>(second) - static_cast<char*>(first), 16);
+  EXPECT_EQ(arena.bytes_allocated(), 48);
+  // Larger allocations than a block get a block of their own.
+  arena.Allocate(1 << 20);
+  EXPECT_EQ(arena.bytes_allocated(), 48 + (1 << 20));
+  EXPECT_GE(arena.bytes_reserved(), arena.bytes_allocated());
+}
+
+TEST(ArenaTest, ArenaAllocated) {
+  int destroyed = 0;
+  Arena arena;
+  ArenaTestObject* in_arena = new (&arena) ArenaTestObject(&destroyed);
+  EXPECT_GT(arena.bytes_allocated(), sizeof(ArenaTestObject));
+  ArenaTestObject* on_heap = new ArenaTestObject(&destroyed);
+  delete in_arena;
+  delete on_heap;
+  EXPECT_EQ(destroyed, 2);
+}
+
+TEST(ArenaTest, ArenaScope) {
+  EXPECT_EQ(ArenaScope::Current(), nullptr);
+  Arena arena;
+  {
+    ArenaScope scope(&arena);
+    EXPECT_EQ(ArenaScope::Current(), &arena);
+    {
+      ArenaScope inner_scope(nullptr);
+      EXPECT_EQ(ArenaScope::Current(), nullptr);
+    }
+    EXPECT_EQ(ArenaScope::Current(), &arena);
+  }
+  EXPECT_EQ(ArenaScope::Current(), nullptr);
+}
+
+TEST(ArenaTest, NetOperatorsInArena) {
+  Workspace ws;
+  for (const string& type : {"simple", "dag"}) {
+    NetDef net_def;
+    net_def.set_type(type);
+    for (int i = 0; i < 3; ++i) {
+      net_def.add_op()->set_type("ArenaTest");
+    }
+    auto* arg = net_def.add_arg();
+    arg->set_name("arena");
+    arg->set_i(1);
+    arena_at_construction = nullptr;
+    num_destroyed_ops = 0;
+    {
+      std::unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+      ASSERT_TRUE(net.get() != nullptr);
+      EXPECT_NE(arena_at_construction, nullptr);
+      EXPECT_TRUE(net->Run());
+    }
+    EXPECT_EQ(num_destroyed_ops, 3);
+    EXPECT_EQ(ArenaScope::Current(), nullptr);
+  }
+}
+
+TEST(ArenaTest, WorkspaceBlobsInArena) {
+  FLAGS_caffe2_arena_allocation = true;
+  {
+    Workspace ws;
+    ws.CreateBlob("a")->GetMutable<TensorCPU>()->Resize(10);
+    ws.CreateBlob("b");
+    EXPECT_TRUE(ws.RemoveBlob("b"));
+    EXPECT_TRUE(ws.GetBlob("a")->IsType<TensorCPU>());
+  }
+  FLAGS_caffe2_arena_allocation = false;
+}
+
+} // namespace caffe2
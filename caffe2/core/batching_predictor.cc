@@ -0,0 +1,215 @@
+#include "caffe2/core/batching_predictor.h"
+
+#include <cstring>
+
+namespace caffe2 {
+
+namespace {
+
+void copyItems(const TypeMeta& meta, TIndex n, const void* src, void* dst) {
+  if (meta.copy()) {
+    meta.copy()(src, dst, n);
+  } else {
+    memcpy(dst, src, n * meta.itemsize());
+  }
+}
+
+void* itemAt(void* data, const TypeMeta& meta, TIndex i) {
+  return static_cast<char*>(data) + i * meta.itemsize();
+}
+
+const void* itemAt(const void* data, const TypeMeta& meta, TIndex i) {
+  return static_cast<const char*>(data) + i * meta.itemsize();
+}
+
+size_t latencyBucket(std::chrono::steady_clock::duration latency) {
+  auto us =
+      std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+  size_t bucket = 0;
+  while (us > 1) {
+    us >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+}
+
+BatchingPredictor::BatchingPredictor(
+    Predictor* predictor,
+    size_t max_batch_size,
+    std::chrono::microseconds timeout)
+    : predictor_(predictor),
+      max_batch_size_(max_batch_size),
+      timeout_(timeout) {
+  CAFFE_ENFORCE(predictor_);
+  CAFFE_ENFORCE_GT(max_batch_size_, 0);
+  worker_ = std::thread([this]() { worker(); });
+}
+
+BatchingPredictor::~BatchingPredictor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  queued_.notify_one();
+  worker_.join();
+}
+
+std::future<BatchingPredictor::Outputs> BatchingPredictor::run(
+    const TensorVector& inputs) {
+  CAFFE_ENFORCE(inputs.size(), "A request needs at least one input.");
+  Request request;
+  request.start = Clock::now();
+  request.rows = -1;
+  request.inputs.resize(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    CAFFE_ENFORCE_GT(inputs[i]->ndim(), 0, "Inputs are batched on dim 0.");
+    if (request.rows < 0) {
+      request.rows = inputs[i]->dim(0);
+    }
+    CAFFE_ENFORCE_EQ(
+        inputs[i]->dim(0),
+        request.rows,
+        "The inputs of a request must have the same number of rows.");
+    request.inputs[i].ResizeLike(*inputs[i]);
+    request.inputs[i].ShareData(*inputs[i]);
+  }
+  auto outputs = request.outputs.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_rows_ += request.rows;
+    queue_.push_back(std::move(request));
+  }
+  queued_.notify_one();
+  return outputs;
+}
+
+BatchingPredictor::Stats BatchingPredictor::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void BatchingPredictor::worker() {
+  std::vector<Request> batch;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queued_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      queued_.wait_until(lock, queue_.front().start + timeout_, [this]() {
+        return stop_ || queued_rows_ >= max_batch_size_;
+      });
+      TIndex rows = 0;
+      while (!queue_.empty() &&
+             (batch.empty() ||
+              rows + queue_.front().rows <= max_batch_size_)) {
+        rows += queue_.front().rows;
+        queued_rows_ -= queue_.front().rows;
+        batch.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+    }
+    runBatch(&batch);
+    batch.clear();
+  }
+}
+
+void BatchingPredictor::runBatch(std::vector<Request>* batch) {
+  TIndex rows = 0;
+  for (const auto& request : *batch) {
+    rows += request.rows;
+  }
+  std::vector<Outputs> results(batch->size());
+  std::exception_ptr error;
+  try {
+    const auto& first = batch->front();
+    std::vector<TensorCPU> inputs(first.inputs.size());
+    TensorVector input_ptrs;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      if (batch->size() == 1) {
+        input_ptrs.push_back(&(*batch)[0].inputs[i]);
+        continue;
+      }
+      const auto& meta = first.inputs[i].meta();
+      auto dims = first.inputs[i].dims();
+      dims[0] = rows;
+      inputs[i].Resize(dims);
+      void* data = inputs[i].raw_mutable_data(meta);
+      TIndex offset = 0;
+      for (const auto& request : *batch) {
+        CAFFE_ENFORCE_EQ(request.inputs.size(), inputs.size());
+        const auto& input = request.inputs[i];
+        CAFFE_ENFORCE(
+            input.meta() == meta,
+            "The requests of a batch must have inputs of the same type.");
+        auto request_dims = input.dims();
+        request_dims[0] = rows;
+        CAFFE_ENFORCE(
+            request_dims == dims,
+            "The requests of a batch must have inputs of the same shape, "
+            "except for the first dimension.");
+        copyItems(
+            meta, input.size(), input.raw_data(), itemAt(data, meta, offset));
+        offset += input.size();
+      }
+      input_ptrs.push_back(&inputs[i]);
+    }
+
+    if (batch->size() == 1) {
+      // Nothing to split: the outputs are taken over without a copy.
+      predictor_->runAndTakeOutputs(input_ptrs, &results[0]);
+    } else {
+      TensorVector outputs;
+      predictor_->run(input_ptrs, &outputs);
+      for (auto* output : outputs) {
+        CAFFE_ENFORCE(
+            output->ndim() > 0 && output->dim(0) == rows,
+            "The outputs must have as many rows as the batch.");
+        const auto& meta = output->meta();
+        const TIndex row_size = rows ? output->size() / rows : 0;
+        auto dims = output->dims();
+        TIndex offset = 0;
+        for (size_t r = 0; r < batch->size(); ++r) {
+          dims[0] = (*batch)[r].rows;
+          results[r].emplace_back(dims);
+          auto& result = results[r].back();
+          copyItems(
+              meta,
+              result.size(),
+              itemAt(output->raw_data(), meta, offset),
+              result.raw_mutable_data(meta));
+          offset += dims[0] * row_size;
+        }
+      }
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  // The stats are up to date by the time the callers get their outputs.
+  {
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stats_.batch_sizes.size() <= rows) {
+      stats_.batch_sizes.resize(rows + 1);
+    }
+    ++stats_.batch_sizes[rows];
+    for (const auto& request : *batch) {
+      const size_t bucket = latencyBucket(now - request.start);
+      if (stats_.latencies.size() <= bucket) {
+        stats_.latencies.resize(bucket + 1);
+      }
+      ++stats_.latencies[bucket];
+    }
+  }
+  for (size_t r = 0; r < batch->size(); ++r) {
+    if (error) {
+      (*batch)[r].outputs.set_exception(error);
+    } else {
+      (*batch)[r].outputs.set_value(std::move(results[r]));
+    }
+  }
+}
+}
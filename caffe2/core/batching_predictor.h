@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "caffe2/core/predictor.h"
+
+namespace caffe2 {
+
+// A front-end to a Predictor that batches concurrent requests together.
+// Each request is a set of inputs whose first dimension is its number of
+// rows, typically a handful. A worker thread concatenates the inputs of the
+// pending requests along the first dimension, up to `max_batch_size` rows,
+// runs the Predictor once on the batch, and splits the outputs, whose first
+// dimension must be the number of rows of the batch, back to the requests.
+// A request that runs alone is neither copied in nor out: it gets the outputs
+// of Predictor::runAndTakeOutputs.
+//
+// A batch is started as soon as it has `max_batch_size` rows, or once its
+// oldest request has waited for `timeout`. A request with more rows than
+// `max_batch_size` runs in a batch of its own.
+//
+// The Predictor is only used by the worker thread, and must not be used by
+// anything else while the BatchingPredictor exists.
+class BatchingPredictor {
+ public:
+  using TensorVector = Predictor::TensorVector;
+  using Outputs = std::vector<TensorCPU>;
+
+  BatchingPredictor(
+      Predictor* predictor,
+      size_t max_batch_size,
+      std::chrono::microseconds timeout);
+  // Runs the pending requests, then stops the worker thread.
+  ~BatchingPredictor();
+
+  // Queues a request, and returns the future of its outputs. The inputs share
+  // their data with the request, so must not be modified until the future is
+  // ready. Safe to call from several threads at once.
+  std::future<Outputs> run(const TensorVector& inputs);
+
+  struct Stats {
+    // batch_sizes[n] is the number of batches of n rows that ran.
+    std::vector<uint64_t> batch_sizes;
+    // latencies[k] is the number of requests whose outputs were ready within
+    // [2^k, 2^(k+1)) microseconds of the call to run, with latencies[0] also
+    // counting those under a microsecond.
+    std::vector<uint64_t> latencies;
+  };
+
+  // A snapshot of the histograms since the BatchingPredictor was created.
+  Stats stats();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Request {
+    std::vector<TensorCPU> inputs;
+    TIndex rows;
+    Clock::time_point start;
+    std::promise<Outputs> outputs;
+  };
+
+  void worker();
+  void runBatch(std::vector<Request>* batch);
+
+  Predictor* predictor_;
+  const TIndex max_batch_size_;
+  const std::chrono::microseconds timeout_;
+
+  std::mutex mutex_;
+  std::condition_variable queued_;
+  std::deque<Request> queue_;
+  TIndex queued_rows_ = 0;
+  bool stop_ = false;
+  Stats stats_;
+
+  std::thread worker_;
+
+  DISABLE_COPY_AND_ASSIGN(BatchingPredictor);
+};
+}
@@ -0,0 +1,163 @@
+#include <google/protobuf/text_format.h>
+#include "caffe2/core/batching_predictor.h"
+
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+const char* predictSpec = R"DOC(
+        name: "predict"
+        type: "simple"
+        external_input: "data"
+        external_input: "W"
+        external_input: "b"
+        external_output: "y"
+        op {
+          input: "data"
+          input: "W"
+          input: "b"
+          output: "y"
+          type: "FC"
+        }
+)DOC";
+
+const char* initSpec = R"DOC(
+        name: "init"
+        op {
+          type: "ConstantFill"
+          output: "data"
+          arg {
+            name: "shape"
+            ints: 1
+            ints: 4
+          }
+        }
+        op {
+          type: "ConstantFill"
+          output: "W"
+          arg {
+            name: "shape"
+            ints: 10
+            ints: 4
+          }
+          arg {
+            name: "value"
+            f: 2.0
+          }
+        }
+        op {
+          type: "ConstantFill"
+          output: "b"
+          arg {
+            name: "shape"
+            ints: 10
+          }
+          arg {
+            name: "value"
+            f: 2.0
+          }
+        }
+)DOC";
+
+NetDef parseNetDef(const std::string& value) {
+  NetDef def;
+  CAFFE_ENFORCE(
+      google::protobuf::TextFormat::ParseFromString(value, &def),
+      "Failed to parse NetDef with value: ",
+      value);
+  return def;
+}
+
+// A request of `rows` rows, where row r is filled with value + r.
+std::unique_ptr<TensorCPU> requestInput(int rows, float value, int cols = 4) {
+  auto input = make_unique<TensorCPU>(vector<TIndex>{rows, cols});
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      input->mutable_data<float>()[r * cols + c] = value + r;
+    }
+  }
+  return input;
+}
+
+// W and b are filled with 2, so every output of row r is 8 * (value + r) + 2.
+void expectOutputs(
+    const BatchingPredictor::Outputs& outputs,
+    int rows,
+    float value) {
+  ASSERT_EQ(outputs.size(), 1);
+  ASSERT_EQ(outputs[0].dims(), (vector<TIndex>{rows, 10}));
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < 10; ++c) {
+      EXPECT_FLOAT_EQ(
+          outputs[0].data<float>()[r * 10 + c], 8 * (value + r) + 2);
+    }
+  }
+}
+}
+
+class BatchingPredictorTest : public testing::Test {
+ public:
+  void SetUp() override {
+    p_ = make_unique<Predictor>(
+        parseNetDef(initSpec), parseNetDef(predictSpec));
+  }
+
+  std::unique_ptr<Predictor> p_;
+};
+
+TEST_F(BatchingPredictorTest, BatchesConcurrentRequests) {
+  // The timeout is long enough for the batch to fill up first.
+  BatchingPredictor batching(p_.get(), 8, std::chrono::seconds(10));
+  std::vector<std::unique_ptr<TensorCPU>> inputs;
+  std::vector<std::future<BatchingPredictor::Outputs>> outputs;
+  for (int i = 0; i < 4; ++i) {
+    inputs.push_back(requestInput(2, 10 * i));
+    outputs.push_back(batching.run({inputs.back().get()}));
+  }
+  for (int i = 0; i < 4; ++i) {
+    expectOutputs(outputs[i].get(), 2, 10 * i);
+  }
+  auto stats = batching.stats();
+  ASSERT_EQ(stats.batch_sizes.size(), 9);
+  EXPECT_EQ(stats.batch_sizes[8], 1);
+  uint64_t requests = 0;
+  for (auto count : stats.latencies) {
+    requests += count;
+  }
+  EXPECT_EQ(requests, 4);
+}
+
+TEST_F(BatchingPredictorTest, RunsPartialBatchOnTimeout) {
+  BatchingPredictor batching(p_.get(), 64, std::chrono::milliseconds(1));
+  auto input = requestInput(3, 1);
+  expectOutputs(batching.run({input.get()}).get(), 3, 1);
+  auto stats = batching.stats();
+  ASSERT_EQ(stats.batch_sizes.size(), 4);
+  EXPECT_EQ(stats.batch_sizes[3], 1);
+}
+
+TEST_F(BatchingPredictorTest, SplitsBatchesAtMaxSize) {
+  BatchingPredictor batching(p_.get(), 4, std::chrono::milliseconds(1));
+  std::vector<std::unique_ptr<TensorCPU>> inputs;
+  std::vector<std::future<BatchingPredictor::Outputs>> outputs;
+  for (int i = 0; i < 3; ++i) {
+    inputs.push_back(requestInput(3, i));
+    outputs.push_back(batching.run({inputs.back().get()}));
+  }
+  for (int i = 0; i < 3; ++i) {
+    expectOutputs(outputs[i].get(), 3, i);
+  }
+  // No two requests of 3 rows fit in a batch of 4.
+  auto stats = batching.stats();
+  EXPECT_EQ(stats.batch_sizes[3], 3);
+}
+
+TEST_F(BatchingPredictorTest, PropagatesErrors) {
+  BatchingPredictor batching(p_.get(), 4, std::chrono::milliseconds(1));
+  auto input = requestInput(1, 1, 3);
+  auto output = batching.run({input.get()});
+  EXPECT_ANY_THROW(output.get());
+}
+}
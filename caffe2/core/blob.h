@@ -7,6 +7,7 @@
 #include <type_traits>
 #include <vector>
 
+#include "caffe2/core/arena.h"
 #include "caffe2/core/blob_serializer_base.h"
 #include "caffe2/core/common.h"
 #include "caffe2/core/typeid.h"
@@ -22,7 +23,7 @@ namespace caffe2 {
  * properly when the blob is deallocated or re-allocated with a new type. A blob
  * could contain anything, although the most common case is to contain a Tensor.
  */
-class Blob {
+class Blob : public ArenaAllocated {
  public:
   /**
    * Initializes an empty Blob.
@@ -46,6 +47,15 @@ class Blob {
    */
   inline const char* TypeName() const { return meta_.name(); }
 
+  /**
+   * Returns a number that changes whenever the content of the blob may have
+   * changed: on every GetMutable(), Reset(), ShareExternal() and swap(). Since
+   * operators get their outputs through GetMutable(), a blob that keeps its
+   * version has not been written by any operator in the meantime. Writes
+   * through a pointer kept from an earlier GetMutable() are not seen.
+   */
+  inline size_t version() const { return version_; }
+
   /**
    * @brief Gets the const reference of the stored object. The code checks if
    * the stored object is of the desired type.
@@ -75,6 +85,7 @@ class Blob {
    */
   template <class T>
   T* GetMutable(bool* is_new_object=nullptr) {
+    ++version_;
     if (IsType<T>()) {
       if (is_new_object) *is_new_object = false;
       return static_cast<T*>(pointer_);
@@ -101,6 +112,7 @@ class Blob {
     meta_ = TypeMeta::Make<T>();
     pointer_ = static_cast<void*>(allocated);
     destroy_ = &Destroy<T>;
+    ++version_;
     return allocated;
   }
 
@@ -129,6 +141,7 @@ class Blob {
     meta_ = meta;
     pointer_ = static_cast<void*>(allocated);
     destroy_ = nullptr;
+    ++version_;
     return allocated;
   }
 
@@ -142,6 +155,7 @@ class Blob {
     pointer_ = nullptr;
     meta_ = TypeMeta();
     destroy_ = nullptr;
+    ++version_;
   }
 
   /**
@@ -175,6 +189,8 @@ class Blob {
     swap(meta_, rhs.meta_);
     swap(pointer_, rhs.pointer_);
     swap(destroy_, rhs.destroy_);
+    ++version_;
+    ++rhs.version_;
   }
 
   /**
@@ -197,6 +213,7 @@ class Blob {
   TypeMeta meta_;
   void* pointer_ = nullptr;
   DestroyCall destroy_ = nullptr;
+  size_t version_ = 0;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };
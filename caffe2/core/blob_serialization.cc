@@ -1,16 +1,160 @@
 #include "caffe2/core/blob_serialization.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
 #include <sstream>
 #include <mutex>
+#include <thread>
 
 #include "caffe2/core/blob.h"
+#include "caffe2/core/compression.h"
+#include "caffe2/core/executor_pool.h"
 
 CAFFE2_DEFINE_int(
     caffe2_tensor_chunk_size,
     1000000,
     "Chunk size to split tensor data into");
+CAFFE2_DEFINE_int(
+    caffe2_serialization_threads,
+    0,
+    "The number of threads that serialize and deserialize the chunks of a "
+    "tensor in parallel. If not positive, the number of cores is used.");
+CAFFE2_DEFINE_bool(
+    caffe2_tensor_raw_bytes_encoding,
+    false,
+    "If set, the data of numeric tensors is serialized as raw bytes instead "
+    "of into the typed fields of TensorProto, which is faster to encode and "
+    "decode, and more compact for most types.");
+CAFFE2_DEFINE_bool(
+    caffe2_tensor_float16_encoding,
+    false,
+    "If set, float tensors are serialized as raw float16 bytes, which halves "
+    "their size but loses precision.");
 
 namespace caffe2 {
+
+namespace detail {
+
+uint16_t FloatToHalfBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const uint32_t abs_bits = bits & 0x7fffffff;
+  if (abs_bits >= 0x7f800000) {
+    // Infinity stays infinity, and NaN stays a (quiet) NaN.
+    return sign | 0x7c00 | (abs_bits > 0x7f800000 ? 0x200 : 0);
+  }
+  if (abs_bits >= 0x477ff000) {
+    // Rounds to a value beyond the largest half, 65504.
+    return sign | 0x7c00;
+  }
+  if (abs_bits < 0x38800000) {
+    // The result is a subnormal half, or zero. Adding 0.5 makes the float
+    // hardware do the shift and the rounding to the nearest even for us.
+    float abs_value;
+    memcpy(&abs_value, &abs_bits, sizeof(abs_value));
+    abs_value += 0.5f;
+    uint32_t shifted;
+    memcpy(&shifted, &abs_value, sizeof(shifted));
+    return sign | static_cast<uint16_t>(shifted - 0x3f000000);
+  }
+  // Rebias the exponent from 127 to 15, and round the 13 dropped mantissa
+  // bits to the nearest even.
+  const uint32_t odd = (abs_bits >> 13) & 1;
+  const uint32_t rounded = abs_bits + 0xfff + odd - (112u << 23);
+  return sign | static_cast<uint16_t>(rounded >> 13);
+}
+
+float HalfBitsToFloat(uint16_t bits) {
+  const uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+  const uint32_t exponent = (bits >> 10) & 0x1f;
+  uint32_t mantissa = bits & 0x3ff;
+  uint32_t result;
+  if (exponent == 0x1f) {
+    result = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent != 0) {
+    result = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    result = sign;
+  } else {
+    // A subnormal half is a normal float: normalize the mantissa.
+    int shift = 0;
+    while ((mantissa & 0x400) == 0) {
+      mantissa <<= 1;
+      ++shift;
+    }
+    result = sign | ((113 - shift) << 23) | ((mantissa & 0x3ff) << 13);
+  }
+  float value;
+  memcpy(&value, &result, sizeof(value));
+  return value;
+}
+
+}  // namespace detail
+
+void ParallelForChunks(
+    size_t num_tasks,
+    const std::function<void(size_t)>& task) {
+  int num_threads = FLAGS_caffe2_serialization_threads;
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  if (num_tasks <= 1 || num_threads <= 1) {
+    for (size_t i = 0; i < num_tasks; ++i) {
+      task(i);
+    }
+    return;
+  }
+
+  // Leaked on purpose, like the other process-wide pools, so that it does not
+  // have to be torn down at exit.
+  static ExecutorPool* pool = new ExecutorPool();
+  struct State {
+    std::function<void(size_t)> task;
+    std::atomic<size_t> next_task{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t num_done = 0;
+    std::exception_ptr exception;
+  };
+  auto state = std::make_shared<State>();
+  state->task = task;
+  // Every worker takes tasks until there are none left. The calling thread is
+  // a worker too, so the tasks get done even if the pool is busy, and pool
+  // threads that only start once everything is done just return.
+  auto work = [state, num_tasks]() {
+    for (size_t i = state->next_task++; i < num_tasks;
+         i = state->next_task++) {
+      std::exception_ptr exception;
+      try {
+        state->task(i);
+      } catch (...) {
+        exception = std::current_exception();
+      }
+      std::lock_guard<std::mutex> guard(state->mutex);
+      if (exception && !state->exception) {
+        state->exception = exception;
+      }
+      if (++state->num_done == num_tasks) {
+        state->cv.notify_all();
+      }
+    }
+  };
+  const size_t num_helpers =
+      std::min(static_cast<size_t>(num_threads), num_tasks) - 1;
+  for (size_t i = 0; i < num_helpers; ++i) {
+    pool->Submit(DeviceOption(), work);
+  }
+  work();
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cv.wait(lock, [&]() { return state->num_done == num_tasks; });
+  if (state->exception) {
+    std::rethrow_exception(state->exception);
+  }
+}
+
 /**
  * @brief StringSerializer is the serializer for String.
  *
@@ -124,7 +268,33 @@ void Blob::Deserialize(const string& content) {
   Deserialize(blob_proto);
 }
 
+string CompressSerializedBlob(const string& serialized, const string& codec) {
+  BlobProto blob_proto;
+  blob_proto.set_compression(codec);
+  blob_proto.set_uncompressed_size(serialized.size());
+  blob_proto.set_content(CreateCompressionCodec(codec)->Compress(serialized));
+  return blob_proto.SerializeAsString();
+}
+
+void DecompressBlobProto(BlobProto* proto) {
+  if (!proto->has_compression()) {
+    return;
+  }
+  const string serialized =
+      CreateCompressionCodec(proto->compression())
+          ->Decompress(proto->content(), proto->uncompressed_size());
+  CAFFE_ENFORCE(
+      proto->ParseFromString(serialized),
+      "Cannot parse decompressed content into a BlobProto.");
+}
+
 void Blob::Deserialize(const BlobProto& blob_proto) {
+  if (blob_proto.has_compression()) {
+    BlobProto decompressed = blob_proto;
+    DecompressBlobProto(&decompressed);
+    Deserialize(decompressed);
+    return;
+  }
   if (blob_proto.type() == kTensorBlobType) {
     // This is a tensor object. Depending on the device type, we will
     // use the corresponding TensorDeserializer.
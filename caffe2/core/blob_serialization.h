@@ -1,8 +1,8 @@
 #ifndef CAFFE2_CORE_BLOB_SERIALIZATION_H_
 #define CAFFE2_CORE_BLOB_SERIALIZATION_H_
 
+#include <functional>
 #include <limits>
-#include <future>
 
 #include <google/protobuf/repeated_field.h>
 
@@ -13,6 +13,9 @@
 #include "caffe2/core/types.h"
 
 CAFFE2_DECLARE_int(caffe2_tensor_chunk_size);
+CAFFE2_DECLARE_int(caffe2_serialization_threads);
+CAFFE2_DECLARE_bool(caffe2_tensor_raw_bytes_encoding);
+CAFFE2_DECLARE_bool(caffe2_tensor_float16_encoding);
 
 namespace caffe2 {
 
@@ -32,6 +35,25 @@ inline unique_ptr<BlobSerializerBase> CreateSerializer(CaffeTypeId id) {
   return BlobSerializerRegistry()->Create(id);
 }
 
+/**
+ * Runs task(0), ..., task(num_tasks - 1) in parallel, on the calling thread and
+ * on up to FLAGS_caffe2_serialization_threads - 1 threads of a pool shared by
+ * all serialization, and rethrows the first exception thrown by a task. The
+ * chunks of tensors are serialized and deserialized with it.
+ */
+void ParallelForChunks(
+    size_t num_tasks,
+    const std::function<void(size_t)>& task);
+
+/**
+ * Compresses a serialized BlobProto with the given codec (see
+ * core/compression.h), and returns the serialized BlobProto that holds the
+ * compressed data. DecompressBlobProto() reverses it.
+ */
+string CompressSerializedBlob(const string& serialized, const string& codec);
+// If the proto holds a compressed blob, replaces it with the decompressed one.
+void DecompressBlobProto(BlobProto* proto);
+
 /**
  * @brief TensorSerializer is the serializer for Tensors.
  *
@@ -176,6 +198,89 @@ inline void CopyFromProtoWithCast(
   context->template Copy<DstType, CPUContext, Context>(size, buffer.get(), dst);
 }
 
+// Converts between floats and the bits of IEEE half precision floats,
+// rounding to the nearest even.
+uint16_t FloatToHalfBits(float value);
+float HalfBitsToFloat(uint16_t bits);
+
+inline bool IsLittleEndian() {
+  const uint16_t one = 1;
+  return *reinterpret_cast<const uint8_t*>(&one) == 1;
+}
+
+// Stores the elements of a numeric tensor as raw bytes, see
+// TensorProto::DataEncoding.
+template <class Context>
+inline void CopyToProtoAsRawBytes(
+    const size_t size,
+    const Tensor<Context>& input,
+    const size_t begin,
+    TensorProto* proto,
+    Context* context) {
+  string* bytes = proto->mutable_byte_data();
+  if (proto->data_encoding() == TensorProto_DataEncoding_RAW_FLOAT16) {
+    unique_ptr<float[]> buffer(new float[size]);
+    context->template Copy<float, Context, CPUContext>(
+        size, input.template data<float>() + begin, buffer.get());
+    context->FinishDeviceComputation();
+    bytes->resize(size * sizeof(uint16_t));
+    uint16_t* dst = reinterpret_cast<uint16_t*>(&(*bytes)[0]);
+    for (int i = 0; i < size; ++i) {
+      dst[i] = FloatToHalfBits(buffer[i]);
+    }
+  } else {
+    const size_t itemsize = input.itemsize();
+    bytes->resize(size * itemsize);
+    context->template CopyBytes<Context, CPUContext>(
+        size * itemsize,
+        static_cast<const char*>(input.raw_data()) + begin * itemsize,
+        &(*bytes)[0]);
+    context->FinishDeviceComputation();
+  }
+}
+
+template <class Context>
+inline void CopyFromProtoAsRawBytes(
+    const size_t size,
+    const TensorProto& proto,
+    const size_t begin,
+    Tensor<Context>* tensor,
+    Context* context) {
+  CAFFE_ENFORCE(
+      IsLittleEndian(),
+      "Tensors stored as raw bytes can only be loaded on little-endian "
+      "machines.");
+  const string& bytes = proto.byte_data();
+  if (proto.data_encoding() == TensorProto_DataEncoding_RAW_FLOAT16) {
+    CAFFE_ENFORCE_EQ(
+        proto.data_type(),
+        TensorProto_DataType_FLOAT,
+        "Only float tensors can be stored as float16.");
+    CAFFE_ENFORCE_EQ(
+        size * sizeof(uint16_t), bytes.size(), "Incorrect proto field size.");
+    unique_ptr<float[]> buffer(new float[size]);
+    const uint16_t* src = reinterpret_cast<const uint16_t*>(bytes.data());
+    for (int i = 0; i < size; ++i) {
+      buffer[i] = HalfBitsToFloat(src[i]);
+    }
+    context->template Copy<float, CPUContext, Context>(
+        size, buffer.get(), tensor->template mutable_data<float>() + begin);
+  } else {
+    CAFFE_ENFORCE_NE(
+        proto.data_type(),
+        TensorProto_DataType_STRING,
+        "Strings cannot be stored as raw bytes.");
+    const TypeMeta& meta = DataTypeToTypeMeta(proto.data_type());
+    CAFFE_ENFORCE_EQ(
+        size * meta.itemsize(), bytes.size(), "Incorrect proto field size.");
+    context->template CopyBytes<CPUContext, Context>(
+        bytes.size(),
+        bytes.data(),
+        static_cast<char*>(tensor->raw_mutable_data(meta)) +
+            begin * meta.itemsize());
+  }
+}
+
 }  // namespace detail
 
 template <class Context>
@@ -200,48 +305,26 @@ void TensorSerializer<Context>::SerializeWithChunkSize(
     chunk_size = FLAGS_caffe2_tensor_chunk_size;
   }
 
-#ifndef __ANDROID__
-  std::vector<std::future<void>> futures;
-#endif
-
   VLOG(1) << "Serializing blob " << name;
   // Serialize whole vector. If vector is empty, it's shape still needs to be
   // serialized in empty proto
-  for (size_t chunkBegin = 0;
-       chunkBegin < std::max(tensor.size(), static_cast<TIndex>(1));
-       chunkBegin += chunk_size) {
-    VLOG(2) << "Starting a chunk at " << chunkBegin;
-    auto task = [&](size_t chunkStart) {
-      BlobProto blob_proto;
-      blob_proto.set_name(name);
-      blob_proto.set_type(kTensorBlobType);
-      TensorProto& proto = *blob_proto.mutable_tensor();
-      proto.set_name(name);
-      this->Serialize(
-          tensor, name, blob_proto.mutable_tensor(), chunkStart, chunk_size);
-      acceptor(
-          MakeString(
-              name, kChunkIdSeparator, chunkStart / chunk_size),
-          blob_proto.SerializeAsString());
-    };
-#ifndef __ANDROID__
-    if (tensor.size() > chunk_size) {
-      futures.emplace_back(std::async(std::launch::async, task, chunkBegin));
-    } else {
-      // Sync mode for small tensors
-      task(chunkBegin);
-    }
-#else
-    // Since Android does not have std::future, we will always do sync mode
-    task(chunkBegin);
-#endif
-  }
-
-#ifndef __ANDROID__
-  for (auto& fut : futures) {
-    fut.get();
-  }
-#endif
+  const size_t num_chunks =
+      (std::max(tensor.size(), static_cast<TIndex>(1)) + chunk_size - 1) /
+      chunk_size;
+  ParallelForChunks(num_chunks, [&](size_t chunk) {
+    const size_t chunkStart = chunk * chunk_size;
+    VLOG(2) << "Starting a chunk at " << chunkStart;
+    BlobProto blob_proto;
+    blob_proto.set_name(name);
+    blob_proto.set_type(kTensorBlobType);
+    TensorProto& proto = *blob_proto.mutable_tensor();
+    proto.set_name(name);
+    this->Serialize(
+        tensor, name, blob_proto.mutable_tensor(), chunkStart, chunk_size);
+    acceptor(
+        MakeString(name, kChunkIdSeparator, chunk),
+        blob_proto.SerializeAsString());
+  });
 }
 
 template <class Context>
@@ -276,6 +359,24 @@ void TensorSerializer<Context>::Serialize(
   proto.set_data_type(data_type);
   StoreDeviceDetail(input, &proto);
 
+  if (data_type == TensorProto_DataType_FLOAT &&
+      FLAGS_caffe2_tensor_float16_encoding) {
+    proto.set_data_encoding(TensorProto_DataEncoding_RAW_FLOAT16);
+  } else if (
+      FLAGS_caffe2_tensor_raw_bytes_encoding &&
+      data_type != TensorProto_DataType_STRING &&
+      data_type != TensorProto_DataType_UNDEFINED) {
+    proto.set_data_encoding(TensorProto_DataEncoding_RAW_BYTES);
+  }
+  if (proto.data_encoding() != TensorProto_DataEncoding_TYPED_FIELDS) {
+    CAFFE_ENFORCE(
+        detail::IsLittleEndian(),
+        "Tensors can only be stored as raw bytes on little-endian machines.");
+    detail::CopyToProtoAsRawBytes(
+        chunkSize, input, chunkBegin, &proto, &this->context_);
+    return;
+  }
+
   // A lot of copypaste is error prone. Should we create a macro for this?
   switch (data_type) {
   case TensorProto_DataType_FLOAT:
@@ -390,7 +491,11 @@ void TensorDeserializer<Context>::Deserialize(
   for (const TIndex d : proto.dims()) {
     dims.push_back(d);
   }
-  tensor->Resize(dims);
+  // Chunks of the same tensor may be deserialized in parallel once the first
+  // one has allocated it, so the tensor is only touched if it has to change.
+  if (tensor->dims() != dims) {
+    tensor->Resize(dims);
+  }
 
   int64_t chunkBegin = 0;
   auto chunkEnd = tensor->size();
@@ -408,6 +513,13 @@ void TensorDeserializer<Context>::Deserialize(
       tensor->size());
   auto chunkSize = chunkEnd - chunkBegin;
 
+  if (proto.data_encoding() != TensorProto_DataEncoding_TYPED_FIELDS) {
+    detail::CopyFromProtoAsRawBytes(
+        chunkSize, proto, chunkBegin, tensor, &context);
+    context.FinishDeviceComputation();
+    return;
+  }
+
   switch (proto.data_type()) {
     case TensorProto_DataType_FLOAT:
       detail::CopyFromProtoAsIs(
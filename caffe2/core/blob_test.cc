@@ -1,8 +1,12 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <iostream>
 #include <memory>
 #include <mutex>
 
 #include "caffe2/core/blob.h"
+#include "caffe2/core/blob_serialization.h"
 #include "caffe2/core/common.h"
 #include "caffe2/core/context.h"
 #include "caffe2/core/db.h"
@@ -101,6 +105,23 @@ TEST(BlobTest, BlobShareExternalObject) {
   blob.Reset();
 }
 
+TEST(BlobTest, BlobVersion) {
+  Blob blob;
+  size_t version = blob.version();
+  blob.GetMutable<int>();
+  EXPECT_NE(blob.version(), version);
+  version = blob.version();
+  blob.Get<int>();
+  blob.IsType<int>();
+  EXPECT_EQ(blob.version(), version);
+  Blob other;
+  blob.swap(other);
+  EXPECT_NE(blob.version(), version);
+  version = other.version();
+  other.Reset();
+  EXPECT_NE(other.version(), version);
+}
+
 TEST(BlobTest, StringSerialization) {
   const std::string kTestString = "Hello world?";
   Blob blob;
@@ -337,6 +358,10 @@ TYPED_TEST(TensorCPUTest, KeepOnShrink) {
   TensorCPU tensor(dims);
   TypeParam* ptr = tensor.mutable_data<TypeParam>();
   EXPECT_TRUE(ptr != nullptr);
+  // Keeps the old storage alive, so that the allocator cannot hand out the
+  // same address again.
+  TensorCPU old_tensor(dims);
+  old_tensor.ShareData(tensor);
   // Expanding - will reallocate
   tensor.Resize(3, 4, 6);
   TypeParam* larger_ptr = tensor.mutable_data<TypeParam>();
@@ -356,6 +381,41 @@ TYPED_TEST(TensorCPUTest, KeepOnShrink) {
   EXPECT_EQ(larger_ptr, new_ptr);
 }
 
+TYPED_TEST(TensorCPUTest, TensorShareDataCopyOnWrite) {
+  TensorCPU tensor(vector<int>{2, 3, 5});
+  TypeParam* data = tensor.mutable_data<TypeParam>();
+  for (int i = 0; i < tensor.size(); ++i) {
+    data[i] = i;
+  }
+  TensorCPU other_tensor;
+  other_tensor.ShareDataCopyOnWrite(tensor);
+  EXPECT_TRUE(other_tensor.is_copy_on_write());
+  EXPECT_EQ(other_tensor.dims(), tensor.dims());
+  // Reading does not copy.
+  EXPECT_EQ(other_tensor.data<TypeParam>(), data);
+  // Writing copies the data first.
+  TypeParam* other_data = other_tensor.mutable_data<TypeParam>();
+  EXPECT_NE(other_data, data);
+  EXPECT_FALSE(other_tensor.is_copy_on_write());
+  for (int i = 0; i < tensor.size(); ++i) {
+    EXPECT_EQ(other_data[i], i);
+    other_data[i] = 0;
+    EXPECT_EQ(tensor.data<TypeParam>()[i], i);
+  }
+}
+
+TYPED_TEST(TensorCPUTest, TensorShareDataCopyOnWriteLastUser) {
+  TensorCPU other_tensor;
+  {
+    TensorCPU tensor(vector<int>{2, 3, 5});
+    tensor.mutable_data<TypeParam>();
+    other_tensor.ShareDataCopyOnWrite(tensor);
+  }
+  // Nobody else uses the storage anymore, so it is not copied.
+  const TypeParam* data = other_tensor.data<TypeParam>();
+  EXPECT_EQ(other_tensor.mutable_data<TypeParam>(), data);
+}
+
 TYPED_TEST(TensorCPUDeathTest, CannotAccessRawDataWhenEmpty) {
   TensorCPU tensor;
   EXPECT_EQ(tensor.ndim(), 0);
@@ -392,6 +452,55 @@ TEST(TensorTest, TensorNonFundamentalTypeCopy) {
   }
 }
 
+TEST(TensorTest, TensorNonFundamentalTypeCopyOnWrite) {
+  TensorCPU tensor(vector<int>{2, 3, 4});
+  std::string* ptr = tensor.mutable_data<std::string>();
+  for (int i = 0; i < tensor.size(); ++i) {
+    ptr[i] = "filled";
+  }
+  TensorCPU other_tensor;
+  other_tensor.ShareDataCopyOnWrite(tensor);
+  std::string* other_ptr = other_tensor.mutable_data<std::string>();
+  EXPECT_NE(other_ptr, ptr);
+  for (int i = 0; i < other_tensor.size(); ++i) {
+    EXPECT_TRUE(other_ptr[i] == "filled");
+  }
+}
+
+TEST(TensorTest, TensorShareExternalPointerWithDeleter) {
+  std::vector<float> buffer(10, 1);
+  int deleted = 0;
+  {
+    Blob blob;
+    auto* tensor = blob.GetMutable<TensorCPU>();
+    tensor->Resize(10);
+    tensor->ShareExternalPointer(
+        buffer.data(), 0, [&deleted](void*) { ++deleted; });
+    EXPECT_EQ(tensor->data<float>(), buffer.data());
+    EXPECT_EQ(tensor->capacity_nbytes(), 10 * sizeof(float));
+    {
+      TensorCPU other_tensor(vector<int>{10});
+      other_tensor.ShareData(*tensor);
+      tensor->Resize(20);
+      tensor->mutable_data<float>();
+      EXPECT_EQ(deleted, 0);
+    }
+    EXPECT_EQ(deleted, 1);
+    tensor->Resize(10);
+    tensor->ShareExternalPointer(
+        static_cast<void*>(buffer.data()),
+        TypeMeta::Make<float>(),
+        0,
+        [&deleted](void*) { ++deleted; });
+    // Swapping blobs, like BlobsQueue does, keeps the view.
+    Blob other_blob;
+    swap(blob, other_blob);
+    EXPECT_EQ(other_blob.Get<TensorCPU>().data<float>(), buffer.data());
+    EXPECT_EQ(deleted, 1);
+  }
+  EXPECT_EQ(deleted, 2);
+}
+
 TEST(TensorTest, Tensor64BitDimension) {
   // Initialize a large tensor.
   TIndex large_number =
@@ -657,5 +766,122 @@ TEST(CustomChunkSize, BigTensorSerialization) {
   blob.Serialize("test", acceptor, kNoChunking);
   EXPECT_EQ(counter, 1);
 }
+
+TYPED_TEST(TypedTensorTest, RawBytesSerialization) {
+  FLAGS_caffe2_tensor_raw_bytes_encoding = true;
+  Blob blob;
+  TensorCPU* tensor = blob.GetMutable<TensorCPU>();
+  tensor->Resize(3, 5);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<TypeParam>()[i] = static_cast<TypeParam>(i % 3);
+  }
+  string serialized = blob.Serialize("test");
+  FLAGS_caffe2_tensor_raw_bytes_encoding = false;
+  BlobProto proto;
+  CAFFE_ENFORCE(proto.ParseFromString(serialized));
+  EXPECT_EQ(
+      proto.tensor().data_encoding(), TensorProto_DataEncoding_RAW_BYTES);
+  EXPECT_EQ(proto.tensor().byte_data().size(), tensor->nbytes());
+  Blob new_blob;
+  new_blob.Deserialize(serialized);
+  const auto& new_tensor = new_blob.Get<TensorCPU>();
+  EXPECT_EQ(new_tensor.dims(), tensor->dims());
+  for (int i = 0; i < tensor->size(); ++i) {
+    EXPECT_EQ(new_tensor.data<TypeParam>()[i], tensor->data<TypeParam>()[i]);
+  }
+}
+
+TEST(TensorSerialization, HalfBitsRoundTrip) {
+  for (uint32_t bits = 0; bits <= 0xffff; ++bits) {
+    const bool is_nan = (bits & 0x7c00) == 0x7c00 && (bits & 0x3ff) != 0;
+    if (!is_nan) {
+      EXPECT_EQ(detail::FloatToHalfBits(detail::HalfBitsToFloat(bits)), bits);
+    }
+  }
+  EXPECT_EQ(detail::HalfBitsToFloat(detail::FloatToHalfBits(1.0f)), 1.0f);
+  EXPECT_EQ(detail::HalfBitsToFloat(detail::FloatToHalfBits(-2.5f)), -2.5f);
+  // 2049 is halfway between the halves 2048 and 2050, and rounds to even.
+  EXPECT_EQ(detail::HalfBitsToFloat(detail::FloatToHalfBits(2049.0f)), 2048);
+  EXPECT_EQ(detail::FloatToHalfBits(1e6f), 0x7c00);
+  EXPECT_EQ(detail::FloatToHalfBits(-1e-10f), 0x8000);
+  EXPECT_TRUE(std::isnan(detail::HalfBitsToFloat(
+      detail::FloatToHalfBits(std::numeric_limits<float>::quiet_NaN()))));
+}
+
+TEST(TensorSerialization, Float16Encoding) {
+  FLAGS_caffe2_tensor_float16_encoding = true;
+  Blob blob;
+  TensorCPU* tensor = blob.GetMutable<TensorCPU>();
+  tensor->Resize(100);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = (i - 50) * 0.37f;
+  }
+  string serialized = blob.Serialize("test");
+  FLAGS_caffe2_tensor_float16_encoding = false;
+  BlobProto proto;
+  CAFFE_ENFORCE(proto.ParseFromString(serialized));
+  EXPECT_EQ(
+      proto.tensor().data_encoding(), TensorProto_DataEncoding_RAW_FLOAT16);
+  EXPECT_EQ(proto.tensor().byte_data().size(), 2 * tensor->size());
+  Blob new_blob;
+  new_blob.Deserialize(serialized);
+  const auto& new_tensor = new_blob.Get<TensorCPU>();
+  for (int i = 0; i < tensor->size(); ++i) {
+    const float value = tensor->data<float>()[i];
+    EXPECT_NEAR(new_tensor.data<float>()[i], value, std::abs(value) / 1024);
+  }
+}
+
+TEST(ParallelForChunks, RunsAllTasksAndRethrows) {
+  std::vector<std::atomic<int>> runs(100);
+  ParallelForChunks(runs.size(), [&](size_t i) { ++runs[i]; });
+  for (const auto& run : runs) {
+    EXPECT_EQ(run, 1);
+  }
+  EXPECT_THROW(
+      ParallelForChunks(
+          runs.size(),
+          [&](size_t i) {
+            if (i == 42) {
+              CAFFE_THROW("Task failed");
+            }
+          }),
+      EnforceNotMet);
+}
+
+TEST(CustomChunkSize, ChunksLoadedOutOfOrder) {
+  const int size = 1000;
+  Blob blob;
+  TensorCPU* tensor = blob.GetMutable<TensorCPU>();
+  tensor->Resize(size);
+  for (int i = 0; i < size; ++i) {
+    tensor->mutable_data<float>()[i] = i;
+  }
+  StringMap data;
+  std::mutex mutex;
+  auto acceptor = [&](const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> guard(mutex);
+    data.emplace_back(key, value);
+  };
+  blob.Serialize("test", acceptor, 7);
+  EXPECT_EQ(data.size(), (size + 6) / 7);
+  std::reverse(data.begin(), data.end());
+  const string db_source = "chunks_loaded_out_of_order";
+  VectorDB::registerData(db_source, std::move(data));
+
+  OperatorDef op_def;
+  op_def.set_type("Load");
+  op_def.add_output("test");
+  AddArgument<string>("db_type", "vector_db", &op_def);
+  AddArgument<string>("db", db_source, &op_def);
+  AddArgument<int>("absolute_path", 1, &op_def);
+  Workspace ws;
+  ASSERT_TRUE(ws.RunOperatorOnce(op_def));
+  const auto& new_tensor = ws.GetBlob("test")->Get<TensorCPU>();
+  EXPECT_EQ(new_tensor.size(), size);
+  for (int i = 0; i < size; ++i) {
+    EXPECT_EQ(new_tensor.data<float>()[i], i);
+  }
+}
 } // namespace
 } // namespace caffe2
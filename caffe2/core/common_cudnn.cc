@@ -2,6 +2,15 @@
 
 #include "caffe2/core/init.h"
 
+// Earlier in the days Caffe sets the default cudnn workspace to 8MB. We bump
+// it up to 64MB in Caffe2, as this enables the use of Winograd in many cases,
+// something very beneficial to more recent CNN models.
+CAFFE2_DEFINE_int(
+    caffe2_cudnn_workspace_limit_mb,
+    64,
+    "The cudnn workspace budget per device and cudnn state, used by the ops "
+    "that do not set ws_nbytes_limit when they choose an algorithm.");
+
 namespace caffe2 {
 
 thread_local CuDNNHandles CuDNNWrapper::tls_cudnn_handles_;
@@ -1,6 +1,7 @@
 #ifndef CAFFE2_CORE_COMMON_CUDNN_H_
 #define CAFFE2_CORE_COMMON_CUDNN_H_
 
+#include <algorithm>
 #include <array>
 #include <mutex>
 
@@ -10,6 +11,7 @@
 #include "caffe2/core/common_gpu.h"
 #include "caffe2/core/context.h"
 #include "caffe2/core/context_gpu.h"
+#include "caffe2/core/flags.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/types.h"
 #include "caffe2/proto/caffe2.pb.h"
@@ -18,6 +20,8 @@ static_assert(
     CUDNN_VERSION >= 5000,
     "Caffe2 requires cudnn version 5.0 or above.");
 
+CAFFE2_DECLARE_int(caffe2_cudnn_workspace_limit_mb);
+
 namespace caffe2 {
 
 namespace internal {
@@ -83,6 +87,7 @@ class cudnnTypeWrapper<float> {
  public:
   static const cudnnDataType_t type = CUDNN_DATA_FLOAT;
   typedef const float ScalingParamType;
+  typedef float BNParamType;
   static ScalingParamType* kOne() {
     static ScalingParamType v = 1.0;
     return &v;
@@ -98,6 +103,7 @@ class cudnnTypeWrapper<double> {
  public:
   static const cudnnDataType_t type = CUDNN_DATA_DOUBLE;
   typedef const double ScalingParamType;
+  typedef double BNParamType;
   static ScalingParamType* kOne() {
     static ScalingParamType v = 1.0;
     return &v;
@@ -113,6 +119,9 @@ class cudnnTypeWrapper<float16> {
  public:
   static const cudnnDataType_t type = CUDNN_DATA_HALF;
   typedef const float ScalingParamType;
+  // cuDNN keeps the batch norm scale, bias and statistics of half tensors in
+  // float.
+  typedef float BNParamType;
   static ScalingParamType* kOne() {
     static ScalingParamType v = 1.0;
     return &v;
@@ -265,6 +274,7 @@ class CuDNNHandles {
   CuDNNHandles() {
     for (int i = 0; i < CAFFE2_COMPILE_TIME_MAX_GPUS; ++i) {
       cudnn_handle_[i] = nullptr;
+      stream_[i] = nullptr;
     }
   }
 
@@ -277,6 +287,8 @@ class CuDNNHandles {
   }
 
   cudnnHandle_t cudnn_handle_[CAFFE2_COMPILE_TIME_MAX_GPUS];
+  // The stream each handle is currently bound to.
+  cudaStream_t stream_[CAFFE2_COMPILE_TIME_MAX_GPUS];
 };
 
 /**
@@ -385,17 +397,21 @@ class CuDNNWrapper {
 
   /**
    * Returns the inline cudnn handle that executes on the current
-   * thread's cuda_stream.
+   * thread's cuda_stream. The handle is shared by all the streams of the
+   * thread on a device, and rebound whenever the context's stream differs
+   * from the last one it was used with.
    */
   cudnnHandle_t& inline_cudnn_handle() {
     int gpu_id = context_->cuda_gpu_id();
     auto& cudnn_handle_ = tls_cudnn_handles_.cudnn_handle_[gpu_id];
-    if (cudnn_handle_) {
-      return cudnn_handle_;
-    } else {
+    auto& stream = tls_cudnn_handles_.stream_[gpu_id];
+    if (!cudnn_handle_) {
       context_->SwitchToDevice();
       CUDNN_CHECK(cudnnCreate(&cudnn_handle_));
-      CUDNN_CHECK(cudnnSetStream(cudnn_handle_, context_->cuda_stream()));
+    }
+    if (stream != context_->cuda_stream()) {
+      stream = context_->cuda_stream();
+      CUDNN_CHECK(cudnnSetStream(cudnn_handle_, stream));
     }
     return cudnn_handle_;
   }
@@ -420,6 +436,27 @@ class CuDNNWrapper {
     CHECK_NOTNULL(sync_state.state.get())->execute(context_->cuda_stream(), f);
   }
 
+  /**
+   * Returns the workspace budget, in bytes, that an op running on the given
+   * state should plan for when choosing an algorithm. All the ops on a device
+   * share one workspace per state, which grows to the largest request. The
+   * budget is therefore --caffe2_cudnn_workspace_limit_mb, or the current
+   * size of the workspace if it has already grown past that, since memory
+   * that is already reserved costs nothing more to use.
+   */
+  size_t workspace_limit(size_t state_idx) {
+    CAFFE_ENFORCE(
+        state_idx < CAFFE2_COMPILE_TIME_MAX_CUDNN_STATES, "Invalid state_idx");
+    auto& sync_state = cudnn_states()[context_->cuda_gpu_id()][state_idx];
+    size_t limit =
+        static_cast<size_t>(FLAGS_caffe2_cudnn_workspace_limit_mb) << 20;
+    std::lock_guard<std::mutex> g(sync_state.mutex);
+    if (sync_state.state.get()) {
+      limit = std::max(limit, sync_state.state->workspace().nbytes_);
+    }
+    return limit;
+  }
+
  protected:
   // Pointer to an external cuda context that the cudnn wrapper will use.
   CUDAContext* context_;
@@ -176,6 +176,41 @@ bool GetCudaPeerAccessPattern(vector<vector<bool> >* pattern) {
   return true;
 }
 
+namespace {
+std::atomic<bool> gCudaPeerAccessEnabled[CAFFE2_COMPILE_TIME_MAX_GPUS]
+                                       [CAFFE2_COMPILE_TIME_MAX_GPUS];
+} // namespace
+
+bool EnableCudaPeerAccess(const int device, const int peer) {
+  CAFFE_ENFORCE_LT(device, CAFFE2_COMPILE_TIME_MAX_GPUS);
+  CAFFE_ENFORCE_LT(peer, CAFFE2_COMPILE_TIME_MAX_GPUS);
+  if (device == peer) {
+    return true;
+  }
+  int can_access;
+  CUDA_CHECK(cudaDeviceCanAccessPeer(&can_access, device, peer));
+  if (!can_access) {
+    return false;
+  }
+  DeviceGuard guard(device);
+  // Note: just for future reference, the 0 here is not a gpu id, it is
+  // a reserved flag for cudaDeviceEnablePeerAccess that should always be
+  // zero currently.
+  const cudaError_t err = cudaDeviceEnablePeerAccess(peer, 0);
+  if (err == cudaErrorPeerAccessAlreadyEnabled) {
+    // Something else in the process enabled it first; clear the error.
+    cudaGetLastError();
+  } else {
+    CUDA_CHECK(err);
+  }
+  gCudaPeerAccessEnabled[device][peer] = true;
+  return true;
+}
+
+bool CudaPeerAccessEnabled(const int device, const int peer) {
+  return device == peer || gCudaPeerAccessEnabled[device][peer];
+}
+
 const char* cublasGetErrorString(cublasStatus_t error) {
   switch (error) {
   case CUBLAS_STATUS_SUCCESS:
@@ -98,6 +98,20 @@ void DeviceQuery(const int deviceid);
  */
 bool GetCudaPeerAccessPattern(vector<vector<bool> >* pattern);
 
+/**
+ * Enables peer access from device to peer if the hardware allows it, and
+ * returns whether it is enabled. Caffe2 calls this for every pair of devices
+ * when it initializes CUDA.
+ */
+bool EnableCudaPeerAccess(const int device, const int peer);
+
+/**
+ * Returns whether device can directly access the memory of peer, that is,
+ * whether EnableCudaPeerAccess(device, peer) succeeded. Copies between two
+ * devices without peer access are staged through pinned host memory.
+ */
+bool CudaPeerAccessEnabled(const int device, const int peer);
+
 /**
  * Return a human readable cublas error string.
  */
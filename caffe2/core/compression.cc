@@ -0,0 +1,94 @@
+#include "caffe2/core/compression.h"
+
+#include "caffe2/core/logging.h"
+
+#ifdef CAFFE2_USE_LZ4
+#include <lz4.h>
+#endif
+#ifdef CAFFE2_USE_ZSTD
+#include <zstd.h>
+#endif
+
+CAFFE2_DEFINE_int(
+    caffe2_zstd_compression_level,
+    3,
+    "The compression level of the zstd codec, from 1 (fastest) to 22.");
+
+namespace caffe2 {
+
+CAFFE_DEFINE_REGISTRY(CompressionCodecRegistry, CompressionCodec);
+
+unique_ptr<CompressionCodec> CreateCompressionCodec(const string& name) {
+  auto codec = CompressionCodecRegistry()->Create(name);
+  CAFFE_ENFORCE(
+      codec,
+      "Unknown compression codec: ",
+      name,
+      ". Was caffe2 built with support for it?");
+  return codec;
+}
+
+namespace {
+
+#ifdef CAFFE2_USE_LZ4
+class LZ4Codec : public CompressionCodec {
+ public:
+  string Compress(const string& data) override {
+    CAFFE_ENFORCE_LE(
+        data.size(), LZ4_MAX_INPUT_SIZE, "Too much data for LZ4.");
+    string compressed(LZ4_compressBound(data.size()), '\0');
+    const int size = LZ4_compress_default(
+        data.data(), &compressed[0], data.size(), compressed.size());
+    CAFFE_ENFORCE_GT(size, 0, "LZ4 compression failed.");
+    compressed.resize(size);
+    return compressed;
+  }
+
+  string Decompress(const string& data, size_t uncompressed_size) override {
+    string decompressed(uncompressed_size, '\0');
+    const int size = LZ4_decompress_safe(
+        data.data(), &decompressed[0], data.size(), uncompressed_size);
+    CAFFE_ENFORCE_EQ(size, uncompressed_size, "LZ4 decompression failed.");
+    return decompressed;
+  }
+};
+REGISTER_COMPRESSION_CODEC(lz4, LZ4Codec);
+#endif  // CAFFE2_USE_LZ4
+
+#ifdef CAFFE2_USE_ZSTD
+class ZstdCodec : public CompressionCodec {
+ public:
+  string Compress(const string& data) override {
+    string compressed(ZSTD_compressBound(data.size()), '\0');
+    const size_t size = ZSTD_compress(
+        &compressed[0],
+        compressed.size(),
+        data.data(),
+        data.size(),
+        FLAGS_caffe2_zstd_compression_level);
+    CAFFE_ENFORCE(
+        !ZSTD_isError(size),
+        "Zstd compression failed: ",
+        ZSTD_getErrorName(size));
+    compressed.resize(size);
+    return compressed;
+  }
+
+  string Decompress(const string& data, size_t uncompressed_size) override {
+    string decompressed(uncompressed_size, '\0');
+    const size_t size = ZSTD_decompress(
+        &decompressed[0], uncompressed_size, data.data(), data.size());
+    CAFFE_ENFORCE(
+        !ZSTD_isError(size),
+        "Zstd decompression failed: ",
+        ZSTD_getErrorName(size));
+    CAFFE_ENFORCE_EQ(size, uncompressed_size, "Zstd decompression failed.");
+    return decompressed;
+  }
+};
+REGISTER_COMPRESSION_CODEC(zstd, ZstdCodec);
+#endif  // CAFFE2_USE_ZSTD
+
+}  // namespace
+
+}  // namespace caffe2
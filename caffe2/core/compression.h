@@ -0,0 +1,42 @@
+#ifndef CAFFE2_CORE_COMPRESSION_H_
+#define CAFFE2_CORE_COMPRESSION_H_
+
+#include <memory>
+#include <string>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/flags.h"
+#include "caffe2/core/registry.h"
+
+CAFFE2_DECLARE_int(caffe2_zstd_compression_level);
+
+namespace caffe2 {
+
+/**
+ * A block compression codec, used to compress serialized blobs. Codecs are
+ * registered by name with REGISTER_COMPRESSION_CODEC: "lz4" and "zstd" are
+ * available in builds with USE_LZ4 and USE_ZSTD respectively.
+ *
+ * Codecs should be stateless, since the chunks of a tensor are compressed and
+ * decompressed in parallel.
+ */
+class CompressionCodec {
+ public:
+  virtual ~CompressionCodec() {}
+
+  virtual string Compress(const string& data) = 0;
+  // The size of the decompressed data is known from the compressed blob, so
+  // codecs do not have to store it themselves.
+  virtual string Decompress(const string& data, size_t uncompressed_size) = 0;
+};
+
+CAFFE_DECLARE_REGISTRY(CompressionCodecRegistry, CompressionCodec);
+#define REGISTER_COMPRESSION_CODEC(name, ...) \
+  CAFFE_REGISTER_CLASS(CompressionCodecRegistry, name, __VA_ARGS__)
+
+// Returns the codec of the given name, and throws if there is none.
+unique_ptr<CompressionCodec> CreateCompressionCodec(const string& name);
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_COMPRESSION_H_
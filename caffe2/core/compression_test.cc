@@ -0,0 +1,136 @@
+#include <cstdio>
+
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/compression.h"
+#include "caffe2/core/db.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/workspace.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Run-length encodes the data as (count, byte) pairs.
+class RunLengthCodec : public CompressionCodec {
+ public:
+  string Compress(const string& data) override {
+    string compressed;
+    for (size_t i = 0; i < data.size();) {
+      size_t count = 1;
+      while (i + count < data.size() && data[i + count] == data[i] &&
+             count < 255) {
+        ++count;
+      }
+      compressed.push_back(static_cast<char>(count));
+      compressed.push_back(data[i]);
+      i += count;
+    }
+    return compressed;
+  }
+
+  string Decompress(const string& data, size_t uncompressed_size) override {
+    string decompressed;
+    for (size_t i = 0; i + 1 < data.size(); i += 2) {
+      decompressed.append(static_cast<unsigned char>(data[i]), data[i + 1]);
+    }
+    CAFFE_ENFORCE_EQ(decompressed.size(), uncompressed_size);
+    return decompressed;
+  }
+};
+REGISTER_COMPRESSION_CODEC(test_rle, RunLengthCodec);
+
+void ExpectCodecRoundTrip(const string& name) {
+  auto codec = CreateCompressionCodec(name);
+  const string data = string(10000, 'a') + "bcd" + string(1000, '\0');
+  const string compressed = codec->Compress(data);
+  EXPECT_LT(compressed.size(), data.size());
+  EXPECT_EQ(codec->Decompress(compressed, data.size()), data);
+  EXPECT_EQ(codec->Decompress(codec->Compress(""), 0), "");
+}
+
+} // namespace
+
+TEST(CompressionTest, UnknownCodec) {
+  EXPECT_THROW(CreateCompressionCodec("not_a_codec"), EnforceNotMet);
+}
+
+TEST(CompressionTest, CompressedBlobRoundTrip) {
+  ExpectCodecRoundTrip("test_rle");
+  Blob blob;
+  auto* tensor = blob.GetMutable<TensorCPU>();
+  tensor->Resize(1000);
+  memset(tensor->mutable_data<float>(), 0, tensor->nbytes());
+  const string serialized = blob.Serialize("sparse");
+  const string compressed = CompressSerializedBlob(serialized, "test_rle");
+  EXPECT_LT(compressed.size(), serialized.size());
+
+  BlobProto proto;
+  ASSERT_TRUE(proto.ParseFromString(compressed));
+  EXPECT_EQ(proto.compression(), "test_rle");
+  Blob new_blob;
+  new_blob.Deserialize(proto);
+  EXPECT_EQ(new_blob.Get<TensorCPU>().size(), 1000);
+  DecompressBlobProto(&proto);
+  EXPECT_FALSE(proto.has_compression());
+  EXPECT_EQ(proto.name(), "sparse");
+}
+
+TEST(CompressionTest, SaveAndLoadCompressed) {
+  const string filename = std::tmpnam(nullptr);
+  Workspace ws;
+  auto* tensor = ws.CreateBlob("weights")->GetMutable<TensorCPU>();
+  tensor->Resize(2000);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = i / 500;
+  }
+
+  OperatorDef save_def;
+  save_def.set_type("Save");
+  save_def.add_input("weights");
+  AddArgument<string>("db", filename, &save_def);
+  AddArgument<string>("db_type", "minidb", &save_def);
+  AddArgument<int>("absolute_path", 1, &save_def);
+  AddArgument<string>("compression", "test_rle", &save_def);
+  ASSERT_TRUE(ws.RunOperatorOnce(save_def));
+  {
+    std::unique_ptr<db::DB> in_db(db::CreateDB("minidb", filename, db::READ));
+    std::unique_ptr<db::Cursor> cursor(in_db->NewCursor());
+    ASSERT_TRUE(cursor->Valid());
+    BlobProto proto;
+    ASSERT_TRUE(proto.ParseFromString(cursor->value()));
+    EXPECT_EQ(proto.compression(), "test_rle");
+  }
+
+  OperatorDef load_def;
+  load_def.set_type("Load");
+  load_def.add_output("weights");
+  AddArgument<string>("db", filename, &load_def);
+  AddArgument<string>("db_type", "minidb", &load_def);
+  AddArgument<int>("absolute_path", 1, &load_def);
+  Workspace load_ws;
+  ASSERT_TRUE(load_ws.RunOperatorOnce(load_def));
+  const auto& loaded = load_ws.GetBlob("weights")->Get<TensorCPU>();
+  ASSERT_EQ(loaded.size(), tensor->size());
+  for (int i = 0; i < tensor->size(); ++i) {
+    EXPECT_EQ(loaded.data<float>()[i], tensor->data<float>()[i]);
+  }
+
+  AddArgument<string>("compression", "not_a_codec", &save_def);
+  EXPECT_THROW(ws.RunOperatorOnce(save_def), EnforceNotMet);
+  std::remove(filename.c_str());
+}
+
+#ifdef CAFFE2_USE_LZ4
+TEST(CompressionTest, LZ4) {
+  ExpectCodecRoundTrip("lz4");
+}
+#endif
+
+#ifdef CAFFE2_USE_ZSTD
+TEST(CompressionTest, Zstd) {
+  ExpectCodecRoundTrip("zstd");
+}
+#endif
+
+} // namespace caffe2
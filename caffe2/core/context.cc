@@ -13,4 +13,13 @@ void SetCPUAllocator(CPUAllocator* alloc) {
   g_cpu_allocator.reset(alloc);
 }
 
+static std::unique_ptr<CPUAllocator> g_pinned_cpu_allocator;
+CPUAllocator* GetPinnedCPUAllocator() {
+  return g_pinned_cpu_allocator.get();
+}
+
+void SetPinnedCPUAllocator(CPUAllocator* alloc) {
+  g_pinned_cpu_allocator.reset(alloc);
+}
+
 }  // namespace caffe2
@@ -6,6 +6,8 @@
 #include <random>
 
 #include "caffe2/core/logging.h"
+#include "caffe2/core/memory_tracking.h"
+#include "caffe2/core/numa.h"
 #include "caffe2/core/typeid.h"
 #include "caffe2/proto/caffe2.pb.h"
 #include "caffe2/utils/math.h"
@@ -35,6 +37,11 @@ struct DefaultCPUAllocator final : CPUAllocator {
 #else
     CAFFE_ENFORCE_EQ(posix_memalign(&data, gCaffe2Alignment, nbytes), 0);
 #endif
+    // Place the memory on the node of the allocating thread before it is
+    // first touched below.
+    if (FLAGS_caffe2_cpu_numa_enabled) {
+      NUMAMove(data, nbytes, GetCurrentNUMANode());
+    }
     memset(data, 0, nbytes);
     return data;
   }
@@ -47,6 +54,14 @@ CPUAllocator* GetCPUAllocator();
 // ownership of the pointer.
 void SetCPUAllocator(CPUAllocator* alloc);
 
+// Get the allocator of page-locked host memory, used for the CPU buffers that
+// are copied to and from GPUs. This is nullptr until the CUDA runtime installs
+// one, and thus always in CPU-only builds.
+CPUAllocator* GetPinnedCPUAllocator();
+// Sets the pinned CPU allocator: the caller gives away the ownership of the
+// pointer.
+void SetPinnedCPUAllocator(CPUAllocator* alloc);
+
 /**
  * The CPU Context, representing the bare minimum of what a Context class in
  * Caffe2 should implement.
@@ -102,10 +117,35 @@ class CPUContext final {
     return *random_generator_.get();
   }
 
+  // The key of the Philox stream of the seed, and the first of num_blocks
+  // blocks of it that nothing else of this context draws. math::RandUniform,
+  // math::RandGaussian and Dropout take their numbers from there, so they
+  // give the same numbers for a seed on any number of threads.
+  inline uint64_t PhiloxKey() const {
+    return static_cast<uint32_t>(random_seed_);
+  }
+  inline uint64_t ReservePhiloxBlocks(uint64_t num_blocks) {
+    const uint64_t first = philox_counter_;
+    philox_counter_ += num_blocks;
+    return first;
+  }
+
   inline static void* New(size_t nbytes) {
-    return GetCPUAllocator()->New(nbytes);
+    if (FLAGS_caffe2_memory_tracking) {
+      MemoryTracker::Get()->EnforceBudget(nbytes);
+    }
+    void* data = GetCPUAllocator()->New(nbytes);
+    if (FLAGS_caffe2_memory_tracking) {
+      MemoryTracker::Get()->RecordNew(data, nbytes, CPU, 0);
+    }
+    return data;
+  }
+  inline static void Delete(void* data) {
+    if (FLAGS_caffe2_memory_tracking) {
+      MemoryTracker::Get()->RecordDelete(data);
+    }
+    GetCPUAllocator()->Delete(data);
   }
-  inline static void Delete(void* data) { GetCPUAllocator()->Delete(data); }
 
   // Two copy functions that deals with cross-device copies.
   template <class SrcContext, class DstContext>
@@ -138,6 +178,7 @@ class CPUContext final {
   // TODO(jiayq): instead of hard-coding a generator, make it more flexible.
   int random_seed_{1701};
   std::unique_ptr<std::mt19937> random_generator_;
+  uint64_t philox_counter_{0};
 };
 
 template<>
@@ -1,7 +1,12 @@
 #include <algorithm>
 #include <atomic>
 #include <cstdlib>
+#include <cstring>
+#include <map>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "cub/util_allocator.cuh"
 #include "cnmem.h"
@@ -21,7 +26,7 @@
 
 CAFFE2_DEFINE_string(caffe2_cuda_memory_pool, "",
               "Sets the memory pool used by caffe2. Possible values are "
-              "none, cnmen and cub.");
+              "none, cnmen, cub and caffe2.");
 CAFFE2_DEFINE_double(caffe2_cnmem_reserve, 0.8,
              "Sets the proportion of memory pre-allocated by the memory "
              "pool if you use cnmem.");
@@ -41,6 +46,16 @@ CAFFE2_DEFINE_int(caffe2_cub_min_bin, 6,
 CAFFE2_DEFINE_int(caffe2_cub_max_bin, 16,
              "If using cub as the memory allocator, sets the max number of "
              "bins.");
+CAFFE2_DEFINE_int64(caffe2_cuda_memory_pool_max_cached_bytes, 0,
+             "If using caffe2 as the memory allocator, sets the number of "
+             "freed bytes that may be cached on every gpu before memory is "
+             "returned to the system. 0 means no limit.");
+CAFFE2_DEFINE_bool(caffe2_cuda_pinned_memory_pool, true,
+             "If set, the pinned CPU allocator caches freed pinned memory "
+             "for reuse instead of returning it with cudaFreeHost.");
+CAFFE2_DEFINE_int64(caffe2_cuda_pinned_memory_pool_max_cached_bytes, 256 << 20,
+             "The number of freed bytes that the pinned memory pool may "
+             "cache before returning memory to the system.");
 
 namespace caffe2 {
 
@@ -58,6 +73,10 @@ CudaMemoryPoolType g_cuda_memory_pool_type;
 vector<bool> g_cnmem_available_for_device;
 // For cub allocator
 unique_ptr<cub::CachingDeviceAllocator> g_cub_allocator;
+// For caffe2 allocator
+class CudaCachingAllocator;
+// Leaked on purpose, since device memory may still be deleted at exit.
+CudaCachingAllocator* g_caffe2_cuda_allocator = nullptr;
 
 CudaMemoryPoolType GetCudaMemoryPoolType() {
   return g_cuda_memory_pool_type;
@@ -103,14 +122,11 @@ static void Caffe2InitializeCuda() {
     // Enable peer access.
     for (int j = 0; j < NumCudaDevices(); ++j) {
       if (i == j) continue;
-      int can_access;
-      CUDA_CHECK(cudaDeviceCanAccessPeer(&can_access, i, j));
-      if (can_access) {
-        VLOG(1) << "Enabling peer access from " << i << " to " << j;
-        // Note: just for future reference, the 0 here is not a gpu id, it is
-        // a reserved flag for cudaDeviceEnablePeerAccess that should always be
-        // zero currently.
-        CUDA_CHECK(cudaDeviceEnablePeerAccess(j, 0));
+      if (EnableCudaPeerAccess(i, j)) {
+        VLOG(1) << "Enabled peer access from " << i << " to " << j;
+      } else {
+        VLOG(1) << "No peer access from " << i << " to " << j
+                << ", copies between them are staged through the host.";
       }
     }
   }
@@ -121,6 +137,18 @@ static void Caffe2InitializeCuda() {
     TypeMeta::Id<Tensor<CUDAContext>>(),
     GetTensorShape<CUDAContext>
   );
+  RegisterCapacityCallFunction(
+    TypeMeta::Id<Tensor<CUDAContext>>(),
+    GetTensorCapacity<CUDAContext>
+  );
+  RegisterDataPointerCallFunction(
+    TypeMeta::Id<Tensor<CUDAContext>>(),
+    GetTensorDataPointer<CUDAContext>
+  );
+  RegisterItemTypeCallFunction(
+    TypeMeta::Id<Tensor<CUDAContext>>(),
+    GetTensorItemType<CUDAContext>
+  );
 }
 
 static void SetUpCNMEM() {
@@ -201,6 +229,216 @@ static void SetUpCub() {
   VLOG(1) << "Done setting up cub memory pool.";
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// The caffe2 memory pool, which caches freed device memory per gpu.
+//
+// Freed blocks remember the stream of the thread that allocated them, and an
+// allocation from the same stream may reuse them right away, since the work
+// queued on a stream runs in order. An allocation from another stream only
+// reuses a block once the work queued on its stream before the free is
+// done, which is tracked with an event. Blocks freed by another thread than
+// the one that allocated them are not tracked: like with the other pools,
+// it is then up to the threads to synchronize, which caffe2 operators do
+// when they finish.
+//
+// All the calls are made under CUDAContext::mutex().
+///////////////////////////////////////////////////////////////////////////////
+class CudaCachingAllocator {
+ public:
+  void* New(size_t nbytes, int gpu_id, cudaStream_t stream) {
+    const size_t size = RoundSize(nbytes);
+    DevicePool& pool = pools_[gpu_id];
+    Block* block = TakeCachedBlock(&pool, size, stream);
+    if (!block) {
+      void* ptr = nullptr;
+      cudaError_t err = cudaMalloc(&ptr, size);
+      if (err == cudaErrorMemoryAllocation) {
+        // Under memory pressure, give the cached blocks back and retry.
+        cudaGetLastError();
+        VLOG(1) << "Out of memory on gpu " << gpu_id
+                << ", freeing the cached blocks.";
+        FreeCached(gpu_id);
+        err = cudaMalloc(&ptr, size);
+      }
+      CUDA_CHECK(err);
+      block = new Block();
+      block->ptr = ptr;
+      block->size = size;
+      block->gpu_id = gpu_id;
+      ++pool.stats.num_cuda_mallocs;
+    }
+    block->requested = nbytes;
+    block->stream = stream;
+    block->thread_id = std::this_thread::get_id();
+    allocated_blocks_[block->ptr] = block;
+    pool.stats.bytes_in_use += block->size;
+    pool.stats.bytes_requested += nbytes;
+    ++pool.stats.num_allocations;
+    pool.stats.peak_bytes_reserved = std::max(
+        pool.stats.peak_bytes_reserved,
+        pool.stats.bytes_in_use + pool.stats.bytes_cached);
+    return block->ptr;
+  }
+
+  void Delete(void* ptr) {
+    if (!ptr) {
+      return;
+    }
+    auto it = allocated_blocks_.find(ptr);
+    CAFFE_ENFORCE(
+        it != allocated_blocks_.end(),
+        "Deleting memory that was not allocated by the caffe2 memory pool.");
+    Block* block = it->second;
+    allocated_blocks_.erase(it);
+    DevicePool& pool = pools_[block->gpu_id];
+    pool.stats.bytes_in_use -= block->size;
+    pool.stats.bytes_requested -= block->requested;
+    if (FLAGS_caffe2_cuda_memory_pool_max_cached_bytes > 0 &&
+        pool.stats.bytes_cached + block->size >
+            FLAGS_caffe2_cuda_memory_pool_max_cached_bytes) {
+      FreeBlock(block);
+      return;
+    }
+    if (block->thread_id == std::this_thread::get_id()) {
+      RecordFreeEvent(&pool, block);
+    }
+    pool.free_blocks.emplace(block->size, block);
+    pool.stats.bytes_cached += block->size;
+  }
+
+  void FreeCached(int gpu_id) {
+    DevicePool& pool = pools_[gpu_id];
+    for (auto& entry : pool.free_blocks) {
+      FreeBlock(entry.second);
+    }
+    pool.free_blocks.clear();
+    pool.stats.bytes_cached = 0;
+    DeviceGuard guard(gpu_id);
+    for (cudaEvent_t event : pool.events) {
+      cudaEventDestroy(event);
+    }
+    pool.events.clear();
+  }
+
+  CudaMemoryPoolStats GetStats(int gpu_id) {
+    return pools_[gpu_id].stats;
+  }
+
+ private:
+  struct Block {
+    void* ptr;
+    size_t size;
+    size_t requested;
+    int gpu_id;
+    cudaStream_t stream;
+    std::thread::id thread_id;
+    // Recorded on the stream when the block was freed, if it is tracked.
+    cudaEvent_t event = nullptr;
+  };
+
+  struct DevicePool {
+    std::multimap<size_t, Block*> free_blocks;
+    // Events that are not recorded for any block, for reuse.
+    vector<cudaEvent_t> events;
+    CudaMemoryPoolStats stats;
+  };
+
+  // Small blocks are rounded up to 512 bytes, so that e.g. several bias
+  // vectors can share a size, and large blocks to 1MB.
+  static size_t RoundSize(size_t nbytes) {
+    constexpr size_t kSmallRound = 512;
+    constexpr size_t kLargeRound = 1 << 20;
+    const size_t round = nbytes < kLargeRound ? kSmallRound : kLargeRound;
+    return std::max<size_t>((nbytes + round - 1) / round * round, round);
+  }
+
+  // Finds the smallest cached block that is large enough, wastes at most a
+  // fourth of its size, and is safe to use from the given stream.
+  Block* TakeCachedBlock(DevicePool* pool, size_t size, cudaStream_t stream) {
+    for (auto it = pool->free_blocks.lower_bound(size);
+         it != pool->free_blocks.end() && it->first <= size + size / 4;
+         ++it) {
+      Block* block = it->second;
+      if (block->event && block->stream != stream) {
+        cudaError_t err = cudaEventQuery(block->event);
+        if (err == cudaErrorNotReady) {
+          cudaGetLastError();
+          continue;
+        }
+        CUDA_CHECK(err);
+      }
+      pool->free_blocks.erase(it);
+      pool->stats.bytes_cached -= block->size;
+      if (block->event) {
+        pool->events.push_back(block->event);
+        block->event = nullptr;
+      }
+      return block;
+    }
+    return nullptr;
+  }
+
+  void RecordFreeEvent(DevicePool* pool, Block* block) {
+    DeviceGuard guard(block->gpu_id);
+    cudaEvent_t event;
+    if (!pool->events.empty()) {
+      event = pool->events.back();
+      pool->events.pop_back();
+    } else {
+      CUDA_CHECK(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+    }
+    // The stream is gone if the thread that allocated the block exited, as
+    // it happens at exit time. There is nothing to wait for then.
+    if (cudaEventRecord(event, block->stream) != cudaSuccess) {
+      cudaGetLastError();
+      pool->events.push_back(event);
+      return;
+    }
+    block->event = event;
+  }
+
+  void FreeBlock(Block* block) {
+    DeviceGuard guard(block->gpu_id);
+    if (block->event) {
+      cudaEventDestroy(block->event);
+    }
+    cudaError_t err = cudaFree(block->ptr);
+    // The cuda runtime may already be unloading at exit.
+    if (err != cudaSuccess && err != cudaErrorCudartUnloading) {
+      CUDA_CHECK(err);
+    }
+    delete block;
+  }
+
+  std::unordered_map<void*, Block*> allocated_blocks_;
+  DevicePool pools_[CAFFE2_COMPILE_TIME_MAX_GPUS];
+};
+
+CudaMemoryPoolStats GetCudaMemoryPoolStats(int gpu_id) {
+  CAFFE_ENFORCE(gpu_id >= 0 && gpu_id < CAFFE2_COMPILE_TIME_MAX_GPUS);
+  std::lock_guard<std::mutex> lock(CUDAContext::mutex());
+  if (g_cuda_memory_pool_type != CudaMemoryPoolType::CAFFE2) {
+    return CudaMemoryPoolStats();
+  }
+  return g_caffe2_cuda_allocator->GetStats(gpu_id);
+}
+
+void EmptyCudaMemoryPoolCache() {
+  std::lock_guard<std::mutex> lock(CUDAContext::mutex());
+  switch (g_cuda_memory_pool_type) {
+  case CudaMemoryPoolType::CUB:
+    CUDA_CHECK(g_cub_allocator->FreeAllCached());
+    break;
+  case CudaMemoryPoolType::CAFFE2:
+    for (int i = 0; i < NumCudaDevices(); ++i) {
+      g_caffe2_cuda_allocator->FreeCached(i);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
 static void Caffe2SetCUDAMemoryPool() {
   if (FLAGS_caffe2_cuda_memory_pool == "" ||
       FLAGS_caffe2_cuda_memory_pool == "none") {
@@ -213,12 +451,163 @@ static void Caffe2SetCUDAMemoryPool() {
     // Sets up cub.
     g_cuda_memory_pool_type = CudaMemoryPoolType::CUB;
     SetUpCub();
+  } else if (FLAGS_caffe2_cuda_memory_pool == "caffe2") {
+    g_cuda_memory_pool_type = CudaMemoryPoolType::CAFFE2;
+    g_caffe2_cuda_allocator = new CudaCachingAllocator();
   } else {
     CAFFE_THROW("Unrecognized cuda memory pool type: ",
                 FLAGS_caffe2_cuda_memory_pool);
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// The pinned memory pool, which caches the blocks of pinned memory freed by
+// PinnedCPUAllocator. Block sizes are rounded up to powers of two so that
+// they can be reused for similar requests, such as the staging buffers of
+// consecutive batches.
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+
+class PinnedMemoryPool {
+ public:
+  static PinnedMemoryPool* Get() {
+    // Leaked on purpose, since pinned memory may still be deleted at exit.
+    static PinnedMemoryPool* pool = new PinnedMemoryPool();
+    return pool;
+  }
+
+  void* New(size_t nbytes) {
+    size_t block_bytes = kMinBlockBytes;
+    while (block_bytes < nbytes) {
+      block_bytes <<= 1;
+    }
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      auto& blocks = free_blocks_[block_bytes];
+      if (!blocks.empty()) {
+        void* data = blocks.back();
+        blocks.pop_back();
+        cached_bytes_ -= block_bytes;
+        return data;
+      }
+    }
+    void* data = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(CUDAContext::mutex());
+      CUDA_CHECK(cudaMallocHost(&data, block_bytes));
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    block_bytes_[data] = block_bytes;
+    return data;
+  }
+
+  // Returns false if the memory was not allocated by the pool.
+  bool Delete(void* data) {
+    std::unique_lock<std::mutex> guard(mutex_);
+    auto it = block_bytes_.find(data);
+    if (it == block_bytes_.end()) {
+      return false;
+    }
+    const size_t block_bytes = it->second;
+    if (cached_bytes_ + block_bytes <=
+        FLAGS_caffe2_cuda_pinned_memory_pool_max_cached_bytes) {
+      free_blocks_[block_bytes].push_back(data);
+      cached_bytes_ += block_bytes;
+      return true;
+    }
+    block_bytes_.erase(it);
+    guard.unlock();
+    FreeHost(data);
+    return true;
+  }
+
+  void FreeCached() {
+    std::vector<void*> blocks;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      for (auto& bin : free_blocks_) {
+        for (void* data : bin.second) {
+          block_bytes_.erase(data);
+          blocks.push_back(data);
+        }
+        bin.second.clear();
+      }
+      cached_bytes_ = 0;
+    }
+    for (void* data : blocks) {
+      FreeHost(data);
+    }
+  }
+
+ private:
+  static constexpr size_t kMinBlockBytes = 4096;
+
+  PinnedMemoryPool() {}
+
+  static void FreeHost(void* data) {
+    std::lock_guard<std::mutex> lock(CUDAContext::mutex());
+    cudaError_t err = cudaFreeHost(data);
+    // The cuda runtime may already be unloaded at exit.
+    if (err != cudaErrorCudartUnloading) {
+      CUDA_CHECK(err);
+    }
+  }
+
+  std::mutex mutex_;
+  // All the blocks of the pool, in use or cached, with their sizes.
+  std::unordered_map<void*, size_t> block_bytes_;
+  std::unordered_map<size_t, std::vector<void*>> free_blocks_;
+  size_t cached_bytes_ = 0;
+
+  DISABLE_COPY_AND_ASSIGN(PinnedMemoryPool);
+};
+
+constexpr size_t PinnedMemoryPool::kMinBlockBytes;
+
+}  // namespace
+
+void* PinnedCPUAllocator::New(size_t nbytes) {
+  void* data = nullptr;
+  if (FLAGS_caffe2_cuda_pinned_memory_pool) {
+    data = PinnedMemoryPool::Get()->New(nbytes);
+  } else {
+    std::lock_guard<std::mutex> lock(CUDAContext::mutex());
+    CUDA_CHECK(cudaMallocHost(&data, nbytes));
+  }
+  memset(data, 0, nbytes);
+  return data;
+}
+
+void PinnedCPUAllocator::Delete(void* data) {
+  if (!data) {
+    return;
+  }
+  // The pool is checked even if it is turned off now, since it may have been
+  // on when the memory was allocated.
+  if (PinnedMemoryPool::Get()->Delete(data)) {
+    return;
+  }
+  // Caffe2 uses a lazy way to figure out if one is actually going to use GPUs
+  // or not. If a CUDAContext::New() call is made, inside the CUDAContext
+  // function we will switch the cpu side allocator to a PinnedCPUAllocator.
+  // But, if one calls CPUContext::New() before any cuda allocations,
+  // PinnedCPUAllocator can still delete the corresponding memory.
+  std::lock_guard<std::mutex> lock(CUDAContext::mutex());
+  cudaError_t err = cudaFreeHost(data);
+  if (err == cudaErrorInvalidValue) {
+    free(data);
+    // Calling cudaGetLastError will reset the cuda error.
+    cudaGetLastError();
+  } else {
+    // For all other errors, still do a cuda check.
+    CUDA_CHECK(err);
+  }
+}
+
+void FreeCachedPinnedMemory() {
+  PinnedMemoryPool::Get()->FreeCached();
+}
+
 // An initialization function that sets the CPU side to use pinned cpu
 // allocator.
 void Caffe2UsePinnedCPUAllocator() {
@@ -236,6 +625,7 @@ void Caffe2UsePinnedCPUAllocator() {
   }
   VLOG(1) << "Caffe2 gpu: setting CPUAllocator to PinnedCPUAllocator.";
   SetCPUAllocator(new PinnedCPUAllocator());
+  SetPinnedCPUAllocator(new PinnedCPUAllocator());
 #endif
 }
 
@@ -279,16 +669,135 @@ std::mutex& CUDAContext::mutex() {
   return m;
 }
 
+namespace {
+// The size of the chunks staged through the host. The staging buffer of a
+// stream holds two of them.
+constexpr size_t kStagingChunkBytes = 4 << 20;
+
+// Returns the device holding ptr, or -1 if it is not device memory.
+int GetDeviceOfPointer(const void* ptr) {
+  cudaPointerAttributes attr;
+  if (cudaPointerGetAttributes(&attr, ptr) != cudaSuccess) {
+    // Host memory that was never registered with CUDA; clear the error.
+    cudaGetLastError();
+    return -1;
+  }
+  return attr.memoryType == cudaMemoryTypeDevice ? attr.device : -1;
+}
+
+cudaEvent_t CreateEvent(int gpu) {
+  DeviceGuard guard(gpu);
+  cudaEvent_t event;
+  CUDA_CHECK(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+  return event;
+}
+} // namespace
+
+void* ThreadLocalCUDAObjects::GetStagingBuffer(
+    int gpu,
+    int stream_id,
+    size_t nbytes) {
+  vector<void*>& gpu_buffers = staging_buffers_[gpu];
+  if (gpu_buffers.size() <= stream_id) {
+    gpu_buffers.resize(stream_id + 1);
+  }
+  if (!gpu_buffers[stream_id]) {
+    std::lock_guard<std::mutex> lock(CUDAContext::mutex());
+    CUDA_CHECK(cudaMallocHost(&gpu_buffers[stream_id], nbytes));
+  }
+  return gpu_buffers[stream_id];
+}
+
+void CUDAContext::CopyBytesBetweenDevices(
+    size_t nbytes,
+    const void* src,
+    void* dst) {
+  static const bool multiple_gpus = NumCudaDevices() > 1;
+  if (multiple_gpus && nbytes > 0) {
+    const int src_gpu = GetDeviceOfPointer(src);
+    const int dst_gpu = GetDeviceOfPointer(dst);
+    if (src_gpu >= 0 && dst_gpu >= 0 && src_gpu != dst_gpu &&
+        !CudaPeerAccessEnabled(dst_gpu, src_gpu)) {
+      CopyBytesThroughHost(nbytes, src, src_gpu, dst, dst_gpu);
+      return;
+    }
+  }
+  CUDA_CHECK(cudaMemcpyAsync(
+      dst, src, nbytes, cudaMemcpyDefault, cuda_stream()));
+}
+
+void CUDAContext::CopyBytesThroughHost(
+    size_t nbytes,
+    const void* src,
+    int src_gpu,
+    void* dst,
+    int dst_gpu) {
+  char* buffers = static_cast<char*>(cuda_objects_.GetStagingBuffer(
+      gpu_id_, stream_id_, 2 * kStagingChunkBytes));
+  cudaStream_t stream = cuda_stream();
+  cudaStream_t src_stream = cuda_stream(src_gpu, stream_id_);
+  cudaStream_t dst_stream = cuda_stream(dst_gpu, stream_id_);
+
+  // Both streams start after the work already issued on this context's
+  // stream, which includes the previous copies through the same buffer.
+  cudaEvent_t start = CreateEvent(gpu_id_);
+  cudaEvent_t copied_to_host[2] = {CreateEvent(src_gpu), CreateEvent(src_gpu)};
+  cudaEvent_t copied_to_device[2] = {CreateEvent(dst_gpu),
+                                     CreateEvent(dst_gpu)};
+  CUDA_CHECK(cudaEventRecord(start, stream));
+  CUDA_CHECK(cudaStreamWaitEvent(src_stream, start, 0));
+  CUDA_CHECK(cudaStreamWaitEvent(dst_stream, start, 0));
+
+  for (size_t offset = 0, chunk = 0; offset < nbytes;
+       offset += kStagingChunkBytes, ++chunk) {
+    const size_t bytes = std::min(kStagingChunkBytes, nbytes - offset);
+    const int b = chunk % 2;
+    char* buffer = buffers + b * kStagingChunkBytes;
+    if (chunk >= 2) {
+      // The chunk that used this half of the buffer has reached dst.
+      CUDA_CHECK(cudaStreamWaitEvent(src_stream, copied_to_device[b], 0));
+    }
+    CUDA_CHECK(cudaMemcpyAsync(
+        buffer,
+        static_cast<const char*>(src) + offset,
+        bytes,
+        cudaMemcpyDeviceToHost,
+        src_stream));
+    CUDA_CHECK(cudaEventRecord(copied_to_host[b], src_stream));
+    CUDA_CHECK(cudaStreamWaitEvent(dst_stream, copied_to_host[b], 0));
+    CUDA_CHECK(cudaMemcpyAsync(
+        static_cast<char*>(dst) + offset,
+        buffer,
+        bytes,
+        cudaMemcpyHostToDevice,
+        dst_stream));
+    CUDA_CHECK(cudaEventRecord(copied_to_device[b], dst_stream));
+  }
+
+  // The work issued later on this context's stream waits for the copy.
+  const int last = ((nbytes - 1) / kStagingChunkBytes) % 2;
+  CUDA_CHECK(cudaStreamWaitEvent(stream, copied_to_device[last], 0));
+  // Events can be destroyed before they complete.
+  CUDA_CHECK(cudaEventDestroy(start));
+  for (int b = 0; b < 2; ++b) {
+    CUDA_CHECK(cudaEventDestroy(copied_to_host[b]));
+    CUDA_CHECK(cudaEventDestroy(copied_to_device[b]));
+  }
+}
+
 void* CUDAContext::New(size_t nbytes) {
   // Lock the mutex
   std::lock_guard<std::mutex> lock(CUDAContext::mutex());
   // A one-time caffe2 cuda initializer.
   static Caffe2CudaInitializerHelper g_cuda_initializer_;
+  if (FLAGS_caffe2_memory_tracking) {
+    MemoryTracker::Get()->EnforceBudget(nbytes);
+  }
   void* ptr = nullptr;
   switch (g_cuda_memory_pool_type) {
   case CudaMemoryPoolType::NONE:
     CUDA_CHECK(cudaMalloc(&ptr, nbytes));
-    return ptr;
+    break;
   case CudaMemoryPoolType::CNMEM: {
     auto gpuId = GetCurrentGPUID();
     CAFFE_ENFORCE(
@@ -298,18 +807,30 @@ void* CUDAContext::New(size_t nbytes) {
         gpuId,
         " but cnmem pool is not set up for it.");
     CNMEM_CHECK(cnmemMalloc(&ptr, nbytes, nullptr));
-    return ptr;
+    break;
   }
   case CudaMemoryPoolType::CUB:
     CUDA_CHECK(g_cub_allocator->DeviceAllocate(&ptr, nbytes));
-    return ptr;
+    break;
+  case CudaMemoryPoolType::CAFFE2: {
+    const int gpu_id = GetCurrentGPUID();
+    ptr = g_caffe2_cuda_allocator->New(
+        nbytes, gpu_id, cuda_objects_.GetStream(gpu_id, 0));
+    break;
   }
-  return nullptr;
+  }
+  if (ptr && FLAGS_caffe2_memory_tracking) {
+    MemoryTracker::Get()->RecordNew(ptr, nbytes, CUDA, GetCurrentGPUID());
+  }
+  return ptr;
 }
 
 void CUDAContext::Delete(void* ptr) {
   // lock the mutex
   std::lock_guard<std::mutex> lock(CUDAContext::mutex());
+  if (FLAGS_caffe2_memory_tracking) {
+    MemoryTracker::Get()->RecordDelete(ptr);
+  }
 
   switch (g_cuda_memory_pool_type) {
   case CudaMemoryPoolType::NONE: {
@@ -332,6 +853,9 @@ void CUDAContext::Delete(void* ptr) {
   case CudaMemoryPoolType::CUB:
     CUDA_CHECK(g_cub_allocator->DeviceFree(ptr));
     break;
+  case CudaMemoryPoolType::CAFFE2:
+    g_caffe2_cuda_allocator->Delete(ptr);
+    break;
   }
 }
 
@@ -6,17 +6,21 @@
 
 #include "caffe2/core/common_gpu.h"
 #include "caffe2/core/context.h"
+#include "caffe2/core/flags.h"
 #include "caffe2/core/tensor.h"
 #include "caffe2/core/types.h"
 #include "caffe2/proto/caffe2.pb.h"
 #include "caffe2/core/logging.h"
 
+CAFFE2_DECLARE_bool(caffe2_cuda_pinned_memory_pool);
+
 namespace caffe2 {
 
 enum class CudaMemoryPoolType {
   NONE = 0,
   CNMEM = 1,
   CUB = 2,
+  CAFFE2 = 3,
 };
 
 /**
@@ -26,6 +30,37 @@ enum class CudaMemoryPoolType {
  */
 CudaMemoryPoolType GetCudaMemoryPoolType();
 
+/**
+ * Statistics of the caffe2 memory pool on one GPU. The difference between
+ * bytes_in_use and bytes_requested is lost to rounding, and bytes_cached is
+ * held by free blocks that no other process can use.
+ */
+struct CudaMemoryPoolStats {
+  // Bytes of the blocks handed out by CUDAContext::New() and not deleted yet.
+  size_t bytes_in_use = 0;
+  // Bytes that were asked for by these allocations.
+  size_t bytes_requested = 0;
+  // Bytes of the free blocks that the pool keeps for reuse.
+  size_t bytes_cached = 0;
+  // The largest bytes_in_use + bytes_cached so far.
+  size_t peak_bytes_reserved = 0;
+  size_t num_allocations = 0;
+  // The allocations that could not reuse a cached block.
+  size_t num_cuda_mallocs = 0;
+};
+
+/**
+ * Returns the statistics of the caffe2 memory pool on the given GPU. All
+ * counters are zero unless --caffe2_cuda_memory_pool=caffe2.
+ */
+CudaMemoryPoolStats GetCudaMemoryPoolStats(int gpu_id);
+
+/**
+ * Returns the memory cached by the cub or caffe2 memory pool on all GPUs to
+ * the system, e.g. to make room for another process sharing the GPU.
+ */
+void EmptyCudaMemoryPoolCache();
+
 
 
 /**
@@ -79,8 +114,17 @@ class ThreadLocalCUDAObjects {
     return gpu_handles[stream_id];
   }
 
+  // The pinned host buffer used to stage copies between devices without peer
+  // access that are issued on the given stream, allocated on first use.
+  void* GetStagingBuffer(int gpu, int stream_id, size_t nbytes);
+
   ~ThreadLocalCUDAObjects() {
     for (int i = 0; i < CAFFE2_COMPILE_TIME_MAX_GPUS; ++i) {
+      for (auto buffer : staging_buffers_[i]) {
+        if (buffer) {
+          cudaFreeHost(buffer);
+        }
+      }
       for (auto handle : cublas_handles_[i]) {
         if (handle) {
           cublasDestroy(handle);
@@ -95,6 +139,7 @@ class ThreadLocalCUDAObjects {
   }
   vector<cudaStream_t> cuda_streams_[CAFFE2_COMPILE_TIME_MAX_GPUS];
   vector<cublasHandle_t> cublas_handles_[CAFFE2_COMPILE_TIME_MAX_GPUS];
+  vector<void*> staging_buffers_[CAFFE2_COMPILE_TIME_MAX_GPUS];
 };
 
 class CUDAContext final {
@@ -192,7 +237,20 @@ class CUDAContext final {
     stream_id_ = stream_id;
   }
 
+  // Copies between device pointers, see CopyBytes<CUDAContext, CUDAContext>.
+  void CopyBytesBetweenDevices(size_t nbytes, const void* src, void* dst);
+
  protected:
+  // Copies from src_gpu to dst_gpu, which have no peer access, through a
+  // pinned host buffer. Chunks are copied to the host on a stream of src_gpu
+  // and to dst_gpu on a stream of dst_gpu, so that the two directions overlap.
+  void CopyBytesThroughHost(
+      size_t nbytes,
+      const void* src,
+      int src_gpu,
+      void* dst,
+      int dst_gpu);
+
   int gpu_id_;
   int stream_id_ = 0;
   int random_seed_;
@@ -200,6 +258,15 @@ class CUDAContext final {
   static thread_local ThreadLocalCUDAObjects cuda_objects_;
 };
 
+// Copies between two devices go directly when peer access between them is
+// enabled, and are staged through pinned host memory otherwise, so that they
+// stay asynchronous. Copies within a device are a plain cudaMemcpyAsync.
+template <>
+inline void CUDAContext::CopyBytes<CUDAContext, CUDAContext>(
+    size_t nbytes, const void* src, void* dst) {
+  CopyBytesBetweenDevices(nbytes, src, dst);
+}
+
 // For the CPU context, we also allow a (probably expensive) function
 // to copy the data from a cuda context. Inside the function, we create
 // a temporary CUDAContext object to carry out the copy. From the caller's
@@ -225,37 +292,26 @@ inline void CPUContext::CopyBytes<CPUContext, CUDAContext>(
  * the underlying CPU memory also needs to be allocated into pinned memory
  * space. As a result, whenever Caffe2 is built with GPU and there is
  * GPU present during runtime, at global initialization time we will set
- * the CPU memory allocator to allocate pinned memory.
+ * the CPU memory allocator to allocate pinned memory, and install it as the
+ * pinned CPU allocator used by PinnedRawMutableData().
+ *
+ * cudaMallocHost() and cudaFreeHost() are expensive and may synchronize the
+ * device, so freed pinned memory is cached for reuse when
+ * --caffe2_cuda_pinned_memory_pool is set.
  */
 struct PinnedCPUAllocator final : CPUAllocator {
   PinnedCPUAllocator() {}
   ~PinnedCPUAllocator() {}
-  void* New(size_t nbytes) override {
-    void* data;
-    std::lock_guard<std::mutex> lock(CUDAContext::mutex());
-    CUDA_CHECK(cudaMallocHost(&data, nbytes));
-    memset(data, 0, nbytes);
-    return data;
-  }
-  void Delete(void* data) override {
-    // Caffe2 uses a lazy way to figure out if one is actually going to use GPUs
-    // or not. If a CUDAContext::New() call is made, inside the CUDAContext
-    // function we will switch the cpu side allocator to a PinnedCPUAllocator.
-    // But, if one calls CPUContext::New() before any cuda allocations,
-    // PinnedCPUAllocator can still delete the corresponding memory.
-    std::lock_guard<std::mutex> lock(CUDAContext::mutex());
-    cudaError_t err = cudaFreeHost(data);
-    if (err == cudaErrorInvalidValue) {
-      free(data);
-      // Calling cudaGetLastError will reset the cuda error.
-      cudaGetLastError();
-    } else {
-      // For all other errors, still do a cuda check.
-      CUDA_CHECK(err);
-    }
-  }
+  void* New(size_t nbytes) override;
+  void Delete(void* data) override;
 };
 
+/**
+ * Returns the pinned memory cached by the pinned memory pool (see
+ * --caffe2_cuda_pinned_memory_pool) to the system.
+ */
+void FreeCachedPinnedMemory();
+
 // For simplicity, we will typedef Tensor<CPUContext> to TensorCPU.
 typedef Tensor<CUDAContext> TensorCUDA;
 
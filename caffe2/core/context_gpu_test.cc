@@ -110,4 +110,81 @@ TEST(CUDAContextTest, TestDifferntThreadDifferentobject) {
   EXPECT_NE(temp[0], temp[1]);
 }
 
+TEST(CUDAContextTest, Caffe2MemoryPoolStats) {
+  if (!HasCudaGPU() ||
+      GetCudaMemoryPoolType() != CudaMemoryPoolType::CAFFE2) {
+    return;
+  }
+  DeviceGuard guard(0);
+  const CudaMemoryPoolStats before = GetCudaMemoryPoolStats(0);
+  void* allocated = CUDAContext::New(1000);
+  CudaMemoryPoolStats stats = GetCudaMemoryPoolStats(0);
+  // 1000 bytes are rounded up to 1024.
+  EXPECT_EQ(stats.bytes_in_use - before.bytes_in_use, 1024);
+  EXPECT_EQ(stats.bytes_requested - before.bytes_requested, 1000);
+  CUDAContext::Delete(allocated);
+  // The same thread reuses the block right away.
+  EXPECT_EQ(CUDAContext::New(1000), allocated);
+  CUDAContext::Delete(allocated);
+  EXPECT_GE(GetCudaMemoryPoolStats(0).bytes_cached, 1024);
+  EmptyCudaMemoryPoolCache();
+  stats = GetCudaMemoryPoolStats(0);
+  EXPECT_EQ(stats.bytes_cached, 0);
+  EXPECT_EQ(stats.bytes_in_use, before.bytes_in_use);
+}
+
+TEST(CUDAContextTest, PinnedMemoryPool) {
+  if (!HasCudaGPU() || !FLAGS_caffe2_cuda_pinned_memory_pool) {
+    return;
+  }
+  // Initializes cuda, which installs the pinned allocators.
+  CUDAContext context(0);
+  CPUAllocator* allocator = GetPinnedCPUAllocator();
+  ASSERT_NE(allocator, nullptr);
+  void* data = allocator->New(10000);
+  cudaPointerAttributes attr;
+  CUDA_CHECK(cudaPointerGetAttributes(&attr, data));
+  EXPECT_EQ(attr.memoryType, cudaMemoryTypeHost);
+  allocator->Delete(data);
+  // The block is cached and handed out again.
+  EXPECT_EQ(allocator->New(12000), data);
+  allocator->Delete(data);
+  FreeCachedPinnedMemory();
+}
+
+TEST(CUDAContextTest, CopyBetweenDevices) {
+  if (NumCudaDevices() < 2) {
+    return;
+  }
+  // Larger than a staging chunk, so that copies without peer access go
+  // through both halves of the staging buffer.
+  const int n = 3 * (1 << 20) + 7;
+  std::vector<float> host(n), result(n);
+  for (int i = 0; i < n; ++i) {
+    host[i] = i;
+  }
+  for (int src_gpu = 0; src_gpu < 2; ++src_gpu) {
+    const int dst_gpu = 1 - src_gpu;
+    // Issue the copy on a third device's stream when there is one.
+    CUDAContext context(NumCudaDevices() > 2 ? 2 : dst_gpu);
+    float* src;
+    float* dst;
+    {
+      DeviceGuard guard(src_gpu);
+      src = static_cast<float*>(CUDAContext::New(n * sizeof(float)));
+    }
+    {
+      DeviceGuard guard(dst_gpu);
+      dst = static_cast<float*>(CUDAContext::New(n * sizeof(float)));
+    }
+    context.Copy<float, CPUContext, CUDAContext>(n, host.data(), src);
+    context.Copy<float, CUDAContext, CUDAContext>(n, src, dst);
+    context.Copy<float, CUDAContext, CPUContext>(n, dst, result.data());
+    EXPECT_TRUE(context.FinishDeviceComputation());
+    EXPECT_EQ(host, result);
+    CUDAContext::Delete(src);
+    CUDAContext::Delete(dst);
+  }
+}
+
 }  // namespace caffe2
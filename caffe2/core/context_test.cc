@@ -2,6 +2,7 @@
 
 #include "caffe2/proto/caffe2.pb.h"
 #include "caffe2/core/context.h"
+#include "caffe2/core/tensor.h"
 #include "gtest/gtest.h"
 
 namespace caffe2 {
@@ -32,4 +33,48 @@ TEST(CPUContextTest, TestAllocDealloc) {
   CPUContext::Delete(dst_data);
 }
 
+namespace {
+// Stands in for the pinned allocator of the CUDA runtime.
+struct CountingCPUAllocator final : CPUAllocator {
+  void* New(size_t nbytes) override {
+    ++live;
+    return allocator.New(nbytes);
+  }
+  void Delete(void* data) override {
+    --live;
+    allocator.Delete(data);
+  }
+  DefaultCPUAllocator allocator;
+  int live = 0;
+};
+}  // namespace
+
+TEST(CPUContextTest, TestPinnedRawMutableData) {
+  {
+    // Without a pinned allocator, this is just raw_mutable_data().
+    TensorCPU tensor(vector<TIndex>{4});
+    float* data = PinnedMutableData<float>(&tensor);
+    EXPECT_EQ(data, tensor.data<float>());
+  }
+  auto* allocator = new CountingCPUAllocator();
+  SetPinnedCPUAllocator(allocator);
+  {
+    TensorCPU tensor(vector<TIndex>{16});
+    float* data = PinnedMutableData<float>(&tensor);
+    EXPECT_EQ(allocator->live, 1);
+    EXPECT_EQ(tensor.data<float>(), data);
+    EXPECT_EQ(tensor.capacity_nbytes(), 16 * sizeof(float));
+    // The pinned storage is kept while it is large enough.
+    tensor.Resize(8);
+    EXPECT_EQ(PinnedMutableData<float>(&tensor), data);
+    EXPECT_EQ(allocator->live, 1);
+    tensor.Resize(32);
+    PinnedMutableData<float>(&tensor);
+    EXPECT_EQ(allocator->live, 1);
+    EXPECT_EQ(tensor.capacity_nbytes(), 32 * sizeof(float));
+  }
+  EXPECT_EQ(allocator->live, 0);
+  SetPinnedCPUAllocator(nullptr);
+}
+
 }  // namespace caffe2
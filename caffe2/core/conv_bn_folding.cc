@@ -0,0 +1,181 @@
+#include "caffe2/core/conv_bn_folding.h"
+
+#include <cmath>
+#include <map>
+#include <set>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+
+namespace caffe2 {
+
+namespace {
+
+const DeviceOption& GetDeviceOption(
+    const OperatorDef& op_def,
+    const NetDef& net_def) {
+  return op_def.has_device_option() ? op_def.device_option()
+                                    : net_def.device_option();
+}
+
+string GetOrder(const OperatorDef& op_def) {
+  return ArgumentHelper(op_def).GetSingleArgument<string>("order", "NCHW");
+}
+
+const TensorCPU* GetFloatTensor(Workspace* ws, const string& name) {
+  const Blob* blob = ws->GetBlob(name);
+  if (!blob || !blob->IsType<TensorCPU>()) {
+    return nullptr;
+  }
+  const auto& tensor = blob->Get<TensorCPU>();
+  return tensor.IsType<float>() ? &tensor : nullptr;
+}
+
+// A name based on base that is neither a blob of ws nor already taken.
+string UniqueBlobName(
+    const string& base,
+    Workspace* ws,
+    std::set<string>* taken) {
+  string name = base;
+  for (int i = 1; ws->HasBlob(name) || taken->count(name); ++i) {
+    name = base + "_" + caffe2::to_string(i);
+  }
+  taken->insert(name);
+  return name;
+}
+
+} // namespace
+
+NetDef FoldConvBatchNorm(const NetDef& net_def, Workspace* ws) {
+  std::map<string, int> num_reads;
+  std::set<string> blobs;
+  for (const auto& op_def : net_def.op()) {
+    for (const string& input : op_def.input()) {
+      ++num_reads[input];
+      blobs.insert(input);
+    }
+    blobs.insert(op_def.output().begin(), op_def.output().end());
+  }
+  std::set<string> external_outputs(
+      net_def.external_output().begin(), net_def.external_output().end());
+  // Whether the output of prev disappears when op is folded into prev: either
+  // op is the only reader of that output, or op overwrites it in place.
+  auto foldable = [&](const OperatorDef& prev, const OperatorDef& op) {
+    const string& blob = prev.output(0);
+    if (op.input_size() < 1 || op.input(0) != blob) {
+      return false;
+    }
+    return op.output(0) == blob ||
+        (num_reads[blob] == 1 && !external_outputs.count(blob));
+  };
+
+  NetDef folded(net_def);
+  folded.clear_op();
+  int num_folded = 0;
+  int idx = 0;
+  while (idx < net_def.op_size()) {
+    const OperatorDef& conv = net_def.op(idx);
+    const DeviceOption& device = GetDeviceOption(conv, net_def);
+    const bool is_conv = conv.type() == "Conv" && conv.input_size() >= 2 &&
+        conv.output_size() == 1 && device.device_type() == CPU &&
+        idx + 1 < net_def.op_size();
+    const OperatorDef* bn = is_conv ? &net_def.op(idx + 1) : nullptr;
+    if (!bn || bn->type() != "SpatialBN" || bn->input_size() != 5 ||
+        bn->output_size() != 1 ||
+        !ArgumentHelper(*bn).GetSingleArgument<int>("is_test", 0) ||
+        GetDeviceOption(*bn, net_def).device_type() != CPU ||
+        GetOrder(*bn) != GetOrder(conv) || !foldable(conv, *bn)) {
+      folded.add_op()->CopyFrom(conv);
+      ++idx;
+      continue;
+    }
+    const TensorCPU* filter = GetFloatTensor(ws, conv.input(1));
+    const TensorCPU* conv_bias =
+        conv.input_size() == 3 ? GetFloatTensor(ws, conv.input(2)) : nullptr;
+    vector<const TensorCPU*> params;
+    for (int i = 1; i < 5; ++i) {
+      params.push_back(GetFloatTensor(ws, bn->input(i)));
+    }
+    const int M = filter && filter->ndim() > 0 ? filter->dim32(0) : 0;
+    bool valid = M > 0 && (conv.input_size() == 2 || conv_bias);
+    if (conv_bias) {
+      valid &= conv_bias->size() == M;
+    }
+    for (const auto* param : params) {
+      valid &= param && param->size() == M;
+    }
+    // The Relu is only folded if the engine of the convolution has a
+    // ConvBiasRelu of its own, as other engines would otherwise be replaced
+    // by the default one.
+    const OperatorDef* relu =
+        idx + 2 < net_def.op_size() ? &net_def.op(idx + 2) : nullptr;
+    const bool fold_relu = relu && relu->type() == "Relu" &&
+        relu->input_size() == 1 && relu->output_size() == 1 &&
+        GetDeviceOption(*relu, net_def).device_type() == CPU &&
+        foldable(*bn, *relu) &&
+        (conv.engine().empty() ||
+         CPUOperatorRegistry()->Has("ConvBiasRelu_ENGINE_" + conv.engine()));
+    const string& output = fold_relu ? relu->output(0) : bn->output(0);
+    // The convolution cannot run in place.
+    if (!valid || output == conv.input(0)) {
+      folded.add_op()->CopyFrom(conv);
+      ++idx;
+      continue;
+    }
+
+    // Y = conv(X, W) + b; Z = (Y - mean) * s + bias, with
+    // s = scale / sqrt(var + epsilon).
+    const float epsilon =
+        ArgumentHelper(*bn).GetSingleArgument<float>("epsilon", 1e-5);
+    const float* scale = params[0]->data<float>();
+    const float* bias = params[1]->data<float>();
+    const float* mean = params[2]->data<float>();
+    const float* var = params[3]->data<float>();
+    const string filter_name =
+        UniqueBlobName(output + "_folded_filter", ws, &blobs);
+    const string bias_name =
+        UniqueBlobName(output + "_folded_bias", ws, &blobs);
+    auto* new_filter = ws->CreateBlob(filter_name)->GetMutable<TensorCPU>();
+    auto* new_bias = ws->CreateBlob(bias_name)->GetMutable<TensorCPU>();
+    new_filter->ResizeLike(*filter);
+    new_bias->Resize(M);
+    const int filter_size = filter->size() / M;
+    const float* W = filter->data<float>();
+    float* new_W = new_filter->mutable_data<float>();
+    float* new_b = new_bias->mutable_data<float>();
+    for (int m = 0; m < M; ++m) {
+      const float s = scale[m] / std::sqrt(var[m] + epsilon);
+      for (int i = 0; i < filter_size; ++i) {
+        new_W[m * filter_size + i] = W[m * filter_size + i] * s;
+      }
+      const float b = conv_bias ? conv_bias->data<float>()[m] : 0;
+      new_b[m] = (b - mean[m]) * s + bias[m];
+    }
+
+    OperatorDef op_def(conv);
+    if (fold_relu) {
+      op_def.set_type("ConvBiasRelu");
+    }
+    op_def.set_input(1, filter_name);
+    if (op_def.input_size() == 3) {
+      op_def.set_input(2, bias_name);
+    } else {
+      op_def.add_input(bias_name);
+    }
+    op_def.set_output(0, output);
+    // Nets that declare their inputs must declare the new parameters too.
+    if (net_def.external_input_size()) {
+      folded.add_external_input(filter_name);
+      folded.add_external_input(bias_name);
+    }
+    folded.add_op()->CopyFrom(op_def);
+    num_folded += fold_relu ? 2 : 1;
+    idx += fold_relu ? 3 : 2;
+  }
+  VLOG(1) << "Folded " << num_folded << " SpatialBN and Relu operators of net "
+          << net_def.name() << " into convolutions.";
+  return folded;
+}
+
+}  // namespace caffe2
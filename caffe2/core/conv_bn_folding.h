@@ -0,0 +1,33 @@
+#ifndef CAFFE2_CORE_CONV_BN_FOLDING_H_
+#define CAFFE2_CORE_CONV_BN_FOLDING_H_
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+
+// Folds the inference SpatialBN operators that directly follow a Conv into
+// the filter and bias of the convolution, and the Relu that directly follows
+// either of them into a ConvBiasRelu operator, so that each layer makes one
+// pass over its output instead of three.
+//
+// A SpatialBN with is_test set normalizes channel m with
+//   y = (x - mean[m]) * scale[m] / sqrt(var[m] + epsilon) + bias[m],
+// which is folded into the convolution by scaling the filters of output m by
+// s[m] = scale[m] / sqrt(var[m] + epsilon), and replacing the conv bias b by
+// (b[m] - mean[m]) * s[m] + bias[m]. The folded filter and bias are written
+// to new blobs of ws, so the original parameters are left untouched, and the
+// rewritten net refers to the new blobs.
+//
+// Only CPU operators with the same storage order are folded, and only when
+// the filter, bias and SpatialBN parameters are float tensors already present
+// in ws: the folding is meant to run once at load time, after the init net.
+// As for FuseElementwiseOps, the intermediate outputs must be read by the next
+// operator only (or be overwritten in place), and must not be external
+// outputs of the net.
+NetDef FoldConvBatchNorm(const NetDef& net_def, Workspace* ws);
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_CONV_BN_FOLDING_H_
@@ -0,0 +1,174 @@
+#include <random>
+
+#include "caffe2/core/conv_bn_folding.h"
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    float min,
+    float max,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(min, max);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+OperatorDef* AddOp(
+    NetDef* net,
+    const string& type,
+    const vector<string>& inputs,
+    const string& output,
+    const string& order) {
+  auto* op = net->add_op();
+  op->set_type(type);
+  for (const auto& input : inputs) {
+    op->add_input(input);
+  }
+  op->add_output(output);
+  if (!order.empty()) {
+    AddArgument<string>("order", order, op);
+  }
+  return op;
+}
+
+// Conv, SpatialBN and optionally Relu, in the given storage order, with the
+// parameters in ws. SpatialBN cannot run in place, but Relu can.
+NetDef ConvBNNet(
+    const string& order,
+    bool conv_bias,
+    bool relu,
+    bool inplace,
+    Workspace* ws) {
+  const int N = 2, C = 3, M = 5, H = 6, W = 7;
+  std::mt19937 gen(0);
+  AddRandomTensor(
+      ws, "X", order == "NCHW" ? vector<TIndex>{N, C, H, W}
+                               : vector<TIndex>{N, H, W, C},
+      -1, 1, &gen);
+  AddRandomTensor(
+      ws, "W", order == "NCHW" ? vector<TIndex>{M, C, 3, 3}
+                               : vector<TIndex>{M, 3, 3, C},
+      -1, 1, &gen);
+  AddRandomTensor(ws, "b", {M}, -1, 1, &gen);
+  AddRandomTensor(ws, "scale", {M}, 0.5, 2, &gen);
+  AddRandomTensor(ws, "bias", {M}, -1, 1, &gen);
+  AddRandomTensor(ws, "mean", {M}, -1, 1, &gen);
+  AddRandomTensor(ws, "var", {M}, 0.5, 2, &gen);
+  NetDef net;
+  net.set_name("conv_bn");
+  vector<string> conv_inputs{"X", "W"};
+  if (conv_bias) {
+    conv_inputs.push_back("b");
+  }
+  auto* conv = AddOp(&net, "Conv", conv_inputs, "Y", order);
+  AddArgument<int>("kernel", 3, conv);
+  AddArgument<int>("pad", 1, conv);
+  auto* bn = AddOp(
+      &net, "SpatialBN", {"Y", "scale", "bias", "mean", "var"}, "Z", order);
+  AddArgument<int>("is_test", 1, bn);
+  AddArgument<float>("epsilon", 1e-3, bn);
+  const string output = relu && !inplace ? "out" : "Z";
+  if (relu) {
+    AddOp(&net, "Relu", {"Z"}, output, "");
+  }
+  net.add_external_output(output);
+  return net;
+}
+
+void ExpectSameOutput(const NetDef& net, const NetDef& folded, Workspace* ws) {
+  const string& output = net.external_output(0);
+  ASSERT_TRUE(ws->RunNetOnce(net));
+  TensorCPU expected(ws->GetBlob(output)->Get<TensorCPU>());
+  ws->GetBlob(output)->GetMutable<TensorCPU>()->mutable_data<float>()[0] = -7;
+  ASSERT_TRUE(ws->RunNetOnce(folded));
+  const auto& actual = ws->GetBlob(output)->Get<TensorCPU>();
+  ASSERT_EQ(expected.dims(), actual.dims());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected.data<float>()[i], actual.data<float>()[i], 1e-4);
+  }
+}
+
+} // namespace
+
+TEST(ConvBNFoldingTest, FoldsIntoConvolution) {
+  for (const string order : {"NCHW", "NHWC"}) {
+    for (bool conv_bias : {false, true}) {
+      for (bool relu : {false, true}) {
+        for (bool inplace : {false, true}) {
+          if (inplace && !relu) {
+            continue;
+          }
+          Workspace ws;
+          const NetDef net = ConvBNNet(order, conv_bias, relu, inplace, &ws);
+          const NetDef folded = FoldConvBatchNorm(net, &ws);
+          ASSERT_EQ(folded.op_size(), 1);
+          const auto& op = folded.op(0);
+          EXPECT_EQ(op.type(), relu ? "ConvBiasRelu" : "Conv");
+          EXPECT_EQ(op.input_size(), 3);
+          EXPECT_EQ(op.input(0), "X");
+          EXPECT_EQ(op.output(0), net.external_output(0));
+          ExpectSameOutput(net, folded, &ws);
+          // The original parameters are left untouched.
+          EXPECT_EQ(ws.GetBlob("W")->Get<TensorCPU>().dim32(0), 5);
+        }
+      }
+    }
+  }
+}
+
+TEST(ConvBNFoldingTest, KeepsIntermediateOutputsThatAreUsed) {
+  Workspace ws;
+  NetDef net = ConvBNNet("NCHW", true, true, false, &ws);
+  // The output of the convolution is an output of the net: nothing is folded.
+  net.add_external_output("Y");
+  EXPECT_EQ(FoldConvBatchNorm(net, &ws).op_size(), 3);
+
+  // The output of the SpatialBN is read twice: only the SpatialBN is folded.
+  net.mutable_external_output()->RemoveLast();
+  AddOp(&net, "Relu", {"Z"}, "out2", "");
+  const NetDef folded = FoldConvBatchNorm(net, &ws);
+  ASSERT_EQ(folded.op_size(), 3);
+  EXPECT_EQ(folded.op(0).type(), "Conv");
+  EXPECT_EQ(folded.op(0).output(0), "Z");
+  ExpectSameOutput(net, folded, &ws);
+
+  // A SpatialBN in training mode is not folded.
+  net = ConvBNNet("NCHW", true, false, false, &ws);
+  for (auto& arg : *net.mutable_op(1)->mutable_arg()) {
+    if (arg.name() == "is_test") {
+      arg.set_i(0);
+    }
+  }
+  EXPECT_EQ(FoldConvBatchNorm(net, &ws).op_size(), 2);
+}
+
+TEST(ConvBNFoldingTest, ConvBiasRelu) {
+  std::mt19937 gen(0);
+  Workspace ws;
+  AddRandomTensor(&ws, "X", {2, 3, 6, 7}, -1, 1, &gen);
+  AddRandomTensor(&ws, "W", {4, 3, 3, 3}, -1, 1, &gen);
+  AddRandomTensor(&ws, "b", {4}, -1, 1, &gen);
+  NetDef net;
+  auto* conv = AddOp(&net, "Conv", {"X", "W", "b"}, "Y", "NCHW");
+  AddArgument<int>("kernel", 3, conv);
+  AddOp(&net, "Relu", {"Y"}, "out", "");
+  net.add_external_output("out");
+  NetDef fused;
+  fused.add_op()->CopyFrom(*conv);
+  fused.mutable_op(0)->set_type("ConvBiasRelu");
+  fused.mutable_op(0)->set_output(0, "out");
+  fused.add_external_output("out");
+  ExpectSameOutput(net, fused, &ws);
+}
+
+} // namespace caffe2
@@ -14,6 +14,34 @@ namespace db {
 
 CAFFE_DEFINE_REGISTRY(Caffe2DBRegistry, DB, const string&, Mode);
 
+void CursorBatchBuffer::GetViews(
+    vector<StringView>* keys,
+    vector<StringView>* values) const {
+  keys->resize(records_.size());
+  values->resize(records_.size());
+  for (size_t i = 0; i < records_.size(); ++i) {
+    const Record& record = records_[i];
+    const char* key = data_.data() + record.offset;
+    (*keys)[i] = StringView(key, record.key_size);
+    (*values)[i] = StringView(key + record.key_size, record.value_size);
+  }
+}
+
+size_t Cursor::NextBatch(
+    size_t max_records,
+    vector<StringView>* keys,
+    vector<StringView>* values) {
+  batch_buffer_.Clear();
+  for (; batch_buffer_.size() < max_records && Valid(); Next()) {
+    const string key_str = key();
+    const string value_str = value();
+    batch_buffer_.Add(
+        key_str.data(), key_str.size(), value_str.data(), value_str.size());
+  }
+  batch_buffer_.GetViews(keys, values);
+  return batch_buffer_.size();
+}
+
 // Below, we provide a bare minimum database "minidb" as a reference
 // implementation as well as a portable choice to store data.
 // Note that the MiniDB classes are not exposed via a header file - they should
@@ -79,6 +107,18 @@ class MiniDBCursor : public Cursor {
 
   bool Valid() override { return valid_; }
 
+  size_t NextBatch(
+      size_t max_records,
+      vector<StringView>* keys,
+      vector<StringView>* values) override {
+    batch_buffer_.Clear();
+    for (; batch_buffer_.size() < max_records && valid_; Next()) {
+      batch_buffer_.Add(key_.data(), key_len_, value_.data(), value_len_);
+    }
+    batch_buffer_.GetViews(keys, values);
+    return batch_buffer_.size();
+  }
+
  private:
   FILE* file_;
   std::lock_guard<std::mutex> lock_;
@@ -179,8 +219,16 @@ void DBReaderSerializer::Serialize(
   proto.set_name(name);
   proto.set_source(reader.source_);
   proto.set_db_type(reader.db_type_);
-  if (reader.cursor() && reader.cursor()->SupportsSeek()) {
-    proto.set_key(reader.cursor()->key());
+  if (!reader.cursors_.empty()) {
+    // The cursor of the next read is at the first record not read yet.
+    auto& cursor = reader.cursors_[reader.next_cursor_ % reader.num_cursors()];
+    std::unique_lock<std::mutex> mutex_lock(cursor->mutex);
+    if (cursor->cursor->SupportsSeek() && cursor->cursor->Valid()) {
+      proto.set_key(cursor->cursor->key());
+    }
+  }
+  if (reader.num_cursors() > 1) {
+    proto.set_num_cursors(reader.num_cursors());
   }
   BlobProto blob_proto;
   blob_proto.set_name(name);
@@ -1,6 +1,7 @@
 #ifndef CAFFE2_CORE_DB_H_
 #define CAFFE2_CORE_DB_H_
 
+#include <atomic>
 #include <mutex>
 
 #include "caffe2/core/blob_serialization.h"
@@ -16,6 +17,56 @@ namespace db {
  */
 enum Mode { READ, WRITE, NEW };
 
+/**
+ * A view of bytes that someone else owns, such as the records that a cursor
+ * reads with NextBatch().
+ */
+struct StringView {
+  StringView() : data(nullptr), size(0) {}
+  StringView(const char* d, size_t s) : data(d), size(s) {}
+  string ToString() const { return string(data, size); }
+
+  const char* data;
+  size_t size;
+};
+
+/**
+ * A buffer that cursors copy the records of a batch into. It keeps its memory
+ * across batches, so that reading a batch does not allocate once the buffer
+ * has grown to the size of the largest batch.
+ */
+class CursorBatchBuffer {
+ public:
+  void Clear() {
+    data_.clear();
+    records_.clear();
+  }
+  void Add(
+      const char* key,
+      size_t key_size,
+      const char* value,
+      size_t value_size) {
+    records_.push_back({data_.size(), key_size, value_size});
+    data_.append(key, key_size);
+    data_.append(value, value_size);
+  }
+  size_t size() const {
+    return records_.size();
+  }
+  // Sets the views of the records added since the last Clear(). They are
+  // only valid until the next Add() or Clear().
+  void GetViews(vector<StringView>* keys, vector<StringView>* values) const;
+
+ private:
+  struct Record {
+    size_t offset;
+    size_t key_size;
+    size_t value_size;
+  };
+  string data_;
+  vector<Record> records_;
+};
+
 /**
  * An abstract class for the cursor of the database while reading.
  */
@@ -51,8 +102,26 @@ class Cursor {
    * reached the end of the database, return false.
    */
   virtual bool Valid() = 0;
+  /**
+   * Reads up to max_records records from the current location, and moves past
+   * them. The keys and values are views of memory owned by the cursor, which
+   * stay valid until the next call to the cursor. Returns the number of
+   * records read, which is less than max_records only at the end of the
+   * database.
+   *
+   * By default, the records are copied from key() and value() into a buffer
+   * of the cursor. Backends override it to copy straight from their own
+   * memory, or to not copy at all (LMDB).
+   */
+  virtual size_t NextBatch(
+      size_t max_records,
+      vector<StringView>* keys,
+      vector<StringView>* values);
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
+
+ protected:
+  CursorBatchBuffer batch_buffer_;
 };
 
 /**
@@ -95,6 +164,11 @@ class DB {
    * ownership of the pointer.
    */
   virtual std::unique_ptr<Transaction> NewTransaction() = 0;
+  /**
+   * Returns whether the db can have several cursors open at the same time,
+   * for DBReader to read from with several cursors.
+   */
+  virtual bool SupportsMultipleCursors() { return false; }
 
  protected:
   Mode mode_;
@@ -123,6 +197,15 @@ inline unique_ptr<DB> CreateDB(
 
 /**
  * A reader wrapper for DB that also allows us to serialize it.
+ *
+ * Several threads can read from the same reader. By default they all share
+ * one cursor, under a lock. A reader can instead open several cursors, for
+ * dbs that support it: the cursor i reads the records i, i + num_cursors,
+ * i + 2 * num_cursors, ... of the shard, and each read goes to the next cursor
+ * in a round robin, so that readers only contend on the cursor that they read
+ * from. Read by a single thread, the records still come in the order of the
+ * db, up to the end of the db: each cursor then goes back to its own first
+ * record.
  */
 class DBReader {
  public:
@@ -134,20 +217,27 @@ class DBReader {
       const string& db_type,
       const string& source,
       const int32_t num_shards = 1,
-      const int32_t shard_id = 0) {
-    Open(db_type, source, num_shards, shard_id);
+      const int32_t shard_id = 0,
+      const int32_t num_cursors = 1) {
+    Open(db_type, source, num_shards, shard_id, num_cursors);
   }
 
   explicit DBReader(const DBReaderProto& proto) {
-    Open(proto.db_type(), proto.source());
+    Open(proto.db_type(), proto.source(), 1, 0, proto.num_cursors());
     if (proto.has_key()) {
-      CAFFE_ENFORCE(cursor_->SupportsSeek(),
+      CAFFE_ENFORCE(cursors_[0]->cursor->SupportsSeek(),
           "Encountering a proto that needs seeking but the db type "
           "does not support it.");
-      cursor_->Seek(proto.key());
+      for (auto& cursor : cursors_) {
+        cursor->cursor->Seek(proto.key());
+        for (int s = 0; s < cursor->offset && cursor->cursor->Valid(); s++) {
+          cursor->cursor->Next();
+        }
+        if (!cursor->cursor->Valid()) {
+          MoveToBeginning(cursor.get());
+        }
+      }
     }
-    num_shards_ = 1;
-    shard_id_ = 0;
   }
 
   explicit DBReader(std::unique_ptr<DB> db)
@@ -155,17 +245,20 @@ class DBReader {
         source_("<memory-source>"),
         db_(std::move(db)) {
     CAFFE_ENFORCE(db_.get(), "Passed null db");
-    cursor_ = db_->NewCursor();
+    num_shards_ = 1;
+    shard_id_ = 0;
+    cursors_.emplace_back(new StridedCursor(db_->NewCursor(), 0));
   }
 
   void Open(
       const string& db_type,
       const string& source,
       const int32_t num_shards = 1,
-      const int32_t shard_id = 0) {
+      const int32_t shard_id = 0,
+      const int32_t num_cursors = 1) {
     // Note(jiayq): resetting is needed when we re-open e.g. leveldb where no
     // concurrent access is allowed.
-    cursor_.reset();
+    cursors_.clear();
     db_.reset();
     db_type_ = db_type;
     source_ = source;
@@ -175,9 +268,18 @@ class DBReader {
     CAFFE_ENFORCE(num_shards >= 1);
     CAFFE_ENFORCE(shard_id >= 0);
     CAFFE_ENFORCE(shard_id < num_shards);
+    CAFFE_ENFORCE(num_cursors >= 1);
+    CAFFE_ENFORCE(
+        num_cursors == 1 || db_->SupportsMultipleCursors(),
+        "The db type ",
+        db_type_,
+        " cannot be read with several cursors at once.");
     num_shards_ = num_shards;
     shard_id_ = shard_id;
-    cursor_ = db_->NewCursor();
+    for (int i = 0; i < num_cursors; ++i) {
+      cursors_.emplace_back(
+          new StridedCursor(db_->NewCursor(), shard_id + i * num_shards));
+    }
     SeekToFirst();
   }
 
@@ -199,17 +301,57 @@ class DBReader {
    * output blob.
    */
   void Read(string* key, string* value) const {
-    CAFFE_ENFORCE(cursor_ != nullptr, "Reader not initialized.");
-    std::unique_lock<std::mutex> mutex_lock(reader_mutex_);
-    *key = cursor_->key();
-    *value = cursor_->value();
-
-    // In sharded mode, each read skips num_shards_ records
-    for (int s = 0; s < num_shards_; s++) {
-      cursor_->Next();
-      if (!cursor_->Valid()) {
-        MoveToBeginning();
-        break;
+    CAFFE_ENFORCE(!cursors_.empty(), "Reader not initialized.");
+    StridedCursor* cursor = NextCursor();
+    std::unique_lock<std::mutex> mutex_lock(cursor->mutex);
+    ReadAndMove(cursor, key, value);
+  }
+
+  /**
+   * Reads num_records keys and values, as that many calls to Read() would,
+   * but under a single lock and with batched reads of the cursor. Thread
+   * safe. With several cursors, the records of a batch all come from the same
+   * cursor.
+   *
+   * The strings are assigned to, so that the memory of the strings of keys
+   * and values is reused across calls. keys can be null if they are not
+   * needed.
+   */
+  void ReadBatch(
+      size_t num_records,
+      vector<string>* keys,
+      vector<string>* values) const {
+    CAFFE_ENFORCE(!cursors_.empty(), "Reader not initialized.");
+    StridedCursor* cursor = NextCursor();
+    std::unique_lock<std::mutex> mutex_lock(cursor->mutex);
+    if (keys) {
+      keys->resize(num_records);
+    }
+    values->resize(num_records);
+    size_t num_read = 0;
+    if (stride() > 1) {
+      // The records of a cursor are not contiguous.
+      string key;
+      for (; num_read < num_records; ++num_read) {
+        ReadAndMove(
+            cursor, keys ? &(*keys)[num_read] : &key, &(*values)[num_read]);
+      }
+      return;
+    }
+    auto& batch_keys = cursor->batch_keys;
+    auto& batch_values = cursor->batch_values;
+    while (num_read < num_records) {
+      const size_t batch_size = cursor->cursor->NextBatch(
+          num_records - num_read, &batch_keys, &batch_values);
+      CAFFE_ENFORCE_GT(batch_size, 0, "Cannot read from an empty db.");
+      for (size_t i = 0; i < batch_size; ++i, ++num_read) {
+        if (keys) {
+          (*keys)[num_read].assign(batch_keys[i].data, batch_keys[i].size);
+        }
+        (*values)[num_read].assign(batch_values[i].data, batch_values[i].size);
+      }
+      if (!cursor->cursor->Valid()) {
+        MoveToBeginning(cursor);
       }
     }
   }
@@ -218,13 +360,50 @@ class DBReader {
    * @brief Seeks to the first key. Thread safe.
    */
   void SeekToFirst() const {
-    CAFFE_ENFORCE(cursor_ != nullptr, "Reader not initialized.");
-    std::unique_lock<std::mutex> mutex_lock(reader_mutex_);
-    MoveToBeginning();
+    CAFFE_ENFORCE(!cursors_.empty(), "Reader not initialized.");
+    for (auto& cursor : cursors_) {
+      std::unique_lock<std::mutex> mutex_lock(cursor->mutex);
+      MoveToBeginning(cursor.get());
+    }
+    next_cursor_ = 0;
   }
 
   /**
-   * Returns the underlying cursor of the db reader.
+   * @brief Seeks to the given key, or to the next one if it is not in the db,
+   * so that the next read returns it. Thread safe. The key is usually one
+   * that the reader returned before, and the db must support seeking.
+   */
+  void Seek(const string& key) const {
+    CAFFE_ENFORCE(SupportsSeek(), "The db type ", db_type_,
+        " does not support seeking.");
+    for (auto& cursor : cursors_) {
+      std::unique_lock<std::mutex> mutex_lock(cursor->mutex);
+      cursor->cursor->Seek(key);
+      // The other cursors read the records that follow, as they do from the
+      // beginning of the db.
+      const int skip = cursor->offset - cursors_[0]->offset;
+      for (int s = 0; s < skip && cursor->cursor->Valid(); s++) {
+        cursor->cursor->Next();
+      }
+      if (!cursor->cursor->Valid()) {
+        MoveToBeginning(cursor.get());
+      }
+    }
+    next_cursor_ = 0;
+  }
+
+  bool SupportsSeek() const {
+    CAFFE_ENFORCE(!cursors_.empty(), "Reader not initialized.");
+    return cursors_[0]->cursor->SupportsSeek();
+  }
+
+  int num_cursors() const {
+    return cursors_.size();
+  }
+
+  /**
+   * Returns the underlying cursor of the db reader, or the first one if it
+   * has several.
    *
    * Note that if you directly use the cursor, the read will not be thread
    * safe, because there is no mechanism to stop multiple threads from
@@ -233,24 +412,66 @@ class DBReader {
   inline Cursor* cursor() const {
     LOG(ERROR) << "Usually for a DBReader you should use Read() to be "
                   "thread safe. Consider refactoring your code.";
-    return cursor_.get();
+    return cursors_.empty() ? nullptr : cursors_[0]->cursor.get();
   }
 
  private:
-  void MoveToBeginning() const {
-    cursor_->SeekToFirst();
-    for (auto s = 0; s < shard_id_; s++) {
-      cursor_->Next();
+  struct StridedCursor {
+    StridedCursor(unique_ptr<Cursor> c, int o)
+        : cursor(std::move(c)), offset(o) {}
+
+    unique_ptr<Cursor> cursor;
+    // The index of the first record of the cursor in the db.
+    const int offset;
+    std::mutex mutex;
+    vector<StringView> batch_keys;
+    vector<StringView> batch_values;
+  };
+
+  int stride() const {
+    return num_shards_ * cursors_.size();
+  }
+
+  StridedCursor* NextCursor() const {
+    if (cursors_.size() == 1) {
+      return cursors_[0].get();
+    }
+    return cursors_[next_cursor_++ % cursors_.size()].get();
+  }
+
+  void ReadAndMove(StridedCursor* cursor, string* key, string* value) const {
+    *key = cursor->cursor->key();
+    *value = cursor->cursor->value();
+
+    // In sharded mode, each read skips num_shards_ records, times the number
+    // of cursors.
+    for (int s = 0; s < stride(); s++) {
+      cursor->cursor->Next();
+      if (!cursor->cursor->Valid()) {
+        MoveToBeginning(cursor);
+        break;
+      }
+    }
+  }
+
+  void MoveToBeginning(StridedCursor* cursor) const {
+    cursor->cursor->SeekToFirst();
+    for (auto s = 0; s < cursor->offset; s++) {
+      cursor->cursor->Next();
       CAFFE_ENFORCE(
-          cursor_->Valid(), "Db has less rows than shard id: ", s, shard_id_);
+          cursor->cursor->Valid(),
+          "Db has less rows than the offset of its cursor: ",
+          s,
+          cursor->offset);
     }
   }
 
   string db_type_;
   string source_;
   unique_ptr<DB> db_;
-  unique_ptr<Cursor> cursor_;
-  mutable std::mutex reader_mutex_;
+  vector<unique_ptr<StridedCursor>> cursors_;
+  // The round robin over the cursors only needs an atomic increment.
+  mutable std::atomic<uint64_t> next_cursor_{0};
   uint32_t num_shards_;
   uint32_t shard_id_;
 
@@ -0,0 +1,49 @@
+#include "caffe2/core/dirty_rows.h"
+
+namespace caffe2 {
+
+DirtyRowTracker* DirtyRowTracker::Get() {
+  // Leaked on purpose, since operators may still mark rows at exit.
+  static DirtyRowTracker* tracker = new DirtyRowTracker();
+  return tracker;
+}
+
+void DirtyRowTracker::Track(const Blob* blob) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (bitmaps_.emplace(blob, vector<uint64_t>()).second) {
+    ++num_tracked_;
+  } else {
+    bitmaps_[blob].clear();
+  }
+}
+
+void DirtyRowTracker::Untrack(const Blob* blob) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (bitmaps_.erase(blob)) {
+    --num_tracked_;
+  }
+}
+
+bool DirtyRowTracker::IsTracked(const Blob* blob) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return bitmaps_.count(blob) > 0;
+}
+
+vector<TIndex> DirtyRowTracker::TakeDirtyRows(const Blob* blob) {
+  vector<uint64_t> bits;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = bitmaps_.find(blob);
+    CAFFE_ENFORCE(it != bitmaps_.end(), "The blob is not tracked.");
+    bits.swap(it->second);
+  }
+  vector<TIndex> rows;
+  for (size_t word = 0; word < bits.size(); ++word) {
+    for (uint64_t w = bits[word]; w; w &= w - 1) {
+      rows.push_back(word * 64 + __builtin_ctzll(w));
+    }
+  }
+  return rows;
+}
+
+}  // namespace caffe2
@@ -0,0 +1,82 @@
+#ifndef CAFFE2_CORE_DIRTY_ROWS_H_
+#define CAFFE2_CORE_DIRTY_ROWS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/tensor.h"
+
+namespace caffe2 {
+
+class Blob;
+
+/**
+ * DirtyRowTracker records which rows (indices into the first dimension) of a
+ * tensor blob were written to, so that checkpoints can write only the rows
+ * that changed since the previous one.
+ *
+ * Only blobs that something asked to track are recorded: the Checkpoint
+ * operator tracks its inputs when it writes delta checkpoints, and the sparse
+ * update operators (SparseAdagrad, SparseAdam, SparseFtrl and ScatterAssign)
+ * mark the rows they update. Writes by any other operator are not seen, so
+ * tracked blobs should only be updated sparsely between two full
+ * checkpoints.
+ *
+ * Blobs are identified by address: a tracked blob should be untracked before
+ * it is destroyed.
+ */
+class DirtyRowTracker {
+ public:
+  static DirtyRowTracker* Get();
+
+  // Starts tracking the blob, with all of its rows clean.
+  void Track(const Blob* blob);
+  void Untrack(const Blob* blob);
+  bool IsTracked(const Blob* blob);
+
+  // Marks the given rows of the blob as dirty, if the blob is tracked.
+  template <typename Index>
+  void MarkRows(const Blob* blob, const Index* rows, size_t num_rows) {
+    if (num_tracked_ == 0) {
+      // The common case, with no delta checkpoints, costs a single load.
+      return;
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = bitmaps_.find(blob);
+    if (it == bitmaps_.end()) {
+      return;
+    }
+    auto& bits = it->second;
+    for (size_t i = 0; i < num_rows; ++i) {
+      if (rows[i] < 0) {
+        continue;
+      }
+      const size_t row = rows[i];
+      if (row / 64 >= bits.size()) {
+        bits.resize(row / 64 + 1, 0);
+      }
+      bits[row / 64] |= uint64_t(1) << (row % 64);
+    }
+  }
+
+  // Returns the sorted rows of the blob that were marked since it started
+  // being tracked or since the last call, and marks all of them clean.
+  vector<TIndex> TakeDirtyRows(const Blob* blob);
+
+ private:
+  DirtyRowTracker() {}
+
+  std::mutex mutex_;
+  std::atomic<int> num_tracked_{0};
+  std::unordered_map<const Blob*, vector<uint64_t>> bitmaps_;
+
+  DISABLE_COPY_AND_ASSIGN(DirtyRowTracker);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_DIRTY_ROWS_H_
@@ -0,0 +1,149 @@
+#include <cstdio>
+
+#include "caffe2/core/db.h"
+#include "caffe2/core/dirty_rows.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/workspace.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+// The name of the checkpoint db of the given iteration.
+string DBName(const string& prefix, int iter) {
+  return prefix + "_" + caffe2::to_string(iter);
+}
+
+void SetIter(Workspace* ws, int64_t iter) {
+  auto* tensor = ws->CreateBlob("iter")->GetMutable<TensorCPU>();
+  tensor->Resize(1);
+  tensor->mutable_data<int64_t>()[0] = iter;
+}
+
+void ScatterRows(Workspace* ws, const vector<int>& rows, float value) {
+  auto* indices = ws->CreateBlob("indices")->GetMutable<TensorCPU>();
+  indices->Resize(rows.size());
+  auto* slices = ws->CreateBlob("slices")->GetMutable<TensorCPU>();
+  slices->Resize(rows.size(), 2);
+  for (int i = 0; i < rows.size(); ++i) {
+    indices->mutable_data<int>()[i] = rows[i];
+    slices->mutable_data<float>()[2 * i] = value;
+    slices->mutable_data<float>()[2 * i + 1] = value;
+  }
+  OperatorDef def;
+  def.set_type("ScatterAssign");
+  def.add_input("weights");
+  def.add_input("indices");
+  def.add_input("slices");
+  def.add_output("weights");
+  ASSERT_TRUE(ws->RunOperatorOnce(def));
+}
+
+} // namespace
+
+TEST(DirtyRowTrackerTest, MarksTrackedBlobsOnly) {
+  auto* tracker = DirtyRowTracker::Get();
+  Blob tracked, untracked;
+  const int64_t rows[] = {130, 3, -1, 3, 64};
+  tracker->MarkRows(&tracked, rows, 5);
+  tracker->Track(&tracked);
+  EXPECT_TRUE(tracker->IsTracked(&tracked));
+  EXPECT_FALSE(tracker->IsTracked(&untracked));
+  tracker->MarkRows(&tracked, rows, 5);
+  tracker->MarkRows(&untracked, rows, 5);
+  EXPECT_EQ(tracker->TakeDirtyRows(&tracked), (vector<TIndex>{3, 64, 130}));
+  EXPECT_TRUE(tracker->TakeDirtyRows(&tracked).empty());
+  EXPECT_THROW(tracker->TakeDirtyRows(&untracked), EnforceNotMet);
+  tracker->Untrack(&tracked);
+  EXPECT_FALSE(tracker->IsTracked(&tracked));
+}
+
+TEST(DirtyRowTrackerTest, DeltaCheckpoints) {
+  const string prefix = std::tmpnam(nullptr);
+  const string pattern = prefix + "_%d";
+  Workspace ws;
+  auto* weights = ws.CreateBlob("weights")->GetMutable<TensorCPU>();
+  weights->Resize(10, 2);
+  for (int i = 0; i < weights->size(); ++i) {
+    weights->mutable_data<float>()[i] = 0;
+  }
+  auto* bias = ws.CreateBlob("bias")->GetMutable<TensorCPU>();
+  bias->Resize(1);
+  bias->mutable_data<float>()[0] = 0;
+
+  OperatorDef checkpoint_def;
+  checkpoint_def.set_type("Checkpoint");
+  checkpoint_def.add_input("iter");
+  checkpoint_def.add_input("weights");
+  checkpoint_def.add_input("bias");
+  AddArgument<string>("db", pattern, &checkpoint_def);
+  AddArgument<string>("db_type", "minidb", &checkpoint_def);
+  AddArgument<int>("absolute_path", 1, &checkpoint_def);
+  AddArgument<int>("full_every", 3, &checkpoint_def);
+  AddArgument<vector<string>>("delta_blobs", {"weights"}, &checkpoint_def);
+  SetIter(&ws, 0);
+  NetDef net_def;
+  net_def.set_name("checkpoint");
+  *net_def.add_op() = checkpoint_def;
+  ASSERT_TRUE(ws.CreateNet(net_def));
+
+  // A full checkpoint, then two deltas.
+  ASSERT_TRUE(ws.RunNet("checkpoint"));
+  ScatterRows(&ws, {1, 7}, 1);
+  SetIter(&ws, 1);
+  ASSERT_TRUE(ws.RunNet("checkpoint"));
+  ScatterRows(&ws, {7, 8}, 2);
+  bias->mutable_data<float>()[0] = 3;
+  SetIter(&ws, 2);
+  ASSERT_TRUE(ws.RunNet("checkpoint"));
+  // Deltas only hold the changed rows.
+  {
+    std::unique_ptr<db::DB> delta(
+        db::CreateDB("minidb", DBName(prefix, 2), db::READ));
+    std::unique_ptr<db::Cursor> cursor(delta->NewCursor());
+    for (; cursor->Valid(); cursor->Next()) {
+      if (cursor->key() == "weights") {
+        BlobProto proto;
+        ASSERT_TRUE(proto.ParseFromString(cursor->value()));
+        EXPECT_EQ(proto.tensor().dims(0), 2);
+      }
+    }
+  }
+
+  OperatorDef load_def;
+  load_def.set_type("Load");
+  load_def.add_output("weights");
+  load_def.add_output("bias");
+  AddArgument<string>("db", DBName(prefix, 0), &load_def);
+  AddArgument<string>("db_type", "minidb", &load_def);
+  AddArgument<int>("absolute_path", 1, &load_def);
+  AddArgument<vector<string>>(
+      "delta_dbs",
+      {DBName(prefix, 1), DBName(prefix, 2)}, &load_def);
+  Workspace load_ws;
+  ASSERT_TRUE(load_ws.RunOperatorOnce(load_def));
+  const auto& loaded = load_ws.GetBlob("weights")->Get<TensorCPU>();
+  ASSERT_EQ(loaded.dims(), weights->dims());
+  for (int i = 0; i < weights->size(); ++i) {
+    EXPECT_EQ(loaded.data<float>()[i], weights->data<float>()[i]);
+  }
+  EXPECT_EQ(load_ws.GetBlob("bias")->Get<TensorCPU>().data<float>()[0], 3);
+
+  // A full checkpoint cannot be applied as a delta.
+  OperatorDef bad_load_def = load_def;
+  bad_load_def.clear_arg();
+  AddArgument<string>("db", DBName(prefix, 0), &bad_load_def);
+  AddArgument<string>("db_type", "minidb", &bad_load_def);
+  AddArgument<int>("absolute_path", 1, &bad_load_def);
+  AddArgument<vector<string>>("delta_dbs", {DBName(prefix, 0)}, &bad_load_def);
+  EXPECT_THROW(load_ws.RunOperatorOnce(bad_load_def), EnforceNotMet);
+
+  ws.DeleteNet("checkpoint");
+  EXPECT_FALSE(DirtyRowTracker::Get()->IsTracked(ws.GetBlob("weights")));
+  for (int i = 0; i < 3; ++i) {
+    std::remove(DBName(prefix, i).c_str());
+  }
+}
+
+} // namespace caffe2
@@ -0,0 +1,184 @@
+#include "caffe2/core/elementwise_fusion.h"
+
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+
+namespace caffe2 {
+
+namespace {
+
+bool IsUnary(const OperatorDef& op_def) {
+  static const std::set<string> types{
+      "Relu", "Sigmoid", "Tanh", "Scale", "Clip"};
+  return types.count(op_def.type()) && op_def.input_size() == 1 &&
+      op_def.output_size() == 1 &&
+      !ArgumentHelper(op_def).HasArgument(kRunIfArgument);
+}
+
+bool IsBinary(const OperatorDef& op_def) {
+  static const std::set<string> types{"Add", "Sub", "Mul", "Div"};
+  return types.count(op_def.type()) && op_def.input_size() == 2 &&
+      op_def.output_size() == 1 &&
+      !ArgumentHelper(op_def).GetSingleArgument<int>("broadcast", 0) &&
+      !ArgumentHelper(op_def).HasArgument(kRunIfArgument);
+}
+
+const DeviceOption& GetDeviceOption(
+    const OperatorDef& op_def,
+    const NetDef& net_def) {
+  return op_def.has_device_option() ? op_def.device_option()
+                                    : net_def.device_option();
+}
+
+bool SameDevice(const DeviceOption& a, const DeviceOption& b) {
+  return a.device_type() == b.device_type() &&
+      a.cuda_gpu_id() == b.cuda_gpu_id();
+}
+
+// One step of a fused chain: the operator, the input of the fused operator
+// that is its other operand (-1 for unary operators), and whether the chain
+// value is the second operand.
+struct Step {
+  const OperatorDef* op_def;
+  int operand;
+  bool swapped;
+};
+
+} // namespace
+
+NetDef FuseElementwiseOps(const NetDef& net_def) {
+  const bool has_cuda = CUDAOperatorRegistry()->Has("FusedElementwise");
+  std::map<string, int> num_reads;
+  for (const auto& op_def : net_def.op()) {
+    for (const string& input : op_def.input()) {
+      ++num_reads[input];
+    }
+  }
+  std::set<string> external_outputs(
+      net_def.external_output().begin(), net_def.external_output().end());
+  // Returns the position of the input through which op consumes the output of
+  // prev, if that output is consumed by op only.
+  auto chain_position = [&](const OperatorDef& prev, const OperatorDef& op) {
+    const string& blob = prev.output(0);
+    if (num_reads[blob] != 1 || external_outputs.count(blob)) {
+      return -1;
+    }
+    for (int i = 0; i < op.input_size(); ++i) {
+      if (op.input(i) == blob) {
+        return i;
+      }
+    }
+    return -1;
+  };
+
+  NetDef fused(net_def);
+  fused.clear_op();
+  int num_fused = 0;
+  int idx = 0;
+  while (idx < net_def.op_size()) {
+    const OperatorDef& first = net_def.op(idx);
+    const DeviceOption& device = GetDeviceOption(first, net_def);
+    if (!IsUnary(first) && !IsBinary(first)) {
+      fused.add_op()->CopyFrom(first);
+      ++idx;
+      continue;
+    }
+    OperatorDef op_def;
+    op_def.set_type("FusedElementwise");
+    op_def.add_input(first.input(0));
+    vector<Step> steps;
+    auto add_step = [&](const OperatorDef& step_def, int position) {
+      Step step{&step_def, -1, position == 1};
+      if (IsBinary(step_def)) {
+        const string& operand = step_def.input(1 - position);
+        for (step.operand = 0; step.operand < op_def.input_size();
+             ++step.operand) {
+          if (op_def.input(step.operand) == operand) {
+            break;
+          }
+        }
+        if (step.operand == op_def.input_size()) {
+          op_def.add_input(operand);
+        }
+      }
+      steps.push_back(step);
+    };
+    add_step(first, 0);
+    bool has_unary = IsUnary(first);
+    int end = idx + 1;
+    for (; end < net_def.op_size(); ++end) {
+      const OperatorDef& op = net_def.op(end);
+      if (!(IsUnary(op) || IsBinary(op)) ||
+          !SameDevice(GetDeviceOption(op, net_def), device)) {
+        break;
+      }
+      const int position = chain_position(net_def.op(end - 1), op);
+      if (position < 0) {
+        break;
+      }
+      add_step(op, position);
+      has_unary |= IsUnary(op);
+    }
+    const bool supported = device.device_type() == CPU ||
+        (device.device_type() == CUDA && has_cuda);
+    if (steps.size() < 2 || !has_unary || !supported) {
+      fused.add_op()->CopyFrom(first);
+      ++idx;
+      continue;
+    }
+
+    op_def.add_output(net_def.op(end - 1).output(0));
+    if (first.has_device_option()) {
+      op_def.mutable_device_option()->CopyFrom(first.device_option());
+    }
+    std::stringstream name;
+    for (const auto& step : steps) {
+      name << (name.tellp() ? "_" : "fused_") << step.op_def->type();
+    }
+    op_def.set_name(name.str());
+    vector<string> types;
+    vector<float> step_args;
+    vector<float> step_args_max;
+    vector<int> operands;
+    vector<int> swapped;
+    for (const auto& step : steps) {
+      const string& type = step.op_def->type();
+      ArgumentHelper helper(*step.op_def);
+      types.push_back(type);
+      float arg = 0;
+      float arg_max = 0;
+      if (type == "Scale") {
+        arg = helper.GetSingleArgument<float>("scale", 1.0);
+      } else if (type == "Clip") {
+        // The same defaults as ClipOp.
+        arg = helper.GetSingleArgument<float>(
+            "min", std::numeric_limits<float>::min());
+        arg_max = helper.GetSingleArgument<float>(
+            "max", std::numeric_limits<float>::max());
+      }
+      step_args.push_back(arg);
+      step_args_max.push_back(arg_max);
+      operands.push_back(step.operand);
+      swapped.push_back(step.swapped);
+    }
+    AddArgument("steps", types, &op_def);
+    AddArgument("step_args", step_args, &op_def);
+    AddArgument("step_args_max", step_args_max, &op_def);
+    AddArgument("step_operands", operands, &op_def);
+    AddArgument("step_swapped", swapped, &op_def);
+    fused.add_op()->CopyFrom(op_def);
+    num_fused += steps.size();
+    idx = end;
+  }
+  VLOG(1) << "Fused " << num_fused << " element-wise operators of net "
+          << net_def.name() << " into " << fused.op_size() << " operators.";
+  return fused;
+}
+
+}  // namespace caffe2
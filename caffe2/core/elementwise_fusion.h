@@ -0,0 +1,26 @@
+#ifndef CAFFE2_CORE_ELEMENTWISE_FUSION_H_
+#define CAFFE2_CORE_ELEMENTWISE_FUSION_H_
+
+#include "caffe2/core/common.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+
+// Replaces chains of element-wise operators by single fused operators, so that
+// the chain does one pass over memory instead of one pass per operator.
+//
+// A chain is a run of consecutive operators among Relu, Sigmoid, Tanh, Scale,
+// Clip and the non-broadcasting Add, Sub, Mul and Div, where every operator
+// reads the output of the previous one, and that output is not read anywhere
+// else nor listed as an external output of the net. Since the intermediate
+// blobs disappear, they must not be consumed by anything outside of the net. A
+// chain has to contain at least one of the unary operators, which only exist
+// for float, so that the fused operator can assume float tensors.
+//
+// A chain becomes a FusedElementwise operator, on CUDA too if the NVRTC based
+// implementation is compiled in.
+NetDef FuseElementwiseOps(const NetDef& net_def);
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_ELEMENTWISE_FUSION_H_
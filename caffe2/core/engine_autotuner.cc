@@ -0,0 +1,257 @@
+#include "caffe2/core/engine_autotuner.h"
+
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/tensor.h"
+#include "caffe2/core/timer.h"
+
+CAFFE2_DEFINE_bool(
+    caffe2_autotune_engines,
+    false,
+    "If set, the operators without an engine run the fastest of the engines "
+    "registered for them, per shape of their inputs, as with engine AUTO.");
+CAFFE2_DEFINE_string(
+    caffe2_engine_autotune_file,
+    "",
+    "If set, the engines picked by autotuning are loaded from and appended to "
+    "this file, so that later runs on the same kind of machine skip the "
+    "tuning.");
+
+namespace caffe2 {
+
+namespace {
+
+// The number of timed runs of every engine, after an untimed one that
+// allocates the outputs and whatever else the engine caches.
+constexpr int kTimedRuns = 3;
+
+// FNV-1a, which unlike std::hash is the same in every build.
+uint64_t Fingerprint(const string& bytes) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const unsigned char c : bytes) {
+    hash = (hash ^ c) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+} // namespace
+
+EngineChoiceStore::EngineChoiceStore()
+    : file_(FLAGS_caffe2_engine_autotune_file) {
+  if (!file_.empty()) {
+    const int count = Load(file_);
+    VLOG(1) << "Loaded " << count << " engine choices from " << file_;
+  }
+}
+
+EngineChoiceStore& EngineChoiceStore::Instance() {
+  static EngineChoiceStore store;
+  return store;
+}
+
+bool EngineChoiceStore::Find(const string& key, string* engine) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = engines_.find(key);
+  if (it == engines_.end()) {
+    return false;
+  }
+  *engine = it->second;
+  return true;
+}
+
+void EngineChoiceStore::Insert(const string& key, const string& engine) {
+  CAFFE_ENFORCE(
+      key.find_first_of("\t\n") == string::npos,
+      "Invalid engine choice key: ",
+      key);
+  std::lock_guard<std::mutex> lock(mutex_);
+  engines_[key] = engine;
+  if (!file_.empty()) {
+    std::ofstream out(file_, std::ios::app);
+    out << key << '\t' << engine << '\n';
+    if (!out) {
+      LOG(WARNING) << "Could not append to the engine choices " << file_;
+    }
+  }
+}
+
+int EngineChoiceStore::Load(const string& path) {
+  std::ifstream in(path);
+  if (!in) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  int count = 0;
+  string line;
+  while (std::getline(in, line)) {
+    const auto tab = line.rfind('\t');
+    if (tab == string::npos || tab + 1 == line.size()) {
+      LOG(WARNING) << "Skipping malformed line in " << path << ": " << line;
+      continue;
+    }
+    // Later lines win, as they were appended by later tuning.
+    engines_[line.substr(0, tab)] = line.substr(tab + 1);
+    ++count;
+  }
+  return count;
+}
+
+void EngineChoiceStore::Save(const string& path) const {
+  std::ofstream out(path, std::ios::trunc);
+  CAFFE_ENFORCE(out, "Cannot open ", path, " for writing.");
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& it : engines_) {
+    out << it.first << '\t' << it.second << '\n';
+  }
+  CAFFE_ENFORCE(out, "Failed to write ", path);
+}
+
+size_t EngineChoiceStore::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return engines_.size();
+}
+
+void EngineChoiceStore::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  engines_.clear();
+}
+
+EngineAutotuner::EngineAutotuner(
+    const OperatorDef& operator_def,
+    Workspace* ws,
+    Candidates candidates)
+    : OperatorBase(operator_def, ws), candidates_(std::move(candidates)) {
+  CAFFE_ENFORCE(!candidates_.empty());
+  std::ostringstream prefix;
+  prefix << operator_def.type() << '|'
+         << operator_def.device_option().device_type() << '|';
+  for (size_t i = 0; i < candidates_.size(); ++i) {
+    prefix << (i ? "," : "") << candidates_[i].first;
+  }
+  // The arguments, e.g. kernel sizes and strides, matter as much as the
+  // shapes.
+  string args;
+  for (const auto& arg : operator_def.arg()) {
+    args += arg.SerializeAsString();
+  }
+  prefix << '|' << std::hex << Fingerprint(args);
+  key_prefix_ = prefix.str();
+}
+
+bool EngineAutotuner::Run() {
+  return Choose()->Run();
+}
+
+bool EngineAutotuner::RunAsync() {
+  return Choose()->RunAsync();
+}
+
+bool EngineAutotuner::RunInBatch(bool switch_to_device, bool finish) {
+  return Choose()->RunInBatch(switch_to_device, finish);
+}
+
+void EngineAutotuner::SetStreamId(int stream_id) {
+  for (auto& candidate : candidates_) {
+    candidate.second->SetStreamId(stream_id);
+  }
+}
+
+const string& EngineAutotuner::engine() const {
+  static const string kNone;
+  return last_ < 0 ? kNone : candidates_[last_].first;
+}
+
+OperatorBase* EngineAutotuner::Choose() {
+  std::ostringstream shapes;
+  for (const Blob* blob : Inputs()) {
+    const CaffeTypeId id = blob->meta().id();
+    void* raw = const_cast<Blob*>(blob)->GetRaw();
+    ItemTypeCall item_type_fun = GetItemTypeCallFunction(id);
+    shapes << '|'
+           << (item_type_fun ? item_type_fun(raw) : blob->meta()).name();
+    ShapeCall shape_fun = GetShapeCallFunction(id);
+    if (shape_fun) {
+      for (const TIndex dim : shape_fun(raw)) {
+        shapes << ',' << dim;
+      }
+    }
+  }
+  const string key = shapes.str();
+  auto it = choices_.find(key);
+  if (it != choices_.end()) {
+    last_ = it->second;
+    return candidates_[last_].second.get();
+  }
+
+  const string store_key = key_prefix_ + key;
+  auto& store = EngineChoiceStore::Instance();
+  string engine;
+  int choice = -1;
+  if (store.Find(store_key, &engine)) {
+    for (size_t i = 0; i < candidates_.size(); ++i) {
+      if (candidates_[i].first == engine) {
+        choice = i;
+      }
+    }
+  }
+  if (choice < 0) {
+    choice = Tune();
+    store.Insert(store_key, candidates_[choice].first);
+  }
+  choices_[key] = choice;
+  last_ = choice;
+  return candidates_[last_].second.get();
+}
+
+int EngineAutotuner::Tune() {
+  int best = -1;
+  float best_ms = std::numeric_limits<float>::max();
+  for (size_t i = 0; i < candidates_.size(); ++i) {
+    OperatorBase* op = candidates_[i].second.get();
+    float ms = std::numeric_limits<float>::max();
+    try {
+      bool success = op->Run();
+      for (int run = 0; success && run < kTimedRuns; ++run) {
+        Timer timer;
+        success = op->Run();
+        ms = std::min(ms, timer.MilliSeconds());
+      }
+      if (!success) {
+        continue;
+      }
+    } catch (const std::exception& e) {
+      VLOG(1) << "Engine " << candidates_[i].first << " of " << def().type()
+              << " failed: " << e.what();
+      continue;
+    }
+    VLOG(1) << "Engine " << candidates_[i].first << " of " << def().type()
+            << " takes " << ms << " ms";
+    if (ms < best_ms) {
+      best = i;
+      best_ms = ms;
+    }
+  }
+  // If every engine failed, the default one reports the error.
+  return best < 0 ? candidates_.size() - 1 : best;
+}
+
+bool AutotunesEngine(const OperatorDef& operator_def) {
+  if (operator_def.engine() != kAutotuneEngine &&
+      !(FLAGS_caffe2_autotune_engines && operator_def.engine().empty())) {
+    return false;
+  }
+  for (const string& output : operator_def.output()) {
+    for (const string& input : operator_def.input()) {
+      if (output == input) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace caffe2
@@ -0,0 +1,100 @@
+#ifndef CAFFE2_CORE_ENGINE_AUTOTUNER_H_
+#define CAFFE2_CORE_ENGINE_AUTOTUNER_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/flags.h"
+#include "caffe2/core/operator.h"
+
+CAFFE2_DECLARE_bool(caffe2_autotune_engines);
+CAFFE2_DECLARE_string(caffe2_engine_autotune_file);
+
+namespace caffe2 {
+
+// The engine that asks CreateOperator to pick the fastest of the engines
+// registered for an operator, per shape of its inputs. With
+// --caffe2_autotune_engines, the operators without an engine do as well.
+constexpr char kAutotuneEngine[] = "AUTO";
+// How EngineAutotuner names the implementation registered without an engine.
+constexpr char kDefaultEngine[] = "DEFAULT";
+
+/**
+ * Process-wide table of the engines picked by EngineAutotuner. Keys are
+ * strings that spell out the operator, its arguments, the candidate engines
+ * and the types and shapes of its inputs, so that a table written by one run
+ * can be read back by another on the same kind of machine. If
+ * --caffe2_engine_autotune_file is set, the table is loaded from that file on
+ * first use and every new entry is appended to it, like the cuDNN algorithm
+ * cache.
+ */
+class EngineChoiceStore {
+ public:
+  static EngineChoiceStore& Instance();
+
+  bool Find(const string& key, string* engine) const;
+  void Insert(const string& key, const string& engine);
+  // Merges the entries of a file written by Save or by a previous run into
+  // the table and returns the number of entries read. A missing file is not
+  // an error.
+  int Load(const string& path);
+  void Save(const string& path) const;
+  size_t size() const;
+  void Clear();
+
+ private:
+  EngineChoiceStore();
+
+  mutable std::mutex mutex_;
+  std::unordered_map<string, string> engines_;
+  string file_;
+};
+
+/**
+ * Runs one of several implementations of an operator, one per engine, that
+ * all read and write the same blobs. The first time the inputs have a new
+ * shape, the choice is looked up in EngineChoiceStore, or else every
+ * implementation runs a few times and the fastest one is remembered; the
+ * ones that fail are left out. Later runs with the same shapes cost a hash
+ * of the shapes. As tuning runs the operator several times on the same
+ * inputs, operators that write one of their inputs are not autotuned.
+ */
+class EngineAutotuner final : public OperatorBase {
+ public:
+  using Candidates = vector<std::pair<string, unique_ptr<OperatorBase>>>;
+
+  EngineAutotuner(
+      const OperatorDef& operator_def,
+      Workspace* ws,
+      Candidates candidates);
+
+  bool Run() override;
+  bool RunAsync() override;
+  bool RunInBatch(bool switch_to_device, bool finish) override;
+  void SetStreamId(int stream_id) override;
+
+  // The engine that ran last, or the empty string before the first run.
+  const string& engine() const;
+
+ private:
+  OperatorBase* Choose();
+  int Tune();
+
+  Candidates candidates_;
+  // The part of the store keys that does not depend on the inputs.
+  string key_prefix_;
+  std::unordered_map<string, int> choices_;
+  int last_ = -1;
+};
+
+// Whether CreateOperator autotunes the engine of the operator.
+bool AutotunesEngine(const OperatorDef& operator_def);
+
+} // namespace caffe2
+
+#endif // CAFFE2_CORE_ENGINE_AUTOTUNER_H_
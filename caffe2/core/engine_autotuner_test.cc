@@ -0,0 +1,150 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "caffe2/core/engine_autotuner.h"
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+int gSlowRuns = 0;
+int gFastRuns = 0;
+
+class AutotuneTestSlowOp final : public Operator<CPUContext> {
+ public:
+  using Operator<CPUContext>::Operator;
+  bool RunOnDevice() override {
+    ++gSlowRuns;
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    Output(0)->ResizeLike(Input(0));
+    return true;
+  }
+};
+
+class AutotuneTestFastOp final : public Operator<CPUContext> {
+ public:
+  using Operator<CPUContext>::Operator;
+  bool RunOnDevice() override {
+    ++gFastRuns;
+    Output(0)->ResizeLike(Input(0));
+    return true;
+  }
+};
+
+class AutotuneTestBrokenOp final : public Operator<CPUContext> {
+ public:
+  using Operator<CPUContext>::Operator;
+  bool RunOnDevice() override {
+    CAFFE_THROW("Broken engine.");
+  }
+};
+
+OPERATOR_SCHEMA(AutotuneTest)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .AllowInplace({{0, 0}});
+REGISTER_CPU_OPERATOR(AutotuneTest, AutotuneTestSlowOp);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(AutotuneTest, FAST, AutotuneTestFastOp);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(AutotuneTest, BROKEN, AutotuneTestBrokenOp);
+
+OperatorDef AutotuneTestDef(const string& input, const string& output) {
+  OperatorDef def;
+  def.set_type("AutotuneTest");
+  def.set_engine(kAutotuneEngine);
+  def.add_input(input);
+  def.add_output(output);
+  return def;
+}
+
+void ResizeInput(Workspace* ws, const vector<TIndex>& dims) {
+  auto* tensor = ws->CreateBlob("X")->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  tensor->mutable_data<float>();
+}
+
+} // namespace
+
+TEST(EngineAutotunerTest, PicksTheFastestEnginePerShape) {
+  EngineChoiceStore::Instance().Clear();
+  Workspace ws;
+  ResizeInput(&ws, {4, 8});
+  auto op = CreateOperator(AutotuneTestDef("X", "Y"), &ws);
+  auto* tuner = dynamic_cast<EngineAutotuner*>(op.get());
+  ASSERT_NE(tuner, nullptr);
+  EXPECT_EQ(tuner->engine(), "");
+
+  gSlowRuns = gFastRuns = 0;
+  EXPECT_TRUE(op->Run());
+  EXPECT_EQ(tuner->engine(), "FAST");
+  EXPECT_GT(gSlowRuns, 0);
+  EXPECT_EQ(EngineChoiceStore::Instance().size(), 1);
+
+  // The same shape runs only the chosen engine.
+  gSlowRuns = gFastRuns = 0;
+  EXPECT_TRUE(op->Run());
+  EXPECT_EQ(gSlowRuns, 0);
+  EXPECT_EQ(gFastRuns, 1);
+
+  // A new shape is tuned again.
+  ResizeInput(&ws, {16});
+  gSlowRuns = gFastRuns = 0;
+  EXPECT_TRUE(op->Run());
+  EXPECT_GT(gSlowRuns, 0);
+  EXPECT_EQ(EngineChoiceStore::Instance().size(), 2);
+  EXPECT_EQ(ws.GetBlob("Y")->Get<TensorCPU>().dims(), vector<TIndex>{16});
+}
+
+TEST(EngineAutotunerTest, ReusesTheStoredChoice) {
+  EngineChoiceStore::Instance().Clear();
+  Workspace ws;
+  ResizeInput(&ws, {4, 8});
+  auto first = CreateOperator(AutotuneTestDef("X", "Y"), &ws);
+  EXPECT_TRUE(first->Run());
+
+  auto second = CreateOperator(AutotuneTestDef("X", "Z"), &ws);
+  gSlowRuns = gFastRuns = 0;
+  EXPECT_TRUE(second->Run());
+  EXPECT_EQ(gSlowRuns, 0);
+  EXPECT_EQ(gFastRuns, 1);
+  EXPECT_EQ(dynamic_cast<EngineAutotuner*>(second.get())->engine(), "FAST");
+}
+
+TEST(EngineAutotunerTest, DoesNotTuneInPlaceOperators) {
+  Workspace ws;
+  ResizeInput(&ws, {4, 8});
+  auto op = CreateOperator(AutotuneTestDef("X", "X"), &ws);
+  EXPECT_EQ(dynamic_cast<EngineAutotuner*>(op.get()), nullptr);
+  EXPECT_NE(dynamic_cast<AutotuneTestSlowOp*>(op.get()), nullptr);
+}
+
+TEST(EngineAutotunerTest, DoesNotTuneWithoutTheEngine) {
+  Workspace ws;
+  ResizeInput(&ws, {4, 8});
+  OperatorDef def = AutotuneTestDef("X", "Y");
+  def.clear_engine();
+  auto op = CreateOperator(def, &ws);
+  EXPECT_EQ(dynamic_cast<EngineAutotuner*>(op.get()), nullptr);
+}
+
+TEST(EngineAutotunerTest, StoreRoundTrips) {
+  auto& store = EngineChoiceStore::Instance();
+  store.Clear();
+  store.Insert("A|0|FAST,DEFAULT|0|float,1", "FAST");
+  store.Insert("B|1|X,DEFAULT|0|float,2", "DEFAULT");
+  const string path = testing::TempDir() + "engine_autotuner_test.txt";
+  store.Save(path);
+  store.Clear();
+  EXPECT_EQ(store.Load(path), 2);
+  string engine;
+  EXPECT_TRUE(store.Find("A|0|FAST,DEFAULT|0|float,1", &engine));
+  EXPECT_EQ(engine, "FAST");
+  EXPECT_TRUE(store.Find("B|1|X,DEFAULT|0|float,2", &engine));
+  EXPECT_EQ(engine, "DEFAULT");
+  EXPECT_FALSE(store.Find("C", &engine));
+  std::remove(path.c_str());
+}
+
+} // namespace caffe2
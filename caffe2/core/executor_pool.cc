@@ -0,0 +1,170 @@
+#include "caffe2/core/executor_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/numa.h"
+#include "caffe2/core/thread_budget.h"
+#include "caffe2/utils/work_stealing_queue.h"
+
+CAFFE2_DEFINE_int(
+    caffe2_executor_pool_cpu_threads,
+    0,
+    "Number of workspace executor pool threads serving the CPU. 0 means one "
+    "per hardware thread.");
+CAFFE2_DEFINE_int(
+    caffe2_executor_pool_gpu_threads,
+    4,
+    "Number of workspace executor pool threads serving each GPU.");
+
+namespace caffe2 {
+
+class ExecutorPool::DeviceThreads {
+ public:
+  DeviceThreads(
+      const ExecutorPool* owner,
+      int num_threads,
+      int numa_node_id,
+      std::unique_ptr<ThreadAllotment> allotment)
+      : owner_(owner),
+        numa_node_id_(numa_node_id),
+        allotment_(std::move(allotment)),
+        queue_(num_threads),
+        next_worker_(0) {
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.emplace_back(&DeviceThreads::WorkerFunction, this, i);
+    }
+  }
+
+  ~DeviceThreads() {
+    queue_.NoMoreJobs();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Submit(Task task) {
+    if (current_ == this) {
+      queue_.Push(current_worker_, std::move(task));
+    } else {
+      queue_.Push(next_worker_++ % queue_.num_workers(), std::move(task));
+    }
+  }
+
+  bool TryRunOne() {
+    CAFFE_ENFORCE_EQ(current_, this);
+    Task task;
+    if (!queue_.TryPop(current_worker_, &task)) {
+      return false;
+    }
+    task();
+    return true;
+  }
+
+  int NumThreads() const {
+    return threads_.size();
+  }
+
+  const ExecutorPool* owner() const {
+    return owner_;
+  }
+
+  // The pool and worker id of the calling thread, if it is a pool thread.
+  static thread_local DeviceThreads* current_;
+  static thread_local int current_worker_;
+
+ private:
+  void WorkerFunction(int worker_id) {
+    NUMABind(numa_node_id_);
+    current_ = this;
+    current_worker_ = worker_id;
+    Task task;
+    while (queue_.Pop(worker_id, &task)) {
+      task();
+      // Release whatever the task captured before waiting for the next one.
+      task = nullptr;
+    }
+  }
+
+  const ExecutorPool* owner_;
+  const int numa_node_id_;
+  // The reservation of the threads, for CPU threads.
+  std::unique_ptr<ThreadAllotment> allotment_;
+  WorkStealingQueue<Task> queue_;
+  std::atomic<unsigned int> next_worker_;
+  std::vector<std::thread> threads_;
+};
+
+thread_local ExecutorPool::DeviceThreads* ExecutorPool::DeviceThreads::current_ =
+    nullptr;
+thread_local int ExecutorPool::DeviceThreads::current_worker_ = -1;
+
+ExecutorPool::ExecutorPool() {}
+
+ExecutorPool::~ExecutorPool() {
+  // Joins all the threads; any tasks still queued are run first.
+  devices_.clear();
+}
+
+void ExecutorPool::Submit(const DeviceOption& device_option, Task task) {
+  GetDeviceThreads(device_option)->Submit(std::move(task));
+}
+
+bool ExecutorPool::TryRunOne() {
+  auto* current = DeviceThreads::current_;
+  // Only help out with work from our own pool.
+  if (!current || current->owner() != this) {
+    return false;
+  }
+  return current->TryRunOne();
+}
+
+bool ExecutorPool::InPoolThread() {
+  return DeviceThreads::current_ != nullptr;
+}
+
+int ExecutorPool::NumThreads(const DeviceOption& device_option) {
+  return GetDeviceThreads(device_option)->NumThreads();
+}
+
+ExecutorPool::DeviceThreads* ExecutorPool::GetDeviceThreads(
+    const DeviceOption& device_option) {
+  const bool is_cuda = device_option.device_type() == CUDA;
+  // With NUMA, every CPU node gets threads of its own, bound to the node.
+  const int numa_node_id =
+      !is_cuda && device_option.has_numa_node_id() && IsNUMAEnabled()
+      ? device_option.numa_node_id()
+      : -1;
+  const auto key = std::make_pair(
+      device_option.device_type(),
+      is_cuda ? device_option.cuda_gpu_id() : numa_node_id + 1);
+  std::lock_guard<std::mutex> guard(devices_mutex_);
+  auto& threads = devices_[key];
+  if (!threads) {
+    int num_threads = is_cuda ? FLAGS_caffe2_executor_pool_gpu_threads
+                              : FLAGS_caffe2_executor_pool_cpu_threads;
+    std::unique_ptr<ThreadAllotment> allotment;
+    if (num_threads <= 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+      if (numa_node_id >= 0) {
+        num_threads = std::max(1, num_threads / GetNumNUMANodes());
+      }
+      // The CPU threads run operators, so by default there are only as many
+      // of them as the thread budget has left.
+      allotment.reset(new ThreadAllotment(num_threads));
+      num_threads = allotment->threads();
+    } else if (!is_cuda) {
+      allotment.reset(new ThreadAllotment(num_threads));
+    }
+    VLOG(1) << "Starting " << num_threads << " executor pool threads for "
+            << "device type " << key.first << ", id " << key.second;
+    threads.reset(new DeviceThreads(
+        this, num_threads, numa_node_id, std::move(allotment)));
+  }
+  return threads.get();
+}
+
+}  // namespace caffe2
@@ -0,0 +1,79 @@
+#ifndef CAFFE2_CORE_EXECUTOR_POOL_H_
+#define CAFFE2_CORE_EXECUTOR_POOL_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <utility>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/flags.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+CAFFE2_DECLARE_int(caffe2_executor_pool_cpu_threads);
+CAFFE2_DECLARE_int(caffe2_executor_pool_gpu_threads);
+
+namespace caffe2 {
+
+/**
+ * ExecutorPool is a set of persistent worker threads, owned by a Workspace,
+ * that nets can schedule their work onto instead of each net starting threads
+ * of its own.
+ *
+ * Threads are grouped per device: the CPU has one group, and each CUDA gpu id
+ * has its own group. With NUMA enabled, CPU device options with a
+ * numa_node_id get a group per node, whose threads are bound to the node. A task submitted for a device only ever runs on that
+ * device's threads, so a thread keeps working on the same device. The groups
+ * are created lazily, the first time a task is submitted for the device, with
+ * FLAGS_caffe2_executor_pool_cpu_threads and
+ * FLAGS_caffe2_executor_pool_gpu_threads threads respectively.
+ *
+ * Within a group, tasks submitted from one of the group's own threads go to
+ * that thread's local deque, and idle threads steal from the others (see
+ * WorkStealingQueue).
+ */
+class ExecutorPool {
+ public:
+  using Task = std::function<void()>;
+
+  ExecutorPool();
+  ~ExecutorPool();
+
+  /**
+   * Schedules the task to run on one of the threads of the given device.
+   */
+  void Submit(const DeviceOption& device_option, Task task);
+
+  /**
+   * If the calling thread is an ExecutorPool thread, runs one pending task of
+   * its device group and returns true. Returns false if the calling thread is
+   * not a pool thread or there was nothing to run. Code that has to wait while
+   * running on a pool thread should call this instead of blocking, so that it
+   * does not starve the pool of the threads it is waiting on.
+   */
+  bool TryRunOne();
+
+  /**
+   * Returns whether the calling thread is a thread of any ExecutorPool.
+   */
+  static bool InPoolThread();
+
+  /**
+   * Returns the number of threads serving the given device.
+   */
+  int NumThreads(const DeviceOption& device_option);
+
+ private:
+  class DeviceThreads;
+  DeviceThreads* GetDeviceThreads(const DeviceOption& device_option);
+
+  std::mutex devices_mutex_;
+  std::map<std::pair<int, int>, std::unique_ptr<DeviceThreads>> devices_;
+
+  DISABLE_COPY_AND_ASSIGN(ExecutorPool);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_EXECUTOR_POOL_H_
@@ -9,6 +9,7 @@
 #endif // CAFFE2_USE_MKL
 
 #include "caffe2/core/init.h"
+#include "caffe2/core/thread_budget.h"
 
 CAFFE2_DEFINE_int(
     caffe2_omp_num_threads, 0,
@@ -36,6 +37,11 @@ bool Caffe2SetOpenMPThreads(int*, char***) {
     VLOG(1) << "Setting omp_num_threads to " << FLAGS_caffe2_omp_num_threads;
     omp_set_num_threads(FLAGS_caffe2_omp_num_threads);
   }
+  if (omp_get_max_threads() > ThreadBudget::Get()->total()) {
+    LOG(WARNING) << "Limiting omp_num_threads to the thread budget of "
+                 << ThreadBudget::Get()->total() << " threads";
+    omp_set_num_threads(ThreadBudget::Get()->total());
+  }
   VLOG(1) << "Caffe2 running with " << omp_get_max_threads() << " OMP threads";
   return true;
 }
@@ -0,0 +1,233 @@
+#include "caffe2/core/memonger.h"
+
+#include <map>
+#include <vector>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/operator_schema.h"
+
+namespace caffe2 {
+namespace memonger {
+
+namespace {
+
+string DeviceKey(const OperatorDef& op_def, const NetDef& net_def) {
+  const DeviceOption& option =
+      op_def.has_device_option() ? op_def.device_option()
+                                 : net_def.device_option();
+  return caffe2::to_string(option.device_type()) + ":" +
+      caffe2::to_string(option.cuda_gpu_id());
+}
+
+bool Contains(
+    const ::google::protobuf::RepeatedPtrField<string>& blobs,
+    const string& blob) {
+  for (const string& b : blobs) {
+    if (b == blob) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// ancestors[i][j] is true if operator j always finishes before operator i
+// starts, following the same read/write rules that DAGNetBase uses.
+vector<vector<bool>> ComputeAncestors(const NetDef& net_def) {
+  const int num_ops = net_def.op_size();
+  vector<vector<bool>> ancestors(num_ops, vector<bool>(num_ops, false));
+  std::map<string, int> last_writer;
+  std::map<string, vector<int>> readers;
+  for (int idx = 0; idx < num_ops; ++idx) {
+    const OperatorDef& op_def = net_def.op(idx);
+    std::set<int> parents;
+    for (const string& input : op_def.input()) {
+      if (last_writer.count(input)) {
+        parents.insert(last_writer[input]);
+      }
+    }
+    for (const string& output : op_def.output()) {
+      if (last_writer.count(output)) {
+        parents.insert(last_writer[output]);
+      }
+      for (int reader : readers[output]) {
+        parents.insert(reader);
+      }
+    }
+    parents.erase(idx);
+    for (int parent : parents) {
+      ancestors[idx][parent] = true;
+      for (int j = 0; j < parent; ++j) {
+        if (ancestors[parent][j]) {
+          ancestors[idx][j] = true;
+        }
+      }
+    }
+    for (const string& input : op_def.input()) {
+      readers[input].push_back(idx);
+    }
+    for (const string& output : op_def.output()) {
+      last_writer[output] = idx;
+      readers[output].clear();
+    }
+  }
+  return ancestors;
+}
+
+} // namespace
+
+bool IsAliasingOperator(const OperatorDef& op_def) {
+  static const std::set<string> ops{"Alias",
+                                    "UnsafeCoalesce",
+                                    "RecurrentNetwork",
+                                    "RecurrentNetworkGradient"};
+  if (ops.count(op_def.type())) {
+    return true;
+  }
+  // A zero-copy Split may return views of its input.
+  return (op_def.type() == "Split" || op_def.type() == "DepthSplit") &&
+      ArgumentHelper(op_def).GetSingleArgument<int>("zero_copy", 0);
+}
+
+NetDef OptimizeNet(const NetDef& net_def, const std::set<string>& static_blobs) {
+  const int num_ops = net_def.op_size();
+  std::set<string> fixed(static_blobs);
+  fixed.insert(net_def.external_input().begin(), net_def.external_input().end());
+  fixed.insert(
+      net_def.external_output().begin(), net_def.external_output().end());
+
+  // Collect the users of every blob, and fix the blobs that cannot be renamed.
+  std::map<string, vector<int>> users;
+  std::map<string, string> device;
+  std::set<string> read;
+  for (int idx = 0; idx < num_ops; ++idx) {
+    const OperatorDef& op_def = net_def.op(idx);
+    const bool aliasing = IsAliasingOperator(op_def);
+    // The run_if blob is read by the net rather than as an input.
+    ArgumentHelper helper(op_def);
+    if (helper.HasArgument(kRunIfArgument)) {
+      fixed.insert(helper.GetSingleArgument<string>(kRunIfArgument, ""));
+    }
+    for (const string& input : op_def.input()) {
+      if (!users.count(input) || aliasing) {
+        fixed.insert(input);
+      }
+      read.insert(input);
+      if (users[input].empty() || users[input].back() != idx) {
+        users[input].push_back(idx);
+      }
+    }
+    const string key = DeviceKey(op_def, net_def);
+    for (const string& output : op_def.output()) {
+      if (aliasing || (device.count(output) && device[output] != key)) {
+        fixed.insert(output);
+      }
+      device[output] = key;
+      if (users[output].empty() || users[output].back() != idx) {
+        users[output].push_back(idx);
+      }
+    }
+  }
+
+  // Blobs that are never read by the net are what it produces for others.
+  for (const auto& kv : device) {
+    if (!read.count(kv.first)) {
+      fixed.insert(kv.first);
+    }
+  }
+
+  const auto ancestors = ComputeAncestors(net_def);
+  // Returns whether all the users of a blob, except possibly op idx itself,
+  // are guaranteed to have finished before op idx starts.
+  auto done_before = [&](const string& blob, int idx) {
+    for (int user : users[blob]) {
+      if (user != idx && (user > idx || !ancestors[idx][user])) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  std::map<string, string> mapping;
+  // The blobs that can be recycled, and the blob currently held by each.
+  std::map<string, string> tenant;
+  for (int idx = 0; idx < num_ops; ++idx) {
+    const OperatorDef& op_def = net_def.op(idx);
+    const OpSchema* schema = OpSchemaRegistry::Schema(op_def.type());
+    const string key = DeviceKey(op_def, net_def);
+    std::set<string> taken;
+    for (const string& input : op_def.input()) {
+      if (mapping.count(input)) {
+        taken.insert(mapping[input]);
+      }
+    }
+    for (int out_idx = 0; out_idx < op_def.output_size(); ++out_idx) {
+      const string& output = op_def.output(out_idx);
+      if (fixed.count(output) || mapping.count(output) ||
+          Contains(op_def.input(), output)) {
+        continue;
+      }
+      string target;
+      // Prefer running in place on an input that dies here.
+      for (int in_idx = 0; schema && in_idx < op_def.input_size(); ++in_idx) {
+        const string& input = op_def.input(in_idx);
+        if (!mapping.count(input) || !schema->inplace_allowed(in_idx, out_idx) ||
+            device[input] != key || !done_before(input, idx)) {
+          continue;
+        }
+        int count = 0;
+        for (const string& other : op_def.input()) {
+          count += other == input;
+        }
+        if (count == 1 && tenant[mapping[input]] == input &&
+            !Contains(op_def.output(), mapping[input])) {
+          target = mapping[input];
+          taken.erase(target);
+          break;
+        }
+      }
+      // Otherwise pick up any blob whose content is dead by now.
+      if (target.empty()) {
+        for (const auto& kv : tenant) {
+          if (!taken.count(kv.first) && device[kv.second] == key &&
+              !Contains(op_def.output(), kv.first) &&
+              done_before(kv.second, idx) && users[kv.second].back() < idx) {
+            target = kv.first;
+            break;
+          }
+        }
+      }
+      if (target.empty()) {
+        target = output;
+      }
+      mapping[output] = target;
+      tenant[target] = output;
+      taken.insert(target);
+    }
+  }
+
+  NetDef optimized(net_def);
+  int num_renamed = 0;
+  for (auto& op_def : *optimized.mutable_op()) {
+    for (auto& input : *op_def.mutable_input()) {
+      if (mapping.count(input)) {
+        input = mapping[input];
+      }
+    }
+    for (auto& output : *op_def.mutable_output()) {
+      if (mapping.count(output)) {
+        output = mapping[output];
+      }
+    }
+  }
+  for (const auto& kv : mapping) {
+    num_renamed += kv.first != kv.second;
+  }
+  VLOG(1) << "memonger: " << net_def.name() << " recycled " << num_renamed
+          << " of " << mapping.size() << " blobs into " << tenant.size()
+          << " blobs.";
+  return optimized;
+}
+
+}  // namespace memonger
+}  // namespace caffe2
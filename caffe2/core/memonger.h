@@ -0,0 +1,37 @@
+#ifndef CAFFE2_CORE_MEMONGER_H_
+#define CAFFE2_CORE_MEMONGER_H_
+
+#include <set>
+#include <string>
+
+#include "caffe2/core/common.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+namespace memonger {
+
+// Returns whether the outputs of the given operator may point to the memory
+// of its inputs or of other blobs, in which case the blobs it touches must
+// keep their names and memory.
+bool IsAliasingOperator(const OperatorDef& op_def);
+
+// The C++ counterpart of python/memonger.py: renames the blobs of a net so
+// that activations that are no longer needed are recycled for later outputs.
+//
+// An output first takes the blob of one of its op's inputs if the OpSchema
+// allows that pair to run in place and the input is not used afterwards.
+// Otherwise it takes any blob on the same device whose users have all run
+// before it. "Before" is taken with respect to the dependencies that DAG nets
+// derive from the NetDef, so the rewritten net is also safe to run with the
+// dag net types and does not lose any parallelism.
+//
+// External inputs and outputs, the blobs in static_blobs, blobs that are read
+// before being written or never read at all, and blobs touched by aliasing
+// operators keep their names. All other blobs are assumed to be consumed only
+// by this net.
+NetDef OptimizeNet(const NetDef& net_def, const std::set<string>& static_blobs);
+
+}  // namespace memonger
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_MEMONGER_H_
@@ -0,0 +1,115 @@
+#include "caffe2/core/memonger.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+OPERATOR_SCHEMA(MemongerTestNoInplace).NumInputs(1, INT_MAX).NumOutputs(1);
+
+namespace {
+
+NetDef ChainNet(const string& type, int num_ops) {
+  NetDef net_def;
+  net_def.set_name("chain");
+  string input = "X";
+  for (int i = 0; i < num_ops; ++i) {
+    auto* op = net_def.add_op();
+    op->set_type(type);
+    op->add_input(input);
+    input = i + 1 < num_ops ? string(1, 'A' + i) : "Y";
+    op->add_output(input);
+  }
+  net_def.add_external_input("X");
+  net_def.add_external_output("Y");
+  return net_def;
+}
+
+} // namespace
+
+TEST(MemongerTest, RunsInPlaceWhenAllowed) {
+  NetDef optimized = memonger::OptimizeNet(ChainNet("Relu", 4), {});
+  // X -> A -> B -> C -> Y turns into X -> A -> A -> A -> Y.
+  EXPECT_EQ(optimized.op(0).input(0), "X");
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(optimized.op(i).output(0), "A");
+    EXPECT_EQ(optimized.op(i + 1).input(0), "A");
+  }
+  EXPECT_EQ(optimized.op(3).output(0), "Y");
+}
+
+TEST(MemongerTest, RecyclesDeadBlobs) {
+  NetDef optimized =
+      memonger::OptimizeNet(ChainNet("MemongerTestNoInplace", 5), {});
+  // A and B are both alive while computing B, but A is dead by the time C
+  // is computed, and B by the time D is computed.
+  EXPECT_EQ(optimized.op(0).output(0), "A");
+  EXPECT_EQ(optimized.op(1).output(0), "B");
+  EXPECT_EQ(optimized.op(2).output(0), "A");
+  EXPECT_EQ(optimized.op(3).output(0), "B");
+  EXPECT_EQ(optimized.op(4).input(0), "B");
+  EXPECT_EQ(optimized.op(4).output(0), "Y");
+}
+
+TEST(MemongerTest, KeepsStaticBlobs) {
+  NetDef optimized =
+      memonger::OptimizeNet(ChainNet("MemongerTestNoInplace", 5), {"A"});
+  EXPECT_EQ(optimized.op(0).output(0), "A");
+  EXPECT_EQ(optimized.op(1).output(0), "B");
+  EXPECT_EQ(optimized.op(2).output(0), "C");
+  EXPECT_EQ(optimized.op(3).output(0), "B");
+}
+
+TEST(MemongerTest, DoesNotShareAcrossParallelBranches) {
+  const char* spec = R"DOC(
+      name: "fork"
+      op { input: "X" output: "A" type: "MemongerTestNoInplace" }
+      op { input: "A" output: "B" type: "MemongerTestNoInplace" }
+      op { input: "A" output: "C" type: "MemongerTestNoInplace" }
+      op { input: "B" output: "D" type: "MemongerTestNoInplace" }
+      op { input: "C" output: "E" type: "MemongerTestNoInplace" }
+      op { input: "D" input: "E" output: "F" type: "MemongerTestNoInplace" }
+      op { input: "F" output: "Y" type: "MemongerTestNoInplace" }
+      external_input: "X"
+      external_output: "Y"
+  )DOC";
+  NetDef net_def;
+  CAFFE_ENFORCE(
+      ::google::protobuf::TextFormat::ParseFromString(spec, &net_def));
+  NetDef optimized = memonger::OptimizeNet(net_def, {});
+  // A is read by both branches, so neither branch may overwrite it, and the
+  // two branches may not share with each other.
+  for (int i = 1; i < 5; ++i) {
+    EXPECT_EQ(optimized.op(i).output(0), net_def.op(i).output(0));
+  }
+  // After the branches join, everything but D and E is dead.
+  EXPECT_NE(optimized.op(5).output(0), "F");
+  EXPECT_NE(optimized.op(5).output(0), "D");
+  EXPECT_NE(optimized.op(5).output(0), "E");
+}
+
+TEST(MemongerTest, CreateNetWithMemonger) {
+  Workspace ws;
+  auto* X = ws.CreateBlob("X")->GetMutable<TensorCPU>();
+  X->Resize(2, 3);
+  for (int i = 0; i < X->size(); ++i) {
+    X->mutable_data<float>()[i] = i - 3;
+  }
+  NetDef net_def = ChainNet("Relu", 4);
+  auto* arg = net_def.add_arg();
+  arg->set_name("memonger");
+  arg->set_i(1);
+  auto* net = ws.CreateNet(net_def);
+  ASSERT_TRUE(net != nullptr);
+  ASSERT_TRUE(net->Run());
+  EXPECT_TRUE(ws.HasBlob("A"));
+  EXPECT_FALSE(ws.HasBlob("B"));
+  EXPECT_FALSE(ws.HasBlob("C"));
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  for (int i = 0; i < Y.size(); ++i) {
+    EXPECT_EQ(Y.data<float>()[i], std::max(i - 3, 0));
+  }
+}
+
+} // namespace caffe2
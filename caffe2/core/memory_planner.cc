@@ -0,0 +1,278 @@
+#include "caffe2/core/memory_planner.h"
+
+#include <algorithm>
+#include <set>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/memonger.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/operator_schema.h"
+#include "caffe2/core/types.h"
+
+namespace caffe2 {
+
+namespace {
+
+size_t AlignUp(size_t nbytes) {
+  return (nbytes + gCaffe2Alignment - 1) / gCaffe2Alignment * gCaffe2Alignment;
+}
+
+bool IsCPU(const OperatorDef& op_def, const NetDef& net_def) {
+  if (op_def.has_device_option()) {
+    return op_def.device_option().device_type() == CPU;
+  }
+  return !net_def.has_device_option() ||
+      net_def.device_option().device_type() == CPU;
+}
+
+// Returns the number of bytes needed by a tensor of the given shape, or 0 if
+// the shape or type is unknown or the type needs a constructor.
+size_t TensorBytes(const TensorShape& shape) {
+  if (shape.unknown_shape() || shape.unknown_dims_size() > 0) {
+    return 0;
+  }
+  const TypeMeta& meta = DataTypeToTypeMeta(shape.data_type());
+  if (meta.id() == 0 || meta.ctor() != nullptr) {
+    return 0;
+  }
+  TIndex size = 1;
+  for (auto d : shape.dims()) {
+    if (d < 0) {
+      return 0;
+    }
+    size *= d;
+  }
+  return size * meta.itemsize();
+}
+
+} // namespace
+
+StaticMemoryPlan PlanStaticMemory(const NetDef& net_def, Workspace* ws) {
+  std::set<string> excluded(
+      net_def.external_input().begin(), net_def.external_input().end());
+  excluded.insert(
+      net_def.external_output().begin(), net_def.external_output().end());
+
+  // Infer the shape of every blob and record the lifetime of the blobs that
+  // are written before they are read.
+  CaffeMap<string, TensorShape> shapes;
+  CaffeMap<string, StaticMemoryPlan::Slot> candidates;
+  CaffeMap<string, vector<int>> writers;
+  vector<int> concats;
+  for (int idx = 0; idx < net_def.op_size(); ++idx) {
+    const OperatorDef& op_def = net_def.op(idx);
+    const bool aliasing = memonger::IsAliasingOperator(op_def);
+    if ((op_def.type() == "Concat" || op_def.type() == "DepthConcat") &&
+        IsCPU(op_def, net_def)) {
+      concats.push_back(idx);
+    }
+    // The run_if blob is read by the net rather than as an input.
+    ArgumentHelper helper(op_def);
+    if (helper.HasArgument(kRunIfArgument)) {
+      excluded.insert(helper.GetSingleArgument<string>(kRunIfArgument, ""));
+    }
+    vector<TensorShape> input_shapes;
+    for (const string& input : op_def.input()) {
+      if (!candidates.count(input)) {
+        excluded.insert(input);
+      } else {
+        candidates[input].last_use = idx;
+      }
+      if (aliasing) {
+        excluded.insert(input);
+      }
+      if (!shapes.count(input) && ws->HasBlob(input)) {
+        const Blob* blob = ws->GetBlob(input);
+        if (blob->IsType<TensorCPU>()) {
+          const auto& tensor = blob->Get<TensorCPU>();
+          for (auto d : tensor.dims()) {
+            shapes[input].add_dims(d);
+          }
+          shapes[input].set_data_type(TypeMetaToDataType(tensor.meta()));
+        }
+      }
+      if (shapes.count(input)) {
+        input_shapes.push_back(shapes[input]);
+      }
+    }
+    vector<TensorShape> output_shapes;
+    const OpSchema* schema = OpSchemaRegistry::Schema(op_def.type());
+    if (schema && input_shapes.size() == op_def.input_size()) {
+      try {
+        output_shapes = schema->InferTensor(op_def, input_shapes);
+      } catch (const std::exception& e) {
+        VLOG(1) << "Cannot infer the output shapes of " << op_def.type()
+                << ": " << e.what();
+      }
+    }
+    for (int i = 0; i < op_def.output_size(); ++i) {
+      const string& output = op_def.output(i);
+      writers[output].push_back(idx);
+      shapes.erase(output);
+      size_t nbytes = 0;
+      if (i < output_shapes.size()) {
+        nbytes = TensorBytes(output_shapes[i]);
+        if (!output_shapes[i].unknown_shape()) {
+          shapes[output] = output_shapes[i];
+        }
+      }
+      if (aliasing || !IsCPU(op_def, net_def) || nbytes == 0) {
+        excluded.insert(output);
+      }
+      if (excluded.count(output)) {
+        continue;
+      }
+      auto it = candidates.find(output);
+      if (it == candidates.end()) {
+        StaticMemoryPlan::Slot slot;
+        slot.dims.assign(
+            output_shapes[i].dims().begin(), output_shapes[i].dims().end());
+        slot.data_type = output_shapes[i].data_type();
+        slot.offset = 0;
+        slot.nbytes = nbytes;
+        slot.first_use = idx;
+        slot.last_use = idx;
+        candidates.emplace(output, slot);
+      } else if (
+          it->second.nbytes != nbytes ||
+          it->second.data_type != output_shapes[i].data_type()) {
+        // The blob changes shape or type halfway through the net; it is simpler
+        // to leave it alone.
+        excluded.insert(output);
+      } else {
+        it->second.last_use = idx;
+      }
+    }
+  }
+
+  auto planned = [&](const string& blob) {
+    return candidates.count(blob) && !excluded.count(blob);
+  };
+
+  // A Concat along an axis with only dimensions of 1 before it lays out its
+  // inputs one after another in its output. If the inputs are not written
+  // again after the Concat, and the output is only written by it, the inputs
+  // are placed in their slices of the output, and ConcatOp skips the copy.
+  // Each input then lives as long as the output does.
+  CaffeMap<string, std::pair<string, size_t>> slices;
+  std::set<string> concat_outputs;
+  for (int idx : concats) {
+    const OperatorDef& op_def = net_def.op(idx);
+    const string& output = op_def.output(0);
+    if (!planned(output) || writers[output] != vector<int>{idx} ||
+        slices.count(output)) {
+      continue;
+    }
+    ArgumentHelper helper(op_def);
+    const string order = helper.GetSingleArgument<string>("order", "");
+    const int axis = helper.HasArgument("axis")
+        ? helper.GetSingleArgument<int>("axis", -1)
+        : order == "NCHW" ? 1 : order == "NHWC" ? 3 : -1;
+    auto& output_slot = candidates[output];
+    if (axis < 0 || axis >= static_cast<int>(output_slot.dims.size())) {
+      continue;
+    }
+    bool contiguous = true;
+    for (int i = 0; i < axis; ++i) {
+      contiguous &= output_slot.dims[i] == 1;
+    }
+    std::set<string> inputs;
+    size_t nbytes = 0;
+    for (const string& input : op_def.input()) {
+      contiguous = contiguous && planned(input) && !slices.count(input) &&
+          !concat_outputs.count(input) && inputs.insert(input).second &&
+          writers[input].back() < idx &&
+          candidates[input].data_type == output_slot.data_type;
+      if (contiguous) {
+        nbytes += candidates[input].nbytes;
+      }
+    }
+    if (!contiguous || nbytes != output_slot.nbytes) {
+      continue;
+    }
+    size_t offset = 0;
+    for (const string& input : op_def.input()) {
+      const auto& input_slot = candidates[input];
+      slices[input] = std::make_pair(output, offset);
+      offset += input_slot.nbytes;
+      output_slot.first_use =
+          std::min(output_slot.first_use, input_slot.first_use);
+      output_slot.last_use =
+          std::max(output_slot.last_use, input_slot.last_use);
+    }
+    concat_outputs.insert(output);
+  }
+
+  // Place the blobs, largest first, at the lowest offset that does not collide
+  // with a blob already placed whose lifetime overlaps.
+  vector<std::pair<string, StaticMemoryPlan::Slot>> blobs;
+  for (const auto& kv : candidates) {
+    if (planned(kv.first) && !slices.count(kv.first)) {
+      blobs.push_back(kv);
+    }
+  }
+  std::stable_sort(
+      blobs.begin(),
+      blobs.end(),
+      [](const std::pair<string, StaticMemoryPlan::Slot>& a,
+         const std::pair<string, StaticMemoryPlan::Slot>& b) {
+        return a.second.nbytes > b.second.nbytes;
+      });
+  StaticMemoryPlan plan;
+  vector<const StaticMemoryPlan::Slot*> placed;
+  for (auto& kv : blobs) {
+    auto& slot = kv.second;
+    vector<const StaticMemoryPlan::Slot*> live;
+    for (const auto* other : placed) {
+      if (other->first_use <= slot.last_use &&
+          slot.first_use <= other->last_use) {
+        live.push_back(other);
+      }
+    }
+    std::sort(
+        live.begin(),
+        live.end(),
+        [](const StaticMemoryPlan::Slot* a, const StaticMemoryPlan::Slot* b) {
+          return a->offset < b->offset;
+        });
+    size_t offset = 0;
+    for (const auto* other : live) {
+      if (offset + slot.nbytes <= other->offset) {
+        break;
+      }
+      offset = std::max(offset, AlignUp(other->offset + other->nbytes));
+    }
+    slot.offset = offset;
+    plan.arena_nbytes = std::max(plan.arena_nbytes, offset + slot.nbytes);
+    placed.push_back(&plan.slots.emplace(kv.first, slot).first->second);
+  }
+  for (const auto& kv : slices) {
+    auto slot = candidates[kv.first];
+    slot.offset = plan.slots[kv.second.first].offset + kv.second.second;
+    plan.slots.emplace(kv.first, slot);
+  }
+  return plan;
+}
+
+void BindStaticMemoryPlan(const StaticMemoryPlan& plan, Workspace* ws) {
+  if (plan.slots.empty()) {
+    return;
+  }
+  std::shared_ptr<void> arena(
+      CPUContext::New(plan.arena_nbytes), CPUContext::Delete);
+  for (const auto& kv : plan.slots) {
+    const auto& slot = kv.second;
+    auto* tensor = ws->CreateBlob(kv.first)->GetMutable<TensorCPU>();
+    tensor->Resize(slot.dims);
+    tensor->ShareExternalPointer(
+        std::shared_ptr<void>(
+            arena, static_cast<char*>(arena.get()) + slot.offset),
+        DataTypeToTypeMeta(slot.data_type),
+        slot.nbytes);
+  }
+  VLOG(1) << "Planned " << plan.slots.size() << " blobs in an arena of "
+          << plan.arena_nbytes << " bytes.";
+}
+
+} // namespace caffe2
@@ -0,0 +1,56 @@
+#ifndef CAFFE2_CORE_MEMORY_PLANNER_H_
+#define CAFFE2_CORE_MEMORY_PLANNER_H_
+
+#include <memory>
+#include <string>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/tensor.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+
+// The result of static memory planning: where every planned blob lives inside
+// a single arena allocation.
+struct StaticMemoryPlan {
+  struct Slot {
+    vector<TIndex> dims;
+    TensorProto::DataType data_type;
+    size_t offset;
+    size_t nbytes;
+    // The first and last operator (inclusive) that touch the blob.
+    int first_use;
+    int last_use;
+  };
+  CaffeMap<string, Slot> slots;
+  size_t arena_nbytes = 0;
+};
+
+// Plans the memory of the intermediate blobs of a net whose operators are run
+// one after another in the order of the NetDef.
+//
+// The shapes of all blobs are inferred statically with the OpSchema tensor
+// inference functions, starting from the shapes of the blobs that are already
+// in the workspace. A blob is planned if it is a CPU tensor of a fundamental
+// type with a fully known shape, is written by the net before it is read, and
+// is not listed as an external input or output of the net. Planned blobs whose
+// lifetimes do not overlap share memory. Aliasing operators such as Alias
+// leave their blobs unplanned, since the output borrows the input's memory.
+// The inputs of a Concat along the outermost non-trivial axis are planned in
+// their slices of its output when possible, which makes the Concat a no-op.
+//
+// Note that this assumes that, after a Run(), nobody reads intermediate blobs
+// that are not external outputs: their content may have been overwritten by
+// another blob that shares the same memory.
+StaticMemoryPlan PlanStaticMemory(const NetDef& net_def, Workspace* ws);
+
+// Allocates one arena for the plan and binds every planned blob to its slot,
+// so that subsequent runs of the net resize the blobs to the same shape
+// without allocating. If an operator ever needs more memory than planned, the
+// tensor transparently falls back to its own allocation.
+void BindStaticMemoryPlan(const StaticMemoryPlan& plan, Workspace* ws);
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_MEMORY_PLANNER_H_
@@ -0,0 +1,214 @@
+#include "caffe2/core/memory_planner.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+const char kChainNet[] = R"DOC(
+  name: "chain"
+  op {
+    input: "X"
+    output: "A"
+    type: "Relu"
+  }
+  op {
+    input: "A"
+    output: "B"
+    type: "Scale"
+    arg {
+      name: "scale"
+      f: 2.0
+    }
+  }
+  op {
+    input: "B"
+    output: "C"
+    type: "Relu"
+  }
+  op {
+    input: "C"
+    output: "Y"
+    type: "Scale"
+    arg {
+      name: "scale"
+      f: 2.0
+    }
+  }
+  external_input: "X"
+  external_output: "Y"
+)DOC";
+
+NetDef ParseNet(const char* spec) {
+  NetDef net_def;
+  CAFFE_ENFORCE(
+      ::google::protobuf::TextFormat::ParseFromString(spec, &net_def));
+  return net_def;
+}
+
+void FillInput(Workspace* ws) {
+  auto* X = ws->CreateBlob("X")->GetMutable<TensorCPU>();
+  X->Resize(4, 8);
+  float* data = X->mutable_data<float>();
+  for (int i = 0; i < X->size(); ++i) {
+    data[i] = i - 16;
+  }
+}
+
+const char kConcatNet[] = R"DOC(
+  name: "concat"
+  op {
+    input: "X"
+    output: "A"
+    type: "Relu"
+  }
+  op {
+    input: "X"
+    output: "B"
+    type: "Scale"
+    arg {
+      name: "scale"
+      f: 2.0
+    }
+  }
+  op {
+    input: "A"
+    input: "B"
+    output: "C"
+    output: "C_split"
+    type: "Concat"
+    arg {
+      name: "axis"
+      i: 0
+    }
+  }
+  op {
+    input: "C"
+    output: "Y"
+    type: "Scale"
+    arg {
+      name: "scale"
+      f: 2.0
+    }
+  }
+  external_input: "X"
+  external_output: "Y"
+)DOC";
+
+} // namespace
+
+TEST(MemoryPlannerTest, ReusesMemoryOfDeadBlobs) {
+  Workspace ws;
+  FillInput(&ws);
+  auto plan = PlanStaticMemory(ParseNet(kChainNet), &ws);
+  // X and Y are external, A, B and C are intermediates of 4 * 8 floats.
+  ASSERT_EQ(plan.slots.size(), 3);
+  for (const auto& kv : plan.slots) {
+    EXPECT_EQ(kv.second.nbytes, 4 * 8 * sizeof(float));
+  }
+  // A is dead by the time C is produced, so they share memory, while B is
+  // alive with both of them.
+  EXPECT_EQ(plan.slots["A"].offset, plan.slots["C"].offset);
+  EXPECT_NE(plan.slots["A"].offset, plan.slots["B"].offset);
+  EXPECT_EQ(plan.arena_nbytes, 2 * 4 * 8 * sizeof(float));
+}
+
+TEST(MemoryPlannerTest, SkipsUnknownAndAliasedBlobs) {
+  Workspace ws;
+  FillInput(&ws);
+  NetDef net_def = ParseNet(kChainNet);
+  // The shape of Z is not known, and neither is anything computed from it.
+  auto* op = net_def.add_op();
+  op->set_type("Relu");
+  op->add_input("Z");
+  op->add_output("D");
+  // E borrows the memory of B.
+  op = net_def.add_op();
+  op->set_type("Alias");
+  op->add_input("B");
+  op->add_output("E");
+  net_def.add_external_input("Z");
+  auto plan = PlanStaticMemory(net_def, &ws);
+  ASSERT_EQ(plan.slots.size(), 2);
+  EXPECT_TRUE(plan.slots.count("A"));
+  EXPECT_TRUE(plan.slots.count("C"));
+}
+
+TEST(MemoryPlannerTest, NetRunsWithoutReallocation) {
+  Workspace ws;
+  FillInput(&ws);
+  NetDef net_def = ParseNet(kChainNet);
+  auto* arg = net_def.add_arg();
+  arg->set_name("static_memory_planning");
+  arg->set_i(1);
+  auto* net = ws.CreateNet(net_def);
+  ASSERT_TRUE(net != nullptr);
+
+  const auto& A = ws.GetBlob("A")->Get<TensorCPU>();
+  const auto& C = ws.GetBlob("C")->Get<TensorCPU>();
+  const void* a_data = A.raw_data();
+  EXPECT_EQ(a_data, C.raw_data());
+  for (int iter = 0; iter < 3; ++iter) {
+    ASSERT_TRUE(net->Run());
+    EXPECT_EQ(A.raw_data(), a_data);
+    EXPECT_EQ(C.raw_data(), a_data);
+    const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+    for (int i = 0; i < Y.size(); ++i) {
+      EXPECT_FLOAT_EQ(Y.data<float>()[i], std::max(i - 16, 0) * 4.0f);
+    }
+  }
+}
+
+TEST(MemoryPlannerTest, PlacesConcatInputsInOutput) {
+  Workspace ws;
+  FillInput(&ws);
+  NetDef net_def = ParseNet(kConcatNet);
+  auto plan = PlanStaticMemory(net_def, &ws);
+  ASSERT_TRUE(plan.slots.count("A"));
+  ASSERT_TRUE(plan.slots.count("B"));
+  ASSERT_TRUE(plan.slots.count("C"));
+  const size_t nbytes = 4 * 8 * sizeof(float);
+  EXPECT_EQ(plan.slots["C"].nbytes, 2 * nbytes);
+  EXPECT_EQ(plan.slots["A"].offset, plan.slots["C"].offset);
+  EXPECT_EQ(plan.slots["B"].offset, plan.slots["C"].offset + nbytes);
+
+  auto* arg = net_def.add_arg();
+  arg->set_name("static_memory_planning");
+  arg->set_i(1);
+  auto* net = ws.CreateNet(net_def);
+  ASSERT_TRUE(net != nullptr);
+  ASSERT_TRUE(net->Run());
+  const auto& C = ws.GetBlob("C")->Get<TensorCPU>();
+  EXPECT_EQ(ws.GetBlob("A")->Get<TensorCPU>().raw_data(), C.raw_data());
+  EXPECT_EQ(
+      ws.GetBlob("B")->Get<TensorCPU>().data<float>(),
+      C.data<float>() + 4 * 8);
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  ASSERT_EQ(Y.dims(), vector<TIndex>({8, 8}));
+  for (int i = 0; i < 4 * 8; ++i) {
+    EXPECT_FLOAT_EQ(Y.data<float>()[i], std::max(i - 16, 0) * 2.0f);
+    EXPECT_FLOAT_EQ(Y.data<float>()[4 * 8 + i], (i - 16) * 4.0f);
+  }
+}
+
+TEST(MemoryPlannerTest, KeepsConcatInputsWrittenAfterIt) {
+  Workspace ws;
+  FillInput(&ws);
+  NetDef net_def = ParseNet(kConcatNet);
+  // Writing A after the Concat would change C.
+  auto* op = net_def.add_op();
+  op->set_type("Relu");
+  op->add_input("B");
+  op->add_output("A");
+  auto plan = PlanStaticMemory(net_def, &ws);
+  ASSERT_TRUE(plan.slots.count("A"));
+  ASSERT_TRUE(plan.slots.count("C"));
+  EXPECT_FALSE(
+      plan.slots["A"].offset >= plan.slots["C"].offset &&
+      plan.slots["A"].offset < plan.slots["C"].offset + plan.slots["C"].nbytes);
+}
+
+} // namespace caffe2
@@ -0,0 +1,266 @@
+#include "caffe2/core/memory_timeline.h"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/memory_tracking.h"
+#include "caffe2/core/net_tracer.h"
+#include "caffe2/core/operator.h"
+
+namespace caffe2 {
+
+std::atomic<bool> MemoryTimeline::active_(false);
+
+namespace {
+
+// The operator that the current thread is running, if any.
+thread_local const string* current_op = nullptr;
+
+// The number of contributions that Stop() logs per device.
+constexpr int kLoggedContributions = 10;
+
+string DeviceName(const std::pair<int, int>& device) {
+  return device.first == CPU ? "CPU"
+                             : "CUDA:" + caffe2::to_string(device.second);
+}
+
+string JoinBlobs(const std::vector<string>& blobs) {
+  string joined;
+  for (const auto& blob : blobs) {
+    if (!joined.empty()) {
+      joined += "|";
+    }
+    joined += blob;
+  }
+  return joined;
+}
+} // namespace
+
+MemoryTimeline* MemoryTimeline::Get() {
+  // Leaked on purpose, like the tracker that calls it.
+  static MemoryTimeline* timeline = new MemoryTimeline();
+  return timeline;
+}
+
+bool MemoryTimeline::Start() {
+  CAFFE_ENFORCE(
+      FLAGS_caffe2_memory_tracking,
+      "The memory timeline needs --caffe2_memory_tracking.");
+  auto* tracker = MemoryTracker::Get();
+  // Taken in the order that RecordNew() and RecordDelete() are called in.
+  std::lock_guard<std::mutex> tracker_guard(tracker->mutex_);
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (active_) {
+    return false;
+  }
+  buffers_.clear();
+  events_.clear();
+  live_.clear();
+  peaks_.clear();
+  const double now_us = NetTracer::NowUs();
+  for (const auto& allocation : tracker->allocations_) {
+    live_[allocation.first] = buffers_.size();
+    events_.push_back(Event{now_us, buffers_.size(), true});
+    buffers_.push_back(
+        Buffer{allocation.second.nbytes, allocation.second.device, "", {}});
+  }
+  active_ = true;
+  return true;
+}
+
+void MemoryTimeline::Stop(const string& path) {
+  {
+    // The tracker checks Active() with its lock held, so that no events are
+    // recorded once it is released.
+    std::lock_guard<std::mutex> tracker_guard(MemoryTracker::Get()->mutex_);
+    if (!active_.exchange(false)) {
+      return;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    ComputePeaks();
+  }
+  for (const auto& device : Devices()) {
+    LOG(INFO) << "Peak memory on " << DeviceName(device) << ": "
+              << PeakBytes(device.first, device.second) << " bytes";
+    const auto contributions = PeakContributions(device.first, device.second);
+    for (int i = 0; i < contributions.size() && i < kLoggedContributions;
+         ++i) {
+      const auto& contribution = contributions[i];
+      LOG(INFO) << "  " << contribution.bytes << " bytes: "
+                << (contribution.blobs.empty() ? "<no blob>"
+                                               : contribution.blobs)
+                << " from "
+                << (contribution.op.empty() ? "<no operator>"
+                                            : contribution.op);
+    }
+  }
+  if (!path.empty()) {
+    Write(path);
+  }
+}
+
+void MemoryTimeline::RecordNew(
+    void* ptr,
+    size_t nbytes,
+    int device_type,
+    int gpu_id) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  live_[ptr] = buffers_.size();
+  events_.push_back(Event{NetTracer::NowUs(), buffers_.size(), true});
+  buffers_.push_back(Buffer{nbytes,
+                            std::make_pair(device_type, gpu_id),
+                            current_op ? *current_op : "",
+                            {}});
+}
+
+void MemoryTimeline::RecordDelete(void* ptr) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = live_.find(ptr);
+  if (it == live_.end()) {
+    return;
+  }
+  events_.push_back(Event{NetTracer::NowUs(), it->second, false});
+  live_.erase(it);
+}
+
+void MemoryTimeline::NameOutputs(OperatorBase* op) {
+  const auto& outputs = op->Outputs();
+  std::lock_guard<std::mutex> guard(mutex_);
+  for (int i = 0; i < outputs.size() && i < op->def().output_size(); ++i) {
+    DataPointerCall data_fun =
+        GetDataPointerCallFunction(outputs[i]->meta().id());
+    if (!data_fun) {
+      continue;
+    }
+    auto it = live_.find(const_cast<void*>(data_fun(outputs[i]->GetRaw())));
+    if (it == live_.end()) {
+      continue;
+    }
+    auto& blobs = buffers_[it->second].blobs;
+    const string& name = op->def().output(i);
+    if (std::find(blobs.begin(), blobs.end(), name) == blobs.end()) {
+      blobs.push_back(name);
+    }
+  }
+}
+
+void MemoryTimeline::ComputePeaks() {
+  // Finds the event after which every device peaked, then replays the events
+  // up to there to find the buffers live at that point.
+  std::map<std::pair<int, int>, size_t> in_use;
+  std::map<std::pair<int, int>, size_t> peak_event;
+  for (size_t i = 0; i < events_.size(); ++i) {
+    const Buffer& buffer = buffers_[events_[i].buffer];
+    size_t& bytes = in_use[buffer.device];
+    bytes = events_[i].allocated ? bytes + buffer.nbytes
+                                 : bytes - buffer.nbytes;
+    if (!peak_event.count(buffer.device) ||
+        bytes > peaks_[buffer.device].bytes) {
+      peaks_[buffer.device].bytes = bytes;
+      peak_event[buffer.device] = i;
+    }
+  }
+  std::set<size_t> live;
+  for (size_t i = 0; i < events_.size(); ++i) {
+    if (events_[i].allocated) {
+      live.insert(events_[i].buffer);
+    } else {
+      live.erase(events_[i].buffer);
+    }
+    for (const auto& device : peak_event) {
+      if (device.second != i) {
+        continue;
+      }
+      std::map<std::pair<string, string>, size_t> grouped;
+      for (size_t index : live) {
+        const Buffer& buffer = buffers_[index];
+        if (buffer.device == device.first) {
+          grouped[std::make_pair(JoinBlobs(buffer.blobs), buffer.op)] +=
+              buffer.nbytes;
+        }
+      }
+      auto& contributions = peaks_[device.first].contributions;
+      for (const auto& group : grouped) {
+        MemoryPeakContribution contribution;
+        contribution.blobs = group.first.first;
+        contribution.op = group.first.second;
+        contribution.bytes = group.second;
+        contributions.push_back(contribution);
+      }
+      std::stable_sort(
+          contributions.begin(),
+          contributions.end(),
+          [](const MemoryPeakContribution& a,
+             const MemoryPeakContribution& b) { return a.bytes > b.bytes; });
+    }
+  }
+}
+
+void MemoryTimeline::Write(const string& path) {
+  std::ofstream out(path, std::ofstream::out | std::ofstream::trunc);
+  if (!out.good()) {
+    LOG(ERROR) << "Failed to open memory timeline file " << path;
+    return;
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  out << "{\"traceEvents\":[";
+  std::map<std::pair<int, int>, size_t> in_use;
+  for (size_t i = 0; i < events_.size(); ++i) {
+    const Buffer& buffer = buffers_[events_[i].buffer];
+    size_t& bytes = in_use[buffer.device];
+    bytes = events_[i].allocated ? bytes + buffer.nbytes
+                                 : bytes - buffer.nbytes;
+    out << (i ? ",\n" : "") << "{\"name\":\"" << DeviceName(buffer.device)
+        << " memory\",\"ph\":\"C\",\"pid\":0,\"ts\":" << events_[i].time_us
+        << ",\"args\":{\"bytes\":" << bytes << "}}";
+  }
+  out << "],\"displayTimeUnit\":\"ms\"}\n";
+  LOG(INFO) << "Wrote " << events_.size() << " memory events to " << path;
+}
+
+std::vector<std::pair<int, int>> MemoryTimeline::Devices() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::vector<std::pair<int, int>> devices;
+  for (const auto& peak : peaks_) {
+    devices.push_back(peak.first);
+  }
+  return devices;
+}
+
+size_t MemoryTimeline::PeakBytes(int device_type, int gpu_id) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = peaks_.find(std::make_pair(device_type, gpu_id));
+  return it == peaks_.end() ? 0 : it->second.bytes;
+}
+
+std::vector<MemoryPeakContribution> MemoryTimeline::PeakContributions(
+    int device_type,
+    int gpu_id) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = peaks_.find(std::make_pair(device_type, gpu_id));
+  return it == peaks_.end() ? std::vector<MemoryPeakContribution>()
+                            : it->second.contributions;
+}
+
+MemoryTimelineOpScope::MemoryTimelineOpScope(
+    const string& net_name,
+    int idx,
+    OperatorBase* op)
+    : op_(op),
+      previous_(current_op),
+      label_(net_name + "/" + caffe2::to_string(idx) + ":" + op->def().type()) {
+  current_op = &label_;
+}
+
+MemoryTimelineOpScope::~MemoryTimelineOpScope() {
+  current_op = previous_;
+  if (MemoryTimeline::Active()) {
+    MemoryTimeline::Get()->NameOutputs(op_);
+  }
+}
+
+}  // namespace caffe2
@@ -0,0 +1,136 @@
+#ifndef CAFFE2_CORE_MEMORY_TIMELINE_H_
+#define CAFFE2_CORE_MEMORY_TIMELINE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "caffe2/core/common.h"
+
+namespace caffe2 {
+
+class OperatorBase;
+
+/**
+ * The memory that one buffer held at the peak of a device: the blobs that
+ * referred to it, the operator that allocated it, and its size. Buffers that
+ * were allocated before the recording started, or that no operator output
+ * referred to, have no blobs.
+ */
+struct MemoryPeakContribution {
+  // The names of the blobs, in the order they were seen, joined by "|" if
+  // several blobs shared the buffer, as they do after memonger.
+  string blobs;
+  // "<net>/<index>:<type>" of the operator, "" if outside of any.
+  string op;
+  size_t bytes = 0;
+};
+
+/**
+ * MemoryTimeline records every allocation and deletion that MemoryTracker
+ * sees while it is recording, with the operator that the allocating thread
+ * was running and the output blobs that the memory ended up in. From that it
+ * finds the peak of every device, and the buffers that were live at the
+ * peak, to see what a memory plan or memonger left alive when a net runs out
+ * of memory.
+ *
+ * It relies on MemoryTracker, so --caffe2_memory_tracking has to be set, from
+ * before the memory of interest is allocated. Memory allocated before Start()
+ * counts towards the peaks, without an operator. While it is not recording,
+ * it costs one relaxed atomic load per operator run.
+ */
+class MemoryTimeline {
+ public:
+  static MemoryTimeline* Get();
+
+  // Starts recording, dropping the previous recording. Returns false, doing
+  // nothing, if a recording is in progress already.
+  bool Start();
+  // Ends the recording, if any, and computes the peaks. If `path` is not
+  // empty, writes the memory in use on every device over time as Chrome
+  // trace JSON counters to it.
+  void Stop(const string& path = "");
+
+  static inline bool Active() {
+    return active_.load(std::memory_order_relaxed);
+  }
+
+  // The devices of the last recording, as (device type, gpu id).
+  std::vector<std::pair<int, int>> Devices();
+  // The most memory in use on the device during the last recording.
+  size_t PeakBytes(int device_type, int gpu_id = 0);
+  // The buffers live at the peak of the device, grouped by blobs and
+  // operator, largest first.
+  std::vector<MemoryPeakContribution> PeakContributions(
+      int device_type,
+      int gpu_id = 0);
+
+  // Called by MemoryTracker, with its lock held.
+  void RecordNew(void* ptr, size_t nbytes, int device_type, int gpu_id);
+  void RecordDelete(void* ptr);
+  // Names the buffers of the outputs of an operator that just ran.
+  void NameOutputs(OperatorBase* op);
+
+ private:
+  friend class MemoryTimelineOpScope;
+
+  struct Buffer {
+    size_t nbytes;
+    std::pair<int, int> device;
+    string op;
+    std::vector<string> blobs;
+  };
+  struct Event {
+    double time_us;
+    // Index into buffers_.
+    size_t buffer;
+    bool allocated;
+  };
+  struct DevicePeak {
+    size_t bytes = 0;
+    std::vector<MemoryPeakContribution> contributions;
+  };
+
+  MemoryTimeline() {}
+  void Write(const string& path);
+  void ComputePeaks();
+
+  static std::atomic<bool> active_;
+
+  std::mutex mutex_;
+  std::vector<Buffer> buffers_;
+  std::vector<Event> events_;
+  // The buffers of the live allocations, by pointer.
+  std::unordered_map<void*, size_t> live_;
+  std::map<std::pair<int, int>, DevicePeak> peaks_;
+
+  DISABLE_COPY_AND_ASSIGN(MemoryTimeline);
+};
+
+/**
+ * Attributes the memory that the current thread allocates while the scope is
+ * alive to the given operator, and names the buffers of its outputs when it
+ * ends. Nets open one around every operator run while MemoryTimeline is
+ * recording.
+ */
+class MemoryTimelineOpScope {
+ public:
+  MemoryTimelineOpScope(const string& net_name, int idx, OperatorBase* op);
+  ~MemoryTimelineOpScope();
+
+ private:
+  OperatorBase* op_;
+  const string* previous_;
+  string label_;
+
+  DISABLE_COPY_AND_ASSIGN(MemoryTimelineOpScope);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_MEMORY_TIMELINE_H_
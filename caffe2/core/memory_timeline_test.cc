@@ -0,0 +1,117 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <google/protobuf/text_format.h>
+#include "caffe2/core/memory_timeline.h"
+#include "caffe2/core/memory_tracking.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Ignores its input, which only orders it in DAG nets.
+class MemoryTimelineAllocOp final : public Operator<CPUContext> {
+ public:
+  MemoryTimelineAllocOp(const OperatorDef& def, Workspace* ws)
+      : Operator<CPUContext>(def, ws),
+        bytes_(OperatorBase::GetSingleArgument<int>("bytes", 0)) {}
+
+  bool RunOnDevice() override {
+    auto* output = Output(0);
+    output->Resize(bytes_);
+    output->mutable_data<char>();
+    return true;
+  }
+
+ private:
+  const int bytes_;
+};
+
+class MemoryTimelineFreeOp final : public OperatorBase {
+ public:
+  using OperatorBase::OperatorBase;
+
+  bool Run() override {
+    OperatorBase::Outputs()[0]->Reset();
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(MemoryTimelineAlloc, MemoryTimelineAllocOp);
+REGISTER_CPU_OPERATOR(MemoryTimelineFree, MemoryTimelineFreeOp);
+OPERATOR_SCHEMA(MemoryTimelineAlloc).NumInputs(0, 1).NumOutputs(1);
+OPERATOR_SCHEMA(MemoryTimelineFree).NumInputs(0, 1).NumOutputs(1);
+
+const char* netSpec = R"DOC(
+        name: "timeline"
+        op {
+          output: "a"
+          type: "MemoryTimelineAlloc"
+          arg { name: "bytes" i: 4000 }
+        }
+        op {
+          input: "a"
+          output: "b"
+          type: "MemoryTimelineAlloc"
+          arg { name: "bytes" i: 8000 }
+        }
+        op {
+          input: "b"
+          output: "a"
+          type: "MemoryTimelineFree"
+        }
+        op {
+          input: "a"
+          output: "c"
+          type: "MemoryTimelineAlloc"
+          arg { name: "bytes" i: 2000 }
+        }
+)DOC";
+} // namespace
+
+TEST(MemoryTimelineTest, RanksBlobsLiveAtPeak) {
+  FLAGS_caffe2_memory_tracking = true;
+  for (const string type : {"simple", "dag"}) {
+    NetDef def;
+    CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(netSpec, &def));
+    def.set_type(type);
+    Workspace ws;
+    ASSERT_NE(ws.CreateNet(def), nullptr);
+    const size_t start = MemoryTracker::Get()->BytesInUse(CPU);
+    ASSERT_TRUE(MemoryTimeline::Get()->Start());
+    EXPECT_FALSE(MemoryTimeline::Get()->Start());
+    ASSERT_TRUE(ws.RunNet("timeline"));
+    const string path = "memory_timeline_test_" + type + ".json";
+    MemoryTimeline::Get()->Stop(path);
+    EXPECT_FALSE(MemoryTimeline::Active());
+
+    EXPECT_EQ(MemoryTimeline::Get()->PeakBytes(CPU), start + 12000);
+    const auto contributions = MemoryTimeline::Get()->PeakContributions(CPU);
+    ASSERT_GE(contributions.size(), 2);
+    EXPECT_EQ(contributions[0].blobs, "b");
+    EXPECT_EQ(contributions[0].op, "timeline/1:MemoryTimelineAlloc");
+    EXPECT_EQ(contributions[0].bytes, 8000);
+    EXPECT_EQ(contributions[1].blobs, "a");
+    EXPECT_EQ(contributions[1].op, "timeline/0:MemoryTimelineAlloc");
+    EXPECT_EQ(contributions[1].bytes, 4000);
+
+    std::ifstream in(path);
+    std::stringstream trace;
+    trace << in.rdbuf();
+    std::remove(path.c_str());
+    EXPECT_EQ(trace.str().find("{\"traceEvents\":["), 0);
+    EXPECT_NE(trace.str().find("\"CPU memory\""), string::npos);
+  }
+  FLAGS_caffe2_memory_tracking = false;
+}
+
+TEST(MemoryTimelineTest, NeedsMemoryTracking) {
+  EXPECT_ANY_THROW(MemoryTimeline::Get()->Start());
+}
+
+}  // namespace caffe2
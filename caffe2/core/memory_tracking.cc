@@ -0,0 +1,155 @@
+#include "caffe2/core/memory_tracking.h"
+
+#include <algorithm>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/memory_timeline.h"
+
+CAFFE2_DEFINE_bool(
+    caffe2_memory_tracking,
+    false,
+    "If set, the memory handed out by the CPU and CUDA contexts is accounted "
+    "for per device, and workspaces record the peak memory of every net run.");
+
+namespace caffe2 {
+
+namespace {
+thread_local MemoryAccount* current_account = nullptr;
+} // namespace
+
+MemoryTracker* MemoryTracker::Get() {
+  // Leaked on purpose, since memory may still be deleted at exit.
+  static MemoryTracker* tracker = new MemoryTracker();
+  return tracker;
+}
+
+void MemoryTracker::EnforceBudget(size_t nbytes) {
+  MemoryAccount* account = current_account;
+  if (!account || !account->budget_bytes_) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  CAFFE_ENFORCE_LE(
+      account->bytes_in_use_ + nbytes,
+      account->budget_bytes_,
+      "Allocating ",
+      nbytes,
+      " bytes would exceed the memory budget of ",
+      account->budget_bytes_,
+      " bytes, of which ",
+      account->bytes_in_use_,
+      " are in use.");
+}
+
+void MemoryTracker::RecordNew(
+    void* ptr,
+    size_t nbytes,
+    int device_type,
+    int gpu_id) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  const auto device = std::make_pair(device_type, gpu_id);
+  MemoryAccount* account = current_account;
+  if (account) {
+    account->bytes_in_use_ += nbytes;
+    account->peak_bytes_ =
+        std::max(account->peak_bytes_, account->bytes_in_use_);
+  }
+  allocations_[ptr] = Allocation{
+      nbytes, device, account ? account->shared_from_this() : nullptr};
+  auto& stats = devices_[device];
+  stats.bytes_in_use += nbytes;
+  stats.peak_bytes = std::max(stats.peak_bytes, stats.bytes_in_use);
+  total_bytes_in_use_ += nbytes;
+  for (MemoryPeakScope* scope : scopes_) {
+    scope->peak_bytes_ = std::max(scope->peak_bytes_, total_bytes_in_use_);
+  }
+  if (MemoryTimeline::Active()) {
+    MemoryTimeline::Get()->RecordNew(ptr, nbytes, device_type, gpu_id);
+  }
+}
+
+void MemoryTracker::RecordDelete(void* ptr) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = allocations_.find(ptr);
+  if (it == allocations_.end()) {
+    return;
+  }
+  const size_t nbytes = it->second.nbytes;
+  devices_[it->second.device].bytes_in_use -= nbytes;
+  total_bytes_in_use_ -= nbytes;
+  if (it->second.account) {
+    it->second.account->bytes_in_use_ -= nbytes;
+  }
+  allocations_.erase(it);
+  if (MemoryTimeline::Active()) {
+    MemoryTimeline::Get()->RecordDelete(ptr);
+  }
+}
+
+size_t MemoryTracker::BytesInUse(int device_type, int gpu_id) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = devices_.find(std::make_pair(device_type, gpu_id));
+  return it == devices_.end() ? 0 : it->second.bytes_in_use;
+}
+
+size_t MemoryTracker::PeakBytes(int device_type, int gpu_id) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = devices_.find(std::make_pair(device_type, gpu_id));
+  return it == devices_.end() ? 0 : it->second.peak_bytes;
+}
+
+size_t MemoryTracker::TotalBytesInUse() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return total_bytes_in_use_;
+}
+
+void MemoryTracker::ResetPeaks() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  for (auto& device : devices_) {
+    device.second.peak_bytes = device.second.bytes_in_use;
+  }
+}
+
+MemoryPeakScope::MemoryPeakScope() {
+  auto* tracker = MemoryTracker::Get();
+  std::lock_guard<std::mutex> guard(tracker->mutex_);
+  bytes_at_start_ = tracker->total_bytes_in_use_;
+  peak_bytes_ = bytes_at_start_;
+  tracker->scopes_.insert(this);
+}
+
+MemoryPeakScope::~MemoryPeakScope() {
+  auto* tracker = MemoryTracker::Get();
+  std::lock_guard<std::mutex> guard(tracker->mutex_);
+  tracker->scopes_.erase(this);
+}
+
+size_t MemoryPeakScope::peak_bytes() {
+  std::lock_guard<std::mutex> guard(MemoryTracker::Get()->mutex_);
+  return peak_bytes_;
+}
+
+size_t MemoryAccount::bytes_in_use() {
+  std::lock_guard<std::mutex> guard(MemoryTracker::Get()->mutex_);
+  return bytes_in_use_;
+}
+
+size_t MemoryAccount::peak_bytes() {
+  std::lock_guard<std::mutex> guard(MemoryTracker::Get()->mutex_);
+  return peak_bytes_;
+}
+
+MemoryAccountScope::MemoryAccountScope(MemoryAccount* account)
+    : previous_(current_account) {
+  current_account = account;
+}
+
+MemoryAccountScope::~MemoryAccountScope() {
+  current_account = previous_;
+}
+
+MemoryAccount* MemoryAccountScope::Current() {
+  return current_account;
+}
+
+}  // namespace caffe2
@@ -0,0 +1,158 @@
+#ifndef CAFFE2_CORE_MEMORY_TRACKING_H_
+#define CAFFE2_CORE_MEMORY_TRACKING_H_
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/flags.h"
+
+CAFFE2_DECLARE_bool(caffe2_memory_tracking);
+
+namespace caffe2 {
+
+class MemoryPeakScope;
+
+/**
+ * MemoryAccount attributes tracked memory to one of several tenants of the
+ * process, such as the models hosted together by a ModelHost. Memory that a
+ * thread allocates inside a MemoryAccountScope is charged to the scope's
+ * account until it is deleted, by whichever thread. An account with a
+ * budget refuses, by throwing from the allocating context, an allocation
+ * that would take it over the budget.
+ */
+class MemoryAccount : public std::enable_shared_from_this<MemoryAccount> {
+ public:
+  // A budget of 0 means no limit.
+  explicit MemoryAccount(size_t budget_bytes = 0)
+      : budget_bytes_(budget_bytes) {}
+
+  size_t budget_bytes() const {
+    return budget_bytes_;
+  }
+  size_t bytes_in_use();
+  size_t peak_bytes();
+
+ private:
+  friend class MemoryTracker;
+
+  const size_t budget_bytes_;
+  // Guarded by the mutex of the tracker.
+  size_t bytes_in_use_ = 0;
+  size_t peak_bytes_ = 0;
+
+  DISABLE_COPY_AND_ASSIGN(MemoryAccount);
+};
+
+/**
+ * MemoryTracker accounts for the memory that CPUContext::New() and
+ * CUDAContext::New() hand out, whatever allocator or memory pool they use, as
+ * long as --caffe2_memory_tracking is set. Turn the flag on before allocating
+ * anything: memory allocated while it is off is not tracked.
+ *
+ * Devices are identified by a device type and a gpu id, which is always 0 for
+ * the CPU.
+ */
+class MemoryTracker {
+ public:
+  static MemoryTracker* Get();
+
+  // Throws if allocating `nbytes` would take the account of the current
+  // MemoryAccountScope over its budget. Called by the contexts before they
+  // allocate, so that a refused allocation leaves nothing to clean up.
+  void EnforceBudget(size_t nbytes);
+  // Also charges the allocation to the account of the current
+  // MemoryAccountScope, if any.
+  void RecordNew(void* ptr, size_t nbytes, int device_type, int gpu_id);
+  // Pointers that were not recorded by RecordNew() are ignored. Both also
+  // record into the MemoryTimeline, if it is recording.
+  void RecordDelete(void* ptr);
+
+  // The tracked bytes currently in use on the given device, and the most
+  // that were ever in use since the last ResetPeaks().
+  size_t BytesInUse(int device_type, int gpu_id = 0);
+  size_t PeakBytes(int device_type, int gpu_id = 0);
+  // The tracked bytes currently in use on all devices together.
+  size_t TotalBytesInUse();
+  void ResetPeaks();
+
+ private:
+  friend class MemoryPeakScope;
+  friend class MemoryAccount;
+  friend class MemoryTimeline;
+
+  struct DeviceStats {
+    size_t bytes_in_use = 0;
+    size_t peak_bytes = 0;
+  };
+
+  struct Allocation {
+    size_t nbytes;
+    std::pair<int, int> device;
+    // Keeps the account alive until the memory charged to it is deleted.
+    std::shared_ptr<MemoryAccount> account;
+  };
+
+  MemoryTracker() {}
+
+  std::mutex mutex_;
+  std::unordered_map<void*, Allocation> allocations_;
+  std::map<std::pair<int, int>, DeviceStats> devices_;
+  size_t total_bytes_in_use_ = 0;
+  std::set<MemoryPeakScope*> scopes_;
+
+  DISABLE_COPY_AND_ASSIGN(MemoryTracker);
+};
+
+/**
+ * MemoryPeakScope records the most tracked memory that was in use, on all
+ * devices together, between its construction and its destruction. Since the
+ * tracker is process wide, this includes allocations made by other threads in
+ * the meantime.
+ */
+class MemoryPeakScope {
+ public:
+  MemoryPeakScope();
+  ~MemoryPeakScope();
+
+  size_t bytes_at_start() const {
+    return bytes_at_start_;
+  }
+  size_t peak_bytes();
+
+ private:
+  friend class MemoryTracker;
+
+  size_t bytes_at_start_;
+  size_t peak_bytes_;
+
+  DISABLE_COPY_AND_ASSIGN(MemoryPeakScope);
+};
+
+/**
+ * MemoryAccountScope charges the tracked memory that the current thread
+ * allocates, until the scope ends, to the given account. Scopes nest, the
+ * innermost one winning.
+ */
+class MemoryAccountScope {
+ public:
+  explicit MemoryAccountScope(MemoryAccount* account);
+  ~MemoryAccountScope();
+
+  // The account of the innermost scope of the current thread, or nullptr.
+  static MemoryAccount* Current();
+
+ private:
+  MemoryAccount* previous_;
+
+  DISABLE_COPY_AND_ASSIGN(MemoryAccountScope);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_MEMORY_TRACKING_H_
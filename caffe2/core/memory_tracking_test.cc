@@ -0,0 +1,65 @@
+#include "caffe2/core/context.h"
+#include "caffe2/core/memory_tracking.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+TEST(MemoryTrackerTest, TracksCPUAllocations) {
+  FLAGS_caffe2_memory_tracking = true;
+  auto* tracker = MemoryTracker::Get();
+  const size_t start = tracker->BytesInUse(CPU);
+  tracker->ResetPeaks();
+  void* first = CPUContext::New(1000);
+  void* second = CPUContext::New(3000);
+  EXPECT_EQ(tracker->BytesInUse(CPU), start + 4000);
+  CPUContext::Delete(second);
+  EXPECT_EQ(tracker->BytesInUse(CPU), start + 1000);
+  EXPECT_EQ(tracker->PeakBytes(CPU), start + 4000);
+  CPUContext::Delete(first);
+  EXPECT_EQ(tracker->BytesInUse(CPU), start);
+  tracker->ResetPeaks();
+  EXPECT_EQ(tracker->PeakBytes(CPU), start);
+  FLAGS_caffe2_memory_tracking = false;
+}
+
+TEST(MemoryTrackerTest, IgnoresUntrackedMemory) {
+  void* data = CPUContext::New(1000);
+  FLAGS_caffe2_memory_tracking = true;
+  const size_t start = MemoryTracker::Get()->TotalBytesInUse();
+  CPUContext::Delete(data);
+  EXPECT_EQ(MemoryTracker::Get()->TotalBytesInUse(), start);
+  FLAGS_caffe2_memory_tracking = false;
+}
+
+TEST(MemoryTrackerTest, PeakScope) {
+  FLAGS_caffe2_memory_tracking = true;
+  void* outside = CPUContext::New(100);
+  MemoryPeakScope scope;
+  void* inside = CPUContext::New(1000);
+  CPUContext::Delete(inside);
+  EXPECT_EQ(scope.peak_bytes(), scope.bytes_at_start() + 1000);
+  CPUContext::Delete(outside);
+  FLAGS_caffe2_memory_tracking = false;
+}
+
+TEST(MemoryTrackerTest, AccountScope) {
+  FLAGS_caffe2_memory_tracking = true;
+  auto account = std::make_shared<MemoryAccount>(2000);
+  void* inside = nullptr;
+  {
+    MemoryAccountScope scope(account.get());
+    EXPECT_EQ(MemoryAccountScope::Current(), account.get());
+    inside = CPUContext::New(1500);
+    EXPECT_ANY_THROW(CPUContext::New(1000));
+  }
+  EXPECT_EQ(MemoryAccountScope::Current(), nullptr);
+  void* outside = CPUContext::New(1000);
+  EXPECT_EQ(account->bytes_in_use(), 1500);
+  CPUContext::Delete(inside);
+  CPUContext::Delete(outside);
+  EXPECT_EQ(account->bytes_in_use(), 0);
+  EXPECT_EQ(account->peak_bytes(), 1500);
+  FLAGS_caffe2_memory_tracking = false;
+}
+
+}  // namespace caffe2
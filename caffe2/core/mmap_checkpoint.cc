@@ -0,0 +1,261 @@
+#include "caffe2/core/mmap_checkpoint.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/types.h"
+
+namespace caffe2 {
+
+constexpr size_t MmapCheckpoint::kAlignment;
+
+namespace {
+// The file starts with a fixed header: the magic, the format version, the
+// number of tensors and the size of the index that follows it.
+constexpr char kMagic[8] = {'C', '2', 'M', 'M', 'A', 'P', 'C', 'K'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderBytes = sizeof(kMagic) + 2 * sizeof(uint32_t) +
+    sizeof(uint64_t);
+
+inline size_t AlignUp(size_t nbytes) {
+  return (nbytes + MmapCheckpoint::kAlignment - 1) /
+      MmapCheckpoint::kAlignment * MmapCheckpoint::kAlignment;
+}
+
+template <typename T>
+void Append(string* buffer, const T& value) {
+  buffer->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Reads the index of a mapped file, checking that it stays within bounds.
+class IndexReader {
+ public:
+  IndexReader(const char* data, size_t size, const string& filename)
+      : data_(data), size_(size), filename_(filename) {}
+
+  template <typename T>
+  T Read() {
+    T value;
+    memcpy(&value, Advance(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  string ReadString(size_t length) {
+    return string(Advance(length), length);
+  }
+
+  size_t position() const {
+    return position_;
+  }
+
+ private:
+  const char* Advance(size_t nbytes) {
+    CAFFE_ENFORCE_LE(
+        nbytes, size_ - position_, "Truncated checkpoint: ", filename_);
+    const char* ptr = data_ + position_;
+    position_ += nbytes;
+    return ptr;
+  }
+
+  const char* data_;
+  size_t size_;
+  const string& filename_;
+  size_t position_ = 0;
+};
+}  // namespace
+
+void MmapCheckpoint::Write(
+    const string& filename,
+    const vector<std::pair<string, const TensorCPU*>>& tensors) {
+  string index;
+  vector<size_t> offsets;
+  size_t index_bytes = 0;
+  for (const auto& named_tensor : tensors) {
+    index_bytes += sizeof(uint32_t) + named_tensor.first.size() +
+        sizeof(int32_t) + sizeof(uint32_t) +
+        named_tensor.second->ndim() * sizeof(int64_t) + 2 * sizeof(uint64_t);
+  }
+  size_t offset = AlignUp(kHeaderBytes + index_bytes);
+  for (const auto& named_tensor : tensors) {
+    const string& name = named_tensor.first;
+    const TensorCPU& tensor = *named_tensor.second;
+    const TensorProto::DataType data_type = TypeMetaToDataType(tensor.meta());
+    CAFFE_ENFORCE(
+        data_type != TensorProto_DataType_UNDEFINED &&
+            data_type != TensorProto_DataType_STRING && !tensor.meta().ctor(),
+        "Only tensors of fundamental types can be saved to a raw checkpoint, "
+        "but ",
+        name,
+        " is of type ",
+        tensor.meta().name());
+    Append<uint32_t>(&index, name.size());
+    index.append(name);
+    Append<int32_t>(&index, data_type);
+    Append<uint32_t>(&index, tensor.ndim());
+    for (TIndex dim : tensor.dims()) {
+      Append<int64_t>(&index, dim);
+    }
+    Append<uint64_t>(&index, offset);
+    Append<uint64_t>(&index, tensor.nbytes());
+    offsets.push_back(offset);
+    offset = AlignUp(offset + tensor.nbytes());
+  }
+  DCHECK_EQ(index.size(), index_bytes);
+
+  const string tmp_filename = filename + ".tmp";
+  FILE* file = fopen(tmp_filename.c_str(), "wb");
+  CAFFE_ENFORCE(
+      file, "Cannot open ", tmp_filename, " for writing: ", strerror(errno));
+  bool ok = true;
+  size_t position = 0;
+  auto write = [&](const void* data, size_t nbytes) {
+    ok = ok && fwrite(data, 1, nbytes, file) == nbytes;
+    position += nbytes;
+  };
+  auto pad_to = [&](size_t target) {
+    static const char kZeros[kAlignment] = {};
+    DCHECK_LE(target - position, kAlignment);
+    write(kZeros, target - position);
+  };
+  write(kMagic, sizeof(kMagic));
+  const uint32_t version = kVersion;
+  const uint32_t num_tensors = tensors.size();
+  const uint64_t index_size = index.size();
+  write(&version, sizeof(version));
+  write(&num_tensors, sizeof(num_tensors));
+  write(&index_size, sizeof(index_size));
+  write(index.data(), index.size());
+  for (int i = 0; i < tensors.size(); ++i) {
+    const TensorCPU& tensor = *tensors[i].second;
+    pad_to(offsets[i]);
+    if (tensor.nbytes()) {
+      write(tensor.raw_data(), tensor.nbytes());
+    }
+  }
+  pad_to(offset);
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    const int error = errno;
+    remove(tmp_filename.c_str());
+    CAFFE_THROW("Cannot write checkpoint ", filename, ": ", strerror(error));
+  }
+}
+
+std::shared_ptr<MmapCheckpoint> MmapCheckpoint::Open(const string& filename) {
+  std::shared_ptr<MmapCheckpoint> checkpoint(new MmapCheckpoint());
+  int fd = open(filename.c_str(), O_RDONLY);
+  CAFFE_ENFORCE(fd >= 0, "Cannot open ", filename, ": ", strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    const int error = errno;
+    close(fd);
+    CAFFE_THROW("Cannot stat ", filename, ": ", strerror(error));
+  }
+  CAFFE_ENFORCE_GE(
+      st.st_size, kHeaderBytes, filename, " is not a raw checkpoint.");
+  // The mapping is writable but private, so that loaded tensors can be
+  // modified in place without ever touching the file.
+  void* data = mmap(
+      nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  const int error = errno;
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  CAFFE_ENFORCE(
+      data != MAP_FAILED, "Cannot map ", filename, ": ", strerror(error));
+  checkpoint->data_ = static_cast<char*>(data);
+  checkpoint->size_ = st.st_size;
+  checkpoint->ParseIndex(filename);
+  return checkpoint;
+}
+
+MmapCheckpoint::~MmapCheckpoint() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+}
+
+void MmapCheckpoint::ParseIndex(const string& filename) {
+  IndexReader reader(data_, size_, filename);
+  CAFFE_ENFORCE(
+      memcmp(reader.ReadString(sizeof(kMagic)).data(), kMagic, sizeof(kMagic)) ==
+          0,
+      filename,
+      " is not a raw checkpoint.");
+  const uint32_t version = reader.Read<uint32_t>();
+  CAFFE_ENFORCE_EQ(
+      version, kVersion, "Unsupported raw checkpoint version in ", filename);
+  const uint32_t num_tensors = reader.Read<uint32_t>();
+  const uint64_t index_size = reader.Read<uint64_t>();
+  CAFFE_ENFORCE_LE(index_size, size_ - kHeaderBytes);
+  for (int i = 0; i < num_tensors; ++i) {
+    const string name = reader.ReadString(reader.Read<uint32_t>());
+    Entry entry;
+    entry.data_type =
+        static_cast<TensorProto::DataType>(reader.Read<int32_t>());
+    CAFFE_ENFORCE(
+        TensorProto::DataType_IsValid(entry.data_type),
+        "Invalid data type for ",
+        name,
+        " in ",
+        filename);
+    const uint32_t ndim = reader.Read<uint32_t>();
+    size_t size = 1;
+    for (int j = 0; j < ndim; ++j) {
+      entry.dims.push_back(reader.Read<int64_t>());
+      CAFFE_ENFORCE_GE(entry.dims.back(), 0);
+      size *= entry.dims.back();
+    }
+    entry.offset = reader.Read<uint64_t>();
+    entry.nbytes = reader.Read<uint64_t>();
+    CAFFE_ENFORCE_EQ(
+        entry.nbytes,
+        size * DataTypeToTypeMeta(entry.data_type).itemsize(),
+        "Corrupted index entry for ",
+        name,
+        " in ",
+        filename);
+    CAFFE_ENFORCE(
+        entry.offset % kAlignment == 0 && entry.offset <= size_ &&
+            entry.nbytes <= size_ - entry.offset,
+        "Payload of ",
+        name,
+        " is out of bounds in ",
+        filename);
+    CAFFE_ENFORCE(
+        entries_.emplace(name, std::move(entry)).second,
+        "Duplicated tensor ",
+        name,
+        " in ",
+        filename);
+    names_.push_back(name);
+  }
+  CAFFE_ENFORCE_EQ(reader.position(), kHeaderBytes + index_size);
+}
+
+void MmapCheckpoint::ShareTensor(const string& name, TensorCPU* tensor) {
+  auto it = entries_.find(name);
+  CAFFE_ENFORCE(it != entries_.end(), "Tensor ", name, " not in checkpoint.");
+  const Entry& entry = it->second;
+  const TypeMeta& meta = DataTypeToTypeMeta(entry.data_type);
+  tensor->Resize(entry.dims);
+  if (tensor->size() == 0) {
+    // There is nothing to alias, but the tensor still gets its type.
+    tensor->raw_mutable_data(meta);
+    return;
+  }
+  // The aliasing constructor ties the lifetime of the payload to the one of
+  // the whole mapping.
+  tensor->ShareExternalPointer(
+      std::shared_ptr<void>(shared_from_this(), data_ + entry.offset),
+      meta,
+      entry.nbytes);
+}
+
+}  // namespace caffe2
@@ -0,0 +1,81 @@
+#ifndef CAFFE2_CORE_MMAP_CHECKPOINT_H_
+#define CAFFE2_CORE_MMAP_CHECKPOINT_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/tensor.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+
+// The db_type under which the Load and Save operators use the format below.
+constexpr char kMmapCheckpointDBType[] = "mmap";
+
+/**
+ * A raw checkpoint format for CPU tensors of fundamental types: a header with
+ * an index of the tensors (name, data type, dims, and the offset and size of
+ * the payload) followed by the raw payloads, each aligned to kAlignment bytes.
+ * Payloads are stored in the byte order of the machine that wrote them.
+ *
+ * Unlike a db of serialized BlobProtos, nothing has to be parsed or converted
+ * on load: the file is mapped into memory, and the loaded tensors alias the
+ * mapping directly, so pages are only read from disk when they are touched.
+ * The mapping is private: a loaded tensor that is written to gets its own
+ * copy of the touched pages, and the file is never modified.
+ */
+class MmapCheckpoint : public std::enable_shared_from_this<MmapCheckpoint> {
+ public:
+  static constexpr size_t kAlignment = 64;
+
+  // Writes the given tensors to filename. The file is written under a
+  // temporary name and then renamed, so that checkpoints that are currently
+  // mapped keep their contents.
+  static void Write(
+      const string& filename,
+      const vector<std::pair<string, const TensorCPU*>>& tensors);
+
+  // Maps the checkpoint at filename. Throws if it is not a valid checkpoint.
+  static std::shared_ptr<MmapCheckpoint> Open(const string& filename);
+
+  ~MmapCheckpoint();
+
+  // The names of the tensors in the checkpoint, in the order they were
+  // written.
+  const vector<string>& names() const {
+    return names_;
+  }
+
+  bool Has(const string& name) const {
+    return entries_.count(name) > 0;
+  }
+
+  // Makes tensor alias the payload of the given name. The tensor keeps the
+  // mapping alive for as long as it uses it.
+  void ShareTensor(const string& name, TensorCPU* tensor);
+
+ private:
+  struct Entry {
+    TensorProto::DataType data_type;
+    vector<TIndex> dims;
+    size_t offset;
+    size_t nbytes;
+  };
+
+  MmapCheckpoint() {}
+
+  void ParseIndex(const string& filename);
+
+  char* data_ = nullptr;
+  size_t size_ = 0;
+  vector<string> names_;
+  CaffeMap<string, Entry> entries_;
+
+  DISABLE_COPY_AND_ASSIGN(MmapCheckpoint);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_MMAP_CHECKPOINT_H_
@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <fstream>
+
+#include "caffe2/core/mmap_checkpoint.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/workspace.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+TEST(MmapCheckpointTest, WriteAndOpen) {
+  string filename = std::tmpnam(nullptr);
+  TensorCPU floats(vector<TIndex>{2, 3});
+  for (int i = 0; i < floats.size(); ++i) {
+    floats.mutable_data<float>()[i] = i;
+  }
+  TensorCPU ints(vector<TIndex>{5});
+  for (int i = 0; i < ints.size(); ++i) {
+    ints.mutable_data<int64_t>()[i] = -i;
+  }
+  TensorCPU empty(vector<TIndex>{0, 4});
+  empty.mutable_data<uint8_t>();
+  MmapCheckpoint::Write(
+      filename, {{"floats", &floats}, {"ints", &ints}, {"empty", &empty}});
+
+  auto checkpoint = MmapCheckpoint::Open(filename);
+  EXPECT_EQ(checkpoint->names(), vector<string>({"floats", "ints", "empty"}));
+  EXPECT_TRUE(checkpoint->Has("ints"));
+  EXPECT_FALSE(checkpoint->Has("doubles"));
+
+  TensorCPU loaded_floats;
+  TensorCPU loaded_ints;
+  TensorCPU loaded_empty;
+  checkpoint->ShareTensor("floats", &loaded_floats);
+  checkpoint->ShareTensor("ints", &loaded_ints);
+  checkpoint->ShareTensor("empty", &loaded_empty);
+  EXPECT_EQ(loaded_floats.dims(), floats.dims());
+  EXPECT_EQ(
+      reinterpret_cast<size_t>(loaded_floats.raw_data()) %
+          MmapCheckpoint::kAlignment,
+      0);
+  EXPECT_EQ(
+      reinterpret_cast<size_t>(loaded_ints.raw_data()) %
+          MmapCheckpoint::kAlignment,
+      0);
+  for (int i = 0; i < floats.size(); ++i) {
+    EXPECT_EQ(loaded_floats.data<float>()[i], i);
+  }
+  for (int i = 0; i < ints.size(); ++i) {
+    EXPECT_EQ(loaded_ints.data<int64_t>()[i], -i);
+  }
+  EXPECT_EQ(loaded_empty.dims(), empty.dims());
+  EXPECT_TRUE(loaded_empty.IsType<uint8_t>());
+
+  // The tensors keep the mapping alive, and writing to them does not change
+  // the file.
+  checkpoint.reset();
+  loaded_floats.mutable_data<float>()[0] = 42;
+  EXPECT_EQ(loaded_floats.data<float>()[0], 42);
+  TensorCPU reloaded;
+  MmapCheckpoint::Open(filename)->ShareTensor("floats", &reloaded);
+  EXPECT_EQ(reloaded.data<float>()[0], 0);
+  std::remove(filename.c_str());
+}
+
+TEST(MmapCheckpointTest, RejectsInvalidFiles) {
+  string filename = std::tmpnam(nullptr);
+  EXPECT_THROW(MmapCheckpoint::Open(filename), EnforceNotMet);
+  {
+    std::ofstream file(filename);
+    file << "definitely not a checkpoint";
+  }
+  EXPECT_THROW(MmapCheckpoint::Open(filename), EnforceNotMet);
+  TensorCPU strings(vector<TIndex>{1});
+  strings.mutable_data<std::string>();
+  EXPECT_THROW(
+      MmapCheckpoint::Write(filename, {{"strings", &strings}}), EnforceNotMet);
+  std::remove(filename.c_str());
+}
+
+TEST(MmapCheckpointTest, SaveAndLoadOperators) {
+  string filename = std::tmpnam(nullptr);
+  Workspace ws;
+  auto* weights = ws.CreateBlob("weights")->GetMutable<TensorCPU>();
+  weights->Resize(16);
+  for (int i = 0; i < weights->size(); ++i) {
+    weights->mutable_data<float>()[i] = i * 0.5;
+  }
+
+  OperatorDef save_def;
+  save_def.set_type("Save");
+  save_def.add_input("weights");
+  AddArgument<string>("db", filename, &save_def);
+  AddArgument<string>("db_type", kMmapCheckpointDBType, &save_def);
+  AddArgument<int>("absolute_path", 1, &save_def);
+  ASSERT_TRUE(ws.RunOperatorOnce(save_def));
+
+  OperatorDef load_def;
+  load_def.set_type("Load");
+  load_def.add_output("weights");
+  AddArgument<string>("db", filename, &load_def);
+  AddArgument<string>("db_type", kMmapCheckpointDBType, &load_def);
+  AddArgument<int>("absolute_path", 1, &load_def);
+  Workspace load_ws;
+  ASSERT_TRUE(load_ws.RunOperatorOnce(load_def));
+  const auto& loaded = load_ws.GetBlob("weights")->Get<TensorCPU>();
+  EXPECT_EQ(loaded.dims(), weights->dims());
+  for (int i = 0; i < weights->size(); ++i) {
+    EXPECT_EQ(loaded.data<float>()[i], weights->data<float>()[i]);
+  }
+
+  load_def.clear_output();
+  AddArgument<int>("load_all", 1, &load_def);
+  Workspace load_all_ws;
+  ASSERT_TRUE(load_all_ws.RunOperatorOnce(load_def));
+  EXPECT_TRUE(load_all_ws.GetBlob("weights")->IsType<TensorCPU>());
+
+  load_def.clear_arg();
+  load_def.add_output("missing");
+  AddArgument<string>("db", filename, &load_def);
+  AddArgument<string>("db_type", kMmapCheckpointDBType, &load_def);
+  AddArgument<int>("absolute_path", 1, &load_def);
+  EXPECT_THROW(load_ws.RunOperatorOnce(load_def), EnforceNotMet);
+  std::remove(filename.c_str());
+}
+
+}  // namespace caffe2
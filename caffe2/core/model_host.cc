@@ -0,0 +1,176 @@
+#include "caffe2/core/model_host.h"
+
+#include <algorithm>
+
+namespace caffe2 {
+
+ModelHost::ModelHost(size_t num_threads) {
+  CAFFE_ENFORCE_GT(num_threads, 0);
+  for (size_t i = 0; i < num_threads; ++i) {
+    workers_.emplace_back([this]() { worker(); });
+  }
+}
+
+ModelHost::~ModelHost() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  changed_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ModelHost::addModel(
+    const std::string& name,
+    const NetDef& init_net,
+    const NetDef& run_net,
+    const ModelOptions& options) {
+  CAFFE_ENFORCE_GT(options.weight, 0);
+  CAFFE_ENFORCE_GT(options.max_concurrent_runs, 0);
+  CAFFE_ENFORCE(
+      !options.memory_budget_bytes || FLAGS_caffe2_memory_tracking,
+      "Memory budgets need --caffe2_memory_tracking.");
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CAFFE_ENFORCE(!models_.count(name), "Model ", name, " already exists.");
+  }
+  std::unique_ptr<Model> model(new Model());
+  model->options = options;
+  model->account = std::make_shared<MemoryAccount>(options.memory_budget_bytes);
+  {
+    // The weights count against the budget of the model.
+    MemoryAccountScope scope(model->account.get());
+    model->pool.reset(
+        new PredictorPool(init_net, run_net, options.max_concurrent_runs));
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  CAFFE_ENFORCE(!models_.count(name), "Model ", name, " already exists.");
+  models_[name] = std::move(model);
+}
+
+ModelHost::Model* ModelHost::findModel(const std::string& name) {
+  auto it = models_.find(name);
+  CAFFE_ENFORCE(it != models_.end(), "Unknown model ", name);
+  return it->second.get();
+}
+
+std::future<ModelHost::Outputs> ModelHost::run(
+    const std::string& name,
+    const TensorVector& inputs) {
+  Request request;
+  request.inputs.resize(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    request.inputs[i].ResizeLike(*inputs[i]);
+    request.inputs[i].ShareData(*inputs[i]);
+  }
+  auto outputs = request.outputs.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Model* model = findModel(name);
+    const auto& options = model->options;
+    if (options.max_queued_runs &&
+        model->queue.size() >= options.max_queued_runs) {
+      ++model->stats.rejected_runs;
+      CAFFE_THROW(
+          "Model ",
+          name,
+          " has ",
+          model->queue.size(),
+          " runs queued already.");
+    }
+    if (options.memory_budget_bytes &&
+        model->account->bytes_in_use() >= options.memory_budget_bytes) {
+      ++model->stats.rejected_runs;
+      CAFFE_THROW("Model ", name, " has used up its memory budget.");
+    }
+    if (model->queue.empty() && !model->running) {
+      model->virtual_time = std::max(model->virtual_time, virtual_time_);
+    }
+    model->queue.push_back(std::move(request));
+    ++queued_runs_;
+  }
+  changed_.notify_one();
+  return outputs;
+}
+
+ModelHost::Stats ModelHost::stats(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Model* model = findModel(name);
+  Stats stats = model->stats;
+  stats.bytes_in_use = model->account->bytes_in_use();
+  stats.peak_bytes = model->account->peak_bytes();
+  return stats;
+}
+
+ModelHost::Model* ModelHost::nextModel() {
+  Model* next = nullptr;
+  for (auto& entry : models_) {
+    Model* model = entry.second.get();
+    if (model->queue.empty() ||
+        model->running >= model->options.max_concurrent_runs) {
+      continue;
+    }
+    if (!next || model->virtual_time < next->virtual_time) {
+      next = model;
+    }
+  }
+  return next;
+}
+
+void ModelHost::worker() {
+  while (true) {
+    Model* model = nullptr;
+    Request request;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [this, &model]() {
+        model = nextModel();
+        return model || (stop_ && !queued_runs_);
+      });
+      if (!model) {
+        return;
+      }
+      request = std::move(model->queue.front());
+      model->queue.pop_front();
+      --queued_runs_;
+      ++model->running;
+      virtual_time_ = model->virtual_time;
+    }
+
+    const auto start = Clock::now();
+    Outputs outputs;
+    std::exception_ptr error;
+    try {
+      MemoryAccountScope scope(model->account.get());
+      TensorVector inputs;
+      for (auto& input : request.inputs) {
+        inputs.push_back(&input);
+      }
+      auto predictor = model->pool->acquire();
+      predictor->runAndTakeOutputs(inputs, &outputs);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    const double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    // The stats are up to date by the time the caller gets the outputs.
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --model->running;
+      model->virtual_time += seconds / model->options.weight;
+      model->stats.run_seconds += seconds;
+      ++(error ? model->stats.failed_runs : model->stats.completed_runs);
+    }
+    if (error) {
+      request.outputs.set_exception(error);
+    } else {
+      request.outputs.set_value(std::move(outputs));
+    }
+    // Another run of the model may be due now that this one is done.
+    changed_.notify_all();
+  }
+}
+}
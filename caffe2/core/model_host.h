@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "caffe2/core/memory_tracking.h"
+#include "caffe2/core/predictor_pool.h"
+
+namespace caffe2 {
+
+// Hosts several models in one process, sharing a fixed set of worker
+// threads between them instead of each model bringing its own, so that the
+// cores are not oversubscribed when the models are busy together.
+//
+// Each model is a PredictorPool whose runs are queued to the host. A worker
+// takes the next run from the model with the least weighted run time so
+// far, among those with queued runs and fewer than `max_concurrent_runs`
+// running, and charges the model the run's duration divided by its
+// `weight`: busy models share the workers in proportion to their weights,
+// and a model that was idle does not get to catch up for the time it did
+// not use. Nets run inline on the worker, so the run nets should be of the
+// simple type.
+//
+// A model may have a memory budget, which covers its weights, the
+// activations of its predictors and the outputs of its runs that are not
+// deleted yet. The MemoryTracker enforces it, so --caffe2_memory_tracking
+// must be set before the model is added: a run whose allocations would
+// exceed the budget fails, and its future holds the error.
+//
+// Admission control rejects a run up front, by throwing from `run`, when the
+// model has `max_queued_runs` runs queued already or its budget is used up,
+// so that an overloaded model sheds load instead of queueing it.
+class ModelHost {
+ public:
+  using TensorVector = Predictor::TensorVector;
+  using Outputs = std::vector<TensorCPU>;
+
+  struct ModelOptions {
+    // The share of the workers the model gets when other models are busy.
+    double weight = 1;
+    // The tracked memory the model may hold, or 0 for no limit.
+    size_t memory_budget_bytes = 0;
+    // The most runs the model may have queued, or 0 for no limit.
+    size_t max_queued_runs = 0;
+    // The most runs of the model that the workers run at once, each with a
+    // Predictor of its own.
+    size_t max_concurrent_runs = 1;
+  };
+
+  explicit ModelHost(size_t num_threads);
+  // Runs the queued runs, then stops the workers.
+  ~ModelHost();
+
+  // Runs `init_net` and adds the model under `name`, which must be new.
+  // Safe to call while other models are serving.
+  void addModel(
+      const std::string& name,
+      const NetDef& init_net,
+      const NetDef& run_net,
+      const ModelOptions& options);
+
+  // Queues a run of the model, and returns the future of its outputs. The
+  // inputs share their data with the run, so must not be modified until the
+  // future is ready. Throws if the run is not admitted. Safe to call from
+  // several threads at once.
+  std::future<Outputs> run(const std::string& name, const TensorVector& inputs);
+
+  struct Stats {
+    uint64_t completed_runs = 0;
+    uint64_t failed_runs = 0;
+    uint64_t rejected_runs = 0;
+    // The time the workers spent running the model.
+    double run_seconds = 0;
+    size_t bytes_in_use = 0;
+    size_t peak_bytes = 0;
+  };
+
+  // A snapshot of the stats of the model since it was added.
+  Stats stats(const std::string& name);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Request {
+    std::vector<TensorCPU> inputs;
+    std::promise<Outputs> outputs;
+  };
+
+  struct Model {
+    ModelOptions options;
+    std::shared_ptr<MemoryAccount> account;
+    std::unique_ptr<PredictorPool> pool;
+    std::deque<Request> queue;
+    size_t running = 0;
+    // The run time of the model divided by its weight, in seconds.
+    double virtual_time = 0;
+    Stats stats;
+  };
+
+  Model* findModel(const std::string& name);
+  // The model whose run is due next, or nullptr if none can run.
+  Model* nextModel();
+  void worker();
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::map<std::string, std::unique_ptr<Model>> models_;
+  // The virtual time of the model that last started a run, which a model
+  // that becomes busy again starts from at least.
+  double virtual_time_ = 0;
+  size_t queued_runs_ = 0;
+  bool stop_ = false;
+
+  std::vector<std::thread> workers_;
+
+  DISABLE_COPY_AND_ASSIGN(ModelHost);
+};
+}
@@ -0,0 +1,196 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include <google/protobuf/text_format.h>
+#include "caffe2/core/model_host.h"
+#include "caffe2/core/operator.h"
+
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+const char* predictSpec = R"DOC(
+        name: "predict"
+        type: "simple"
+        external_input: "data"
+        external_output: "y"
+        op {
+          input: "data"
+          output: "y"
+          type: "ModelHostTestGate"
+        }
+)DOC";
+
+const char* initSpec = R"DOC(
+        name: "init"
+        op {
+          type: "ConstantFill"
+          output: "data"
+          arg {
+            name: "shape"
+            ints: 1
+          }
+        }
+)DOC";
+
+// Runs are held at the gate while it is closed.
+std::mutex gate_mutex;
+std::condition_variable gate_changed;
+bool gate_open = true;
+int runs_at_gate = 0;
+
+void setGate(bool open) {
+  {
+    std::lock_guard<std::mutex> lock(gate_mutex);
+    gate_open = open;
+  }
+  gate_changed.notify_all();
+}
+
+void waitForRunsAtGate(int runs) {
+  std::unique_lock<std::mutex> lock(gate_mutex);
+  gate_changed.wait(lock, [runs]() { return runs_at_gate >= runs; });
+}
+
+// Copies its input once the gate is open.
+class ModelHostTestGateOp final : public OperatorBase {
+ public:
+  using OperatorBase::OperatorBase;
+
+  bool Run() override {
+    {
+      std::unique_lock<std::mutex> lock(gate_mutex);
+      ++runs_at_gate;
+      gate_changed.notify_all();
+      gate_changed.wait(lock, []() { return gate_open; });
+      --runs_at_gate;
+    }
+    Output<TensorCPU>(0)->CopyFrom(Input<TensorCPU>(0));
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(ModelHostTestGate, ModelHostTestGateOp);
+OPERATOR_SCHEMA(ModelHostTestGate).NumInputs(1).NumOutputs(1);
+
+NetDef parseNetDef(const std::string& value) {
+  NetDef def;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(value, &def));
+  return def;
+}
+
+std::unique_ptr<TensorCPU> makeInput(int size, float value) {
+  std::unique_ptr<TensorCPU> input(new TensorCPU(std::vector<TIndex>{size}));
+  auto* data = input->mutable_data<float>();
+  for (int i = 0; i < size; ++i) {
+    data[i] = value;
+  }
+  return input;
+}
+}
+
+class ModelHostTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    initNet_ = parseNetDef(initSpec);
+    predictNet_ = parseNetDef(predictSpec);
+    setGate(true);
+  }
+
+  NetDef initNet_;
+  NetDef predictNet_;
+};
+
+TEST_F(ModelHostTest, RunsModels) {
+  ModelHost host(2);
+  host.addModel("a", initNet_, predictNet_, ModelHost::ModelOptions());
+  host.addModel("b", initNet_, predictNet_, ModelHost::ModelOptions());
+  EXPECT_ANY_THROW(
+      host.addModel("a", initNet_, predictNet_, ModelHost::ModelOptions()));
+
+  auto one = makeInput(3, 1);
+  auto two = makeInput(3, 2);
+  auto a = host.run("a", {one.get()});
+  auto b = host.run("b", {two.get()});
+  auto outputs = a.get();
+  ASSERT_EQ(outputs.size(), 1);
+  EXPECT_EQ(outputs[0].size(), 3);
+  EXPECT_EQ(outputs[0].data<float>()[0], 1);
+  outputs = b.get();
+  ASSERT_EQ(outputs.size(), 1);
+  EXPECT_EQ(outputs[0].data<float>()[2], 2);
+  EXPECT_ANY_THROW(host.run("c", {one.get()}));
+
+  EXPECT_EQ(host.stats("a").completed_runs, 1);
+  EXPECT_EQ(host.stats("b").completed_runs, 1);
+}
+
+TEST_F(ModelHostTest, RejectsRunsBeyondTheQueue) {
+  ModelHost host(1);
+  ModelHost::ModelOptions options;
+  options.max_queued_runs = 1;
+  host.addModel("a", initNet_, predictNet_, options);
+
+  auto input = makeInput(1, 5);
+  setGate(false);
+  auto running = host.run("a", {input.get()});
+  waitForRunsAtGate(1);
+  auto queued = host.run("a", {input.get()});
+  EXPECT_ANY_THROW(host.run("a", {input.get()}));
+  setGate(true);
+
+  EXPECT_EQ(running.get()[0].data<float>()[0], 5);
+  EXPECT_EQ(queued.get()[0].data<float>()[0], 5);
+  const auto stats = host.stats("a");
+  EXPECT_EQ(stats.completed_runs, 2);
+  EXPECT_EQ(stats.rejected_runs, 1);
+}
+
+TEST_F(ModelHostTest, ServesOtherModelsWhileOneIsBusy) {
+  ModelHost host(2);
+  host.addModel("slow", initNet_, predictNet_, ModelHost::ModelOptions());
+  host.addModel("fast", initNet_, predictNet_, ModelHost::ModelOptions());
+
+  auto input = makeInput(1, 3);
+  setGate(false);
+  auto first = host.run("slow", {input.get()});
+  waitForRunsAtGate(1);
+  // The second worker is free, but the slow model may only run once at a
+  // time, so it is left for the fast one.
+  auto second = host.run("slow", {input.get()});
+  auto fast = host.run("fast", {input.get()});
+  waitForRunsAtGate(2);
+  EXPECT_EQ(host.stats("fast").completed_runs, 0);
+  setGate(true);
+
+  EXPECT_EQ(fast.get()[0].data<float>()[0], 3);
+  first.get();
+  second.get();
+  EXPECT_EQ(host.stats("slow").completed_runs, 2);
+}
+
+TEST_F(ModelHostTest, EnforcesMemoryBudget) {
+  FLAGS_caffe2_memory_tracking = true;
+  {
+    ModelHost host(1);
+    ModelHost::ModelOptions options;
+    options.memory_budget_bytes = 1000;
+    host.addModel("a", initNet_, predictNet_, options);
+
+    auto small = makeInput(10, 1);
+    auto large = makeInput(1000, 1);
+    EXPECT_EQ(host.run("a", {small.get()}).get()[0].size(), 10);
+    EXPECT_ANY_THROW(host.run("a", {large.get()}).get());
+    const auto stats = host.stats("a");
+    EXPECT_EQ(stats.completed_runs, 1);
+    EXPECT_EQ(stats.failed_runs, 1);
+    EXPECT_LE(stats.peak_bytes, options.memory_budget_bytes);
+    EXPECT_GT(stats.bytes_in_use, 0);
+  }
+  FLAGS_caffe2_memory_tracking = false;
+}
+
+}  // namespace caffe2
@@ -4,12 +4,46 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "caffe2/core/elementwise_fusion.h"
+#include "caffe2/core/memonger.h"
+#include "caffe2/core/memory_planner.h"
+#include "caffe2/core/numa.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/core/static_tracepoint.h"
 #include "caffe2/core/timer.h"
 #include "caffe2/proto/caffe2.pb.h"
 #include "caffe2/utils/proto_utils.h"
 
+CAFFE2_DEFINE_bool(
+    caffe2_simple_net_static_memory_planning,
+    CAFFE2_MOBILE,
+    "If set, simple nets plan the memory of their intermediate blobs at "
+    "construction time. This can be overridden per net with the "
+    "static_memory_planning argument. On by default on mobile, where the "
+    "peak memory of inference matters most.");
+
+CAFFE2_DEFINE_bool(
+    caffe2_simple_net_batched_dispatch,
+    false,
+    "If set, simple nets only switch to the device and wait for it at the "
+    "boundaries between runs of operators with the same device option, "
+    "instead of around every operator. This can be overridden per net with "
+    "the batched_dispatch argument.");
+
+CAFFE2_DEFINE_bool(
+    caffe2_net_memonger,
+    false,
+    "If set, CreateNet recycles dead activation blobs of every net it creates "
+    "(see core/memonger.h). This can be overridden per net with the memonger "
+    "argument; blobs listed in the memonger_static_blobs argument are kept.");
+
+CAFFE2_DEFINE_bool(
+    caffe2_net_fuse_elementwise,
+    false,
+    "If set, CreateNet fuses chains of element-wise operators of every net it "
+    "creates (see core/elementwise_fusion.h). This can be overridden per net "
+    "with the fuse_elementwise argument.");
+
 namespace caffe2 {
 
 CAFFE_DEFINE_REGISTRY(NetRegistry, NetBase, const NetDef&, Workspace*);
@@ -20,6 +54,27 @@ NetBase::NetBase(const NetDef& def, Workspace* /* unused */)
           def.external_output().begin(),
           def.external_output().end()),
       name_(def.name()) {
+  numa_node_id_ = ArgumentHelper(def).GetSingleArgument<int>(
+      "numa_node_id",
+      def.device_option().has_numa_node_id()
+          ? def.device_option().numa_node_id()
+          : -1);
+  if (ArgumentHelper(def).GetSingleArgument<int>(
+          "arena", FLAGS_caffe2_arena_allocation)) {
+    arena_.reset(new Arena());
+  }
+  const int profile_sample_rate = ArgumentHelper(def).GetSingleArgument<int>(
+      "profile_sample_rate", FLAGS_caffe2_net_profile_sample_rate);
+  if (profile_sample_rate > 0) {
+    profiler_.reset(new NetProfiler(
+        def,
+        profile_sample_rate,
+        ArgumentHelper(def).GetSingleArgument<string>(
+            "profile_perf_events", FLAGS_caffe2_net_profile_perf_events)));
+  }
+  for (const OperatorDef& op : def.op()) {
+    op_types_.push_back(op.type());
+  }
   // Go through the operators and make sure that blobs are correctly made.
   std::set<string> known_blobs(
       external_input_.begin(), external_input_.end());
@@ -63,7 +118,13 @@ NetBase::NetBase(const NetDef& def, Workspace* /* unused */)
       *remaining_output.begin());
 }
 
-unique_ptr<NetBase> CreateNet(const NetDef& net_def, Workspace* ws) {
+namespace {
+unique_ptr<NetBase> CreateNetWithoutRewrites(
+    const NetDef& net_def,
+    Workspace* ws) {
+  if (ArgumentHelper(net_def).GetSingleArgument<int>("pipelined", 0)) {
+    return NetRegistry()->Create("pipelined", net_def, ws);
+  }
   // In default, we will return a simple network that just runs all operators
   // sequentially.
   if (!net_def.has_type()) {
@@ -72,11 +133,52 @@ unique_ptr<NetBase> CreateNet(const NetDef& net_def, Workspace* ws) {
   return NetRegistry()->Create(net_def.type(), net_def, ws);
 }
 
+// Whether operators with these device options run on the same device, and
+// thus on the same stream when run from the same thread.
+bool SameDevice(const DeviceOption& a, const DeviceOption& b) {
+  return a.device_type() == b.device_type() &&
+      (a.device_type() == CPU || a.cuda_gpu_id() == b.cuda_gpu_id());
+}
+} // namespace
+
+void NetBase::TraceOperator(int idx, double start_us) {
+  const string& type = op_types_[idx];
+  NetTracer::Get()->AddSpan(
+      type.find("Allreduce") != string::npos ? "allreduce" : "operator",
+      type,
+      name_,
+      start_us,
+      NetTracer::NowUs());
+}
+
+unique_ptr<NetBase> CreateNet(const NetDef& net_def, Workspace* ws) {
+  ArgumentHelper arg_helper(net_def);
+  const bool fuse = arg_helper.GetSingleArgument<int>(
+      "fuse_elementwise", FLAGS_caffe2_net_fuse_elementwise);
+  const bool memonger =
+      arg_helper.GetSingleArgument<int>("memonger", FLAGS_caffe2_net_memonger);
+  if (!fuse && !memonger) {
+    return CreateNetWithoutRewrites(net_def, ws);
+  }
+  NetDef optimized(net_def);
+  if (fuse) {
+    optimized = FuseElementwiseOps(optimized);
+  }
+  if (memonger) {
+    auto static_blobs =
+        arg_helper.GetRepeatedArgument<string>("memonger_static_blobs");
+    optimized = memonger::OptimizeNet(
+        optimized, std::set<string>(static_blobs.begin(), static_blobs.end()));
+  }
+  return CreateNetWithoutRewrites(optimized, ws);
+}
+
 SimpleNet::SimpleNet(const NetDef& net_def, Workspace* ws)
     : NetBase(net_def, ws) {
   VLOG(1) << "Constructing SimpleNet " << net_def.name();
   bool net_def_has_device_option = net_def.has_device_option();
   // Initialize the operators
+  ArenaScope arena_scope(arena_.get());
   for (const OperatorDef& operator_def : net_def.op()) {
     VLOG(1) << "Creating operator " << operator_def.name()
             << ":" << operator_def.type();
@@ -91,14 +193,65 @@ SimpleNet::SimpleNet(const NetDef& net_def, Workspace* ws)
       operators_.emplace_back(CreateOperator(operator_def, ws));
     }
   }
+  batched_dispatch_ = ArgumentHelper(net_def).GetSingleArgument<int>(
+      "batched_dispatch", FLAGS_caffe2_simple_net_batched_dispatch);
+  if (batched_dispatch_) {
+    const int num_ops = operators_.size();
+    switches_device_.resize(num_ops);
+    finishes_device_.resize(num_ops);
+    for (int idx = 0; idx < num_ops; ++idx) {
+      switches_device_[idx] = idx == 0 ||
+          !SameDevice(operators_[idx - 1]->def().device_option(),
+                      operators_[idx]->def().device_option());
+      if (idx > 0) {
+        finishes_device_[idx - 1] = switches_device_[idx];
+      }
+    }
+    if (num_ops > 0) {
+      finishes_device_[num_ops - 1] = true;
+    }
+    // An operator that may be skipped is a batch of its own, so that the
+    // batches around it still switch to and wait for their device.
+    for (int idx = 0; idx < num_ops; ++idx) {
+      if (operators_[idx]->HasArgument(kRunIfArgument)) {
+        switches_device_[idx] = finishes_device_[idx] = true;
+        if (idx > 0) {
+          finishes_device_[idx - 1] = true;
+        }
+        if (idx + 1 < num_ops) {
+          switches_device_[idx + 1] = true;
+        }
+      }
+    }
+  }
+  // Since the operators run in order, the lifetime of every blob is known
+  // statically, and the intermediate blobs can be laid out in one arena up
+  // front instead of being allocated on the first run.
+  if (ArgumentHelper(net_def).GetSingleArgument<int>(
+          "static_memory_planning",
+          FLAGS_caffe2_simple_net_static_memory_planning)) {
+    BindStaticMemoryPlan(PlanStaticMemory(net_def, ws), ws);
+  }
 }
 
 bool SimpleNet::Run() {
   VLOG(1) << "Running net " << name_;
-  for (auto& op : operators_) {
+  NUMABind(numa_node_id_);
+  for (int idx = 0; idx < operators_.size(); ++idx) {
+    auto& op = operators_[idx];
+    if (!op->ShouldRun()) {
+      VLOG(1) << "Skipping operator " << op->def().name() << "("
+              << op->def().type() << ").";
+      continue;
+    }
     VLOG(1) << "Running operator " << op->def().name()
             << "(" << op->def().type() << ").";
-    if (!op->Run()) {
+    bool ok = RunOperator(idx, op.get(), [&]() {
+      return batched_dispatch_
+          ? op->RunInBatch(switches_device_[idx], finishes_device_[idx])
+          : op->Run();
+    });
+    if (!ok) {
       LOG(ERROR) << "Operator failed: "
                       << ProtoDebugString(op->def());
       return false;
@@ -109,10 +262,17 @@ bool SimpleNet::Run() {
 
 bool SimpleNet::RunAsync() {
   VLOG(1) << "Running net " << name_;
-  for (auto& op : operators_) {
+  NUMABind(numa_node_id_);
+  for (int idx = 0; idx < operators_.size(); ++idx) {
+    auto& op = operators_[idx];
+    if (!op->ShouldRun()) {
+      VLOG(1) << "Skipping operator " << op->def().name() << "("
+              << op->def().type() << ").";
+      continue;
+    }
     VLOG(1) << "Running operator " << op->def().name()
             << "(" << op->def().type() << ").";
-    if (!op->RunAsync()) {
+    if (!RunOperator(idx, op.get(), [&]() { return op->RunAsync(); })) {
       LOG(ERROR) << "Operator failed: "
                  << ProtoDebugString(op->def());
       return false;
@@ -167,7 +327,7 @@ vector<float> SimpleNet::TEST_Benchmark(
         const string& op_type = op->def().type();
         timer.Start();
         CAFFE_ENFORCE(
-            op->Run(),
+            !op->ShouldRun() || op->Run(),
             "operator ",
             op->def().name(),
             "(",
@@ -4,21 +4,28 @@
 #include <atomic>
 #include <climits>
 #include <cstddef>
+#include <queue>
 #include <thread>  // NOLINT
 #include <typeinfo>
 #include <vector>
 #include <unordered_map>
 
+#include "caffe2/core/arena.h"
 #include "caffe2/core/blob.h"
 #include "caffe2/core/common.h"
 #include "caffe2/core/logging.h"
+#include "caffe2/core/memory_timeline.h"
+#include "caffe2/core/net_profiler.h"
+#include "caffe2/core/net_tracer.h"
 #include "caffe2/core/registry.h"
 #include "caffe2/core/operator_schema.h"
 
 #include "caffe2/core/tensor.h"
+#include "caffe2/core/thread_budget.h"
 #include "caffe2/core/workspace.h"
 #include "caffe2/proto/caffe2.pb.h"
 #include "caffe2/utils/simple_queue.h"
+#include "caffe2/utils/work_stealing_queue.h"
 
 namespace caffe2 {
 
@@ -62,10 +69,62 @@ class NetBase {
     return external_input_;
   }
 
+  /**
+   * The sampled timings of the operators of the net, or of its operator types
+   * if `by_type`, if profiling is on for it (see NetProfiler), or else an
+   * empty vector.
+   */
+  vector<OperatorProfile> OperatorProfiles(bool by_type = false) const {
+    return profiler_ ? profiler_->Profiles(by_type)
+                     : vector<OperatorProfile>();
+  }
+  void ResetOperatorProfiles() {
+    if (profiler_) {
+      profiler_->Reset();
+    }
+  }
+
  protected:
+  // Runs the operator `op` at `idx` of the net by calling `run`, which
+  // returns whether it succeeded, through the profiler if there is one. Traces
+  // it if a trace is in progress (see NetTracer), and attributes its memory
+  // to it if a memory timeline is recording (see MemoryTimeline).
+  template <typename Run>
+  inline bool RunOperator(int idx, OperatorBase* op, Run run) {
+    if (MemoryTimeline::Active()) {
+      MemoryTimelineOpScope memory_scope(name_, idx, op);
+      return RunTracedOperator(idx, run);
+    }
+    return RunTracedOperator(idx, run);
+  }
+  template <typename Run>
+  inline bool RunTracedOperator(int idx, Run run) {
+    if (NetTracer::Active()) {
+      const double start_us = NetTracer::NowUs();
+      const bool success = profiler_ ? profiler_->Profile(idx, run) : run();
+      TraceOperator(idx, start_us);
+      return success;
+    }
+    return profiler_ ? profiler_->Profile(idx, run) : run();
+  }
+  void TraceOperator(int idx, double start_us);
+
   vector<string> external_input_;
   vector<string> external_output_;
   string name_;
+  // The NUMA node that the threads running the net are bound to, from the
+  // numa_node_id argument or the device option of the net, or -1.
+  int numa_node_id_ = -1;
+  // The arena that the operators of the net are allocated from, if the arena
+  // argument or --caffe2_arena_allocation is set. Being a member of the base
+  // class, it outlives the operators.
+  std::unique_ptr<Arena> arena_;
+  // Set if the profile_sample_rate argument or
+  // --caffe2_net_profile_sample_rate is positive. Counts the perf events of
+  // the profile_perf_events argument or --caffe2_net_profile_perf_events.
+  std::unique_ptr<NetProfiler> profiler_;
+  // The operator types, which name the operators in traces.
+  vector<string> op_types_;
 
   DISABLE_COPY_AND_ASSIGN(NetBase);
 };
@@ -92,6 +151,12 @@ class SimpleNet final : public NetBase {
 
  protected:
   vector<unique_ptr<OperatorBase> > operators_;
+  // With batched dispatch, consecutive operators that share a device option
+  // only switch to the device before the first of them, and only wait for the
+  // device after the last of them. See the batched_dispatch argument.
+  bool batched_dispatch_ = false;
+  vector<bool> switches_device_;
+  vector<bool> finishes_device_;
 
   DISABLE_COPY_AND_ASSIGN(SimpleNet);
 };
@@ -122,8 +187,9 @@ class DAGNetBase : public NetBase {
   // WorkerFunction() is a function wrapper to allow us to run worker threads.
   // It checks out one ready-to-run operator from the job queue, runs it,
   // notifies all its children, and for any children that is ready, enqueues
-  // it to the job queue.
-  void WorkerFunction();
+  // it to the job queue. worker_id identifies the worker's own deque when
+  // work stealing is enabled.
+  void WorkerFunction(int worker_id);
   vector<float> TEST_Benchmark(
       const int warmup_runs,
       const int main_runs,
@@ -133,14 +199,54 @@ class DAGNetBase : public NetBase {
     return execution_chains_;
   }
 
+  // The scheduling priority of every chain, indexed by operator, if the net
+  // has prioritized scheduling.
+  const vector<int>& TEST_chain_priorities() const {
+    return chain_priorities_;
+  }
+
  protected:
+  // Same as above, but if work_stealing is true, every worker gets its own
+  // deque of ready chains and only steals from the others when it runs out of
+  // work, instead of all workers sharing the single job_queue_.
+  DAGNetBase(const NetDef& net_def, Workspace* ws, bool work_stealing);
+
   virtual bool RunAt(const std::vector<int>& chain) = 0;
+  // Runs the given chain, schedules the children that it makes ready, and
+  // does the book-keeping for Run().
+  void ExecuteChain(int idx, int worker_id);
+  // Hands a ready chain over to whatever executes chains for this net.
+  void ScheduleChain(int idx, int worker_id);
+  // Submits a chain that got an in-flight slot to the executor pool.
+  void SubmitChainToPool(int idx);
+
   vector<internal::OperatorNode> operator_nodes_;
+  // When a trace is in progress, the time every chain became ready to run,
+  // indexed by the chain source, or 0 once it started running.
+  vector<double> chain_ready_us_;
   ExecutionChains execution_chains_;
   vector<int> initial_frontier_;
   SimpleQueue<int> job_queue_;
+  // With prioritized scheduling, ready chains are popped from
+  // priority_queue_ instead of job_queue_, highest chain_priorities_ first.
+  vector<int> chain_priorities_;
+  SimplePriorityQueue<int> priority_queue_;
+  std::unique_ptr<WorkStealingQueue<int>> stealing_queue_;
   std::vector<std::thread> workers_;
   int num_workers_;
+  // The threads of the workers, unless they are the executor pool's, and the
+  // OpenMP and MKL threads that each of them may add to run operators.
+  std::unique_ptr<ThreadAllotment> thread_allotment_;
+  int intra_op_threads_ = 1;
+
+  // If set, the net starts no workers_ of its own. Its chains run on the
+  // workspace executor pool instead, with at most max_in_flight_chains_ of
+  // them submitted at a time; the rest wait in pending_chains_.
+  ExecutorPool* executor_pool_ = nullptr;
+  int max_in_flight_chains_ = 0;
+  int in_flight_chains_ = 0;
+  std::queue<int> pending_chains_;
+  std::mutex pending_chains_mutex_;
   int remaining_ops_;
 
   bool success_;
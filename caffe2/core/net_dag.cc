@@ -2,9 +2,11 @@
 
 #include <set>
 #include <stack>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "caffe2/core/numa.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/core/static_tracepoint.h"
 #include "caffe2/core/timer.h"
@@ -15,6 +17,31 @@ CAFFE2_DEFINE_bool(
     caffe2_disable_chaining,
     false,
     "Disable chaining logic (some latent multi-device issues).");
+CAFFE2_DEFINE_bool(
+    caffe2_dag_cost_based_chaining,
+    false,
+    "If set, DAG nets use operator cost estimates when forming execution "
+    "chains, so that cheap operators do not get chains of their own. Can be "
+    "overridden per net with the cost_based_chaining argument.");
+CAFFE2_DEFINE_double(
+    caffe2_dag_cheap_op_cost,
+    65536,
+    "Operators with an estimated cost below this are cheap for the purpose "
+    "of cost based chaining. The unit is flops plus bytes moved for costs "
+    "estimated from the OpSchema, or that of the op_costs net argument.");
+CAFFE2_DEFINE_bool(
+    caffe2_dag_prioritized_scheduling,
+    false,
+    "If set, DAG nets run the ready chain with the highest priority first "
+    "instead of the one that became ready first. Priorities come from the "
+    "priority arguments of the operators and the critical path lengths. Can "
+    "be overridden per net with the prioritized_scheduling argument.");
+CAFFE2_DEFINE_bool(
+    caffe2_dag_shared_executor,
+    false,
+    "If set, DAG nets run on the workspace executor pool instead of starting "
+    "their own worker threads. Can be overridden per net with the "
+    "shared_executor argument.");
 
 namespace caffe2 {
 
@@ -26,6 +53,69 @@ bool sameDevice(const OperatorDef& lhs, const OperatorDef& rhs) {
       lhs.device_option().cuda_gpu_id() == rhs.device_option().cuda_gpu_id();
 }
 
+// Estimates the cost of running each operator of the net once. Costs are
+// taken from the op_costs argument of the net if it has one (e.g. timings
+// from a profiling run), and are otherwise inferred from the OpSchema cost
+// functions, with the shapes of the blobs currently in the workspace as the
+// input shapes. Operators whose cost cannot be estimated get a negative cost.
+std::vector<float> estimateOpCosts(const NetDef& net_def, Workspace* ws) {
+  ArgumentHelper arg_helper(net_def);
+  if (arg_helper.HasArgument("op_costs")) {
+    auto costs = arg_helper.GetRepeatedArgument<float>("op_costs");
+    CAFFE_ENFORCE_EQ(
+        costs.size(),
+        net_def.op_size(),
+        "op_costs should have one entry per operator.");
+    return costs;
+  }
+
+  std::vector<float> costs(net_def.op_size(), -1);
+  CaffeMap<string, TensorShape> shapes;
+  for (int idx = 0; idx < net_def.op_size(); ++idx) {
+    const OperatorDef& op_def = net_def.op(idx);
+    vector<TensorShape> input_shapes;
+    for (const string& input : op_def.input()) {
+      if (!shapes.count(input) && ws->HasBlob(input)) {
+        const Blob* blob = ws->GetBlob(input);
+        ShapeCall shape_fun = GetShapeCallFunction(blob->meta().id());
+        if (shape_fun) {
+          for (auto d : shape_fun(const_cast<Blob*>(blob)->GetRaw())) {
+            shapes[input].add_dims(d);
+          }
+        }
+      }
+      if (!shapes.count(input)) {
+        break;
+      }
+      input_shapes.push_back(shapes[input]);
+    }
+    for (const string& output : op_def.output()) {
+      shapes.erase(output);
+    }
+    const OpSchema* schema = OpSchemaRegistry::Schema(op_def.type());
+    if (!schema || input_shapes.size() != op_def.input_size()) {
+      continue;
+    }
+    try {
+      if (schema->HasCostInferenceFunction()) {
+        const auto cost = schema->InferCost(op_def, input_shapes);
+        costs[idx] = cost.flops + cost.bytes_moved;
+      }
+      auto output_shapes = schema->InferTensor(op_def, input_shapes);
+      for (int i = 0; i < op_def.output_size() && i < output_shapes.size();
+           ++i) {
+        if (!output_shapes[i].unknown_shape()) {
+          shapes[op_def.output(i)] = output_shapes[i];
+        }
+      }
+    } catch (const std::exception& e) {
+      VLOG(1) << "Cannot estimate the cost of " << op_def.type() << ": "
+              << e.what();
+    }
+  }
+  return costs;
+}
+
 using OpIndex = int;
 DAGNetBase::ExecutionChains singleChains(
     const std::vector<internal::OperatorNode>& nodes) {
@@ -114,8 +204,13 @@ std::vector<internal::OpGraphNode> pruneOpNodeGraph(
   return pruned;
 }
 
+// Computes the execution chains. If op_costs is not empty, operators with a
+// known cost below cheap_op_cost that fan out to several children end the
+// chain of their producer instead of becoming a chain of their own.
 DAGNetBase::ExecutionChains computeChains(
-    const std::vector<internal::OperatorNode>& orig_nodes) {
+    const std::vector<internal::OperatorNode>& orig_nodes,
+    const std::vector<float>& op_costs,
+    float cheap_op_cost) {
   const std::vector<internal::OpGraphNode> nodes = pruneOpNodeGraph(orig_nodes);
   vector<int> initial_frontier;
   for (int idx = 0; idx < nodes.size(); ++idx) {
@@ -171,6 +266,10 @@ DAGNetBase::ExecutionChains computeChains(
                                   orig_nodes[cur.first].operator_->def(),
                                   orig_nodes[chain.back()].operator_->def())));
   };
+  auto is_cheap = [&](OpIndex idx) -> bool {
+    return !op_costs.empty() && op_costs[idx] >= 0 &&
+        op_costs[idx] < cheap_op_cost;
+  };
   auto commit_chain = [&]() {
     if (chain.size() > 0) {
       CAFFE_ENFORCE(
@@ -228,6 +327,13 @@ DAGNetBase::ExecutionChains computeChains(
           // Add current node to the current chain and commit.
           chain.push_back(cur.first);
           commit_chain();
+        } else if (is_cheap(cur.first) && check_current_for_chaining()) {
+          // Node has more than one child, but is too cheap to be worth the
+          // scheduling overhead of a chain of its own, so it ends the current
+          // chain instead. Its children are scheduled when the chain is done.
+          chain.push_back(cur.first);
+          commit_chain();
+          depth_traverse();
         } else {
           // Node has more than one child.
           commit_chain();
@@ -257,16 +363,70 @@ DAGNetBase::ExecutionChains computeChains(
       ".");
   return chains;
 }
+
+// Computes the scheduling priority of every chain. Chains are ranked by the
+// largest priority argument of their operators and of every operator that
+// depends on them, so that e.g. the gradient operators feeding an allreduce
+// with a priority argument go first, then by the length of the longest path
+// from the chain to the end of the net, in op costs if there are any or in
+// operators otherwise. Returns the priorities indexed by operator, with the
+// highest number for the chain that should run first.
+std::vector<int> computeChainPriorities(
+    const NetDef& net_def,
+    const std::vector<internal::OperatorNode>& nodes,
+    const DAGNetBase::ExecutionChains& chains,
+    const std::vector<float>& op_costs) {
+  // Operators only depend on earlier operators, so the children of an
+  // operator are done before it when going backwards.
+  std::vector<float> user_priority(nodes.size());
+  std::vector<float> path_length(nodes.size());
+  for (int idx = nodes.size() - 1; idx >= 0; --idx) {
+    user_priority[idx] = ArgumentHelper(net_def.op(idx))
+                             .GetSingleArgument<float>("priority", 0);
+    float longest_child_path = 0;
+    for (int child : nodes[idx].children_) {
+      user_priority[idx] = std::max(user_priority[idx], user_priority[child]);
+      longest_child_path = std::max(longest_child_path, path_length[child]);
+    }
+    const float cost = op_costs.empty() ? 1 : std::max(op_costs[idx], 0.0f);
+    path_length[idx] = cost + longest_child_path;
+  }
+
+  std::vector<std::tuple<float, float, int>> keys;
+  for (const auto& chain : chains) {
+    float chain_priority = user_priority[chain.first];
+    for (int idx : chain.second) {
+      chain_priority = std::max(chain_priority, user_priority[idx]);
+    }
+    // Later operators go last among equals, hence the negated index.
+    keys.emplace_back(chain_priority, path_length[chain.first], -chain.first);
+  }
+  std::sort(keys.begin(), keys.end());
+  std::vector<int> priorities(nodes.size(), 0);
+  for (int rank = 0; rank < keys.size(); ++rank) {
+    priorities[-std::get<2>(keys[rank])] = rank;
+  }
+  return priorities;
+}
 }
 
 DAGNetBase::DAGNetBase(const NetDef& net_def, Workspace* ws)
-    : NetBase(net_def, ws), operator_nodes_(net_def.op_size()) {
+    : DAGNetBase(net_def, ws, false) {}
+
+DAGNetBase::DAGNetBase(
+    const NetDef& net_def,
+    Workspace* ws,
+    bool work_stealing)
+    : NetBase(net_def, ws),
+      operator_nodes_(net_def.op_size()),
+      chain_ready_us_(net_def.op_size()) {
   // Blob creator allows us to track which operator created which blob.
   VLOG(1) << "Constructing DAGNet " << net_def.name();
   std::map<string, int> blob_creator;
   std::map<string, std::set<int>> blob_readers;
   bool net_def_has_device_option = net_def.has_device_option();
   // Initialize the operators
+  ArenaScope arena_scope(arena_.get());
   for (int idx = 0; idx < net_def.op_size(); ++idx) {
     const OperatorDef& op_def = net_def.op(idx);
     VLOG(1) << "Creating operator #" << idx << ": " << op_def.name() << ":"
@@ -299,6 +459,12 @@ DAGNetBase::DAGNetBase(const NetDef& net_def, Workspace* ws)
         };
     checkInputs(op_def.input());
     checkInputs(op_def.control_input());
+    if (ArgumentHelper(op_def).HasArgument(kRunIfArgument)) {
+      google::protobuf::RepeatedPtrField<std::string> run_if;
+      *run_if.Add() =
+          ArgumentHelper(op_def).GetSingleArgument<string>(kRunIfArgument, "");
+      checkInputs(run_if);
+    }
 
     // Check the outputs.
     for (const string& output : op_def.output()) {
@@ -345,9 +511,20 @@ DAGNetBase::DAGNetBase(const NetDef& net_def, Workspace* ws)
     c.erase(std::remove(c.begin(), c.end(), i), c.end());
   }
 
+  ArgumentHelper arg_helper(net_def);
+  std::vector<float> op_costs;
+  if (arg_helper.GetSingleArgument<int>(
+          "cost_based_chaining", FLAGS_caffe2_dag_cost_based_chaining)) {
+    op_costs = estimateOpCosts(net_def, ws);
+  }
   execution_chains_ =
-      (FLAGS_caffe2_disable_chaining ? singleChains(operator_nodes_)
-                                     : computeChains(operator_nodes_));
+      (FLAGS_caffe2_disable_chaining
+           ? singleChains(operator_nodes_)
+           : computeChains(
+                 operator_nodes_,
+                 op_costs,
+                 arg_helper.GetSingleArgument<float>(
+                     "cheap_op_cost", FLAGS_caffe2_dag_cheap_op_cost)));
 
   // Tag operator nodes that start chains
   for (int i = 0; i < operator_nodes_.size(); ++i) {
@@ -373,6 +550,18 @@ DAGNetBase::DAGNetBase(const NetDef& net_def, Workspace* ws)
       initial_frontier_.push_back(idx);
     }
   }
+  if (arg_helper.GetSingleArgument<int>(
+          "prioritized_scheduling", FLAGS_caffe2_dag_prioritized_scheduling)) {
+    chain_priorities_ = computeChainPriorities(
+        net_def, operator_nodes_, execution_chains_, op_costs);
+    // Kick off the initial frontier in priority order as well.
+    std::stable_sort(
+        initial_frontier_.begin(),
+        initial_frontier_.end(),
+        [this](int a, int b) {
+          return chain_priorities_[a] > chain_priorities_[b];
+        });
+  }
   // Finally, start the workers.
   int num_workers = net_def.has_num_workers() ? net_def.num_workers() : 1;
   CAFFE_ENFORCE(num_workers > 0, "Must have a positive number of workers.");
@@ -388,7 +577,6 @@ DAGNetBase::DAGNetBase(const NetDef& net_def, Workspace* ws)
   // Option to start only one thread for first iteration. This hack is
   // needed to prevent deadlocks happening with CUDA and concurrent allocations
   // that operators do when run the first time.
-  ArgumentHelper arg_helper(net_def);
   if (arg_helper.HasArgument("first_iter_only_one_worker")) {
     if (arg_helper.GetSingleArgument<int64_t>(
             "first_iter_only_one_worker", 0)) {
@@ -396,15 +584,46 @@ DAGNetBase::DAGNetBase(const NetDef& net_def, Workspace* ws)
     }
   }
 
+  const bool shared_executor = arg_helper.GetSingleArgument<int>(
+      "shared_executor", FLAGS_caffe2_dag_shared_executor);
+  // Operators run with a single OpenMP thread on each worker, unless the net
+  // asks for more with intra_op_threads and the thread budget has them.
+  const int intra_op_threads =
+      std::max(1, arg_helper.GetSingleArgument<int>("intra_op_threads", 1));
+  const int worker_threads = shared_executor ? 0 : num_workers_;
+  thread_allotment_.reset(new ThreadAllotment(
+      worker_threads + num_workers_ * (intra_op_threads - 1)));
+  intra_op_threads_ = 1 +
+      std::max(0, thread_allotment_->threads() - worker_threads) / num_workers_;
+  VLOG(1) << "Net " << net_def.name() << " runs operators with "
+          << intra_op_threads_ << " intra-op threads per worker";
+
+  if (shared_executor) {
+    // Run on the workspace executor pool. num_workers now only limits how
+    // many chains of this net may run at the same time.
+    VLOG(1) << "Using the workspace executor pool for net " << net_def.name();
+    executor_pool_ = ws->GetExecutorPool();
+    max_in_flight_chains_ = num_workers_to_start;
+    return;
+  }
+
+  if (work_stealing) {
+    stealing_queue_.reset(new WorkStealingQueue<int>(num_workers_));
+  }
+
   for (int i = 0; i < num_workers_to_start; ++i) {
     VLOG(1) << "Start worker #" << i;
-    workers_.push_back(std::thread(&DAGNetBase::WorkerFunction, this));
+    workers_.push_back(std::thread(&DAGNetBase::WorkerFunction, this, i));
   }
 }
 
 DAGNetBase::~DAGNetBase() {
   // Safely join all the workers before exiting.
   job_queue_.NoMoreJobs();
+  priority_queue_.NoMoreJobs();
+  if (stealing_queue_) {
+    stealing_queue_->NoMoreJobs();
+  }
   VLOG(1) << "Joining workers.";
   for (auto& worker : workers_) {
     worker.join();
@@ -424,13 +643,25 @@ bool DAGNetBase::Run() {
   for (auto& node : operator_nodes_) {
     node.runtime_parent_count_ = node.parents_.size();
   }
-  // Kickstart the job queue.
-  for (auto& value : initial_frontier_) {
-    job_queue_.Push(value);
+  // Kickstart the job queue. With work stealing, the initial frontier is
+  // spread over the workers that are running so they all start busy.
+  for (int i = 0; i < initial_frontier_.size(); ++i) {
+    ScheduleChain(initial_frontier_[i], i);
   }
   std::unique_lock<std::mutex> mutex_lock(remaining_ops_mutex_);
   while (remaining_ops_ > 0) {
     VLOG(2) << "Remaining ops to run: " << remaining_ops_;
+    if (executor_pool_ && ExecutorPool::InPoolThread()) {
+      // This net is being run from a pool thread (e.g. by an operator of
+      // another net), so blocking here could take away the very thread our
+      // chains are waiting for. Help run pool tasks instead.
+      mutex_lock.unlock();
+      if (!executor_pool_->TryRunOne()) {
+        std::this_thread::yield();
+      }
+      mutex_lock.lock();
+      continue;
+    }
     cv_.wait(mutex_lock);
   }
   VLOG(2) << "All ops finished running.";
@@ -445,79 +676,165 @@ bool DAGNetBase::Run() {
   }
 
   // Ensure the number of workers matches the defined
-  for (auto i = workers_.size(); i < num_workers_; ++i) {
-    VLOG(1) << "Start worker #" << i;
-    workers_.push_back(std::thread(&DAGNetBase::WorkerFunction, this));
+  if (executor_pool_) {
+    std::lock_guard<std::mutex> guard(pending_chains_mutex_);
+    max_in_flight_chains_ = num_workers_;
+  } else {
+    for (auto i = workers_.size(); i < num_workers_; ++i) {
+      VLOG(1) << "Start worker #" << i;
+      workers_.push_back(std::thread(&DAGNetBase::WorkerFunction, this, i));
+    }
   }
 
   // If the above while loop finished, we know that the current run finished.
   return success_;
 }
 
-void DAGNetBase::WorkerFunction() {
+void DAGNetBase::WorkerFunction(int worker_id) {
+  NUMABind(numa_node_id_);
   // WorkerFunctions() is an infinite loop until there are no more jobs to run.
   while (true) {
     int idx = 0;
     // If there is no more jobs - meaning that the DAGNetBase is destructing -
     // we will exit safely.
-    if (!job_queue_.Pop(&idx)) {
-      return;
+    bool popped = false;
+    if (stealing_queue_) {
+      popped = stealing_queue_->Pop(worker_id, &idx);
+    } else if (!chain_priorities_.empty()) {
+      popped = priority_queue_.Pop(&idx);
+    } else {
+      popped = job_queue_.Pop(&idx);
     }
-    VLOG(1) << "Running operator #" << idx << " "
-            << operator_nodes_[idx].operator_->def().name() << "("
-            << operator_nodes_[idx].operator_->def().type() << ").";
-    CAFFE_ENFORCE(
-        execution_chains_.find(idx) != execution_chains_.end(),
-        "Can't find chain ",
-        idx,
-        ".");
-    const auto& chain = execution_chains_[idx];
-    bool this_success = RunAt(execution_chains_[idx]);
-    if (!this_success) {
-      LOG(ERROR) << "Operator chain failed: "
-                 << ProtoDebugString(operator_nodes_[idx].operator_->def());
+    if (!popped) {
+      return;
     }
+    ExecuteChain(idx, worker_id);
+  }
+}
 
-    // Do book-keeping
-    for (const auto idx : chain) {
-      for (const auto child : operator_nodes_[idx].children_) {
-        const int count = --operator_nodes_[child].runtime_parent_count_;
-        CAFFE_ENFORCE(
-            count >= 0,
-            "Found runtime parent count smaller than zero for ",
-            "operator node ",
-            operator_nodes_[child].operator_->def().name(),
-            "(",
-            operator_nodes_[child].operator_->def().type(),
-            ").");
-
-        if (count != 0) {
-          continue;
-        }
+void DAGNetBase::ExecuteChain(int idx, int worker_id) {
+  IntraOpThreadsGuard intra_op_guard(intra_op_threads_);
+  VLOG(1) << "Running operator #" << idx << " "
+          << operator_nodes_[idx].operator_->def().name() << "("
+          << operator_nodes_[idx].operator_->def().type() << ").";
+  CAFFE_ENFORCE(
+      execution_chains_.find(idx) != execution_chains_.end(),
+      "Can't find chain ",
+      idx,
+      ".");
+  const auto& chain = execution_chains_[idx];
+  if (chain_ready_us_[idx] > 0) {
+    NetTracer::Get()->AddTrackSpan(
+        name_ + " queue",
+        "queue",
+        op_types_[idx],
+        "",
+        chain_ready_us_[idx],
+        NetTracer::NowUs());
+    chain_ready_us_[idx] = 0;
+  }
+  bool this_success = RunAt(execution_chains_[idx]);
+  if (!this_success) {
+    LOG(ERROR) << "Operator chain failed: "
+               << ProtoDebugString(operator_nodes_[idx].operator_->def());
+  }
 
-        if (operator_nodes_[child].is_chain_start_) {
-          VLOG(2) << "Pushing chain #" << child << " to queue.";
-          job_queue_.Push(child);
-        }
+  // Do book-keeping
+  for (const auto idx : chain) {
+    for (const auto child : operator_nodes_[idx].children_) {
+      const int count = --operator_nodes_[child].runtime_parent_count_;
+      CAFFE_ENFORCE(
+          count >= 0,
+          "Found runtime parent count smaller than zero for ",
+          "operator node ",
+          operator_nodes_[child].operator_->def().name(),
+          "(",
+          operator_nodes_[child].operator_->def().type(),
+          ").");
+
+      if (count != 0) {
+        continue;
+      }
+
+      if (operator_nodes_[child].is_chain_start_) {
+        VLOG(2) << "Pushing chain #" << child << " to queue.";
+        ScheduleChain(child, worker_id);
       }
     }
+  }
 
-    // Notify that the processed op is incremented by one.
+  if (executor_pool_) {
+    // Hand our in-flight slot over to a pending chain, if any.
+    int next = -1;
     {
-      std::unique_lock<std::mutex> mutex_lock(remaining_ops_mutex_);
-      remaining_ops_ -= chain.size();
-      success_ &= this_success;
-      CAFFE_ENFORCE(
-          remaining_ops_ >= 0,
-          "All the operations should be finished by now, still have ",
-          remaining_ops_,
-          " remaining.");
+      std::lock_guard<std::mutex> guard(pending_chains_mutex_);
+      if (!pending_chains_.empty()) {
+        next = pending_chains_.front();
+        pending_chains_.pop();
+      } else {
+        --in_flight_chains_;
+      }
     }
+    if (next >= 0) {
+      SubmitChainToPool(next);
+    }
+  }
+
+  VLOG(2) << "Finished executing operator #" << idx;
+  // Notify that the processed op is incremented by one. We notify while
+  // holding the lock: once Run() sees no remaining ops it may return and
+  // the net may be destroyed, so we must not touch it after unlocking.
+  {
+    std::unique_lock<std::mutex> mutex_lock(remaining_ops_mutex_);
+    remaining_ops_ -= chain.size();
+    success_ &= this_success;
+    CAFFE_ENFORCE(
+        remaining_ops_ >= 0,
+        "All the operations should be finished by now, still have ",
+        remaining_ops_,
+        " remaining.");
     cv_.notify_one();
-    VLOG(2) << "Finished executing operator #" << idx;
   }
 }
 
+void DAGNetBase::ScheduleChain(int idx, int worker_id) {
+  if (NetTracer::Active()) {
+    chain_ready_us_[idx] = NetTracer::NowUs();
+  }
+  if (executor_pool_) {
+    {
+      std::lock_guard<std::mutex> guard(pending_chains_mutex_);
+      if (in_flight_chains_ >= max_in_flight_chains_) {
+        pending_chains_.push(idx);
+        return;
+      }
+      ++in_flight_chains_;
+    }
+    SubmitChainToPool(idx);
+  } else if (stealing_queue_) {
+    stealing_queue_->Push(worker_id % stealing_queue_->num_workers(), idx);
+  } else if (!chain_priorities_.empty()) {
+    priority_queue_.Push(idx, chain_priorities_[idx]);
+  } else {
+    job_queue_.Push(idx);
+  }
+}
+
+void DAGNetBase::SubmitChainToPool(int idx) {
+  const auto& device_option =
+      operator_nodes_[idx].operator_->def().device_option();
+  if (numa_node_id_ >= 0 && device_option.device_type() == CPU &&
+      !device_option.has_numa_node_id()) {
+    // Run on the pool threads of the node of the net.
+    DeviceOption numa_device_option(device_option);
+    numa_device_option.set_numa_node_id(numa_node_id_);
+    executor_pool_->Submit(
+        numa_device_option, [this, idx]() { ExecuteChain(idx, 0); });
+    return;
+  }
+  executor_pool_->Submit(device_option, [this, idx]() { ExecuteChain(idx, 0); });
+}
+
 vector<float> DAGNetBase::TEST_Benchmark(
     const int warmup_runs,
     const int main_runs,
@@ -560,23 +877,38 @@ class DAGNet : public DAGNetBase {
   using DAGNetBase::DAGNetBase;
 
  protected:
+  DAGNet(const NetDef& net_def, Workspace* ws, bool work_stealing)
+      : DAGNetBase(net_def, ws, work_stealing) {}
+
   bool RunAt(const std::vector<int>& chain) override {
     bool success = true;
     const auto& net_name = name_.c_str();
     for (const auto i : chain) {
       const auto& op_name = operator_nodes_[i].operator_->def().name().c_str();
       const auto& op_type = operator_nodes_[i].operator_->def().type().c_str();
+      if (!operator_nodes_[i].operator_->ShouldRun()) {
+        continue;
+      }
       CAFFE_SDT(operator_start, net_name, op_name, op_type);
-      success &= operator_nodes_[i].operator_->Run();
+      OperatorBase* op = operator_nodes_[i].operator_.get();
+      success &= RunOperator(i, op, [&]() { return op->Run(); });
       CAFFE_SDT(operator_done, net_name, op_name, op_type);
     }
     return success;
   }
 };
 
+// DAGNet that schedules execution chains with per-worker deques and work
+// stealing; see WorkStealingQueue.
+class DAGNetWS : public DAGNet {
+ public:
+  DAGNetWS(const NetDef& net_def, Workspace* ws) : DAGNet(net_def, ws, true) {}
+};
+
 namespace {
 
 REGISTER_NET(dag, DAGNet);
+REGISTER_NET(dag_ws, DAGNetWS);
 }
 
 } // namespace caffe2
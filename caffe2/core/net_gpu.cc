@@ -1,5 +1,9 @@
 #include "caffe2/core/net_gpu.h"
 
+#include <algorithm>
+#include <array>
+#include <set>
+
 #include "caffe2/core/flags.h"
 
 #include "caffe2/core/operator.h"
@@ -11,6 +15,11 @@
 #endif
 
 CAFFE2_DEFINE_bool(caffe2_use_nvtx, false, "Use NVTX ranges for profiling");
+CAFFE2_DEFINE_int(
+    caffe2_async_dag_streams_per_gpu,
+    1,
+    "The number of streams per GPU that an async_dag net spreads its chains "
+    "over, unless the net sets the streams_per_gpu argument.");
 
 namespace caffe2 {
 
@@ -64,16 +73,28 @@ class ProfiledRange {
 
 #endif // ifdef CAFFE2_USE_NVTX
 
+// Whether an operator only copies between the host and a device.
+bool IsHostDeviceCopy(const string& type) {
+  return type == "CopyGPUToCPU" || type == "CopyCPUToGPU";
+}
+
+// A collective makes the stream of its operator wait until the transfers
+// between the devices are done, so it must not share that stream with the
+// compute.
+bool IsCommunication(const string& type) {
+  return type.compare(0, 4, "NCCL") == 0;
+}
+
 } // namespace
 
 namespace internal {
 
 struct Stream {
-  explicit Stream(const DeviceOption& device_option) {
+  explicit Stream(const DeviceOption& device_option, int stream_id = 0) {
     if (device_option.device_type() == CUDA) {
       gpu_id_ = device_option.has_cuda_gpu_id() ? device_option.cuda_gpu_id()
                                                 : GetDefaultGPUID();
-      stream_ = CHECK_NOTNULL(CUDAContext::cuda_stream(gpu_id_, 0));
+      stream_ = CHECK_NOTNULL(CUDAContext::cuda_stream(gpu_id_, stream_id));
     }
   }
 
@@ -157,13 +178,61 @@ AsyncDAGNet::AsyncDAGNet(const NetDef& net_def, Workspace* ws)
       events_.emplace_back(new internal::Event(op_def.device_option()));
     }
   }
+
+  ArgumentHelper arg_helper(net_def);
+  const int streams_per_gpu = arg_helper.GetSingleArgument<int>(
+      "streams_per_gpu", FLAGS_caffe2_async_dag_streams_per_gpu);
+  CAFFE_ENFORCE_GE(streams_per_gpu, 1);
+  stream_ids_.assign(net_def.op_size(), 0);
+  // Going through the chains in operator order hands the sibling branches
+  // that follow a fork consecutive, hence distinct, streams. The chains that
+  // only copy between the host and the device, such as the ones that offload
+  // activations, get the stream after the compute streams, and the chains of
+  // collectives, such as the gradient all-reduces of data parallel training,
+  // the one after it, so that the transfers overlap with the compute. The
+  // parent events are waited on in any case, so any assignment is correct.
+  std::vector<int> sources;
+  for (const auto& chain : execution_chains_) {
+    sources.push_back(chain.first);
+  }
+  std::sort(sources.begin(), sources.end());
+  std::array<int, CAFFE2_COMPILE_TIME_MAX_GPUS> next_stream{};
+  for (int source : sources) {
+    const int gpu_id = events_[source]->gpu_id_;
+    if (gpu_id < 0) {
+      continue;
+    }
+    const auto& chain = execution_chains_[source];
+    const auto all_of_type = [this, &chain](bool (*is_type)(const string&)) {
+      return std::all_of(chain.begin(), chain.end(), [this, is_type](int idx) {
+        return is_type(operator_nodes_[idx].operator_->def().type());
+      });
+    };
+    int stream_id = 0;
+    if (all_of_type(IsHostDeviceCopy)) {
+      stream_id = streams_per_gpu;
+    } else if (all_of_type(IsCommunication)) {
+      stream_id = streams_per_gpu + 1;
+    } else if (streams_per_gpu > 1) {
+      stream_id = next_stream[gpu_id]++ % streams_per_gpu;
+    } else {
+      continue;
+    }
+    stream_ids_[source] = stream_id;
+    for (int idx : chain) {
+      if (events_[idx]->gpu_id_ == gpu_id) {
+        operator_nodes_[idx].operator_->SetStreamId(stream_id);
+      }
+    }
+  }
 }
 
 bool AsyncDAGNet::RunAt(const std::vector<int>& chain) {
   CAFFE_ENFORCE(!chain.empty(), "Chain should not be empty.");
   const auto source_idx = chain.front();
   internal::Stream stream{
-      operator_nodes_[source_idx].operator_->def().device_option()};
+      operator_nodes_[source_idx].operator_->def().device_option(),
+      stream_ids_[source_idx]};
   const auto& parents = operator_nodes_[source_idx].parents_;
   // Help ensure that our chaining is correct by verifying at least
   // one parent recorded an event.
@@ -183,8 +252,29 @@ bool AsyncDAGNet::RunAt(const std::vector<int>& chain) {
   // We've waited on all our parent indices.
   bool success = true;
   for (auto idx : chain) {
+    // The run_if blob is a CPU tensor, written synchronously by its producer.
+    if (!operator_nodes_[idx].operator_->ShouldRun()) {
+      continue;
+    }
     ProfiledRange r(operator_nodes_[idx].operator_->def(), kRunColor);
-    success &= operator_nodes_[idx].operator_->RunAsync();
+    const bool trace_device = stream.stream_ &&
+        trace_references_.count(stream.gpu_id_) && NetTracer::Active();
+    TracedOperator traced{
+        idx, stream.gpu_id_, stream_ids_[source_idx], nullptr, nullptr};
+    if (trace_device) {
+      DeviceGuard g(stream.gpu_id_);
+      CUDA_CHECK(cudaEventCreate(&traced.start));
+      CUDA_CHECK(cudaEventRecord(traced.start, stream.stream_));
+    }
+    OperatorBase* op = operator_nodes_[idx].operator_.get();
+    success &= RunOperator(idx, op, [&]() { return op->RunAsync(); });
+    if (trace_device) {
+      DeviceGuard g(stream.gpu_id_);
+      CUDA_CHECK(cudaEventCreate(&traced.stop));
+      CUDA_CHECK(cudaEventRecord(traced.stop, stream.stream_));
+      std::lock_guard<std::mutex> lock(traced_operators_mutex_);
+      traced_operators_.push_back(traced);
+    }
   }
 
   // Record an event for the sink of the chain.
@@ -206,6 +296,10 @@ bool AsyncDAGNet::Run() {
   // Reset the event tracking at each iteration
   eventRecorded_.assign(eventRecorded_.size(), 0);
 
+  const bool traced = NetTracer::Active();
+  if (traced) {
+    StartDeviceTrace();
+  }
   const auto result = DAGNetBase::Run();
 
   // Synchronize execution of the network with respect to the host.
@@ -222,8 +316,202 @@ bool AsyncDAGNet::Run() {
       stream.wait(event.get());
     }
   }
+  if (traced) {
+    FinishDeviceTrace();
+  }
   return result;
 }
 
+void AsyncDAGNet::StartDeviceTrace() {
+  for (const auto& event : events_) {
+    const int gpu_id = event->gpu_id_;
+    if (gpu_id < 0 || trace_references_.count(gpu_id)) {
+      continue;
+    }
+    // The previous run left the device idle, so the reference event
+    // completes about when the host sees it complete.
+    DeviceGuard g(gpu_id);
+    cudaEvent_t reference;
+    CUDA_CHECK(cudaEventCreate(&reference));
+    CUDA_CHECK(cudaEventRecord(reference, CUDAContext::cuda_stream(gpu_id, 0)));
+    CUDA_CHECK(cudaEventSynchronize(reference));
+    trace_references_[gpu_id] = std::make_pair(reference, NetTracer::NowUs());
+  }
+}
+
+void AsyncDAGNet::FinishDeviceTrace() {
+  for (const auto& traced : traced_operators_) {
+    DeviceGuard g(traced.gpu_id);
+    const auto& reference = trace_references_[traced.gpu_id];
+    float start_ms = 0;
+    float duration_ms = 0;
+    CUDA_CHECK(cudaEventSynchronize(traced.stop));
+    CUDA_CHECK(cudaEventElapsedTime(&start_ms, reference.first, traced.start));
+    CUDA_CHECK(cudaEventElapsedTime(&duration_ms, traced.start, traced.stop));
+    const double start_us = reference.second + start_ms * 1000;
+    NetTracer::Get()->AddTrackSpan(
+        "GPU " + caffe2::to_string(traced.gpu_id) + " stream " +
+            caffe2::to_string(traced.stream_id),
+        "gpu",
+        op_types_[traced.idx],
+        name_,
+        start_us,
+        start_us + duration_ms * 1000);
+    CUDA_CHECK(cudaEventDestroy(traced.start));
+    CUDA_CHECK(cudaEventDestroy(traced.stop));
+  }
+  traced_operators_.clear();
+  for (const auto& reference : trace_references_) {
+    DeviceGuard g(reference.first);
+    CUDA_CHECK(cudaEventDestroy(reference.second.first));
+  }
+  trace_references_.clear();
+}
+
 REGISTER_NET(async_dag, AsyncDAGNet);
+
+CUDAGraphNet::CUDAGraphNet(const NetDef& net_def, Workspace* ws)
+    : NetBase(net_def, ws) {
+  VLOG(1) << "Constructing CUDA graph net " << net_def.name();
+  NetDef simple_def(net_def);
+  simple_def.set_type("simple");
+  net_.reset(new SimpleNet(simple_def, ws));
+  warmup_runs_ = ArgumentHelper(net_def).GetSingleArgument<int>(
+      "graph_warmup_runs", 2);
+
+  capturable_ = net_def.op_size() > 0;
+  std::set<string> blob_names;
+  for (const auto& op_def : net_def.op()) {
+    const auto& option = op_def.has_device_option()
+        ? op_def.device_option()
+        : net_def.device_option();
+    const int gpu_id = option.has_cuda_gpu_id() ? option.cuda_gpu_id()
+                                                : GetDefaultGPUID();
+    if (option.device_type() != CUDA || (gpu_id_ != -1 && gpu_id != gpu_id_)) {
+      capturable_ = false;
+    }
+    gpu_id_ = gpu_id;
+    blob_names.insert(op_def.input().begin(), op_def.input().end());
+    blob_names.insert(op_def.output().begin(), op_def.output().end());
+  }
+  if (!capturable_) {
+    LOG(WARNING) << "Net " << name_ << " does not run all its ops on one GPU, "
+                 << "so it will run op by op.";
+    return;
+  }
+#if CUDART_VERSION < 10010
+  LOG(WARNING) << "CUDA graphs need CUDA 10.1 or newer, so net " << name_
+               << " will run op by op.";
+  capturable_ = false;
+#endif
+  for (const auto& name : blob_names) {
+    blobs_.push_back(CHECK_NOTNULL(ws->GetBlob(name)));
+  }
+}
+
+CUDAGraphNet::~CUDAGraphNet() {
+  ResetGraph();
+}
+
+bool CUDAGraphNet::Run() {
+  return RunImpl(true);
+}
+
+bool CUDAGraphNet::RunAsync() {
+  return RunImpl(false);
+}
+
+bool CUDAGraphNet::RunImpl(bool sync) {
+  if (capturable_) {
+    auto signature = ComputeSignature();
+    if (signature != signature_) {
+      ResetGraph();
+      signature_ = std::move(signature);
+      unchanged_runs_ = 0;
+    }
+#if CUDART_VERSION >= 10010
+    if (!graph_exec_ && unchanged_runs_ >= warmup_runs_) {
+      Capture();
+    }
+    if (graph_exec_) {
+      DeviceGuard g(gpu_id_);
+      cudaStream_t stream = CUDAContext::cuda_stream(gpu_id_, 0);
+      CUDA_CHECK(cudaGraphLaunch(graph_exec_, stream));
+      if (sync) {
+        CUDA_CHECK(cudaStreamSynchronize(stream));
+      }
+      return true;
+    }
+#endif
+    ++unchanged_runs_;
+  }
+  return sync ? net_->Run() : net_->RunAsync();
+}
+
+CUDAGraphNet::Signature CUDAGraphNet::ComputeSignature() const {
+  Signature signature;
+  signature.reserve(blobs_.size());
+  for (const Blob* blob : blobs_) {
+    if (blob->IsType<TensorCUDA>()) {
+      const auto& tensor = blob->Get<TensorCUDA>();
+      signature.emplace_back(tensor.raw_data(), tensor.dims());
+    } else if (blob->IsType<TensorCPU>()) {
+      const auto& tensor = blob->Get<TensorCPU>();
+      signature.emplace_back(tensor.raw_data(), tensor.dims());
+    } else {
+      signature.emplace_back(blob->GetRaw(), std::vector<TIndex>());
+    }
+  }
+  return signature;
+}
+
+void CUDAGraphNet::Capture() {
+#if CUDART_VERSION >= 10010
+  DeviceGuard g(gpu_id_);
+  cudaStream_t stream = CUDAContext::cuda_stream(gpu_id_, 0);
+  VLOG(1) << "Capturing net " << name_ << " into a CUDA graph.";
+  // Relaxed mode, as the ops may still grow a scratch buffer during the
+  // captured run.
+  CUDA_CHECK(cudaStreamBeginCapture(stream, cudaStreamCaptureModeRelaxed));
+  bool ok = false;
+  try {
+    ok = net_->RunAsync();
+  } catch (const EnforceNotMet& err) {
+    LOG(WARNING) << "Capturing net " << name_ << " failed: " << err.msg();
+  }
+  const cudaError_t error = cudaStreamEndCapture(stream, &graph_);
+  if (ok && error == cudaSuccess) {
+#if CUDART_VERSION >= 12000
+    ok = cudaGraphInstantiate(&graph_exec_, graph_, 0) == cudaSuccess;
+#else
+    ok = cudaGraphInstantiate(&graph_exec_, graph_, nullptr, nullptr, 0) ==
+        cudaSuccess;
+#endif
+  }
+  if (!ok || error != cudaSuccess) {
+    // Clear the sticky error of the failed capture.
+    cudaGetLastError();
+    ResetGraph();
+    LOG(WARNING) << "Net " << name_ << " could not be captured into a CUDA "
+                 << "graph, so it will run op by op.";
+    capturable_ = false;
+  }
+#endif
+}
+
+void CUDAGraphNet::ResetGraph() {
+#if CUDART_VERSION >= 10010
+  DeviceGuard g(gpu_id_ >= 0 ? gpu_id_ : GetDefaultGPUID());
+  if (graph_exec_) {
+    CUDA_CHECK(cudaGraphExecDestroy(graph_exec_));
+    graph_exec_ = nullptr;
+  }
+  if (graph_) {
+    CUDA_CHECK(cudaGraphDestroy(graph_));
+    graph_ = nullptr;
+  }
+#endif
+}
+
+REGISTER_NET(cuda_graph, CUDAGraphNet);
 }
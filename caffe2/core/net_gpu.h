@@ -1,6 +1,11 @@
 #ifndef CAFFE2_CORE_NET_GPU_H_
 #define CAFFE2_CORE_NET_GPU_H_
 
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 #include "caffe2/core/context_gpu.h"
 #include "caffe2/core/net.h"
 
@@ -32,7 +37,11 @@ struct Event {
 
 // Run an event-driven graph - before each operator chain, wait on
 // each parent operator for the chain source (Stream::wait), then
-// execute each operator (implicitly on the same stream).
+// execute each operator (implicitly on the same stream). With
+// streams_per_gpu > 1 the chains on a device are spread round-robin over
+// that many streams, so that independent chains can overlap on the device.
+// The chains of host-device copies run on a stream of their own, and so do
+// the chains of collectives, e.g. NCCL all-reduces.
 class AsyncDAGNet : public DAGNetBase {
  public:
   AsyncDAGNet(const NetDef& net_def, Workspace* ws);
@@ -44,9 +53,72 @@ class AsyncDAGNet : public DAGNetBase {
   // RunAt() iteration.
   std::vector<int32_t> eventRecorded_;
   std::vector<std::unique_ptr<internal::Event>> events_;
+  // The stream each chain runs on, indexed by the chain source.
+  std::vector<int> stream_ids_;
+
+  // While a trace is in progress (see NetTracer), the operators that run on
+  // GPU streams are bracketed by CUDA events, which Run() turns into spans
+  // of device time once the device is done with them.
+  struct TracedOperator {
+    int idx;
+    int gpu_id;
+    int stream_id;
+    cudaEvent_t start;
+    cudaEvent_t stop;
+  };
+  void StartDeviceTrace();
+  void FinishDeviceTrace();
+  // Per GPU, an event recorded at the start of a traced run, and the host
+  // time it completed at, which the device times are relative to.
+  std::map<int, std::pair<cudaEvent_t, double>> trace_references_;
+  std::mutex traced_operators_mutex_;
+  std::vector<TracedOperator> traced_operators_;
+
   DISABLE_COPY_AND_ASSIGN(AsyncDAGNet);
 };
 
+// Runs the net like SimpleNet, but once the shapes and buffers of all the
+// blobs it reads and writes have stayed the same for graph_warmup_runs runs,
+// records the CUDA work of one run into a CUDA graph and from then on
+// launches the whole graph at once, which takes the per-op launch overhead
+// off the host. Any change of those shapes or buffers drops the graph and
+// goes back to running op by op until the next capture.
+//
+// Only nets whose ops all run on the same GPU are captured. The ops must not
+// synchronize with the host, and must not depend on host-side state that
+// changes from run to run, such as the values of CPU inputs or data-dependent
+// output shapes: the graph replays exactly the work of the captured run. A
+// net whose capture fails keeps running op by op. CUDA graphs need CUDA 10.1;
+// with older versions the net always runs op by op.
+class CUDAGraphNet final : public NetBase {
+ public:
+  CUDAGraphNet(const NetDef& net_def, Workspace* ws);
+  ~CUDAGraphNet();
+  bool Run() override;
+  bool RunAsync() override;
+
+ protected:
+  using Signature = std::vector<std::pair<const void*, std::vector<TIndex>>>;
+  bool RunImpl(bool sync);
+  Signature ComputeSignature() const;
+  void Capture();
+  void ResetGraph();
+
+  std::unique_ptr<NetBase> net_;
+  // Every blob the ops read or write, whose buffers the graph bakes in.
+  std::vector<const Blob*> blobs_;
+  int gpu_id_ = -1;
+  bool capturable_ = false;
+  int warmup_runs_;
+  int unchanged_runs_ = 0;
+  Signature signature_;
+#if CUDART_VERSION >= 10010
+  cudaGraph_t graph_ = nullptr;
+  cudaGraphExec_t graph_exec_ = nullptr;
+#endif
+  DISABLE_COPY_AND_ASSIGN(CUDAGraphNet);
+};
+
 } // namespace caffe2
 
 #endif // CAFFE2_CORE_NET_GPU_H_
@@ -0,0 +1,273 @@
+#include <condition_variable>  // NOLINT
+#include <map>
+#include <mutex>  // NOLINT
+#include <set>
+
+#include "caffe2/core/executor_pool.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/proto/caffe2.pb.h"
+#include "caffe2/utils/proto_utils.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Suffix of the second buffer of double-buffered blobs.
+const char kSecondBufferSuffix[] = "_pipelined_1";
+
+/**
+ * PipelinedNet overlaps consecutive iterations of a net. It is created by
+ * CreateNet for nets that have the "pipelined" argument set, and runs the ops
+ * with the net type of the original NetDef (or as a simple net if the type is
+ * "pipelined" itself).
+ *
+ * The ops are split in two: the head is the largest set of ops that only
+ * depends on itself, and in particular not on anything that the rest of the
+ * ops (the tail) writes in the previous iteration. This is typically the data
+ * reading and preprocessing part of a training net, while the tail holds the
+ * forward and backward passes and the parameter updates. Run() then runs the
+ * tail of the current iteration concurrently with the head of the next
+ * iteration, on the workspace ExecutorPool.
+ *
+ * For this to work, the blobs written by the head and consumed by the tail are
+ * double buffered: every other iteration, they are renamed with a
+ * "_pipelined_1" suffix. Only blobs that are local to an iteration, i.e. are
+ * written before being read, and are not external outputs, can be double
+ * buffered, and the head may not write any other blob that the tail uses.
+ *
+ * When Run() returns, the external outputs hold the results of the iteration
+ * that it just finished, but the head of the next iteration has already run,
+ * which means that one extra head, e.g. reading one more batch, runs after the
+ * last iteration.
+ */
+class PipelinedNet final : public NetBase {
+ public:
+  PipelinedNet(const NetDef& net_def, Workspace* ws)
+      : NetBase(net_def, ws), ws_(ws), device_option_(net_def.device_option()) {
+    const int num_ops = net_def.op_size();
+    std::set<string> external_outputs(
+        net_def.external_output().begin(), net_def.external_output().end());
+    std::set<string> external_inputs(
+        net_def.external_input().begin(), net_def.external_input().end());
+
+    // Dependencies inside one iteration, following the DAGNet rules, and the
+    // users of every blob.
+    vector<std::set<int>> parents(num_ops);
+    std::map<string, std::set<int>> writers;
+    std::map<string, std::set<int>> users;
+    std::set<string> local;
+    {
+      std::map<string, int> last_writer;
+      std::map<string, vector<int>> readers;
+      std::set<string> seen;
+      for (int idx = 0; idx < num_ops; ++idx) {
+        const OperatorDef& op_def = net_def.op(idx);
+        for (const string& input : op_def.input()) {
+          if (last_writer.count(input)) {
+            parents[idx].insert(last_writer[input]);
+          }
+          seen.insert(input);
+          users[input].insert(idx);
+        }
+        for (const string& output : op_def.output()) {
+          if (last_writer.count(output)) {
+            parents[idx].insert(last_writer[output]);
+          }
+          for (int reader : readers[output]) {
+            parents[idx].insert(reader);
+          }
+          if (!seen.count(output) && !external_inputs.count(output) &&
+              !external_outputs.count(output)) {
+            local.insert(output);
+          }
+          seen.insert(output);
+          writers[output].insert(idx);
+          users[output].insert(idx);
+        }
+        parents[idx].erase(idx);
+        for (const string& input : op_def.input()) {
+          readers[input].push_back(idx);
+        }
+        for (const string& output : op_def.output()) {
+          last_writer[output] = idx;
+          readers[output].clear();
+        }
+      }
+    }
+
+    // Start with every op in the head, and move ops to the tail until the
+    // head does not depend on the tail anymore.
+    vector<bool> in_head(num_ops, true);
+    auto all_in_head = [&](const std::set<int>& ops) {
+      for (int op : ops) {
+        if (!in_head[op]) {
+          return false;
+        }
+      }
+      return true;
+    };
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (int idx = 0; idx < num_ops; ++idx) {
+        if (!in_head[idx]) {
+          continue;
+        }
+        const OperatorDef& op_def = net_def.op(idx);
+        bool ok = all_in_head(parents[idx]);
+        for (const string& input : op_def.input()) {
+          ok = ok && all_in_head(writers[input]);
+        }
+        for (const string& output : op_def.output()) {
+          ok = ok && !external_outputs.count(output) &&
+              (local.count(output) || all_in_head(users[output]));
+        }
+        if (!ok) {
+          in_head[idx] = false;
+          changed = true;
+        }
+      }
+    }
+
+    std::map<string, string> second_buffer;
+    int head_size = 0;
+    for (int idx = 0; idx < num_ops; ++idx) {
+      if (in_head[idx]) {
+        ++head_size;
+        for (const string& output : net_def.op(idx).output()) {
+          if (local.count(output)) {
+            second_buffer[output] = output + kSecondBufferSuffix;
+          }
+        }
+      }
+    }
+    has_head_ = head_size > 0;
+    LOG(INFO) << "Pipelining net " << name_ << ": " << head_size << " of "
+              << num_ops << " operators overlap with the previous iteration, "
+              << second_buffer.size() << " blobs are double buffered.";
+
+    for (int buffer = 0; buffer < 2; ++buffer) {
+      NetDef head_def = SubnetDef(net_def, "_head_" + caffe2::to_string(buffer));
+      NetDef tail_def = SubnetDef(net_def, "_tail_" + caffe2::to_string(buffer));
+      for (int idx = 0; idx < num_ops; ++idx) {
+        OperatorDef* op_def = in_head[idx] ? head_def.add_op()
+                                           : tail_def.add_op();
+        op_def->CopyFrom(net_def.op(idx));
+        if (buffer == 1) {
+          for (auto& input : *op_def->mutable_input()) {
+            if (second_buffer.count(input)) {
+              input = second_buffer[input];
+            }
+          }
+          for (auto& output : *op_def->mutable_output()) {
+            if (second_buffer.count(output)) {
+              output = second_buffer[output];
+            }
+          }
+        }
+      }
+      head_[buffer] = CreateSubnet(head_def, ws);
+      tail_[buffer] = CreateSubnet(tail_def, ws);
+    }
+  }
+
+  bool Run() override {
+    if (!has_head_) {
+      return tail_[0]->Run();
+    }
+    if (!head_done_ && !head_[buffer_]->Run()) {
+      return false;
+    }
+    head_done_ = false;
+    const int next = 1 - buffer_;
+    bool tail_ok = false;
+    bool head_ok = false;
+    if (ExecutorPool::InPoolThread()) {
+      // Blocking a pool thread on another pool task could starve the pool.
+      tail_ok = tail_[buffer_]->Run();
+      head_ok = tail_ok && head_[next]->Run();
+    } else {
+      std::mutex mutex;
+      std::condition_variable cv;
+      bool head_finished = false;
+      ws_->GetExecutorPool()->Submit(device_option_, [&]() {
+        bool ok = false;
+        try {
+          ok = head_[next]->Run();
+        } catch (const std::exception& e) {
+          LOG(ERROR) << "Exception in the head of pipelined net " << name_
+                     << ": " << e.what();
+        }
+        std::lock_guard<std::mutex> guard(mutex);
+        head_ok = ok;
+        head_finished = true;
+        cv.notify_one();
+      });
+      try {
+        tail_ok = tail_[buffer_]->Run();
+      } catch (...) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return head_finished; });
+        throw;
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&]() { return head_finished; });
+    }
+    if (!tail_ok) {
+      return false;
+    }
+    buffer_ = next;
+    head_done_ = head_ok;
+    return head_ok;
+  }
+
+ private:
+  NetDef SubnetDef(const NetDef& net_def, const string& suffix) {
+    NetDef subnet_def;
+    subnet_def.set_name(net_def.name() + suffix);
+    if (net_def.has_type() && net_def.type() != "pipelined") {
+      subnet_def.set_type(net_def.type());
+    }
+    if (net_def.has_num_workers()) {
+      subnet_def.set_num_workers(net_def.num_workers());
+    }
+    if (net_def.has_device_option()) {
+      subnet_def.mutable_device_option()->CopyFrom(net_def.device_option());
+    }
+    for (const auto& arg : net_def.arg()) {
+      // The subnets only see part of the blob lifetimes, so they must not plan
+      // memory on their own.
+      if (arg.name() != "static_memory_planning" && arg.name() != "pipelined") {
+        subnet_def.add_arg()->CopyFrom(arg);
+      }
+    }
+    return subnet_def;
+  }
+
+  static unique_ptr<NetBase> CreateSubnet(const NetDef& net_def, Workspace* ws) {
+    if (!net_def.has_type() || net_def.op_size() == 0) {
+      return make_unique<SimpleNet>(net_def, ws);
+    }
+    return NetRegistry()->Create(net_def.type(), net_def, ws);
+  }
+
+  Workspace* ws_;
+  DeviceOption device_option_;
+  unique_ptr<NetBase> head_[2];
+  unique_ptr<NetBase> tail_[2];
+  bool has_head_;
+  // The buffer used by the iteration that the next Run() finishes.
+  int buffer_ = 0;
+  // Whether the head of that iteration has already run.
+  bool head_done_ = false;
+
+  DISABLE_COPY_AND_ASSIGN(PipelinedNet);
+};
+
+REGISTER_NET(pipelined, PipelinedNet);
+
+} // namespace
+
+} // namespace caffe2
@@ -0,0 +1,206 @@
+#include "caffe2/core/net_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <thread>
+
+#include "caffe2/core/logging.h"
+
+CAFFE2_DEFINE_int(
+    caffe2_net_profile_sample_rate,
+    0,
+    "If positive, every net times on average one in this many operator "
+    "runs, and keeps per-operator counts, times and latency percentiles "
+    "(see core/net_profiler.h). This can be overridden per net with the "
+    "profile_sample_rate argument.");
+CAFFE2_DEFINE_string(
+    caffe2_net_profile_perf_events,
+    "",
+    "Comma-separated hardware events, such as cycles, instructions, "
+    "cache_misses, dtlb_misses or branch_misses, that profiled nets count "
+    "in the operator runs they sample (see core/perf_events.h). This can be "
+    "overridden per net with the profile_perf_events argument.");
+
+namespace caffe2 {
+
+constexpr int NetProfiler::kShards;
+constexpr int NetProfiler::kBuckets;
+
+namespace {
+
+// The number of operator runs of the current thread before the next sample.
+thread_local int countdown = 0;
+thread_local uint32_t random_state = 0;
+thread_local int shard = -1;
+std::atomic<int> next_shard(0);
+
+uint32_t NextRandom() {
+  if (!random_state) {
+    random_state = static_cast<uint32_t>(
+        std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+  }
+  // xorshift32
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+// Two buckets per power of two of nanoseconds: the first for [2^e, 1.5 * 2^e)
+// and the second for [1.5 * 2^e, 2^(e+1)).
+int BucketOf(uint64_t ns, int num_buckets) {
+  int exponent = 0;
+  while ((ns >> exponent) > 1) {
+    ++exponent;
+  }
+  const int upper_half = exponent > 0 ? (ns >> (exponent - 1)) & 1 : 0;
+  return std::min(2 * exponent + upper_half, num_buckets - 1);
+}
+
+// The midpoint of a bucket, in microseconds.
+double BucketMidpointUs(int bucket) {
+  const double low = std::ldexp(1.0 + 0.5 * (bucket % 2), bucket / 2);
+  return low * (bucket % 2 ? 7.0 / 6.0 : 1.25) / 1000;
+}
+
+double Percentile(
+    const std::vector<uint64_t>& histogram,
+    uint64_t samples,
+    double fraction) {
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(samples * fraction)));
+  uint64_t seen = 0;
+  for (int b = 0; b < histogram.size(); ++b) {
+    seen += histogram[b];
+    if (seen >= rank) {
+      return BucketMidpointUs(b);
+    }
+  }
+  return 0;
+}
+} // namespace
+
+NetProfiler::NetProfiler(
+    const NetDef& net_def,
+    int sample_rate,
+    const string& perf_events)
+    : sample_rate_(sample_rate) {
+  CAFFE_ENFORCE_GT(sample_rate_, 0);
+  if (!perf_events.empty()) {
+    perf_events_.reset(new PerfEvents(perf_events));
+  }
+  for (const auto& op : net_def.op()) {
+    names_.push_back(
+        op.name().empty() && op.output_size() ? op.output(0) : op.name());
+    types_.push_back(op.type());
+  }
+  // Value-initialized, so the counters start at zero.
+  counters_.reset(new Counters[kShards * names_.size()]());
+}
+
+bool NetProfiler::ShouldSample() {
+  if (--countdown > 0) {
+    return false;
+  }
+  // Gaps uniform in [1, 2 * rate - 1] average the rate.
+  countdown = sample_rate_ > 1 ? 1 + NextRandom() % (2 * sample_rate_ - 1) : 1;
+  return true;
+}
+
+void NetProfiler::Record(
+    int idx,
+    uint64_t ns,
+    const uint64_t* start_events) {
+  if (shard < 0) {
+    shard = next_shard.fetch_add(1, std::memory_order_relaxed) % kShards;
+  }
+  auto& counters = counters_[shard * names_.size() + idx];
+  counters.samples.fetch_add(1, std::memory_order_relaxed);
+  counters.total_ns.fetch_add(ns, std::memory_order_relaxed);
+  counters.histogram[BucketOf(ns, kBuckets)].fetch_add(
+      1, std::memory_order_relaxed);
+  uint64_t end_events[PerfEvents::kMaxEvents];
+  if (!start_events || !perf_events_->Read(end_events)) {
+    return;
+  }
+  counters.event_samples.fetch_add(1, std::memory_order_relaxed);
+  for (int e = 0; e < perf_events_->names().size(); ++e) {
+    counters.events[e].fetch_add(
+        end_events[e] - start_events[e], std::memory_order_relaxed);
+  }
+}
+
+std::vector<OperatorProfile> NetProfiler::Profiles(bool by_type) const {
+  // The operators of every profile.
+  std::vector<std::vector<int>> groups;
+  std::vector<OperatorProfile> profiles;
+  for (int idx = 0; idx < names_.size(); ++idx) {
+    int group = groups.size();
+    if (by_type) {
+      for (int g = 0; g < groups.size(); ++g) {
+        if (profiles[g].type == types_[idx]) {
+          group = g;
+        }
+      }
+    }
+    if (group == groups.size()) {
+      groups.emplace_back();
+      profiles.emplace_back();
+      profiles.back().name = by_type ? types_[idx] : names_[idx];
+      profiles.back().type = types_[idx];
+    }
+    groups[group].push_back(idx);
+  }
+  const int num_events = perf_events_ ? perf_events_->names().size() : 0;
+  std::vector<uint64_t> histogram(kBuckets);
+  for (int g = 0; g < groups.size(); ++g) {
+    auto& profile = profiles[g];
+    uint64_t total_ns = 0;
+    std::vector<uint64_t> events(num_events);
+    std::fill(histogram.begin(), histogram.end(), 0);
+    for (int idx : groups[g]) {
+      for (int s = 0; s < kShards; ++s) {
+        const auto& counters = counters_[s * names_.size() + idx];
+        profile.samples += counters.samples.load(std::memory_order_relaxed);
+        total_ns += counters.total_ns.load(std::memory_order_relaxed);
+        for (int b = 0; b < kBuckets; ++b) {
+          histogram[b] +=
+              counters.histogram[b].load(std::memory_order_relaxed);
+        }
+        profile.event_samples +=
+            counters.event_samples.load(std::memory_order_relaxed);
+        for (int e = 0; e < num_events; ++e) {
+          events[e] += counters.events[e].load(std::memory_order_relaxed);
+        }
+      }
+    }
+    for (int e = 0; e < num_events; ++e) {
+      profile.events.emplace_back(perf_events_->names()[e], events[e]);
+    }
+    if (!profile.samples) {
+      continue;
+    }
+    profile.total_us = total_ns / 1000.0;
+    profile.p50_us = Percentile(histogram, profile.samples, 0.5);
+    profile.p99_us = Percentile(histogram, profile.samples, 0.99);
+  }
+  return profiles;
+}
+
+void NetProfiler::Reset() {
+  for (size_t i = 0; i < kShards * names_.size(); ++i) {
+    auto& counters = counters_[i];
+    counters.samples.store(0, std::memory_order_relaxed);
+    counters.total_ns.store(0, std::memory_order_relaxed);
+    for (int b = 0; b < kBuckets; ++b) {
+      counters.histogram[b].store(0, std::memory_order_relaxed);
+    }
+    counters.event_samples.store(0, std::memory_order_relaxed);
+    for (int e = 0; e < PerfEvents::kMaxEvents; ++e) {
+      counters.events[e].store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+}  // namespace caffe2
@@ -0,0 +1,123 @@
+#ifndef CAFFE2_CORE_NET_PROFILER_H_
+#define CAFFE2_CORE_NET_PROFILER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/flags.h"
+#include "caffe2/core/perf_events.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+CAFFE2_DECLARE_int(caffe2_net_profile_sample_rate);
+CAFFE2_DECLARE_string(caffe2_net_profile_perf_events);
+
+namespace caffe2 {
+
+/**
+ * The sampled timings of one operator of a net, or of all the operators of a
+ * type, in microseconds. The percentiles come from a histogram with two
+ * buckets per power of two, so they are only accurate to within a quarter or
+ * so.
+ */
+struct OperatorProfile {
+  string name;
+  string type;
+  uint64_t samples = 0;
+  double total_us = 0;
+  double p50_us = 0;
+  double p99_us = 0;
+  // The totals of the perf events that the net counts, if any, over the
+  // `event_samples` samples that could count them. See PerfEvents.
+  std::vector<std::pair<string, uint64_t>> events;
+  uint64_t event_samples = 0;
+};
+
+/**
+ * NetProfiler times a sample of the operator runs of a net, at a cost low
+ * enough to leave it on in production: an operator run that is not sampled
+ * only costs a thread-local countdown, and a sampled one two clock reads and
+ * a few relaxed atomic adds to counters sharded by thread, so that threads
+ * running the same net do not contend.
+ *
+ * On average one in `sample_rate` operator runs of every thread is timed,
+ * with randomized gaps so that the samples do not lock onto a period of the
+ * net. Operators that run asynchronously are timed until they return, which
+ * does not include the work they left on the device.
+ *
+ * Given `perf_events`, a comma-separated list of PerfEvents names such as
+ * "cycles,instructions,cache_misses,dtlb_misses", sampled runs also count
+ * these hardware events on the thread that runs the operator, at the cost of
+ * two more system calls per sample.
+ */
+class NetProfiler {
+ public:
+  NetProfiler(
+      const NetDef& net_def,
+      int sample_rate,
+      const string& perf_events = "");
+
+  // Runs `run`, which runs the operator at `idx` and returns whether it
+  // succeeded, and times it if it is sampled.
+  template <typename Run>
+  inline bool Profile(int idx, Run run) {
+    if (!ShouldSample()) {
+      return run();
+    }
+    uint64_t start_events[PerfEvents::kMaxEvents];
+    const bool counting = perf_events_ && perf_events_->Read(start_events);
+    const auto start = std::chrono::steady_clock::now();
+    const bool success = run();
+    Record(
+        idx,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count(),
+        counting ? start_events : nullptr);
+    return success;
+  }
+
+  // A snapshot of the profiles of all operators, in the order of the net, or
+  // if `by_type`, of all operator types, in the order they first appear in.
+  std::vector<OperatorProfile> Profiles(bool by_type = false) const;
+  void Reset();
+
+  int sample_rate() const {
+    return sample_rate_;
+  }
+
+ private:
+  static constexpr int kShards = 8;
+  static constexpr int kBuckets = 80;
+
+  struct Counters {
+    std::atomic<uint64_t> samples;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint32_t> histogram[kBuckets];
+    std::atomic<uint64_t> event_samples;
+    std::atomic<uint64_t> events[PerfEvents::kMaxEvents];
+  };
+
+  bool ShouldSample();
+  // `start_events` are the perf event counts before the run, or nullptr if
+  // they are not counted.
+  void Record(int idx, uint64_t ns, const uint64_t* start_events);
+
+  const int sample_rate_;
+  std::unique_ptr<PerfEvents> perf_events_;
+  std::vector<string> names_;
+  std::vector<string> types_;
+  // The counters of operator idx in shard s are at s * names_.size() + idx,
+  // so that every thread writes to a block of its own.
+  std::unique_ptr<Counters[]> counters_;
+
+  DISABLE_COPY_AND_ASSIGN(NetProfiler);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_NET_PROFILER_H_
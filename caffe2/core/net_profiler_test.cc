@@ -0,0 +1,161 @@
+#include <chrono>
+#include <thread>
+
+#include <google/protobuf/text_format.h>
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Sleeps for the given number of microseconds.
+class NetProfilerTestSleepOp final : public OperatorBase {
+ public:
+  NetProfilerTestSleepOp(const OperatorDef& def, Workspace* ws)
+      : OperatorBase(def, ws),
+        us_(OperatorBase::GetSingleArgument<int>("us", 0)) {}
+
+  bool Run() override {
+    std::this_thread::sleep_for(std::chrono::microseconds(us_));
+    return true;
+  }
+
+ private:
+  const int us_;
+};
+
+REGISTER_CPU_OPERATOR(NetProfilerTestSleep, NetProfilerTestSleepOp);
+OPERATOR_SCHEMA(NetProfilerTestSleep).NumInputs(0, 1).NumOutputs(0, 1);
+
+const char* netSpec = R"DOC(
+        name: "profiled"
+        op {
+          name: "fast"
+          output: "a"
+          type: "NetProfilerTestSleep"
+        }
+        op {
+          input: "a"
+          output: "b"
+          type: "NetProfilerTestSleep"
+          arg {
+            name: "us"
+            i: 2000
+          }
+        }
+)DOC";
+
+NetDef netDef(const string& type, int sample_rate) {
+  NetDef def;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(netSpec, &def));
+  def.set_type(type);
+  if (sample_rate) {
+    auto* arg = def.add_arg();
+    arg->set_name("profile_sample_rate");
+    arg->set_i(sample_rate);
+  }
+  return def;
+}
+} // namespace
+
+TEST(NetProfilerTest, ProfilesEveryRunAtRateOne) {
+  for (const string type : {"simple", "dag"}) {
+    Workspace ws;
+    auto* net = ws.CreateNet(netDef(type, 1));
+    ASSERT_NE(net, nullptr);
+    for (int i = 0; i < 5; ++i) {
+      ASSERT_TRUE(net->Run());
+    }
+    const auto profiles = ws.NetOperatorProfiles("profiled");
+    ASSERT_EQ(profiles.size(), 2);
+    EXPECT_EQ(profiles[0].name, "fast");
+    EXPECT_EQ(profiles[1].name, "b");
+    EXPECT_EQ(profiles[1].type, "NetProfilerTestSleep");
+    for (const auto& profile : profiles) {
+      EXPECT_EQ(profile.samples, 5);
+      EXPECT_LE(profile.p50_us, profile.p99_us);
+    }
+    EXPECT_GE(profiles[1].total_us, 5 * 2000);
+    // Within the precision of the histogram.
+    EXPECT_GE(profiles[1].p50_us, 2000 * 0.75);
+    EXPECT_LT(profiles[0].p99_us, profiles[1].p50_us);
+
+    net->ResetOperatorProfiles();
+    EXPECT_EQ(net->OperatorProfiles()[1].samples, 0);
+  }
+}
+
+TEST(NetProfilerTest, SamplesAtTheGivenRate) {
+  Workspace ws;
+  auto def = netDef("simple", 4);
+  def.mutable_op(1)->clear_arg();
+  auto* net = ws.CreateNet(def);
+  ASSERT_NE(net, nullptr);
+  const int runs = 2000;
+  for (int i = 0; i < runs; ++i) {
+    ASSERT_TRUE(net->Run());
+  }
+  uint64_t samples = 0;
+  for (const auto& profile : net->OperatorProfiles()) {
+    samples += profile.samples;
+  }
+  EXPECT_GT(samples, 2 * runs / 4 * 0.8);
+  EXPECT_LT(samples, 2 * runs / 4 * 1.2);
+}
+
+TEST(NetProfilerTest, AggregatesByType) {
+  Workspace ws;
+  auto* net = ws.CreateNet(netDef("simple", 1));
+  ASSERT_NE(net, nullptr);
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(net->Run());
+  }
+  const auto profiles = ws.NetOperatorProfiles("profiled");
+  const auto type_profiles = ws.NetOperatorProfiles("profiled", true);
+  ASSERT_EQ(type_profiles.size(), 1);
+  EXPECT_EQ(type_profiles[0].name, "NetProfilerTestSleep");
+  // The countdown to the next sample of the thread may be left over from an
+  // earlier net, so the first runs may not be sampled.
+  EXPECT_GT(type_profiles[0].samples, 0);
+  EXPECT_EQ(
+      type_profiles[0].samples, profiles[0].samples + profiles[1].samples);
+  EXPECT_DOUBLE_EQ(
+      type_profiles[0].total_us, profiles[0].total_us + profiles[1].total_us);
+}
+
+TEST(NetProfilerTest, CountsPerfEvents) {
+  auto def = netDef("simple", 1);
+  auto* arg = def.add_arg();
+  arg->set_name("profile_perf_events");
+  arg->set_s("instructions,cycles");
+  Workspace ws;
+  auto* net = ws.CreateNet(def);
+  ASSERT_NE(net, nullptr);
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(net->Run());
+  }
+  for (const auto& profile : net->OperatorProfiles()) {
+    ASSERT_EQ(profile.events.size(), 2);
+    EXPECT_EQ(profile.events[0].first, "instructions");
+    EXPECT_EQ(profile.events[1].first, "cycles");
+    // Hardware events are not available everywhere, such as in most VMs.
+    if (profile.event_samples) {
+      EXPECT_EQ(profile.event_samples, profile.samples);
+      EXPECT_GT(profile.events[0].second, 0);
+    }
+  }
+  EXPECT_ANY_THROW(PerfEvents("instructions,no_such_event"));
+}
+
+TEST(NetProfilerTest, OffByDefault) {
+  Workspace ws;
+  auto* net = ws.CreateNet(netDef("simple", 0));
+  ASSERT_NE(net, nullptr);
+  ASSERT_TRUE(net->Run());
+  EXPECT_TRUE(net->OperatorProfiles().empty());
+}
+
+}  // namespace caffe2
@@ -250,6 +250,52 @@ TEST(NetTest, ChainingForFork) {
   checkChainingAndRun(spec, {{0, {0}}, {1, {1}}, {2, {2}}});
 }
 
+// A cheap op that fans out ends the chain of its producer instead of getting a
+// chain of its own.
+TEST(NetTest, ChainingForForkWithOpCosts) {
+  const auto spec = R"DOC(
+        name: "example"
+        type: "dag"
+        external_input: "in"
+        arg {
+          name: "cost_based_chaining"
+          i: 1
+        }
+        arg {
+          name: "cheap_op_cost"
+          f: 5
+        }
+        arg {
+          name: "op_costs"
+          floats: 10
+          floats: 1
+          floats: 10
+          floats: 10
+        }
+        op {
+          input: "in"
+          output: "hidden"
+          type: "NetTestDummy"
+        }
+        op {
+          input: "hidden"
+          output: "hidden2"
+          type: "NetTestDummy"
+        }
+        op {
+          input: "hidden2"
+          output: "out1"
+          type: "NetTestDummy"
+        }
+        op {
+          input: "hidden2"
+          output: "out2"
+          type: "NetTestDummy"
+        }
+)DOC";
+  checkChainingAndRun(spec, {{0, {0, 1}}, {2, {2}}, {3, {3}}});
+}
+
 // TEST(NetTest, ChainingForJoinWithAncestor) {
 //   const auto spec = R"DOC(
 //         name: "example"
@@ -559,4 +605,223 @@ TEST(NetTest, ChainingForHogwildModel) {
   checkNumChainsAndRun(spec, 2);
 }
 
+namespace {
+// Counts how often the operators of a net switch to and wait for the device.
+static int device_switches;
+static int device_finishes;
+
+class CountingContext {
+ public:
+  explicit CountingContext(const DeviceOption& /* unused */) {}
+  void SwitchToDevice() {
+    ++device_switches;
+  }
+  bool FinishDeviceComputation() {
+    ++device_finishes;
+    return true;
+  }
+};
+
+class NetTestCountingOp final : public Operator<CountingContext> {
+ public:
+  using Operator<CountingContext>::Operator;
+  bool RunOnDevice() override {
+    counter.fetch_add(1);
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(NetTestCounting, NetTestCountingOp);
+OPERATOR_SCHEMA(NetTestCounting).NumInputs(0, INT_MAX).NumOutputs(0, INT_MAX);
+
+const char kCountingNetDefString[] =
+"  name: \"counting\""
+"  op { output: \"a\" type: \"NetTestCounting\" }"
+"  op { input: \"a\" output: \"b\" type: \"NetTestCounting\" }"
+"  op { input: \"b\" output: \"c\" type: \"NetTestCounting\" }";
+
+void CheckDeviceCalls(bool batched, int switches, int finishes) {
+  NetDef net_def;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(
+      kCountingNetDefString, &net_def));
+  auto* arg = net_def.add_arg();
+  arg->set_name("batched_dispatch");
+  arg->set_i(batched);
+  Workspace ws;
+  unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+  counter = 0;
+  device_switches = 0;
+  device_finishes = 0;
+  ASSERT_TRUE(net->Run());
+  EXPECT_EQ(counter, 3);
+  EXPECT_EQ(device_switches, switches);
+  EXPECT_EQ(device_finishes, finishes);
+}
+} // namespace
+
+TEST(NetTest, SimpleNetDispatch) {
+  CheckDeviceCalls(false, 3, 3);
+}
+
+TEST(NetTest, SimpleNetBatchedDispatch) {
+  CheckDeviceCalls(true, 1, 1);
+}
+
+namespace {
+std::mutex run_order_mutex;
+vector<string> run_order;
+
+// Records the order in which the operators of a net run, by name.
+class NetTestOrderOp final : public OperatorBase {
+ public:
+  using OperatorBase::OperatorBase;
+  bool Run() override {
+    std::lock_guard<std::mutex> guard(run_order_mutex);
+    run_order.push_back(def().name());
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(NetTestOrder, NetTestOrderOp);
+OPERATOR_SCHEMA(NetTestOrder).NumInputs(0, INT_MAX).NumOutputs(0, INT_MAX);
+
+vector<string> runAndGetOrder(const char* spec) {
+  NetDef net_def;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(spec, &net_def));
+  Workspace ws;
+  std::unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+  run_order.clear();
+  CAFFE_ENFORCE(net->Run());
+  return run_order;
+}
+} // namespace
+
+TEST(NetTest, PrioritizedSchedulingCriticalPath) {
+  const auto spec = R"DOC(
+        name: "example"
+        type: "dag"
+        arg { name: "prioritized_scheduling" i: 1 }
+        op { output: "a" name: "short" type: "NetTestOrder" }
+        op { output: "b" name: "long1" type: "NetTestOrder" }
+        op { input: "b" output: "c" name: "long2" type: "NetTestOrder" }
+)DOC";
+  EXPECT_EQ(runAndGetOrder(spec), (vector<string>{"long1", "long2", "short"}));
+}
+
+TEST(NetTest, PrioritizedSchedulingPriorityArgument) {
+  // The priority of "comm" is inherited by "grad", which feeds it.
+  const auto spec = R"DOC(
+        name: "example"
+        type: "dag"
+        arg { name: "prioritized_scheduling" i: 1 }
+        op { output: "a" name: "long1" type: "NetTestOrder" }
+        op { input: "a" output: "b" name: "long2" type: "NetTestOrder" }
+        op { input: "b" output: "c" name: "long3" type: "NetTestOrder" }
+        op { output: "g" name: "grad" type: "NetTestOrder" }
+        op {
+          input: "g" output: "g_reduced" name: "comm" type: "NetTestOrder"
+          arg { name: "priority" f: 1 }
+        }
+)DOC";
+  NetDef net_def;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(spec, &net_def));
+  Workspace ws;
+  std::unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+  auto* dag = dynamic_cast_if_rtti<DAGNetBase*>(net.get());
+  CHECK_NOTNULL(dag);
+  const auto& priorities = dag->TEST_chain_priorities();
+  EXPECT_GT(priorities[3], priorities[0]);
+  EXPECT_EQ(runAndGetOrder(spec)[0], "grad");
+}
+
+namespace {
+// Writes the bool of its "value" argument to its output.
+class NetTestConditionOp final : public OperatorBase {
+ public:
+  using OperatorBase::OperatorBase;
+  bool Run() override {
+    auto* output = Output<TensorCPU>(0);
+    output->Resize(1);
+    output->mutable_data<bool>()[0] = GetSingleArgument<int>("value", 0);
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(NetTestCondition, NetTestConditionOp);
+OPERATOR_SCHEMA(NetTestCondition).NumInputs(0).NumOutputs(1);
+
+// The second stage of the cascade only runs if the first one keeps
+// something, and "last" always runs.
+NetDef cascadeNet(const string& type, bool keep) {
+  NetDef net_def;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(
+      R"DOC(
+        name: "cascade"
+        op { output: "keep" name: "first" type: "NetTestCondition" }
+        op {
+          input: "x" output: "y" name: "second" type: "NetTestOrder"
+          arg { name: "run_if" s: "keep" }
+        }
+        op {
+          input: "y" output: "z" name: "third" type: "NetTestOrder"
+          arg { name: "run_if" s: "keep" }
+        }
+        op { output: "w" name: "last" type: "NetTestOrder" }
+)DOC",
+      &net_def));
+  net_def.set_type(type);
+  auto* arg = net_def.mutable_op(0)->add_arg();
+  arg->set_name("value");
+  arg->set_i(keep);
+  return net_def;
+}
+} // namespace
+
+TEST(NetTest, RunIfSkipsOperators) {
+  for (const string type : {"simple", "dag"}) {
+    for (bool keep : {false, true}) {
+      Workspace ws;
+      ws.CreateBlob("x");
+      std::unique_ptr<NetBase> net(CreateNet(cascadeNet(type, keep), &ws));
+      for (int i = 0; i < 2; ++i) {
+        run_order.clear();
+        ASSERT_TRUE(net->Run());
+        std::sort(run_order.begin(), run_order.end());
+        const vector<string> expected = keep
+            ? vector<string>{"last", "second", "third"}
+            : vector<string>{"last"};
+        EXPECT_EQ(run_order, expected) << type;
+      }
+    }
+  }
+}
+
+TEST(NetTest, RunIfBatchedDispatch) {
+  NetDef net_def;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(
+      R"DOC(
+        name: "counting"
+        arg { name: "batched_dispatch" i: 1 }
+        op { output: "keep" type: "NetTestCondition" }
+        op { output: "a" type: "NetTestCounting" }
+        op {
+          input: "a" output: "b" type: "NetTestCounting"
+          arg { name: "run_if" s: "keep" }
+        }
+        op { input: "a" output: "c" type: "NetTestCounting" }
+)DOC",
+      &net_def));
+  Workspace ws;
+  unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+  counter = 0;
+  device_switches = 0;
+  device_finishes = 0;
+  ASSERT_TRUE(net->Run());
+  EXPECT_EQ(counter, 2);
+  // The skipped operator is a batch of its own, so the operator before it
+  // still waits for the device, and the one after it switches to it.
+  EXPECT_EQ(device_switches, 1);
+  EXPECT_EQ(device_finishes, 2);
+}
+
 } // namespace caffe2
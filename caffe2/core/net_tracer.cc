@@ -0,0 +1,289 @@
+#include "caffe2/core/net_tracer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+
+CAFFE2_DEFINE_string(
+    caffe2_trace_path,
+    "/tmp/caffe2_trace.json",
+    "The file that traces requested by SIGUSR2 are written to, as Chrome "
+    "trace JSON. See core/net_tracer.h.");
+CAFFE2_DEFINE_int(
+    caffe2_trace_runs,
+    10,
+    "The number of top-level net runs that a trace requested by SIGUSR2 "
+    "covers.");
+CAFFE2_DEFINE_bool(
+    caffe2_trace_on_sigusr2,
+    false,
+    "If set, SIGUSR2 starts a trace of the next --caffe2_trace_runs net "
+    "runs, written to --caffe2_trace_path.");
+
+namespace caffe2 {
+
+std::atomic<bool> NetTracer::active_(false);
+thread_local NetTracer::Buffer* NetTracer::thread_buffer_ = nullptr;
+
+namespace {
+
+// The depth of the net runs of the current thread, to count the outermost
+// ones only.
+thread_local int run_depth = 0;
+
+const std::chrono::steady_clock::time_point kEpoch =
+    std::chrono::steady_clock::now();
+
+// Track ids of named tracks start after those of threads.
+constexpr int kFirstTrackId = 100000;
+
+void WriteJSONString(std::ostream& out, const string& value) {
+  out << '"';
+  for (char c : value) {
+    switch (c) {
+      case '"':
+        out << "\\\"";
+        break;
+      case '\\':
+        out << "\\\\";
+        break;
+      case '\n':
+        out << "\\n";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out << escaped;
+        } else {
+          out << c;
+        }
+    }
+  }
+  out << '"';
+}
+
+void WriteThreadName(std::ostream& out, int tid, const string& name) {
+  out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << tid
+      << ",\"args\":{\"name\":";
+  WriteJSONString(out, name);
+  out << "}}";
+}
+} // namespace
+
+NetTracer* NetTracer::Get() {
+  // Leaked on purpose, since nets may still run at exit.
+  static NetTracer* tracer = new NetTracer();
+  return tracer;
+}
+
+double NetTracer::NowUs() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - kEpoch)
+      .count();
+}
+
+bool NetTracer::Start(const string& path, int num_runs) {
+  CAFFE_ENFORCE_GT(num_runs, 0);
+  std::lock_guard<std::mutex> guard(control_mutex_);
+  if (active_) {
+    return false;
+  }
+  LOG(INFO) << "Tracing the next " << num_runs << " net runs into " << path;
+  path_ = path;
+  remaining_runs_ = num_runs;
+  active_ = true;
+  return true;
+}
+
+void NetTracer::Stop() {
+  std::lock_guard<std::mutex> guard(control_mutex_);
+  if (!active_.exchange(false)) {
+    return;
+  }
+  // Spans that end after this point are dropped, since the tracer is not
+  // active anymore when they are recorded.
+  std::vector<Event> events;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& buffer : buffers_) {
+      std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+      for (auto& event : buffer->events) {
+        events.push_back(std::move(event));
+      }
+      buffer->events.clear();
+    }
+    for (auto& event : track_events_) {
+      events.push_back(std::move(event));
+    }
+    track_events_.clear();
+  }
+  Write(path_, events);
+}
+
+void NetTracer::Request() {
+  requested_ = true;
+}
+
+void NetTracer::Write(const string& path, const std::vector<Event>& events) {
+  std::ofstream out(path, std::ofstream::out | std::ofstream::trunc);
+  if (!out.good()) {
+    LOG(ERROR) << "Failed to open trace file " << path;
+    return;
+  }
+  out << "{\"traceEvents\":[";
+  bool first = true;
+  auto separate = [&out, &first]() {
+    if (!first) {
+      out << ",\n";
+    }
+    first = false;
+  };
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& buffer : buffers_) {
+      separate();
+      WriteThreadName(
+          out, buffer->tid, "thread " + caffe2::to_string(buffer->tid));
+    }
+    for (const auto& track : tracks_) {
+      separate();
+      WriteThreadName(out, track.second, track.first);
+    }
+  }
+  for (const auto& event : events) {
+    separate();
+    out << "{\"name\":";
+    WriteJSONString(out, event.name);
+    out << ",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"pid\":0"
+        << ",\"tid\":" << event.tid << ",\"ts\":" << event.start_us
+        << ",\"dur\":" << event.duration_us << ",\"args\":{\"detail\":";
+    WriteJSONString(out, event.detail);
+    out << "}}";
+  }
+  out << "],\"displayTimeUnit\":\"ms\"}\n";
+  LOG(INFO) << "Wrote " << events.size() << " trace events to " << path;
+}
+
+NetTracer::Buffer* NetTracer::ThreadBuffer() {
+  if (!thread_buffer_) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.emplace_back(new Buffer());
+    thread_buffer_ = buffers_.back().get();
+    thread_buffer_->tid = buffers_.size();
+  }
+  return thread_buffer_;
+}
+
+void NetTracer::AddSpan(
+    const char* category,
+    const string& name,
+    const string& detail,
+    double start_us,
+    double end_us) {
+  if (!Active()) {
+    return;
+  }
+  Buffer* buffer = ThreadBuffer();
+  std::lock_guard<std::mutex> lock(buffer->mutex);
+  buffer->events.push_back(
+      Event{category, name, detail, start_us, end_us - start_us, buffer->tid});
+}
+
+void NetTracer::AddTrackSpan(
+    const string& track,
+    const char* category,
+    const string& name,
+    const string& detail,
+    double start_us,
+    double end_us) {
+  if (!Active()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = tracks_.find(track);
+  if (it == tracks_.end()) {
+    it = tracks_.emplace(track, kFirstTrackId + tracks_.size()).first;
+  }
+  track_events_.push_back(
+      Event{category, name, detail, start_us, end_us - start_us, it->second});
+}
+
+bool NetTracer::BeginRun() {
+  if (++run_depth > 1) {
+    return false;
+  }
+  if (requested_.load(std::memory_order_relaxed) &&
+      requested_.exchange(false)) {
+    Start(FLAGS_caffe2_trace_path, FLAGS_caffe2_trace_runs);
+  }
+  return Active();
+}
+
+void NetTracer::EndRun() {
+  if (--remaining_runs_ == 0) {
+    Stop();
+  }
+}
+
+NetTraceRunScope::NetTraceRunScope(const string& net_name)
+    : net_name_(net_name) {
+  traced_ = NetTracer::Get()->BeginRun();
+  if (traced_) {
+    start_us_ = NetTracer::NowUs();
+  }
+}
+
+NetTraceRunScope::~NetTraceRunScope() {
+  --run_depth;
+  if (traced_) {
+    auto* tracer = NetTracer::Get();
+    tracer->AddSpan("net", net_name_, "", start_us_, NetTracer::NowUs());
+    tracer->EndRun();
+  }
+}
+
+namespace {
+
+#ifndef _WIN32
+void HandleSIGUSR2(int /* unused */) {
+  NetTracer::Get()->Request();
+}
+#endif
+
+bool Caffe2InstallTraceSignalHandler(int*, char***) {
+  if (!FLAGS_caffe2_trace_on_sigusr2) {
+    return true;
+  }
+#ifndef _WIN32
+  // Created up front, since Get() is not safe to call from the handler the
+  // first time.
+  NetTracer::Get();
+  struct sigaction sa;
+  sa.sa_handler = &HandleSIGUSR2;
+  sa.sa_flags = SA_RESTART;
+  sigfillset(&sa.sa_mask);
+  if (sigaction(SIGUSR2, &sa, nullptr) == -1) {
+    LOG(ERROR) << "Cannot install the SIGUSR2 handler for tracing.";
+  }
+#else
+  LOG(WARNING) << "Tracing on a signal is not supported on Windows.";
+#endif
+  return true;
+}
+
+} // namespace
+
+REGISTER_CAFFE2_INIT_FUNCTION(
+    Caffe2InstallTraceSignalHandler,
+    &Caffe2InstallTraceSignalHandler,
+    "Install the SIGUSR2 handler that starts a net trace if requested.");
+
+}  // namespace caffe2
@@ -0,0 +1,139 @@
+#ifndef CAFFE2_CORE_NET_TRACER_H_
+#define CAFFE2_CORE_NET_TRACER_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/flags.h"
+
+CAFFE2_DECLARE_string(caffe2_trace_path);
+CAFFE2_DECLARE_int(caffe2_trace_runs);
+CAFFE2_DECLARE_bool(caffe2_trace_on_sigusr2);
+
+namespace caffe2 {
+
+/**
+ * NetTracer captures a timeline of a few net runs and writes it as Chrome
+ * trace JSON, which chrome://tracing and Perfetto open as is. It records:
+ *
+ *   - every top-level net run, counted by NetTraceRunScope;
+ *   - the start and end of every operator, on the thread that ran it, with
+ *     all-reduce operators in a category of their own;
+ *   - for DAG nets, the time every chain waited to be picked up after it
+ *     became ready;
+ *   - for async_dag nets, the device time of the operators on every GPU
+ *     stream, from CUDA events.
+ *
+ * A trace is started by Start(), by the StartNetTrace operator, or, with
+ * --caffe2_trace_on_sigusr2, by sending the process SIGUSR2. It covers the
+ * next given number of top-level net runs, after which it is written to its
+ * file. While no trace is in progress, tracing costs one relaxed atomic load
+ * per operator run.
+ */
+class NetTracer {
+ public:
+  static NetTracer* Get();
+
+  // Traces the next `num_runs` top-level net runs, and writes the trace to
+  // `path` once they are done. Returns false, doing nothing, if a trace is
+  // in progress already.
+  bool Start(const string& path, int num_runs);
+  // Ends the trace in progress, if any, and writes it out.
+  void Stop();
+  // Asks for a trace of --caffe2_trace_runs runs into --caffe2_trace_path,
+  // starting with the next top-level net run. Only sets a flag, so that it
+  // can be called from a signal handler.
+  void Request();
+
+  static inline bool Active() {
+    return active_.load(std::memory_order_relaxed);
+  }
+  // The clock of the trace, in microseconds.
+  static double NowUs();
+
+  // Records a span on the track of the current thread. `detail` shows up in
+  // the arguments of the span.
+  void AddSpan(
+      const char* category,
+      const string& name,
+      const string& detail,
+      double start_us,
+      double end_us);
+  // Records a span on a track of its own, such as a GPU stream.
+  void AddTrackSpan(
+      const string& track,
+      const char* category,
+      const string& name,
+      const string& detail,
+      double start_us,
+      double end_us);
+
+ private:
+  friend class NetTraceRunScope;
+
+  struct Event {
+    const char* category;
+    string name;
+    string detail;
+    double start_us;
+    double duration_us;
+    int tid;
+  };
+  struct Buffer {
+    // Only contended while the trace is written.
+    std::mutex mutex;
+    std::vector<Event> events;
+    int tid;
+  };
+
+  NetTracer() {}
+  // Returns whether the run is traced.
+  bool BeginRun();
+  void EndRun();
+  Buffer* ThreadBuffer();
+  void Write(const string& path, const std::vector<Event>& events);
+
+  static std::atomic<bool> active_;
+  static thread_local Buffer* thread_buffer_;
+  std::atomic<bool> requested_{false};
+
+  // Guards starting and stopping traces.
+  std::mutex control_mutex_;
+  string path_;
+  std::atomic<int> remaining_runs_{0};
+
+  // Guards the members below.
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+  std::vector<Event> track_events_;
+  std::map<string, int> tracks_;
+
+  DISABLE_COPY_AND_ASSIGN(NetTracer);
+};
+
+/**
+ * Marks a top-level net run, such as one by Workspace::RunNet or by a
+ * Predictor. Runs nested in it, such as those of the step nets of recurrent
+ * operators, are traced as part of it and do not count as runs of their own.
+ */
+class NetTraceRunScope {
+ public:
+  explicit NetTraceRunScope(const string& net_name);
+  ~NetTraceRunScope();
+
+ private:
+  const string& net_name_;
+  bool traced_ = false;
+  double start_us_ = 0;
+
+  DISABLE_COPY_AND_ASSIGN(NetTraceRunScope);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_NET_TRACER_H_
@@ -0,0 +1,112 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <google/protobuf/text_format.h>
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+class NetTracerTestOp final : public OperatorBase {
+ public:
+  using OperatorBase::OperatorBase;
+
+  bool Run() override {
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(NetTracerTest, NetTracerTestOp);
+REGISTER_CPU_OPERATOR(NetTracerTestAllreduce, NetTracerTestOp);
+OPERATOR_SCHEMA(NetTracerTest).NumInputs(0, 1).NumOutputs(0, 1);
+OPERATOR_SCHEMA(NetTracerTestAllreduce).NumInputs(0, 1).NumOutputs(0, 1);
+
+const char* netSpec = R"DOC(
+        name: "traced"
+        op {
+          output: "a"
+          type: "NetTracerTest"
+        }
+        op {
+          input: "a"
+          output: "b"
+          type: "NetTracerTestAllreduce"
+        }
+)DOC";
+
+NetDef netDef(const string& type) {
+  NetDef def;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(netSpec, &def));
+  def.set_type(type);
+  return def;
+}
+
+string ReadFile(const string& path) {
+  std::ifstream in(path);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  return contents.str();
+}
+
+int Count(const string& haystack, const string& needle) {
+  int count = 0;
+  for (size_t pos = haystack.find(needle); pos != string::npos;
+       pos = haystack.find(needle, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+} // namespace
+
+TEST(NetTracerTest, TracesTheGivenNumberOfRuns) {
+  for (const string type : {"simple", "dag"}) {
+    const string path = "net_tracer_test_" + type + ".json";
+    Workspace ws;
+    ASSERT_NE(ws.CreateNet(netDef(type)), nullptr);
+    EXPECT_FALSE(NetTracer::Active());
+    ASSERT_TRUE(NetTracer::Get()->Start(path, 2));
+    EXPECT_FALSE(NetTracer::Get()->Start(path, 2));
+    for (int i = 0; i < 3; ++i) {
+      ASSERT_TRUE(ws.RunNet("traced"));
+    }
+    EXPECT_FALSE(NetTracer::Active());
+
+    const string trace = ReadFile(path);
+    std::remove(path.c_str());
+    EXPECT_EQ(trace.find("{\"traceEvents\":["), 0);
+    EXPECT_EQ(Count(trace, "\"cat\":\"net\""), 2);
+    EXPECT_EQ(
+        Count(trace, "\"name\":\"NetTracerTest\",\"cat\":\"operator\""), 2);
+    EXPECT_EQ(Count(trace, "\"cat\":\"allreduce\""), 2);
+    EXPECT_EQ(Count(trace, "\"cat\":\"operator\""), 2);
+    if (type == "dag") {
+      EXPECT_GT(Count(trace, "\"cat\":\"queue\""), 0);
+    }
+  }
+}
+
+TEST(NetTracerTest, StartedByRequest) {
+  const string path = "net_tracer_test_request.json";
+  const string saved_path = FLAGS_caffe2_trace_path;
+  const int saved_runs = FLAGS_caffe2_trace_runs;
+  FLAGS_caffe2_trace_path = path;
+  FLAGS_caffe2_trace_runs = 1;
+  Workspace ws;
+  ASSERT_NE(ws.CreateNet(netDef("simple")), nullptr);
+  NetTracer::Get()->Request();
+  EXPECT_FALSE(NetTracer::Active());
+  ASSERT_TRUE(ws.RunNet("traced"));
+  EXPECT_FALSE(NetTracer::Active());
+  const string trace = ReadFile(path);
+  std::remove(path.c_str());
+  EXPECT_EQ(Count(trace, "\"cat\":\"net\""), 1);
+  FLAGS_caffe2_trace_path = saved_path;
+  FLAGS_caffe2_trace_runs = saved_runs;
+}
+
+}  // namespace caffe2
@@ -0,0 +1,128 @@
+#include "caffe2/core/numa.h"
+
+#include "caffe2/core/logging.h"
+
+#ifdef CAFFE2_USE_NUMA
+#include <numa.h>
+#include <numaif.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+CAFFE2_DEFINE_bool(
+    caffe2_cpu_numa_enabled,
+    false,
+    "If set, CPU memory is placed on the NUMA node of the allocating thread, "
+    "and nets and executor pool threads with a numa_node_id in their device "
+    "option are bound to that node.");
+
+namespace caffe2 {
+
+#ifdef CAFFE2_USE_NUMA
+
+namespace {
+// The node that the calling thread is bound to, to skip repeated binds.
+thread_local int bound_numa_node_id = -1;
+} // namespace
+
+bool IsNUMAEnabled() {
+  static const bool numa_available_ = numa_available() >= 0;
+  return FLAGS_caffe2_cpu_numa_enabled && numa_available_;
+}
+
+int GetNumNUMANodes() {
+  if (!IsNUMAEnabled()) {
+    return 1;
+  }
+  return numa_num_configured_nodes();
+}
+
+void NUMABind(int numa_node_id) {
+  if (numa_node_id < 0 || !IsNUMAEnabled() ||
+      numa_node_id == bound_numa_node_id) {
+    return;
+  }
+  CAFFE_ENFORCE(
+      numa_node_id <= numa_max_node(),
+      "NUMA node id ",
+      numa_node_id,
+      " is out of range.");
+  struct bitmask* mask = numa_allocate_nodemask();
+  numa_bitmask_setbit(mask, numa_node_id);
+  numa_bind(mask);
+  numa_bitmask_free(mask);
+  bound_numa_node_id = numa_node_id;
+}
+
+int GetNUMANode(const void* ptr) {
+  if (!IsNUMAEnabled()) {
+    return 0;
+  }
+  CAFFE_ENFORCE(ptr);
+  int numa_node = -1;
+  if (get_mempolicy(
+          &numa_node,
+          nullptr,
+          0,
+          const_cast<void*>(ptr),
+          MPOL_F_NODE | MPOL_F_ADDR) != 0) {
+    return -1;
+  }
+  return numa_node;
+}
+
+void NUMAMove(void* ptr, size_t size, int numa_node_id) {
+  if (numa_node_id < 0 || !IsNUMAEnabled()) {
+    return;
+  }
+  CAFFE_ENFORCE(ptr);
+  unsigned long mask = 1UL << numa_node_id;
+  CAFFE_ENFORCE_LT(
+      numa_node_id, sizeof(mask) * 8, "NUMA node id is out of range.");
+  // mbind works on whole pages.
+  const size_t page_size = getpagesize();
+  const size_t offset = reinterpret_cast<size_t>(ptr) % page_size;
+  void* page_start = static_cast<char*>(ptr) - offset;
+  if (mbind(
+          page_start,
+          size + offset,
+          MPOL_BIND,
+          &mask,
+          sizeof(mask) * 8,
+          MPOL_MF_MOVE) != 0) {
+    VLOG(1) << "Could not move memory to NUMA node " << numa_node_id;
+  }
+}
+
+int GetCurrentNUMANode() {
+  if (!IsNUMAEnabled()) {
+    return 0;
+  }
+  return numa_node_of_cpu(sched_getcpu());
+}
+
+#else // CAFFE2_USE_NUMA
+
+bool IsNUMAEnabled() {
+  return false;
+}
+
+int GetNumNUMANodes() {
+  return 1;
+}
+
+void NUMABind(int /* unused */) {}
+
+int GetNUMANode(const void* /* unused */) {
+  return 0;
+}
+
+void NUMAMove(void* /* unused */, size_t /* unused */, int /* unused */) {}
+
+int GetCurrentNUMANode() {
+  return 0;
+}
+
+#endif // CAFFE2_USE_NUMA
+
+}  // namespace caffe2
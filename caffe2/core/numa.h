@@ -0,0 +1,41 @@
+#ifndef CAFFE2_CORE_NUMA_H_
+#define CAFFE2_CORE_NUMA_H_
+
+#include <cstddef>
+
+#include "caffe2/core/flags.h"
+
+CAFFE2_DECLARE_bool(caffe2_cpu_numa_enabled);
+
+namespace caffe2 {
+
+/**
+ * NUMA support. It needs a build with USE_NUMA and libnuma, a machine that
+ * has NUMA, and the --caffe2_cpu_numa_enabled flag. Without any of these, the
+ * functions below act as if there was a single node 0 and do nothing.
+ *
+ * Threads are placed on a node with NUMABind(), typically from the
+ * numa_node_id field of a DeviceOption. The CPU allocator then places new
+ * memory on the node of the allocating thread.
+ */
+bool IsNUMAEnabled();
+
+// Returns the number of NUMA nodes.
+int GetNumNUMANodes();
+
+// Binds the calling thread, and the memory that it allocates, to the given
+// node. A negative node id leaves the thread alone.
+void NUMABind(int numa_node_id);
+
+// Returns the node of the memory page at the given address, or -1 if unknown.
+int GetNUMANode(const void* ptr);
+
+// Moves the memory pages of the given range to the given node.
+void NUMAMove(void* ptr, size_t size, int numa_node_id);
+
+// Returns the node of the CPU that the calling thread runs on.
+int GetCurrentNUMANode();
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_NUMA_H_
@@ -0,0 +1,58 @@
+#include "caffe2/core/context.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/numa.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+TEST(NUMATest, AllocatesOnBoundNode) {
+  FLAGS_caffe2_cpu_numa_enabled = true;
+  EXPECT_GE(GetNumNUMANodes(), 1);
+  if (!IsNUMAEnabled()) {
+    FLAGS_caffe2_cpu_numa_enabled = false;
+    return;
+  }
+  const int node = GetNumNUMANodes() - 1;
+  NUMABind(node);
+  EXPECT_EQ(GetCurrentNUMANode(), node);
+  void* data = CPUContext::New(1 << 20);
+  EXPECT_EQ(GetNUMANode(data), node);
+  CPUContext::Delete(data);
+  FLAGS_caffe2_cpu_numa_enabled = false;
+}
+
+TEST(NUMATest, ExecutorPoolGroupsPerNode) {
+  FLAGS_caffe2_cpu_numa_enabled = true;
+  FLAGS_caffe2_executor_pool_cpu_threads = 0;
+  ExecutorPool pool;
+  DeviceOption cpu;
+  DeviceOption numa;
+  numa.set_numa_node_id(0);
+  // Without NUMA, the node is ignored and both options share the CPU threads.
+  const int expected = IsNUMAEnabled()
+      ? pool.NumThreads(cpu) / GetNumNUMANodes()
+      : pool.NumThreads(cpu);
+  EXPECT_EQ(pool.NumThreads(numa), std::max(1, expected));
+  FLAGS_caffe2_cpu_numa_enabled = false;
+}
+
+TEST(NUMATest, NetsRunOnNode) {
+  FLAGS_caffe2_cpu_numa_enabled = true;
+  for (const char* type : {"simple", "dag"}) {
+    NetDef net_def;
+    net_def.set_type(type);
+    net_def.mutable_device_option()->set_numa_node_id(0);
+    auto* op = net_def.add_op();
+    op->set_type("ConstantFill");
+    op->add_output("out");
+    AddArgument<vector<int>>("shape", vector<int>{1000}, op);
+    Workspace ws;
+    ASSERT_TRUE(ws.RunNetOnce(net_def));
+    EXPECT_EQ(ws.GetBlob("out")->Get<TensorCPU>().size(), 1000);
+  }
+  FLAGS_caffe2_cpu_numa_enabled = false;
+}
+
+}  // namespace caffe2
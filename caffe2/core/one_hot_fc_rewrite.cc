@@ -0,0 +1,175 @@
+#include "caffe2/core/one_hot_fc_rewrite.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+
+namespace caffe2 {
+
+namespace {
+
+bool IsOnCPU(const OperatorDef& op_def, const NetDef& net_def) {
+  const DeviceOption& device = op_def.has_device_option()
+      ? op_def.device_option()
+      : net_def.device_option();
+  return device.device_type() == CPU;
+}
+
+const TensorCPU* GetTensor(Workspace* ws, const string& name) {
+  const Blob* blob = ws->GetBlob(name);
+  return blob && blob->IsType<TensorCPU>() ? &blob->Get<TensorCPU>()
+                                           : nullptr;
+}
+
+// A name based on base that is neither a blob of ws nor already taken.
+string UniqueBlobName(
+    const string& base,
+    Workspace* ws,
+    std::set<string>* taken) {
+  string name = base;
+  for (int i = 1; ws->HasBlob(name) || taken->count(name); ++i) {
+    name = base + "_" + caffe2::to_string(i);
+  }
+  taken->insert(name);
+  return name;
+}
+
+// Whether op_def writes blob.
+bool Writes(const OperatorDef& op_def, const string& blob) {
+  for (const string& output : op_def.output()) {
+    if (output == blob) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+NetDef RewriteOneHotFC(const NetDef& net_def, Workspace* ws) {
+  std::map<string, int> num_reads;
+  std::set<string> blobs;
+  for (const auto& op_def : net_def.op()) {
+    for (const string& input : op_def.input()) {
+      ++num_reads[input];
+      blobs.insert(input);
+    }
+    blobs.insert(op_def.output().begin(), op_def.output().end());
+  }
+  std::set<string> external_outputs(
+      net_def.external_output().begin(), net_def.external_output().end());
+
+  // The index of the OneHot read by each rewritten FC, by index of the FC.
+  std::map<int, int> one_hot_of;
+  std::set<int> removed;
+  for (int i = 0; i < net_def.op_size(); ++i) {
+    const OperatorDef& one_hot = net_def.op(i);
+    if (one_hot.type() != "OneHot" || one_hot.input_size() != 2 ||
+        one_hot.output_size() != 1 || !IsOnCPU(one_hot, net_def)) {
+      continue;
+    }
+    const string& indices = one_hot.input(0);
+    const string& one_hots = one_hot.output(0);
+    if (num_reads[one_hots] != 1 || external_outputs.count(one_hots)) {
+      continue;
+    }
+    // The reader of the one hots, provided that the indices are still the
+    // same when it runs.
+    int j = i + 1;
+    while (j < net_def.op_size() && !Writes(net_def.op(j), indices) &&
+           !Writes(net_def.op(j), one_hots) &&
+           std::find(
+               net_def.op(j).input().begin(),
+               net_def.op(j).input().end(),
+               one_hots) == net_def.op(j).input().end()) {
+      ++j;
+    }
+    if (j == net_def.op_size()) {
+      continue;
+    }
+    const OperatorDef& fc = net_def.op(j);
+    ArgumentHelper fc_args(fc);
+    if (fc.type() != "FC" || fc.input_size() != 3 || fc.output_size() != 1 ||
+        fc.input(0) != one_hots || !IsOnCPU(fc, net_def) ||
+        fc_args.GetSingleArgument<int>("axis", 1) != 1 ||
+        fc.output(0) == indices || fc.output(0) == fc.input(2)) {
+      continue;
+    }
+    const TensorCPU* weights = GetTensor(ws, fc.input(1));
+    if (!weights || !weights->IsType<float>() || weights->ndim() != 2) {
+      continue;
+    }
+    const TensorCPU* index_size = GetTensor(ws, one_hot.input(1));
+    if (index_size &&
+        (!index_size->IsType<int64_t>() || index_size->size() != 1 ||
+         index_size->data<int64_t>()[0] != weights->dim(1))) {
+      continue;
+    }
+    one_hot_of[j] = i;
+    removed.insert(i);
+  }
+
+  NetDef rewritten(net_def);
+  rewritten.clear_op();
+  std::map<string, string> transposed;
+  for (int j = 0; j < net_def.op_size(); ++j) {
+    if (removed.count(j)) {
+      continue;
+    }
+    const OperatorDef& fc = net_def.op(j);
+    auto it = one_hot_of.find(j);
+    if (it == one_hot_of.end()) {
+      rewritten.add_op()->CopyFrom(fc);
+      continue;
+    }
+    const string& weights_name = fc.input(1);
+    string& transposed_name = transposed[weights_name];
+    if (transposed_name.empty()) {
+      transposed_name =
+          UniqueBlobName(weights_name + "_transposed", ws, &blobs);
+      const auto& W = ws->GetBlob(weights_name)->Get<TensorCPU>();
+      const int D = W.dim32(0);
+      const int V = W.dim32(1);
+      auto* W_t = ws->CreateBlob(transposed_name)->GetMutable<TensorCPU>();
+      W_t->Resize(V, D);
+      const float* src = W.data<float>();
+      float* dst = W_t->mutable_data<float>();
+      for (int d = 0; d < D; ++d) {
+        for (int v = 0; v < V; ++v) {
+          dst[v * D + d] = src[d * V + v];
+        }
+      }
+      // Nets that declare their inputs must declare the new parameter too.
+      if (net_def.external_input_size()) {
+        rewritten.add_external_input(transposed_name);
+      }
+    }
+
+    // Y = Gather(W^T, indices); Y += b, in place.
+    const string& output = fc.output(0);
+    auto* gather = rewritten.add_op();
+    gather->set_type("Gather");
+    gather->add_input(transposed_name);
+    gather->add_input(net_def.op(it->second).input(0));
+    gather->add_output(output);
+    auto* add = rewritten.add_op();
+    add->set_type("Add");
+    add->add_input(output);
+    add->add_input(fc.input(2));
+    add->add_output(output);
+    add->add_arg()->CopyFrom(MakeArgument<int>("broadcast", 1));
+    if (fc.has_device_option()) {
+      gather->mutable_device_option()->CopyFrom(fc.device_option());
+      add->mutable_device_option()->CopyFrom(fc.device_option());
+    }
+  }
+  VLOG(1) << "Rewrote " << one_hot_of.size() << " OneHot and FC operators of "
+          << "net " << net_def.name() << " into gathers.";
+  return rewritten;
+}
+
+}  // namespace caffe2
@@ -0,0 +1,32 @@
+#ifndef CAFFE2_CORE_ONE_HOT_FC_REWRITE_H_
+#define CAFFE2_CORE_ONE_HOT_FC_REWRITE_H_
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+
+// Replaces the FullyConnected operators whose input is the output of a OneHot
+// by a Gather of rows of the transposed weights followed by a broadcast Add of
+// the bias, which costs O(N * D) instead of the O(N * V * D) of a GEMM over a
+// mostly zero N x V matrix.
+//
+// FC computes Y = X * W^T + b with W of shape D x V, so the one hot row of
+// index i selects column i of W. The pass writes W^T to a new blob of ws once,
+// shared by all of the FCs with the same weights, and the rewritten net
+// gathers its rows. The original weights are left untouched.
+//
+// Only CPU operators are rewritten, and only when the weights are a 2-D float
+// tensor already present in ws, and the index size of the OneHot is V if it is
+// in ws too. As for FoldConvBatchNorm, the output of the OneHot must be read
+// by the FC only, and must not be an external output of the net.
+//
+// For training, run it after the init net and before adding the gradient
+// operators: the gradient of the Gather is a GradientSlice of the touched rows,
+// so the transposed weights become a sparse parameter that replaces W.
+NetDef RewriteOneHotFC(const NetDef& net_def, Workspace* ws);
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_ONE_HOT_FC_REWRITE_H_
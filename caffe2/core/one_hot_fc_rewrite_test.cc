@@ -0,0 +1,159 @@
+#include <random>
+
+#include "caffe2/core/one_hot_fc_rewrite.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/operator_gradient.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+constexpr int kVocab = 10;
+constexpr int kDim = 4;
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+void AddInt64Tensor(
+    Workspace* ws,
+    const string& name,
+    const vector<int64_t>& values) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(values.size());
+  std::copy(values.begin(), values.end(), tensor->mutable_data<int64_t>());
+}
+
+OperatorDef* AddOp(
+    NetDef* net,
+    const string& type,
+    const vector<string>& inputs,
+    const string& output) {
+  auto* op = net->add_op();
+  op->set_type(type);
+  for (const auto& input : inputs) {
+    op->add_input(input);
+  }
+  op->add_output(output);
+  return op;
+}
+
+// OneHot of the indices followed by an FC, with the parameters in ws.
+NetDef OneHotFCNet(Workspace* ws) {
+  std::mt19937 gen(0);
+  AddInt64Tensor(ws, "indices", {3, 0, 9, 3, 5, 1});
+  AddInt64Tensor(ws, "index_size", {kVocab});
+  AddRandomTensor(ws, "W", {kDim, kVocab}, &gen);
+  AddRandomTensor(ws, "b", {kDim}, &gen);
+  NetDef net;
+  net.set_name("one_hot_fc");
+  AddOp(&net, "OneHot", {"indices", "index_size"}, "one_hots");
+  AddOp(&net, "FC", {"one_hots", "W", "b"}, "Y");
+  net.add_external_output("Y");
+  return net;
+}
+
+void ExpectSameOutput(
+    const NetDef& net,
+    const NetDef& rewritten,
+    Workspace* ws) {
+  for (const string& output : net.external_output()) {
+    ASSERT_TRUE(ws->RunNetOnce(net));
+    TensorCPU expected(ws->GetBlob(output)->Get<TensorCPU>());
+    auto* clobbered = ws->GetBlob(output)->GetMutable<TensorCPU>();
+    clobbered->mutable_data<float>()[0] = -7;
+    ASSERT_TRUE(ws->RunNetOnce(rewritten));
+    const auto& actual = ws->GetBlob(output)->Get<TensorCPU>();
+    ASSERT_EQ(expected.dims(), actual.dims());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_NEAR(expected.data<float>()[i], actual.data<float>()[i], 1e-5);
+    }
+  }
+}
+
+} // namespace
+
+TEST(OneHotFCRewriteTest, RewritesIntoGather) {
+  Workspace ws;
+  const NetDef net = OneHotFCNet(&ws);
+  const NetDef rewritten = RewriteOneHotFC(net, &ws);
+  ASSERT_EQ(rewritten.op_size(), 2);
+  EXPECT_EQ(rewritten.op(0).type(), "Gather");
+  EXPECT_EQ(rewritten.op(0).input(0), "W_transposed");
+  EXPECT_EQ(rewritten.op(0).input(1), "indices");
+  EXPECT_EQ(rewritten.op(1).type(), "Add");
+  EXPECT_EQ(rewritten.op(1).output(0), "Y");
+  const auto& W_t = ws.GetBlob("W_transposed")->Get<TensorCPU>();
+  EXPECT_EQ(W_t.dims(), (vector<TIndex>{kVocab, kDim}));
+  ExpectSameOutput(net, rewritten, &ws);
+  // The original weights are left untouched.
+  EXPECT_EQ(ws.GetBlob("W")->Get<TensorCPU>().dim32(0), kDim);
+}
+
+TEST(OneHotFCRewriteTest, SharesTheTransposedWeights) {
+  Workspace ws;
+  NetDef net = OneHotFCNet(&ws);
+  AddInt64Tensor(&ws, "other_indices", {2, 2, 8});
+  AddOp(&net, "Relu", {"Y"}, "Z");
+  AddOp(&net, "OneHot", {"other_indices", "index_size"}, "other_one_hots");
+  AddOp(&net, "FC", {"other_one_hots", "W", "b"}, "Y2");
+  net.add_external_output("Y2");
+  for (const char* input :
+       {"indices", "index_size", "W", "b", "other_indices"}) {
+    net.add_external_input(input);
+  }
+  const NetDef rewritten = RewriteOneHotFC(net, &ws);
+  ASSERT_EQ(rewritten.op_size(), 5);
+  EXPECT_EQ(rewritten.op(2).type(), "Relu");
+  EXPECT_EQ(rewritten.op(3).input(0), "W_transposed");
+  EXPECT_EQ(rewritten.external_input_size(), 6);
+  EXPECT_EQ(rewritten.external_input(5), "W_transposed");
+  ExpectSameOutput(net, rewritten, &ws);
+}
+
+TEST(OneHotFCRewriteTest, KeepsWhatCannotBeRewritten) {
+  Workspace ws;
+  NetDef net = OneHotFCNet(&ws);
+  // The one hots are read elsewhere.
+  net.add_external_output("one_hots");
+  EXPECT_EQ(RewriteOneHotFC(net, &ws).op(0).type(), "OneHot");
+
+  // The indices change before the FC runs.
+  net = OneHotFCNet(&ws);
+  OperatorDef fc(net.op(1));
+  net.mutable_op()->RemoveLast();
+  AddOp(&net, "Copy", {"b"}, "indices");
+  net.add_op()->CopyFrom(fc);
+  EXPECT_EQ(RewriteOneHotFC(net, &ws).op(0).type(), "OneHot");
+
+  // The weights do not match the index size.
+  net = OneHotFCNet(&ws);
+  AddInt64Tensor(&ws, "index_size", {kVocab + 1});
+  EXPECT_EQ(RewriteOneHotFC(net, &ws).op_size(), 2);
+  EXPECT_EQ(RewriteOneHotFC(net, &ws).op(0).type(), "OneHot");
+}
+
+TEST(OneHotFCRewriteTest, GradientOfTheWeightsIsSparse) {
+  Workspace ws;
+  const NetDef rewritten = RewriteOneHotFC(OneHotFCNet(&ws), &ws);
+  ASSERT_EQ(rewritten.op(0).type(), "Gather");
+  vector<GradientWrapper> g_output(1);
+  g_output[0].dense_ = "Y_grad";
+  const auto meta = GetGradientForOp(rewritten.op(0), g_output);
+  ASSERT_EQ(meta.g_input_.size(), 2);
+  EXPECT_TRUE(meta.g_input_[0].IsSparse());
+  EXPECT_EQ(meta.g_input_[0].indices_, "indices");
+  EXPECT_EQ(meta.g_input_[0].values_, "Y_grad");
+}
+
+} // namespace caffe2
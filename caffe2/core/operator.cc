@@ -2,6 +2,7 @@
 
 #include <algorithm>
 
+#include "caffe2/core/engine_autotuner.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/net.h"
 #include "caffe2/core/operator_gradient.h"
@@ -32,6 +33,32 @@ OperatorBase::OperatorBase(const OperatorDef& operator_def, Workspace* ws)
   for (const string& output_str : operator_def_.output()) {
     outputs_.push_back(CHECK_NOTNULL(ws->CreateBlob(output_str)));
   }
+
+  if (HasArgument(kRunIfArgument)) {
+    // The blob is usually written by an earlier operator of the net.
+    run_if_ = CHECK_NOTNULL(
+        ws->CreateBlob(GetSingleArgument<string>(kRunIfArgument, "")));
+  }
+}
+
+bool OperatorBase::RunIfValue() const {
+  const string& name = GetSingleArgument<string>(kRunIfArgument, "");
+  CAFFE_ENFORCE(
+      run_if_->IsType<TensorCPU>(),
+      "The run_if blob ",
+      name,
+      " of operator ",
+      operator_def_.type(),
+      " is not a CPU tensor.");
+  const auto& condition = run_if_->Get<TensorCPU>();
+  CAFFE_ENFORCE(
+      condition.size() == 1 && condition.IsType<bool>(),
+      "The run_if blob ",
+      name,
+      " of operator ",
+      operator_def_.type(),
+      " must hold a single bool.");
+  return condition.data<bool>()[0];
 }
 
 namespace {
@@ -74,8 +101,44 @@ unique_ptr<OperatorBase> CreateOperator(
                << ". Will skip schema checking.";
   }
 
-  // Second, if the user has provided an engine, try create that engine
-  if (operator_def.engine().size()) {
+  // Second, if the engine is to be autotuned, create every engine that is
+  // registered for the operator, with the default one last.
+  if (AutotunesEngine(operator_def)) {
+    const auto type = operator_def.device_option().device_type();
+    CAFFE_ENFORCE(
+        gDeviceTypeRegistry()->count(type),
+        "Device type ",
+        type,
+        " not registered.");
+    const string prefix = operator_def.type() + "_ENGINE_";
+    EngineAutotuner::Candidates candidates;
+    OperatorDef engine_def(operator_def);
+    for (const string& key : gDeviceTypeRegistry()->at(type)->Keys()) {
+      if (key.compare(0, prefix.size(), prefix) != 0) {
+        continue;
+      }
+      engine_def.set_engine(key.substr(prefix.size()));
+      auto op = TryCreateOperator(key, engine_def, ws);
+      if (op) {
+        candidates.emplace_back(engine_def.engine(), std::move(op));
+      }
+    }
+    engine_def.clear_engine();
+    auto op = TryCreateOperator(operator_def.type(), engine_def, ws);
+    if (op) {
+      candidates.emplace_back(kDefaultEngine, std::move(op));
+    }
+    if (candidates.size() == 1) {
+      return std::move(candidates[0].second);
+    }
+    if (candidates.size() > 1) {
+      return unique_ptr<OperatorBase>(
+          new EngineAutotuner(operator_def, ws, std::move(candidates)));
+    }
+  }
+
+  // Third, if the user has provided an engine, try create that engine
+  if (operator_def.engine().size() && !AutotunesEngine(operator_def)) {
     vector<string> engine_choices = split(',', operator_def.engine());
     for (const string& engine : engine_choices) {
       string key = operator_def.type() + "_ENGINE_" + engine;
@@ -7,6 +7,7 @@
 #include <typeinfo>
 #include <vector>
 
+#include "caffe2/core/arena.h"
 #include "caffe2/core/blob.h"
 #include "caffe2/core/common.h"
 #include "caffe2/core/net.h"
@@ -20,11 +21,22 @@
 
 namespace caffe2 {
 
-class OperatorBase {
+// The argument of an operator that names a blob holding a single bool, which
+// decides whether the nets run the operator (see OperatorBase::ShouldRun).
+constexpr char kRunIfArgument[] = "run_if";
+
+class OperatorBase : public ArenaAllocated {
  public:
   explicit OperatorBase(const OperatorDef& operator_def, Workspace* ws);
   virtual ~OperatorBase() {}
 
+  // Operators are allocated from the arena of the net that creates them, if
+  // the net has one (see core/arena.h).
+  using ArenaAllocated::operator new;
+  static void* operator new(size_t nbytes) {
+    return NewInCurrentArena(nbytes);
+  }
+
   /** @brief Checks if the operator has an argument of the given name.
    */
   inline bool HasArgument(const string& name) const {
@@ -83,6 +95,16 @@ class OperatorBase {
     return outputs_.at(idx)->template IsType<T>();
   }
 
+  // Whether the nets should run the operator. An operator with the run_if
+  // argument only runs when the blob it names, a CPU tensor with a single
+  // bool, is true, so that a net can skip some of its operators, e.g. the
+  // later stages of a cascade that no candidate made it to. A skipped
+  // operator leaves its outputs as they are, so the operators that read them
+  // should be skipped as well.
+  inline bool ShouldRun() const {
+    return !run_if_ || RunIfValue();
+  }
+
   inline int InputSize() { return inputs_.size(); }
   inline int OutputSize() { return outputs_.size(); }
   inline const vector<const Blob*>& Inputs() const { return inputs_; }
@@ -92,6 +114,16 @@ class OperatorBase {
     CAFFE_NOT_IMPLEMENTED;
   }
   virtual bool RunAsync() { return Run(); }
+  // Runs the operator as part of a batch of operators that share the same
+  // device option: the device is switched to only if switch_to_device is set,
+  // and the device computation is waited for only if finish is set, which
+  // also waits for the earlier operators of the batch.
+  virtual bool RunInBatch(bool switch_to_device, bool finish) {
+    return finish ? Run() : RunAsync();
+  }
+  // Selects which of its device's streams the operator runs on, for devices
+  // that have several of them. A no-op for the other devices.
+  virtual void SetStreamId(int stream_id) {}
 
   inline const OperatorDef& def() const {
     return operator_def_;
@@ -100,11 +132,21 @@ class OperatorBase {
     return arg_helper_;
   }
 
+ protected:
+  // Points an output to another blob, for operators that write their outputs
+  // to buffers of their own first (see PrefetchOperator).
+  inline void SetOutputBlob(int idx, Blob* blob) {
+    outputs_.at(idx) = blob;
+  }
+
  private:
+  bool RunIfValue() const;
+
   OperatorDef operator_def_;
   ArgumentHelper arg_helper_;
   vector<const Blob*> inputs_;
   vector<Blob*> outputs_;
+  const Blob* run_if_ = nullptr;
 
   DISABLE_COPY_AND_ASSIGN(OperatorBase);
 };
@@ -137,6 +179,17 @@ class OperatorBase {
   enum _OutputTags { first_input = 0, __VA_ARGS__ }
 
 
+namespace detail {
+// Calls context->set_stream_id() for the contexts that have one.
+template <class Context>
+auto SetContextStreamId(Context* context, int stream_id, int)
+    -> decltype(context->set_stream_id(stream_id)) {
+  context->set_stream_id(stream_id);
+}
+template <class Context>
+void SetContextStreamId(Context* /*context*/, int /*stream_id*/, long) {}
+} // namespace detail
+
 // Operator is the class that you usually want to derive, if your operator will
 // run on different devices. You should then implement the RunOnDevice()
 // function.
@@ -190,6 +243,30 @@ class Operator : public OperatorBase {
     }
   }
 
+  bool RunInBatch(bool switch_to_device, bool finish) final {
+    try {
+      if (switch_to_device) {
+        context_.SwitchToDevice();
+      }
+      bool started = RunOnDevice();
+      if (!finish) {
+        return started;
+      }
+      if (!context_.FinishDeviceComputation()) {
+        LOG(FATAL) << "Computation on device returned error in operator\n"
+                   << ProtoDebugString(this->def());
+      }
+      return started;
+    } catch (EnforceNotMet& err) {
+      err.AppendMessage("Error from operator: \n" + ProtoDebugString(def()));
+      throw;
+    }
+  }
+
+  void SetStreamId(int stream_id) final {
+    detail::SetContextStreamId(&context_, stream_id, 0);
+  }
+
   virtual bool RunOnDevice() = 0;
 
  protected:
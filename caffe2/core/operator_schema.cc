@@ -1,5 +1,7 @@
 #include "caffe2/core/operator_schema.h"
 
+#include <tuple>
+
 #include "caffe2/core/logging.h"
 
 namespace caffe2 {
@@ -71,6 +73,16 @@ bool OpSchema::Verify(const OperatorDef& def) const {
     }
   }
 
+  // Check that only the outputs that allow it accumulate.
+  for (const int out_idx : ArgumentHelper(def).GetRepeatedArgument<int>(
+           kAccumulateOutputsArgument)) {
+    if (!accumulation_allowed_.count(out_idx)) {
+      LOG(ERROR) << "Output idx " << out_idx << " is set to accumulate but "
+                 << "this is not supported by op " << def.type();
+      return false;
+    }
+  }
+
   // Phew. All verifications passed.
   return true;
 }
@@ -161,6 +173,11 @@ OpSchema& OpSchema::EnforceInplace(set<std::pair<int, int>> inplace) {
       });
 }
 
+OpSchema& OpSchema::AllowAccumulation(set<int> outputs) {
+  accumulation_allowed_ = outputs;
+  return *this;
+}
+
 OpSchema& OpSchema::EnforceOneToOneInplace() {
   return EnforceInplace([](int in, int out) { return in == out; });
 }
@@ -171,6 +188,11 @@ OpSchema& OpSchema::TensorInferenceFunction(
   return *this;
 }
 
+OpSchema& OpSchema::CostInferenceFunction(CostInferenceFunctionType function) {
+  cost_inference_function_ = function;
+  return *this;
+}
+
 OpSchema& OpSchema::IdenticalTypeAndShape() {
   return TensorInferenceFunction(
       [](const OperatorDef&, const vector<TensorShape>& input_types) {
@@ -197,7 +219,14 @@ OpSchema& OpSchema::ScalarType(::caffe2::TensorProto_DataType dt) {
      });
 }
 
+OpSchema& OpSchema::SetDoc(const char* doc) {
+  doc_literal_ = doc;
+  doc_.clear();
+  return *this;
+}
+
 OpSchema& OpSchema::SetDoc(const string& doc) {
+  doc_literal_ = nullptr;
   doc_ = doc;
   return *this;
 }
@@ -284,6 +313,34 @@ std::ostream& operator<<(std::ostream& out, const OpSchema& schema) {
   return out;
 }
 
+OpSchema& OpSchemaRegistry::NewSchema(
+    const string& key,
+    const char* file,
+    const int line) {
+  auto result = map().emplace(
+      std::piecewise_construct,
+      std::forward_as_tuple(key),
+      std::forward_as_tuple(file, line));
+  if (!result.second) {
+    const auto& schema = result.first->second;
+    std::cerr << "Trying to register schema with name " << key
+              << " from file " << file << " line " << line
+              << ", but it is already registered from file " << schema.file()
+              << " line " << schema.line();
+    abort();
+  }
+  return result.first->second;
+}
+
+vector<string> OpSchemaRegistry::Keys() {
+  vector<string> keys;
+  keys.reserve(map().size());
+  for (const auto& it : map()) {
+    keys.push_back(it.first);
+  }
+  return keys;
+}
+
 CaffeMap<string, OpSchema>& OpSchemaRegistry::map() {
   static CaffeMap<string, OpSchema> map;
   return map;
@@ -9,11 +9,17 @@
 #include <vector>
 
 #include "caffe2/core/common.h"
+#include "caffe2/core/logging.h"
 #include "caffe2/core/registry.h"
 #include "caffe2/proto/caffe2.pb.h"
+#include "caffe2/utils/proto_utils.h"
 
 namespace caffe2 {
 
+// The argument that lists the outputs an operator adds to, instead of
+// overwriting them; see OpSchema::AllowAccumulation.
+constexpr char kAccumulateOutputsArgument[] = "accumulate_outputs";
+
 // A const value returned by OpSchema::CalculateOutput() if the number of
 // output cannot be determined.
 constexpr int kCannotComputeNumOutputs = -1;
@@ -53,6 +59,9 @@ class OpSchema {
    * @brief Returns the docstring of the op schema.
    */
   inline const char* doc() const {
+    if (doc_literal_) {
+      return doc_literal_;
+    }
     return doc_.empty() ? nullptr : doc_.c_str();
   }
 
@@ -127,6 +136,27 @@ class OpSchema {
   OpSchema& EnforceInplace(std::function<bool(int, int)> inplace);
   OpSchema& EnforceInplace(set<std::pair<int, int>> inplace);
   OpSchema& EnforceOneToOneInplace();
+  // Returns whether output output_id may share the blob of input input_id,
+  // either optionally or because it is enforced.
+  inline bool inplace_allowed(int input_id, int output_id) const {
+    return inplace_allowed_(input_id, output_id) ||
+        inplace_enforced_(input_id, output_id);
+  }
+  inline bool inplace_enforced(int input_id, int output_id) const {
+    return inplace_enforced_(input_id, output_id);
+  }
+
+  // Sets the outputs that the operator adds to, instead of overwriting, when
+  // they are listed in its accumulate_outputs argument. The gradient builder
+  // uses it to accumulate the gradients of a blob read by several operators
+  // in a single buffer, without a Sum.
+  OpSchema& AllowAccumulation(set<int> outputs);
+  inline bool accumulation_allowed(int output_id) const {
+    return accumulation_allowed_.count(output_id) > 0;
+  }
+  const set<int>& accumulation_allowed_outputs() const {
+    return accumulation_allowed_;
+  }
 
   // Functions to deal with type and shape inference. Basically, this registers
   // a function that takes in an OperatorDef and a series of input type and
@@ -158,7 +188,44 @@ class OpSchema {
     return tensor_inference_function_(def, input_type_shape);
   }
 
-  // Functions to do documentation for the operator schema.
+  /**
+   * @brief A struct to store various cost information about an operator, such
+   * as the number of floating point operations and the amount of memory it
+   * reads and writes.
+   */
+  struct Cost {
+    uint64_t flops{0}; // Floating point operations.
+    uint64_t bytes_read{0}; // Bytes of inputs read.
+    uint64_t bytes_written{0}; // Bytes of outputs written.
+    uint64_t bytes_moved{0}; // Bytes read and written.
+  };
+
+  // Functions to deal with cost inference. This registers a function that
+  // takes in an OperatorDef and the type and shape of its inputs, and
+  // estimates the cost of running the operator once.
+  typedef std::function<
+      struct Cost(const OperatorDef&, const vector<TensorShape>&)>
+      CostInferenceFunctionType;
+
+  /**
+   * @brief Register the Cost inference function.
+   */
+  OpSchema& CostInferenceFunction(CostInferenceFunctionType function);
+  inline bool HasCostInferenceFunction() const {
+    return !!cost_inference_function_;
+  }
+  inline struct Cost InferCost(
+      const OperatorDef& def,
+      const vector<TensorShape>& input_tensor_shape) const {
+    CAFFE_ENFORCE(
+        cost_inference_function_, "Cost inference function not defined.");
+    return cost_inference_function_(def, input_tensor_shape);
+  }
+
+  // Functions to do documentation for the operator schema. A doc that is a
+  // string literal is not copied, which keeps the thousands of lines of docs
+  // out of the memory touched when the schemas register at startup.
+  OpSchema& SetDoc(const char* doc);
   OpSchema& SetDoc(const string& doc);
   OpSchema& Arg(const char* name, const char* description);
   OpSchema& Input(const int n, const char* name, const char* description);
@@ -187,6 +254,7 @@ class OpSchema {
 
  private:
   string file_;
+  const char* doc_literal_ = nullptr;
   string doc_;
   std::vector<std::pair<const char*, const char*>> arg_desc_{};
   std::vector<std::pair<const char*, const char*>> input_desc_{};
@@ -208,6 +276,7 @@ class OpSchema {
       = [](int, int) { return false; };
   std::function<bool(int, int)> inplace_enforced_
       = [](int, int) { return false; };
+  set<int> accumulation_allowed_;
   TensorInferenceFunctionType tensor_inference_function_ =
       [](const OperatorDef& def, const vector<TensorShape>&) {
         vector<TensorShape> out;
@@ -218,6 +287,7 @@ class OpSchema {
         }
         return out;
       };
+  CostInferenceFunctionType cost_inference_function_;
 };
 
 /**
@@ -225,30 +295,20 @@ class OpSchema {
  */
 class OpSchemaRegistry {
  public:
-  static OpSchema& NewSchema(
-      const string& key, const string& file, const int line) {
-    auto& m = map();
-    if (m.count(key)) {
-      const auto& schema = m[key];
-      std::cerr << "Trying to register schema with name "
-                << key << " from file " << file << " line " << line
-                << ", but it is already registered from file "
-                << schema.file() << " line " << schema.line();
-      abort();
-    }
-    m.emplace(std::make_pair(key, OpSchema(file, line)));
-    return m[key];
-  }
+  static OpSchema&
+  NewSchema(const string& key, const char* file, const int line);
 
   static const OpSchema* Schema(const string& key) {
     auto& m = map();
-    if (m.count(key)) {
-      return &m[key];
-    } else {
-      return nullptr;
-    }
+    auto it = m.find(key);
+    return it == m.end() ? nullptr : &it->second;
   }
 
+  /**
+   * @brief Returns the names of the registered schemas.
+   */
+  static vector<string> Keys();
+
  private:
   // OpSchemaRegistry should not need to be instantiated.
   OpSchemaRegistry() = delete;
@@ -287,6 +347,31 @@ inline vector<TIndex> GetDimsVector(const TensorShape& shape) {
   return dims;
 }
 
+// Helper function to get the number of elements of a tensor shape.
+inline uint64_t GetNumElements(const TensorShape& shape) {
+  uint64_t size = 1;
+  for (auto d : shape.dims()) {
+    size *= d;
+  }
+  return size;
+}
+
+// Cost inference for element-wise ops that do OpsPerPoint floating point
+// operations per element of the first input, and read and write every element
+// of their (same-sized, float) inputs and outputs once.
+template <uint64_t OpsPerPoint>
+OpSchema::Cost PointwiseCostInference(
+    const OperatorDef& def,
+    const vector<TensorShape>& inputs) {
+  struct OpSchema::Cost c;
+  const uint64_t size = GetNumElements(inputs[0]);
+  c.flops = size * OpsPerPoint;
+  c.bytes_read = size * inputs.size() * sizeof(float);
+  c.bytes_written = size * def.output_size() * sizeof(float);
+  c.bytes_moved = c.bytes_read + c.bytes_written;
+  return c;
+}
+
 }  // namespace caffe2
 
 #define OPERATOR_SCHEMA(name)                                                 \
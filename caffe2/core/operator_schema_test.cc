@@ -141,6 +141,26 @@ TEST(OperatorSchemaTest, Inplace) {
   EXPECT_FALSE(schema->Verify(def4));
 }
 
+OPERATOR_SCHEMA(OpSchemaAccumulation)
+    .NumInputs(1).NumOutputs(2)
+    .AllowAccumulation({1});
+
+TEST(OperatorSchemaTest, Accumulation) {
+  const OpSchema* schema =
+      OpSchemaRegistry::Schema("OpSchemaAccumulation");
+  EXPECT_FALSE(schema->accumulation_allowed(0));
+  EXPECT_TRUE(schema->accumulation_allowed(1));
+  OperatorDef def = CreateOperatorDef(
+      "OpSchemaAccumulation", "",
+      vector<string>{"in"}, vector<string>{"out1", "out2"});
+  EXPECT_TRUE(schema->Verify(def));
+  def.add_arg()->CopyFrom(
+      MakeArgument<vector<int>>(kAccumulateOutputsArgument, {1}));
+  EXPECT_TRUE(schema->Verify(def));
+  def.mutable_arg(0)->add_ints(0);
+  EXPECT_FALSE(schema->Verify(def));
+}
+
 OPERATOR_SCHEMA(OpSchemaSameInputOutputTensorInference).IdenticalTypeAndShape();
 
 TEST(OperatorSchemaTest, TensorInferenceIdentical) {
@@ -185,6 +205,30 @@ TEST(OperatorSchemaTest, TensorInferenceArbitrary) {
   EXPECT_EQ(out[0].dims(0), 1701);
 }
 
+OPERATOR_SCHEMA(OpSchemaPointwiseCostInference)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .CostInferenceFunction(PointwiseCostInference<2>);
+
+TEST(OperatorSchemaTest, TestPointwiseCostInference) {
+  const OpSchema* schema =
+      OpSchemaRegistry::Schema("OpSchemaPointwiseCostInference");
+  EXPECT_TRUE(schema->HasCostInferenceFunction());
+  OperatorDef def = CreateOperatorDef(
+      "OpSchemaPointwiseCostInference",
+      "",
+      vector<string>{"in"},
+      vector<string>{"out"});
+  vector<TensorShape> shapes(1);
+  shapes[0].add_dims(2);
+  shapes[0].add_dims(3);
+  auto cost = schema->InferCost(def, shapes);
+  EXPECT_EQ(cost.flops, 12);
+  EXPECT_EQ(cost.bytes_read, 6 * sizeof(float));
+  EXPECT_EQ(cost.bytes_written, 6 * sizeof(float));
+  EXPECT_EQ(cost.bytes_moved, 2 * 6 * sizeof(float));
+}
+
 TEST(OperatorSchemaTest, TestCastSchema) {
   // This tests a use case of the schema: the Cast op takes in the def and
   // deduces the
@@ -0,0 +1,98 @@
+#include "caffe2/core/packed_strings.h"
+
+#include "caffe2/core/blob_serialization.h"
+
+namespace caffe2 {
+
+void PackedStrings::CopyFrom(const TensorCPU& strings) {
+  const auto* data = strings.data<std::string>();
+  size_t nbytes = 0;
+  for (TIndex i = 0; i < strings.size(); ++i) {
+    nbytes += data[i].size();
+  }
+  Clear();
+  Reserve(strings.size(), nbytes);
+  for (TIndex i = 0; i < strings.size(); ++i) {
+    Append(data[i]);
+  }
+  dims_ = strings.dims();
+}
+
+void PackedStrings::CopyTo(TensorCPU* strings) const {
+  strings->Resize(dims_);
+  auto* data = strings->mutable_data<std::string>();
+  for (TIndex i = 0; i < size(); ++i) {
+    const StringView str = (*this)[i];
+    data[i].assign(str.data(), str.size());
+  }
+}
+
+namespace {
+
+/**
+ * Serializes PackedStrings as a STRING TensorProto, with the length of every
+ * element in int64_data and the bytes of all of them in byte_data, so that
+ * neither side makes a string per element. It is not chunked, as the blobs
+ * that are not tensors are loaded as a single chunk.
+ */
+class PackedStringsSerializer : public BlobSerializerBase {
+ public:
+  void Serialize(
+      const Blob& blob,
+      const string& name,
+      SerializationAcceptor acceptor) override {
+    const auto& strings = blob.Get<PackedStrings>();
+    BlobProto blob_proto;
+    blob_proto.set_name(name);
+    blob_proto.set_type("PackedStrings");
+    auto* proto = blob_proto.mutable_tensor();
+    proto->set_name(name);
+    proto->set_data_type(TensorProto_DataType_STRING);
+    for (const TIndex dim : strings.dims()) {
+      proto->add_dims(dim);
+    }
+    auto* lengths = proto->mutable_int64_data();
+    lengths->Reserve(strings.size());
+    string* bytes = proto->mutable_byte_data();
+    bytes->reserve(strings.nbytes());
+    for (TIndex i = 0; i < strings.size(); ++i) {
+      const StringView str = strings[i];
+      lengths->AddAlreadyReserved(str.size());
+      bytes->append(str.data(), str.size());
+    }
+    acceptor(name, blob_proto.SerializeAsString());
+  }
+};
+
+class PackedStringsDeserializer : public BlobDeserializerBase {
+ public:
+  void Deserialize(const BlobProto& blob_proto, Blob* blob) override {
+    const auto& proto = blob_proto.tensor();
+    const auto& bytes = proto.byte_data();
+    auto* strings = blob->GetMutable<PackedStrings>();
+    strings->Clear();
+    strings->Reserve(proto.int64_data_size(), bytes.size());
+    size_t begin = 0;
+    for (const int64_t length : proto.int64_data()) {
+      CAFFE_ENFORCE(
+          length >= 0 && begin + length <= bytes.size(),
+          "Invalid PackedStrings proto.");
+      strings->Append(bytes.data() + begin, length);
+      begin += length;
+    }
+    CAFFE_ENFORCE_EQ(begin, bytes.size(), "Invalid PackedStrings proto.");
+    strings->Reshape(
+        vector<TIndex>(proto.dims().begin(), proto.dims().end()));
+  }
+};
+
+} // namespace
+
+CAFFE_KNOWN_TYPE(PackedStrings);
+
+REGISTER_BLOB_SERIALIZER(
+    (TypeMeta::Id<PackedStrings>()),
+    PackedStringsSerializer);
+REGISTER_BLOB_DESERIALIZER(PackedStrings, PackedStringsDeserializer);
+
+} // namespace caffe2
@@ -0,0 +1,152 @@
+#ifndef CAFFE2_CORE_PACKED_STRINGS_H_
+#define CAFFE2_CORE_PACKED_STRINGS_H_
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/tensor.h"
+
+namespace caffe2 {
+
+/**
+ * A non-owning view of a sequence of bytes, such as an element of
+ * PackedStrings. It stays valid as long as the bytes it points to do.
+ */
+class StringView {
+ public:
+  StringView() {}
+  StringView(const char* data, size_t size) : data_(data), size_(size) {}
+  /* implicit */ StringView(const char* str)
+      : data_(str), size_(std::strlen(str)) {}
+  /* implicit */ StringView(const std::string& str)
+      : data_(str.data()), size_(str.size()) {}
+
+  const char* data() const {
+    return data_;
+  }
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+  const char* begin() const {
+    return data_;
+  }
+  const char* end() const {
+    return data_ + size_;
+  }
+  char operator[](size_t i) const {
+    return data_[i];
+  }
+
+  // The first (last) at most n bytes.
+  StringView prefix(size_t n) const {
+    return StringView(data_, std::min(n, size_));
+  }
+  StringView suffix(size_t n) const {
+    const size_t size = std::min(n, size_);
+    return StringView(data_ + size_ - size, size);
+  }
+  bool starts_with(StringView other) const {
+    return size_ >= other.size_ && prefix(other.size_) == other;
+  }
+  bool ends_with(StringView other) const {
+    return size_ >= other.size_ && suffix(other.size_) == other;
+  }
+
+  std::string ToString() const {
+    return std::string(data_, size_);
+  }
+
+  friend bool operator==(StringView a, StringView b) {
+    return a.size_ == b.size_ &&
+        (a.size_ == 0 || std::memcmp(a.data_, b.data_, a.size_) == 0);
+  }
+  friend bool operator!=(StringView a, StringView b) {
+    return !(a == b);
+  }
+
+ private:
+  const char* data_ = "";
+  size_t size_ = 0;
+};
+
+/**
+ * PackedStrings is a tensor of strings that keeps the bytes of all of its
+ * elements in a single buffer, with the end offset of every element in a
+ * second one, instead of a std::string per element as Tensor<std::string>
+ * does. Filling it costs two amortized appends per element rather than an
+ * allocation, and reading it walks memory in order.
+ *
+ * Elements are appended in order, and read as StringViews into the buffer,
+ * which are invalidated by the next append. The string ops, the indexes and
+ * TextFileReaderRead accept it where they accept a tensor of strings, and
+ * the PackStrings and UnpackStrings operators convert between the two.
+ */
+class PackedStrings {
+ public:
+  PackedStrings() {}
+
+  const vector<TIndex>& dims() const {
+    return dims_;
+  }
+  TIndex size() const {
+    return ends_.size();
+  }
+  // The number of bytes of all of the elements.
+  size_t nbytes() const {
+    return bytes_.size();
+  }
+
+  StringView operator[](TIndex i) const {
+    const size_t begin = i == 0 ? 0 : ends_[i - 1];
+    return StringView(bytes_.data() + begin, ends_[i] - begin);
+  }
+
+  // Removes all of the elements, but keeps the memory.
+  void Clear() {
+    dims_.assign(1, 0);
+    ends_.clear();
+    bytes_.clear();
+  }
+  void Reserve(TIndex size, size_t nbytes) {
+    ends_.reserve(size);
+    bytes_.reserve(nbytes);
+  }
+
+  // Appends an element, and makes the tensor 1-D. The bytes must not be
+  // those of an element of this tensor.
+  void Append(const char* data, size_t size) {
+    bytes_.insert(bytes_.end(), data, data + size);
+    ends_.push_back(bytes_.size());
+    dims_.assign(1, ends_.size());
+  }
+  void Append(StringView str) {
+    Append(str.data(), str.size());
+  }
+
+  // Gives the elements the shape dims, which must have as many elements.
+  void Reshape(const vector<TIndex>& dims) {
+    CAFFE_ENFORCE_EQ(
+        size_from_dim_(0, dims), size(), "Reshape cannot change the size.");
+    dims_ = dims;
+  }
+
+  void CopyFrom(const TensorCPU& strings);
+  void CopyTo(TensorCPU* strings) const;
+
+ private:
+  vector<TIndex> dims_{0};
+  vector<size_t> ends_;
+  vector<char> bytes_;
+
+  DISABLE_COPY_AND_ASSIGN(PackedStrings);
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_CORE_PACKED_STRINGS_H_
@@ -0,0 +1,85 @@
+#include <string>
+#include <vector>
+
+#include "caffe2/core/blob.h"
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/packed_strings.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+TEST(StringViewTest, Basics) {
+  const std::string str = "prefix_suffix";
+  StringView view(str);
+  EXPECT_EQ(view.size(), str.size());
+  EXPECT_EQ(view.prefix(6).ToString(), "prefix");
+  EXPECT_EQ(view.suffix(6).ToString(), "suffix");
+  EXPECT_EQ(view.prefix(100), view);
+  EXPECT_TRUE(view.starts_with("prefix"));
+  EXPECT_FALSE(view.starts_with("suffix"));
+  EXPECT_TRUE(view.ends_with("suffix"));
+  EXPECT_FALSE(StringView("fix").ends_with(view));
+  EXPECT_TRUE(StringView().empty());
+  EXPECT_EQ(StringView(), StringView(str.data(), 0));
+}
+
+TEST(PackedStringsTest, AppendAndReshape) {
+  PackedStrings strings;
+  EXPECT_EQ(strings.size(), 0);
+  EXPECT_EQ(strings.dims(), vector<TIndex>{0});
+  for (const char* str : {"a", "", "bcd", "ef"}) {
+    strings.Append(str);
+  }
+  EXPECT_EQ(strings.dims(), vector<TIndex>{4});
+  EXPECT_EQ(strings.nbytes(), 6);
+  EXPECT_EQ(strings[0].ToString(), "a");
+  EXPECT_TRUE(strings[1].empty());
+  EXPECT_EQ(strings[2].ToString(), "bcd");
+  EXPECT_EQ(strings[3].ToString(), "ef");
+  strings.Reshape({2, 2});
+  EXPECT_EQ(strings.dims(), (vector<TIndex>{2, 2}));
+  EXPECT_THROW(strings.Reshape({3}), EnforceNotMet);
+  strings.Clear();
+  EXPECT_EQ(strings.size(), 0);
+  EXPECT_EQ(strings.nbytes(), 0);
+}
+
+TEST(PackedStringsTest, CopiesToAndFromTensors) {
+  TensorCPU tensor(vector<TIndex>{3, 1});
+  auto* data = tensor.mutable_data<std::string>();
+  data[0] = "x";
+  data[1] = std::string("with\0null", 9);
+  data[2] = "";
+  PackedStrings strings;
+  strings.CopyFrom(tensor);
+  EXPECT_EQ(strings.dims(), tensor.dims());
+  EXPECT_EQ(strings[1].size(), 9);
+
+  TensorCPU copy;
+  strings.CopyTo(&copy);
+  EXPECT_EQ(copy.dims(), tensor.dims());
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(copy.data<std::string>()[i], data[i]);
+  }
+}
+
+TEST(PackedStringsTest, SerializationRoundTrips) {
+  Blob blob;
+  auto* strings = blob.GetMutable<PackedStrings>();
+  for (int i = 0; i < 6; ++i) {
+    strings->Append(std::string(i, 'a' + i));
+  }
+  strings->Reshape({3, 2});
+  const string serialized = blob.Serialize("strings");
+
+  Blob loaded;
+  loaded.Deserialize(serialized);
+  ASSERT_TRUE(loaded.IsType<PackedStrings>());
+  const auto& result = loaded.Get<PackedStrings>();
+  EXPECT_EQ(result.dims(), (vector<TIndex>{3, 2}));
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(result[i], (*strings)[i]);
+  }
+}
+
+} // namespace caffe2
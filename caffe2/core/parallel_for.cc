@@ -0,0 +1,49 @@
+#include "caffe2/core/parallel_for.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "caffe2/core/workspace.h"
+
+namespace caffe2 {
+
+void ParallelFor(
+    Workspace* ws,
+    size_t range,
+    const std::function<void(int, size_t)>& fn) {
+#if CAFFE2_MOBILE
+  if (ws && range > 1) {
+    ws->GetThreadPool()->run(fn, range);
+    return;
+  }
+#elif defined(_OPENMP)
+  (void)ws;
+  if (range > 1) {
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < static_cast<long>(range); ++i) {
+      fn(omp_get_thread_num(), i);
+    }
+    return;
+  }
+#else
+  (void)ws;
+#endif
+  for (size_t i = 0; i < range; ++i) {
+    fn(0, i);
+  }
+}
+
+int ParallelForNumThreads(Workspace* ws) {
+#if CAFFE2_MOBILE
+  return ws ? ws->GetThreadPool()->getNumThreads() : 1;
+#elif defined(_OPENMP)
+  (void)ws;
+  return omp_get_max_threads();
+#else
+  (void)ws;
+  return 1;
+#endif
+}
+
+} // namespace caffe2
@@ -0,0 +1,33 @@
+#ifndef CAFFE2_CORE_PARALLEL_FOR_H_
+#define CAFFE2_CORE_PARALLEL_FOR_H_
+
+#include <cstddef>
+#include <functional>
+
+#include "caffe2/core/common.h"
+
+namespace caffe2 {
+
+class Workspace;
+
+// Runs fn(thread, i) for every i in [0, range), split across threads: on
+// mobile, across the thread pool of the workspace (see
+// Workspace::GetThreadPool), and elsewhere across OpenMP threads if OpenMP
+// is enabled. Without either, or without a workspace on mobile, the items
+// run inline. `thread` is in [0, ParallelForNumThreads(ws)) and identifies
+// the thread that runs the item, e.g. to pick a scratch buffer.
+//
+// The items should be coarse, such as images, planes or blocks of rows, as
+// each one is a call through std::function. The thread pool runs one loop at
+// a time, so fn must not call ParallelFor itself.
+void ParallelFor(
+    Workspace* ws,
+    size_t range,
+    const std::function<void(int, size_t)>& fn);
+
+// The number of threads that ParallelFor may use.
+int ParallelForNumThreads(Workspace* ws);
+
+} // namespace caffe2
+
+#endif // CAFFE2_CORE_PARALLEL_FOR_H_
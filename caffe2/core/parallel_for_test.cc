@@ -0,0 +1,40 @@
+#include <atomic>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "caffe2/core/parallel_for.h"
+#include "caffe2/core/workspace.h"
+
+namespace caffe2 {
+
+TEST(ParallelForTest, RunsEveryItemOnce) {
+  Workspace ws;
+  const int num_threads = ParallelForNumThreads(&ws);
+  ASSERT_GE(num_threads, 1);
+  for (size_t range : {0, 1, 7, 1000}) {
+    std::vector<std::atomic<int>> counts(range);
+    for (auto& count : counts) {
+      count = 0;
+    }
+    std::atomic<bool> threads_ok(true);
+    ParallelFor(&ws, range, [&](int thread, size_t i) {
+      if (thread < 0 || thread >= num_threads) {
+        threads_ok = false;
+      }
+      ++counts[i];
+    });
+    EXPECT_TRUE(threads_ok);
+    for (const auto& count : counts) {
+      EXPECT_EQ(count, 1);
+    }
+  }
+}
+
+TEST(ParallelForTest, RunsWithoutWorkspace) {
+  std::atomic<int> sum(0);
+  ParallelFor(nullptr, 100, [&](int, size_t i) { sum += i; });
+  EXPECT_EQ(sum, 4950);
+}
+
+} // namespace caffe2
@@ -111,6 +111,51 @@ TEST(DAGNetTest, TestDAGNetTiming) {
   EXPECT_NEAR(ms, 200, kTimeThreshold);
 }
 
+namespace {
+// Run a network on the workspace executor pool instead of its own workers.
+int RunNetOnExecutorPoolAndGetDuration(
+    const string& net_def_str,
+    const string& type,
+    int num_workers) {
+  FLAGS_caffe2_executor_pool_cpu_threads = 4;
+  NetDef net_def;
+  CAFFE_ENFORCE(
+      google::protobuf::TextFormat::ParseFromString(net_def_str, &net_def));
+  net_def.set_type(type);
+  net_def.set_num_workers(num_workers);
+  auto* arg = net_def.add_arg();
+  arg->set_name("shared_executor");
+  arg->set_i(1);
+  Workspace ws;
+  unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+  CAFFE_ENFORCE(net.get() != nullptr);
+  auto start_time = std::chrono::system_clock::now();
+  CAFFE_ENFORCE(net->Run());
+  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now() - start_time);
+  return duration.count();
+}
+}  // namespace
+
+TEST(DAGNetTest, TestDAGNetTimingOnExecutorPool) {
+  int ms = RunNetOnExecutorPoolAndGetDuration(
+      string(kSleepNetDefString), "dag", 2);
+  EXPECT_NEAR(ms, 200, kTimeThreshold);
+}
+
+// With a single worker the net may only have one chain in flight on the pool,
+// so everything runs sequentially even though the pool has more threads.
+TEST(DAGNetTest, TestDAGNetConcurrencyLimitOnExecutorPool) {
+  int ms = RunNetOnExecutorPoolAndGetDuration(
+      string(kSleepNetDefString), "dag", 1);
+  EXPECT_NEAR(ms, 350, kTimeThreshold);
+}
+
+TEST(DAGNetTest, TestWorkStealingDAGNetTiming) {
+  int ms = RunNetAndGetDuration(string(kSleepNetDefString), "dag_ws");
+  EXPECT_NEAR(ms, 200, kTimeThreshold);
+}
+
 // For sanity check, we also test the sequential time - it should take 0.35
 // seconds instead since everything has to be sequential.
 TEST(SimpleNetTest, TestSimpleNetTiming) {
@@ -160,6 +205,12 @@ TEST(DAGNetTest, TestDAGNetTimingReadAfterRead) {
   EXPECT_NEAR(ms, 250, kTimeThreshold);
 }
 
+TEST(DAGNetTest, TestWorkStealingDAGNetTimingReadAfterRead) {
+  int ms =
+      RunNetAndGetDuration(string(kSleepNetDefStringReadAfterRead), "dag_ws");
+  EXPECT_NEAR(ms, 250, kTimeThreshold);
+}
+
 // For sanity check, we also test the sequential time - it should take 0.35
 // seconds instead since everything has to be sequential.
 TEST(SimpleNetTest, TestSimpleNetTimingReadAfterRead) {
@@ -313,4 +364,57 @@ TEST(SimpleNetTest, TestSimpleNetTimingControlDependency) {
   EXPECT_NEAR(ms, 350, kTimeThreshold);
 }
 
+const char kPipelinedNetDefString[] =
+"  name: \"pipelinednet\""
+"  op {"
+"    output: \"data\""
+"    name: \"reader\""
+"    type: \"Sleep\""
+"    arg {"
+"      name: \"ms\""
+"      i: 100"
+"    }"
+"  }"
+"  op {"
+"    input: \"data\""
+"    output: \"loss\""
+"    name: \"trainer\""
+"    type: \"Sleep\""
+"    arg {"
+"      name: \"ms\""
+"      i: 100"
+"    }"
+"  }"
+"  external_output: \"loss\""
+"  arg {"
+"    name: \"pipelined\""
+"    i: 1"
+"  }";
+
+TEST(PipelinedNetTest, TestPipelinedNetTiming) {
+  for (const string type : {"simple", "dag"}) {
+    NetDef net_def;
+    CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(
+        string(kPipelinedNetDefString), &net_def));
+    net_def.set_type(type);
+    Workspace ws;
+    unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+    ASSERT_TRUE(net.get() != nullptr);
+    auto start_time = std::chrono::system_clock::now();
+    for (int i = 0; i < 5; ++i) {
+      ASSERT_TRUE(net->Run());
+    }
+    int ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::system_clock::now() - start_time)
+                 .count();
+    // The reader of the next iteration runs together with the trainer, so
+    // apart from the first reader every iteration only takes 100ms.
+    EXPECT_NEAR(ms, 600, 3 * kTimeThreshold);
+    // The reader output is double buffered, the external output is not.
+    EXPECT_TRUE(ws.HasBlob("data"));
+    EXPECT_TRUE(ws.HasBlob("data_pipelined_1"));
+    EXPECT_FALSE(ws.HasBlob("loss_pipelined_1"));
+  }
+}
+
 }  // namespace caffe2
@@ -0,0 +1,174 @@
+#include "caffe2/core/perf_events.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "caffe2/core/logging.h"
+
+namespace caffe2 {
+
+constexpr int PerfEvents::kMaxEvents;
+
+namespace {
+
+#ifdef __linux__
+
+uint64_t CacheEvent(uint64_t cache, uint64_t op, uint64_t result) {
+  return cache | (op << 8) | (result << 16);
+}
+
+const std::vector<std::pair<string, std::pair<uint32_t, uint64_t>>>&
+KnownEvents() {
+  static const std::vector<std::pair<string, std::pair<uint32_t, uint64_t>>>
+      events = {
+          {"cycles", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES}},
+          {"instructions", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS}},
+          {"cache_references",
+           {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES}},
+          {"cache_misses", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}},
+          {"branch_misses",
+           {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}},
+          {"l1d_misses",
+           {PERF_TYPE_HW_CACHE,
+            CacheEvent(
+                PERF_COUNT_HW_CACHE_L1D,
+                PERF_COUNT_HW_CACHE_OP_READ,
+                PERF_COUNT_HW_CACHE_RESULT_MISS)}},
+          {"dtlb_misses",
+           {PERF_TYPE_HW_CACHE,
+            CacheEvent(
+                PERF_COUNT_HW_CACHE_DTLB,
+                PERF_COUNT_HW_CACHE_OP_READ,
+                PERF_COUNT_HW_CACHE_RESULT_MISS)}},
+          {"itlb_misses",
+           {PERF_TYPE_HW_CACHE,
+            CacheEvent(
+                PERF_COUNT_HW_CACHE_ITLB,
+                PERF_COUNT_HW_CACHE_OP_READ,
+                PERF_COUNT_HW_CACHE_RESULT_MISS)}},
+      };
+  return events;
+}
+
+// The events of one PerfEvents for one thread, read together through the
+// group leader.
+struct Group {
+  std::vector<int> fds;
+  bool failed = false;
+
+  ~Group() {
+    for (int fd : fds) {
+      close(fd);
+    }
+  }
+};
+
+// By the key of the PerfEvents, so that profilers that count the same events
+// share the groups.
+thread_local std::unordered_map<string, Group> groups;
+
+bool Open(
+    const std::vector<std::pair<uint32_t, uint64_t>>& events,
+    Group* group) {
+  for (const auto& event : events) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.first;
+    attr.config = event.second;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    const int leader = group->fds.empty() ? -1 : group->fds[0];
+    const int fd = syscall(
+        __NR_perf_event_open, &attr, 0 /* this thread */, -1, leader, 0);
+    if (fd < 0) {
+      return false;
+    }
+    group->fds.push_back(fd);
+  }
+  return true;
+}
+
+#else
+
+const std::vector<std::pair<string, std::pair<uint32_t, uint64_t>>>&
+KnownEvents() {
+  static const std::vector<std::pair<string, std::pair<uint32_t, uint64_t>>>
+      events;
+  return events;
+}
+
+#endif // __linux__
+
+} // namespace
+
+PerfEvents::PerfEvents(const string& names) : key_(names) {
+  size_t begin = 0;
+  while (begin <= names.size()) {
+    size_t end = names.find(',', begin);
+    if (end == string::npos) {
+      end = names.size();
+    }
+    const string name = names.substr(begin, end - begin);
+    begin = end + 1;
+    if (name.empty()) {
+      continue;
+    }
+    bool known = false;
+    for (const auto& event : KnownEvents()) {
+      if (event.first == name) {
+        names_.push_back(name);
+        events_.push_back(event.second);
+        known = true;
+      }
+    }
+    CAFFE_ENFORCE(known, "Unknown or unsupported perf event: ", name);
+  }
+  CAFFE_ENFORCE_LE(names_.size(), kMaxEvents, "Too many perf events.");
+}
+
+bool PerfEvents::Read(uint64_t* values) const {
+#ifdef __linux__
+  if (events_.empty()) {
+    return false;
+  }
+  Group& group = groups[key_];
+  if (group.failed) {
+    return false;
+  }
+  if (group.fds.empty() && !Open(events_, &group)) {
+    LOG(WARNING) << "Cannot open the perf events " << key_
+                 << " on this thread; see perf_event_open(2).";
+    group.failed = true;
+    return false;
+  }
+  uint64_t buffer[kMaxEvents + 1];
+  const size_t size = (events_.size() + 1) * sizeof(uint64_t);
+  if (read(group.fds[0], buffer, size) != size ||
+      buffer[0] != events_.size()) {
+    return false;
+  }
+  std::copy(buffer + 1, buffer + 1 + events_.size(), values);
+  return true;
+#else
+  return false;
+#endif // __linux__
+}
+
+std::vector<string> PerfEvents::SupportedNames() {
+  std::vector<string> names;
+  for (const auto& event : KnownEvents()) {
+    names.push_back(event.first);
+  }
+  return names;
+}
+
+}  // namespace caffe2
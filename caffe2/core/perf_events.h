@@ -0,0 +1,56 @@
+#ifndef CAFFE2_CORE_PERF_EVENTS_H_
+#define CAFFE2_CORE_PERF_EVENTS_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe2/core/common.h"
+
+namespace caffe2 {
+
+/**
+ * PerfEvents counts hardware events of the calling thread with the Linux
+ * perf_event interface, for profiling operators. The events are given by
+ * name, from SupportedNames():
+ *
+ *   cycles, instructions, cache_references, cache_misses, branch_misses,
+ *   l1d_misses, dtlb_misses, itlb_misses
+ *
+ * Every thread that reads the counters opens a group of them the first time,
+ * which stays open until it exits. Only the calling thread is counted, not
+ * the threads it hands work to, such as those of OpenMP or of a thread pool,
+ * and only in user space. If the events cannot be opened, because the
+ * platform is not Linux, the hardware does not have them, or
+ * /proc/sys/kernel/perf_event_paranoid forbids them, Read() returns false.
+ */
+class PerfEvents {
+ public:
+  static constexpr int kMaxEvents = 8;
+
+  // Takes a comma-separated list of event names. Throws on unknown names.
+  explicit PerfEvents(const string& names);
+
+  const std::vector<string>& names() const {
+    return names_;
+  }
+  // Reads the running counts of the events of the calling thread into
+  // `values`, which holds names().size() of them. Returns false if they are
+  // not available.
+  bool Read(uint64_t* values) const;
+
+  static std::vector<string> SupportedNames();
+
+ private:
+  string key_;
+  std::vector<string> names_;
+  // (perf_event_attr type, config) of every event.
+  std::vector<std::pair<uint32_t, uint64_t>> events_;
+
+  DISABLE_COPY_AND_ASSIGN(PerfEvents);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_PERF_EVENTS_H_
@@ -0,0 +1,357 @@
+#include "caffe2/core/pooled_allocator.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
+#include "caffe2/core/flags.h"
+#include "caffe2/core/init.h"
+
+CAFFE2_DEFINE_bool(
+    caffe2_pooled_cpu_allocator,
+    false,
+    "If set, GlobalInit installs a PooledCPUAllocator as the CPU allocator "
+    "(see core/pooled_allocator.h).");
+CAFFE2_DEFINE_int64(
+    caffe2_pooled_cpu_allocator_thread_cache_bytes,
+    4 << 20,
+    "The number of freed bytes that every thread may cache in the pooled CPU "
+    "allocator before passing them to the central cache.");
+CAFFE2_DEFINE_int64(
+    caffe2_pooled_cpu_allocator_max_cached_bytes,
+    1 << 30,
+    "The number of freed bytes that the central cache of the pooled CPU "
+    "allocator may hold before returning memory to the system.");
+
+namespace caffe2 {
+
+namespace {
+
+// Every block starts with a header of one alignment unit, so that the data
+// after it stays aligned.
+struct BlockHeader {
+  int size_class;
+  size_t nbytes;
+};
+static_assert(
+    sizeof(BlockHeader) <= kPooledCPUAllocatorAlignment,
+    "The block header should fit in one alignment unit.");
+
+constexpr int kMinSizeClassLog = 6;
+constexpr int kMaxSizeClassLog = 24;
+constexpr int kNumSizeClasses = (kMaxSizeClassLog - kMinSizeClassLog) * 4 + 1;
+// The size class of allocations that are too large to be cached.
+constexpr int kLargeSizeClass = -1;
+
+// Size class 0 holds up to 64 bytes. After that, every power of two
+// (2^p, 2^(p+1)] is split in four classes of 2^p + k * 2^(p-2) bytes.
+int SizeClass(size_t nbytes) {
+  if (nbytes <= (1 << kMinSizeClassLog)) {
+    return 0;
+  }
+  if (nbytes > (1 << kMaxSizeClassLog)) {
+    return kLargeSizeClass;
+  }
+  int log = kMinSizeClassLog;
+  while ((size_t(2) << log) < nbytes) {
+    ++log;
+  }
+  const size_t step = size_t(1) << (log - 2);
+  const int k = ((nbytes - (size_t(1) << log)) + step - 1) / step;
+  return (log - kMinSizeClassLog) * 4 + k;
+}
+
+size_t SizeClassBytes(int size_class) {
+  if (size_class == 0) {
+    return 1 << kMinSizeClassLog;
+  }
+  const int log = kMinSizeClassLog + (size_class - 1) / 4;
+  const int k = (size_class - 1) % 4 + 1;
+  return (size_t(1) << log) + k * (size_t(1) << (log - 2));
+}
+
+void* AllocateBlock(size_t nbytes) {
+  void* base = nullptr;
+  const size_t total = nbytes + kPooledCPUAllocatorAlignment;
+#ifdef __ANDROID__
+  base = memalign(kPooledCPUAllocatorAlignment, total);
+#elif defined(_MSC_VER)
+  base = _aligned_malloc(total, kPooledCPUAllocatorAlignment);
+#else
+  CAFFE_ENFORCE_EQ(
+      posix_memalign(&base, kPooledCPUAllocatorAlignment, total), 0);
+#endif
+  CAFFE_ENFORCE(base, "Failed to allocate ", nbytes, " bytes.");
+  return base;
+}
+
+void FreeBlock(void* base) {
+#ifdef _MSC_VER
+  _aligned_free(base);
+#else
+  free(base);
+#endif
+}
+
+inline BlockHeader* HeaderOf(void* data) {
+  return reinterpret_cast<BlockHeader*>(
+      static_cast<char*>(data) - kPooledCPUAllocatorAlignment);
+}
+
+inline void* DataOf(void* base) {
+  return static_cast<char*>(base) + kPooledCPUAllocatorAlignment;
+}
+
+} // namespace
+
+struct PooledCPUAllocator::Central {
+  struct FreeList {
+    std::mutex mutex;
+    std::vector<void*> blocks;
+  };
+
+  Central(size_t thread_cache_bytes, size_t max_cached_bytes)
+      : thread_cache_bytes(thread_cache_bytes),
+        max_cached_bytes(max_cached_bytes) {
+    static std::atomic<uint64_t> next_id(0);
+    id = next_id++;
+  }
+
+  ~Central() {
+    FreeAll();
+  }
+
+  // Takes a cached block of the given class, or returns nullptr.
+  void* Take(int size_class) {
+    FreeList& list = free_lists[size_class];
+    std::lock_guard<std::mutex> guard(list.mutex);
+    if (list.blocks.empty()) {
+      return nullptr;
+    }
+    void* base = list.blocks.back();
+    list.blocks.pop_back();
+    central_cached_bytes -= SizeClassBytes(size_class);
+    return base;
+  }
+
+  // Caches the block if there is room for it, and frees it otherwise.
+  void Give(int size_class, void* base) {
+    const size_t nbytes = SizeClassBytes(size_class);
+    if (central_cached_bytes + nbytes > max_cached_bytes) {
+      bytes_cached -= nbytes;
+      FreeBlock(base);
+      return;
+    }
+    FreeList& list = free_lists[size_class];
+    std::lock_guard<std::mutex> guard(list.mutex);
+    list.blocks.push_back(base);
+    central_cached_bytes += nbytes;
+  }
+
+  void FreeAll() {
+    for (int size_class = 0; size_class < kNumSizeClasses; ++size_class) {
+      FreeList& list = free_lists[size_class];
+      std::lock_guard<std::mutex> guard(list.mutex);
+      const size_t nbytes = SizeClassBytes(size_class);
+      for (void* base : list.blocks) {
+        FreeBlock(base);
+        central_cached_bytes -= nbytes;
+        bytes_cached -= nbytes;
+      }
+      list.blocks.clear();
+    }
+  }
+
+  const size_t thread_cache_bytes;
+  const size_t max_cached_bytes;
+  uint64_t id;
+  FreeList free_lists[kNumSizeClasses];
+  std::atomic<size_t> central_cached_bytes{0};
+  std::atomic<size_t> bytes_in_use{0};
+  std::atomic<size_t> bytes_cached{0};
+};
+
+namespace {
+
+// The blocks that one thread caches for one allocator. The cache keeps the
+// central cache alive, so that blocks can still be handed back to it when the
+// thread exits after the allocator is gone.
+struct ThreadCache {
+  explicit ThreadCache(std::shared_ptr<PooledCPUAllocator::Central> central)
+      : central(std::move(central)), free_lists(kNumSizeClasses) {}
+
+  ~ThreadCache() {
+    Flush();
+  }
+
+  void Flush() {
+    for (int size_class = 0; size_class < kNumSizeClasses; ++size_class) {
+      for (void* base : free_lists[size_class]) {
+        central->Give(size_class, base);
+      }
+      free_lists[size_class].clear();
+    }
+    cached_bytes = 0;
+  }
+
+  std::shared_ptr<PooledCPUAllocator::Central> central;
+  std::vector<std::vector<void*>> free_lists;
+  size_t cached_bytes = 0;
+};
+
+// The caches of the calling thread, by allocator id. The last used one is
+// remembered, since there is usually only one allocator.
+struct ThreadCaches {
+  ~ThreadCaches();
+
+  std::unordered_map<uint64_t, std::unique_ptr<ThreadCache>> caches;
+  uint64_t last_id = 0;
+  ThreadCache* last = nullptr;
+};
+
+thread_local ThreadCaches thread_caches;
+// Memory may still be allocated and deleted after the thread caches are gone,
+// e.g. by static objects at exit. This flag is trivially destructible, so it
+// can be checked at any time.
+thread_local bool thread_caches_destroyed = false;
+
+ThreadCaches::~ThreadCaches() {
+  thread_caches_destroyed = true;
+}
+
+// Returns the cache of the calling thread for the given allocator, or nullptr
+// if the thread caches are gone.
+ThreadCache* GetThreadCache(
+    const std::shared_ptr<PooledCPUAllocator::Central>& central) {
+  if (thread_caches_destroyed) {
+    return nullptr;
+  }
+  ThreadCaches& caches = thread_caches;
+  if (caches.last && caches.last_id == central->id) {
+    return caches.last;
+  }
+  auto& cache = caches.caches[central->id];
+  if (!cache) {
+    cache.reset(new ThreadCache(central));
+  }
+  caches.last_id = central->id;
+  caches.last = cache.get();
+  return cache.get();
+}
+
+} // namespace
+
+PooledCPUAllocator::PooledCPUAllocator()
+    : PooledCPUAllocator(
+          FLAGS_caffe2_pooled_cpu_allocator_thread_cache_bytes,
+          FLAGS_caffe2_pooled_cpu_allocator_max_cached_bytes) {}
+
+PooledCPUAllocator::PooledCPUAllocator(
+    size_t thread_cache_bytes,
+    size_t max_cached_bytes)
+    : central_(std::make_shared<Central>(thread_cache_bytes, max_cached_bytes)) {
+}
+
+PooledCPUAllocator::~PooledCPUAllocator() {
+  // Only the cache of the calling thread can be dropped here. The caches of
+  // other threads keep the central cache alive until they exit.
+  if (thread_caches_destroyed) {
+    return;
+  }
+  ThreadCaches& caches = thread_caches;
+  caches.caches.erase(central_->id);
+  if (caches.last_id == central_->id) {
+    caches.last = nullptr;
+  }
+}
+
+void* PooledCPUAllocator::New(size_t nbytes) {
+  const int size_class = SizeClass(nbytes);
+  void* base = nullptr;
+  if (size_class == kLargeSizeClass) {
+    base = AllocateBlock(nbytes);
+    central_->bytes_in_use += nbytes;
+  } else {
+    const size_t class_nbytes = SizeClassBytes(size_class);
+    ThreadCache* cache = GetThreadCache(central_);
+    if (cache && !cache->free_lists[size_class].empty()) {
+      base = cache->free_lists[size_class].back();
+      cache->free_lists[size_class].pop_back();
+      cache->cached_bytes -= class_nbytes;
+      central_->bytes_cached -= class_nbytes;
+    } else if ((base = central_->Take(size_class)) != nullptr) {
+      central_->bytes_cached -= class_nbytes;
+    } else {
+      base = AllocateBlock(class_nbytes);
+    }
+    central_->bytes_in_use += class_nbytes;
+  }
+  BlockHeader* header = static_cast<BlockHeader*>(base);
+  header->size_class = size_class;
+  header->nbytes = nbytes;
+  void* data = DataOf(base);
+  memset(data, 0, nbytes);
+  return data;
+}
+
+void PooledCPUAllocator::Delete(void* data) {
+  if (!data) {
+    return;
+  }
+  BlockHeader* header = HeaderOf(data);
+  void* base = header;
+  const int size_class = header->size_class;
+  if (size_class == kLargeSizeClass) {
+    central_->bytes_in_use -= header->nbytes;
+    FreeBlock(base);
+    return;
+  }
+  const size_t class_nbytes = SizeClassBytes(size_class);
+  central_->bytes_in_use -= class_nbytes;
+  central_->bytes_cached += class_nbytes;
+  ThreadCache* cache = GetThreadCache(central_);
+  if (cache &&
+      cache->cached_bytes + class_nbytes <= central_->thread_cache_bytes) {
+    cache->free_lists[size_class].push_back(base);
+    cache->cached_bytes += class_nbytes;
+  } else {
+    central_->Give(size_class, base);
+  }
+}
+
+PooledCPUAllocator::Stats PooledCPUAllocator::GetStats() const {
+  Stats stats;
+  stats.bytes_in_use = central_->bytes_in_use;
+  stats.bytes_cached = central_->bytes_cached;
+  return stats;
+}
+
+void PooledCPUAllocator::FreeCached() {
+  ThreadCache* cache = GetThreadCache(central_);
+  if (cache) {
+    cache->Flush();
+  }
+  central_->FreeAll();
+}
+
+namespace {
+
+bool Caffe2InstallPooledCPUAllocator(int*, char***) {
+  if (FLAGS_caffe2_pooled_cpu_allocator) {
+    VLOG(1) << "Installing the pooled CPU allocator.";
+    SetCPUAllocator(new PooledCPUAllocator());
+  }
+  return true;
+}
+
+} // namespace
+
+REGISTER_CAFFE2_INIT_FUNCTION(
+    Caffe2InstallPooledCPUAllocator,
+    &Caffe2InstallPooledCPUAllocator,
+    "Install the pooled CPU allocator if requested.");
+
+} // namespace caffe2
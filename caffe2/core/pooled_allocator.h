@@ -0,0 +1,68 @@
+#ifndef CAFFE2_CORE_POOLED_ALLOCATOR_H_
+#define CAFFE2_CORE_POOLED_ALLOCATOR_H_
+
+#include <cstdint>
+#include <memory>
+
+#include "caffe2/core/context.h"
+
+namespace caffe2 {
+
+// Alignment of the memory returned by PooledCPUAllocator: one cache line,
+// which is also the width of an AVX-512 register.
+constexpr size_t kPooledCPUAllocatorAlignment = 64;
+
+/**
+ * PooledCPUAllocator is a CPUAllocator that keeps freed memory around for
+ * reuse instead of returning it to the system allocator on every Delete().
+ *
+ * Allocations are rounded up to size classes, four per power of two, and
+ * freed blocks go to a cache of the freeing thread, so that most New() and
+ * Delete() calls take no lock at all. Once a thread cache holds more than
+ * thread_cache_bytes, freed blocks go to a central cache shared by all the
+ * threads, with a lock per size class, and once that holds more than
+ * max_cached_bytes they are returned to the system. Allocations larger than
+ * the largest size class always go to the system directly.
+ *
+ * The allocator can be installed with SetCPUAllocator(), or with the
+ * --caffe2_pooled_cpu_allocator flag at GlobalInit() time. Either way, this
+ * has to happen before any CPU memory is allocated, since memory can only be
+ * deleted by the allocator that created it.
+ */
+class PooledCPUAllocator final : public CPUAllocator {
+ public:
+  struct Stats {
+    // Bytes handed out by New() and not deleted yet, rounded up to the size
+    // classes.
+    size_t bytes_in_use;
+    // Bytes held by the thread caches and the central cache.
+    size_t bytes_cached;
+  };
+
+  PooledCPUAllocator();
+  PooledCPUAllocator(size_t thread_cache_bytes, size_t max_cached_bytes);
+  ~PooledCPUAllocator();
+
+  void* New(size_t nbytes) override;
+  void Delete(void* data) override;
+
+  Stats GetStats() const;
+
+  /**
+   * Returns the memory held by the central cache and by the cache of the
+   * calling thread to the system. The caches of other threads are left alone.
+   */
+  void FreeCached();
+
+  // Exposed for the thread caches.
+  struct Central;
+
+ private:
+  std::shared_ptr<Central> central_;
+
+  DISABLE_COPY_AND_ASSIGN(PooledCPUAllocator);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_POOLED_ALLOCATOR_H_
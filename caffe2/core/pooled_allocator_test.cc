@@ -0,0 +1,87 @@
+#include <thread>  // NOLINT
+
+#include "caffe2/core/pooled_allocator.h"
+#include "caffe2/core/tensor.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+TEST(PooledCPUAllocatorTest, Alignment) {
+  PooledCPUAllocator allocator;
+  for (size_t nbytes : {1, 63, 64, 65, 1000, 100000, 100 << 20}) {
+    void* data = allocator.New(nbytes);
+    EXPECT_EQ(
+        reinterpret_cast<size_t>(data) % kPooledCPUAllocatorAlignment, 0);
+    EXPECT_EQ(static_cast<char*>(data)[nbytes - 1], 0);
+    allocator.Delete(data);
+  }
+}
+
+TEST(PooledCPUAllocatorTest, ReusesFreedBlocks) {
+  PooledCPUAllocator allocator;
+  void* data = allocator.New(1000);
+  memset(data, 1, 1000);
+  allocator.Delete(data);
+  // 1000 and 1010 bytes are in the same size class.
+  void* reused = allocator.New(1010);
+  EXPECT_EQ(reused, data);
+  // New memory is zeroed, like with the default allocator.
+  EXPECT_EQ(static_cast<char*>(reused)[0], 0);
+  allocator.Delete(reused);
+}
+
+TEST(PooledCPUAllocatorTest, Stats) {
+  PooledCPUAllocator allocator;
+  void* small = allocator.New(100);
+  void* large = allocator.New(100 << 20);
+  auto stats = allocator.GetStats();
+  // 100 bytes are rounded up to the 112 byte class.
+  EXPECT_EQ(stats.bytes_in_use, 112 + (100 << 20));
+  EXPECT_EQ(stats.bytes_cached, 0);
+  allocator.Delete(small);
+  allocator.Delete(large);
+  stats = allocator.GetStats();
+  EXPECT_EQ(stats.bytes_in_use, 0);
+  // Large allocations are never cached.
+  EXPECT_EQ(stats.bytes_cached, 112);
+  allocator.FreeCached();
+  EXPECT_EQ(allocator.GetStats().bytes_cached, 0);
+}
+
+TEST(PooledCPUAllocatorTest, CachesLimits) {
+  // Neither the thread cache nor the central cache hold more than 1KB.
+  PooledCPUAllocator allocator(1024, 1024);
+  vector<void*> blocks;
+  for (int i = 0; i < 8; ++i) {
+    blocks.push_back(allocator.New(512));
+  }
+  for (void* data : blocks) {
+    allocator.Delete(data);
+  }
+  EXPECT_EQ(allocator.GetStats().bytes_cached, 2048);
+}
+
+TEST(PooledCPUAllocatorTest, DeleteFromOtherThread) {
+  PooledCPUAllocator allocator;
+  void* data = allocator.New(4096);
+  std::thread([&]() { allocator.Delete(data); }).join();
+  // The other thread handed its cache back when it exited.
+  EXPECT_EQ(allocator.GetStats().bytes_in_use, 0);
+  EXPECT_EQ(allocator.GetStats().bytes_cached, 4096);
+  EXPECT_EQ(allocator.New(4096), data);
+  allocator.Delete(data);
+}
+
+TEST(PooledCPUAllocatorTest, TensorsUseInstalledAllocator) {
+  auto* allocator = new PooledCPUAllocator();
+  SetCPUAllocator(allocator);
+  {
+    TensorCPU tensor(vector<TIndex>{16, 16});
+    tensor.mutable_data<float>();
+    EXPECT_EQ(allocator->GetStats().bytes_in_use, 16 * 16 * sizeof(float));
+  }
+  EXPECT_EQ(allocator->GetStats().bytes_in_use, 0);
+  SetCPUAllocator(new DefaultCPUAllocator());
+}
+
+} // namespace caffe2
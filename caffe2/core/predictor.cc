@@ -1,34 +1,100 @@
 #include "caffe2/core/predictor.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include "caffe2/core/conv_bn_folding.h"
+#include "caffe2/core/one_hot_fc_rewrite.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_bool(
+    caffe2_predictor_fold_conv_bn,
+    true,
+    "If set, predictors fold the inference SpatialBN and Relu operators that "
+    "follow convolutions of the run net into the convolutions (see "
+    "core/conv_bn_folding.h), once the init net has run.");
+CAFFE2_DEFINE_bool(
+    caffe2_predictor_rewrite_one_hot_fc,
+    true,
+    "If set, predictors replace the FC operators that read the output of a "
+    "OneHot by gathers of rows of the transposed weights (see "
+    "core/one_hot_fc_rewrite.h), once the init net has run.");
+
 namespace caffe2 {
 
 namespace {
 
-void enforceIsTensor(Workspace* ws, const std::string& name) {
-  auto blob = ws->GetBlob(name);
+void enforceIsTensor(const Blob* blob, const std::string& name) {
   CAFFE_ENFORCE(blob, "Blob does not exist: ", name);
   CAFFE_ENFORCE(
       blob->template IsType<TensorCPU>(), "Blob is not a CPU Tensor: ", name);
 }
 
-void shareInputTensor(
-    Workspace* ws,
-    const std::string& name,
-    TensorCPU* input) {
-  enforceIsTensor(ws, name);
-  auto* blob = ws->GetBlob(name);
-  CAFFE_ENFORCE(blob, "Blob: ", name, " does not exist");
+void shareInputTensor(Blob* blob, const std::string& name, TensorCPU* input) {
+  enforceIsTensor(blob, name);
   auto* tensor = blob->template GetMutable<TensorCPU>();
   tensor->ResizeLike(*input);
   tensor->ShareData(*input);
 }
 
-TensorCPU* extractOutputTensor(Workspace* ws, const std::string& name) {
-  enforceIsTensor(ws, name);
-  auto* blob = ws->GetBlob(name);
-  CAFFE_ENFORCE(blob, "Blob: ", name, " does not exist");
+TensorCPU* extractOutputTensor(Blob* blob, const std::string& name) {
+  enforceIsTensor(blob, name);
   return blob->template GetMutable<TensorCPU>();
 }
+
+// Looks up the blobs of the names once, so that runs do not look them up by
+// name. Blobs that do not exist are nullptr.
+std::vector<Blob*> resolveBlobs(
+    Workspace* ws,
+    const google::protobuf::RepeatedPtrField<std::string>& names) {
+  std::vector<Blob*> blobs;
+  for (const auto& name : names) {
+    blobs.push_back(ws->HasBlob(name) ? ws->GetBlob(name) : nullptr);
+  }
+  return blobs;
+}
+
+// Returns the resolved blob, looking it up again if it did not exist then.
+Blob* resolvedBlob(Workspace* ws, Blob** blob, const std::string& name) {
+  if (!*blob && ws->HasBlob(name)) {
+    *blob = ws->GetBlob(name);
+  }
+  return *blob;
+}
+
+// Copies `input` to `padded`, with zeros up to `rows` rows.
+void padInput(const TensorCPU& input, TIndex rows, TensorCPU* padded) {
+  const auto& meta = input.meta();
+  CAFFE_ENFORCE(
+      !meta.copy(), "Only inputs of fundamental types can be padded.");
+  auto dims = input.dims();
+  dims[0] = rows;
+  padded->Resize(dims);
+  auto* data = static_cast<char*>(padded->raw_mutable_data(meta));
+  memcpy(data, input.raw_data(), input.nbytes());
+  memset(data + input.nbytes(), 0, padded->nbytes() - input.nbytes());
+}
+
+// Reads a byte of every page of the CPU tensors of ws, and of its parents,
+// so that the pages of tensors mapped from a file are faulted in.
+void touchTensorPages(Workspace* ws) {
+  constexpr size_t kPageSize = 4096;
+  volatile char sink = 0;
+  for (const auto& name : ws->Blobs()) {
+    const Blob* blob = ws->GetBlob(name);
+    if (!blob || !blob->IsType<TensorCPU>()) {
+      continue;
+    }
+    const auto& tensor = blob->Get<TensorCPU>();
+    if (tensor.nbytes() == 0) {
+      continue;
+    }
+    const char* data = static_cast<const char*>(tensor.raw_data());
+    for (size_t offset = 0; offset < tensor.nbytes(); offset += kPageSize) {
+      sink = sink + data[offset];
+    }
+  }
+}
 }
 
 Predictor::Predictor(
@@ -36,21 +102,224 @@ Predictor::Predictor(
     const NetDef& run_net,
     Workspace* parent)
     : run_net_(run_net), ws_(parent) {
+  if (parent) {
+    ws_.ShareTensorsCopyOnWrite();
+  }
   CAFFE_ENFORCE(ws_.RunNetOnce(init_net));
-  CAFFE_ENFORCE(ws_.CreateNet(run_net));
+  if (FLAGS_caffe2_predictor_fold_conv_bn) {
+    run_net_ = FoldConvBatchNorm(run_net_, &ws_);
+  }
+  if (FLAGS_caffe2_predictor_rewrite_one_hot_fc) {
+    run_net_ = RewriteOneHotFC(run_net_, &ws_);
+  }
+  CAFFE_ENFORCE(ws_.CreateNet(run_net_));
+  input_blobs_ = resolveBlobs(&ws_, run_net_.external_input());
+  output_blobs_ = resolveBlobs(&ws_, run_net_.external_output());
 }
 
-void Predictor::run(const TensorVector& inputs, TensorVector* outputs) {
+void Predictor::specializeShapes(
+    size_t max_instances,
+    std::vector<TIndex> batch_buckets) {
+  CAFFE_ENFORCE(
+      std::is_sorted(batch_buckets.begin(), batch_buckets.end()),
+      "The batch buckets must be sorted.");
+  max_shape_instances_ = max_instances;
+  batch_buckets_ = std::move(batch_buckets);
+  shape_instances_.clear();
+}
+
+void Predictor::warmup(const TensorVector& sample_inputs, int iters) {
+  CAFFE_ENFORCE_GT(iters, 0);
+  touchTensorPages(&ws_);
+  TensorVector outputs;
+  for (int i = 0; i < iters; ++i) {
+    run(sample_inputs, &outputs);
+  }
+  warmed_up_ = true;
+}
+
+void Predictor::shareInputs(const TensorVector& inputs) {
+  CAFFE_ENFORCE(inputs.size() <= run_net_.external_input_size());
+  for (auto i = 0; i < inputs.size(); ++i) {
+    const auto& name = run_net_.external_input(i);
+    shareInputTensor(
+        resolvedBlob(&ws_, &input_blobs_[i], name), name, inputs[i]);
+  }
+}
+
+Predictor::RunTarget Predictor::feedInputs(const TensorVector& inputs) {
+  RunTarget target;
+  if (max_shape_instances_ == 0) {
+    shareInputs(inputs);
+    target.ws = &ws_;
+    target.net = ws_.GetNet(run_net_.name());
+    target.outputs = &output_blobs_;
+    return target;
+  }
   CAFFE_ENFORCE(inputs.size() <= run_net_.external_input_size());
+  if (!batch_buckets_.empty() && !inputs.empty()) {
+    for (auto* input : inputs) {
+      CAFFE_ENFORCE(
+          input->ndim() > 0 && input->dim(0) == inputs[0]->dim(0),
+          "With batch buckets, the inputs must have the same first "
+          "dimension.");
+    }
+    const TIndex rows = inputs[0]->dim(0);
+    auto bucket =
+        std::lower_bound(batch_buckets_.begin(), batch_buckets_.end(), rows);
+    if (bucket != batch_buckets_.end() && *bucket != rows) {
+      target.rows = rows;
+      target.padded_rows = *bucket;
+    }
+  }
+  auto* instance = findShapeInstance(inputs, target.padded_rows);
+  target.ws = instance->ws.get();
+  target.net = instance->net;
+  target.outputs = &instance->output_blobs;
+  return target;
+}
+
+Predictor::ShapeInstance* Predictor::findShapeInstance(
+    const TensorVector& inputs,
+    TIndex padded_rows) {
+  std::vector<std::vector<TIndex>> dims;
+  std::vector<CaffeTypeId> types;
+  for (auto* input : inputs) {
+    dims.push_back(input->dims());
+    if (padded_rows >= 0) {
+      dims.back()[0] = padded_rows;
+    }
+    types.push_back(input->meta().id());
+  }
+  for (auto it = shape_instances_.begin(); it != shape_instances_.end();
+       ++it) {
+    if ((*it)->dims == dims && (*it)->types == types) {
+      shape_instances_.splice(
+          shape_instances_.begin(), shape_instances_, it);
+      auto* instance = shape_instances_.front().get();
+      feedShapeInstance(instance, inputs, padded_rows);
+      return instance;
+    }
+  }
+
+  if (shape_instances_.size() >= max_shape_instances_) {
+    shape_instances_.pop_back();
+  }
+  auto instance = make_unique<ShapeInstance>();
+  instance->dims = std::move(dims);
+  instance->types = std::move(types);
+  instance->ws = make_unique<Workspace>(&ws_);
+  instance->ws->ShareTensorsCopyOnWrite();
+  // The inputs, activations and outputs of the instance are its own, even
+  // though the run net of ws_ created blobs of the same names.
+  for (const auto& input : run_net_.external_input()) {
+    instance->input_blobs.push_back(instance->ws->CreateLocalBlob(input));
+  }
+  for (const auto& op : run_net_.op()) {
+    for (const auto& output : op.output()) {
+      instance->ws->CreateLocalBlob(output);
+    }
+  }
+  instance->padded_inputs.resize(inputs.size());
+  // The inputs are fed first, so that the memory is planned for their shape.
+  feedShapeInstance(instance.get(), inputs, padded_rows);
+  NetDef net_def = run_net_;
+  net_def.clear_arg();
+  for (const auto& arg : run_net_.arg()) {
+    if (arg.name() != "static_memory_planning") {
+      net_def.add_arg()->CopyFrom(arg);
+    }
+  }
+  net_def.add_arg()->CopyFrom(MakeArgument<int>("static_memory_planning", 1));
+  instance->net = instance->ws->CreateNet(net_def);
+  CAFFE_ENFORCE(instance->net);
+  instance->output_blobs =
+      resolveBlobs(instance->ws.get(), run_net_.external_output());
+  shape_instances_.push_front(std::move(instance));
+  return shape_instances_.front().get();
+}
+
+void Predictor::feedShapeInstance(
+    ShapeInstance* instance,
+    const TensorVector& inputs,
+    TIndex padded_rows) {
   for (auto i = 0; i < inputs.size(); ++i) {
-    shareInputTensor(&ws_, run_net_.external_input(i), inputs[i]);
+    TensorCPU* input = inputs[i];
+    if (padded_rows >= 0) {
+      padInput(*input, padded_rows, &instance->padded_inputs[i]);
+      input = &instance->padded_inputs[i];
+    }
+    auto* tensor = instance->input_blobs[i]->GetMutable<TensorCPU>();
+    tensor->ResizeLike(*input);
+    tensor->ShareData(*input);
   }
+}
 
-  CAFFE_ENFORCE(ws_.RunNet(run_net_.name()));
+void Predictor::unpadOutputs(const RunTarget& target) {
+  if (target.padded_rows < 0) {
+    return;
+  }
+  for (int i = 0; i < run_net_.external_output_size(); ++i) {
+    const auto& name = run_net_.external_output(i);
+    auto* tensor = extractOutputTensor(
+        resolvedBlob(target.ws, &(*target.outputs)[i], name), name);
+    if (tensor->ndim() > 0 && tensor->dim(0) == target.padded_rows) {
+      tensor->Shrink(target.rows);
+    }
+  }
+}
+
+void Predictor::run(const TensorVector& inputs, TensorVector* outputs) {
+  auto target = feedInputs(inputs);
+  {
+    NetTraceRunScope trace_scope(run_net_.name());
+    CAFFE_ENFORCE(target.net->Run());
+  }
+  unpadOutputs(target);
 
   outputs->resize(run_net_.external_output_size());
   for (auto i = 0; i < outputs->size(); ++i) {
-    (*outputs)[i] = extractOutputTensor(&ws_, run_net_.external_output(i));
+    const auto& name = run_net_.external_output(i);
+    (*outputs)[i] = extractOutputTensor(
+        resolvedBlob(target.ws, &(*target.outputs)[i], name), name);
+  }
+}
+
+void Predictor::runAndTakeOutputs(
+    const TensorVector& inputs,
+    std::vector<TensorCPU>* outputs) {
+  auto target = feedInputs(inputs);
+  outputs->resize(run_net_.external_output_size());
+  for (auto i = 0; i < outputs->size(); ++i) {
+    auto& output = (*outputs)[i];
+    if (output.size() > 0 && output.capacity_nbytes() > 0 &&
+        !output.is_copy_on_write()) {
+      // Lend the buffer: operators that produce an output of the same size
+      // and type write into it directly.
+      auto& blob = (*target.outputs)[i];
+      if (!blob) {
+        blob = target.ws->CreateBlob(run_net_.external_output(i));
+      }
+      auto* tensor = blob->GetMutable<TensorCPU>();
+      tensor->ResizeLike(output);
+      tensor->ShareData(output);
+    }
+  }
+
+  {
+    NetTraceRunScope trace_scope(run_net_.name());
+    CAFFE_ENFORCE(target.net->Run());
+  }
+  unpadOutputs(target);
+
+  for (auto i = 0; i < outputs->size(); ++i) {
+    const auto& name = run_net_.external_output(i);
+    auto* tensor = extractOutputTensor(
+        resolvedBlob(target.ws, &(*target.outputs)[i], name), name);
+    auto& output = (*outputs)[i];
+    output.ResizeLike(*tensor);
+    output.ShareData(*tensor);
+    tensor->FreeMemory();
   }
 }
 }
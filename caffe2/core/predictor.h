@@ -1,5 +1,8 @@
 #pragma once
 
+#include <list>
+#include <memory>
+
 #include "caffe2/core/net.h"
 #include "caffe2/core/tensor.h"
 
@@ -10,6 +13,9 @@ class Predictor {
   using TensorVector = std::vector<TensorCPU*>;
   // Runs the `init_net` once, then saves the `run_net` to be executed
   // in `::run`
+  // The CPU tensors of the `parent` workspace are shared copy-on-write, so
+  // several predictors can share one copy of the weights, and a net that
+  // modifies a weight only modifies a private copy of it.
   Predictor(
       const NetDef& init_net,
       const NetDef& run_net,
@@ -18,6 +24,9 @@ class Predictor {
   // Executes `run_net` on the inputs.
   // The first `inputs.size()` inputs from run_net::external_inputs
   // are shared with the data in `inputs`.
+  // Inputs can be views over buffers owned by the caller (see
+  // Tensor::ShareExternalPointer() with a deleter), which are then used
+  // without a copy and kept alive while the workspace uses them.
 
   // Precondition:
   //   inputs.size() <= run_net_.external_inputs.size()
@@ -26,6 +35,57 @@ class Predictor {
   //   outputs->size() == run_net.external_inputs.size()
   void run(const TensorVector& inputs, TensorVector* outputs);
 
+  // Executes `run_net` like `run`, but hands the outputs over to the caller
+  // instead of pointing into the workspace, so that they stay valid across
+  // runs without a copy. Each output takes the storage of the workspace's
+  // tensor, which allocates a fresh one on the next run.
+  // An output that the caller already allocated, with the size the net
+  // produces, is lent to the net for the run, and written in place.
+
+  // Postcondition:
+  //   outputs->size() == run_net.external_outputs.size()
+  void runAndTakeOutputs(
+      const TensorVector& inputs,
+      std::vector<TensorCPU>* outputs);
+
+  // Drives the lazy initialization of `run_net` before the first request, so
+  // that it does not add to its latency: the pages of the weights, which may
+  // be mapped from a file (see core/mmap_checkpoint.h), are faulted in, and
+  // the net runs `iters` times on `sample_inputs`, which allocates the
+  // activations, creates the thread pools and lets operators such as the
+  // cuDNN ones pick their algorithms. Since buffers are kept when a tensor
+  // shrinks, later runs on inputs no larger than the samples do not
+  // allocate. With specializeShapes, warm up each shape to serve.
+  void warmup(const TensorVector& sample_inputs, int iters = 2);
+
+  // Whether warmup has completed, e.g. to report the predictor as ready.
+  bool isWarmedUp() const {
+    return warmed_up_;
+  }
+
+  // Runs each distinct shape of the inputs with an instance of `run_net` of
+  // its own, created on the first run with that shape, in a child workspace
+  // that shares the weights copy-on-write. The memory of the intermediate
+  // blobs of an instance is planned once for its shape (see
+  // core/memory_planner.h), and the state of its operators, such as the
+  // algorithms picked by cuDNN, is kept across runs. The `max_instances` most
+  // recently used instances are kept.
+  //
+  // With `batch_buckets`, a sorted list of sizes, the inputs, which must then
+  // have the same first dimension, are padded with zeros up to the smallest
+  // bucket that holds them, and the outputs whose first dimension is the
+  // bucket are cut back to the rows of the inputs. Sizes beyond the last
+  // bucket are not padded. This bounds the number of instances when the batch
+  // size varies, at the cost of the padding.
+  void specializeShapes(
+      size_t max_instances,
+      std::vector<TIndex> batch_buckets = {});
+
+  // The number of shape-specialized instances that are kept.
+  size_t numShapeInstances() const {
+    return shape_instances_.size();
+  }
+
   const NetDef& def() const {
     return run_net_;
   };
@@ -35,7 +95,53 @@ class Predictor {
   };
 
  private:
+  struct ShapeInstance {
+    std::vector<std::vector<TIndex>> dims;
+    std::vector<CaffeTypeId> types;
+    std::unique_ptr<Workspace> ws;
+    NetBase* net = nullptr;
+    // The buffers that padded inputs are copied to.
+    std::vector<TensorCPU> padded_inputs;
+    // The blobs of the external inputs and outputs of the run net in ws.
+    std::vector<Blob*> input_blobs;
+    std::vector<Blob*> output_blobs;
+  };
+
+  // Where a run happens: the workspace that the inputs were fed to, its net,
+  // and the blobs of the outputs in it. If the inputs were padded, `rows` is
+  // the number of rows of the inputs, and `padded_rows` the number of rows
+  // after padding.
+  struct RunTarget {
+    Workspace* ws;
+    NetBase* net;
+    std::vector<Blob*>* outputs;
+    TIndex rows = -1;
+    TIndex padded_rows = -1;
+  };
+
+  void shareInputs(const TensorVector& inputs);
+  RunTarget feedInputs(const TensorVector& inputs);
+  ShapeInstance* findShapeInstance(
+      const TensorVector& inputs,
+      TIndex padded_rows);
+  void feedShapeInstance(
+      ShapeInstance* instance,
+      const TensorVector& inputs,
+      TIndex padded_rows);
+  // Cuts the outputs of a padded run back to the rows of the inputs.
+  void unpadOutputs(const RunTarget& target);
+
   NetDef run_net_;
   Workspace ws_;
+  // The blobs of the external inputs and outputs of the run net in ws_,
+  // nullptr for those that did not exist once it was created.
+  std::vector<Blob*> input_blobs_;
+  std::vector<Blob*> output_blobs_;
+
+  size_t max_shape_instances_ = 0;
+  std::vector<TIndex> batch_buckets_;
+  // Most recently used first.
+  std::list<std::unique_ptr<ShapeInstance>> shape_instances_;
+  bool warmed_up_ = false;
 };
 }
@@ -0,0 +1,101 @@
+#include "caffe2/core/predictor_package.h"
+
+#include <set>
+
+#include "caffe2/core/conv_bn_folding.h"
+#include "caffe2/core/elementwise_fusion.h"
+#include "caffe2/core/mmap_checkpoint.h"
+#include "caffe2/core/one_hot_fc_rewrite.h"
+#include "caffe2/utils/proto_utils.h"
+
+namespace caffe2 {
+
+namespace {
+
+// The run net is stored in the package as the bytes of its serialization.
+constexpr char kRunNetName[] = "__predictor_package_run_net__";
+
+void setNetArgument(const string& name, int value, NetDef* net_def) {
+  for (auto& arg : *net_def->mutable_arg()) {
+    if (arg.name() == name) {
+      arg.CopyFrom(MakeArgument<int>(name, value));
+      return;
+    }
+  }
+  net_def->add_arg()->CopyFrom(MakeArgument<int>(name, value));
+}
+}
+
+void WritePredictorPackage(
+    const NetDef& init_net,
+    const NetDef& run_net,
+    const string& filename) {
+  Workspace ws;
+  CAFFE_ENFORCE(ws.RunNetOnce(init_net));
+  NetDef optimized = FoldConvBatchNorm(run_net, &ws);
+  optimized = RewriteOneHotFC(optimized, &ws);
+  optimized = FuseElementwiseOps(optimized);
+  // Already fused, so nothing is left for the load-time fusion.
+  setNetArgument("fuse_elementwise", 0, &optimized);
+  setNetArgument("static_memory_planning", 1, &optimized);
+
+  std::set<string> read;
+  for (const auto& op : optimized.op()) {
+    read.insert(op.input().begin(), op.input().end());
+  }
+  vector<std::pair<string, const TensorCPU*>> tensors;
+  for (const string& name : ws.Blobs()) {
+    const Blob* blob = ws.GetBlob(name);
+    if (read.count(name) && blob->IsType<TensorCPU>()) {
+      tensors.emplace_back(name, &blob->Get<TensorCPU>());
+    }
+  }
+
+  string serialized;
+  CAFFE_ENFORCE(optimized.SerializeToString(&serialized));
+  TensorCPU net_bytes(vector<TIndex>{static_cast<TIndex>(serialized.size())});
+  std::copy(
+      serialized.begin(),
+      serialized.end(),
+      net_bytes.mutable_data<uint8_t>());
+  tensors.emplace_back(kRunNetName, &net_bytes);
+  MmapCheckpoint::Write(filename, tensors);
+}
+
+PredictorPackageNets ReadPredictorPackage(const string& filename) {
+  auto checkpoint = MmapCheckpoint::Open(filename);
+  CAFFE_ENFORCE(
+      checkpoint->Has(kRunNetName), "Not a predictor package: ", filename);
+  PredictorPackageNets nets;
+  TensorCPU net_bytes;
+  checkpoint->ShareTensor(kRunNetName, &net_bytes);
+  CAFFE_ENFORCE(
+      nets.run_net.ParseFromArray(net_bytes.data<uint8_t>(), net_bytes.size()),
+      "Cannot parse the run net of ",
+      filename);
+
+  vector<string> weights;
+  for (const string& name : checkpoint->names()) {
+    if (name != kRunNetName) {
+      weights.push_back(name);
+    }
+  }
+  nets.init_net.set_name(nets.run_net.name() + "_package_init");
+  nets.init_net.add_op()->CopyFrom(CreateOperatorDef(
+      "Load",
+      "",
+      vector<string>{},
+      weights,
+      vector<Argument>{MakeArgument<string>("db", filename),
+                       MakeArgument<string>("db_type", kMmapCheckpointDBType),
+                       MakeArgument<int>("absolute_path", 1)}));
+  return nets;
+}
+
+std::unique_ptr<Predictor> LoadPredictorPackage(
+    const string& filename,
+    Workspace* parent) {
+  auto nets = ReadPredictorPackage(filename);
+  return make_unique<Predictor>(nets.init_net, nets.run_net, parent);
+}
+}
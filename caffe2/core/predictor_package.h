@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+
+#include "caffe2/core/predictor.h"
+
+namespace caffe2 {
+
+// A predictor package is a model optimized for inference ahead of time and
+// saved as a single MmapCheckpoint file (see core/mmap_checkpoint.h), so that
+// loading it parses no weights and runs no fill operators.
+//
+// WritePredictorPackage runs `init_net`, then rewrites `run_net` with the
+// load-time passes: conv/BN folding (core/conv_bn_folding.h) against the
+// initialized weights and element-wise fusion (core/elementwise_fusion.h).
+// Static memory planning (core/memory_planner.h) is turned on for the
+// rewritten net; it needs the shapes of the loaded weights, so it runs when
+// the net is instantiated. The package holds the rewritten net and the CPU
+// tensors that it reads from the initialized workspace.
+void WritePredictorPackage(
+    const NetDef& init_net,
+    const NetDef& run_net,
+    const string& filename);
+
+// The nets to construct a Predictor or PredictorPool from a package with:
+// `init_net` is a single mmap Load operator, whose tensors alias the mapping
+// of the package instead of being copied.
+struct PredictorPackageNets {
+  NetDef init_net;
+  NetDef run_net;
+};
+
+PredictorPackageNets ReadPredictorPackage(const string& filename);
+
+// Shorthand for a Predictor on the nets of ReadPredictorPackage.
+std::unique_ptr<Predictor> LoadPredictorPackage(
+    const string& filename,
+    Workspace* parent = nullptr);
+}
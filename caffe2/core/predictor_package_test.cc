@@ -0,0 +1,133 @@
+#include <cstdio>
+
+#include <google/protobuf/text_format.h>
+#include "caffe2/core/mmap_checkpoint.h"
+#include "caffe2/core/predictor_package.h"
+
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+const char* predictSpec = R"DOC(
+        name: "predict"
+        type: "simple"
+        external_input: "data"
+        external_input: "W"
+        external_input: "b"
+        external_output: "y"
+        op {
+          input: "data"
+          input: "W"
+          input: "b"
+          output: "fc"
+          type: "FC"
+        }
+        op {
+          input: "fc"
+          output: "relu"
+          type: "Relu"
+        }
+        op {
+          input: "relu"
+          output: "y"
+          type: "Sigmoid"
+        }
+)DOC";
+
+const char* initSpec = R"DOC(
+        name: "init"
+        op {
+          type: "ConstantFill"
+          output: "data"
+          arg {
+            name: "shape"
+            ints: 1
+            ints: 4
+          }
+        }
+        op {
+          type: "UniformFill"
+          output: "W"
+          arg {
+            name: "shape"
+            ints: 10
+            ints: 4
+          }
+          arg {
+            name: "min"
+            f: -1.0
+          }
+          arg {
+            name: "max"
+            f: 1.0
+          }
+        }
+        op {
+          type: "ConstantFill"
+          output: "b"
+          arg {
+            name: "shape"
+            ints: 10
+          }
+          arg {
+            name: "value"
+            f: 0.1
+          }
+        }
+)DOC";
+
+NetDef parseNetDef(const std::string& value) {
+  NetDef def;
+  CAFFE_ENFORCE(
+      google::protobuf::TextFormat::ParseFromString(value, &def),
+      "Failed to parse NetDef with value: ",
+      value);
+  return def;
+}
+}
+
+TEST(PredictorPackageTest, MatchesPredictor) {
+  string filename = std::tmpnam(nullptr);
+  // The init net is deterministic, so that both predictors get the same W.
+  auto init = parseNetDef(initSpec);
+  init.mutable_device_option()->set_random_seed(1701);
+  for (auto& op : *init.mutable_op()) {
+    op.mutable_device_option()->set_random_seed(1701);
+  }
+  WritePredictorPackage(init, parseNetDef(predictSpec), filename);
+  Predictor reference(init, parseNetDef(predictSpec));
+  auto packaged = LoadPredictorPackage(filename);
+
+  // The element-wise chain was fused ahead of time.
+  const auto& run_net = packaged->def();
+  ASSERT_EQ(run_net.op_size(), 2);
+  EXPECT_EQ(run_net.op(1).type(), "FusedElementwise");
+
+  TensorCPU input(vector<TIndex>{2, 4});
+  for (int i = 0; i < input.size(); ++i) {
+    input.mutable_data<float>()[i] = i * 0.25 - 1;
+  }
+  Predictor::TensorVector inputs{&input};
+  Predictor::TensorVector expected, actual;
+  reference.run(inputs, &expected);
+  packaged->run(inputs, &actual);
+  ASSERT_EQ(actual.size(), 1);
+  ASSERT_EQ(actual[0]->dims(), expected[0]->dims());
+  for (int i = 0; i < expected[0]->size(); ++i) {
+    EXPECT_NEAR(
+        actual[0]->data<float>()[i], expected[0]->data<float>()[i], 1e-6);
+  }
+  std::remove(filename.c_str());
+}
+
+TEST(PredictorPackageTest, RejectsPlainCheckpoint) {
+  string filename = std::tmpnam(nullptr);
+  TensorCPU weights(vector<TIndex>{3});
+  weights.mutable_data<float>();
+  MmapCheckpoint::Write(filename, {{"W", &weights}});
+  EXPECT_ANY_THROW(ReadPredictorPackage(filename));
+  std::remove(filename.c_str());
+}
+}
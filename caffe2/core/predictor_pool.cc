@@ -0,0 +1,93 @@
+#include "caffe2/core/predictor_pool.h"
+
+#include <algorithm>
+
+#include "caffe2/core/conv_bn_folding.h"
+#include "caffe2/core/one_hot_fc_rewrite.h"
+
+CAFFE2_DECLARE_bool(caffe2_predictor_fold_conv_bn);
+CAFFE2_DECLARE_bool(caffe2_predictor_rewrite_one_hot_fc);
+
+namespace caffe2 {
+
+PredictorPool::PredictorPool(
+    const NetDef& init_net,
+    const NetDef& run_net,
+    size_t max_predictors)
+    : run_net_(run_net), max_predictors_(max_predictors) {
+  CAFFE_ENFORCE_GT(max_predictors_, 0);
+  CAFFE_ENFORCE(ws_.RunNetOnce(init_net));
+  // Fold once into the shared weights, rather than once per predictor.
+  if (FLAGS_caffe2_predictor_fold_conv_bn) {
+    run_net_ = FoldConvBatchNorm(run_net_, &ws_);
+  }
+  if (FLAGS_caffe2_predictor_rewrite_one_hot_fc) {
+    run_net_ = RewriteOneHotFC(run_net_, &ws_);
+  }
+}
+
+PredictorPool::Handle PredictorPool::acquire() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  released_.wait(lock, [this] {
+    return !idle_.empty() || num_predictors_ < max_predictors_;
+  });
+  if (!idle_.empty()) {
+    Predictor* predictor = idle_.back();
+    idle_.pop_back();
+    return Handle(this, predictor);
+  }
+  // Create the predictor without holding the lock, so that the others can
+  // be acquired and released meanwhile.
+  ++num_predictors_;
+  lock.unlock();
+  std::unique_ptr<Predictor> predictor;
+  try {
+    predictor = make_unique<Predictor>(NetDef(), run_net_, &ws_);
+  } catch (...) {
+    lock.lock();
+    --num_predictors_;
+    released_.notify_one();
+    throw;
+  }
+  lock.lock();
+  predictors_.push_back(std::move(predictor));
+  return Handle(this, predictors_.back().get());
+}
+
+void PredictorPool::release(Predictor* predictor) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(predictor);
+  }
+  released_.notify_one();
+}
+
+void PredictorPool::run(
+    const TensorVector& inputs,
+    std::vector<TensorCPU>* outputs) {
+  auto predictor = acquire();
+  predictor->runAndTakeOutputs(inputs, outputs);
+}
+
+void PredictorPool::warmup(
+    const TensorVector& sample_inputs,
+    size_t num_predictors,
+    int iters) {
+  // The handles are held together, so that each acquire creates a new
+  // predictor instead of handing back the one just warmed up.
+  const size_t count = std::min(num_predictors, max_predictors_);
+  std::vector<Handle> predictors;
+  predictors.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    predictors.push_back(acquire());
+    if (!predictors.back()->isWarmedUp()) {
+      predictors.back()->warmup(sample_inputs, iters);
+    }
+  }
+}
+
+size_t PredictorPool::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return predictors_.size();
+}
+}
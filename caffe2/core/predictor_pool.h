@@ -0,0 +1,105 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "caffe2/core/predictor.h"
+
+namespace caffe2 {
+
+// A pool of Predictors of one model that threads can use concurrently.
+// The `init_net` runs once, into a workspace that the pool owns and that
+// holds the only copy of the weights. Each Predictor of the pool runs
+// `run_net` in a child workspace of it, which shares the weights
+// copy-on-write and holds its own activations.
+//
+// Predictors are created on demand, up to `max_predictors`, after which
+// `acquire` blocks until one is released. The most recently released
+// Predictor is handed out first, so that a few warmed-up Predictors, whose
+// activation buffers are already allocated, serve most of the requests.
+class PredictorPool {
+ public:
+  using TensorVector = Predictor::TensorVector;
+
+  PredictorPool(
+      const NetDef& init_net,
+      const NetDef& run_net,
+      size_t max_predictors);
+
+  // Exclusive use of one Predictor of the pool, which returns to the pool
+  // when the Handle is destroyed. The outputs of a run stay valid until then.
+  class Handle {
+   public:
+    Handle(Handle&& other) : pool_(other.pool_), predictor_(other.predictor_) {
+      other.predictor_ = nullptr;
+    }
+    ~Handle() {
+      if (predictor_) {
+        pool_->release(predictor_);
+      }
+    }
+
+    Predictor* operator->() const {
+      return predictor_;
+    }
+    Predictor* get() const {
+      return predictor_;
+    }
+
+   private:
+    friend class PredictorPool;
+    Handle(PredictorPool* pool, Predictor* predictor)
+        : pool_(pool), predictor_(predictor) {}
+
+    PredictorPool* pool_;
+    Predictor* predictor_;
+
+    DISABLE_COPY_AND_ASSIGN(Handle);
+  };
+
+  // Takes an idle Predictor, or creates one if there are fewer than
+  // `max_predictors`, or else waits for one to be released.
+  Handle acquire();
+
+  // Runs `run_net` on the inputs with an idle Predictor, whose outputs are
+  // handed over to the caller without a copy, as with
+  // Predictor::runAndTakeOutputs. Safe to call from several threads at once.
+  void run(const TensorVector& inputs, std::vector<TensorCPU>* outputs);
+
+  // Creates up to `num_predictors` Predictors, at most `max_predictors`, and
+  // warms each of them up on `sample_inputs` (see Predictor::warmup), so
+  // that the first requests served concurrently do not pay for the lazy
+  // initialization. Meant to be called before serving.
+  void warmup(
+      const TensorVector& sample_inputs,
+      size_t num_predictors,
+      int iters = 2);
+
+  // The workspace holding the weights, which must not be modified once
+  // predictors are created.
+  Workspace* ws() {
+    return &ws_;
+  }
+
+  // The number of Predictors created so far.
+  size_t size();
+
+ private:
+  void release(Predictor* predictor);
+
+  Workspace ws_;
+  NetDef run_net_;
+  const size_t max_predictors_;
+
+  std::mutex mutex_;
+  std::condition_variable released_;
+  // Includes the predictors being created, which are not in predictors_ yet.
+  size_t num_predictors_ = 0;
+  std::vector<std::unique_ptr<Predictor>> predictors_;
+  std::vector<Predictor*> idle_;
+
+  DISABLE_COPY_AND_ASSIGN(PredictorPool);
+};
+}
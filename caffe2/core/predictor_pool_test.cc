@@ -0,0 +1,154 @@
+#include <thread>
+
+#include <google/protobuf/text_format.h>
+#include "caffe2/core/predictor_pool.h"
+
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+const char* predictSpec = R"DOC(
+        name: "predict"
+        type: "simple"
+        external_input: "data"
+        external_input: "W"
+        external_input: "b"
+        external_output: "y"
+        op {
+          input: "data"
+          input: "W"
+          input: "b"
+          output: "y"
+          type: "FC"
+        }
+)DOC";
+
+const char* initSpec = R"DOC(
+        name: "init"
+        op {
+          type: "ConstantFill"
+          output: "data"
+          arg {
+            name: "shape"
+            ints: 1
+            ints: 4
+          }
+        }
+        op {
+          type: "ConstantFill"
+          output: "W"
+          arg {
+            name: "shape"
+            ints: 10
+            ints: 4
+          }
+          arg {
+            name: "value"
+            f: 2.0
+          }
+        }
+        op {
+          type: "ConstantFill"
+          output: "b"
+          arg {
+            name: "shape"
+            ints: 10
+          }
+          arg {
+            name: "value"
+            f: 2.0
+          }
+        }
+)DOC";
+
+NetDef parseNetDef(const std::string& value) {
+  NetDef def;
+  CAFFE_ENFORCE(
+      google::protobuf::TextFormat::ParseFromString(value, &def),
+      "Failed to parse NetDef with value: ",
+      value);
+  return def;
+}
+
+TensorCPU constantInput(float value) {
+  TensorCPU input(vector<TIndex>{1, 4});
+  for (int i = 0; i < 4; ++i) {
+    input.mutable_data<float>()[i] = value;
+  }
+  return input;
+}
+}
+
+TEST(PredictorPoolTest, SharesWeights) {
+  PredictorPool pool(parseNetDef(initSpec), parseNetDef(predictSpec), 2);
+  auto input = constantInput(1);
+  PredictorPool::TensorVector inputs{&input};
+  PredictorPool::TensorVector outputs;
+  auto first = pool.acquire();
+  auto second = pool.acquire();
+  EXPECT_EQ(pool.size(), 2);
+  first->run(inputs, &outputs);
+  // W and b are filled with 2, so every output is 4 * 1 * 2 + 2.
+  EXPECT_FLOAT_EQ(outputs.front()->data<float>()[0], 10.0);
+  const float* weights =
+      pool.ws()->GetBlob("W")->Get<TensorCPU>().data<float>();
+  for (auto* predictor : {first.get(), second.get()}) {
+    EXPECT_EQ(
+        predictor->ws()->GetBlob("W")->Get<TensorCPU>().data<float>(),
+        weights);
+  }
+}
+
+TEST(PredictorPoolTest, ReusesReleasedPredictor) {
+  PredictorPool pool(parseNetDef(initSpec), parseNetDef(predictSpec), 4);
+  Predictor* predictor;
+  {
+    auto handle = pool.acquire();
+    predictor = handle.get();
+  }
+  EXPECT_EQ(pool.acquire().get(), predictor);
+  EXPECT_EQ(pool.size(), 1);
+}
+
+TEST(PredictorPoolTest, Warmup) {
+  PredictorPool pool(parseNetDef(initSpec), parseNetDef(predictSpec), 2);
+  auto input = constantInput(1);
+  PredictorPool::TensorVector inputs{&input};
+  pool.warmup(inputs, 3);
+  EXPECT_EQ(pool.size(), 2);
+  auto first = pool.acquire();
+  auto second = pool.acquire();
+  EXPECT_TRUE(first->isWarmedUp());
+  EXPECT_TRUE(second->isWarmedUp());
+}
+
+TEST(PredictorPoolTest, ConcurrentRuns) {
+  const int kThreads = 8;
+  const int kRuns = 50;
+  PredictorPool pool(parseNetDef(initSpec), parseNetDef(predictSpec), 3);
+  std::vector<std::thread> threads;
+  std::vector<int> failures(kThreads, 0);
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      auto input = constantInput(t);
+      PredictorPool::TensorVector inputs{&input};
+      std::vector<TensorCPU> outputs;
+      for (int i = 0; i < kRuns; ++i) {
+        pool.run(inputs, &outputs);
+        for (int j = 0; j < outputs[0].size(); ++j) {
+          failures[t] += outputs[0].data<float>()[j] != 8 * t + 2;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < kThreads; ++t) {
+    EXPECT_EQ(failures[t], 0) << "thread " << t;
+  }
+  EXPECT_LE(pool.size(), 3);
+}
+}
@@ -118,4 +118,152 @@ TEST_F(PredictorTest, SimpleBatchSized) {
   EXPECT_TRUE(output.front()->dim(1) == 10);
   EXPECT_NEAR(output.front()->data<float>()[4], 0.1209, 1E-4);
 }
+
+TEST_F(PredictorTest, ExternalBufferInput) {
+  auto buffer = std::make_shared<std::string>(4 * sizeof(float), '\0');
+  auto* values = reinterpret_cast<float*>(&(*buffer)[0]);
+  for (int i = 0; i < 4; ++i) {
+    values[i] = 1.0;
+  }
+  TensorCPU input(vector<TIndex>{1, 4});
+  // The view keeps the buffer alive for as long as it is used.
+  input.ShareExternalPointer(values, 0, [buffer](void*) {});
+  Predictor::TensorVector inputs{&input};
+  Predictor::TensorVector outputs;
+  p_->run(inputs, &outputs);
+  EXPECT_EQ(p_->ws()->GetBlob("data")->Get<TensorCPU>().data<float>(), values);
+  // W and b are filled with 2, so every output is 4 * 1 * 2 + 2.
+  EXPECT_FLOAT_EQ(outputs.front()->data<float>()[0], 10.0);
+  // One reference for the caller and one for the storage that the input and
+  // the workspace share.
+  EXPECT_EQ(buffer.use_count(), 2);
+}
+
+TEST_F(PredictorTest, TakeOutputs) {
+  auto inputData = randomTensor({1, 4}, ctx_.get());
+  Predictor::TensorVector input{inputData->template GetMutable<TensorCPU>()};
+  std::vector<TensorCPU> first, second;
+  p_->runAndTakeOutputs(input, &first);
+  ASSERT_EQ(first.size(), 1);
+  EXPECT_NEAR(first.front().data<float>()[4], 0.1209, 1E-4);
+  const float* firstData = first.front().data<float>();
+
+  // The next run writes into new storage, so the first outputs are intact.
+  TensorCPU ones(vector<TIndex>{1, 4});
+  for (int i = 0; i < 4; ++i) {
+    ones.mutable_data<float>()[i] = 1.0;
+  }
+  Predictor::TensorVector onesInput{&ones};
+  p_->runAndTakeOutputs(onesInput, &second);
+  EXPECT_NE(second.front().data<float>(), firstData);
+  EXPECT_NEAR(first.front().data<float>()[4], 0.1209, 1E-4);
+  EXPECT_FLOAT_EQ(second.front().data<float>()[4], 10.0);
+  EXPECT_EQ(p_->ws()->GetBlob("y")->Get<TensorCPU>().capacity_nbytes(), 0);
+}
+
+TEST_F(PredictorTest, TakeOutputsIntoPreallocated) {
+  TensorCPU ones(vector<TIndex>{1, 4});
+  for (int i = 0; i < 4; ++i) {
+    ones.mutable_data<float>()[i] = 1.0;
+  }
+  Predictor::TensorVector input{&ones};
+  std::vector<TensorCPU> outputs(1);
+  outputs.front().Resize(1, 10);
+  const float* buffer = outputs.front().mutable_data<float>();
+  p_->runAndTakeOutputs(input, &outputs);
+  EXPECT_EQ(outputs.front().data<float>(), buffer);
+  EXPECT_FLOAT_EQ(outputs.front().data<float>()[0], 10.0);
+}
+
+namespace {
+
+TensorCPU onesTensor(TIndex rows) {
+  TensorCPU ones(vector<TIndex>{rows, 4});
+  for (int i = 0; i < ones.size(); ++i) {
+    ones.mutable_data<float>()[i] = 1.0;
+  }
+  return ones;
+}
+}
+
+TEST_F(PredictorTest, Warmup) {
+  EXPECT_FALSE(p_->isWarmedUp());
+  auto three = onesTensor(3);
+  Predictor::TensorVector threeInput{&three};
+  p_->warmup(threeInput);
+  EXPECT_TRUE(p_->isWarmedUp());
+
+  // Smaller inputs reuse the buffers allocated during the warm-up.
+  auto* output = p_->ws()->GetBlob("y")->GetMutable<TensorCPU>();
+  const void* buffer = output->raw_data();
+  auto one = onesTensor(1);
+  Predictor::TensorVector oneInput{&one};
+  Predictor::TensorVector outputs;
+  p_->run(oneInput, &outputs);
+  EXPECT_EQ(outputs.front()->dims(), vector<TIndex>({1, 10}));
+  EXPECT_EQ(outputs.front()->raw_data(), buffer);
+  EXPECT_FLOAT_EQ(outputs.front()->data<float>()[9], 10.0);
+}
+
+TEST_F(PredictorTest, ShapeSpecialization) {
+  p_->specializeShapes(2);
+  auto one = onesTensor(1);
+  auto three = onesTensor(3);
+  Predictor::TensorVector oneInput{&one}, threeInput{&three};
+  Predictor::TensorVector oneOutputs, threeOutputs, outputs;
+  p_->run(oneInput, &oneOutputs);
+  p_->run(threeInput, &threeOutputs);
+  EXPECT_EQ(p_->numShapeInstances(), 2);
+  // Each shape has outputs of its own.
+  EXPECT_NE(oneOutputs.front(), threeOutputs.front());
+  EXPECT_EQ(oneOutputs.front()->dims(), vector<TIndex>({1, 10}));
+  EXPECT_EQ(threeOutputs.front()->dims(), vector<TIndex>({3, 10}));
+  EXPECT_FLOAT_EQ(threeOutputs.front()->data<float>()[29], 10.0);
+
+  p_->run(oneInput, &outputs);
+  EXPECT_EQ(outputs.front(), oneOutputs.front());
+  EXPECT_EQ(p_->numShapeInstances(), 2);
+
+  // The least recently used shape makes room for a new one.
+  auto five = onesTensor(5);
+  Predictor::TensorVector fiveInput{&five};
+  p_->run(fiveInput, &outputs);
+  EXPECT_EQ(p_->numShapeInstances(), 2);
+  EXPECT_EQ(outputs.front()->dims(), vector<TIndex>({5, 10}));
+  p_->run(oneInput, &outputs);
+  EXPECT_EQ(outputs.front(), oneOutputs.front());
+  EXPECT_FLOAT_EQ(outputs.front()->data<float>()[0], 10.0);
+
+  // The instances leave the predictor's own workspace alone.
+  EXPECT_FALSE(p_->ws()->GetBlob("y")->IsType<TensorCPU>());
+}
+
+TEST_F(PredictorTest, ShapeSpecializationBatchBuckets) {
+  p_->specializeShapes(4, {4, 8});
+  for (TIndex rows : {1, 3, 4}) {
+    auto input = onesTensor(rows);
+    Predictor::TensorVector inputs{&input};
+    Predictor::TensorVector outputs;
+    p_->run(inputs, &outputs);
+    EXPECT_EQ(outputs.front()->dims(), vector<TIndex>({rows, 10}));
+    EXPECT_FLOAT_EQ(outputs.front()->data<float>()[rows * 10 - 1], 10.0);
+  }
+  // 1, 3 and 4 rows all run in the bucket of 4.
+  EXPECT_EQ(p_->numShapeInstances(), 1);
+
+  auto six = onesTensor(6);
+  Predictor::TensorVector sixInput{&six};
+  std::vector<TensorCPU> taken;
+  p_->runAndTakeOutputs(sixInput, &taken);
+  EXPECT_EQ(taken.front().dims(), vector<TIndex>({6, 10}));
+  EXPECT_FLOAT_EQ(taken.front().data<float>()[59], 10.0);
+
+  // Beyond the last bucket, the inputs are not padded.
+  auto nine = onesTensor(9);
+  Predictor::TensorVector nineInput{&nine};
+  Predictor::TensorVector outputs;
+  p_->run(nineInput, &outputs);
+  EXPECT_EQ(outputs.front()->dims(), vector<TIndex>({9, 10}));
+  EXPECT_EQ(p_->numShapeInstances(), 3);
+}
 }
@@ -21,76 +21,153 @@ namespace caffe2 {
  * @brief A template class that allows one to register classes by keys.
  *
  * The keys are usually a string specifying the name, but can be anything that
- * can be used in a std::map.
+ * can be sorted with operator<.
  *
  * You should most likely not use the Registry class explicitly, but use the
  * helper macros below to declare specific registries as well as registering
  * objects.
+ *
+ * Since registration is carried out by hundreds of static initializers when a
+ * binary starts, it is kept as cheap as possible: Register only appends to a
+ * table, which is sorted, and checked for keys registered twice, by the first
+ * lookup after it, and the help messages of classes are only demangled when
+ * asked for.
  */
 template <class SrcType, class ObjectType, class... Args>
 class Registry {
  public:
   typedef std::function<std::unique_ptr<ObjectType> (Args ...)> Creator;
+  // Returns a help message, which is only computed if someone asks for it.
+  typedef const char* (*HelpMessageFunction)();
 
-  Registry() : registry_() {}
+  Registry() : sorted_(true) {}
 
   void Register(const SrcType& key, Creator creator) {
-    // The if statement below is essentially the same as the following line:
-    // CHECK_EQ(registry_.count(key), 0) << "Key " << key
-    //                                   << " registered twice.";
-    // However, CHECK_EQ depends on google logging, and since registration is
-    // carried out at static initialization time, we do not want to have an
-    // explicit dependency on glog's initialization function.
-    std::lock_guard<std::mutex> lock(register_mutex_);
-    if (registry_.count(key) != 0) {
-      std::cerr << "Key " << key << " already registered." << std::endl;
-      std::exit(1);
-    }
-    registry_[key] = creator;
+    Register(key, creator, static_cast<HelpMessageFunction>(nullptr));
   }
 
   void Register(const SrcType& key, Creator creator, const string& help_msg) {
     Register(key, creator);
+    std::lock_guard<std::mutex> lock(register_mutex_);
     help_message_[key] = help_msg;
   }
 
-  inline bool Has(const SrcType& key) { return (registry_.count(key) != 0); }
+  void Register(
+      const SrcType& key,
+      Creator creator,
+      HelpMessageFunction help_msg) {
+    std::lock_guard<std::mutex> lock(register_mutex_);
+    sorted_ = sorted_ && (entries_.empty() || entries_.back().key < key);
+    entries_.push_back(Entry{key, creator, help_msg});
+  }
+
+  inline bool Has(const SrcType& key) {
+    std::lock_guard<std::mutex> lock(register_mutex_);
+    return Find(key) != nullptr;
+  }
 
   unique_ptr<ObjectType> Create(const SrcType& key, Args ... args) {
-    if (registry_.count(key) == 0) {
-      // Returns nullptr if the key is not registered.
-      return nullptr;
+    Creator creator;
+    {
+      std::lock_guard<std::mutex> lock(register_mutex_);
+      const Entry* entry = Find(key);
+      if (entry == nullptr) {
+        // Returns nullptr if the key is not registered.
+        return nullptr;
+      }
+      creator = entry->creator;
     }
-    return registry_[key](args...);
+    return creator(args...);
   }
 
   /**
    * Returns the keys currently registered as a vector.
    */
   vector<SrcType> Keys() {
+    std::lock_guard<std::mutex> lock(register_mutex_);
+    Sort();
     vector<SrcType> keys;
-    for (const auto& it : registry_) {
-      keys.push_back(it.first);
+    keys.reserve(entries_.size());
+    for (const auto& entry : entries_) {
+      keys.push_back(entry.key);
     }
     return keys;
   }
 
   const CaffeMap<SrcType, string>& HelpMessage() const {
+    std::lock_guard<std::mutex> lock(register_mutex_);
+    for (const auto& entry : entries_) {
+      if (entry.help_msg != nullptr && !help_message_.count(entry.key)) {
+        help_message_[entry.key] = entry.help_msg();
+      }
+    }
     return help_message_;
   }
 
   const char* HelpMessage(const SrcType& key) const {
+    std::lock_guard<std::mutex> lock(register_mutex_);
     auto it = help_message_.find(key);
-    if (it == help_message_.end()) {
+    if (it != help_message_.end()) {
+      return it->second.c_str();
+    }
+    const Entry* entry = Find(key);
+    if (entry == nullptr || entry->help_msg == nullptr) {
       return nullptr;
     }
-    return it->second.c_str();
+    return entry->help_msg();
   }
 
  private:
-  CaffeMap<SrcType, Creator> registry_;
-  CaffeMap<SrcType, string> help_message_;
-  std::mutex register_mutex_;
+  struct Entry {
+    SrcType key;
+    Creator creator;
+    HelpMessageFunction help_msg;
+  };
+
+  // Sorts the entries by key if some were registered out of order, which also
+  // finds the keys registered twice. Must be called with the mutex held.
+  void Sort() const {
+    if (sorted_) {
+      return;
+    }
+    std::stable_sort(
+        entries_.begin(),
+        entries_.end(),
+        [](const Entry& a, const Entry& b) { return a.key < b.key; });
+    // The if statement below is essentially a CHECK that no key is registered
+    // twice. However, CHECK depends on google logging, and since registration
+    // is usually carried out at static initialization time, we do not want to
+    // have an explicit dependency on glog's initialization function.
+    auto it = std::adjacent_find(
+        entries_.begin(),
+        entries_.end(),
+        [](const Entry& a, const Entry& b) { return !(a.key < b.key); });
+    if (it != entries_.end()) {
+      std::cerr << "Key " << it->key << " already registered." << std::endl;
+      std::exit(1);
+    }
+    sorted_ = true;
+  }
+
+  // Returns the entry of key, or nullptr if it is not registered. Must be
+  // called with the mutex held.
+  const Entry* Find(const SrcType& key) const {
+    Sort();
+    auto it = std::lower_bound(
+        entries_.begin(),
+        entries_.end(),
+        key,
+        [](const Entry& entry, const SrcType& k) { return entry.key < k; });
+    if (it == entries_.end() || key < it->key) {
+      return nullptr;
+    }
+    return &*it;
+  }
+
+  mutable vector<Entry> entries_;
+  mutable bool sorted_;
+  mutable CaffeMap<SrcType, string> help_message_;
+  mutable std::mutex register_mutex_;
 
   DISABLE_COPY_AND_ASSIGN(Registry);
 };
@@ -98,10 +175,28 @@ class Registry {
 template <class SrcType, class ObjectType, class... Args>
 class Registerer {
  public:
-  Registerer(const SrcType& key,
-             Registry<SrcType, ObjectType, Args...>* registry,
-             typename Registry<SrcType, ObjectType, Args...>::Creator creator,
-             const string& help_msg="") {
+  typedef Registry<SrcType, ObjectType, Args...> RegistryType;
+
+  Registerer(
+      const SrcType& key,
+      RegistryType* registry,
+      typename RegistryType::Creator creator) {
+    registry->Register(key, creator);
+  }
+
+  Registerer(
+      const SrcType& key,
+      RegistryType* registry,
+      typename RegistryType::Creator creator,
+      const string& help_msg) {
+    registry->Register(key, creator, help_msg);
+  }
+
+  Registerer(
+      const SrcType& key,
+      RegistryType* registry,
+      typename RegistryType::Creator creator,
+      typename RegistryType::HelpMessageFunction help_msg) {
     registry->Register(key, creator, help_msg);
   }
 
@@ -159,7 +254,7 @@ class Registerer {
       key,                                                                    \
       RegistryName(),                                                         \
       Registerer##RegistryName::DefaultCreator<__VA_ARGS__>,                  \
-      TypeMeta::Name<__VA_ARGS__>());                                         \
+      &TypeMeta::Name<__VA_ARGS__>);                                          \
   }
 
 // CAFFE_DECLARE_REGISTRY and CAFFE_DEFINE_REGISTRY are hard-wired to use string
@@ -42,5 +42,42 @@ TEST(RegistryTest, CanRunCreator) {
 TEST(RegistryTest, ReturnNullOnNonExistingCreator) {
   EXPECT_EQ(FooRegistry()->Create("Non-existing bar", 1), nullptr);
 }
+
+TEST(RegistryTest, KeysAreSorted) {
+  EXPECT_EQ(FooRegistry()->Keys(), vector<string>({"AnotherBar", "Bar"}));
+}
+
+TEST(RegistryTest, HelpMessageIsTheClassName) {
+  EXPECT_EQ(string(FooRegistry()->HelpMessage("Bar")), TypeMeta::Name<Bar>());
+  EXPECT_EQ(FooRegistry()->HelpMessage("Non-existing bar"), nullptr);
+  EXPECT_EQ(
+      FooRegistry()->HelpMessage().at("AnotherBar"),
+      TypeMeta::Name<AnotherBar>());
+}
+
+TEST(RegistryTest, CanRegisterAfterLookup) {
+  Registry<string, Foo, int> registry;
+  registry.Register("Bar", Registerer<string, Foo, int>::DefaultCreator<Bar>);
+  EXPECT_TRUE(registry.Has("Bar"));
+  registry.Register(
+      "AnotherBar",
+      Registerer<string, Foo, int>::DefaultCreator<AnotherBar>,
+      "Another bar.");
+  EXPECT_TRUE(registry.Has("AnotherBar"));
+  EXPECT_TRUE(registry.Create("AnotherBar", 1) != nullptr);
+  EXPECT_EQ(registry.Keys(), vector<string>({"AnotherBar", "Bar"}));
+  EXPECT_EQ(string(registry.HelpMessage("AnotherBar")), "Another bar.");
+  EXPECT_EQ(registry.HelpMessage("Bar"), nullptr);
+}
+
+TEST(RegistryDeathTest, ExitsOnKeysRegisteredTwice) {
+  Registry<string, Foo, int> registry;
+  registry.Register("Bar", Registerer<string, Foo, int>::DefaultCreator<Bar>);
+  registry.Register("Bar", Registerer<string, Foo, int>::DefaultCreator<Bar>);
+  EXPECT_EXIT(
+      registry.Has("Bar"),
+      ::testing::ExitedWithCode(1),
+      "Key Bar already registered.");
+}
 }
 }  // namespace caffe2
@@ -0,0 +1,134 @@
+#ifndef CAFFE2_CORE_RUN_ONCE_CACHE_H_
+#define CAFFE2_CORE_RUN_ONCE_CACHE_H_
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "caffe2/core/common.h"
+
+namespace caffe2 {
+
+/**
+ * An LRU cache of the nets or operators that Workspace::RunNetOnce() and
+ * RunOperatorOnce() create, keyed by their serialized definitions, so that
+ * running the same definition again only costs its execution.
+ *
+ * An instance is taken out of the cache while it runs and put back after, so
+ * that concurrent or nested runs of the same definition each create their own
+ * instance instead of sharing one. Instances hold pointers to the blobs that
+ * they are bound to, so they are dropped when one of these blobs is removed.
+ *
+ * The instances are held by shared pointers, which delete them through the
+ * deleter that they were created with, so that the cache can be a member of
+ * Workspace while OperatorBase is still incomplete.
+ */
+template <class T>
+class RunOnceCache {
+ public:
+  RunOnceCache() {}
+
+  /**
+   * Takes the instance of the given key out of the cache, with the blobs that
+   * it is bound to, or returns nullptr if there is none.
+   */
+  std::shared_ptr<T> Take(const string& key, std::vector<string>* blobs) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return nullptr;
+    }
+    auto instance = std::move(it->second->instance);
+    *blobs = std::move(it->second->blobs);
+    entries_.erase(it->second);
+    index_.erase(it);
+    return instance;
+  }
+
+  /**
+   * Puts an instance that is bound to the given blobs in the cache, as the
+   * most recently used one, and evicts the least recently used ones beyond
+   * capacity. If the cache already has an instance of the key, which another
+   * run put back first, the new one is dropped.
+   */
+  void Put(
+      const string& key,
+      std::shared_ptr<T> instance,
+      std::vector<string> blobs,
+      size_t capacity) {
+    std::vector<std::shared_ptr<T>> dropped;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (capacity == 0 || index_.count(key)) {
+        dropped.push_back(std::move(instance));
+      } else {
+        entries_.push_front(Entry{key, std::move(instance), std::move(blobs)});
+        index_[key] = entries_.begin();
+      }
+      while (entries_.size() > capacity) {
+        dropped.push_back(std::move(entries_.back().instance));
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+      }
+    }
+    // Destroyed outside of the lock, as nets may wait for their threads.
+  }
+
+  /**
+   * Drops the instances that are bound to the given blob.
+   */
+  void Invalidate(const string& blob) {
+    std::vector<std::shared_ptr<T>> dropped;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      for (auto it = entries_.begin(); it != entries_.end();) {
+        const auto& blobs = it->blobs;
+        if (std::find(blobs.begin(), blobs.end(), blob) == blobs.end()) {
+          ++it;
+          continue;
+        }
+        dropped.push_back(std::move(it->instance));
+        index_.erase(it->key);
+        it = entries_.erase(it);
+      }
+    }
+  }
+
+  /**
+   * Drops all the instances.
+   */
+  void Clear() {
+    std::list<Entry> dropped;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      dropped.swap(entries_);
+      index_.clear();
+    }
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return entries_.size();
+  }
+
+ private:
+  struct Entry {
+    string key;
+    std::shared_ptr<T> instance;
+    std::vector<string> blobs;
+  };
+
+  mutable std::mutex mutex_;
+  // The most recently used first.
+  std::list<Entry> entries_;
+  std::unordered_map<string, typename std::list<Entry>::iterator> index_;
+
+  DISABLE_COPY_AND_ASSIGN(RunOnceCache);
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_CORE_RUN_ONCE_CACHE_H_
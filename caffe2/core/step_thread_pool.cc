@@ -0,0 +1,101 @@
+#include "caffe2/core/step_thread_pool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "caffe2/core/logging.h"
+
+namespace caffe2 {
+
+namespace {
+
+#ifdef __linux__
+// Binds the calling thread to the given core for as long as the object lives.
+class CoreBinding {
+ public:
+  explicit CoreBinding(int core) {
+    if (core < 0) {
+      return;
+    }
+    if (pthread_getaffinity_np(
+            pthread_self(), sizeof(original_), &original_) != 0) {
+      return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core % std::thread::hardware_concurrency(), &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0) {
+      bound_ = true;
+    } else {
+      LOG(WARNING) << "Could not bind substep thread to core " << core;
+    }
+  }
+
+  ~CoreBinding() {
+    if (bound_) {
+      pthread_setaffinity_np(pthread_self(), sizeof(original_), &original_);
+    }
+  }
+
+ private:
+  cpu_set_t original_;
+  bool bound_ = false;
+};
+#else
+class CoreBinding {
+ public:
+  explicit CoreBinding(int /* unused */) {}
+};
+#endif
+
+} // namespace
+
+StepThreadPool::~StepThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void StepThreadPool::Run(Task task, int core) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  tasks_.emplace(std::move(task), core);
+  if (num_idle_ < tasks_.size()) {
+    threads_.emplace_back(&StepThreadPool::WorkerMain, this);
+  } else {
+    cv_.notify_one();
+  }
+}
+
+int StepThreadPool::NumThreads() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return threads_.size();
+}
+
+void StepThreadPool::WorkerMain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    ++num_idle_;
+    cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+    --num_idle_;
+    if (tasks_.empty()) {
+      return;
+    }
+    auto task = std::move(tasks_.front());
+    tasks_.pop();
+    lock.unlock();
+    {
+      CoreBinding binding(task.second);
+      task.first();
+    }
+    lock.lock();
+  }
+}
+
+} // namespace caffe2
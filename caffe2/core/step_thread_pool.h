@@ -0,0 +1,61 @@
+#ifndef CAFFE2_CORE_STEP_THREAD_POOL_H_
+#define CAFFE2_CORE_STEP_THREAD_POOL_H_
+
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <mutex>  // NOLINT
+#include <queue>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "caffe2/core/common.h"
+
+namespace caffe2 {
+
+/**
+ * StepThreadPool runs the concurrent substeps of execution steps on threads
+ * that are kept around between iterations, instead of starting a fresh thread
+ * for every substep run.
+ *
+ * Concurrent substeps may wait on each other, for example a trainer waiting
+ * on a queue filled by a reader, so a task must never wait for a thread: the
+ * pool starts a new thread whenever there is no idle one. The number of
+ * threads is thus bounded by the largest number of substeps that ever ran at
+ * the same time, and these threads are then reused.
+ */
+class StepThreadPool {
+ public:
+  using Task = std::function<void()>;
+
+  StepThreadPool() {}
+  ~StepThreadPool();
+
+  /**
+   * Runs the task on a pool thread. If core is not negative, the thread is
+   * bound to that core (modulo the number of cores) while it runs the task.
+   * Core binding is only supported on Linux, and ignored elsewhere.
+   */
+  void Run(Task task, int core = -1);
+
+  /**
+   * Returns the number of threads started so far.
+   */
+  int NumThreads();
+
+ private:
+  void WorkerMain();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::queue<std::pair<Task, int>> tasks_;
+  std::vector<std::thread> threads_;
+  int num_idle_ = 0;
+  bool stop_ = false;
+
+  DISABLE_COPY_AND_ASSIGN(StepThreadPool);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_STEP_THREAD_POOL_H_
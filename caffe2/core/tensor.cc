@@ -1,5 +1,7 @@
 #include "caffe2/core/tensor.h"
 
+#include <memory>
+
 #include "caffe2/core/flags.h"
 
 CAFFE2_DEFINE_bool(
@@ -11,6 +13,44 @@ namespace caffe2 {
 // declaring it here instead of context.cc because tensor.h includes context.h
 CAFFE_KNOWN_TYPE(Tensor<CPUContext>);
 
+namespace {
+// The deleter of pinned storage, which also marks the storage as pinned.
+struct PinnedDeleter {
+  CPUAllocator* allocator;
+  void operator()(void* data) const {
+    if (FLAGS_caffe2_memory_tracking) {
+      MemoryTracker::Get()->RecordDelete(data);
+    }
+    allocator->Delete(data);
+  }
+};
+} // namespace
+
+void* PinnedRawMutableData(TensorCPU* tensor, const TypeMeta& meta) {
+  CPUAllocator* allocator = GetPinnedCPUAllocator();
+  if (!allocator || meta.ctor() || tensor->size_ <= 0) {
+    return tensor->raw_mutable_data(meta);
+  }
+  if (tensor->copy_on_write_) {
+    return tensor->raw_mutable_data(meta);
+  }
+  if (tensor->meta_ == meta &&
+      std::get_deleter<PinnedDeleter>(tensor->data_) != nullptr) {
+    return tensor->data_.get();
+  }
+  const size_t nbytes = tensor->size_ * meta.itemsize();
+  if (FLAGS_caffe2_memory_tracking) {
+    MemoryTracker::Get()->EnforceBudget(nbytes);
+  }
+  void* data = allocator->New(nbytes);
+  if (FLAGS_caffe2_memory_tracking) {
+    MemoryTracker::Get()->RecordNew(data, nbytes, CPU, 0);
+  }
+  tensor->ShareExternalPointer(
+      std::shared_ptr<void>(data, PinnedDeleter{allocator}), meta, nbytes);
+  return data;
+}
+
 TensorPrinter::TensorPrinter(
     const std::string& tensor_name,
     const std::string& file_name,
@@ -65,4 +105,52 @@ void RegisterShapeCallFunction(CaffeTypeId id, ShapeCall c) {
   shape_call_registry_[id] = c;
 }
 
+static CaffeMap<CaffeTypeId, CapacityCall> capacity_call_registry_ {
+  {TypeMeta::Id<Tensor<CPUContext>>(), GetTensorCapacity<CPUContext>}
+};
+
+CapacityCall GetCapacityCallFunction(CaffeTypeId id) {
+  auto f = capacity_call_registry_.find(id);
+  if (f == capacity_call_registry_.end()) {
+    return nullptr;
+  }
+  return f->second;
+}
+
+void RegisterCapacityCallFunction(CaffeTypeId id, CapacityCall c) {
+  capacity_call_registry_[id] = c;
+}
+
+static CaffeMap<CaffeTypeId, DataPointerCall> data_pointer_call_registry_ {
+  {TypeMeta::Id<Tensor<CPUContext>>(), GetTensorDataPointer<CPUContext>}
+};
+
+DataPointerCall GetDataPointerCallFunction(CaffeTypeId id) {
+  auto f = data_pointer_call_registry_.find(id);
+  if (f == data_pointer_call_registry_.end()) {
+    return nullptr;
+  }
+  return f->second;
+}
+
+void RegisterDataPointerCallFunction(CaffeTypeId id, DataPointerCall c) {
+  data_pointer_call_registry_[id] = c;
+}
+
+static CaffeMap<CaffeTypeId, ItemTypeCall> item_type_call_registry_ {
+  {TypeMeta::Id<Tensor<CPUContext>>(), GetTensorItemType<CPUContext>}
+};
+
+ItemTypeCall GetItemTypeCallFunction(CaffeTypeId id) {
+  auto f = item_type_call_registry_.find(id);
+  if (f == item_type_call_registry_.end()) {
+    return nullptr;
+  }
+  return f->second;
+}
+
+void RegisterItemTypeCallFunction(CaffeTypeId id, ItemTypeCall c) {
+  item_type_call_registry_[id] = c;
+}
+
 } // namespace caffe2
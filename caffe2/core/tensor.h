@@ -358,6 +358,73 @@ class Tensor {
     // Finally, do sharing.
     data_ = src.data_;
     capacity_ = src.capacity_;
+    // Sharing copy-on-write storage must not give a way to modify it.
+    copy_on_write_ = src.copy_on_write_;
+  }
+
+  /**
+   * @brief Shares a contiguous part of the data of another tensor.
+   *
+   * Like ShareData(), but this tensor becomes a view of the size() items of
+   * src that start at item offset, e.g. of a range of the outer dimension of
+   * src. The view keeps the storage of src alive, and writes through either
+   * tensor are seen by the other.
+   */
+  void ShareDataSlice(const Tensor& src, TIndex offset) {
+    meta_ = src.meta();
+    CAFFE_ENFORCE(
+        offset >= 0 && offset + size_ <= src.size_,
+        "Slice [",
+        offset,
+        ", ",
+        offset + size_,
+        ") is out of the range of a tensor of size ",
+        src.size_);
+    CAFFE_ENFORCE(
+        src.data_.get() || src.size_ == 0,
+        "Source tensor has no content and has size > 0");
+    const size_t begin = offset * meta_.itemsize();
+    data_ = std::shared_ptr<void>(
+        src.data_, static_cast<char*>(src.data_.get()) + begin);
+    capacity_ = src.capacity_ > begin ? src.capacity_ - begin : 0;
+    copy_on_write_ = src.copy_on_write_;
+  }
+
+  /**
+   * @brief Shares the data with another tensor until this tensor is modified.
+   *
+   * Unlike ShareData(), this takes over the shape of the source tensor, and
+   * the first mutable_data() or raw_mutable_data() call makes a private copy
+   * of the storage, unless this tensor is the last one using it by then. This
+   * lets many tensors, e.g. the weights of several predictors, hold a single
+   * read-only copy of the data without modifying each other's.
+   *
+   * Modifications made through the source tensor are still seen by this
+   * tensor, so the source should be treated as read-only as well.
+   */
+  void ShareDataCopyOnWrite(const Tensor& src) {
+    ResizeLike(src);
+    ShareData(src);
+    copy_on_write_ = true;
+  }
+
+  /**
+   * Releases the storage of the tensor, keeping its shape and type. The next
+   * mutable_data() or raw_mutable_data() call allocates fresh storage, so
+   * that the tensors that shared the old one keep it to themselves.
+   */
+  void FreeMemory() {
+    data_.reset();
+    capacity_ = 0;
+    copy_on_write_ = false;
+  }
+
+  /**
+   * Returns true if the storage is shared copy-on-write and has not been
+   * copied yet.
+   */
+  inline bool is_copy_on_write() const {
+    return copy_on_write_;
   }
 
   /**
@@ -384,6 +451,7 @@ class Tensor {
         size_ > 0,
         "To share data with a raw pointer, you need to set shape first.");
     data_.reset(src, [](void*)->void {});
+    copy_on_write_ = false;
     // Sets capacity. If not specified, we will implicitly assume that
     // the capacity is the current size.
     if (capacity) {
@@ -393,6 +461,63 @@ class Tensor {
     }
   }
 
+  /**
+   * @brief Shares the data with an externally owned pointer, and calls the
+   * deleter on it once no tensor uses the data anymore.
+   *
+   * This makes the tensor a zero-copy view over a buffer that is owned by
+   * someone else, e.g. a network message or a memory-mapped file, and the
+   * deleter releases the handle that keeps the buffer alive. The deleter goes
+   * along with the data, so the view stays valid when the data is shared with
+   * other tensors, e.g. as Predictor inputs, or when its blob is swapped, e.g.
+   * by a BlobsQueue. If no capacity is given, it is the current size.
+   */
+  template <typename T, typename Deleter>
+  void ShareExternalPointer(T* src, size_t capacity, Deleter deleter) {
+    ShareExternalPointer(
+        static_cast<void*>(src), TypeMeta::Make<T>(), capacity, deleter);
+  }
+
+  template <typename Deleter>
+  void ShareExternalPointer(
+      void* src,
+      const TypeMeta& meta,
+      size_t capacity,
+      Deleter deleter) {
+    ShareExternalPointer(
+        std::shared_ptr<void>(src, deleter),
+        meta,
+        capacity ? capacity : size_ * meta.itemsize());
+  }
+
+  /**
+   * @brief Shares the data with a pointer whose storage is owned by a
+   * shared_ptr.
+   *
+   * Unlike the raw pointer version above, the tensor keeps the storage alive
+   * for as long as it uses it. The pointer may point into the middle of a
+   * larger allocation (for example via the aliasing constructor of
+   * std::shared_ptr), which lets several tensors be carved out of one buffer.
+   */
+  void ShareExternalPointer(
+      const std::shared_ptr<void>& src,
+      const TypeMeta& meta,
+      size_t capacity) {
+    meta_ = meta;
+    CAFFE_ENFORCE(
+        meta_.id(),
+        "To share with a raw external pointer you need to have meta "
+        "already set.");
+    CAFFE_ENFORCE(
+        size_ > 0,
+        "To share data with a raw pointer, you need to set shape first.");
+    CAFFE_ENFORCE_GE(
+        capacity, nbytes(), "Capacity is smaller than the tensor size.");
+    data_ = src;
+    capacity_ = capacity;
+    copy_on_write_ = false;
+  }
+
   /**
    * Returns a const raw void* pointer of the underlying storage. mutable_data()
    * or raw_mutable_data() must have been called prior to this function call.
@@ -436,6 +561,9 @@ class Tensor {
    * and a new storage will be created.
    */
   inline void* raw_mutable_data(const TypeMeta& meta) {
+    if (copy_on_write_) {
+      DetachCopyOnWrite(meta);
+    }
     // For 0-size tensors it's fine to return any pointer (including nullptr)
     if (meta_ == meta && (data_.get() || size_ == 0)) {
       return data_.get();
@@ -498,7 +626,7 @@ class Tensor {
    */
   template <typename T>
   inline T* mutable_data() {
-    if ((size_ == 0 || data_.get()) && IsType<T>()) {
+    if ((size_ == 0 || data_.get()) && IsType<T>() && !copy_on_write_) {
       return static_cast<T*>(data_.get());
     }
     return static_cast<T*>(raw_mutable_data(TypeMeta::Make<T>()));
@@ -523,6 +651,11 @@ class Tensor {
    * This is equivalent to calling size() * itemsize().
    */
   inline size_t nbytes() const { return size_ * meta_.itemsize(); }
+  /**
+   * Returns the number of bytes allocated for the storage, which may be more
+   * than nbytes() if the tensor was shrunk or reserved memory.
+   */
+  inline size_t capacity_nbytes() const { return capacity_; }
   /**
    * Returns the dimensions of the tensor as a vector.
    */
@@ -592,9 +725,35 @@ class Tensor {
   TypeMeta meta_;
   std::shared_ptr<void> data_;
   size_t capacity_ = 0;
+  bool copy_on_write_ = false;
   // In case of chunk load we store how much data was already loaded
 
  private:
+  friend void* PinnedRawMutableData(
+      Tensor<CPUContext>* tensor,
+      const TypeMeta& meta);
+
+  // Makes a private copy of copy-on-write storage before it is modified. The
+  // copy is not needed if the storage is about to be replaced because of a
+  // type change, or if no other tensor uses it anymore.
+  void DetachCopyOnWrite(const TypeMeta& meta) {
+    copy_on_write_ = false;
+    if (meta_ != meta || !data_ || data_.use_count() == 1) {
+      return;
+    }
+    auto shared = std::move(data_);
+    capacity_ = 0;
+    void* data = raw_mutable_data(meta_);
+    if (meta_.copy()) {
+      meta_.copy()(shared.get(), data, size_);
+    } else {
+      Context context;
+      context.template CopyBytes<Context, Context>(
+          nbytes(), shared.get(), data);
+      context.FinishDeviceComputation();
+    }
+  }
+
   template <
       typename T,
       typename = typename std::enable_if<std::is_integral<T>::value>::type>
@@ -667,6 +826,30 @@ class Tensor {
 // For simplicity, we will typedef Tensor<CPUContext> to TensorCPU.
 typedef Tensor<CPUContext> TensorCPU;
 
+/**
+ * Like raw_mutable_data(), but allocates the storage of a CPU tensor from the
+ * pinned CPU allocator, so that copies between the tensor and a GPU do not
+ * need to be staged by the driver and can run asynchronously. The pinned
+ * storage is kept for as long as it is large enough, like any other storage.
+ *
+ * When no pinned allocator is installed, e.g. before CUDA is initialized, or
+ * when the type needs a constructor, this is just raw_mutable_data(). For
+ * tensors of other devices, it always is.
+ */
+void* PinnedRawMutableData(TensorCPU* tensor, const TypeMeta& meta);
+
+template <class Context>
+inline void* PinnedRawMutableData(
+    Tensor<Context>* tensor,
+    const TypeMeta& meta) {
+  return tensor->raw_mutable_data(meta);
+}
+
+template <typename T, class Context>
+inline T* PinnedMutableData(Tensor<Context>* tensor) {
+  return static_cast<T*>(PinnedRawMutableData(tensor, TypeMeta::Make<T>()));
+}
+
 constexpr int k_limit_default_ = 1000;
 
 // Shape call registry
@@ -680,6 +863,40 @@ vector<TIndex> GetTensorShape(void* c) {
   return tc->dims();
 }
 
+// Capacity call registry, returning the bytes allocated by a tensor type.
+typedef size_t (*CapacityCall)(const void*);
+CapacityCall GetCapacityCallFunction(CaffeTypeId id);
+void RegisterCapacityCallFunction(CaffeTypeId id, CapacityCall c);
+
+template <class Context>
+size_t GetTensorCapacity(const void* c) {
+  const Tensor<Context>* tc = static_cast<const Tensor<Context>*>(c);
+  // Copy-on-write tensors use the memory of the tensor they share.
+  return tc->is_copy_on_write() ? 0 : tc->capacity_nbytes();
+}
+
+// Data pointer call registry, returning the storage of a tensor type, or
+// nullptr if none is allocated.
+typedef const void* (*DataPointerCall)(const void*);
+DataPointerCall GetDataPointerCallFunction(CaffeTypeId id);
+void RegisterDataPointerCallFunction(CaffeTypeId id, DataPointerCall c);
+
+template <class Context>
+const void* GetTensorDataPointer(const void* c) {
+  const Tensor<Context>* tc = static_cast<const Tensor<Context>*>(c);
+  return tc->capacity_nbytes() ? tc->raw_data() : nullptr;
+}
+
+// Item type call registry, returning the type of the items of a tensor type.
+typedef const TypeMeta& (*ItemTypeCall)(const void*);
+ItemTypeCall GetItemTypeCallFunction(CaffeTypeId id);
+void RegisterItemTypeCallFunction(CaffeTypeId id, ItemTypeCall c);
+
+template <class Context>
+const TypeMeta& GetTensorItemType(const void* c) {
+  return static_cast<const Tensor<Context>*>(c)->meta();
+}
+
 class TensorPrinter {
  public:
   explicit TensorPrinter(
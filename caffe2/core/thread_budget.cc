@@ -0,0 +1,84 @@
+#include "caffe2/core/thread_budget.h"
+
+#include <algorithm>
+#include <thread>  // NOLINT
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif  // _OPENMP
+
+#ifdef CAFFE2_USE_MKL
+#include <mkl.h>
+#endif  // CAFFE2_USE_MKL
+
+#include "caffe2/core/logging.h"
+
+CAFFE2_DEFINE_int(
+    caffe2_thread_budget,
+    0,
+    "The number of threads that the workers of DAG nets, the CPU executor "
+    "pool threads, the workspace thread pools and the OpenMP and MKL threads "
+    "of operators may use together. 0 means one per hardware thread.");
+
+namespace caffe2 {
+
+ThreadBudget::ThreadBudget(int total) : total_(total) {
+  CAFFE_ENFORCE_GT(total, 0, "A thread budget needs at least one thread.");
+}
+
+ThreadBudget* ThreadBudget::Get() {
+  static ThreadBudget budget(
+      FLAGS_caffe2_thread_budget > 0
+          ? FLAGS_caffe2_thread_budget
+          : std::max(1u, std::thread::hardware_concurrency()));
+  return &budget;
+}
+
+int ThreadBudget::available() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return std::max(0, total_ - reserved_);
+}
+
+int ThreadBudget::Acquire(int wanted) {
+  if (wanted <= 0) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  const int threads = std::max(1, std::min(wanted, total_ - reserved_));
+  reserved_ += threads;
+  VLOG(1) << "Reserved " << threads << " of " << wanted << " threads, "
+          << reserved_ << " of " << total_ << " in use";
+  return threads;
+}
+
+void ThreadBudget::Release(int threads) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  reserved_ -= threads;
+  CAFFE_ENFORCE_GE(reserved_, 0, "Released more threads than reserved.");
+}
+
+IntraOpThreadsGuard::IntraOpThreadsGuard(int num_threads) {
+  num_threads = std::max(1, num_threads);
+#ifdef _OPENMP
+  // The number of threads of parallel regions is a setting of the calling
+  // thread.
+  previous_omp_threads_ = omp_get_max_threads();
+  omp_set_num_threads(num_threads);
+#endif  // _OPENMP
+#ifdef CAFFE2_USE_MKL
+  previous_mkl_threads_ = mkl_set_num_threads_local(num_threads);
+#endif  // CAFFE2_USE_MKL
+  (void)num_threads;
+}
+
+IntraOpThreadsGuard::~IntraOpThreadsGuard() {
+#ifdef _OPENMP
+  omp_set_num_threads(previous_omp_threads_);
+#endif  // _OPENMP
+#ifdef CAFFE2_USE_MKL
+  // 0 goes back to the global MKL setting.
+  mkl_set_num_threads_local(previous_mkl_threads_);
+#endif  // CAFFE2_USE_MKL
+}
+
+}  // namespace caffe2
@@ -0,0 +1,98 @@
+#ifndef CAFFE2_CORE_THREAD_BUDGET_H_
+#define CAFFE2_CORE_THREAD_BUDGET_H_
+
+#include <mutex>  // NOLINT
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/flags.h"
+
+CAFFE2_DECLARE_int(caffe2_thread_budget);
+
+namespace caffe2 {
+
+/**
+ * ThreadBudget shares the cores of the process between the threads that
+ * Caffe2 starts: the workers of DAG nets, the CPU threads of executor pools
+ * and the thread pools of workspaces, as well as the OpenMP, MKL and Eigen
+ * threads that operators run on these threads may add.
+ *
+ * Each of them reserves an allotment of threads before starting them, and
+ * gets at most what is left of the budget. The thread that asks always runs,
+ * so an allotment is never empty, and the budget is overdrawn by one thread
+ * per allotment once it is exhausted.
+ */
+class ThreadBudget {
+ public:
+  explicit ThreadBudget(int total);
+
+  // The budget of the process, of --caffe2_thread_budget threads, or one per
+  // hardware thread.
+  static ThreadBudget* Get();
+
+  int total() const {
+    return total_;
+  }
+
+  // The number of threads that are not reserved.
+  int available();
+
+  // Reserves up to `wanted` threads, and returns how many were reserved,
+  // which is at least 1 if `wanted` is positive.
+  int Acquire(int wanted);
+
+  void Release(int threads);
+
+ private:
+  const int total_;
+  std::mutex mutex_;
+  int reserved_ = 0;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadBudget);
+};
+
+/**
+ * A reservation of threads from a budget, released on destruction.
+ */
+class ThreadAllotment {
+ public:
+  explicit ThreadAllotment(
+      int wanted,
+      ThreadBudget* budget = ThreadBudget::Get())
+      : budget_(budget), threads_(budget->Acquire(wanted)) {}
+  ~ThreadAllotment() {
+    budget_->Release(threads_);
+  }
+
+  int threads() const {
+    return threads_;
+  }
+
+ private:
+  ThreadBudget* budget_;
+  const int threads_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadAllotment);
+};
+
+/**
+ * Sets the number of OpenMP and MKL threads of the parallel regions that the
+ * calling thread starts while in scope, and restores them afterwards. Eigen
+ * follows the OpenMP setting, as Caffe2 never sets its number of threads.
+ * Workers of DAG nets run their operators under one of these, so operators do
+ * not start OpenMP threads of their own unless the net budgets them.
+ */
+class IntraOpThreadsGuard {
+ public:
+  explicit IntraOpThreadsGuard(int num_threads);
+  ~IntraOpThreadsGuard();
+
+ private:
+  int previous_omp_threads_ = 0;
+  int previous_mkl_threads_ = 0;
+
+  DISABLE_COPY_AND_ASSIGN(IntraOpThreadsGuard);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_THREAD_BUDGET_H_
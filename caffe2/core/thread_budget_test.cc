@@ -0,0 +1,99 @@
+#ifdef _OPENMP
+#include <omp.h>
+#endif  // _OPENMP
+
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/thread_budget.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Writes the number of OpenMP threads that the operator may use.
+class ThreadBudgetTestOp final : public OperatorBase {
+ public:
+  using OperatorBase::OperatorBase;
+  bool Run() override {
+    auto* threads = Output<TensorCPU>(0);
+    threads->Resize(1);
+#ifdef _OPENMP
+    threads->mutable_data<int>()[0] = omp_get_max_threads();
+#else
+    threads->mutable_data<int>()[0] = 1;
+#endif  // _OPENMP
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(ThreadBudgetTest, ThreadBudgetTestOp);
+OPERATOR_SCHEMA(ThreadBudgetTest).NumInputs(0).NumOutputs(1);
+
+int RunAndGetIntraOpThreads(int num_workers, int intra_op_threads) {
+  Workspace ws;
+  NetDef net_def;
+  net_def.set_type("dag");
+  net_def.set_num_workers(num_workers);
+  net_def.add_arg()->CopyFrom(
+      MakeArgument<int>("intra_op_threads", intra_op_threads));
+  net_def.add_op()->CopyFrom(CreateOperatorDef(
+      "ThreadBudgetTest", "", vector<string>{}, vector<string>{"threads"}));
+  std::unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+  CAFFE_ENFORCE(net->Run());
+  return ws.GetBlob("threads")->Get<TensorCPU>().data<int>()[0];
+}
+
+} // namespace
+
+TEST(ThreadBudgetTest, Allotments) {
+  ThreadBudget budget(4);
+  EXPECT_EQ(budget.total(), 4);
+  {
+    ThreadAllotment first(3, &budget);
+    EXPECT_EQ(first.threads(), 3);
+    EXPECT_EQ(budget.available(), 1);
+    ThreadAllotment second(3, &budget);
+    EXPECT_EQ(second.threads(), 1);
+    // The budget is exhausted, but the thread that asks still runs.
+    ThreadAllotment third(2, &budget);
+    EXPECT_EQ(third.threads(), 1);
+    EXPECT_EQ(budget.available(), 0);
+  }
+  EXPECT_EQ(budget.available(), 4);
+  EXPECT_EQ(budget.Acquire(0), 0);
+}
+
+#ifdef _OPENMP
+TEST(ThreadBudgetTest, IntraOpThreadsGuard) {
+  const int threads = omp_get_max_threads();
+  {
+    IntraOpThreadsGuard guard(3);
+    EXPECT_EQ(omp_get_max_threads(), 3);
+    int team_size = 0;
+#pragma omp parallel
+    {
+#pragma omp master
+      team_size = omp_get_num_threads();
+    }
+    EXPECT_LE(team_size, 3);
+  }
+  EXPECT_EQ(omp_get_max_threads(), threads);
+}
+
+TEST(ThreadBudgetTest, DAGNetWorkers) {
+  // By default operators on DAG workers do not start OpenMP threads.
+  EXPECT_EQ(RunAndGetIntraOpThreads(2, 1), 1);
+  // Intra-op threads come out of the budget, after the workers.
+  ThreadBudget* budget = ThreadBudget::Get();
+  const int available = budget->available();
+  const int expected =
+      1 + std::max(0, std::min(available, 2 + 2 * 2) - 2) / 2;
+  EXPECT_EQ(RunAndGetIntraOpThreads(2, 3), expected);
+  // The net gives its threads back.
+  EXPECT_EQ(budget->available(), available);
+}
+#endif  // _OPENMP
+
+} // namespace caffe2
@@ -61,6 +61,7 @@ const TypeMeta& DataTypeToTypeMeta(const TensorProto::DataType& dt) {
       {TensorProto_DataType_INT32, TypeMeta::Make<int>()},
       {TensorProto_DataType_STRING, TypeMeta::Make<std::string>()},
       {TensorProto_DataType_BOOL, TypeMeta::Make<bool>()},
+      {TensorProto_DataType_BYTE, TypeMeta::Make<uint8_t>()},
       {TensorProto_DataType_UINT8, TypeMeta::Make<uint8_t>()},
       {TensorProto_DataType_INT8, TypeMeta::Make<int8_t>()},
       {TensorProto_DataType_UINT16, TypeMeta::Make<uint16_t>()},
@@ -13,10 +13,14 @@
 namespace caffe2 {
 
 // Storage orders that are often used in the image applications.
+// NCHWc is the blocked channel order: an N x C x H x W image is stored as
+// N x (C / c) x H x W x c, with the block size c (typically 8 or 16, the
+// floats of a SIMD register) as the last dimension of the tensor.
 enum StorageOrder {
   UNKNOWN = 0,
   NHWC = 1,
   NCHW = 2,
+  NCHWc = 3,
 };
 
 inline StorageOrder StringToStorageOrder(const string& str) {
@@ -24,6 +28,8 @@ inline StorageOrder StringToStorageOrder(const string& str) {
     return StorageOrder::NHWC;
   } else if (str == "NCHW" || str == "nchw") {
     return StorageOrder::NCHW;
+  } else if (str == "NCHWc" || str == "nchwc") {
+    return StorageOrder::NCHWc;
   } else {
     LOG(ERROR) << "Unknown storage order string: " << str;
     return StorageOrder::UNKNOWN;
@@ -5,6 +5,7 @@
 #include <mutex>
 
 #include "caffe2/core/logging.h"
+#include "caffe2/core/memory_tracking.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/core/net.h"
 #include "caffe2/core/timer.h"
@@ -16,6 +17,14 @@ CAFFE2_DEFINE_bool(
     "If used we will handle exceptions in executor threads. "
     "This avoids SIGABRT but may cause process to deadlock");
 
+CAFFE2_DEFINE_int(
+    caffe2_run_once_cache_size,
+    0,
+    "If positive, Workspace::RunNetOnce() and RunOperatorOnce() each keep up "
+    "to this many of the nets and operators that they create, and reuse them "
+    "when they run the same definition again. The cached instances keep their "
+    "state between runs, such as db cursors and random number generators.");
+
 #if CAFFE2_MOBILE
 // Threadpool restrictions
 
@@ -74,17 +83,36 @@ std::function<bool(int64_t)> getContinuationTest(
 
 vector<string> Workspace::LocalBlobs() const {
   vector<string> names;
+  names.reserve(blob_map_.size());
   for (auto& entry : blob_map_) {
     names.push_back(entry.first);
   }
+  std::sort(names.begin(), names.end());
   return names;
 }
 
-vector<string> Workspace::Blobs() const {
-  vector<string> names;
+CaffeMap<string, size_t> Workspace::BlobMemoryUsage() const {
+  CaffeMap<string, size_t> usage;
   for (auto& entry : blob_map_) {
-    names.push_back(entry.first);
+    CapacityCall capacity_fun =
+        GetCapacityCallFunction(entry.second->meta().id());
+    if (capacity_fun) {
+      usage[entry.first] = capacity_fun(entry.second->GetRaw());
+    }
   }
+  return usage;
+}
+
+size_t Workspace::MemoryUsage() const {
+  size_t total = 0;
+  for (const auto& entry : BlobMemoryUsage()) {
+    total += entry.second;
+  }
+  return total;
+}
+
+vector<string> Workspace::Blobs() const {
+  vector<string> names = LocalBlobs();
   if (shared_) {
     vector<string> shared_blobs = shared_->Blobs();
     names.insert(names.end(), shared_blobs.begin(), shared_blobs.end());
@@ -93,19 +121,72 @@ vector<string> Workspace::Blobs() const {
 }
 
 Blob* Workspace::CreateBlob(const string& name) {
-  if (HasBlob(name)) {
+  auto it = blob_map_.find(name);
+  if (it != blob_map_.end()) {
     VLOG(1) << "Blob " << name << " already exists. Skipping.";
-  } else {
-    VLOG(1) << "Creating blob " << name;
-    blob_map_[name] = unique_ptr<Blob>(new Blob());
+    return it->second.get();
+  }
+  if (shared_ && shared_->HasBlob(name)) {
+    VLOG(1) << "Blob " << name << " already exists. Skipping.";
+    return shared_->GetBlob(name);
+  }
+  VLOG(1) << "Creating blob " << name;
+  auto& blob = blob_map_[name];
+  blob.reset(NewBlob());
+  return blob.get();
+}
+
+Blob* Workspace::CreateLocalBlob(const string& name) {
+  auto& blob = blob_map_[name];
+  if (!blob) {
+    VLOG(1) << "Creating local blob " << name;
+    blob.reset(NewBlob());
   }
-  return GetBlob(name);
+  return blob.get();
+}
+
+Blob* Workspace::NewBlob() {
+  if (FLAGS_caffe2_arena_allocation) {
+    return new (&blob_arena_) Blob();
+  }
+  return new Blob();
+}
+
+vector<string> Workspace::ShareTensorsCopyOnWrite() {
+  vector<string> names;
+  if (!shared_) {
+    return names;
+  }
+  for (const string& name : shared_->Blobs()) {
+    if (blob_map_.count(name)) {
+      continue;
+    }
+    const Blob* blob = shared_->GetBlob(name);
+    if (!blob->IsType<TensorCPU>()) {
+      continue;
+    }
+    const auto& tensor = blob->Get<TensorCPU>();
+    // Tensors without data have nothing to share yet.
+    if (tensor.size() < 0 ||
+        (tensor.size() > 0 && tensor.capacity_nbytes() == 0)) {
+      continue;
+    }
+    auto& local = blob_map_[name];
+    local.reset(NewBlob());
+    local->GetMutable<TensorCPU>()->ShareDataCopyOnWrite(tensor);
+    names.push_back(name);
+  }
+  return names;
 }
 
 bool Workspace::RemoveBlob(const string& name) {
   auto it = blob_map_.find(name);
   if (it != blob_map_.end()) {
     VLOG(1) << "Removing blob " << name << " from this workspace.";
+    // The cached instances that are bound to the blob would keep a pointer
+    // to it.
+    net_once_cache_.Invalidate(name);
+    op_once_cache_.Invalidate(name);
     blob_map_.erase(it);
     return true;
   }
@@ -116,8 +197,9 @@ bool Workspace::RemoveBlob(const string& name) {
 }
 
 const Blob* Workspace::GetBlob(const string& name) const {
-  if (blob_map_.count(name)) {
-    return blob_map_.at(name).get();
+  auto it = blob_map_.find(name);
+  if (it != blob_map_.end()) {
+    return it->second.get();
   } else if (shared_ && shared_->HasBlob(name)) {
     return shared_->GetBlob(name);
   } else {
@@ -170,6 +252,7 @@ void Workspace::DeleteNet(const string& name) {
   if (net_map_.count(name)) {
     net_map_.erase(name);
   }
+  net_memory_usage_.erase(name);
 }
 
 bool Workspace::RunNet(const string& name) {
@@ -177,30 +260,112 @@ bool Workspace::RunNet(const string& name) {
     LOG(ERROR) << "Network " << name << " does not exist yet.";
     return false;
   }
-  return net_map_[name]->Run();
+  NetTraceRunScope trace_scope(name);
+  if (!FLAGS_caffe2_memory_tracking) {
+    return net_map_[name]->Run();
+  }
+  MemoryPeakScope memory_scope;
+  const bool success = net_map_[name]->Run();
+  auto& usage = net_memory_usage_[name];
+  usage.bytes_at_start = memory_scope.bytes_at_start();
+  usage.peak_bytes = memory_scope.peak_bytes();
+  return success;
+}
+
+Workspace::NetMemoryUsage Workspace::LastRunMemoryUsage(
+    const string& name) const {
+  auto it = net_memory_usage_.find(name);
+  return it == net_memory_usage_.end() ? NetMemoryUsage() : it->second;
+}
+
+vector<OperatorProfile> Workspace::NetOperatorProfiles(
+    const string& name,
+    bool by_type) const {
+  auto it = net_map_.find(name);
+  CAFFE_ENFORCE(it != net_map_.end(), "Network ", name, " does not exist.");
+  return it->second->OperatorProfiles(by_type);
+}
+
+namespace {
+
+void AddBoundBlobs(const OperatorDef& op_def, vector<string>* blobs) {
+  blobs->insert(blobs->end(), op_def.input().begin(), op_def.input().end());
+  blobs->insert(blobs->end(), op_def.output().begin(), op_def.output().end());
+}
+
+} // namespace
+
+bool Workspace::BlobsAreLocal(const vector<string>& blobs) const {
+  for (const auto& blob : blobs) {
+    if (!blob_map_.count(blob)) {
+      return false;
+    }
+  }
+  return true;
 }
 
 bool Workspace::RunOperatorOnce(const OperatorDef& op_def) {
-  std::unique_ptr<OperatorBase> op(CreateOperator(op_def, this));
-  if (op.get() == nullptr) {
-    LOG(ERROR) << "Cannot create operator of type " << op_def.type();
-    return false;
+  const bool cached = FLAGS_caffe2_run_once_cache_size > 0;
+  string key;
+  vector<string> blobs;
+  std::shared_ptr<OperatorBase> op;
+  if (cached) {
+    key = op_def.SerializeAsString();
+    op = op_once_cache_.Take(key, &blobs);
+  }
+  if (!op) {
+    op = CreateOperator(op_def, this);
+    if (op.get() == nullptr) {
+      LOG(ERROR) << "Cannot create operator of type " << op_def.type();
+      return false;
+    }
+    AddBoundBlobs(op_def, &blobs);
   }
   if (!op->Run()) {
     LOG(ERROR) << "Error when running operator " << op_def.type();
     return false;
   }
+  // Blobs of the shared workspace can be removed without this one knowing.
+  if (cached && BlobsAreLocal(blobs)) {
+    op_once_cache_.Put(
+        key, std::move(op), std::move(blobs), FLAGS_caffe2_run_once_cache_size);
+  }
   return true;
 }
 bool Workspace::RunNetOnce(const NetDef& net_def) {
-  std::unique_ptr<NetBase> net(caffe2::CreateNet(net_def, this));
+  const bool cached = FLAGS_caffe2_run_once_cache_size > 0;
+  string key;
+  vector<string> blobs;
+  std::shared_ptr<NetBase> net;
+  if (cached) {
+    key = net_def.SerializeAsString();
+    net = net_once_cache_.Take(key, &blobs);
+  }
+  if (!net) {
+    net = caffe2::CreateNet(net_def, this);
+    for (const auto& op_def : net_def.op()) {
+      AddBoundBlobs(op_def, &blobs);
+    }
+  }
   if (!net->Run()) {
     LOG(ERROR) << "Error when running network " << net_def.name();
     return false;
   }
+  if (cached && BlobsAreLocal(blobs)) {
+    net_once_cache_.Put(
+        key,
+        std::move(net),
+        std::move(blobs),
+        FLAGS_caffe2_run_once_cache_size);
+  }
   return true;
 }
 
+void Workspace::ClearRunOnceCache() {
+  net_once_cache_.Clear();
+  op_once_cache_.Clear();
+}
+
 bool Workspace::RunPlan(const PlanDef& plan,
                         ShouldContinue shouldContinue) {
   LOG(INFO) << "Started executing plan.";
@@ -266,6 +431,9 @@ ThreadPool* Workspace::GetThreadPool() {
       }
     }
 
+    thread_pool_allotment_.reset(new ThreadAllotment(numThreads));
+    numThreads = thread_pool_allotment_->threads();
+
     LOG(INFO) << "Constructing thread pool with " << numThreads << " threads";
     thread_pool_.reset(new ThreadPool(numThreads));
   }
@@ -274,6 +442,25 @@ ThreadPool* Workspace::GetThreadPool() {
 }
 #endif // CAFFE2_MOBILE
 
+StepThreadPool* Workspace::GetStepThreadPool() {
+  std::lock_guard<std::mutex> guard(step_thread_pool_creation_mutex_);
+  if (!step_thread_pool_) {
+    step_thread_pool_.reset(new StepThreadPool());
+  }
+  return step_thread_pool_.get();
+}
+
+ExecutorPool* Workspace::GetExecutorPool() {
+  if (shared_) {
+    return shared_->GetExecutorPool();
+  }
+  std::lock_guard<std::mutex> guard(executor_pool_creation_mutex_);
+  if (!executor_pool_) {
+    executor_pool_.reset(new ExecutorPool());
+  }
+  return executor_pool_.get();
+}
+
 namespace {
 
 struct Reporter {
@@ -330,6 +517,30 @@ bool Workspace::ExecuteStepRecursive(
     return false;
   }
 
+  // Accumulated wall time of every substep, if it is requested.
+  float* substepTimes = nullptr;
+  if (step.has_substep_timing_blob()) {
+    auto* timing =
+        CreateBlob(step.substep_timing_blob())->GetMutable<TensorCPU>();
+    if (timing->size() != step.substep_size()) {
+      timing->Resize(step.substep_size());
+      std::fill(
+          timing->mutable_data<float>(),
+          timing->mutable_data<float>() + timing->size(),
+          0.f);
+    }
+    substepTimes = timing->mutable_data<float>();
+  }
+  auto executeSubstep = [&](int substep_id, ShouldContinue shouldContinue) {
+    Timer timer;
+    bool success =
+        ExecuteStepRecursive(step.substep().Get(substep_id), shouldContinue);
+    if (substepTimes) {
+      substepTimes[substep_id] += timer.Seconds();
+    }
+    return success;
+  };
+
   Reporter reporter;
   if (step.has_report_net()) {
     CAFFE_ENFORCE(
@@ -362,8 +573,9 @@ bool Workspace::ExecuteStepRecursive(
           return externalShouldContinue(it);
         };
 
-        for (auto& ss : step.substep()) {
-          if (!ExecuteStepRecursive(ss, substepShouldContinue)) {
+        for (int substep_id = 0; substep_id < step.substep_size();
+             ++substep_id) {
+          if (!executeSubstep(substep_id, substepShouldContinue)) {
             return false;
           }
           CHECK_SHOULD_STOP(step, shouldStop);
@@ -386,8 +598,7 @@ bool Workspace::ExecuteStepRecursive(
               break;
             }
             try {
-              if (!ExecuteStepRecursive(
-                      step.substep().Get(substep_id), substepShouldContinue)) {
+              if (!executeSubstep(substep_id, substepShouldContinue)) {
                 got_failure = true;
               }
             } catch (const std::exception& ex) {
@@ -408,12 +619,27 @@ bool Workspace::ExecuteStepRecursive(
           }
         };
 
-        std::vector<std::thread> threads;
-        for (int64_t i = 0; i < step.substep().size(); ++i) {
-          threads.emplace_back(worker);
+        int numWorkers = step.substep().size();
+        if (step.max_concurrent_substeps() > 0) {
+          numWorkers = std::min(numWorkers, step.max_concurrent_substeps());
+        }
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+        int numDone = 0;
+        auto* pool = GetStepThreadPool();
+        for (int i = 0; i < numWorkers; ++i) {
+          pool->Run(
+              [&]() {
+                worker();
+                std::lock_guard<std::mutex> guard(done_mutex);
+                ++numDone;
+                done_cv.notify_all();
+              },
+              step.pin_substeps_to_cores() ? i : -1);
         }
-        for (auto& thread: threads) {
-          thread.join();
+        {
+          std::unique_lock<std::mutex> lock(done_mutex);
+          done_cv.wait(lock, [&]() { return numDone == numWorkers; });
         }
         if (got_failure) {
           LOG(ERROR) << "One of the workers failed.";
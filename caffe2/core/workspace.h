@@ -11,20 +11,30 @@
 #include <cstddef>
 #include <mutex>
 #include <typeinfo>
+#include <unordered_map>
 #include <vector>
 
+#include "caffe2/core/arena.h"
 #include "caffe2/core/blob.h"
+#include "caffe2/core/executor_pool.h"
+#include "caffe2/core/flags.h"
 #include "caffe2/core/registry.h"
 #include "caffe2/core/net.h"
+#include "caffe2/core/run_once_cache.h"
+#include "caffe2/core/step_thread_pool.h"
+#include "caffe2/core/thread_budget.h"
 #include "caffe2/proto/caffe2.pb.h"
 #include "caffe2/utils/signal_handler.h"
 #if CAFFE2_MOBILE
 #include "caffe2/utils/threadpool/ThreadPool.h"
 #endif // CAFFE2_MOBILE
 
+CAFFE2_DECLARE_int(caffe2_run_once_cache_size);
+
 namespace caffe2 {
 
 class NetBase;
+class OperatorBase;
 
 struct StopOnSignal {
   StopOnSignal()
@@ -49,8 +59,18 @@ struct StopOnSignal {
 class Workspace {
  public:
   typedef std::function<bool(int)> ShouldContinue;
-  typedef CaffeMap<string, unique_ptr<Blob> > BlobMap;
+  // Hashed, as workspaces of unrolled nets hold hundreds of thousands of blobs
+  // that are looked up by name whenever an operator is created.
+  typedef std::unordered_map<string, unique_ptr<Blob> > BlobMap;
   typedef CaffeMap<string, unique_ptr<NetBase> > NetMap;
+  /**
+   * The tracked memory in use when a net run started, and the most that was
+   * in use during the run, on all devices together. See MemoryTracker.
+   */
+  struct NetMemoryUsage {
+    size_t bytes_at_start = 0;
+    size_t peak_bytes = 0;
+  };
   /**
    * Initializes an empty workspace.
    */
@@ -83,18 +103,30 @@ class Workspace {
   ~Workspace() {}
 
   /**
-   * Return list of blobs owned by this Workspace, not including blobs
-   * shared from parent workspace.
+   * Return the sorted list of blobs owned by this Workspace, not including
+   * blobs shared from parent workspace.
    */
   vector<string> LocalBlobs() const;
 
   /**
-   * Return a list of blob names. This may be a bit slow since it will involve
-   * creation of multiple temp variables. For best performance, simply use
-   * HasBlob() and GetBlob().
+   * Return a list of blob names, the ones of this workspace first, each part
+   * sorted. This may be a bit slow since it will involve creation of multiple
+   * temp variables. For best performance, simply use HasBlob() and GetBlob().
    */
   vector<string> Blobs() const;
 
+  /**
+   * Returns the bytes allocated by every tensor blob owned by this Workspace,
+   * not including blobs shared from parent workspace. Tensors that share
+   * their data are counted once per blob, except for copy-on-write tensors,
+   * which do not count until they are copied.
+   */
+  CaffeMap<string, size_t> BlobMemoryUsage() const;
+  /**
+   * Returns the sum of BlobMemoryUsage().
+   */
+  size_t MemoryUsage() const;
+
   /**
    * Return the root folder of the workspace.
    */
@@ -112,6 +144,20 @@ class Workspace {
    * already exists, the creation is skipped and the existing blob is returned.
    */
   Blob* CreateBlob(const string& name);
+  /**
+   * Like CreateBlob, but creates the blob in this workspace even if the shared
+   * workspace has a blob of the given name, which it then hides. If the blob
+   * exists locally already, the existing blob is returned.
+   */
+  Blob* CreateLocalBlob(const string& name);
+  /**
+   * Creates a local blob for every CPU tensor of the shared workspace, sharing
+   * the tensor copy-on-write (see Tensor::ShareDataCopyOnWrite()). Nets of
+   * this workspace can then modify these tensors without affecting the shared
+   * workspace, and only the tensors they modify are copied. Blobs that exist
+   * locally already are left alone. Returns the names of the shared blobs.
+   */
+  vector<string> ShareTensorsCopyOnWrite();
   /**
    * Remove the blob of the given name. Return true if removed and false if
    * not exist.
@@ -121,6 +167,10 @@ class Workspace {
   /**
    * Gets the blob with the given name as a const pointer. If the blob does not
    * exist, a nullptr is returned.
+   *
+   * The pointer stays valid until the blob is removed or the workspace is
+   * destroyed, so code that accesses the same blobs repeatedly, such as
+   * operators or Predictor, resolves them once and keeps the pointers.
    */
   const Blob* GetBlob(const string& name) const;
   /**
@@ -153,6 +203,19 @@ class Workspace {
    * returns false.
    */
   bool RunNet(const string& net_name);
+  /**
+   * Returns the memory usage of the last RunNet() of the given network. This
+   * is only recorded while --caffe2_memory_tracking is set.
+   */
+  NetMemoryUsage LastRunMemoryUsage(const string& net_name) const;
+  /**
+   * Returns the sampled per-operator timings of the given network, or its
+   * per-operator-type ones if `by_type`, which are only recorded while
+   * profiling is on for it. See NetProfiler.
+   */
+  vector<OperatorProfile> NetOperatorProfiles(
+      const string& net_name,
+      bool by_type = false) const;
 
   /**
    * Returns a list of names of the currently instantiated networks.
@@ -180,25 +243,60 @@ class Workspace {
   ThreadPool* GetThreadPool();
 #endif
 
+  /*
+   * Returns the executor pool that nets created in this workspace can run
+   * their operators on instead of starting threads of their own. The pool is
+   * created lazily, and a workspace with a shared workspace uses the pool of
+   * the shared workspace, so all nets in the workspace tree share one set of
+   * threads.
+   */
+  ExecutorPool* GetExecutorPool();
+
   // RunOperatorOnce and RunNetOnce runs an operator or net once. The difference
   // between RunNet and RunNetOnce lies in the fact that RunNet allows you to
   // have a persistent net object, while RunNetOnce creates a net and discards
   // it on the fly - this may make things like database read and random number
   // generators repeat the same thing over multiple calls.
+  //
+  // With --caffe2_run_once_cache_size, the nets and operators that they
+  // create are kept instead, and reused when the same definition runs again,
+  // so they keep their state between the runs.
   bool RunOperatorOnce(const OperatorDef& op_def);
   bool RunNetOnce(const NetDef& net_def);
+  /**
+   * Drops the nets and operators that RunNetOnce() and RunOperatorOnce()
+   * cached, so that the next runs start over from new ones.
+   */
+  void ClearRunOnceCache();
 
  protected:
   bool ExecuteStepRecursive(
       const ExecutionStep& execution,
       ShouldContinue externalShouldContinue);
+  // Returns the pool that runs concurrent substeps, creating it if needed.
+  StepThreadPool* GetStepThreadPool();
+  // Allocates a blob from the blob arena if --caffe2_arena_allocation is set.
+  Blob* NewBlob();
+  // Whether all the blobs are in this workspace rather than the shared one.
+  bool BlobsAreLocal(const vector<string>& blobs) const;
 
  private:
+  // Declared first so that it outlives the nets that schedule onto it.
+  std::unique_ptr<ExecutorPool> executor_pool_;
+  std::mutex executor_pool_creation_mutex_;
+  std::unique_ptr<StepThreadPool> step_thread_pool_;
+  std::mutex step_thread_pool_creation_mutex_;
+  // Declared before the blobs, which may live in it.
+  Arena blob_arena_;
   BlobMap blob_map_;
   NetMap net_map_;
+  RunOnceCache<NetBase> net_once_cache_;
+  RunOnceCache<OperatorBase> op_once_cache_;
+  CaffeMap<string, NetMemoryUsage> net_memory_usage_;
   string root_folder_ = ".";
   Workspace* shared_ = nullptr;
 #if CAFFE2_MOBILE
+  std::unique_ptr<ThreadAllotment> thread_pool_allotment_;
   std::unique_ptr<ThreadPool> thread_pool_;
   std::mutex thread_pool_creation_mutex_;
 #endif // CAFFE2_MOBILE
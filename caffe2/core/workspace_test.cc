@@ -1,4 +1,10 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
 
 #include "caffe2/core/operator.h"
 #include "gtest/gtest.h"
@@ -10,6 +16,25 @@ class WorkspaceTestFoo {};
 
 CAFFE_KNOWN_TYPE(WorkspaceTestFoo);
 
+// Counts the instances that are created, to tell the cached ones apart.
+class WorkspaceTestCountingOp final : public OperatorBase {
+ public:
+  WorkspaceTestCountingOp(const OperatorDef& operator_def, Workspace* ws)
+      : OperatorBase(operator_def, ws) {
+    ++instances;
+  }
+  bool Run() override {
+    return true;
+  }
+
+  static int instances;
+};
+
+int WorkspaceTestCountingOp::instances = 0;
+
+REGISTER_CPU_OPERATOR(WorkspaceTestCounting, WorkspaceTestCountingOp);
+OPERATOR_SCHEMA(WorkspaceTestCounting).NumInputs(0, 1).NumOutputs(0, 1);
+
 TEST(WorkspaceTest, BlobAccess) {
   Workspace ws;
 
@@ -48,6 +73,27 @@ TEST(WorkspaceTest, BlobAccess) {
   EXPECT_FALSE(ws.HasBlob("newblob"));
 }
 
+TEST(WorkspaceTest, BlobNamesAreSortedAndPointersStable) {
+  Workspace parent;
+  Blob* c = parent.CreateBlob("c");
+  Workspace child(&parent);
+  Blob* b = child.CreateBlob("b");
+  child.CreateBlob("a");
+  // The blob of the parent is not created again.
+  EXPECT_EQ(child.CreateBlob("c"), c);
+  for (int i = 0; i < 1000; ++i) {
+    child.CreateBlob("blob_" + caffe2::to_string(i));
+  }
+  EXPECT_EQ(child.GetBlob("b"), b);
+  EXPECT_EQ(child.GetBlob("c"), c);
+  const auto local = child.LocalBlobs();
+  EXPECT_EQ(local.size(), 1002);
+  EXPECT_TRUE(std::is_sorted(local.begin(), local.end()));
+  const auto all = child.Blobs();
+  EXPECT_EQ(all.size(), 1003);
+  EXPECT_EQ(all.back(), "c");
+}
+
 TEST(WorkspaceTest, RunEmptyPlan) {
   PlanDef plan_def;
   Workspace ws;
@@ -79,4 +125,188 @@ TEST(WorkspaceTest, Sharing) {
   }
 }
 
+namespace {
+
+std::mutex substep_mutex;
+std::set<std::thread::id> substep_threads;
+std::atomic<int> running_substeps;
+std::atomic<int> max_running_substeps;
+
+// Records which thread runs it, and how many of them run at the same time.
+class WorkspaceTestSubstepOp final : public OperatorBase {
+ public:
+  using OperatorBase::OperatorBase;
+  bool Run() override {
+    int running = ++running_substeps;
+    int max_running = max_running_substeps;
+    while (running > max_running &&
+           !max_running_substeps.compare_exchange_weak(max_running, running)) {
+    }
+    {
+      std::lock_guard<std::mutex> guard(substep_mutex);
+      substep_threads.insert(std::this_thread::get_id());
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    --running_substeps;
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(WorkspaceTestSubstep, WorkspaceTestSubstepOp);
+OPERATOR_SCHEMA(WorkspaceTestSubstep).NumInputs(0).NumOutputs(0);
+
+PlanDef ConcurrentSubstepsPlan(int num_substeps, int num_iter) {
+  PlanDef plan_def;
+  auto* step = plan_def.add_execution_step();
+  step->set_name("concurrent");
+  step->set_num_iter(num_iter);
+  step->set_concurrent_substeps(true);
+  for (int i = 0; i < num_substeps; ++i) {
+    auto* net_def = plan_def.add_network();
+    net_def->set_name("net" + caffe2::to_string(i));
+    net_def->add_op()->set_type("WorkspaceTestSubstep");
+    auto* substep = step->add_substep();
+    substep->set_name("substep" + caffe2::to_string(i));
+    substep->add_network(net_def->name());
+  }
+  return plan_def;
+}
+
+void ResetSubstepStats() {
+  substep_threads.clear();
+  running_substeps = 0;
+  max_running_substeps = 0;
+}
+
+} // namespace
+
+TEST(WorkspaceTest, ConcurrentSubstepsReuseThreads) {
+  ResetSubstepStats();
+  Workspace ws;
+  PlanDef plan_def = ConcurrentSubstepsPlan(4, 5);
+  plan_def.mutable_execution_step(0)->set_substep_timing_blob("timing");
+  EXPECT_TRUE(ws.RunPlan(plan_def));
+  // Every iteration runs on the same 4 threads.
+  EXPECT_LE(substep_threads.size(), 4);
+  EXPECT_GE(max_running_substeps, 2);
+  const auto& timing = ws.GetBlob("timing")->Get<TensorCPU>();
+  ASSERT_EQ(timing.size(), 4);
+  for (int i = 0; i < 4; ++i) {
+    // 5 iterations of at least 10ms.
+    EXPECT_GE(timing.data<float>()[i], 0.045);
+  }
+}
+
+TEST(WorkspaceTest, MaxConcurrentSubsteps) {
+  ResetSubstepStats();
+  Workspace ws;
+  PlanDef plan_def = ConcurrentSubstepsPlan(4, 2);
+  plan_def.mutable_execution_step(0)->set_max_concurrent_substeps(1);
+  plan_def.mutable_execution_step(0)->set_pin_substeps_to_cores(true);
+  EXPECT_TRUE(ws.RunPlan(plan_def));
+  EXPECT_EQ(max_running_substeps, 1);
+  EXPECT_EQ(substep_threads.size(), 1);
+}
+
+TEST(WorkspaceTest, BlobMemoryUsage) {
+  Workspace ws;
+  ws.CreateBlob("tensor")->GetMutable<TensorCPU>()->Resize(10, 10);
+  ws.GetBlob("tensor")->GetMutable<TensorCPU>()->mutable_data<float>();
+  ws.CreateBlob("foo")->GetMutable<WorkspaceTestFoo>();
+  // Shrinking keeps the memory.
+  ws.GetBlob("tensor")->GetMutable<TensorCPU>()->Resize(10);
+  auto usage = ws.BlobMemoryUsage();
+  EXPECT_EQ(usage.size(), 1);
+  EXPECT_EQ(usage["tensor"], 100 * sizeof(float));
+  EXPECT_EQ(ws.MemoryUsage(), 100 * sizeof(float));
+}
+
+TEST(WorkspaceTest, ShareTensorsCopyOnWrite) {
+  Workspace parent;
+  auto* weights = parent.CreateBlob("weights")->GetMutable<TensorCPU>();
+  weights->Resize(10);
+  weights->mutable_data<float>()[0] = 1;
+  parent.CreateBlob("foo")->GetMutable<WorkspaceTestFoo>();
+  parent.CreateBlob("uninitialized")->GetMutable<TensorCPU>()->Resize(10);
+
+  Workspace ws(&parent);
+  EXPECT_EQ(ws.ShareTensorsCopyOnWrite(), vector<string>{"weights"});
+  EXPECT_EQ(ws.LocalBlobs(), vector<string>{"weights"});
+  // Shared tensors do not count as memory of the workspace.
+  EXPECT_EQ(ws.MemoryUsage(), 0);
+  auto* local = ws.GetBlob("weights")->GetMutable<TensorCPU>();
+  EXPECT_EQ(local->data<float>(), weights->data<float>());
+  local->mutable_data<float>()[0] = 2;
+  EXPECT_EQ(weights->data<float>()[0], 1);
+  EXPECT_EQ(ws.MemoryUsage(), 10 * sizeof(float));
+}
+
+TEST(WorkspaceTest, NetRunMemoryUsage) {
+  FLAGS_caffe2_memory_tracking = true;
+  Workspace ws;
+  NetDef net_def;
+  net_def.set_name("fill");
+  auto* op = net_def.add_op();
+  op->set_type("ConstantFill");
+  op->add_output("out");
+  AddArgument<vector<int>>("shape", vector<int>{1000}, op);
+  ASSERT_TRUE(ws.CreateNet(net_def));
+  ASSERT_TRUE(ws.RunNet("fill"));
+  auto usage = ws.LastRunMemoryUsage("fill");
+  EXPECT_GE(usage.peak_bytes, usage.bytes_at_start + 1000 * sizeof(float));
+  ws.DeleteNet("fill");
+  EXPECT_EQ(ws.LastRunMemoryUsage("fill").peak_bytes, 0);
+  FLAGS_caffe2_memory_tracking = false;
+}
+
+TEST(WorkspaceTest, RunOnceCache) {
+  Workspace ws;
+  ws.CreateBlob("in");
+  OperatorDef op_def;
+  op_def.set_type("WorkspaceTestCounting");
+  op_def.add_input("in");
+  op_def.add_output("out");
+  NetDef net_def;
+  net_def.set_name("once");
+  *net_def.add_op() = op_def;
+  auto& instances = WorkspaceTestCountingOp::instances;
+
+  // Off by default.
+  instances = 0;
+  ASSERT_TRUE(ws.RunOperatorOnce(op_def));
+  ASSERT_TRUE(ws.RunOperatorOnce(op_def));
+  EXPECT_EQ(instances, 2);
+
+  FLAGS_caffe2_run_once_cache_size = 1;
+  instances = 0;
+  ASSERT_TRUE(ws.RunOperatorOnce(op_def));
+  ASSERT_TRUE(ws.RunOperatorOnce(op_def));
+  ASSERT_TRUE(ws.RunNetOnce(net_def));
+  ASSERT_TRUE(ws.RunNetOnce(net_def));
+  EXPECT_EQ(instances, 2);
+
+  // Another definition evicts the cached one.
+  OperatorDef other_def = op_def;
+  other_def.set_name("other");
+  ASSERT_TRUE(ws.RunOperatorOnce(other_def));
+  ASSERT_TRUE(ws.RunOperatorOnce(op_def));
+  EXPECT_EQ(instances, 4);
+
+  // Removing a bound blob drops the instances, as does clearing the cache.
+  EXPECT_TRUE(ws.RemoveBlob("out"));
+  ASSERT_TRUE(ws.RunOperatorOnce(op_def));
+  ASSERT_TRUE(ws.RunNetOnce(net_def));
+  EXPECT_EQ(instances, 6);
+  ws.ClearRunOnceCache();
+  ASSERT_TRUE(ws.RunNetOnce(net_def));
+  EXPECT_EQ(instances, 7);
+
+  // Instances bound to blobs of the shared workspace are not cached.
+  Workspace child(&ws);
+  ASSERT_TRUE(child.RunOperatorOnce(op_def));
+  ASSERT_TRUE(child.RunOperatorOnce(op_def));
+  EXPECT_EQ(instances, 9);
+  FLAGS_caffe2_run_once_cache_size = 0;
+}
+
 }  // namespace caffe2
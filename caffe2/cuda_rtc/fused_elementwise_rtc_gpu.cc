@@ -0,0 +1,128 @@
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+#include "caffe2/core/common_gpu.h"
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/cuda_rtc/common_rtc.h"
+#include "caffe2/operators/fused_elementwise_op.h"
+
+namespace caffe2 {
+namespace {
+class FusedElementwiseRTCFunction
+    : public CudaRTCFunction<FusedElementwiseRTCFunction> {
+ public:
+  // The name only depends on the kernel, so that the generated source, and
+  // what VLOG prints of it, is the same in every run.
+  string KernelName(int input_size, const string& body) {
+    std::stringstream ss;
+    ss << "fused_elementwise_" << std::hex
+       << std::hash<string>()(caffe2::to_string(input_size) + body);
+    return ss.str();
+  }
+
+  string GetSource(int input_size, const string& body) {
+    std::stringstream ss;
+    ss << "extern \"C\" __global__ void " << KernelName(input_size, body)
+       << "(const size_t nthreads";
+    for (int i = 0; i < input_size; ++i) {
+      ss << ", const float* in" << i;
+    }
+    ss << ", float* out0) {\n"
+          "for (int index = blockIdx.x * blockDim.x + threadIdx.x;\n"
+          "index < nthreads; index += blockDim.x * gridDim.x) {\n"
+       << body << "}\n}";
+    return ss.str();
+  }
+};
+
+// Returns the kernel computing body on the current device, compiling it the
+// first time. Kernels are shared by all the operators of the process and kept
+// until exit; they are deliberately leaked so that no module is unloaded
+// after the CUDA driver has shut down.
+FusedElementwiseRTCFunction* GetKernel(int input_size, const string& body) {
+  static std::mutex mutex;
+  static std::unordered_map<string, FusedElementwiseRTCFunction*> kernels;
+  const string key = caffe2::to_string(GetCurrentGPUID()) + "|" +
+      caffe2::to_string(input_size) + "|" + body;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& kernel = kernels[key];
+  if (!kernel) {
+    kernel = new FusedElementwiseRTCFunction();
+    kernel->Compile(input_size, body);
+  }
+  return kernel;
+}
+} // namespace
+
+// The CUDA implementation of FusedElementwise, see the CPU operator for the
+// arguments. The chain is turned into the body of an elementwise kernel,
+// which is compiled with NVRTC once per device and shared, through
+// GetKernel, by every operator computing the same chain.
+class FusedElementwiseRTCOp final : public Operator<CUDAContext> {
+ public:
+  FusedElementwiseRTCOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CUDAContext>(operator_def, ws) {
+    const string body =
+        FusedElementwiseCudaSource(GetFusedElementwiseSteps(operator_def));
+    DeviceGuard guard(context_.cuda_gpu_id());
+    func_ = GetKernel(InputSize(), body);
+  }
+
+  bool RunOnDevice() override {
+    static_assert(
+        sizeof(void*) == sizeof(size_t),
+        "The argbuffer relies on the assumption that void* and "
+        "size_t have the same size.");
+    const auto& X = Input(0);
+    CAFFE_ENFORCE(
+        X.size() < std::numeric_limits<int>::max(),
+        "The kernel function currently only supports int index.");
+    for (int i = 1; i < InputSize(); ++i) {
+      CAFFE_ENFORCE_EQ(
+          Input(i).size(), X.size(), "All inputs should have the same size.");
+    }
+    if (X.size() == 0) {
+      Output(0)->ResizeLike(X);
+      Output(0)->mutable_data<float>();
+      return true;
+    }
+    size_t argBuffer[InputSize() + 2];
+    argBuffer[0] = X.size();
+    void** ptr_buffer = reinterpret_cast<void**>(argBuffer + 1);
+    for (int i = 0; i < InputSize(); ++i) {
+      ptr_buffer[i] = const_cast<float*>(Input(i).data<float>());
+    }
+    auto* Y = Output(0);
+    Y->ResizeLike(X);
+    ptr_buffer[InputSize()] = Y->mutable_data<float>();
+    size_t argBufferSize = sizeof(argBuffer);
+    void* config[] = {CU_LAUNCH_PARAM_BUFFER_POINTER,
+                      argBuffer,
+                      CU_LAUNCH_PARAM_BUFFER_SIZE,
+                      &argBufferSize,
+                      CU_LAUNCH_PARAM_END};
+    func_->LaunchEx(
+        CAFFE_GET_BLOCKS(X.size()),
+        1,
+        1,
+        CAFFE_CUDA_NUM_THREADS,
+        1,
+        1,
+        0,
+        context_.cuda_stream(),
+        config);
+    return true;
+  }
+
+ private:
+  FusedElementwiseRTCFunction* func_;
+};
+
+namespace {
+REGISTER_CUDA_OPERATOR(FusedElementwise, FusedElementwiseRTCOp);
+}
+
+} // namespace caffe2
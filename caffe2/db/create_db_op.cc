@@ -4,7 +4,18 @@ namespace caffe2 {
 namespace {
 REGISTER_CPU_OPERATOR(CreateDB, CreateDBOp<CPUContext>);
 
-OPERATOR_SCHEMA(CreateDB).NumInputs(0).NumOutputs(1);
+OPERATOR_SCHEMA(CreateDB)
+    .NumInputs(0)
+    .NumOutputs(1)
+    .Arg("db", "(string) the path to the db.")
+    .Arg("db_type", "(string, default \"leveldb\") the type of the db.")
+    .Arg("num_shards", "(int, default 1) the number of shards of the db.")
+    .Arg("shard_id", "(int, default 0) the shard to read.")
+    .Arg(
+        "num_cursors",
+        "(int, default 1) the number of cursors to read the shard with, so "
+        "that the readers of the db, such as the prefetch threads of several "
+        "input operators, do not all contend on one cursor.");
 
 NO_GRADIENT(CreateDB);
 }
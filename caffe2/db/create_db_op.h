@@ -19,13 +19,15 @@ class CreateDBOp final : public Operator<Context> {
         num_shards_(
             OperatorBase::template GetSingleArgument<int>("num_shards", 1)),
         shard_id_(
-            OperatorBase::template GetSingleArgument<int>("shard_id", 0)) {
+            OperatorBase::template GetSingleArgument<int>("shard_id", 0)),
+        num_cursors_(
+            OperatorBase::template GetSingleArgument<int>("num_cursors", 1)) {
     CAFFE_ENFORCE_GT(db_name_.size(), 0, "Must specify a db name.");
   }
 
   bool RunOnDevice() final {
     OperatorBase::Output<db::DBReader>(0)->Open(
-        db_type_, db_name_, num_shards_, shard_id_);
+        db_type_, db_name_, num_shards_, shard_id_, num_cursors_);
     return true;
   }
 
@@ -34,6 +36,7 @@ class CreateDBOp final : public Operator<Context> {
   string db_name_;
   uint32_t num_shards_;
   uint32_t shard_id_;
+  uint32_t num_cursors_;
   DISABLE_COPY_AND_ASSIGN(CreateDBOp);
 };
 
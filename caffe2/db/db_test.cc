@@ -1,19 +1,77 @@
 #include <cstdio>
 #include <iomanip>
+#include <map>
+#include <set>
 #include <sstream>
 #include <thread>
 
 #include "caffe2/core/blob_serialization.h"
 #include "caffe2/core/db.h"
+#include "caffe2/core/flags.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/proto/caffe2.pb.h"
 #include "gtest/gtest.h"
 
+CAFFE2_DECLARE_int64(caffe2_recorddb_file_size);
+CAFFE2_DECLARE_int(caffe2_recorddb_read_size);
+CAFFE2_DECLARE_int(caffe2_recorddb_queue_depth);
+
 namespace caffe2 {
 namespace db {
 
 constexpr int kMaxItems = 10;
 
+// An in memory db that supports seeking and several cursors, keyed by source.
+std::map<string, std::map<string, string>> test_dbs;
+
+class TestDBCursor : public Cursor {
+ public:
+  explicit TestDBCursor(const std::map<string, string>* records)
+      : records_(records), iter_(records->begin()) {}
+  void Seek(const string& key) override { iter_ = records_->lower_bound(key); }
+  bool SupportsSeek() override { return true; }
+  void SeekToFirst() override { iter_ = records_->begin(); }
+  void Next() override { ++iter_; }
+  string key() override { return iter_->first; }
+  string value() override { return iter_->second; }
+  bool Valid() override { return iter_ != records_->end(); }
+
+ private:
+  const std::map<string, string>* records_;
+  std::map<string, string>::const_iterator iter_;
+};
+
+class TestDBTransaction : public Transaction {
+ public:
+  explicit TestDBTransaction(std::map<string, string>* records)
+      : records_(records) {}
+  void Put(const string& key, const string& value) override {
+    (*records_)[key] = value;
+  }
+  void Commit() override {}
+
+ private:
+  std::map<string, string>* records_;
+};
+
+class TestDB : public DB {
+ public:
+  TestDB(const string& source, Mode mode)
+      : DB(source, mode), records_(&test_dbs[source]) {}
+  void Close() override {}
+  unique_ptr<Cursor> NewCursor() override {
+    return make_unique<TestDBCursor>(records_);
+  }
+  unique_ptr<Transaction> NewTransaction() override {
+    return make_unique<TestDBTransaction>(records_);
+  }
+  bool SupportsMultipleCursors() override { return true; }
+
+ private:
+  std::map<string, string>* records_;
+};
+REGISTER_CAFFE2_DB(test_db, TestDB);
+
 static bool CreateAndFill(const string& db_type, const string& name) {
   VLOG(1) << "Creating db: " << name;
   std::unique_ptr<DB> db(CreateDB(db_type, name, NEW));
@@ -33,6 +91,23 @@ static bool CreateAndFill(const string& db_type, const string& name) {
   return true;
 }
 
+static void TestNextBatch(Cursor* cursor) {
+  cursor->SeekToFirst();
+  vector<StringView> keys, values;
+  EXPECT_EQ(cursor->NextBatch(4, &keys, &values), 4);
+  ASSERT_EQ(keys.size(), 4);
+  ASSERT_EQ(values.size(), 4);
+  EXPECT_EQ(keys[0].ToString(), "00");
+  EXPECT_EQ(values[3].ToString(), "03");
+  EXPECT_EQ(cursor->key(), "04");
+  // The last batch stops at the end of the db.
+  EXPECT_EQ(cursor->NextBatch(kMaxItems, &keys, &values), kMaxItems - 4);
+  EXPECT_EQ(keys.back().ToString(), "09");
+  EXPECT_FALSE(cursor->Valid());
+  EXPECT_EQ(cursor->NextBatch(4, &keys, &values), 0);
+  cursor->SeekToFirst();
+}
+
 static void TestCursor(Cursor* cursor) {
   // Test the first key.
   cursor->SeekToFirst();
@@ -60,6 +135,7 @@ static void TestCursor(Cursor* cursor) {
   // Test seeking to empty string, aka the beginning
   cursor->Seek("");
   EXPECT_EQ(cursor->key(), "00");
+  TestNextBatch(cursor);
 }
 
 static void DBSeekTestWrapper(const string& db_type) {
@@ -86,6 +162,92 @@ TEST(DBSeekTest, LMDB) {
   DBSeekTestWrapper("lmdb");
 }
 
+TEST(DBSeekTest, RecordDB) {
+  DBSeekTestWrapper("recorddb");
+}
+
+TEST(RecordDBTest, ManyFilesAndSmallReads) {
+  const auto file_size = FLAGS_caffe2_recorddb_file_size;
+  const auto read_size = FLAGS_caffe2_recorddb_read_size;
+  FLAGS_caffe2_recorddb_file_size = 10000;
+  FLAGS_caffe2_recorddb_read_size = 1;
+  std::string name = std::tmpnam(nullptr);
+  constexpr int kNumRecords = 1000;
+  {
+    std::unique_ptr<DB> db(CreateDB("recorddb", name, NEW));
+    std::unique_ptr<Transaction> trans(db->NewTransaction());
+    for (int i = 0; i < kNumRecords; ++i) {
+      std::stringstream ss;
+      ss << std::setw(4) << std::setfill('0') << i;
+      // Values of various sizes, some larger than a read.
+      trans->Put(ss.str(), string((i * 37) % 5000, 'a' + i % 26));
+    }
+  }
+  // With and without reads in flight ahead of the cursor.
+  for (int queue_depth : {0, 3}) {
+    FLAGS_caffe2_recorddb_queue_depth = queue_depth;
+    std::unique_ptr<DB> db(CreateDB("recorddb", name, READ));
+    std::unique_ptr<Cursor> cursor(db->NewCursor());
+    int count = 0;
+    for (; cursor->Valid(); cursor->Next(), ++count) {
+      EXPECT_EQ(
+          cursor->value(), string((count * 37) % 5000, 'a' + count % 26));
+    }
+    EXPECT_EQ(count, kNumRecords);
+    cursor->SeekToFirst();
+    vector<StringView> keys, values;
+    count = 0;
+    while (size_t n = cursor->NextBatch(64, &keys, &values)) {
+      for (int i = 0; i < n; ++i, ++count) {
+        EXPECT_EQ(values[i].size, (count * 37) % 5000);
+      }
+    }
+    EXPECT_EQ(count, kNumRecords);
+    EXPECT_TRUE(cursor->SupportsSeek());
+    cursor->Seek("0567");
+    EXPECT_EQ(cursor->key(), "0567");
+    cursor->Seek("0567.5");
+    EXPECT_EQ(cursor->key(), "0568");
+  }
+  FLAGS_caffe2_recorddb_queue_depth = 0;
+  FLAGS_caffe2_recorddb_file_size = file_size;
+  FLAGS_caffe2_recorddb_read_size = read_size;
+}
+
+TEST(DBSeekTest, MiniDBNextBatch) {
+  std::string name = std::tmpnam(nullptr);
+  ASSERT_TRUE(CreateAndFill("minidb", name));
+  std::unique_ptr<DB> db(CreateDB("minidb", name, READ));
+  std::unique_ptr<Cursor> cursor(db->NewCursor());
+  TestNextBatch(cursor.get());
+  std::remove(name.c_str());
+}
+
+TEST(DBReaderTest, ReadBatch) {
+  std::string name = std::tmpnam(nullptr);
+  ASSERT_TRUE(CreateAndFill("minidb", name));
+  DBReader reader("minidb", name);
+  vector<string> keys, values;
+  reader.ReadBatch(4, &keys, &values);
+  ASSERT_EQ(keys.size(), 4);
+  EXPECT_EQ(keys[0], "00");
+  EXPECT_EQ(values[3], "03");
+  // Batches wrap around at the end of the db, like Read() does.
+  reader.ReadBatch(kMaxItems, nullptr, &values);
+  ASSERT_EQ(values.size(), kMaxItems);
+  EXPECT_EQ(values[0], "04");
+  EXPECT_EQ(values[5], "09");
+  EXPECT_EQ(values[6], "00");
+  string key, value;
+  reader.Read(&key, &value);
+  EXPECT_EQ(key, "04");
+
+  DBReader sharded("minidb", name, 3, 1);
+  sharded.ReadBatch(4, &keys, &values);
+  EXPECT_EQ(keys, (vector<string>{"01", "04", "07", "01"}));
+  std::remove(name.c_str());
+}
+
 TEST(DBReaderTest, Reader) {
   std::string name = std::tmpnam(nullptr);
   CreateAndFill("leveldb", name);
@@ -151,6 +313,95 @@ TEST(DBReaderTest, Reader) {
   EXPECT_EQ(keys_set.size(), kMaxItems);
 }
 
+TEST(DBReaderTest, MultipleCursors) {
+  std::string name = std::tmpnam(nullptr);
+  CreateAndFill("test_db", name);
+  std::unique_ptr<DBReader> reader(new DBReader("test_db", name, 1, 0, 3));
+  EXPECT_EQ(reader->num_cursors(), 3);
+  // Read by a single thread, the records come in order.
+  string key, value;
+  for (int i = 0; i < kMaxItems; ++i) {
+    reader->Read(&key, &value);
+    EXPECT_EQ(key, "0" + caffe2::to_string(i));
+  }
+  // Each cursor wraps around on its own: the first one read 00, 03, 06 and
+  // 09, and the next read goes to the second one.
+  reader->Read(&key, &value);
+  EXPECT_EQ(key, "01");
+  EXPECT_THROW(
+      DBReader("minidb", CreateAndFill("minidb", name) ? name : "", 1, 0, 2),
+      EnforceNotMet);
+
+  // The serialized reader resumes from the next record.
+  reader->SeekToFirst();
+  reader->Read(&key, &value);
+  reader->Read(&key, &value);
+  Blob reader_blob;
+  reader_blob.Reset(reader.release());
+  std::string str = reader_blob.Serialize("saved_reader");
+  reader_blob.Reset();
+  reader_blob.Deserialize(str);
+  const DBReader& new_reader = reader_blob.Get<DBReader>();
+  EXPECT_EQ(new_reader.num_cursors(), 3);
+  for (int i = 2; i < 6; ++i) {
+    new_reader.Read(&key, &value);
+    EXPECT_EQ(key, "0" + caffe2::to_string(i));
+  }
+
+  // All the records are read exactly once by concurrent readers.
+  new_reader.SeekToFirst();
+  vector<unique_ptr<std::thread>> threads(kMaxItems);
+  vector<string> keys(kMaxItems);
+  vector<string> values(kMaxItems);
+  for (int i = 0; i < kMaxItems; ++i) {
+    threads[i].reset(new std::thread(
+        [&new_reader](string* key, string* value) {
+          new_reader.Read(key, value);
+        },
+        &keys[i],
+        &values[i]));
+  }
+  for (int i = 0; i < kMaxItems; ++i) {
+    threads[i]->join();
+  }
+  std::set<string> keys_set(keys.begin(), keys.end());
+  EXPECT_EQ(keys_set.size(), kMaxItems);
+  std::remove(name.c_str());
+}
+
+TEST(DBReaderTest, Seek) {
+  std::string name = std::tmpnam(nullptr);
+  CreateAndFill("test_db", name);
+  // The next read returns the key, or the next one, from any of the cursors.
+  DBReader reader("test_db", name, 1, 0, 3);
+  string key, value;
+  reader.Read(&key, &value);
+  reader.Seek("05");
+  for (int i = 5; i < kMaxItems; ++i) {
+    reader.Read(&key, &value);
+    EXPECT_EQ(key, "0" + caffe2::to_string(i));
+  }
+  reader.Seek("07.5");
+  reader.Read(&key, &value);
+  EXPECT_EQ(key, "08");
+  // Past the end, the reader goes back to the beginning of the db.
+  reader.Seek("10");
+  reader.Read(&key, &value);
+  EXPECT_EQ(key, "00");
+
+  // A sharded reader keeps skipping the records of the other shards.
+  DBReader sharded("test_db", name, 3, 1);
+  sharded.Seek("02");
+  sharded.Read(&key, &value);
+  EXPECT_EQ(key, "02");
+  sharded.Read(&key, &value);
+  EXPECT_EQ(key, "05");
+
+  ASSERT_TRUE(CreateAndFill("minidb", name));
+  EXPECT_THROW(DBReader("minidb", name).Seek("05"), EnforceNotMet);
+  std::remove(name.c_str());
+}
+
 TEST(DBReaderShardedTest, Reader) {
   std::string name = std::tmpnam(nullptr);
   CreateAndFill("leveldb", name);
@@ -24,6 +24,23 @@ class LevelDBCursor : public Cursor {
   string key() override { return iter_->key().ToString(); }
   string value() override { return iter_->value().ToString(); }
   bool Valid() override { return iter_->Valid(); }
+  size_t NextBatch(
+      size_t max_records,
+      vector<StringView>* keys,
+      vector<StringView>* values) override {
+    // The slices of the iterator are only valid until it moves.
+    batch_buffer_.Clear();
+    while (batch_buffer_.size() < max_records && iter_->Valid()) {
+      batch_buffer_.Add(
+          iter_->key().data(),
+          iter_->key().size(),
+          iter_->value().data(),
+          iter_->value().size());
+      iter_->Next();
+    }
+    batch_buffer_.GetViews(keys, values);
+    return batch_buffer_.size();
+  }
 
  private:
   std::unique_ptr<leveldb::Iterator> iter_;
@@ -76,6 +93,7 @@ class LevelDB : public DB {
   unique_ptr<Cursor> NewCursor() override {
     return make_unique<LevelDBCursor>(db_.get());
   }
+  bool SupportsMultipleCursors() override { return true; }
   unique_ptr<Transaction> NewTransaction() override {
     return make_unique<LevelDBTransaction>(db_.get());
   }
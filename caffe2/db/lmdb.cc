@@ -66,6 +66,23 @@ class LMDBCursor : public Cursor {
 
   bool Valid() override { return valid_; }
 
+  size_t NextBatch(
+      size_t max_records,
+      vector<StringView>* keys,
+      vector<StringView>* values) override {
+    // The records of a read only transaction stay in the memory map until the
+    // transaction ends, so the views point right into it.
+    keys->clear();
+    values->clear();
+    for (; keys->size() < max_records && valid_; Next()) {
+      keys->emplace_back(
+          static_cast<const char*>(mdb_key_.mv_data), mdb_key_.mv_size);
+      values->emplace_back(
+          static_cast<const char*>(mdb_value_.mv_data), mdb_value_.mv_size);
+    }
+    return keys->size();
+  }
+
  private:
   void SeekLMDB(MDB_cursor_op op) {
     int mdb_status = mdb_cursor_get(mdb_cursor_, &mdb_key_, &mdb_value_, op);
@@ -126,6 +143,7 @@ class LMDB : public DB {
   unique_ptr<Cursor> NewCursor() override {
     return make_unique<LMDBCursor>(mdb_env_);
   }
+  bool SupportsMultipleCursors() override { return true; }
   unique_ptr<Transaction> NewTransaction() override {
     return make_unique<LMDBTransaction>(mdb_env_);
   }
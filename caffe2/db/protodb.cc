@@ -85,6 +85,7 @@ class ProtoDB : public DB {
   unique_ptr<Cursor> NewCursor() override {
     return make_unique<ProtoDBCursor>(&proto_);
   }
+  bool SupportsMultipleCursors() override { return true; }
   unique_ptr<Transaction> NewTransaction() override {
     return make_unique<ProtoDBTransaction>(&proto_);
   }
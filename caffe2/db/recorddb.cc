@@ -0,0 +1,592 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include "caffe2/core/db.h"
+#include "caffe2/core/flags.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/async_file_reader.h"
+
+CAFFE2_DEFINE_int64(
+    caffe2_recorddb_file_size,
+    1 << 30,
+    "The size after which a recorddb starts writing a new file, in bytes.");
+CAFFE2_DEFINE_int(
+    caffe2_recorddb_read_size,
+    4 << 20,
+    "The size of the reads of a recorddb cursor, in bytes.");
+CAFFE2_DEFINE_bool(
+    caffe2_recorddb_direct_io,
+    false,
+    "If true, recorddb cursors read with O_DIRECT and bypass the page cache, "
+    "on the file systems that support it.");
+CAFFE2_DEFINE_int(
+    caffe2_recorddb_queue_depth,
+    0,
+    "If positive, the number of reads of caffe2_recorddb_read_size bytes that "
+    "a recorddb cursor keeps in flight ahead of it. Otherwise the cursor reads "
+    "when it is out of bytes, and relies on the kernel readahead.");
+
+namespace caffe2 {
+namespace db {
+
+// A recorddb is a directory of append only record files, for data that is
+// read front to back. Each file holds:
+//   - the records, each a uint32 key size and a uint32 value size followed by
+//     the key and the value,
+//   - an index with the uint64 offset of each record,
+//   - a footer (see RecordFileFooter).
+// A new file is started once a file is larger than caffe2_recorddb_file_size,
+// and the files are read in the order of their names.
+//
+// Cursors read the records with large reads, and hint the kernel to read
+// ahead of them, or keep their own reads in flight ahead of them with
+// caffe2_recorddb_queue_depth, which keeps a storage with a high latency busy. Seeking is supported when the keys were written in order, by
+// a binary search of the index.
+
+namespace {
+
+constexpr char kFilePrefix[] = "records-";
+constexpr char kMagic[8] = {'C', '2', 'R', 'E', 'C', 'D', 'B', '1'};
+// The alignment of the reads, as needed by O_DIRECT.
+constexpr size_t kAlignment = 4096;
+constexpr size_t kHeaderSize = 2 * sizeof(uint32_t);
+
+struct RecordFileFooter {
+  uint64_t index_offset;
+  uint64_t num_records;
+  // Whether the keys, from the first record of the db up to the last one of
+  // this file, are in order.
+  uint32_t sorted;
+  uint32_t reserved;
+  char magic[8];
+};
+
+size_t RoundUp(size_t size) {
+  return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+string FileName(const string& source, int index) {
+  char name[32];
+  snprintf(name, sizeof(name), "%s%05d", kFilePrefix, index);
+  return source + "/" + name;
+}
+
+vector<string> ListFiles(const string& source) {
+  DIR* dir = opendir(source.c_str());
+  CAFFE_ENFORCE(dir, "Cannot open recorddb ", source, ": ", strerror(errno));
+  vector<string> names;
+  while (dirent* entry = readdir(dir)) {
+    if (strncmp(entry->d_name, kFilePrefix, strlen(kFilePrefix)) == 0) {
+      names.push_back(entry->d_name);
+    }
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  for (auto& name : names) {
+    name = source + "/" + name;
+  }
+  return names;
+}
+
+void PreadFully(int fd, void* data, size_t size, uint64_t offset) {
+  char* dst = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t n = pread(fd, dst, size, offset);
+    CAFFE_ENFORCE_GT(n, 0, "Cannot read recorddb file: ", strerror(errno));
+    dst += n;
+    size -= n;
+    offset += n;
+  }
+}
+
+string ReadKey(int fd, uint64_t offset) {
+  uint32_t sizes[2];
+  PreadFully(fd, sizes, sizeof(sizes), offset);
+  string key(sizes[0], '\0');
+  PreadFully(fd, &key[0], key.size(), offset + kHeaderSize);
+  return key;
+}
+
+} // namespace
+
+class RecordDB : public DB {
+ public:
+  struct File {
+    string path;
+    uint64_t data_size;
+    uint64_t num_records;
+    bool sorted;
+    bool index_loaded;
+    vector<uint64_t> index;
+  };
+
+  RecordDB(const string& source, Mode mode);
+  ~RecordDB() {
+    Close();
+  }
+
+  void Close() override {
+    std::lock_guard<std::mutex> guard(mutex_);
+    FinishFile();
+  }
+  unique_ptr<Cursor> NewCursor() override;
+  unique_ptr<Transaction> NewTransaction() override;
+  bool SupportsMultipleCursors() override {
+    return true;
+  }
+
+  const vector<File>& files() const {
+    return files_;
+  }
+  bool sorted() const {
+    return sorted_;
+  }
+  // Returns the offsets of the records of a file, read on first use.
+  const vector<uint64_t>& Index(int file_index);
+
+  void Put(const string& key, const string& value);
+  void Flush() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (out_) {
+      CAFFE_ENFORCE_EQ(fflush(out_), 0);
+    }
+  }
+
+ private:
+  void FinishFile();
+
+  string source_;
+  std::mutex mutex_;
+  vector<File> files_;
+  bool sorted_ = true;
+  // The state of the file being written.
+  int num_files_written_ = 0;
+  FILE* out_ = nullptr;
+  uint64_t out_size_ = 0;
+  vector<uint64_t> out_index_;
+  uint64_t num_records_written_ = 0;
+  string last_key_;
+};
+
+class RecordDBCursor : public Cursor {
+ public:
+  explicit RecordDBCursor(RecordDB* db)
+      : db_(db), read_size_(RoundUp(FLAGS_caffe2_recorddb_read_size)) {
+    SeekToFirst();
+  }
+  ~RecordDBCursor() {
+    CloseFile();
+    free(buffer_);
+  }
+
+  void Seek(const string& key) override {
+    CAFFE_ENFORCE(
+        db_->sorted(), "Only recorddbs with sorted keys support seeking.");
+    const auto& files = db_->files();
+    for (int f = 0; f < files.size(); ++f) {
+      const auto& index = db_->Index(f);
+      if (index.empty()) {
+        continue;
+      }
+      int fd = open(files[f].path.c_str(), O_RDONLY);
+      CAFFE_ENFORCE_GE(fd, 0, "Cannot open ", files[f].path);
+      // The first record with a key that is not less than the given one.
+      size_t lo = 0, hi = index.size();
+      while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (ReadKey(fd, index[mid]) < key) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      close(fd);
+      if (lo < index.size()) {
+        OpenFile(f, index[lo]);
+        Load();
+        return;
+      }
+    }
+    OpenFile(files.size(), 0);
+    valid_ = false;
+  }
+  bool SupportsSeek() override {
+    return db_->sorted();
+  }
+  void SeekToFirst() override {
+    OpenFile(0, 0);
+    Load();
+  }
+  void Next() override {
+    Resolve();
+    pos_ += record_size_;
+    Load();
+  }
+  string key() override {
+    Resolve();
+    CAFFE_ENFORCE(valid_, "Cursor is at invalid location!");
+    return string(key_, key_size_);
+  }
+  string value() override {
+    Resolve();
+    CAFFE_ENFORCE(valid_, "Cursor is at invalid location!");
+    return string(value_, value_size_);
+  }
+  bool Valid() override {
+    Resolve();
+    return valid_;
+  }
+
+  size_t NextBatch(
+      size_t max_records,
+      vector<StringView>* keys,
+      vector<StringView>* values) override {
+    Resolve();
+    keys->clear();
+    values->clear();
+    // The views point into the read buffer, so the batch stops at the first
+    // record that is not in the buffer yet. Reading it is left to the next
+    // call, since it may move the buffer.
+    while (keys->size() < max_records && valid_) {
+      keys->emplace_back(key_, key_size_);
+      values->emplace_back(value_, value_size_);
+      pos_ += record_size_;
+      if (!ParseInBuffer()) {
+        load_pending_ = true;
+        break;
+      }
+    }
+    return keys->size();
+  }
+
+ private:
+  void Resolve() {
+    if (load_pending_) {
+      load_pending_ = false;
+      Load();
+    }
+  }
+
+  uint64_t Offset() const {
+    return file_end_offset_ - (end_ - pos_);
+  }
+
+  void CloseFile() {
+    async_reader_.reset();
+    chunk_size_ = 0;
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  // Positions the cursor at the given offset of a file, without reading it.
+  void OpenFile(int file_index, uint64_t offset) {
+    CloseFile();
+    load_pending_ = false;
+    file_index_ = file_index;
+    pos_ = end_ = 0;
+    const auto& files = db_->files();
+    if (file_index_ >= files.size()) {
+      return;
+    }
+    const string& path = files[file_index_].path;
+    if (FLAGS_caffe2_recorddb_direct_io) {
+      fd_ = open(path.c_str(), O_RDONLY | O_DIRECT);
+      if (fd_ < 0 && errno == EINVAL) {
+        LOG(WARNING) << "The file system of " << path
+                     << " does not support direct io.";
+      }
+    }
+    direct_ = fd_ >= 0;
+    if (fd_ < 0) {
+      fd_ = open(path.c_str(), O_RDONLY);
+    }
+    CAFFE_ENFORCE_GE(fd_, 0, "Cannot open ", path, ": ", strerror(errno));
+    if (!direct_) {
+      posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    file_end_offset_ = offset / kAlignment * kAlignment;
+    data_size_ = files[file_index_].data_size;
+    if (FLAGS_caffe2_recorddb_queue_depth > 0) {
+      async_reader_.reset(new AsyncFileReader(
+          fd_,
+          file_end_offset_,
+          data_size_,
+          read_size_,
+          FLAGS_caffe2_recorddb_queue_depth));
+    }
+    Fill(offset - file_end_offset_);
+    pos_ = end_ - (file_end_offset_ - offset);
+  }
+
+  // Makes sure that the size bytes from pos_ are in the buffer, moving the
+  // bytes left in it to its beginning if needed.
+  void Fill(size_t size) {
+    if (end_ - pos_ >= size) {
+      return;
+    }
+    // The bytes left are moved so that the reads stay aligned.
+    const size_t left = end_ - pos_;
+    const size_t aligned_left = RoundUp(left);
+    const size_t capacity =
+        aligned_left + std::max(read_size_, RoundUp(size - left));
+    char* src = buffer_ + pos_;
+    if (capacity > capacity_) {
+      void* buffer = nullptr;
+      CAFFE_ENFORCE_EQ(posix_memalign(&buffer, kAlignment, capacity), 0);
+      if (left > 0) {
+        memcpy(static_cast<char*>(buffer) + aligned_left - left, src, left);
+      }
+      free(buffer_);
+      buffer_ = static_cast<char*>(buffer);
+      capacity_ = capacity;
+    } else if (left > 0) {
+      memmove(buffer_ + aligned_left - left, src, left);
+    }
+    pos_ = aligned_left - left;
+    end_ = aligned_left;
+    while (end_ - pos_ < size) {
+      if (async_reader_) {
+        FillFromChunk();
+        continue;
+      }
+      const ssize_t n =
+          pread(fd_, buffer_ + end_, capacity_ - end_, file_end_offset_);
+      CAFFE_ENFORCE_GE(n, 0, "Cannot read recorddb file: ", strerror(errno));
+      CAFFE_ENFORCE_GT(n, 0, "Truncated recorddb file.");
+      end_ += n;
+      file_end_offset_ += n;
+    }
+    if (!direct_ && !async_reader_) {
+      // Let the kernel read the next chunk while this one is parsed.
+      posix_fadvise(fd_, file_end_offset_, read_size_, POSIX_FADV_WILLNEED);
+    }
+  }
+
+  // Copies the bytes of the chunk read ahead that fit in the buffer, taking
+  // the next chunk first if the current one is used up.
+  void FillFromChunk() {
+    if (chunk_size_ == 0) {
+      chunk_size_ = async_reader_->Next(&chunk_);
+      CAFFE_ENFORCE_GT(chunk_size_, 0, "Truncated recorddb file.");
+    }
+    const size_t n = std::min(chunk_size_, capacity_ - end_);
+    memcpy(buffer_ + end_, chunk_, n);
+    chunk_ += n;
+    chunk_size_ -= n;
+    end_ += n;
+    file_end_offset_ += n;
+  }
+
+  // Parses the record at pos_ if it is entirely in the buffer.
+  bool ParseInBuffer() {
+    if (file_index_ >= db_->files().size() || Offset() >= data_size_ ||
+        end_ - pos_ < kHeaderSize) {
+      return false;
+    }
+    uint32_t sizes[2];
+    memcpy(sizes, buffer_ + pos_, sizeof(sizes));
+    if (end_ - pos_ < kHeaderSize + sizes[0] + sizes[1]) {
+      return false;
+    }
+    key_ = buffer_ + pos_ + kHeaderSize;
+    key_size_ = sizes[0];
+    value_ = key_ + key_size_;
+    value_size_ = sizes[1];
+    record_size_ = kHeaderSize + key_size_ + value_size_;
+    valid_ = true;
+    return true;
+  }
+
+  // Parses the record at pos_, reading it first if needed.
+  void Load() {
+    while (!ParseInBuffer()) {
+      if (file_index_ >= db_->files().size()) {
+        valid_ = false;
+        return;
+      }
+      if (Offset() >= data_size_) {
+        OpenFile(file_index_ + 1, 0);
+        continue;
+      }
+      Fill(kHeaderSize);
+      uint32_t sizes[2];
+      memcpy(sizes, buffer_ + pos_, sizeof(sizes));
+      Fill(kHeaderSize + sizes[0] + sizes[1]);
+    }
+  }
+
+  RecordDB* db_;
+  const size_t read_size_;
+  int file_index_ = 0;
+  int fd_ = -1;
+  bool direct_ = false;
+  uint64_t data_size_ = 0;
+  // The buffer holds the bytes of the file up to file_end_offset_, from
+  // pos_, where the current record starts, to end_.
+  char* buffer_ = nullptr;
+  size_t capacity_ = 0;
+  size_t pos_ = 0;
+  size_t end_ = 0;
+  uint64_t file_end_offset_ = 0;
+  // With caffe2_recorddb_queue_depth, the reads in flight, and the bytes of
+  // the last chunk read that are not in the buffer yet.
+  unique_ptr<AsyncFileReader> async_reader_;
+  char* chunk_ = nullptr;
+  size_t chunk_size_ = 0;
+  // The current record.
+  bool valid_ = false;
+  bool load_pending_ = false;
+  const char* key_ = nullptr;
+  size_t key_size_ = 0;
+  const char* value_ = nullptr;
+  size_t value_size_ = 0;
+  size_t record_size_ = 0;
+};
+
+class RecordDBTransaction : public Transaction {
+ public:
+  explicit RecordDBTransaction(RecordDB* db) : db_(db) {}
+  ~RecordDBTransaction() {
+    Commit();
+  }
+  void Put(const string& key, const string& value) override {
+    db_->Put(key, value);
+  }
+  void Commit() override {
+    db_->Flush();
+  }
+
+ private:
+  RecordDB* db_;
+
+  DISABLE_COPY_AND_ASSIGN(RecordDBTransaction);
+};
+
+RecordDB::RecordDB(const string& source, Mode mode)
+    : DB(source, mode), source_(source) {
+  if (mode == NEW) {
+    CAFFE_ENFORCE_EQ(
+        mkdir(source.c_str(), 0744), 0, "mkdir ", source, " failed");
+    return;
+  }
+  for (const string& path : ListFiles(source)) {
+    File file;
+    file.path = path;
+    int fd = open(path.c_str(), O_RDONLY);
+    CAFFE_ENFORCE_GE(fd, 0, "Cannot open ", path);
+    struct stat st;
+    CAFFE_ENFORCE_EQ(fstat(fd, &st), 0);
+    CAFFE_ENFORCE_GE(
+        st.st_size,
+        sizeof(RecordFileFooter),
+        path,
+        " is not a recorddb file, or was not closed.");
+    RecordFileFooter footer;
+    PreadFully(fd, &footer, sizeof(footer), st.st_size - sizeof(footer));
+    close(fd);
+    CAFFE_ENFORCE(
+        memcmp(footer.magic, kMagic, sizeof(kMagic)) == 0,
+        path,
+        " is not a recorddb file, or was not closed.");
+    file.data_size = footer.index_offset;
+    file.num_records = footer.num_records;
+    file.sorted = footer.sorted;
+    file.index_loaded = false;
+    sorted_ = sorted_ && file.sorted;
+    files_.push_back(std::move(file));
+  }
+  if (mode == WRITE) {
+    // The records that are appended go to new files. Whether they keep the
+    // keys in order is not checked against the existing ones.
+    num_files_written_ = files_.size();
+    sorted_ = false;
+  }
+}
+
+unique_ptr<Cursor> RecordDB::NewCursor() {
+  CAFFE_ENFORCE_EQ(mode_, READ, "A recorddb can only be read in READ mode.");
+  return make_unique<RecordDBCursor>(this);
+}
+
+unique_ptr<Transaction> RecordDB::NewTransaction() {
+  CAFFE_ENFORCE_NE(mode_, READ, "Cannot write to a recorddb in READ mode.");
+  return make_unique<RecordDBTransaction>(this);
+}
+
+const vector<uint64_t>& RecordDB::Index(int file_index) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  File& file = files_[file_index];
+  if (!file.index_loaded) {
+    file.index.resize(file.num_records);
+    int fd = open(file.path.c_str(), O_RDONLY);
+    CAFFE_ENFORCE_GE(fd, 0, "Cannot open ", file.path);
+    PreadFully(
+        fd,
+        file.index.data(),
+        file.index.size() * sizeof(uint64_t),
+        file.data_size);
+    close(fd);
+    file.index_loaded = true;
+  }
+  return file.index;
+}
+
+void RecordDB::Put(const string& key, const string& value) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (out_ && out_size_ >= FLAGS_caffe2_recorddb_file_size) {
+    FinishFile();
+  }
+  if (!out_) {
+    const string path = FileName(source_, num_files_written_++);
+    out_ = fopen(path.c_str(), "wb");
+    CAFFE_ENFORCE(out_, "Cannot open ", path, " for writing.");
+    out_size_ = 0;
+    out_index_.clear();
+  }
+  if (num_records_written_++ > 0) {
+    sorted_ = sorted_ && last_key_ <= key;
+  }
+  last_key_ = key;
+  const uint32_t sizes[2] = {static_cast<uint32_t>(key.size()),
+                             static_cast<uint32_t>(value.size())};
+  CAFFE_ENFORCE_EQ(fwrite(sizes, sizeof(sizes), 1, out_), 1);
+  CAFFE_ENFORCE_EQ(fwrite(key.data(), 1, key.size(), out_), key.size());
+  CAFFE_ENFORCE_EQ(fwrite(value.data(), 1, value.size(), out_), value.size());
+  out_index_.push_back(out_size_);
+  out_size_ += kHeaderSize + key.size() + value.size();
+}
+
+void RecordDB::FinishFile() {
+  if (!out_) {
+    return;
+  }
+  RecordFileFooter footer;
+  memset(&footer, 0, sizeof(footer));
+  footer.index_offset = out_size_;
+  footer.num_records = out_index_.size();
+  footer.sorted = sorted_;
+  memcpy(footer.magic, kMagic, sizeof(kMagic));
+  CAFFE_ENFORCE_EQ(
+      fwrite(out_index_.data(), sizeof(uint64_t), out_index_.size(), out_),
+      out_index_.size());
+  CAFFE_ENFORCE_EQ(fwrite(&footer, sizeof(footer), 1, out_), 1);
+  CAFFE_ENFORCE_EQ(fclose(out_), 0);
+  out_ = nullptr;
+}
+
+REGISTER_CAFFE2_DB(RecordDB, RecordDB);
+REGISTER_CAFFE2_DB(recorddb, RecordDB);
+
+} // namespace db
+} // namespace caffe2
@@ -1,32 +1,120 @@
+#include <atomic>
+#include <cstdio>
+#include <map>
+
 #include "caffe2/core/db.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/flags.h"
 #include "rocksdb/db.h"
+#include "rocksdb/env.h"
+#include "rocksdb/slice_transform.h"
+#include "rocksdb/sst_file_writer.h"
 #include "rocksdb/utilities/leveldb_options.h"
 
 CAFFE2_DEFINE_int(caffe2_rocksdb_block_size, 65536,
                   "The caffe2 rocksdb block size when writing a rocksdb.");
+CAFFE2_DEFINE_bool(
+    caffe2_rocksdb_bulk_load,
+    false,
+    "If true, new rocksdbs are written as sorted SST files that are ingested "
+    "into the db, instead of through the memtable and the write ahead log. "
+    "The records of a transaction are only visible once its file is "
+    "ingested.");
+CAFFE2_DEFINE_int64(
+    caffe2_rocksdb_bulk_load_file_size,
+    256 << 20,
+    "The size of the SST files of a bulk load, in bytes.");
+CAFFE2_DEFINE_int64(
+    caffe2_rocksdb_readahead_size,
+    0,
+    "If positive, rocksdb cursors read this many bytes ahead of them, for "
+    "sequential scans. Otherwise rocksdb reads one block at a time.");
+CAFFE2_DEFINE_bool(
+    caffe2_rocksdb_fill_cache,
+    true,
+    "If false, the blocks that rocksdb cursors read do not go to the block "
+    "cache, for dbs that are read once.");
+CAFFE2_DEFINE_int(
+    caffe2_rocksdb_prefix_length,
+    0,
+    "If positive, rocksdbs are opened with a prefix extractor of this many "
+    "bytes, and a cursor that seeks to a key only visits the records that "
+    "share its prefix, until it seeks to the first record again.");
 
 namespace caffe2 {
 namespace db {
 
+namespace {
+
+rocksdb::ReadOptions ScanReadOptions() {
+  rocksdb::ReadOptions options;
+  options.readahead_size = FLAGS_caffe2_rocksdb_readahead_size;
+  options.fill_cache = FLAGS_caffe2_rocksdb_fill_cache;
+  // Scans go over all of the prefixes.
+  options.total_order_seek = true;
+  return options;
+}
+
+} // namespace
+
 class RocksDBCursor : public Cursor {
  public:
-  explicit RocksDBCursor(rocksdb::DB* db)
-      : iter_(db->NewIterator(rocksdb::ReadOptions())) {
+  explicit RocksDBCursor(rocksdb::DB* db) : db_(db) {
     SeekToFirst();
   }
   ~RocksDBCursor() {}
-  void Seek(const string& key) override { iter_->Seek(key); }
+  void Seek(const string& key) override {
+    if (FLAGS_caffe2_rocksdb_prefix_length > 0) {
+      ResetIterator(true);
+    }
+    iter_->Seek(key);
+  }
   bool SupportsSeek() override { return true; }
-  void SeekToFirst() override { iter_->SeekToFirst(); }
+  void SeekToFirst() override {
+    ResetIterator(false);
+    iter_->SeekToFirst();
+  }
   void Next() override { iter_->Next(); }
   string key() override { return iter_->key().ToString(); }
   string value() override { return iter_->value().ToString(); }
   bool Valid() override { return iter_->Valid(); }
+  size_t NextBatch(
+      size_t max_records,
+      vector<StringView>* keys,
+      vector<StringView>* values) override {
+    // The slices of the iterator are only valid until it moves.
+    batch_buffer_.Clear();
+    while (batch_buffer_.size() < max_records && iter_->Valid()) {
+      batch_buffer_.Add(
+          iter_->key().data(),
+          iter_->key().size(),
+          iter_->value().data(),
+          iter_->value().size());
+      iter_->Next();
+    }
+    batch_buffer_.GetViews(keys, values);
+    return batch_buffer_.size();
+  }
 
  private:
+  // A prefix iterator stops at the end of the prefix that it seeked to,
+  // instead of reading the records after it.
+  void ResetIterator(bool prefix) {
+    if (iter_ && prefix == prefix_) {
+      return;
+    }
+    rocksdb::ReadOptions options = ScanReadOptions();
+    if (prefix) {
+      options.total_order_seek = false;
+      options.prefix_same_as_start = true;
+    }
+    iter_.reset(db_->NewIterator(options));
+    prefix_ = prefix;
+  }
+
+  rocksdb::DB* db_;
   std::unique_ptr<rocksdb::Iterator> iter_;
+  bool prefix_ = false;
 };
 
 class RocksDBTransaction : public Transaction {
@@ -53,20 +141,115 @@ class RocksDBTransaction : public Transaction {
   DISABLE_COPY_AND_ASSIGN(RocksDBTransaction);
 };
 
+// Writes the records as SST files, which are moved into the db. SST files
+// hold their keys in order, so each commit sorts its records, and goes on
+// with the current file as long as its keys come after the keys of the file.
+// Records that are written in the order of their keys, as when converting a
+// db, thus end in large files that do not overlap, which the db takes as they
+// are, without compacting them.
+class RocksDBBulkLoadTransaction : public Transaction {
+ public:
+  RocksDBBulkLoadTransaction(
+      rocksdb::DB* db,
+      const rocksdb::Options& options,
+      const string& file_prefix)
+      : db_(db),
+        options_(options),
+        file_prefix_(file_prefix),
+        writer_(rocksdb::EnvOptions(), options_) {
+    CAFFE_ENFORCE(db_);
+  }
+  ~RocksDBBulkLoadTransaction() {
+    Commit();
+    IngestFile();
+  }
+  void Put(const string& key, const string& value) override {
+    records_[key] = value;
+  }
+  void Commit() override {
+    if (records_.empty()) {
+      return;
+    }
+    if (file_open_ && records_.begin()->first <= last_key_) {
+      IngestFile();
+    }
+    if (!file_open_) {
+      file_path_ = MakeString(file_prefix_, num_files_++, ".sst");
+      Check(writer_.Open(file_path_), "open");
+      file_open_ = true;
+      file_size_ = 0;
+    }
+    for (const auto& record : records_) {
+      Check(writer_.Put(record.first, record.second), "write");
+      file_size_ += record.first.size() + record.second.size();
+    }
+    last_key_ = records_.rbegin()->first;
+    records_.clear();
+    if (file_size_ >= FLAGS_caffe2_rocksdb_bulk_load_file_size) {
+      IngestFile();
+    }
+  }
+
+ private:
+  void IngestFile() {
+    if (!file_open_) {
+      return;
+    }
+    file_open_ = false;
+    Check(writer_.Finish(), "finish");
+    rocksdb::IngestExternalFileOptions ingest_options;
+    ingest_options.move_files = true;
+    Check(db_->IngestExternalFile({file_path_}, ingest_options), "ingest");
+    // The db hard links moved files, so this is only left on failure.
+    std::remove(file_path_.c_str());
+    VLOG(1) << "Ingested " << file_size_ << " bytes into rocksdb";
+  }
+
+  void Check(const rocksdb::Status& status, const char* action) {
+    CAFFE_ENFORCE(
+        status.ok(),
+        "Failed to ",
+        action,
+        " the rocksdb SST file ",
+        file_path_,
+        ": ",
+        status.ToString());
+  }
+
+  rocksdb::DB* db_;
+  const rocksdb::Options options_;
+  const string file_prefix_;
+  rocksdb::SstFileWriter writer_;
+  // The records of the commit, in order.
+  std::map<string, string> records_;
+  bool file_open_ = false;
+  string file_path_;
+  int64_t file_size_ = 0;
+  string last_key_;
+  int num_files_ = 0;
+
+  DISABLE_COPY_AND_ASSIGN(RocksDBBulkLoadTransaction);
+};
+
 class RocksDB : public DB {
  public:
-  RocksDB(const string& source, Mode mode) : DB(source, mode) {
+  RocksDB(const string& source, Mode mode)
+      : DB(source, mode), source_(source) {
     rocksdb::LevelDBOptions options;
     options.block_size = FLAGS_caffe2_rocksdb_block_size;
     options.write_buffer_size = 268435456;
     options.max_open_files = 100;
     options.error_if_exists = mode == NEW;
     options.create_if_missing = mode != READ;
-    rocksdb::Options rocksdb_options = rocksdb::ConvertOptions(options);
+    options_ = rocksdb::ConvertOptions(options);
+    if (FLAGS_caffe2_rocksdb_prefix_length > 0) {
+      options_.prefix_extractor.reset(rocksdb::NewFixedPrefixTransform(
+          FLAGS_caffe2_rocksdb_prefix_length));
+    }
 
     rocksdb::DB* db_temp;
     rocksdb::Status status = rocksdb::DB::Open(
-      rocksdb_options, source, &db_temp);
+      options_, source, &db_temp);
     CAFFE_ENFORCE(
         status.ok(),
         "Failed to open rocksdb ",
@@ -81,12 +264,24 @@ class RocksDB : public DB {
   unique_ptr<Cursor> NewCursor() override {
     return make_unique<RocksDBCursor>(db_.get());
   }
+  bool SupportsMultipleCursors() override { return true; }
   unique_ptr<Transaction> NewTransaction() override {
+    if (FLAGS_caffe2_rocksdb_bulk_load && mode_ == NEW) {
+      // The files are written in the db directory, under names that rocksdb
+      // does not take for its own.
+      return make_unique<RocksDBBulkLoadTransaction>(
+          db_.get(),
+          options_,
+          MakeString(source_, "/caffe2_bulk_load_", num_transactions_++, "_"));
+    }
     return make_unique<RocksDBTransaction>(db_.get());
   }
 
  private:
+  const string source_;
+  rocksdb::Options options_;
   std::unique_ptr<rocksdb::DB> db_;
+  std::atomic<int> num_transactions_{0};
 };
 
 REGISTER_CAFFE2_DB(RocksDB, RocksDB);
@@ -1,35 +1,55 @@
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <mutex>
 #include <thread>  // NOLINT
 
 #include "caffe2/core/db.h"
+#include "caffe2/utils/string_utils.h"
 #include "caffe2/utils/zmq_helper.h"
 #include "caffe2/core/logging.h"
 
 namespace caffe2 {
 namespace db {
 
+// Reads records pushed by zmq_feeder. The source is a comma separated list
+// of endpoints: each one gets its own PULL socket and receiving thread, so
+// that several feeder sockets can be drained in parallel. Records arrive in
+// batches (see ZmqBatchWriter), and NextBatch() returns views right into the
+// received zmq messages without copying them.
 class ZmqDBCursor : public Cursor {
  public:
   explicit ZmqDBCursor(const string& source)
-      : source_(source), socket_(ZMQ_PULL),
-        prefetched_(false), finalize_(false) {
-    socket_.Connect(source_);
-    // Start prefetching thread.
-    prefetch_thread_.reset(
-        new std::thread([this] { this->Prefetch(); }));
+      : sources_(split(',', source)), finalize_(false), position_(0) {
+    for (const auto& endpoint : sources_) {
+      sockets_.emplace_back(new ZmqSocket(ZMQ_PULL));
+      // Wake up now and then to see if the cursor is going away.
+      sockets_.back()->SetOption(ZMQ_RCVTIMEO, 100);
+      sockets_.back()->Connect(endpoint);
+    }
+    // Start receiving threads.
+    for (auto& socket : sockets_) {
+      ZmqSocket* ptr = socket.get();
+      receive_threads_.emplace_back([this, ptr] { this->Receive(ptr); });
+    }
     // obtain the first value.
-    Next();
+    current_ = Pop();
   }
 
   ~ZmqDBCursor() {
-    finalize_ = true;
-    prefetched_ = false;
-    producer_.notify_one();
-    // Wait for the prefetch thread to finish elegantly.
-    prefetch_thread_->join();
-    socket_.Disconnect(source_);
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      finalize_ = true;
+    }
+    producer_.notify_all();
+    // Wait for the receiving threads to finish elegantly.
+    for (auto& thread : receive_threads_) {
+      thread.join();
+    }
+    for (int i = 0; i < sockets_.size(); ++i) {
+      sockets_[i]->Disconnect(sources_[i]);
+    }
   }
 
   void Seek(const string& key) override { /* do nothing */ }
@@ -37,50 +57,145 @@ class ZmqDBCursor : public Cursor {
   void SeekToFirst() override { /* do nothing */ }
 
   void Next() override {
-    std::unique_lock<std::mutex> lock(prefetch_access_mutex_);
-    while (!prefetched_) consumer_.wait(lock);
-    key_ = prefetch_key_;
-    value_ = prefetch_value_;
-    prefetched_ = false;
-    producer_.notify_one();
+    retired_.clear();
+    ++position_;
+    Advance();
   }
 
-  string key() override { return key_; }
-  string value() override { return value_; }
+  string key() override {
+    const StringView& key = current_.keys[position_];
+    return string(key.data, key.size);
+  }
+  string value() override {
+    const StringView& value = current_.values[position_];
+    return string(value.data, value.size);
+  }
   bool Valid() override { return true; }
 
+  size_t NextBatch(
+      size_t max_records,
+      vector<StringView>* keys,
+      vector<StringView>* values) override {
+    // The batches read up to here are kept until the next call, as the views
+    // point into their messages.
+    retired_.clear();
+    keys->clear();
+    values->clear();
+    while (keys->size() < max_records) {
+      const size_t n = std::min(
+          max_records - keys->size(), current_.keys.size() - position_);
+      keys->insert(
+          keys->end(),
+          current_.keys.begin() + position_,
+          current_.keys.begin() + position_ + n);
+      values->insert(
+          values->end(),
+          current_.values.begin() + position_,
+          current_.values.begin() + position_ + n);
+      position_ += n;
+      Advance();
+    }
+    return keys->size();
+  }
+
  private:
+  // The records of one zmq message, and the frames they point into.
+  struct Batch {
+    vector<std::unique_ptr<ZmqMessage>> frames;
+    vector<StringView> keys;
+    vector<StringView> values;
+  };
+
+  // Up to this many batches wait in the queue, from all the sockets.
+  static constexpr size_t kMaxQueuedBatches = 16;
+
+  // Moves to the next batch once the current one has been read.
+  void Advance() {
+    if (position_ == current_.keys.size()) {
+      retired_.push_back(std::move(current_));
+      current_ = Pop();
+      position_ = 0;
+    }
+  }
 
-  void Prefetch() {
+  Batch Pop() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    consumer_.wait(lock, [this] { return !queue_.empty(); });
+    Batch batch = std::move(queue_.front());
+    queue_.pop_front();
+    producer_.notify_one();
+    return batch;
+  }
+
+  void Receive(ZmqSocket* socket) {
+    vector<uint32_t> sizes;
     while (!finalize_) {
-      std::unique_lock<std::mutex> lock(prefetch_access_mutex_);
-      while (prefetched_) producer_.wait(lock);
+      Batch batch;
+      if (!ReceiveBatch(socket, &batch, &sizes)) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      producer_.wait(lock, [this] {
+        return finalize_ || queue_.size() < kMaxQueuedBatches;
+      });
       if (finalize_) {
         return;
       }
-      ZmqMessage msg;
-      socket_.RecvTillSuccess(&msg);
-      prefetch_key_.assign(static_cast<char*>(msg.data()), msg.size());
-      socket_.RecvTillSuccess(&msg);
-      prefetch_value_.assign(static_cast<char*>(msg.data()), msg.size());
-      prefetched_ = true;
+      queue_.push_back(std::move(batch));
       consumer_.notify_one();
     }
   }
 
-  string source_;
-  ZmqSocket socket_;
-  string key_;
-  string value_;
-  string prefetch_key_;
-  string prefetch_value_;
-
-  unique_ptr<std::thread> prefetch_thread_;
-  std::mutex prefetch_access_mutex_;
+  // Receives one message, either a batch or a single key and value. Returns
+  // false if none arrived before the socket timed out.
+  static bool ReceiveBatch(
+      ZmqSocket* socket,
+      Batch* batch,
+      vector<uint32_t>* sizes) {
+    auto& frames = batch->frames;
+    frames.emplace_back(new ZmqMessage());
+    // Frames are never empty, so 0 means that the socket timed out.
+    if (socket->Recv(frames.back().get()) == 0) {
+      return false;
+    }
+    // The frames of a message arrive all at once.
+    while (frames.back()->more()) {
+      frames.emplace_back(new ZmqMessage());
+      socket->RecvTillSuccess(frames.back().get());
+    }
+    CAFFE_ENFORCE_EQ(
+        frames.size(), 2, "Expected a batch, or a key and a value.");
+    const char* header = static_cast<const char*>(frames[0]->data());
+    const char* data = static_cast<const char*>(frames[1]->data());
+    if (ParseZmqBatchHeader(
+            header, frames[0]->size(), frames[1]->size(), sizes)) {
+      for (int i = 0; i < sizes->size(); i += 2) {
+        batch->keys.emplace_back(data, (*sizes)[i]);
+        data += (*sizes)[i];
+        batch->values.emplace_back(data, (*sizes)[i + 1]);
+        data += (*sizes)[i + 1];
+      }
+    } else {
+      batch->keys.emplace_back(header, frames[0]->size());
+      batch->values.emplace_back(data, frames[1]->size());
+    }
+    return true;
+  }
+
+  vector<string> sources_;
+  vector<std::unique_ptr<ZmqSocket>> sockets_;
+  vector<std::thread> receive_threads_;
+
+  std::mutex queue_mutex_;
   std::condition_variable producer_, consumer_;
-  std::atomic<bool> prefetched_;
-  // finalize_ is used to tell the prefetcher to quit.
+  std::deque<Batch> queue_;
+  // finalize_ is used to tell the receiving threads to quit.
   std::atomic<bool> finalize_;
+
+  Batch current_;
+  size_t position_;
+  // Batches that NextBatch() returned views of.
+  vector<Batch> retired_;
 };
 
 class ZmqDB : public DB {
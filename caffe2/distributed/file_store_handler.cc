@@ -5,6 +5,7 @@
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include <array>
 #include <chrono>
@@ -89,11 +90,39 @@ std::string FileStoreHandler::get(const std::string& name) {
   return result;
 }
 
-int64_t FileStoreHandler::add(
-    const std::string& /* unused */,
-    int64_t /* unused */) {
-  CHECK(false) << "add not implemented for FileStoreHandler";
-  return 0;
+int64_t FileStoreHandler::add(const std::string& name, int64_t value) {
+  auto path = objectPath(name);
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  CAFFE_ENFORCE_NE(fd, -1, "open: ", strerror(errno));
+
+  // Use a POSIX record lock rather than flock, as it also works on NFS. It
+  // is released when the file is closed.
+  struct flock lock;
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  int rv;
+  do {
+    rv = fcntl(fd, F_SETLKW, &lock);
+  } while (rv == -1 && errno == EINTR);
+  CAFFE_ENFORCE_EQ(rv, 0, "fcntl: ", strerror(errno));
+
+  std::array<char, 32> buf;
+  auto n = pread(fd, buf.data(), buf.size() - 1, 0);
+  CAFFE_ENFORCE_GE(n, 0, "pread: ", strerror(errno));
+  buf[n] = '\0';
+  const int64_t result = (n > 0 ? strtoll(buf.data(), nullptr, 10) : 0) + value;
+  if (value != 0 || n == 0) {
+    const std::string data = std::to_string(result);
+    CAFFE_ENFORCE_EQ(ftruncate(fd, 0), 0, "ftruncate: ", strerror(errno));
+    CAFFE_ENFORCE_EQ(
+        pwrite(fd, data.data(), data.size(), 0),
+        static_cast<ssize_t>(data.size()),
+        "pwrite: ",
+        strerror(errno));
+  }
+  close(fd);
+  return result;
 }
 
 bool FileStoreHandler::check(const std::vector<std::string>& names) {
@@ -3,23 +3,83 @@
 #include <caffe2/core/logging.h>
 
 #include <chrono>
+#include <memory>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 
 namespace caffe2 {
 
+namespace {
+
+struct ReplyDeleter {
+  void operator()(redisReply* reply) {
+    freeReplyObject(reply);
+  }
+};
+
+using Reply = std::unique_ptr<redisReply, ReplyDeleter>;
+
+Reply checkReply(void* ptr, redisContext* redis) {
+  CAFFE_ENFORCE_NE(ptr, (void*)nullptr, redis->errstr);
+  return Reply(static_cast<redisReply*>(ptr));
+}
+
+Reply getReply(redisContext* redis) {
+  void* ptr = nullptr;
+  CAFFE_ENFORCE_EQ(redisGetReply(redis, &ptr), REDIS_OK, redis->errstr);
+  return checkReply(ptr, redis);
+}
+
+// Appends a command made of args to the output buffer of redis, to be sent
+// with the next commands in one round trip.
+void appendCommand(redisContext* redis, const std::vector<std::string>& args) {
+  std::vector<const char*> argv;
+  std::vector<size_t> argvlen;
+  for (const auto& arg : args) {
+    argv.push_back(arg.c_str());
+    argvlen.push_back(arg.length());
+  }
+  CAFFE_ENFORCE_EQ(
+      redisAppendCommandArgv(redis, argv.size(), argv.data(), argvlen.data()),
+      REDIS_OK,
+      redis->errstr);
+}
+
+redisContext* connect(const std::string& host, int port) {
+  struct timeval tv = {
+      .tv_sec = 5, .tv_usec = 0,
+  };
+
+  redisContext* redis = redisConnectWithTimeout(host.c_str(), port, tv);
+  CAFFE_ENFORCE_NE(redis, (redisContext*)nullptr);
+  CAFFE_ENFORCE_EQ(redis->err, 0, redis->errstr);
+  return redis;
+}
+
+// Keyspace notifications of key modifications (K) are published for the
+// string commands, such as SETNX and INCRBY, with '$', or with 'A'.
+bool hasNotifications(redisContext* redis) {
+  Reply reply(static_cast<redisReply*>(
+      redisCommand(redis, "CONFIG GET notify-keyspace-events")));
+  // CONFIG can be disabled on managed servers.
+  if (!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements != 2) {
+    return false;
+  }
+  const std::string flags(reply->element[1]->str, reply->element[1]->len);
+  return flags.find('K') != std::string::npos &&
+      flags.find_first_of("$A") != std::string::npos;
+}
+
+} // namespace
+
 RedisStoreHandler::RedisStoreHandler(
     std::string& host,
     int port,
     std::string& prefix)
     : host_(host), port_(port), prefix_(prefix) {
-  struct timeval tv = {
-      .tv_sec = 5, .tv_usec = 0,
-  };
-
-  redis_ = redisConnectWithTimeout(host.c_str(), port, tv);
-  CAFFE_ENFORCE_NE(redis_, (redisContext*)nullptr);
-  CAFFE_ENFORCE_EQ(redis_->err, 0, redis_->errstr);
+  redis_ = connect(host, port);
+  notifications_ = hasNotifications(redis_);
 }
 
 RedisStoreHandler::~RedisStoreHandler() {
@@ -31,38 +91,63 @@ std::string RedisStoreHandler::compoundKey(const std::string& name) {
 }
 
 void RedisStoreHandler::set(const std::string& name, const std::string& data) {
-  auto key = compoundKey(name);
-  void* ptr = redisCommand(
-      redis_,
-      "SETNX %b %b",
-      key.c_str(),
-      (size_t)key.size(),
-      data.c_str(),
-      (size_t)data.size());
-  CAFFE_ENFORCE_NE(ptr, (void*)nullptr, redis_->errstr);
-  redisReply* reply = static_cast<redisReply*>(ptr);
-  CAFFE_ENFORCE_EQ(reply->type, REDIS_REPLY_INTEGER);
-  CAFFE_ENFORCE_EQ(reply->integer, 1, "Value at ", name, " was already set");
+  multiSet({name}, {data});
 }
 
 std::string RedisStoreHandler::get(const std::string& name) {
-  // Block until key is set
-  wait({name});
+  return multiGet({name})[0];
+}
 
-  auto key = compoundKey(name);
-  void* ptr = redisCommand(redis_, "GET %b", key.c_str(), (size_t)key.size());
-  CAFFE_ENFORCE_NE(ptr, (void*)nullptr, redis_->errstr);
-  redisReply* reply = static_cast<redisReply*>(ptr);
-  CAFFE_ENFORCE_EQ(reply->type, REDIS_REPLY_STRING);
-  return std::string(reply->str, reply->len);
+void RedisStoreHandler::multiSet(
+    const std::vector<std::string>& names,
+    const std::vector<std::string>& data) {
+  CAFFE_ENFORCE_EQ(names.size(), data.size());
+  // Pipeline the SETNX commands: all of them are sent before reading the
+  // first reply.
+  for (int i = 0; i < names.size(); ++i) {
+    appendCommand(redis_, {"SETNX", compoundKey(names[i]), data[i]});
+  }
+  for (const auto& name : names) {
+    auto reply = getReply(redis_);
+    CAFFE_ENFORCE_EQ(reply->type, REDIS_REPLY_INTEGER);
+    CAFFE_ENFORCE_EQ(
+        reply->integer, 1, "Value at ", name, " was already set");
+  }
+}
+
+std::vector<std::string> RedisStoreHandler::multiGet(
+    const std::vector<std::string>& names) {
+  // Block until keys are set
+  wait(names);
+
+  std::vector<std::string> args;
+  args.push_back("MGET");
+  for (const auto& name : names) {
+    args.push_back(compoundKey(name));
+  }
+  appendCommand(redis_, args);
+  auto reply = getReply(redis_);
+  CAFFE_ENFORCE_EQ(reply->type, REDIS_REPLY_ARRAY);
+  CAFFE_ENFORCE_EQ(reply->elements, names.size());
+  std::vector<std::string> data;
+  for (int i = 0; i < names.size(); ++i) {
+    const redisReply* element = reply->element[i];
+    CAFFE_ENFORCE_EQ(element->type, REDIS_REPLY_STRING);
+    data.emplace_back(element->str, element->len);
+  }
+  return data;
 }
 
 int64_t RedisStoreHandler::add(const std::string& name, int64_t value) {
   auto key = compoundKey(name);
-  void* ptr = redisCommand(
-      redis_, "INCRBY %b %ld", key.c_str(), (size_t)key.size(), value);
-  CAFFE_ENFORCE_NE(ptr, (void*)nullptr, redis_->errstr);
-  redisReply* reply = static_cast<redisReply*>(ptr);
+  auto reply = checkReply(
+      redisCommand(
+          redis_,
+          "INCRBY %b %lld",
+          key.c_str(),
+          (size_t)key.size(),
+          (long long)value),
+      redis_);
   CAFFE_ENFORCE_EQ(reply->type, REDIS_REPLY_INTEGER);
   return reply->integer;
 }
@@ -73,30 +158,76 @@ bool RedisStoreHandler::check(const std::vector<std::string>& names) {
   for (const auto& name : names) {
     args.push_back(compoundKey(name));
   }
-
-  std::vector<const char*> argv;
-  std::vector<size_t> argvlen;
-  for (const auto& arg : args) {
-    argv.push_back(arg.c_str());
-    argvlen.push_back(arg.length());
-  }
-
-  auto argc = argv.size();
-  void* ptr = redisCommandArgv(redis_, argc, argv.data(), argvlen.data());
-  CAFFE_ENFORCE_NE(ptr, (void*)nullptr, redis_->errstr);
-  redisReply* reply = static_cast<redisReply*>(ptr);
+  appendCommand(redis_, args);
+  auto reply = getReply(redis_);
   CAFFE_ENFORCE_EQ(reply->type, REDIS_REPLY_INTEGER);
   return reply->integer == names.size();
 }
 
 void RedisStoreHandler::wait(const std::vector<std::string>& names) {
-  // Simple approach: poll...
-  // Complex approach: use pub/sub.
-  // Polling is fine for the typical rendezvous use case, as it is
-  // only done at initialization time and  not at run time.
+  if (notifications_) {
+    waitForNotifications(names);
+    return;
+  }
+  // Without keyspace notifications, poll. This is fine for the typical
+  // rendezvous use case, as it is only done at initialization time and not
+  // at run time.
   while (!check(names)) {
     /* sleep override */
     std::this_thread::sleep_for(std::chrono::milliseconds(10));
   }
 }
+
+void RedisStoreHandler::waitForNotifications(
+    const std::vector<std::string>& names) {
+  // The keys are in database 0, as the connection never selects another.
+  const std::string channelPrefix = "__keyspace@0__:";
+  while (!check(names)) {
+    // Subscribe on a second connection, as a subscribed one cannot run other
+    // commands, then check again for the keys set in the meantime.
+    std::unique_ptr<redisContext, void (*)(redisContext*)> subscriber(
+        connect(host_, port_), redisFree);
+    std::unordered_set<std::string> pending;
+    std::vector<std::string> args;
+    args.push_back("SUBSCRIBE");
+    for (const auto& name : names) {
+      const auto channel = channelPrefix + compoundKey(name);
+      if (pending.insert(channel).second) {
+        args.push_back(channel);
+      }
+    }
+    appendCommand(subscriber.get(), args);
+    for (int i = 1; i < args.size(); ++i) {
+      getReply(subscriber.get());
+    }
+    if (check(names)) {
+      return;
+    }
+
+    // Notifications are not acknowledged, so a missed one would block
+    // forever: after a second without any, start over and check again.
+    struct timeval tv = {
+        .tv_sec = 1, .tv_usec = 0,
+    };
+    redisSetTimeout(subscriber.get(), tv);
+    while (!pending.empty()) {
+      void* ptr = nullptr;
+      if (redisGetReply(subscriber.get(), &ptr) != REDIS_OK) {
+        break;
+      }
+      Reply message(static_cast<redisReply*>(ptr));
+      // A message is ["message", channel, event].
+      if (message->type != REDIS_REPLY_ARRAY || message->elements != 3 ||
+          std::string(message->element[0]->str) != "message") {
+        continue;
+      }
+      const std::string event(
+          message->element[2]->str, message->element[2]->len);
+      if (event != "del" && event != "expired" && event != "evicted") {
+        pending.erase(std::string(
+            message->element[1]->str, message->element[1]->len));
+      }
+    }
+  }
+}
 }
@@ -19,6 +19,13 @@ class RedisStoreHandler : public StoreHandler {
 
   virtual std::string get(const std::string& name) override;
 
+  virtual void multiSet(
+      const std::vector<std::string>& names,
+      const std::vector<std::string>& data) override;
+
+  virtual std::vector<std::string> multiGet(
+      const std::vector<std::string>& names) override;
+
   virtual int64_t add(const std::string& name, int64_t value) override;
 
   virtual bool check(const std::vector<std::string>& names) override;
@@ -32,7 +39,13 @@ class RedisStoreHandler : public StoreHandler {
 
   redisContext* redis_;
 
+  // Whether the server publishes the keyspace notifications of the string
+  // commands, which wait then listens to instead of polling.
+  bool notifications_;
+
   std::string compoundKey(const std::string& name);
+
+  void waitForNotifications(const std::vector<std::string>& names);
 };
 
 } // namespace caffe2
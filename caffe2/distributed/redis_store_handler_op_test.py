@@ -36,3 +36,9 @@ class TestRedisStoreHandlerOp(TestCase):
 
     def test_set_get(self):
         StoreOpsTests.test_set_get(self.create_store_handler)
+
+    def test_set_get_multi(self):
+        StoreOpsTests.test_set_get_multi(self.create_store_handler)
+
+    def test_add(self):
+        StoreOpsTests.test_add(self.create_store_handler)
@@ -2,6 +2,7 @@
 
 #include <memory>
 
+#include "caffe2/core/logging.h"
 #include "caffe2/core/typeid.h"
 
 namespace caffe2 {
@@ -11,6 +12,25 @@ StoreHandler::~StoreHandler() {
   // symbols for this abstract class.
 }
 
+void StoreHandler::multiSet(
+    const std::vector<std::string>& names,
+    const std::vector<std::string>& data) {
+  CAFFE_ENFORCE_EQ(names.size(), data.size());
+  for (int i = 0; i < names.size(); ++i) {
+    set(names[i], data[i]);
+  }
+}
+
+std::vector<std::string> StoreHandler::multiGet(
+    const std::vector<std::string>& names) {
+  std::vector<std::string> data;
+  data.reserve(names.size());
+  for (const auto& name : names) {
+    data.push_back(get(name));
+  }
+  return data;
+}
+
 CAFFE_KNOWN_TYPE(std::unique_ptr<StoreHandler>);
 
 } // namespace caffe2
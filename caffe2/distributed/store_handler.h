@@ -14,6 +14,16 @@ class StoreHandler {
 
   virtual std::string get(const std::string& name) = 0;
 
+  // Sets or gets several keys at once. The default implementations do one
+  // set or get per key; stores with a network round trip per call batch
+  // them. multiGet blocks until all the keys are set, like get.
+  virtual void multiSet(
+      const std::vector<std::string>& names,
+      const std::vector<std::string>& data);
+
+  virtual std::vector<std::string> multiGet(
+      const std::vector<std::string>& names);
+
   virtual int64_t add(const std::string& name, int64_t value) = 0;
 
   virtual bool check(const std::vector<std::string>& names) = 0;
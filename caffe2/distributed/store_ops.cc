@@ -11,31 +11,37 @@ StoreSetOp::StoreSetOp(const OperatorDef& operator_def, Workspace* ws)
 
 bool StoreSetOp::RunOnDevice() {
   // Use argument as name, if specified.
-  // Otherwise, use input blob name.
-  auto& name = blobName_;
-  if (name.empty()) {
-    name = def().input(DATA);
+  // Otherwise, use input blob names.
+  CAFFE_ENFORCE(
+      blobName_.empty() || InputSize() == 2,
+      "blob_name can only be given with a single blob");
+  std::vector<std::string> names;
+  std::vector<std::string> data;
+  for (int i = DATA; i < InputSize(); ++i) {
+    names.push_back(blobName_.empty() ? def().input(i) : blobName_);
+    data.push_back(InputBlob(i).Serialize(names.back()));
   }
 
-  // Serialize and pass to store
+  // Serialize and pass to store, in one batch
   auto* handler =
       OperatorBase::Input<std::unique_ptr<StoreHandler>>(HANDLER).get();
-  handler->set(name, InputBlob(DATA).Serialize(name));
+  handler->multiSet(names, data);
   return true;
 }
 
 REGISTER_CPU_OPERATOR(StoreSet, StoreSetOp);
 OPERATOR_SCHEMA(StoreSet)
-    .NumInputs(2)
+    .NumInputs(2, INT_MAX)
     .NumOutputs(0)
     .SetDoc(R"DOC(
-Set a blob in a store. The key is the input blob's name and the value
-is the data in that blob. The key can be overridden by specifying the
-'blob_name' argument.
+Set blobs in a store. The key of each blob is its name and the value is
+the data in that blob. The blobs are set together, which the Redis store
+does in one round trip. With a single blob, the key can be overridden by
+specifying the 'blob_name' argument.
 )DOC")
     .Arg("blob_name", "alternative key for the blob (optional)")
     .Input(0, "handler", "unique_ptr<StoreHandler>")
-    .Input(1, "data", "data blob");
+    .Input(1, "data", "data blob; more blobs can follow");
 
 StoreGetOp::StoreGetOp(const OperatorDef& operator_def, Workspace* ws)
     : Operator<CPUContext>(operator_def, ws),
@@ -43,30 +49,37 @@ StoreGetOp::StoreGetOp(const OperatorDef& operator_def, Workspace* ws)
 
 bool StoreGetOp::RunOnDevice() {
   // Use argument as name, if specified.
-  // Otherwise, use output blob name.
-  auto& name = blobName_;
-  if (name.empty()) {
-    name = def().output(DATA);
+  // Otherwise, use output blob names.
+  CAFFE_ENFORCE(
+      blobName_.empty() || OutputSize() == 1,
+      "blob_name can only be given with a single blob");
+  std::vector<std::string> names;
+  for (int i = DATA; i < OutputSize(); ++i) {
+    names.push_back(blobName_.empty() ? def().output(i) : blobName_);
   }
 
   // Get from store and deserialize
   auto* handler =
       OperatorBase::Input<std::unique_ptr<StoreHandler>>(HANDLER).get();
-  OperatorBase::Outputs()[DATA]->Deserialize(handler->get(name));
+  const auto data = handler->multiGet(names);
+  for (int i = DATA; i < OutputSize(); ++i) {
+    OperatorBase::Outputs()[i]->Deserialize(data[i - DATA]);
+  }
   return true;
 }
 
 REGISTER_CPU_OPERATOR(StoreGet, StoreGetOp);
 OPERATOR_SCHEMA(StoreGet)
     .NumInputs(1)
-    .NumOutputs(1)
+    .NumOutputs(1, INT_MAX)
     .SetDoc(R"DOC(
-Get a blob from a store. The key is the output blob's name. The key
-can be overridden by specifying the 'blob_name' argument.
+Get blobs from a store, waiting until they are all set. The key of each
+blob is its output name. With a single blob, the key can be overridden by
+specifying the 'blob_name' argument.
 )DOC")
     .Arg("blob_name", "alternative key for the blob (optional)")
     .Input(0, "handler", "unique_ptr<StoreHandler>")
-    .Output(0, "data", "data blob");
+    .Output(0, "data", "data blob; more blobs can follow");
 
 StoreAddOp::StoreAddOp(const OperatorDef& operator_def, Workspace* ws)
     : Operator<CPUContext>(operator_def, ws),
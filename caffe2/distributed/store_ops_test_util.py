@@ -65,3 +65,90 @@ class StoreOpsTests(object):
         # Raise first error we find, if any
         if not queue.empty():
             raise queue.get()
+
+    @classmethod
+    def _test_set_get_multi(cls, queue, create_store_handler_fn, index,
+                            num_procs):
+        store_handler = create_store_handler_fn()
+        blobs = ["blob_{}".format(i) for i in range(num_procs)]
+
+        # Every process sets its own blob, and gets all of them at once.
+        workspace.FeedBlob(blobs[index], np.full(index + 1, index, np.int32))
+        workspace.RunOperatorOnce(
+            core.CreateOperator("StoreSet", [store_handler, blobs[index]], []))
+        workspace.RunOperatorOnce(
+            core.CreateOperator("StoreGet", [store_handler], blobs))
+
+        try:
+            for i, blob in enumerate(blobs):
+                np.testing.assert_array_equal(
+                    workspace.FetchBlob(blob), np.full(i + 1, i, np.int32))
+        except AssertionError as err:
+            queue.put(err)
+
+        workspace.ResetWorkspace()
+
+    @classmethod
+    def test_set_get_multi(cls, create_store_handler_fn):
+        queue = Queue()
+        num_procs = 4
+        procs = []
+        for index in range(num_procs):
+            proc = Process(
+                target=cls._test_set_get_multi,
+                args=(queue, create_store_handler_fn, index, num_procs, ))
+            proc.start()
+            procs.append(proc)
+        for proc in procs:
+            proc.join()
+        if not queue.empty():
+            raise queue.get()
+
+    @classmethod
+    def _test_add(cls, queue, create_store_handler_fn, index, num_procs):
+        store_handler = create_store_handler_fn()
+        value = "value"
+        workspace.RunOperatorOnce(
+            core.CreateOperator(
+                "StoreAdd",
+                [store_handler],
+                [value],
+                blob_name="counter",
+                add_value=index + 1))
+
+        try:
+            total = num_procs * (num_procs + 1) // 2
+            assert 1 <= workspace.FetchBlob(value)[0] <= total
+        except AssertionError as err:
+            queue.put(err)
+
+        workspace.ResetWorkspace()
+
+    @classmethod
+    def test_add(cls, create_store_handler_fn):
+        queue = Queue()
+        num_procs = 4
+        procs = []
+        for index in range(num_procs):
+            proc = Process(
+                target=cls._test_add,
+                args=(queue, create_store_handler_fn, index, num_procs, ))
+            proc.start()
+            procs.append(proc)
+        for proc in procs:
+            proc.join()
+        if not queue.empty():
+            raise queue.get()
+
+        # Adding 0 reads the counter, which got every add once.
+        store_handler = create_store_handler_fn()
+        workspace.RunOperatorOnce(
+            core.CreateOperator(
+                "StoreAdd",
+                [store_handler],
+                ["value"],
+                blob_name="counter",
+                add_value=0))
+        np.testing.assert_array_equal(
+            workspace.FetchBlob("value"), num_procs * (num_procs + 1) // 2)
+        workspace.ResetWorkspace()
@@ -0,0 +1,104 @@
+#include "topology.h"
+
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <tuple>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/string_utils.h"
+
+namespace caffe2 {
+
+namespace {
+
+int currentNumaNode() {
+#ifdef __linux__
+  const int cpu = sched_getcpu();
+  if (cpu < 0) {
+    return -1;
+  }
+  // The node of a CPU is the nodeN entry in its sysfs directory.
+  const std::string path =
+      "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    return -1;
+  }
+  int node = -1;
+  while (struct dirent* entry = readdir(dir)) {
+    const std::string name = entry->d_name;
+    if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+        std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+      node = std::stoi(name.substr(4));
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+#else
+  return -1;
+#endif
+}
+
+} // namespace
+
+Placement localPlacement(const std::string& rack) {
+  Placement placement;
+  placement.rack = rack;
+  std::array<char, 256> host;
+  CAFFE_ENFORCE_EQ(gethostname(host.data(), host.size()), 0);
+  host.back() = '\0';
+  placement.host = host.data();
+  placement.numaNode = currentNumaNode();
+  return placement;
+}
+
+std::string serializePlacement(const Placement& placement) {
+  CAFFE_ENFORCE(
+      placement.rack.find('\n') == std::string::npos,
+      "Rack labels cannot contain new lines");
+  return placement.rack + "\n" + placement.host + "\n" +
+      std::to_string(placement.numaNode);
+}
+
+Placement parsePlacement(const std::string& data) {
+  const auto pieces = split('\n', data);
+  CAFFE_ENFORCE_EQ(pieces.size(), 3, "Invalid placement: ", data);
+  Placement placement;
+  placement.rack = pieces[0];
+  placement.host = pieces[1];
+  placement.numaNode = std::stoi(pieces[2]);
+  return placement;
+}
+
+std::vector<int> topologyOrder(const std::vector<Placement>& placements) {
+  std::vector<int> order(placements.size());
+  for (int i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    const auto& pa = placements[a];
+    const auto& pb = placements[b];
+    return std::tie(pa.rack, pa.host, pa.numaNode, a) <
+        std::tie(pb.rack, pb.host, pb.numaNode, b);
+  });
+  return order;
+}
+
+int crossRackLinks(
+    const std::vector<Placement>& placements,
+    const std::vector<int>& order) {
+  int links = 0;
+  for (int i = 0; i < order.size(); ++i) {
+    const int next = order[(i + 1) % order.size()];
+    links += placements[order[i]].rack != placements[next].rack;
+  }
+  return links;
+}
+
+} // namespace caffe2
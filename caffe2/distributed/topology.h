@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace caffe2 {
+
+// Where a process of a common world runs. The rack is an optional label
+// given by the user, as the host cannot find it by itself.
+struct Placement {
+  std::string rack;
+  std::string host;
+  int numaNode = -1;
+};
+
+// Returns the placement of the calling process: its host name, and the NUMA
+// node of the CPU it runs on, or -1 if that is not known.
+Placement localPlacement(const std::string& rack);
+
+std::string serializePlacement(const Placement& placement);
+
+Placement parsePlacement(const std::string& data);
+
+// Orders the processes at placements, indexed by rank, so that neighbours in
+// the order are as close as possible: the processes of a rack are next to
+// each other, and within it those of a host, then those of a NUMA node, each
+// group in rank order. Returns the ranks in that order.
+//
+// A ring that follows the order enters and leaves each rack only once, and
+// trees built over contiguous ranks keep their subtrees within racks and
+// hosts.
+std::vector<int> topologyOrder(const std::vector<Placement>& placements);
+
+// Returns how many links of the ring through order join different racks.
+int crossRackLinks(
+    const std::vector<Placement>& placements,
+    const std::vector<int>& order);
+
+} // namespace caffe2
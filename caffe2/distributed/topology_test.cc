@@ -0,0 +1,49 @@
+#include "caffe2/distributed/topology.h"
+
+#include <gtest/gtest.h>
+
+namespace caffe2 {
+
+TEST(TopologyTest, SerializeRoundTrip) {
+  Placement placement;
+  placement.rack = "rack 7";
+  placement.host = "host.example.com";
+  placement.numaNode = 1;
+  const auto parsed = parsePlacement(serializePlacement(placement));
+  EXPECT_EQ(parsed.rack, placement.rack);
+  EXPECT_EQ(parsed.host, placement.host);
+  EXPECT_EQ(parsed.numaNode, placement.numaNode);
+}
+
+TEST(TopologyTest, LocalPlacement) {
+  const auto placement = localPlacement("r");
+  EXPECT_EQ(placement.rack, "r");
+  EXPECT_FALSE(placement.host.empty());
+  EXPECT_GE(placement.numaNode, -1);
+}
+
+// Ranks alternate between two racks, so that a ring in rank order crosses
+// between them on every link.
+TEST(TopologyTest, GroupsRacksHostsAndNodes) {
+  std::vector<Placement> placements(6);
+  for (int rank = 0; rank < placements.size(); ++rank) {
+    placements[rank].rack = rank % 2 ? "b" : "a";
+    placements[rank].host = rank < 4 ? "h1" : "h2";
+    placements[rank].numaNode = rank % 3 == 0;
+  }
+  const std::vector<int> rankOrder = {0, 1, 2, 3, 4, 5};
+  EXPECT_EQ(crossRackLinks(placements, rankOrder), 6);
+
+  const auto order = topologyOrder(placements);
+  // Rack a has ranks 0, 2 and 4 on hosts h1, h1 and h2, rank 0 on node 1.
+  EXPECT_EQ(order, std::vector<int>({2, 0, 4, 1, 3, 5}));
+  EXPECT_EQ(crossRackLinks(placements, order), 2);
+}
+
+TEST(TopologyTest, KeepsRankOrderWithinAGroup) {
+  std::vector<Placement> placements(4);
+  EXPECT_EQ(topologyOrder(placements), std::vector<int>({0, 1, 2, 3}));
+  EXPECT_EQ(crossRackLinks(placements, topologyOrder(placements)), 0);
+}
+
+} // namespace caffe2
@@ -1,10 +1,11 @@
 #ifndef CAFFE2_OPERATORS_FUNHASH_OP_H_
 #define CAFFE2_OPERATORS_FUNHASH_OP_H_
 
-#include <xxhash.h>
-#include <array>
+#include <cstring>
+#include <vector>
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/experiments/operators/funhash_utils.h"
 #include "caffe2/utils/math.h"
 
 #define SIGN_MAGIC 0x9e3779b97f4a7c15
@@ -14,6 +15,24 @@
 
 namespace caffe2 {
 
+// The weight index, and with USE_SIGN the sign, of the hashed weight for
+// (feature key, output i, alpha k).
+inline void FunHashWeight(
+    TIndex key,
+    TIndex i,
+    TIndex k,
+    TIndex num_weight,
+    uint64_t seed,
+    TIndex* index,
+    bool* negative) {
+  *index = funhash::Hash(key, i, k, INDEX_MAGIC, seed) % num_weight;
+#ifdef USE_SIGN
+  *negative = funhash::Hash(key, i, k, SIGN_MAGIC, seed) % 2;
+#else
+  *negative = false;
+#endif // USE_SIGN
+}
+
 template <typename T, class Context>
 class FunHashOp : public Operator<Context> {
  public:
@@ -71,45 +90,38 @@ class FunHashOp : public Operator<Context> {
     const auto* val_data = val.template data<T>();
     const auto* key_data = key.template data<TIndex>();
 
-    for (TIndex j = 0; j < num_nz_ent; ++j) {
-      TIndex cur_seg = seg_data[j];
-      TIndex cur_key = key_data[j];
-      T cur_val = val_data[j];
-      TIndex output_stride = cur_seg * num_outputs_;
-      for (TIndex i = 0; i < num_outputs_; ++i) {
-        T sum = 0;
-        for (TIndex k = 0; k < num_alpha; ++k) {
-          uint64_t hash;
-          // The hash function takes as input four integers:
-          // 1. feature index
-          // 2. output index
-          // 3. alpha index
-          // 4. magic number: SIGN_MAGIC for sign (-1/+1)
-          //                  INDEX_MAGIC for weight index
-          hash_data[0] = cur_key;
-          hash_data[1] = i;
-          hash_data[2] = k;
-
-          hash_data[3] = INDEX_MAGIC;
-          hash = XXH64(hash_data.data(), hash_data.size(), seed_);
-          TIndex index = hash % num_weight;
-
+    // The row of the hashed FC weight of each distinct feature, with the
+    // weights gathered as they are hashed.
+    funhash::UniqueKeys(key_data, num_nz_ent, &unique_keys_, &key_slots_);
+    rows_.assign(unique_keys_.size() * num_outputs_, 0);
+    const TIndex num_outputs = num_outputs_;
+    const uint64_t seed = seed_;
+    const bool adaptive = adaptive_;
+    funhash::ForEachHashedWeight(
+        unique_keys_,
+        num_outputs,
+        num_alpha,
+        [=](TIndex key, TIndex i, TIndex k, TIndex* index, bool* negative) {
+          FunHashWeight(key, i, k, num_weight, seed, index, negative);
+        },
+        [&](TIndex u, TIndex i, TIndex k, TIndex index, bool negative) {
           T cur_weight = weight_data[index];
-#ifdef USE_SIGN
-          hash_data[3] = SIGN_MAGIC;
-          hash = XXH64(hash_data.data(), hash_data.size(), seed_);
-          if (hash % 2) {
+          if (negative) {
             cur_weight = -cur_weight;
           }
-#endif // USE_SIGN
-
-          if (adaptive_) {
-            sum += cur_weight * alpha_data[k];
+          if (adaptive) {
+            rows_[u * num_outputs + i] += cur_weight * alpha_data[k];
           } else {
-            sum += cur_weight;
+            rows_[u * num_outputs + i] += cur_weight;
           }
-        }
-        output_data[output_stride + i] += sum * cur_val;
+        });
+
+    for (TIndex j = 0; j < num_nz_ent; ++j) {
+      const T* row = rows_.data() + key_slots_[j] * num_outputs_;
+      T cur_val = val_data[j];
+      TIndex output_stride = seg_data[j] * num_outputs_;
+      for (TIndex i = 0; i < num_outputs_; ++i) {
+        output_data[output_stride + i] += row[i] * cur_val;
       }
     }
 
@@ -120,8 +132,10 @@ class FunHashOp : public Operator<Context> {
   TIndex num_outputs_;
   TIndex num_segments_;
   uint64_t seed_;
-  std::array<uint64_t, 4> hash_data;
   bool adaptive_;
+  std::vector<TIndex> unique_keys_;
+  std::vector<TIndex> key_slots_;
+  std::vector<T> rows_;
 };
 
 template <typename T, class Context>
@@ -172,32 +186,47 @@ class FunHashGradientOp : public Operator<Context> {
 
     memset(grad_weight_data, 0, sizeof(T) * num_weight);
 
+    // The gradient of the row of the hashed FC weight of each distinct
+    // feature, summed over its entries.
+    funhash::UniqueKeys(key_data, num_nz_ent, &unique_keys_, &key_slots_);
+    const TIndex num_keys = unique_keys_.size();
+    grad_rows_.assign(num_keys * num_outputs_, 0);
     for (TIndex j = 0; j < num_nz_ent; ++j) {
-      TIndex cur_seg = seg_data[j];
-      TIndex cur_key = key_data[j];
+      T* grad_row = grad_rows_.data() + key_slots_[j] * num_outputs_;
       T cur_val = val_data[j];
-      TIndex grad_out_stride = cur_seg * num_outputs_;
+      TIndex grad_out_stride = seg_data[j] * num_outputs_;
       for (TIndex i = 0; i < num_outputs_; ++i) {
-        T grad_out_scale = grad_out_data[grad_out_stride + i] * cur_val;
-        for (TIndex k = 0; k < num_alpha; ++k) {
-          uint64_t hash;
-          hash_data[0] = cur_key;
-          hash_data[1] = i;
-          hash_data[2] = k;
-
-          hash_data[3] = INDEX_MAGIC;
-          hash = XXH64(hash_data.data(), hash_data.size(), seed_);
-          TIndex index = hash % num_weight;
-
-          T cur_grad_out_scale = grad_out_scale;
-#ifdef USE_SIGN
-          hash_data[3] = SIGN_MAGIC;
-          hash = XXH64(hash_data.data(), hash_data.size(), seed_);
-          if (hash % 2) {
-            cur_grad_out_scale = -cur_grad_out_scale;
-          }
-#endif // USE_SIGN
+        grad_row[i] += grad_out_data[grad_out_stride + i] * cur_val;
+      }
+    }
 
+    // The hashes are computed in parallel, and the scatter to the shared
+    // weight runs after them.
+    indices_.resize(num_keys * num_outputs_ * num_alpha);
+    negative_.resize(indices_.size());
+    const TIndex num_outputs = num_outputs_;
+    const uint64_t seed = seed_;
+    funhash::ForEachHashedWeight(
+        unique_keys_,
+        num_outputs,
+        num_alpha,
+        [=](TIndex key, TIndex i, TIndex k, TIndex* index, bool* negative) {
+          FunHashWeight(key, i, k, num_weight, seed, index, negative);
+        },
+        [&](TIndex u, TIndex i, TIndex k, TIndex index, bool negative) {
+          const TIndex w_ind = (u * num_outputs + i) * num_alpha + k;
+          indices_[w_ind] = index;
+          negative_[w_ind] = negative;
+        });
+
+    TIndex w_ind = 0;
+    for (TIndex u = 0; u < num_keys; ++u) {
+      for (TIndex i = 0; i < num_outputs_; ++i) {
+        T grad_out_scale = grad_rows_[u * num_outputs_ + i];
+        for (TIndex k = 0; k < num_alpha; ++k, ++w_ind) {
+          TIndex index = indices_[w_ind];
+          T cur_grad_out_scale =
+              negative_[w_ind] ? -grad_out_scale : grad_out_scale;
           if (adaptive_) {
             grad_alpha_data[k] += cur_grad_out_scale * weight_data[index];
             grad_weight_data[index] += alpha_data[k] * cur_grad_out_scale;
@@ -213,8 +242,12 @@ class FunHashGradientOp : public Operator<Context> {
  protected:
   TIndex num_outputs_;
   uint64_t seed_;
-  std::array<uint64_t, 4> hash_data;
   bool adaptive_;
+  std::vector<TIndex> unique_keys_;
+  std::vector<TIndex> key_slots_;
+  std::vector<T> grad_rows_;
+  std::vector<TIndex> indices_;
+  std::vector<char> negative_;
 };
 
 } // namespace caffe2
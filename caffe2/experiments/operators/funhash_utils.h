@@ -0,0 +1,80 @@
+#ifndef CAFFE2_OPERATORS_FUNHASH_UTILS_H_
+#define CAFFE2_OPERATORS_FUNHASH_UTILS_H_
+
+#include <xxhash.h>
+#include <array>
+#include <unordered_map>
+#include <vector>
+
+#include "caffe2/core/common_omp.h"
+#include "caffe2/core/types.h"
+
+namespace caffe2 {
+namespace funhash {
+
+// The hash function takes as input four integers:
+// 1. feature index
+// 2. output index
+// 3. alpha index
+// 4. magic number
+inline uint64_t
+Hash(TIndex key, TIndex i, TIndex k, uint64_t magic, uint64_t seed) {
+  const std::array<uint64_t, 4> hash_data = {{static_cast<uint64_t>(key),
+                                              static_cast<uint64_t>(i),
+                                              static_cast<uint64_t>(k),
+                                              magic}};
+  return XXH64(hash_data.data(), sizeof(hash_data), seed);
+}
+
+// The distinct keys, in order of first appearance, and for each of the n
+// entries the position of its key among them.
+inline void UniqueKeys(
+    const TIndex* keys,
+    TIndex n,
+    std::vector<TIndex>* unique,
+    std::vector<TIndex>* slots) {
+  std::unordered_map<TIndex, TIndex> positions;
+  unique->clear();
+  slots->resize(n);
+  for (TIndex j = 0; j < n; ++j) {
+    const TIndex next = unique->size();
+    auto it = positions.emplace(keys[j], next).first;
+    if (it->second == next) {
+      unique->push_back(keys[j]);
+    }
+    (*slots)[j] = it->second;
+  }
+}
+
+// The hashed weights of a feature only depend on its key, so they are
+// computed once per distinct key, with the keys split across threads. For
+// each key u and each (output i, alpha k), hasher(key, i, k, &index,
+// &negative) gives the weight and its sign, and f(u, i, k, index, negative)
+// consumes them; f must only write to the data of u.
+template <typename Hasher, typename F>
+void ForEachHashedWeight(
+    const std::vector<TIndex>& keys,
+    TIndex num_outputs,
+    TIndex num_alpha,
+    const Hasher& hasher,
+    const F& f) {
+  const TIndex num_keys = keys.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (num_keys > 1)
+#endif
+  for (TIndex u = 0; u < num_keys; ++u) {
+    for (TIndex i = 0; i < num_outputs; ++i) {
+      for (TIndex k = 0; k < num_alpha; ++k) {
+        TIndex index;
+        bool negative;
+        hasher(keys[u], i, k, &index, &negative);
+        f(u, i, k, index, negative);
+      }
+    }
+  }
+}
+
+} // namespace funhash
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_FUNHASH_UTILS_H_
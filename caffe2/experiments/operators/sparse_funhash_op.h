@@ -1,10 +1,11 @@
 #ifndef CAFFE2_OPERATORS_SPARSE_FUNHASH_OP_H_
 #define CAFFE2_OPERATORS_SPARSE_FUNHASH_OP_H_
 
-#include <xxhash.h>
-#include <array>
+#include <cstring>
+#include <vector>
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/experiments/operators/funhash_utils.h"
 #include "caffe2/utils/math.h"
 
 #define HASH_MAGIC 0x9e3779b97f4a7c15
@@ -13,6 +14,27 @@
 
 namespace caffe2 {
 
+// The weight index, and with USE_SIGN the sign, of the hashed weight for
+// (feature key, output i, alpha k).
+inline void SparseFunHashWeight(
+    TIndex key,
+    TIndex i,
+    TIndex k,
+    TIndex num_weight,
+    uint64_t seed,
+    TIndex* index,
+    bool* negative) {
+  uint64_t hash = funhash::Hash(key, i, k, HASH_MAGIC, seed);
+#ifdef USE_SIGN
+  // Use the least significant bit for sign, the rest for weights.
+  *index = (hash >> 1) % num_weight;
+  *negative = hash & 1;
+#else
+  *index = hash % num_weight;
+  *negative = false;
+#endif
+}
+
 template <typename T, class Context>
 class SparseFunHashOp : public Operator<Context> {
  public:
@@ -70,45 +92,38 @@ class SparseFunHashOp : public Operator<Context> {
     const auto* val_data = val.template data<T>();
     const auto* key_data = key.template data<TIndex>();
 
-    for (TIndex j = 0; j < num_nz_ent; ++j) {
-      TIndex cur_seg = seg_data[j];
-      TIndex cur_key = key_data[j];
-      T cur_val = val_data[j];
-      TIndex output_stride = cur_seg * num_outputs_;
-      for (TIndex i = 0; i < num_outputs_; ++i) {
-        T sum = 0;
-        for (TIndex k = 0; k < num_alpha; ++k) {
-          // The hash function takes as input three integers:
-          // 1. feature index
-          // 2. output index
-          // 3. alpha index
-          // 4. magic number to improve hashing
-          hash_data[0] = cur_key;
-          hash_data[1] = i;
-          hash_data[2] = k;
-          hash_data[3] = HASH_MAGIC;
-
-          uint64_t hash = XXH64(hash_data.data(), hash_data.size(), seed_);
-
-#ifdef USE_SIGN
-          // Use the least significant bit for sign, the rest for weights.
-          TIndex index = (hash >> 1) % num_weight;
+    // The row of the hashed FC weight of each distinct feature, with the
+    // weights gathered as they are hashed.
+    funhash::UniqueKeys(key_data, num_nz_ent, &unique_keys_, &key_slots_);
+    rows_.assign(unique_keys_.size() * num_outputs_, 0);
+    const TIndex num_outputs = num_outputs_;
+    const uint64_t seed = seed_;
+    const bool adaptive = adaptive_;
+    funhash::ForEachHashedWeight(
+        unique_keys_,
+        num_outputs,
+        num_alpha,
+        [=](TIndex key, TIndex i, TIndex k, TIndex* index, bool* negative) {
+          SparseFunHashWeight(key, i, k, num_weight, seed, index, negative);
+        },
+        [&](TIndex u, TIndex i, TIndex k, TIndex index, bool negative) {
           T cur_weight = weight_data[index];
-          if (hash & 1) {
+          if (negative) {
             cur_weight = -cur_weight;
           }
-#else
-          TIndex index = hash % num_weight;
-          T cur_weight = weight_data[index];
-#endif
-
-          if (adaptive_) {
-            sum += cur_weight * alpha_data[k];
+          if (adaptive) {
+            rows_[u * num_outputs + i] += cur_weight * alpha_data[k];
           } else {
-            sum += cur_weight;
+            rows_[u * num_outputs + i] += cur_weight;
           }
-        }
-        output_data[output_stride + i] += sum * cur_val;
+        });
+
+    for (TIndex j = 0; j < num_nz_ent; ++j) {
+      const T* row = rows_.data() + key_slots_[j] * num_outputs_;
+      T cur_val = val_data[j];
+      TIndex output_stride = seg_data[j] * num_outputs_;
+      for (TIndex i = 0; i < num_outputs_; ++i) {
+        output_data[output_stride + i] += row[i] * cur_val;
       }
     }
 
@@ -119,8 +134,10 @@ class SparseFunHashOp : public Operator<Context> {
   TIndex num_outputs_;
   TIndex num_segments_;
   uint64_t seed_;
-  std::array<uint64_t, 4> hash_data;
   bool adaptive_;
+  std::vector<TIndex> unique_keys_;
+  std::vector<TIndex> key_slots_;
+  std::vector<T> rows_;
 };
 
 template <typename T, class Context>
@@ -175,39 +192,45 @@ class SparseFunHashGradientOp : public Operator<Context> {
     const auto* val_data = val.template data<T>();
     const auto* key_data = key.template data<TIndex>();
 
+    // The hashes of each distinct feature are computed once, in parallel,
+    // and then copied to the gradient of each of its entries.
+    funhash::UniqueKeys(key_data, num_nz_ent, &unique_keys_, &key_slots_);
+    const TIndex hashes_per_key = num_outputs_ * num_alpha;
+    indices_.resize(unique_keys_.size() * hashes_per_key);
+    negative_.resize(indices_.size());
+    const TIndex num_outputs = num_outputs_;
+    const uint64_t seed = seed_;
+    funhash::ForEachHashedWeight(
+        unique_keys_,
+        num_outputs,
+        num_alpha,
+        [=](TIndex key, TIndex i, TIndex k, TIndex* index, bool* negative) {
+          SparseFunHashWeight(key, i, k, num_weight, seed, index, negative);
+        },
+        [&](TIndex u, TIndex i, TIndex k, TIndex index, bool negative) {
+          const TIndex h = u * hashes_per_key + i * num_alpha + k;
+          indices_[h] = index;
+          negative_[h] = negative;
+        });
+
     TIndex w_ind = 0;
     for (TIndex j = 0; j < num_nz_ent; ++j) {
-      TIndex cur_seg = seg_data[j];
-      TIndex cur_key = key_data[j];
+      const TIndex* index = indices_.data() + key_slots_[j] * hashes_per_key;
+      const char* negative =
+          negative_.data() + key_slots_[j] * hashes_per_key;
       T cur_val = val_data[j];
-      TIndex grad_out_stride = cur_seg * num_outputs_;
+      TIndex grad_out_stride = seg_data[j] * num_outputs_;
       for (TIndex i = 0; i < num_outputs_; ++i) {
         T grad_out_scale = grad_out_data[grad_out_stride + i] * cur_val;
-        for (TIndex k = 0; k < num_alpha; ++k) {
-          hash_data[0] = cur_key;
-          hash_data[1] = i;
-          hash_data[2] = k;
-          hash_data[3] = HASH_MAGIC;
-
-          uint64_t hash = XXH64(hash_data.data(), hash_data.size(), seed_);
-
-          T cur_grad_out_scale = grad_out_scale;
-#ifdef USE_SIGN
-          TIndex index = (hash >> 1) % num_weight;
-          if (hash & 1) {
-            cur_grad_out_scale = -cur_grad_out_scale;
-          }
-#else
-          TIndex index = hash % num_weight;
-#endif
-
+        for (TIndex k = 0; k < num_alpha; ++k, ++index, ++negative) {
+          T cur_grad_out_scale = *negative ? -grad_out_scale : grad_out_scale;
           if (adaptive_) {
-            grad_alpha_data[k] += cur_grad_out_scale * weight_data[index];
+            grad_alpha_data[k] += cur_grad_out_scale * weight_data[*index];
             grad_weight_val_data[w_ind] = alpha_data[k] * cur_grad_out_scale;
           } else {
             grad_weight_val_data[w_ind] = cur_grad_out_scale;
           }
-          grad_weight_ind_data[w_ind] = index;
+          grad_weight_ind_data[w_ind] = *index;
           ++w_ind;
         }
       }
@@ -218,8 +241,11 @@ class SparseFunHashGradientOp : public Operator<Context> {
  protected:
   TIndex num_outputs_;
   uint64_t seed_;
-  std::array<uint64_t, 4> hash_data;
   bool adaptive_;
+  std::vector<TIndex> unique_keys_;
+  std::vector<TIndex> key_slots_;
+  std::vector<TIndex> indices_;
+  std::vector<char> negative_;
 };
 
 } // namespace caffe2
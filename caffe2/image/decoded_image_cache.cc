@@ -0,0 +1,167 @@
+#include "caffe2/image/decoded_image_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "caffe2/core/logging.h"
+
+namespace caffe2 {
+
+namespace {
+
+// The raw files hold the rows, columns and channels as int32, then the
+// pixels.
+constexpr int kHeaderSize = 3 * sizeof(int32_t);
+
+bool WriteImageFile(
+    const string& path,
+    const uint8_t* pixels,
+    int rows,
+    int cols,
+    int channels) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  const int32_t header[3] = {rows, cols, channels};
+  file.write(reinterpret_cast<const char*>(header), kHeaderSize);
+  file.write(
+      reinterpret_cast<const char*>(pixels),
+      static_cast<size_t>(rows) * cols * channels);
+  return file.good();
+}
+
+std::shared_ptr<const DecodedImageCache::Image> ReadImageFile(
+    const string& path) {
+  std::ifstream file(path, std::ios::binary);
+  int32_t header[3];
+  if (!file.read(reinterpret_cast<char*>(header), kHeaderSize)) {
+    return nullptr;
+  }
+  auto image = std::make_shared<DecodedImageCache::Image>();
+  image->rows = header[0];
+  image->cols = header[1];
+  image->channels = header[2];
+  image->pixels.resize(
+      static_cast<size_t>(image->rows) * image->cols * image->channels);
+  if (!file.read(
+          reinterpret_cast<char*>(image->pixels.data()),
+          image->pixels.size())) {
+    return nullptr;
+  }
+  return image;
+}
+
+} // namespace
+
+DecodedImageCache::DecodedImageCache(
+    size_t capacity_bytes,
+    const string& directory)
+    : capacity_bytes_(capacity_bytes), directory_(directory) {}
+
+DecodedImageCache::~DecodedImageCache() {
+  for (const auto& entry : entries_) {
+    if (!entry.second.path.empty()) {
+      std::remove(entry.second.path.c_str());
+    }
+  }
+}
+
+std::shared_ptr<const DecodedImageCache::Image> DecodedImageCache::Lookup(
+    const string& key) {
+  std::shared_ptr<const Image> image;
+  string path;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      ++stats_.misses;
+      return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+    image = it->second.image;
+    path = it->second.path;
+    if (image) {
+      ++stats_.hits;
+      return image;
+    }
+  }
+  // The file is read without the lock. If the image was evicted in the
+  // meantime, it is a miss.
+  image = ReadImageFile(path);
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (image) {
+    ++stats_.hits;
+  } else {
+    ++stats_.misses;
+  }
+  return image;
+}
+
+void DecodedImageCache::Insert(
+    const string& key,
+    const uint8_t* pixels,
+    int rows,
+    int cols,
+    int channels) {
+  const size_t bytes = static_cast<size_t>(rows) * cols * channels;
+  if (bytes > capacity_bytes_) {
+    return;
+  }
+  Entry entry;
+  entry.bytes = bytes;
+  if (directory_.empty()) {
+    auto image = std::make_shared<Image>();
+    image->rows = rows;
+    image->cols = cols;
+    image->channels = channels;
+    image->pixels.assign(pixels, pixels + bytes);
+    entry.image = std::move(image);
+  } else {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      entry.path = MakeString(
+          directory_, "/decoded_image_", this, "_", next_file_id_++, ".raw");
+    }
+    if (!WriteImageFile(entry.path, pixels, rows, cols, channels)) {
+      LOG(ERROR) << "Cannot write the decoded image cache file " << entry.path;
+      std::remove(entry.path.c_str());
+      return;
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (entries_.count(key)) {
+    // Another thread decoded the same image.
+    if (!entry.path.empty()) {
+      std::remove(entry.path.c_str());
+    }
+    return;
+  }
+  EvictLocked(bytes);
+  lru_.push_front(key);
+  entry.lru_position = lru_.begin();
+  entries_.emplace(key, std::move(entry));
+  ++stats_.insertions;
+  ++stats_.images;
+  stats_.bytes += bytes;
+}
+
+void DecodedImageCache::EvictLocked(size_t needed_bytes) {
+  while (!lru_.empty() && stats_.bytes + needed_bytes > capacity_bytes_) {
+    auto it = entries_.find(lru_.back());
+    if (!it->second.path.empty()) {
+      std::remove(it->second.path.c_str());
+    }
+    stats_.bytes -= it->second.bytes;
+    --stats_.images;
+    ++stats_.evictions;
+    entries_.erase(it);
+    lru_.pop_back();
+  }
+}
+
+DecodedImageCache::Stats DecodedImageCache::GetStats() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return stats_;
+}
+
+} // namespace caffe2
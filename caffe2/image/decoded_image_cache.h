@@ -0,0 +1,92 @@
+#ifndef CAFFE2_IMAGE_DECODED_IMAGE_CACHE_H_
+#define CAFFE2_IMAGE_DECODED_IMAGE_CACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "caffe2/core/common.h"
+
+namespace caffe2 {
+
+/**
+ * A bounded cache of decoded images, keyed by db key, that spares
+ * ImageInputOp decoding and scaling the same images again in later epochs.
+ * The images are kept as HWC uint8 pixels, either in memory or, if a
+ * directory is given, in raw files there, e.g. on a local NVMe drive. The
+ * least recently used images are evicted once the pixels take more than the
+ * capacity. All of the methods are thread safe.
+ */
+class DecodedImageCache {
+ public:
+  struct Image {
+    int rows = 0;
+    int cols = 0;
+    int channels = 0;
+    std::vector<uint8_t> pixels;
+  };
+
+  struct Stats {
+    int64_t hits = 0;
+    int64_t misses = 0;
+    int64_t insertions = 0;
+    int64_t evictions = 0;
+    // The number of images and pixel bytes in the cache.
+    int64_t images = 0;
+    int64_t bytes = 0;
+
+    double HitRate() const {
+      return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses)
+                               : 0;
+    }
+  };
+
+  explicit DecodedImageCache(
+      size_t capacity_bytes,
+      const string& directory = "");
+  // Removes the files of the images.
+  ~DecodedImageCache();
+
+  // Returns the image of the key, or nullptr if it is not in the cache.
+  std::shared_ptr<const Image> Lookup(const string& key);
+
+  // Adds a copy of the given pixels under the key, unless they are larger
+  // than the whole cache.
+  void Insert(
+      const string& key,
+      const uint8_t* pixels,
+      int rows,
+      int cols,
+      int channels);
+
+  Stats GetStats();
+
+ private:
+  struct Entry {
+    // In memory, the image, or on disk, the file that holds it.
+    std::shared_ptr<const Image> image;
+    string path;
+    size_t bytes;
+    std::list<string>::iterator lru_position;
+  };
+
+  void EvictLocked(size_t needed_bytes);
+
+  const size_t capacity_bytes_;
+  const string directory_;
+  std::mutex mutex_;
+  // The keys, most recently used first.
+  std::list<string> lru_;
+  std::unordered_map<string, Entry> entries_;
+  int64_t next_file_id_ = 0;
+  Stats stats_;
+
+  DISABLE_COPY_AND_ASSIGN(DecodedImageCache);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_IMAGE_DECODED_IMAGE_CACHE_H_
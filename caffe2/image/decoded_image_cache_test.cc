@@ -0,0 +1,79 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "caffe2/image/decoded_image_cache.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+// A rows x cols x 3 image whose pixels all have the given value.
+std::vector<uint8_t> MakePixels(int rows, int cols, uint8_t value) {
+  return std::vector<uint8_t>(rows * cols * 3, value);
+}
+
+void Insert(DecodedImageCache* cache, const string& key, uint8_t value) {
+  const auto pixels = MakePixels(4, 5, value);
+  cache->Insert(key, pixels.data(), 4, 5, 3);
+}
+
+void ExpectImage(DecodedImageCache* cache, const string& key, uint8_t value) {
+  const auto image = cache->Lookup(key);
+  ASSERT_TRUE(image) << key;
+  EXPECT_EQ(image->rows, 4);
+  EXPECT_EQ(image->cols, 5);
+  EXPECT_EQ(image->channels, 3);
+  EXPECT_EQ(image->pixels, MakePixels(4, 5, value));
+}
+
+void TestEviction(const string& directory) {
+  // Room for 2 images of 60 bytes.
+  DecodedImageCache cache(150, directory);
+  Insert(&cache, "a", 1);
+  Insert(&cache, "b", 2);
+  ExpectImage(&cache, "a", 1);
+  // "b" is the least recently used image.
+  Insert(&cache, "c", 3);
+  EXPECT_FALSE(cache.Lookup("b"));
+  ExpectImage(&cache, "a", 1);
+  ExpectImage(&cache, "c", 3);
+
+  const auto stats = cache.GetStats();
+  EXPECT_EQ(stats.hits, 3);
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.insertions, 3);
+  EXPECT_EQ(stats.evictions, 1);
+  EXPECT_EQ(stats.images, 2);
+  EXPECT_EQ(stats.bytes, 120);
+  EXPECT_DOUBLE_EQ(stats.HitRate(), 0.75);
+}
+
+} // namespace
+
+TEST(DecodedImageCacheTest, InMemory) {
+  TestEviction("");
+}
+
+TEST(DecodedImageCacheTest, OnDisk) {
+  char directory[] = "/tmp/decoded_image_cache_XXXXXX";
+  ASSERT_TRUE(mkdtemp(directory));
+  TestEviction(directory);
+  // The cache removes its files.
+  EXPECT_EQ(std::remove(directory), 0);
+}
+
+TEST(DecodedImageCacheTest, ImagesLargerThanTheCache) {
+  DecodedImageCache cache(50);
+  Insert(&cache, "a", 1);
+  EXPECT_FALSE(cache.Lookup("a"));
+  EXPECT_EQ(cache.GetStats().insertions, 0);
+  // Inserting a key again keeps the first image.
+  DecodedImageCache large_cache(1000);
+  Insert(&large_cache, "a", 1);
+  Insert(&large_cache, "a", 2);
+  ExpectImage(&large_cache, "a", 1);
+  EXPECT_EQ(large_cache.GetStats().bytes, 60);
+}
+
+} // namespace caffe2
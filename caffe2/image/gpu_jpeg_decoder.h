@@ -0,0 +1,40 @@
+#ifndef CAFFE2_IMAGE_GPU_JPEG_DECODER_H_
+#define CAFFE2_IMAGE_GPU_JPEG_DECODER_H_
+
+#ifdef CAFFE2_USE_NVJPEG
+
+#include <nvjpeg.h>
+
+#include "caffe2/core/context_gpu.h"
+
+namespace caffe2 {
+
+// Decodes jpeg images on the GPU with nvJPEG. The compressed bytes are parsed
+// on the host, and the decoded pixels are only written to device memory.
+class GPUJpegDecoder {
+ public:
+  GPUJpegDecoder();
+  ~GPUJpegDecoder();
+
+  // Reads the size of an image from its header, without decoding it.
+  void GetImageSize(const string& encoded, int* height, int* width);
+  // Decodes an image into out, in HWC order with the given number of
+  // channels, BGR for 3 channels as OpenCV does, on the stream of the context.
+  void Decode(
+      const string& encoded,
+      int channels,
+      uint8_t* out,
+      CUDAContext* context);
+
+ private:
+  nvjpegHandle_t handle_;
+  nvjpegJpegState_t state_;
+
+  DISABLE_COPY_AND_ASSIGN(GPUJpegDecoder);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_USE_NVJPEG
+
+#endif  // CAFFE2_IMAGE_GPU_JPEG_DECODER_H_
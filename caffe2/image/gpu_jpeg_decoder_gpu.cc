@@ -0,0 +1,79 @@
+#include "caffe2/image/gpu_jpeg_decoder.h"
+
+#ifdef CAFFE2_USE_NVJPEG
+
+#include <cstring>
+
+#define NVJPEG_ENFORCE(condition)            \
+  do {                                       \
+    nvjpegStatus_t status = condition;       \
+    CAFFE_ENFORCE_EQ(                        \
+        status,                              \
+        NVJPEG_STATUS_SUCCESS,               \
+        "nvJPEG error ",                     \
+        static_cast<int>(status),            \
+        " in ",                              \
+        #condition);                         \
+  } while (0)
+
+namespace caffe2 {
+
+GPUJpegDecoder::GPUJpegDecoder() {
+  NVJPEG_ENFORCE(nvjpegCreateSimple(&handle_));
+  NVJPEG_ENFORCE(nvjpegJpegStateCreate(handle_, &state_));
+}
+
+GPUJpegDecoder::~GPUJpegDecoder() {
+  nvjpegJpegStateDestroy(state_);
+  nvjpegDestroy(handle_);
+}
+
+void GPUJpegDecoder::GetImageSize(
+    const string& encoded,
+    int* height,
+    int* width) {
+  int num_components;
+  nvjpegChromaSubsampling_t subsampling;
+  int widths[NVJPEG_MAX_COMPONENT];
+  int heights[NVJPEG_MAX_COMPONENT];
+  const nvjpegStatus_t status = nvjpegGetImageInfo(
+      handle_,
+      reinterpret_cast<const unsigned char*>(encoded.data()),
+      encoded.size(),
+      &num_components,
+      &subsampling,
+      widths,
+      heights);
+  CAFFE_ENFORCE_EQ(
+      status,
+      NVJPEG_STATUS_SUCCESS,
+      "Cannot decode the image on GPU: only jpeg images are supported.");
+  *height = heights[0];
+  *width = widths[0];
+}
+
+void GPUJpegDecoder::Decode(
+    const string& encoded,
+    int channels,
+    uint8_t* out,
+    CUDAContext* context) {
+  CAFFE_ENFORCE(channels == 3 || channels == 1);
+  int height, width;
+  GetImageSize(encoded, &height, &width);
+  nvjpegImage_t image;
+  memset(&image, 0, sizeof(image));
+  image.channel[0] = out;
+  image.pitch[0] = width * channels;
+  NVJPEG_ENFORCE(nvjpegDecode(
+      handle_,
+      state_,
+      reinterpret_cast<const unsigned char*>(encoded.data()),
+      encoded.size(),
+      channels == 3 ? NVJPEG_OUTPUT_BGRI : NVJPEG_OUTPUT_Y,
+      &image,
+      context->cuda_stream()));
+}
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_USE_NVJPEG
@@ -2,6 +2,16 @@
 
 namespace caffe2 {
 
+template <>
+void ImageInputOp<CPUContext>::InitGPUDecoder() {
+  CAFFE_THROW("use_gpu_decode is only supported by the CUDA ImageInput op.");
+}
+
+template <>
+void ImageInputOp<CPUContext>::DecodeOnDevice(std::mt19937* /* unused */) {
+  CAFFE_THROW("use_gpu_decode is only supported by the CUDA ImageInput op.");
+}
+
 REGISTER_CPU_OPERATOR(ImageInput, ImageInputOp<CPUContext>);
 
 OPERATOR_SCHEMA(ImageInput)
@@ -15,13 +25,70 @@ OPERATOR_SCHEMA(ImageInput)
           int crop = helper.GetSingleArgument<int>("crop", -1);
           int color = helper.GetSingleArgument<int>("color", 1);
           CHECK_GT(crop, 0);
-          out[0] = CreateTensorShape(
-              vector<int>{batch_size, crop, crop, color ? 3 : 1},
-              TensorProto::FLOAT);
+          const int channels = color ? 3 : 1;
+          const int output_type =
+              helper.GetSingleArgument<int>("output_type", TensorProto::FLOAT);
+          if (output_type == TensorProto::UINT8) {
+            out[0] = CreateTensorShape(
+                vector<int>{batch_size, crop, crop, channels},
+                TensorProto::UINT8);
+          } else if (
+              def.device_option().device_type() == CUDA &&
+              (helper.GetSingleArgument<int>("use_gpu_transform", 0) ||
+               helper.GetSingleArgument<int>("use_gpu_decode", 0))) {
+            // The transform on GPU also converts to NCHW.
+            out[0] = CreateTensorShape(
+                vector<int>{batch_size, channels, crop, crop},
+                TensorProto::FLOAT);
+          } else {
+            out[0] = CreateTensorShape(
+                vector<int>{batch_size, crop, crop, channels},
+                TensorProto::FLOAT);
+          }
           out[1] =
               CreateTensorShape(vector<int>{1, batch_size}, TensorProto::INT32);
           return out;
-        });
+        })
+    .Arg(
+        "output_type",
+        "The type of the images output, FLOAT (the default) or UINT8 from "
+        "core.DataType. UINT8 images are cropped and mirrored, but neither "
+        "normalized by mean and std nor converted to NCHW, so that they take "
+        "a quarter of the memory and copies, and can be normalized later by "
+        "the net.")
+    .Arg(
+        "prefetch_depth",
+        "The number of batches to prefetch ahead of the consumer (default 1).")
+    .Arg(
+        "decode_threads",
+        "The number of threads that decode and transform the images of a "
+        "batch in parallel (default 4). The images keep the order of the db, "
+        "and with a random_seed in the device option, the same crops and "
+        "mirroring.")
+    .Arg(
+        "reduced_decode",
+        "If set (the default), jpeg images that are at least 2, 4 or 8 times "
+        "larger than the scale are decoded at a reduced size by libjpeg, "
+        "which is much faster than decoding them at full size and resizing. "
+        "Needs OpenCV 3.2 or later.")
+    .Arg(
+        "image_cache_bytes",
+        "If set, up to this many bytes of images are kept decoded and scaled "
+        "to the scale, by db key, so that the images of later epochs are only "
+        "cropped and mirrored. The least recently used images are evicted, "
+        "and the hit rate is logged every 1000 batches. Not supported with "
+        "use_gpu_decode.")
+    .Arg(
+        "image_cache_dir",
+        "If set with image_cache_bytes, the cached images are stored as raw "
+        "uint8 files in this directory, e.g. on a local NVMe drive, instead "
+        "of in memory.")
+    .Arg(
+        "use_gpu_decode",
+        "If set, the jpeg images are decoded, scaled, cropped and mirrored on "
+        "the GPU, and the CPU threads only parse the db values. Needs the CUDA "
+        "op, and Caffe2 built with nvJPEG (USE_NVJPEG). Implies "
+        "use_gpu_transform.");
 
 NO_GRADIENT(ImageInput);
 
@@ -4,16 +4,21 @@
 #include <opencv2/opencv.hpp>
 
 #include <iostream>
+#include <mutex>
+#include <random>
 
 #include "caffe/proto/caffe.pb.h"
 #include "caffe2/core/db.h"
 #include "caffe2/utils/math.h"
 #include "caffe2/utils/thread_pool.h"
 #include "caffe2/operators/prefetch_op.h"
+#include "caffe2/image/decoded_image_cache.h"
 #include "caffe2/image/transform_gpu.h"
 
 namespace caffe2 {
 
+class GPUJpegDecoder;
+
 template <class Context>
 class ImageInputOp final
     : public PrefetchOperator<Context> {
@@ -25,6 +30,9 @@ class ImageInputOp final
                                     Workspace* ws);
   ~ImageInputOp() {
     PrefetchOperator<Context>::Finalize();
+    if (image_cache_) {
+      LogImageCacheStats();
+    }
   }
 
   bool Prefetch() override;
@@ -33,14 +41,50 @@ class ImageInputOp final
  private:
   bool GetImageAndLabelFromDBValue(
       const string& value, cv::Mat* img, int item_id);
+  // Decodes an encoded image, at a reduced size if it is a jpeg that is large
+  // enough to still be scaled down afterwards.
+  cv::Mat DecodeImage(const char* data, int size);
+  // Only extracts the encoded image, to encoded_images_, and the label.
+  bool GetEncodedImageAndLabelFromDBValue(const string& value, int item_id);
+  // Only extracts the label, for images found in image_cache_.
+  void GetLabelFromDBValue(const string& value, int item_id);
+  // Returns the image of a db value, decoded and scaled, and gets its label.
+  // The image comes from image_cache_ if it is there, in which case it
+  // points into *cached, which must outlive it.
+  cv::Mat GetScaledImage(
+      const string& value,
+      int item_id,
+      std::shared_ptr<const DecodedImageCache::Image>* cached);
+  void LogImageCacheStats();
+  void SetLabel(const TensorProto& label_proto, int item_id);
+  void GetScaledSize(
+      int rows, int cols, int* scaled_height, int* scaled_width) const;
   void DecodeAndTransform(
-      const std::string value, float *image_data, int item_id,
+      const std::string& value, float *image_data, int item_id,
       const int channels, std::mt19937 *randgen,
       std::bernoulli_distribution *mirror_this_image);
   void DecodeAndTransposeOnly(
-      const std::string value, uint8_t *image_data, int item_id,
+      const std::string& value, uint8_t *image_data, int item_id,
       const int channels, std::mt19937 *randgen,
       std::bernoulli_distribution *mirror_this_image);
+  // Decodes and transforms one image of the batch, from values_.
+  void DecodeItem(
+      int item_id, const int channels, std::mt19937::result_type seed);
+  // Device specific: decoding on GPU is only supported by the CUDA op.
+  void InitGPUDecoder();
+  // Decodes encoded_images_, then scales, crops and mirrors them into
+  // prefetched_image_on_device_, on the GPU.
+  void DecodeOnDevice(std::mt19937* randgen);
+
+  // The prefetched tensors are allocated from pinned memory when they are
+  // copied to a GPU, so that the copy does not need to be staged.
+  template <typename T>
+  T* MutablePrefetchedData(TensorCPU* tensor) {
+    if (std::is_same<Context, CPUContext>::value) {
+      return tensor->template mutable_data<T>();
+    }
+    return PinnedMutableData<T>(tensor);
+  }
 
   unique_ptr<db::DBReader> owned_reader_;
   const db::DBReader* reader_;
@@ -59,10 +103,30 @@ class ImageInputOp final
   bool mirror_;
   bool use_caffe_datum_;
   bool gpu_transform_;
+  bool gpu_decode_;
+  bool reduced_decode_;
+  // Whether the images are output as uint8 NHWC, without the mean and std.
+  bool uint8_output_;
+  std::shared_ptr<GPUJpegDecoder> gpu_decoder_;
+  // The decoded and scaled images of earlier epochs, keyed by the db keys_
+  // of the batch, if image_cache_bytes is set.
+  std::unique_ptr<DecodedImageCache> image_cache_;
+  vector<string> keys_;
+  int64_t batches_read_ = 0;
+  std::vector<string> encoded_images_;
+  Tensor<Context> decoded_image_on_device_;
 
   // thread pool for parse + decode
   int num_decode_threads_;
   std::shared_ptr<ThreadPool> thread_pool_;
+  // The values of the batch being decoded, and the first error of a decode
+  // thread, which the pool would otherwise drop.
+  vector<string> values_;
+  std::mutex decode_error_mutex_;
+  string decode_error_;
+  // Seeds the random crops and mirrors, from the random seed of the device
+  // option if there is one.
+  std::mt19937 randgen_;
 };
 
 
@@ -84,9 +148,20 @@ ImageInputOp<Context>::ImageInputOp(
               "use_caffe_datum", 0)),
         gpu_transform_(OperatorBase::template GetSingleArgument<int>(
               "use_gpu_transform", 0)),
+        gpu_decode_(OperatorBase::template GetSingleArgument<int>(
+              "use_gpu_decode", 0)),
+        reduced_decode_(OperatorBase::template GetSingleArgument<int>(
+              "reduced_decode", 1)),
+        uint8_output_(
+            OperatorBase::template GetSingleArgument<int>(
+                "output_type", TensorProto::FLOAT) == TensorProto::UINT8),
         num_decode_threads_(OperatorBase::template GetSingleArgument<int>(
               "decode_threads", 4)),
-        thread_pool_(new ThreadPool(num_decode_threads_))
+        thread_pool_(new ThreadPool(num_decode_threads_)),
+        randgen_(
+            operator_def.device_option().has_random_seed()
+                ? operator_def.device_option().random_seed()
+                : math::randomNumberSeed())
 {
   if (operator_def.input_size() == 0) {
     LOG(ERROR) << "You are using an old ImageInputOp format that creates "
@@ -102,19 +177,54 @@ ImageInputOp<Context>::ImageInputOp(
     reader_ = owned_reader_.get();
   }
   CAFFE_ENFORCE_GT(batch_size_, 0, "Batch size should be nonnegative.");
+  CAFFE_ENFORCE_GT(
+      num_decode_threads_, 0, "Must use at least one decode thread.");
   CAFFE_ENFORCE_GT(scale_, 0, "Must provide the scaling factor.");
   CAFFE_ENFORCE_GT(crop_, 0, "Must provide the cropping value.");
   CAFFE_ENFORCE_GE(
       scale_, crop_, "The scale value must be no smaller than the crop value.");
+  const int output_type = OperatorBase::template GetSingleArgument<int>(
+      "output_type", TensorProto::FLOAT);
+  CAFFE_ENFORCE(
+      output_type == TensorProto::FLOAT || output_type == TensorProto::UINT8,
+      "The output type must be FLOAT or UINT8.");
+  if (gpu_decode_) {
+    // The decoded images stay on the GPU, and are transformed there.
+    gpu_transform_ = true;
+    InitGPUDecoder();
+  }
+  const int64_t image_cache_bytes =
+      OperatorBase::template GetSingleArgument<int64_t>(
+          "image_cache_bytes", 0);
+  if (image_cache_bytes > 0) {
+    CAFFE_ENFORCE(
+        !gpu_decode_, "The decoded images cannot be cached with GPU decoding.");
+    image_cache_.reset(new DecodedImageCache(
+        image_cache_bytes,
+        OperatorBase::template GetSingleArgument<string>(
+            "image_cache_dir", "")));
+  }
 
   LOG(INFO) << "Creating an image input op with the following setting: ";
   LOG(INFO) << "    Using " << num_decode_threads_ << " CPU threads;";
-  if (gpu_transform_) {
+  if (gpu_decode_) {
+    LOG(INFO) << "    Decoding images on GPU";
+  }
+  if (uint8_output_) {
+    LOG(INFO) << "    Outputting uint8 NHWC images, without normalization;";
+  } else if (gpu_transform_) {
     LOG(INFO) << "    Performing transformation on GPU";
   }
   LOG(INFO) << "    Outputting in batches of " << batch_size_ << " images;";
   LOG(INFO) << "    Treating input image as "
             << (color_ ? "color " : "grayscale ") << "image;";
+  if (reduced_decode_) {
+    LOG(INFO) << "    Decoding large jpeg images at a reduced size;";
+  }
+  if (image_cache_) {
+    LOG(INFO) << "    Caching up to " << image_cache_bytes
+              << " bytes of scaled images;";
+  }
   LOG(INFO) << "    Scaling image to " << scale_
             << (warp_ ? " with " : " without ") << "warping;";
   LOG(INFO) << "    Cropping image to " << crop_
@@ -148,13 +258,7 @@ bool ImageInputOp<Context>::GetImageAndLabelFromDBValue(
     prefetched_label_.mutable_data<int>()[item_id] = datum.label();
     if (datum.encoded()) {
       // encoded image in datum.
-      src = cv::imdecode(
-          cv::Mat(
-              1,
-              datum.data().size(),
-              CV_8UC1,
-              const_cast<char*>(datum.data().data())),
-          color_ ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+      src = DecodeImage(datum.data().data(), datum.data().size());
     } else {
       // Raw image in datum.
       CAFFE_ENFORCE(datum.channels() == 3 || datum.channels() == 1);
@@ -192,15 +296,7 @@ bool ImageInputOp<Context>::GetImageAndLabelFromDBValue(
       // encoded image string.
       DCHECK_EQ(image_proto.string_data_size(), 1);
       const string& encoded_image_str = image_proto.string_data(0);
-      int encoded_size = encoded_image_str.size();
-      // We use a cv::Mat to wrap the encoded str so we do not need a copy.
-      src = cv::imdecode(
-          cv::Mat(
-              1,
-              &encoded_size,
-              CV_8UC1,
-              const_cast<char*>(encoded_image_str.data())),
-          color_ ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+      src = DecodeImage(encoded_image_str.data(), encoded_image_str.size());
     } else if (image_proto.data_type() == TensorProto::BYTE) {
       // raw image content.
       int src_c = (image_proto.dims_size() == 3) ? image_proto.dims(2) : 1;
@@ -218,19 +314,7 @@ bool ImageInputOp<Context>::GetImageAndLabelFromDBValue(
       LOG(FATAL) << "Unknown image data type.";
     }
 
-    if (label_proto.data_type() == TensorProto::FLOAT) {
-      DCHECK_EQ(label_proto.float_data_size(), 1);
-
-      prefetched_label_.mutable_data<float>()[item_id] =
-          label_proto.float_data(0);
-    } else if (label_proto.data_type() == TensorProto::INT32) {
-      DCHECK_EQ(label_proto.int32_data_size(), 1);
-
-      prefetched_label_.mutable_data<int>()[item_id] =
-          label_proto.int32_data(0);
-    } else {
-      LOG(FATAL) << "Unsupported label type.";
-    }
+    SetLabel(label_proto, item_id);
   }
 
   //
@@ -250,6 +334,156 @@ bool ImageInputOp<Context>::GetImageAndLabelFromDBValue(
   return true;
 }
 
+// Reads the size of a jpeg image from its frame header, without decoding it.
+// Returns false if the data is not a jpeg image.
+inline bool GetJpegSize(const char* data, int size, int* height, int* width) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  if (size < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8) {
+    return false;
+  }
+  int pos = 2;
+  while (pos + 4 <= size) {
+    if (bytes[pos] != 0xFF) {
+      return false;
+    }
+    const uint8_t marker = bytes[pos + 1];
+    if (marker == 0xFF) {
+      // fill byte
+      ++pos;
+      continue;
+    }
+    const int length = (bytes[pos + 2] << 8) | bytes[pos + 3];
+    // The start of frame markers, apart from DHT, JPG and DAC.
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC) {
+      if (pos + 9 > size) {
+        return false;
+      }
+      *height = (bytes[pos + 5] << 8) | bytes[pos + 6];
+      *width = (bytes[pos + 7] << 8) | bytes[pos + 8];
+      return *height > 0 && *width > 0;
+    }
+    pos += 2 + length;
+  }
+  return false;
+}
+
+template <class Context>
+cv::Mat ImageInputOp<Context>::DecodeImage(const char* data, int size) {
+  int flags = color_ ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE;
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 2)
+  int height, width;
+  if (reduced_decode_ && GetJpegSize(data, size, &height, &width)) {
+    // libjpeg scales down by 2, 4 or 8 while decoding, rounding the sizes up.
+    // The largest factor that keeps the shorter side at least scale_ pixels
+    // leaves the rest of the scaling to the resize, so the crops are the same
+    // up to the interpolation.
+    const int shorter = std::min(height, width);
+    if ((shorter + 7) / 8 >= scale_) {
+      flags = color_ ? cv::IMREAD_REDUCED_COLOR_8
+                     : cv::IMREAD_REDUCED_GRAYSCALE_8;
+    } else if ((shorter + 3) / 4 >= scale_) {
+      flags = color_ ? cv::IMREAD_REDUCED_COLOR_4
+                     : cv::IMREAD_REDUCED_GRAYSCALE_4;
+    } else if ((shorter + 1) / 2 >= scale_) {
+      flags = color_ ? cv::IMREAD_REDUCED_COLOR_2
+                     : cv::IMREAD_REDUCED_GRAYSCALE_2;
+    }
+  }
+#endif
+  // We use a cv::Mat to wrap the encoded str so we do not need a copy.
+  return cv::imdecode(
+      cv::Mat(1, &size, CV_8UC1, const_cast<char*>(data)), flags);
+}
+
+template <class Context>
+bool ImageInputOp<Context>::GetEncodedImageAndLabelFromDBValue(
+    const string& value,
+    int item_id) {
+  if (use_caffe_datum_) {
+    caffe::Datum datum;
+    CAFFE_ENFORCE(datum.ParseFromString(value));
+    CAFFE_ENFORCE(
+        datum.encoded(), "Only encoded images can be decoded on GPU.");
+    prefetched_label_.mutable_data<int>()[item_id] = datum.label();
+    encoded_images_[item_id] = datum.data();
+  } else {
+    TensorProtos protos;
+    CAFFE_ENFORCE(protos.ParseFromString(value));
+    const TensorProto& image_proto = protos.protos(0);
+    CAFFE_ENFORCE_EQ(
+        image_proto.data_type(),
+        TensorProto::STRING,
+        "Only encoded images can be decoded on GPU.");
+    DCHECK_EQ(image_proto.string_data_size(), 1);
+    encoded_images_[item_id] = image_proto.string_data(0);
+    SetLabel(protos.protos(1), item_id);
+  }
+  return true;
+}
+
+template <class Context>
+void ImageInputOp<Context>::SetLabel(
+    const TensorProto& label_proto,
+    int item_id) {
+  if (label_proto.data_type() == TensorProto::FLOAT) {
+    DCHECK_EQ(label_proto.float_data_size(), 1);
+
+    prefetched_label_.mutable_data<float>()[item_id] =
+        label_proto.float_data(0);
+  } else if (label_proto.data_type() == TensorProto::INT32) {
+    DCHECK_EQ(label_proto.int32_data_size(), 1);
+
+    prefetched_label_.mutable_data<int>()[item_id] =
+        label_proto.int32_data(0);
+  } else {
+    LOG(FATAL) << "Unsupported label type.";
+  }
+}
+
+template <class Context>
+void ImageInputOp<Context>::GetLabelFromDBValue(
+    const string& value,
+    int item_id) {
+  if (use_caffe_datum_) {
+    caffe::Datum datum;
+    CAFFE_ENFORCE(datum.ParseFromString(value));
+    prefetched_label_.mutable_data<int>()[item_id] = datum.label();
+  } else {
+    TensorProtos protos;
+    CAFFE_ENFORCE(protos.ParseFromString(value));
+    SetLabel(protos.protos(1), item_id);
+  }
+}
+
+template <class Context>
+void ImageInputOp<Context>::LogImageCacheStats() {
+  const auto stats = image_cache_->GetStats();
+  LOG(INFO) << "Decoded image cache: " << stats.images << " images, "
+            << stats.bytes << " bytes, hit rate " << stats.HitRate() << " ("
+            << stats.hits << " hits, " << stats.misses << " misses), "
+            << stats.evictions << " evictions";
+}
+
+// The size that an image of rows x cols pixels is scaled to before cropping.
+template <class Context>
+void ImageInputOp<Context>::GetScaledSize(
+    int rows,
+    int cols,
+    int* scaled_height,
+    int* scaled_width) const {
+  if (warp_) {
+    *scaled_width = scale_;
+    *scaled_height = scale_;
+  } else if (rows > cols) {
+    *scaled_width = scale_;
+    *scaled_height = static_cast<float>(rows) * scale_ / cols;
+  } else {
+    *scaled_height = scale_;
+    *scaled_width = static_cast<float>(cols) * scale_ / rows;
+  }
+}
+
 // Factored out image transformation
 template <class Context>
 void TransformImage(
@@ -339,29 +573,31 @@ void CropTransposeImage(const cv::Mat& scaled_img, const int channels,
   }
 }
 
-// Parse datum, decode image, perform transform
-// Intended as entry point for binding to thread pool
 template <class Context>
-void ImageInputOp<Context>::DecodeAndTransform(
-      const std::string value, float *image_data, int item_id,
-      const int channels, std::mt19937 *randgen,
-      std::bernoulli_distribution *mirror_this_image) {
+cv::Mat ImageInputOp<Context>::GetScaledImage(
+    const string& value,
+    int item_id,
+    std::shared_ptr<const DecodedImageCache::Image>* cached) {
+  if (image_cache_) {
+    *cached = image_cache_->Lookup(keys_[item_id]);
+    if (*cached) {
+      GetLabelFromDBValue(value, item_id);
+      const auto& image = **cached;
+      return cv::Mat(
+          image.rows,
+          image.cols,
+          CV_8UC(image.channels),
+          const_cast<uint8_t*>(image.pixels.data()));
+    }
+  }
+
   cv::Mat img;
   // Decode the image
   CHECK(GetImageAndLabelFromDBValue(value, &img, item_id));
 
   int scaled_width, scaled_height;
   cv::Mat scaled_img;
-  if (warp_) {
-    scaled_width = scale_;
-    scaled_height = scale_;
-  } else if (img.rows > img.cols) {
-    scaled_width = scale_;
-    scaled_height = static_cast<float>(img.rows) * scale_ / img.cols;
-  } else {
-    scaled_height = scale_;
-    scaled_width = static_cast<float>(img.cols) * scale_ / img.rows;
-  }
+  GetScaledSize(img.rows, img.cols, &scaled_height, &scaled_width);
   if (scaled_height != img.rows || scaled_width != img.cols) {
     cv::resize(img, scaled_img, cv::Size(scaled_width, scaled_height),
                0, 0, cv::INTER_AREA);
@@ -370,6 +606,29 @@ void ImageInputOp<Context>::DecodeAndTransform(
     scaled_img = img;
   }
 
+  if (image_cache_) {
+    // Later epochs only crop and mirror it again.
+    CAFFE_ENFORCE(scaled_img.isContinuous());
+    image_cache_->Insert(
+        keys_[item_id],
+        scaled_img.ptr<uint8_t>(0),
+        scaled_img.rows,
+        scaled_img.cols,
+        scaled_img.channels());
+  }
+  return scaled_img;
+}
+
+// Parse datum, decode image, perform transform
+// Intended as entry point for binding to thread pool
+template <class Context>
+void ImageInputOp<Context>::DecodeAndTransform(
+      const std::string& value, float *image_data, int item_id,
+      const int channels, std::mt19937 *randgen,
+      std::bernoulli_distribution *mirror_this_image) {
+  std::shared_ptr<const DecodedImageCache::Image> cached;
+  cv::Mat scaled_img = GetScaledImage(value, item_id, &cached);
+
   // Factor out the image transformation
   TransformImage<Context>(scaled_img, channels, image_data, crop_, mirror_,
                           mean_, std_, randgen, mirror_this_image);
@@ -377,33 +636,12 @@ void ImageInputOp<Context>::DecodeAndTransform(
 
 template <class Context>
 void ImageInputOp<Context>::DecodeAndTransposeOnly(
-    const std::string value, uint8_t *image_data, int item_id,
+    const std::string& value, uint8_t *image_data, int item_id,
     const int channels, std::mt19937 *randgen,
       std::bernoulli_distribution *mirror_this_image) {
 
-  cv::Mat img;
-  // Decode the image
-  CHECK(GetImageAndLabelFromDBValue(value, &img, item_id));
-
-  int scaled_width, scaled_height;
-  cv::Mat scaled_img;
-  if (warp_) {
-    scaled_width = scale_;
-    scaled_height = scale_;
-  } else if (img.rows > img.cols) {
-    scaled_width = scale_;
-    scaled_height = static_cast<float>(img.rows) * scale_ / img.cols;
-  } else {
-    scaled_height = scale_;
-    scaled_width = static_cast<float>(img.cols) * scale_ / img.rows;
-  }
-  if (scaled_height != img.rows || scaled_width != img.cols) {
-    cv::resize(img, scaled_img, cv::Size(scaled_width, scaled_height),
-               0, 0, cv::INTER_AREA);
-  } else {
-    // No scaling needs to be done.
-    scaled_img = img;
-  }
+  std::shared_ptr<const DecodedImageCache::Image> cached;
+  cv::Mat scaled_img = GetScaledImage(value, item_id, &cached);
 
   // Factor out the image transformation
   CropTransposeImage<Context>(scaled_img, channels, image_data, crop_, mirror_,
@@ -411,6 +649,32 @@ void ImageInputOp<Context>::DecodeAndTransposeOnly(
 }
 
 
+template <class Context>
+void ImageInputOp<Context>::DecodeItem(
+    int item_id,
+    const int channels,
+    std::mt19937::result_type seed) {
+  std::mt19937 randgen(seed);
+  std::bernoulli_distribution mirror_this_image(0.5);
+  if (gpu_decode_) {
+    // only parse on CPU, the images are decoded after the batch is read
+    GetEncodedImageAndLabelFromDBValue(values_[item_id], item_id);
+  } else if (gpu_transform_ || uint8_output_) {
+    // output of decode will still be int8
+    uint8_t* image_data = prefetched_image_.mutable_data<uint8_t>() +
+        crop_ * crop_ * channels * item_id;
+    DecodeAndTransposeOnly(
+        values_[item_id], image_data, item_id, channels, &randgen,
+        &mirror_this_image);
+  } else {
+    float* image_data = prefetched_image_.mutable_data<float>() +
+        crop_ * crop_ * channels * item_id;
+    DecodeAndTransform(
+        values_[item_id], image_data, item_id, channels, &randgen,
+        &mirror_this_image);
+  }
+}
+
 template <class Context>
 bool ImageInputOp<Context>::Prefetch() {
   if (!owned_reader_.get()) {
@@ -421,81 +685,72 @@ bool ImageInputOp<Context>::Prefetch() {
   }
   const int channels = color_ ? 3 : 1;
   // Call mutable_data() once to allocate the underlying memory.
-  if (gpu_transform_) {
-    // we'll transfer up in int8, then convert later
-    prefetched_image_.mutable_data<uint8_t>();
+  if (gpu_decode_) {
+    // The images are decoded straight to the device.
+    encoded_images_.resize(batch_size_);
+  } else if (gpu_transform_ || uint8_output_) {
+    // we'll transfer up in int8, then convert later, if at all
+    MutablePrefetchedData<uint8_t>(&prefetched_image_);
   } else {
-    prefetched_image_.mutable_data<float>();
+    MutablePrefetchedData<float>(&prefetched_image_);
   }
 
-  // Prefetching handled with a thread pool of "decode_threads" threads.
-  std::mt19937 meta_randgen(time(nullptr));
-  std::vector<std::mt19937> randgen_per_thread;
-  for (int i = 0; i < num_decode_threads_; ++i) {
-    randgen_per_thread.emplace_back(meta_randgen());
+  // The whole batch is read at once, with a single lock of the reader.
+  // The keys are only needed to look the images up in the cache.
+  reader_->ReadBatch(
+      batch_size_, image_cache_ ? &keys_ : nullptr, &values_);
+
+  // determine label type based on first item
+  if( use_caffe_datum_ ) {
+    MutablePrefetchedData<int>(&prefetched_label_);
+  } else {
+    TensorProtos protos;
+    CAFFE_ENFORCE(protos.ParseFromString(values_[0]));
+    TensorProto_DataType labeldt = protos.protos(1).data_type();
+    if( labeldt == TensorProto::INT32 ) {
+      MutablePrefetchedData<int>(&prefetched_label_);
+    } else if ( labeldt == TensorProto::FLOAT) {
+      MutablePrefetchedData<float>(&prefetched_label_);
+    } else {
+      LOG(FATAL) << "Unsupported label type.";
+    }
   }
 
+  // Prefetching handled with a thread pool of "decode_threads" threads, each
+  // image written to its own slot of the batch. The random crop and mirror of
+  // an image are drawn from a generator seeded for it here, in order, so that
+  // they do not depend on which thread decodes it or when.
+  decode_error_.clear();
   for (int item_id = 0; item_id < batch_size_; ++item_id) {
-    std::bernoulli_distribution mirror_this_image(0.5);
-    std::mt19937* randgen = &randgen_per_thread[item_id % num_decode_threads_];
-    std::string key, value;
-    cv::Mat img;
-
-    // read data
-    reader_->Read(&key, &value);
-
-    // determine label type based on first item
-    if( item_id == 0 ) {
-      if( use_caffe_datum_ ) {
-        prefetched_label_.mutable_data<int>();
-      } else {
-        TensorProtos protos;
-        CAFFE_ENFORCE(protos.ParseFromString(value));
-        TensorProto_DataType labeldt = protos.protos(1).data_type();
-        if( labeldt == TensorProto::INT32 ) {
-          prefetched_label_.mutable_data<int>();
-        } else if ( labeldt == TensorProto::FLOAT) {
-          prefetched_label_.mutable_data<float>();
-        } else {
-          LOG(FATAL) << "Unsupported label type.";
+    const auto seed = randgen_();
+    thread_pool_->runTask([this, item_id, channels, seed]() {
+      try {
+        DecodeItem(item_id, channels, seed);
+      } catch (const std::exception& e) {
+        std::lock_guard<std::mutex> guard(decode_error_mutex_);
+        if (decode_error_.empty()) {
+          decode_error_ = e.what();
         }
       }
-    }
-
-    // launch into thread pool for processing
-    if (gpu_transform_) {
-      // output of decode will still be int8
-      uint8_t* image_data = prefetched_image_.mutable_data<uint8_t>() +
-          crop_ * crop_ * channels * item_id;
-      thread_pool_->runTask(std::bind(
-          &ImageInputOp<Context>::DecodeAndTransposeOnly,
-          this,
-          std::string(value),
-          image_data,
-          item_id,
-          channels,
-          randgen,
-          &mirror_this_image));
-    } else {
-      float* image_data = prefetched_image_.mutable_data<float>() +
-          crop_ * crop_ * channels * item_id;
-      thread_pool_->runTask(std::bind(
-          &ImageInputOp<Context>::DecodeAndTransform,
-          this,
-          std::string(value),
-          image_data,
-          item_id,
-          channels,
-          randgen,
-          &mirror_this_image));
-    }
+    });
   }
   thread_pool_->waitWorkComplete();
+  if (!decode_error_.empty()) {
+    LOG(ERROR) << "Cannot decode the images of the batch: " << decode_error_;
+    return false;
+  }
+  if (image_cache_ && ++batches_read_ % 1000 == 0) {
+    LogImageCacheStats();
+  }
 
   // If the context is not CPUContext, we will need to do a copy in the
   // prefetch function as well.
   if (!std::is_same<Context, CPUContext>::value) {
-    prefetched_image_on_device_.CopyFrom(prefetched_image_, &context_);
+    if (gpu_decode_) {
+      DecodeOnDevice(&randgen_);
+    } else {
+      prefetched_image_on_device_.CopyFrom(prefetched_image_, &context_);
+    }
     prefetched_label_on_device_.CopyFrom(prefetched_label_, &context_);
   }
   return true;
@@ -511,8 +766,11 @@ bool ImageInputOp<Context>::CopyPrefetched() {
     image_output->CopyFrom(prefetched_image_, &context_);
     label_output->CopyFrom(prefetched_label_, &context_);
   } else {
-    if (gpu_transform_) {
-      TransformOnGPU<uint8_t,float,Context>(prefetched_image_on_device_, image_output, std_, mean_, &context_);
+    if (uint8_output_) {
+      image_output->CopyFrom(prefetched_image_on_device_, &context_);
+    } else if (gpu_transform_) {
+      TransformOnGPU<uint8_t, float, Context>(
+          prefetched_image_on_device_, image_output, mean_, std_, &context_);
     } else {
       image_output->CopyFrom(prefetched_image_on_device_, &context_);
     }
@@ -1,9 +1,73 @@
 #include "caffe2/core/common_gpu.h"
 #include "caffe2/core/context_gpu.h"
+#include "caffe2/image/gpu_jpeg_decoder.h"
 #include "caffe2/image/image_input_op.h"
 
 namespace caffe2 {
 
+template <>
+void ImageInputOp<CUDAContext>::InitGPUDecoder() {
+#ifdef CAFFE2_USE_NVJPEG
+  gpu_decoder_ = std::make_shared<GPUJpegDecoder>();
+#else
+  CAFFE_THROW("use_gpu_decode needs Caffe2 built with nvJPEG (USE_NVJPEG).");
+#endif
+}
+
+template <>
+void ImageInputOp<CUDAContext>::DecodeOnDevice(std::mt19937* randgen) {
+#ifdef CAFFE2_USE_NVJPEG
+  const int channels = color_ ? 3 : 1;
+  // The decoded images share one buffer, which is sized for the largest one
+  // up front, since it cannot be reallocated while the kernels run.
+  vector<int> heights(batch_size_), widths(batch_size_);
+  TIndex max_size = 0;
+  for (int item_id = 0; item_id < batch_size_; ++item_id) {
+    gpu_decoder_->GetImageSize(
+        encoded_images_[item_id], &heights[item_id], &widths[item_id]);
+    max_size = std::max<TIndex>(
+        max_size, TIndex(heights[item_id]) * widths[item_id] * channels);
+  }
+  decoded_image_on_device_.Resize(max_size);
+  uint8_t* decoded = decoded_image_on_device_.mutable_data<uint8_t>();
+  prefetched_image_on_device_.Resize(
+      TIndex(batch_size_), TIndex(crop_), TIndex(crop_), TIndex(channels));
+  uint8_t* image_data = prefetched_image_on_device_.mutable_data<uint8_t>();
+  std::bernoulli_distribution mirror_this_image(0.5);
+  for (int item_id = 0; item_id < batch_size_; ++item_id) {
+    gpu_decoder_->Decode(
+        encoded_images_[item_id], channels, decoded, &context_);
+    int scaled_height, scaled_width;
+    GetScaledSize(
+        heights[item_id], widths[item_id], &scaled_height, &scaled_width);
+    CAFFE_ENFORCE_GE(
+        scaled_height, crop_, "Image height must be bigger than crop.");
+    CAFFE_ENFORCE_GE(
+        scaled_width, crop_, "Image width must be bigger than crop.");
+    const int width_offset =
+        std::uniform_int_distribution<>(0, scaled_width - crop_)(*randgen);
+    const int height_offset =
+        std::uniform_int_distribution<>(0, scaled_height - crop_)(*randgen);
+    const bool mirror = mirror_ && mirror_this_image(*randgen);
+    ScaleCropMirrorOnGPU<uint8_t, CUDAContext>(
+        decoded,
+        heights[item_id],
+        widths[item_id],
+        channels,
+        scaled_height,
+        scaled_width,
+        crop_,
+        height_offset,
+        width_offset,
+        mirror,
+        image_data + crop_ * crop_ * channels * item_id,
+        &context_);
+  }
+#else
+  CAFFE_THROW("use_gpu_decode needs Caffe2 built with nvJPEG (USE_NVJPEG).");
+#endif
+}
+
 REGISTER_CUDA_OPERATOR(ImageInput, ImageInputOp<CUDAContext>);
 
 }  // namespace caffe2
@@ -16,7 +16,7 @@ namespace {
 template <typename In, typename Out>
 __global__
 void transform_kernel(const int N, const int C, const int H, const int W,
-                      const float mean, const float std, const In* in, Out* out) {
+                      const float mean, const float std_inv, const In* in, Out* out) {
   const int n = blockIdx.x;
 
   const int nStride = C*H*W;
@@ -34,7 +34,44 @@ void transform_kernel(const int N, const int C, const int H, const int W,
 
         //out[out_idx] = static_cast<Out>(
         //                static_cast<In>(in[in_idx]-mean)/std);
-        output_ptr[out_idx] = (static_cast<Out>(input_ptr[in_idx])-mean) / std;
+        output_ptr[out_idx] = (static_cast<Out>(input_ptr[in_idx])-mean) * std_inv;
+      }
+    }
+  }
+}
+
+// input and output in (int8, HWC), at most 4 channels
+template <typename T>
+__global__
+void scale_crop_mirror_kernel(const int C, const int H, const int W,
+                              const float scale_h, const float scale_w,
+                              const int crop, const int h_offset,
+                              const int w_offset, const bool mirror,
+                              const T* in, T* out) {
+  // one block per output row
+  for (int h = blockIdx.x; h < crop; h += gridDim.x) {
+    for (int w = threadIdx.x; w < crop; w += blockDim.x) {
+      const int scaled_h = h_offset + h;
+      const int scaled_w = mirror ? w_offset + crop - 1 - w : w_offset + w;
+      // the box of the source image that the scaled pixel covers
+      const float y0 = scaled_h * scale_h, y1 = min(y0 + scale_h, float(H));
+      const float x0 = scaled_w * scale_w, x1 = min(x0 + scale_w, float(W));
+      float sum[4] = {0, 0, 0, 0};
+      float area = 0;
+      for (int y = int(y0); y < y1; ++y) {
+        const float wy = min(y + 1.f, y1) - max(float(y), y0);
+        for (int x = int(x0); x < x1; ++x) {
+          const float wxy = wy * (min(x + 1.f, x1) - max(float(x), x0));
+          const T* pixel = &in[(y * W + x) * C];
+          for (int c = 0; c < C; ++c) {
+            sum[c] += wxy * pixel[c];
+          }
+          area += wxy;
+        }
+      }
+      T* out_pixel = &out[(h * crop + w) * C];
+      for (int c = 0; c < C; ++c) {
+        out_pixel[c] = static_cast<T>(sum[c] / area + 0.5f);
       }
     }
   }
@@ -48,7 +85,7 @@ bool TransformOnGPU(Tensor<Context>& X, Tensor<Context> *Y, T_OUT mean, T_OUT st
 };
 
 template <>
-bool TransformOnGPU<uint8_t, float, CUDAContext>(Tensor<CUDAContext>& X, Tensor<CUDAContext> *Y, float std, float mean, CUDAContext *context)
+bool TransformOnGPU<uint8_t, float, CUDAContext>(Tensor<CUDAContext>& X, Tensor<CUDAContext> *Y, float mean, float std, CUDAContext *context)
 {
   // data comes in as NHWC
   const int N = X.dim32(0), C = X.dim32(3), H = X.dim32(1), W = X.dim32(2);
@@ -58,7 +95,21 @@ bool TransformOnGPU<uint8_t, float, CUDAContext>(Tensor<CUDAContext>& X, Tensor<
   auto* input_data = X.data<uint8_t>();
   auto* output_data = Y->mutable_data<float>();
 
-  transform_kernel<uint8_t,float><<<N, dim3(16,16), 0, context->cuda_stream()>>>(N,C,H,W, mean, std, input_data, output_data);
+  transform_kernel<uint8_t,float><<<N, dim3(16,16), 0, context->cuda_stream()>>>(N,C,H,W, mean, 1.f / std, input_data, output_data);
+  return true;
+}
+
+template <>
+bool ScaleCropMirrorOnGPU<uint8_t, CUDAContext>(
+    const uint8_t* in, int height, int width, int channels,
+    int scaled_height, int scaled_width, int crop, int height_offset,
+    int width_offset, bool mirror, uint8_t* out, CUDAContext* context) {
+  CAFFE_ENFORCE_LE(channels, 4);
+  const float scale_h = static_cast<float>(height) / scaled_height;
+  const float scale_w = static_cast<float>(width) / scaled_width;
+  scale_crop_mirror_kernel<uint8_t><<<crop, 128, 0, context->cuda_stream()>>>(
+      channels, height, width, scale_h, scale_w, crop, height_offset,
+      width_offset, mirror, in, out);
   return true;
 }
 
@@ -33,6 +33,16 @@ namespace caffe2 {
 template <typename T_IN, typename T_OUT, class Context>
 bool TransformOnGPU(Tensor<Context>& X, Tensor<Context> *Y, T_OUT mean, T_OUT std, Context *context);
 
+// Scales an image of height x width pixels in HWC order to scaled_height x
+// scaled_width pixels, averaging the source pixels that each scaled pixel
+// covers, and writes the crop x crop pixels from (height_offset, width_offset)
+// of the scaled image to out, mirrored horizontally if mirror is set.
+template <typename T, class Context>
+bool ScaleCropMirrorOnGPU(const T* in, int height, int width, int channels,
+                          int scaled_height, int scaled_width, int crop,
+                          int height_offset, int width_offset, bool mirror,
+                          T* out, Context* context);
+
 }  // namespace caffe2
 
 #endif
@@ -0,0 +1,131 @@
+#include "caffe2/utils/mkl/mkl_layout_planner.h"
+
+#include <unordered_map>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/mkl_utils.h"
+
+#ifdef CAFFE2_HAS_MKL_DNN
+
+namespace caffe2 {
+namespace mkl {
+
+namespace {
+
+// Which versions of a blob hold its latest value: the one under its own
+// name, which MKL operators read and write, and the TensorCPU one under the
+// name with kMKLPlannerCPUSuffix.
+struct BlobVersions {
+  bool original = true;
+  bool cpu = false;
+};
+
+bool HasMKLImplementation(const OperatorDef& op) {
+  if (MKLOperatorRegistry()->Has(op.type())) {
+    return true;
+  }
+  return op.engine().size() &&
+      MKLOperatorRegistry()->Has(op.type() + "_ENGINE_" + op.engine());
+}
+
+OperatorDef MakeCopy(
+    const string& type,
+    const string& input,
+    const string& output,
+    const DeviceOption& device_option) {
+  OperatorDef copy;
+  copy.set_type(type);
+  copy.add_input(input);
+  copy.add_output(output);
+  *copy.mutable_device_option() = device_option;
+  return copy;
+}
+
+} // namespace
+
+NetDef PlanMKLLayouts(const NetDef& net) {
+  NetDef planned(net);
+  planned.clear_op();
+  std::unordered_map<string, BlobVersions> versions;
+  int conversions = 0;
+
+  for (const auto& op : net.op()) {
+    const DeviceOption& device_option =
+        op.has_device_option() ? op.device_option() : net.device_option();
+    if (device_option.device_type() == MKLDNN && HasMKLImplementation(op)) {
+      for (const auto& input : op.input()) {
+        auto& version = versions[input];
+        if (!version.original) {
+          *planned.add_op() = MakeCopy(
+              "CopyCPUToMKL",
+              input + kMKLPlannerCPUSuffix,
+              input,
+              device_option);
+          version.original = true;
+          ++conversions;
+        }
+      }
+      *planned.add_op() = op;
+      for (const auto& output : op.output()) {
+        versions[output] = BlobVersions();
+      }
+    } else if (device_option.device_type() == MKLDNN) {
+      OperatorDef cpu_op(op);
+      cpu_op.clear_input();
+      cpu_op.clear_output();
+      *cpu_op.mutable_device_option() = device_option;
+      cpu_op.mutable_device_option()->set_device_type(CPU);
+      for (const auto& input : op.input()) {
+        auto& version = versions[input];
+        if (!version.cpu) {
+          *planned.add_op() = MakeCopy(
+              "CopyMKLToCPU",
+              input,
+              input + kMKLPlannerCPUSuffix,
+              device_option);
+          version.cpu = true;
+          ++conversions;
+        }
+        cpu_op.add_input(input + kMKLPlannerCPUSuffix);
+      }
+      for (const auto& output : op.output()) {
+        cpu_op.add_output(output + kMKLPlannerCPUSuffix);
+        auto& version = versions[output];
+        version.original = false;
+        version.cpu = true;
+      }
+      *planned.add_op() = cpu_op;
+    } else {
+      OperatorDef other_op(op);
+      for (int i = 0; i < op.input_size(); ++i) {
+        if (!versions[op.input(i)].original) {
+          other_op.set_input(i, op.input(i) + kMKLPlannerCPUSuffix);
+        }
+      }
+      *planned.add_op() = other_op;
+      for (const auto& output : op.output()) {
+        versions[output] = BlobVersions();
+      }
+    }
+  }
+
+  DeviceOption mkl_option = net.device_option();
+  mkl_option.set_device_type(MKLDNN);
+  for (const auto& output : net.external_output()) {
+    auto& version = versions[output];
+    if (!version.original) {
+      *planned.add_op() = MakeCopy(
+          "CopyCPUToMKL", output + kMKLPlannerCPUSuffix, output, mkl_option);
+      version.original = true;
+      ++conversions;
+    }
+  }
+  VLOG(1) << "Planned MKL layouts of net " << net.name() << " with "
+          << conversions << " conversions.";
+  return planned;
+}
+
+} // namespace mkl
+} // namespace caffe2
+
+#endif // CAFFE2_HAS_MKL_DNN
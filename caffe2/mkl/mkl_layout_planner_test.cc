@@ -0,0 +1,78 @@
+#include <google/protobuf/text_format.h>
+#include "caffe2/core/common.h"
+#include "caffe2/utils/mkl/mkl_layout_planner.h"
+#include "caffe2/utils/mkl_utils.h"
+
+#include "gtest/gtest.h"
+
+#ifdef CAFFE2_HAS_MKL_DNN
+
+namespace caffe2 {
+
+namespace {
+
+// Relu has an MKL implementation, the made-up operators do not.
+const char* kMixedNet = R"DOC(
+  name: "mixed"
+  device_option { device_type: 2 }
+  external_input: "X"
+  op { input: "X" output: "A" type: "Relu" }
+  op { input: "A" output: "B" type: "MKLPlannerTestCPU" }
+  op { input: "A" input: "B" output: "C" type: "MKLPlannerTestCPU" }
+  op { input: "C" output: "D" type: "Relu" }
+  external_output: "B"
+  external_output: "D"
+)DOC";
+
+void ExpectOp(
+    const OperatorDef& op,
+    const string& type,
+    const std::vector<string>& inputs,
+    const string& output,
+    int device_type) {
+  EXPECT_EQ(op.type(), type);
+  ASSERT_EQ(op.input_size(), inputs.size());
+  for (int i = 0; i < inputs.size(); ++i) {
+    EXPECT_EQ(op.input(i), inputs[i]);
+  }
+  ASSERT_EQ(op.output_size(), 1);
+  EXPECT_EQ(op.output(0), output);
+  EXPECT_EQ(op.device_option().device_type(), device_type);
+}
+
+} // namespace
+
+TEST(MKLTest, LayoutPlannerConvertsOnlyAtBoundaries) {
+  NetDef net;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(kMixedNet, &net));
+  const NetDef planned = mkl::PlanMKLLayouts(net);
+  ASSERT_EQ(planned.op_size(), 7);
+  EXPECT_FALSE(planned.op(0).has_device_option());
+  ExpectOp(planned.op(1), "CopyMKLToCPU", {"A"}, "A_cpu", MKLDNN);
+  ExpectOp(planned.op(2), "MKLPlannerTestCPU", {"A_cpu"}, "B_cpu", CPU);
+  // A was converted for the previous operator already.
+  ExpectOp(
+      planned.op(3), "MKLPlannerTestCPU", {"A_cpu", "B_cpu"}, "C_cpu", CPU);
+  ExpectOp(planned.op(4), "CopyCPUToMKL", {"C_cpu"}, "C", MKLDNN);
+  EXPECT_EQ(planned.op(5).type(), "Relu");
+  ExpectOp(planned.op(6), "CopyCPUToMKL", {"B_cpu"}, "B", MKLDNN);
+  EXPECT_EQ(planned.external_input_size(), 1);
+  EXPECT_EQ(planned.external_output_size(), 2);
+}
+
+TEST(MKLTest, LayoutPlannerKeepsAllMKLNets) {
+  NetDef net;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::ParseFromString(kMixedNet, &net));
+  for (auto& op : *net.mutable_op()) {
+    op.set_type("Relu");
+    if (op.input_size() > 1) {
+      op.mutable_input()->RemoveLast();
+    }
+  }
+  const NetDef planned = mkl::PlanMKLLayouts(net);
+  EXPECT_EQ(planned.DebugString(), net.DebugString());
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_HAS_MKL_DNN
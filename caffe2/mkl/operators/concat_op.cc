@@ -0,0 +1,90 @@
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/mkl_utils.h"
+
+#ifdef CAFFE2_HAS_MKL_DNN
+
+namespace caffe2 {
+namespace mkl {
+
+template <typename T>
+class MKLConcatOp final : public MKLOperator<T> {
+ public:
+  USE_MKLOPERATOR_FUNCTIONS(T);
+  MKLConcatOp(const OperatorDef& operator_def, Workspace* ws)
+      : MKLOperator<T>(operator_def, ws) {
+    // MKL concatenates along the channels of NCHW inputs only.
+    if (OperatorBase::HasArgument("axis")) {
+      OPERATOR_NEEDS_FEATURE(
+          OperatorBase::GetSingleArgument<int>("axis", -1) == 1,
+          "Only axis 1 is supported.");
+    } else {
+      OPERATOR_NEEDS_FEATURE(
+          OperatorBase::GetSingleArgument<string>("order", "") == "NCHW",
+          "Only NCHW order supported.");
+    }
+    OPERATOR_NEEDS_FEATURE(
+        InputSize() <= dnnResourceMultipleDst - dnnResourceMultipleSrc,
+        "Too many inputs.");
+  }
+  virtual ~MKLConcatOp() {}
+
+  bool RunOnDevice() override {
+    const auto& X0 = Input(0);
+    auto* Y = Output(0);
+    bool dims_changed = input_size_cache_.size() != InputSize();
+    for (int i = 0; i < InputSize() && !dims_changed; ++i) {
+      dims_changed = input_size_cache_[i] != Input(i).dims();
+    }
+    if (dims_changed) {
+      // First run or changed input size, will need to recreate environment
+      input_size_cache_.clear();
+      vector<TIndex> Y_dims(X0.dims());
+      Y_dims[1] = 0;
+      vector<dnnLayout_t> layouts;
+      for (int i = 0; i < InputSize(); ++i) {
+        const auto& X = Input(i);
+        CAFFE_ENFORCE_EQ(X.ndim(), X0.ndim());
+        for (int j = 0; j < X.ndim(); ++j) {
+          CAFFE_ENFORCE(
+              j == 1 || X.dim(j) == X0.dim(j),
+              "Inputs differ in a dimension other than the channels.");
+        }
+        Y_dims[1] += X.dim(1);
+        input_size_cache_.push_back(X.dims());
+        layouts.push_back(X.layout());
+      }
+      primitive_.Reset(
+          dnnConcatCreate<T>, nullptr, InputSize(), layouts.data());
+      Y->Reset(Y_dims, primitive_, dnnResourceDst);
+      buffer_.Reset(Y_dims, primitive_, dnnResourceDst, true);
+    }
+    // Try to share from the output: this allows us to avoid unnecessary copy
+    // operations, if the output is already allocated and is having the same
+    // layout as the buffer has.
+    buffer_.ShareFrom(*Y);
+    for (int i = 0; i < InputSize(); ++i) {
+      resources_[dnnResourceMultipleSrc + i] = Input(i).buffer();
+    }
+    resources_[dnnResourceDst] = buffer_.buffer();
+    ExecutePrimitive();
+    buffer_.CopyTo(Y, primitive_, dnnResourceDst);
+
+    if (OutputSize() > 1) {
+      auto* split = OperatorBase::Output<TensorCPU>(1);
+      split->Resize(InputSize());
+      int* split_data = split->template mutable_data<int>();
+      for (int i = 0; i < InputSize(); ++i) {
+        split_data[i] = Input(i).dim32(1);
+      }
+    }
+    return true;
+  }
+};
+
+} // namespace mkl
+
+REGISTER_MKL_OPERATOR(Concat, mkl::MKLConcatOp<float>);
+
+} // namespace caffe2
+
+#endif // CAFFE2_HAS_MKL_DNN
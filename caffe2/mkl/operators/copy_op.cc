@@ -0,0 +1,91 @@
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/mkl_utils.h"
+
+#ifdef CAFFE2_HAS_MKL_DNN
+
+namespace caffe2 {
+namespace mkl {
+
+// Both copies accept an input that is already on their output side, which
+// they share instead of converting, so that they can be inserted in front of
+// external inputs whose type is not known until the net runs.
+
+template <typename T>
+class CopyCPUToMKLOp final : public OperatorBase {
+ public:
+  CopyCPUToMKLOp(const OperatorDef& operator_def, Workspace* ws)
+      : OperatorBase(operator_def, ws) {}
+
+  bool Run() override {
+    if (InputIsType<MKLMemory<T>>(0)) {
+      const auto& X = OperatorBase::Input<MKLMemory<T>>(0);
+      auto* Y = OperatorBase::Output<MKLMemory<T>>(0);
+      if (Y->dims() != X.dims()) {
+        Y->Reset(X.dims(), nullptr, dnnResourceNumber, true);
+      }
+      Y->CopyFrom(X);
+      return true;
+    }
+    const auto& X = OperatorBase::Input<TensorCPU>(0);
+    auto* Y = OperatorBase::Output<MKLMemory<T>>(0);
+    if (Y->dims() != X.dims()) {
+      // The user layout of Y is that of X, so the conversion primitive that
+      // Reset() creates is reused by every run until the shape changes.
+      Y->Reset(X.dims());
+    }
+    Y->CopyFrom(X);
+    return true;
+  }
+};
+
+template <typename T>
+class CopyMKLToCPUOp final : public OperatorBase {
+ public:
+  CopyMKLToCPUOp(const OperatorDef& operator_def, Workspace* ws)
+      : OperatorBase(operator_def, ws) {}
+
+  bool Run() override {
+    auto* Y = OperatorBase::Output<TensorCPU>(0);
+    if (InputIsType<TensorCPU>(0)) {
+      const auto& X = OperatorBase::Input<TensorCPU>(0);
+      Y->ResizeLike(X);
+      Y->ShareData(X);
+      return true;
+    }
+    OperatorBase::Input<MKLMemory<T>>(0).CopyTo(Y);
+    return true;
+  }
+};
+
+} // namespace mkl
+
+REGISTER_MKL_OPERATOR(CopyCPUToMKL, mkl::CopyCPUToMKLOp<float>);
+REGISTER_MKL_OPERATOR(CopyMKLToCPU, mkl::CopyMKLToCPUOp<float>);
+
+OPERATOR_SCHEMA(CopyCPUToMKL)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .IdenticalTypeAndShape()
+    .SetDoc(R"DOC(
+Copy a float TensorCPU into an MKLMemory in the plain layout. An input that is
+an MKLMemory already is shared, or copied if the layouts differ. Must be run
+under MKLDNN device option.
+)DOC")
+    .Input(0, "input", "The input TensorCPU or MKLMemory.")
+    .Output(0, "output", "MKLMemory that will contain a copy of the input.");
+
+OPERATOR_SCHEMA(CopyMKLToCPU)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .IdenticalTypeAndShape()
+    .SetDoc(R"DOC(
+Copy a float MKLMemory into a TensorCPU, converting it out of its internal
+layout. An input that is a TensorCPU already is shared. Must be run under
+MKLDNN device option.
+)DOC")
+    .Input(0, "input", "The input MKLMemory or TensorCPU.")
+    .Output(0, "output", "TensorCPU that will contain a copy of the input.");
+
+} // namespace caffe2
+
+#endif // CAFFE2_HAS_MKL_DNN
@@ -0,0 +1,81 @@
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/mkl_utils.h"
+
+#ifdef CAFFE2_HAS_MKL_DNN
+
+namespace caffe2 {
+namespace mkl {
+
+template <typename T>
+class MKLSumOp final : public MKLOperator<T> {
+ public:
+  USE_MKLOPERATOR_FUNCTIONS(T);
+  MKLSumOp(const OperatorDef& operator_def, Workspace* ws)
+      : MKLOperator<T>(operator_def, ws) {
+    OPERATOR_NEEDS_FEATURE(
+        InputSize() <= dnnResourceMultipleDst - dnnResourceMultipleSrc,
+        "Too many inputs.");
+  }
+  virtual ~MKLSumOp() {}
+
+  bool RunOnDevice() override {
+    const auto& X0 = Input(0);
+    auto* Y = Output(0);
+    bool dims_changed = input_size_cache_.size() != InputSize();
+    for (int i = 0; i < InputSize() && !dims_changed; ++i) {
+      dims_changed = input_size_cache_[i] != Input(i).dims();
+    }
+    if (dims_changed) {
+      // First run or changed input size, will need to recreate environment
+      input_size_cache_.clear();
+      for (int i = 0; i < InputSize(); ++i) {
+        CAFFE_ENFORCE_EQ(
+            Input(i).dims(), X0.dims(), "All inputs must have the same shape.");
+        input_size_cache_.push_back(Input(i).dims());
+      }
+      coefficients_.assign(InputSize(), 1);
+      primitive_.Reset(
+          dnnSumCreate<T>,
+          nullptr,
+          InputSize(),
+          X0.layout(),
+          coefficients_.data());
+      // Resetting an output that is also an input would drop the summand.
+      bool in_place = false;
+      for (int i = 0; i < InputSize(); ++i) {
+        in_place |= OperatorBase::Inputs()[i] == OperatorBase::Outputs()[0];
+      }
+      if (!in_place) {
+        Y->Reset(X0.dims(), primitive_, dnnResourceDst);
+      }
+      buffer_.Reset(X0.dims(), primitive_, dnnResourceDst, true);
+    }
+    // Try to share from the output: this allows us to avoid unnecessary copy
+    // operations, if the output is already allocated and is having the same
+    // layout as the buffer has.
+    buffer_.ShareFrom(*Y);
+    // The summands all have to be in the layout of the first one.
+    vector<std::shared_ptr<void>> views(InputSize());
+    for (int i = 0; i < InputSize(); ++i) {
+      const auto type =
+          static_cast<dnnResourceType_t>(dnnResourceMultipleSrc + i);
+      views[i] = Input(i).View(X0.layout(), primitive_, type);
+      resources_[type] = views[i].get();
+    }
+    resources_[dnnResourceDst] = buffer_.buffer();
+    ExecutePrimitive();
+    buffer_.CopyTo(Y, primitive_, dnnResourceDst);
+    return true;
+  }
+
+ private:
+  vector<T> coefficients_;
+};
+
+} // namespace mkl
+
+REGISTER_MKL_OPERATOR(Sum, mkl::MKLSumOp<float>);
+
+} // namespace caffe2
+
+#endif // CAFFE2_HAS_MKL_DNN
@@ -0,0 +1,103 @@
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/mkl_utils.h"
+
+#ifdef CAFFE2_HAS_MKL_DNN
+
+namespace caffe2 {
+namespace mkl {
+
+template <typename T>
+class MKLFullyConnectedOp final : public MKLOperator<T> {
+ public:
+  USE_MKLOPERATOR_FUNCTIONS(T);
+  MKLFullyConnectedOp(const OperatorDef& operator_def, Workspace* ws)
+      : MKLOperator<T>(operator_def, ws) {
+    OPERATOR_NEEDS_FEATURE(
+        OperatorBase::GetSingleArgument<int>("axis", 1) == 1,
+        "Only axis 1 is supported.");
+  }
+  virtual ~MKLFullyConnectedOp() {}
+
+  bool RunOnDevice() override {
+    auto& X = Input(INPUT);
+    auto& filter = Input(FILTER);
+    auto& bias = Input(BIAS);
+    auto* Y = Output(0);
+    CAFFE_ENFORCE(X.ndim() == 2 || X.ndim() == 4);
+    CAFFE_ENFORCE(2 == filter.ndim());
+    const TIndex N = X.dim(0);
+    const TIndex M = filter.dim(0);
+
+    if (input_size_cache_.size() != 2 || input_size_cache_[0] != X.dims() ||
+        input_size_cache_[1] != filter.dims()) {
+      input_size_cache_ = {X.dims(), filter.dims()};
+      TIndex K = 1;
+      for (int i = 1; i < X.ndim(); ++i) {
+        K *= X.dim(i);
+      }
+      CAFFE_ENFORCE_EQ(
+          filter.dim(1), K, "The filter does not match the input size.");
+      CAFFE_ENFORCE(1 == bias.ndim());
+      CAFFE_ENFORCE_EQ(bias.dim(0), M);
+
+      size_t dimension = X.ndim();
+      size_t src_sizes[4];
+      for (int i = 0; i < dimension; ++i) {
+        src_sizes[i] = X.dim(dimension - 1 - i);
+      }
+      primitive_.Reset(
+          dnnInnerProductCreateForwardBias<T>,
+          nullptr,
+          dimension,
+          src_sizes,
+          M);
+      const vector<TIndex> Y_dims{N, M};
+      Y->Reset(Y_dims, primitive_, dnnResourceDst);
+      buffer_.Reset(Y_dims, primitive_, dnnResourceDst, true);
+      input_layout_.Reset(primitive_, dnnResourceSrc);
+      bias_layout_.Reset(primitive_, dnnResourceBias);
+      // The primitive wants a filter with as many dimensions as the input.
+      // An M x K filter in the plain layout is also an M x C x H x W one, so
+      // it is converted with the user layout of that shape.
+      vector<TIndex> filter_dims(X.dims());
+      filter_dims[0] = M;
+      filter_buffer_.Reset(filter_dims, primitive_, dnnResourceFilter);
+      plain_filter_layout_.Reset(TensorCPU(filter.dims()));
+    }
+
+    CAFFE_ENFORCE(
+        dnnLayoutCompare<T>(filter.layout(), plain_filter_layout_),
+        "The filter of the MKL FC has to be in the plain layout.");
+    filter_buffer_.CopyFrom(filter.buffer());
+    // Try to share from the output: this allows us to avoid unnecessary copy
+    // operations, if the output is already allocated and is having the same
+    // layout as the buffer has.
+    buffer_.ShareFrom(*Y);
+    std::shared_ptr<void> X_view =
+        X.View(input_layout_, primitive_, dnnResourceSrc);
+    std::shared_ptr<void> bias_view =
+        bias.View(bias_layout_, primitive_, dnnResourceBias);
+    resources_[dnnResourceSrc] = X_view.get();
+    resources_[dnnResourceFilter] = filter_buffer_.buffer();
+    resources_[dnnResourceBias] = bias_view.get();
+    resources_[dnnResourceDst] = buffer_.buffer();
+    ExecutePrimitive();
+    buffer_.CopyTo(Y, primitive_, dnnResourceDst);
+    return true;
+  }
+
+ private:
+  LayoutWrapper<T> input_layout_;
+  LayoutWrapper<T> bias_layout_;
+  LayoutWrapper<T> plain_filter_layout_;
+  MKLMemory<T> filter_buffer_;
+  INPUT_TAGS(INPUT, FILTER, BIAS);
+};
+
+} // namespace mkl
+
+REGISTER_MKL_OPERATOR(FC, mkl::MKLFullyConnectedOp<float>);
+
+} // namespace caffe2
+
+#endif // CAFFE2_HAS_MKL_DNN
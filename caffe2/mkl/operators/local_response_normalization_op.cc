@@ -0,0 +1,81 @@
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/mkl_utils.h"
+
+#ifdef CAFFE2_HAS_MKL_DNN
+
+namespace caffe2 {
+namespace mkl {
+
+template <typename T>
+class MKLLRNOp final : public MKLOperator<T> {
+ public:
+  USE_MKLOPERATOR_FUNCTIONS(T);
+  MKLLRNOp(const OperatorDef& operator_def, Workspace* ws)
+      : MKLOperator<T>(operator_def, ws),
+        size_(OperatorBase::GetSingleArgument<int>("size", 0)),
+        alpha_(OperatorBase::GetSingleArgument<float>("alpha", 0)),
+        beta_(OperatorBase::GetSingleArgument<float>("beta", 0)),
+        bias_(OperatorBase::GetSingleArgument<float>("bias", 1)) {
+    CAFFE_ENFORCE_GT(size_, 0);
+    CAFFE_ENFORCE_EQ(size_ % 2, 1);
+    OPERATOR_NEEDS_FEATURE(
+        OperatorBase::GetSingleArgument<string>("order", "NHWC") == "NCHW",
+        "Only NCHW order supported.");
+    OPERATOR_NEEDS_FEATURE(
+        OutputSize() == 1, "The scale output is not supported.");
+  }
+  virtual ~MKLLRNOp() {}
+
+  bool RunOnDevice() override {
+    auto& X = Input(0);
+    auto* Y = Output(0);
+    CAFFE_ENFORCE(4 == X.ndim());
+    if (input_size_cache_.size() != 1 || input_size_cache_[0] != X.dims()) {
+      // First run or changed input size, will need to recreate environment
+      input_size_cache_ = {X.dims()};
+      primitive_.Reset(
+          dnnLRNCreateForward<T>,
+          nullptr,
+          X.layout(),
+          size_,
+          alpha_,
+          beta_,
+          bias_);
+      Y->Reset(X.dims(), primitive_, dnnResourceDst);
+      buffer_.Reset(X.dims(), primitive_, dnnResourceDst, true);
+      workspace_layout_.Reset(primitive_, dnnResourceWorkspace);
+      void* allocated = nullptr;
+      MKLDNN_SAFE_CALL(dnnAllocateBuffer<T>(&allocated, workspace_layout_));
+      workspace_.reset(allocated, [](void* ptr) -> void {
+        MKLDNN_CHECK(dnnReleaseBuffer<T>(ptr));
+      });
+    }
+    // Try to share from the output: this allows us to avoid unnecessary copy
+    // operations, if the output is already allocated and is having the same
+    // layout as the buffer has.
+    buffer_.ShareFrom(*Y);
+    resources_[dnnResourceSrc] = X.buffer();
+    resources_[dnnResourceDst] = buffer_.buffer();
+    resources_[dnnResourceWorkspace] = workspace_.get();
+    ExecutePrimitive();
+    buffer_.CopyTo(Y, primitive_, dnnResourceDst);
+    return true;
+  }
+
+ private:
+  const int size_;
+  const float alpha_;
+  const float beta_;
+  const float bias_;
+  // The intermediate sums that the forward pass keeps.
+  LayoutWrapper<T> workspace_layout_;
+  std::shared_ptr<void> workspace_;
+};
+
+} // namespace mkl
+
+REGISTER_MKL_OPERATOR(LRN, mkl::MKLLRNOp<float>);
+
+} // namespace caffe2
+
+#endif // CAFFE2_HAS_MKL_DNN
@@ -17,7 +17,9 @@ namespace caffe2 {
  * yet for an operator. Essentially, what this op does is to automatically
  * deal with data copy for you. Plausibly, this causes a lot of overhead and
  * is not optimal, so you should use this operator mostly for quick prototyping
- * purpose.
+ * purpose. For nets that mix MKL and CPU operators, PlanMKLLayouts() in
+ * caffe2/utils/mkl/mkl_layout_planner.h runs the CPU operators on CPU instead
+ * and converts the blobs only where the net crosses between the two.
  *
  * All the input and output of the original operator should be TensorCPU.
  *
@@ -98,14 +100,14 @@ class MKLFallbackOp final : public Operator<MKLContext> {
         Blob* dst = OperatorBase::OutputBlob(i);
         if (!dst->IsType<MKLMemory<float>>() ||
             dst->Get<MKLMemory<float>>().dims() != src.dims()) {
-          dst->Reset(new MKLMemory<float>(src.dims());
+          dst->Reset(new MKLMemory<float>(src.dims()));
         }
         dst->GetMutable<MKLMemory<float>>()->CopyFrom(src);
       } else if (src.IsType<double>()) {
         Blob* dst = OperatorBase::OutputBlob(i);
         if (!dst->IsType<MKLMemory<double>>() ||
             dst->Get<MKLMemory<double>>().dims() != src.dims()) {
-          dst->Reset(new MKLMemory<double>(src.dims());
+          dst->Reset(new MKLMemory<double>(src.dims()));
         }
         dst->GetMutable<MKLMemory<double>>()->CopyFrom(src);
       } else {
@@ -0,0 +1,107 @@
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/conv_pool_op_base.h"
+#include "caffe2/utils/mkl_utils.h"
+
+#ifdef CAFFE2_HAS_MKL_DNN
+
+namespace caffe2 {
+namespace mkl {
+
+template <typename T, dnnAlgorithm_t algorithm>
+class MKLPoolOp final : public ConvPoolOpBase<MKLContext> {
+ public:
+  USE_CONV_POOL_BASE_FUNCTIONS(MKLContext);
+  MKLPoolOp(const OperatorDef& operator_def, Workspace* ws)
+      : ConvPoolOpBase<MKLContext>(operator_def, ws) {
+    OPERATOR_NEEDS_FEATURE(
+        dilation_h_ == 1 && dilation_w_ == 1, "Dilation not supported.");
+    OPERATOR_NEEDS_FEATURE(
+        pad_l_ == pad_r_ && pad_t_ == pad_b_, "Uneven padding not supported.");
+    OPERATOR_NEEDS_FEATURE(
+        order_ == StorageOrder::NCHW, "Only NCHW order supported.");
+    // The CPU AveragePool leaves the padding out of the average, which MKL
+    // does not.
+    OPERATOR_NEEDS_FEATURE(
+        algorithm == dnnAlgorithmPoolingMax || (pad_l_ == 0 && pad_t_ == 0),
+        "Padded average pooling not supported.");
+  }
+  ~MKLPoolOp() {}
+
+  bool RunOnDeviceWithOrderNCHW() override {
+    auto& X = OperatorBase::Input<MKLMemory<T>>(0);
+    MKLMemory<T>* Y = OperatorBase::Output<MKLMemory<T>>(0);
+    CAFFE_ENFORCE(4 == X.ndim());
+
+    if (cached_input_dims_ != X.dims()) {
+      cached_input_dims_ = X.dims();
+      // We will utilize the SetOutputSize() function in the base class
+      // with dummy TensorCPU input and output to calculate the sizes. This
+      // also sets the kernel for global pooling.
+      TensorCPU dummy_input(X.dims());
+      TensorCPU dummy_output;
+      ConvPoolOpBase<MKLContext>::SetOutputSize(
+          dummy_input, &dummy_output, X.dim32(1));
+      size_t kernel_sizes[2] = {kernel_w_, kernel_h_};
+      size_t strides[2] = {stride_w_, stride_h_};
+      int pads[2] = {-pad_l_, -pad_t_};
+
+      primitive_.Reset(
+          dnnPoolingCreateForward<T>,
+          nullptr,
+          algorithm,
+          X.layout(),
+          kernel_sizes,
+          strides,
+          pads,
+          dnnBorderZeros);
+      Y->Reset(dummy_output.dims(), primitive_, dnnResourceDst);
+      buffer_.Reset(dummy_output.dims(), primitive_, dnnResourceDst, true);
+      if (algorithm == dnnAlgorithmPoolingMax) {
+        // Max pooling keeps where the maximums are in its workspace.
+        workspace_layout_.Reset(primitive_, dnnResourceWorkspace);
+        void* allocated = nullptr;
+        MKLDNN_SAFE_CALL(dnnAllocateBuffer<T>(&allocated, workspace_layout_));
+        workspace_.reset(allocated, [](void* ptr) -> void {
+          MKLDNN_CHECK(dnnReleaseBuffer<T>(ptr));
+        });
+      }
+    }
+
+    // Try to share from the output: this allows us to avoid unnecessary copy
+    // operations, if the output is already allocated and is having the same
+    // layout as the buffer has.
+    buffer_.ShareFrom(*Y);
+    resources_[dnnResourceSrc] = X.buffer();
+    resources_[dnnResourceDst] = buffer_.buffer();
+    resources_[dnnResourceWorkspace] = workspace_.get();
+    MKLDNN_SAFE_CALL(mkl::dnnExecute<T>(primitive_, resources_));
+    buffer_.CopyTo(Y, primitive_, dnnResourceDst);
+    return true;
+  }
+
+  bool RunOnDeviceWithOrderNHWC() override {
+    CAFFE_NOT_IMPLEMENTED;
+  }
+
+ private:
+  vector<TIndex> cached_input_dims_;
+  PrimitiveWrapper<T> primitive_;
+  LayoutWrapper<T> workspace_layout_;
+  std::shared_ptr<void> workspace_;
+  MKLMemory<T> buffer_;
+  void* resources_[dnnResourceNumber] = {0};
+};
+
+} // namespace mkl
+
+REGISTER_MKL_OPERATOR(
+    MaxPool,
+    mkl::MKLPoolOp<float, dnnAlgorithmPoolingMax>);
+REGISTER_MKL_OPERATOR(
+    AveragePool,
+    mkl::MKLPoolOp<float, dnnAlgorithmPoolingAvg>);
+
+} // namespace caffe2
+
+#endif // CAFFE2_HAS_MKL_DNN
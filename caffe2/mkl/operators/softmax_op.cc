@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <cmath>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/mkl_utils.h"
+
+#ifdef CAFFE2_HAS_MKL_DNN
+
+namespace caffe2 {
+namespace mkl {
+
+// MKLDNN has no softmax primitive, so this computes it on the plain layout.
+// It still keeps the blobs in MKLMemory, so that a net does not have to fall
+// back to CPU for its classifier.
+template <typename T>
+class MKLSoftmaxOp final : public MKLOperator<T> {
+ public:
+  USE_MKLOPERATOR_FUNCTIONS(T);
+  MKLSoftmaxOp(const OperatorDef& operator_def, Workspace* ws)
+      : MKLOperator<T>(operator_def, ws),
+        axis_(OperatorBase::GetSingleArgument<int>("axis", 1)) {}
+  virtual ~MKLSoftmaxOp() {}
+
+  bool RunOnDevice() override {
+    auto& X = Input(0);
+    auto* Y = Output(0);
+    CAFFE_ENFORCE_LT(axis_, X.ndim());
+    if (input_size_cache_.size() != 1 || input_size_cache_[0] != X.dims()) {
+      input_size_cache_ = {X.dims()};
+      plain_layout_.Reset(TensorCPU(X.dims()));
+    }
+    TIndex N = 1;
+    for (int i = 0; i < axis_; ++i) {
+      N *= X.dim(i);
+    }
+    TIndex D = 1;
+    for (int i = axis_; i < X.ndim(); ++i) {
+      D *= X.dim(i);
+    }
+    // Taken before Y is reset, which keeps the content alive if the op runs
+    // in place.
+    std::shared_ptr<void> X_view =
+        X.View(plain_layout_, nullptr, dnnResourceNumber);
+    if (Y->dims() != X.dims() ||
+        !dnnLayoutCompare<T>(Y->layout(), plain_layout_)) {
+      Y->Reset(X.dims());
+    }
+    const T* Xdata = static_cast<const T*>(X_view.get());
+    T* Ydata = static_cast<T*>(Y->buffer());
+    for (TIndex i = 0; i < N; ++i) {
+      const T* x = Xdata + i * D;
+      T* y = Ydata + i * D;
+      const T max = *std::max_element(x, x + D);
+      T sum = 0;
+      for (TIndex j = 0; j < D; ++j) {
+        y[j] = std::exp(x[j] - max);
+        sum += y[j];
+      }
+      for (TIndex j = 0; j < D; ++j) {
+        y[j] /= sum;
+      }
+    }
+    return true;
+  }
+
+ private:
+  const int axis_;
+  LayoutWrapper<T> plain_layout_;
+};
+
+} // namespace mkl
+
+REGISTER_MKL_OPERATOR(Softmax, mkl::MKLSoftmaxOp<float>);
+
+} // namespace caffe2
+
+#endif // CAFFE2_HAS_MKL_DNN
@@ -0,0 +1,98 @@
+#include <cmath>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/mkl_utils.h"
+
+#ifdef CAFFE2_HAS_MKL_DNN
+
+namespace caffe2 {
+namespace mkl {
+
+// Inference only: the batch normalization primitive of MKLDNN always
+// computes the statistics of the batch, so with is_test the op applies the
+// running statistics as a per-channel scale and shift on the plain layout.
+template <typename T>
+class MKLSpatialBNOp final : public MKLOperator<T> {
+ public:
+  USE_MKLOPERATOR_FUNCTIONS(T);
+  MKLSpatialBNOp(const OperatorDef& operator_def, Workspace* ws)
+      : MKLOperator<T>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)) {
+    OPERATOR_NEEDS_FEATURE(
+        OperatorBase::GetSingleArgument<int>("is_test", 0),
+        "Only is_test is supported.");
+    OPERATOR_NEEDS_FEATURE(
+        OperatorBase::GetSingleArgument<string>("order", "NCHW") == "NCHW",
+        "Only NCHW order supported.");
+  }
+  virtual ~MKLSpatialBNOp() {}
+
+  bool RunOnDevice() override {
+    auto& X = Input(INPUT);
+    auto* Y = Output(OUTPUT);
+    CAFFE_ENFORCE(4 == X.ndim());
+    const TIndex N = X.dim(0);
+    const TIndex C = X.dim(1);
+    const TIndex HxW = X.dim(2) * X.dim(3);
+    if (input_size_cache_.size() != 1 || input_size_cache_[0] != X.dims()) {
+      input_size_cache_ = {X.dims()};
+      for (int i = SCALE; i <= EST_VAR; ++i) {
+        CAFFE_ENFORCE(1 == Input(i).ndim());
+        CAFFE_ENFORCE_EQ(Input(i).dim(0), C);
+      }
+      plain_layout_.Reset(TensorCPU(X.dims()));
+      channel_layout_.Reset(TensorCPU(vector<TIndex>{C}));
+    }
+    std::shared_ptr<void> views[EST_VAR + 1];
+    for (int i = SCALE; i <= EST_VAR; ++i) {
+      views[i] = Input(i).View(channel_layout_, nullptr, dnnResourceNumber);
+    }
+    const T* scale = static_cast<const T*>(views[SCALE].get());
+    const T* bias = static_cast<const T*>(views[BIAS].get());
+    const T* mean = static_cast<const T*>(views[EST_MEAN].get());
+    const T* var = static_cast<const T*>(views[EST_VAR].get());
+    multiplier_.resize(C);
+    shift_.resize(C);
+    for (TIndex c = 0; c < C; ++c) {
+      multiplier_[c] = scale[c] / std::sqrt(var[c] + epsilon_);
+      shift_[c] = bias[c] - mean[c] * multiplier_[c];
+    }
+
+    // Taken before Y is reset, which keeps the content alive if the op runs
+    // in place.
+    std::shared_ptr<void> X_view =
+        X.View(plain_layout_, nullptr, dnnResourceNumber);
+    if (Y->dims() != X.dims() ||
+        !dnnLayoutCompare<T>(Y->layout(), plain_layout_)) {
+      Y->Reset(X.dims());
+    }
+    const T* Xdata = static_cast<const T*>(X_view.get());
+    T* Ydata = static_cast<T*>(Y->buffer());
+    for (TIndex n = 0; n < N; ++n) {
+      for (TIndex c = 0; c < C; ++c) {
+        const TIndex offset = (n * C + c) * HxW;
+        for (TIndex i = 0; i < HxW; ++i) {
+          Ydata[offset + i] = Xdata[offset + i] * multiplier_[c] + shift_[c];
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  const float epsilon_;
+  LayoutWrapper<T> plain_layout_;
+  LayoutWrapper<T> channel_layout_;
+  vector<T> multiplier_;
+  vector<T> shift_;
+  INPUT_TAGS(INPUT, SCALE, BIAS, EST_MEAN, EST_VAR);
+  OUTPUT_TAGS(OUTPUT);
+};
+
+} // namespace mkl
+
+REGISTER_MKL_OPERATOR(SpatialBN, mkl::MKLSpatialBNOp<float>);
+
+} // namespace caffe2
+
+#endif // CAFFE2_HAS_MKL_DNN
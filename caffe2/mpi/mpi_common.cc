@@ -8,6 +8,7 @@
 namespace caffe2 {
 
 CAFFE_KNOWN_TYPE(MPICommonWorldWrapper);
+CAFFE_KNOWN_TYPE(MPIRequestWrapper);
 
 static std::mutex gCaffe2MPIMutex;
 
@@ -15,6 +16,29 @@ std::mutex& MPIMutex() {
   return gCaffe2MPIMutex;
 }
 
+MPIRequestWrapper::~MPIRequestWrapper() {
+  if (!pending()) {
+    return;
+  }
+  int finalized;
+  MPI_Finalized(&finalized);
+  if (!finalized) {
+    std::lock_guard<std::mutex> guard(MPIMutex());
+    MPI_Wait(&request_, MPI_STATUS_IGNORE);
+  }
+}
+
+void MPIRequestWrapper::Wait() {
+  int done = 0;
+  while (true) {
+    MPI_CHECK(MPI_Test(&request_, &done, MPI_STATUS_IGNORE));
+    if (done) {
+      return;
+    }
+    std::this_thread::yield();
+  }
+}
+
 static MPI_Comm gCaffe2MPIComm = MPI_COMM_WORLD;
 
 MPI_Comm GlobalMPIComm() {
@@ -40,6 +64,36 @@ int MPICommRank(MPI_Comm comm) {
   return comm_rank;
 }
 
+std::vector<Placement> MPIAllgatherPlacements(
+    MPI_Comm comm,
+    const Placement& placement) {
+  const int size = MPICommSize(comm);
+  const string data = serializePlacement(placement);
+  int length = data.size();
+  std::vector<int> lengths(size);
+  MPI_CHECK(
+      MPI_Allgather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, comm));
+  std::vector<int> offsets(size, 0);
+  for (int i = 1; i < size; ++i) {
+    offsets[i] = offsets[i - 1] + lengths[i - 1];
+  }
+  string all(offsets.back() + lengths.back(), '\0');
+  MPI_CHECK(MPI_Allgatherv(
+      data.data(),
+      length,
+      MPI_CHAR,
+      &all[0],
+      lengths.data(),
+      offsets.data(),
+      MPI_CHAR,
+      comm));
+  std::vector<Placement> placements;
+  for (int i = 0; i < size; ++i) {
+    placements.push_back(parsePlacement(all.substr(offsets[i], lengths[i])));
+  }
+  return placements;
+}
+
 /**
  * Helper function used to setup MPI intercommunicator.
  */
@@ -3,8 +3,11 @@
 
 #include <mpi.h>
 #include <mutex>
+#include <vector>
 
+#include "caffe2/core/common.h"
 #include "caffe2/core/logging.h"
+#include "caffe2/distributed/topology.h"
 
 namespace caffe2 {
 
@@ -67,6 +70,13 @@ int MPICommSize(MPI_Comm comm);
  */
 int MPICommRank(MPI_Comm comm);
 
+/**
+ * @brief Gathers the placements of all the ranks of comm, indexed by rank.
+ */
+std::vector<Placement> MPIAllgatherPlacements(
+    MPI_Comm comm,
+    const Placement& placement);
+
 /**
  * @brief A simple wrapper over an MPI common world.
  */
@@ -95,6 +105,7 @@ class MPICommonWorldWrapper {
     MPI_CHECK(MPI_Comm_split(src_comm, color, rank, &comm_));
     MPI_CHECK(MPI_Comm_size(comm_, &size_));
     MPI_CHECK(MPI_Comm_rank(comm_, &rank_));
+    FindRanksOnHost();
   }
 
   ~MPICommonWorldWrapper() {
@@ -123,11 +134,98 @@ class MPICommonWorldWrapper {
   inline int rank() const {
     return rank_;
   }
+  /**
+   * @brief Returns whether the given rank runs on the same host as this
+   * process, so that they can share memory.
+   */
+  inline bool OnSameHost(int rank) const {
+    return on_host_[rank];
+  }
+  /**
+   * @brief Returns whether MPI takes device pointers on all the ranks, so
+   * that CUDA tensors need not be staged through host memory.
+   */
+  inline bool cuda_aware() const {
+    return cuda_aware_;
+  }
+  /**
+   * @brief Records whether MPI takes device pointers on this rank. The world
+   * is only CUDA-aware if it is on all of its ranks, since staged tensors go
+   * through MPI in chunks, and all the ranks must make the same calls. This
+   * is collective.
+   */
+  void SetCudaAware(bool cuda_aware) {
+    int local = cuda_aware;
+    int all = 0;
+    MPI_CHECK(MPI_Allreduce(&local, &all, 1, MPI_INT, MPI_LAND, comm_));
+    cuda_aware_ = all;
+  }
 
  private:
+  // Finds the ranks that can share memory with this one. This is collective,
+  // which is why it is done when the common world is created.
+  void FindRanksOnHost() {
+    MPI_Comm host_comm;
+    MPI_CHECK(MPI_Comm_split_type(
+        comm_, MPI_COMM_TYPE_SHARED, rank_, MPI_INFO_NULL, &host_comm));
+    int host_size;
+    MPI_CHECK(MPI_Comm_size(host_comm, &host_size));
+    MPI_Group group, host_group;
+    MPI_CHECK(MPI_Comm_group(comm_, &group));
+    MPI_CHECK(MPI_Comm_group(host_comm, &host_group));
+    std::vector<int> host_ranks(host_size), ranks(host_size);
+    for (int i = 0; i < host_size; ++i) {
+      host_ranks[i] = i;
+    }
+    MPI_CHECK(MPI_Group_translate_ranks(
+        host_group, host_size, host_ranks.data(), group, ranks.data()));
+    on_host_.assign(size_, false);
+    for (int r : ranks) {
+      on_host_[r] = true;
+    }
+    MPI_CHECK(MPI_Group_free(&host_group));
+    MPI_CHECK(MPI_Group_free(&group));
+    MPI_CHECK(MPI_Comm_free(&host_comm));
+  }
+
   MPI_Comm comm_;
   int size_;
   int rank_;
+  std::vector<bool> on_host_;
+  bool cuda_aware_ = false;
+};
+
+/**
+ * @brief Holds the request of a non-blocking MPI operation until it is
+ * waited for.
+ *
+ * A request that is still pending when the wrapper is destroyed is waited
+ * for, so that MPI never writes into a buffer that was freed.
+ */
+class MPIRequestWrapper {
+ public:
+  MPIRequestWrapper() {}
+  ~MPIRequestWrapper();
+
+  inline MPI_Request* mutable_request() {
+    return &request_;
+  }
+  /**
+   * @brief Returns whether an operation was started and not waited for.
+   */
+  inline bool pending() const {
+    return request_ != MPI_REQUEST_NULL;
+  }
+  /**
+   * @brief Waits for the operation to complete. The request is polled with
+   * MPI_Test, so that other threads can issue MPI calls in the meantime.
+   */
+  void Wait();
+
+ private:
+  MPI_Request request_ = MPI_REQUEST_NULL;
+
+  DISABLE_COPY_AND_ASSIGN(MPIRequestWrapper);
 };
 
 /**
@@ -0,0 +1,184 @@
+#include "caffe2/mpi/mpi_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/mpi/mpi_common.h"
+
+namespace caffe2 {
+
+MPICompression ParseMPICompression(const string& name) {
+  if (name == "none") {
+    return MPICompression::NONE;
+  } else if (name == "fp16") {
+    return MPICompression::FP16;
+  } else if (name == "topk") {
+    return MPICompression::TOP_K;
+  } else if (name == "1bit") {
+    return MPICompression::ONE_BIT;
+  }
+  CAFFE_THROW("Unknown MPI compression: ", name);
+}
+
+namespace {
+
+// MPI reduction summing half precision floats. Each partial sum is rounded
+// to half precision, as it is sent again between the reduction steps.
+void Fp16Sum(void* in, void* inout, int* len, MPI_Datatype* /*type*/) {
+  const uint16_t* a = static_cast<const uint16_t*>(in);
+  uint16_t* b = static_cast<uint16_t*>(inout);
+  for (int i = 0; i < *len; ++i) {
+    b[i] = detail::FloatToHalfBits(
+        detail::HalfBitsToFloat(a[i]) + detail::HalfBitsToFloat(b[i]));
+  }
+}
+
+MPI_Op Fp16SumOp() {
+  // Created on first use, as MPI has to be initialized first. The operation
+  // is kept until MPI_Finalize.
+  static MPI_Op op = [] {
+    MPI_Op created;
+    MPI_CHECK(MPI_Op_create(&Fp16Sum, 1 /* commute */, &created));
+    return created;
+  }();
+  return op;
+}
+
+int CommSize(MPI_Comm comm) {
+  int size;
+  MPI_CHECK(MPI_Comm_size(comm, &size));
+  return size;
+}
+
+// An element of the message sent by TopKAllreduce.
+struct IndexedValue {
+  int32_t index;
+  float value;
+};
+
+} // namespace
+
+size_t Fp16Allreduce(const float* x, float* y, int n, MPI_Comm comm) {
+  vector<uint16_t> buffer(n);
+  for (int i = 0; i < n; ++i) {
+    buffer[i] = detail::FloatToHalfBits(x[i]);
+  }
+  // Not created inside MPI_CHECK, which holds the MPI mutex.
+  MPI_Op sum = Fp16SumOp();
+  MPI_CHECK(
+      MPI_Allreduce(MPI_IN_PLACE, buffer.data(), n, MPI_UINT16_T, sum, comm));
+  for (int i = 0; i < n; ++i) {
+    y[i] = detail::HalfBitsToFloat(buffer[i]);
+  }
+  return n * sizeof(uint16_t);
+}
+
+size_t TopKAllreduce(
+    const float* x,
+    float* y,
+    int n,
+    int k,
+    float* residual,
+    MPI_Comm comm) {
+  CAFFE_ENFORCE_GT(k, 0);
+  k = std::min(k, n);
+  for (int i = 0; i < n; ++i) {
+    residual[i] += x[i];
+  }
+  vector<int32_t> order(n);
+  for (int i = 0; i < n; ++i) {
+    order[i] = i;
+  }
+  std::nth_element(
+      order.begin(), order.begin() + k, order.end(), [residual](int a, int b) {
+        return std::abs(residual[a]) > std::abs(residual[b]);
+      });
+  vector<IndexedValue> message(k);
+  for (int i = 0; i < k; ++i) {
+    message[i].index = order[i];
+    message[i].value = residual[order[i]];
+    residual[order[i]] = 0;
+  }
+
+  // Every rank sends the same number of elements, so that the messages can
+  // be gathered without exchanging their sizes first.
+  const int size = CommSize(comm);
+  vector<IndexedValue> gathered(size * k);
+  MPI_CHECK(MPI_Allgather(
+      message.data(),
+      k * sizeof(IndexedValue),
+      MPI_BYTE,
+      gathered.data(),
+      k * sizeof(IndexedValue),
+      MPI_BYTE,
+      comm));
+  std::fill(y, y + n, 0.f);
+  for (const auto& element : gathered) {
+    y[element.index] += element.value;
+  }
+  return k * sizeof(IndexedValue);
+}
+
+size_t OneBitAllreduce(
+    const float* x,
+    float* y,
+    int n,
+    float* residual,
+    MPI_Comm comm) {
+  // The positive elements are decoded to their mean and the negative ones to
+  // theirs, which keeps the sum of the elements exact.
+  float positive_sum = 0;
+  float negative_sum = 0;
+  int num_positive = 0;
+  for (int i = 0; i < n; ++i) {
+    residual[i] += x[i];
+    if (residual[i] >= 0) {
+      positive_sum += residual[i];
+      ++num_positive;
+    } else {
+      negative_sum += residual[i];
+    }
+  }
+  const int num_negative = n - num_positive;
+  const float scales[2] = {
+      num_negative ? negative_sum / num_negative : 0.f,
+      num_positive ? positive_sum / num_positive : 0.f};
+
+  // The message is the two scales followed by the bits.
+  const int bit_bytes = (n + 7) / 8;
+  const int message_bytes = sizeof(scales) + bit_bytes;
+  vector<uint8_t> message(message_bytes, 0);
+  memcpy(message.data(), scales, sizeof(scales));
+  uint8_t* bits = message.data() + sizeof(scales);
+  for (int i = 0; i < n; ++i) {
+    const int bit = residual[i] >= 0;
+    bits[i / 8] |= bit << (i % 8);
+    residual[i] -= scales[bit];
+  }
+
+  const int size = CommSize(comm);
+  vector<uint8_t> gathered(size * message_bytes);
+  MPI_CHECK(MPI_Allgather(
+      message.data(),
+      message_bytes,
+      MPI_BYTE,
+      gathered.data(),
+      message_bytes,
+      MPI_BYTE,
+      comm));
+  std::fill(y, y + n, 0.f);
+  for (int r = 0; r < size; ++r) {
+    const uint8_t* rank_message = gathered.data() + r * message_bytes;
+    float rank_scales[2];
+    memcpy(rank_scales, rank_message, sizeof(rank_scales));
+    const uint8_t* rank_bits = rank_message + sizeof(rank_scales);
+    for (int i = 0; i < n; ++i) {
+      y[i] += rank_scales[(rank_bits[i / 8] >> (i % 8)) & 1];
+    }
+  }
+  return message_bytes;
+}
+
+} // namespace caffe2
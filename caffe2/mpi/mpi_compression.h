@@ -0,0 +1,68 @@
+#ifndef CAFFE2_MPI_MPI_COMPRESSION_H_
+#define CAFFE2_MPI_MPI_COMPRESSION_H_
+
+#include <mpi.h>
+
+#include "caffe2/core/common.h"
+
+namespace caffe2 {
+
+/**
+ * @brief How the MPI Allreduce operator compresses float tensors on the wire.
+ *
+ * - NONE sends the floats as they are.
+ * - FP16 sends half precision floats and sums them in float precision.
+ * - TOP_K sends the k elements of largest magnitude of each rank, with their
+ *   indices. The elements that are not sent are kept in a residual and added
+ *   to the next tensor reduced by the same operator (error feedback).
+ * - ONE_BIT sends the sign of every element, and the mean of the positive and
+ *   of the negative elements to decode them. The quantization error is kept
+ *   in a residual and added to the next tensor, as for TOP_K.
+ *
+ * TOP_K and ONE_BIT change the result of each reduction, but the residuals
+ * make the sum over many iterations match, which is what SGD needs.
+ */
+enum class MPICompression { NONE, FP16, TOP_K, ONE_BIT };
+
+/**
+ * @brief Parses "none", "fp16", "topk" or "1bit".
+ */
+MPICompression ParseMPICompression(const string& name);
+
+/**
+ * @brief Sums the n floats of x over the ranks of comm into y, which can be
+ * x, sending them as half precision floats. Returns the number of bytes this
+ * rank contributes to the reduction.
+ */
+size_t Fp16Allreduce(const float* x, float* y, int n, MPI_Comm comm);
+
+/**
+ * @brief Adds x to the residual, sends the k elements of largest magnitude
+ * of the sum and keeps the others in the residual. y, which can be x, gets
+ * the sum over the ranks of the elements they sent. Returns the number of
+ * bytes this rank contributes.
+ */
+size_t TopKAllreduce(
+    const float* x,
+    float* y,
+    int n,
+    int k,
+    float* residual,
+    MPI_Comm comm);
+
+/**
+ * @brief Adds x to the residual, sends its signs with one bit per element
+ * and keeps the quantization error in the residual. y, which can be x, gets
+ * the sum over the ranks of the decoded elements. Returns the number of bytes
+ * this rank contributes.
+ */
+size_t OneBitAllreduce(
+    const float* x,
+    float* y,
+    int n,
+    float* residual,
+    MPI_Comm comm);
+
+} // namespace caffe2
+
+#endif // CAFFE2_MPI_MPI_COMPRESSION_H_
@@ -8,6 +8,8 @@
 
 CAFFE2_DEFINE_string(
     caffe_test_root, "gen/", "The root of the caffe test folder.");
+CAFFE2_DECLARE_bool(caffe2_mpi_cuda_aware);
+CAFFE2_DECLARE_int64(caffe2_mpi_staging_chunk_bytes);
 
 namespace caffe2 {
 
@@ -333,6 +335,41 @@ TEST(MPITest, TestInPlaceMPIAllreduce) {
   }
 }
 
+// Stages the tensor through host memory in chunks that do not divide it,
+// whether or not MPI is CUDA-aware.
+TEST(MPITest, TestStagedMPIAllreduce) {
+  NetDef net_def;
+  CHECK(google::protobuf::TextFormat::ParseFromString(
+      string(kMPIAllreduceNet), &net_def));
+  auto* shape = net_def.mutable_op(1)->mutable_arg(0);
+  CAFFE_ENFORCE_EQ(shape->name(), "shape");
+  shape->set_ints(0, 1000);
+  auto* arg = net_def.mutable_op(1)->mutable_arg(1);
+  CAFFE_ENFORCE_EQ(arg->name(), "value");
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  arg->set_f(rank);
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  FLAGS_caffe2_mpi_cuda_aware = false;
+  FLAGS_caffe2_mpi_staging_chunk_bytes = 300;
+  Workspace ws;
+  unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+  EXPECT_NE(nullptr, net.get());
+  EXPECT_TRUE(net->Run());
+  FLAGS_caffe2_mpi_cuda_aware = true;
+  FLAGS_caffe2_mpi_staging_chunk_bytes = 4 << 20;
+  EXPECT_FALSE(ws.GetBlob("comm")->Get<MPICommonWorldWrapper>().cuda_aware());
+  auto& X_reduced = ws.GetBlob("X_reduced")->Get<TensorCUDA>();
+  EXPECT_EQ(X_reduced.size(), 1000);
+  int expected_result = size * (size - 1) / 2;
+  TensorCPU X_reduced_cpu(X_reduced);
+  for (int i = 0; i < X_reduced.size(); ++i) {
+    EXPECT_EQ(X_reduced_cpu.data<float>()[i], expected_result);
+  }
+}
+
 }  // namespace caffe2
 
 
@@ -17,11 +17,23 @@ REGISTER_CPU_OPERATOR_WITH_ENGINE(
     Allreduce,
     MPI,
     MPIAllreduceOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(
+    AllreduceAsync,
+    MPI,
+    MPIAllreduceAsyncOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(
+    WaitCollective,
+    MPI,
+    MPIWaitCollectiveOp<CPUContext>);
 REGISTER_CPU_OPERATOR_WITH_ENGINE(SendTensor, MPI, MPISendTensorOp<CPUContext>);
 REGISTER_CPU_OPERATOR_WITH_ENGINE(
     ReceiveTensor,
     MPI,
     MPIReceiveTensorOp<CPUContext>);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(
+    RingBandwidth,
+    MPI,
+    MPIRingBandwidthOp<CPUContext>);
 
 }  // namespace
 }  // namespace caffe2
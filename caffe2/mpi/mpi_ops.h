@@ -2,26 +2,69 @@
 #define CAFFE2_MPI_MPI_OPS_H_
 
 #include <mpi.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <type_traits>
 
 #include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
 #include "caffe2/mpi/mpi_common.h"
+#include "caffe2/mpi/mpi_compression.h"
+#include "caffe2/mpi/mpi_shm_transport.h"
 
 namespace caffe2 {
 
 // TODO(jiayq): if needed, write up the use of color and key with MPI split.
 // Currently, the operator simply creates a communicator that has the
-// same topology as the Caffe2 global communicator.
+// same topology as the Caffe2 global communicator, or, with topology_aware,
+// one whose ranks are ordered by rack, host and NUMA node, so that the rings
+// and trees MPI builds in rank order stay within racks as much as possible.
 template <class Context>
 class MPICreateCommonWorldOp final : public Operator<Context> {
  public:
   USE_OPERATOR_CONTEXT_FUNCTIONS;
   MPICreateCommonWorldOp(const OperatorDef& operator_def, Workspace* ws)
-      : Operator<Context>(operator_def, ws) {}
+      : Operator<Context>(operator_def, ws),
+        OP_SINGLE_ARG(bool, "topology_aware", topology_aware_, false),
+        OP_SINGLE_ARG(string, "rack", rack_, "") {}
 
   bool RunOnDevice() override {
-    OperatorBase::Outputs()[0]->Reset(new MPICommonWorldWrapper());
+    std::unique_ptr<MPICommonWorldWrapper> world(
+        topology_aware_ ? CreateTopologyAwareWorld()
+                        : new MPICommonWorldWrapper());
+    DetectTransport(world.get());
+    OperatorBase::Outputs()[0]->Reset(world.release());
     return true;
   }
+
+ protected:
+  MPICommonWorldWrapper* CreateTopologyAwareWorld() {
+    MPI_Comm src_comm = GlobalMPIComm();
+    const int rank = MPICommRank(src_comm);
+    const auto placements =
+        MPIAllgatherPlacements(src_comm, localPlacement(rack_));
+    const auto order = topologyOrder(placements);
+    const int key = std::find(order.begin(), order.end(), rank) - order.begin();
+    if (rank == 0) {
+      std::vector<int> rank_order(order.size());
+      for (int i = 0; i < rank_order.size(); ++i) {
+        rank_order[i] = i;
+      }
+      VLOG(1) << "Topology aware common world: "
+              << crossRackLinks(placements, rank_order)
+              << " cross rack links in rank order, "
+              << crossRackLinks(placements, order) << " after reordering.";
+    }
+    return new MPICommonWorldWrapper(src_comm, 0, key);
+  }
+
+  // Records in the world whether MPI takes the pointers of Context, which
+  // only needs to be found out for CUDA.
+  void DetectTransport(MPICommonWorldWrapper* /*world*/) {}
+
+  bool topology_aware_;
+  string rack_;
 };
 
 template <class Context>
@@ -118,13 +161,28 @@ template <typename T, class Context>
 class MPIAllreduceOp final : public Operator<Context> {
  public:
   USE_OPERATOR_CONTEXT_FUNCTIONS;
-  USE_SIMPLE_CTOR_DTOR(MPIAllreduceOp);
+  MPIAllreduceOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        compression_(ParseMPICompression(
+            OperatorBase::GetSingleArgument<string>("compression", "none"))),
+        topk_ratio_(
+            OperatorBase::GetSingleArgument<float>("topk_ratio", 0.01f)) {
+    CAFFE_ENFORCE(
+        compression_ == MPICompression::NONE ||
+            ((std::is_same<T, float>::value &&
+              std::is_same<Context, CPUContext>::value)),
+        "Compression is only supported for float tensors on the CPU.");
+    CAFFE_ENFORCE(topk_ratio_ > 0 && topk_ratio_ <= 1);
+  }
 
   bool RunOnDevice() override {
     MPI_Comm comm = OperatorBase::Input<MPICommonWorldWrapper>(0).comm();
     auto& input = Input(1);
     auto* output = Output(0);
     output->ResizeLike(input);
+    if (compression_ != MPICompression::NONE) {
+      return RunCompressed(comm, input, output);
+    }
     void* source;
     if (output->template mutable_data<T>() == input.template data<T>()) {
       // We are doing in-place call. Special case handling.
@@ -142,6 +200,94 @@ class MPIAllreduceOp final : public Operator<Context> {
         comm));
     return true;
   }
+
+ private:
+  bool RunCompressed(
+      MPI_Comm comm,
+      const Tensor<Context>& input,
+      Tensor<Context>* output) {
+    // The data is on the CPU, which the constructor checks.
+    const float* x = reinterpret_cast<const float*>(input.raw_data());
+    float* y =
+        reinterpret_cast<float*>(output->raw_mutable_data(input.meta()));
+    const int n = input.size();
+    if (compression_ == MPICompression::FP16) {
+      Fp16Allreduce(x, y, n, comm);
+      return true;
+    }
+    // The residual restarts from 0 when the size changes.
+    if (residual_.size() != n) {
+      residual_.Resize(n);
+      std::fill(
+          residual_.template mutable_data<float>(),
+          residual_.template mutable_data<float>() + n,
+          0.f);
+    }
+    float* residual = residual_.template mutable_data<float>();
+    if (compression_ == MPICompression::TOP_K) {
+      const int k = std::max<int>(1, std::ceil(topk_ratio_ * n));
+      TopKAllreduce(x, y, n, k, residual, comm);
+    } else {
+      OneBitAllreduce(x, y, n, residual, comm);
+    }
+    return true;
+  }
+
+  MPICompression compression_;
+  float topk_ratio_;
+  // What was not sent of the previous inputs, for topk and 1bit.
+  TensorCPU residual_;
+};
+
+// MPIAllreduceAsyncOp starts an MPI_Iallreduce and returns without waiting
+// for it; MPIWaitCollectiveOp completes it. Currently, only SUM is supported.
+template <typename T, class Context>
+class MPIAllreduceAsyncOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(MPIAllreduceAsyncOp);
+
+  bool RunOnDevice() override {
+    MPI_Comm comm = OperatorBase::Input<MPICommonWorldWrapper>(0).comm();
+    auto& input = Input(1);
+    auto* output = Output(0);
+    auto* request = OperatorBase::Output<MPIRequestWrapper>(1);
+    CAFFE_ENFORCE(
+        !request->pending(),
+        "The previous collective of the handle has not been waited for.");
+    output->ResizeLike(input);
+    void* source;
+    if (output->template mutable_data<T>() == input.template data<T>()) {
+      source = MPI_IN_PLACE;
+    } else {
+      source = const_cast<T*>(input.template data<T>());
+    }
+    MPI_CHECK(MPI_Iallreduce(
+        source,
+        output->template mutable_data<T>(),
+        input.size(),
+        MPIDataTypeWrapper<T>::type(),
+        MPI_SUM,
+        comm,
+        request->mutable_request()));
+    return true;
+  }
+};
+
+// MPIWaitCollectiveOp waits for the collective of the handle to complete.
+template <class Context>
+class MPIWaitCollectiveOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(MPIWaitCollectiveOp);
+
+  bool RunOnDevice() override {
+    auto* request = OperatorBase::Output<MPIRequestWrapper>(1);
+    CAFFE_ENFORCE(
+        request->pending(), "No collective was started with the handle.");
+    request->Wait();
+    return true;
+  }
 };
 
 template <class Context>
@@ -165,13 +311,20 @@ class MPISendTensorOp final : public Operator<Context> {
   }
 
   bool RunOnDevice() override {
-    MPI_Comm comm = OperatorBase::Input<MPICommonWorldWrapper>(COMM).comm();
+    const auto& world = OperatorBase::Input<MPICommonWorldWrapper>(COMM);
+    MPI_Comm comm = world.comm();
     auto& input = Input(INPUT);
     if (InputSize() == 4) {
       dst_ = OperatorBase::Input<TensorCPU>(DST).template data<int>()[0];
       tag_ = OperatorBase::Input<TensorCPU>(TAG).template data<int>()[0];
     }
-    if (raw_buffer_) {
+    if (raw_buffer_ && std::is_same<Context, CPUContext>::value &&
+        world.OnSameHost(dst_) && UseMPIShmTransport(input.nbytes())) {
+      if (!shm_sender_) {
+        shm_sender_.reset(new MPIShmSender());
+      }
+      shm_sender_->Send(input.raw_data(), input.nbytes(), dst_, tag_, comm);
+    } else if (raw_buffer_) {
       MPI_CHECK(MPI_Send(
           input.raw_data(), input.nbytes(), MPI_CHAR, dst_, tag_, comm));
     } else {
@@ -184,6 +337,7 @@ class MPISendTensorOp final : public Operator<Context> {
   int dst_;
   int tag_;
   bool raw_buffer_;
+  std::unique_ptr<MPIShmSender> shm_sender_;
 
   INPUT_TAGS(COMM, INPUT, DST, TAG);
 };
@@ -201,20 +355,39 @@ class MPIReceiveTensorOp final : public Operator<Context> {
   }
 
   bool RunOnDevice() override {
-    MPI_Comm comm = OperatorBase::Input<MPICommonWorldWrapper>(COMM).comm();
+    const auto& world = OperatorBase::Input<MPICommonWorldWrapper>(COMM);
+    MPI_Comm comm = world.comm();
     if (InputSize() == 4) {
       src_ = OperatorBase::Input<TensorCPU>(SRC_IN).template data<int>()[0];
       tag_ = OperatorBase::Input<TensorCPU>(TAG_IN).template data<int>()[0];
     }
     MPI_Status status;
-    if (raw_buffer_) {
-      auto* output = Output(OUTPUT);
+    auto* output = Output(OUTPUT);
+    int src = src_;
+    int tag = tag_;
+    bool shm = false;
+    if (raw_buffer_ && std::is_same<Context, CPUContext>::value &&
+        UseMPIShmTransport(output->nbytes())) {
+      // Whether the sender is on this host is only known once its message
+      // has arrived when src is MPI_ANY_SOURCE.
+      MPI_CHECK(MPI_Probe(src_, tag_, comm, &status));
+      src = status.MPI_SOURCE;
+      tag = status.MPI_TAG;
+      shm = world.OnSameHost(src);
+    }
+    if (shm) {
+      MPIShmMessage message;
+      MPI_CHECK(MPI_Recv(
+          &message, sizeof(message), MPI_CHAR, src, tag, comm, &status));
+      CAFFE_ENFORCE_EQ(message.nbytes, output->nbytes());
+      shm_receiver_.Receive(message, output->raw_mutable_data());
+    } else if (raw_buffer_) {
       MPI_CHECK(MPI_Recv(
           output->raw_mutable_data(),
           output->nbytes(),
           MPI_CHAR,
-          src_,
-          tag_,
+          src,
+          tag,
           comm,
           &status));
     } else {
@@ -233,10 +406,68 @@ class MPIReceiveTensorOp final : public Operator<Context> {
   int src_;
   int tag_;
   bool raw_buffer_;
+  MPIShmReceiver shm_receiver_;
   INPUT_TAGS(COMM, INPUT, SRC_IN, TAG_IN);
   OUTPUT_TAGS(OUTPUT, SRC_OUT, TAG_OUT);
 };
 
+// Measures the bandwidth of the links of the ring in rank order: every rank
+// sends nbytes to the next one while receiving from the previous one,
+// iterations times, and the bandwidths are gathered on all the ranks.
+template <class Context>
+class MPIRingBandwidthOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  MPIRingBandwidthOp(const OperatorDef& def, Workspace* ws)
+      : Operator<Context>(def, ws),
+        OP_SINGLE_ARG(int, "nbytes", nbytes_, 1 << 22),
+        OP_SINGLE_ARG(int, "iterations", iterations_, 10) {
+    CAFFE_ENFORCE_GT(nbytes_, 0);
+    CAFFE_ENFORCE_GT(iterations_, 0);
+  }
+
+  bool RunOnDevice() override {
+    MPI_Comm comm = OperatorBase::Input<MPICommonWorldWrapper>(0).comm();
+    const int size = MPICommSize(comm);
+    const int rank = MPICommRank(comm);
+    const int next = (rank + 1) % size;
+    const int prev = (rank + size - 1) % size;
+    std::vector<char> send(nbytes_, 1);
+    std::vector<char> recv(nbytes_);
+    auto sendrecv = [&] {
+      MPI_CHECK(MPI_Sendrecv(
+          send.data(), nbytes_, MPI_CHAR, next, 0,
+          recv.data(), nbytes_, MPI_CHAR, prev, 0,
+          comm, MPI_STATUS_IGNORE));
+    };
+    // Warm up, so that connections are set up before timing.
+    sendrecv();
+    MPI_CHECK(MPI_Barrier(comm));
+    Timer timer;
+    for (int i = 0; i < iterations_; ++i) {
+      sendrecv();
+    }
+    // GB/s out of this rank, to the next one.
+    float bandwidth =
+        static_cast<double>(nbytes_) * iterations_ / timer.Seconds() / 1e9;
+    auto* output = OperatorBase::Output<TensorCPU>(0);
+    output->Resize(size);
+    MPI_CHECK(MPI_Allgather(
+        &bandwidth,
+        1,
+        MPI_FLOAT,
+        output->template mutable_data<float>(),
+        1,
+        MPI_FLOAT,
+        comm));
+    return true;
+  }
+
+ protected:
+  int nbytes_;
+  int iterations_;
+};
+
 }  // namespace caffe2
 
 #endif  // CAFFE2_MPI_MPI_OPS_H_
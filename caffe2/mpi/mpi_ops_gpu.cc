@@ -2,6 +2,17 @@
 #include "caffe2/core/context_gpu.h"
 #include "caffe2/operators/operator_fallback_gpu.h"
 
+CAFFE2_DEFINE_bool(
+    caffe2_mpi_cuda_aware,
+    true,
+    "If false, Allreduce and Broadcast stage CUDA tensors through host memory "
+    "even when MPI takes device pointers, as with GPUDirect RDMA.");
+CAFFE2_DEFINE_int64(
+    caffe2_mpi_staging_chunk_bytes,
+    4 << 20,
+    "The size of the chunks that CUDA tensors are staged through host memory "
+    "in, when MPI does not take device pointers. It must be the same on all "
+    "the ranks.");
 
 namespace caffe2 {
 
@@ -52,12 +63,223 @@ namespace caffe2 {
 
 namespace {
 
+// Whether the MPI library takes device pointers. OpenMPI 2.x can tell at run
+// time whether the library that is loaded was built with CUDA, which is not
+// always the one that caffe2 was built against.
+bool CudaAwareMPI() {
+  if (!FLAGS_caffe2_mpi_cuda_aware) {
+    return false;
+  }
+#if CAFFE2_HAS_CUDA_MPI_ALLREDUCE
+#if defined(MPIX_CUDA_AWARE_SUPPORT) && MPIX_CUDA_AWARE_SUPPORT
+  return MPIX_Query_cuda_support() == 1;
+#else
+  return true;
+#endif
+#else
+  return false;
+#endif
+}
+
+// The base of the collectives that run on CUDA tensors. If MPI takes device
+// pointers, they are given to it directly, and with GPUDirect RDMA the network
+// card reads and writes the memory of the GPU. Otherwise the tensor goes
+// through pinned host memory in chunks: all the chunks are queued to be copied
+// to the host, and each one is handed to MPI as soon as its copy is done, and
+// queued to be copied back as soon as MPI is done with it, so that the copies
+// overlap with the communication instead of doubling its latency.
+class MPIGPUCollectiveOp : public Operator<CUDAContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CUDAContext);
+  MPIGPUCollectiveOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CUDAContext>(operator_def, ws) {}
+  ~MPIGPUCollectiveOp() {
+    for (auto event : events_) {
+      cudaEventDestroy(event);
+    }
+  }
+
+ protected:
+  bool CudaAware() {
+    return OperatorBase::Input<MPICommonWorldWrapper>(0).cuda_aware();
+  }
+
+  // Runs op(data, count) on the host copy of each chunk of src, of
+  // caffe2_mpi_staging_chunk_bytes, in order, and copies the results to dst,
+  // which may be src. The copies to the host are skipped if !to_host, and the
+  // ones back if !to_device.
+  template <typename T, typename Op>
+  void RunStaged(
+      const T* src,
+      T* dst,
+      TIndex size,
+      bool to_host,
+      bool to_device,
+      Op op) {
+    const TIndex chunk_size = std::max<TIndex>(
+        1, FLAGS_caffe2_mpi_staging_chunk_bytes / sizeof(T));
+    const TIndex num_chunks = (size + chunk_size - 1) / chunk_size;
+    staging_.Resize(size);
+    T* host = static_cast<T*>(
+        PinnedRawMutableData(&staging_, TypeMeta::Make<T>()));
+    while (events_.size() < num_chunks) {
+      cudaEvent_t event;
+      CUDA_CHECK(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+      events_.push_back(event);
+    }
+    auto stream = context_.cuda_stream();
+    if (to_host) {
+      for (TIndex i = 0; i < num_chunks; ++i) {
+        const TIndex offset = i * chunk_size;
+        const TIndex count = std::min(chunk_size, size - offset);
+        CUDA_CHECK(cudaMemcpyAsync(
+            host + offset,
+            src + offset,
+            count * sizeof(T),
+            cudaMemcpyDeviceToHost,
+            stream));
+        CUDA_CHECK(cudaEventRecord(events_[i], stream));
+      }
+    }
+    for (TIndex i = 0; i < num_chunks; ++i) {
+      const TIndex offset = i * chunk_size;
+      const TIndex count = std::min(chunk_size, size - offset);
+      if (to_host) {
+        CUDA_CHECK(cudaEventSynchronize(events_[i]));
+      }
+      op(host + offset, count);
+      if (to_device) {
+        CUDA_CHECK(cudaMemcpyAsync(
+            dst + offset,
+            host + offset,
+            count * sizeof(T),
+            cudaMemcpyHostToDevice,
+            stream));
+      }
+    }
+  }
+
+ private:
+  TensorCPU staging_;
+  // One event per chunk, marking the end of its copy to the host.
+  std::vector<cudaEvent_t> events_;
+};
+
+// MPIAllreduceGPUOp sums a CUDA tensor over the ranks, like MPIAllreduceOp.
+template <typename T>
+class MPIAllreduceGPUOp final : public MPIGPUCollectiveOp {
+ public:
+  MPIAllreduceGPUOp(const OperatorDef& operator_def, Workspace* ws)
+      : MPIGPUCollectiveOp(operator_def, ws) {
+    CAFFE_ENFORCE_EQ(
+        OperatorBase::GetSingleArgument<string>("compression", "none"),
+        "none",
+        "Compression is only supported for float tensors on the CPU.");
+  }
+
+  bool RunOnDevice() override {
+    MPI_Comm comm = OperatorBase::Input<MPICommonWorldWrapper>(0).comm();
+    auto& input = Input(1);
+    auto* output = Output(0);
+    output->ResizeLike(input);
+    const T* src = input.template data<T>();
+    T* dst = output->template mutable_data<T>();
+    if (!CudaAware()) {
+      RunStaged(
+          src,
+          dst,
+          input.size(),
+          true,
+          true,
+          [comm](T* data, int count) {
+            MPI_CHECK(MPI_Allreduce(
+                MPI_IN_PLACE,
+                data,
+                count,
+                MPIDataTypeWrapper<T>::type(),
+                MPI_SUM,
+                comm));
+          });
+      return true;
+    }
+    // MPI does not wait for the stream that the input was computed on.
+    context_.FinishDeviceComputation();
+    MPI_CHECK(MPI_Allreduce(
+        dst == src ? MPI_IN_PLACE : const_cast<T*>(src),
+        dst,
+        input.size(),
+        MPIDataTypeWrapper<T>::type(),
+        MPI_SUM,
+        comm));
+    return true;
+  }
+};
+
+// MPIBroadcastGPUOp broadcasts a CUDA tensor in place, like MPIBroadcastOp.
+// Staged, only the root copies it to the host, and only the others back.
+class MPIBroadcastGPUOp final : public MPIGPUCollectiveOp {
+ public:
+  MPIBroadcastGPUOp(const OperatorDef& operator_def, Workspace* ws)
+      : MPIGPUCollectiveOp(operator_def, ws),
+        root_(OperatorBase::GetSingleArgument<int>("root", 0)) {}
+
+  bool RunOnDevice() override {
+    const auto& world = OperatorBase::Input<MPICommonWorldWrapper>(0);
+    MPI_Comm comm = world.comm();
+    auto* output = Output(0);
+    CAFFE_ENFORCE(
+        output->size() > 0,
+        "Broadcast op uses in-place operation so the output "
+        "should be already allocated.");
+    auto* data = static_cast<char*>(output->raw_mutable_data());
+    if (!CudaAware()) {
+      const bool is_root = world.rank() == root_;
+      const int root = root_;
+      RunStaged<char>(
+          data,
+          data,
+          output->nbytes(),
+          is_root,
+          !is_root,
+          [comm, root](char* chunk, int count) {
+            MPI_CHECK(MPI_Bcast(
+                chunk, count, MPIDataTypeWrapper<char>::type(), root, comm));
+          });
+      return true;
+    }
+    context_.FinishDeviceComputation();
+    MPI_CHECK(MPI_Bcast(
+        data,
+        output->nbytes(),
+        MPIDataTypeWrapper<char>::type(),
+        root_,
+        comm));
+    return true;
+  }
+
+ private:
+  int root_;
+};
+
+} // namespace
+
+template <>
+void MPICreateCommonWorldOp<CUDAContext>::DetectTransport(
+    MPICommonWorldWrapper* world) {
+  world->SetCudaAware(CudaAwareMPI());
+  VLOG(1) << "MPI common world of size " << world->size() << " is "
+          << (world->cuda_aware() ? "" : "not ") << "CUDA-aware";
+}
+
+namespace {
+
 REGISTER_CUDA_OPERATOR_WITH_ENGINE(
     CreateCommonWorld,
     MPI,
     MPICreateCommonWorldOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR_WITH_ENGINE(Broadcast, MPI, MPIBroadcastGPUOp);
+REGISTER_CUDA_OPERATOR_WITH_ENGINE(Allreduce, MPI, MPIAllreduceGPUOp<float>);
 #if CAFFE2_HAS_CUDA_MPI_BASICS
-REGISTER_CUDA_OPERATOR_WITH_ENGINE(Broadcast, MPI, MPIBroadcastOp<CUDAContext>);
 REGISTER_CUDA_OPERATOR_WITH_ENGINE(
     Reduce,
     MPI,
@@ -75,10 +297,6 @@ REGISTER_CUDA_OPERATOR_WITH_ENGINE(
     MPI,
     MPIReceiveTensorOp<CUDAContext>);
 #else
-REGISTER_CUDA_OPERATOR_WITH_ENGINE(
-    Broadcast,
-    MPI,
-    GPUFallbackOp<MPIBroadcastOp<CPUContext>>);
 REGISTER_CUDA_OPERATOR_WITH_ENGINE(
     Reduce,
     MPI,
@@ -98,15 +316,16 @@ REGISTER_CUDA_OPERATOR_WITH_ENGINE(
 #endif
 
 #if CAFFE2_HAS_CUDA_MPI_ALLREDUCE
+// A fallback would copy the output back before the reduction completes, so
+// there is no asynchronous allreduce on GPU without CUDA-aware MPI.
 REGISTER_CUDA_OPERATOR_WITH_ENGINE(
-    Allreduce,
+    AllreduceAsync,
     MPI,
-    MPIAllreduceOp<float, CUDAContext>);
-#else
+    MPIAllreduceAsyncOp<float, CUDAContext>);
 REGISTER_CUDA_OPERATOR_WITH_ENGINE(
-    Allreduce,
+    WaitCollective,
     MPI,
-    GPUFallbackOp<MPIAllreduceOp<float, CPUContext>>);
+    MPIWaitCollectiveOp<CUDAContext>);
 #endif
 }  // namespace
 
@@ -0,0 +1,161 @@
+#include "caffe2/mpi/mpi_shm_transport.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "caffe2/mpi/mpi_common.h"
+
+CAFFE2_DEFINE_bool(
+    caffe2_mpi_shm_transport,
+    true,
+    "If set, SendTensor and ReceiveTensor move large raw buffers between "
+    "ranks of the same host through shared memory. It must be the same on "
+    "all the ranks.");
+
+namespace caffe2 {
+
+namespace {
+
+// Buffers up to this size are sent inline: the MPI latency dominates.
+constexpr size_t kMinShmBytes = 64 << 10;
+constexpr size_t kAlignment = 64;
+
+// The segment starts with the state of every slot, each on its own cache
+// line, followed by the slots.
+struct alignas(kAlignment) SlotState {
+  std::atomic<int> full;
+};
+
+size_t SegmentSize(size_t capacity) {
+  return kMPIShmSlots * (sizeof(SlotState) + capacity);
+}
+
+SlotState* Slot(char* segment, int64_t slot) {
+  return reinterpret_cast<SlotState*>(segment) + slot;
+}
+
+char* SlotData(char* segment, size_t capacity, int64_t slot) {
+  return segment + kMPIShmSlots * sizeof(SlotState) + slot * capacity;
+}
+
+string SenderName(int64_t pid, int64_t id) {
+  return "/caffe2_mpi_" + caffe2::to_string(pid) + "_" + caffe2::to_string(id);
+}
+
+string SegmentName(int64_t pid, int64_t id, int64_t generation) {
+  return SenderName(pid, id) + "_" + caffe2::to_string(generation);
+}
+
+char* MapSegment(const string& name, size_t size, bool create) {
+  const int fd =
+      shm_open(name.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+  CAFFE_ENFORCE_GE(fd, 0, "shm_open ", name, ": ", strerror(errno));
+  if (create) {
+    CAFFE_ENFORCE_EQ(
+        ftruncate(fd, size), 0, "ftruncate ", name, ": ", strerror(errno));
+  }
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  CAFFE_ENFORCE(ptr != MAP_FAILED, "mmap ", name, ": ", strerror(errno));
+  return static_cast<char*>(ptr);
+}
+
+int64_t NextSenderId() {
+  static std::atomic<int64_t> next_id(0);
+  return next_id++;
+}
+
+} // namespace
+
+bool UseMPIShmTransport(size_t nbytes) {
+  return FLAGS_caffe2_mpi_shm_transport && nbytes >= kMinShmBytes;
+}
+
+MPIShmSender::MPIShmSender() : id_(NextSenderId()) {}
+
+MPIShmSender::~MPIShmSender() {
+  Unmap();
+}
+
+void MPIShmSender::Unmap() {
+  if (segment_) {
+    munmap(segment_, SegmentSize(capacity_));
+    shm_unlink(SegmentName(getpid(), id_, generation_).c_str());
+    segment_ = nullptr;
+  }
+}
+
+void MPIShmSender::Map(size_t capacity) {
+  // The receiver has mapped the old segment, if it received anything from
+  // it, as all its slots are free: it can be unlinked.
+  for (int64_t slot = 0; segment_ && slot < kMPIShmSlots; ++slot) {
+    while (Slot(segment_, slot)->full.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+  Unmap();
+  capacity_ = (capacity + kAlignment - 1) / kAlignment * kAlignment;
+  ++generation_;
+  segment_ = MapSegment(
+      SegmentName(getpid(), id_, generation_), SegmentSize(capacity_), true);
+  // A new segment is zero filled, so all the slots are free.
+}
+
+void MPIShmSender::Send(
+    const void* data,
+    size_t nbytes,
+    int dst,
+    int tag,
+    MPI_Comm comm) {
+  if (nbytes > capacity_) {
+    Map(std::max(nbytes, 2 * capacity_));
+  }
+  const int64_t slot = next_slot_;
+  next_slot_ = (next_slot_ + 1) % kMPIShmSlots;
+  auto& full = Slot(segment_, slot)->full;
+  while (full.load(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+  memcpy(SlotData(segment_, capacity_, slot), data, nbytes);
+  full.store(1, std::memory_order_release);
+  MPIShmMessage message{
+      getpid(), id_, generation_, static_cast<int64_t>(capacity_), slot,
+      static_cast<int64_t>(nbytes)};
+  MPI_CHECK(
+      MPI_Send(&message, sizeof(message), MPI_CHAR, dst, tag, comm));
+}
+
+MPIShmReceiver::~MPIShmReceiver() {
+  for (auto& it : mappings_) {
+    munmap(it.second.segment, it.second.size);
+  }
+}
+
+void MPIShmReceiver::Receive(const MPIShmMessage& message, void* data) {
+  auto& mapping = mappings_[SenderName(message.pid, message.id)];
+  if (!mapping.segment || mapping.generation != message.generation) {
+    if (mapping.segment) {
+      munmap(mapping.segment, mapping.size);
+    }
+    mapping.generation = message.generation;
+    mapping.size = SegmentSize(message.capacity);
+    mapping.segment = MapSegment(
+        SegmentName(message.pid, message.id, message.generation),
+        mapping.size,
+        false);
+  }
+  auto& full = Slot(mapping.segment, message.slot)->full;
+  CAFFE_ENFORCE(full.load(std::memory_order_acquire));
+  memcpy(
+      data,
+      SlotData(mapping.segment, message.capacity, message.slot),
+      message.nbytes);
+  full.store(0, std::memory_order_release);
+}
+
+} // namespace caffe2
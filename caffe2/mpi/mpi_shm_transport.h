@@ -0,0 +1,95 @@
+#ifndef CAFFE2_MPI_MPI_SHM_TRANSPORT_H_
+#define CAFFE2_MPI_MPI_SHM_TRANSPORT_H_
+
+#include <mpi.h>
+#include <unordered_map>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/flags.h"
+
+CAFFE2_DECLARE_bool(caffe2_mpi_shm_transport);
+
+namespace caffe2 {
+
+/**
+ * @brief Moves raw tensor buffers between ranks of the same host through
+ * shared memory, for SendTensor and ReceiveTensor.
+ *
+ * Each sender owns a POSIX shared memory segment with a ring of slots. It
+ * copies a buffer into a free slot and sends only a small MPIShmMessage over
+ * MPI, on the tag of the tensor; the receiver maps the segment named by the
+ * message, copies the buffer out of the slot and marks it free. This replaces
+ * the copies through MPI's own buffers with one copy on each side and lets up
+ * to kMPIShmSlots buffers be in flight.
+ *
+ * Both sides have to agree on whether a buffer goes through shared memory,
+ * which is why it only depends on the flag, which must be the same on all
+ * ranks, on the ranks being on the same host and on the size of the buffer.
+ */
+constexpr int kMPIShmSlots = 4;
+
+/**
+ * @brief Returns whether a buffer of nbytes between two ranks on the same
+ * host goes through shared memory. Small buffers are faster inline.
+ */
+bool UseMPIShmTransport(size_t nbytes);
+
+/**
+ * @brief What the sender sends over MPI in place of a buffer.
+ */
+struct MPIShmMessage {
+  int64_t pid;
+  int64_t id;
+  int64_t generation;
+  int64_t capacity;
+  int64_t slot;
+  int64_t nbytes;
+};
+
+class MPIShmSender {
+ public:
+  MPIShmSender();
+  ~MPIShmSender();
+
+  /**
+   * @brief Copies the buffer into a free slot, waiting for one if needed,
+   * and sends its MPIShmMessage to dst.
+   */
+  void Send(const void* data, size_t nbytes, int dst, int tag, MPI_Comm comm);
+
+ private:
+  void Map(size_t capacity);
+  void Unmap();
+
+  const int64_t id_;
+  int64_t generation_ = -1;
+  size_t capacity_ = 0;
+  char* segment_ = nullptr;
+  int64_t next_slot_ = 0;
+
+  DISABLE_COPY_AND_ASSIGN(MPIShmSender);
+};
+
+class MPIShmReceiver {
+ public:
+  ~MPIShmReceiver();
+
+  /**
+   * @brief Copies the buffer described by a message received from a sender
+   * into data, which must have message.nbytes bytes, and frees its slot.
+   */
+  void Receive(const MPIShmMessage& message, void* data);
+
+ private:
+  struct Mapping {
+    int64_t generation;
+    size_t size;
+    char* segment;
+  };
+  // The segments mapped so far, by sender.
+  std::unordered_map<string, Mapping> mappings_;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_MPI_MPI_SHM_TRANSPORT_H_
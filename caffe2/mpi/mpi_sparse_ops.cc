@@ -0,0 +1,299 @@
+#include <cmath>
+#include <unordered_map>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/mpi/mpi_common.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Sends the ids each rank asks for to the ranks that own them, with
+// MPI_Alltoallv. Row id of a table is on rank id % size, at row id / size of
+// its shard, which is how Partition with pack_first_input splits ids.
+class SparseExchange {
+ public:
+  explicit SparseExchange(MPI_Comm comm) : comm_(comm) {
+    MPI_CHECK(MPI_Comm_size(comm, &size_));
+  }
+
+  int size() const {
+    return size_;
+  }
+
+  // Sends ids, which must be distinct, to their owners. Afterwards order()[j]
+  // is the position in ids of the j-th sent id, and received_ids() are the
+  // ids that the other ranks asked this one for, grouped by rank.
+  template <typename Index>
+  void SendIds(const vector<Index>& ids) {
+    send_counts_.assign(size_, 0);
+    for (const Index id : ids) {
+      CAFFE_ENFORCE_GE(id, 0);
+      ++send_counts_[id % size_];
+    }
+    Offsets(send_counts_, &send_offsets_);
+    order_.resize(ids.size());
+    vector<int> next = send_offsets_;
+    vector<int64_t> sent(ids.size());
+    for (int i = 0; i < ids.size(); ++i) {
+      const int j = next[ids[i] % size_]++;
+      order_[j] = i;
+      sent[j] = ids[i];
+    }
+    recv_counts_.resize(size_);
+    MPI_CHECK(MPI_Alltoall(
+        send_counts_.data(), 1, MPI_INT, recv_counts_.data(), 1, MPI_INT,
+        comm_));
+    Offsets(recv_counts_, &recv_offsets_);
+    received_ids_.resize(recv_offsets_.back() + recv_counts_.back());
+    MPI_CHECK(MPI_Alltoallv(
+        sent.data(),
+        send_counts_.data(),
+        send_offsets_.data(),
+        MPI_INT64_T,
+        received_ids_.data(),
+        recv_counts_.data(),
+        recv_offsets_.data(),
+        MPI_INT64_T,
+        comm_));
+  }
+
+  const vector<int>& order() const {
+    return order_;
+  }
+
+  const vector<int64_t>& received_ids() const {
+    return received_ids_;
+  }
+
+  // Sends block floats per id along with the ids of the last SendIds.
+  void SendRows(const float* rows, int block, float* received) {
+    Exchange(send_counts_, send_offsets_, recv_counts_, recv_offsets_, rows,
+             block, received);
+  }
+
+  // Replies to the last SendIds with block floats per received id.
+  void ReplyRows(const float* rows, int block, float* replies) {
+    Exchange(recv_counts_, recv_offsets_, send_counts_, send_offsets_, rows,
+             block, replies);
+  }
+
+ private:
+  static void Offsets(const vector<int>& counts, vector<int>* offsets) {
+    offsets->resize(counts.size());
+    int offset = 0;
+    for (int r = 0; r < counts.size(); ++r) {
+      (*offsets)[r] = offset;
+      offset += counts[r];
+    }
+  }
+
+  void Exchange(
+      const vector<int>& send_counts,
+      const vector<int>& send_offsets,
+      const vector<int>& recv_counts,
+      const vector<int>& recv_offsets,
+      const float* send,
+      int block,
+      float* recv) {
+    vector<int> sc(size_), so(size_), rc(size_), ro(size_);
+    for (int r = 0; r < size_; ++r) {
+      sc[r] = send_counts[r] * block;
+      so[r] = send_offsets[r] * block;
+      rc[r] = recv_counts[r] * block;
+      ro[r] = recv_offsets[r] * block;
+    }
+    MPI_CHECK(MPI_Alltoallv(
+        send, sc.data(), so.data(), MPI_FLOAT, recv, rc.data(), ro.data(),
+        MPI_FLOAT, comm_));
+  }
+
+  MPI_Comm comm_;
+  int size_;
+  vector<int> send_counts_;
+  vector<int> send_offsets_;
+  vector<int> recv_counts_;
+  vector<int> recv_offsets_;
+  vector<int> order_;
+  vector<int64_t> received_ids_;
+};
+
+// Collects the distinct values of ids in unique, in order of first
+// occurrence, and sets position[i] to the position of ids[i] in unique.
+template <typename Index>
+void Deduplicate(
+    const Index* ids,
+    int n,
+    vector<Index>* unique,
+    vector<int>* position) {
+  std::unordered_map<Index, int> seen;
+  unique->clear();
+  position->resize(n);
+  for (int i = 0; i < n; ++i) {
+    auto it = seen.emplace(ids[i], unique->size()).first;
+    if (it->second == unique->size()) {
+      unique->push_back(ids[i]);
+    }
+    (*position)[i] = it->second;
+  }
+}
+
+// Returns the local row of id in a shard of rows rows, checking that it is
+// owned by this rank.
+TIndex LocalRow(int64_t id, int size, TIndex rows) {
+  const TIndex row = id / size;
+  CAFFE_ENFORCE(
+      row < rows, "Id ", id, " is out of the shard of ", rows, " rows");
+  return row;
+}
+
+class MPISparsePullOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  MPISparsePullOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename Index>
+  bool DoRunWithType() {
+    const auto& table = Input(TABLE);
+    const auto& indices = Input(INDICES);
+    auto* output = Output(0);
+    CAFFE_ENFORCE_GE(table.ndim(), 1);
+    const int block = table.size_from_dim(1);
+    auto shape = indices.dims();
+    shape.insert(shape.end(), table.dims().begin() + 1, table.dims().end());
+    output->Resize(shape);
+    float* out = output->mutable_data<float>();
+
+    SparseExchange exchange(
+        OperatorBase::Input<MPICommonWorldWrapper>(COMM).comm());
+    vector<Index> unique;
+    vector<int> position;
+    Deduplicate(indices.data<Index>(), indices.size(), &unique, &position);
+    exchange.SendIds(unique);
+
+    // Serve the rows the other ranks asked for.
+    const auto& asked = exchange.received_ids();
+    vector<float> served(asked.size() * block);
+    const float* rows = table.data<float>();
+    for (int j = 0; j < asked.size(); ++j) {
+      const TIndex row = LocalRow(asked[j], exchange.size(), table.dim(0));
+      std::copy(
+          rows + row * block,
+          rows + (row + 1) * block,
+          served.data() + j * block);
+    }
+    vector<float> pulled(unique.size() * block);
+    exchange.ReplyRows(served.data(), block, pulled.data());
+
+    // pulled has the rows of unique in the order they were sent.
+    vector<int> slot(unique.size());
+    for (int j = 0; j < unique.size(); ++j) {
+      slot[exchange.order()[j]] = j;
+    }
+    for (int i = 0; i < indices.size(); ++i) {
+      const float* row = pulled.data() + slot[position[i]] * block;
+      std::copy(row, row + block, out + i * block);
+    }
+    return true;
+  }
+
+ private:
+  INPUT_TAGS(COMM, TABLE, INDICES);
+};
+
+class MPISparsePushOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  MPISparsePushOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename Index>
+  bool DoRunWithType() {
+    auto& param = Input(PARAM);
+    auto& moment = Input(MOMENT);
+    const auto& indices = Input(INDICES);
+    const auto& grad = Input(GRAD);
+    CAFFE_ENFORCE_EQ(&param, Output(OUTPUT_PARAM));
+    CAFFE_ENFORCE_EQ(&moment, Output(OUTPUT_MOMENT_1));
+    CAFFE_ENFORCE_EQ(param.size(), moment.size());
+    CAFFE_ENFORCE_GE(param.ndim(), 1);
+    CAFFE_ENFORCE_EQ(Input(LR).size(), 1);
+    const int block = param.size_from_dim(1);
+    CAFFE_ENFORCE_EQ(grad.size(), indices.size() * block);
+    const float lr = Input(LR).data<float>()[0];
+
+    // Sum the gradients of duplicate indices, so that every row is sent once.
+    vector<Index> unique;
+    vector<int> position;
+    Deduplicate(indices.data<Index>(), indices.size(), &unique, &position);
+    SparseExchange exchange(
+        OperatorBase::Input<MPICommonWorldWrapper>(COMM).comm());
+    exchange.SendIds(unique);
+    vector<int> slot(unique.size());
+    for (int j = 0; j < unique.size(); ++j) {
+      slot[exchange.order()[j]] = j;
+    }
+    vector<float> sent(unique.size() * block, 0.f);
+    const float* g = grad.data<float>();
+    for (int i = 0; i < indices.size(); ++i) {
+      float* row = sent.data() + slot[position[i]] * block;
+      for (int k = 0; k < block; ++k) {
+        row[k] += g[i * block + k];
+      }
+    }
+    const auto& ids = exchange.received_ids();
+    vector<float> received(ids.size() * block);
+    exchange.SendRows(sent.data(), block, received.data());
+
+    // Several ranks can push the same row: their gradients are summed and
+    // applied once.
+    std::unordered_map<TIndex, int> first;
+    vector<TIndex> rows;
+    for (int j = 0; j < ids.size(); ++j) {
+      const TIndex row = LocalRow(ids[j], exchange.size(), param.dim(0));
+      auto it = first.emplace(row, j).first;
+      if (it->second == j) {
+        rows.push_back(row);
+      } else {
+        float* sum = received.data() + it->second * block;
+        for (int k = 0; k < block; ++k) {
+          sum[k] += received[j * block + k];
+        }
+      }
+    }
+    float* w = Output(OUTPUT_PARAM)->mutable_data<float>();
+    float* h = Output(OUTPUT_MOMENT_1)->mutable_data<float>();
+    for (const TIndex row : rows) {
+      const float* gi = received.data() + first[row] * block;
+      for (int k = 0; k < block; ++k) {
+        float& hk = h[row * block + k];
+        hk += gi[k] * gi[k];
+        w[row * block + k] += lr * gi[k] / (std::sqrt(hk) + epsilon_);
+      }
+    }
+    return true;
+  }
+
+ private:
+  float epsilon_;
+  INPUT_TAGS(COMM, PARAM, MOMENT, INDICES, GRAD, LR);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
+};
+
+REGISTER_CPU_OPERATOR_WITH_ENGINE(SparsePull, MPI, MPISparsePullOp);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(SparsePush, MPI, MPISparsePushOp);
+
+} // namespace
+} // namespace caffe2
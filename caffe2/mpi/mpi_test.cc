@@ -2,6 +2,8 @@
 #include "caffe2/core/net.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/mpi/mpi_common.h"
+#include "caffe2/mpi/mpi_compression.h"
+#include "caffe2/mpi/mpi_shm_transport.h"
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
 
@@ -310,6 +312,324 @@ TEST(MPITest, TestInPlaceMPIAllreduce) {
   }
 }
 
+TEST(MPITest, TestFp16MPIAllreduce) {
+  NetDef net_def;
+  CHECK(google::protobuf::TextFormat::ParseFromString(
+      string(kMPIAllreduceNet), &net_def));
+  auto* arg = net_def.mutable_op(1)->mutable_arg(1);
+  CAFFE_ENFORCE_EQ(arg->name(), "value");
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  arg->set_f(rank);
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  auto* compression = net_def.mutable_op(2)->add_arg();
+  compression->set_name("compression");
+  compression->set_s("fp16");
+
+  Workspace ws;
+  unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+  EXPECT_NE(nullptr, net.get());
+  EXPECT_TRUE(net->Run());
+  // Small integers are exact in half precision.
+  auto& X_reduced = ws.GetBlob("X_reduced")->Get<TensorCPU>();
+  EXPECT_EQ(X_reduced.size(), 10);
+  int expected_result = size * (size - 1) / 2;
+  for (int i = 0; i < X_reduced.size(); ++i) {
+    EXPECT_EQ(X_reduced.data<float>()[i], expected_result);
+  }
+}
+
+// With error feedback, what has been received after any number of reductions
+// plus what is left in the residuals of all the ranks is the exact sum.
+TEST(MPITest, TestCompressedAllreduceErrorFeedback) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  const int n = 37;
+  const int iters = 20;
+  vector<float> x(n);
+  for (int i = 0; i < n; ++i) {
+    x[i] = (i % 5 - 2) * 0.25f + 0.1f * rank;
+  }
+  for (const auto mode : {MPICompression::TOP_K, MPICompression::ONE_BIT}) {
+    vector<float> residual(n, 0.f);
+    vector<float> y(n);
+    vector<float> received(n, 0.f);
+    for (int iter = 0; iter < iters; ++iter) {
+      size_t bytes;
+      if (mode == MPICompression::TOP_K) {
+        bytes = TopKAllreduce(x.data(), y.data(), n, 4, residual.data(),
+                              MPI_COMM_WORLD);
+      } else {
+        bytes = OneBitAllreduce(x.data(), y.data(), n, residual.data(),
+                                MPI_COMM_WORLD);
+      }
+      EXPECT_LT(bytes, n * sizeof(float));
+      for (int i = 0; i < n; ++i) {
+        received[i] += y[i];
+      }
+    }
+    MPI_Allreduce(
+        MPI_IN_PLACE, residual.data(), n, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+    for (int i = 0; i < n; ++i) {
+      const float expected =
+          iters * (size * ((i % 5 - 2) * 0.25f) + 0.1f * size * (size - 1) / 2);
+      EXPECT_NEAR(received[i] + residual[i], expected, 1e-3);
+    }
+  }
+}
+
+const char kMPIAllreduceAsyncNet[] = R"NET(
+  name: "allreduce_async"
+  op {
+    output: "comm"
+    type: "CreateCommonWorld"
+    engine: "MPI"
+  }
+  op {
+    output: "X"
+    type: "ConstantFill"
+    arg {
+      name: "shape"
+      ints: 10
+    }
+    arg {
+      name: "value"
+      f: 0.0
+    }
+  }
+  op {
+    input: "comm"
+    input: "X"
+    output: "X"
+    output: "handle"
+    type: "AllreduceAsync"
+    engine: "MPI"
+  }
+  op {
+    input: "handle"
+    input: "X"
+    output: "X"
+    output: "handle"
+    type: "WaitCollective"
+    engine: "MPI"
+  }
+)NET";
+
+TEST(MPITest, TestMPIAllreduceAsync) {
+  NetDef net_def;
+  CHECK(google::protobuf::TextFormat::ParseFromString(
+      string(kMPIAllreduceAsyncNet), &net_def));
+  // Let's set the network's constant fill value to be the mpi rank.
+  auto* arg = net_def.mutable_op(1)->mutable_arg(1);
+  CAFFE_ENFORCE_EQ(arg->name(), "value");
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  arg->set_f(rank);
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  Workspace ws;
+  unique_ptr<NetBase> net(CreateNet(net_def, &ws));
+  EXPECT_NE(nullptr, net.get());
+  EXPECT_TRUE(net->Run());
+  EXPECT_FALSE(ws.GetBlob("handle")->Get<MPIRequestWrapper>().pending());
+  auto& X_reduced = ws.GetBlob("X")->Get<TensorCPU>();
+  EXPECT_EQ(X_reduced.size(), 10);
+  int expected_result = size * (size - 1) / 2;
+  for (int i = 0; i < X_reduced.size(); ++i) {
+    EXPECT_EQ(X_reduced.data<float>()[i], expected_result);
+  }
+}
+
+// Each node holds the rows id % size == rank of a table whose row id is
+// filled with id, pulls rows with duplicates from all the shards, then pushes
+// a gradient of 1 for them and checks the update on the owners.
+TEST(MPITest, TestSparsePullPush) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  const int shard_rows = 5;
+  const int block = 3;
+  Workspace ws;
+  auto* table = ws.CreateBlob("table")->GetMutable<TensorCPU>();
+  table->Resize(shard_rows, block);
+  for (int r = 0; r < shard_rows; ++r) {
+    for (int k = 0; k < block; ++k) {
+      table->mutable_data<float>()[r * block + k] = r * size + rank;
+    }
+  }
+  auto* moment = ws.CreateBlob("moment")->GetMutable<TensorCPU>();
+  moment->Resize(shard_rows, block);
+  std::fill(
+      moment->mutable_data<float>(),
+      moment->mutable_data<float>() + moment->size(),
+      0.f);
+  // Every node asks for ids 0 and 1, twice, and one id of its own.
+  const vector<int64_t> ids = {0, 1, 0, 1, rank + size};
+  auto* indices = ws.CreateBlob("indices")->GetMutable<TensorCPU>();
+  indices->Resize(ids.size());
+  std::copy(ids.begin(), ids.end(), indices->mutable_data<int64_t>());
+  auto* grad = ws.CreateBlob("grad")->GetMutable<TensorCPU>();
+  grad->Resize(ids.size(), block);
+  std::fill(
+      grad->mutable_data<float>(),
+      grad->mutable_data<float>() + grad->size(),
+      1.f);
+  auto* lr = ws.CreateBlob("lr")->GetMutable<TensorCPU>();
+  lr->Resize(1);
+  lr->mutable_data<float>()[0] = -0.5f;
+
+  OperatorDef def;
+  def.set_type("CreateCommonWorld");
+  def.set_engine("MPI");
+  def.add_output("comm");
+  EXPECT_TRUE(ws.RunOperatorOnce(def));
+
+  def.Clear();
+  def.set_type("SparsePull");
+  def.set_engine("MPI");
+  for (const char* input : {"comm", "table", "indices"}) {
+    def.add_input(input);
+  }
+  def.add_output("rows");
+  EXPECT_TRUE(ws.RunOperatorOnce(def));
+  auto& rows = ws.GetBlob("rows")->Get<TensorCPU>();
+  EXPECT_EQ(rows.dims(), vector<TIndex>({5, block}));
+  for (int i = 0; i < ids.size(); ++i) {
+    for (int k = 0; k < block; ++k) {
+      EXPECT_EQ(rows.data<float>()[i * block + k], ids[i]);
+    }
+  }
+
+  def.Clear();
+  def.set_type("SparsePush");
+  def.set_engine("MPI");
+  for (const char* input : {"comm", "table", "moment", "indices", "grad",
+                            "lr"}) {
+    def.add_input(input);
+  }
+  def.add_output("table");
+  def.add_output("moment");
+  EXPECT_TRUE(ws.RunOperatorOnce(def));
+  // The owners of ids 0 and 1 get a gradient of 2 from every node, and each
+  // node pushes 1 for its own id.
+  for (int r = 0; r < shard_rows; ++r) {
+    const int id = r * size + rank;
+    float g = 0;
+    if (id == 0 || id == 1) {
+      g = 2 * size;
+    }
+    if (id >= size && id < 2 * size) {
+      g += 1;
+    }
+    for (int k = 0; k < block; ++k) {
+      EXPECT_EQ(moment->data<float>()[r * block + k], g * g);
+      const float expected = g ? id - 0.5f * g / (g + 1e-5f) : id;
+      EXPECT_NEAR(table->data<float>()[r * block + k], expected, 1e-5);
+    }
+  }
+}
+
+// Each node sends a tensor larger than the shared-memory threshold to the
+// next one in a ring, more times than there are slots, so that slots are
+// reused while the segment is mapped by the receiver.
+TEST(MPITest, TestSendReceiveTensorOnHost) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  const int n = 100000;
+  Workspace ws;
+  OperatorDef def;
+  def.set_type("CreateCommonWorld");
+  def.set_engine("MPI");
+  def.add_output("comm");
+  EXPECT_TRUE(ws.RunOperatorOnce(def));
+  auto* X = ws.CreateBlob("X")->GetMutable<TensorCPU>();
+  X->Resize(n);
+  auto* Y = ws.CreateBlob("Y")->GetMutable<TensorCPU>();
+  Y->Resize(n);
+  Y->mutable_data<float>();
+
+  OperatorDef send_def;
+  send_def.set_type("SendTensor");
+  send_def.set_engine("MPI");
+  send_def.add_input("comm");
+  send_def.add_input("X");
+  AddArgument<int>("dst", (rank + 1) % size, &send_def);
+  AddArgument<int>("tag", 7, &send_def);
+  AddArgument<bool>("raw_buffer", true, &send_def);
+  auto send = CreateOperator(send_def, &ws);
+  OperatorDef receive_def;
+  receive_def.set_type("ReceiveTensor");
+  receive_def.set_engine("MPI");
+  receive_def.add_input("comm");
+  receive_def.add_input("Y");
+  receive_def.add_output("Y");
+  receive_def.add_output("src");
+  receive_def.add_output("tag");
+  AddArgument<bool>("raw_buffer", true, &receive_def);
+  auto receive = CreateOperator(receive_def, &ws);
+  const int from = (rank + size - 1) % size;
+  for (int run = 0; run < 2 * kMPIShmSlots + 1; ++run) {
+    for (int i = 0; i < n; ++i) {
+      X->mutable_data<float>()[i] = run * size + rank + i;
+    }
+    EXPECT_TRUE(send->Run());
+    EXPECT_TRUE(receive->Run());
+    for (int i = 0; i < n; ++i) {
+      EXPECT_EQ(Y->data<float>()[i], run * size + from + i);
+    }
+    EXPECT_EQ(ws.GetBlob("src")->Get<TensorCPU>().data<int>()[0], from);
+    EXPECT_EQ(ws.GetBlob("tag")->Get<TensorCPU>().data<int>()[0], 7);
+  }
+}
+
+// The ranks of a topology aware common world follow topologyOrder over the
+// placements of the global communicator, whatever the placements are.
+TEST(MPITest, TestTopologyAwareCommonWorld) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  Workspace ws;
+  OperatorDef def;
+  def.set_type("CreateCommonWorld");
+  def.set_engine("MPI");
+  def.add_output("comm");
+  AddArgument<bool>("topology_aware", true, &def);
+  // Two racks, with the ranks alternating between them.
+  AddArgument<string>("rack", rank % 2 ? "b" : "a", &def);
+  EXPECT_TRUE(ws.RunOperatorOnce(def));
+  const auto& comm = ws.GetBlob("comm")->Get<MPICommonWorldWrapper>();
+  EXPECT_EQ(comm.size(), size);
+
+  const auto placements = MPIAllgatherPlacements(
+      MPI_COMM_WORLD, localPlacement(rank % 2 ? "b" : "a"));
+  vector<int> old_ranks(size);
+  MPI_Allgather(
+      &rank, 1, MPI_INT, old_ranks.data(), 1, MPI_INT, comm.comm());
+  EXPECT_EQ(old_ranks, topologyOrder(placements));
+  EXPECT_LE(crossRackLinks(placements, old_ranks), 2);
+
+  def.Clear();
+  def.set_type("RingBandwidth");
+  def.set_engine("MPI");
+  def.add_input("comm");
+  def.add_output("bandwidth");
+  AddArgument<int>("nbytes", 1 << 16, &def);
+  EXPECT_TRUE(ws.RunOperatorOnce(def));
+  const auto& bandwidth = ws.GetBlob("bandwidth")->Get<TensorCPU>();
+  EXPECT_EQ(bandwidth.size(), size);
+  for (int i = 0; i < size; ++i) {
+    EXPECT_GT(bandwidth.data<float>()[i], 0);
+  }
+}
+
 }  // namespace caffe2
 
 
@@ -65,23 +65,22 @@ class BatchMatMulOp final : public Operator<Context> {
     }
 
     // Y = A * B
-    auto a_offset = A.size() / A.dim(0);
-    auto b_offset = B.size() / B.dim(0);
-    auto y_offset = a_dim0 * b_dim1;
-    for (int i = 0; i < A.dim32(0); ++i) {
-      math::Gemm<T, Context, Engine>(
-          trans_a_ ? CblasTrans : CblasNoTrans,
-          trans_b_ ? CblasTrans : CblasNoTrans,
-          a_dim0,
-          b_dim1,
-          a_dim1,
-          1,
-          A.template data<T>() + a_offset * i,
-          B.template data<T>() + b_offset * i,
-          0,
-          Y->template mutable_data<T>() + y_offset * i,
-          &context_);
-    }
+    math::GemmBatched<T, Context, Engine>(
+        trans_a_ ? CblasTrans : CblasNoTrans,
+        trans_b_ ? CblasTrans : CblasNoTrans,
+        A.dim32(0),
+        a_dim0,
+        b_dim1,
+        a_dim1,
+        1,
+        A.template data<T>(),
+        A.size() / A.dim(0),
+        B.template data<T>(),
+        B.size() / B.dim(0),
+        0,
+        Y->template mutable_data<T>(),
+        a_dim0 * b_dim1,
+        &context_);
     return true;
   }
 
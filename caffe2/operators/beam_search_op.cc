@@ -0,0 +1,66 @@
+#include "caffe2/operators/beam_search_op.h"
+
+namespace caffe2 {
+namespace {
+
+REGISTER_CPU_OPERATOR(BeamSearch, BeamSearchOp<CPUContext>);
+
+OPERATOR_SCHEMA(BeamSearch)
+    .NumInputs(0, INT_MAX)
+    .NumOutputs(3)
+    .SetDoc(R"DOC(
+Decodes sequences with a beam search, running the decoder step net `step_net`
+once per token in a loop of the operator rather than in RecurrentNetwork or
+Python, with the log-softmax, the top-k and the reordering of the beams fused
+into the operator.
+
+Every beam of every batch item is a row of the step net blobs, so they have
+`batch_size * beam_size` rows. Before each step the operator writes the last
+token of every beam to `token_blob` (int32, starting with `go_token`) and the
+index of the step to `timestep`. The step net must compute the logits of the
+next token in `logits_blob`, of shape `(batch_size * beam_size, V)`, and the
+next value of each state in `state_inputs` in the matching `state_outputs`.
+The operator then keeps the `beam_size` best extensions of the beams of each
+batch item, and moves the next states of their beams to the `state_inputs`,
+by swapping the blobs when no beam moves.
+
+A beam that emits `eos_token` is finished, and the search stops when all of
+the kept beams are finished, or after `max_length` steps. The parameters of
+the step net are looked up in the workspace of the operator.
+)DOC")
+    .Arg("step_net", "The decoder step net, as a NetDef in text format.")
+    .Arg("beam_size", "The number of beams per batch item, 1 by default.")
+    .Arg("max_length", "The maximum number of decoded tokens.")
+    .Arg("eos_token", "The token that ends a sequence.")
+    .Arg("go_token", "The token fed at the first step, eos_token by default.")
+    .Arg("state_inputs", "The blobs of the step net that hold the states.")
+    .Arg("state_outputs", "The blobs of the step net with the next states.")
+    .Arg("token_blob", "The blob of the step net with the tokens, `token`.")
+    .Arg("logits_blob", "The blob of the step net with the logits, `logits`.")
+    .Arg("timestep", "The blob of the step net with the step, `timestep`.")
+    .Arg("batch_size", "The batch size if there are no initial states.")
+    .Input(
+        0,
+        "initial_states",
+        "The initial value of each state in state_inputs, with the batch as "
+        "the first dimension. Each beam starts from a copy of it.")
+    .Output(
+        0,
+        "tokens",
+        "int32 tensor of shape (batch_size, beam_size, length) with the "
+        "decoded sequences, best first, padded with eos_token.")
+    .Output(
+        1,
+        "scores",
+        "The log probabilities of the sequences, of shape "
+        "(batch_size, beam_size).")
+    .Output(
+        2,
+        "lengths",
+        "int32 tensor of shape (batch_size, beam_size) with the number of "
+        "tokens of each sequence before eos_token.");
+
+NO_GRADIENT(BeamSearch);
+
+} // namespace
+} // namespace caffe2
@@ -0,0 +1,327 @@
+#ifndef CAFFE2_OPERATORS_BEAM_SEARCH_OP_H_
+#define CAFFE2_OPERATORS_BEAM_SEARCH_OP_H_
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor.h"
+#include "caffe2/operators/top_k_op.h"
+#include "google/protobuf/text_format.h"
+
+namespace caffe2 {
+
+/**
+ * Decodes with a beam search that runs the decoder step net in a loop, with
+ * the log-softmax, the top-k over all the extensions of the beams of a batch
+ * item and the reordering of the states done in the operator instead of by
+ * separate operators per step.
+ *
+ * The beams of all the batch items are the rows of the step net blobs: the
+ * op feeds the token of every beam in token_blob, the step net computes the
+ * logits of the next token in logits_blob and the next states in the
+ * state_outputs, and the op moves the next states of the surviving beams to
+ * the state_inputs. When no beam changes its position, which is common once
+ * the search has settled, the blobs are swapped instead of copied. A beam
+ * that emits eos_token only extends itself with eos_token and keeps its
+ * score, and the search stops as soon as all of the best beams have ended:
+ * since log probabilities are not positive, no live beam can beat them.
+ */
+template <class Context>
+class BeamSearchOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  BeamSearchOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        stepWs_(ws),
+        beamSize_(OperatorBase::GetSingleArgument<int>("beam_size", 1)),
+        maxLength_(OperatorBase::GetSingleArgument<int>("max_length", -1)),
+        eosToken_(OperatorBase::GetSingleArgument<int>("eos_token", -1)),
+        goToken_(OperatorBase::GetSingleArgument<int>("go_token", eosToken_)),
+        tokenBlob_(
+            OperatorBase::GetSingleArgument<string>("token_blob", "token")),
+        logitsBlob_(
+            OperatorBase::GetSingleArgument<string>("logits_blob", "logits")),
+        timestep_(
+            OperatorBase::GetSingleArgument<string>("timestep", "timestep")),
+        stateInputs_(
+            OperatorBase::GetRepeatedArgument<string>("state_inputs")),
+        stateOutputs_(
+            OperatorBase::GetRepeatedArgument<string>("state_outputs")) {
+    CAFFE_ENFORCE_GT(beamSize_, 0, "beam_size must be positive.");
+    CAFFE_ENFORCE_GT(maxLength_, 0, "max_length must be given and positive.");
+    CAFFE_ENFORCE_GE(eosToken_, 0, "eos_token must be given.");
+    CAFFE_ENFORCE_EQ(
+        stateInputs_.size(),
+        InputSize(),
+        "There must be one state input per initial state.");
+    CAFFE_ENFORCE_EQ(stateInputs_.size(), stateOutputs_.size());
+    for (int i = 0; i < stateInputs_.size(); ++i) {
+      CAFFE_ENFORCE_NE(
+          stateInputs_[i],
+          stateOutputs_[i],
+          "The states cannot be updated in place, since the beams reorder "
+          "them.");
+    }
+    const auto stepNet =
+        OperatorBase::GetSingleArgument<string>("step_net", "");
+    CAFFE_ENFORCE(
+        google::protobuf::TextFormat::ParseFromString(stepNet, &stepNetDef_),
+        "Invalid netdef");
+    CAFFE_ENFORCE(
+        stepNetDef_.type().empty() || stepNetDef_.type() == "simple",
+        "Step Net must be `simple`",
+        stepNet);
+  }
+
+  bool RunOnDevice() override;
+
+ private:
+  // Copies the initial states to the state inputs, beamSize_ times each.
+  void InitializeStates(int batchSize);
+  // Moves the next state of beam parents[i] to row i of the state inputs.
+  void ReorderStates(const std::vector<int>& parents);
+  // Runs the step net once with the tokens, and copies the logits to the
+  // CPU if they are elsewhere.
+  const float* RunStep(int t, const std::vector<int>& tokens, int* vocabSize);
+
+  NetDef stepNetDef_;
+  Workspace stepWs_;
+  std::unique_ptr<NetBase> stepNet_;
+  int beamSize_;
+  int maxLength_;
+  int eosToken_;
+  int goToken_;
+  string tokenBlob_;
+  string logitsBlob_;
+  string timestep_;
+  std::vector<string> stateInputs_;
+  std::vector<string> stateOutputs_;
+  TensorCPU logits_;
+};
+
+template <class Context>
+void BeamSearchOp<Context>::InitializeStates(int batchSize) {
+  for (int i = 0; i < InputSize(); ++i) {
+    const auto& initial = Input(i);
+    CAFFE_ENFORCE_GE(initial.ndim(), 1, stateInputs_[i]);
+    CAFFE_ENFORCE_EQ(initial.dim(0), batchSize, stateInputs_[i]);
+    auto dims = initial.dims();
+    dims[0] = batchSize * beamSize_;
+    auto* state = stepWs_.CreateLocalBlob(stateInputs_[i])
+                      ->template GetMutable<Tensor<Context>>();
+    state->Resize(dims);
+    const TIndex rowSize = initial.size_from_dim(1);
+    const size_t rowBytes = rowSize * initial.meta().itemsize();
+    const char* src = static_cast<const char*>(initial.raw_data());
+    char* dst =
+        static_cast<char*>(state->raw_mutable_data(initial.meta()));
+    for (int row = 0; row < batchSize * beamSize_; ++row) {
+      context_.template CopyItems<Context, Context>(
+          initial.meta(),
+          rowSize,
+          src + row / beamSize_ * rowBytes,
+          dst + row * rowBytes);
+    }
+    stepWs_.CreateLocalBlob(stateOutputs_[i]);
+  }
+}
+
+template <class Context>
+void BeamSearchOp<Context>::ReorderStates(const std::vector<int>& parents) {
+  bool identity = true;
+  for (int i = 0; i < parents.size(); ++i) {
+    identity &= parents[i] == i;
+  }
+  for (int i = 0; i < stateInputs_.size(); ++i) {
+    Blob* input = stepWs_.GetBlob(stateInputs_[i]);
+    Blob* output = stepWs_.GetBlob(stateOutputs_[i]);
+    if (identity) {
+      input->swap(*output);
+      continue;
+    }
+    const auto& next = output->template Get<Tensor<Context>>();
+    CAFFE_ENFORCE_EQ(next.dim(0), parents.size(), stateOutputs_[i]);
+    auto* state = input->template GetMutable<Tensor<Context>>();
+    state->ResizeLike(next);
+    const TIndex rowSize = next.size_from_dim(1);
+    const size_t rowBytes = rowSize * next.meta().itemsize();
+    const char* src = static_cast<const char*>(next.raw_data());
+    char* dst = static_cast<char*>(state->raw_mutable_data(next.meta()));
+    for (int row = 0; row < parents.size(); ++row) {
+      context_.template CopyItems<Context, Context>(
+          next.meta(),
+          rowSize,
+          src + parents[row] * rowBytes,
+          dst + row * rowBytes);
+    }
+  }
+}
+
+template <class Context>
+const float* BeamSearchOp<Context>::RunStep(
+    int t,
+    const std::vector<int>& tokens,
+    int* vocabSize) {
+  auto* token = stepWs_.CreateLocalBlob(tokenBlob_)
+                    ->template GetMutable<Tensor<Context>>();
+  token->Resize(tokens.size());
+  context_.template Copy<int, CPUContext, Context>(
+      tokens.size(), tokens.data(), token->template mutable_data<int>());
+  auto* timestep =
+      stepWs_.CreateLocalBlob(timestep_)->template GetMutable<TensorCPU>();
+  timestep->Resize(1);
+  timestep->template mutable_data<int32_t>()[0] = t;
+  if (!stepNet_) {
+    stepNet_ = CreateNet(stepNetDef_, &stepWs_);
+    CAFFE_ENFORCE(stepNet_, "Step Net construction failure");
+  }
+  CAFFE_ENFORCE(stepNet_->Run(), "Step Net failed at timestep ", t);
+
+  const Blob* logitsBlob = stepWs_.GetBlob(logitsBlob_);
+  CAFFE_ENFORCE(logitsBlob, "The step net did not output ", logitsBlob_);
+  const auto& logits = logitsBlob->template Get<Tensor<Context>>();
+  CAFFE_ENFORCE_EQ(logits.ndim(), 2, logitsBlob_);
+  CAFFE_ENFORCE_EQ(logits.dim(0), tokens.size(), logitsBlob_);
+  *vocabSize = logits.dim32(1);
+  CAFFE_ENFORCE_GT(*vocabSize, eosToken_, "eos_token is out of range.");
+  if (std::is_same<Context, CPUContext>::value) {
+    return logits.template data<float>();
+  }
+  logits_.Resize(logits.dims());
+  context_.template Copy<float, Context, CPUContext>(
+      logits.size(),
+      logits.template data<float>(),
+      logits_.template mutable_data<float>());
+  context_.FinishDeviceComputation();
+  return logits_.template data<float>();
+}
+
+template <class Context>
+bool BeamSearchOp<Context>::RunOnDevice() {
+  const int batchSize = InputSize() ? Input(0).dim32(0)
+                                    : OperatorBase::GetSingleArgument<int>(
+                                          "batch_size", 1);
+  const int numBeams = batchSize * beamSize_;
+  InitializeStates(batchSize);
+
+  // The token and parent beam of every beam at every step, from which the
+  // best sequences are traced back at the end.
+  std::vector<std::vector<int>> tokens;
+  std::vector<std::vector<int>> parents;
+  std::vector<int> current(numBeams, goToken_);
+  std::vector<float> scores(numBeams, 0);
+  std::vector<char> finished(numBeams, 0);
+  std::vector<float> bestScores(beamSize_);
+  std::vector<TIndex> bestIndices(beamSize_);
+  TopKHeap<float> heap(beamSize_);
+  for (int t = 0; t < maxLength_; ++t) {
+    int V = 0;
+    const float* logits = RunStep(t, current, &V);
+    std::vector<int> next(numBeams);
+    std::vector<int> parent(numBeams);
+    std::vector<float> nextScores(numBeams);
+    std::vector<char> nextFinished(numBeams);
+    bool allFinished = true;
+    for (int b = 0; b < batchSize; ++b) {
+      // The beams all start from the same state: only the first one is
+      // extended at the first step, so that they do not duplicate each other.
+      const int liveBeams = t == 0 ? 1 : beamSize_;
+      for (int k = 0; k < liveBeams; ++k) {
+        const int row = b * beamSize_ + k;
+        if (finished[row]) {
+          heap.Push(scores[row], static_cast<TIndex>(k) * V + eosToken_);
+          continue;
+        }
+        // Log-softmax of the row, fused into the scores of the extensions.
+        const float* x = logits + static_cast<TIndex>(row) * V;
+        float maxLogit = x[0];
+        for (int v = 1; v < V; ++v) {
+          maxLogit = std::max(maxLogit, x[v]);
+        }
+        float sum = 0;
+        for (int v = 0; v < V; ++v) {
+          sum += std::exp(x[v] - maxLogit);
+        }
+        const float base = scores[row] - maxLogit - std::log(sum);
+        for (int v = 0; v < V; ++v) {
+          heap.Push(base + x[v], static_cast<TIndex>(k) * V + v);
+        }
+      }
+      heap.Extract(bestScores.data(), bestIndices.data());
+      for (int k = 0; k < beamSize_; ++k) {
+        const int row = b * beamSize_ + k;
+        if (bestIndices[k] < 0) {
+          // Fewer extensions than beams: a dead beam that stays last.
+          parent[row] = b * beamSize_;
+          next[row] = eosToken_;
+          nextScores[row] = -std::numeric_limits<float>::infinity();
+          nextFinished[row] = 1;
+          continue;
+        }
+        const int from = b * beamSize_ + bestIndices[k] / V;
+        parent[row] = from;
+        next[row] = bestIndices[k] % V;
+        nextScores[row] = bestScores[k];
+        nextFinished[row] = finished[from] || next[row] == eosToken_;
+        allFinished &= nextFinished[row];
+      }
+    }
+    tokens.push_back(next);
+    parents.push_back(parent);
+    current.swap(next);
+    scores.swap(nextScores);
+    finished.swap(nextFinished);
+    if (allFinished || t + 1 == maxLength_) {
+      break;
+    }
+    ReorderStates(parent);
+  }
+
+  const int length = tokens.size();
+  auto* outputTokens = Output(0);
+  auto* outputScores = Output(1);
+  auto* outputLengths = Output(2);
+  outputTokens->Resize(batchSize, beamSize_, length);
+  outputScores->Resize(batchSize, beamSize_);
+  outputLengths->Resize(batchSize, beamSize_);
+  std::vector<int> sequences(numBeams * length);
+  std::vector<int> lengths(numBeams);
+  for (int row = 0; row < numBeams; ++row) {
+    int beam = row;
+    for (int t = length - 1; t >= 0; --t) {
+      sequences[row * length + t] = tokens[t][beam];
+      beam = parents[t][beam];
+    }
+    lengths[row] = length;
+    for (int t = 0; t < length; ++t) {
+      if (sequences[row * length + t] == eosToken_) {
+        lengths[row] = t;
+        break;
+      }
+    }
+  }
+  context_.template Copy<int, CPUContext, Context>(
+      sequences.size(),
+      sequences.data(),
+      outputTokens->template mutable_data<int>());
+  context_.template Copy<float, CPUContext, Context>(
+      scores.size(),
+      scores.data(),
+      outputScores->template mutable_data<float>());
+  context_.template Copy<int, CPUContext, Context>(
+      lengths.size(),
+      lengths.data(),
+      outputLengths->template mutable_data<int>());
+  return true;
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_BEAM_SEARCH_OP_H_
@@ -0,0 +1,8 @@
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/operators/beam_search_op.h"
+
+namespace caffe2 {
+namespace {
+REGISTER_CUDA_OPERATOR(BeamSearch, BeamSearchOp<CUDAContext>);
+}
+}
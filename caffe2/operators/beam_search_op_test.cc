@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+#include "google/protobuf/text_format.h"
+
+namespace caffe2 {
+
+namespace {
+
+constexpr int kVocab = 3;
+constexpr int kEos = 0;
+constexpr int kMaxLength = 3;
+
+// A toy decoder: the logits of the next token are T[token] + h * w, and the
+// state h adds up the tokens fed so far. The step net computes the same with
+// operators.
+struct Model {
+  vector<float> T;
+  vector<float> w;
+
+  vector<float> LogProbs(int token, float h) const {
+    vector<float> logits(kVocab);
+    float sum = 0;
+    for (int v = 0; v < kVocab; ++v) {
+      logits[v] = T[token * kVocab + v] + h * w[v];
+      sum += std::exp(logits[v]);
+    }
+    for (auto& logit : logits) {
+      logit -= std::log(sum);
+    }
+    return logits;
+  }
+
+  // All of the sequences that end with kEos or have kMaxLength tokens.
+  void Enumerate(
+      int token,
+      float h,
+      float score,
+      vector<int> sequence,
+      vector<std::pair<float, vector<int>>>* sequences) const {
+    const auto logProbs = LogProbs(token, h);
+    for (int v = 0; v < kVocab; ++v) {
+      vector<int> extended(sequence);
+      extended.push_back(v);
+      if (v == kEos || extended.size() == kMaxLength) {
+        sequences->emplace_back(score + logProbs[v], extended);
+      } else {
+        Enumerate(v, h + token, score + logProbs[v], extended, sequences);
+      }
+    }
+  }
+};
+
+Model MakeModel(Workspace* ws) {
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<float> value(-2, 2);
+  Model model;
+  for (int i = 0; i < kVocab * kVocab; ++i) {
+    model.T.push_back(value(gen));
+  }
+  for (int i = 0; i < kVocab; ++i) {
+    model.w.push_back(value(gen));
+  }
+  auto* T = ws->CreateBlob("T")->GetMutable<TensorCPU>();
+  T->Resize(kVocab, kVocab);
+  std::copy(model.T.begin(), model.T.end(), T->mutable_data<float>());
+  auto* w = ws->CreateBlob("w")->GetMutable<TensorCPU>();
+  w->Resize(kVocab, 1);
+  std::copy(model.w.begin(), model.w.end(), w->mutable_data<float>());
+  auto* zeros = ws->CreateBlob("zeros")->GetMutable<TensorCPU>();
+  zeros->Resize(kVocab);
+  std::fill_n(zeros->mutable_data<float>(), kVocab, 0.f);
+  return model;
+}
+
+void AddOp(
+    NetDef* net,
+    const string& type,
+    const vector<string>& inputs,
+    const vector<string>& outputs,
+    const vector<Argument>& args = {}) {
+  net->add_op()->CopyFrom(CreateOperatorDef(type, "", inputs, outputs, args));
+}
+
+OperatorDef BeamSearchDef(int beamSize) {
+  NetDef step;
+  step.set_name("decoder_step");
+  AddOp(&step, "Gather", {"T", "token"}, {"table_logits"});
+  AddOp(&step, "FC", {"h", "w", "zeros"}, {"state_logits"});
+  AddOp(&step, "Add", {"table_logits", "state_logits"}, {"logits"});
+  AddOp(
+      &step,
+      "Cast",
+      {"token"},
+      {"token_float"},
+      {MakeArgument<int>("to", TensorProto_DataType_FLOAT)});
+  AddOp(
+      &step,
+      "ExpandDims",
+      {"token_float"},
+      {"token_column"},
+      {MakeArgument<vector<int>>("dims", {1})});
+  AddOp(&step, "Add", {"h", "token_column"}, {"h_next"});
+  string stepNet;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::PrintToString(step, &stepNet));
+
+  OperatorDef def;
+  def.set_type("BeamSearch");
+  def.add_input("h0");
+  def.add_output("tokens");
+  def.add_output("scores");
+  def.add_output("lengths");
+  AddArgument<string>("step_net", stepNet, &def);
+  AddArgument<int>("beam_size", beamSize, &def);
+  AddArgument<int>("max_length", kMaxLength, &def);
+  AddArgument<int>("eos_token", kEos, &def);
+  AddArgument<int>("go_token", 1, &def);
+  def.add_arg()->CopyFrom(
+      MakeArgument<vector<string>>("state_inputs", {"h"}));
+  def.add_arg()->CopyFrom(
+      MakeArgument<vector<string>>("state_outputs", {"h_next"}));
+  return def;
+}
+
+const vector<float> kInitialStates{0.f, 0.7f};
+
+void FeedInitialStates(Workspace* ws) {
+  auto* h0 = ws->CreateBlob("h0")->GetMutable<TensorCPU>();
+  h0->Resize(kInitialStates.size(), 1);
+  std::copy(
+      kInitialStates.begin(),
+      kInitialStates.end(),
+      h0->mutable_data<float>());
+}
+
+} // namespace
+
+TEST(BeamSearchTest, WideBeamFindsTheBestSequences) {
+  // 21 beams keep every candidate of every step, so the search is exact.
+  const int beamSize = 21;
+  Workspace ws;
+  const Model model = MakeModel(&ws);
+  FeedInitialStates(&ws);
+  auto op = CreateOperator(BeamSearchDef(beamSize), &ws);
+  ASSERT_TRUE(op->Run());
+  const auto& tokens = ws.GetBlob("tokens")->Get<TensorCPU>();
+  const auto& scores = ws.GetBlob("scores")->Get<TensorCPU>();
+  const auto& lengths = ws.GetBlob("lengths")->Get<TensorCPU>();
+  ASSERT_EQ(tokens.dims(), (vector<TIndex>{2, beamSize, kMaxLength}));
+  ASSERT_EQ(scores.dims(), (vector<TIndex>{2, beamSize}));
+
+  for (int b = 0; b < kInitialStates.size(); ++b) {
+    vector<std::pair<float, vector<int>>> expected;
+    model.Enumerate(1, kInitialStates[b], 0, {}, &expected);
+    std::sort(
+        expected.begin(),
+        expected.end(),
+        [](const std::pair<float, vector<int>>& x,
+           const std::pair<float, vector<int>>& y) {
+          return x.first > y.first;
+        });
+    ASSERT_EQ(expected.size(), 15);
+    for (int k = 0; k < expected.size(); ++k) {
+      const int row = b * beamSize + k;
+      EXPECT_NEAR(scores.data<float>()[row], expected[k].first, 1e-4);
+      const auto& sequence = expected[k].second;
+      const int length = sequence.back() == kEos ? sequence.size() - 1
+                                                 : sequence.size();
+      EXPECT_EQ(lengths.data<int>()[row], length);
+      for (int t = 0; t < kMaxLength; ++t) {
+        EXPECT_EQ(
+            tokens.data<int>()[row * kMaxLength + t],
+            t < sequence.size() ? sequence[t] : kEos);
+      }
+    }
+    // The beams left over are dead.
+    EXPECT_TRUE(std::isinf(scores.data<float>()[b * beamSize + 15]));
+  }
+}
+
+TEST(BeamSearchTest, GreedyDecoding) {
+  Workspace ws;
+  const Model model = MakeModel(&ws);
+  FeedInitialStates(&ws);
+  auto op = CreateOperator(BeamSearchDef(1), &ws);
+  ASSERT_TRUE(op->Run());
+  const auto& tokens = ws.GetBlob("tokens")->Get<TensorCPU>();
+  const auto& lengths = ws.GetBlob("lengths")->Get<TensorCPU>();
+  const int length = tokens.dim32(2);
+  for (int b = 0; b < kInitialStates.size(); ++b) {
+    int token = 1;
+    float h = kInitialStates[b];
+    int t = 0;
+    for (; t < kMaxLength && (t == 0 || token != kEos); ++t) {
+      const auto logProbs = model.LogProbs(token, h);
+      h += token;
+      token = std::max_element(logProbs.begin(), logProbs.end()) -
+          logProbs.begin();
+      EXPECT_EQ(tokens.data<int>()[b * length + t], token);
+    }
+    EXPECT_EQ(lengths.data<int>()[b], token == kEos ? t - 1 : t);
+  }
+  // Running again starts over from the initial states.
+  TensorCPU first(tokens);
+  ASSERT_TRUE(op->Run());
+  for (int i = 0; i < first.size(); ++i) {
+    EXPECT_EQ(first.data<int>()[i], tokens.data<int>()[i]);
+  }
+}
+
+} // namespace caffe2
@@ -1,110 +1,124 @@
-#include "caffe2/core/operator.h"
-#include "caffe2/core/tensor.h"
+#include "caffe2/operators/boolean_mask_ops.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "caffe2/core/common_omp.h"
 
 namespace caffe2 {
 namespace {
 
-template <class Context>
-class BooleanMaskLengthsOp final : public Operator<Context> {
- public:
-  USE_OPERATOR_CONTEXT_FUNCTIONS;
-  BooleanMaskLengthsOp(const OperatorDef& operator_def, Workspace* ws)
-      : Operator<Context>(operator_def, ws) {}
+// The number of chunks of a mask of n values that threads go over.
+int NumChunks(TIndex n) {
+#ifdef _OPENMP
+  const TIndex kMinChunkSize = 1 << 14;
+  return std::max<TIndex>(
+      1, std::min<TIndex>(omp_get_max_threads(), n / kMinChunkSize));
+#else
+  return 1;
+#endif
+}
 
-  bool RunOnDevice() override {
-    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(this, Input(0));
+// Bools are bytes of 0 or 1, so counting the true values is a sum of bytes,
+// which the compiler vectorizes.
+TIndex CountTrue(const bool* mask, TIndex n) {
+  const auto* bytes = reinterpret_cast<const uint8_t*>(mask);
+  TIndex count = 0;
+  for (TIndex i = 0; i < n; ++i) {
+    count += bytes[i];
   }
+  return count;
+}
 
-  template <typename T>
-  bool DoRunWithType() {
-    auto& lengths = Input(0);
-    auto& mask = Input(1);
-    auto* lengthsOut = Output(0);
-    CAFFE_ENFORCE(lengths.ndim() == 1);
-    CAFFE_ENFORCE(mask.ndim() == 1);
-    const auto* lengthsPtr = lengths.template data<T>();
-    const auto* maskPtr = mask.template data<bool>();
-    auto totalLength =
-        std::accumulate(lengthsPtr, lengthsPtr + lengths.size(), 0);
-    CAFFE_ENFORCE(mask.size() == totalLength);
-    lengthsOut->ResizeLike(lengths);
-    auto* lengthsOutPtr = lengthsOut->template mutable_data<T>();
-    int p = 0;
-    for (int i = 0; i < lengths.size(); ++i) {
-      T lengthOut = 0;
-      for (int j = 0; j < lengthsPtr[i]; ++j) {
-        if (maskPtr[p++]) {
-          ++lengthOut;
-        }
-      }
-      lengthsOutPtr[i] = lengthOut;
-    }
-    return true;
-  }
-};
+} // namespace
 
-template <class Context>
-class BooleanMaskOp final : public Operator<Context> {
- public:
-  USE_OPERATOR_CONTEXT_FUNCTIONS;
-  BooleanMaskOp(const OperatorDef& operator_def, Workspace* ws)
-      : Operator<Context>(operator_def, ws) {}
+template <>
+bool BooleanMaskOp<CPUContext>::RunOnDevice() {
+  auto& data = Input(0);
+  auto& mask = Input(1);
+  auto* dataOut = Output(0);
+  CAFFE_ENFORCE(data.ndim() >= 1);
+  CAFFE_ENFORCE_EQ(mask.ndim(), 1);
+  CAFFE_ENFORCE(data.dims()[0] == mask.dims()[0]);
 
-  bool RunOnDevice() override {
-    auto& data = Input(0);
-    auto& mask = Input(1);
-    auto* dataOut = Output(0);
-    CAFFE_ENFORCE(data.ndim() >= 1);
-    CAFFE_ENFORCE(mask.ndim(), 1);
-    CAFFE_ENFORCE(data.dims()[0] == mask.dims()[0]);
+  const auto* maskPtr = mask.template data<bool>();
+  const TIndex outerSize = mask.size();
+  const int chunks = NumChunks(outerSize);
+  chunk_offsets_.resize(chunks + 1);
+  chunk_offsets_[0] = 0;
+#pragma omp parallel for if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const TIndex begin = outerSize * c / chunks;
+    const TIndex end = outerSize * (c + 1) / chunks;
+    chunk_offsets_[c + 1] = CountTrue(maskPtr + begin, end - begin);
+  }
+  for (int c = 0; c < chunks; ++c) {
+    chunk_offsets_[c + 1] += chunk_offsets_[c];
+  }
+  const TIndex numOutputs = chunk_offsets_[chunks];
 
-    const auto* maskPtr = mask.template data<bool>();
-    int numOutputs = 0;
-    int outerSize = mask.size();
-    for (int i = 0; i < outerSize; ++i) {
-      if (maskPtr[i]) {
-        ++numOutputs;
-      }
-    }
-    std::vector<TIndex> outShape;
-    outShape.push_back(numOutputs);
-    outShape.insert(outShape.end(), data.dims().begin() + 1, data.dims().end());
-    dataOut->Resize(outShape);
-    auto* outPtr = (char*)dataOut->raw_mutable_data(data.meta());
-    if (numOutputs == 0) {
-      return true;
-    }
-    auto innerSizeBytes = std::accumulate(
-                              data.dims().begin() + 1,
-                              data.dims().end(),
-                              1,
-                              std::multiplies<TIndex>()) *
-        data.meta().itemsize();
-    TIndex lastStart = -1;
-    const auto* inPtr = (char*)data.raw_data();
-    TIndex outStart = 0;
-    for (TIndex i = 0;; ++i) {
-      // mask was true and either a) became false, or b) sequence finished
-      if (lastStart != -1 && ((i >= outerSize) || !maskPtr[i])) {
-        const auto* src = inPtr + lastStart * innerSizeBytes;
-        auto* dst = outPtr + outStart * innerSizeBytes;
-        int numItems = i - lastStart;
-        context_.template CopyItems<CPUContext, CPUContext>(
-            data.meta(), numItems, src, dst);
-        outStart += numItems;
-        lastStart = -1;
-      }
-      if (i >= outerSize) {
+  std::vector<TIndex> outShape;
+  outShape.push_back(numOutputs);
+  outShape.insert(outShape.end(), data.dims().begin() + 1, data.dims().end());
+  dataOut->Resize(outShape);
+  auto* outPtr = (char*)dataOut->raw_mutable_data(data.meta());
+  if (numOutputs == 0) {
+    return true;
+  }
+  const TIndex innerSize = data.size_from_dim(1);
+  const auto innerSizeBytes = innerSize * data.meta().itemsize();
+  const auto* inPtr = (const char*)data.raw_data();
+#pragma omp parallel for if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const TIndex end = outerSize * (c + 1) / chunks;
+    TIndex outStart = chunk_offsets_[c];
+    // Copies the runs of consecutive rows whose mask is true.
+    for (TIndex i = outerSize * c / chunks; i < end;) {
+      const TIndex runStart = std::find(maskPtr + i, maskPtr + end, true) -
+          maskPtr;
+      if (runStart == end) {
         break;
       }
-      // mask was false and became true
-      if (lastStart == -1 && maskPtr[i]) {
-        lastStart = i;
-      }
+      i = std::find(maskPtr + runStart, maskPtr + end, false) - maskPtr;
+      context_.template CopyItems<CPUContext, CPUContext>(
+          data.meta(),
+          (i - runStart) * innerSize,
+          inPtr + runStart * innerSizeBytes,
+          outPtr + outStart * innerSizeBytes);
+      outStart += i - runStart;
     }
-    return true;
   }
-};
+  return true;
+}
+
+template <>
+template <typename T>
+bool BooleanMaskLengthsOp<CPUContext>::DoRunWithType() {
+  auto& lengths = Input(0);
+  auto& mask = Input(1);
+  auto* lengthsOut = Output(0);
+  CAFFE_ENFORCE(lengths.ndim() == 1);
+  CAFFE_ENFORCE(mask.ndim() == 1);
+  const auto* lengthsPtr = lengths.template data<T>();
+  const auto* maskPtr = mask.template data<bool>();
+  ends_.ResizeLike(lengths);
+  auto* endsPtr = ends_.template mutable_data<T>();
+  T totalLength = 0;
+  for (TIndex i = 0; i < lengths.size(); ++i) {
+    totalLength += lengthsPtr[i];
+    endsPtr[i] = totalLength;
+  }
+  CAFFE_ENFORCE(mask.size() == totalLength);
+  lengthsOut->ResizeLike(lengths);
+  auto* lengthsOutPtr = lengthsOut->template mutable_data<T>();
+  const TIndex numSegments = lengths.size();
+#pragma omp parallel for if (NumChunks(totalLength) > 1)
+  for (TIndex i = 0; i < numSegments; ++i) {
+    lengthsOutPtr[i] =
+        CountTrue(maskPtr + endsPtr[i] - lengthsPtr[i], lengthsPtr[i]);
+  }
+  return true;
+}
 
 REGISTER_CPU_OPERATOR(BooleanMask, BooleanMaskOp<CPUContext>);
 REGISTER_CPU_OPERATOR(BooleanMaskLengths, BooleanMaskLengthsOp<CPUContext>);
@@ -135,5 +149,4 @@ applied.
 
 NO_GRADIENT(BooleanMask)
 NO_GRADIENT(BooleanMaskLengths);
-}
-}
+} // namespace caffe2
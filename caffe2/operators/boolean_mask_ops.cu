@@ -0,0 +1,178 @@
+#include "cub/block/block_reduce.cuh"
+#include "cub/device/device_scan.cuh"
+#include "cub/device/device_select.cuh"
+#include "cub/iterator/counting_input_iterator.cuh"
+
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/operators/boolean_mask_ops.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Copies row i of the output from row indices[i] of the input, with one
+// block per row. T is the unit that the rows are copied in.
+template <typename T>
+__global__ void BooleanMaskCopyKernel(
+    const TIndex numOutputs,
+    const TIndex rowSize,
+    const TIndex* indices,
+    const T* src,
+    T* dst) {
+  for (TIndex i = blockIdx.x; i < numOutputs; i += gridDim.x) {
+    const T* srcRow = src + indices[i] * rowSize;
+    T* dstRow = dst + i * rowSize;
+    for (TIndex j = threadIdx.x; j < rowSize; j += blockDim.x) {
+      dstRow[j] = srcRow[j];
+    }
+  }
+}
+
+// Counts the true values of each segment of the mask, with one block per
+// segment.
+template <typename T>
+__global__ void BooleanMaskLengthsKernel(
+    const int numSegments,
+    const T* lengths,
+    const T* ends,
+    const bool* mask,
+    T* lengthsOut) {
+  typedef cub::BlockReduce<T, CAFFE_CUDA_NUM_THREADS> BlockReduce;
+  __shared__ typename BlockReduce::TempStorage tempStorage;
+  for (int i = blockIdx.x; i < numSegments; i += gridDim.x) {
+    const T end = ends[i];
+    T count = 0;
+    for (T j = end - lengths[i] + threadIdx.x; j < end; j += blockDim.x) {
+      count += mask[j];
+    }
+    count = BlockReduce(tempStorage).Sum(count);
+    if (threadIdx.x == 0) {
+      lengthsOut[i] = count;
+    }
+    __syncthreads();
+  }
+}
+
+} // namespace
+
+template <>
+bool BooleanMaskOp<CUDAContext>::RunOnDevice() {
+  auto& data = Input(0);
+  auto& mask = Input(1);
+  auto* dataOut = Output(0);
+  CAFFE_ENFORCE(data.ndim() >= 1);
+  CAFFE_ENFORCE_EQ(mask.ndim(), 1);
+  CAFFE_ENFORCE(data.dims()[0] == mask.dims()[0]);
+
+  const int outerSize = mask.size();
+  indices_.Resize(outerSize);
+  num_selected_.Resize(1);
+  cub::CountingInputIterator<TIndex> rows(0);
+  size_t scratchBytes = 0;
+  CUDA_CHECK(cub::DeviceSelect::Flagged(
+      nullptr,
+      scratchBytes,
+      rows,
+      mask.data<bool>(),
+      indices_.mutable_data<TIndex>(),
+      num_selected_.mutable_data<TIndex>(),
+      outerSize,
+      context_.cuda_stream()));
+  scratch_.Resize(scratchBytes);
+  CUDA_CHECK(cub::DeviceSelect::Flagged(
+      static_cast<void*>(scratch_.mutable_data<char>()),
+      scratchBytes,
+      rows,
+      mask.data<bool>(),
+      indices_.mutable_data<TIndex>(),
+      num_selected_.mutable_data<TIndex>(),
+      outerSize,
+      context_.cuda_stream()));
+  // The shape of the output waits for the number of rows.
+  TIndex numOutputs = 0;
+  context_.Copy<TIndex, CUDAContext, CPUContext>(
+      1, num_selected_.data<TIndex>(), &numOutputs);
+  context_.FinishDeviceComputation();
+
+  std::vector<TIndex> outShape;
+  outShape.push_back(numOutputs);
+  outShape.insert(outShape.end(), data.dims().begin() + 1, data.dims().end());
+  dataOut->Resize(outShape);
+  auto* outPtr = (char*)dataOut->raw_mutable_data(data.meta());
+  const TIndex innerSizeBytes = data.size_from_dim(1) * data.meta().itemsize();
+  if (numOutputs == 0 || innerSizeBytes == 0) {
+    return true;
+  }
+  const auto* inPtr = (const char*)data.raw_data();
+  const int blocks = std::min<TIndex>(numOutputs, CAFFE_MAXIMUM_NUM_BLOCKS);
+  if (innerSizeBytes % sizeof(int) == 0) {
+    BooleanMaskCopyKernel<int>
+        <<<blocks, CAFFE_CUDA_NUM_THREADS, 0, context_.cuda_stream()>>>(
+            numOutputs,
+            innerSizeBytes / sizeof(int),
+            indices_.data<TIndex>(),
+            reinterpret_cast<const int*>(inPtr),
+            reinterpret_cast<int*>(outPtr));
+  } else {
+    BooleanMaskCopyKernel<char>
+        <<<blocks, CAFFE_CUDA_NUM_THREADS, 0, context_.cuda_stream()>>>(
+            numOutputs, innerSizeBytes, indices_.data<TIndex>(), inPtr, outPtr);
+  }
+  return true;
+}
+
+template <>
+template <typename T>
+bool BooleanMaskLengthsOp<CUDAContext>::DoRunWithType() {
+  auto& lengths = Input(0);
+  auto& mask = Input(1);
+  auto* lengthsOut = Output(0);
+  CAFFE_ENFORCE(lengths.ndim() == 1);
+  CAFFE_ENFORCE(mask.ndim() == 1);
+  const int numSegments = lengths.size();
+  lengthsOut->ResizeLike(lengths);
+  auto* lengthsOutPtr = lengthsOut->template mutable_data<T>();
+  if (numSegments == 0) {
+    CAFFE_ENFORCE_EQ(mask.size(), 0);
+    return true;
+  }
+  ends_.ResizeLike(lengths);
+  size_t scratchBytes = 0;
+  CUDA_CHECK(cub::DeviceScan::InclusiveSum(
+      nullptr,
+      scratchBytes,
+      lengths.template data<T>(),
+      ends_.template mutable_data<T>(),
+      numSegments,
+      context_.cuda_stream()));
+  scratch_.Resize(scratchBytes);
+  CUDA_CHECK(cub::DeviceScan::InclusiveSum(
+      static_cast<void*>(scratch_.mutable_data<char>()),
+      scratchBytes,
+      lengths.template data<T>(),
+      ends_.template mutable_data<T>(),
+      numSegments,
+      context_.cuda_stream()));
+  T totalLength = 0;
+  context_.Copy<T, CUDAContext, CPUContext>(
+      1, ends_.template data<T>() + numSegments - 1, &totalLength);
+  context_.FinishDeviceComputation();
+  CAFFE_ENFORCE(mask.size() == totalLength);
+
+  BooleanMaskLengthsKernel<T><<<
+      std::min(numSegments, CAFFE_MAXIMUM_NUM_BLOCKS),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context_.cuda_stream()>>>(
+      numSegments,
+      lengths.template data<T>(),
+      ends_.template data<T>(),
+      mask.template data<bool>(),
+      lengthsOutPtr);
+  return true;
+}
+
+REGISTER_CUDA_OPERATOR(BooleanMask, BooleanMaskOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(BooleanMaskLengths, BooleanMaskLengthsOp<CUDAContext>);
+
+} // namespace caffe2
@@ -0,0 +1,58 @@
+#ifndef CAFFE2_OPERATORS_BOOLEAN_MASK_OPS_H_
+#define CAFFE2_OPERATORS_BOOLEAN_MASK_OPS_H_
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor.h"
+
+namespace caffe2 {
+
+// Both operators compact a mask in two passes. On the CPU, threads first
+// count the true values of contiguous chunks of the mask, whose prefix sum
+// gives each chunk its offset in the output, and then each thread writes
+// its chunk there. On the GPU, a device select turns the mask into the
+// indices of its true values, and the rows are gathered from them.
+
+template <class Context>
+class BooleanMaskOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  BooleanMaskOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws) {}
+
+  bool RunOnDevice() override;
+
+ private:
+  // CPU: the first output row of each chunk of the mask.
+  vector<TIndex> chunk_offsets_;
+  // CUDA: the indices of the true values, their number and the scratch space
+  // of the select.
+  Tensor<Context> indices_;
+  Tensor<Context> num_selected_;
+  Tensor<Context> scratch_;
+};
+
+template <class Context>
+class BooleanMaskLengthsOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  BooleanMaskLengthsOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(this, Input(0));
+  }
+
+  template <typename T>
+  bool DoRunWithType();
+
+ private:
+  // The end of each segment in the mask, and, for CUDA, the scratch space of
+  // the scan that computes them.
+  Tensor<Context> ends_;
+  Tensor<Context> scratch_;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_BOOLEAN_MASK_OPS_H_
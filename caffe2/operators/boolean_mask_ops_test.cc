@@ -0,0 +1,123 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+void RunBooleanMask(
+    Workspace* ws,
+    const string& type,
+    const string& data,
+    const string& mask) {
+  OperatorDef def;
+  def.set_type(type);
+  def.add_input(data);
+  def.add_input(mask);
+  def.add_output("output");
+  ASSERT_TRUE(ws->RunOperatorOnce(def));
+}
+
+vector<char> RandomMask(int size, int percent, std::mt19937* gen) {
+  vector<char> mask(size);
+  for (auto& m : mask) {
+    m = (*gen)() % 100 < percent;
+  }
+  return mask;
+}
+
+void SetMask(Workspace* ws, const vector<char>& mask) {
+  auto* tensor = ws->CreateBlob("mask")->GetMutable<TensorCPU>();
+  tensor->Resize(mask.size());
+  std::copy(mask.begin(), mask.end(), tensor->mutable_data<bool>());
+}
+
+} // namespace
+
+// Masks large enough to be compacted in several chunks, mostly false, mostly
+// true, and with runs that span the chunks.
+TEST(BooleanMaskTest, MatchesReference) {
+  std::mt19937 gen(5);
+  const int rows = 100000;
+  const int cols = 3;
+  for (int percent : {0, 1, 50, 99, 100}) {
+    Workspace ws;
+    const auto mask = RandomMask(rows, percent, &gen);
+    SetMask(&ws, mask);
+    auto* data = ws.CreateBlob("data")->GetMutable<TensorCPU>();
+    data->Resize(rows, cols);
+    for (int i = 0; i < rows * cols; ++i) {
+      data->mutable_data<float>()[i] = i;
+    }
+    RunBooleanMask(&ws, "BooleanMask", "data", "mask");
+
+    vector<float> expected;
+    for (int i = 0; i < rows; ++i) {
+      for (int j = 0; mask[i] && j < cols; ++j) {
+        expected.push_back(i * cols + j);
+      }
+    }
+    const auto& output = ws.GetBlob("output")->Get<TensorCPU>();
+    ASSERT_EQ(output.ndim(), 2);
+    EXPECT_EQ(output.dim(0), expected.size() / cols);
+    EXPECT_EQ(output.dim(1), cols);
+    const auto* values = output.data<float>();
+    EXPECT_EQ(vector<float>(values, values + output.size()), expected);
+  }
+}
+
+TEST(BooleanMaskTest, Strings) {
+  std::mt19937 gen(7);
+  const int rows = 50000;
+  Workspace ws;
+  const auto mask = RandomMask(rows, 30, &gen);
+  SetMask(&ws, mask);
+  auto* data = ws.CreateBlob("data")->GetMutable<TensorCPU>();
+  data->Resize(rows);
+  vector<string> expected;
+  for (int i = 0; i < rows; ++i) {
+    data->mutable_data<string>()[i] = std::to_string(i);
+    if (mask[i]) {
+      expected.push_back(std::to_string(i));
+    }
+  }
+  RunBooleanMask(&ws, "BooleanMask", "data", "mask");
+  const auto& output = ws.GetBlob("output")->Get<TensorCPU>();
+  EXPECT_EQ(
+      vector<string>(
+          output.data<string>(), output.data<string>() + output.size()),
+      expected);
+}
+
+TEST(BooleanMaskTest, Lengths) {
+  std::mt19937 gen(9);
+  Workspace ws;
+  vector<int64_t> lengths(20000);
+  int total = 0;
+  for (auto& length : lengths) {
+    length = gen() % 8;
+    total += length;
+  }
+  const auto mask = RandomMask(total, 40, &gen);
+  SetMask(&ws, mask);
+  auto* lengths_blob = ws.CreateBlob("lengths")->GetMutable<TensorCPU>();
+  lengths_blob->Resize(lengths.size());
+  std::copy(
+      lengths.begin(), lengths.end(), lengths_blob->mutable_data<int64_t>());
+  RunBooleanMask(&ws, "BooleanMaskLengths", "lengths", "mask");
+
+  const auto& output = ws.GetBlob("output")->Get<TensorCPU>();
+  ASSERT_EQ(output.size(), lengths.size());
+  int p = 0;
+  for (int i = 0; i < lengths.size(); ++i) {
+    int64_t expected = 0;
+    for (int j = 0; j < lengths[i]; ++j) {
+      expected += mask[p++];
+    }
+    EXPECT_EQ(output.data<int64_t>()[i], expected);
+  }
+}
+
+} // namespace caffe2
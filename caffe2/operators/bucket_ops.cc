@@ -0,0 +1,62 @@
+#include "caffe2/operators/bucket_ops.h"
+
+namespace caffe2 {
+namespace {
+
+REGISTER_CPU_OPERATOR(PackBucket, PackBucketOp<CPUContext>);
+REGISTER_CPU_OPERATOR(UnpackBucket, UnpackBucketOp<CPUContext>);
+
+OPERATOR_SCHEMA(PackBucket)
+    .NumInputs(1, INT_MAX)
+    .NumOutputs(1)
+    .TensorInferenceFunction(
+        [](const OperatorDef& def, const vector<TensorShape>& in) {
+          vector<TensorShape> out(1);
+          TIndex total = 0;
+          for (const auto& shape : in) {
+            TIndex size = 1;
+            for (auto d : shape.dims()) {
+              size *= d;
+            }
+            total += size;
+          }
+          out[0].add_dims(total);
+          out[0].set_data_type(in[0].data_type());
+          return out;
+        })
+    .SetDoc(R"DOC(
+Copies all the inputs, which must have the same type, one after the other into
+a flat 1-D bucket. Reducing one bucket instead of each of the tensors it holds
+saves the latency of many small collectives; UnpackBucket copies the reduced
+values back.
+)DOC")
+    .Input(0, "X_0", "The first tensor to pack, followed by the others.")
+    .Output(0, "bucket", "1-D tensor holding the elements of all the inputs.");
+
+OPERATOR_SCHEMA(UnpackBucket)
+    .NumInputs(2, INT_MAX)
+    .NumOutputs(1, INT_MAX)
+    .NumInputsOutputs([](int in, int out) { return in == out + 1; })
+    .AllowInplace([](int in, int out) { return in == out + 1; })
+    .TensorInferenceFunction(
+        [](const OperatorDef& def, const vector<TensorShape>& in) {
+          vector<TensorShape> out(in.begin() + 1, in.end());
+          for (auto& shape : out) {
+            shape.set_data_type(in[0].data_type());
+          }
+          return out;
+        })
+    .SetDoc(R"DOC(
+Splits a bucket produced by PackBucket into tensors shaped like the reference
+inputs X_0, X_1..., in the same order. The bucket must have as many elements
+as the references together. The outputs can be the references themselves.
+)DOC")
+    .Input(0, "bucket", "1-D tensor to split.")
+    .Input(1, "X_0", "Tensor with the shape of the first output.")
+    .Output(0, "Y_0", "The first part of the bucket, shaped like X_0.");
+
+SHOULD_NOT_DO_GRADIENT(PackBucket);
+SHOULD_NOT_DO_GRADIENT(UnpackBucket);
+
+} // namespace
+} // namespace caffe2
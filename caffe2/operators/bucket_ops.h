@@ -0,0 +1,86 @@
+#ifndef CAFFE2_OPERATORS_BUCKET_OPS_H_
+#define CAFFE2_OPERATORS_BUCKET_OPS_H_
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+
+namespace caffe2 {
+
+// Copies its inputs one after the other into a flat 1-D bucket, so that a
+// single collective can reduce all of them. The inputs must have the same
+// type.
+template <class Context>
+class PackBucketOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(PackBucketOp);
+
+  bool RunOnDevice() override {
+    const TypeMeta& meta = Input(0).meta();
+    TIndex total = 0;
+    for (int i = 0; i < InputSize(); ++i) {
+      CAFFE_ENFORCE(
+          Input(i).meta() == meta,
+          "All the inputs of PackBucket must have the same type, input ",
+          i,
+          " is ",
+          Input(i).meta().name(),
+          " instead of ",
+          meta.name());
+      total += Input(i).size();
+    }
+    auto* bucket = Output(0);
+    bucket->Resize(total);
+    char* dst = static_cast<char*>(bucket->raw_mutable_data(meta));
+    for (int i = 0; i < InputSize(); ++i) {
+      const auto& input = Input(i);
+      if (input.size() == 0) {
+        continue;
+      }
+      context_.template CopyItems<Context, Context>(
+          meta, input.size(), input.raw_data(), dst);
+      dst += input.nbytes();
+    }
+    return true;
+  }
+};
+
+// The inverse of PackBucket: splits the bucket back into tensors shaped like
+// the reference inputs, usually the tensors that were packed, which can be
+// overwritten in place.
+template <class Context>
+class UnpackBucketOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(UnpackBucketOp);
+
+  bool RunOnDevice() override {
+    const auto& bucket = Input(0);
+    const TypeMeta& meta = bucket.meta();
+    TIndex total = 0;
+    for (int i = 0; i < OutputSize(); ++i) {
+      total += Input(i + 1).size();
+    }
+    CAFFE_ENFORCE_EQ(
+        total,
+        bucket.size(),
+        "The bucket does not have as many elements as the reference inputs");
+    const char* src = static_cast<const char*>(bucket.raw_data());
+    for (int i = 0; i < OutputSize(); ++i) {
+      auto* output = Output(i);
+      output->ResizeLike(Input(i + 1));
+      void* dst = output->raw_mutable_data(meta);
+      if (output->size() == 0) {
+        continue;
+      }
+      context_.template CopyItems<Context, Context>(
+          meta, output->size(), src, dst);
+      src += output->nbytes();
+    }
+    return true;
+  }
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_BUCKET_OPS_H_
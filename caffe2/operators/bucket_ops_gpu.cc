@@ -0,0 +1,9 @@
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/operators/bucket_ops.h"
+
+namespace caffe2 {
+namespace {
+REGISTER_CUDA_OPERATOR(PackBucket, PackBucketOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(UnpackBucket, UnpackBucketOp<CUDAContext>);
+} // namespace
+} // namespace caffe2
@@ -8,11 +8,71 @@ OPERATOR_SCHEMA(CreateCommonWorld)
     .NumOutputs(1)
     .SetDoc(R"DOC(
 Creates a common world for communication operators.
+
+With the MPI engine on a GPU, it also finds out whether MPI takes device
+pointers on all the ranks, as with GPUDirect RDMA. If it does, the collectives
+of the world pass CUDA tensors to MPI directly; otherwise Allreduce and
+Broadcast stage them through pinned host memory in chunks, overlapping the
+copies with the communication.
 )DOC")
     .Input(0, "kv_handler", "Key/value handler for rendezvous (optional).")
     .Output(0, "comm_world", "A common world for collective operations.")
     .Arg("size", "(int) size of the common world.")
-    .Arg("rank", "(int) rank of this node in the common world.");
+    .Arg("rank", "(int) rank of this node in the common world.")
+    .Arg(
+        "topology_aware",
+        "(bool, default false) If set, the ranks of the common world are "
+        "ordered by rack, host and NUMA node instead of following the rank "
+        "arguments, so that rings and trees over consecutive ranks cross "
+        "racks as little as possible.")
+    .Arg(
+        "rack",
+        "(string, default \"\") With topology_aware, the rack of this node; "
+        "nodes with the same label are kept next to each other.");
+
+OPERATOR_SCHEMA(JoinCommonWorld)
+    .NumInputs(1)
+    .NumOutputs(1, 3)
+    .SetDoc(R"DOC(
+Creates an elastic common world out of the processes that run this operator,
+with the same name, at about the same time. Instead of taking a size and a
+rank, each process gets its rank in order of arrival, and the size is the
+number of processes that arrived before the first one to arrive closes the
+world: once at least min_size have joined and no other one did for
+settle_ms, or once max_size have.
+
+To drop failed nodes or add new ones, run it again on the processes that are
+left and the new ones; the world is rebuilt through the key/value store
+without restarting the job. A process that arrives after a world is closed
+waits for the next one.
+)DOC")
+    .Input(0, "kv_handler", "Key/value handler for rendezvous.")
+    .Output(0, "comm_world", "A common world for collective operations.")
+    .Output(1, "rank", "(optional) The int rank of this node in the world.")
+    .Output(2, "size", "(optional) The int size of the world.")
+    .Arg("min_size", "(int, default 1) The smallest size of the world.")
+    .Arg("max_size", "(int, default 0) If positive, the largest size.")
+    .Arg(
+        "settle_ms",
+        "(int, default 1000) How long no new process must join before the "
+        "world is closed.");
+
+OPERATOR_SCHEMA(RingBandwidth)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Measures the bandwidth of the links of the ring that goes through the ranks
+of the common world in order: every node sends to the next one and receives
+from the previous one at the same time.
+)DOC")
+    .Input(0, "comm_world", "The common world.")
+    .Output(
+        0,
+        "bandwidth",
+        "A float tensor with the GB/s from each rank to the next one, the "
+        "same on all the nodes.")
+    .Arg("nbytes", "(int, default 4MB) The size of the messages.")
+    .Arg("iterations", "(int, default 10) The number of messages timed.");
 
 OPERATOR_SCHEMA(Broadcast)
     .NumInputs(2)
@@ -45,11 +105,53 @@ OPERATOR_SCHEMA(Allreduce)
     .AllowInplace({{1, 0}})
     .SetDoc(R"DOC(
 Does an allreduce operation among the nodes. Currently only Sum is supported.
+
+The MPI engine can compress float tensors on the CPU to send fewer bytes:
+"fp16" sends half precision floats, "topk" sends the largest elements of each
+node with their indices and "1bit" sends the signs of the elements. topk and
+1bit keep what they did not send in the operator and add it to the next
+input, so they are meant for gradients that are reduced every iteration.
 )DOC")
+    .Arg(
+        "compression",
+        "(string, default \"none\") One of \"none\", \"fp16\", \"topk\" "
+        "or \"1bit\".")
+    .Arg(
+        "topk_ratio",
+        "(float, default 0.01) The fraction of the elements sent by topk.")
     .Input(0, "comm_world", "The common world.")
     .Input(1, "X", "A tensor to be allreduced.")
     .Output(0, "Y", "The allreduced tensor, same on all nodes.");
 
+OPERATOR_SCHEMA(AllreduceAsync)
+    .NumInputs(2)
+    .NumOutputs(2)
+    .AllowInplace({{1, 0}})
+    .SetDoc(R"DOC(
+Starts an allreduce operation among the nodes and returns without waiting for
+it, so that the net can keep computing while the data is on the wire.
+WaitCollective must be run on the handle before Y is read, and X must not be
+changed until then. Currently only Sum is supported.
+)DOC")
+    .Input(0, "comm_world", "The common world.")
+    .Input(1, "X", "A tensor to be allreduced.")
+    .Output(0, "Y", "The allreduced tensor, valid after WaitCollective.")
+    .Output(1, "handle", "The handle of the collective for WaitCollective.");
+
+OPERATOR_SCHEMA(WaitCollective)
+    .NumInputs(2)
+    .NumOutputs(2)
+    .EnforceInplace({{0, 1}, {1, 0}})
+    .SetDoc(R"DOC(
+Waits for a collective started by an asynchronous operator such as
+AllreduceAsync to complete. Y is passed through in place, so that the
+operators reading Y run after the wait.
+)DOC")
+    .Input(0, "handle", "The handle output by the asynchronous operator.")
+    .Input(1, "Y", "The output of the asynchronous operator.")
+    .Output(0, "Y", "In-place as input 1, now complete.")
+    .Output(1, "handle", "In-place as input 0.");
+
 OPERATOR_SCHEMA(Allgather)
     .NumInputs(2)
     .NumOutputs(1)
@@ -129,21 +231,82 @@ Receives the tensor from another node.
         "(bool) if set, only send the content and assume that the receiver "
         "has already known the tensor's shape and information.");
 
+OPERATOR_SCHEMA(SparsePull)
+    .NumInputs(3)
+    .NumOutputs(1)
+    .TensorInferenceFunction([](const OperatorDef& /* unused */,
+                                const vector<TensorShape>& in) {
+      vector<TensorShape> out(1);
+      out[0].set_data_type(in[1].data_type());
+      for (auto d : in[2].dims()) {
+        out[0].add_dims(d);
+      }
+      for (int i = 1; i < in[1].dims_size(); ++i) {
+        out[0].add_dims(in[1].dims(i));
+      }
+      return out;
+    })
+    .SetDoc(R"DOC(
+Gathers rows of a float table that is sharded over the nodes, like Gather on
+the whole table. Row id is at row id / num_nodes of the shard of node
+id % num_nodes, which is how Partition with pack_first_input splits the ids.
+All the nodes must run the operator together: each one sends the distinct ids
+it needs to their owners and receives only these rows, and serves the rows
+the others ask for.
+)DOC")
+    .Input(0, "comm_world", "The common world.")
+    .Input(1, "shard", "The shard of the table on this node.")
+    .Input(2, "indices", "int32 or int64 ids of the rows of the whole table.")
+    .Output(0, "rows", "The rows of the indices.");
+
+OPERATOR_SCHEMA(SparsePush)
+    .NumInputs(6)
+    .NumOutputs(2)
+    .EnforceInplace({{1, 0}, {2, 1}})
+    .SetDoc(R"DOC(
+Applies SparseAdagrad to a float table sharded over the nodes as for
+SparsePull, on the nodes that own the rows. All the nodes must run the
+operator together. Each node sums the gradients of duplicate indices and
+sends every row once; the owner of a row sums the gradients it receives from
+all the nodes and updates the row once.
+)DOC")
+    .Arg("epsilon", "Default 1e-5")
+    .Input(0, "comm_world", "The common world.")
+    .Input(1, "param", "The shard of the parameters on this node.")
+    .Input(2, "moment", "The shard of the moments on this node.")
+    .Input(3, "indices", "int32 or int64 ids of the rows of the whole table.")
+    .Input(4, "grad", "The gradients of the rows of the indices.")
+    .Input(5, "lr", "The learning rate.")
+    .Output(0, "output_param", "Updated parameters.")
+    .Output(1, "output_moment", "Updated moments.");
+
 SHOULD_NOT_DO_GRADIENT(CreateCommonWorld);
+SHOULD_NOT_DO_GRADIENT(JoinCommonWorld);
+SHOULD_NOT_DO_GRADIENT(RingBandwidth);
 SHOULD_NOT_DO_GRADIENT(Broadcast);
 SHOULD_NOT_DO_GRADIENT(Reduce);
 SHOULD_NOT_DO_GRADIENT(Allgather);
 SHOULD_NOT_DO_GRADIENT(Allreduce);
+SHOULD_NOT_DO_GRADIENT(AllreduceAsync);
+SHOULD_NOT_DO_GRADIENT(WaitCollective);
 SHOULD_NOT_DO_GRADIENT(SendTensor);
 SHOULD_NOT_DO_GRADIENT(ReceiveTensor);
+SHOULD_NOT_DO_GRADIENT(SparsePull);
+SHOULD_NOT_DO_GRADIENT(SparsePush);
 
 // Communication operators do not have default engines.
 REGISTER_CPU_OPERATOR(CreateCommonWorld, NoDefaultEngineOp<CPUContext>);
+REGISTER_CPU_OPERATOR(JoinCommonWorld, NoDefaultEngineOp<CPUContext>);
+REGISTER_CPU_OPERATOR(RingBandwidth, NoDefaultEngineOp<CPUContext>);
 REGISTER_CPU_OPERATOR(Broadcast, NoDefaultEngineOp<CPUContext>);
 REGISTER_CPU_OPERATOR(Reduce, NoDefaultEngineOp<CPUContext>);
 REGISTER_CPU_OPERATOR(Allgather, NoDefaultEngineOp<CPUContext>);
 REGISTER_CPU_OPERATOR(Allreduce, NoDefaultEngineOp<CPUContext>);
+REGISTER_CPU_OPERATOR(AllreduceAsync, NoDefaultEngineOp<CPUContext>);
+REGISTER_CPU_OPERATOR(WaitCollective, NoDefaultEngineOp<CPUContext>);
 REGISTER_CPU_OPERATOR(SendTensor, NoDefaultEngineOp<CPUContext>);
 REGISTER_CPU_OPERATOR(ReceiveTensor, NoDefaultEngineOp<CPUContext>);
+REGISTER_CPU_OPERATOR(SparsePull, NoDefaultEngineOp<CPUContext>);
+REGISTER_CPU_OPERATOR(SparsePush, NoDefaultEngineOp<CPUContext>);
 
 } // namespace caffe2
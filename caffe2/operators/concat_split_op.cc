@@ -9,12 +9,42 @@ OPERATOR_SCHEMA(Split)
     .NumOutputs(1, INT_MAX)
     .Arg("axis", "Which axis to split on")
     .Arg("order", "Either NHWC or NCWH, will split on C axis")
+    .Arg(
+        "zero_copy",
+        "If nonzero and all the dimensions before the axis are 1, e.g. when "
+        "splitting on axis 0, the outputs share the memory of the input "
+        "instead of copying it. They must then not be modified in place.")
     .SetDoc("Split a tensor into a list of tensors.");
 OPERATOR_SCHEMA(Concat)
     .NumInputs(1, INT_MAX)
     .NumOutputs(2)
     .Arg("axis", "Which axis to concat on")
     .Arg("order", "Either NHWC or HCWH, will concat on C axis")
+    .TensorInferenceFunction([](const OperatorDef& def,
+                                const vector<TensorShape>& in) {
+      ArgumentHelper helper(def);
+      const int axis = helper.HasArgument("axis")
+          ? helper.GetSingleArgument<int>("axis", -1)
+          : GetDimFromOrderString(
+                helper.GetSingleArgument<string>("order", ""));
+      vector<TensorShape> out(2);
+      out[1] = CreateTensorShape(
+          vector<int>{static_cast<int>(in.size())}, TensorProto::INT32);
+      for (const auto& shape : in) {
+        if (shape.unknown_shape()) {
+          out[0].set_unknown_shape(true);
+          return out;
+        }
+      }
+      CAFFE_ENFORCE_LT(axis, in[0].dims_size(), "Axis not in input range.");
+      vector<int> dims(in[0].dims().begin(), in[0].dims().end());
+      for (int i = 1; i < in.size(); ++i) {
+        CAFFE_ENFORCE_EQ(in[i].dims_size(), dims.size());
+        dims[axis] += in[i].dims(axis);
+      }
+      out[0] = CreateTensorShape(dims, in[0].data_type());
+      return out;
+    })
     .SetDoc("Concatenate a list of tensors into a single tensor.");
 
 // Backward compatibility names.
@@ -29,7 +29,8 @@ class SplitOp final : public Operator<Context> {
   USE_OPERATOR_CONTEXT_FUNCTIONS;
   SplitOp(const OperatorDef& operator_def, Workspace* ws)
       : Operator<Context>(operator_def, ws),
-        split_(OperatorBase::GetRepeatedArgument<int>("split")) {
+        split_(OperatorBase::GetRepeatedArgument<int>("split")),
+        zero_copy_(OperatorBase::GetSingleArgument<int>("zero_copy", 0)) {
     CAFFE_ENFORCE(
         OperatorBase::HasArgument("axis") ^ OperatorBase::HasArgument("order"),
         "You should either specify the dim to split, or the order "
@@ -48,6 +49,7 @@ class SplitOp final : public Operator<Context> {
  protected:
   int axis_;
   vector<int> split_;
+  bool zero_copy_;
   // Input: X, optionally split
   // The split tensor is stored in CPU.
 };
@@ -133,6 +135,12 @@ bool SplitOp<Context>::RunOnDevice() {
     auto* output = Output(i);
     output_dims[axis_] = axis_data[i];
     output->Resize(output_dims);
+    if (zero_copy_ && before == 1) {
+      // Each output is a contiguous range of the input.
+      output->ShareDataSlice(input, input_offset / input.itemsize());
+      input_offset += axis_data[i] * after * input.itemsize();
+      continue;
+    }
     math::CopyMatrix<Context>(
         input.itemsize(),
         before,
@@ -210,16 +218,23 @@ bool ConcatOp<Context>::RunOnDevice() {
   output_dims[axis_] = output_channels;
   output->Resize(output_dims);
   int output_offset = 0;
+  char* output_data =
+      static_cast<char*>(output->raw_mutable_data(input_zero.meta()));
   for (int i = 0; i < InputSize(); ++i) {
     auto& input = Input(i);
+    // The memory planner may have placed the input in its slice of the
+    // output already, see PlanStaticMemory().
+    if (before == 1 && input.raw_data() == output_data + output_offset) {
+      output_offset += input.dim32(axis_) * after * input.itemsize();
+      continue;
+    }
     math::CopyMatrix<Context>(
         input.itemsize(),
         before,
         input.dim32(axis_) * after,
         input.raw_data(),
         input.dim32(axis_) * after,
-        static_cast<char*>(output->raw_mutable_data(input_zero.meta())) +
-            output_offset,
+        output_data + output_offset,
         output_channels * after,
         &context_);
     output_offset += input.dim32(axis_) * after * input.itemsize();
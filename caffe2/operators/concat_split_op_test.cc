@@ -0,0 +1,50 @@
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+TEST(SplitOpTest, ZeroCopyOnOuterAxis) {
+  Workspace ws;
+  auto* X = ws.CreateBlob("X")->GetMutable<TensorCPU>();
+  X->Resize(5, 3);
+  for (int i = 0; i < X->size(); ++i) {
+    X->mutable_data<float>()[i] = i;
+  }
+  OperatorDef def;
+  def.set_type("Split");
+  def.add_input("X");
+  def.add_output("A");
+  def.add_output("B");
+  AddArgument<int>("axis", 0, &def);
+  AddArgument<vector<int>>("split", vector<int>{2, 3}, &def);
+  AddArgument<int>("zero_copy", 1, &def);
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& A = ws.GetBlob("A")->Get<TensorCPU>();
+  const auto& B = ws.GetBlob("B")->Get<TensorCPU>();
+  EXPECT_EQ(A.dims(), vector<TIndex>({2, 3}));
+  EXPECT_EQ(B.dims(), vector<TIndex>({3, 3}));
+  EXPECT_EQ(A.data<float>(), X->data<float>());
+  EXPECT_EQ(B.data<float>(), X->data<float>() + 6);
+
+  // The views keep the data alive after the input is gone.
+  ws.RemoveBlob("X");
+  for (int i = 0; i < B.size(); ++i) {
+    EXPECT_EQ(B.data<float>()[i], 6 + i);
+  }
+
+  // Concat puts the views back together.
+  OperatorDef concat;
+  concat.set_type("Concat");
+  concat.add_input("A");
+  concat.add_input("B");
+  concat.add_output("Y");
+  concat.add_output("Y_split");
+  AddArgument<int>("axis", 0, &concat);
+  ASSERT_TRUE(ws.RunOperatorOnce(concat));
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  for (int i = 0; i < Y.size(); ++i) {
+    EXPECT_EQ(Y.data<float>()[i], i);
+  }
+}
+
+} // namespace caffe2
@@ -0,0 +1,65 @@
+#include "caffe2/operators/control_ops.h"
+
+namespace caffe2 {
+namespace {
+
+REGISTER_CPU_OPERATOR(If, IfOp<CPUContext>);
+REGISTER_CPU_OPERATOR(While, WhileOp<CPUContext>);
+
+OPERATOR_SCHEMA(If)
+    .NumInputs(1, INT_MAX)
+    .NumOutputs(0, INT_MAX)
+    .AllowInplace([](int, int) { return true; })
+    .SetDoc(R"DOC(
+Runs `then_net` if the scalar bool `condition` is true, and `else_net`, if
+given, otherwise. The subnets run in the workspace of the operator, and are
+created on the first run that needs them and then reused.
+
+The other inputs and the outputs are not used by the operator, but should list
+the blobs that the subnets read and write, so that DAG nets schedule the
+operator after the operators that produce them, and before the ones that use
+them.
+)DOC")
+    .Arg("then_net", "The NetDef, in text format, run if condition is true.")
+    .Arg("else_net", "The NetDef, in text format, run if condition is false.")
+    .Input(
+        0,
+        "condition",
+        "A scalar bool tensor, on the CPU or on the device of the operator.")
+    .Input(1, "inputs", "The blobs that the subnets read.")
+    .Output(0, "outputs", "The blobs that the subnets write.");
+
+OPERATOR_SCHEMA(While)
+    .NumInputs(1, INT_MAX)
+    .NumOutputs(0, INT_MAX)
+    .AllowInplace([](int, int) { return true; })
+    .SetDoc(R"DOC(
+Runs `loop_net` as long as the scalar bool `condition` is true, all within one
+run of the net, rather than with an execution step that checks a stop blob on
+the host between iterations. Before each iteration `cond_net`, if given, runs
+to update `condition`, otherwise `loop_net` must update it. The condition is
+read directly if it is a CPU tensor, and is the only data copied to the host
+otherwise.
+
+The subnets run in the workspace of the operator, and are created on their
+first run and then reused. The other inputs and the outputs are not used by
+the operator, but should list the blobs that the subnets read and write, for
+DAG nets to schedule the operator.
+)DOC")
+    .Arg("loop_net", "The NetDef of the body of the loop, in text format.")
+    .Arg("cond_net", "The NetDef, in text format, that updates condition.")
+    .Arg(
+        "max_iterations",
+        "If not negative, the loop stops after this many iterations.")
+    .Input(
+        0,
+        "condition",
+        "A scalar bool tensor, on the CPU or on the device of the operator.")
+    .Input(1, "inputs", "The blobs that the subnets read.")
+    .Output(0, "outputs", "The blobs that the subnets write.");
+
+SHOULD_NOT_DO_GRADIENT(If);
+SHOULD_NOT_DO_GRADIENT(While);
+
+} // namespace
+} // namespace caffe2
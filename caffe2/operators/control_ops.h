@@ -0,0 +1,140 @@
+#ifndef CAFFE2_OPERATORS_CONTROL_OPS_H_
+#define CAFFE2_OPERATORS_CONTROL_OPS_H_
+
+#include <memory>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor.h"
+#include "google/protobuf/text_format.h"
+
+namespace caffe2 {
+
+/**
+ * The base of If and While, which run subnets of a net in its own workspace,
+ * depending on a scalar bool condition in their first input, instead of
+ * leaving the net for the plan or Python to check the condition.
+ *
+ * The subnets are given as NetDefs in text format, and are created on their
+ * first run, once the blobs that they read exist, and then reused. The
+ * condition is read directly if it is a CPU tensor. Otherwise it is the only
+ * thing that is copied to the host, with a single wait on the device, and the
+ * work of the subnets stays on the device.
+ */
+template <class Context>
+class ControlOpBase : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  ControlOpBase(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws), ws_(ws) {}
+
+ protected:
+  // Parses the NetDef of the argument, or returns false if it is not given.
+  bool ParseNet(const string& arg, NetDef* net_def) {
+    const auto text = OperatorBase::GetSingleArgument<string>(arg, "");
+    if (text.empty()) {
+      return false;
+    }
+    CAFFE_ENFORCE(
+        google::protobuf::TextFormat::ParseFromString(text, net_def),
+        "Invalid NetDef in ",
+        arg);
+    return true;
+  }
+
+  void RunNet(const NetDef& net_def, std::unique_ptr<NetBase>* net) {
+    if (!*net) {
+      *net = CreateNet(net_def, ws_);
+      CAFFE_ENFORCE(*net, "Cannot create the subnet ", net_def.name());
+    }
+    CAFFE_ENFORCE((*net)->Run(), "Subnet ", net_def.name(), " failed");
+  }
+
+  bool ReadCondition() {
+    const Blob& blob = OperatorBase::InputBlob(0);
+    if (blob.template IsType<TensorCPU>()) {
+      const auto& condition = blob.template Get<TensorCPU>();
+      CAFFE_ENFORCE_EQ(condition.size(), 1, "The condition must be a scalar");
+      return condition.template data<bool>()[0];
+    }
+    const auto& condition = Input(0);
+    CAFFE_ENFORCE_EQ(condition.size(), 1, "The condition must be a scalar");
+    bool value = false;
+    context_.template Copy<bool, Context, CPUContext>(
+        1, condition.template data<bool>(), &value);
+    context_.FinishDeviceComputation();
+    return value;
+  }
+
+ private:
+  Workspace* ws_;
+};
+
+template <class Context>
+class IfOp final : public ControlOpBase<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  IfOp(const OperatorDef& operator_def, Workspace* ws)
+      : ControlOpBase<Context>(operator_def, ws) {
+    CAFFE_ENFORCE(
+        this->ParseNet("then_net", &then_net_def_), "then_net must be given.");
+    has_else_net_ = this->ParseNet("else_net", &else_net_def_);
+  }
+
+  bool RunOnDevice() override {
+    if (this->ReadCondition()) {
+      this->RunNet(then_net_def_, &then_net_);
+    } else if (has_else_net_) {
+      this->RunNet(else_net_def_, &else_net_);
+    }
+    return true;
+  }
+
+ private:
+  NetDef then_net_def_;
+  NetDef else_net_def_;
+  bool has_else_net_;
+  std::unique_ptr<NetBase> then_net_;
+  std::unique_ptr<NetBase> else_net_;
+};
+
+template <class Context>
+class WhileOp final : public ControlOpBase<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  WhileOp(const OperatorDef& operator_def, Workspace* ws)
+      : ControlOpBase<Context>(operator_def, ws),
+        max_iterations_(
+            OperatorBase::GetSingleArgument<int64_t>("max_iterations", -1)) {
+    CAFFE_ENFORCE(
+        this->ParseNet("loop_net", &loop_net_def_), "loop_net must be given.");
+    has_cond_net_ = this->ParseNet("cond_net", &cond_net_def_);
+  }
+
+  bool RunOnDevice() override {
+    for (int64_t i = 0; max_iterations_ < 0 || i < max_iterations_; ++i) {
+      if (has_cond_net_) {
+        this->RunNet(cond_net_def_, &cond_net_);
+      }
+      if (!this->ReadCondition()) {
+        break;
+      }
+      this->RunNet(loop_net_def_, &loop_net_);
+    }
+    return true;
+  }
+
+ private:
+  int64_t max_iterations_;
+  NetDef loop_net_def_;
+  NetDef cond_net_def_;
+  bool has_cond_net_;
+  std::unique_ptr<NetBase> loop_net_;
+  std::unique_ptr<NetBase> cond_net_;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_CONTROL_OPS_H_
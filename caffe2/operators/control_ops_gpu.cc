@@ -0,0 +1,9 @@
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/operators/control_ops.h"
+
+namespace caffe2 {
+namespace {
+REGISTER_CUDA_OPERATOR(If, IfOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(While, WhileOp<CUDAContext>);
+}
+}
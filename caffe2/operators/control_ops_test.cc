@@ -0,0 +1,113 @@
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Adds 1 to the int scalar of its input, and sets the bool scalar of its
+// output to whether the result is below `limit`.
+class ControlOpsTestCountOp final : public OperatorBase {
+ public:
+  using OperatorBase::OperatorBase;
+  bool Run() override {
+    auto* counter = Outputs()[0]->GetMutable<TensorCPU>();
+    counter->Resize(1);
+    ++counter->mutable_data<int>()[0];
+    auto* condition = Output<TensorCPU>(1);
+    condition->Resize(1);
+    condition->mutable_data<bool>()[0] = counter->data<int>()[0] <
+        GetSingleArgument<int>("limit", 0);
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(ControlOpsTestCount, ControlOpsTestCountOp);
+OPERATOR_SCHEMA(ControlOpsTestCount).NumInputs(0).NumOutputs(2);
+
+void SetScalar(Workspace* ws, const string& name, int value) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(1);
+  tensor->mutable_data<int>()[0] = value;
+}
+
+void SetCondition(Workspace* ws, bool value) {
+  auto* tensor = ws->CreateBlob("condition")->GetMutable<TensorCPU>();
+  tensor->Resize(1);
+  tensor->mutable_data<bool>()[0] = value;
+}
+
+int GetScalar(Workspace* ws, const string& name) {
+  return ws->GetBlob(name)->Get<TensorCPU>().data<int>()[0];
+}
+
+string CountNet(const string& counter, int limit) {
+  return "op { type: 'ControlOpsTestCount' output: '" + counter +
+      "' output: 'condition' arg { name: 'limit' i: " +
+      std::to_string(limit) + " } }";
+}
+
+} // namespace
+
+TEST(ControlOpsTest, If) {
+  Workspace ws;
+  SetScalar(&ws, "then", 0);
+  SetScalar(&ws, "else", 0);
+  OperatorDef def = CreateOperatorDef(
+      "If",
+      "",
+      vector<string>{"condition"},
+      vector<string>{"then", "else"},
+      vector<Argument>{MakeArgument<string>("then_net", CountNet("then", 0)),
+                       MakeArgument<string>("else_net", CountNet("else", 0))});
+  for (bool condition : {true, true, false}) {
+    SetCondition(&ws, condition);
+    ASSERT_TRUE(ws.RunOperatorOnce(def));
+  }
+  EXPECT_EQ(GetScalar(&ws, "then"), 2);
+  EXPECT_EQ(GetScalar(&ws, "else"), 1);
+}
+
+TEST(ControlOpsTest, While) {
+  Workspace ws;
+  NetDef net;
+  net.set_name("outer");
+  net.add_op()->CopyFrom(CreateOperatorDef(
+      "While",
+      "",
+      vector<string>{"condition"},
+      vector<string>{"counter", "condition"},
+      vector<Argument>{
+          MakeArgument<string>("loop_net", CountNet("counter", 10))}));
+  SetScalar(&ws, "counter", 0);
+  SetCondition(&ws, true);
+  ASSERT_TRUE(ws.CreateNet(net));
+  ASSERT_TRUE(ws.RunNet("outer"));
+  EXPECT_EQ(GetScalar(&ws, "counter"), 10);
+  // The loop net is kept, and runs again.
+  SetCondition(&ws, true);
+  ASSERT_TRUE(ws.RunNet("outer"));
+  EXPECT_EQ(GetScalar(&ws, "counter"), 11);
+}
+
+TEST(ControlOpsTest, WhileWithCondNetAndMaxIterations) {
+  Workspace ws;
+  SetScalar(&ws, "counter", 0);
+  SetScalar(&ws, "body", 0);
+  SetCondition(&ws, false);
+  OperatorDef def = CreateOperatorDef(
+      "While",
+      "",
+      vector<string>{"condition"},
+      vector<string>{"counter", "body", "condition"},
+      vector<Argument>{
+          MakeArgument<string>("cond_net", CountNet("counter", 100)),
+          MakeArgument<string>("loop_net", CountNet("body", 0)),
+          MakeArgument<int>("max_iterations", 5)});
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  EXPECT_EQ(GetScalar(&ws, "counter"), 5);
+  EXPECT_EQ(GetScalar(&ws, "body"), 5);
+}
+
+} // namespace caffe2
@@ -1,16 +1,231 @@
+#include <cstring>
+
+#include "caffe2/core/common_omp.h"
+#include "caffe2/core/parallel_for.h"
 #include "caffe2/operators/conv_op.h"
 #include "caffe2/operators/conv_op_impl.h"
 #include "caffe2/operators/conv_pool_op_base.h"
 
 namespace caffe2 {
+
+namespace {
+
+// Direct convolution in the NCHWc order. Each output position accumulates a
+// block of output channels, over the input blocks and the kernel window, so
+// the innermost loop is a multiply-add over kBlock contiguous floats that the
+// compiler vectorizes. kBlock is 0 for block sizes only known at run time.
+template <int kBlock>
+void ConvNCHWc(
+    const float* X,
+    const float* filter, // Mb x Cb x kH x kW x block (in) x block (out)
+    const float* bias,
+    int N,
+    int Cb,
+    int H,
+    int W,
+    int Mb,
+    int OH,
+    int OW,
+    int block,
+    int kernel_h,
+    int kernel_w,
+    int dilation_h,
+    int dilation_w,
+    int stride_h,
+    int stride_w,
+    int pad_t,
+    int pad_l,
+    bool relu,
+    float* Y) {
+  const int B = kBlock ? kBlock : block;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int row = 0; row < N * Mb * OH; ++row) {
+    const int n = row / (Mb * OH);
+    const int mb = row / OH % Mb;
+    const int oh = row % OH;
+    std::vector<float> acc(B);
+    for (int ow = 0; ow < OW; ++ow) {
+      for (int co = 0; co < B; ++co) {
+        acc[co] = bias ? bias[mb * B + co] : 0;
+      }
+      for (int cb = 0; cb < Cb; ++cb) {
+        for (int kh = 0; kh < kernel_h; ++kh) {
+          const int ih = oh * stride_h - pad_t + kh * dilation_h;
+          if (ih < 0 || ih >= H) {
+            continue;
+          }
+          for (int kw = 0; kw < kernel_w; ++kw) {
+            const int iw = ow * stride_w - pad_l + kw * dilation_w;
+            if (iw < 0 || iw >= W) {
+              continue;
+            }
+            const float* x = X + (((n * Cb + cb) * H + ih) * W + iw) * B;
+            const float* w = filter +
+                (((mb * Cb + cb) * kernel_h + kh) * kernel_w + kw) * B * B;
+            for (int ci = 0; ci < B; ++ci) {
+              const float xv = x[ci];
+              for (int co = 0; co < B; ++co) {
+                acc[co] += xv * w[ci * B + co];
+              }
+            }
+          }
+        }
+      }
+      float* y = Y + (((n * Mb + mb) * OH + oh) * OW + ow) * B;
+      for (int co = 0; co < B; ++co) {
+        y[co] = relu && acc[co] < 0 ? 0 : acc[co];
+      }
+    }
+  }
+}
+
+} // namespace
+
+template <>
+bool ConvOp<float, CPUContext>::RunOnDeviceWithOrderNCHWc() {
+  const auto& X = Input(INPUT);
+  auto& filter = Input(FILTER);
+  auto* Y = Output(0);
+  CAFFE_ENFORCE(5 == X.ndim());
+  CAFFE_ENFORCE(4 == filter.ndim());
+  CAFFE_ENFORCE(group_ == 1, "Group convolution is not supported in NCHWc.");
+  const int N = X.dim32(0), Cb = X.dim32(1), H = X.dim32(2), W = X.dim32(3);
+  const int B = X.dim32(4);
+  const int M = filter.dim32(0);
+  CAFFE_ENFORCE(
+      filter.dim32(1) == Cb * B,
+      "Convolution op: input channels does not match: # of input channels ",
+      Cb * B,
+      " is not equal to kernel channels ",
+      filter.dim32(1));
+  CAFFE_ENFORCE(filter.dim32(2) == kernel_h_);
+  CAFFE_ENFORCE(filter.dim32(3) == kernel_w_);
+  ConvPoolOpBase<CPUContext>::SetOutputSize(X, Y, M);
+  const int Mb = M / B;
+  const float* bias = nullptr;
+  if (InputSize() == 3) {
+    auto& bias_input = Input(BIAS);
+    CAFFE_ENFORCE(bias_input.ndim() == 1);
+    CAFFE_ENFORCE(bias_input.dim32(0) == M);
+    bias = bias_input.data<float>();
+  }
+
+  // Blocks the filter once, and again only when it changes.
+  const float* g = filter.data<float>();
+  const int kernel_size = kernel_h_ * kernel_w_;
+  if (nchwc_filter_source_.size() != filter.size() ||
+      nchwc_filter_.ndim() != 5 || nchwc_filter_.dim32(4) != B ||
+      memcmp(nchwc_filter_source_.data(), g, filter.nbytes()) != 0) {
+    nchwc_filter_source_.assign(g, g + filter.size());
+    nchwc_filter_.Resize(vector<TIndex>{Mb, Cb, kernel_size, B, B});
+    float* blocked = nchwc_filter_.mutable_data<float>();
+    for (int m = 0; m < M; ++m) {
+      for (int c = 0; c < Cb * B; ++c) {
+        for (int k = 0; k < kernel_size; ++k) {
+          blocked[(((m / B * Cb + c / B) * kernel_size + k) * B + c % B) * B +
+                  m % B] = g[(m * Cb * B + c) * kernel_size + k];
+        }
+      }
+    }
+  }
+
+  auto conv = B == 8 ? ConvNCHWc<8> : B == 16 ? ConvNCHWc<16> : ConvNCHWc<0>;
+  conv(
+      X.data<float>(),
+      nchwc_filter_.data<float>(),
+      bias,
+      N,
+      Cb,
+      H,
+      W,
+      Mb,
+      Y->dim32(2),
+      Y->dim32(3),
+      B,
+      kernel_h_,
+      kernel_w_,
+      dilation_h_,
+      dilation_w_,
+      stride_h_,
+      stride_w_,
+      pad_t_,
+      pad_l_,
+      relu_,
+      Y->mutable_data<float>());
+  return true;
+}
+
+template <>
+void ConvFilterGemm<float, CPUContext>(
+    int M,
+    int N,
+    int K,
+    const float* W,
+    const float* col,
+    float* Y,
+    Workspace* ws,
+    CPUContext* context) {
+#if CAFFE2_MOBILE
+  // Each thread computes a block of whole output channels, which keeps the
+  // blocks of Y contiguous. Small gemms are not worth the dispatch.
+  constexpr int kMinRowsPerBlock = 4;
+  constexpr int kMinFlopsPerBlock = 1 << 16;
+  const int num_blocks = std::min(
+      ParallelForNumThreads(ws),
+      std::min(
+          M / kMinRowsPerBlock,
+          static_cast<int>(
+              static_cast<int64_t>(M) * N * K / kMinFlopsPerBlock)));
+  if (num_blocks > 1) {
+    const int rows_per_block = (M + num_blocks - 1) / num_blocks;
+    ParallelFor(ws, num_blocks, [&](int /* unused */, size_t block) {
+      const int begin = block * rows_per_block;
+      const int rows = std::min(rows_per_block, M - begin);
+      if (rows > 0) {
+        math::Gemm<float, CPUContext>(
+            CblasNoTrans,
+            CblasNoTrans,
+            rows,
+            N,
+            K,
+            1,
+            W + begin * K,
+            col,
+            0,
+            Y + begin * N,
+            context);
+      }
+    });
+    return;
+  }
+#else
+  (void)ws;
+#endif
+  math::Gemm<float, CPUContext>(
+      CblasNoTrans, CblasNoTrans, M, N, K, 1, W, col, 0, Y, context);
+}
+
+template <>
+void ConvReluEpilogue<float, CPUContext>(
+    int size,
+    float* Y,
+    CPUContext* /* unused */) {
+  EigenVectorArrayMap<float> Y_arr(Y, size);
+  Y_arr = Y_arr.cwiseMax(0.f);
+}
+
 namespace {
 
 REGISTER_CPU_OPERATOR(Conv, ConvOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR(ConvBiasRelu, ConvOp<float, CPUContext>);
 
 OPERATOR_SCHEMA(Conv)
   .NumInputs(2,3)
   .NumOutputs(1)
   .TensorInferenceFunction(ConvPoolOpBase<CPUContext>::TensorInferenceForConv)
+  .CostInferenceFunction(ConvPoolOpBase<CPUContext>::CostInferenceForConv)
   .SetDoc(R"DOC(
 The convolution operator consumes an input vector, the filter blob and the bias
 blob and computes the output. Note that other parameters, such as the stride and
@@ -37,5 +252,24 @@ why they are separate files.
   "stride size, and pad lengths."
   "");
 
+OPERATOR_SCHEMA(ConvBiasRelu)
+  .NumInputs(2,3)
+  .NumOutputs(1)
+  .TensorInferenceFunction(ConvPoolOpBase<CPUContext>::TensorInferenceForConv)
+  .CostInferenceFunction(ConvPoolOpBase<CPUContext>::CostInferenceForConv)
+  .SetDoc(R"DOC(
+Same as Conv, followed by a ReLU: Y = max(conv(X, filter) + bias, 0). The ReLU
+is applied to each output image as soon as it is computed, so the output does
+not make a second trip through memory. FoldConvBatchNorm in
+core/conv_bn_folding.h produces this operator from Conv, SpatialBN and Relu in
+inference nets. There is no gradient: it is meant for inference.
+)DOC")
+  .Input(0, "X", "Input data blob, as for Conv.")
+  .Input(1, "filter", "The filter blob, as for Conv.")
+  .Input(2, "bias", "The optional 1D bias blob of size (M).")
+  .Output(0, "Y", "The output of the convolution after the ReLU.");
+
+NO_GRADIENT(ConvBiasRelu);
+
 }  // namespace
 }  // namespace caffe2
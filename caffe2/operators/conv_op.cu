@@ -0,0 +1,21 @@
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/operators/conv_op.h"
+
+namespace caffe2 {
+namespace {
+__global__ void ConvReluEpilogueKernel(const int N, float* Y) {
+  CUDA_1D_KERNEL_LOOP(i, N) {
+    Y[i] = Y[i] > 0 ? Y[i] : 0;
+  }
+}
+}  // namespace
+
+template <>
+void ConvReluEpilogue<float, CUDAContext>(
+    int size,
+    float* Y,
+    CUDAContext* context) {
+  ConvReluEpilogueKernel<<<CAFFE_GET_BLOCKS(size), CAFFE_CUDA_NUM_THREADS,
+                           0, context->cuda_stream()>>>(size, Y);
+}
+}  // namespace caffe2
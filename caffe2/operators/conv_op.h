@@ -12,7 +12,8 @@ class ConvOp final : public ConvPoolOpBase<Context> {
  public:
   USE_CONV_POOL_BASE_FUNCTIONS(Context);
   ConvOp(const OperatorDef& operator_def, Workspace* ws)
-      : ConvPoolOpBase<Context>(operator_def, ws) {
+      : ConvPoolOpBase<Context>(operator_def, ws),
+        relu_(operator_def.type() == "ConvBiasRelu") {
     // Since this is the default convolution implementation, we will
     // use CAFFE_ENFORCE instead of OPERATOR_NEEDS_FEATURE.
     CAFFE_ENFORCE(
@@ -23,15 +24,68 @@ class ConvOp final : public ConvPoolOpBase<Context> {
 
   bool RunOnDeviceWithOrderNCHW() override;
   bool RunOnDeviceWithOrderNHWC() override;
+  // Only implemented on CPU. The filter is in the NCHW layout.
+  bool RunOnDeviceWithOrderNCHWc() override;
 
  private:
+  // ConvBiasRelu applies ReLU to each output image right after computing it,
+  // while it is still in the cache.
+  const bool relu_;
   Tensor<Context> col_buffer_;
   Tensor<Context> bias_multiplier_;
+  // The filter of the last NCHWc run, and its blocked copy.
+  vector<T> nchwc_filter_source_;
+  TensorCPU nchwc_filter_;
   // Input: X, W, b
   // Output: Y
   INPUT_TAGS(INPUT, FILTER, BIAS);
 };
 
+template <>
+bool ConvOp<float, CPUContext>::RunOnDeviceWithOrderNCHWc();
+
+// Y = W * col, the weight term of one group of the NCHW convolution, with W
+// of M x K and col of K x N. On mobile, the CPU version splits the rows of W
+// across the thread pool of ws.
+template <typename T, class Context>
+void ConvFilterGemm(
+    int M,
+    int N,
+    int K,
+    const T* W,
+    const T* col,
+    T* Y,
+    Workspace* ws,
+    Context* context);
+
+template <>
+void ConvFilterGemm<float, CPUContext>(
+    int M,
+    int N,
+    int K,
+    const float* W,
+    const float* col,
+    float* Y,
+    Workspace* ws,
+    CPUContext* context);
+
+// Y = max(Y, 0) in place, the epilogue of ConvBiasRelu.
+template <typename T, class Context>
+void ConvReluEpilogue(int size, T* Y, Context* context);
+
+template <>
+void ConvReluEpilogue<float, CPUContext>(
+    int size,
+    float* Y,
+    CPUContext* context);
+
+class CUDAContext;
+template <>
+void ConvReluEpilogue<float, CUDAContext>(
+    int size,
+    float* Y,
+    CUDAContext* context);
+
 template <typename T, class Context>
 class ConvGradientOp final : public ConvPoolOpBase<Context> {
  public:
@@ -1,16 +1,118 @@
 #include "caffe2/operators/conv_op_cache_cudnn.h"
 
 #include <cudnn.h>
+#include <fstream>
+#include <sstream>
 
+#include "caffe2/core/common_gpu.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/tensor.h"
 
+CAFFE2_DEFINE_string(
+    caffe2_cudnn_algo_cache_file,
+    "",
+    "If set, the cuDNN algorithms found by exhaustive search are loaded from "
+    "and appended to this file, so that later runs on the same GPU model and "
+    "cuDNN version skip the search.");
+
 namespace caffe2 {
 
+namespace {
+
+void AppendDims(const std::vector<TIndex>& dims, std::ostringstream* out) {
+  *out << '|';
+  for (size_t i = 0; i < dims.size(); ++i) {
+    *out << (i ? "," : "") << dims[i];
+  }
+}
+
+} // namespace
+
+AlgorithmsStore::AlgorithmsStore()
+    : file_(FLAGS_caffe2_cudnn_algo_cache_file) {
+  if (!file_.empty()) {
+    const int count = Load(file_);
+    VLOG(1) << "Loaded " << count << " cuDNN algorithms from " << file_;
+  }
+}
+
+AlgorithmsStore& AlgorithmsStore::Instance() {
+  static AlgorithmsStore store;
+  return store;
+}
+
+bool AlgorithmsStore::Find(const string& key, int* algo) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = algos_.find(key);
+  if (it == algos_.end()) {
+    return false;
+  }
+  *algo = it->second;
+  return true;
+}
+
+void AlgorithmsStore::Insert(const string& key, int algo) {
+  CAFFE_ENFORCE(
+      key.find_first_of("\t\n") == string::npos,
+      "Invalid algorithm key: ",
+      key);
+  std::lock_guard<std::mutex> lock(mutex_);
+  algos_[key] = algo;
+  if (!file_.empty()) {
+    std::ofstream out(file_, std::ios::app);
+    out << key << '\t' << algo << '\n';
+    if (!out) {
+      LOG(WARNING) << "Could not append to the cuDNN algorithm cache " << file_;
+    }
+  }
+}
+
+int AlgorithmsStore::Load(const string& path) {
+  std::ifstream in(path);
+  if (!in) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  int count = 0;
+  string line;
+  while (std::getline(in, line)) {
+    const auto tab = line.rfind('\t');
+    if (tab == string::npos || tab + 1 == line.size()) {
+      LOG(WARNING) << "Skipping malformed line in " << path << ": " << line;
+      continue;
+    }
+    // Later lines win, as they were appended by later searches.
+    algos_[line.substr(0, tab)] = std::stoi(line.substr(tab + 1));
+    ++count;
+  }
+  return count;
+}
+
+void AlgorithmsStore::Save(const string& path) const {
+  std::ofstream out(path, std::ios::trunc);
+  CAFFE_ENFORCE(out, "Cannot open ", path, " for writing.");
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& it : algos_) {
+    out << it.first << '\t' << it.second << '\n';
+  }
+  CAFFE_ENFORCE(out, "Failed to write ", path);
+}
+
+size_t AlgorithmsStore::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return algos_.size();
+}
+
+void AlgorithmsStore::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  algos_.clear();
+}
+
 template <typename T>
 T AlgorithmsCache<T>::getAlgorithm(
     const std::vector<TIndex>& vec1,
     const std::vector<TIndex>& vec2,
+    const std::vector<TIndex>& params,
     std::function<T()> generatingFunc) {
   int64_t seed = 0;
   std::hash<TIndex> hashFn;
@@ -25,16 +127,42 @@ T AlgorithmsCache<T>::getAlgorithm(
     seed ^= hashFn(num) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
   }
 
+  for (const auto num : params) {
+    seed ^= hashFn(num) + 0x9e3779b9 + (seed << 6) + (seed >> 2) + 2;
+  }
+
   if (seed == 0) {
     return generatingFunc();
   }
 
-  if (hash_.find(seed) == hash_.end()) {
-    T value = generatingFunc();
-    hash_[seed] = value;
+  auto it = hash_.find(seed);
+  if (it != hash_.end()) {
+    return it->second;
   }
 
-  return hash_[seed];
+  T value;
+  if (name_.empty()) {
+    value = generatingFunc();
+  } else {
+    // The tuned algorithm depends on the hardware and the library as much as
+    // on the problem, so both are part of the shared key.
+    std::ostringstream key;
+    key << name_ << '|' << GetDeviceProperty(GetCurrentGPUID()).name
+        << "|cudnn" << cudnnGetVersion();
+    AppendDims(vec1, &key);
+    AppendDims(vec2, &key);
+    AppendDims(params, &key);
+    auto& store = AlgorithmsStore::Instance();
+    int algo;
+    if (store.Find(key.str(), &algo)) {
+      value = static_cast<T>(algo);
+    } else {
+      value = generatingFunc();
+      store.Insert(key.str(), static_cast<int>(value));
+    }
+  }
+  hash_[seed] = value;
+  return value;
 }
 
 template class AlgorithmsCache<cudnnConvolutionFwdAlgo_t>;
@@ -2,22 +2,75 @@
 #define CAFFE2_OPERATORS_CONV_OP_CACHE_H_
 
 #include <functional>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
+#include "caffe2/core/flags.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/tensor.h"
 
+CAFFE2_DECLARE_string(caffe2_cudnn_algo_cache_file);
+
 namespace caffe2 {
+
+/**
+ * Process-wide table of tuned cuDNN algorithms shared by all the named
+ * AlgorithmsCache instances. Keys are strings that spell out the GPU model,
+ * the cuDNN version and the problem, so that a table written by one run can
+ * be read back by another. If --caffe2_cudnn_algo_cache_file is set, the
+ * table is loaded from that file on first use and every new entry is
+ * appended to it.
+ */
+class AlgorithmsStore {
+ public:
+  static AlgorithmsStore& Instance();
+
+  bool Find(const string& key, int* algo) const;
+  void Insert(const string& key, int algo);
+  // Merges the entries of a file written by Save or by a previous run into
+  // the table and returns the number of entries read. A missing file is not
+  // an error.
+  int Load(const string& path);
+  void Save(const string& path) const;
+  size_t size() const;
+  void Clear();
+
+ private:
+  AlgorithmsStore();
+
+  mutable std::mutex mutex_;
+  std::unordered_map<string, int> algos_;
+  string file_;
+};
+
 template <typename T>
 class AlgorithmsCache {
  public:
+  // An unnamed cache only remembers the algorithms found by its owner.
+  AlgorithmsCache() {}
+  // A named cache also shares them, through AlgorithmsStore, with every other
+  // cache of the same name in the process and with later runs. The name has
+  // to identify the kind of search, e.g. "conv_fwd".
+  explicit AlgorithmsCache(const string& name) : name_(name) {}
+
+  T getAlgorithm(
+      const std::vector<TIndex>& bottom,
+      const std::vector<TIndex>& desc,
+      std::function<T()> generatingFunc) {
+    return getAlgorithm(bottom, desc, std::vector<TIndex>(), generatingFunc);
+  }
+
+  // params holds whatever else besides the two shapes defines the problem:
+  // data type, storage order, workspace limit, pads, strides, groups...
   T getAlgorithm(
       const std::vector<TIndex>& bottom,
       const std::vector<TIndex>& desc,
+      const std::vector<TIndex>& params,
       std::function<T()> generatingFunc);
 
  private:
+  string name_;
   std::unordered_map<int64_t, T> hash_;
 };
 }
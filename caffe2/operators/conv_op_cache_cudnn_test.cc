@@ -1,3 +1,5 @@
+#include <cstdio>
+#include <fstream>
 #include <vector>
 
 #include "caffe2/core/context_gpu.h"
@@ -45,4 +47,62 @@ TEST(AlgorithmsCacheTest, KeysDifferIfOneVectorIsEmpty) {
   EXPECT_EQ(res2, 10);
 }
 
+TEST(AlgorithmsCacheTest, ParamsArePartOfTheKey) {
+  AlgorithmsCache<int> cache;
+  const std::vector<TIndex> dims(2, 3);
+  EXPECT_EQ(cache.getAlgorithm(dims, dims, {1}, []() { return 5; }), 5);
+  EXPECT_EQ(cache.getAlgorithm(dims, dims, {2}, []() { return 10; }), 10);
+  EXPECT_EQ(cache.getAlgorithm(dims, dims, {1}, []() { return 15; }), 5);
+}
+
+TEST(AlgorithmsCacheTest, NamedCachesShareAlgorithms) {
+  if (!HasCudaGPU()) {
+    return;
+  }
+  AlgorithmsStore::Instance().Clear();
+  const std::vector<TIndex> dims(1, 7);
+  AlgorithmsCache<int> first("test");
+  EXPECT_EQ(first.getAlgorithm(dims, dims, {1}, []() { return 5; }), 5);
+  AlgorithmsCache<int> second("test");
+  EXPECT_EQ(second.getAlgorithm(dims, dims, {1}, []() { return 10; }), 5);
+  // Unnamed caches and caches of another kind of search do not share.
+  AlgorithmsCache<int> other("other");
+  EXPECT_EQ(other.getAlgorithm(dims, dims, {1}, []() { return 10; }), 10);
+  AlgorithmsCache<int> local;
+  EXPECT_EQ(local.getAlgorithm(dims, dims, {1}, []() { return 15; }), 15);
+  EXPECT_EQ(AlgorithmsStore::Instance().size(), 2u);
+  AlgorithmsStore::Instance().Clear();
+}
+
+TEST(AlgorithmsStoreTest, SavesAndLoads) {
+  auto& store = AlgorithmsStore::Instance();
+  store.Clear();
+  store.Insert("conv_fwd|Some GPU|cudnn5105|1,3,8,8|4,3,3,3|0", 2);
+  store.Insert("conv_bwd_data|Some GPU|cudnn5105|1,3,8,8|4,3,3,3|0", 1);
+  string filename = std::tmpnam(nullptr);
+  store.Save(filename);
+  store.Clear();
+  EXPECT_EQ(store.size(), 0u);
+
+  // Lines appended later override earlier ones.
+  {
+    std::ofstream out(filename, std::ios::app);
+    out << "conv_fwd|Some GPU|cudnn5105|1,3,8,8|4,3,3,3|0\t6\n";
+  }
+  EXPECT_EQ(store.Load(filename), 3);
+  EXPECT_EQ(store.size(), 2u);
+  int algo = -1;
+  EXPECT_TRUE(
+      store.Find("conv_fwd|Some GPU|cudnn5105|1,3,8,8|4,3,3,3|0", &algo));
+  EXPECT_EQ(algo, 6);
+  EXPECT_TRUE(
+      store.Find("conv_bwd_data|Some GPU|cudnn5105|1,3,8,8|4,3,3,3|0", &algo));
+  EXPECT_EQ(algo, 1);
+  EXPECT_FALSE(store.Find("conv_fwd|Other GPU|cudnn5105", &algo));
+  std::remove(filename.c_str());
+  store.Clear();
+
+  EXPECT_EQ(store.Load(filename), 0);
+}
+
 } // namespace caffe2
@@ -6,11 +6,6 @@
 
 namespace caffe2 {
 
-// Earlier in the days Caffe sets the default cudnn workspace to 8MB. We bump
-// it up to 64MB in Caffe2, as this enables the use of Winograd in many cases,
-// something very beneficial to more recent CNN models.
-static constexpr size_t kCONV_CUDNN_WORKSPACE_LIMIT_BYTES = 64*1024*1024;
-
 // Manually specified number of algorithms implemented in CuDNN.
 // This does not have any performance implications, as we will always find the
 // fastest algorithm; setting them to the right number of algorithms will enable
@@ -38,9 +33,9 @@ class CudnnConvOpBase : public ConvPoolOpBase<CUDAContext> {
   CudnnConvOpBase(const OperatorDef& operator_def, Workspace* ws)
       : ConvPoolOpBase<CUDAContext>(operator_def, ws),
         cudnn_wrapper_(&context_),
-        cudnn_ws_nbytes_limit_(OperatorBase::GetSingleArgument<size_t>(
-            "ws_nbytes_limit",
-            kCONV_CUDNN_WORKSPACE_LIMIT_BYTES)),
+        ws_nbytes_limit_(
+            OperatorBase::GetSingleArgument<size_t>("ws_nbytes_limit", 0)),
+        cudnn_ws_nbytes_limit_(0),
         exhaustive_search_(
             OperatorBase::GetSingleArgument<int>("exhaustive_search", 0)),
         deterministic_(
@@ -119,6 +114,25 @@ class CudnnConvOpBase : public ConvPoolOpBase<CUDAContext> {
     }
   }
 
+  // Everything besides the input and filter shapes that the result of an
+  // exhaustive search depends on, for the shared algorithm caches. The
+  // configured budget is used rather than cudnn_ws_nbytes_limit_, which also
+  // depends on how far the shared workspace has grown so far.
+  template <typename T>
+  vector<TIndex> AlgorithmKeyParams() const {
+    const size_t budget = ws_nbytes_limit_
+        ? ws_nbytes_limit_
+        : static_cast<size_t>(FLAGS_caffe2_cudnn_workspace_limit_mb) << 20;
+    return vector<TIndex>{static_cast<TIndex>(cudnnTypeWrapper<T>::type),
+                          static_cast<TIndex>(order_),
+                          static_cast<TIndex>(budget),
+                          pad_t_,
+                          pad_l_,
+                          stride_h_,
+                          stride_w_,
+                          group_};
+  }
+
   vector<TIndex> cudnn_input_dims_;
   vector<TIndex> cudnn_filter_dims_;
 
@@ -130,7 +144,9 @@ class CudnnConvOpBase : public ConvPoolOpBase<CUDAContext> {
   // top desc for bias add in case we do group convolution
   cudnnTensorDescriptor_t top_desc_for_bias_;
   cudnnConvolutionDescriptor_t conv_desc_;
-  const size_t cudnn_ws_nbytes_limit_;
+  // An explicit ws_nbytes_limit argument overrides the device-wide budget.
+  const size_t ws_nbytes_limit_;
+  size_t cudnn_ws_nbytes_limit_;
   size_t cudnn_ws_nbytes_;
   bool exhaustive_search_;
   bool deterministic_;
@@ -141,7 +157,7 @@ template <typename T>
 class CudnnConvOp final : public CudnnConvOpBase {
  public:
   CudnnConvOp(const OperatorDef& operator_def, Workspace* ws)
-      : CudnnConvOpBase(operator_def, ws)  {}
+      : CudnnConvOpBase(operator_def, ws), algo_cache_("conv_fwd") {}
 
   ~CudnnConvOp() {}
 
@@ -160,6 +176,8 @@ class CudnnConvGradientOp final : public CudnnConvOpBase {
  public:
   CudnnConvGradientOp(const OperatorDef& operator_def, Workspace* ws)
       : CudnnConvOpBase(operator_def, ws),
+        filter_algo_cache_("conv_bwd_filter"),
+        data_algo_cache_("conv_bwd_data"),
         no_bias_(OperatorBase::GetSingleArgument<int>("no_bias", 0)) {
     CAFFE_ENFORCE(
         !(no_bias_ && OutputSize() == 3),
@@ -238,6 +256,9 @@ bool CudnnConvOp<T>::RunOnDevice() {
   bool filter_changed = (filter.dims() != cudnn_filter_dims_);
   if (input_changed || filter_changed) {
     VLOG(1) << "Changing the cudnn descriptor configurations.";
+    cudnn_ws_nbytes_limit_ = ws_nbytes_limit_
+        ? ws_nbytes_limit_
+        : cudnn_wrapper_.workspace_limit(cudnn_state_);
     if (input_changed) {
       cudnn_input_dims_ = X.dims();
       SetTensor4dDescriptorWithGroup<T>(bottom_desc_, N, C, H, W);
@@ -276,7 +297,8 @@ bool CudnnConvOp<T>::RunOnDevice() {
     if (deterministic_) {
       algo_ = CUDNN_CONVOLUTION_FWD_ALGO_IMPLICIT_PRECOMP_GEMM;
     } else if (exhaustive_search_) {
-      algo_ = algo_cache_.getAlgorithm(X.dims(), filter.dims(), [&]() {
+      algo_ = algo_cache_.getAlgorithm(
+          X.dims(), filter.dims(), AlgorithmKeyParams<T>(), [&]() {
         VLOG(1) << "CUDNN Convolution: doing exhaustive search.";
         // When we do an exhaustive search, we will ignore the workspace size
         // limit and simply go for the fastest algorithm. If you happen to run
@@ -418,6 +440,9 @@ bool CudnnConvGradientOp<T>::RunOnDevice() {
   bool filter_changed = (filter.dims() != cudnn_filter_dims_);
   if (input_changed || filter_changed) {
     VLOG(1) << "Changing the cudnn descriptor configurations.";
+    cudnn_ws_nbytes_limit_ = ws_nbytes_limit_
+        ? ws_nbytes_limit_
+        : cudnn_wrapper_.workspace_limit(cudnn_state_);
     if (input_changed) {
       cudnn_input_dims_ = X.dims();
       SetTensor4dDescriptorWithGroup<T>(bottom_desc_, N, C, H, W);
@@ -462,7 +487,8 @@ bool CudnnConvGradientOp<T>::RunOnDevice() {
       bwd_filter_algo_ = CUDNN_CONVOLUTION_BWD_FILTER_ALGO_1;
     } else if (exhaustive_search_) {
       bwd_filter_algo_ =
-          filter_algo_cache_.getAlgorithm(X.dims(), filter.dims(), [&]() {
+          filter_algo_cache_.getAlgorithm(
+              X.dims(), filter.dims(), AlgorithmKeyParams<T>(), [&]() {
             VLOG(1) << "CUDNN Convolution bwd: doing filter exhaustive search.";
             // When we do an exhaustive search, we will ignore the workspace
             // size
@@ -501,7 +527,8 @@ bool CudnnConvGradientOp<T>::RunOnDevice() {
 
       if (OutputSize() == 3 || (no_bias_ && (OutputSize() == 2))) {
         bwd_data_algo_ =
-            data_algo_cache_.getAlgorithm(X.dims(), filter.dims(), [&]() {
+            data_algo_cache_.getAlgorithm(
+                X.dims(), filter.dims(), AlgorithmKeyParams<T>(), [&]() {
               VLOG(1) << "CUDNN Convolution bwd: doing data exhaustive search.";
               int returned_algo_count;
 
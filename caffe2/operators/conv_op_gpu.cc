@@ -6,5 +6,6 @@ namespace caffe2 {
 namespace {
 REGISTER_CUDA_OPERATOR(Conv, ConvOp<float, CUDAContext>);
 REGISTER_CUDA_OPERATOR(ConvGradient, ConvGradientOp<float, CUDAContext>);
+REGISTER_CUDA_OPERATOR(ConvBiasRelu, ConvOp<float, CUDAContext>);
 }  // namespace
 }  // namespace caffe2
@@ -15,6 +15,20 @@ CAFFE2_DECLARE_bool(caffe2_force_shared_col_buffer);
 
 namespace caffe2 {
 
+template <typename T, class Context>
+void ConvFilterGemm(
+    int M,
+    int N,
+    int K,
+    const T* W,
+    const T* col,
+    T* Y,
+    Workspace* /* unused */,
+    Context* context) {
+  math::Gemm<T, Context>(
+      CblasNoTrans, CblasNoTrans, M, N, K, 1, W, col, 0, Y, context);
+}
+
 template <typename T, class Context>
 bool ConvOp<T, Context>::RunOnDeviceWithOrderNCHW() {
   const Tensor<Context>& X = Input(INPUT);
@@ -67,43 +81,49 @@ bool ConvOp<T, Context>::RunOnDeviceWithOrderNCHW() {
   }
   T* Ydata = Y->template mutable_data<T>();
 
+  // For 1x1 convolutions with stride 1 and no padding, the image is the
+  // column buffer.
+  const bool pointwise = ConvPoolOpBase<Context>::IsPointwiseConv();
   auto f = [&](Tensor<Context>* col_buffer) {
-    col_buffer->Resize(vector<TIndex>{
-        C / group_, kernel_h_, kernel_w_, Y->dim32(2), Y->dim32(3)});
-
-    T* col_buffer_data = col_buffer->template mutable_data<T>();
+    T* col_buffer_data = nullptr;
+    if (!pointwise) {
+      col_buffer->Resize(vector<TIndex>{
+          C / group_, kernel_h_, kernel_w_, Y->dim32(2), Y->dim32(3)});
+      col_buffer_data = col_buffer->template mutable_data<T>();
+    }
     // Im2col, followed by gemm.
     for (int image_id = 0; image_id < N; ++image_id) {
       for (int group_id = 0; group_id < group_; ++group_id) {
-        math::Im2col<T, Context, StorageOrder::NCHW>(
-            Xdata + group_id * input_offset,
-            C / group_,
-            H,
-            W,
-            kernel_h_,
-            kernel_w_,
-            dilation_h_,
-            dilation_w_,
-            pad_t_,
-            pad_l_,
-            pad_b_,
-            pad_r_,
-            stride_h_,
-            stride_w_,
-            col_buffer_data,
-            &context_);
+        const T* col_data = Xdata + group_id * input_offset;
+        if (!pointwise) {
+          math::Im2col<T, Context, StorageOrder::NCHW>(
+              col_data,
+              C / group_,
+              H,
+              W,
+              kernel_h_,
+              kernel_w_,
+              dilation_h_,
+              dilation_w_,
+              pad_t_,
+              pad_l_,
+              pad_b_,
+              pad_r_,
+              stride_h_,
+              stride_w_,
+              col_buffer_data,
+              &context_);
+          col_data = col_buffer_data;
+        }
         // Weight term
-        math::Gemm<T, Context>(
-            CblasNoTrans,
-            CblasNoTrans,
+        ConvFilterGemm<T, Context>(
             M / group_,
             output_image_size,
             kernel_dim,
-            1,
             filter.template data<T>() + group_id * filter_offset,
-            col_buffer_data,
-            0,
+            col_data,
             Ydata + group_id * output_offset,
+            ws_,
             &context_);
       }
       if (InputSize() == 3) {
@@ -122,12 +142,15 @@ bool ConvOp<T, Context>::RunOnDeviceWithOrderNCHW() {
             Ydata,
             &context_);
       }
+      if (relu_) {
+        ConvReluEpilogue<T, Context>(output_offset * group_, Ydata, &context_);
+      }
       Xdata += input_offset * group_;
       Ydata += output_offset * group_;
     }
   };
 
-  if (FLAGS_caffe2_force_shared_col_buffer || shared_buffer_) {
+  if (!pointwise && (FLAGS_caffe2_force_shared_col_buffer || shared_buffer_)) {
     runWithSharedBuffer<Context>(ws_, f);
   } else {
     f(&col_buffer_);
@@ -204,6 +227,9 @@ bool ConvOp<T, Context>::RunOnDeviceWithOrderNHWC() {
           Ydata,
           &context_);
     }
+    if (relu_) {
+      ConvReluEpilogue<T, Context>(Y->size(), Ydata, &context_);
+    }
   } else {
     if (InputSize() == 3) {
       auto& bias = Input(BIAS);
@@ -270,6 +296,9 @@ bool ConvOp<T, Context>::RunOnDeviceWithOrderNHWC() {
               Ydata,
               &context_);
         }
+        if (relu_) {
+          ConvReluEpilogue<T, Context>(output_offset, Ydata, &context_);
+        }
         Xdata += input_offset;
         Ydata += output_offset;
       }
@@ -283,6 +312,11 @@ bool ConvOp<T, Context>::RunOnDeviceWithOrderNHWC() {
   return true;
 }
 
+template <typename T, class Context>
+bool ConvOp<T, Context>::RunOnDeviceWithOrderNCHWc() {
+  CAFFE_THROW("The blocked NCHWc order is only implemented for float on CPU");
+}
+
 template <typename T, class Context>
 bool ConvGradientOp<T, Context>::RunOnDeviceWithOrderNCHW() {
   auto& X = Input(INPUT);
@@ -308,12 +342,16 @@ bool ConvGradientOp<T, Context>::RunOnDeviceWithOrderNCHW() {
   // The output image size is the spatial size of the output.
   const int output_image_size = dY.dim32(2) * dY.dim32(3);
   // The col buffer is stored in CHW order as well - kernel_dim, and the height
-  // and width.
-  col_buffer_.Resize(kernel_dim, output_image_size);
+  // and width. Pointwise convolutions use the images instead.
+  const bool pointwise = ConvPoolOpBase<Context>::IsPointwiseConv();
+  T* col_buffer_data = nullptr;
+  if (!pointwise) {
+    col_buffer_.Resize(kernel_dim, output_image_size);
+    col_buffer_data = col_buffer_.template mutable_data<T>();
+  }
   const T* Xdata = X.template data<T>();
   const T* filter_data = filter.template data<T>();
   const T* dYdata = dY.template data<T>();
-  T* col_buffer_data = col_buffer_.template mutable_data<T>();
   T* dfilter_data = dfilter->template mutable_data<T>();
 
   // Pre-setting the gradients to zero.
@@ -340,23 +378,27 @@ bool ConvGradientOp<T, Context>::RunOnDeviceWithOrderNCHW() {
     for (int group_id = 0; group_id < group_; ++group_id) {
       // When we compute the gradient with respect to the filters, we need to do
       // im2col to allow gemm-type computation.
-      math::Im2col<T, Context, StorageOrder::NCHW>(
-          Xdata + group_id * input_offset,
-          C / group_,
-          H,
-          W,
-          kernel_h_,
-          kernel_w_,
-          dilation_h_,
-          dilation_w_,
-          pad_t_,
-          pad_l_,
-          pad_b_,
-          pad_r_,
-          stride_h_,
-          stride_w_,
-          col_buffer_data,
-          &context_);
+      const T* col_data = Xdata + group_id * input_offset;
+      if (!pointwise) {
+        math::Im2col<T, Context, StorageOrder::NCHW>(
+            col_data,
+            C / group_,
+            H,
+            W,
+            kernel_h_,
+            kernel_w_,
+            dilation_h_,
+            dilation_w_,
+            pad_t_,
+            pad_l_,
+            pad_b_,
+            pad_r_,
+            stride_h_,
+            stride_w_,
+            col_buffer_data,
+            &context_);
+        col_data = col_buffer_data;
+      }
       // Gradient with respect to filter.
       math::Gemm<T, Context>(
           CblasNoTrans,
@@ -366,7 +408,7 @@ bool ConvGradientOp<T, Context>::RunOnDeviceWithOrderNCHW() {
           output_image_size,
           1,
           dYdata + group_id * output_offset,
-          col_buffer_data,
+          col_data,
           1,
           dfilter_data + group_id * filter_offset,
           &context_);
@@ -395,7 +437,8 @@ bool ConvGradientOp<T, Context>::RunOnDeviceWithOrderNCHW() {
     dYdata = dY.template data<T>();
     for (int image_id = 0; image_id < N; ++image_id) {
       for (int group_id = 0; group_id < group_; ++group_id) {
-        // Compute gradient into col_buffer.
+        // Compute gradient into col_buffer, or directly into dX for
+        // pointwise convolutions.
         math::Gemm<T, Context>(
             CblasTrans,
             CblasNoTrans,
@@ -406,25 +449,27 @@ bool ConvGradientOp<T, Context>::RunOnDeviceWithOrderNCHW() {
             filter_data + group_id * filter_offset,
             dYdata,
             0,
-            col_buffer_data,
-            &context_);
-        math::Col2im<T, Context, StorageOrder::NCHW>(
-            col_buffer_data,
-            C / group_,
-            H,
-            W,
-            kernel_h_,
-            kernel_w_,
-            dilation_h_,
-            dilation_w_,
-            pad_t_,
-            pad_l_,
-            pad_b_,
-            pad_r_,
-            stride_h_,
-            stride_w_,
-            dXdata,
+            pointwise ? dXdata : col_buffer_data,
             &context_);
+        if (!pointwise) {
+          math::Col2im<T, Context, StorageOrder::NCHW>(
+              col_buffer_data,
+              C / group_,
+              H,
+              W,
+              kernel_h_,
+              kernel_w_,
+              dilation_h_,
+              dilation_w_,
+              pad_t_,
+              pad_l_,
+              pad_b_,
+              pad_r_,
+              stride_h_,
+              stride_w_,
+              dXdata,
+              &context_);
+        }
         dXdata += input_offset;
         dYdata += output_offset;
       }
@@ -458,13 +503,17 @@ bool ConvGradientOp<T, Context>::RunOnDeviceWithOrderNHWC() {
   // The output image size is the spatial size of the output.
   const int output_image_size = dY.dim32(1) * dY.dim32(2);
   // The col buffer is stored in CHW order as well - kernel_dim, and the height
-  // and width.
-  col_buffer_.Resize(output_image_size, kernel_dim);
+  // and width. Pointwise convolutions use the images instead.
+  const bool pointwise = ConvPoolOpBase<Context>::IsPointwiseConv();
+  T* col_buffer_data = nullptr;
+  if (!pointwise) {
+    col_buffer_.Resize(output_image_size, kernel_dim);
+    col_buffer_data = col_buffer_.template mutable_data<T>();
+  }
 
   const T* Xdata = X.template data<T>();
   const T* const filter_data = filter.template data<T>();
   const T* const dYdata = dY.template data<T>();
-  T* col_buffer_data = col_buffer_.template mutable_data<T>();
   T* dfilter_data = dfilter->template mutable_data<T>();
 
   // Pre-setting the gradients to zero.
@@ -490,23 +539,27 @@ bool ConvGradientOp<T, Context>::RunOnDeviceWithOrderNHWC() {
   for (int image_id = 0; image_id < N; ++image_id) {
     // When we compute the gradient with respect to the filters, we need to do
     // im2col to allow gemm-type computation.
-    math::Im2col<T, Context, StorageOrder::NHWC>(
-        Xdata,
-        C,
-        H,
-        W,
-        kernel_h_,
-        kernel_w_,
-        dilation_h_,
-        dilation_w_,
-        pad_t_,
-        pad_l_,
-        pad_b_,
-        pad_r_,
-        stride_h_,
-        stride_w_,
-        col_buffer_data,
-        &context_);
+    const T* col_data = Xdata;
+    if (!pointwise) {
+      math::Im2col<T, Context, StorageOrder::NHWC>(
+          Xdata,
+          C,
+          H,
+          W,
+          kernel_h_,
+          kernel_w_,
+          dilation_h_,
+          dilation_w_,
+          pad_t_,
+          pad_l_,
+          pad_b_,
+          pad_r_,
+          stride_h_,
+          stride_w_,
+          col_buffer_data,
+          &context_);
+      col_data = col_buffer_data;
+    }
     // Gradient with respect to filter.
     math::Gemm<T, Context>(
         CblasTrans,
@@ -516,7 +569,7 @@ bool ConvGradientOp<T, Context>::RunOnDeviceWithOrderNHWC() {
         output_image_size,
         1,
         dYdata + output_offset * image_id,
-        col_buffer_data,
+        col_data,
         1,
         dfilter_data,
         &context_);
@@ -542,7 +595,8 @@ bool ConvGradientOp<T, Context>::RunOnDeviceWithOrderNHWC() {
     dX->ResizeLike(X);
     T* dXdata = dX->template mutable_data<T>();
     for (int image_id = 0; image_id < N; ++image_id) {
-      // Compute gradient into col_buffer.
+      // Compute gradient into col_buffer, or directly into dX for pointwise
+      // convolutions.
       math::Gemm<T, Context>(
           CblasNoTrans,
           CblasNoTrans,
@@ -553,25 +607,27 @@ bool ConvGradientOp<T, Context>::RunOnDeviceWithOrderNHWC() {
           dYdata + output_offset * image_id,
           filter_data,
           0,
-          col_buffer_data,
-          &context_);
-      math::Col2im<T, Context, StorageOrder::NHWC>(
-          col_buffer_data,
-          C,
-          H,
-          W,
-          kernel_h_,
-          kernel_w_,
-          dilation_h_,
-          dilation_w_,
-          pad_t_,
-          pad_l_,
-          pad_b_,
-          pad_r_,
-          stride_h_,
-          stride_w_,
-          dXdata,
+          pointwise ? dXdata : col_buffer_data,
           &context_);
+      if (!pointwise) {
+        math::Col2im<T, Context, StorageOrder::NHWC>(
+            col_buffer_data,
+            C,
+            H,
+            W,
+            kernel_h_,
+            kernel_w_,
+            dilation_h_,
+            dilation_w_,
+            pad_t_,
+            pad_l_,
+            pad_b_,
+            pad_r_,
+            stride_h_,
+            stride_w_,
+            dXdata,
+            &context_);
+      }
       dXdata += input_offset;
     }
   }
@@ -0,0 +1,125 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+const TensorCPU& AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+  return *tensor;
+}
+
+const float* Data(Workspace* ws, const string& name) {
+  return ws->GetBlob(name)->Get<TensorCPU>().data<float>();
+}
+
+} // namespace
+
+// 1x1 convolutions with stride 1 and no padding skip im2col: checks them, and
+// the strided ones that still subsample the input, against plain loops.
+TEST(ConvOpTest, Pointwise) {
+  const int N = 2, C = 3, M = 4, H = 5, W = 6;
+  std::mt19937 gen(0);
+  for (const string order : {"NCHW", "NHWC"}) {
+    for (int stride : {1, 2}) {
+      const bool nchw = order == "NCHW";
+      const int OH = (H - 1) / stride + 1;
+      const int OW = (W - 1) / stride + 1;
+      Workspace ws;
+      const auto& X = nchw ? AddRandomTensor(&ws, "X", {N, C, H, W}, &gen)
+                           : AddRandomTensor(&ws, "X", {N, H, W, C}, &gen);
+      AddRandomTensor(
+          &ws,
+          "W",
+          nchw ? vector<TIndex>{M, C, 1, 1} : vector<TIndex>{M, 1, 1, C},
+          &gen);
+      AddRandomTensor(&ws, "b", {M}, &gen);
+      const auto& dY = nchw
+          ? AddRandomTensor(&ws, "dY", {N, M, OH, OW}, &gen)
+          : AddRandomTensor(&ws, "dY", {N, OH, OW, M}, &gen);
+
+      OperatorDef def;
+      def.set_type("Conv");
+      def.add_input("X");
+      def.add_input("W");
+      def.add_input("b");
+      def.add_output("Y");
+      AddArgument<int>("kernel", 1, &def);
+      AddArgument<int>("stride", stride, &def);
+      AddArgument<string>("order", order, &def);
+      ASSERT_TRUE(ws.RunOperatorOnce(def));
+      def.set_type("ConvGradient");
+      def.clear_input();
+      def.add_input("X");
+      def.add_input("W");
+      def.add_input("dY");
+      def.clear_output();
+      def.add_output("dW");
+      def.add_output("db");
+      def.add_output("dX");
+      ASSERT_TRUE(ws.RunOperatorOnce(def));
+
+      auto x = [&](int n, int c, int h, int w) {
+        return X.data<float>()[nchw ? ((n * C + c) * H + h) * W + w
+                                    : ((n * H + h) * W + w) * C + c];
+      };
+      auto dy = [&](int n, int m, int h, int w) {
+        return dY.data<float>()[nchw ? ((n * M + m) * OH + h) * OW + w
+                                     : ((n * OH + h) * OW + w) * M + m];
+      };
+      const float* w = Data(&ws, "W");
+      const float* b = Data(&ws, "b");
+      const float* y = Data(&ws, "Y");
+      const float* dw = Data(&ws, "dW");
+      const float* db = Data(&ws, "db");
+      const float* dx = Data(&ws, "dX");
+      vector<float> expected_dw(M * C, 0);
+      vector<float> expected_db(M, 0);
+      vector<float> expected_dx(N * C * H * W, 0);
+      for (int n = 0; n < N; ++n) {
+        for (int oh = 0; oh < OH; ++oh) {
+          for (int ow = 0; ow < OW; ++ow) {
+            const int h = oh * stride, iw = ow * stride;
+            for (int m = 0; m < M; ++m) {
+              float expected = b[m];
+              for (int c = 0; c < C; ++c) {
+                expected += w[m * C + c] * x(n, c, h, iw);
+                expected_dw[m * C + c] += dy(n, m, oh, ow) * x(n, c, h, iw);
+                const int xi = nchw ? ((n * C + c) * H + h) * W + iw
+                                    : ((n * H + h) * W + iw) * C + c;
+                expected_dx[xi] += w[m * C + c] * dy(n, m, oh, ow);
+              }
+              expected_db[m] += dy(n, m, oh, ow);
+              const int yi = nchw ? ((n * M + m) * OH + oh) * OW + ow
+                                  : ((n * OH + oh) * OW + ow) * M + m;
+              EXPECT_NEAR(y[yi], expected, 1e-5);
+            }
+          }
+        }
+      }
+      for (int i = 0; i < M * C; ++i) {
+        EXPECT_NEAR(dw[i], expected_dw[i], 1e-4);
+      }
+      for (int m = 0; m < M; ++m) {
+        EXPECT_NEAR(db[m], expected_db[m], 1e-4);
+      }
+      for (int i = 0; i < N * C * H * W; ++i) {
+        EXPECT_NEAR(dx[i], expected_dx[i], 1e-5);
+      }
+    }
+  }
+}
+
+} // namespace caffe2
@@ -0,0 +1,266 @@
+#include <cstring>
+
+#include "caffe2/core/common_omp.h"
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/conv_pool_op_base.h"
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Winograd F(2x2, 3x3): each 2x2 tile of the output is computed from a 4x4
+// tile of the input, with 16 multiplications per channel pair instead of 36.
+// In the transformed domain, the convolution becomes 16 independent matrix
+// products over the channels, which run as GEMMs over all tiles of an image.
+constexpr int kTileSize = 2;
+constexpr int kInputTileSize = 4;
+constexpr int kNumElements = kInputTileSize * kInputTileSize;
+
+// U = G g G^T for a 3x3 filter g read with the given strides.
+void TransformFilter(const float* g, int row_stride, int col_stride, float* u) {
+  float tmp[4][3];
+  for (int j = 0; j < 3; ++j) {
+    const float g0 = g[j * col_stride];
+    const float g1 = g[row_stride + j * col_stride];
+    const float g2 = g[2 * row_stride + j * col_stride];
+    tmp[0][j] = g0;
+    tmp[1][j] = 0.5f * (g0 + g1 + g2);
+    tmp[2][j] = 0.5f * (g0 - g1 + g2);
+    tmp[3][j] = g2;
+  }
+  for (int i = 0; i < 4; ++i) {
+    u[i * 4 + 0] = tmp[i][0];
+    u[i * 4 + 1] = 0.5f * (tmp[i][0] + tmp[i][1] + tmp[i][2]);
+    u[i * 4 + 2] = 0.5f * (tmp[i][0] - tmp[i][1] + tmp[i][2]);
+    u[i * 4 + 3] = tmp[i][2];
+  }
+}
+
+// V = B^T d B for a 4x4 input tile d.
+void TransformInputTile(const float d[4][4], float* v) {
+  float tmp[4][4];
+  for (int j = 0; j < 4; ++j) {
+    tmp[0][j] = d[0][j] - d[2][j];
+    tmp[1][j] = d[1][j] + d[2][j];
+    tmp[2][j] = d[2][j] - d[1][j];
+    tmp[3][j] = d[1][j] - d[3][j];
+  }
+  for (int i = 0; i < 4; ++i) {
+    v[i * 4 + 0] = tmp[i][0] - tmp[i][2];
+    v[i * 4 + 1] = tmp[i][1] + tmp[i][2];
+    v[i * 4 + 2] = tmp[i][2] - tmp[i][1];
+    v[i * 4 + 3] = tmp[i][1] - tmp[i][3];
+  }
+}
+
+// Y = A^T m A for a 4x4 tile m of the products.
+void TransformOutputTile(const float m[4][4], float y[2][2]) {
+  float tmp[2][4];
+  for (int j = 0; j < 4; ++j) {
+    tmp[0][j] = m[0][j] + m[1][j] + m[2][j];
+    tmp[1][j] = m[1][j] - m[2][j] - m[3][j];
+  }
+  for (int i = 0; i < 2; ++i) {
+    y[i][0] = tmp[i][0] + tmp[i][1] + tmp[i][2];
+    y[i][1] = tmp[i][1] - tmp[i][2] - tmp[i][3];
+  }
+}
+
+} // namespace
+
+// Conv engine for 3x3 convolutions with stride and dilation 1, selected with
+// engine "WINOGRAD". The transformed filter is kept between runs, and only
+// recomputed when the filter changes.
+class WinogradConvOp final : public ConvPoolOpBase<CPUContext> {
+ public:
+  USE_CONV_POOL_BASE_FUNCTIONS(CPUContext);
+  WinogradConvOp(const OperatorDef& operator_def, Workspace* ws)
+      : ConvPoolOpBase<CPUContext>(operator_def, ws) {
+    OPERATOR_NEEDS_FEATURE(
+        kernel_h_ == 3 && kernel_w_ == 3,
+        "Winograd convolution only supports 3x3 kernels.");
+    OPERATOR_NEEDS_FEATURE(
+        stride_h_ == 1 && stride_w_ == 1,
+        "Winograd convolution only supports stride 1.");
+    OPERATOR_NEEDS_FEATURE(
+        dilation_h_ == 1 && dilation_w_ == 1,
+        "Winograd convolution does not support dilation.");
+    OPERATOR_NEEDS_FEATURE(group_ == 1, "Group convolution not supported.");
+  }
+  ~WinogradConvOp() {}
+
+  bool RunOnDeviceWithOrderNCHW() override {
+    return RunWithOrder(StorageOrder::NCHW);
+  }
+  bool RunOnDeviceWithOrderNHWC() override {
+    return RunWithOrder(StorageOrder::NHWC);
+  }
+
+ private:
+  bool RunWithOrder(StorageOrder order);
+  void TransformFilterIfChanged(const TensorCPU& filter, StorageOrder order);
+
+  // The filter that transformed_filter_ was computed from.
+  vector<float> filter_copy_;
+  // 16 matrices of M x C.
+  TensorCPU transformed_filter_;
+  // 16 matrices of C x tiles.
+  TensorCPU transformed_input_;
+  // 16 matrices of M x tiles.
+  TensorCPU products_;
+  INPUT_TAGS(INPUT, FILTER, BIAS);
+};
+
+void WinogradConvOp::TransformFilterIfChanged(
+    const TensorCPU& filter,
+    StorageOrder order) {
+  const float* g = filter.data<float>();
+  if (filter_copy_.size() == filter.size() &&
+      memcmp(filter_copy_.data(), g, filter.nbytes()) == 0) {
+    return;
+  }
+  filter_copy_.assign(g, g + filter.size());
+  const int M = filter.dim32(0);
+  const int C = order == StorageOrder::NCHW ? filter.dim32(1) : filter.dim32(3);
+  transformed_filter_.Resize(kNumElements, M, C);
+  float* U = transformed_filter_.mutable_data<float>();
+  for (int m = 0; m < M; ++m) {
+    for (int c = 0; c < C; ++c) {
+      float u[kNumElements];
+      if (order == StorageOrder::NCHW) {
+        TransformFilter(g + (m * C + c) * 9, 3, 1, u);
+      } else {
+        TransformFilter(g + m * 9 * C + c, 3 * C, C, u);
+      }
+      for (int e = 0; e < kNumElements; ++e) {
+        U[(e * M + m) * C + c] = u[e];
+      }
+    }
+  }
+}
+
+bool WinogradConvOp::RunWithOrder(StorageOrder order) {
+  auto& X = Input(INPUT);
+  auto& filter = Input(FILTER);
+  auto* Y = Output(0);
+  CAFFE_ENFORCE(4 == X.ndim());
+  CAFFE_ENFORCE(4 == filter.ndim());
+  const bool nchw = order == StorageOrder::NCHW;
+  const int N = X.dim32(0);
+  const int C = nchw ? X.dim32(1) : X.dim32(3);
+  const int H = nchw ? X.dim32(2) : X.dim32(1);
+  const int W = nchw ? X.dim32(3) : X.dim32(2);
+  const int M = filter.dim32(0);
+  CAFFE_ENFORCE_EQ(C, nchw ? filter.dim32(1) : filter.dim32(3));
+  CAFFE_ENFORCE_EQ(kernel_h_, nchw ? filter.dim32(2) : filter.dim32(1));
+  CAFFE_ENFORCE_EQ(kernel_w_, nchw ? filter.dim32(3) : filter.dim32(2));
+  ConvPoolOpBase<CPUContext>::SetOutputSize(X, Y, M);
+  const int OH = nchw ? Y->dim32(2) : Y->dim32(1);
+  const int OW = nchw ? Y->dim32(3) : Y->dim32(2);
+  const float* bias = nullptr;
+  if (InputSize() == 3) {
+    auto& bias_input = Input(BIAS);
+    CAFFE_ENFORCE(bias_input.ndim() == 1);
+    CAFFE_ENFORCE(bias_input.dim32(0) == M);
+    bias = bias_input.data<float>();
+  }
+  TransformFilterIfChanged(filter, order);
+
+  // Strides of the channels, rows and columns of an image.
+  const int x_c = nchw ? H * W : 1;
+  const int x_h = nchw ? W : W * C;
+  const int x_w = nchw ? 1 : C;
+  const int y_c = nchw ? OH * OW : 1;
+  const int y_h = nchw ? OW : OW * M;
+  const int y_w = nchw ? 1 : M;
+
+  const int tiles_h = (OH + kTileSize - 1) / kTileSize;
+  const int tiles_w = (OW + kTileSize - 1) / kTileSize;
+  const int T = tiles_h * tiles_w;
+  transformed_input_.Resize(kNumElements, C, T);
+  products_.Resize(kNumElements, M, T);
+  float* V = transformed_input_.mutable_data<float>();
+  float* P = products_.mutable_data<float>();
+  const float* U = transformed_filter_.data<float>();
+
+  for (int n = 0; n < N; ++n) {
+    const float* x = X.data<float>() + n * C * H * W;
+    float* y = Y->mutable_data<float>() + n * M * OH * OW;
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int c = 0; c < C; ++c) {
+      for (int th = 0; th < tiles_h; ++th) {
+        for (int tw = 0; tw < tiles_w; ++tw) {
+          float d[4][4];
+          for (int i = 0; i < kInputTileSize; ++i) {
+            const int h = th * kTileSize + i - pad_t_;
+            for (int j = 0; j < kInputTileSize; ++j) {
+              const int w = tw * kTileSize + j - pad_l_;
+              d[i][j] = (h >= 0 && h < H && w >= 0 && w < W)
+                  ? x[c * x_c + h * x_h + w * x_w]
+                  : 0;
+            }
+          }
+          float v[kNumElements];
+          TransformInputTile(d, v);
+          const int t = th * tiles_w + tw;
+          for (int e = 0; e < kNumElements; ++e) {
+            V[(e * C + c) * T + t] = v[e];
+          }
+        }
+      }
+    }
+
+    for (int e = 0; e < kNumElements; ++e) {
+      math::Gemm<float, CPUContext>(
+          CblasNoTrans,
+          CblasNoTrans,
+          M,
+          T,
+          C,
+          1,
+          U + e * M * C,
+          V + e * C * T,
+          0,
+          P + e * M * T,
+          &context_);
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int m = 0; m < M; ++m) {
+      const float b = bias ? bias[m] : 0;
+      for (int th = 0; th < tiles_h; ++th) {
+        for (int tw = 0; tw < tiles_w; ++tw) {
+          const int t = th * tiles_w + tw;
+          float p[4][4];
+          for (int e = 0; e < kNumElements; ++e) {
+            p[e / 4][e % 4] = P[(e * M + m) * T + t];
+          }
+          float out[2][2];
+          TransformOutputTile(p, out);
+          // Tiles on the bottom and right edges may stick out of the output.
+          for (int i = 0; i < kTileSize; ++i) {
+            const int h = th * kTileSize + i;
+            for (int j = 0; j < kTileSize; ++j) {
+              const int w = tw * kTileSize + j;
+              if (h < OH && w < OW) {
+                y[m * y_c + h * y_h + w * y_w] = out[i][j] + b;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+REGISTER_CPU_OPERATOR_WITH_ENGINE(Conv, WINOGRAD, WinogradConvOp);
+
+} // namespace caffe2
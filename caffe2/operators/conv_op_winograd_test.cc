@@ -0,0 +1,107 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/conv_op.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+using DefaultConvOp = ConvOp<float, CPUContext>;
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+OperatorDef ConvDef(
+    const string& engine,
+    const string& order,
+    int pad,
+    bool with_bias,
+    const string& output) {
+  OperatorDef def;
+  def.set_type("Conv");
+  def.set_engine(engine);
+  def.add_input("X");
+  def.add_input("W");
+  if (with_bias) {
+    def.add_input("b");
+  }
+  def.add_output(output);
+  AddArgument<int>("kernel", 3, &def);
+  AddArgument<int>("pad", pad, &def);
+  AddArgument<string>("order", order, &def);
+  return def;
+}
+
+} // namespace
+
+TEST(WinogradConvTest, MatchesDefaultEngine) {
+  const int N = 2, C = 5, M = 7;
+  std::mt19937 gen(0);
+  for (const string order : {"NCHW", "NHWC"}) {
+    // Odd and even output sizes, with and without padding.
+    for (int H : {6, 9}) {
+      for (int pad : {0, 1}) {
+        for (bool with_bias : {false, true}) {
+          const int W = H + 2;
+          Workspace ws;
+          if (order == "NCHW") {
+            AddRandomTensor(&ws, "X", {N, C, H, W}, &gen);
+            AddRandomTensor(&ws, "W", {M, C, 3, 3}, &gen);
+          } else {
+            AddRandomTensor(&ws, "X", {N, H, W, C}, &gen);
+            AddRandomTensor(&ws, "W", {M, 3, 3, C}, &gen);
+          }
+          AddRandomTensor(&ws, "b", {M}, &gen);
+          ASSERT_TRUE(ws.RunOperatorOnce(
+              ConvDef("", order, pad, with_bias, "expected")));
+          unique_ptr<OperatorBase> op(CreateOperator(
+              ConvDef("WINOGRAD", order, pad, with_bias, "actual"), &ws));
+          ASSERT_EQ(dynamic_cast<DefaultConvOp*>(op.get()), nullptr);
+          // The second run reuses the transformed filter, the third one
+          // transforms the changed filter again.
+          for (int run = 0; run < 3; ++run) {
+            if (run == 2) {
+              const auto dims = ws.GetBlob("W")->Get<TensorCPU>().dims();
+              AddRandomTensor(&ws, "W", dims, &gen);
+              ASSERT_TRUE(ws.RunOperatorOnce(
+                  ConvDef("", order, pad, with_bias, "expected")));
+            }
+            ASSERT_TRUE(op->Run());
+            const auto& expected = ws.GetBlob("expected")->Get<TensorCPU>();
+            const auto& actual = ws.GetBlob("actual")->Get<TensorCPU>();
+            ASSERT_EQ(expected.dims(), actual.dims());
+            for (int i = 0; i < expected.size(); ++i) {
+              EXPECT_NEAR(
+                  expected.data<float>()[i], actual.data<float>()[i], 1e-4);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(WinogradConvTest, FallsBackForStrides) {
+  Workspace ws;
+  std::mt19937 gen(0);
+  AddRandomTensor(&ws, "X", {1, 2, 5, 5}, &gen);
+  AddRandomTensor(&ws, "W", {3, 2, 3, 3}, &gen);
+  auto def = ConvDef("WINOGRAD", "NCHW", 0, false, "Y");
+  AddArgument<int>("stride", 2, &def);
+  unique_ptr<OperatorBase> op(CreateOperator(def, &ws));
+  EXPECT_NE(dynamic_cast<DefaultConvOp*>(op.get()), nullptr);
+}
+
+} // namespace caffe2
@@ -121,7 +121,7 @@ class ConvPoolOpBase : public Operator<Context> {
       const Tensor<AlternativeContext>& input,
       Tensor<AlternativeContext>* output,
       int output_channel) {
-        CAFFE_ENFORCE(4 == input.ndim());
+        CAFFE_ENFORCE((order_ == StorageOrder::NCHWc ? 5 : 4) == input.ndim());
         CAFFE_ENFORCE(input.size() > 0);
         int output_height, output_width;
         int N = input.dim32(0);
@@ -148,7 +148,15 @@ class ConvPoolOpBase : public Operator<Context> {
           pad_r_,
           channel_first
         );
-        if (channel_first) {
+        if (order_ == StorageOrder::NCHWc) {
+          const int block = input.dim32(4);
+          CAFFE_ENFORCE_EQ(
+              output_channel % block,
+              0,
+              "Output channels must be a multiple of the block size");
+          output->Resize(vector<TIndex>{
+              N, output_channel / block, output_height, output_width, block});
+        } else if (channel_first) {
           output->Resize(N, output_channel, output_height, output_width);
         } else {
           output->Resize(N, output_height, output_width, output_channel);
@@ -188,7 +196,8 @@ class ConvPoolOpBase : public Operator<Context> {
         W = input_dims[2];
         break;
       case StorageOrder::NCHW:
-        // Old Caffe order.
+      case StorageOrder::NCHWc:
+        // Old Caffe order, or its blocked variant.
         channel_first = true;
         H = input_dims[2];
         W = input_dims[3];
@@ -255,6 +264,14 @@ class ConvPoolOpBase : public Operator<Context> {
     }
   }
 
+  // Whether the input already is the column buffer of im2col: 1x1 kernels with
+  // stride 1 and no padding. Only valid once the pads have been computed.
+  bool IsPointwiseConv() const {
+    return kernel_h_ == 1 && kernel_w_ == 1 && stride_h_ == 1 &&
+        stride_w_ == 1 && pad_t_ == 0 && pad_l_ == 0 && pad_b_ == 0 &&
+        pad_r_ == 0;
+  }
+
   bool RunOnDevice() override {
     CAFFE_ENFORCE(kernel_h_ > 0 || global_pooling_);
     CAFFE_ENFORCE(kernel_w_ > 0 || global_pooling_);
@@ -265,6 +282,8 @@ class ConvPoolOpBase : public Operator<Context> {
       case StorageOrder::NCHW:
         // VLOG(2) << "Running NCHW";
         return RunOnDeviceWithOrderNCHW();
+      case StorageOrder::NCHWc:
+        return RunOnDeviceWithOrderNCHWc();
       default:
         CAFFE_THROW("Unknown Storage order: ", order_);
     }
@@ -278,6 +297,9 @@ class ConvPoolOpBase : public Operator<Context> {
   virtual bool RunOnDeviceWithOrderNCHW() {
     CAFFE_NOT_IMPLEMENTED;
   }
+  virtual bool RunOnDeviceWithOrderNCHWc() {
+    CAFFE_THROW("The blocked NCHWc order is not supported by this operator");
+  }
 
   static vector<TensorShape> TensorInferenceForSchema(
       const OperatorDef& def,
@@ -286,6 +308,8 @@ class ConvPoolOpBase : public Operator<Context> {
     ArgumentHelper helper(def);
     int N = in[0].dims(0);
     int pad = helper.GetSingleArgument<int>("pad", 0);
+    const StorageOrder order =
+        StringToStorageOrder(helper.GetSingleArgument<string>("order", "NCHW"));
     int output_width, output_height;
     bool channel_first;
     int kernel_h = helper.GetSingleArgument<int>(
@@ -297,7 +321,7 @@ class ConvPoolOpBase : public Operator<Context> {
     ConvPoolOpBase<CPUContext>::InferOutputSize(
       GetDimsVector(in[0]),
       output_channel,
-      StringToStorageOrder(helper.GetSingleArgument<string>("order", "NCHW")),
+      order,
       helper.GetSingleArgument<int>("global_pooling", 0),
       static_cast<LegacyPadding>(helper.GetSingleArgument<int>(
           "legacy_pad",
@@ -326,7 +350,13 @@ class ConvPoolOpBase : public Operator<Context> {
       channel_first
     );
     vector<TensorShape> out(1);
-    if (channel_first) {
+    if (order == StorageOrder::NCHWc) {
+      const int block = in[0].dims(4);
+      out[0] = CreateTensorShape(
+          vector<int>{
+              N, output_channel / block, output_height, output_width, block},
+          TensorProto::FLOAT);
+    } else if (channel_first) {
       out[0] = CreateTensorShape(
           vector<int> {N, output_channel, output_height, output_width},
           TensorProto::FLOAT
@@ -347,6 +377,24 @@ class ConvPoolOpBase : public Operator<Context> {
      return TensorInferenceForSchema(def, in, in[1].dims(0));
  }
 
+ static struct OpSchema::Cost CostInferenceForConv(
+     const OperatorDef& def,
+     const vector<TensorShape>& in) {
+   struct OpSchema::Cost c;
+   const TensorShape Y = TensorInferenceForConv(def, in)[0];
+   const uint64_t output_size = GetNumElements(Y);
+   // Every output element is a dot product over one filter.
+   const uint64_t filter_size = GetNumElements(in[1]) / in[1].dims(0);
+   c.flops = 2 * output_size * filter_size;
+   c.bytes_read = 0;
+   for (const auto& shape : in) {
+     c.bytes_read += GetNumElements(shape) * sizeof(float);
+   }
+   c.bytes_written = output_size * sizeof(float);
+   c.bytes_moved = c.bytes_read + c.bytes_written;
+   return c;
+ }
+
  static vector<TensorShape> TensorInferenceForPool(
      const OperatorDef& def,
      const vector<TensorShape>& in) {
@@ -354,10 +402,38 @@ class ConvPoolOpBase : public Operator<Context> {
    auto order =
        StringToStorageOrder(helper.GetSingleArgument<string>("order", "NCHW"));
    int num_channels =
-       (order == StorageOrder::NCHW ? in[0].dims(1) : in[0].dims(3));
+       (order == StorageOrder::NCHW
+            ? in[0].dims(1)
+            : order == StorageOrder::NCHWc ? in[0].dims(1) * in[0].dims(4)
+                                           : in[0].dims(3));
    return TensorInferenceForSchema(def, in, num_channels);
  }
 
+ static struct OpSchema::Cost CostInferenceForPool(
+     const OperatorDef& def,
+     const vector<TensorShape>& in) {
+   struct OpSchema::Cost c;
+   const uint64_t input_size = GetNumElements(in[0]);
+   const uint64_t output_size =
+       GetNumElements(TensorInferenceForPool(def, in)[0]);
+   // Every output element reduces one window of the input, which is the
+   // whole image for global pooling.
+   ArgumentHelper helper(def);
+   uint64_t window_size = 1;
+   if (helper.GetSingleArgument<int>("global_pooling", 0)) {
+     window_size = output_size ? input_size / output_size : 0;
+   } else {
+     const int kernel = helper.GetSingleArgument<int>("kernel", 0);
+     window_size = helper.GetSingleArgument<int>("kernel_h", kernel) *
+         helper.GetSingleArgument<int>("kernel_w", kernel);
+   }
+   c.flops = output_size * window_size;
+   c.bytes_read = input_size * sizeof(float);
+   c.bytes_written = output_size * sizeof(float);
+   c.bytes_moved = c.bytes_read + c.bytes_written;
+   return c;
+ }
+
  virtual ~ConvPoolOpBase() {}
 
 private:
@@ -5,11 +5,6 @@
 
 namespace caffe2 {
 
-// Earlier in the days Caffe sets the default cudnn workspace to 8MB. We bump
-// it up to 64MB in Caffe2, as this enables the use of Winograd in many cases,
-// something very beneficial to more recent CNN models.
-static constexpr size_t kCONV_CUDNN_WORKSPACE_LIMIT_BYTES = 64 * 1024 * 1024;
-
 // Manually specified number of algorithms implemented in CuDNN.
 // This does not have any performance implications, as we will always find the
 // fastest algorithm; setting them to the right number of algorithms will enable
@@ -37,9 +32,9 @@ class CudnnConvTransposeOpBase : public ConvTransposeUnpoolBase<CUDAContext> {
   CudnnConvTransposeOpBase(const OperatorDef& operator_def, Workspace* ws)
       : ConvTransposeUnpoolBase<CUDAContext>(operator_def, ws),
         cudnn_wrapper_(&context_),
-        cudnn_ws_nbytes_limit_(OperatorBase::GetSingleArgument<size_t>(
-            "ws_nbytes_limit",
-            kCONV_CUDNN_WORKSPACE_LIMIT_BYTES)),
+        ws_nbytes_limit_(
+            OperatorBase::GetSingleArgument<size_t>("ws_nbytes_limit", 0)),
+        cudnn_ws_nbytes_limit_(0),
         exhaustive_search_(
             OperatorBase::GetSingleArgument<int>("exhaustive_search", 0)),
         deterministic_(
@@ -62,6 +57,26 @@ class CudnnConvTransposeOpBase : public ConvTransposeUnpoolBase<CUDAContext> {
   }
 
  protected:
+  // Everything besides the input and filter shapes that the result of an
+  // exhaustive search depends on, for the shared algorithm caches. The
+  // configured budget is used rather than cudnn_ws_nbytes_limit_, which also
+  // depends on how far the shared workspace has grown so far.
+  template <typename T>
+  vector<TIndex> AlgorithmKeyParams() const {
+    const size_t budget = ws_nbytes_limit_
+        ? ws_nbytes_limit_
+        : static_cast<size_t>(FLAGS_caffe2_cudnn_workspace_limit_mb) << 20;
+    return vector<TIndex>{static_cast<TIndex>(cudnnTypeWrapper<T>::type),
+                          static_cast<TIndex>(order_),
+                          static_cast<TIndex>(budget),
+                          pad_t_,
+                          pad_l_,
+                          stride_h_,
+                          stride_w_,
+                          adj_h_,
+                          adj_w_};
+  }
+
   vector<TIndex> cudnn_input_dims_;
   vector<TIndex> cudnn_filter_dims_;
 
@@ -71,7 +86,9 @@ class CudnnConvTransposeOpBase : public ConvTransposeUnpoolBase<CUDAContext> {
   cudnnTensorDescriptor_t bias_desc_;
   cudnnTensorDescriptor_t top_desc_;
   cudnnConvolutionDescriptor_t conv_desc_;
-  const size_t cudnn_ws_nbytes_limit_;
+  // An explicit ws_nbytes_limit argument overrides the device-wide budget.
+  const size_t ws_nbytes_limit_;
+  size_t cudnn_ws_nbytes_limit_;
   size_t cudnn_ws_nbytes_;
   bool exhaustive_search_;
   bool deterministic_;
@@ -82,7 +99,8 @@ template <typename T>
 class CudnnConvTransposeOp final : public CudnnConvTransposeOpBase {
  public:
   CudnnConvTransposeOp(const OperatorDef& operator_def, Workspace* ws)
-      : CudnnConvTransposeOpBase(operator_def, ws) {}
+      : CudnnConvTransposeOpBase(operator_def, ws),
+        data_algo_cache_("conv_transpose_bwd_data") {}
 
   ~CudnnConvTransposeOp() {}
 
@@ -100,7 +118,9 @@ template <typename T>
 class CudnnConvTransposeGradientOp final : public CudnnConvTransposeOpBase {
  public:
   CudnnConvTransposeGradientOp(const OperatorDef& operator_def, Workspace* ws)
-      : CudnnConvTransposeOpBase(operator_def, ws) {}
+      : CudnnConvTransposeOpBase(operator_def, ws),
+        forward_algo_cache_("conv_transpose_fwd"),
+        filter_algo_cache_("conv_transpose_bwd_filter") {}
 
   ~CudnnConvTransposeGradientOp() {}
 
@@ -178,6 +198,9 @@ bool CudnnConvTransposeOp<T>::RunOnDevice() {
 
   if (input_changed || filter_changed) {
     VLOG(1) << "Changing the cudnn descriptor configurations.";
+    cudnn_ws_nbytes_limit_ = ws_nbytes_limit_
+        ? ws_nbytes_limit_
+        : cudnn_wrapper_.workspace_limit(cudnn_state_);
     if (input_changed) {
       cudnn_input_dims_ = X.dims();
       CUDNN_CHECK(cudnnSetTensor4dDescriptor(
@@ -241,7 +264,8 @@ bool CudnnConvTransposeOp<T>::RunOnDevice() {
       bwd_data_algo_ = CUDNN_CONVOLUTION_BWD_DATA_ALGO_1;
     } else if (exhaustive_search_) {
       bwd_data_algo_ =
-          data_algo_cache_.getAlgorithm(X.dims(), filter.dims(), [&]() {
+          data_algo_cache_.getAlgorithm(
+              X.dims(), filter.dims(), AlgorithmKeyParams<T>(), [&]() {
             int returned_algo_count;
             std::array<
                 cudnnConvolutionBwdDataAlgoPerf_t,
@@ -384,6 +408,9 @@ bool CudnnConvTransposeGradientOp<T>::RunOnDevice() {
   bool filter_changed = (filter.dims() != cudnn_filter_dims_);
   if (input_changed || filter_changed) {
     VLOG(1) << "Changing the cudnn descriptor configurations.";
+    cudnn_ws_nbytes_limit_ = ws_nbytes_limit_
+        ? ws_nbytes_limit_
+        : cudnn_wrapper_.workspace_limit(cudnn_state_);
     if (input_changed) {
       cudnn_input_dims_ = X.dims();
       CUDNN_CHECK(cudnnSetTensor4dDescriptor(
@@ -452,7 +479,8 @@ bool CudnnConvTransposeGradientOp<T>::RunOnDevice() {
       bwd_filter_algo_ = CUDNN_CONVOLUTION_BWD_FILTER_ALGO_1;
     } else if (exhaustive_search_) {
       bwd_filter_algo_ =
-          filter_algo_cache_.getAlgorithm(X.dims(), filter.dims(), [&]() {
+          filter_algo_cache_.getAlgorithm(
+              X.dims(), filter.dims(), AlgorithmKeyParams<T>(), [&]() {
 
             LOG(INFO) << "CUDNN Convolution bwd: doing exhaustive search.";
             // When we do an exhaustive search, we will ignore the workspace
@@ -487,7 +515,8 @@ bool CudnnConvTransposeGradientOp<T>::RunOnDevice() {
             return filter_perf_stat[0].algo;
           });
 
-      algo_ = forward_algo_cache_.getAlgorithm(X.dims(), filter.dims(), [&]() {
+      algo_ = forward_algo_cache_.getAlgorithm(
+          X.dims(), filter.dims(), AlgorithmKeyParams<T>(), [&]() {
         int returned_algo_count;
         std::array<cudnnConvolutionFwdAlgoPerf_t, kNUM_CUDNN_FWD_ALGS>
             fwd_perf_stat;
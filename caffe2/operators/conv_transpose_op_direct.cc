@@ -0,0 +1,86 @@
+#include "caffe2/operators/conv_transpose_op_direct.h"
+
+namespace caffe2 {
+
+// Channel by channel, so that the taps add to an output plane in the cache.
+template <>
+void ConvTransposeAddTaps<float, CPUContext, StorageOrder::NCHW>(
+    const int C,
+    const int rows,
+    const int W,
+    const int first,
+    const int group,
+    const int kernel_w,
+    const int out_h,
+    const int out_w,
+    const int stride_h,
+    const int stride_w,
+    const int output_h,
+    const int output_w,
+    const float* taps,
+    float* Y,
+    CPUContext* /*context*/) {
+  const int tap_size = C * rows * W;
+  for (int c = 0; c < C; ++c) {
+    float* Y_c = Y + c * output_h * output_w;
+    for (int i = 0; i < group; ++i) {
+      const int kh = (first + i) / kernel_w;
+      const int kw = (first + i) % kernel_w;
+      int h_lo, h_hi, w_lo, w_hi;
+      ConvTransposeValidRange(
+          out_h + kh, stride_h, output_h, rows, &h_lo, &h_hi);
+      ConvTransposeValidRange(
+          out_w + kw, stride_w, output_w, W, &w_lo, &w_hi);
+      const float* tap = taps + i * tap_size + c * rows * W;
+      for (int h = h_lo; h < h_hi; ++h) {
+        const float* src = tap + h * W;
+        float* dst =
+            Y_c + (out_h + kh + h * stride_h) * output_w + out_w + kw;
+        for (int w = w_lo; w < w_hi; ++w) {
+          dst[w * stride_w] += src[w];
+        }
+      }
+    }
+  }
+}
+
+// Pixel by pixel, so that the taps add to a patch of the output.
+template <>
+void ConvTransposeAddTaps<float, CPUContext, StorageOrder::NHWC>(
+    const int C,
+    const int rows,
+    const int W,
+    const int first,
+    const int group,
+    const int kernel_w,
+    const int out_h,
+    const int out_w,
+    const int stride_h,
+    const int stride_w,
+    const int output_h,
+    const int output_w,
+    const float* taps,
+    float* Y,
+    CPUContext* context) {
+  for (int h = 0; h < rows; ++h) {
+    for (int w = 0; w < W; ++w) {
+      const float* src = taps + (h * W + w) * group * C;
+      for (int i = 0; i < group; ++i, src += C) {
+        const int oh = out_h + (first + i) / kernel_w + h * stride_h;
+        const int ow = out_w + (first + i) % kernel_w + w * stride_w;
+        if (oh < 0 || oh >= output_h || ow < 0 || ow >= output_w) {
+          continue;
+        }
+        float* dst = Y + (oh * output_w + ow) * C;
+        math::Add<float, CPUContext>(C, dst, src, dst, context);
+      }
+    }
+  }
+}
+
+REGISTER_CPU_OPERATOR_WITH_ENGINE(
+    ConvTranspose,
+    DIRECT,
+    ConvTransposeDirectOp<float, CPUContext>);
+
+} // namespace caffe2
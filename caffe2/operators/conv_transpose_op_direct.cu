@@ -0,0 +1,173 @@
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/operators/conv_transpose_op_direct.h"
+#include "caffe2/utils/fixed_divisor.h"
+
+namespace caffe2 {
+
+namespace {
+
+// The inputs of a tap map to distinct outputs, so that every thread owns the
+// output it adds to. The kernels only go over the inputs whose outputs fall
+// in the image, from (h_lo, w_lo) on.
+__global__ void ConvTransposeAddTapNCHWKernel(
+    const int n,
+    const IndexDecomposer<3> dims,
+    const int W,
+    const int tap_ld,
+    const int h_lo,
+    const int w_lo,
+    const int out_h,
+    const int out_w,
+    const int stride_h,
+    const int stride_w,
+    const int output_h,
+    const int output_w,
+    const float* tap,
+    float* Y) {
+  CUDA_1D_KERNEL_LOOP(index, n) {
+    int coords[3];
+    dims.decompose(index, coords);
+    const int c = coords[0];
+    const int h = h_lo + coords[1];
+    const int w = w_lo + coords[2];
+    Y[(c * output_h + out_h + h * stride_h) * output_w + out_w +
+      w * stride_w] += tap[c * tap_ld + h * W + w];
+  }
+}
+
+__global__ void ConvTransposeAddTapNHWCKernel(
+    const int n,
+    const IndexDecomposer<3> dims,
+    const int C,
+    const int W,
+    const int tap_ld,
+    const int h_lo,
+    const int w_lo,
+    const int out_h,
+    const int out_w,
+    const int stride_h,
+    const int stride_w,
+    const int output_w,
+    const float* tap,
+    float* Y) {
+  CUDA_1D_KERNEL_LOOP(index, n) {
+    int coords[3];
+    dims.decompose(index, coords);
+    const int h = h_lo + coords[0];
+    const int w = w_lo + coords[1];
+    const int c = coords[2];
+    Y[((out_h + h * stride_h) * output_w + out_w + w * stride_w) * C + c] +=
+        tap[(h * W + w) * tap_ld + c];
+  }
+}
+
+} // namespace
+
+// One launch per tap, since the inputs of different taps may add to the same
+// output.
+template <>
+void ConvTransposeAddTaps<float, CUDAContext, StorageOrder::NCHW>(
+    const int C,
+    const int rows,
+    const int W,
+    const int first,
+    const int group,
+    const int kernel_w,
+    const int out_h,
+    const int out_w,
+    const int stride_h,
+    const int stride_w,
+    const int output_h,
+    const int output_w,
+    const float* taps,
+    float* Y,
+    CUDAContext* context) {
+  for (int i = 0; i < group; ++i) {
+    const int kh = (first + i) / kernel_w;
+    const int kw = (first + i) % kernel_w;
+    int h_lo, h_hi, w_lo, w_hi;
+    ConvTransposeValidRange(
+        out_h + kh, stride_h, output_h, rows, &h_lo, &h_hi);
+    ConvTransposeValidRange(out_w + kw, stride_w, output_w, W, &w_lo, &w_hi);
+    const int n = C * (h_hi - h_lo) * (w_hi - w_lo);
+    if (n == 0) {
+      continue;
+    }
+    ConvTransposeAddTapNCHWKernel<<<
+        CAFFE_GET_BLOCKS(n),
+        CAFFE_CUDA_NUM_THREADS,
+        0,
+        context->cuda_stream()>>>(
+        n,
+        IndexDecomposer<3>{C, h_hi - h_lo, w_hi - w_lo},
+        W,
+        rows * W,
+        h_lo,
+        w_lo,
+        out_h + kh,
+        out_w + kw,
+        stride_h,
+        stride_w,
+        output_h,
+        output_w,
+        taps + i * C * rows * W,
+        Y);
+  }
+}
+
+template <>
+void ConvTransposeAddTaps<float, CUDAContext, StorageOrder::NHWC>(
+    const int C,
+    const int rows,
+    const int W,
+    const int first,
+    const int group,
+    const int kernel_w,
+    const int out_h,
+    const int out_w,
+    const int stride_h,
+    const int stride_w,
+    const int output_h,
+    const int output_w,
+    const float* taps,
+    float* Y,
+    CUDAContext* context) {
+  for (int i = 0; i < group; ++i) {
+    const int kh = (first + i) / kernel_w;
+    const int kw = (first + i) % kernel_w;
+    int h_lo, h_hi, w_lo, w_hi;
+    ConvTransposeValidRange(
+        out_h + kh, stride_h, output_h, rows, &h_lo, &h_hi);
+    ConvTransposeValidRange(out_w + kw, stride_w, output_w, W, &w_lo, &w_hi);
+    const int n = (h_hi - h_lo) * (w_hi - w_lo) * C;
+    if (n == 0) {
+      continue;
+    }
+    ConvTransposeAddTapNHWCKernel<<<
+        CAFFE_GET_BLOCKS(n),
+        CAFFE_CUDA_NUM_THREADS,
+        0,
+        context->cuda_stream()>>>(
+        n,
+        IndexDecomposer<3>{h_hi - h_lo, w_hi - w_lo, C},
+        C,
+        W,
+        group * C,
+        h_lo,
+        w_lo,
+        out_h + kh,
+        out_w + kw,
+        stride_h,
+        stride_w,
+        output_w,
+        taps + i * C,
+        Y);
+  }
+}
+
+REGISTER_CUDA_OPERATOR_WITH_ENGINE(
+    ConvTranspose,
+    DIRECT,
+    ConvTransposeDirectOp<float, CUDAContext>);
+
+} // namespace caffe2
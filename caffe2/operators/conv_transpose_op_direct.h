@@ -0,0 +1,313 @@
+#ifndef CAFFE2_OPERATORS_CONV_TRANSPOSE_OP_DIRECT_H_
+#define CAFFE2_OPERATORS_CONV_TRANSPOSE_OP_DIRECT_H_
+
+#include <algorithm>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/flags.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/conv_op_shared.h"
+#include "caffe2/operators/conv_transpose_unpool_op_base.h"
+#include "caffe2/utils/math.h"
+
+CAFFE2_DECLARE_bool(caffe2_force_shared_col_buffer);
+
+namespace caffe2 {
+
+// The input positions i in [*lo, *hi) of a dimension of size n whose output
+// positions offset + i * stride fall in [0, limit).
+inline void ConvTransposeValidRange(
+    const int offset,
+    const int stride,
+    const int limit,
+    const int n,
+    int* lo,
+    int* hi) {
+  *lo = offset >= 0 ? 0 : (-offset + stride - 1) / stride;
+  *hi = limit > offset ? (limit - offset + stride - 1) / stride : 0;
+  *hi = std::min(*hi, n);
+  *lo = std::min(*lo, *hi);
+}
+
+// Adds the contributions of the kernel taps [first, first + group), computed
+// for a block of rows of the input, to the output image Y. Through tap
+// (kh, kw), the input at (h, w) of the block lands at
+// (out_h + kh + h * stride_h, out_w + kw + w * stride_w) of the output. The
+// taps are (group, C, rows * W) in NCHW and (rows * W, group, C) in NHWC.
+template <typename T, class Context, StorageOrder kOrder>
+void ConvTransposeAddTaps(
+    const int C,
+    const int rows,
+    const int W,
+    const int first,
+    const int group,
+    const int kernel_w,
+    const int out_h,
+    const int out_w,
+    const int stride_h,
+    const int stride_w,
+    const int output_h,
+    const int output_w,
+    const T* taps,
+    T* Y,
+    Context* context);
+
+// ConvTranspose engine that writes the output directly, selected with engine
+// "DIRECT". The default implementation computes all the kernel_h * kernel_w
+// taps of an image into a col buffer of kernel_h * kernel_w * C * H * W and
+// reduces it into the output with Col2im. This one computes a group of taps
+// for a block of input rows at a time, with one GEMM into a buffer of at most
+// kMaxTapBufferSize values, and adds the taps to the output at the strided
+// positions that they cover. The buffer lives in the shared col buffer when
+// shared_buffer is set.
+template <typename T, class Context>
+class ConvTransposeDirectOp final : public ConvTransposeUnpoolBase<Context> {
+ public:
+  USE_CONV_TRANSPOSE_UNPOOL_BASE_FUNCTIONS(Context);
+  ConvTransposeDirectOp(const OperatorDef& operator_def, Workspace* ws)
+      : ConvTransposeUnpoolBase<Context>(operator_def, ws) {}
+
+  bool RunOnDeviceWithOrderNCHW() override {
+    const auto& X = Input(INPUT);
+    const auto& filter = Input(FILTER);
+    const auto& bias = Input(BIAS);
+    auto* Y = Output(0);
+    const int N = X.dim32(0), M = X.dim32(1), H = X.dim32(2), W = X.dim32(3);
+    CAFFE_ENFORCE(filter.ndim() == 4, "filter must be 4D tensor");
+    CAFFE_ENFORCE(
+        filter.dim32(0) == M,
+        "filter number must be equal to input channel number");
+    const int C = filter.dim32(1);
+    CAFFE_ENFORCE(
+        filter.dim32(2) == kernel_h_,
+        "filter height must be equal to kernel height");
+    CAFFE_ENFORCE(
+        filter.dim32(3) == kernel_w_,
+        "filter width must be equal to kernel width");
+    CAFFE_ENFORCE(
+        bias.ndim() == 1 && bias.dim32(0) == C,
+        "bias dimension must be equal to output channel number");
+    ConvTransposeUnpoolBase<Context>::SetOutputSize(X, Y, C);
+    const int output_h = Y->dim32(2), output_w = Y->dim32(3);
+
+    // The (M, kernel_h, kernel_w, C) filter, so that the taps of a group
+    // are next to each other, as in NHWC.
+    const int taps = kernel_h_ * kernel_w_;
+    packed_filter_.Resize(M, taps, C);
+    math::Transpose2D<T, Context>(
+        M,
+        C,
+        taps,
+        filter.template data<T>(),
+        packed_filter_.template mutable_data<T>(),
+        &context_);
+    const T* packed = packed_filter_.template data<T>();
+    SetBiasMultiplier(output_h * output_w);
+
+    int block_rows, group_taps;
+    Blocking(C * W, H, &block_rows, &group_taps);
+    const T* Xdata = X.template data<T>();
+    T* Ydata = Y->template mutable_data<T>();
+    auto f = [&](Tensor<Context>* buffer) {
+      buffer->Resize(group_taps, C, block_rows * W);
+      T* buffer_data = buffer->template mutable_data<T>();
+      for (int image_id = 0; image_id < N; ++image_id) {
+        math::Gemm<T, Context>(
+            CblasNoTrans,
+            CblasNoTrans,
+            C,
+            output_h * output_w,
+            1,
+            1,
+            bias.template data<T>(),
+            bias_multiplier_.template data<T>(),
+            0,
+            Ydata,
+            &context_);
+        for (int row = 0; row < H; row += block_rows) {
+          const int rows = std::min(block_rows, H - row);
+          for (int first = 0; first < taps; first += group_taps) {
+            const int group = std::min(group_taps, taps - first);
+            math::GemmEx<T, Context>(
+                CblasTrans,
+                CblasNoTrans,
+                group * C,
+                rows * W,
+                M,
+                1,
+                packed + first * C,
+                taps * C,
+                Xdata + row * W,
+                H * W,
+                0,
+                buffer_data,
+                rows * W,
+                &context_);
+            ConvTransposeAddTaps<T, Context, StorageOrder::NCHW>(
+                C,
+                rows,
+                W,
+                first,
+                group,
+                kernel_w_,
+                row * stride_h_ - pad_t_,
+                -pad_l_,
+                stride_h_,
+                stride_w_,
+                output_h,
+                output_w,
+                buffer_data,
+                Ydata,
+                &context_);
+          }
+        }
+        Xdata += M * H * W;
+        Ydata += C * output_h * output_w;
+      }
+    };
+    RunWithBuffer(f);
+    return true;
+  }
+
+  bool RunOnDeviceWithOrderNHWC() override {
+    const auto& X = Input(INPUT);
+    const auto& filter = Input(FILTER);
+    const auto& bias = Input(BIAS);
+    auto* Y = Output(0);
+    const int N = X.dim32(0), H = X.dim32(1), W = X.dim32(2), M = X.dim32(3);
+    CAFFE_ENFORCE(filter.ndim() == 4, "filter must be 4D tensor");
+    CAFFE_ENFORCE(
+        filter.dim32(0) == M,
+        "filter number must be equal to input channel number");
+    CAFFE_ENFORCE(
+        filter.dim32(1) == kernel_h_,
+        "filter height must be equal to kernel height");
+    CAFFE_ENFORCE(
+        filter.dim32(2) == kernel_w_,
+        "filter width must be equal to kernel width");
+    const int C = filter.dim32(3);
+    CAFFE_ENFORCE(
+        bias.ndim() == 1 && bias.dim32(0) == C,
+        "bias dimension must be equal to output channel number");
+    ConvTransposeUnpoolBase<Context>::SetOutputSize(X, Y, C);
+    const int output_h = Y->dim32(1), output_w = Y->dim32(2);
+    SetBiasMultiplier(output_h * output_w);
+
+    // The taps of a group are next to each other in the
+    // (M, kernel_h, kernel_w, C) filter.
+    const int taps = kernel_h_ * kernel_w_;
+    int block_rows, group_taps;
+    Blocking(W * C, H, &block_rows, &group_taps);
+    const T* Xdata = X.template data<T>();
+    T* Ydata = Y->template mutable_data<T>();
+    auto f = [&](Tensor<Context>* buffer) {
+      buffer->Resize(block_rows * W, group_taps, C);
+      T* buffer_data = buffer->template mutable_data<T>();
+      for (int image_id = 0; image_id < N; ++image_id) {
+        math::Gemm<T, Context>(
+            CblasNoTrans,
+            CblasNoTrans,
+            output_h * output_w,
+            C,
+            1,
+            1,
+            bias_multiplier_.template data<T>(),
+            bias.template data<T>(),
+            0,
+            Ydata,
+            &context_);
+        for (int row = 0; row < H; row += block_rows) {
+          const int rows = std::min(block_rows, H - row);
+          for (int first = 0; first < taps; first += group_taps) {
+            const int group = std::min(group_taps, taps - first);
+            math::GemmEx<T, Context>(
+                CblasNoTrans,
+                CblasNoTrans,
+                rows * W,
+                group * C,
+                M,
+                1,
+                Xdata + row * W * M,
+                M,
+                filter.template data<T>() + first * C,
+                taps * C,
+                0,
+                buffer_data,
+                group * C,
+                &context_);
+            ConvTransposeAddTaps<T, Context, StorageOrder::NHWC>(
+                C,
+                rows,
+                W,
+                first,
+                group,
+                kernel_w_,
+                row * stride_h_ - pad_t_,
+                -pad_l_,
+                stride_h_,
+                stride_w_,
+                output_h,
+                output_w,
+                buffer_data,
+                Ydata,
+                &context_);
+          }
+        }
+        Xdata += H * W * M;
+        Ydata += output_h * output_w * C;
+      }
+    };
+    RunWithBuffer(f);
+    return true;
+  }
+
+ private:
+  // The values of the tap buffer: enough for wide GEMMs, and a small part of
+  // the col buffer of the default engine for large images.
+  static constexpr int kMaxTapBufferSize = 1 << 20;
+
+  // The input rows of a block and the taps of a group that fill the buffer,
+  // for an input of height rows of row_size outputs per tap.
+  void Blocking(
+      const int row_size,
+      const int height,
+      int* block_rows,
+      int* group_taps) const {
+    const int budget = kMaxTapBufferSize;
+    *block_rows = std::max(1, std::min(height, budget / row_size));
+    *group_taps = std::max(
+        1,
+        std::min(kernel_h_ * kernel_w_, budget / (*block_rows * row_size)));
+  }
+
+  void SetBiasMultiplier(const int size) {
+    if (bias_multiplier_.size() != size) {
+      bias_multiplier_.Resize(size);
+      math::Set<T, Context>(
+          size,
+          static_cast<T>(1),
+          bias_multiplier_.template mutable_data<T>(),
+          &context_);
+    }
+  }
+
+  template <typename F>
+  void RunWithBuffer(F& f) {
+    if (FLAGS_caffe2_force_shared_col_buffer || shared_buffer_) {
+      runWithSharedBuffer<Context>(ws_, f);
+    } else {
+      f(&tap_buffer_);
+    }
+  }
+
+  Tensor<Context> tap_buffer_;
+  Tensor<Context> packed_filter_;
+  Tensor<Context> bias_multiplier_;
+  // Input: X, W, b
+  // Output: Y
+  INPUT_TAGS(INPUT, FILTER, BIAS);
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_CONV_TRANSPOSE_OP_DIRECT_H_
@@ -0,0 +1,98 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/conv_transpose_op.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+using DefaultConvTransposeOp = ConvTransposeOp<float, CPUContext>;
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+// kernel, stride, pad_t, pad_l, pad_b, pad_r, adj.
+using Config = vector<int>;
+
+OperatorDef ConvTransposeDef(
+    const string& engine,
+    const string& order,
+    const Config& config,
+    const string& output) {
+  OperatorDef def;
+  def.set_type("ConvTranspose");
+  def.set_engine(engine);
+  def.add_input("X");
+  def.add_input("W");
+  def.add_input("b");
+  def.add_output(output);
+  AddArgument<int>("kernel", config[0], &def);
+  AddArgument<int>("stride", config[1], &def);
+  AddArgument<int>("pad_t", config[2], &def);
+  AddArgument<int>("pad_l", config[3], &def);
+  AddArgument<int>("pad_b", config[4], &def);
+  AddArgument<int>("pad_r", config[5], &def);
+  AddArgument<int>("adj", config[6], &def);
+  AddArgument<string>("order", order, &def);
+  return def;
+}
+
+} // namespace
+
+TEST(DirectConvTransposeTest, MatchesDefaultEngine) {
+  const int N = 2, M = 5, C = 3, H = 6, W = 7;
+  // The 2x upsampling of decoders, and odd kernels, strides and pads.
+  const vector<Config> configs = {{4, 2, 1, 1, 1, 1, 0},
+                                  {2, 2, 0, 0, 0, 0, 0},
+                                  {3, 2, 1, 1, 1, 1, 1},
+                                  {3, 1, 1, 1, 1, 1, 0},
+                                  {5, 3, 2, 0, 1, 3, 2}};
+  std::mt19937 gen(0);
+  for (const string order : {"NCHW", "NHWC"}) {
+    for (const auto& config : configs) {
+      for (bool shared_buffer : {false, true}) {
+        const int k = config[0];
+        Workspace ws;
+        if (order == "NCHW") {
+          AddRandomTensor(&ws, "X", {N, M, H, W}, &gen);
+          AddRandomTensor(&ws, "W", {M, C, k, k}, &gen);
+        } else {
+          AddRandomTensor(&ws, "X", {N, H, W, M}, &gen);
+          AddRandomTensor(&ws, "W", {M, k, k, C}, &gen);
+        }
+        AddRandomTensor(&ws, "b", {C}, &gen);
+        ASSERT_TRUE(ws.RunOperatorOnce(
+            ConvTransposeDef("", order, config, "expected")));
+        auto def = ConvTransposeDef("DIRECT", order, config, "actual");
+        AddArgument<int>("shared_buffer", shared_buffer, &def);
+        unique_ptr<OperatorBase> op(CreateOperator(def, &ws));
+        ASSERT_EQ(dynamic_cast<DefaultConvTransposeOp*>(op.get()), nullptr);
+        // The second run writes over the output of the first one.
+        for (int run = 0; run < 2; ++run) {
+          ASSERT_TRUE(op->Run());
+          const auto& expected = ws.GetBlob("expected")->Get<TensorCPU>();
+          const auto& actual = ws.GetBlob("actual")->Get<TensorCPU>();
+          ASSERT_EQ(expected.dims(), actual.dims());
+          for (int i = 0; i < expected.size(); ++i) {
+            EXPECT_NEAR(
+                expected.data<float>()[i], actual.data<float>()[i], 1e-4);
+          }
+        }
+      }
+    }
+  }
+}
+
+} // namespace caffe2
@@ -180,26 +180,42 @@ class TreeIterator {
 
 class TreeCursor {
  public:
-  explicit TreeCursor(const TreeIterator& iterator) : it(iterator) {}
+  explicit TreeCursor(const TreeIterator& iterator, int numShards = 0)
+      : it(iterator), shards(numShards) {}
   std::vector<TOffset> offsets;
   std::mutex mutex_;
   TreeIterator it;
+
+  // A contiguous range of the top-level entries, with the offsets of the next
+  // read and of the end of the range in each domain. Both are empty until the
+  // first read of the shard.
+  struct Shard {
+    std::vector<TOffset> offsets;
+    std::vector<TOffset> limits;
+  };
+  // Each shard is read by a single reader, so they are not guarded by mutex_.
+  std::vector<Shard> shards;
 };
 
 class CreateTreeCursorOp : public Operator<CPUContext> {
  public:
   CreateTreeCursorOp(const OperatorDef& operator_def, Workspace* ws)
       : Operator(operator_def, ws),
-        fields_(OperatorBase::GetRepeatedArgument<std::string>("fields")) {}
+        fields_(OperatorBase::GetRepeatedArgument<std::string>("fields")),
+        numShards_(OperatorBase::GetSingleArgument<int>("num_shards", 0)) {
+    CAFFE_ENFORCE_GE(numShards_, 0);
+  }
 
   bool RunOnDevice() override {
     *OperatorBase::Output<std::unique_ptr<TreeCursor>>(0) =
-        std::unique_ptr<TreeCursor>(new TreeCursor(TreeIterator(fields_)));
+        std::unique_ptr<TreeCursor>(
+            new TreeCursor(TreeIterator(fields_), numShards_));
     return true;
   }
 
  private:
   std::vector<std::string> fields_;
+  int numShards_;
 };
 
 class ResetCursorOp : public Operator<CPUContext> {
@@ -211,6 +227,10 @@ class ResetCursorOp : public Operator<CPUContext> {
     auto& cursor = OperatorBase::Input<std::unique_ptr<TreeCursor>>(0);
     std::lock_guard<std::mutex> lock(cursor->mutex_);
     cursor->offsets.clear();
+    for (auto& shard : cursor->shards) {
+      shard.offsets.clear();
+      shard.limits.clear();
+    }
     return true;
   }
 };
@@ -278,7 +298,8 @@ class ReadNextBatchOp : public Operator<CPUContext> {
  public:
   ReadNextBatchOp(const OperatorDef& operator_def, Workspace* ws)
       : Operator(operator_def, ws),
-        batchSize_(OperatorBase::GetSingleArgument<int>("batch_size", 1)) {}
+        batchSize_(OperatorBase::GetSingleArgument<int>("batch_size", 1)),
+        shardId_(OperatorBase::GetSingleArgument<int>("shard_id", -1)) {}
 
   bool RunOnDevice() override {
     auto& cursor = OperatorBase::Input<std::unique_ptr<TreeCursor>>(0);
@@ -307,7 +328,19 @@ class ReadNextBatchOp : public Operator<CPUContext> {
           std::min(limits[lengthFieldIdx], (TOffset)Input(i + 1).dims()[0]);
     }
     // advance cursor
-    {
+    if (shardId_ >= 0) {
+      CAFFE_ENFORCE_LT(
+          shardId_,
+          cursor->shards.size(),
+          "The cursor was created with fewer shards.");
+      auto& shard = cursor->shards[shardId_];
+      if (shard.offsets.empty()) {
+        initShard(cursor.get(), lengths, limits, &shard);
+      }
+      offsets = shard.offsets;
+      cursor->it.advance(
+          lengths, shard.offsets, sizes, shard.limits, batchSize_);
+    } else {
       std::lock_guard<std::mutex> lock(cursor->mutex_);
       if (cursor->offsets.empty()) {
         cursor->offsets.assign(sizes.size(), 0);
@@ -338,7 +371,27 @@ class ReadNextBatchOp : public Operator<CPUContext> {
     }
     return true;
   }
+
+ private:
+  // Finds the offsets of the range of the shard in each domain, by advancing
+  // through the lengths of the entries before it.
+  void initShard(
+      TreeCursor* cursor,
+      const std::vector<const TLength*>& lengths,
+      std::vector<TOffset>& limits,
+      TreeCursor::Shard* shard) {
+    const TOffset numShards = cursor->shards.size();
+    const TOffset begin = limits[0] * shardId_ / numShards;
+    const TOffset end = limits[0] * (shardId_ + 1) / numShards;
+    std::vector<TOffset> sizes;
+    shard->offsets.assign(limits.size(), 0);
+    cursor->it.advance(lengths, shard->offsets, sizes, limits, begin);
+    shard->limits = shard->offsets;
+    cursor->it.advance(lengths, shard->limits, sizes, limits, end - begin);
+  }
+
   int batchSize_;
+  int shardId_;
 };
 
 class ComputeOffsetOp : public Operator<CPUContext> {
@@ -531,6 +584,20 @@ class ReadRandomBatchOp : public Operator<CPUContext> {
           "block_bytesize should be consistent with data dim");
       auto src_base = static_cast<const char*>(in.raw_data());
       int start = 0;
+      // The entries that follow each other in the input are copied together,
+      // in one copy per run of them.
+      TOffset runOffset = 0;
+      TOffset runSize = 0;
+      auto copyRun = [&]() {
+        if (runSize > 0) {
+          context_.template CopyItems<CPUContext, CPUContext>(
+              in.meta(),
+              runSize * block_size,
+              src_base + runOffset * block_bytesize,
+              dst + start * block_bytesize);
+          start += runSize;
+        }
+      };
       for (int j = 0; j < batchSize_; ++j) {
         if (idx >= idxblob.size()) {
           break;
@@ -539,13 +606,15 @@ class ReadRandomBatchOp : public Operator<CPUContext> {
             idxvec[idx] * offsetdim[1] + lengthIdx;
         auto offset = *offsetptr;
         auto size = *(offsetptr + offsetdim[1]) - offset;
-        // copy data
-        auto src = src_base + offset * block_bytesize;
-        context_.template CopyItems<CPUContext, CPUContext>(
-            in.meta(), size * block_size, src, dst + start * block_bytesize);
-        start += size;
+        if (offset != runOffset + runSize) {
+          copyRun();
+          runOffset = offset;
+          runSize = 0;
+        }
+        runSize += size;
         idx++;
       }
+      copyRun();
       idx = idxbegin; // reSet
     }
     return true;
@@ -856,7 +925,12 @@ to pass a list of blobs containing the data to read for each one of the fields.
     .Output(0, "cursor", "A blob pointing to an instance of a new TreeCursor.")
     .Arg(
         "fields",
-        "A list of strings each one representing a field of the dataset.");
+        "A list of strings each one representing a field of the dataset.")
+    .Arg(
+        "num_shards",
+        "If positive, the top-level entries are also split into that many "
+        "contiguous shards, which ReadNextBatch can read with shard_id "
+        "without taking the lock of the cursor.");
 
 OPERATOR_SCHEMA(ResetCursor)
     .NumInputs(1)
@@ -881,7 +955,12 @@ ReadNextBatch is thread safe.
     .Input(0, "cursor", "A blob containing a pointer to the cursor.")
     .Input(1, "dataset_field_0", "First dataset field")
     .Output(0, "field_0", "Tensor containing the next batch for field 0.")
-    .Arg("batch_size", "Number of top-level entries to read.");
+    .Arg("batch_size", "Number of top-level entries to read.")
+    .Arg(
+        "shard_id",
+        "If set, read from this shard of the cursor only, without locking. "
+        "Each shard must then be read by a single reader at a time. The "
+        "bounds of a shard are computed from the data on its first read.");
 
 OPERATOR_SCHEMA(ComputeOffset)
     .NumInputs(1, INT_MAX)
@@ -89,6 +89,58 @@ bool CosineSimilarityOp<float, CPUContext>::RunOnDevice() {
   return true;
 }
 
+template <>
+void RowwiseSquaredNorms<float, CPUContext>(
+    const int N,
+    const int D,
+    const float* X,
+    float* norms,
+    CPUContext* /*context*/) {
+  EigenVectorMap<float>(norms, N) =
+      ConstEigenMatrixMap<float>(X, D, N).colwise().squaredNorm().transpose();
+}
+
+template <>
+void ApplyPairwiseNorms<float, CPUContext>(
+    const PairwiseDistance kind,
+    const int N,
+    const int M,
+    const float* x_norms,
+    const float* y_norms,
+    float* P,
+    CPUContext* /*context*/) {
+  // Column i of the M x N column major map is row i of P.
+  EigenArrayMap<float> P_map(P, M, N);
+  ConstEigenVectorArrayMap<float> x_map(x_norms, N);
+  ConstEigenVectorArrayMap<float> y_map(y_norms, M);
+  if (kind == PairwiseDistance::kSquaredL2) {
+    P_map.colwise() += 0.5f * y_map;
+    P_map.rowwise() += 0.5f * x_map.transpose();
+  } else if (kind == PairwiseDistance::kCosine) {
+    P_map.colwise() *= y_map.max(kPairwiseNormEpsilon).sqrt().inverse();
+    P_map.rowwise() *=
+        x_map.max(kPairwiseNormEpsilon).sqrt().inverse().transpose();
+  }
+}
+
+template <>
+void RowwiseAxpy<float, CPUContext>(
+    const int N,
+    const int D,
+    const float* coeffs,
+    const float* norms,
+    const float* X,
+    float* Y,
+    CPUContext* /*context*/) {
+  Eigen::ArrayXf scales = ConstEigenVectorArrayMap<float>(coeffs, N);
+  if (norms) {
+    scales /= ConstEigenVectorArrayMap<float>(norms, N).max(
+        kPairwiseNormEpsilon);
+  }
+  EigenMatrixMap<float>(Y, D, N).noalias() +=
+      ConstEigenMatrixMap<float>(X, D, N) * scales.matrix().asDiagonal();
+}
+
 namespace {
 // L2
 REGISTER_CPU_OPERATOR(SquaredL2Distance,
@@ -182,5 +234,84 @@ class GetCosineSimilarityGradient : public GradientMakerBase {
 };
 REGISTER_GRADIENT(CosineSimilarity, GetCosineSimilarityGradient);
 
+// Pairwise
+REGISTER_CPU_OPERATOR(
+    PairwiseDotProduct,
+    PairwiseDistanceOp<float, CPUContext, PairwiseDistance::kDotProduct>);
+REGISTER_CPU_OPERATOR(
+    PairwiseDotProductGradient,
+    PairwiseDistanceGradientOp<
+        float,
+        CPUContext,
+        PairwiseDistance::kDotProduct>);
+REGISTER_CPU_OPERATOR(
+    PairwiseSquaredL2Distance,
+    PairwiseDistanceOp<float, CPUContext, PairwiseDistance::kSquaredL2>);
+REGISTER_CPU_OPERATOR(
+    PairwiseSquaredL2DistanceGradient,
+    PairwiseDistanceGradientOp<
+        float,
+        CPUContext,
+        PairwiseDistance::kSquaredL2>);
+REGISTER_CPU_OPERATOR(
+    PairwiseCosineSimilarity,
+    PairwiseDistanceOp<float, CPUContext, PairwiseDistance::kCosine>);
+REGISTER_CPU_OPERATOR(
+    PairwiseCosineSimilarityGradient,
+    PairwiseDistanceGradientOp<float, CPUContext, PairwiseDistance::kCosine>);
+
+vector<TensorShape> PairwiseDistanceShape(
+    const OperatorDef& /*def*/,
+    const vector<TensorShape>& in) {
+  vector<TensorShape> out(1);
+  out[0] = CreateTensorShape(
+      vector<int>{static_cast<int>(in[0].dims(0)),
+                  static_cast<int>(in[1].dims(0))},
+      in[0].data_type());
+  return out;
+}
+
+#define PAIRWISE_DISTANCE_SCHEMA(name, what)                                  \
+  OPERATOR_SCHEMA(name)                                                       \
+      .NumInputs(2)                                                           \
+      .NumOutputs(1)                                                          \
+      .TensorInferenceFunction(PairwiseDistanceShape)                         \
+      .SetDoc(                                                                \
+          "Given a float tensor X of N rows and a float tensor Y of M rows "  \
+          "of the same size, produces the N x M matrix of the " what          \
+          " between every row of X and every row of Y, with a single matrix " \
+          "product. It replaces tiling X and Y to pair the rows for the "     \
+          "row-aligned operator.")                                            \
+      .Input(0, "X", "Tensor of shape (N, D1, D2, ...)")                      \
+      .Input(1, "Y", "Tensor of shape (M, D1, D2, ...)")                      \
+      .Output(0, "Z", "Tensor of shape (N, M)")
+
+PAIRWISE_DISTANCE_SCHEMA(PairwiseDotProduct, "dot products");
+PAIRWISE_DISTANCE_SCHEMA(
+    PairwiseSquaredL2Distance,
+    "halved squared L2 distances ||x - y||^2 / 2");
+PAIRWISE_DISTANCE_SCHEMA(PairwiseCosineSimilarity, "cosine similarities");
+#undef PAIRWISE_DISTANCE_SCHEMA
+
+OPERATOR_SCHEMA(PairwiseDotProductGradient).NumInputs(3).NumOutputs(2);
+OPERATOR_SCHEMA(PairwiseSquaredL2DistanceGradient).NumInputs(3).NumOutputs(2);
+OPERATOR_SCHEMA(PairwiseCosineSimilarityGradient).NumInputs(4).NumOutputs(2);
+
+class GetPairwiseDistanceGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    vector<string> inputs{I(0), I(1), GO(0)};
+    // The cosine similarity reuses its output rather than dividing again.
+    if (def_.type() == "PairwiseCosineSimilarity") {
+      inputs.push_back(O(0));
+    }
+    return SingleGradientDef(
+        def_.type() + "Gradient", "", inputs, vector<string>{GI(0), GI(1)});
+  }
+};
+REGISTER_GRADIENT(PairwiseDotProduct, GetPairwiseDistanceGradient);
+REGISTER_GRADIENT(PairwiseSquaredL2Distance, GetPairwiseDistanceGradient);
+REGISTER_GRADIENT(PairwiseCosineSimilarity, GetPairwiseDistanceGradient);
+
 }  // namespace
 }  // namespace caffe2
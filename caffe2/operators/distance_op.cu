@@ -1,3 +1,5 @@
+#include "cub/block/block_reduce.cuh"
+
 #include "caffe2/core/context_gpu.h"
 #include "caffe2/operators/distance_op.h"
 
@@ -38,11 +40,143 @@ bool SquaredL2DistanceOp<float, CUDAContext>::RunOnDevice() {
   return true;
 }
 
+namespace {
+// One block per row.
+template <typename T>
+__global__ void RowwiseSquaredNormsKernel(const int D, const T* X, T* norms) {
+  typedef cub::BlockReduce<T, CAFFE_CUDA_NUM_THREADS> BlockReduce;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  const T* row = X + blockIdx.x * D;
+  T sum = 0;
+  for (int j = threadIdx.x; j < D; j += blockDim.x) {
+    sum += row[j] * row[j];
+  }
+  sum = BlockReduce(temp_storage).Sum(sum);
+  if (threadIdx.x == 0) {
+    norms[blockIdx.x] = sum;
+  }
+}
+
+template <typename T, bool kCosine>
+__global__ void ApplyPairwiseNormsKernel(
+    const int N,
+    const int M,
+    const T* x_norms,
+    const T* y_norms,
+    T* P) {
+  CUDA_1D_KERNEL_LOOP(k, N * M) {
+    const int i = k / M;
+    const int j = k % M;
+    if (kCosine) {
+      P[k] *= rsqrt(max(x_norms[i], T(kPairwiseNormEpsilon))) *
+          rsqrt(max(y_norms[j], T(kPairwiseNormEpsilon)));
+    } else {
+      P[k] += (x_norms[i] + y_norms[j]) / 2;
+    }
+  }
+}
+
+template <typename T>
+__global__ void RowwiseAxpyKernel(
+    const int N,
+    const int D,
+    const T* coeffs,
+    const T* norms,
+    const T* X,
+    T* Y) {
+  CUDA_1D_KERNEL_LOOP(k, N * D) {
+    const int i = k / D;
+    T coeff = coeffs[i];
+    if (norms) {
+      coeff /= max(norms[i], T(kPairwiseNormEpsilon));
+    }
+    Y[k] += coeff * X[k];
+  }
+}
+}  // namespace
+
+template <>
+void RowwiseSquaredNorms<float, CUDAContext>(
+    const int N,
+    const int D,
+    const float* X,
+    float* norms,
+    CUDAContext* context) {
+  if (N == 0) {
+    return;
+  }
+  RowwiseSquaredNormsKernel<float>
+      <<<N, CAFFE_CUDA_NUM_THREADS, 0, context->cuda_stream()>>>(D, X, norms);
+}
+
+template <>
+void ApplyPairwiseNorms<float, CUDAContext>(
+    const PairwiseDistance kind,
+    const int N,
+    const int M,
+    const float* x_norms,
+    const float* y_norms,
+    float* P,
+    CUDAContext* context) {
+  if (kind == PairwiseDistance::kSquaredL2) {
+    ApplyPairwiseNormsKernel<float, false><<<
+        CAFFE_GET_BLOCKS(N * M),
+        CAFFE_CUDA_NUM_THREADS,
+        0,
+        context->cuda_stream()>>>(N, M, x_norms, y_norms, P);
+  } else if (kind == PairwiseDistance::kCosine) {
+    ApplyPairwiseNormsKernel<float, true><<<
+        CAFFE_GET_BLOCKS(N * M),
+        CAFFE_CUDA_NUM_THREADS,
+        0,
+        context->cuda_stream()>>>(N, M, x_norms, y_norms, P);
+  }
+}
+
+template <>
+void RowwiseAxpy<float, CUDAContext>(
+    const int N,
+    const int D,
+    const float* coeffs,
+    const float* norms,
+    const float* X,
+    float* Y,
+    CUDAContext* context) {
+  RowwiseAxpyKernel<float><<<
+      CAFFE_GET_BLOCKS(N * D),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context->cuda_stream()>>>(N, D, coeffs, norms, X, Y);
+}
 
 namespace {
 REGISTER_CUDA_OPERATOR(SquaredL2Distance,
                        SquaredL2DistanceOp<float, CUDAContext>);
 REGISTER_CUDA_OPERATOR(SquaredL2DistanceGradient,
                        SquaredL2DistanceGradientOp<float, CUDAContext>);
+REGISTER_CUDA_OPERATOR(
+    PairwiseDotProduct,
+    PairwiseDistanceOp<float, CUDAContext, PairwiseDistance::kDotProduct>);
+REGISTER_CUDA_OPERATOR(
+    PairwiseDotProductGradient,
+    PairwiseDistanceGradientOp<
+        float,
+        CUDAContext,
+        PairwiseDistance::kDotProduct>);
+REGISTER_CUDA_OPERATOR(
+    PairwiseSquaredL2Distance,
+    PairwiseDistanceOp<float, CUDAContext, PairwiseDistance::kSquaredL2>);
+REGISTER_CUDA_OPERATOR(
+    PairwiseSquaredL2DistanceGradient,
+    PairwiseDistanceGradientOp<
+        float,
+        CUDAContext,
+        PairwiseDistance::kSquaredL2>);
+REGISTER_CUDA_OPERATOR(
+    PairwiseCosineSimilarity,
+    PairwiseDistanceOp<float, CUDAContext, PairwiseDistance::kCosine>);
+REGISTER_CUDA_OPERATOR(
+    PairwiseCosineSimilarityGradient,
+    PairwiseDistanceGradientOp<float, CUDAContext, PairwiseDistance::kCosine>);
 }  // namespace
 }  // namespace caffe2
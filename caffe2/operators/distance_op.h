@@ -226,6 +226,280 @@ class CosineSimilarityGradientOp final : public Operator<Context> {
   OUTPUT_TAGS(DER_X_OUT, DER_Y_OUT);
 };
 
+// The distances between every row of X and every row of Y, as opposed to the
+// operators above, which pair the i-th rows of X and Y. They cost one Gemm
+// of X by Y^T, plus the squared norms of the rows for the L2 distance and the
+// cosine similarity.
+enum class PairwiseDistance {
+  kDotProduct,
+  kSquaredL2,
+  kCosine,
+};
+
+// The cosine similarity clamps the squared norms to this, as above.
+constexpr float kPairwiseNormEpsilon = 1e-12;
+
+// norms[i] = ||X[i, :]||^2 for the rows of the N x D matrix X.
+template <typename T, class Context>
+void RowwiseSquaredNorms(
+    const int N,
+    const int D,
+    const T* X,
+    T* norms,
+    Context* context);
+
+// Turns the N x M dot products P into the distance of the given kind, with
+// the squared norms of the rows of X and Y: for kSquaredL2, P holds minus the
+// dot products, and becomes (x_norms[i] + y_norms[j]) / 2 + P[i, j]; for
+// kCosine, it becomes P[i, j] / sqrt(x_norms[i] * y_norms[j]), with the norms
+// clamped to kPairwiseNormEpsilon.
+template <typename T, class Context>
+void ApplyPairwiseNorms(
+    const PairwiseDistance kind,
+    const int N,
+    const int M,
+    const T* x_norms,
+    const T* y_norms,
+    T* P,
+    Context* context);
+
+// Y[i, :] += coeffs[i] * X[i, :] for the rows of the N x D matrices X and Y,
+// or coeffs[i] / max(norms[i], kPairwiseNormEpsilon) if norms is given.
+template <typename T, class Context>
+void RowwiseAxpy(
+    const int N,
+    const int D,
+    const T* coeffs,
+    const T* norms,
+    const T* X,
+    T* Y,
+    Context* context);
+
+template <typename T, class Context, PairwiseDistance kKind>
+class PairwiseDistanceOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(PairwiseDistanceOp);
+
+  bool RunOnDevice() override {
+    const auto& X = Input(X_IN);
+    const auto& Y = Input(Y_IN);
+    auto* P = Output(DISTANCE_OUT);
+    CAFFE_ENFORCE_GE(X.ndim(), 1);
+    CAFFE_ENFORCE_GE(Y.ndim(), 1);
+    const int N = X.dim32(0);
+    const int M = Y.dim32(0);
+    const int D = X.size_from_dim(1);
+    CAFFE_ENFORCE_EQ(
+        D, Y.size_from_dim(1), "X and Y must have rows of the same size.");
+    P->Resize(N, M);
+    T* P_data = P->template mutable_data<T>();
+    if (N == 0 || M == 0) {
+      return true;
+    }
+    math::Gemm<T, Context>(
+        CblasNoTrans,
+        CblasTrans,
+        N,
+        M,
+        D,
+        kKind == PairwiseDistance::kSquaredL2 ? -1 : 1,
+        X.template data<T>(),
+        Y.template data<T>(),
+        0,
+        P_data,
+        &context_);
+    if (kKind == PairwiseDistance::kDotProduct) {
+      return true;
+    }
+    x_norms_.Resize(N);
+    y_norms_.Resize(M);
+    RowwiseSquaredNorms<T, Context>(
+        N,
+        D,
+        X.template data<T>(),
+        x_norms_.template mutable_data<T>(),
+        &context_);
+    RowwiseSquaredNorms<T, Context>(
+        M,
+        D,
+        Y.template data<T>(),
+        y_norms_.template mutable_data<T>(),
+        &context_);
+    ApplyPairwiseNorms<T, Context>(
+        kKind,
+        N,
+        M,
+        x_norms_.template data<T>(),
+        y_norms_.template data<T>(),
+        P_data,
+        &context_);
+    return true;
+  }
+
+ protected:
+  INPUT_TAGS(X_IN, Y_IN);
+  OUTPUT_TAGS(DISTANCE_OUT);
+  Tensor<Context> x_norms_;
+  Tensor<Context> y_norms_;
+};
+
+// Input: X, Y, dP, and P for kCosine; Output: dX, dY.
+template <typename T, class Context, PairwiseDistance kKind>
+class PairwiseDistanceGradientOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(PairwiseDistanceGradientOp);
+
+  bool RunOnDevice() override {
+    const auto& X = Input(X_IN);
+    const auto& Y = Input(Y_IN);
+    const auto& dP = Input(DER_DISTANCE_IN);
+    auto* dX = Output(DER_X_OUT);
+    auto* dY = Output(DER_Y_OUT);
+    const int N = X.dim32(0);
+    const int M = Y.dim32(0);
+    const int D = X.size_from_dim(1);
+    CAFFE_ENFORCE_EQ(dP.ndim(), 2);
+    CAFFE_ENFORCE_EQ(dP.dim32(0), N);
+    CAFFE_ENFORCE_EQ(dP.dim32(1), M);
+    dX->ResizeLike(X);
+    dY->ResizeLike(Y);
+    const T* X_data = X.template data<T>();
+    const T* Y_data = Y.template data<T>();
+    T* dX_data = dX->template mutable_data<T>();
+    T* dY_data = dY->template mutable_data<T>();
+    if (N == 0 || M == 0 || D == 0) {
+      math::Set<T, Context>(dX->size(), 0, dX_data, &context_);
+      math::Set<T, Context>(dY->size(), 0, dY_data, &context_);
+      return true;
+    }
+
+    // dX = G * Y and dY = G^T * X, with G = dP but for the cosine, where
+    // G[i, j] = dP[i, j] / (||x_i|| * ||y_j||).
+    const T* G_data = dP.template data<T>();
+    const T alpha = kKind == PairwiseDistance::kSquaredL2 ? -1 : 1;
+    if (kKind == PairwiseDistance::kCosine) {
+      x_norms_.Resize(N);
+      y_norms_.Resize(M);
+      RowwiseSquaredNorms<T, Context>(
+          N, D, X_data, x_norms_.template mutable_data<T>(), &context_);
+      RowwiseSquaredNorms<T, Context>(
+          M, D, Y_data, y_norms_.template mutable_data<T>(), &context_);
+      G_.ResizeLike(dP);
+      G_.template CopyFrom<Context, Context>(dP, &context_);
+      ApplyPairwiseNorms<T, Context>(
+          kKind,
+          N,
+          M,
+          x_norms_.template data<T>(),
+          y_norms_.template data<T>(),
+          G_.template mutable_data<T>(),
+          &context_);
+      G_data = G_.template data<T>();
+    }
+    math::Gemm<T, Context>(
+        CblasNoTrans,
+        CblasNoTrans,
+        N,
+        D,
+        M,
+        alpha,
+        G_data,
+        Y_data,
+        0,
+        dX_data,
+        &context_);
+    math::Gemm<T, Context>(
+        CblasTrans,
+        CblasNoTrans,
+        M,
+        D,
+        N,
+        alpha,
+        G_data,
+        X_data,
+        0,
+        dY_data,
+        &context_);
+    if (kKind == PairwiseDistance::kDotProduct) {
+      return true;
+    }
+
+    // The terms along x_i and y_j themselves: for the L2 distance, the sums
+    // of the rows and columns of dP; for the cosine, minus those of dP * P,
+    // over the squared norms.
+    const T* S_data = dP.template data<T>();
+    if (kKind == PairwiseDistance::kCosine) {
+      const auto& P = Input(DISTANCE_IN);
+      CAFFE_ENFORCE_EQ(P.size(), dP.size());
+      S_.ResizeLike(dP);
+      math::Mul<T, Context>(
+          dP.size(),
+          dP.template data<T>(),
+          P.template data<T>(),
+          S_.template mutable_data<T>(),
+          &context_);
+      S_data = S_.template data<T>();
+    }
+    const T sign = kKind == PairwiseDistance::kCosine ? -1 : 1;
+    ones_.Resize(std::max(N, M));
+    math::Set<T, Context>(
+        ones_.size(), 1, ones_.template mutable_data<T>(), &context_);
+    row_sums_.Resize(N);
+    col_sums_.Resize(M);
+    math::Gemv<T, Context>(
+        CblasNoTrans,
+        N,
+        M,
+        sign,
+        S_data,
+        ones_.template data<T>(),
+        0,
+        row_sums_.template mutable_data<T>(),
+        &context_);
+    math::Gemv<T, Context>(
+        CblasTrans,
+        N,
+        M,
+        sign,
+        S_data,
+        ones_.template data<T>(),
+        0,
+        col_sums_.template mutable_data<T>(),
+        &context_);
+    const bool cosine = kKind == PairwiseDistance::kCosine;
+    RowwiseAxpy<T, Context>(
+        N,
+        D,
+        row_sums_.template data<T>(),
+        cosine ? x_norms_.template data<T>() : nullptr,
+        X_data,
+        dX_data,
+        &context_);
+    RowwiseAxpy<T, Context>(
+        M,
+        D,
+        col_sums_.template data<T>(),
+        cosine ? y_norms_.template data<T>() : nullptr,
+        Y_data,
+        dY_data,
+        &context_);
+    return true;
+  }
+
+ protected:
+  INPUT_TAGS(X_IN, Y_IN, DER_DISTANCE_IN, DISTANCE_IN);
+  OUTPUT_TAGS(DER_X_OUT, DER_Y_OUT);
+  Tensor<Context> x_norms_;
+  Tensor<Context> y_norms_;
+  Tensor<Context> G_;
+  Tensor<Context> S_;
+  Tensor<Context> ones_;
+  Tensor<Context> row_sums_;
+  Tensor<Context> col_sums_;
+};
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_DISTANCE_OP_H_
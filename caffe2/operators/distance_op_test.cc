@@ -0,0 +1,136 @@
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+constexpr int kN = 5;
+constexpr int kM = 7;
+constexpr int kD = 6;
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+// The distance of the given pairwise operator between two rows.
+float Reference(const string& type, const float* x, const float* y) {
+  float xy = 0, xx = 0, yy = 0;
+  for (int k = 0; k < kD; ++k) {
+    xy += x[k] * y[k];
+    xx += x[k] * x[k];
+    yy += y[k] * y[k];
+  }
+  if (type == "PairwiseDotProduct") {
+    return xy;
+  }
+  if (type == "PairwiseSquaredL2Distance") {
+    return (xx + yy) / 2 - xy;
+  }
+  return xy / std::sqrt(xx * yy);
+}
+
+// The sum of dP * P, whose gradient is checked by finite differences.
+float Loss(const string& type, Workspace* ws) {
+  const float* X = ws->GetBlob("X")->Get<TensorCPU>().data<float>();
+  const float* Y = ws->GetBlob("Y")->Get<TensorCPU>().data<float>();
+  const float* dP = ws->GetBlob("dP")->Get<TensorCPU>().data<float>();
+  float loss = 0;
+  for (int i = 0; i < kN; ++i) {
+    for (int j = 0; j < kM; ++j) {
+      loss += dP[i * kM + j] * Reference(type, X + i * kD, Y + j * kD);
+    }
+  }
+  return loss;
+}
+
+class PairwiseDistanceTest : public testing::TestWithParam<string> {};
+
+} // namespace
+
+TEST_P(PairwiseDistanceTest, MatchesTheRowwiseDistances) {
+  const string type = GetParam();
+  std::mt19937 gen(0);
+  Workspace ws;
+  // The rows of X are 2 x 3 matrices, flattened.
+  AddRandomTensor(&ws, "X", {kN, 2, 3}, &gen);
+  AddRandomTensor(&ws, "Y", {kM, kD}, &gen);
+  auto op = CreateOperator(
+      CreateOperatorDef(
+          type, "", vector<string>{"X", "Y"}, vector<string>{"P"}),
+      &ws);
+  ASSERT_TRUE(op->Run());
+  const auto& P = ws.GetBlob("P")->Get<TensorCPU>();
+  ASSERT_EQ(P.dims(), (vector<TIndex>{kN, kM}));
+  const float* X = ws.GetBlob("X")->Get<TensorCPU>().data<float>();
+  const float* Y = ws.GetBlob("Y")->Get<TensorCPU>().data<float>();
+  for (int i = 0; i < kN; ++i) {
+    for (int j = 0; j < kM; ++j) {
+      EXPECT_NEAR(
+          P.data<float>()[i * kM + j],
+          Reference(type, X + i * kD, Y + j * kD),
+          1e-5);
+    }
+  }
+}
+
+TEST_P(PairwiseDistanceTest, Gradient) {
+  const string type = GetParam();
+  std::mt19937 gen(1);
+  Workspace ws;
+  AddRandomTensor(&ws, "X", {kN, kD}, &gen);
+  AddRandomTensor(&ws, "Y", {kM, kD}, &gen);
+  AddRandomTensor(&ws, "dP", {kN, kM}, &gen);
+  const OperatorDef def = CreateOperatorDef(
+      type, "", vector<string>{"X", "Y"}, vector<string>{"P"});
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  vector<GradientWrapper> g_output(1);
+  g_output[0].dense_ = "dP";
+  const auto meta = GetGradientForOp(def, g_output);
+  ASSERT_EQ(meta.ops_.size(), 1);
+  EXPECT_EQ(meta.ops_[0].type(), type + "Gradient");
+  ASSERT_TRUE(ws.RunOperatorOnce(meta.ops_[0]));
+
+  const float kStep = 1e-2;
+  for (const string input : {"X", "Y"}) {
+    const auto& grad =
+        ws.GetBlob(meta.g_input_[input == "X" ? 0 : 1].dense_)
+            ->Get<TensorCPU>();
+    auto* tensor = ws.GetBlob(input)->GetMutable<TensorCPU>();
+    ASSERT_EQ(grad.dims(), tensor->dims());
+    for (int k = 0; k < tensor->size(); ++k) {
+      float* value = tensor->mutable_data<float>() + k;
+      const float original = *value;
+      *value = original + kStep;
+      const float plus = Loss(type, &ws);
+      *value = original - kStep;
+      const float minus = Loss(type, &ws);
+      *value = original;
+      EXPECT_NEAR(grad.data<float>()[k], (plus - minus) / (2 * kStep), 2e-3)
+          << input << "[" << k << "]";
+    }
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(
+    PairwiseDistance,
+    PairwiseDistanceTest,
+    testing::Values(
+        "PairwiseDotProduct",
+        "PairwiseSquaredL2Distance",
+        "PairwiseCosineSimilarity"));
+
+} // namespace caffe2
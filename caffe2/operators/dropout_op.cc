@@ -1,5 +1,7 @@
 #include "caffe2/operators/dropout_op.h"
 
+#include "caffe2/utils/philox_random.h"
+
 namespace caffe2 {
 
 template <>
@@ -19,16 +21,25 @@ bool DropoutOp<float, CPUContext>::RunOnDevice() {
   } else {
     float scale = 1. / (1. - ratio_);
     // mask=true means keep, and mask=false means not keep, so we will
-    // generate probability depending on 1-ratio.
-    std::bernoulli_distribution dist(1. - ratio_);
+    // generate probability depending on 1-ratio. The numbers come from the
+    // Philox stream of the context, four per block, in parallel.
+    const float keep = 1. - ratio_;
     const float* Xdata = X.data<float>();
     float* Ydata = Y->mutable_data<float>();
     bool* mask_data = mask->mutable_data<bool>();
-    auto& gen = context_.RandGenerator();
-    for (int i = 0; i < X.size(); ++i) {
-      mask_data[i] = dist(gen);
-      Ydata[i] = Xdata[i] * scale * mask_data[i];
-    }
+    const TIndex size = X.size();
+    const int64_t num_blocks = (size + 3) / 4;
+    math::philox::ForEachBlock(
+        context_.PhiloxKey(),
+        context_.ReservePhiloxBlocks(num_blocks),
+        num_blocks,
+        [=](int64_t block, const uint32_t* x) {
+          for (int j = 0; j < 4 && block * 4 + j < size; ++j) {
+            const TIndex i = block * 4 + j;
+            mask_data[i] = math::philox::ToUniform(x[j]) < keep;
+            Ydata[i] = Xdata[i] * scale * mask_data[i];
+          }
+        });
     return true;
   }
 }
@@ -2,54 +2,30 @@
 
 namespace caffe2 {
 
-// For some comparison and logical operators, eigen does not have vectorized
-// math so we need to improvise.
-#define NAIVE_FUNCTOR(name, op, input_type, output_type)                       \
-  struct Naive##name##Functor {                                                \
-    template <int b_is_scalar, typename T, typename R>                         \
-    inline void Run(size_t n, const T* a, const T* b, R* out, CPUContext*) {   \
-      for (int i = 0; i < n; ++i) {                                            \
-        out[i] = op(a[i], b[b_is_scalar ? 0 : i]);                             \
-      }                                                                        \
-    }                                                                          \
-    template <typename T, typename R>                                          \
-    void RunWithBroadcast(                                                     \
-        const T* a,                                                            \
-        const T* b,                                                            \
-        R* out,                                                                \
-        size_t pre,                                                            \
-        size_t n,                                                              \
-        CPUContext*) {                                                         \
-      for (int i = 0; i < pre; ++i) {                                          \
-        for (int j = 0; j < n; ++j) {                                          \
-          out[i * n + j] = op(a[i * n + j], b[j]);                             \
-        }                                                                      \
-      }                                                                        \
-    }                                                                          \
-    template <typename T, typename R>                                          \
-    void RunWithBroadcast2(                                                    \
-        const T* a,                                                            \
-        const T* b,                                                            \
-        R* out,                                                                \
-        size_t pre,                                                            \
-        size_t n,                                                              \
-        size_t post,                                                           \
-        CPUContext*) {                                                         \
-      for (int i = 0; i < pre; ++i) {                                          \
-        for (int j = 0; j < n; ++j) {                                          \
-          for (int k = 0; k < post; ++k) {                                     \
-            out[(i * n + j) * post + k] = op(a[(i * n + j) * post + k], b[j]); \
-          }                                                                    \
-        }                                                                      \
-      }                                                                        \
-    }                                                                          \
-  };                                                                           \
-  REGISTER_CPU_OPERATOR(                                                       \
-      name,                                                                    \
-      BinaryElementwiseOp<                                                     \
-          input_type,                                                          \
-          CPUContext,                                                          \
-          Naive##name##Functor,                                                \
+// For comparison and logical operators Eigen does not help much, so the
+// kernels are plain loops that the compiler vectorizes.
+#define NAIVE_FUNCTOR(name, op, input_type, output_type)                   \
+  struct Naive##name##Kernel {                                             \
+    template <typename T, typename R>                                      \
+    static void Run(size_t n, const T* a, const T* b, R* out) {            \
+      for (size_t i = 0; i < n; ++i) {                                     \
+        out[i] = op(a[i], b[i]);                                           \
+      }                                                                    \
+    }                                                                      \
+    template <typename T, typename R>                                      \
+    static void RunScalar(size_t n, const T* a, T b, R* out) {             \
+      for (size_t i = 0; i < n; ++i) {                                     \
+        out[i] = op(a[i], b);                                              \
+      }                                                                    \
+    }                                                                      \
+  };                                                                       \
+  using Naive##name##Functor = CPUBroadcastFunctor<Naive##name##Kernel>;   \
+  REGISTER_CPU_OPERATOR(                                                   \
+      name,                                                                \
+      BinaryElementwiseOp<                                                 \
+          input_type,                                                      \
+          CPUContext,                                                      \
+          Naive##name##Functor,                                            \
           output_type>)
 
 #define EIGEN_SUB(x, y) ((x) - (y))
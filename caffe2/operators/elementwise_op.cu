@@ -4,25 +4,59 @@
 
 namespace caffe2 {
 
+// Elements are loaded through ToComputeType and stored through
+// FromComputeType, so that float16 tensors are computed in float.
+template <typename T>
+inline __device__ T ToComputeType(T x) {
+  return x;
+}
+
+template <typename R, typename T>
+inline __device__ R FromComputeType(T x) {
+  return x;
+}
+
+#ifdef CAFFE_HAS_CUDA_FP16
+inline __device__ float ToComputeType(float16 x) {
+  return __half2float(reinterpret_cast<const half&>(x));
+}
+
+template <>
+inline __device__ float16 FromComputeType<float16, float>(float x) {
+  const half h = __float2half(x);
+  return reinterpret_cast<const float16&>(h);
+}
+
+// The arithmetic ops also take the float16 activations and gradients of
+// mixed precision nets.
+using CudaArithmeticTypes =
+    TensorTypes<int32_t, int64_t, float, double, float16>;
+#else
+using CudaArithmeticTypes = NumericTypes;
+#endif // CAFFE_HAS_CUDA_FP16
+
 #define CUDA_FUNCTOR(name, op, input_type, output_type) \
 template <int b_is_scalar, typename T, typename R> \
 __global__ void name##Kernel(const T* a, const T* b, R* out, int n) { \
   CUDA_1D_KERNEL_LOOP(i, n) { \
-    out[i] = op(a[i], b[b_is_scalar ? 0 : i]); \
+    out[i] = FromComputeType<R>( \
+        op(ToComputeType(a[i]), ToComputeType(b[b_is_scalar ? 0 : i]))); \
   } \
 } \
 template <typename T, typename R> \
 __global__ void name##BroadcastKernel( \
     const T* a, const T* b, R* out, int pre, int n) { \
   CUDA_1D_KERNEL_LOOP(i, pre * n) { \
-    out[i] = op(a[i], b[i % n]); \
+    out[i] = FromComputeType<R>( \
+        op(ToComputeType(a[i]), ToComputeType(b[i % n]))); \
   } \
 } \
 template <typename T, typename R> \
 __global__ void name##Broadcast2Kernel( \
     const T* a, const T* b, R* out, int pre, int n, int post) { \
   CUDA_1D_KERNEL_LOOP(i, pre * n * post) { \
-    out[i] = op(a[i], b[(i / post) % n]); \
+    out[i] = FromComputeType<R>( \
+        op(ToComputeType(a[i]), ToComputeType(b[(i / post) % n]))); \
   } \
 } \
  \
@@ -59,16 +93,16 @@ REGISTER_CUDA_OPERATOR( \
         input_type, CUDAContext, Cuda##name##Functor, output_type>)
 
 #define CUDA_ADD(x, y) ((x) + (y))
-CUDA_FUNCTOR(Add, CUDA_ADD, NumericTypes, SameTypeAsInput);
+CUDA_FUNCTOR(Add, CUDA_ADD, CudaArithmeticTypes, SameTypeAsInput);
 #undef CUDA_ADD
 #define CUDA_SUB(x, y) ((x) - (y))
-CUDA_FUNCTOR(Sub, CUDA_SUB, NumericTypes, SameTypeAsInput);
+CUDA_FUNCTOR(Sub, CUDA_SUB, CudaArithmeticTypes, SameTypeAsInput);
 #undef CUDA_SUB
 #define CUDA_MUL(x, y) ((x) * (y))
-CUDA_FUNCTOR(Mul, CUDA_MUL, NumericTypes, SameTypeAsInput);
+CUDA_FUNCTOR(Mul, CUDA_MUL, CudaArithmeticTypes, SameTypeAsInput);
 #undef CUDA_MUL
 #define CUDA_DIV(x, y) ((x) / (y))
-CUDA_FUNCTOR(Div, CUDA_DIV, NumericTypes, SameTypeAsInput);
+CUDA_FUNCTOR(Div, CUDA_DIV, CudaArithmeticTypes, SameTypeAsInput);
 #undef CUDA_DIV
 #define CUDA_LT(x, y) ((x) < (y))
 CUDA_FUNCTOR(LT, CUDA_LT, NumericTypes, FixedType<bool>);
@@ -289,55 +289,66 @@ bool DivGradientOp<Context>::RunOnDevice() {
   return true;
 }
 
-// For arithmetic operators, Eigen provides a good way to vectorize even
-// when broadcasting.
-#define EIGEN_FUNCTOR(name, eigen_op, input_type, output_type)               \
-  struct Eigen##name##Functor {                                              \
-    template <int b_is_scalar, typename T, typename R>                       \
-    inline void Run(size_t n, const T* a, const T* b, R* out, CPUContext*) { \
-      if (b_is_scalar) {                                                     \
-        EigenVectorArrayMap<R>(out, n) =                                     \
-            eigen_op((ConstEigenVectorArrayMap<T>(a, n)), (b[0]));           \
-      } else {                                                               \
-        EigenVectorArrayMap<R>(out, n) = eigen_op(                           \
-            (ConstEigenVectorArrayMap<T>(a, n)),                             \
-            (ConstEigenVectorArrayMap<T>(b, n)));                            \
-      }                                                                      \
-    }                                                                        \
-    template <typename T, typename R>                                        \
-    void RunWithBroadcast(                                                   \
-        const T* a,                                                          \
-        const T* b,                                                          \
-        R* out,                                                              \
-        size_t pre,                                                          \
-        size_t n,                                                            \
-        CPUContext*) {                                                       \
-      EigenArrayMap<R>(out, n, pre) = eigen_op(                              \
-          (ConstEigenArrayMap<T>(a, n, pre).colwise()),                      \
-          (ConstEigenVectorArrayMap<T>(b, n)));                              \
-    }                                                                        \
-    template <typename T, typename R>                                        \
-    void RunWithBroadcast2(                                                  \
-        const T* a,                                                          \
-        const T* b,                                                          \
-        R* out,                                                              \
-        size_t pre,                                                          \
-        size_t n,                                                            \
-        size_t post,                                                         \
-        CPUContext*) {                                                       \
-      for (int i = 0; i < pre; ++i) {                                        \
-        EigenArrayMap<R>(out + i * n * post, post, n) = eigen_op(            \
-            (ConstEigenArrayMap<T>(a + i * n * post, post, n).rowwise()),    \
-            (Eigen::Map<const Eigen::Array<T, 1, Eigen::Dynamic>>(b, n)));   \
-      }                                                                      \
-    }                                                                        \
-  };                                                                         \
-  REGISTER_CPU_OPERATOR(                                                     \
-      name,                                                                  \
-      BinaryElementwiseOp<                                                   \
-          input_type,                                                        \
-          CPUContext,                                                        \
-          Eigen##name##Functor,                                              \
+/**
+ * CPUBroadcastFunctor adapts a kernel for math::detail::BroadcastBinary to the
+ * functor interface of BinaryElementwiseOp. All three cases (same shape,
+ * scalar and axis broadcast) run through the same threaded engine.
+ */
+template <class Kernel>
+struct CPUBroadcastFunctor {
+  template <bool b_is_scalar, typename T, typename R>
+  inline void Run(size_t n, const T* a, const T* b, R* out, CPUContext*) {
+    if (b_is_scalar) {
+      math::detail::BroadcastBinary<Kernel>(1, 1, n, a, b, out);
+    } else {
+      math::detail::BroadcastBinary<Kernel>(1, n, 1, a, b, out);
+    }
+  }
+  template <typename T, typename R>
+  void RunWithBroadcast(
+      const T* a,
+      const T* b,
+      R* out,
+      size_t pre,
+      size_t n,
+      CPUContext*) {
+    math::detail::BroadcastBinary<Kernel>(pre, n, 1, a, b, out);
+  }
+  template <typename T, typename R>
+  void RunWithBroadcast2(
+      const T* a,
+      const T* b,
+      R* out,
+      size_t pre,
+      size_t n,
+      size_t post,
+      CPUContext*) {
+    math::detail::BroadcastBinary<Kernel>(pre, n, post, a, b, out);
+  }
+};
+
+// For arithmetic operators, Eigen provides the vectorized inner loops.
+#define EIGEN_FUNCTOR(name, eigen_op, input_type, output_type)             \
+  struct Eigen##name##Kernel {                                             \
+    template <typename T, typename R>                                      \
+    static void Run(size_t n, const T* a, const T* b, R* out) {            \
+      EigenVectorArrayMap<R>(out, n) = eigen_op(                           \
+          (ConstEigenVectorArrayMap<T>(a, n)),                             \
+          (ConstEigenVectorArrayMap<T>(b, n)));                            \
+    }                                                                      \
+    template <typename T, typename R>                                      \
+    static void RunScalar(size_t n, const T* a, T b, R* out) {             \
+      EigenVectorArrayMap<R>(out, n) =                                     \
+          eigen_op((ConstEigenVectorArrayMap<T>(a, n)), (b));              \
+    }                                                                      \
+  };                                                                       \
+  using Eigen##name##Functor = CPUBroadcastFunctor<Eigen##name##Kernel>;   \
+  REGISTER_CPU_OPERATOR(                                                   \
+      name,                                                                \
+      BinaryElementwiseOp<                                                 \
+          input_type,                                                      \
+          CPUContext,                                                      \
+          Eigen##name##Functor,                                            \
           output_type>)
 
 } // namespace caffe2
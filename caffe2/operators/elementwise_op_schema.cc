@@ -52,21 +52,29 @@ OPERATOR_SCHEMA(Add)
     .NumInputs(2)
     .NumOutputs(1)
     .AllowInplace({{0, 0}, {1, 0}})
+    .IdenticalTypeAndShapeOfInput(0)
+    .CostInferenceFunction(PointwiseCostInference<1>)
     .FillUsing(MathDocGenerator("addition"));
 OPERATOR_SCHEMA(Sub)
     .NumInputs(2)
     .NumOutputs(1)
     .AllowInplace({{0, 0}, {1, 0}})
+    .IdenticalTypeAndShapeOfInput(0)
+    .CostInferenceFunction(PointwiseCostInference<1>)
     .FillUsing(MathDocGenerator("subtraction"));
 OPERATOR_SCHEMA(Mul)
     .NumInputs(2)
     .NumOutputs(1)
     .AllowInplace({{0, 0}, {1, 0}})
+    .IdenticalTypeAndShapeOfInput(0)
+    .CostInferenceFunction(PointwiseCostInference<1>)
     .FillUsing(MathDocGenerator("multiplication"));
 OPERATOR_SCHEMA(Div)
     .NumInputs(2)
     .NumOutputs(1)
     .AllowInplace({{0, 0}})
+    .IdenticalTypeAndShapeOfInput(0)
+    .CostInferenceFunction(PointwiseCostInference<1>)
     .FillUsing(MathDocGenerator("division"));
 OPERATOR_SCHEMA(DivGradient).NumInputs(3).NumOutputs(2).AllowInplace({{0, 0}});
 
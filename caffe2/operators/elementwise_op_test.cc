@@ -17,6 +17,14 @@ void CopyVector<caffe2::CPUContext, int32_t>(
   memcpy(y, x, N * sizeof(int32_t));
 }
 
+template <>
+void CopyVector<caffe2::CPUContext, float>(
+    const int N,
+    const float* x,
+    float* y) {
+  memcpy(y, x, N * sizeof(float));
+}
+
 TEST(ElementwiseCPUTest, And) {
   elementwiseAnd<caffe2::CPUContext>();
 }
@@ -36,3 +44,87 @@ TEST(ElementwiseTest, Not) {
 TEST(ElementwiseTest, EQ) {
   elementwiseEQ<caffe2::CPUContext>();
 }
+
+namespace {
+
+void AddArg(caffe2::OperatorDef* def, const std::string& name, int value) {
+  auto* arg = def->add_arg();
+  arg->set_name(name);
+  arg->set_i(value);
+}
+
+} // namespace
+
+TEST(ElementwiseCPUTest, AddBroadcastAxis) {
+  const int pre = 2, n = 3, post = 4;
+  caffe2::Workspace ws;
+  auto def = DefineOperator<caffe2::CPUContext>("Add");
+  AddArg(&def, "broadcast", 1);
+  AddArg(&def, "axis", 1);
+  std::vector<float> x(pre * n * post);
+  for (size_t i = 0; i < x.size(); ++i) {
+    x[i] = i;
+  }
+  FillTensor<caffe2::CPUContext, float, float>(&ws, "X", {pre, n, post}, x);
+  FillTensor<caffe2::CPUContext, float, float>(
+      &ws, "Y", {n}, {100.f, 200.f, 300.f});
+  std::unique_ptr<caffe2::OperatorBase> op(caffe2::CreateOperator(def, &ws));
+  ASSERT_NE(nullptr, op.get());
+  EXPECT_TRUE(op->Run());
+  const auto& Z = ws.GetBlob("Z")->Get<caffe2::TensorCPU>();
+  ASSERT_EQ(Z.size(), x.size());
+  for (int i = 0; i < pre; ++i) {
+    for (int j = 0; j < n; ++j) {
+      for (int k = 0; k < post; ++k) {
+        const int idx = (i * n + j) * post + k;
+        EXPECT_EQ(Z.data<float>()[idx], x[idx] + 100.f * (j + 1));
+      }
+    }
+  }
+}
+
+// Large enough to be split into several chunks and threads by the engine.
+TEST(ElementwiseCPUTest, LTBroadcastLarge) {
+  const int pre = 3, n = 5, post = 20000;
+  caffe2::Workspace ws;
+  auto def = DefineOperator<caffe2::CPUContext>("LT");
+  AddArg(&def, "broadcast", 1);
+  AddArg(&def, "axis", 1);
+  std::vector<float> x(pre * n * post);
+  for (size_t i = 0; i < x.size(); ++i) {
+    x[i] = i % 7;
+  }
+  std::vector<float> y{0.f, 1.f, 3.f, 5.f, 7.f};
+  FillTensor<caffe2::CPUContext, float, float>(&ws, "X", {pre, n, post}, x);
+  FillTensor<caffe2::CPUContext, float, float>(&ws, "Y", {n}, y);
+  std::unique_ptr<caffe2::OperatorBase> op(caffe2::CreateOperator(def, &ws));
+  ASSERT_NE(nullptr, op.get());
+  EXPECT_TRUE(op->Run());
+  const auto& Z = ws.GetBlob("Z")->Get<caffe2::TensorCPU>();
+  ASSERT_EQ(Z.size(), x.size());
+  for (size_t idx = 0; idx < x.size(); ++idx) {
+    const int j = (idx / post) % n;
+    ASSERT_EQ(Z.data<bool>()[idx], x[idx] < y[j]) << idx;
+  }
+}
+
+TEST(ElementwiseCPUTest, SubScalarInPlace) {
+  const int N = 40000;
+  caffe2::Workspace ws;
+  auto def = DefineOperator<caffe2::CPUContext>("Sub");
+  def.set_output(0, "X");
+  AddArg(&def, "broadcast", 1);
+  std::vector<float> x(N);
+  for (int i = 0; i < N; ++i) {
+    x[i] = i;
+  }
+  FillTensor<caffe2::CPUContext, float, float>(&ws, "X", {N}, x);
+  FillTensor<caffe2::CPUContext, float, float>(&ws, "Y", {1}, {2.f});
+  std::unique_ptr<caffe2::OperatorBase> op(caffe2::CreateOperator(def, &ws));
+  ASSERT_NE(nullptr, op.get());
+  EXPECT_TRUE(op->Run());
+  const auto& X = ws.GetBlob("X")->Get<caffe2::TensorCPU>();
+  for (int i = 0; i < N; ++i) {
+    ASSERT_EQ(X.data<float>()[i], i - 2.f);
+  }
+}
@@ -0,0 +1,242 @@
+#ifndef CAFFE2_OPERATORS_EMBEDDING_LOOKUP_H_
+#define CAFFE2_OPERATORS_EMBEDDING_LOOKUP_H_
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/common.h"
+#include "caffe2/core/types.h"
+
+namespace caffe2 {
+
+namespace embedding_lookup_detail {
+
+// How many indices ahead of the row being added to prefetch the rows of.
+// Embedding tables are much larger than the caches, so the rows of bags are
+// mostly read from memory.
+constexpr TIndex kPrefetchDistance = 16;
+// Below that many values to add, threads cost more than they save.
+constexpr TIndex kMinParallelWork = 1 << 16;
+
+template <typename T>
+inline void prefetchRow(const T* row, TIndex block_size) {
+#if defined(__GNUC__)
+  const char* bytes = reinterpret_cast<const char*>(row);
+  for (TIndex offset = 0; offset < block_size * sizeof(T); offset += 64) {
+    __builtin_prefetch(bytes + offset, 0 /* read */, 0 /* no reuse */);
+  }
+#endif
+}
+
+template <typename T>
+inline void addRow(TIndex block_size, T weight, const T* in, T* out) {
+  for (TIndex j = 0; j < block_size; ++j) {
+    out[j] += weight * in[j];
+  }
+}
+
+#ifdef __AVX2__
+template <>
+inline void
+addRow<float>(TIndex block_size, float weight, const float* in, float* out) {
+  const __m256 w = _mm256_set1_ps(weight);
+  TIndex j = 0;
+  for (; j + 8 <= block_size; j += 8) {
+    const __m256 x = _mm256_loadu_ps(in + j);
+    const __m256 y = _mm256_loadu_ps(out + j);
+#ifdef __FMA__
+    _mm256_storeu_ps(out + j, _mm256_fmadd_ps(w, x, y));
+#else
+    _mm256_storeu_ps(out + j, _mm256_add_ps(_mm256_mul_ps(w, x), y));
+#endif
+  }
+  for (; j < block_size; ++j) {
+    out[j] += weight * in[j];
+  }
+}
+#endif
+
+// Rows of halves are converted to floats on the fly.
+template <typename T>
+inline void
+addRow(TIndex block_size, T weight, const float16* in, T* out) {
+  for (TIndex j = 0; j < block_size; ++j) {
+    out[j] += weight * detail::HalfBitsToFloat(in[j].x);
+  }
+}
+
+#ifdef __F16C__
+template <>
+inline void
+addRow<float>(TIndex block_size, float weight, const float16* in, float* out) {
+  const __m256 w = _mm256_set1_ps(weight);
+  TIndex j = 0;
+  for (; j + 8 <= block_size; j += 8) {
+    const __m256 x = _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + j)));
+    const __m256 y = _mm256_loadu_ps(out + j);
+    _mm256_storeu_ps(out + j, _mm256_add_ps(_mm256_mul_ps(w, x), y));
+  }
+  for (; j < block_size; ++j) {
+    out[j] += weight * detail::HalfBitsToFloat(in[j].x);
+  }
+}
+#endif
+
+// A row of the fused 8-bit row-wise format: block_size quantized values
+// followed by the float scale and bias of the row, so that each value is
+// scale * q + bias.
+template <typename T>
+inline void
+addFused8BitRow(TIndex block_size, T weight, const uint8_t* in, T* out) {
+  float scale_bias[2];
+  memcpy(scale_bias, in + block_size, sizeof(scale_bias));
+  const T scale = weight * scale_bias[0];
+  const T bias = weight * scale_bias[1];
+  for (TIndex j = 0; j < block_size; ++j) {
+    out[j] += scale * in[j] + bias;
+  }
+}
+
+// What a bag of the given length is multiplied by: 1 / length^lengths_power.
+template <typename T>
+inline T lengthsScale(TIndex length, float lengths_power) {
+  if (lengths_power == 1) {
+    return T(1) / length;
+  }
+  if (lengths_power == 0.5) {
+    return T(1) / std::sqrt(T(length));
+  }
+  return T(1) / std::pow(T(length), lengths_power);
+}
+
+// The bag loop shared by the lookups: the rows of data are row_size elements
+// apart, and add_row adds a weighted row to a bag.
+template <typename InType, typename T, typename TLengths, typename AddRow>
+void LookupBags(
+    const TIndex block_size,
+    const TIndex row_size,
+    const TIndex output_size,
+    const TIndex index_size,
+    const InType* data,
+    const TIndex* indices,
+    const TLengths* lengths,
+    const T* weights,
+    float lengths_power,
+    T* out,
+    AddRow add_row) {
+  std::vector<TIndex> starts(output_size + 1);
+  starts[0] = 0;
+  for (TIndex s = 0; s < output_size; ++s) {
+    starts[s + 1] = starts[s] + lengths[s];
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if ( \
+    index_size * block_size >= kMinParallelWork)
+#endif
+  for (TIndex s = 0; s < output_size; ++s) {
+    T* bag = out + block_size * s;
+    memset(bag, 0, sizeof(T) * block_size);
+    const TIndex end = starts[s + 1];
+    for (TIndex i = starts[s]; i < end; ++i) {
+      if (i + kPrefetchDistance < index_size) {
+        prefetchRow(data + row_size * indices[i + kPrefetchDistance], row_size);
+      }
+      add_row(
+          block_size,
+          weights ? weights[i] : T(1),
+          data + row_size * indices[i],
+          bag);
+    }
+    if (lengths_power != 0 && end > starts[s]) {
+      const T scale = lengthsScale<T>(end - starts[s], lengths_power);
+      for (TIndex j = 0; j < block_size; ++j) {
+        bag[j] *= scale;
+      }
+    }
+  }
+}
+
+} // namespace embedding_lookup_detail
+
+/**
+ * Reduces rows of an embedding table, picked by indices, in consecutive bags
+ * of the given lengths: row i of bag s is scaled by weights[i] if weights are
+ * given, and the sum of the bag goes to row s of out, divided by the length
+ * of the bag to the power lengths_power: 0 for a sum, 1 for a mean and 0.5 to
+ * divide by the square root of the length. Empty bags give rows of zeros.
+ *
+ * This is what the fused sparse segment ops with sum, weighted sum, mean and
+ * sqrt mean reducers compute, with the rows of upcoming indices prefetched,
+ * and the bags split across OpenMP threads when the build has it. The table
+ * can be stored as halves, which are converted while they are added. The
+ * indices must be within the table and the lengths must add up to
+ * index_size: both are checked by the callers.
+ */
+template <typename InType, typename T, typename TLengths>
+void EmbeddingLookup(
+    const TIndex block_size,
+    const TIndex output_size,
+    const TIndex index_size,
+    const InType* data,
+    const TIndex* indices,
+    const TLengths* lengths,
+    const T* weights, // optional
+    float lengths_power,
+    T* out) {
+  embedding_lookup_detail::LookupBags(
+      block_size,
+      block_size,
+      output_size,
+      index_size,
+      data,
+      indices,
+      lengths,
+      weights,
+      lengths_power,
+      out,
+      [](TIndex size, T weight, const InType* in, T* bag) {
+        embedding_lookup_detail::addRow(size, weight, in, bag);
+      });
+}
+
+/**
+ * Same as EmbeddingLookup, for a table in the fused 8-bit row-wise format:
+ * each row holds block_size bytes of quantized values followed by the float
+ * scale and bias of the row. The rows are dequantized while they are added.
+ */
+template <typename T, typename TLengths>
+void Fused8BitRowwiseEmbeddingLookup(
+    const TIndex block_size,
+    const TIndex output_size,
+    const TIndex index_size,
+    const uint8_t* data,
+    const TIndex* indices,
+    const TLengths* lengths,
+    const T* weights, // optional
+    float lengths_power,
+    T* out) {
+  embedding_lookup_detail::LookupBags(
+      block_size,
+      block_size + 2 * static_cast<TIndex>(sizeof(float)),
+      output_size,
+      index_size,
+      data,
+      indices,
+      lengths,
+      weights,
+      lengths_power,
+      out,
+      embedding_lookup_detail::addFused8BitRow<T>);
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_EMBEDDING_LOOKUP_H_
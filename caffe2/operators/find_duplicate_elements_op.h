@@ -1,12 +1,15 @@
 #ifndef CAFFE2_OPERATORS_FIND_DUPLICATE_ELEMENTS_OP_H
 #define CAFFE2_OPERATORS_FIND_DUPLICATE_ELEMENTS_OP_H
 
+#include <limits>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/core/tensor.h"
+#include "caffe2/utils/radix_sort.h"
 
 namespace caffe2 {
 
@@ -28,16 +31,9 @@ class FindDuplicateElementsOp final : public Operator<Context> {
     CAFFE_ENFORCE(data.ndim() == 1, "data should be 1-D.");
 
     const auto* data_ptr = data.template data<T>();
-    std::unordered_map<T, int64_t> dict;
     std::vector<int64_t> dupIndices;
-    // i is the index of unique elements, j is the index of all elements
-    for (int64_t i = 0, j = 0; j < data.dims()[0]; ++i, ++j) {
-      bool retVal = dict.insert({data_ptr[j], i}).second;
-      if (!retVal) {
-        --i;
-        dupIndices.push_back(j);
-      }
-    }
+    FindDuplicates(
+        data_ptr, data.dims()[0], &dupIndices, std::is_integral<T>());
 
     const auto dupSize = dupIndices.size();
     auto* output = Output(0);
@@ -49,6 +45,63 @@ class FindDuplicateElementsOp final : public Operator<Context> {
 
     return true;
   }
+
+ private:
+  template <typename T>
+  void FindDuplicates(
+      const T* data_ptr,
+      int64_t n,
+      std::vector<int64_t>* dupIndices,
+      std::false_type /* is_integral */) {
+    std::unordered_map<T, int64_t> dict;
+    // i is the index of unique elements, j is the index of all elements
+    for (int64_t i = 0, j = 0; j < n; ++i, ++j) {
+      bool retVal = dict.insert({data_ptr[j], i}).second;
+      if (!retVal) {
+        --i;
+        dupIndices->push_back(j);
+      }
+    }
+  }
+
+  // Integer ids are radix sorted together with their positions instead. The
+  // sort is stable, so every run of equal keys starts with the first
+  // occurrence and the rest of the run are the duplicates.
+  template <typename T>
+  void FindDuplicates(
+      const T* data_ptr,
+      int64_t n,
+      std::vector<int64_t>* dupIndices,
+      std::true_type /* is_integral */) {
+    CAFFE_ENFORCE_LE(n, std::numeric_limits<int>::max());
+    keys_.resize(n);
+    keysTmp_.resize(n);
+    order_.resize(n);
+    orderTmp_.resize(n);
+    for (int64_t i = 0; i < n; ++i) {
+      keys_[i] = RadixKey<int64_t>(data_ptr[i]);
+      order_[i] = i;
+    }
+    RadixSortPairs<uint64_t, int>(
+        n, keys_.data(), order_.data(), keysTmp_.data(), orderTmp_.data());
+    isDuplicate_.assign(n, 0);
+    for (int64_t i = 1; i < n; ++i) {
+      if (keys_[i] == keys_[i - 1]) {
+        isDuplicate_[order_[i]] = 1;
+      }
+    }
+    for (int64_t j = 0; j < n; ++j) {
+      if (isDuplicate_[j]) {
+        dupIndices->push_back(j);
+      }
+    }
+  }
+
+  std::vector<uint64_t> keys_;
+  std::vector<uint64_t> keysTmp_;
+  std::vector<int> order_;
+  std::vector<int> orderTmp_;
+  std::vector<char> isDuplicate_;
 };
 
 } // namespace caffe2
@@ -15,6 +15,10 @@ class FreeOp : public Operator<Context> {
   FreeOp(const OperatorDef& def, Workspace* ws) : Operator<Context>(def, ws) {}
 
   bool RunOnDevice() override {
+    // The allocators only know about the stream that allocated the memory,
+    // not about the other streams that this one waited for, such as the copy
+    // stream of an async_dag net, which may still be reading it.
+    this->context_.FinishDeviceComputation();
     for (Blob* output : OperatorBase::Outputs()) {
       output->Reset();
     }
@@ -1,6 +1,62 @@
 #include "caffe2/operators/fully_connected_op.h"
 
+#include "caffe2/core/parallel_for.h"
+
 namespace caffe2 {
+
+template <>
+void FullyConnectedGemm<float, CPUContext, DefaultEngine>(
+    int M,
+    int N,
+    int K,
+    const float* X,
+    const float* W,
+    float* Y,
+    Workspace* ws,
+    CPUContext* context) {
+#if CAFFE2_MOBILE
+  // Each thread computes a block of columns of Y from a block of rows of W.
+  // Small gemms are not worth the dispatch.
+  constexpr int kMinColsPerBlock = 8;
+  constexpr int kMinFlopsPerBlock = 1 << 16;
+  const int num_blocks = std::min(
+      ParallelForNumThreads(ws),
+      std::min(
+          N / kMinColsPerBlock,
+          static_cast<int>(
+              static_cast<int64_t>(M) * N * K / kMinFlopsPerBlock)));
+  if (num_blocks > 1) {
+    const int cols_per_block = (N + num_blocks - 1) / num_blocks;
+    ParallelFor(ws, num_blocks, [&](int /* unused */, size_t block) {
+      const int begin = block * cols_per_block;
+      const int cols = std::min(cols_per_block, N - begin);
+      if (cols > 0) {
+        math::GemmEx<float, CPUContext>(
+            CblasNoTrans,
+            CblasTrans,
+            M,
+            cols,
+            K,
+            1,
+            X,
+            K,
+            W + begin * K,
+            K,
+            0,
+            Y + begin,
+            N,
+            context);
+      }
+    });
+    return;
+  }
+#else
+  (void)ws;
+#endif
+  math::Gemm<float, CPUContext>(
+      CblasNoTrans, CblasTrans, M, N, K, 1, X, W, 0, Y, context);
+}
+
 namespace {
 
 REGISTER_CPU_OPERATOR(FC, FullyConnectedOp<float, CPUContext>);
@@ -22,6 +78,23 @@ OPERATOR_SCHEMA(FC)
           out[0] = CreateTensorShape(vector<int> {M, N}, TensorProto::FLOAT);
           return out;
         })
+  .CostInferenceFunction(
+        [](const OperatorDef& def, const vector<TensorShape>& in) {
+          struct OpSchema::Cost c;
+          ArgumentHelper helper(def);
+
+          auto axis = helper.GetSingleArgument<int32_t>("axis", 1);
+          const auto canonical_axis =
+            canonical_axis_index_(axis, in[0].dims().size());
+          const uint64_t M = size_to_dim_(canonical_axis, GetDimsVector(in[0]));
+          const uint64_t K = size_from_dim_(canonical_axis, GetDimsVector(in[0]));
+          const uint64_t N = in[1].dims(0);
+          c.flops = 2 * M * N * K + M * N;
+          c.bytes_read = (M * K + N * K + N) * sizeof(float);
+          c.bytes_written = M * N * sizeof(float);
+          c.bytes_moved = c.bytes_read + c.bytes_written;
+          return c;
+        })
   .SetDoc(R"DOC(
 Computes the result of passing an input vector X into a fully connected
 layer with 2D weight matrix W and 1D bias vector b.
@@ -47,18 +120,26 @@ throw errors.
     .Input(2, "b", "1D blob containing bias vector")
     .Output(0, "Y", "2D output tensor");
 
-OPERATOR_SCHEMA(FCGradient).NumInputs(3).NumOutputs(2, 3);
+OPERATOR_SCHEMA(FCGradient)
+    .NumInputs(3)
+    .NumOutputs(2, 3)
+    .AllowAccumulation({2})
+    .Arg(
+        "accumulate_outputs",
+        "If it lists 2, the input gradient is added to the existing one, "
+        "which must have the shape of the input.");
 
 class GetFCGradient : public GradientMakerBase {
   using GradientMakerBase::GradientMakerBase;
   vector<OperatorDef> GetGradientDefs() override {
     CAFFE_ENFORCE_EQ(def_.input_size(), 3);
     return SingleGradientDef(
-        "FCGradient", "",
+        def_.type() + "Gradient", "",
         vector<string>{I(0), I(1), GO(0)},
         vector<string>{GI(1), GI(2), GI(0)});
   }
 };
 REGISTER_GRADIENT(FC, GetFCGradient);
+REGISTER_GRADIENT(FCFp16, GetFCGradient);
 }  // namespace
 }  // namespace caffe2
@@ -7,6 +7,34 @@
 
 namespace caffe2 {
 
+// Y = X * W^T, the weight term of FC, with X of M x K and W of N x K. On
+// mobile, the CPU version with the default engine splits the rows of W, and
+// so the columns of Y, across the thread pool of ws.
+template <typename T, class Context, class Engine>
+void FullyConnectedGemm(
+    int M,
+    int N,
+    int K,
+    const T* X,
+    const T* W,
+    T* Y,
+    Workspace* /* unused */,
+    Context* context) {
+  math::Gemm<T, Context, Engine>(
+      CblasNoTrans, CblasTrans, M, N, K, 1, X, W, 0, Y, context);
+}
+
+template <>
+void FullyConnectedGemm<float, CPUContext, DefaultEngine>(
+    int M,
+    int N,
+    int K,
+    const float* X,
+    const float* W,
+    float* Y,
+    Workspace* ws,
+    CPUContext* context);
+
 // This is Caffe's InnerProductOp, with a name that fits its purpose better.
 template <typename T, class Context, class Engine = DefaultEngine>
 class FullyConnectedOp final : public Operator<Context> {
@@ -14,7 +42,8 @@ class FullyConnectedOp final : public Operator<Context> {
   USE_OPERATOR_CONTEXT_FUNCTIONS;
   FullyConnectedOp(const OperatorDef& operator_def, Workspace* ws)
       : Operator<Context>(operator_def, ws),
-        axis_(OperatorBase::GetSingleArgument<int32_t>("axis", 1)) {}
+        axis_(OperatorBase::GetSingleArgument<int32_t>("axis", 1)),
+        ws_(ws) {}
   ~FullyConnectedOp() {}
 
   bool RunOnDevice() override {
@@ -64,17 +93,14 @@ class FullyConnectedOp final : public Operator<Context> {
     CAFFE_ENFORCE(M * N == Y->size(), dimErrorString());
 
     // X * W^T
-    math::Gemm<T, Context, Engine>(
-        CblasNoTrans,
-        CblasTrans,
+    FullyConnectedGemm<T, Context, Engine>(
         M,
         N,
         K,
-        1,
         X.template data<T>(),
         W.template data<T>(),
-        0,
         Y->template mutable_data<T>(),
+        ws_,
         &context_);
     // Add bias term
     if (bias_multiplier_.size() != M) {
@@ -107,6 +133,7 @@ class FullyConnectedOp final : public Operator<Context> {
   // a vector object every time we run Run().
   vector<TIndex> Y_shape_cache_;
   Tensor<Context> bias_multiplier_;
+  Workspace* ws_;
 };
 
 template <typename T, class Context, class Engine = DefaultEngine>
@@ -115,7 +142,12 @@ class FullyConnectedGradientOp : public Operator<Context> {
   USE_OPERATOR_CONTEXT_FUNCTIONS;
   FullyConnectedGradientOp(const OperatorDef& operator_def, Workspace* ws)
       : Operator<Context>(operator_def, ws),
-        axis_(OperatorBase::GetSingleArgument<int32_t>("axis", 1)) {}
+        axis_(OperatorBase::GetSingleArgument<int32_t>("axis", 1)) {
+    for (const int output : OperatorBase::GetRepeatedArgument<int>(
+             kAccumulateOutputsArgument)) {
+      accumulate_dX_ |= output == 2;
+    }
+  }
   ~FullyConnectedGradientOp() {}
 
   bool RunOnDevice() override {
@@ -171,10 +203,16 @@ class FullyConnectedGradientOp : public Operator<Context> {
         db->template mutable_data<T>(),
         &context_);
 
-    // Compute dX
+    // Compute dX, or add it to the existing dX.
     if (OutputSize() == 3) {
       auto* dX = Output(2);
-      dX->ResizeLike(X);
+      if (accumulate_dX_) {
+        CAFFE_ENFORCE(
+            dX->dims() == X.dims(),
+            "The accumulated input gradient must have the shape of the input.");
+      } else {
+        dX->ResizeLike(X);
+      }
       math::Gemm<T, Context, Engine>(
           CblasNoTrans,
           CblasNoTrans,
@@ -184,7 +222,7 @@ class FullyConnectedGradientOp : public Operator<Context> {
           1,
           dY.template data<T>(),
           W.template data<T>(),
-          0,
+          accumulate_dX_ ? 1 : 0,
           dX->template mutable_data<T>(),
           &context_);
     }
@@ -193,6 +231,7 @@ class FullyConnectedGradientOp : public Operator<Context> {
 
  protected:
   size_t axis_{1};
+  bool accumulate_dX_{false};
   Tensor<Context> bias_multiplier_;
 };
 
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cmath>
+
+#include "caffe2/core/common_omp.h"
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/types.h"
+#include "caffe2/operators/fully_connected_op.h"
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+
+// An N x K FC weight in block CSR format, with blocks of kBlockRows x 1:
+// block row r holds the rows r * kBlockRows, ... of W, and each of its blocks
+// the kBlockRows weights of one column, contiguously. Blocks that are all
+// zero are not stored, and the last block row is padded with zeros. When the
+// blocks are too dense for the sparse kernel to beat the dense GEMM, the
+// weight is kept dense instead.
+struct BlockSparseFCWeight {
+  static constexpr int kBlockRows = 4;
+
+  int N = 0;
+  int K = 0;
+  bool is_dense = false;
+  // Only when is_dense.
+  vector<float> dense;
+  // Block row r has the blocks row_ptr[r], ..., row_ptr[r + 1] - 1.
+  vector<int> row_ptr;
+  vector<int> col_index;
+  vector<float> values;
+  // The tensor that the FC op packed the weight from, if it did.
+  const float* source = nullptr;
+
+  float Density() const {
+    const int num_block_rows = (N + kBlockRows - 1) / kBlockRows;
+    return num_block_rows * K == 0
+        ? 0
+        : static_cast<float>(col_index.size()) / (num_block_rows * K);
+  }
+
+  // Weights with a magnitude of at most prune_threshold are dropped. The
+  // weight is kept dense if more than max_density of the blocks remain.
+  void Pack(const TensorCPU& W, float prune_threshold, float max_density) {
+    CAFFE_ENFORCE_EQ(W.ndim(), 2, "The weight must be a matrix.");
+    N = W.dim32(0);
+    K = W.dim32(1);
+    const float* w = W.data<float>();
+    auto kept = [&](int n, int k) {
+      return n < N && std::abs(w[n * K + k]) > prune_threshold;
+    };
+    const int num_block_rows = (N + kBlockRows - 1) / kBlockRows;
+    row_ptr.assign(1, 0);
+    col_index.clear();
+    values.clear();
+    for (int r = 0; r < num_block_rows; ++r) {
+      for (int k = 0; k < K; ++k) {
+        bool nonzero = false;
+        for (int i = 0; i < kBlockRows; ++i) {
+          nonzero |= kept(r * kBlockRows + i, k);
+        }
+        if (!nonzero) {
+          continue;
+        }
+        col_index.push_back(k);
+        for (int i = 0; i < kBlockRows; ++i) {
+          const int n = r * kBlockRows + i;
+          values.push_back(kept(n, k) ? w[n * K + k] : 0);
+        }
+      }
+      row_ptr.push_back(col_index.size());
+    }
+    is_dense = Density() > max_density;
+    dense.clear();
+    if (is_dense) {
+      dense.resize(N * K);
+      for (int n = 0; n < N; ++n) {
+        for (int k = 0; k < K; ++k) {
+          dense[n * K + k] = kept(n, k) ? w[n * K + k] : 0;
+        }
+      }
+      row_ptr.clear();
+      col_index.clear();
+      values.clear();
+    }
+    source = nullptr;
+  }
+};
+
+CAFFE_KNOWN_TYPE(BlockSparseFCWeight);
+
+namespace {
+
+constexpr int kBlockRows = BlockSparseFCWeight::kBlockRows;
+// Rows of X that the micro-kernel computes at once, so that each block is
+// loaded once for all of them.
+constexpr int kRowBlock = 4;
+constexpr float kDefaultMaxDensity = 0.3;
+
+// Y[m][0:kBlockRows] = X[m] * block row r of W, for kRows rows of X. A block
+// is a fixed-size Eigen array, so the kBlockRows products of a column are
+// one vector multiply-add per row of X.
+template <int kRows>
+void MicroKernel(
+    const BlockSparseFCWeight& W,
+    int r,
+    const float* X,
+    int ldx,
+    float* Y,
+    int ldy) {
+  using Block = Eigen::Array<float, kBlockRows, 1>;
+  Block acc[kRows];
+  for (int m = 0; m < kRows; ++m) {
+    acc[m].setZero();
+  }
+  for (int b = W.row_ptr[r]; b < W.row_ptr[r + 1]; ++b) {
+    const Block w = Eigen::Map<const Block>(W.values.data() + b * kBlockRows);
+    const float* x = X + W.col_index[b];
+    for (int m = 0; m < kRows; ++m) {
+      acc[m] += x[m * ldx] * w;
+    }
+  }
+  for (int m = 0; m < kRows; ++m) {
+    Eigen::Map<Block>(Y + m * ldy) = acc[m];
+  }
+}
+
+} // namespace
+
+// FC engine for pruned weights, selected with engine "BLOCK_SPARSE". The
+// weight is either a BlockSparseFCWeight made by PackBlockSparseFCWeight,
+// or a plain tensor, which is then packed on the first run, and again only
+// when it is resized or reallocated: like the PREPACKED engine, the op
+// assumes that the weight is not changed in place. Weights that are too
+// dense are multiplied with the dense GEMM of FC instead.
+class BlockSparseFullyConnectedOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  BlockSparseFullyConnectedOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        axis_(OperatorBase::GetSingleArgument<int32_t>("axis", 1)),
+        prune_threshold_(
+            OperatorBase::GetSingleArgument<float>("prune_threshold", 0)),
+        max_density_(OperatorBase::GetSingleArgument<float>(
+            "max_density", kDefaultMaxDensity)),
+        ws_(ws) {}
+  ~BlockSparseFullyConnectedOp() {}
+
+  bool RunOnDevice() override {
+    const auto& X = Input(0);
+    const auto& b = Input(2);
+    auto* Y = Output(0);
+    const BlockSparseFCWeight* W = &packed_;
+    if (OperatorBase::InputIsType<BlockSparseFCWeight>(1)) {
+      W = &OperatorBase::Input<BlockSparseFCWeight>(1);
+    } else {
+      const auto& dense_W = Input(1);
+      CAFFE_ENFORCE(dense_W.ndim() == 2, dense_W.ndim());
+      if (packed_.source != dense_W.data<float>() ||
+          packed_.N != dense_W.dim32(0) || packed_.K != dense_W.dim32(1)) {
+        packed_.Pack(dense_W, prune_threshold_, max_density_);
+        packed_.source = dense_W.data<float>();
+      }
+    }
+    CAFFE_ENFORCE(b.ndim() == 1, b.ndim());
+    const auto canonical_axis = X.canonical_axis_index(axis_);
+    const int M = X.size_to_dim(canonical_axis);
+    const int K = X.size_from_dim(canonical_axis);
+    const int N = W->N;
+    CAFFE_ENFORCE_EQ(
+        K, W->K, "Dimension mismatch: X: ", X.dims(), ", W: ", N, "x", W->K);
+    CAFFE_ENFORCE_EQ(
+        N, b.dim32(0), "Dimension mismatch: W: ", N, "x", K, ", b: ", b.dims());
+
+    Y_shape_cache_ = X.dims();
+    DCHECK_LE(canonical_axis + 1, Y_shape_cache_.size());
+    Y_shape_cache_.resize(canonical_axis + 1);
+    Y_shape_cache_[canonical_axis] = N;
+    Y->Resize(Y_shape_cache_);
+    const float* x = X.data<float>();
+    const float* bias = b.data<float>();
+    float* y = Y->mutable_data<float>();
+
+    if (W->is_dense) {
+      FullyConnectedGemm<float, CPUContext, DefaultEngine>(
+          M, N, K, x, W->dense.data(), y, ws_, &context_);
+      for (int m = 0; m < M; ++m) {
+        for (int n = 0; n < N; ++n) {
+          y[m * N + n] += bias[n];
+        }
+      }
+      return true;
+    }
+
+    // Each block row gives kBlockRows columns of the output, so the block
+    // rows are split across threads.
+    const int num_block_rows = (N + kBlockRows - 1) / kBlockRows;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+    if (num_block_rows > 1 && M * W->values.size() > 4096)
+#endif
+    for (int r = 0; r < num_block_rows; ++r) {
+      float acc[kRowBlock * kBlockRows];
+      const int cols = std::min(kBlockRows, N - r * kBlockRows);
+      for (int m = 0; m < M; m += kRowBlock) {
+        const float* x_block = x + m * K;
+        const int rows = std::min(kRowBlock, M - m);
+        switch (rows) {
+          case 4:
+            MicroKernel<4>(*W, r, x_block, K, acc, kBlockRows);
+            break;
+          case 3:
+            MicroKernel<3>(*W, r, x_block, K, acc, kBlockRows);
+            break;
+          case 2:
+            MicroKernel<2>(*W, r, x_block, K, acc, kBlockRows);
+            break;
+          default:
+            MicroKernel<1>(*W, r, x_block, K, acc, kBlockRows);
+        }
+        for (int i = 0; i < rows; ++i) {
+          for (int j = 0; j < cols; ++j) {
+            const int n = r * kBlockRows + j;
+            y[(m + i) * N + n] = acc[i * kBlockRows + j] + bias[n];
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  size_t axis_{1};
+  float prune_threshold_;
+  float max_density_;
+  Workspace* ws_;
+  vector<TIndex> Y_shape_cache_;
+  BlockSparseFCWeight packed_;
+};
+
+class PackBlockSparseFCWeightOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  PackBlockSparseFCWeightOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        prune_threshold_(
+            OperatorBase::GetSingleArgument<float>("prune_threshold", 0)),
+        max_density_(OperatorBase::GetSingleArgument<float>(
+            "max_density", kDefaultMaxDensity)) {}
+
+  bool RunOnDevice() override {
+    auto* packed = OperatorBase::Output<BlockSparseFCWeight>(0);
+    packed->Pack(Input(0), prune_threshold_, max_density_);
+    VLOG(1) << "Packed a " << packed->N << "x" << packed->K
+            << " FC weight with a block density of " << packed->Density()
+            << (packed->is_dense ? ", kept dense." : ".");
+    return true;
+  }
+
+ private:
+  float prune_threshold_;
+  float max_density_;
+};
+
+REGISTER_CPU_OPERATOR_WITH_ENGINE(
+    FC,
+    BLOCK_SPARSE,
+    BlockSparseFullyConnectedOp);
+REGISTER_CPU_OPERATOR(PackBlockSparseFCWeight, PackBlockSparseFCWeightOp);
+
+OPERATOR_SCHEMA(PackBlockSparseFCWeight)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Packs a pruned FC weight into block CSR format, with blocks of 4 output rows
+by 1 input column, for FC with engine BLOCK_SPARSE. Run it once, for example
+in the init net, so that the predict net does not pack the weight again on
+each run. If more than max_density of the blocks have a nonzero weight, the
+weight is kept dense, and FC uses the dense GEMM.
+)DOC")
+    .Arg(
+        "prune_threshold",
+        "Weights with a magnitude of at most this are dropped (default 0).")
+    .Arg(
+        "max_density",
+        "Fraction of nonzero blocks above which the weight is kept dense "
+        "(default 0.3).")
+    .Input(0, "W", "The N x K FC weight.")
+    .Output(0, "packed_W", "The packed weight, a BlockSparseFCWeight.");
+
+NO_GRADIENT(PackBlockSparseFCWeight);
+
+} // namespace caffe2
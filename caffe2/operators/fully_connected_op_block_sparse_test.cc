@@ -0,0 +1,119 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+// A random tensor, with about a fraction of zero_fraction of its entries set
+// to zero.
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    float zero_fraction,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  std::uniform_real_distribution<float> coin(0, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] =
+        coin(*gen) < zero_fraction ? 0 : value(*gen);
+  }
+}
+
+OperatorDef FCDef(const string& engine, const string& W, const string& output) {
+  OperatorDef def;
+  def.set_type("FC");
+  def.set_engine(engine);
+  def.add_input("X");
+  def.add_input(W);
+  def.add_input("b");
+  def.add_output(output);
+  return def;
+}
+
+void ExpectNear(Workspace* ws) {
+  const auto& expected = ws->GetBlob("expected")->Get<TensorCPU>();
+  const auto& actual = ws->GetBlob("actual")->Get<TensorCPU>();
+  ASSERT_EQ(expected.dims(), actual.dims());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected.data<float>()[i], actual.data<float>()[i], 1e-4);
+  }
+}
+
+} // namespace
+
+TEST(BlockSparseFullyConnectedTest, MatchesDefaultEngine) {
+  std::mt19937 gen(0);
+  // Sparse and dense weights, partial block rows and row blocks.
+  for (float zero_fraction : {0.f, 0.9f, 1.f}) {
+    for (int M : {1, 3, 9}) {
+      for (int N : {6, 17}) {
+        for (int K : {10, 300}) {
+          Workspace ws;
+          AddRandomTensor(&ws, "X", {M, K}, 0, &gen);
+          AddRandomTensor(&ws, "W", {N, K}, zero_fraction, &gen);
+          AddRandomTensor(&ws, "b", {N}, 0, &gen);
+          ASSERT_TRUE(ws.RunOperatorOnce(FCDef("", "W", "expected")));
+          unique_ptr<OperatorBase> op(
+              CreateOperator(FCDef("BLOCK_SPARSE", "W", "actual"), &ws));
+          ASSERT_TRUE(op->Run());
+          ExpectNear(&ws);
+
+          // A weight of another shape is packed again.
+          AddRandomTensor(&ws, "X", {M, K + 1}, 0, &gen);
+          AddRandomTensor(&ws, "W", {N, K + 1}, zero_fraction, &gen);
+          ASSERT_TRUE(ws.RunOperatorOnce(FCDef("", "W", "expected")));
+          ASSERT_TRUE(op->Run());
+          ExpectNear(&ws);
+        }
+      }
+    }
+  }
+}
+
+TEST(BlockSparseFullyConnectedTest, PackedWeight) {
+  std::mt19937 gen(0);
+  for (float max_density : {0.f, 1.f}) {
+    Workspace ws;
+    AddRandomTensor(&ws, "X", {5, 40}, 0, &gen);
+    AddRandomTensor(&ws, "W", {11, 40}, 0.8, &gen);
+    AddRandomTensor(&ws, "b", {11}, 0, &gen);
+    OperatorDef pack;
+    pack.set_type("PackBlockSparseFCWeight");
+    pack.add_input("W");
+    pack.add_output("packed_W");
+    AddArgument<float>("max_density", max_density, &pack);
+    ASSERT_TRUE(ws.RunOperatorOnce(pack));
+    ASSERT_TRUE(ws.RunOperatorOnce(FCDef("", "W", "expected")));
+    ASSERT_TRUE(
+        ws.RunOperatorOnce(FCDef("BLOCK_SPARSE", "packed_W", "actual")));
+    ExpectNear(&ws);
+  }
+}
+
+TEST(BlockSparseFullyConnectedTest, PruneThreshold) {
+  Workspace ws;
+  auto* X = ws.CreateBlob("X")->GetMutable<TensorCPU>();
+  X->Resize(1, 2);
+  X->mutable_data<float>()[0] = 1;
+  X->mutable_data<float>()[1] = 1;
+  auto* W = ws.CreateBlob("W")->GetMutable<TensorCPU>();
+  W->Resize(1, 2);
+  W->mutable_data<float>()[0] = 0.5;
+  W->mutable_data<float>()[1] = 0.01;
+  auto* b = ws.CreateBlob("b")->GetMutable<TensorCPU>();
+  b->Resize(1);
+  b->mutable_data<float>()[0] = 0;
+  auto def = FCDef("BLOCK_SPARSE", "W", "Y");
+  AddArgument<float>("prune_threshold", 0.1, &def);
+  AddArgument<float>("max_density", 1, &def);
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  EXPECT_FLOAT_EQ(ws.GetBlob("Y")->Get<TensorCPU>().data<float>()[0], 0.5);
+}
+
+} // namespace caffe2
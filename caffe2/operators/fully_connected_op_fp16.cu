@@ -0,0 +1,222 @@
+#include "caffe2/core/common_gpu.h"
+#ifdef CAFFE_HAS_CUDA_FP16
+
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/operators/fully_connected_op.h"
+
+namespace caffe2 {
+namespace {
+__global__ void SetHalfKernel(const int N, const float value, half* Y) {
+  const half h = __float2half(value);
+  CUDA_1D_KERNEL_LOOP(i, N) {
+    Y[i] = h;
+  }
+}
+
+// C = alpha * op(A) * op(B) + beta * C for half matrices, accumulated in
+// float. From CUDA 9 on cuBLAS may run it on the tensor cores.
+void HalfGemm(
+    const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB,
+    const int M,
+    const int N,
+    const int K,
+    const float alpha,
+    const float16* A,
+    const float16* B,
+    const float beta,
+    float16* C,
+    CUDAContext* context) {
+  // Note that cublas follows fortran order, so the order is different from
+  // the cblas convention.
+  const int lda = (TransA == CblasNoTrans) ? K : M;
+  const int ldb = (TransB == CblasNoTrans) ? N : K;
+  const cublasOperation_t cuTransA =
+      (TransA == CblasNoTrans) ? CUBLAS_OP_N : CUBLAS_OP_T;
+  const cublasOperation_t cuTransB =
+      (TransB == CblasNoTrans) ? CUBLAS_OP_N : CUBLAS_OP_T;
+#if CUDA_VERSION >= 9000
+  CUBLAS_CHECK(cublasGemmEx(
+      context->cublas_handle(),
+      cuTransB,
+      cuTransA,
+      N,
+      M,
+      K,
+      &alpha,
+      B,
+      CUDA_R_16F,
+      ldb,
+      A,
+      CUDA_R_16F,
+      lda,
+      &beta,
+      C,
+      CUDA_R_16F,
+      N,
+      CUDA_R_32F,
+      CUBLAS_GEMM_DEFAULT_TENSOR_OP));
+#else
+  CUBLAS_CHECK(cublasSgemmEx(
+      context->cublas_handle(),
+      cuTransB,
+      cuTransA,
+      N,
+      M,
+      K,
+      &alpha,
+      B,
+      CUDA_R_16F,
+      ldb,
+      A,
+      CUDA_R_16F,
+      lda,
+      &beta,
+      C,
+      CUDA_R_16F,
+      N));
+#endif
+}
+
+void SetBiasMultiplier(const int M, Tensor<CUDAContext>* bias_multiplier,
+                       CUDAContext* context) {
+  if (bias_multiplier->size() != M) {
+    bias_multiplier->Resize(M);
+    SetHalfKernel<<<CAFFE_GET_BLOCKS(M), CAFFE_CUDA_NUM_THREADS,
+                    0, context->cuda_stream()>>>(
+        M, 1.f,
+        reinterpret_cast<half*>(bias_multiplier->mutable_data<float16>()));
+  }
+}
+}  // namespace
+
+template <>
+bool FullyConnectedOp<float16, CUDAContext>::RunOnDevice() {
+  const auto& X = Input(0);
+  const auto& W = Input(1);
+  const auto& b = Input(2);
+  auto* Y = Output(0);
+  CAFFE_ENFORCE(W.ndim() == 2, W.ndim());
+  CAFFE_ENFORCE(b.ndim() == 1, b.ndim());
+  const auto canonical_axis = X.canonical_axis_index(axis_);
+  const int M = X.size_to_dim(canonical_axis);
+  const int K = X.size_from_dim(canonical_axis);
+  const int N = W.dim32(0);
+  CAFFE_ENFORCE_EQ(K, W.size() / N, "X: ", X.dims(), ", W: ", W.dims());
+  CAFFE_ENFORCE_EQ(N, b.size(), "W: ", W.dims(), ", b: ", b.dims());
+
+  Y_shape_cache_ = X.dims();
+  Y_shape_cache_.resize(canonical_axis + 1);
+  Y_shape_cache_[canonical_axis] = N;
+  Y->Resize(Y_shape_cache_);
+
+  // X * W^T
+  HalfGemm(
+      CblasNoTrans,
+      CblasTrans,
+      M,
+      N,
+      K,
+      1,
+      X.data<float16>(),
+      W.data<float16>(),
+      0,
+      Y->mutable_data<float16>(),
+      &context_);
+  // Add bias term
+  SetBiasMultiplier(M, &bias_multiplier_, &context_);
+  HalfGemm(
+      CblasNoTrans,
+      CblasNoTrans,
+      M,
+      N,
+      1,
+      1,
+      bias_multiplier_.data<float16>(),
+      b.data<float16>(),
+      1,
+      Y->mutable_data<float16>(),
+      &context_);
+  return true;
+}
+
+template <>
+bool FullyConnectedGradientOp<float16, CUDAContext>::RunOnDevice() {
+  const auto& X = Input(0);
+  const auto& W = Input(1);
+  const auto& dY = Input(2);
+  CAFFE_ENFORCE(W.ndim() == 2, W.ndim());
+  const auto canonical_axis = X.canonical_axis_index(axis_);
+  const int M = X.size_to_dim(canonical_axis);
+  const int K = X.size_from_dim(canonical_axis);
+  const int N = W.dim32(0);
+  CAFFE_ENFORCE(K * N == W.size());
+  CAFFE_ENFORCE(M * N == dY.size());
+
+  auto* dW = Output(0);
+  auto* db = Output(1);
+  dW->ResizeLike(W);
+  db->Resize(N);
+
+  // Compute dW
+  HalfGemm(
+      CblasTrans,
+      CblasNoTrans,
+      N,
+      K,
+      M,
+      1,
+      dY.data<float16>(),
+      X.data<float16>(),
+      0,
+      dW->mutable_data<float16>(),
+      &context_);
+  // Compute dB as ones^T * dY, which keeps the float accumulation.
+  SetBiasMultiplier(M, &bias_multiplier_, &context_);
+  HalfGemm(
+      CblasNoTrans,
+      CblasNoTrans,
+      1,
+      N,
+      M,
+      1,
+      bias_multiplier_.data<float16>(),
+      dY.data<float16>(),
+      0,
+      db->mutable_data<float16>(),
+      &context_);
+  // Compute dX, or add it to the existing dX.
+  if (OutputSize() == 3) {
+    auto* dX = Output(2);
+    if (accumulate_dX_) {
+      CAFFE_ENFORCE(
+          dX->dims() == X.dims(),
+          "The accumulated input gradient must have the shape of the input.");
+    } else {
+      dX->ResizeLike(X);
+    }
+    HalfGemm(
+        CblasNoTrans,
+        CblasNoTrans,
+        M,
+        K,
+        N,
+        1,
+        dY.data<float16>(),
+        W.data<float16>(),
+        accumulate_dX_ ? 1 : 0,
+        dX->mutable_data<float16>(),
+        &context_);
+  }
+  return true;
+}
+
+namespace {
+REGISTER_CUDA_OPERATOR(FCFp16, FullyConnectedOp<float16, CUDAContext>);
+REGISTER_CUDA_OPERATOR(
+    FCFp16Gradient,
+    FullyConnectedGradientOp<float16, CUDAContext>);
+}  // namespace
+}  // namespace caffe2
+
+#endif  // CAFFE_HAS_CUDA_FP16
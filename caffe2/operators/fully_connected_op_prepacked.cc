@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/common_omp.h"
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/types.h"
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+
+namespace {
+
+// The weight is packed in panels of kPanelWidth output columns: panel p holds
+// the rows p * kPanelWidth, ... of W, interleaved so that for each k, the
+// kPanelWidth weights are contiguous. The last panel is padded with zeros.
+constexpr int kPanelWidth = 8;
+// Rows of X that the micro-kernel computes at once.
+constexpr int kRowBlock = 4;
+// Depth of the slices of a panel that stay in the L1 cache while all the rows
+// of X go through them.
+constexpr int kDepthBlock = 256;
+
+// Y[r][0:kPanelWidth] += X[r][0:depth] * panel[0:depth][0:kPanelWidth], for
+// kRows rows. The accumulators are fixed-size Eigen arrays, which stay in
+// vector registers for the whole slice. With fewer rows, odd and even k go
+// to separate accumulators, so that the additions do not wait on each other.
+template <int kRows>
+void MicroKernel(
+    int depth,
+    const float* X,
+    int ldx,
+    const float* panel,
+    float* Y,
+    int ldy) {
+  using Row = Eigen::Array<float, kPanelWidth, 1>;
+  constexpr int kChains = kRows <= 2 ? 2 : 1;
+  Row acc[kChains][kRows];
+  for (int r = 0; r < kRows; ++r) {
+    acc[0][r] = Eigen::Map<const Row>(Y + r * ldy);
+    for (int c = 1; c < kChains; ++c) {
+      acc[c][r].setZero();
+    }
+  }
+  int k = 0;
+  for (; k + kChains <= depth; k += kChains) {
+    for (int c = 0; c < kChains; ++c) {
+      const Row w = Eigen::Map<const Row>(panel + (k + c) * kPanelWidth);
+      for (int r = 0; r < kRows; ++r) {
+        acc[c][r] += X[r * ldx + k + c] * w;
+      }
+    }
+  }
+  for (; k < depth; ++k) {
+    const Row w = Eigen::Map<const Row>(panel + k * kPanelWidth);
+    for (int r = 0; r < kRows; ++r) {
+      acc[0][r] += X[r * ldx + k] * w;
+    }
+  }
+  for (int r = 0; r < kRows; ++r) {
+    for (int c = 1; c < kChains; ++c) {
+      acc[0][r] += acc[c][r];
+    }
+    Eigen::Map<Row>(Y + r * ldy) = acc[0][r];
+  }
+}
+
+// Halves and int8 are converted to a buffer of floats, one slice at a time.
+inline const float*
+ToFloat(const float* in, int /* unused */, float* /* unused */) {
+  return in;
+}
+
+inline const float* ToFloat(const float16* in, int n, float* out) {
+  int i = 0;
+#ifdef __F16C__
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(
+        out + i,
+        _mm256_cvtph_ps(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))));
+  }
+#endif
+  // Same as detail::HalfBitsToFloat, without branches so that the loop is
+  // vectorized: the exponent and mantissa bits, scaled by 2^(127 - 15), give
+  // normal and subnormal halves exactly. Only infinities and NaNs need their
+  // exponent fixed.
+  for (; i < n; ++i) {
+    const uint32_t bits = in[i].x;
+    const uint32_t magnitude = (bits & 0x7fff) << 13;
+    float value;
+    memcpy(&value, &magnitude, sizeof(value));
+    value *= 5.192296858534828e33f; // 2^112
+    uint32_t result;
+    memcpy(&result, &value, sizeof(result));
+    if ((bits & 0x7c00) == 0x7c00) {
+      result |= 0x7f800000;
+    }
+    result |= (bits & 0x8000) << 16;
+    memcpy(out + i, &result, sizeof(result));
+  }
+  return out;
+}
+
+inline const float* ToFloat(const int8_t* in, int n, float* out) {
+  for (int i = 0; i < n; ++i) {
+    out[i] = in[i];
+  }
+  return out;
+}
+
+// A weight packed once into panels of W, stored as floats, halves, or int8
+// with a scale per output column.
+template <typename WType>
+struct PackedWeight {
+  const float* source = nullptr;
+  int N = 0;
+  int K = 0;
+  vector<WType> panels;
+  // Only for int8: W[n][k] is scales[n] * q[n][k].
+  vector<float> scales;
+
+  bool Matches(const TensorCPU& W) const {
+    return source == W.data<float>() && N == W.dim32(0) && K == W.dim32(1);
+  }
+
+  void Pack(const TensorCPU& W) {
+    source = W.data<float>();
+    N = W.dim32(0);
+    K = W.dim32(1);
+    const int num_panels = (N + kPanelWidth - 1) / kPanelWidth;
+    panels.assign(num_panels * K * kPanelWidth, WType());
+    PrepareScales();
+    for (int n = 0; n < N; ++n) {
+      WType* panel = panels.data() + n / kPanelWidth * K * kPanelWidth;
+      const float scale = scales.empty() ? 1 : scales[n];
+      for (int k = 0; k < K; ++k) {
+        Store(
+            source[n * K + k] / scale,
+            &panel[k * kPanelWidth + n % kPanelWidth]);
+      }
+    }
+  }
+
+ private:
+  void PrepareScales();
+  static void Store(float value, float* out) {
+    *out = value;
+  }
+  static void Store(float value, float16* out) {
+    out->x = detail::FloatToHalfBits(value);
+  }
+  static void Store(float value, int8_t* out) {
+    *out = static_cast<int8_t>(std::round(value));
+  }
+};
+
+template <typename WType>
+void PackedWeight<WType>::PrepareScales() {
+  scales.clear();
+}
+
+// Symmetric quantization of each row of W to [-127, 127].
+template <>
+void PackedWeight<int8_t>::PrepareScales() {
+  scales.resize(N);
+  for (int n = 0; n < N; ++n) {
+    float max_abs = 0;
+    for (int k = 0; k < K; ++k) {
+      max_abs = std::max(max_abs, std::abs(source[n * K + k]));
+    }
+    scales[n] = max_abs > 0 ? max_abs / 127 : 1;
+  }
+}
+
+} // namespace
+
+// FC engine for inference, selected with engine "PREPACKED". The weight is
+// packed on the first run, and again only when the weight tensor is resized
+// or reallocated: like PackedFC, the op assumes that the weight is not
+// changed in place. With the "precision" argument set to "fp16" or "int8",
+// the packed weight is stored as halves, or as int8 with a scale per output,
+// which halves or quarters the memory traffic of small batches.
+class PrepackedFullyConnectedOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  PrepackedFullyConnectedOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        axis_(OperatorBase::GetSingleArgument<int32_t>("axis", 1)),
+        precision_(
+            OperatorBase::GetSingleArgument<string>("precision", "float")) {
+    CAFFE_ENFORCE(
+        precision_ == "float" || precision_ == "fp16" || precision_ == "int8",
+        "Unknown precision: ",
+        precision_);
+  }
+  ~PrepackedFullyConnectedOp() {}
+
+  bool RunOnDevice() override {
+    if (precision_ == "fp16") {
+      return RunWithPackedWeight(&packed_fp16_);
+    } else if (precision_ == "int8") {
+      return RunWithPackedWeight(&packed_int8_);
+    }
+    return RunWithPackedWeight(&packed_float_);
+  }
+
+ private:
+  template <typename WType>
+  bool RunWithPackedWeight(PackedWeight<WType>* packed);
+
+  size_t axis_{1};
+  string precision_;
+  vector<TIndex> Y_shape_cache_;
+  PackedWeight<float> packed_float_;
+  PackedWeight<float16> packed_fp16_;
+  PackedWeight<int8_t> packed_int8_;
+};
+
+template <typename WType>
+bool PrepackedFullyConnectedOp::RunWithPackedWeight(
+    PackedWeight<WType>* packed) {
+  const auto& X = Input(0);
+  const auto& W = Input(1);
+  const auto& b = Input(2);
+  auto* Y = Output(0);
+  CAFFE_ENFORCE(W.ndim() == 2, W.ndim());
+  CAFFE_ENFORCE(b.ndim() == 1, b.ndim());
+  const auto canonical_axis = X.canonical_axis_index(axis_);
+  const int M = X.size_to_dim(canonical_axis);
+  const int K = X.size_from_dim(canonical_axis);
+  const int N = W.dim32(0);
+  CAFFE_ENFORCE_EQ(
+      K, W.dim32(1), "Dimension mismatch: X: ", X.dims(), ", W: ", W.dims());
+  CAFFE_ENFORCE_EQ(
+      N, b.dim32(0), "Dimension mismatch: W: ", W.dims(), ", b: ", b.dims());
+  if (!packed->Matches(W)) {
+    packed->Pack(W);
+  }
+
+  Y_shape_cache_ = X.dims();
+  DCHECK_LE(canonical_axis + 1, Y_shape_cache_.size());
+  Y_shape_cache_.resize(canonical_axis + 1);
+  Y_shape_cache_[canonical_axis] = N;
+  Y->Resize(Y_shape_cache_);
+  const float* x = X.data<float>();
+  const float* bias = b.data<float>();
+  float* y = Y->mutable_data<float>();
+  const int num_panels = (N + kPanelWidth - 1) / kPanelWidth;
+
+  // Each panel gives kPanelWidth columns of the output, so the panels are
+  // split across threads. Each slice of a panel is converted once, and all
+  // the rows of X go through it while it is in the cache.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (num_panels > 1 && M * K > 4096)
+#endif
+  for (int p = 0; p < num_panels; ++p) {
+    float buffer[kDepthBlock * kPanelWidth];
+    vector<float> acc(
+        (M + kRowBlock - 1) / kRowBlock * kRowBlock * kPanelWidth, 0);
+    const WType* panel = packed->panels.data() + p * K * kPanelWidth;
+    for (int k = 0; k < K; k += kDepthBlock) {
+      const int depth = std::min(kDepthBlock, K - k);
+      const float* slice =
+          ToFloat(panel + k * kPanelWidth, depth * kPanelWidth, buffer);
+      for (int m = 0; m < M; m += kRowBlock) {
+        const float* x_block = x + m * K + k;
+        float* acc_block = acc.data() + m * kPanelWidth;
+        switch (std::min(kRowBlock, M - m)) {
+          case 4:
+            MicroKernel<4>(depth, x_block, K, slice, acc_block, kPanelWidth);
+            break;
+          case 3:
+            MicroKernel<3>(depth, x_block, K, slice, acc_block, kPanelWidth);
+            break;
+          case 2:
+            MicroKernel<2>(depth, x_block, K, slice, acc_block, kPanelWidth);
+            break;
+          default:
+            MicroKernel<1>(depth, x_block, K, slice, acc_block, kPanelWidth);
+        }
+      }
+    }
+    const int cols = std::min(kPanelWidth, N - p * kPanelWidth);
+    for (int m = 0; m < M; ++m) {
+      for (int j = 0; j < cols; ++j) {
+        const int n = p * kPanelWidth + j;
+        const float scale = packed->scales.empty() ? 1 : packed->scales[n];
+        y[m * N + n] = acc[m * kPanelWidth + j] * scale + bias[n];
+      }
+    }
+  }
+  return true;
+}
+
+REGISTER_CPU_OPERATOR_WITH_ENGINE(FC, PREPACKED, PrepackedFullyConnectedOp);
+
+} // namespace caffe2
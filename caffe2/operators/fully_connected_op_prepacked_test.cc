@@ -0,0 +1,78 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+OperatorDef FCDef(const string& engine, const string& output) {
+  OperatorDef def;
+  def.set_type("FC");
+  def.set_engine(engine);
+  def.add_input("X");
+  def.add_input("W");
+  def.add_input("b");
+  def.add_output(output);
+  return def;
+}
+
+void ExpectNear(Workspace* ws, float tolerance) {
+  const auto& expected = ws->GetBlob("expected")->Get<TensorCPU>();
+  const auto& actual = ws->GetBlob("actual")->Get<TensorCPU>();
+  ASSERT_EQ(expected.dims(), actual.dims());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected.data<float>()[i], actual.data<float>()[i], tolerance);
+  }
+}
+
+} // namespace
+
+TEST(PrepackedFullyConnectedTest, MatchesDefaultEngine) {
+  std::mt19937 gen(0);
+  // The tolerances are for sums of K products of values in [-1, 1].
+  const vector<std::pair<string, float>> precisions = {
+      {"float", 1e-4}, {"fp16", 2e-2}, {"int8", 1e-1}};
+  for (const auto& precision : precisions) {
+    // Partial panels and row blocks, and depths over one slice.
+    for (int M : {1, 3, 9}) {
+      for (int N : {6, 17}) {
+        for (int K : {10, 300}) {
+          Workspace ws;
+          AddRandomTensor(&ws, "X", {M, K}, &gen);
+          AddRandomTensor(&ws, "W", {N, K}, &gen);
+          AddRandomTensor(&ws, "b", {N}, &gen);
+          ASSERT_TRUE(ws.RunOperatorOnce(FCDef("", "expected")));
+          auto def = FCDef("PREPACKED", "actual");
+          AddArgument<string>("precision", precision.first, &def);
+          unique_ptr<OperatorBase> op(CreateOperator(def, &ws));
+          ASSERT_TRUE(op->Run());
+          ExpectNear(&ws, precision.second);
+
+          // A weight of another shape is packed again.
+          AddRandomTensor(&ws, "X", {M, K + 1}, &gen);
+          AddRandomTensor(&ws, "W", {N, K + 1}, &gen);
+          ASSERT_TRUE(ws.RunOperatorOnce(FCDef("", "expected")));
+          ASSERT_TRUE(op->Run());
+          ExpectNear(&ws, precision.second);
+        }
+      }
+    }
+  }
+}
+
+} // namespace caffe2
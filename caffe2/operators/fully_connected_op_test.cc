@@ -46,4 +46,38 @@ TEST(FullyConnectedTest, Test) {
   }
 }
 
+TEST(FullyConnectedTest, GradientAccumulatesInputGradient) {
+  Workspace ws;
+  OperatorDef def;
+  def.set_type("FCGradient");
+  def.add_input("X");
+  def.add_input("W");
+  def.add_input("dY");
+  def.add_output("dW");
+  def.add_output("db");
+  def.add_output("dX");
+  AddConstInput(vector<TIndex>{5, 10}, 1., "X", &ws);
+  AddConstInput(vector<TIndex>{6, 10}, 0.5, "W", &ws);
+  AddConstInput(vector<TIndex>{5, 6}, 1., "dY", &ws);
+  AddConstInput(vector<TIndex>{5, 10}, 2., "dX", &ws);
+  auto* arg = def.add_arg();
+  arg->set_name("accumulate_outputs");
+  arg->add_ints(2);
+  unique_ptr<OperatorBase> op(CreateOperator(def, &ws));
+  EXPECT_TRUE(op->Run());
+  // Each element of dY * W is 6 * 0.5, added to the existing 2.
+  const auto& dX = ws.GetBlob("dX")->Get<TensorCPU>();
+  for (int i = 0; i < dX.size(); ++i) {
+    EXPECT_FLOAT_EQ(dX.data<float>()[i], 5.);
+  }
+
+  // The accumulated gradient must have the shape of the input.
+  AddConstInput(vector<TIndex>{5, 9}, 2., "dX", &ws);
+  EXPECT_THROW(op->Run(), EnforceNotMet);
+
+  // Only the input gradient can accumulate.
+  arg->set_ints(0, 0);
+  EXPECT_THROW(CreateOperator(def, &ws), EnforceNotMet);
+}
+
 }  // namespace caffe2
@@ -0,0 +1,255 @@
+#include "caffe2/operators/fused_elementwise_op.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/parallel_for.h"
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+
+vector<FusedElementwiseStep> GetFusedElementwiseSteps(const OperatorDef& def) {
+  static const std::map<string, FusedElementwiseStep::Kind> kinds{
+      {"Relu", FusedElementwiseStep::kRelu},
+      {"Sigmoid", FusedElementwiseStep::kSigmoid},
+      {"Tanh", FusedElementwiseStep::kTanh},
+      {"Scale", FusedElementwiseStep::kScale},
+      {"Clip", FusedElementwiseStep::kClip},
+      {"Add", FusedElementwiseStep::kAdd},
+      {"Sub", FusedElementwiseStep::kSub},
+      {"Mul", FusedElementwiseStep::kMul},
+      {"Div", FusedElementwiseStep::kDiv}};
+  ArgumentHelper helper(def);
+  auto types = helper.GetRepeatedArgument<string>("steps");
+  auto args = helper.GetRepeatedArgument<float>("step_args");
+  auto args_max = helper.GetRepeatedArgument<float>("step_args_max");
+  auto operands = helper.GetRepeatedArgument<int>("step_operands");
+  auto swapped = helper.GetRepeatedArgument<int>("step_swapped");
+  CAFFE_ENFORCE(types.size(), "FusedElementwise needs at least one step.");
+  CAFFE_ENFORCE_EQ(args.size(), types.size());
+  CAFFE_ENFORCE(args_max.empty() || args_max.size() == types.size());
+  CAFFE_ENFORCE_EQ(operands.size(), types.size());
+  CAFFE_ENFORCE_EQ(swapped.size(), types.size());
+  vector<FusedElementwiseStep> steps;
+  for (int i = 0; i < types.size(); ++i) {
+    auto it = kinds.find(types[i]);
+    CAFFE_ENFORCE(
+        it != kinds.end(), "Unsupported step for FusedElementwise: ", types[i]);
+    FusedElementwiseStep step{
+        it->second,
+        args[i],
+        args_max.empty() ? std::numeric_limits<float>::max() : args_max[i],
+        operands[i],
+        swapped[i] != 0};
+    if (step.IsBinary()) {
+      CAFFE_ENFORCE(
+          step.operand >= 0 && step.operand < def.input_size(),
+          "Invalid operand for step ",
+          i,
+          ": ",
+          step.operand);
+    }
+    steps.push_back(step);
+  }
+  return steps;
+}
+
+string FusedElementwiseCudaSource(const vector<FusedElementwiseStep>& steps) {
+  std::stringstream ss;
+  // showpoint keeps whole numbers valid as float literals: 2.00000000f.
+  ss << std::setprecision(9) << std::showpoint;
+  ss << "float v = in0[index];\n";
+  for (const auto& step : steps) {
+    switch (step.kind) {
+      case FusedElementwiseStep::kRelu:
+        ss << "v = v > 0.f ? v : 0.f;\n";
+        break;
+      case FusedElementwiseStep::kSigmoid:
+        ss << "v = 1.f / (1.f + expf(-v));\n";
+        break;
+      case FusedElementwiseStep::kTanh:
+        ss << "v = tanhf(v);\n";
+        break;
+      case FusedElementwiseStep::kScale:
+        ss << "v = v * " << step.arg << "f;\n";
+        break;
+      case FusedElementwiseStep::kClip:
+        ss << "v = fminf(fmaxf(v, " << step.arg << "f), " << step.arg_max
+           << "f);\n";
+        break;
+      default: {
+        static const char* symbols[] = {" + ", " - ", " * ", " / "};
+        const string operand =
+            "in" + caffe2::to_string(step.operand) + "[index]";
+        ss << "v = " << (step.swapped ? operand : "v")
+           << symbols[step.kind - FusedElementwiseStep::kAdd]
+           << (step.swapped ? "v" : operand) << ";\n";
+      }
+    }
+  }
+  ss << "out0[index] = v;\n";
+  return ss.str();
+}
+
+namespace {
+
+// Runs a chain of element-wise operators in one pass over memory. The data is
+// processed in blocks small enough to stay in L1 cache: every step of the
+// chain is applied to a block before moving on to the next one.
+class FusedElementwiseOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  FusedElementwiseOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        steps_(GetFusedElementwiseSteps(operator_def)),
+        ws_(ws) {}
+
+  bool RunOnDevice() override {
+    const auto& X = Input(0);
+    const TIndex size = X.size();
+    for (int i = 1; i < InputSize(); ++i) {
+      CAFFE_ENFORCE_EQ(
+          Input(i).size(), size, "All inputs should have the same size.");
+    }
+    vector<const float*> inputs;
+    for (int i = 0; i < InputSize(); ++i) {
+      inputs.push_back(Input(i).data<float>());
+    }
+    auto* Y = Output(0);
+    Y->ResizeLike(X);
+    float* out = Y->mutable_data<float>();
+
+    // The runs of blocks are split across threads, each with its own block
+    // buffer.
+    const TIndex num_blocks = (size + kBlockSize - 1) / kBlockSize;
+    const TIndex num_runs = (num_blocks + kBlocksPerRun - 1) / kBlocksPerRun;
+    buffers_.resize(ParallelForNumThreads(ws_) * kBlockSize);
+    ParallelFor(ws_, num_runs, [&](int thread, size_t run) {
+      float* buffer = buffers_.data() + thread * kBlockSize;
+      const TIndex end =
+          std::min<TIndex>(size, (run + 1) * kBlocksPerRun * kBlockSize);
+      for (TIndex start = run * kBlocksPerRun * kBlockSize; start < end;
+           start += kBlockSize) {
+        RunBlock(
+            inputs,
+            start,
+            std::min<TIndex>(kBlockSize, end - start),
+            buffer,
+            out);
+      }
+    });
+    return true;
+  }
+
+ private:
+  // 4KB of floats.
+  static constexpr int kBlockSize = 1024;
+  // 64KB of floats per work item of ParallelFor.
+  static constexpr int kBlocksPerRun = 16;
+
+  // Applies the chain to the n values at start, through buffer.
+  void RunBlock(
+      const vector<const float*>& inputs,
+      TIndex start,
+      int n,
+      float* buffer,
+      float* out) const {
+    EigenVectorArrayMap<float> v(buffer, n);
+    v = ConstEigenVectorArrayMap<float>(inputs[0] + start, n);
+    for (const auto& step : steps_) {
+      if (step.IsBinary()) {
+        ConstEigenVectorArrayMap<float> x(inputs[step.operand] + start, n);
+        switch (step.kind) {
+          case FusedElementwiseStep::kAdd:
+            v += x;
+            break;
+          case FusedElementwiseStep::kSub:
+            if (step.swapped) {
+              v = x - v;
+            } else {
+              v -= x;
+            }
+            break;
+          case FusedElementwiseStep::kMul:
+            v *= x;
+            break;
+          default:
+            if (step.swapped) {
+              v = x / v;
+            } else {
+              v /= x;
+            }
+            break;
+        }
+        continue;
+      }
+      switch (step.kind) {
+        case FusedElementwiseStep::kRelu:
+          v = v.cwiseMax(0.f);
+          break;
+        case FusedElementwiseStep::kSigmoid:
+          v = ((-v).exp() + 1).inverse();
+          break;
+        case FusedElementwiseStep::kTanh:
+          v = 1 - 2 * ((v * 2).exp() + 1).inverse();
+          break;
+        case FusedElementwiseStep::kClip:
+          v = v.cwiseMax(step.arg).cwiseMin(step.arg_max);
+          break;
+        default:
+          v *= step.arg;
+          break;
+      }
+    }
+    // The output may be the same blob as an input; every block is read
+    // before it is written so this is fine.
+    memcpy(out + start, buffer, n * sizeof(float));
+  }
+
+  vector<FusedElementwiseStep> steps_;
+  Workspace* ws_;
+  vector<float> buffers_;
+};
+
+} // namespace
+
+REGISTER_CPU_OPERATOR(FusedElementwise, FusedElementwiseOp);
+OPERATOR_SCHEMA(FusedElementwise)
+    .NumInputs(1, INT_MAX)
+    .NumOutputs(1)
+    .AllowInplace([](int, int) { return true; })
+    .IdenticalTypeAndShapeOfInput(0)
+    .SetDoc(R"DOC(
+Applies a chain of element-wise operators in a single pass over memory. It is
+normally not created by hand but by the element-wise fusion pass (see
+core/elementwise_fusion.h), which replaces chains such as Add -> Relu -> Scale.
+
+The chain value starts as the first input, and each step applies one operator
+to it. Binary steps take their other operand from one of the inputs, all of
+which must have the same size as the first one.
+
+The CUDA implementation compiles the chain into a single kernel with NVRTC the
+first time it is seen on a device; operators with the same chain share it.
+)DOC")
+    .Arg("steps", "(string list) the operator type of every step: Relu, "
+         "Sigmoid, Tanh, Scale, Clip, Add, Sub, Mul or Div.")
+    .Arg("step_args", "(float list) the scale of Scale steps and the min of "
+         "Clip steps, unused by others.")
+    .Arg("step_args_max", "(float list, optional) the max of Clip steps, "
+         "unused by others.")
+    .Arg("step_operands", "(int list) the input holding the other operand of "
+         "binary steps, -1 for unary steps.")
+    .Arg("step_swapped", "(int list) for binary steps, 1 if the chain value is "
+         "the second operand, as in in1 - value.")
+    .Input(0, "X", "The input the chain starts from.")
+    .Output(0, "Y", "The result of the chain, of the same shape as X.");
+SHOULD_NOT_DO_GRADIENT(FusedElementwise);
+
+} // namespace caffe2
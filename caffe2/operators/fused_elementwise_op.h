@@ -0,0 +1,49 @@
+#ifndef CAFFE2_OPERATORS_FUSED_ELEMENTWISE_OP_H_
+#define CAFFE2_OPERATORS_FUSED_ELEMENTWISE_OP_H_
+
+#include "caffe2/core/common.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+
+// One step of the chain computed by a FusedElementwise operator. The CPU
+// operator interprets the steps, the CUDA one compiles them into a kernel.
+struct FusedElementwiseStep {
+  enum Kind {
+    kRelu,
+    kSigmoid,
+    kTanh,
+    kScale,
+    kClip,
+    kAdd,
+    kSub,
+    kMul,
+    kDiv
+  };
+
+  bool IsBinary() const {
+    return kind >= kAdd;
+  }
+
+  Kind kind;
+  // The scale of Scale steps and the min of Clip steps.
+  float arg;
+  // The max of Clip steps.
+  float arg_max;
+  // For binary steps, the input holding the other operand.
+  int operand;
+  // For binary steps, whether the chain value is the second operand.
+  bool swapped;
+};
+
+// Reads and checks the steps described by the arguments of a FusedElementwise
+// operator.
+vector<FusedElementwiseStep> GetFusedElementwiseSteps(const OperatorDef& def);
+
+// Returns CUDA statements that compute the chain for element `index` of the
+// inputs in0, in1... and store it to out0[index].
+string FusedElementwiseCudaSource(const vector<FusedElementwiseStep>& steps);
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_FUSED_ELEMENTWISE_OP_H_
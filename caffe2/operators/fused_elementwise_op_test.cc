@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+
+#include "caffe2/core/elementwise_fusion.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/fused_elementwise_op.h"
+#include "google/protobuf/text_format.h"
+
+namespace caffe2 {
+
+namespace {
+
+const char kChainNet[] = R"DOC(
+  name: "chain"
+  op { input: "X" input: "W" output: "A" type: "Add" }
+  op { input: "A" output: "B" type: "Relu" }
+  op { input: "W" input: "B" output: "C" type: "Sub" }
+  op { input: "C" output: "D" type: "Sigmoid" }
+  op {
+    input: "D" output: "Y" type: "Scale"
+    arg { name: "scale" f: 0.5 }
+  }
+  op { input: "Y" output: "Z" type: "Tanh" }
+  external_input: "X"
+  external_input: "W"
+  external_output: "Y"
+  external_output: "Z"
+)DOC";
+
+NetDef ParseNet(const char* spec) {
+  NetDef net_def;
+  CAFFE_ENFORCE(
+      ::google::protobuf::TextFormat::ParseFromString(spec, &net_def));
+  return net_def;
+}
+
+void FillInputs(Workspace* ws, int size) {
+  for (const char* name : {"X", "W"}) {
+    auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+    tensor->Resize(size);
+    float* data = tensor->mutable_data<float>();
+    for (int i = 0; i < size; ++i) {
+      data[i] = (i % 17 - 8) * (name[0] == 'X' ? 0.25 : -0.125);
+    }
+  }
+}
+
+} // namespace
+
+TEST(ElementwiseFusionTest, FusesChains) {
+  NetDef fused = FuseElementwiseOps(ParseNet(kChainNet));
+  // Y is an external output, so the chain is cut after Scale.
+  ASSERT_EQ(fused.op_size(), 2);
+  const auto& op = fused.op(0);
+  EXPECT_EQ(op.type(), "FusedElementwise");
+  ASSERT_EQ(op.input_size(), 2);
+  EXPECT_EQ(op.input(0), "X");
+  EXPECT_EQ(op.input(1), "W");
+  EXPECT_EQ(op.output(0), "Y");
+  ArgumentHelper helper(op);
+  EXPECT_EQ(
+      helper.GetRepeatedArgument<string>("steps"),
+      (vector<string>{"Add", "Relu", "Sub", "Sigmoid", "Scale"}));
+  EXPECT_EQ(
+      helper.GetRepeatedArgument<int>("step_operands"),
+      (vector<int>{1, -1, 1, -1, -1}));
+  EXPECT_EQ(
+      helper.GetRepeatedArgument<int>("step_swapped"),
+      (vector<int>{0, 0, 1, 0, 0}));
+  // A single Tanh is left alone.
+  EXPECT_EQ(fused.op(1).type(), "Tanh");
+}
+
+TEST(ElementwiseFusionTest, DoesNotFuseSharedBlobs) {
+  NetDef net_def = ParseNet(kChainNet);
+  // B is now also read outside of the chain.
+  auto* op = net_def.add_op();
+  op->set_type("Relu");
+  op->add_input("B");
+  op->add_output("E");
+  NetDef fused = FuseElementwiseOps(net_def);
+  ASSERT_EQ(fused.op_size(), 4);
+  EXPECT_EQ(fused.op(0).type(), "FusedElementwise");
+  EXPECT_EQ(fused.op(0).output(0), "B");
+  EXPECT_EQ(fused.op(1).type(), "FusedElementwise");
+  EXPECT_EQ(fused.op(1).output(0), "Y");
+}
+
+TEST(ElementwiseFusionTest, MatchesUnfusedNet) {
+  // Spans a few runs of blocks of the fused operator, the last one partial.
+  const int kSize = 40000;
+  Workspace ws;
+  FillInputs(&ws, kSize);
+  NetDef net_def = ParseNet(kChainNet);
+  ASSERT_TRUE(ws.RunNetOnce(net_def));
+  TensorCPU expected(ws.GetBlob("Z")->Get<TensorCPU>());
+
+  Workspace fused_ws;
+  FillInputs(&fused_ws, kSize);
+  auto* arg = net_def.add_arg();
+  arg->set_name("fuse_elementwise");
+  arg->set_i(1);
+  ASSERT_TRUE(fused_ws.RunNetOnce(net_def));
+  EXPECT_FALSE(fused_ws.HasBlob("A"));
+  const auto& Z = fused_ws.GetBlob("Z")->Get<TensorCPU>();
+  ASSERT_EQ(Z.size(), kSize);
+  for (int i = 0; i < kSize; ++i) {
+    EXPECT_NEAR(Z.data<float>()[i], expected.data<float>()[i], 1e-6);
+  }
+}
+
+TEST(ElementwiseFusionTest, FusesClip) {
+  NetDef net_def = ParseNet(R"DOC(
+    op { input: "X" input: "W" output: "A" type: "Mul" }
+    op {
+      input: "A" output: "B" type: "Clip"
+      arg { name: "min" f: -0.5 } arg { name: "max" f: 0.25 }
+    }
+    op { input: "B" output: "Y" type: "Tanh" }
+    external_input: "X"
+    external_input: "W"
+    external_output: "Y"
+  )DOC");
+  const int kSize = 100;
+  Workspace ws;
+  FillInputs(&ws, kSize);
+  ASSERT_TRUE(ws.RunNetOnce(net_def));
+  TensorCPU expected(ws.GetBlob("Y")->Get<TensorCPU>());
+
+  NetDef fused = FuseElementwiseOps(net_def);
+  ASSERT_EQ(fused.op_size(), 1);
+  EXPECT_EQ(
+      ArgumentHelper(fused.op(0)).GetRepeatedArgument<float>("step_args_max"),
+      (vector<float>{0, 0.25, 0}));
+  Workspace fused_ws;
+  FillInputs(&fused_ws, kSize);
+  ASSERT_TRUE(fused_ws.RunNetOnce(fused));
+  const auto& Y = fused_ws.GetBlob("Y")->Get<TensorCPU>();
+  for (int i = 0; i < kSize; ++i) {
+    EXPECT_NEAR(Y.data<float>()[i], expected.data<float>()[i], 1e-6);
+  }
+}
+
+TEST(ElementwiseFusionTest, CudaSource) {
+  OperatorDef def;
+  def.set_type("FusedElementwise");
+  def.add_input("X");
+  def.add_input("W");
+  def.add_output("Y");
+  AddArgument("steps", vector<string>{"Sub", "Scale", "Clip"}, &def);
+  AddArgument("step_args", vector<float>{0, 2, -1}, &def);
+  AddArgument("step_args_max", vector<float>{0, 0, 1}, &def);
+  AddArgument("step_operands", vector<int>{1, -1, -1}, &def);
+  AddArgument("step_swapped", vector<int>{1, 0, 0}, &def);
+  EXPECT_EQ(
+      FusedElementwiseCudaSource(GetFusedElementwiseSteps(def)),
+      "float v = in0[index];\n"
+      "v = in1[index] - v;\n"
+      "v = v * 2.00000000f;\n"
+      "v = fminf(fmaxf(v, -1.00000000f), 1.00000000f);\n"
+      "out0[index] = v;\n");
+}
+
+} // namespace caffe2
@@ -1,68 +1,57 @@
 #include "caffe2/operators/h_softmax_op.h"
 
+#include <algorithm>
+#include <cmath>
 #include <queue>
 #include <stack>
 
 namespace caffe2 {
 
 template <>
-float HSoftmaxOp<float, CPUContext>::RunForwardSingle(const float* X,
-  const float* W, const float* b, int target, float* int_output,
-  const float* bias_multiplier, int dim_out, int dim_in,
-  int& int_output_offset) {
-
-  // W * x
-  float* fc_output_data = int_output + int_output_offset;
-
-  math::Gemm<float, CPUContext>(CblasNoTrans, CblasTrans, 1, dim_out, dim_in, 1,
-    X, W, 0, fc_output_data, &context_);
-  math::Gemv<float, CPUContext>(CblasNoTrans, dim_out, 1, 1,
-    b, bias_multiplier, 1, fc_output_data, &context_);
-
-  int_output_offset += dim_out;
-
-  //Softmax
-  float* softmax_output_data = int_output + int_output_offset;
-
-  if (scale_.size() != 1) {
-    scale_.Resize(1);
-  }
-  if (sum_multiplier_.size() != dim_out) {
-    sum_multiplier_.Resize(dim_out);
-    math::Set<float, CPUContext>(dim_out, 1.f,
-      sum_multiplier_.mutable_data<float>(), &context_);
-  }
-  math::RowwiseMax<float, CPUContext>(1, dim_out, fc_output_data,
-    scale_.mutable_data<float>(), &context_);
-
-  // Put the intermediate result X - max(X) into Y
-  context_.template Copy<float, CPUContext, CPUContext>(dim_out, fc_output_data,
-    softmax_output_data);
-  // Subtract the scale
-  math::Gemv<float, CPUContext>(CblasNoTrans, dim_out, 1, -1,
-    sum_multiplier_.data<float>(), scale_.data<float>(), 1, softmax_output_data,
-    &context_);
-
-  // Exponentiation
-  math::Exp<float, CPUContext>(dim_out, softmax_output_data,
-    softmax_output_data, &context_);
-  math::Gemv<float, CPUContext>(CblasNoTrans, 1, dim_out, 1,
-    softmax_output_data, sum_multiplier_.data<float>(), 0,
-    scale_.mutable_data<float>(), &context_);
-
-  // Do division
-  const float scale = *scale_.data<float>();
-  for (int j = 0; j < dim_out; ++j) {
-    softmax_output_data[j] /= scale;
-  }
-
-  int_output_offset += dim_out;
-
-  if (target < 0) {
-    return -1;
+void HSoftmaxOp<float, CPUContext>::RunForwardBatch(
+    const float* X,
+    const float* W,
+    const float* b,
+    int K,
+    const std::vector<int>& samples,
+    int dim_out) {
+  const int n = samples.size();
+  gatherRows(X, K, samples);
+  batch_output_.Resize(n, dim_out);
+  batch_softmax_.Resize(n, dim_out);
+  float* fc_output_data = batch_output_.mutable_data<float>();
+  float* softmax_output_data = batch_softmax_.mutable_data<float>();
+
+  // W * x + b for all of the samples of the node
+  math::Gemm<float, CPUContext>(
+      CblasNoTrans,
+      CblasTrans,
+      n,
+      dim_out,
+      K,
+      1,
+      batch_input_.data<float>(),
+      W,
+      0,
+      fc_output_data,
+      &context_);
+  EigenMatrixMap<float>(fc_output_data, dim_out, n).colwise() +=
+      ConstEigenVectorMap<float>(b, dim_out);
+
+  // Softmax of each row
+  for (int i = 0; i < n; ++i) {
+    const float* fc_row = fc_output_data + i * dim_out;
+    float* softmax_row = softmax_output_data + i * dim_out;
+    const float max = *std::max_element(fc_row, fc_row + dim_out);
+    float sum = 0;
+    for (int j = 0; j < dim_out; ++j) {
+      softmax_row[j] = std::exp(fc_row[j] - max);
+      sum += softmax_row[j];
+    }
+    for (int j = 0; j < dim_out; ++j) {
+      softmax_row[j] /= sum;
+    }
   }
-  //Return cross entropy loss
-  return -log(std::max(softmax_output_data[target], kLOG_THRESHOLD()));
 }
 
 // Implementation for the CPU context.
@@ -94,99 +83,37 @@ bool HSoftmaxOp<float, CPUContext>::RunOnDevice() {
   int int_output_size = getIntermediateOutputSize(labeldata, M, hierarchy);
   intermediate_output->Resize(int_output_size);
   float * int_output_data = intermediate_output->mutable_data<float>();
-  int int_output_offset = 0;
-
-  if (bias_multiplier_.size() != M) {
-    bias_multiplier_.Resize(M);
-    math::Set<float, CPUContext>(M, static_cast<float>(1),
-        bias_multiplier_.mutable_data<float>(), &context_);
-  }
 
-  for (int sample = 0; sample < M; ++sample) {
-    int word_id = labeldata[sample];
-    const PathProto& path = hierarchy[word_id];
-    for (const PathNodeProto& node : path.path_nodes()) {
-      //Offset of node's weight matrix in W
-      int w_offset = node.index();
-      //Number of output dimensions in node's weight matrix
-      int w_length = node.length();
-      int target = node.target();
-      //Adding log probabilities
-      Ydata[sample] += RunForwardSingle(X.data<float>() + sample*K,
-        W.data<float>() + w_offset*K, b.data<float>() + w_offset, target,
-        int_output_data, bias_multiplier_.data<float>()+sample, w_length, K,
-        int_output_offset);
+  for (const auto& batch : getNodeBatches(labeldata, M, hierarchy)) {
+    //Offset of node's weight matrix in W
+    int w_offset = batch.first;
+    //Number of output dimensions in node's weight matrix
+    int w_length = batch.second.length;
+    const auto& samples = batch.second.samples;
+    RunForwardBatch(
+        X.data<float>(),
+        W.data<float>() + w_offset * K,
+        b.data<float>() + w_offset,
+        K,
+        samples,
+        w_length);
+    const float* fc_output_data = batch_output_.data<float>();
+    const float* softmax_output_data = batch_softmax_.data<float>();
+    for (int i = 0; i < samples.size(); ++i) {
+      float* output = int_output_data + batch.second.offsets[i];
+      context_.Copy<float, CPUContext, CPUContext>(
+          w_length, fc_output_data + i * w_length, output);
+      context_.Copy<float, CPUContext, CPUContext>(
+          w_length, softmax_output_data + i * w_length, output + w_length);
+      //Adding the cross entropy loss of the node
+      const float p =
+          softmax_output_data[i * w_length + batch.second.targets[i]];
+      Ydata[samples[i]] += -log(std::max(p, kLOG_THRESHOLD()));
     }
   }
   return true;
 }
 
-template <>
-void HSoftmaxGradientOp<float, CPUContext>::RunBackwardSingle(const float* X,
-  const float* dY, const float* W, int target,
-  const float* int_output, float* dX, float* dW, float* db, float* dint_output,
-  int dim_in, int dim_out, int& int_output_offset) {
-
-  //Cross entropy
-  // dX_entropy is the dX for the cross entropy layer
-  float* dX_entropy = dint_output + int_output_offset - dim_out;
-  // X_entropy is the X for the cross entropy layer and Y for the softmax layer
-  const float* X_entropy = int_output + int_output_offset - dim_out;
-
-  math::Set<float, CPUContext>(dim_out, 0.f, dX_entropy, &context_);
-  dX_entropy[target] = - (*dY) / std::max(X_entropy[target], kLOG_THRESHOLD());
-
-  int_output_offset -= dim_out;
-
-  //Softmax
-  if (scale_.size() != 1) {
-    scale_.Resize(1);
-  }
-  float* scaledata = scale_.mutable_data<float>();
-
-  if (sum_multiplier_.size() != dim_out) {
-    sum_multiplier_.Resize(dim_out);
-    math::Set<float, CPUContext>(dim_out, 1.f,
-      sum_multiplier_.mutable_data<float>(), &context_);
-  }
-
-  float* dX_softmax = dint_output + int_output_offset - dim_out;
-  context_.Copy<float, CPUContext, CPUContext>(dim_out, dX_entropy, dX_softmax);
-
-  math::Dot<float, CPUContext>(dim_out, X_entropy, dX_entropy, scaledata,
-    &context_);
-  math::Gemv<float, CPUContext>(CblasTrans, 1, dim_out, -1,
-    sum_multiplier_.data<float>(), scaledata , 1, dX_softmax, &context_);
-  math::Mul<float, CPUContext>(dim_out, dX_softmax, X_entropy, dX_softmax,
-    &context_);
-
-  int_output_offset -= dim_out;
-
-  //FC
-  if (bias_multiplier_.size() != 1) {
-    // If the helper bias multiplier has not been created, reshape and fill
-    // it with 1
-    bias_multiplier_.Resize(1);
-    math::Set<float, CPUContext>(1, static_cast<float>(1),
-        bias_multiplier_.template mutable_data<float>(), &context_);
-  }
-
-  // Compute dW and add incrementally
-  // dW = dW + dX_softmax'*X
-  math::Gemm<float, CPUContext>(CblasTrans, CblasNoTrans, dim_out, dim_in, 1, 1,
-    dX_softmax, X, 1, dW, &context_);
-
-  // Compute dB and add incrementally
-  // db = db + dX_softmax*bias_multiplier_
-  math::Gemv<float, CPUContext>(CblasTrans, 1, dim_out, 1, dX_softmax,
-    bias_multiplier_.template data<float>(), 1, db, &context_);
-
-  // Compute dX and add incrementally
-  // dX = dX + W'dX_softmax
-  math::Gemv<float, CPUContext>(CblasTrans, dim_out, dim_in,
-    1, W, dX_softmax, 1, dX, &context_);
-}
-
 // Implementation for the CPU context.
 template <>
 bool HSoftmaxGradientOp<float, CPUContext>::RunOnDevice() {
@@ -221,117 +148,77 @@ bool HSoftmaxGradientOp<float, CPUContext>::RunOnDevice() {
   // Input feature dimension
   int K = X.size() / M;
   const auto* labeldata = label.data<int>();
+  const float* int_output_data = intermediate_output.data<float>();
 
   auto hierarchy = getHierarchyForLabels(M, labeldata, hierarchy_all_map_);
-  int output_offset = getIntermediateOutputSize(labeldata, M, hierarchy);
-
-  //Traverse backward to access intermediate_output generated by HSoftmaxOp
-  // sequentially in reverse order
-  for (int sample = M-1; sample >= 0; sample--) {
-    int word_id = labeldata[sample];
-    PathProto path = hierarchy[word_id];
-    for (auto node = path.path_nodes().rbegin();
-      node != path.path_nodes().rend(); node++) {
-      int w_offset = node->index();
-      int w_length = node->length();
-      int target = node->target();
-      RunBackwardSingle(X.data<float>() + sample*K, dY.data<float>() + sample,
-        W.data<float>() + w_offset*K, target, intermediate_output.data<float>(),
-        dX_data + sample*K, dW_data + w_offset*K, db_data + w_offset,
-        dOutput_data, K, w_length, output_offset);
-    }
-  }
-  return true;
-}
 
-// Implementation for the CPU context.
-template <>
-bool HSoftmaxSearchOp<float, CPUContext>::pruning(
-    const float* X,
-    int sample,
-    int K,
-    const float* W,
-    const float* b,
-    const NodeProto& src_node,
-    NodeProto& dst_node,
-    float parent_score,
-    float beam) {
-  int w_length = src_node.children_size() + src_node.word_ids_size();
-  Tensor<CPUContext> intermediate_data;
-  intermediate_data.Resize(2 * w_length);
-  float* int_output_data = intermediate_data.template mutable_data<float>();
-  int int_output_offset = 0;
-  int w_offset = src_node.offset();
-
-  RunForwardSingle(
-      X + K * sample,
-      W + w_offset * K,
-      b + w_offset,
-      -1,
-      int_output_data,
-      bias_multiplier_.template data<float>() + sample,
-      w_length,
-      K,
-      int_output_offset);
-
-  float* softmax_output_data = int_output_data + w_length;
-  // real probabilities
-  for (int i = 0; i < w_length; i++) {
-    softmax_output_data[i] =
-        -log(std::max(softmax_output_data[i], kLOG_THRESHOLD())) + parent_score;
-  }
-  for (int i = 0; i < src_node.children_size(); i++) {
-    if (softmax_output_data[i] < parent_score + beam) {
-      dst_node.add_children();
-      int idx = dst_node.children_size() - 1;
-      CAFFE_ENFORCE(
-          src_node.children(i).has_offset(),
-          "HSM Search require the field offset in NodeProte");
-      dst_node.mutable_children(idx)->set_offset(src_node.children(i).offset());
-      CAFFE_ENFORCE(
-          src_node.children(i).has_name(),
-          "HSM Search require the field name in NodeProte");
-      dst_node.mutable_children(idx)->set_name(src_node.children(i).name());
-      dst_node.add_scores(softmax_output_data[i]);
-      pruning(
-          X,
-          sample,
-          K,
-          W,
-          b,
-          src_node.children(i),
-          *dst_node.mutable_children(idx),
-          softmax_output_data[i],
-          beam);
+  for (const auto& batch : getNodeBatches(labeldata, M, hierarchy)) {
+    int w_offset = batch.first;
+    int dim_out = batch.second.length;
+    const auto& samples = batch.second.samples;
+    const int n = samples.size();
+    batch_output_.Resize(n, dim_out);
+    float* dFC_data = batch_output_.mutable_data<float>();
+
+    for (int i = 0; i < n; ++i) {
+      const int offset = batch.second.offsets[i];
+      const int target = batch.second.targets[i];
+      //Cross entropy
+      // X_entropy is the X for the cross entropy layer and Y for the softmax
+      // layer
+      const float* X_entropy = int_output_data + offset + dim_out;
+      float* dX_entropy = dOutput_data + offset + dim_out;
+      dX_entropy[target] = -dY.data<float>()[samples[i]] /
+          std::max(X_entropy[target], kLOG_THRESHOLD());
+
+      //Softmax, with the dot product of the one-hot dX_entropy and Y
+      float* dX_softmax = dOutput_data + offset;
+      const float dot = X_entropy[target] * dX_entropy[target];
+      for (int j = 0; j < dim_out; ++j) {
+        dX_softmax[j] = (dX_entropy[j] - dot) * X_entropy[j];
+      }
+      context_.Copy<float, CPUContext, CPUContext>(
+          dim_out, dX_softmax, dFC_data + i * dim_out);
     }
-  }
 
-  for (int i = src_node.children_size(); i < w_length; i++) {
-    if (softmax_output_data[i] < parent_score + beam) {
-      dst_node.add_word_ids(src_node.word_ids(i - src_node.children_size()));
-      dst_node.add_scores(softmax_output_data[i]);
+    //FC, for all of the samples of the node
+    gatherRows(X.data<float>(), K, samples);
+    // dW = dW + dX_softmax'*X
+    math::Gemm<float, CPUContext>(
+        CblasTrans,
+        CblasNoTrans,
+        dim_out,
+        K,
+        n,
+        1,
+        dFC_data,
+        batch_input_.data<float>(),
+        1,
+        dW_data + w_offset * K,
+        &context_);
+    // db = db + sum of the rows of dX_softmax
+    EigenVectorMap<float>(db_data + w_offset, dim_out) +=
+        ConstEigenMatrixMap<float>(dFC_data, dim_out, n).rowwise().sum();
+    // dX = dX + dX_softmax*W, scattered back to the rows of the samples
+    batch_input_grad_.Resize(n, K);
+    float* dX_batch_data = batch_input_grad_.mutable_data<float>();
+    math::Gemm<float, CPUContext>(
+        CblasNoTrans,
+        CblasNoTrans,
+        n,
+        K,
+        dim_out,
+        1,
+        dFC_data,
+        W.data<float>() + w_offset * K,
+        0,
+        dX_batch_data,
+        &context_);
+    for (int i = 0; i < n; ++i) {
+      math::Axpy<float, CPUContext>(
+          K, 1.f, dX_batch_data + i * K, dX_data + samples[i] * K, &context_);
     }
   }
-
-  return true;
-}
-
-template <>
-bool HSoftmaxSearchOp<float, CPUContext>::extractNodes(
-    const NodeProto& node,
-    std::vector<std::pair<string, float>>& info) {
-  int i = 0;
-
-  for (const auto& n : node.children()) {
-    info.emplace_back(std::make_pair(n.name(), node.scores(i++)));
-  }
-  for (const int n : node.word_ids()) {
-    info.emplace_back(std::make_pair(caffe2::to_string(n), node.scores(i++)));
-  }
-
-  for (const auto& n : node.children()) {
-    extractNodes(n, info);
-  }
   return true;
 }
 
@@ -355,55 +242,94 @@ bool HSoftmaxSearchOp<float, CPUContext>::RunOnDevice() {
   CAFFE_ENFORCE(N == b.dim32(0), "mismatch between Weight and Bias.");
   Y_names->Resize(M, top_n_);
   Y_scores->Resize(M, top_n_);
-
-  if (bias_multiplier_.size() != M) {
-    bias_multiplier_.Resize(M);
-    math::Set<float, CPUContext>(
-        M,
-        static_cast<float>(1),
-        bias_multiplier_.mutable_data<float>(),
-        &context_);
+  CAFFE_ENFORCE(
+      tree_.root_node().has_offset(),
+      "HSM Search require the field offset in NodeProte");
+  CAFFE_ENFORCE(
+      tree_.root_node().has_name(),
+      "HSM Search require the field name in NodeProte");
+
+  // The tree is expanded one level at a time for all of the samples, and the
+  // samples that reach a node are scored together with one GEMM.
+  std::vector<std::vector<std::pair<string, float>>> info(M);
+  std::vector<SearchNode> frontier;
+  std::vector<SearchNode> next_frontier;
+  for (int sample = 0; sample < M; ++sample) {
+    frontier.push_back({sample, &tree_.root_node(), 0});
+  }
+  while (!frontier.empty()) {
+    std::map<int, std::vector<int>> node_batches;
+    for (int i = 0; i < frontier.size(); ++i) {
+      node_batches[frontier[i].node->offset()].push_back(i);
+    }
+    next_frontier.clear();
+    for (const auto& batch : node_batches) {
+      const NodeProto& src_node = *frontier[batch.second[0]].node;
+      int w_offset = batch.first;
+      int w_length = src_node.children_size() + src_node.word_ids_size();
+      std::vector<int> samples;
+      for (int i : batch.second) {
+        samples.push_back(frontier[i].sample);
+      }
+      RunForwardBatch(
+          X.data<float>(),
+          W.data<float>() + w_offset * K,
+          b.data<float>() + w_offset,
+          K,
+          samples,
+          w_length);
+
+      for (int i = 0; i < samples.size(); ++i) {
+        const int sample = samples[i];
+        const float parent_score = frontier[batch.second[i]].score;
+        const float* softmax_output_data =
+            batch_softmax_.data<float>() + i * w_length;
+        for (int j = 0; j < w_length; j++) {
+          // real probabilities
+          const float score =
+              -log(std::max(softmax_output_data[j], kLOG_THRESHOLD())) +
+              parent_score;
+          if (score >= parent_score + beam_) {
+            continue;
+          }
+          if (j < src_node.children_size()) {
+            const auto& child = src_node.children(j);
+            CAFFE_ENFORCE(
+                child.has_offset(),
+                "HSM Search require the field offset in NodeProte");
+            CAFFE_ENFORCE(
+                child.has_name(),
+                "HSM Search require the field name in NodeProte");
+            info[sample].emplace_back(child.name(), score);
+            next_frontier.push_back({sample, &child, score});
+          } else {
+            info[sample].emplace_back(
+                caffe2::to_string(
+                    src_node.word_ids(j - src_node.children_size())),
+                score);
+          }
+        }
+      }
+    }
+    frontier.swap(next_frontier);
   }
 
   for (int sample = 0; sample < M; ++sample) {
-    CAFFE_ENFORCE(
-        tree_.root_node().has_offset(),
-        "HSM Search require the field offset in NodeProte");
-    CAFFE_ENFORCE(
-        tree_.root_node().has_name(),
-        "HSM Search require the field name in NodeProte");
-
-    NodeProto dst_node;
-    dst_node.set_offset(tree_.root_node().offset());
-    dst_node.set_name(tree_.root_node().name());
-
-    pruning(
-        X.data<float>(),
-        sample,
-        K,
-        W.data<float>(),
-        b.data<float>(),
-        tree_.root_node(),
-        dst_node,
-        0,
-        beam_);
-
-    std::vector<std::pair<string, float>> info;
-    extractNodes(dst_node, info);
+    auto& sample_info = info[sample];
     // saving the results for each sample.
     std::partial_sort(
-        info.begin(),
-        info.begin() + (top_n_ < info.size() ? top_n_ : info.size() - 1),
-        info.end(),
+        sample_info.begin(),
+        sample_info.begin() + std::min<size_t>(top_n_, sample_info.size()),
+        sample_info.end(),
         [&](std::pair<string, float> a, std::pair<string, float> b) {
           return a.second < b.second;
         });
     auto* y_name_data = Y_names->mutable_data<string>() + sample * top_n_;
     auto* y_score_data = Y_scores->mutable_data<float>() + sample * top_n_;
     for (int i = 0; i < top_n_; i++) {
-      if (i < info.size()) {
-        y_name_data[i] = info[i].first;
-        y_score_data[i] = info[i].second;
+      if (i < sample_info.size()) {
+        y_name_data[i] = sample_info[i].first;
+        y_score_data[i] = sample_info[i].second;
       } else {
         y_score_data[i] = 0;
       }
@@ -575,7 +501,9 @@ used by the gradient operator to compute gradients for all samples in the batch.
   .Output(1, "intermediate_output", "Extra blob to store the intermediate "
   "FC and softmax outputs for each node in the hierarchical path of a word. "
   "The outputs from samples are stored in consecutive blocks in the forward "
-  "pass and are used in reverse order in the backward gradientOp pass");
+  "pass and are used by the backward gradientOp pass. The samples are grouped "
+  "by node, so that the FC of each node is one GEMM over all of the samples "
+  "whose paths go through it");
 
 OPERATOR_SCHEMA(HSoftmaxGradient).NumInputs(6).NumOutputs(4);
 
@@ -598,7 +526,8 @@ OPERATOR_SCHEMA(HSoftmaxSearch)
     .SetDoc(R"DOC(
   HSoftmaxSearch is an operator to generate the most possible paths given a
   well-trained model and input vector. Greedy algorithm is used for pruning the
-  search tree.
+  search tree. The tree is expanded one level at a time for the whole batch, and
+  the samples that reach a node are scored with one GEMM.
   )DOC")
     .Arg(
         "tree",
@@ -1,6 +1,8 @@
 #ifndef CAFFE2_OPERATORS_H_SOFTMAX_OP_H_
 #define CAFFE2_OPERATORS_H_SOFTMAX_OP_H_
 
+#include <map>
+
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
@@ -24,10 +26,23 @@ class HSoftmaxOpBase : public Operator<Context> {
   }
 
  protected:
+  // The samples whose paths go through a node, with the targets of their
+  // paths at the node and the offsets of their FC outputs in
+  // intermediate_output.
+  struct NodeBatch {
+    int length;
+    std::vector<int> samples;
+    std::vector<int> targets;
+    std::vector<int> offsets;
+  };
+
   std::unordered_map<int, PathProto> hierarchy_all_map_;
-  Tensor<Context> scale_;
-  Tensor<Context> sum_multiplier_;
-  Tensor<Context> bias_multiplier_;
+  // The rows of X of the samples of a node, and their gradient.
+  Tensor<Context> batch_input_;
+  Tensor<Context> batch_input_grad_;
+  // The FC outputs of a node for its samples, or their gradient.
+  Tensor<Context> batch_output_;
+  Tensor<Context> batch_softmax_;
   static constexpr T kLOG_THRESHOLD() {
     return 1e-20;
   }
@@ -63,6 +78,38 @@ class HSoftmaxOpBase : public Operator<Context> {
     }
     return size;
   }
+  // Groups the nodes of the paths of all of the samples by node index, so
+  // that the weights of each node are applied to its samples with one GEMM.
+  // The outputs of the samples stay in consecutive blocks of
+  // intermediate_output, in the order of their paths.
+  static std::map<int, NodeBatch> getNodeBatches(
+      const int* labels,
+      int M,
+      std::unordered_map<int, PathProto>& hierarchy) {
+    std::map<int, NodeBatch> batches;
+    int offset = 0;
+    for (int sample = 0; sample < M; ++sample) {
+      const auto& path = hierarchy[labels[sample]];
+      for (const auto& node : path.path_nodes()) {
+        auto& batch = batches[node.index()];
+        batch.length = node.length();
+        batch.samples.push_back(sample);
+        batch.targets.push_back(node.target());
+        batch.offsets.push_back(offset);
+        offset += 2 * node.length();
+      }
+    }
+    return batches;
+  }
+  // Copies the rows of the given samples of X into batch_input_.
+  void gatherRows(const T* X, int K, const std::vector<int>& samples) {
+    batch_input_.Resize(samples.size(), K);
+    T* rows = batch_input_.template mutable_data<T>();
+    for (int i = 0; i < samples.size(); ++i) {
+      this->context_.template Copy<T, Context, Context>(
+          K, X + samples[i] * K, rows + i * K);
+    }
+  }
 };
 
 template <typename T, class Context>
@@ -74,16 +121,16 @@ class HSoftmaxOp : public HSoftmaxOpBase<T, Context> {
   bool RunOnDevice() override;
 
  protected:
-  float RunForwardSingle(
+  // Computes the FC and softmax outputs of a node, whose weights and bias
+  // start at W and b, for all of the given samples of X at once, into
+  // batch_output_ and batch_softmax_.
+  void RunForwardBatch(
       const float* X,
       const float* W,
       const float* b,
-      int target,
-      float* output,
-      const float* bias_multiplier,
-      int w_length,
       int K,
-      int& output_offset);
+      const std::vector<int>& samples,
+      int w_length);
 };
 
 template <typename T, class Context>
@@ -92,21 +139,6 @@ class HSoftmaxGradientOp final : public HSoftmaxOpBase<T, Context> {
   USE_OPERATOR_CONTEXT_FUNCTIONS;
   using HSoftmaxOpBase<T, Context>::HSoftmaxOpBase;
   bool RunOnDevice() override;
-
- private:
-  void RunBackwardSingle(
-      const float* X,
-      const float* dY,
-      const float* W,
-      int target,
-      const float* int_output,
-      float* dX,
-      float* dW,
-      float* db,
-      float* dOutput,
-      int dim_in,
-      int w_length,
-      int& output_offset);
 };
 
 template <typename T, class Context>
@@ -122,22 +154,16 @@ class HSoftmaxSearchOp final : public HSoftmaxOp<T, Context> {
   bool RunOnDevice() override;
 
  private:
+  // A node of the tree reached by a sample, with the score of the path.
+  struct SearchNode {
+    int sample;
+    const NodeProto* node;
+    float score;
+  };
+
   int top_n_;
   float beam_;
   TreeProto tree_;
-  bool pruning(
-      const float* X,
-      int sample,
-      int K,
-      const float* W,
-      const float* b,
-      const NodeProto& src_node,
-      NodeProto& dst_node,
-      float parent_score,
-      float beam);
-  bool extractNodes(
-      const NodeProto& node,
-      std::vector<std::pair<string, float>>& info);
 };
 
 template <typename T, class Context>
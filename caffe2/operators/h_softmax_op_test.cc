@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/proto/hsm.pb.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+constexpr int kM = 6;
+constexpr int kK = 4;
+// The root has the rows 0 to 2 of W, with the children A and B and the word 4.
+// A has the rows 3 and 4, with the words 0 and 1, and B has the rows 5 and 6,
+// with the words 2 and 3.
+constexpr int kN = 7;
+const vector<int> kLabels{0, 4, 2, 1, 3, 2};
+
+void AddPath(
+    HierarchyProto* hierarchy,
+    int word_id,
+    const vector<std::pair<int, int>>& nodes) {
+  auto* path = hierarchy->add_paths();
+  path->set_word_id(word_id);
+  for (const auto& node : nodes) {
+    auto* path_node = path->add_path_nodes();
+    path_node->set_index(node.first);
+    path_node->set_length(node.first == 0 ? 3 : 2);
+    path_node->set_target(node.second);
+  }
+}
+
+string Hierarchy() {
+  HierarchyProto hierarchy;
+  AddPath(&hierarchy, 0, {{0, 0}, {3, 0}});
+  AddPath(&hierarchy, 1, {{0, 0}, {3, 1}});
+  AddPath(&hierarchy, 2, {{0, 1}, {5, 0}});
+  AddPath(&hierarchy, 3, {{0, 1}, {5, 1}});
+  AddPath(&hierarchy, 4, {{0, 2}});
+  hierarchy.set_size(5);
+  string serialized;
+  hierarchy.SerializeToString(&serialized);
+  return serialized;
+}
+
+string Tree() {
+  TreeProto tree;
+  auto* root = tree.mutable_root_node();
+  root->set_offset(0);
+  root->set_name("root");
+  auto* a = root->add_children();
+  a->set_offset(3);
+  a->set_name("A");
+  a->add_word_ids(0);
+  a->add_word_ids(1);
+  auto* b = root->add_children();
+  b->set_offset(5);
+  b->set_name("B");
+  b->add_word_ids(2);
+  b->add_word_ids(3);
+  root->add_word_ids(4);
+  string serialized;
+  tree.SerializeToString(&serialized);
+  return serialized;
+}
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+void AddInputs(Workspace* ws, std::mt19937* gen) {
+  AddRandomTensor(ws, "X", {kM, kK}, gen);
+  AddRandomTensor(ws, "W", {kN, kK}, gen);
+  AddRandomTensor(ws, "b", {kN}, gen);
+  auto* labels = ws->CreateBlob("labels")->GetMutable<TensorCPU>();
+  labels->Resize(kM);
+  std::copy(kLabels.begin(), kLabels.end(), labels->mutable_data<int>());
+}
+
+// The negative log probabilities of the children of the node at the given
+// offset for the sample.
+vector<float> NodeLosses(Workspace* ws, int sample, int offset, int length) {
+  const float* X = ws->GetBlob("X")->Get<TensorCPU>().data<float>();
+  const float* W = ws->GetBlob("W")->Get<TensorCPU>().data<float>();
+  const float* b = ws->GetBlob("b")->Get<TensorCPU>().data<float>();
+  vector<float> logits(length);
+  float sum = 0;
+  for (int i = 0; i < length; ++i) {
+    logits[i] = b[offset + i];
+    for (int k = 0; k < kK; ++k) {
+      logits[i] += W[(offset + i) * kK + k] * X[sample * kK + k];
+    }
+    sum += std::exp(logits[i]);
+  }
+  for (auto& logit : logits) {
+    logit = std::log(sum) - logit;
+  }
+  return logits;
+}
+
+// The negative log probability of the word, along its path.
+float WordLoss(Workspace* ws, int sample, int word) {
+  const float root = NodeLosses(ws, sample, 0, 3)[std::min(word / 2, 2)];
+  if (word == 4) {
+    return root;
+  }
+  const int offset = word < 2 ? 3 : 5;
+  return root + NodeLosses(ws, sample, offset, 2)[word % 2];
+}
+
+// The sum of dY * Y, whose gradient is checked by finite differences.
+float Loss(Workspace* ws) {
+  const float* dY = ws->GetBlob("dY")->Get<TensorCPU>().data<float>();
+  float loss = 0;
+  for (int sample = 0; sample < kM; ++sample) {
+    loss += dY[sample] * WordLoss(ws, sample, kLabels[sample]);
+  }
+  return loss;
+}
+
+OperatorDef HSoftmaxDef() {
+  OperatorDef def = CreateOperatorDef(
+      "HSoftmax",
+      "",
+      vector<string>{"X", "W", "b", "labels"},
+      vector<string>{"Y", "intermediate_output"});
+  AddArgument<string>("hierarchy", Hierarchy(), &def);
+  return def;
+}
+
+} // namespace
+
+TEST(HSoftmaxTest, MatchesThePathLosses) {
+  std::mt19937 gen(0);
+  Workspace ws;
+  AddInputs(&ws, &gen);
+  ASSERT_TRUE(ws.RunOperatorOnce(HSoftmaxDef()));
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  ASSERT_EQ(Y.size(), kM);
+  for (int sample = 0; sample < kM; ++sample) {
+    EXPECT_NEAR(
+        Y.data<float>()[sample], WordLoss(&ws, sample, kLabels[sample]), 1e-5);
+  }
+  // The outputs of the samples stay in consecutive blocks in path order: the
+  // second sample, of word 4, starts after the 3 + 2 outputs of the first.
+  const auto& intermediate =
+      ws.GetBlob("intermediate_output")->Get<TensorCPU>();
+  const auto rootLosses = NodeLosses(&ws, 1, 0, 3);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_NEAR(
+        intermediate.data<float>()[2 * 5 + 3 + i],
+        std::exp(-rootLosses[i]),
+        1e-5);
+  }
+}
+
+TEST(HSoftmaxTest, Gradient) {
+  std::mt19937 gen(1);
+  Workspace ws;
+  AddInputs(&ws, &gen);
+  AddRandomTensor(&ws, "dY", {kM}, &gen);
+  const OperatorDef def = HSoftmaxDef();
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  vector<GradientWrapper> g_output(2);
+  g_output[0].dense_ = "dY";
+  g_output[1].dense_ = "dintermediate_output";
+  const auto meta = GetGradientForOp(def, g_output);
+  ASSERT_EQ(meta.ops_.size(), 1);
+  ASSERT_TRUE(ws.RunOperatorOnce(meta.ops_[0]));
+
+  const float kStep = 1e-2;
+  const vector<string> inputs{"X", "W", "b"};
+  for (int input = 0; input < inputs.size(); ++input) {
+    const auto& grad =
+        ws.GetBlob(meta.g_input_[input].dense_)->Get<TensorCPU>();
+    auto* tensor = ws.GetBlob(inputs[input])->GetMutable<TensorCPU>();
+    ASSERT_EQ(grad.dims(), tensor->dims());
+    for (int k = 0; k < tensor->size(); ++k) {
+      float* value = tensor->mutable_data<float>() + k;
+      const float original = *value;
+      *value = original + kStep;
+      const float plus = Loss(&ws);
+      *value = original - kStep;
+      const float minus = Loss(&ws);
+      *value = original;
+      EXPECT_NEAR(grad.data<float>()[k], (plus - minus) / (2 * kStep), 2e-3)
+          << inputs[input] << "[" << k << "]";
+    }
+  }
+}
+
+TEST(HSoftmaxSearchTest, ScoresAllOfTheNodesWithAWideBeam) {
+  const int kTopN = 9;
+  std::mt19937 gen(2);
+  Workspace ws;
+  AddInputs(&ws, &gen);
+  OperatorDef def = CreateOperatorDef(
+      "HSoftmaxSearch",
+      "",
+      vector<string>{"X", "W", "b"},
+      vector<string>{"names", "scores"});
+  AddArgument<string>("tree", Tree(), &def);
+  AddArgument<float>("beam", 100, &def);
+  AddArgument<int>("topN", kTopN, &def);
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& names = ws.GetBlob("names")->Get<TensorCPU>();
+  const auto& scores = ws.GetBlob("scores")->Get<TensorCPU>();
+  ASSERT_EQ(names.dims(), (vector<TIndex>{kM, kTopN}));
+
+  for (int sample = 0; sample < kM; ++sample) {
+    const auto rootLosses = NodeLosses(&ws, sample, 0, 3);
+    vector<std::pair<float, string>> expected{
+        {rootLosses[0], "A"}, {rootLosses[1], "B"}};
+    for (int word = 0; word < 5; ++word) {
+      expected.emplace_back(
+          WordLoss(&ws, sample, word), caffe2::to_string(word));
+    }
+    std::sort(expected.begin(), expected.end());
+    for (int i = 0; i < kTopN; ++i) {
+      const int index = sample * kTopN + i;
+      if (i < expected.size()) {
+        EXPECT_EQ(names.data<string>()[index], expected[i].second);
+        EXPECT_NEAR(scores.data<float>()[index], expected[i].first, 1e-5);
+      } else {
+        EXPECT_EQ(scores.data<float>()[index], 0);
+      }
+    }
+  }
+}
+
+TEST(HSoftmaxSearchTest, NarrowBeamPrunesTheSubtrees) {
+  std::mt19937 gen(3);
+  Workspace ws;
+  AddInputs(&ws, &gen);
+  OperatorDef def = CreateOperatorDef(
+      "HSoftmaxSearch",
+      "",
+      vector<string>{"X", "W", "b"},
+      vector<string>{"names", "scores"});
+  AddArgument<string>("tree", Tree(), &def);
+  // Only the children of the root more likely than 1/e are expanded.
+  AddArgument<float>("beam", 1, &def);
+  AddArgument<int>("topN", 7, &def);
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& names = ws.GetBlob("names")->Get<TensorCPU>();
+  for (int sample = 0; sample < kM; ++sample) {
+    const auto rootLosses = NodeLosses(&ws, sample, 0, 3);
+    for (int i = 0; i < 7; ++i) {
+      const string& name = names.data<string>()[sample * 7 + i];
+      if (name == "0" || name == "1") {
+        EXPECT_LT(rootLosses[0], 1);
+      } else if (name == "2" || name == "3") {
+        EXPECT_LT(rootLosses[1], 1);
+      }
+    }
+  }
+}
+
+} // namespace caffe2
@@ -1,9 +1,129 @@
 #include "caffe2/operators/half_float_ops.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "caffe2/core/blob_serialization.h"
+
 namespace caffe2 {
+
+template <>
+bool FloatToHalfOp<CPUContext>::RunOnDevice() {
+  auto& X = Input(0);
+  auto* Y = Output(0);
+  Y->ResizeLike(X);
+  const float* x = X.data<float>();
+  float16* y = Y->mutable_data<float16>();
+  for (TIndex i = 0; i < X.size(); ++i) {
+    y[i].x = detail::FloatToHalfBits(x[i]);
+  }
+  return true;
+}
+
+template <>
+bool HalfToFloatOp<CPUContext>::RunOnDevice() {
+  auto& X = Input(0);
+  auto* Y = Output(0);
+  Y->ResizeLike(X);
+  const float16* x = X.data<float16>();
+  float* y = Y->mutable_data<float>();
+  for (TIndex i = 0; i < X.size(); ++i) {
+    y[i] = detail::HalfBitsToFloat(x[i].x);
+  }
+  return true;
+}
+
 namespace {
+// The scale and bias of a row follow its quantized values.
+constexpr TIndex kScaleBiasBytes = 2 * sizeof(float);
+} // namespace
+
+bool FloatToFused8BitRowwiseQuantizedOp::RunOnDevice() {
+  auto& X = Input(0);
+  auto* Y = Output(0);
+  CAFFE_ENFORCE_EQ(X.ndim(), 2, "Input must be a 2-D matrix");
+  const TIndex rows = X.dim(0);
+  const TIndex cols = X.dim(1);
+  Y->Resize(rows, cols + kScaleBiasBytes);
+  const float* x = X.data<float>();
+  uint8_t* y = Y->mutable_data<uint8_t>();
+  for (TIndex i = 0; i < rows; ++i) {
+    const float* row = x + i * cols;
+    uint8_t* out = y + i * (cols + kScaleBiasBytes);
+    float min = 0;
+    float max = 0;
+    if (cols > 0) {
+      min = *std::min_element(row, row + cols);
+      max = *std::max_element(row, row + cols);
+    }
+    const float range = max - min;
+    const float scale_bias[2] = {range / 255, min};
+    const float inverse_scale = 255 / (range + 1e-8f);
+    for (TIndex j = 0; j < cols; ++j) {
+      out[j] = static_cast<uint8_t>(std::lrint((row[j] - min) * inverse_scale));
+    }
+    memcpy(out + cols, scale_bias, kScaleBiasBytes);
+  }
+  return true;
+}
+
+bool Fused8BitRowwiseQuantizedToFloatOp::RunOnDevice() {
+  auto& X = Input(0);
+  auto* Y = Output(0);
+  CAFFE_ENFORCE_EQ(X.ndim(), 2, "Input must be a 2-D matrix");
+  CAFFE_ENFORCE_GE(
+      X.dim(1), kScaleBiasBytes, "Rows must end with their scale and bias");
+  const TIndex rows = X.dim(0);
+  const TIndex cols = X.dim(1) - kScaleBiasBytes;
+  Y->Resize(rows, cols);
+  const uint8_t* x = X.data<uint8_t>();
+  float* y = Y->mutable_data<float>();
+  for (TIndex i = 0; i < rows; ++i) {
+    const uint8_t* row = x + i * (cols + kScaleBiasBytes);
+    float scale_bias[2];
+    memcpy(scale_bias, row + cols, kScaleBiasBytes);
+    for (TIndex j = 0; j < cols; ++j) {
+      y[i * cols + j] = scale_bias[0] * row[j] + scale_bias[1];
+    }
+  }
+  return true;
+}
+
+namespace {
+REGISTER_CPU_OPERATOR(FloatToHalf, FloatToHalfOp<CPUContext>);
+REGISTER_CPU_OPERATOR(HalfToFloat, HalfToFloatOp<CPUContext>);
+REGISTER_CPU_OPERATOR(
+    FloatToFused8BitRowwiseQuantized,
+    FloatToFused8BitRowwiseQuantizedOp);
+REGISTER_CPU_OPERATOR(
+    Fused8BitRowwiseQuantizedToFloat,
+    Fused8BitRowwiseQuantizedToFloatOp);
+
 OPERATOR_SCHEMA(FloatToHalf).NumInputs(1).NumOutputs(1);
 OPERATOR_SCHEMA(HalfToFloat).NumInputs(1).NumOutputs(1);
+OPERATOR_SCHEMA(FloatToFused8BitRowwiseQuantized)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Quantizes each row of a float matrix to 8 bits with its own scale and bias,
+which take the last 8 bytes of the rows of the uint8 output: a row of N floats
+becomes N + 8 bytes. The values of a row are mapped linearly from [min, max]
+to [0, 255], so that value = scale * q + bias with bias = min.
+)DOC")
+    .Input(0, "input", "Float matrix to quantize.")
+    .Output(0, "output", "Fused 8-bit row-wise quantized uint8 matrix.");
+OPERATOR_SCHEMA(Fused8BitRowwiseQuantizedToFloat)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Dequantizes a matrix produced by FloatToFused8BitRowwiseQuantized back to
+floats.
+)DOC")
+    .Input(0, "input", "Fused 8-bit row-wise quantized uint8 matrix.")
+    .Output(0, "output", "Dequantized float matrix.");
+NO_GRADIENT(FloatToFused8BitRowwiseQuantized);
+NO_GRADIENT(Fused8BitRowwiseQuantizedToFloat);
 
 class GetFloatToHalfGradient : public GradientMakerBase {
   using GradientMakerBase::GradientMakerBase;
@@ -24,6 +24,27 @@ class HalfToFloatOp : public Operator<Context> {
   bool RunOnDevice() override;
 };
 
+// Quantizes each row of a 2-D float tensor to 8 bits, with its own scale and
+// bias: the output rows hold the quantized values followed by the float scale
+// and bias, as read by SparseLengths{Sum,WeightedSum,Mean}Fused8BitRowwise.
+class FloatToFused8BitRowwiseQuantizedOp final
+    : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  using Operator<CPUContext>::Operator;
+
+  bool RunOnDevice() override;
+};
+
+class Fused8BitRowwiseQuantizedToFloatOp final
+    : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  using Operator<CPUContext>::Operator;
+
+  bool RunOnDevice() override;
+};
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_HALF_FLOAT_OPS_H_
@@ -1,17 +1,56 @@
 #include <atomic>
+#include <functional>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <sstream>
-#include <unordered_map>
 #include <vector>
 #include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/common_omp.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/packed_strings.h"
 #include "caffe2/core/tensor.h"
 
 namespace caffe2 {
 namespace {
 using IndexKeyTypes = TensorTypes<int32_t, int64_t, std::string>;
 using TIndexValue = int64_t;
+
+template <typename T>
+size_t KeyHash(const T& key) {
+  return std::hash<T>()(key);
+}
+
+// Strings are hashed by their bytes, so that a std::string and a StringView
+// of the same bytes hash to the same value (FNV-1a).
+inline size_t KeyHash(StringView key) {
+  uint64_t h = 14695981039346656037ULL;
+  for (const unsigned char c : key) {
+    h = (h ^ c) * 1099511628211ULL;
+  }
+  return h;
+}
+inline size_t KeyHash(const std::string& key) {
+  return KeyHash(StringView(key));
+}
+
+template <typename T, typename K>
+void AssignKey(const K& from, T* to) {
+  *to = from;
+}
+inline void AssignKey(StringView from, std::string* to) {
+  to->assign(from.data(), from.size());
+}
+
+// Views of the elements of packed strings, to look them up in an
+// Index<std::string> without making a std::string of each.
+vector<StringView> KeyViews(const PackedStrings& strings) {
+  vector<StringView> views(strings.size());
+  for (TIndex i = 0; i < strings.size(); ++i) {
+    views[i] = strings[i];
+  }
+  return views;
+}
 }  // namespace
 
 struct IndexBase {
@@ -21,7 +60,8 @@ struct IndexBase {
     , meta_(type)
     , frozen_{false} {}
 
-  void Freeze() { frozen_ = true; }
+  // Should not be called concurrently with Get.
+  virtual void Freeze() { frozen_ = true; }
 
   bool isFrozen() const {
     return frozen_;
@@ -36,83 +76,302 @@ struct IndexBase {
   const TypeMeta& Type() const { return meta_; }
 
   TIndexValue Size() {
-    std::lock_guard<std::mutex> guard(dictMutex_);
     return nextId_;
   }
 
  protected:
   int64_t maxElements_;
   TypeMeta meta_;
-  TIndexValue nextId_{1}; // guarded by dictMutex_
+  std::atomic<TIndexValue> nextId_{1};
   std::atomic<bool> frozen_{false};
-  std::mutex dictMutex_;
 };
 
+/**
+ * Index<T> is a concurrent open-addressing hash table. Keys are spread over
+ * kNumShards shards, each with its own linear-probing table and a mutex that
+ * is only taken for insertion, so concurrent IndexGet calls never block each
+ * other on known keys. A slot is published by storing its id with release
+ * semantics after the key is written and is never modified afterwards, which
+ * lets readers probe without locks. When a shard grows, its new table is
+ * published atomically and the old one is retired but kept alive until the
+ * next Load or Freeze, since readers may still be probing it.
+ *
+ * Freeze replaces the shards with a single read-only flat table that is
+ * probed without any atomics.
+ */
 template<typename T>
 struct Index: IndexBase {
   explicit Index(TIndexValue maxElements)
-    : IndexBase(maxElements, TypeMeta::Make<T>()) {}
+    : IndexBase(maxElements, TypeMeta::Make<T>()) {
+    Reset();
+  }
 
-  void Get(const T* keys, TIndexValue* values, size_t numKeys) {
+  // The keys are of type T, or for strings, possibly StringViews.
+  template <typename K>
+  void Get(const K* keys, TIndexValue* values, size_t numKeys) {
+    const int64_t n = numKeys;
     if (frozen_) {
-      FrozenGet(keys, values, numKeys);
+#pragma omp parallel for if (n >= kParallelGetMinKeys)
+      for (int64_t i = 0; i < n; ++i) {
+        values[i] = FlatFind(keys[i]);
+      }
       return;
     }
-    std::lock_guard<std::mutex> lock(dictMutex_);
-    for (int i = 0; i < numKeys; ++i) {
-      auto it = dict_.find(keys[i]);
-      if (it != dict_.end()) {
-        values[i] = it->second;
-      } else if (nextId_ < maxElements_) {
-        auto newValue = nextId_++;
-        dict_.insert({keys[i], newValue});
-        values[i] = newValue;
-      } else {
-        CAFFE_THROW("Dict max size reached");
+    // Lock-free lookup of the whole batch first; the misses are then inserted
+    // in batch order so that new ids are assigned deterministically.
+#pragma omp parallel for if (n >= kParallelGetMinKeys)
+    for (int64_t i = 0; i < n; ++i) {
+      values[i] = Find(keys[i], Hash(keys[i]));
+    }
+    for (int64_t i = 0; i < n; ++i) {
+      if (values[i] == 0) {
+        values[i] = Insert(keys[i], Hash(keys[i]));
       }
     }
   }
 
-  bool Load(const T* keys, size_t numKeys) {
+  // Assumes that no Get is in flight.
+  template <typename K>
+  bool Load(const K* keys, size_t numKeys) {
     CAFFE_ENFORCE(
         numKeys <= maxElements_,
         "Cannot load index: Tensor is larger than max_elements.");
-    decltype(dict_) dict;
+    Reset();
     for (int i = 0; i < numKeys; ++i) {
+      const size_t hash = Hash(keys[i]);
       CAFFE_ENFORCE(
-          dict.insert({keys[i], i + 1}).second,
+          Find(keys[i], hash) == 0,
           "Repeated elements found: cannot load into dictionary.");
+      Insert(keys[i], hash);
     }
-    // assume no `get` is inflight while this happens
-    {
-      std::lock_guard<std::mutex> lock(dictMutex_);
-      // let the old dict get destructed outside of the lock
-      dict_.swap(dict);
-      nextId_ = numKeys + 1;
+    if (frozen_) {
+      BuildFlat();
     }
     return true;
   }
 
   template<typename Ctx>
   bool Store(Tensor<Ctx>* out) {
-    std::lock_guard<std::mutex> lock(dictMutex_);
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto& shard : shards_) {
+      locks.emplace_back(shard.mutex);
+    }
     out->Resize(nextId_ - 1);
     auto outData = out->template mutable_data<T>();
-    for (const auto& entry : dict_) {
-      outData[entry.second - 1] = entry.first;
-    }
+    ForEach([outData](const T& key, TIndexValue id) {
+      outData[id - 1] = key;
+    });
     return true;
   }
 
+  void Freeze() override {
+    BuildFlat();
+    IndexBase::Freeze();
+  }
+
  private:
-  void FrozenGet(const T* keys, TIndexValue* values, size_t numKeys) {
-    for (int i = 0; i < numKeys; ++i) {
-      auto it = dict_.find(keys[i]);
-      values[i] = it != dict_.end() ? it->second : 0;
+  static constexpr int kShardBits = 6;
+  static constexpr int kNumShards = 1 << kShardBits;
+  static constexpr size_t kInitialShardCapacity = 16;
+  static constexpr int64_t kParallelGetMinKeys = 4096;
+
+  struct Slot {
+    std::atomic<TIndexValue> id{0}; // 0 marks an empty slot
+    size_t hash{0};
+    T key;
+  };
+
+  struct Table {
+    explicit Table(size_t capacity)
+        : mask(capacity - 1), slots(new Slot[capacity]) {}
+    size_t capacity() const {
+      return mask + 1;
+    }
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+  };
+
+  struct Shard {
+    std::atomic<Table*> table{nullptr};
+    std::mutex mutex;
+    // Guarded by mutex. The last table is the live one.
+    size_t size{0};
+    std::vector<std::unique_ptr<Table>> tables;
+  };
+
+  struct FlatSlot {
+    TIndexValue id{0};
+    T key;
+  };
+
+  // std::hash is the identity for integers on common implementations, so
+  // the bits are mixed (murmur3 finalizer) before being used for both the
+  // shard and the probe start.
+  template <typename K>
+  static size_t Hash(const K& key) {
+    uint64_t h = KeyHash(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  Shard& ShardFor(size_t hash) {
+    return shards_[hash >> (8 * sizeof(size_t) - kShardBits)];
+  }
+
+  void Reset() {
+    for (auto& shard : shards_) {
+      shard.tables.clear();
+      shard.tables.emplace_back(new Table(kInitialShardCapacity));
+      shard.table = shard.tables.back().get();
+      shard.size = 0;
     }
+    nextId_ = 1;
+    flat_.clear();
+    flatMask_ = 0;
   }
 
-  std::unordered_map<T, TIndexValue> dict_;
+  // Returns the id of key, or 0 if it is not present. Lock-free.
+  template <typename K>
+  TIndexValue Find(const K& key, size_t hash) {
+    const Table* table = ShardFor(hash).table.load(std::memory_order_acquire);
+    for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+      const Slot& slot = table->slots[i];
+      const TIndexValue id = slot.id.load(std::memory_order_acquire);
+      if (id == 0) {
+        return 0;
+      }
+      if (slot.hash == hash && slot.key == key) {
+        return id;
+      }
+    }
+  }
+
+  template <typename K>
+  TIndexValue Insert(const K& key, size_t hash) {
+    Shard& shard = ShardFor(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // Another thread may have inserted the key since the lock-free lookup.
+    const TIndexValue existing = Find(key, hash);
+    if (existing != 0) {
+      return existing;
+    }
+    if (2 * (shard.size + 1) > shard.tables.back()->capacity()) {
+      Grow(&shard);
+    }
+    const TIndexValue id = NextId();
+    Table* table = shard.tables.back().get();
+    size_t i = hash & table->mask;
+    while (table->slots[i].id.load(std::memory_order_relaxed) != 0) {
+      i = (i + 1) & table->mask;
+    }
+    Slot& slot = table->slots[i];
+    slot.hash = hash;
+    AssignKey(key, &slot.key);
+    slot.id.store(id, std::memory_order_release);
+    ++shard.size;
+    return id;
+  }
+
+  TIndexValue NextId() {
+    TIndexValue id = nextId_.load();
+    do {
+      if (id >= maxElements_) {
+        CAFFE_THROW("Dict max size reached");
+      }
+    } while (!nextId_.compare_exchange_weak(id, id + 1));
+    return id;
+  }
+
+  // Called with shard->mutex held.
+  void Grow(Shard* shard) {
+    const Table& old = *shard->tables.back();
+    std::unique_ptr<Table> table(new Table(2 * old.capacity()));
+    for (size_t j = 0; j < old.capacity(); ++j) {
+      const Slot& from = old.slots[j];
+      const TIndexValue id = from.id.load(std::memory_order_relaxed);
+      if (id == 0) {
+        continue;
+      }
+      size_t i = from.hash & table->mask;
+      while (table->slots[i].id.load(std::memory_order_relaxed) != 0) {
+        i = (i + 1) & table->mask;
+      }
+      table->slots[i].hash = from.hash;
+      table->slots[i].key = from.key;
+      table->slots[i].id.store(id, std::memory_order_relaxed);
+    }
+    shard->table.store(table.get(), std::memory_order_release);
+    shard->tables.push_back(std::move(table));
+  }
+
+  template <typename Fn>
+  void ForEach(Fn fn) {
+    if (!flat_.empty()) {
+      for (const auto& slot : flat_) {
+        if (slot.id != 0) {
+          fn(slot.key, slot.id);
+        }
+      }
+      return;
+    }
+    for (const auto& shard : shards_) {
+      const Table& table = *shard.tables.back();
+      for (size_t i = 0; i < table.capacity(); ++i) {
+        const TIndexValue id = table.slots[i].id.load();
+        if (id != 0) {
+          fn(table.slots[i].key, id);
+        }
+      }
+    }
+  }
+
+  void BuildFlat() {
+    if (!flat_.empty()) {
+      return;
+    }
+    size_t capacity = 2;
+    while (capacity < 2 * static_cast<size_t>(nextId_)) {
+      capacity <<= 1;
+    }
+    std::vector<FlatSlot> flat(capacity);
+    const size_t mask = capacity - 1;
+    ForEach([&flat, mask](const T& key, TIndexValue id) {
+      size_t i = Hash(key) & mask;
+      while (flat[i].id != 0) {
+        i = (i + 1) & mask;
+      }
+      flat[i].id = id;
+      flat[i].key = key;
+    });
+    flat_.swap(flat);
+    flatMask_ = mask;
+    // The shards are no longer needed, keep a single empty table in each so
+    // that Find stays valid.
+    for (auto& shard : shards_) {
+      shard.tables.clear();
+      shard.tables.emplace_back(new Table(kInitialShardCapacity));
+      shard.table = shard.tables.back().get();
+      shard.size = 0;
+    }
+  }
+
+  template <typename K>
+  TIndexValue FlatFind(const K& key) const {
+    for (size_t i = Hash(key) & flatMask_;; i = (i + 1) & flatMask_) {
+      const FlatSlot& slot = flat_[i];
+      if (slot.id == 0 || slot.key == key) {
+        return slot.id;
+      }
+    }
+  }
+
+  Shard shards_[kNumShards];
+  std::vector<FlatSlot> flat_;
+  size_t flatMask_{0};
 };
 
 // TODO(azzolini): support sizes larger than int32
@@ -135,12 +394,31 @@ class IndexCreateOp: public Operator<CPUContext> {
   TIndexValue maxElements_;
 };
 
+// The index to look up or load PackedStrings into.
+Index<std::string>* StringIndex(const std::unique_ptr<IndexBase>& base) {
+  auto* dict = dynamic_cast_if_rtti<Index<std::string>*>(base.get());
+  CAFFE_ENFORCE(dict, "Wrong dictionary type given input keys.");
+  return dict;
+}
+
 class IndexGetOp: public Operator<CPUContext> {
  public:
   IndexGetOp(const OperatorDef& operator_def, Workspace* ws)
    : Operator(operator_def, ws) {}
 
   bool RunOnDevice() override {
+    if (OperatorBase::InputIsType<PackedStrings>(1)) {
+      const auto& keys = OperatorBase::Input<PackedStrings>(1);
+      auto* values = Output(0);
+      values->Resize(keys.dims());
+      auto* dict =
+          StringIndex(OperatorBase::Input<std::unique_ptr<IndexBase>>(0));
+      dict->Get(
+          KeyViews(keys).data(),
+          values->mutable_data<TIndexValue>(),
+          keys.size());
+      return true;
+    }
     return DispatchHelper<IndexKeyTypes>::call(this, Input(1));
   }
   template <typename T>
@@ -164,6 +442,14 @@ class IndexLoadOp: public Operator<CPUContext> {
             OperatorBase::GetSingleArgument<int>("skip_first_entry", 0)) {}
 
   bool RunOnDevice() override {
+    if (OperatorBase::InputIsType<PackedStrings>(1)) {
+      const auto views = KeyViews(OperatorBase::Input<PackedStrings>(1));
+      const size_t skip = skipFirstEntry_ ? 1 : 0;
+      CAFFE_ENFORCE(views.size() >= skip);
+      auto* dict =
+          StringIndex(OperatorBase::Input<std::unique_ptr<IndexBase>>(0));
+      return dict->Load(views.data() + skip, views.size() - skip);
+    }
     return DispatchHelper<IndexKeyTypes>::call(this, Input(1));
   }
   template <typename T>
@@ -281,7 +567,10 @@ entries are given index 0. Otherwise, new entries are added into the index.
 If an insert is necessary but max_elements has been reached, fail.
 )DOC")
   .Input(0, "handle", "Pointer to an Index instance.")
-  .Input(1, "keys", "Tensor of keys to be looked up.")
+  .Input(
+      1,
+      "keys",
+      "Tensor of keys to be looked up, or PackedStrings for a string index.")
   .Output(0, "indices", "Indices for each of the keys.");
 
 OPERATOR_SCHEMA(IndexFreeze)
@@ -303,7 +592,11 @@ Loads the index from the given 1-D tensor. Elements in the tensor will be given
 consecutive indexes starting at 1. Fails if tensor contains repeated elements.
 )DOC")
     .Input(0, "handle", "Pointer to an Index instance.")
-    .Input(1, "items", "1-D tensor with elements starting with index 1.")
+    .Input(
+        1,
+        "items",
+        "1-D tensor with elements starting with index 1, or PackedStrings "
+        "for a string index.")
     .Output(0, "handle", "The input handle.")
     .EnforceInplace({{0, 0}})
     .Arg(
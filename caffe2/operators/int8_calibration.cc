@@ -0,0 +1,177 @@
+#include "caffe2/operators/int8_calibration.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include "caffe2/utils/proto_utils.h"
+
+namespace caffe2 {
+
+namespace {
+
+bool IsInt8Quantizable(const OperatorDef& def) {
+  static const std::set<string> kTypes = {
+      "Conv", "FC", "Relu", "MaxPool", "AveragePool"};
+  if (!kTypes.count(def.type()) || !def.engine().empty() ||
+      def.input_size() < 1 || def.output_size() != 1 ||
+      (def.has_device_option() &&
+       def.device_option().device_type() != CPU)) {
+    return false;
+  }
+  ArgumentHelper helper(def);
+  if (def.type() == "Conv" && helper.GetSingleArgument<int>("group", 1) != 1) {
+    return false;
+  }
+  if (def.type() != "FC" && def.type() != "Relu") {
+    const auto order = helper.GetSingleArgument<string>("order", "NCHW");
+    if (order != "NCHW" && order != "NHWC") {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Relu and pooling work on the quantized values, so their output keeps the
+// parameters of their input.
+bool ChangesParams(const OperatorDef& def) {
+  return def.type() == "Conv" || def.type() == "FC";
+}
+
+string Int8Name(const string& blob) {
+  return blob + "_int8";
+}
+
+void AddParams(
+    OperatorDef* def,
+    const string& prefix,
+    const Int8QuantizationParams& params) {
+  def->add_arg()->CopyFrom(MakeArgument(prefix + "_scale", params.scale));
+  def->add_arg()->CopyFrom(MakeArgument(
+      prefix + "_zero_point", static_cast<int>(params.zero_point)));
+}
+
+} // namespace
+
+Int8Calibrator::Int8Calibrator(const NetDef& net, Workspace* ws)
+    : net_(net), ws_(ws) {
+  for (const auto& input : net_.external_input()) {
+    ws_->CreateBlob(input);
+  }
+  for (const auto& def : net_.op()) {
+    ops_.push_back(CreateOperator(def, ws_));
+    quantizable_.push_back(IsInt8Quantizable(def));
+  }
+  input_ranges_.resize(ops_.size());
+  output_ranges_.resize(ops_.size());
+}
+
+void Int8Calibrator::Observe(const string& blob, Range* range) {
+  const Blob* b = ws_->GetBlob(blob);
+  if (!b || !b->IsType<TensorCPU>()) {
+    return;
+  }
+  const auto& tensor = b->Get<TensorCPU>();
+  if (!tensor.IsType<float>() || tensor.size() == 0) {
+    return;
+  }
+  const float* data = tensor.data<float>();
+  const auto minmax = std::minmax_element(data, data + tensor.size());
+  range->min = std::min(range->min, *minmax.first);
+  range->max = std::max(range->max, *minmax.second);
+}
+
+bool Int8Calibrator::RunAndObserve() {
+  for (size_t i = 0; i < ops_.size(); ++i) {
+    const auto& def = net_.op(i);
+    // The input is observed before the op runs, as an op in place overwrites
+    // it.
+    if (quantizable_[i]) {
+      Observe(def.input(0), &input_ranges_[i]);
+    }
+    if (!ops_[i]->Run()) {
+      return false;
+    }
+    if (quantizable_[i]) {
+      Observe(def.output(0), &output_ranges_[i]);
+    }
+  }
+  return true;
+}
+
+NetDef Int8Calibrator::QuantizedNet() const {
+  NetDef quantized = net_;
+  quantized.clear_op();
+  // The blobs whose uint8 version is up to date, with its parameters.
+  std::map<string, Int8QuantizationParams> int8_blobs;
+  // The blobs last written in uint8 only, whose float version is stale.
+  std::set<string> stale_floats;
+
+  auto dequantize = [&](const string& blob) {
+    if (!stale_floats.count(blob)) {
+      return;
+    }
+    auto* def = quantized.add_op();
+    def->set_type("Int8Dequantize");
+    def->add_input(Int8Name(blob));
+    def->add_output(blob);
+    AddParams(def, "X", int8_blobs.at(blob));
+    stale_floats.erase(blob);
+  };
+
+  for (size_t i = 0; i < ops_.size(); ++i) {
+    const auto& def = net_.op(i);
+    const bool quantize = quantizable_[i] && input_ranges_[i].observed() &&
+        (!ChangesParams(def) || output_ranges_[i].observed());
+    if (!quantize) {
+      for (const auto& input : def.input()) {
+        dequantize(input);
+      }
+      quantized.add_op()->CopyFrom(def);
+      for (const auto& output : def.output()) {
+        int8_blobs.erase(output);
+        stale_floats.erase(output);
+      }
+      continue;
+    }
+
+    const string& X = def.input(0);
+    const string& Y = def.output(0);
+    if (!int8_blobs.count(X)) {
+      const auto params = ChooseInt8QuantizationParams(
+          input_ranges_[i].min, input_ranges_[i].max);
+      auto* quantize_def = quantized.add_op();
+      quantize_def->set_type("Int8Quantize");
+      quantize_def->add_input(X);
+      quantize_def->add_output(Int8Name(X));
+      AddParams(quantize_def, "Y", params);
+      int8_blobs[X] = params;
+    }
+    const auto x_params = int8_blobs.at(X);
+    const auto y_params = ChangesParams(def)
+        ? ChooseInt8QuantizationParams(
+              output_ranges_[i].min, output_ranges_[i].max)
+        : x_params;
+    // The weights and bias stay float, and may have been written in uint8
+    // only if another quantized op produced them.
+    for (int j = 1; j < def.input_size(); ++j) {
+      dequantize(def.input(j));
+    }
+    auto* int8_def = quantized.add_op();
+    int8_def->CopyFrom(def);
+    int8_def->set_engine("INT8");
+    int8_def->set_input(0, Int8Name(X));
+    int8_def->set_output(0, Int8Name(Y));
+    AddParams(int8_def, "X", x_params);
+    AddParams(int8_def, "Y", y_params);
+    int8_blobs[Y] = y_params;
+    stale_floats.insert(Y);
+  }
+
+  for (const auto& output : net_.external_output()) {
+    dequantize(output);
+  }
+  return quantized;
+}
+
+} // namespace caffe2
@@ -0,0 +1,67 @@
+#ifndef CAFFE2_OPERATORS_INT8_CALIBRATION_H_
+#define CAFFE2_OPERATORS_INT8_CALIBRATION_H_
+
+#include <limits>
+#include <memory>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/operators/int8_ops.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+
+// Calibrates the quantization of the activations of a float inference net,
+// and rewrites it to run with the "INT8" engine.
+//
+// The net is run on a few representative inputs, one op at a time, and the
+// range of the data input and of the output of each op that has an INT8
+// engine (Conv, FC, Relu, MaxPool and AveragePool) is recorded. The
+// quantized net then runs these ops with the INT8 engine, with
+// quantization parameters that cover the recorded ranges. Relu and pooling
+// keep the parameters of their input. An Int8Quantize is inserted where a
+// quantized op reads a float blob, and an Int8Dequantize where a float op or
+// the caller reads a quantized one. The uint8 version of blob "x" is
+// "x_int8".
+//
+// Only CPU ops without an engine are quantized, and Conv only without groups
+// and in the NCHW or NHWC order. The weights are left as they are: the INT8
+// ops quantize them on their first run.
+class Int8Calibrator {
+ public:
+  // Creates the ops of `net` in ws, which must already hold the parameters,
+  // e.g. after running the init net.
+  Int8Calibrator(const NetDef& net, Workspace* ws);
+
+  // Runs the net once on the inputs in the workspace, and widens the
+  // recorded ranges to the values seen.
+  bool RunAndObserve();
+
+  // The rewritten net. Ops whose ranges were never observed stay in float.
+  NetDef QuantizedNet() const;
+
+ private:
+  struct Range {
+    float min = std::numeric_limits<float>::infinity();
+    float max = -std::numeric_limits<float>::infinity();
+
+    bool observed() const {
+      return min <= max;
+    }
+  };
+
+  void Observe(const string& blob, Range* range);
+
+  NetDef net_;
+  Workspace* ws_;
+  vector<std::unique_ptr<OperatorBase>> ops_;
+  vector<bool> quantizable_;
+  vector<Range> input_ranges_;
+  vector<Range> output_ranges_;
+
+  DISABLE_COPY_AND_ASSIGN(Int8Calibrator);
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_INT8_CALIBRATION_H_
@@ -0,0 +1,141 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/int8_calibration.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+OperatorDef* AddOp(
+    NetDef* net,
+    const string& type,
+    const vector<string>& inputs,
+    const string& output) {
+  auto* def = net->add_op();
+  def->set_type(type);
+  for (const auto& input : inputs) {
+    def->add_input(input);
+  }
+  def->add_output(output);
+  return def;
+}
+
+// Conv -> Relu in place -> MaxPool -> FC.
+NetDef ConvNet() {
+  NetDef net;
+  net.set_name("conv_net");
+  for (const string input : {"X", "W", "b", "fc_w", "fc_b"}) {
+    net.add_external_input(input);
+  }
+  auto* conv = AddOp(&net, "Conv", {"X", "W", "b"}, "conv");
+  conv->add_arg()->CopyFrom(MakeArgument("kernel", 3));
+  conv->add_arg()->CopyFrom(MakeArgument("pad", 1));
+  AddOp(&net, "Relu", {"conv"}, "conv");
+  auto* pool = AddOp(&net, "MaxPool", {"conv"}, "pool");
+  pool->add_arg()->CopyFrom(MakeArgument("kernel", 2));
+  pool->add_arg()->CopyFrom(MakeArgument("stride", 2));
+  AddOp(&net, "FC", {"pool", "fc_w", "fc_b"}, "Y");
+  net.add_external_output("Y");
+  return net;
+}
+
+void AddParameters(Workspace* ws, std::mt19937* gen) {
+  AddRandomTensor(ws, "W", {8, 3, 3, 3}, gen);
+  AddRandomTensor(ws, "b", {8}, gen);
+  AddRandomTensor(ws, "fc_w", {5, 8 * 4 * 4}, gen);
+  AddRandomTensor(ws, "fc_b", {5}, gen);
+}
+
+} // namespace
+
+TEST(Int8CalibratorTest, QuantizesConvNet) {
+  std::mt19937 gen(0);
+  Workspace ws;
+  AddParameters(&ws, &gen);
+  Int8Calibrator calibrator(ConvNet(), &ws);
+  for (int i = 0; i < 4; ++i) {
+    AddRandomTensor(&ws, "X", {2, 3, 8, 8}, &gen);
+    ASSERT_TRUE(calibrator.RunAndObserve());
+  }
+  const auto quantized = calibrator.QuantizedNet();
+
+  const vector<string> types = {
+      "Int8Quantize", "Conv", "Relu", "MaxPool", "FC", "Int8Dequantize"};
+  ASSERT_EQ(quantized.op_size(), types.size());
+  for (int i = 0; i < quantized.op_size(); ++i) {
+    EXPECT_EQ(quantized.op(i).type(), types[i]);
+  }
+  EXPECT_EQ(quantized.op(1).engine(), "INT8");
+  EXPECT_EQ(quantized.op(1).input(0), "X_int8");
+  EXPECT_EQ(quantized.op(2).input(0), "conv_int8");
+  EXPECT_EQ(quantized.op(2).output(0), "conv_int8");
+  EXPECT_EQ(quantized.op(4).input(1), "fc_w");
+  EXPECT_EQ(quantized.op(5).input(0), "Y_int8");
+  EXPECT_EQ(quantized.op(5).output(0), "Y");
+
+  // On new inputs, the quantized net stays within a few percent of the range
+  // of the output.
+  AddRandomTensor(&ws, "X", {2, 3, 8, 8}, &gen);
+  ASSERT_TRUE(ws.RunNetOnce(ConvNet()));
+  TensorCPU expected(ws.GetBlob("Y")->Get<TensorCPU>());
+  ASSERT_TRUE(ws.RunNetOnce(quantized));
+  const auto& actual = ws.GetBlob("Y")->Get<TensorCPU>();
+  ASSERT_EQ(expected.dims(), actual.dims());
+  const float* data = expected.data<float>();
+  const auto range = std::minmax_element(data, data + expected.size());
+  const float tolerance = 0.05 * (*range.second - *range.first);
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(data[i], actual.data<float>()[i], tolerance);
+  }
+}
+
+TEST(Int8CalibratorTest, DequantizesForFloatOps) {
+  std::mt19937 gen(0);
+  Workspace ws;
+  AddParameters(&ws, &gen);
+  auto net = ConvNet();
+  // An op with an engine is left alone, so the MaxPool reads the output of
+  // the Relu in float, which is dequantized once for it and the Copy.
+  net.mutable_op(2)->set_engine("CUSTOM");
+  AddOp(&net, "Copy", {"conv"}, "conv_copy");
+  Int8Calibrator calibrator(net, &ws);
+  AddRandomTensor(&ws, "X", {2, 3, 8, 8}, &gen);
+  ASSERT_TRUE(calibrator.RunAndObserve());
+  const auto quantized = calibrator.QuantizedNet();
+
+  const vector<string> types = {"Int8Quantize",
+                                "Conv",
+                                "Relu",
+                                "Int8Dequantize",
+                                "MaxPool",
+                                "Int8Quantize",
+                                "FC",
+                                "Copy",
+                                "Int8Dequantize"};
+  ASSERT_EQ(quantized.op_size(), types.size());
+  for (int i = 0; i < quantized.op_size(); ++i) {
+    EXPECT_EQ(quantized.op(i).type(), types[i]);
+  }
+  EXPECT_EQ(quantized.op(3).output(0), "conv");
+  EXPECT_EQ(quantized.op(4).engine(), "CUSTOM");
+  EXPECT_EQ(quantized.op(5).input(0), "pool");
+  EXPECT_EQ(quantized.op(7).input(0), "conv");
+}
+
+} // namespace caffe2
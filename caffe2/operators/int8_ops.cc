@@ -0,0 +1,561 @@
+#include "caffe2/operators/int8_ops.h"
+
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "caffe2/core/common_omp.h"
+#include "caffe2/operators/conv_pool_op_base.h"
+
+namespace caffe2 {
+
+void Int8PackedWeight::Pack(const TensorCPU& W, int N_, int K_) {
+  CAFFE_ENFORCE_EQ(W.size(), static_cast<TIndex>(N_) * K_);
+  source = W.data<float>();
+  N = N_;
+  K = K_;
+  data.resize(N * K);
+  scales.resize(N);
+  sums.resize(N);
+  for (int n = 0; n < N; ++n) {
+    const float* w = source + n * K;
+    float max_abs = 0;
+    for (int k = 0; k < K; ++k) {
+      max_abs = std::max(max_abs, std::abs(w[k]));
+    }
+    scales[n] = max_abs > 0 ? max_abs / 127 : 1;
+    int32_t sum = 0;
+    for (int k = 0; k < K; ++k) {
+      const int8_t q = static_cast<int8_t>(std::nearbyint(w[k] / scales[n]));
+      data[n * K + k] = q;
+      sum += q;
+    }
+    sums[n] = sum;
+  }
+}
+
+namespace {
+
+#ifdef __AVX2__
+inline int32_t HorizontalSum(__m256i v) {
+  __m128i sum = _mm_add_epi32(
+      _mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  sum = _mm_hadd_epi32(sum, sum);
+  sum = _mm_hadd_epi32(sum, sum);
+  return _mm_cvtsi128_si32(sum);
+}
+#endif
+
+// out[j] = sum_k a[k] * b[j * ldb + k], for kCols rows of B, so that each
+// slice of a is loaded once for all of them.
+//
+// With AVX2, both operands are widened to int16 and multiplied with
+// _mm256_madd_epi16, whose pairwise sums of two products cannot overflow.
+// _mm256_maddubs_epi16 would take the uint8 and int8 values directly, but
+// saturates its pairwise sums to int16, which 255 * 127 * 2 exceeds.
+template <int kCols>
+void DotU8S8(int K, const uint8_t* a, const int8_t* b, int ldb, int32_t* out) {
+  int k = 0;
+#if defined(__AVX2__)
+  __m256i acc[kCols];
+  for (int j = 0; j < kCols; ++j) {
+    acc[j] = _mm256_setzero_si256();
+  }
+  for (; k + 16 <= K; k += 16) {
+    const __m256i va = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + k)));
+    for (int j = 0; j < kCols; ++j) {
+      const __m256i vb = _mm256_cvtepi8_epi16(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j * ldb + k)));
+      acc[j] = _mm256_add_epi32(acc[j], _mm256_madd_epi16(va, vb));
+    }
+  }
+  for (int j = 0; j < kCols; ++j) {
+    out[j] = HorizontalSum(acc[j]);
+  }
+#elif defined(__ARM_NEON__)
+  int32x4_t acc[kCols];
+  for (int j = 0; j < kCols; ++j) {
+    acc[j] = vdupq_n_s32(0);
+  }
+  for (; k + 8 <= K; k += 8) {
+    const int16x8_t va = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(a + k)));
+    for (int j = 0; j < kCols; ++j) {
+      const int16x8_t vb = vmovl_s8(vld1_s8(b + j * ldb + k));
+      acc[j] = vmlal_s16(acc[j], vget_low_s16(va), vget_low_s16(vb));
+      acc[j] = vmlal_s16(acc[j], vget_high_s16(va), vget_high_s16(vb));
+    }
+  }
+  for (int j = 0; j < kCols; ++j) {
+    out[j] = vgetq_lane_s32(acc[j], 0) + vgetq_lane_s32(acc[j], 1) +
+        vgetq_lane_s32(acc[j], 2) + vgetq_lane_s32(acc[j], 3);
+  }
+#else
+  for (int j = 0; j < kCols; ++j) {
+    out[j] = 0;
+  }
+#endif
+  for (; k < K; ++k) {
+    const int32_t value = a[k];
+    for (int j = 0; j < kCols; ++j) {
+      out[j] += value * b[j * ldb + k];
+    }
+  }
+}
+
+// Converts the int32 sums of a layer to its uint8 output. Row m and column n
+// of acc (M x N) go to Y[m * row_stride + n * col_stride].
+//
+// With the input x = sx * (qx - zx) and the weight w = sw[n] * qw, the output
+//   y[m][n] = sx * sw[n] * (acc[m][n] - zx * sum_k qw[n][k]) + bias[n]
+// is quantized to qy = y / sy + zy.
+void Int8Requantize(
+    int M,
+    int N,
+    const int32_t* acc,
+    const Int8PackedWeight& W,
+    const float* bias,
+    const Int8QuantizationParams& x_params,
+    const Int8QuantizationParams& y_params,
+    uint8_t* Y,
+    int row_stride,
+    int col_stride) {
+  vector<float> multipliers(N);
+  vector<float> offsets(N);
+  for (int n = 0; n < N; ++n) {
+    multipliers[n] = x_params.scale * W.scales[n] / y_params.scale;
+    offsets[n] = (bias ? bias[n] / y_params.scale : 0) + y_params.zero_point -
+        x_params.zero_point * W.sums[n] * multipliers[n];
+  }
+  for (int m = 0; m < M; ++m) {
+    for (int n = 0; n < N; ++n) {
+      const float value = acc[m * N + n] * multipliers[n] + offsets[n];
+      Y[m * row_stride + n * col_stride] =
+          Int8Clamp(static_cast<int32_t>(std::nearbyint(value)));
+    }
+  }
+}
+
+} // namespace
+
+void Int8Gemm(
+    int M,
+    int N,
+    int K,
+    const uint8_t* A,
+    int lda,
+    const int8_t* B,
+    int32_t* C) {
+  constexpr int kCols = 4;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (M > 1 && M * N * K > 65536)
+#endif
+  for (int m = 0; m < M; ++m) {
+    const uint8_t* a = A + m * lda;
+    int32_t* c = C + m * N;
+    int n = 0;
+    for (; n + kCols <= N; n += kCols) {
+      DotU8S8<kCols>(K, a, B + n * K, K, c + n);
+    }
+    for (; n < N; ++n) {
+      DotU8S8<1>(K, a, B + n * K, K, c + n);
+    }
+  }
+}
+
+namespace {
+
+class Int8QuantizeOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  Int8QuantizeOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        params_(GetInt8QuantizationParams(*this, "Y")) {}
+
+  bool RunOnDevice() override {
+    const auto& X = Input(0);
+    auto* Y = Output(0);
+    Y->ResizeLike(X);
+    const float* x = X.data<float>();
+    uint8_t* y = Y->mutable_data<uint8_t>();
+    for (TIndex i = 0; i < X.size(); ++i) {
+      y[i] = Int8QuantizeValue(x[i], params_);
+    }
+    return true;
+  }
+
+ private:
+  Int8QuantizationParams params_;
+};
+
+class Int8DequantizeOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  Int8DequantizeOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        params_(GetInt8QuantizationParams(*this, "X")) {}
+
+  bool RunOnDevice() override {
+    const auto& X = Input(0);
+    auto* Y = Output(0);
+    Y->ResizeLike(X);
+    const uint8_t* x = X.data<uint8_t>();
+    float* y = Y->mutable_data<float>();
+    for (TIndex i = 0; i < X.size(); ++i) {
+      y[i] = Int8DequantizeValue(x[i], params_);
+    }
+    return true;
+  }
+
+ private:
+  Int8QuantizationParams params_;
+};
+
+class Int8FCOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  Int8FCOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        axis_(OperatorBase::GetSingleArgument<int32_t>("axis", 1)),
+        x_params_(GetInt8QuantizationParams(*this, "X")),
+        y_params_(GetInt8QuantizationParams(*this, "Y")) {}
+
+  bool RunOnDevice() override {
+    const auto& X = Input(0);
+    const auto& W = Input(1);
+    const auto& b = Input(2);
+    auto* Y = Output(0);
+    CAFFE_ENFORCE(W.ndim() == 2, W.ndim());
+    CAFFE_ENFORCE(b.ndim() == 1, b.ndim());
+    const auto canonical_axis = X.canonical_axis_index(axis_);
+    const int M = X.size_to_dim(canonical_axis);
+    const int K = X.size_from_dim(canonical_axis);
+    const int N = W.dim32(0);
+    CAFFE_ENFORCE_EQ(
+        K, W.dim32(1), "Dimension mismatch: X: ", X.dims(), ", W: ", W.dims());
+    CAFFE_ENFORCE_EQ(
+        N, b.dim32(0), "Dimension mismatch: W: ", W.dims(), ", b: ", b.dims());
+    if (!packed_.Matches(W, N, K)) {
+      packed_.Pack(W, N, K);
+    }
+
+    Y_shape_cache_ = X.dims();
+    Y_shape_cache_.resize(canonical_axis + 1);
+    Y_shape_cache_[canonical_axis] = N;
+    Y->Resize(Y_shape_cache_);
+    acc_.resize(M * N);
+    Int8Gemm(
+        M, N, K, X.data<uint8_t>(), K, packed_.data.data(), acc_.data());
+    Int8Requantize(
+        M,
+        N,
+        acc_.data(),
+        packed_,
+        b.data<float>(),
+        x_params_,
+        y_params_,
+        Y->mutable_data<uint8_t>(),
+        N,
+        1);
+    return true;
+  }
+
+ private:
+  size_t axis_{1};
+  Int8QuantizationParams x_params_;
+  Int8QuantizationParams y_params_;
+  vector<TIndex> Y_shape_cache_;
+  Int8PackedWeight packed_;
+  vector<int32_t> acc_;
+};
+
+class Int8ConvOp final : public ConvPoolOpBase<CPUContext> {
+ public:
+  USE_CONV_POOL_BASE_FUNCTIONS(CPUContext);
+  Int8ConvOp(const OperatorDef& operator_def, Workspace* ws)
+      : ConvPoolOpBase<CPUContext>(operator_def, ws),
+        x_params_(GetInt8QuantizationParams(*this, "X")),
+        y_params_(GetInt8QuantizationParams(*this, "Y")) {
+    CAFFE_ENFORCE_EQ(group_, 1, "The INT8 Conv does not support groups.");
+  }
+
+  bool RunOnDeviceWithOrderNCHW() override {
+    return RunWithOrder(false);
+  }
+  bool RunOnDeviceWithOrderNHWC() override {
+    return RunWithOrder(true);
+  }
+
+ private:
+  bool RunWithOrder(bool nhwc);
+  // Writes the receptive field of each output pixel of an image to a row of
+  // col_, in the order of the values of a filter: (c, kh, kw) for NCHW, and
+  // (kh, kw, c) for NHWC. The padding is the zero point, which stands for 0.
+  void Im2Col(
+      bool nhwc,
+      const uint8_t* x,
+      int C,
+      int H,
+      int W,
+      int out_h,
+      int out_w);
+
+  Int8QuantizationParams x_params_;
+  Int8QuantizationParams y_params_;
+  Int8PackedWeight packed_;
+  vector<uint8_t> col_;
+  vector<int32_t> acc_;
+};
+
+void Int8ConvOp::Im2Col(
+    bool nhwc,
+    const uint8_t* x,
+    int C,
+    int H,
+    int W,
+    int out_h,
+    int out_w) {
+  const int K = C * kernel_h_ * kernel_w_;
+  col_.resize(out_h * out_w * K);
+  const uint8_t pad = static_cast<uint8_t>(x_params_.zero_point);
+  for (int oh = 0; oh < out_h; ++oh) {
+    for (int ow = 0; ow < out_w; ++ow) {
+      uint8_t* row = col_.data() + (oh * out_w + ow) * K;
+      for (int kh = 0; kh < kernel_h_; ++kh) {
+        const int h = oh * stride_h_ - pad_t_ + kh * dilation_h_;
+        for (int kw = 0; kw < kernel_w_; ++kw) {
+          const int w = ow * stride_w_ - pad_l_ + kw * dilation_w_;
+          const bool inside = h >= 0 && h < H && w >= 0 && w < W;
+          if (nhwc) {
+            uint8_t* out = row + (kh * kernel_w_ + kw) * C;
+            if (inside) {
+              memcpy(out, x + (h * W + w) * C, C);
+            } else {
+              memset(out, pad, C);
+            }
+          } else {
+            for (int c = 0; c < C; ++c) {
+              row[(c * kernel_h_ + kh) * kernel_w_ + kw] =
+                  inside ? x[(c * H + h) * W + w] : pad;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+bool Int8ConvOp::RunWithOrder(bool nhwc) {
+  const auto& X = Input(0);
+  const auto& filter = Input(1);
+  auto* Y = Output(0);
+  const int N = X.dim32(0);
+  const int C = nhwc ? X.dim32(3) : X.dim32(1);
+  const int H = nhwc ? X.dim32(1) : X.dim32(2);
+  const int W = nhwc ? X.dim32(2) : X.dim32(3);
+  CAFFE_ENFORCE_EQ(filter.ndim(), 4);
+  const int M = filter.dim32(0);
+  ConvPoolOpBase<CPUContext>::SetOutputSize(X, Y, M);
+  CAFFE_ENFORCE_EQ(filter.dim32(nhwc ? 1 : 2), kernel_h_);
+  CAFFE_ENFORCE_EQ(filter.dim32(nhwc ? 2 : 3), kernel_w_);
+  CAFFE_ENFORCE_EQ(filter.dim32(nhwc ? 3 : 1), C);
+  const float* bias = nullptr;
+  if (InputSize() == 3) {
+    const auto& b = Input(2);
+    CAFFE_ENFORCE_EQ(b.ndim(), 1);
+    CAFFE_ENFORCE_EQ(b.dim32(0), M);
+    bias = b.data<float>();
+  }
+  const int K = C * kernel_h_ * kernel_w_;
+  if (!packed_.Matches(filter, M, K)) {
+    packed_.Pack(filter, M, K);
+  }
+
+  const int out_h = nhwc ? Y->dim32(1) : Y->dim32(2);
+  const int out_w = nhwc ? Y->dim32(2) : Y->dim32(3);
+  const int P = out_h * out_w;
+  acc_.resize(P * M);
+  const uint8_t* x = X.data<uint8_t>();
+  uint8_t* y = Y->mutable_data<uint8_t>();
+  for (int i = 0; i < N; ++i) {
+    const uint8_t* x_image = x + i * C * H * W;
+    // In NHWC, the pixels of the image are already the rows of a pointwise
+    // convolution.
+    const bool direct = nhwc && IsPointwiseConv();
+    if (!direct) {
+      Im2Col(nhwc, x_image, C, H, W, out_h, out_w);
+    }
+    Int8Gemm(
+        P,
+        M,
+        K,
+        direct ? x_image : col_.data(),
+        K,
+        packed_.data.data(),
+        acc_.data());
+    Int8Requantize(
+        P,
+        M,
+        acc_.data(),
+        packed_,
+        bias,
+        x_params_,
+        y_params_,
+        y + i * M * P,
+        nhwc ? M : 1,
+        nhwc ? 1 : P);
+  }
+  return true;
+}
+
+// Relu on the quantized values: the output has the scale and zero point of
+// the input, and the zero point stands for 0.
+class Int8ReluOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  Int8ReluOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        zero_point_(static_cast<uint8_t>(
+            GetInt8QuantizationParams(*this, "X").zero_point)) {}
+
+  bool RunOnDevice() override {
+    const auto& X = Input(0);
+    auto* Y = Output(0);
+    Y->ResizeLike(X);
+    const uint8_t* x = X.data<uint8_t>();
+    uint8_t* y = Y->mutable_data<uint8_t>();
+    for (TIndex i = 0; i < X.size(); ++i) {
+      y[i] = std::max(x[i], zero_point_);
+    }
+    return true;
+  }
+
+ private:
+  uint8_t zero_point_;
+};
+
+// Pooling on the quantized values, with the scale and zero point of the input
+// for the output. As for the float ops, the average is over the part of the
+// window inside the image, and dilation is not supported.
+template <bool kMax>
+class Int8PoolOp final : public ConvPoolOpBase<CPUContext> {
+ public:
+  USE_CONV_POOL_BASE_FUNCTIONS(CPUContext);
+  Int8PoolOp(const OperatorDef& operator_def, Workspace* ws)
+      : ConvPoolOpBase<CPUContext>(operator_def, ws) {
+    CAFFE_ENFORCE(
+        dilation_h_ == 1 && dilation_w_ == 1,
+        "Pooling op does not support dilation right now.");
+  }
+
+  bool RunOnDeviceWithOrderNCHW() override {
+    return RunWithOrder(false);
+  }
+  bool RunOnDeviceWithOrderNHWC() override {
+    return RunWithOrder(true);
+  }
+
+ private:
+  bool RunWithOrder(bool nhwc) {
+    const auto& X = Input(0);
+    auto* Y = Output(0);
+    const int N = X.dim32(0);
+    const int C = nhwc ? X.dim32(3) : X.dim32(1);
+    const int H = nhwc ? X.dim32(1) : X.dim32(2);
+    const int W = nhwc ? X.dim32(2) : X.dim32(3);
+    ConvPoolOpBase<CPUContext>::SetOutputSize(X, Y, C);
+    const int out_h = nhwc ? Y->dim32(1) : Y->dim32(2);
+    const int out_w = nhwc ? Y->dim32(2) : Y->dim32(3);
+    // The distance between consecutive pixels and channels of an image.
+    const int pixel_stride = nhwc ? C : 1;
+    const int channel_stride = nhwc ? 1 : H * W;
+    const int out_pixel_stride = nhwc ? C : 1;
+    const int out_channel_stride = nhwc ? 1 : out_h * out_w;
+    const uint8_t* x = X.data<uint8_t>();
+    uint8_t* y = Y->mutable_data<uint8_t>();
+    for (int i = 0; i < N * C; ++i) {
+      const int n = i / C;
+      const int c = i % C;
+      const uint8_t* x_plane = x + n * C * H * W + c * channel_stride;
+      uint8_t* y_plane = y + n * C * out_h * out_w + c * out_channel_stride;
+      for (int oh = 0; oh < out_h; ++oh) {
+        const int h_start = std::max(oh * stride_h_ - pad_t_, 0);
+        const int h_end = std::min(oh * stride_h_ - pad_t_ + kernel_h_, H);
+        for (int ow = 0; ow < out_w; ++ow) {
+          const int w_start = std::max(ow * stride_w_ - pad_l_, 0);
+          const int w_end = std::min(ow * stride_w_ - pad_l_ + kernel_w_, W);
+          int32_t value = 0;
+          for (int h = h_start; h < h_end; ++h) {
+            for (int w = w_start; w < w_end; ++w) {
+              const int32_t q = x_plane[(h * W + w) * pixel_stride];
+              value = kMax ? std::max(value, q) : value + q;
+            }
+          }
+          if (!kMax) {
+            const int32_t count = (h_end - h_start) * (w_end - w_start);
+            value = count > 0 ? (value + count / 2) / count : 0;
+          }
+          y_plane[(oh * out_w + ow) * out_pixel_stride] =
+              static_cast<uint8_t>(value);
+        }
+      }
+    }
+    return true;
+  }
+};
+
+} // namespace
+
+REGISTER_CPU_OPERATOR(Int8Quantize, Int8QuantizeOp);
+REGISTER_CPU_OPERATOR(Int8Dequantize, Int8DequantizeOp);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(FC, INT8, Int8FCOp);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(Conv, INT8, Int8ConvOp);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(Relu, INT8, Int8ReluOp);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(MaxPool, INT8, Int8PoolOp<true>);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(AveragePool, INT8, Int8PoolOp<false>);
+
+OPERATOR_SCHEMA(Int8Quantize)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .TensorInferenceFunction([](const OperatorDef& /* unused */,
+                                const vector<TensorShape>& in) {
+      vector<TensorShape> out(1, in[0]);
+      out[0].set_data_type(TensorProto_DataType_UINT8);
+      return out;
+    })
+    .SetDoc(R"DOC(
+Quantizes a float tensor to uint8 for the ops of the "INT8" engine: each value
+x becomes clamp(round(x / Y_scale) + Y_zero_point, 0, 255).
+)DOC")
+    .Arg("Y_scale", "The quantization step of the output.")
+    .Arg("Y_zero_point", "The uint8 value that stands for 0.")
+    .Input(0, "X", "Float tensor.")
+    .Output(0, "Y", "uint8 tensor of the shape of X.");
+
+OPERATOR_SCHEMA(Int8Dequantize)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .TensorInferenceFunction([](const OperatorDef& /* unused */,
+                                const vector<TensorShape>& in) {
+      vector<TensorShape> out(1, in[0]);
+      out[0].set_data_type(TensorProto_DataType_FLOAT);
+      return out;
+    })
+    .SetDoc(R"DOC(
+Converts a uint8 tensor of the "INT8" engine back to float: each value q
+becomes X_scale * (q - X_zero_point).
+)DOC")
+    .Arg("X_scale", "The quantization step of the input.")
+    .Arg("X_zero_point", "The uint8 value that stands for 0.")
+    .Input(0, "X", "uint8 tensor.")
+    .Output(0, "Y", "Float tensor of the shape of X.");
+
+SHOULD_NOT_DO_GRADIENT(Int8Quantize);
+SHOULD_NOT_DO_GRADIENT(Int8Dequantize);
+
+} // namespace caffe2
@@ -0,0 +1,112 @@
+#ifndef CAFFE2_OPERATORS_INT8_OPS_H_
+#define CAFFE2_OPERATORS_INT8_OPS_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "caffe2/core/operator.h"
+
+namespace caffe2 {
+
+// Quantized inference with the "INT8" engine.
+//
+// Activations are uint8 tensors with an affine quantization: the value q
+// stands for scale * (q - zero_point). The scale and zero point of a tensor
+// are not stored with it, but given as arguments to the ops that read and
+// write it: "X_scale" and "X_zero_point" for the input, "Y_scale" and
+// "Y_zero_point" for the output. Weights stay float tensors in the workspace,
+// and are quantized by the op on its first run to int8 with one scale per
+// output channel and no zero point.
+//
+// Int8Quantize and Int8Dequantize convert between float and uint8 at the
+// boundaries of the quantized part of a net. See int8_calibration.h for how
+// a float net is rewritten to use them.
+struct Int8QuantizationParams {
+  float scale = 1;
+  int32_t zero_point = 0;
+};
+
+// The parameters that cover [min, max], widened to include 0, so that the
+// zero padding of convolutions and the output of Relu are exact.
+inline Int8QuantizationParams ChooseInt8QuantizationParams(
+    float min,
+    float max) {
+  min = std::min(min, 0.f);
+  max = std::max(max, 0.f);
+  Int8QuantizationParams params;
+  params.scale = max > min ? (max - min) / 255 : 1;
+  params.zero_point = static_cast<int32_t>(std::max(
+      0.f, std::min(255.f, std::nearbyint(-min / params.scale))));
+  return params;
+}
+
+inline uint8_t Int8Clamp(int32_t value) {
+  return static_cast<uint8_t>(std::max(0, std::min(255, value)));
+}
+
+inline uint8_t Int8QuantizeValue(
+    float value,
+    const Int8QuantizationParams& params) {
+  return Int8Clamp(
+      static_cast<int32_t>(std::nearbyint(value / params.scale)) +
+      params.zero_point);
+}
+
+inline float Int8DequantizeValue(
+    uint8_t value,
+    const Int8QuantizationParams& params) {
+  return params.scale * (static_cast<int32_t>(value) - params.zero_point);
+}
+
+// Reads the "<prefix>_scale" and "<prefix>_zero_point" arguments of an op.
+inline Int8QuantizationParams GetInt8QuantizationParams(
+    const OperatorBase& op,
+    const string& prefix) {
+  Int8QuantizationParams params;
+  params.scale = op.GetSingleArgument<float>(prefix + "_scale", 1);
+  params.zero_point = op.GetSingleArgument<int>(prefix + "_zero_point", 0);
+  CAFFE_ENFORCE_GT(params.scale, 0, prefix, "_scale must be positive.");
+  CAFFE_ENFORCE(
+      params.zero_point >= 0 && params.zero_point <= 255,
+      prefix,
+      "_zero_point must be in [0, 255].");
+  return params;
+}
+
+// A float weight of N output channels of K values each, quantized once to
+// int8 with a symmetric scale per channel: W[n][k] is scales[n] * q[n][k].
+// Like the PREPACKED FC engine, the ops assume that the weight is not changed
+// in place, and only quantize it again when it is resized or reallocated.
+struct Int8PackedWeight {
+  const float* source = nullptr;
+  int N = 0;
+  int K = 0;
+  vector<int8_t> data;
+  vector<float> scales;
+  // sums[n] is the sum of q[n][k] over k, which corrects for the zero point
+  // of the input.
+  vector<int32_t> sums;
+
+  bool Matches(const TensorCPU& W, int N_, int K_) const {
+    return source == W.data<float>() && N == N_ && K == K_;
+  }
+
+  void Pack(const TensorCPU& W, int N_, int K_);
+};
+
+// C[m][n] = sum_k A[m][k] * B[n][k], with the sums in int32. A is M x K with
+// rows lda apart, B is N x K, and C is M x N. Exact as long as K is under
+// 2^31 / (255 * 128), about 65000.
+void Int8Gemm(
+    int M,
+    int N,
+    int K,
+    const uint8_t* A,
+    int lda,
+    const int8_t* B,
+    int32_t* C);
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_INT8_OPS_H_
@@ -0,0 +1,269 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/int8_ops.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    float min,
+    float max,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(min, max);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+void AddArg(OperatorDef* def, const string& name, float value) {
+  auto* arg = def->add_arg();
+  arg->set_name(name);
+  arg->set_f(value);
+}
+
+void AddArg(OperatorDef* def, const string& name, int value) {
+  auto* arg = def->add_arg();
+  arg->set_name(name);
+  arg->set_i(value);
+}
+
+void AddArg(OperatorDef* def, const string& name, const string& value) {
+  auto* arg = def->add_arg();
+  arg->set_name(name);
+  arg->set_s(value);
+}
+
+void AddParams(
+    OperatorDef* def,
+    const string& prefix,
+    const Int8QuantizationParams& params) {
+  AddArg(def, prefix + "_scale", params.scale);
+  AddArg(def, prefix + "_zero_point", static_cast<int>(params.zero_point));
+}
+
+OperatorDef OpDef(
+    const string& type,
+    const vector<string>& inputs,
+    const string& output) {
+  OperatorDef def;
+  def.set_type(type);
+  for (const auto& input : inputs) {
+    def.add_input(input);
+  }
+  def.add_output(output);
+  return def;
+}
+
+OperatorDef QuantizeDef(
+    const string& input,
+    const string& output,
+    const Int8QuantizationParams& params) {
+  auto def = OpDef("Int8Quantize", {input}, output);
+  AddParams(&def, "Y", params);
+  return def;
+}
+
+OperatorDef DequantizeDef(
+    const string& input,
+    const string& output,
+    const Int8QuantizationParams& params) {
+  auto def = OpDef("Int8Dequantize", {input}, output);
+  AddParams(&def, "X", params);
+  return def;
+}
+
+Int8QuantizationParams ParamsOf(const TensorCPU& tensor) {
+  const float* data = tensor.data<float>();
+  const auto range = std::minmax_element(data, data + tensor.size());
+  return ChooseInt8QuantizationParams(*range.first, *range.second);
+}
+
+void ExpectNear(
+    const TensorCPU& expected,
+    const TensorCPU& actual,
+    float tolerance) {
+  ASSERT_EQ(expected.dims(), actual.dims());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected.data<float>()[i], actual.data<float>()[i], tolerance);
+  }
+}
+
+// Runs `def` with the float engine and with the INT8 engine on X, and
+// compares the dequantized output to the float one, within a number of
+// quantization steps of the output.
+void ExpectMatchesFloat(
+    Workspace* ws,
+    OperatorDef def,
+    bool same_params,
+    float tolerance_in_steps) {
+  // The float op runs on the values that the quantized X stands for, so that
+  // only the error of the op itself is measured.
+  const auto x_params = ParamsOf(ws->GetBlob("X")->Get<TensorCPU>());
+  EXPECT_TRUE(ws->RunOperatorOnce(QuantizeDef("X", "X_int8", x_params)));
+  EXPECT_TRUE(ws->RunOperatorOnce(DequantizeDef("X_int8", "X", x_params)));
+  def.set_output(0, "expected");
+  EXPECT_TRUE(ws->RunOperatorOnce(def));
+  const auto y_params = same_params
+      ? x_params
+      : ParamsOf(ws->GetBlob("expected")->Get<TensorCPU>());
+
+  def.set_engine("INT8");
+  def.set_input(0, "X_int8");
+  def.set_output(0, "Y_int8");
+  AddParams(&def, "X", x_params);
+  AddParams(&def, "Y", y_params);
+  EXPECT_TRUE(ws->RunOperatorOnce(def));
+  EXPECT_TRUE(ws->RunOperatorOnce(DequantizeDef("Y_int8", "actual", y_params)));
+  ExpectNear(
+      ws->GetBlob("expected")->Get<TensorCPU>(),
+      ws->GetBlob("actual")->Get<TensorCPU>(),
+      tolerance_in_steps * y_params.scale);
+}
+
+} // namespace
+
+TEST(Int8Test, QuantizeDequantize) {
+  std::mt19937 gen(0);
+  Workspace ws;
+  AddRandomTensor(&ws, "X", {1000}, -3, 5, &gen);
+  const auto params = ChooseInt8QuantizationParams(-3, 5);
+  EXPECT_NEAR(params.scale, 8.f / 255, 1e-6);
+  EXPECT_EQ(params.zero_point, 96);
+  ASSERT_TRUE(ws.RunOperatorOnce(QuantizeDef("X", "X_int8", params)));
+  ASSERT_TRUE(ws.RunOperatorOnce(DequantizeDef("X_int8", "Y", params)));
+  ExpectNear(
+      ws.GetBlob("X")->Get<TensorCPU>(),
+      ws.GetBlob("Y")->Get<TensorCPU>(),
+      params.scale / 2 + 1e-6);
+  // 0 is exact, and values out of the range are clamped.
+  EXPECT_EQ(Int8QuantizeValue(0, params), 96);
+  EXPECT_EQ(Int8QuantizeValue(-10, params), 0);
+  EXPECT_EQ(Int8QuantizeValue(10, params), 255);
+}
+
+TEST(Int8Test, GemmIsExact) {
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int> u8(0, 255);
+  std::uniform_int_distribution<int> s8(-127, 127);
+  // Partial column blocks, and depths with and without a remainder.
+  for (int M : {1, 5}) {
+    for (int N : {3, 9}) {
+      for (int K : {7, 16, 45, 300}) {
+        vector<uint8_t> A(M * K);
+        vector<int8_t> B(N * K);
+        for (auto& a : A) {
+          a = u8(gen);
+        }
+        for (auto& b : B) {
+          b = s8(gen);
+        }
+        // The extremes, to catch saturation.
+        A[0] = 255;
+        B[0] = B[1] = 127;
+        A[1] = 255;
+        vector<int32_t> C(M * N);
+        Int8Gemm(M, N, K, A.data(), K, B.data(), C.data());
+        for (int m = 0; m < M; ++m) {
+          for (int n = 0; n < N; ++n) {
+            int32_t expected = 0;
+            for (int k = 0; k < K; ++k) {
+              expected += A[m * K + k] * B[n * K + k];
+            }
+            EXPECT_EQ(expected, C[m * N + n]) << M << " " << N << " " << K;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(Int8Test, FC) {
+  std::mt19937 gen(0);
+  for (int M : {1, 6}) {
+    for (int K : {10, 300}) {
+      Workspace ws;
+      AddRandomTensor(&ws, "X", {M, K}, -1, 2, &gen);
+      AddRandomTensor(&ws, "W", {7, K}, -1, 1, &gen);
+      AddRandomTensor(&ws, "b", {7}, -1, 1, &gen);
+      ExpectMatchesFloat(&ws, OpDef("FC", {"X", "W", "b"}, ""), false, 2);
+    }
+  }
+}
+
+TEST(Int8Test, Conv) {
+  std::mt19937 gen(0);
+  struct Case {
+    int kernel;
+    int stride;
+    int pad;
+    int dilation;
+  };
+  for (const string order : {"NCHW", "NHWC"}) {
+    for (const auto& c : vector<Case>{
+             {3, 1, 1, 1}, {3, 2, 0, 1}, {3, 1, 2, 2}, {1, 1, 0, 1}}) {
+      for (bool bias : {false, true}) {
+        Workspace ws;
+        const bool nchw = order == "NCHW";
+        AddRandomTensor(
+            &ws,
+            "X",
+            nchw ? vector<TIndex>{2, 5, 7, 6} : vector<TIndex>{2, 7, 6, 5},
+            -1,
+            1,
+            &gen);
+        AddRandomTensor(
+            &ws,
+            "W",
+            nchw ? vector<TIndex>{6, 5, c.kernel, c.kernel}
+                 : vector<TIndex>{6, c.kernel, c.kernel, 5},
+            -1,
+            1,
+            &gen);
+        AddRandomTensor(&ws, "b", {6}, -1, 1, &gen);
+        auto def = OpDef(
+            "Conv",
+            bias ? vector<string>{"X", "W", "b"} : vector<string>{"X", "W"},
+            "");
+        AddArg(&def, "kernel", c.kernel);
+        AddArg(&def, "stride", c.stride);
+        AddArg(&def, "pad", c.pad);
+        AddArg(&def, "dilation", c.dilation);
+        AddArg(&def, "order", order);
+        ExpectMatchesFloat(&ws, def, false, 2);
+      }
+    }
+  }
+}
+
+TEST(Int8Test, ReluAndPooling) {
+  std::mt19937 gen(0);
+  for (const string order : {"NCHW", "NHWC"}) {
+    Workspace ws;
+    AddRandomTensor(&ws, "X", {2, 3, 7, 7}, -1, 3, &gen);
+    // The quantized values stay on the grid of the input, so Relu and
+    // MaxPool are exact, and AveragePool is off by a rounding.
+    ExpectMatchesFloat(&ws, OpDef("Relu", {"X"}, ""), true, 1e-3);
+    for (const string type : {"MaxPool", "AveragePool"}) {
+      auto def = OpDef(type, {"X"}, "");
+      AddArg(&def, "kernel", 3);
+      AddArg(&def, "stride", 2);
+      AddArg(&def, "pad", 1);
+      AddArg(&def, "order", order);
+      ExpectMatchesFloat(&ws, def, true, 1.01);
+      auto global = OpDef(type, {"X"}, "");
+      AddArg(&global, "global_pooling", 1);
+      AddArg(&global, "order", order);
+      ExpectMatchesFloat(&ws, global, true, 1.01);
+    }
+  }
+}
+
+} // namespace caffe2
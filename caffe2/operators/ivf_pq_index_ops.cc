@@ -0,0 +1,517 @@
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor.h"
+#include "caffe2/operators/top_k_op.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Below that many values to compute, threads cost more than they save.
+constexpr TIndex kMinParallelWork = 1 << 16;
+
+float SquaredDistance(const float* x, const float* y, int d) {
+  float distance = 0;
+  for (int j = 0; j < d; ++j) {
+    const float diff = x[j] - y[j];
+    distance += diff * diff;
+  }
+  return distance;
+}
+
+// The index of the nearest of the k centroids of width d to x.
+int NearestCentroid(const float* x, const float* centroids, int k, int d) {
+  int best = 0;
+  float bestDistance = std::numeric_limits<float>::max();
+  for (int c = 0; c < k; ++c) {
+    const float distance = SquaredDistance(x, centroids + c * d, d);
+    if (distance < bestDistance) {
+      best = c;
+      bestDistance = distance;
+    }
+  }
+  return best;
+}
+
+// Lloyd's k-means of the n points of width d of x, which are stride apart,
+// starting from k distinct points picked at random. A centroid that loses all
+// its points keeps its position.
+void KMeans(
+    const float* x,
+    TIndex n,
+    int d,
+    TIndex stride,
+    int k,
+    int iterations,
+    std::mt19937* gen,
+    float* centroids) {
+  CAFFE_ENFORCE_GE(n, k, "Fewer training points than centroids.");
+  std::vector<TIndex> points(n);
+  for (TIndex i = 0; i < n; ++i) {
+    points[i] = i;
+  }
+  for (int c = 0; c < k; ++c) {
+    std::uniform_int_distribution<TIndex> pick(c, n - 1);
+    std::swap(points[c], points[pick(*gen)]);
+    std::copy(x + points[c] * stride, x + points[c] * stride + d,
+              centroids + c * d);
+  }
+  std::vector<int> assignment(n);
+  std::vector<float> sums(k * d);
+  std::vector<TIndex> counts(k);
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (n * k * d >= kMinParallelWork)
+#endif
+    for (TIndex i = 0; i < n; ++i) {
+      assignment[i] = NearestCentroid(x + i * stride, centroids, k, d);
+    }
+    std::fill(sums.begin(), sums.end(), 0);
+    std::fill(counts.begin(), counts.end(), 0);
+    for (TIndex i = 0; i < n; ++i) {
+      const float* point = x + i * stride;
+      float* sum = sums.data() + assignment[i] * d;
+      for (int j = 0; j < d; ++j) {
+        sum[j] += point[j];
+      }
+      ++counts[assignment[i]];
+    }
+    for (int c = 0; c < k; ++c) {
+      if (counts[c] > 0) {
+        for (int j = 0; j < d; ++j) {
+          centroids[c * d + j] = sums[c * d + j] / counts[c];
+        }
+      }
+    }
+  }
+}
+
+} // namespace
+
+/**
+ * IVFPQIndex is an approximate nearest neighbor index for the L2 distance, an
+ * inverted file of product-quantized vectors. Train clusters the vectors with
+ * k-means into numLists lists, then splits the residuals of the vectors to
+ * their list centroid into numSubquantizers subvectors and clusters each part
+ * into numCodes codewords. Add appends each vector to the list of its nearest
+ * centroid, stored as one byte per subvector: the nearest codeword of its
+ * residual.
+ *
+ * Search only scans the nprobe lists nearest to the query. For each of them,
+ * the distances of every part of the residual of the query to the codewords
+ * are computed once, so the distance to a vector of the list is a sum of
+ * numSubquantizers table lookups. The k nearest are kept in a TopKHeap.
+ *
+ * Add and Search must not run concurrently.
+ */
+class IVFPQIndex {
+ public:
+  IVFPQIndex(int dim, int numLists, int numSubquantizers, int numCodes)
+      : dim_(dim),
+        numLists_(numLists),
+        numSubquantizers_(numSubquantizers),
+        numCodes_(numCodes),
+        subDim_(dim / numSubquantizers),
+        lists_(numLists) {
+    CAFFE_ENFORCE_GT(dim, 0);
+    CAFFE_ENFORCE_GT(numLists, 0);
+    CAFFE_ENFORCE_GT(numSubquantizers, 0);
+    CAFFE_ENFORCE_EQ(
+        dim % numSubquantizers,
+        0,
+        "The dimension must be a multiple of the number of subquantizers.");
+    CAFFE_ENFORCE(
+        numCodes > 0 && numCodes <= 256, "Codes must fit in a byte.");
+  }
+
+  int dim() const {
+    return dim_;
+  }
+
+  bool isTrained() const {
+    return !centroids_.empty();
+  }
+
+  TIndex Size() const {
+    TIndex size = 0;
+    for (const auto& list : lists_) {
+      size += list.ids.size();
+    }
+    return size;
+  }
+
+  void Train(const float* x, TIndex n, int iterations, std::mt19937* gen) {
+    centroids_.resize(numLists_ * dim_);
+    KMeans(x, n, dim_, dim_, numLists_, iterations, gen, centroids_.data());
+    std::vector<float> residuals(n * dim_);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if ( \
+    n * numLists_ * dim_ >= kMinParallelWork)
+#endif
+    for (TIndex i = 0; i < n; ++i) {
+      const float* point = x + i * dim_;
+      Residual(point, Nearest(point), residuals.data() + i * dim_);
+    }
+    codebooks_.resize(numSubquantizers_ * numCodes_ * subDim_);
+    for (int m = 0; m < numSubquantizers_; ++m) {
+      KMeans(
+          residuals.data() + m * subDim_,
+          n,
+          subDim_,
+          dim_,
+          numCodes_,
+          iterations,
+          gen,
+          Codebook(m));
+    }
+    for (auto& list : lists_) {
+      list.ids.clear();
+      list.codes.clear();
+    }
+  }
+
+  void Add(const float* x, const TIndex* ids, TIndex n) {
+    CAFFE_ENFORCE(isTrained(), "The index must be trained first.");
+    std::vector<int> assignment(n);
+    std::vector<uint8_t> codes(n * numSubquantizers_);
+#ifdef _OPENMP
+#pragma omp parallel if (n * numLists_ * dim_ >= kMinParallelWork)
+#endif
+    {
+      std::vector<float> residual(dim_);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+      for (TIndex i = 0; i < n; ++i) {
+        assignment[i] = Nearest(x + i * dim_);
+        Residual(x + i * dim_, assignment[i], residual.data());
+        for (int m = 0; m < numSubquantizers_; ++m) {
+          codes[i * numSubquantizers_ + m] = NearestCentroid(
+              residual.data() + m * subDim_, Codebook(m), numCodes_, subDim_);
+        }
+      }
+    }
+    for (TIndex i = 0; i < n; ++i) {
+      auto& list = lists_[assignment[i]];
+      list.ids.push_back(ids ? ids[i] : nextId_ + i);
+      list.codes.insert(
+          list.codes.end(),
+          codes.begin() + i * numSubquantizers_,
+          codes.begin() + (i + 1) * numSubquantizers_);
+    }
+    nextId_ += n;
+  }
+
+  // The k nearest vectors to each of the n queries, the nearest first, as
+  // squared distances and ids. Missing neighbors have an infinite distance
+  // and an id of -1.
+  void Search(
+      const float* queries,
+      TIndex n,
+      int k,
+      int nprobe,
+      float* distances,
+      TIndex* ids) const {
+    CAFFE_ENFORCE(isTrained(), "The index must be trained first.");
+    nprobe = std::min(nprobe, numLists_);
+#ifdef _OPENMP
+#pragma omp parallel if (n > 1)
+#endif
+    {
+      TopKHeap<float> heap(k);
+      std::vector<std::pair<float, int>> probes(numLists_);
+      std::vector<float> residual(dim_);
+      std::vector<float> table(numSubquantizers_ * numCodes_);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (TIndex q = 0; q < n; ++q) {
+        const float* query = queries + q * dim_;
+        for (int c = 0; c < numLists_; ++c) {
+          probes[c] = std::make_pair(
+              SquaredDistance(query, centroids_.data() + c * dim_, dim_), c);
+        }
+        std::partial_sort(
+            probes.begin(), probes.begin() + nprobe, probes.end());
+        for (int p = 0; p < nprobe; ++p) {
+          const List& list = lists_[probes[p].second];
+          if (list.ids.empty()) {
+            continue;
+          }
+          Residual(query, probes[p].second, residual.data());
+          for (int m = 0; m < numSubquantizers_; ++m) {
+            const float* codebook = Codebook(m);
+            for (int code = 0; code < numCodes_; ++code) {
+              table[m * numCodes_ + code] = SquaredDistance(
+                  residual.data() + m * subDim_,
+                  codebook + code * subDim_,
+                  subDim_);
+            }
+          }
+          const uint8_t* codes = list.codes.data();
+          for (size_t i = 0; i < list.ids.size(); ++i) {
+            float distance = 0;
+            for (int m = 0; m < numSubquantizers_; ++m) {
+              distance += table[m * numCodes_ + codes[m]];
+            }
+            codes += numSubquantizers_;
+            // The heap keeps the largest values.
+            heap.Push(-distance, list.ids[i]);
+          }
+        }
+        float* queryDistances = distances + q * k;
+        heap.Extract(queryDistances, ids + q * k);
+        for (int i = 0; i < k; ++i) {
+          queryDistances[i] = ids[q * k + i] >= 0
+              ? -queryDistances[i]
+              : std::numeric_limits<float>::infinity();
+        }
+      }
+    }
+  }
+
+ private:
+  struct List {
+    std::vector<TIndex> ids;
+    // numSubquantizers_ codes for each id.
+    std::vector<uint8_t> codes;
+  };
+
+  int Nearest(const float* x) const {
+    return NearestCentroid(x, centroids_.data(), numLists_, dim_);
+  }
+
+  void Residual(const float* x, int list, float* residual) const {
+    const float* centroid = centroids_.data() + list * dim_;
+    for (int j = 0; j < dim_; ++j) {
+      residual[j] = x[j] - centroid[j];
+    }
+  }
+
+  float* Codebook(int m) {
+    return codebooks_.data() + m * numCodes_ * subDim_;
+  }
+  const float* Codebook(int m) const {
+    return codebooks_.data() + m * numCodes_ * subDim_;
+  }
+
+  const int dim_;
+  const int numLists_;
+  const int numSubquantizers_;
+  const int numCodes_;
+  const int subDim_;
+  // numLists_ x dim_
+  std::vector<float> centroids_;
+  // numSubquantizers_ x numCodes_ x subDim_
+  std::vector<float> codebooks_;
+  std::vector<List> lists_;
+  TIndex nextId_{0};
+};
+
+namespace {
+
+using IVFPQIndexPtr = std::unique_ptr<IVFPQIndex>;
+
+class IVFPQIndexCreateOp : public Operator<CPUContext> {
+ public:
+  IVFPQIndexCreateOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator(operator_def, ws),
+        dim_(OperatorBase::GetSingleArgument<int>("dim", 0)),
+        numLists_(OperatorBase::GetSingleArgument<int>("num_lists", 1)),
+        numSubquantizers_(
+            OperatorBase::GetSingleArgument<int>("num_subquantizers", 1)),
+        numCodes_(OperatorBase::GetSingleArgument<int>("num_codes", 256)) {}
+
+  bool RunOnDevice() override {
+    *OperatorBase::Output<IVFPQIndexPtr>(0) = IVFPQIndexPtr(
+        new IVFPQIndex(dim_, numLists_, numSubquantizers_, numCodes_));
+    return true;
+  }
+
+ private:
+  int dim_;
+  int numLists_;
+  int numSubquantizers_;
+  int numCodes_;
+};
+
+// The data of a matrix of vectors of the width of the index.
+const float* Vectors(const TensorCPU& X, const IVFPQIndex& index) {
+  CAFFE_ENFORCE_EQ(X.ndim(), 2, "Vectors must be a matrix.");
+  CAFFE_ENFORCE_EQ(X.dim32(1), index.dim(), "Vectors have the wrong width.");
+  return X.data<float>();
+}
+
+class IVFPQIndexTrainOp : public Operator<CPUContext> {
+ public:
+  IVFPQIndexTrainOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator(operator_def, ws),
+        iterations_(
+            OperatorBase::GetSingleArgument<int>("kmeans_iterations", 10)) {}
+
+  bool RunOnDevice() override {
+    auto& index = OperatorBase::Input<IVFPQIndexPtr>(0);
+    const auto& X = Input(1);
+    index->Train(
+        Vectors(X, *index), X.dim(0), iterations_, &context_.RandGenerator());
+    return true;
+  }
+
+ private:
+  int iterations_;
+};
+
+class IVFPQIndexAddOp : public Operator<CPUContext> {
+ public:
+  IVFPQIndexAddOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    auto& index = OperatorBase::Input<IVFPQIndexPtr>(0);
+    const auto& X = Input(1);
+    const TIndex* ids = nullptr;
+    if (InputSize() > 2) {
+      CAFFE_ENFORCE_EQ(Input(2).size(), X.dim(0), "One id per vector.");
+      ids = Input(2).data<TIndex>();
+    }
+    index->Add(Vectors(X, *index), ids, X.dim(0));
+    return true;
+  }
+};
+
+class IVFPQIndexSearchOp : public Operator<CPUContext> {
+ public:
+  IVFPQIndexSearchOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator(operator_def, ws),
+        k_(OperatorBase::GetSingleArgument<int>("k", 1)),
+        nprobe_(OperatorBase::GetSingleArgument<int>("nprobe", 1)) {
+    CAFFE_ENFORCE_GT(k_, 0);
+    CAFFE_ENFORCE_GT(nprobe_, 0);
+  }
+
+  bool RunOnDevice() override {
+    const auto& index = OperatorBase::Input<IVFPQIndexPtr>(0);
+    const auto& Q = Input(1);
+    auto* distances = Output(0);
+    auto* ids = Output(1);
+    const float* queries = Vectors(Q, *index);
+    distances->Resize(Q.dim(0), k_);
+    ids->Resize(Q.dim(0), k_);
+    index->Search(
+        queries,
+        Q.dim(0),
+        k_,
+        nprobe_,
+        distances->mutable_data<float>(),
+        ids->mutable_data<TIndex>());
+    return true;
+  }
+
+ private:
+  int k_;
+  int nprobe_;
+};
+
+class IVFPQIndexSizeOp : public Operator<CPUContext> {
+ public:
+  IVFPQIndexSizeOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    const auto& index = OperatorBase::Input<IVFPQIndexPtr>(0);
+    auto* out = Output(0);
+    out->Resize(std::vector<TIndex>{});
+    *out->mutable_data<TIndex>() = index->Size();
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(IVFPQIndexCreate, IVFPQIndexCreateOp);
+REGISTER_CPU_OPERATOR(IVFPQIndexTrain, IVFPQIndexTrainOp);
+REGISTER_CPU_OPERATOR(IVFPQIndexAdd, IVFPQIndexAddOp);
+REGISTER_CPU_OPERATOR(IVFPQIndexSearch, IVFPQIndexSearchOp);
+REGISTER_CPU_OPERATOR(IVFPQIndexSize, IVFPQIndexSizeOp);
+
+OPERATOR_SCHEMA(IVFPQIndexCreate)
+    .NumInputs(0)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Creates an approximate nearest neighbor index for the L2 distance: an inverted
+file of num_lists lists, whose vectors are stored as num_subquantizers bytes of
+product quantization codes. The index must be trained with IVFPQIndexTrain
+before vectors are added with IVFPQIndexAdd and searched with IVFPQIndexSearch.
+)DOC")
+    .Arg("dim", "Width of the vectors.")
+    .Arg("num_lists", "Number of lists of the inverted file (default 1).")
+    .Arg(
+        "num_subquantizers",
+        "Number of parts the vectors are split in, a divisor of dim "
+        "(default 1).")
+    .Arg("num_codes", "Number of codewords of each part, at most 256.")
+    .Output(0, "handle", "Pointer to an IVFPQIndex instance.");
+
+OPERATOR_SCHEMA(IVFPQIndexTrain)
+    .NumInputs(2)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Learns the list centroids and the codebooks of the index with k-means on the
+given vectors, which must be at least as many as the lists and the codewords.
+Empties the index.
+)DOC")
+    .Arg("kmeans_iterations", "Number of k-means iterations (default 10).")
+    .Input(0, "handle", "Pointer to an IVFPQIndex instance.")
+    .Input(1, "vectors", "Training vectors of shape (n, dim).")
+    .Output(0, "handle", "The input handle.")
+    .EnforceInplace({{0, 0}});
+
+OPERATOR_SCHEMA(IVFPQIndexAdd)
+    .NumInputs(2, 3)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Adds vectors to the index. Their ids are given as int64, or are the number of
+vectors added before them.
+)DOC")
+    .Input(0, "handle", "Pointer to an IVFPQIndex instance.")
+    .Input(1, "vectors", "Vectors of shape (n, dim).")
+    .Input(2, "ids", "Optional int64 ids of shape (n).")
+    .Output(0, "handle", "The input handle.")
+    .EnforceInplace({{0, 0}});
+
+OPERATOR_SCHEMA(IVFPQIndexSearch)
+    .NumInputs(2)
+    .NumOutputs(2)
+    .SetDoc(R"DOC(
+Retrieves the approximate k nearest vectors of the index to each query, the
+nearest first, by scanning the nprobe lists nearest to the query. When fewer
+than k vectors are scanned, the remaining ids are -1.
+)DOC")
+    .Arg("k", "Number of neighbors to retrieve (default 1).")
+    .Arg("nprobe", "Number of lists to scan for each query (default 1).")
+    .Input(0, "handle", "Pointer to an IVFPQIndex instance.")
+    .Input(1, "queries", "Queries of shape (n, dim).")
+    .Output(0, "distances", "Squared L2 distances of shape (n, k).")
+    .Output(1, "ids", "Int64 ids of shape (n, k).");
+
+OPERATOR_SCHEMA(IVFPQIndexSize)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .SetDoc("Returns the number of vectors in the index.")
+    .Input(0, "handle", "Pointer to an IVFPQIndex instance.")
+    .Output(0, "size", "Scalar int64 tensor.");
+
+NO_GRADIENT(IVFPQIndexCreate);
+SHOULD_NOT_DO_GRADIENT(IVFPQIndexTrain);
+SHOULD_NOT_DO_GRADIENT(IVFPQIndexAdd);
+SHOULD_NOT_DO_GRADIENT(IVFPQIndexSearch);
+SHOULD_NOT_DO_GRADIENT(IVFPQIndexSize);
+
+} // namespace
+
+CAFFE_KNOWN_TYPE(std::unique_ptr<caffe2::IVFPQIndex>);
+
+} // namespace caffe2
@@ -0,0 +1,123 @@
+#include <limits>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+const int kDim = 16;
+const int kNumVectors = 2000;
+
+OperatorDef Def(
+    const string& type,
+    const vector<string>& inputs,
+    const vector<string>& outputs) {
+  OperatorDef def;
+  def.set_type(type);
+  for (const auto& input : inputs) {
+    def.add_input(input);
+  }
+  for (const auto& output : outputs) {
+    def.add_output(output);
+  }
+  return def;
+}
+
+// Vectors around a few random centers, as embeddings tend to be.
+void AddVectors(Workspace* ws, const string& name, int n, std::mt19937* gen) {
+  std::normal_distribution<float> value(0, 1);
+  vector<float> centers(8 * kDim);
+  for (auto& x : centers) {
+    x = 4 * value(*gen);
+  }
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(n, kDim);
+  float* data = tensor->mutable_data<float>();
+  for (int i = 0; i < n; ++i) {
+    const float* center = centers.data() + (*gen)() % 8 * kDim;
+    for (int j = 0; j < kDim; ++j) {
+      data[i * kDim + j] = center[j] + value(*gen);
+    }
+  }
+}
+
+class IVFPQIndexTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    std::mt19937 gen(0);
+    AddVectors(&ws_, "vectors", kNumVectors, &gen);
+    auto create = Def("IVFPQIndexCreate", {}, {"index"});
+    AddArgument<int>("dim", kDim, &create);
+    AddArgument<int>("num_lists", 8, &create);
+    AddArgument<int>("num_subquantizers", 8, &create);
+    ASSERT_TRUE(ws_.RunOperatorOnce(create));
+    ASSERT_TRUE(ws_.RunOperatorOnce(
+        Def("IVFPQIndexTrain", {"index", "vectors"}, {"index"})));
+    ASSERT_TRUE(ws_.RunOperatorOnce(
+        Def("IVFPQIndexAdd", {"index", "vectors"}, {"index"})));
+  }
+
+  void Search(const string& queries, int k, int nprobe) {
+    auto search =
+        Def("IVFPQIndexSearch", {"index", queries}, {"distances", "ids"});
+    AddArgument<int>("k", k, &search);
+    AddArgument<int>("nprobe", nprobe, &search);
+    ASSERT_TRUE(ws_.RunOperatorOnce(search));
+  }
+
+  Workspace ws_;
+};
+
+} // namespace
+
+TEST_F(IVFPQIndexTest, FindsTheIndexedVectors) {
+  ASSERT_TRUE(
+      ws_.RunOperatorOnce(Def("IVFPQIndexSize", {"index"}, {"size"})));
+  EXPECT_EQ(
+      ws_.GetBlob("size")->Get<TensorCPU>().data<TIndex>()[0], kNumVectors);
+
+  const int k = 5;
+  Search("vectors", k, 8);
+  const auto& distances = ws_.GetBlob("distances")->Get<TensorCPU>();
+  const auto& ids = ws_.GetBlob("ids")->Get<TensorCPU>();
+  ASSERT_EQ(ids.dims(), vector<TIndex>({kNumVectors, k}));
+  int found = 0;
+  for (int i = 0; i < kNumVectors; ++i) {
+    bool self = false;
+    for (int j = 0; j < k; ++j) {
+      const TIndex id = ids.data<TIndex>()[i * k + j];
+      EXPECT_TRUE(0 <= id && id < kNumVectors);
+      self |= id == i;
+      if (j > 0) {
+        EXPECT_LE(
+            distances.data<float>()[i * k + j - 1],
+            distances.data<float>()[i * k + j]);
+      }
+    }
+    found += self;
+  }
+  // Quantization loses some of the vectors, but not many.
+  EXPECT_GT(found, 0.9 * kNumVectors);
+}
+
+TEST_F(IVFPQIndexTest, PadsMissingNeighbors) {
+  // Scanning a single list can't find all the vectors.
+  const int k = kNumVectors;
+  std::mt19937 gen(1);
+  AddVectors(&ws_, "queries", 3, &gen);
+  Search("queries", k, 1);
+  const auto& distances = ws_.GetBlob("distances")->Get<TensorCPU>();
+  const auto& ids = ws_.GetBlob("ids")->Get<TensorCPU>();
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_GE(ids.data<TIndex>()[i * k], 0);
+    EXPECT_EQ(ids.data<TIndex>()[i * k + k - 1], -1);
+    EXPECT_EQ(
+        distances.data<float>()[i * k + k - 1],
+        std::numeric_limits<float>::infinity());
+  }
+}
+
+} // namespace caffe2
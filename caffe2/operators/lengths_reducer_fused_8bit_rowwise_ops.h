@@ -0,0 +1,95 @@
+#ifndef CAFFE2_OPERATORS_LENGTHS_REDUCER_FUSED_8BIT_ROWWISE_OPS_H_
+#define CAFFE2_OPERATORS_LENGTHS_REDUCER_FUSED_8BIT_ROWWISE_OPS_H_
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/embedding_lookup.h"
+
+namespace caffe2 {
+
+// SparseLengths{Sum,WeightedSum,Mean} over a table quantized by
+// FloatToFused8BitRowwiseQuantized: the rows are dequantized while they are
+// added, so the table never exists in floats.
+template <bool with_weights, bool is_mean>
+class SparseLengthsFused8BitRowwiseOp final : public Operator<CPUContext> {
+ public:
+  static_assert(
+      !(with_weights && is_mean),
+      "Weighted mean reduction is not supported");
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  using Operator<CPUContext>::Operator;
+
+  bool RunOnDevice() override {
+    auto& data = Input(DATA);
+    auto& indices = Input(INDICES);
+    auto& lengths = Input(LENGTHS);
+    auto* output = Output(0);
+
+    CAFFE_ENFORCE_EQ(2, data.ndim(), "DATA must be a matrix");
+    CAFFE_ENFORCE_EQ(1, indices.ndim(), "INDICES must be a vector");
+    CAFFE_ENFORCE_EQ(1, lengths.ndim(), "LENGTHS must be a vector");
+    CAFFE_ENFORCE_GT(
+        data.dim(1),
+        2 * sizeof(float),
+        "DATA rows must end with their scale and bias");
+    const TIndex dataSize = data.dim(0);
+    const TIndex blockSize = data.dim(1) - 2 * sizeof(float);
+    const TIndex indexSize = indices.size();
+    const TIndex outputSize = lengths.size();
+
+    const float* weights = nullptr;
+    if (with_weights) { // static if
+      auto& weightsInput = Input(WEIGHTS);
+      CAFFE_ENFORCE_EQ(1, weightsInput.ndim(), "WEIGHTS must be a vector");
+      CAFFE_ENFORCE_EQ(
+          indexSize,
+          weightsInput.size(),
+          "WEIGHTS must have the same length as INDICES");
+      weights = weightsInput.template data<float>();
+    }
+
+    const TIndex* idxs = indices.template data<TIndex>();
+    const int* lens = lengths.template data<int>();
+    TIndex totalLength = 0;
+    for (TIndex i = 0; i < outputSize; ++i) {
+      totalLength += lens[i];
+    }
+    CAFFE_ENFORCE_EQ(
+        totalLength, indexSize, "LENGTHS must add up to the size of INDICES");
+    for (TIndex i = 0; i < indexSize; ++i) {
+      CAFFE_ENFORCE(
+          0 <= idxs[i] && idxs[i] < dataSize,
+          "Index ",
+          i,
+          " is out of bounds: ",
+          idxs[i],
+          ", range 0 to ",
+          dataSize);
+    }
+
+    output->Resize(outputSize, blockSize);
+    Fused8BitRowwiseEmbeddingLookup(
+        blockSize,
+        outputSize,
+        indexSize,
+        data.template data<uint8_t>(),
+        idxs,
+        lens,
+        weights,
+        is_mean ? 1.f : 0.f,
+        output->template mutable_data<float>());
+    return true;
+  }
+
+  enum {
+    DATA = 0,
+    WEIGHTS = 1,
+    INDICES = 1 + with_weights,
+    LENGTHS = 2 + with_weights,
+  };
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_LENGTHS_REDUCER_FUSED_8BIT_ROWWISE_OPS_H_
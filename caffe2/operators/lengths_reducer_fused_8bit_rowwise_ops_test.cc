@@ -0,0 +1,114 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+template <typename T>
+void AddTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    const vector<T>& values) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  std::copy(values.begin(), values.end(), tensor->mutable_data<T>());
+}
+
+const TensorCPU& RunOp(
+    Workspace* ws,
+    const string& type,
+    const vector<string>& inputs,
+    const string& output) {
+  OperatorDef def;
+  def.set_type(type);
+  for (const auto& input : inputs) {
+    def.add_input(input);
+  }
+  def.add_output(output);
+  CAFFE_ENFORCE(ws->RunOperatorOnce(def));
+  return ws->GetBlob(output)->Get<TensorCPU>();
+}
+
+void ExpectNear(const TensorCPU& a, const TensorCPU& b, float error) {
+  ASSERT_EQ(a.dims(), b.dims());
+  for (TIndex i = 0; i < a.size(); ++i) {
+    EXPECT_NEAR(a.data<float>()[i], b.data<float>()[i], error);
+  }
+}
+
+class Fused8BitRowwiseTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> value(-2, 2);
+    std::uniform_int_distribution<TIndex> index(0, kNumRows - 1);
+    vector<float> data;
+    for (int i = 0; i < kNumRows * kBlockSize; ++i) {
+      data.push_back(value(gen));
+    }
+    // A constant row has no range to quantize.
+    std::fill(data.begin(), data.begin() + kBlockSize, 1.5f);
+    vector<TIndex> indices;
+    vector<int> lengths;
+    vector<float> weights;
+    for (int length : {2, 0, 30, 5}) {
+      for (int i = 0; i < length; ++i) {
+        indices.push_back(index(gen));
+        weights.push_back(value(gen));
+      }
+      lengths.push_back(length);
+    }
+    indices[0] = 0;
+    AddTensor(&ws_, "data", {kNumRows, kBlockSize}, data);
+    AddTensor<TIndex>(&ws_, "indices", {(TIndex)indices.size()}, indices);
+    AddTensor(&ws_, "lengths", {(TIndex)lengths.size()}, lengths);
+    AddTensor(&ws_, "weights", {(TIndex)weights.size()}, weights);
+    RunOp(&ws_, "FloatToFused8BitRowwiseQuantized", {"data"}, "quantized");
+    RunOp(
+        &ws_,
+        "Fused8BitRowwiseQuantizedToFloat",
+        {"quantized"},
+        "dequantized");
+  }
+
+  static const int kNumRows = 20;
+  static const int kBlockSize = 11;
+  Workspace ws_;
+};
+
+} // namespace
+
+TEST_F(Fused8BitRowwiseTest, RoundTrip) {
+  const auto& quantized = ws_.GetBlob("quantized")->Get<TensorCPU>();
+  EXPECT_EQ(
+      quantized.dims(),
+      vector<TIndex>({kNumRows, kBlockSize + 2 * sizeof(float)}));
+  // Each value is within half a step, 4 / 255 / 2, of the original.
+  ExpectNear(
+      ws_.GetBlob("data")->Get<TensorCPU>(),
+      ws_.GetBlob("dequantized")->Get<TensorCPU>(),
+      0.008);
+  EXPECT_EQ(ws_.GetBlob("dequantized")->Get<TensorCPU>().data<float>()[0], 1.5);
+}
+
+TEST_F(Fused8BitRowwiseTest, ReducersMatchDequantizedTable) {
+  for (const string reducer : {"Sum", "WeightedSum", "Mean"}) {
+    vector<string> inputs{"indices", "lengths"};
+    if (reducer == "WeightedSum") {
+      inputs.insert(inputs.begin(), "weights");
+    }
+    inputs.insert(inputs.begin(), "dequantized");
+    const auto& expected =
+        RunOp(&ws_, "SparseLengths" + reducer, inputs, "expected");
+    inputs[0] = "quantized";
+    const auto& actual = RunOp(
+        &ws_, "SparseLengths" + reducer + "Fused8BitRowwise", inputs, "actual");
+    ExpectNear(expected, actual, 1e-4);
+  }
+}
+
+} // namespace caffe2
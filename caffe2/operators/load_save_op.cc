@@ -9,12 +9,71 @@ void LoadOp<CPUContext>::SetCurrentDevice(BlobProto* proto) {
   }
 }
 
+template <>
+void CheckpointOp<CPUContext>::beginSnapshot() {}
+
+template <>
+void CheckpointOp<CPUContext>::endSnapshot() {}
+
+AsyncCheckpointWriter* AsyncCheckpointWriter::Get() {
+  // Leaked on purpose, so that the thread is never joined at exit.
+  static AsyncCheckpointWriter* writer = new AsyncCheckpointWriter();
+  return writer;
+}
+
+AsyncCheckpointWriter::AsyncCheckpointWriter() : thread_([this]() { Run(); }) {}
+
+void AsyncCheckpointWriter::Schedule(std::function<void()> checkpoint) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  checkpoints_.push_back(std::move(checkpoint));
+  scheduled_.notify_one();
+}
+
+void AsyncCheckpointWriter::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this]() { return checkpoints_.empty() && !writing_; });
+  if (error_) {
+    std::exception_ptr error;
+    std::swap(error, error_);
+    std::rethrow_exception(error);
+  }
+}
+
+void AsyncCheckpointWriter::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    scheduled_.wait(lock, [this]() { return !checkpoints_.empty(); });
+    auto checkpoint = std::move(checkpoints_.front());
+    checkpoints_.pop_front();
+    writing_ = true;
+    lock.unlock();
+    try {
+      checkpoint();
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Asynchronous checkpoint failed: " << e.what();
+      lock.lock();
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+      lock.unlock();
+    }
+    // Release the snapshot before waking up the waiters.
+    checkpoint = nullptr;
+    lock.lock();
+    writing_ = false;
+    if (checkpoints_.empty()) {
+      done_.notify_all();
+    }
+  }
+}
+
 namespace {
 REGISTER_CPU_OPERATOR(Load, LoadOp<CPUContext>);
 REGISTER_CPU_OPERATOR(Save, SaveOp<CPUContext>);
 REGISTER_CPU_OPERATOR(Checkpoint, CheckpointOp<CPUContext>);
 // CPU Operator old name: do NOT use, we may deprecate this later.
 REGISTER_CPU_OPERATOR(Snapshot, CheckpointOp<CPUContext>);
+REGISTER_CPU_OPERATOR(CheckpointBarrier, CheckpointBarrierOp<CPUContext>);
 
 OPERATOR_SCHEMA(Load)
     .NumInputs(0, 1)
@@ -27,13 +86,38 @@ entries with the outputs.
 If an input is passed, then it is assumed that that input blob is a
 DBReader to load from, and we ignore the db and db_type arguments.
 
+If db_type is "mmap", the db is a raw checkpoint written by the Save operator
+with the same db_type. It is mapped into memory instead of being parsed, and
+CPU tensors are loaded without any copy: they share the memory of the mapping,
+which is private, so modifying them does not modify the checkpoint.
+
+The blobs of sharded checkpoints can be loaded from several dbs at once with
+the dbs argument. Each db is read with its own cursor on one of db_threads
+threads, and each blob must be stored in only one of them. When loading only
+the outputs from dbs that support seeking, the outputs are looked up in the
+key index of the dbs instead of scanning them.
+
 )DOC")
     .Arg(
         "absolute_path",
         "(int, default 0) if set, use the db path directly and do not prepend "
         "the current root folder of the workspace.")
     .Arg("db", "(string) the path to the db to load.")
-    .Arg("db_type", "(string) the type of the db.")
+    .Arg(
+        "dbs",
+        "(list of strings) the paths to several dbs to load concurrently, "
+        "instead of db.")
+    .Arg(
+        "db_type",
+        "(string) the type of the db, or \"mmap\" for a raw checkpoint.")
+    .Arg(
+        "db_threads",
+        "(int, default 0) the number of threads reading dbs, or 0 for one "
+        "thread per db.")
+    .Arg(
+        "use_key_index",
+        "(int, default 1) if nonzero, the outputs are looked up by key in the "
+        "dbs that support seeking instead of scanning the whole db.")
     .Arg(
         "keep_device",
         "(int, default 0) if nonzero, the blobs are loaded into the device that "
@@ -42,7 +126,12 @@ DBReader to load from, and we ignore the db and db_type arguments.
     .Arg(
         "load_all",
         "(int, default 0) if nonzero, will load all blobs pointed to by the db "
-        "to the workspace overwriting/creating blobs as needed.");
+        "to the workspace overwriting/creating blobs as needed.")
+    .Arg(
+        "delta_dbs",
+        "(list of strings) delta checkpoints written by the Checkpoint "
+        "operator after the loaded db, of the same db_type. They are applied "
+        "in order on top of the loaded blobs. CPU only.");
 
 OPERATOR_SCHEMA(Save)
     .NumInputs(1, INT_MAX)
@@ -51,6 +140,10 @@ OPERATOR_SCHEMA(Save)
 The Save operator saves a set of blobs to a db. It takes [1, infinity) number
 of inputs and has no output. The contents of the inputs are written into the
 db specified by the arguments.
+
+If db_type is "mmap", the inputs are written to a raw checkpoint file instead:
+an index followed by the aligned tensor data, which the Load operator can map
+into memory. Only tensors of fundamental types can be saved this way.
 )DOC")
     .Arg(
         "absolute_path",
@@ -66,7 +159,19 @@ db specified by the arguments.
         "(list of strings) if set, used instead of original "
         "blob names. Must be the same length as number of blobs.")
     .Arg("db", "(string) the path to the db to load.")
-    .Arg("db_type", "(string) the type of the db.");
+    .Arg(
+        "db_type",
+        "(string) the type of the db, or \"mmap\" for a raw checkpoint.")
+    .Arg(
+        "compression",
+        "(string, default=\"\") if set, the codec that the serialized blobs, "
+        "or the chunks of tensors, are compressed with, e.g. \"lz4\" or "
+        "\"zstd\". Load decompresses them as needed.")
+    .Arg(
+        "delta",
+        "(int, default 0) if nonzero, only save the rows of the inputs "
+        "tracked by the Checkpoint operator that changed since its previous "
+        "checkpoint. Set by the Checkpoint operator.");
 
 OPERATOR_SCHEMA(Checkpoint)
     .NumInputs(1, INT_MAX)
@@ -77,6 +182,18 @@ to db every few iterations, with a db name that is appended with the iteration
 count. It takes [1, infinity) number of inputs and has no output. The first
 input has to be a TensorCPU of type int and has size 1 (i.e. the iteration
 counter). This is determined whether we need to do checkpointing.
+
+With full_every, most checkpoints are deltas: for each of the delta_blobs, they
+only hold the rows that the sparse update operators (SparseAdagrad, SparseAdam,
+SparseFtrl and ScatterAssign) changed since the previous checkpoint, and the
+other inputs in full. The Load operator restores the state from a full
+checkpoint and the deltas after it, passed as delta_dbs.
+
+With async, the operator only copies its inputs to the CPU, and the copies are
+serialized and written to the db by a background thread. A CheckpointBarrier
+operator waits for the checkpoints to be written. Only one such copy is held
+at a time: a checkpoint that is due before the previous one is written waits
+for it, and reports its errors if it failed.
 )DOC")
     .Arg(
         "absolute_path",
@@ -91,11 +208,35 @@ counter). This is determined whether we need to do checkpointing.
     .Arg(
         "every",
         "(int, default 1) the checkpointing is carried out when "
-        "(iter mod every) is zero.");
+        "(iter mod every) is zero.")
+    .Arg(
+        "full_every",
+        "(int, default 0) if positive, only one checkpoint out of full_every, "
+        "starting with the first one, is a full one, and the others are "
+        "deltas.")
+    .Arg(
+        "delta_blobs",
+        "(list of strings) the inputs that delta checkpoints save the changed "
+        "rows of. They should only be updated by sparse update operators "
+        "between two full checkpoints.")
+    .Arg(
+        "async",
+        "(int, default 0) if nonzero, write the checkpoints in the background "
+        "from a copy of the inputs.");
+
+OPERATOR_SCHEMA(CheckpointBarrier)
+    .NumInputs(0, INT_MAX)
+    .NumOutputs(0)
+    .SetDoc(R"DOC(
+Waits for the checkpoints that Checkpoint operators with async set are writing
+in the background, and throws if any of them failed. The inputs are not used,
+other than to order the barrier after the Checkpoint operators.
+)DOC");
 
 NO_GRADIENT(Load);
 SHOULD_NOT_DO_GRADIENT(Save);
 SHOULD_NOT_DO_GRADIENT(Checkpoint);
 SHOULD_NOT_DO_GRADIENT(Snapshot);
+SHOULD_NOT_DO_GRADIENT(CheckpointBarrier);
 }  // namespace
 }  // namespace caffe2
@@ -1,16 +1,31 @@
 #ifndef CAFFE2_OPERATORS_LOAD_SAVE_OP_H_
 #define CAFFE2_OPERATORS_LOAD_SAVE_OP_H_
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <regex>
+#include <thread>
+#include <type_traits>
 #include <unordered_set>
 
 #include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/compression.h"
 #include "caffe2/core/context.h"
 #include "caffe2/core/db.h"
+#include "caffe2/core/dirty_rows.h"
 #include "caffe2/core/logging.h"
+#include "caffe2/core/mmap_checkpoint.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/workspace.h"
 #include "caffe2/utils/math.h"
 #include "caffe2/utils/proto_utils.h"
 
@@ -20,6 +35,12 @@ using db::Cursor;
 using db::DB;
 using db::Transaction;
 
+// Delta checkpoints (see CheckpointOp) store the dirty rows of a blob under its
+// name and the indices of these rows under the name with kDeltaRowsSuffix, and
+// are told apart from full checkpoints by an entry under kDeltaCheckpointKey.
+constexpr auto kDeltaRowsSuffix = "__delta_rows";
+constexpr auto kDeltaCheckpointKey = "__delta_checkpoint__";
+
 template <class Context>
 class LoadOp final : public Operator<Context> {
  public:
@@ -32,9 +53,17 @@ class LoadOp final : public Operator<Context> {
         db_name_(OperatorBase::GetSingleArgument<string>("db", "")),
         db_type_(OperatorBase::GetSingleArgument<string>("db_type", "")),
         keep_device_(OperatorBase::GetSingleArgument<int>("keep_device", 0)),
-        load_all_(OperatorBase::GetSingleArgument<int>("load_all", 0)) {
+        load_all_(OperatorBase::GetSingleArgument<int>("load_all", 0)),
+        use_key_index_(
+            OperatorBase::GetSingleArgument<int>("use_key_index", 1)),
+        db_threads_(OperatorBase::GetSingleArgument<int>("db_threads", 0)),
+        db_names_(OperatorBase::GetRepeatedArgument<string>("dbs")),
+        delta_dbs_(OperatorBase::GetRepeatedArgument<string>("delta_dbs")) {
+    if (db_names_.empty() && !db_name_.empty()) {
+      db_names_.push_back(db_name_);
+    }
     if (InputSize() == 0) {
-      CAFFE_ENFORCE_GT(db_name_.size(), 0, "Must specify a db name.");
+      CAFFE_ENFORCE_GT(db_names_.size(), 0, "Must specify a db name.");
       CAFFE_ENFORCE_GT(db_type_.size(), 0, "Must specify a db type.");
     }
     if (!load_all_) {
@@ -48,131 +77,428 @@ class LoadOp final : public Operator<Context> {
   void SetCurrentDevice(BlobProto* proto);
 
   bool RunOnDevice() override {
+    if (db_type_ == kMmapCheckpointDBType) {
+      CAFFE_ENFORCE_EQ(
+          InputSize(), 0, "Raw checkpoints cannot be read from a DBReader.");
+      CAFFE_ENFORCE_EQ(
+          db_names_.size(), 1, "Raw checkpoints are loaded from a single db.");
+      extractMmapCheckpoint();
+      applyDeltas();
+      return true;
+    }
+    LoadState state;
     if (InputSize() == 1) {
       const db::DBReader& reader = OperatorBase::Input<db::DBReader>(0);
-      extract(reader.cursor());
+      extract(reader.cursor(), 0, &state);
+    } else {
+      extractDBs(&state);
+    }
+    if (!load_all_) {
+      checkLoaded(state);
+    }
+    applyDeltas();
+
+    return true;
+  }
+
+ private:
+  // The progress of a load, shared by the threads that read the dbs and
+  // guarded by its mutex.
+  struct LoadState {
+    std::mutex mutex;
+    // The db that each blob was read from, which is the only one that may
+    // hold it.
+    std::map<string, int> blob_dbs;
+    // We are tracking sizes of already read tensor parts while reading data
+    // chunks. This way we can make sure that all chunks were loaded in the
+    // end. This is a map from output index to current size of the blob
+    std::map<int, size_t> blob_sizes;
+    std::unordered_set<string> loaded;
+  };
+
+  // Reads the dbs concurrently, each with its own cursor on one of up to
+  // db_threads_ threads, including the calling one.
+  void extractDBs(LoadState* state) {
+    std::atomic<int> next_db(0);
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto worker = [&]() {
+      // Blobs are deserialized to the device of the operator, which is the
+      // current one of the thread.
+      Context context(this->def().device_option());
+      context.SwitchToDevice();
+      for (int i = next_db++; i < db_names_.size(); i = next_db++) {
+        try {
+          string full_db_name = absolute_path_
+              ? db_names_[i]
+              : (ws_->RootFolder() + "/" + db_names_[i]);
+          std::unique_ptr<DB> in_db(
+              caffe2::db::CreateDB(db_type_, full_db_name, caffe2::db::READ));
+          CAFFE_ENFORCE(in_db.get(), "Cannot open db: ", db_names_[i]);
+          std::unique_ptr<Cursor> cursor(in_db->NewCursor());
+          extract(cursor.get(), i, state);
+        } catch (...) {
+          std::lock_guard<std::mutex> guard(error_mutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+      }
+    };
+    const int num_threads = std::min<int>(
+        db_threads_ > 0 ? db_threads_ : db_names_.size(), db_names_.size());
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; ++i) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  void extract(Cursor* cursor, int db, LoadState* state) {
+    CAFFE_ENFORCE(cursor, "cursor is not valid");
+    if (load_all_) {
+      extractAll(cursor, db, state);
+    } else if (use_key_index_ && cursor->SupportsSeek()) {
+      extractByKey(cursor, db, state);
     } else {
+      extractFrom(cursor, db, state);
+    }
+  }
+
+  // Replays the delta checkpoints on top of the loaded blobs, in order.
+  void applyDeltas() {
+    if (delta_dbs_.empty()) {
+      return;
+    }
+    CAFFE_ENFORCE(
+        (std::is_same<Context, CPUContext>::value),
+        "Delta checkpoints can only be replayed by a CPU Load.");
+    for (const string& delta_db : delta_dbs_) {
       string full_db_name =
-          absolute_path_ ? db_name_ : (ws_->RootFolder() + "/" + db_name_);
+          absolute_path_ ? delta_db : (ws_->RootFolder() + "/" + delta_db);
       std::unique_ptr<DB> in_db(
           caffe2::db::CreateDB(db_type_, full_db_name, caffe2::db::READ));
-      CAFFE_ENFORCE(in_db.get(), "Cannot open db: ", db_name_);
+      CAFFE_ENFORCE(in_db.get(), "Cannot open db: ", delta_db);
       std::unique_ptr<Cursor> cursor(in_db->NewCursor());
-      extract(cursor.get());
+      bool is_delta = false;
+      // Deltas only hold the rows that changed, so they are small enough to
+      // be read in full before being applied.
+      std::map<string, Blob> blobs;
+      while (cursor->Valid()) {
+        auto key = blobName(cursor->key());
+        vector<BlobProto> protos;
+        readChunks(key, cursor.get(), &protos);
+        if (key == kDeltaCheckpointKey) {
+          is_delta = true;
+        } else {
+          deserializeChunks(protos, &blobs[key]);
+        }
+      }
+      CAFFE_ENFORCE(is_delta, delta_db, " is not a delta checkpoint.");
+
+      for (auto& named_blob : blobs) {
+        const string& name = named_blob.first;
+        if (isDeltaRows(name)) {
+          continue;
+        }
+        const auto rows = blobs.find(name + kDeltaRowsSuffix);
+        Blob* blob = nullptr;
+        if (load_all_) {
+          blob = ws_->CreateBlob(name);
+        } else if (output_indices_.count(name)) {
+          blob = OperatorBase::Outputs()[output_indices_[name]];
+        }
+        if (!blob) {
+          continue;
+        }
+        if (rows == blobs.end()) {
+          // Blobs that are not tracked are stored in full.
+          blob->swap(named_blob.second);
+          continue;
+        }
+        CAFFE_ENFORCE(
+            blob->IsType<TensorCPU>(),
+            "Cannot apply the delta of ",
+            name,
+            " to a blob that is not a TensorCPU.");
+        scatterRows(
+            name,
+            named_blob.second.Get<TensorCPU>(),
+            rows->second.Get<TensorCPU>(),
+            blob->GetMutable<TensorCPU>());
+      }
     }
+  }
 
-    return true;
+  static bool isDeltaRows(const string& name) {
+    const size_t suffix_size = strlen(kDeltaRowsSuffix);
+    return name.size() > suffix_size &&
+        name.compare(
+            name.size() - suffix_size, suffix_size, kDeltaRowsSuffix) == 0;
   }
 
- private:
-  void extract(Cursor* cursor) {
+  static void scatterRows(
+      const string& name,
+      const TensorCPU& values,
+      const TensorCPU& rows,
+      TensorCPU* tensor) {
+    CAFFE_ENFORCE(
+        values.meta() == tensor->meta() && values.ndim() == tensor->ndim() &&
+            values.dim(0) == rows.size(),
+        "The delta of ",
+        name,
+        " does not match the loaded tensor.");
+    for (int i = 1; i < tensor->ndim(); ++i) {
+      CAFFE_ENFORCE_EQ(
+          values.dim(i), tensor->dim(i), "Mismatched delta dims for ", name);
+    }
+    const TypeMeta& meta = tensor->meta();
+    const size_t row_size = tensor->size_from_dim(1);
+    const int64_t* row_indices = rows.data<int64_t>();
+    const char* src = static_cast<const char*>(values.raw_data());
+    char* dst = static_cast<char*>(tensor->raw_mutable_data(meta));
+    for (int i = 0; i < rows.size(); ++i) {
+      const int64_t row = row_indices[i];
+      CAFFE_ENFORCE(
+          0 <= row && row < tensor->dim(0),
+          "Delta row ",
+          row,
+          " is out of range for ",
+          name);
+      const char* row_src = src + i * row_size * meta.itemsize();
+      char* row_dst = dst + row * row_size * meta.itemsize();
+      if (meta.copy()) {
+        meta.copy()(row_src, row_dst, row_size);
+      } else {
+        memcpy(row_dst, row_src, row_size * meta.itemsize());
+      }
+    }
+  }
+
+  void extractMmapCheckpoint() {
+    const string& db_name = db_names_[0];
+    string full_db_name =
+        absolute_path_ ? db_name : (ws_->RootFolder() + "/" + db_name);
+    auto checkpoint = MmapCheckpoint::Open(full_db_name);
     if (load_all_) {
-      extractAll(cursor);
+      for (const string& name : checkpoint->names()) {
+        extractMmapTensor(checkpoint.get(), name, ws_->CreateBlob(name));
+      }
     } else {
-      extractFrom(cursor, OperatorBase::Outputs());
+      for (int i = 0; i < OutputSize(); ++i) {
+        const string& name = def().output(i);
+        CAFFE_ENFORCE(
+            checkpoint->Has(name), "Failed to load blob: ", name);
+        extractMmapTensor(checkpoint.get(), name, OperatorBase::Outputs()[i]);
+      }
     }
+    // Copies to the device read from the mapping, which may be released
+    // once we return.
+    context_.FinishDeviceComputation();
   }
 
-  void extractAll(Cursor* cursor) {
-    CAFFE_ENFORCE(cursor, "cursor is not valid");
-    std::unordered_set<string> seen_blobs;
-    for (; cursor->Valid(); cursor->Next()) {
-      const string& dbKey = cursor->key();
-      auto key = dbKey.substr(0, dbKey.find(kChunkIdSeparator));
-      BlobProto proto;
+  void extractMmapTensor(
+      MmapCheckpoint* checkpoint,
+      const string& name,
+      Blob* blob) {
+    // As in extractFrom(), reset the blob to get rid of existing content.
+    blob->Reset();
+    if (std::is_same<Context, CPUContext>::value) {
+      // CPU tensors alias the mapping and are not copied at all.
+      checkpoint->ShareTensor(name, blob->GetMutable<TensorCPU>());
+    } else {
+      TensorCPU mapped;
+      checkpoint->ShareTensor(name, &mapped);
+      blob->GetMutable<Tensor<Context>>()->CopyFrom(mapped, &context_);
+    }
+  }
+
+  static string blobName(const string& dbKey) {
+    return dbKey.substr(0, dbKey.find(kChunkIdSeparator));
+  }
+
+  // Reads the consecutive entries of the given blob at the cursor, which are
+  // the chunks of a tensor, and parses them in parallel.
+  void readChunks(
+      const string& key,
+      Cursor* cursor,
+      vector<BlobProto>* protos) {
+    vector<string> values;
+    for (; cursor->Valid() && blobName(cursor->key()) == key; cursor->Next()) {
+      values.push_back(cursor->value());
+    }
+    protos->resize(values.size());
+    ParallelForChunks(values.size(), [&](size_t i) {
       CAFFE_ENFORCE(
-          proto.ParseFromString(cursor->value()), "Couldn't parse Proto");
-      if (!keep_device_) {
-        // If we are not keeping the device as the one specified in the
-        // proto, we will set the current device.
+          protos->at(i).ParseFromString(values[i]), "Couldn't parse Proto");
+      DecompressBlobProto(&protos->at(i));
+    });
+    if (!keep_device_) {
+      // If we are not keeping the device as the one specified in the
+      // proto, we will set the current device. This is done on the thread of
+      // the cursor, whose current device is the one of the operator.
+      for (auto& proto : *protos) {
         SetCurrentDevice(&proto);
       }
+    }
+  }
 
-      if (seen_blobs.count(key) == 0 && ws_->GetBlob(key)) {
-        // This blob already exists, reset it, read below about why!
-        ws_->GetBlob(key)->Reset();
+  // Deserializes the chunks of a blob. The first chunk allocates the tensor,
+  // so that the other ones can then fill their segments of it in parallel, in
+  // whatever order they were stored.
+  void deserializeChunks(const vector<BlobProto>& protos, Blob* blob) {
+    blob->Deserialize(protos[0]);
+    if (blob->IsType<Tensor<Context>>()) {
+      ParallelForChunks(protos.size() - 1, [&](size_t i) {
+        blob->Deserialize(protos[i + 1]);
+      });
+    } else {
+      for (int i = 1; i < protos.size(); ++i) {
+        blob->Deserialize(protos[i]);
       }
+    }
+  }
 
-      Blob* blob = ws_->CreateBlob(key);
-      blob->Deserialize(proto);
+  void extractAll(Cursor* cursor, int db, LoadState* state) {
+    while (cursor->Valid()) {
+      auto key = blobName(cursor->key());
+      vector<BlobProto> protos;
+      readChunks(key, cursor, &protos);
+
+      Blob* blob = nullptr;
+      bool seen = false;
+      {
+        std::lock_guard<std::mutex> guard(state->mutex);
+        auto found = state->blob_dbs.emplace(key, db);
+        CAFFE_ENFORCE_EQ(
+            found.first->second, db, "Blob ", key, " found in several dbs.");
+        seen = !found.second;
+        if (!seen && ws_->GetBlob(key)) {
+          // This blob already exists, reset it, read below about why!
+          ws_->GetBlob(key)->Reset();
+        }
+        blob = ws_->CreateBlob(key);
+      }
+      deserializeChunks(protos, blob);
       if (!blob->IsType<Tensor<Context>>()) {
         // Only tensors can be seen multiple times as chunks.
-        CAFFE_ENFORCE(seen_blobs.count(key) == 0, "Blob duplicated");
+        CAFFE_ENFORCE(!seen && protos.size() == 1, "Blob duplicated");
       }
-      seen_blobs.insert(key);
     }
   }
 
-  void extractFrom(Cursor* cursor, const vector<Blob*>& outputs) {
-    CAFFE_ENFORCE(cursor);
-
-    // We are tracking sizes of already read tensor parts while reading data
-    // chunks. This way we can make sure that all chunks were loaded in the end.
-    // This is a map from output index to current size of the blob
-    std::map<int, size_t> blobSizes;
-    std::unordered_set<string> loaded;
-    for (; cursor->Valid(); cursor->Next()) {
-      const string& dbKey = cursor->key();
-      auto key = dbKey.substr(0, dbKey.find(kChunkIdSeparator));
+  // Scans the whole db for the outputs, until all of them are loaded.
+  void extractFrom(Cursor* cursor, int db, LoadState* state) {
+    while (cursor->Valid()) {
+      auto key = blobName(cursor->key());
       if (!output_indices_.count(key)) {
         VLOG(1) << "Key " << key << " not used. Skipping.";
-      } else {
-        CAFFE_ENFORCE(
-            loaded.count(key) == 0,
-            "Multiple copies of blob ",
-            key,
-            " found in the db.");
-
-        VLOG(2) << "Deserializing blob " << key;
-        BlobProto proto;
-        CAFFE_ENFORCE(proto.ParseFromString(cursor->value()));
-        if (!keep_device_) {
-          // If we are not keeping the device as the one specified in the
-          // proto, we will set the current device.
-          SetCurrentDevice(&proto);
-        }
-        auto blobIndex = output_indices_[key];
-        Blob* blob = outputs.at(blobIndex);
-        auto blobSize = blobSizes.insert({blobIndex, 0});
-        if (blobSize.second) {
-          // We reset the blob so that any existing content is destroyed. This
-          // is to guaranee correct device placement: if we are deserializing
-          // into a TensorCUDA, without explicit Reset we might be loading data
-          // into an existing TensorCUDA that has pre-allocated memory on a
-          // different GPU.
-          blob->Reset();
+        cursor->Next();
+        continue;
+      }
+      extractBlob(key, cursor, db, state);
+
+      std::lock_guard<std::mutex> guard(state->mutex);
+      if (state->loaded.size() >= OutputSize()) {
+        VLOG(1) << "Read all required blobs";
+        break;
+      }
+    }
+  }
+
+  // Looks the outputs that are not loaded yet up in the key index of the db,
+  // instead of scanning it.
+  void extractByKey(Cursor* cursor, int db, LoadState* state) {
+    for (const string& name : this->def().output()) {
+      {
+        std::lock_guard<std::mutex> guard(state->mutex);
+        if (state->loaded.count(name)) {
+          continue;
         }
-        blob->Deserialize(proto);
+      }
+      // Tensors are stored in chunks, whose keys follow the name with
+      // kChunkIdSeparator, and other blobs under their name.
+      cursor->Seek(name);
+      if (cursor->Valid() && blobName(cursor->key()) != name) {
+        cursor->Seek(name + kChunkIdSeparator);
+      }
+      if (cursor->Valid() && blobName(cursor->key()) == name) {
+        extractBlob(name, cursor, db, state);
+      }
+    }
+  }
+
+  // Reads the consecutive entries of the given output at the cursor.
+  void extractBlob(
+      const string& key,
+      Cursor* cursor,
+      int db,
+      LoadState* state) {
+    auto blobIndex = output_indices_[key];
+    Blob* blob = OperatorBase::Outputs().at(blobIndex);
+    {
+      std::lock_guard<std::mutex> guard(state->mutex);
+      CAFFE_ENFORCE(
+          state->loaded.count(key) == 0 &&
+              state->blob_dbs.emplace(key, db).first->second == db,
+          "Multiple copies of blob ",
+          key,
+          " found in the db.");
+      if (state->blob_sizes.insert({blobIndex, 0}).second) {
+        // We reset the blob so that any existing content is destroyed. This
+        // is to guaranee correct device placement: if we are deserializing
+        // into a TensorCUDA, without explicit Reset we might be loading data
+        // into an existing TensorCUDA that has pre-allocated memory on a
+        // different GPU.
+        blob->Reset();
+      }
+    }
 
-        if (!blob->IsType<Tensor<Context>>()) {
-          // Deal with non-tensors: we don't support chunking so we're done.
-          loaded.insert(key);
+    VLOG(2) << "Deserializing blob " << key;
+    vector<BlobProto> protos;
+    readChunks(key, cursor, &protos);
+    deserializeChunks(protos, blob);
+
+    std::lock_guard<std::mutex> guard(state->mutex);
+    size_t& blobSize = state->blob_sizes[blobIndex];
+    for (const BlobProto& proto : protos) {
+      CAFFE_ENFORCE(
+          state->loaded.count(key) == 0,
+          "Multiple copies of blob ",
+          key,
+          " found in the db.");
+      if (!blob->IsType<Tensor<Context>>()) {
+        // Deal with non-tensors: we don't support chunking so we're done.
+        state->loaded.insert(key);
+      } else {
+        // Deal with tensors: done whtn read total tensor size
+        CAFFE_ENFORCE(proto.has_tensor());
+        auto tensorSize = blob->Get<Tensor<Context>>().size();
+        if (proto.tensor().has_segment()) {
+          blobSize +=
+              proto.tensor().segment().end() - proto.tensor().segment().begin();
         } else {
-          // Deal with tensors: done whtn read total tensor size
-          CAFFE_ENFORCE(proto.has_tensor());
-          auto tensorSize = blob->Get<Tensor<Context>>().size();
-          if (proto.tensor().has_segment()) {
-            blobSize.first->second += proto.tensor().segment().end() -
-                proto.tensor().segment().begin();
-          } else {
-            CAFFE_ENFORCE(blobSize.first->second == 0);
-            blobSize.first->second = tensorSize;
-          }
-          if (blobSize.first->second >= tensorSize) {
-            loaded.insert(key);
-          }
+          CAFFE_ENFORCE(blobSize == 0);
+          blobSize = tensorSize;
         }
-
-        if (loaded.size() >= OutputSize()) {
-          VLOG(1) << "Read all required blobs";
-          break;
+        if (blobSize >= tensorSize) {
+          state->loaded.insert(key);
         }
       }
     }
-    VLOG(1) << "Fully loaded " << loaded.size() << " blobs";
+  }
+
+  void checkLoaded(const LoadState& state) {
+    VLOG(1) << "Fully loaded " << state.loaded.size() << " blobs";
 
-    for (const auto& blobSize : blobSizes) {
-      Blob* blob = outputs.at(blobSize.first);
+    for (const auto& blobSize : state.blob_sizes) {
+      Blob* blob = OperatorBase::Outputs().at(blobSize.first);
       if (blob->IsType<Tensor<Context>>()) {
         size_t tensorSize = blob->Get<Tensor<Context>>().size();
         CAFFE_ENFORCE(
@@ -186,14 +512,18 @@ class LoadOp final : public Operator<Context> {
       }
     }
 
-    if (loaded.size() != OutputSize()) {
+    if (state.loaded.size() != OutputSize()) {
       for (const string& output_name : this->def().output()) {
-        if (loaded.count(output_name) <= 0) {
+        if (state.loaded.count(output_name) <= 0) {
           LOG(ERROR) << "Failed to load blob: " << output_name;
         }
       }
       CAFFE_THROW(
-          "Expected to load ", OutputSize(), " blobs, ", "got ", loaded.size());
+          "Expected to load ",
+          OutputSize(),
+          " blobs, ",
+          "got ",
+          state.loaded.size());
     }
   }
 
@@ -204,6 +534,10 @@ class LoadOp final : public Operator<Context> {
   string db_type_;
   bool keep_device_;
   bool load_all_;
+  bool use_key_index_;
+  int db_threads_;
+  vector<string> db_names_;
+  vector<string> delta_dbs_;
   std::map<string, int> output_indices_;
 };
 
@@ -220,10 +554,23 @@ class SaveOp final : public Operator<Context> {
             OperatorBase::GetSingleArgument<string>("strip_regex", "")),
         db_name_(OperatorBase::GetSingleArgument<string>("db", "")),
         db_type_(OperatorBase::GetSingleArgument<string>("db_type", "")),
+        compression_(
+            OperatorBase::GetSingleArgument<string>("compression", "")),
+        delta_(OperatorBase::GetSingleArgument<int>("delta", 0)),
         blob_names_(
             OperatorBase::GetRepeatedArgument<string>("blob_name_overrides")) {
     CAFFE_ENFORCE_GT(db_name_.size(), 0, "Must specify a db name.");
     CAFFE_ENFORCE_GT(db_type_.size(), 0, "Must specify a db type.");
+    if (!compression_.empty()) {
+      // Fail early if the codec is not available.
+      CreateCompressionCodec(compression_);
+      CAFFE_ENFORCE(
+          db_type_ != kMmapCheckpointDBType,
+          "Raw checkpoints cannot be compressed.");
+    }
+    CAFFE_ENFORCE(
+        !delta_ || db_type_ != kMmapCheckpointDBType,
+        "Raw checkpoints cannot be deltas.");
     CAFFE_ENFORCE(
         blob_names_.empty() ||
             blob_names_.size() == OperatorBase::Inputs().size(),
@@ -249,6 +596,10 @@ class SaveOp final : public Operator<Context> {
   bool RunOnDevice() override {
     string full_db_name =
         absolute_path_ ? db_name_ : (ws_->RootFolder() + "/" + db_name_);
+    if (db_type_ == kMmapCheckpointDBType) {
+      saveMmapCheckpoint(full_db_name);
+      return true;
+    }
     std::unique_ptr<DB> out_db(
         caffe2::db::CreateDB(db_type_, full_db_name, caffe2::db::NEW));
     CAFFE_ENFORCE(out_db.get(), "Cannot open db for writing: ", full_db_name);
@@ -259,24 +610,121 @@ class SaveOp final : public Operator<Context> {
       VLOG(2) << "Sending " << blobName << " blob's data of size "
               << data.size() << " to db";
       auto transaction = out_db->NewTransaction();
-      transaction->Put(blobName, data);
+      // The acceptor runs on the threads that serialize the chunks of a
+      // tensor, so that the chunks are compressed in parallel too.
+      transaction->Put(
+          blobName,
+          compression_.empty() ? data
+                               : CompressSerializedBlob(data, compression_));
       transaction->Commit();
     };
 
     const vector<const Blob*>& inputs = OperatorBase::Inputs();
+    auto* dirty_rows = DirtyRowTracker::Get();
     for (int i = 0; i < inputs.size(); ++i) {
+      if (dirty_rows->IsTracked(inputs[i])) {
+        // Deltas are relative to the previous checkpoint, full or not.
+        const vector<TIndex> rows = dirty_rows->TakeDirtyRows(inputs[i]);
+        if (delta_ && inputs[i]->IsType<TensorCPU>()) {
+          saveDirtyRows(
+              blob_names_[i], inputs[i]->Get<TensorCPU>(), rows, acceptor);
+          continue;
+        }
+      }
       inputs[i]->Serialize(blob_names_[i], acceptor);
     }
+    if (delta_) {
+      Blob marker;
+      marker.GetMutable<string>();
+      marker.Serialize(kDeltaCheckpointKey, acceptor);
+    }
     out_db->Close();
     return true;
   }
 
  private:
+  void saveDirtyRows(
+      const string& name,
+      const TensorCPU& tensor,
+      const vector<TIndex>& rows,
+      BlobSerializerBase::SerializationAcceptor acceptor) {
+    CAFFE_ENFORCE_GT(tensor.ndim(), 0, "Cannot save the rows of a scalar.");
+    Blob indices_blob;
+    auto* indices = indices_blob.GetMutable<TensorCPU>();
+    indices->Resize(rows.size());
+    int64_t* indices_data = indices->mutable_data<int64_t>();
+    int num_rows = 0;
+    for (TIndex row : rows) {
+      // Rows past the end may have been marked before a resize.
+      if (row < tensor.dim(0)) {
+        indices_data[num_rows++] = row;
+      }
+    }
+    indices->Shrink(num_rows);
+
+    Blob values_blob;
+    auto* values = values_blob.GetMutable<TensorCPU>();
+    vector<TIndex> dims = tensor.dims();
+    dims[0] = num_rows;
+    values->Resize(dims);
+    const TypeMeta& meta = tensor.meta();
+    const size_t row_bytes = tensor.size_from_dim(1) * meta.itemsize();
+    const char* src = static_cast<const char*>(tensor.raw_data());
+    char* dst = static_cast<char*>(values->raw_mutable_data(meta));
+    for (int i = 0; i < num_rows; ++i) {
+      if (meta.copy()) {
+        meta.copy()(
+            src + indices_data[i] * row_bytes,
+            dst + i * row_bytes,
+            tensor.size_from_dim(1));
+      } else {
+        memcpy(
+            dst + i * row_bytes, src + indices_data[i] * row_bytes, row_bytes);
+      }
+    }
+    values_blob.Serialize(name, acceptor);
+    indices_blob.Serialize(name + kDeltaRowsSuffix, acceptor);
+  }
+
+  void saveMmapCheckpoint(const string& full_db_name) {
+    const vector<const Blob*>& inputs = OperatorBase::Inputs();
+    // A full checkpoint restarts the deltas of the tracked inputs.
+    auto* dirty_rows = DirtyRowTracker::Get();
+    for (const Blob* input : inputs) {
+      if (dirty_rows->IsTracked(input)) {
+        dirty_rows->TakeDirtyRows(input);
+      }
+    }
+    vector<std::pair<string, const TensorCPU*>> tensors;
+    // Tensors of other devices are copied to the CPU first.
+    vector<std::unique_ptr<TensorCPU>> cpu_copies;
+    for (int i = 0; i < inputs.size(); ++i) {
+      if (inputs[i]->IsType<TensorCPU>()) {
+        tensors.emplace_back(blob_names_[i], &inputs[i]->Get<TensorCPU>());
+        continue;
+      }
+      CAFFE_ENFORCE(
+          inputs[i]->IsType<Tensor<Context>>(),
+          "Only tensors can be saved to a raw checkpoint, but ",
+          def().input(i),
+          " is of type ",
+          inputs[i]->TypeName());
+      cpu_copies.emplace_back(
+          new TensorCPU(inputs[i]->Get<Tensor<Context>>(), &context_));
+      tensors.emplace_back(blob_names_[i], cpu_copies.back().get());
+    }
+    context_.FinishDeviceComputation();
+    MmapCheckpoint::Write(full_db_name, tensors);
+  }
+
+
   Workspace* ws_;
   bool absolute_path_;
   string strip_regex_;
   string db_name_;
   string db_type_;
+  string compression_;
+  bool delta_;
   std::vector<std::string> blob_names_;
 };
 
@@ -303,11 +751,46 @@ string FormatString(const string& pattern, Ts... values) {
   */
 }
 
+// Writes the checkpoints of CheckpointOp with async set, one at a time, on a
+// background thread.
+class AsyncCheckpointWriter {
+ public:
+  static AsyncCheckpointWriter* Get();
+
+  void Schedule(std::function<void()> checkpoint);
+  // Waits for all the scheduled checkpoints to be written, and rethrows the
+  // first error that any of them ran into since the last call.
+  void Wait();
+
+ private:
+  AsyncCheckpointWriter();
+  void Run();
+
+  std::mutex mutex_;
+  std::condition_variable scheduled_;
+  std::condition_variable done_;
+  std::deque<std::function<void()>> checkpoints_;
+  bool writing_ = false;
+  std::exception_ptr error_;
+  std::thread thread_;
+
+  DISABLE_COPY_AND_ASSIGN(AsyncCheckpointWriter);
+};
+
 // CheckpointOp is a wrapper over a SaveFloatTensorOp that basically allows
 // flexible naming over iterations.
 // The file pattern in db_name should be a format string that can be passed into
 // sprintf with an int argument specifying the current iteration. An example:
 //     "/path/to/my/checkpoint/checkpoint_at_%d.pb"
+//
+// With full_every, only one checkpoint out of full_every is a full one, and
+// the others are deltas that only hold the rows of the delta_blobs that the
+// sparse update operators changed since the previous checkpoint (see
+// DirtyRowTracker). Load replays such deltas with its delta_dbs argument.
+//
+// With async, the inputs are copied to the CPU and the checkpoint is written
+// by the AsyncCheckpointWriter, while the training goes on. CheckpointBarrier
+// waits for it to be written.
 template <class Context>
 class CheckpointOp final : public Operator<Context> {
  public:
@@ -315,8 +798,11 @@ class CheckpointOp final : public Operator<Context> {
       : Operator<Context>(operator_def, ws),
         db_pattern_(OperatorBase::GetSingleArgument<string>("db", "")),
         every_(OperatorBase::GetSingleArgument<int>("every", 1)),
+        full_every_(OperatorBase::GetSingleArgument<int>("full_every", 0)),
+        async_(OperatorBase::GetSingleArgument<int>("async", 0)),
         ws_(ws),
-        save_op_def_(operator_def) {
+        save_op_def_(operator_def),
+        snapshot_context_(operator_def.device_option()) {
     CAFFE_ENFORCE_GT(
         db_pattern_.size(), 0, "Must specify a checkpoint file pattern.");
     CAFFE_ENFORCE_GT(every_, 0, "Checkpoint interval should be positive.");
@@ -326,6 +812,25 @@ class CheckpointOp final : public Operator<Context> {
                    << "Is that intended?";
     }
     save_op_def_.set_type("Save");
+    const auto delta_blobs =
+        OperatorBase::GetRepeatedArgument<string>("delta_blobs");
+    CAFFE_ENFORCE(
+        delta_blobs.empty() || full_every_ > 0,
+        "delta_blobs needs full_every to be set.");
+    for (const string& name : delta_blobs) {
+      const auto& inputs = this->def().input();
+      auto it = std::find(inputs.begin(), inputs.end(), name);
+      CAFFE_ENFORCE(it != inputs.end(), "Delta blob ", name, " not an input.");
+      const Blob* blob = OperatorBase::Inputs()[it - inputs.begin()];
+      DirtyRowTracker::Get()->Track(blob);
+      tracked_blobs_.push_back(blob);
+    }
+  }
+
+  ~CheckpointOp() {
+    for (const Blob* blob : tracked_blobs_) {
+      DirtyRowTracker::Get()->Untrack(blob);
+    }
   }
 
   bool RunOnDevice() override {
@@ -334,6 +839,14 @@ class CheckpointOp final : public Operator<Context> {
     if (iter % every_ == 0) {
       GetMutableArgument("db", true, &save_op_def_)
           ->set_s(FormatString(db_pattern_, iter));
+      const bool delta =
+          full_every_ > 0 && num_checkpoints_ % full_every_ != 0;
+      GetMutableArgument("delta", true, &save_op_def_)->set_i(delta);
+      ++num_checkpoints_;
+      if (async_) {
+        saveAsync();
+        return true;
+      }
       SaveOp<Context> sub_op(save_op_def_, ws_);
       return sub_op.Run();
     } else {
@@ -342,10 +855,83 @@ class CheckpointOp final : public Operator<Context> {
   }
 
  private:
+  void saveAsync() {
+    auto* writer = AsyncCheckpointWriter::Get();
+    // Only one snapshot is held at a time: if the previous checkpoint is not
+    // written yet, training waits for it.
+    writer->Wait();
+    // The snapshot is a workspace with a CPU copy of each input, that a CPU
+    // Save writes from the background thread.
+    auto* dirty_rows = DirtyRowTracker::Get();
+    std::shared_ptr<Workspace> snapshot(
+        new Workspace(ws_->RootFolder()), [dirty_rows](Workspace* ws) {
+          for (const string& name : ws->Blobs()) {
+            dirty_rows->Untrack(ws->GetBlob(name));
+          }
+          delete ws;
+        });
+    const vector<const Blob*>& inputs = OperatorBase::Inputs();
+    beginSnapshot();
+    for (int i = 0; i < inputs.size(); ++i) {
+      Blob* copy = snapshot->CreateBlob(this->def().input(i));
+      if (inputs[i]->template IsType<Tensor<Context>>()) {
+        copy->GetMutable<TensorCPU>()->CopyFrom(
+            inputs[i]->template Get<Tensor<Context>>(), &snapshot_context_);
+      } else if (inputs[i]->template IsType<TensorCPU>()) {
+        copy->GetMutable<TensorCPU>()->CopyFrom(
+            inputs[i]->template Get<TensorCPU>(), &snapshot_context_);
+      } else {
+        // Blobs of other types are copied through their serialization.
+        copy->Deserialize(inputs[i]->Serialize(this->def().input(i)));
+      }
+      if (dirty_rows->IsTracked(inputs[i])) {
+        // The dirty rows move to the copy, for the Save of a delta.
+        const vector<TIndex> rows = dirty_rows->TakeDirtyRows(inputs[i]);
+        dirty_rows->Track(copy);
+        dirty_rows->MarkRows(copy, rows.data(), rows.size());
+      }
+    }
+    endSnapshot();
+
+    OperatorDef save_def = save_op_def_;
+    save_def.clear_device_option();
+    writer->Schedule([snapshot, save_def]() {
+      SaveOp<CPUContext> save_op(save_def, snapshot.get());
+      CAFFE_ENFORCE(
+          save_op.Run(),
+          "Failed to write checkpoint ",
+          GetArgument(save_def, "db").s());
+    });
+  }
+
+  // Order the copies of the inputs on snapshot_context_ after the
+  // computation of the op, and wait for them.
+  void beginSnapshot();
+  void endSnapshot();
+
   string db_pattern_;
   int every_;
+  int full_every_;
+  bool async_;
+  int num_checkpoints_ = 0;
+  vector<const Blob*> tracked_blobs_;
   Workspace* ws_;
   OperatorDef save_op_def_;
+  Context snapshot_context_;
+};
+
+// Waits for the checkpoints written in the background to be done. It takes
+// any number of inputs, only to be ordered after the Checkpoint operators.
+template <class Context>
+class CheckpointBarrierOp final : public Operator<Context> {
+ public:
+  CheckpointBarrierOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    AsyncCheckpointWriter::Get()->Wait();
+    return true;
+  }
 };
 
 } // namespace caffe2
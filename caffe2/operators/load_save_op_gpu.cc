@@ -12,9 +12,33 @@ void LoadOp<CUDAContext>::SetCurrentDevice(BlobProto* proto) {
   }
 }
 
+namespace {
+// The stream that Checkpoint copies its inputs to the CPU on, when async.
+constexpr int kCheckpointStreamId = 1;
+}  // namespace
+
+template <>
+void CheckpointOp<CUDAContext>::beginSnapshot() {
+  // The copies wait for the computation of the op stream through an event,
+  // without the host having to drain that stream.
+  snapshot_context_.set_stream_id(kCheckpointStreamId);
+  cudaEvent_t computed;
+  CUDA_CHECK(cudaEventCreateWithFlags(&computed, cudaEventDisableTiming));
+  CUDA_CHECK(cudaEventRecord(computed, context_.cuda_stream()));
+  CUDA_CHECK(
+      cudaStreamWaitEvent(snapshot_context_.cuda_stream(), computed, 0));
+  CUDA_CHECK(cudaEventDestroy(computed));
+}
+
+template <>
+void CheckpointOp<CUDAContext>::endSnapshot() {
+  snapshot_context_.FinishDeviceComputation();
+}
+
 namespace {
 REGISTER_CUDA_OPERATOR(Load, LoadOp<CUDAContext>);
 REGISTER_CUDA_OPERATOR(Save, SaveOp<CUDAContext>);
 REGISTER_CUDA_OPERATOR(Checkpoint, CheckpointOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(CheckpointBarrier, CheckpointBarrierOp<CUDAContext>);
 }  // namespace
 }  // namespace caffe2
@@ -0,0 +1,288 @@
+#include <cstdio>
+#include <map>
+
+#include "caffe2/operators/load_save_op.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace db {
+namespace {
+
+// An in memory db that supports seeking, and counts the entries that its
+// cursors step over.
+std::map<string, std::map<string, string>> seek_dbs;
+int seek_db_steps = 0;
+
+class SeekDBCursor : public Cursor {
+ public:
+  explicit SeekDBCursor(const std::map<string, string>* records)
+      : records_(records), iter_(records->begin()) {}
+  void Seek(const string& key) override { iter_ = records_->lower_bound(key); }
+  bool SupportsSeek() override { return true; }
+  void SeekToFirst() override { iter_ = records_->begin(); }
+  void Next() override {
+    ++seek_db_steps;
+    ++iter_;
+  }
+  string key() override { return iter_->first; }
+  string value() override { return iter_->second; }
+  bool Valid() override { return iter_ != records_->end(); }
+
+ private:
+  const std::map<string, string>* records_;
+  std::map<string, string>::const_iterator iter_;
+};
+
+class SeekDBTransaction : public Transaction {
+ public:
+  explicit SeekDBTransaction(std::map<string, string>* records)
+      : records_(records) {}
+  void Put(const string& key, const string& value) override {
+    (*records_)[key] = value;
+  }
+  void Commit() override {}
+
+ private:
+  std::map<string, string>* records_;
+};
+
+class SeekDB : public DB {
+ public:
+  SeekDB(const string& source, Mode mode)
+      : DB(source, mode), records_(&seek_dbs[source]) {}
+  void Close() override {}
+  std::unique_ptr<Cursor> NewCursor() override {
+    return make_unique<SeekDBCursor>(records_);
+  }
+  std::unique_ptr<Transaction> NewTransaction() override {
+    return make_unique<SeekDBTransaction>(records_);
+  }
+
+ private:
+  std::map<string, string>* records_;
+};
+REGISTER_CAFFE2_DB(load_save_seek_db, SeekDB);
+
+} // namespace
+} // namespace db
+
+namespace {
+
+void AddTensor(Workspace* ws, const string& name, int size, float value) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(size);
+  for (int i = 0; i < size; ++i) {
+    tensor->mutable_data<float>()[i] = value + i;
+  }
+}
+
+void Save(
+    Workspace* ws,
+    const vector<string>& blobs,
+    const string& db,
+    const string& db_type) {
+  OperatorDef def;
+  def.set_type("Save");
+  for (const string& blob : blobs) {
+    def.add_input(blob);
+  }
+  AddArgument<string>("db", db, &def);
+  AddArgument<string>("db_type", db_type, &def);
+  AddArgument<int>("absolute_path", 1, &def);
+  CAFFE_ENFORCE(ws->RunOperatorOnce(def));
+}
+
+OperatorDef LoadDef(
+    const vector<string>& outputs,
+    const vector<string>& dbs,
+    const string& db_type) {
+  OperatorDef def;
+  def.set_type("Load");
+  for (const string& output : outputs) {
+    def.add_output(output);
+  }
+  def.add_arg()->CopyFrom(MakeArgument<vector<string>>("dbs", dbs));
+  AddArgument<string>("db_type", db_type, &def);
+  AddArgument<int>("absolute_path", 1, &def);
+  if (outputs.empty()) {
+    AddArgument<int>("load_all", 1, &def);
+  }
+  return def;
+}
+
+void ExpectTensor(Workspace* ws, const string& name, int size, float value) {
+  const auto& tensor = ws->GetBlob(name)->Get<TensorCPU>();
+  ASSERT_EQ(tensor.size(), size) << name;
+  for (int i = 0; i < size; ++i) {
+    EXPECT_EQ(tensor.data<float>()[i], value + i) << name;
+  }
+}
+
+OperatorDef CheckpointDef(const string& pattern, const string& db_type) {
+  OperatorDef def;
+  def.set_type("Checkpoint");
+  def.add_input("iter");
+  def.add_input("weights");
+  def.add_input("name");
+  AddArgument<string>("db", pattern, &def);
+  AddArgument<string>("db_type", db_type, &def);
+  AddArgument<int>("absolute_path", 1, &def);
+  AddArgument<int>("async", 1, &def);
+  return def;
+}
+
+void InitBlobs(Workspace* ws) {
+  auto* iter = ws->CreateBlob("iter")->GetMutable<TensorCPU>();
+  iter->Resize(1);
+  iter->mutable_data<int64_t>()[0] = 0;
+  auto* weights = ws->CreateBlob("weights")->GetMutable<TensorCPU>();
+  weights->Resize(1000);
+  for (int i = 0; i < weights->size(); ++i) {
+    weights->mutable_data<float>()[i] = i;
+  }
+  *ws->CreateBlob("name")->GetMutable<string>() = "model";
+}
+
+} // namespace
+
+TEST(LoadSaveOpTest, AsyncCheckpoint) {
+  const string filename = std::tmpnam(nullptr);
+  Workspace ws;
+  InitBlobs(&ws);
+  ASSERT_TRUE(ws.RunOperatorOnce(CheckpointDef(filename, "minidb")));
+  // The checkpoint has the inputs of when it ran.
+  auto* weights = ws.GetBlob("weights")->GetMutable<TensorCPU>();
+  for (int i = 0; i < weights->size(); ++i) {
+    weights->mutable_data<float>()[i] = -1;
+  }
+  *ws.GetBlob("name")->GetMutable<string>() = "changed";
+  OperatorDef barrier_def;
+  barrier_def.set_type("CheckpointBarrier");
+  barrier_def.add_input("weights");
+  ASSERT_TRUE(ws.RunOperatorOnce(barrier_def));
+
+  OperatorDef load_def;
+  load_def.set_type("Load");
+  load_def.add_output("weights");
+  load_def.add_output("name");
+  AddArgument<string>("db", filename, &load_def);
+  AddArgument<string>("db_type", "minidb", &load_def);
+  AddArgument<int>("absolute_path", 1, &load_def);
+  Workspace load_ws;
+  ASSERT_TRUE(load_ws.RunOperatorOnce(load_def));
+  const auto& loaded = load_ws.GetBlob("weights")->Get<TensorCPU>();
+  ASSERT_EQ(loaded.size(), 1000);
+  for (int i = 0; i < loaded.size(); ++i) {
+    EXPECT_EQ(loaded.data<float>()[i], i);
+  }
+  EXPECT_EQ(load_ws.GetBlob("name")->Get<string>(), "model");
+  std::remove(filename.c_str());
+}
+
+TEST(LoadSaveOpTest, AsyncCheckpointError) {
+  Workspace ws;
+  InitBlobs(&ws);
+  // The db is only opened in the background, so the error is reported by the
+  // barrier, and only once.
+  ASSERT_TRUE(ws.RunOperatorOnce(
+      CheckpointDef(std::tmpnam(nullptr), "not_a_db_type")));
+  OperatorDef barrier_def;
+  barrier_def.set_type("CheckpointBarrier");
+  EXPECT_THROW(ws.RunOperatorOnce(barrier_def), EnforceNotMet);
+  EXPECT_TRUE(ws.RunOperatorOnce(barrier_def));
+}
+
+TEST(LoadSaveOpTest, LoadFromSeveralDBs) {
+  const vector<string> dbs{
+      std::tmpnam(nullptr), std::tmpnam(nullptr), std::tmpnam(nullptr)};
+  Workspace ws;
+  AddTensor(&ws, "a", 10, 0);
+  AddTensor(&ws, "b", 100, 1);
+  AddTensor(&ws, "c", 1000, 2);
+  *ws.CreateBlob("name")->GetMutable<string>() = "model";
+  Save(&ws, {"a", "b"}, dbs[0], "minidb");
+  Save(&ws, {"c"}, dbs[1], "minidb");
+  Save(&ws, {"name"}, dbs[2], "minidb");
+
+  Workspace outputs_ws;
+  ASSERT_TRUE(outputs_ws.RunOperatorOnce(
+      LoadDef({"name", "a", "c"}, dbs, "minidb")));
+  ExpectTensor(&outputs_ws, "a", 10, 0);
+  ExpectTensor(&outputs_ws, "c", 1000, 2);
+  EXPECT_EQ(outputs_ws.GetBlob("name")->Get<string>(), "model");
+  EXPECT_FALSE(outputs_ws.HasBlob("b"));
+
+  Workspace all_ws;
+  ASSERT_TRUE(all_ws.RunOperatorOnce(LoadDef({}, dbs, "minidb")));
+  ExpectTensor(&all_ws, "a", 10, 0);
+  ExpectTensor(&all_ws, "b", 100, 1);
+  ExpectTensor(&all_ws, "c", 1000, 2);
+  EXPECT_EQ(all_ws.GetBlob("name")->Get<string>(), "model");
+
+  // A missing output is still reported.
+  Workspace missing_ws;
+  EXPECT_THROW(
+      missing_ws.RunOperatorOnce(LoadDef({"a", "d"}, dbs, "minidb")),
+      EnforceNotMet);
+  for (const string& db : dbs) {
+    std::remove(db.c_str());
+  }
+}
+
+TEST(LoadSaveOpTest, BlobInSeveralDBs) {
+  const vector<string> dbs{std::tmpnam(nullptr), std::tmpnam(nullptr)};
+  Workspace ws;
+  AddTensor(&ws, "a", 10, 0);
+  Save(&ws, {"a"}, dbs[0], "minidb");
+  Save(&ws, {"a"}, dbs[1], "minidb");
+  Workspace load_ws;
+  EXPECT_THROW(
+      load_ws.RunOperatorOnce(LoadDef({}, dbs, "minidb")), EnforceNotMet);
+  for (const string& db : dbs) {
+    std::remove(db.c_str());
+  }
+}
+
+TEST(LoadSaveOpTest, LoadByKey) {
+  Workspace ws;
+  vector<string> blobs;
+  for (int i = 0; i < 20; ++i) {
+    blobs.push_back("w" + caffe2::to_string(i));
+    AddTensor(&ws, blobs.back(), 10, i);
+  }
+  // "w!" sorts between "w" and the keys of the chunks of "w".
+  AddTensor(&ws, "w", 10, 100);
+  AddTensor(&ws, "w!", 10, 200);
+  blobs.push_back("w");
+  blobs.push_back("w!");
+  Save(&ws, blobs, "first", "load_save_seek_db");
+  Save(&ws, {"w"}, "second", "load_save_seek_db");
+
+  Workspace load_ws;
+  db::seek_db_steps = 0;
+  ASSERT_TRUE(load_ws.RunOperatorOnce(
+      LoadDef({"w3", "w", "w17"}, {"first"}, "load_save_seek_db")));
+  ExpectTensor(&load_ws, "w3", 10, 3);
+  ExpectTensor(&load_ws, "w17", 10, 17);
+  ExpectTensor(&load_ws, "w", 10, 100);
+  // Only the entries of the outputs were read.
+  EXPECT_EQ(db::seek_db_steps, 3);
+
+  // Without the key index, the db is scanned.
+  OperatorDef scan_def =
+      LoadDef({"w3", "w", "w17"}, {"first"}, "load_save_seek_db");
+  AddArgument<int>("use_key_index", 0, &scan_def);
+  db::seek_db_steps = 0;
+  ASSERT_TRUE(load_ws.RunOperatorOnce(scan_def));
+  ExpectTensor(&load_ws, "w", 10, 100);
+  EXPECT_GT(db::seek_db_steps, 3);
+
+  // The outputs are looked up in every db.
+  ASSERT_TRUE(load_ws.RunOperatorOnce(
+      LoadDef({"w3", "w!"}, {"second", "first"}, "load_save_seek_db")));
+  ExpectTensor(&load_ws, "w3", 10, 3);
+  ExpectTensor(&load_ws, "w!", 10, 200);
+}
+
+} // namespace caffe2
@@ -0,0 +1,36 @@
+#include "caffe2/operators/lstm_op.h"
+
+namespace caffe2 {
+
+namespace {
+REGISTER_CPU_OPERATOR(LSTM, LSTMOp<float, CPUContext>);
+OPERATOR_SCHEMA(LSTM)
+    .NumInputs(6, 7)
+    .NumOutputs(3)
+    .SetDoc(R"DOC(
+LSTM runs a standard LSTM (without peephole connections) over a whole
+sequence. It computes the same activations as a RecurrentNetwork whose
+step net is an FC followed by LSTMUnit, but does the input projection of
+all the timesteps in one GEMM, and runs the timesteps in a single loop
+without a step net.
+
+The gates are in the order input, forget, output, cell, as in LSTMUnit.
+Timesteps at or past the sequence length of an item keep its hidden and
+cell state. Given seq_lengths, the op runs the items in order of decreasing
+length and drops them from the batch as their sequences end, so that the
+padding of shorter sequences costs no computation.
+)DOC")
+    .Input(0, "input", "Input sequence of shape (T, N, input_size)")
+    .Input(1, "hidden_init", "Initial hidden state of shape (1, N, D)")
+    .Input(2, "cell_init", "Initial cell state of shape (1, N, D)")
+    .Input(3, "weight_input", "Input weights of shape (4 * D, input_size)")
+    .Input(4, "weight_recurrent", "Recurrent weights of shape (4 * D, D)")
+    .Input(5, "bias", "Gate bias of shape (4 * D)")
+    .Input(6, "seq_lengths", "Optional int32 sequence lengths of shape (N)")
+    .Output(0, "output", "Hidden states of all timesteps, (T, N, D)")
+    .Output(1, "hidden_output", "Final hidden state of shape (1, N, D)")
+    .Output(2, "cell_output", "Final cell state of shape (1, N, D)");
+NO_GRADIENT(LSTM);
+}
+
+} // namespace caffe2
@@ -0,0 +1,251 @@
+#ifndef CAFFE2_OPERATORS_LSTM_OP_H_
+#define CAFFE2_OPERATORS_LSTM_OP_H_
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/lstm_unit_op.h"
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+
+// Runs a whole LSTM sequence in one operator. The input projection of all
+// the timesteps is a single GEMM. Each timestep then only adds the
+// recurrent projection and applies the gates with detail::LSTMUnit. With
+// sequence lengths, the batch is sorted by length and shrinks as sequences
+// end, so that no gates are computed for padding.
+template <typename T, class Context>
+class LSTMOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  using Operator<Context>::Operator;
+
+  bool RunOnDevice() override {
+    const auto& X = Input(INPUT);
+    const auto& W = Input(WEIGHT_INPUT);
+    const auto& R = Input(WEIGHT_RECURRENT);
+    const auto& b = Input(BIAS);
+    CAFFE_ENFORCE_EQ(X.ndim(), 3);
+    const int seqLen = X.dim32(0);
+    const int batchSize = X.dim32(1);
+    const int inputSize = X.dim32(2);
+    CAFFE_ENFORCE_EQ(W.ndim(), 2);
+    const int G = W.dim32(0);
+    CAFFE_ENFORCE_EQ(G % 4, 0, "The weights must have 4 * hidden_size rows");
+    const int D = G / 4;
+    CAFFE_ENFORCE_EQ(W.dim32(1), inputSize);
+    CAFFE_ENFORCE_EQ(R.ndim(), 2);
+    CAFFE_ENFORCE_EQ(R.dim32(0), G);
+    CAFFE_ENFORCE_EQ(R.dim32(1), D);
+    CAFFE_ENFORCE_EQ(b.size(), G);
+    const auto& hiddenInput = Input(HIDDEN_INPUT);
+    const auto& cellInput = Input(CELL_INPUT);
+    CAFFE_ENFORCE_EQ(hiddenInput.size(), batchSize * D);
+    CAFFE_ENFORCE_EQ(cellInput.size(), batchSize * D);
+
+    planBatch(seqLen, batchSize);
+    const int numRows = offsets_[seqLen];
+
+    // The rows of X that are within their sequence, packed by timestep:
+    // step t has the rows offsets_[t], ..., offsets_[t + 1] - 1. Padding is
+    // not copied, so the projection below does not compute gates for it.
+    const T* inputRows = X.template data<T>();
+    if (numRows < seqLen * batchSize || !inOrder_) {
+      packedInput_.Resize(numRows, inputSize);
+      T* packed = packedInput_.template mutable_data<T>();
+      for (int t = 0; t < seqLen; ++t) {
+        const T* X_t = X.template data<T>() + t * batchSize * inputSize;
+        T* packed_t = packed + offsets_[t] * inputSize;
+        if (inOrder_) {
+          context_.template Copy<T, Context, Context>(
+              active_[t] * inputSize, X_t, packed_t);
+          continue;
+        }
+        for (int i = 0; i < active_[t]; ++i) {
+          context_.template Copy<T, Context, Context>(
+              inputSize,
+              X_t + order_[i] * inputSize,
+              packed_t + i * inputSize);
+        }
+      }
+      inputRows = packed;
+    }
+
+    // gates = X * W^T + b, for all the timesteps at once.
+    gates_.Resize(numRows, G);
+    T* gates = gates_.template mutable_data<T>();
+    if (numRows > 0) {
+      if (biasMultiplier_.size() != numRows) {
+        biasMultiplier_.Resize(numRows);
+        math::Set<T, Context>(
+            numRows,
+            static_cast<T>(1),
+            biasMultiplier_.template mutable_data<T>(),
+            &context_);
+      }
+      math::Gemm<T, Context>(
+          CblasNoTrans,
+          CblasNoTrans,
+          numRows,
+          G,
+          1,
+          1,
+          biasMultiplier_.template data<T>(),
+          b.template data<T>(),
+          0,
+          gates,
+          &context_);
+      math::Gemm<T, Context>(
+          CblasNoTrans,
+          CblasTrans,
+          numRows,
+          G,
+          inputSize,
+          1,
+          inputRows,
+          W.template data<T>(),
+          1,
+          gates,
+          &context_);
+    }
+
+    // The states are kept in the order of order_, and updated in place:
+    // only the first active_[t] rows change at step t, the others keep the
+    // state of the end of their sequence.
+    hidden_.Resize(batchSize, D);
+    cell_.Resize(batchSize, D);
+    T* H = hidden_.template mutable_data<T>();
+    T* C = cell_.template mutable_data<T>();
+    gatherRows(batchSize, D, hiddenInput.template data<T>(), H);
+    gatherRows(batchSize, D, cellInput.template data<T>(), C);
+    auto* output = Output(OUTPUT);
+    output->Resize(seqLen, batchSize, D);
+    for (int t = 0; t < seqLen; ++t) {
+      const int active = active_[t];
+      T* gates_t = gates + offsets_[t] * G;
+      if (active > 0) {
+        math::Gemm<T, Context>(
+            CblasNoTrans,
+            CblasTrans,
+            active,
+            G,
+            D,
+            1,
+            H,
+            R.template data<T>(),
+            1,
+            gates_t,
+            &context_);
+        detail::LSTMUnit<T, Context>(
+            active,
+            D,
+            t,
+            H,
+            C,
+            gates_t,
+            sortedLengths_.data(),
+            C,
+            H,
+            &context_);
+      }
+      scatterRows(
+          batchSize,
+          D,
+          H,
+          output->template mutable_data<T>() + t * batchSize * D);
+    }
+
+    auto* hiddenOutput = Output(HIDDEN_OUTPUT);
+    hiddenOutput->Resize(1, batchSize, D);
+    scatterRows(batchSize, D, H, hiddenOutput->template mutable_data<T>());
+    auto* cellOutput = Output(CELL_OUTPUT);
+    cellOutput->Resize(1, batchSize, D);
+    scatterRows(batchSize, D, C, cellOutput->template mutable_data<T>());
+    return true;
+  }
+
+ protected:
+  INPUT_TAGS(
+      INPUT,
+      HIDDEN_INPUT,
+      CELL_INPUT,
+      WEIGHT_INPUT,
+      WEIGHT_RECURRENT,
+      BIAS,
+      SEQ_LENGTHS);
+  OUTPUT_TAGS(OUTPUT, HIDDEN_OUTPUT, CELL_OUTPUT);
+
+  // Runs the sequences in order of decreasing length, so that the ones
+  // still running at step t are the first active_[t] rows of the states.
+  void planBatch(int seqLen, int batchSize) {
+    std::vector<int32_t> lengths(batchSize, seqLen);
+    if (InputSize() > SEQ_LENGTHS) {
+      const auto& seqLengths = Input(SEQ_LENGTHS);
+      CAFFE_ENFORCE_EQ(seqLengths.size(), batchSize);
+      context_.template Copy<int32_t, Context, CPUContext>(
+          batchSize, seqLengths.template data<int32_t>(), lengths.data());
+    }
+    order_.resize(batchSize);
+    std::iota(order_.begin(), order_.end(), 0);
+    std::stable_sort(order_.begin(), order_.end(), [&](int a, int b) {
+      return lengths[a] > lengths[b];
+    });
+    inOrder_ = std::is_sorted(order_.begin(), order_.end());
+    sortedLengths_.resize(batchSize);
+    for (int i = 0; i < batchSize; ++i) {
+      sortedLengths_[i] = lengths[order_[i]];
+    }
+    active_.resize(seqLen);
+    offsets_.assign(1, 0);
+    int active = batchSize;
+    for (int t = 0; t < seqLen; ++t) {
+      while (active > 0 && sortedLengths_[active - 1] <= t) {
+        --active;
+      }
+      active_[t] = active;
+      offsets_.push_back(offsets_[t] + active);
+    }
+  }
+
+  // dst[i] = src[order_[i]], for rows of D.
+  void gatherRows(int rows, int D, const T* src, T* dst) {
+    if (inOrder_) {
+      context_.template Copy<T, Context, Context>(rows * D, src, dst);
+      return;
+    }
+    for (int i = 0; i < rows; ++i) {
+      context_.template Copy<T, Context, Context>(
+          D, src + order_[i] * D, dst + i * D);
+    }
+  }
+
+  // dst[order_[i]] = src[i], for rows of D.
+  void scatterRows(int rows, int D, const T* src, T* dst) {
+    if (inOrder_) {
+      context_.template Copy<T, Context, Context>(rows * D, src, dst);
+      return;
+    }
+    for (int i = 0; i < rows; ++i) {
+      context_.template Copy<T, Context, Context>(
+          D, src + i * D, dst + order_[i] * D);
+    }
+  }
+
+  Tensor<Context> packedInput_;
+  Tensor<Context> gates_;
+  Tensor<Context> hidden_;
+  Tensor<Context> cell_;
+  Tensor<Context> biasMultiplier_;
+  std::vector<int> order_;
+  bool inOrder_{true};
+  std::vector<int32_t> sortedLengths_;
+  std::vector<int> active_;
+  std::vector<int> offsets_;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_LSTM_OP_H_
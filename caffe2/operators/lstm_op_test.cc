@@ -0,0 +1,141 @@
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+float Sigmoid(float x) {
+  return 1.0f / (1.0f + std::exp(-x));
+}
+
+// Computes the hidden states of every timestep one element at a time.
+vector<float> ReferenceLSTM(
+    const TensorCPU& X,
+    const TensorCPU& H0,
+    const TensorCPU& C0,
+    const TensorCPU& W,
+    const TensorCPU& R,
+    const TensorCPU& b,
+    const vector<int>& lengths) {
+  const int T = X.dim32(0);
+  const int N = X.dim32(1);
+  const int K = X.dim32(2);
+  const int D = R.dim32(1);
+  vector<float> h(H0.data<float>(), H0.data<float>() + N * D);
+  vector<float> c(C0.data<float>(), C0.data<float>() + N * D);
+  vector<float> output;
+  vector<float> gates(4 * D);
+  for (int t = 0; t < T; ++t) {
+    vector<float> next_h = h;
+    for (int n = 0; n < N; ++n) {
+      if (t >= lengths[n]) {
+        continue;
+      }
+      for (int g = 0; g < 4 * D; ++g) {
+        float sum = b.data<float>()[g];
+        for (int k = 0; k < K; ++k) {
+          sum += X.data<float>()[(t * N + n) * K + k] *
+              W.data<float>()[g * K + k];
+        }
+        for (int d = 0; d < D; ++d) {
+          sum += h[n * D + d] * R.data<float>()[g * D + d];
+        }
+        gates[g] = sum;
+      }
+      for (int d = 0; d < D; ++d) {
+        const float i = Sigmoid(gates[d]);
+        const float f = Sigmoid(gates[D + d]);
+        const float o = Sigmoid(gates[2 * D + d]);
+        const float g = std::tanh(gates[3 * D + d]);
+        c[n * D + d] = f * c[n * D + d] + i * g;
+        next_h[n * D + d] = o * std::tanh(c[n * D + d]);
+      }
+    }
+    h = next_h;
+    output.insert(output.end(), h.begin(), h.end());
+  }
+  output.insert(output.end(), c.begin(), c.end());
+  return output;
+}
+
+} // namespace
+
+TEST(LSTMTest, MatchesReference) {
+  std::mt19937 gen(0);
+  const int T = 5;
+  const int N = 3;
+  const int K = 7;
+  for (int D : {4, 300}) {
+    // No lengths, sorted lengths, and unsorted ones longer than the input.
+    for (const auto& itemLengths :
+         vector<vector<int>>{{}, {T, 2, 0}, {2, T + 3, 0}}) {
+      Workspace ws;
+      AddRandomTensor(&ws, "X", {T, N, K}, &gen);
+      AddRandomTensor(&ws, "H0", {1, N, D}, &gen);
+      AddRandomTensor(&ws, "C0", {1, N, D}, &gen);
+      AddRandomTensor(&ws, "W", {4 * D, K}, &gen);
+      AddRandomTensor(&ws, "R", {4 * D, D}, &gen);
+      AddRandomTensor(&ws, "b", {4 * D}, &gen);
+      OperatorDef def;
+      def.set_type("LSTM");
+      for (const char* input : {"X", "H0", "C0", "W", "R", "b"}) {
+        def.add_input(input);
+      }
+      vector<int> lengths(N, T);
+      if (!itemLengths.empty()) {
+        lengths = itemLengths;
+        auto* tensor = ws.CreateBlob("lengths")->GetMutable<TensorCPU>();
+        tensor->Resize(N);
+        for (int n = 0; n < N; ++n) {
+          tensor->mutable_data<int32_t>()[n] = lengths[n];
+        }
+        def.add_input("lengths");
+      }
+      def.add_output("Y");
+      def.add_output("H");
+      def.add_output("C");
+      ASSERT_TRUE(ws.RunOperatorOnce(def));
+
+      const auto expected = ReferenceLSTM(
+          ws.GetBlob("X")->Get<TensorCPU>(),
+          ws.GetBlob("H0")->Get<TensorCPU>(),
+          ws.GetBlob("C0")->Get<TensorCPU>(),
+          ws.GetBlob("W")->Get<TensorCPU>(),
+          ws.GetBlob("R")->Get<TensorCPU>(),
+          ws.GetBlob("b")->Get<TensorCPU>(),
+          lengths);
+      const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+      const auto& H = ws.GetBlob("H")->Get<TensorCPU>();
+      const auto& C = ws.GetBlob("C")->Get<TensorCPU>();
+      ASSERT_EQ(Y.size(), T * N * D);
+      ASSERT_EQ(H.size(), N * D);
+      ASSERT_EQ(C.size(), N * D);
+      for (int i = 0; i < Y.size(); ++i) {
+        EXPECT_NEAR(Y.data<float>()[i], expected[i], 1e-4);
+      }
+      for (int i = 0; i < N * D; ++i) {
+        EXPECT_NEAR(H.data<float>()[i], expected[(T - 1) * N * D + i], 1e-4);
+        EXPECT_NEAR(C.data<float>()[i], expected[T * N * D + i], 1e-4);
+      }
+    }
+  }
+}
+
+} // namespace caffe2
@@ -1,6 +1,55 @@
 #include "lstm_unit_op.h"
 
 namespace caffe2 {
+namespace detail {
+
+template <>
+void LSTMUnit<float, CPUContext>(
+    int N,
+    int D,
+    int t,
+    const float* H_prev,
+    const float* C_prev,
+    const float* X,
+    const int32_t* seqLengths,
+    float* C,
+    float* H,
+    CPUContext* context) {
+  // Activations of the i, f and o gates, then of g, for one block of D.
+  constexpr int kBlock = 256;
+  float sigmoid_ifo[3][kBlock];
+  float tanh_g[kBlock];
+  for (int n = 0; n < N; ++n) {
+    if (t >= seqLengths[n]) {
+      context->Copy<float, CPUContext, CPUContext>(D, H_prev, H);
+      context->Copy<float, CPUContext, CPUContext>(D, C_prev, C);
+    } else {
+      for (int d0 = 0; d0 < D; d0 += kBlock) {
+        const int block = std::min(kBlock, D - d0);
+        for (int gate = 0; gate < 3; ++gate) {
+          math::Sigmoid<float, CPUContext>(
+              block, X + gate * D + d0, sigmoid_ifo[gate], context);
+        }
+        math::Tanh<float, CPUContext>(block, X + 3 * D + d0, tanh_g, context);
+        for (int d = 0; d < block; ++d) {
+          C[d0 + d] = sigmoid_ifo[1][d] * C_prev[d0 + d] +
+              sigmoid_ifo[0][d] * tanh_g[d];
+        }
+        math::Tanh<float, CPUContext>(block, C + d0, H + d0, context);
+        for (int d = 0; d < block; ++d) {
+          H[d0 + d] *= sigmoid_ifo[2][d];
+        }
+      }
+    }
+    H_prev += D;
+    C_prev += D;
+    X += 4 * D;
+    C += D;
+    H += D;
+  }
+}
+
+} // namespace detail
 
 namespace {
 REGISTER_CPU_OPERATOR(LSTMUnit, LSTMUnitOp<float, CPUContext>);
@@ -3,6 +3,7 @@
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/utils/math.h"
 
 namespace caffe2 {
 namespace detail {
@@ -55,6 +56,21 @@ void LSTMUnit(
   }
 }
 
+// The CPU version computes the gate activations a block of D at a time with
+// math::Sigmoid and math::Tanh, so that they are vectorized.
+template <>
+void LSTMUnit<float, CPUContext>(
+    int N,
+    int D,
+    int t,
+    const float* H_prev,
+    const float* C_prev,
+    const float* X,
+    const int32_t* seqLengths,
+    float* C,
+    float* H,
+    CPUContext* context);
+
 template <typename T, typename Context>
 void LSTMUnitGradient(
     int N,
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cmath>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+
+namespace {
+
+// The positions of a padded (T, N, ...) or (N, T, ...) tensor: row t of
+// item n is at Index(t, n), and is within its sequence if t < lengths[n].
+class PaddedRows {
+ public:
+  PaddedRows(const TensorCPU& X, const TensorCPU& lengths, bool batchMajor)
+      : batchMajor_(batchMajor) {
+    CAFFE_ENFORCE_GE(X.ndim(), 3, "X must be (T, N, D) or (N, T, D).");
+    T_ = X.dim32(batchMajor ? 1 : 0);
+    N_ = X.dim32(batchMajor ? 0 : 1);
+    CAFFE_ENFORCE_EQ(lengths.ndim(), 1);
+    CAFFE_ENFORCE_EQ(lengths.dim32(0), N_, "One length per item expected.");
+    lengths_ = lengths.data<int32_t>();
+  }
+
+  int T() const {
+    return T_;
+  }
+  int N() const {
+    return N_;
+  }
+  int Length(int n) const {
+    return std::max(0, std::min(T_, lengths_[n]));
+  }
+  int Index(int t, int n) const {
+    return batchMajor_ ? n * T_ + t : t * N_ + n;
+  }
+  int NumValid() const {
+    int count = 0;
+    for (int n = 0; n < N_; ++n) {
+      count += Length(n);
+    }
+    return count;
+  }
+
+ private:
+  bool batchMajor_;
+  int T_;
+  int N_;
+  const int32_t* lengths_;
+};
+
+// Softmax and cross entropy of the rows of a padded tensor of logits,
+// which only computes the rows within their sequences.
+class MaskedSoftmaxWithLossOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  MaskedSoftmaxWithLossOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        batchMajor_(OperatorBase::GetSingleArgument<int>("batch_major", 0)) {}
+
+  bool RunOnDevice() override {
+    const auto& X = Input(0);
+    const auto& labels = Input(1);
+    const PaddedRows rows(X, Input(2), batchMajor_);
+    const int D = X.size_from_dim(2);
+    CAFFE_ENFORCE_EQ(labels.size(), rows.T() * rows.N());
+    auto* P = Output(0);
+    auto* avgLoss = Output(1);
+    P->ResizeLike(X);
+    avgLoss->Resize(vector<TIndex>());
+    const float* Xdata = X.data<float>();
+    const int32_t* labelData = labels.data<int32_t>();
+    float* Pdata = P->mutable_data<float>();
+
+    float loss = 0;
+    for (int n = 0; n < rows.N(); ++n) {
+      const int length = rows.Length(n);
+      for (int t = 0; t < rows.T(); ++t) {
+        const int i = rows.Index(t, n);
+        float* P_i = Pdata + i * D;
+        if (t >= length) {
+          math::Set<float, CPUContext>(D, 0, P_i, &context_);
+          continue;
+        }
+        const int label = labelData[i];
+        CAFFE_ENFORCE(label >= 0 && label < D, "Invalid label: ", label);
+        ConstEigenVectorArrayMap<float> X_i(Xdata + i * D, D);
+        const float max = X_i.maxCoeff();
+        EigenVectorArrayMap<float> expX(P_i, D);
+        expX = (X_i - max).exp();
+        const float sum = expX.sum();
+        expX /= sum;
+        // -log(P[label]), without the underflow of log(P[label]).
+        loss += std::log(sum) - (X_i(label) - max);
+      }
+    }
+    const int numValid = rows.NumValid();
+    avgLoss->mutable_data<float>()[0] = numValid > 0 ? loss / numValid : 0;
+    return true;
+  }
+
+ private:
+  bool batchMajor_;
+};
+
+class MaskedSoftmaxWithLossGradientOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  MaskedSoftmaxWithLossGradientOp(
+      const OperatorDef& operator_def,
+      Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        batchMajor_(OperatorBase::GetSingleArgument<int>("batch_major", 0)) {}
+
+  bool RunOnDevice() override {
+    const auto& X = Input(0);
+    const auto& labels = Input(1);
+    const PaddedRows rows(X, Input(2), batchMajor_);
+    const auto& P = Input(3);
+    const auto& dAvgLoss = Input(4);
+    const int D = X.size_from_dim(2);
+    CAFFE_ENFORCE(P.dims() == X.dims());
+    auto* dX = Output(0);
+    dX->ResizeLike(X);
+    const int numValid = rows.NumValid();
+    const float scale =
+        numValid > 0 ? dAvgLoss.data<float>()[0] / numValid : 0;
+    const int32_t* labelData = labels.data<int32_t>();
+    const float* Pdata = P.data<float>();
+    float* dXdata = dX->mutable_data<float>();
+    for (int n = 0; n < rows.N(); ++n) {
+      const int length = rows.Length(n);
+      for (int t = 0; t < rows.T(); ++t) {
+        const int i = rows.Index(t, n);
+        float* dX_i = dXdata + i * D;
+        if (t >= length) {
+          math::Set<float, CPUContext>(D, 0, dX_i, &context_);
+          continue;
+        }
+        math::Scale<float, CPUContext>(
+            D, scale, Pdata + i * D, dX_i, &context_);
+        dX_i[labelData[i]] -= scale;
+      }
+    }
+    return true;
+  }
+
+ private:
+  bool batchMajor_;
+};
+
+REGISTER_CPU_OPERATOR(MaskedSoftmaxWithLoss, MaskedSoftmaxWithLossOp);
+REGISTER_CPU_OPERATOR(
+    MaskedSoftmaxWithLossGradient,
+    MaskedSoftmaxWithLossGradientOp);
+
+OPERATOR_SCHEMA(MaskedSoftmaxWithLoss)
+    .NumInputs(3)
+    .NumOutputs(2)
+    .SetDoc(R"DOC(
+Combined softmax and cross entropy loss over a padded batch of sequences,
+such as the output of a RecurrentNetwork, LSTM, AddPadding or PackSegments.
+Only the positions within the length of their sequence are computed: the
+softmax of the padding is zero, and the loss is the average over the other
+positions. This gives the same loss as SoftmaxWithLoss with a weight of zero
+for the padding, without computing the softmax of the padding.
+)DOC")
+    .Arg(
+        "batch_major",
+        "If nonzero, the inputs are (N, T, ...) rather than (T, N, ...).")
+    .Input(0, "logits", "Padded logits of shape (T, N, D)")
+    .Input(1, "labels", "Int32 labels of shape (T, N)")
+    .Input(2, "lengths", "Int32 sequence lengths of shape (N)")
+    .Output(0, "softmax", "Softmax of the logits, zero for the padding")
+    .Output(1, "loss", "Average loss over the positions within a sequence");
+
+OPERATOR_SCHEMA(MaskedSoftmaxWithLossGradient).NumInputs(5).NumOutputs(1);
+
+class GetMaskedSoftmaxWithLossGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    return SingleGradientDef(
+        "MaskedSoftmaxWithLossGradient",
+        "",
+        vector<string>{I(0), I(1), I(2), O(0), GO(1)},
+        vector<string>{GI(0)});
+  }
+};
+
+REGISTER_GRADIENT(MaskedSoftmaxWithLoss, GetMaskedSoftmaxWithLossGradient);
+
+} // namespace
+
+} // namespace caffe2
@@ -0,0 +1,116 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+template <typename T>
+TensorCPU* AddTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  tensor->mutable_data<T>();
+  return tensor;
+}
+
+OperatorDef Def(
+    const string& type,
+    const vector<string>& inputs,
+    const vector<string>& outputs) {
+  OperatorDef def;
+  def.set_type(type);
+  for (const auto& input : inputs) {
+    def.add_input(input);
+  }
+  for (const auto& output : outputs) {
+    def.add_output(output);
+  }
+  return def;
+}
+
+void ExpectNear(Workspace* ws, const string& expected, const string& actual) {
+  const auto& e = ws->GetBlob(expected)->Get<TensorCPU>();
+  const auto& a = ws->GetBlob(actual)->Get<TensorCPU>();
+  ASSERT_EQ(e.size(), a.size());
+  for (int i = 0; i < e.size(); ++i) {
+    EXPECT_NEAR(e.data<float>()[i], a.data<float>()[i], 1e-5);
+  }
+}
+
+} // namespace
+
+// The loss and its gradient are those of SoftmaxWithLoss with a weight of
+// zero for the padding, in both layouts.
+TEST(MaskedSoftmaxWithLossTest, MatchesWeightedSoftmaxWithLoss) {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> value(-3, 3);
+  const int T = 4;
+  const int N = 3;
+  const int D = 5;
+  const vector<int> lengths = {2, 0, T};
+  for (bool batchMajor : {false, true}) {
+    Workspace ws;
+    const vector<TIndex> dims =
+        batchMajor ? vector<TIndex>{N, T} : vector<TIndex>{T, N};
+    auto* labels = AddTensor<int32_t>(&ws, "labels", dims);
+    auto* X = AddTensor<float>(&ws, "X", {dims[0], dims[1], D});
+    auto* lengthsTensor = AddTensor<int32_t>(&ws, "lengths", {N});
+    auto* weights = AddTensor<float>(&ws, "weights", {T * N});
+    for (int i = 0; i < X->size(); ++i) {
+      X->mutable_data<float>()[i] = value(gen);
+    }
+    for (int n = 0; n < N; ++n) {
+      lengthsTensor->mutable_data<int32_t>()[n] = lengths[n];
+      for (int t = 0; t < T; ++t) {
+        const int i = batchMajor ? n * T + t : t * N + n;
+        labels->mutable_data<int32_t>()[i] = gen() % D;
+        weights->mutable_data<float>()[i] = t < lengths[n];
+      }
+    }
+    auto* X2D = AddTensor<float>(&ws, "X2D", {T * N, D});
+    X2D->CopyFrom(*X);
+    X2D->Resize(T * N, D);
+    auto* labels1D = AddTensor<int32_t>(&ws, "labels1D", {T * N});
+    labels1D->CopyFrom(*labels);
+    labels1D->Resize(T * N);
+    AddTensor<float>(&ws, "dloss", {})->mutable_data<float>()[0] = 0.7;
+
+    auto masked = Def(
+        "MaskedSoftmaxWithLoss", {"X", "labels", "lengths"}, {"P", "loss"});
+    AddArgument<int>("batch_major", batchMajor, &masked);
+    ASSERT_TRUE(ws.RunOperatorOnce(masked));
+    auto maskedGrad = Def(
+        "MaskedSoftmaxWithLossGradient",
+        {"X", "labels", "lengths", "P", "dloss"},
+        {"dX"});
+    AddArgument<int>("batch_major", batchMajor, &maskedGrad);
+    ASSERT_TRUE(ws.RunOperatorOnce(maskedGrad));
+    ASSERT_TRUE(ws.RunOperatorOnce(Def(
+        "SoftmaxWithLoss",
+        {"X2D", "labels1D", "weights"},
+        {"expected_P", "expected_loss"})));
+    ASSERT_TRUE(ws.RunOperatorOnce(Def(
+        "SoftmaxWithLossGradient",
+        {"X2D", "labels1D", "weights", "expected_P", "dloss"},
+        {"expected_dX"})));
+
+    ExpectNear(&ws, "expected_loss", "loss");
+    ExpectNear(&ws, "expected_dX", "dX");
+    const float* P = ws.GetBlob("P")->Get<TensorCPU>().data<float>();
+    const float* expectedP =
+        ws.GetBlob("expected_P")->Get<TensorCPU>().data<float>();
+    const float* w = weights->data<float>();
+    for (int i = 0; i < T * N; ++i) {
+      for (int d = 0; d < D; ++d) {
+        EXPECT_NEAR(P[i * D + d], w[i] * expectedP[i * D + d], 1e-5);
+      }
+    }
+  }
+}
+
+} // namespace caffe2
@@ -0,0 +1,70 @@
+#include "caffe2/core/net_tracer.h"
+#include "caffe2/core/operator.h"
+
+namespace caffe2 {
+namespace {
+
+class StartNetTraceOp final : public Operator<CPUContext> {
+ public:
+  StartNetTraceOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        path_(OperatorBase::GetSingleArgument<string>(
+            "path",
+            FLAGS_caffe2_trace_path)),
+        runs_(OperatorBase::GetSingleArgument<int>(
+            "runs",
+            FLAGS_caffe2_trace_runs)) {}
+
+  bool RunOnDevice() override {
+    if (!NetTracer::Get()->Start(path_, runs_)) {
+      LOG(WARNING) << "A net trace is in progress already.";
+    }
+    return true;
+  }
+
+ private:
+  const string path_;
+  const int runs_;
+};
+
+class StopNetTraceOp final : public Operator<CPUContext> {
+ public:
+  StopNetTraceOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    NetTracer::Get()->Stop();
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(StartNetTrace, StartNetTraceOp);
+REGISTER_CPU_OPERATOR(StopNetTrace, StopNetTraceOp);
+
+OPERATOR_SCHEMA(StartNetTrace)
+    .NumInputs(0)
+    .NumOutputs(0)
+    .SetDoc(R"DOC(
+Starts a trace of the next top-level net runs, written as Chrome trace JSON
+once they are done. The run of the net that contains this operator is not
+traced, since it started before the trace. Does nothing if a trace is in
+progress already.
+)DOC")
+    .Arg(
+        "path",
+        "The file to write the trace to; --caffe2_trace_path if unset.")
+    .Arg("runs", "The number of runs to trace; --caffe2_trace_runs if unset.");
+
+OPERATOR_SCHEMA(StopNetTrace)
+    .NumInputs(0)
+    .NumOutputs(0)
+    .SetDoc(R"DOC(
+Ends the net trace in progress, if any, and writes it out before it has
+covered all its runs.
+)DOC");
+
+SHOULD_NOT_DO_GRADIENT(StartNetTrace);
+SHOULD_NOT_DO_GRADIENT(StopNetTrace);
+
+} // namespace
+} // namespace caffe2
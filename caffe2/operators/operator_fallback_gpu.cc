@@ -0,0 +1,62 @@
+#include "caffe2/operators/operator_fallback_gpu.h"
+
+#include <memory>
+#include <mutex>
+
+CAFFE2_DEFINE_bool(
+    caffe2_gpu_fallback_cache_inputs,
+    true,
+    "If set, GPU fallback ops do not copy again the inputs whose blob version "
+    "did not change since their last run.");
+
+namespace caffe2 {
+
+namespace {
+std::mutex& CountersMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::map<string, std::unique_ptr<detail::GPUFallbackCopyCounters>>&
+Counters() {
+  static std::map<string, std::unique_ptr<detail::GPUFallbackCopyCounters>>
+      counters;
+  return counters;
+}
+} // namespace
+
+namespace detail {
+GPUFallbackCopyCounters* GetGPUFallbackCopyCounters(const string& op_type) {
+  std::lock_guard<std::mutex> lock(CountersMutex());
+  auto& counters = Counters()[op_type];
+  if (!counters) {
+    counters.reset(new GPUFallbackCopyCounters());
+  }
+  return counters.get();
+}
+} // namespace detail
+
+std::map<string, GPUFallbackCopyStats> GetGPUFallbackCopyStats() {
+  std::lock_guard<std::mutex> lock(CountersMutex());
+  std::map<string, GPUFallbackCopyStats> stats;
+  for (const auto& it : Counters()) {
+    auto& op_stats = stats[it.first];
+    op_stats.runs = it.second->runs;
+    op_stats.bytes_to_cpu = it.second->bytes_to_cpu;
+    op_stats.bytes_to_gpu = it.second->bytes_to_gpu;
+    op_stats.bytes_reused = it.second->bytes_reused;
+  }
+  return stats;
+}
+
+void ResetGPUFallbackCopyStats() {
+  std::lock_guard<std::mutex> lock(CountersMutex());
+  for (auto& it : Counters()) {
+    it.second->runs = 0;
+    it.second->bytes_to_cpu = 0;
+    it.second->bytes_to_gpu = 0;
+    it.second->bytes_reused = 0;
+  }
+}
+
+} // namespace caffe2
@@ -1,14 +1,45 @@
 #ifndef CAFFE2_OPERATORS_OPERATOR_FALLBACK_H_
 #define CAFFE2_OPERATORS_OPERATOR_FALLBACK_H_
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+
 #include "caffe2/core/common.h"
 #include "caffe2/core/context.h"
 #include "caffe2/core/context_gpu.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/proto/caffe2.pb.h"
 
+CAFFE2_DECLARE_bool(caffe2_gpu_fallback_cache_inputs);
+
 namespace caffe2 {
 
+// The copies made by the GPUFallbackOps of one operator type since the last
+// ResetGPUFallbackCopyStats(), to find the ops that most need a CUDA kernel.
+struct GPUFallbackCopyStats {
+  int64_t runs = 0;
+  int64_t bytes_to_cpu = 0;
+  int64_t bytes_to_gpu = 0;
+  // Input bytes that were not copied because the input had not changed.
+  int64_t bytes_reused = 0;
+};
+
+std::map<string, GPUFallbackCopyStats> GetGPUFallbackCopyStats();
+void ResetGPUFallbackCopyStats();
+
+namespace detail {
+struct GPUFallbackCopyCounters {
+  std::atomic<int64_t> runs{0};
+  std::atomic<int64_t> bytes_to_cpu{0};
+  std::atomic<int64_t> bytes_to_gpu{0};
+  std::atomic<int64_t> bytes_reused{0};
+};
+
+// The counters of an operator type, which live until the end of the process.
+GPUFallbackCopyCounters* GetGPUFallbackCopyCounters(const string& op_type);
+} // namespace detail
+
 /**
  * @brief A templated class to allow one to wrap a CPU operator as a CUDA
  * operator.
@@ -21,6 +52,13 @@ namespace caffe2 {
  *
  * All the input and output of the original operator should be TensorCPU.
  *
+ * To keep the overhead down, the inputs are copied into pinned staging
+ * tensors and the outputs copied back from pinned tensors, all asynchronously
+ * on the stream of the op, which is only synchronized before the CPU op runs.
+ * An input whose blob version did not change since the last run is not copied
+ * again, unless --caffe2_gpu_fallback_cache_inputs is turned off. The bytes
+ * copied are accounted per operator type in GetGPUFallbackCopyStats().
+ *
  * Example usage: if you have a class MyMagicOp that is CPU based, and you use
  * the registration code
  *     REGISTER_CPU_OPERATOR(MyMagic, MyMagicOp);
@@ -51,22 +89,55 @@ class GPUFallbackOp final : public Operator<CUDAContext> {
     for (const string& name : def.input()) {
       local_input_blobs_.push_back(local_ws_.CreateBlob(name));
       CHECK_NOTNULL(local_input_blobs_.back());
+      // The staging tensor of an in-place input is overwritten by the base op,
+      // so it can never be reused.
+      cacheable_inputs_.push_back(
+          FLAGS_caffe2_gpu_fallback_cache_inputs &&
+          std::find(def.output().begin(), def.output().end(), name) ==
+              def.output().end());
     }
+    input_versions_.resize(def.input_size());
+    input_sources_.resize(def.input_size(), nullptr);
     base_op_.reset(new CPUOp(base_def_, &local_ws_));
     for (const string& name : def.output()) {
       local_output_blobs_.push_back(local_ws_.GetBlob(name));
       CHECK_NOTNULL(local_output_blobs_.back());
+      // In-place outputs may share the storage of a CPU input.
+      pinnable_outputs_.push_back(
+          std::find(def.input().begin(), def.input().end(), name) ==
+          def.input().end());
     }
+    counters_ = detail::GetGPUFallbackCopyCounters(def.type());
   }
 
   bool RunOnDevice() override {
-    bool need_sync = false;
+    // The outputs of the last run may still be being copied from.
+    bool need_sync = outputs_in_flight_;
+    int64_t bytes_to_cpu = 0;
+    int64_t bytes_to_gpu = 0;
+    int64_t bytes_reused = 0;
     for (int i = 0; i < InputSize(); ++i) {
       if (OperatorBase::InputIsType<TensorCUDA>(i)) {
-        local_input_blobs_[i]->template GetMutable<TensorCPU>()->CopyFrom(
-            Input(i), &context_);
+        const Blob* source = OperatorBase::Inputs()[i];
+        const auto& input = Input(i);
+        if (cacheable_inputs_[i] && input_sources_[i] == source &&
+            input_versions_[i] == source->version()) {
+          bytes_reused += input.nbytes();
+          continue;
+        }
+        auto* staging =
+            local_input_blobs_[i]->template GetMutable<TensorCPU>();
+        staging->ResizeLike(input);
+        if (input.size() > 0) {
+          PinnedRawMutableData(staging, input.meta());
+        }
+        staging->CopyFrom(input, &context_);
+        input_sources_[i] = source;
+        input_versions_[i] = source->version();
+        bytes_to_cpu += input.nbytes();
         need_sync = true;
       } else {
+        input_sources_[i] = nullptr;
         VLOG(1) << "Input " << i << " is not TensorCUDA. Skipping copy.";
         // Note(jiayq): This removes a const but conceptually
         // local_input_blobs will only be used as const blob input for the
@@ -80,6 +151,20 @@ class GPUFallbackOp final : public Operator<CUDAContext> {
     // Sync to make sure copies are done.
     if (need_sync) {
       context_.FinishDeviceComputation();
+      outputs_in_flight_ = false;
+    }
+
+    // Outputs that were produced before get pinned storage, which the base op
+    // then reuses for as long as they keep their size.
+    for (int i = 0; i < OutputSize(); ++i) {
+      if (SkipOutputCopy::Contains(i) || !pinnable_outputs_[i] ||
+          !local_output_blobs_[i]->template IsType<TensorCPU>()) {
+        continue;
+      }
+      auto* output = local_output_blobs_[i]->template GetMutable<TensorCPU>();
+      if (output->size() > 0 && output->meta().id() != 0) {
+        PinnedRawMutableData(output, output->meta());
+      }
     }
 
     if (!base_op_->Run()) {
@@ -96,9 +181,15 @@ class GPUFallbackOp final : public Operator<CUDAContext> {
           local_output_blobs_[i]->template IsType<TensorCPU>(),
           "GPU fallback op currently does not support non-TensorCPU "
           "output type who needs copying.");
-      Output(i)->CopyFrom(
-          local_output_blobs_[i]->template Get<TensorCPU>(), &context_);
+      const auto& output = local_output_blobs_[i]->template Get<TensorCPU>();
+      Output(i)->CopyFrom(output, &context_);
+      bytes_to_gpu += output.nbytes();
+      outputs_in_flight_ = true;
     }
+    counters_->runs++;
+    counters_->bytes_to_cpu += bytes_to_cpu;
+    counters_->bytes_to_gpu += bytes_to_gpu;
+    counters_->bytes_reused += bytes_reused;
     return true;
   }
 
@@ -107,6 +198,14 @@ class GPUFallbackOp final : public Operator<CUDAContext> {
   vector<Blob*> local_input_blobs_;
   vector<Blob*> local_output_blobs_;
   std::unique_ptr<CPUOp> base_op_;
+  // For each input, whether its staging tensor can be reused, and the blob and
+  // blob version it was last copied from.
+  vector<bool> cacheable_inputs_;
+  vector<const Blob*> input_sources_;
+  vector<size_t> input_versions_;
+  vector<bool> pinnable_outputs_;
+  bool outputs_in_flight_ = false;
+  detail::GPUFallbackCopyCounters* counters_;
 };
 
 } // namespace caffe2
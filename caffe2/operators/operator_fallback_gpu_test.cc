@@ -79,4 +79,40 @@ TEST(OperatorFallbackTest, GPUIncrementByOneOp) {
   }
 }
 
+TEST(OperatorFallbackTest, GPUFallbackReusesUnchangedInputs) {
+  if (!HasCudaGPU()) return;
+  OperatorDef op_def = CreateOperatorDef(
+      "IncrementByOne", "", vector<string>{"X"},
+      vector<string>{"Y"});
+  op_def.mutable_device_option()->set_device_type(CUDA);
+  Workspace ws;
+  TensorCPU source_tensor(vector<TIndex>{2, 3});
+  for (int i = 0; i < 6; ++i) {
+    source_tensor.mutable_data<float>()[i] = i;
+  }
+  ws.CreateBlob("X")->GetMutable<TensorCUDA>()->CopyFrom(source_tensor);
+  unique_ptr<OperatorBase> op(CreateOperator(op_def, &ws));
+  EXPECT_TRUE(op.get() != nullptr);
+  ResetGPUFallbackCopyStats();
+  EXPECT_TRUE(op->Run());
+  EXPECT_TRUE(op->Run());
+  auto stats = GetGPUFallbackCopyStats()["IncrementByOne"];
+  EXPECT_EQ(stats.runs, 2);
+  EXPECT_EQ(stats.bytes_to_cpu, 6 * sizeof(float));
+  EXPECT_EQ(stats.bytes_reused, 6 * sizeof(float));
+  EXPECT_EQ(stats.bytes_to_gpu, 2 * 6 * sizeof(float));
+
+  // A new value of X is copied again.
+  source_tensor.mutable_data<float>()[0] = 10;
+  ws.GetBlob("X")->GetMutable<TensorCUDA>()->CopyFrom(source_tensor);
+  EXPECT_TRUE(op->Run());
+  TensorCPU output_cpu(ws.GetBlob("Y")->Get<TensorCUDA>());
+  EXPECT_EQ(output_cpu.data<float>()[0], 11);
+  for (int i = 1; i < 6; ++i) {
+    EXPECT_EQ(output_cpu.data<float>()[i], i + 1);
+  }
+  stats = GetGPUFallbackCopyStats()["IncrementByOne"];
+  EXPECT_EQ(stats.bytes_to_cpu, 2 * 6 * sizeof(float));
+}
+
 }  // namespace caffe2
@@ -1,4 +1,5 @@
 #include "caffe2/operators/order_switch_ops.h"
+#include "caffe2/utils/math.h"
 
 namespace caffe2 {
 
@@ -9,14 +10,42 @@ bool NHWC2NCHWOp<float, CPUContext>::RunOnDevice() {
   CAFFE_ENFORCE(X.ndim() == 4);
   const int N = X.dim32(0), H = X.dim32(1), W = X.dim32(2), C = X.dim32(3);
   Y->Resize(N, C, H, W);
+  // Each image is an HW x C matrix to transpose.
+  math::Transpose2D<float, CPUContext>(
+      N, H * W, C, X.data<float>(), Y->mutable_data<float>(), &context_);
+  return true;
+}
+
+template <>
+bool NCHW2NHWCOp<float, CPUContext>::RunOnDevice() {
+  auto& X = Input(0);
+  auto* Y = Output(0);
+  CAFFE_ENFORCE(X.ndim() == 4);
+  const int N = X.dim32(0), C = X.dim32(1), H = X.dim32(2), W = X.dim32(3);
+  Y->Resize(N, H, W, C);
+  // Each image is a C x HW matrix to transpose.
+  math::Transpose2D<float, CPUContext>(
+      N, C, H * W, X.data<float>(), Y->mutable_data<float>(), &context_);
+  return true;
+}
+
+template <>
+bool NCHW2NCHWcOp<float, CPUContext>::RunOnDevice() {
+  auto& X = Input(0);
+  auto* Y = Output(0);
+  CAFFE_ENFORCE(X.ndim() == 4);
+  const int N = X.dim32(0), C = X.dim32(1), H = X.dim32(2), W = X.dim32(3);
+  CAFFE_ENFORCE_EQ(
+      C % block_, 0, "Channels must be a multiple of the block size");
+  const int B = block_;
+  Y->Resize(vector<TIndex>{N, C / B, H, W, B});
   const float* Xdata = X.data<float>();
   float* Ydata = Y->mutable_data<float>();
   for (int n = 0; n < N; ++n) {
-    for (int h = 0; h < H; ++h) {
-      for (int w = 0; w < W; ++w) {
-        for (int c = 0; c < C; ++c) {
-          Ydata[((n * C + c) * H + h) * W + w] = *(Xdata++);
-        }
+    for (int c = 0; c < C; ++c) {
+      float* Yblock = Ydata + (n * (C / B) + c / B) * H * W * B + c % B;
+      for (int hw = 0; hw < H * W; ++hw) {
+        Yblock[hw * B] = *(Xdata++);
       }
     }
   }
@@ -24,30 +53,31 @@ bool NHWC2NCHWOp<float, CPUContext>::RunOnDevice() {
 }
 
 template <>
-bool NCHW2NHWCOp<float, CPUContext>::RunOnDevice() {
+bool NCHWc2NCHWOp<float, CPUContext>::RunOnDevice() {
   auto& X = Input(0);
   auto* Y = Output(0);
-  CAFFE_ENFORCE(X.ndim() == 4);
-  const int N = X.dim32(0), C = X.dim32(1), H = X.dim32(2), W = X.dim32(3);
-  Y->Resize(N, H, W, C);
+  CAFFE_ENFORCE(X.ndim() == 5);
+  const int N = X.dim32(0), H = X.dim32(2), W = X.dim32(3), B = X.dim32(4);
+  const int C = X.dim32(1) * B;
+  Y->Resize(N, C, H, W);
   const float* Xdata = X.data<float>();
   float* Ydata = Y->mutable_data<float>();
   for (int n = 0; n < N; ++n) {
     for (int c = 0; c < C; ++c) {
-      for (int h = 0; h < H; ++h) {
-        for (int w = 0; w < W; ++w) {
-          Ydata[((n * H + h) * W + w) * C + c] = *(Xdata++);
-        }
+      const float* Xblock = Xdata + (n * (C / B) + c / B) * H * W * B + c % B;
+      for (int hw = 0; hw < H * W; ++hw) {
+        *(Ydata++) = Xblock[hw * B];
       }
     }
   }
   return true;
 }
 
-
 namespace {
 REGISTER_CPU_OPERATOR(NHWC2NCHW, NHWC2NCHWOp<float, CPUContext>);
 REGISTER_CPU_OPERATOR(NCHW2NHWC, NCHW2NHWCOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR(NCHW2NCHWc, NCHW2NCHWcOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR(NCHWc2NCHW, NCHWc2NCHWOp<float, CPUContext>);
 
 OPERATOR_SCHEMA(NHWC2NCHW)
     .NumInputs(1)
@@ -101,5 +131,67 @@ class GetNCHW2NHWCGradient : public GradientMakerBase {
   }
 };
 REGISTER_GRADIENT(NCHW2NHWC, GetNCHW2NHWCGradient);
+
+OPERATOR_SCHEMA(NCHW2NCHWc)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .TensorInferenceFunction(
+        [](const OperatorDef& def, const vector<TensorShape>& in) {
+          ArgumentHelper helper(def);
+          const int block = helper.GetSingleArgument<int>("block", 8);
+          vector<TensorShape> out(1);
+          out[0].add_dims(in[0].dims(0));
+          out[0].add_dims(in[0].dims(1) / block);
+          out[0].add_dims(in[0].dims(2));
+          out[0].add_dims(in[0].dims(3));
+          out[0].add_dims(block);
+          return out;
+        })
+    .SetDoc(R"DOC(
+The operator switches the order of data in a tensor from NCHW to the blocked
+NCHWc order: the channels are split in blocks of `block` channels, and the
+channels of a block are stored next to each other, so that the output has the
+shape N x C/block x H x W x block. Conv, pooling and SpatialBN can run on it
+with order "NCHWc", and so can element-wise ops like Relu.
+)DOC")
+    .Arg("block", "Number of channels in a block, 8 by default. Must divide C.")
+    .Input(0, "data", "The input data (Tensor<float>) in the NCHW order.")
+    .Output(
+        0,
+        "output",
+        "The output tensor (Tensor<float>) in the NCHWc order.");
+
+OPERATOR_SCHEMA(NCHWc2NCHW)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .TensorInferenceFunction(
+        [](const OperatorDef& /*unused*/ def, const vector<TensorShape>& in) {
+          vector<TensorShape> out(1);
+          out[0].add_dims(in[0].dims(0));
+          out[0].add_dims(in[0].dims(1) * in[0].dims(4));
+          out[0].add_dims(in[0].dims(2));
+          out[0].add_dims(in[0].dims(3));
+          return out;
+        })
+    .SetDoc(R"DOC(
+The operator switches the order of data in a tensor from the blocked NCHWc
+order, N x C/c x H x W x c, back to NCHW.
+)DOC")
+    .Input(0, "data", "The input data (Tensor<float>) in the NCHWc order.")
+    .Output(
+        0,
+        "output",
+        "The output tensor (Tensor<float>) in the NCHW order.");
+
+class GetNCHW2NCHWcGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    return SingleGradientDef(
+        "NCHWc2NCHW", "",
+        vector<string>{GO(0)},
+        vector<string>{GI(0)});
+  }
+};
+REGISTER_GRADIENT(NCHW2NCHWc, GetNCHW2NCHWcGradient);
 }  // namespace
 }  // namespace caffe2
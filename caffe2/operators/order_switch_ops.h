@@ -29,6 +29,34 @@ class NCHW2NHWCOp final : public Operator<Context> {
  protected:
 };
 
+// Converts NCHW images to the blocked NCHWc order, with blocks of `block`
+// channels (8 by default). The number of channels must be a multiple of the
+// block size.
+template <typename T, class Context>
+class NCHW2NCHWcOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  NCHW2NCHWcOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        block_(OperatorBase::GetSingleArgument<int>("block", 8)) {
+    CAFFE_ENFORCE_GT(block_, 0);
+  }
+  bool RunOnDevice() override;
+
+ protected:
+  const int block_;
+};
+
+template <typename T, class Context>
+class NCHWc2NCHWOp final : public Operator<Context> {
+ public:
+  USE_SIMPLE_CTOR_DTOR(NCHWc2NCHWOp);
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  bool RunOnDevice() override;
+
+ protected:
+};
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_ORDER_SWITCH_OPS_H_
@@ -0,0 +1,175 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+OperatorDef OpDef(
+    const string& type,
+    const vector<string>& inputs,
+    const string& output,
+    const string& order) {
+  OperatorDef def;
+  def.set_type(type);
+  for (const auto& input : inputs) {
+    def.add_input(input);
+  }
+  def.add_output(output);
+  if (!order.empty()) {
+    AddArgument<string>("order", order, &def);
+  }
+  return def;
+}
+
+// Runs def on the NCHW input "X", and again in the NCHWc order, on the input
+// blocked with the given block size, and checks that the unblocked output is
+// the same.
+void ExpectSameInNCHWc(OperatorDef def, int block, Workspace* ws) {
+  ASSERT_TRUE(ws->RunOperatorOnce(def));
+  auto to_nchwc = OpDef("NCHW2NCHWc", {"X"}, "X_blocked", "");
+  AddArgument<int>("block", block, &to_nchwc);
+  ASSERT_TRUE(ws->RunOperatorOnce(to_nchwc));
+  def.set_input(0, "X_blocked");
+  def.set_output(0, "Y_blocked");
+  for (auto& arg : *def.mutable_arg()) {
+    if (arg.name() == "order") {
+      arg.set_s("NCHWc");
+    }
+  }
+  ASSERT_TRUE(ws->RunOperatorOnce(def));
+  ASSERT_TRUE(ws->RunOperatorOnce(
+      OpDef("NCHWc2NCHW", {"Y_blocked"}, "Y_unblocked", "")));
+  const auto& Y = ws->GetBlob("Y")->Get<TensorCPU>();
+  const auto& Y_unblocked = ws->GetBlob("Y_unblocked")->Get<TensorCPU>();
+  ASSERT_EQ(Y.dims(), Y_unblocked.dims());
+  for (int i = 0; i < Y.size(); ++i) {
+    EXPECT_NEAR(Y.data<float>()[i], Y_unblocked.data<float>()[i], 1e-4);
+  }
+}
+
+} // namespace
+
+TEST(OrderSwitchOpsTest, NHWCRoundTrip) {
+  std::mt19937 gen(0);
+  Workspace ws;
+  // Sizes that are not multiples of the 8 x 8 transpose blocks.
+  AddRandomTensor(&ws, "X", {2, 19, 5, 7}, &gen);
+  ASSERT_TRUE(ws.RunOperatorOnce(OpDef("NCHW2NHWC", {"X"}, "X_nhwc", "")));
+  const auto& X = ws.GetBlob("X")->Get<TensorCPU>();
+  const auto& X_nhwc = ws.GetBlob("X_nhwc")->Get<TensorCPU>();
+  EXPECT_EQ(X_nhwc.dims(), vector<TIndex>({2, 5, 7, 19}));
+  // Channel 11 of image 1 at (3, 4).
+  EXPECT_EQ(
+      X_nhwc.data<float>()[((1 * 5 + 3) * 7 + 4) * 19 + 11],
+      X.data<float>()[((1 * 19 + 11) * 5 + 3) * 7 + 4]);
+  ASSERT_TRUE(
+      ws.RunOperatorOnce(OpDef("NHWC2NCHW", {"X_nhwc"}, "X_back", "")));
+  const auto& X_back = ws.GetBlob("X_back")->Get<TensorCPU>();
+  ASSERT_EQ(X_back.dims(), X.dims());
+  for (int i = 0; i < X.size(); ++i) {
+    EXPECT_EQ(X_back.data<float>()[i], X.data<float>()[i]);
+  }
+}
+
+TEST(OrderSwitchOpsTest, NCHWcRoundTrip) {
+  std::mt19937 gen(0);
+  Workspace ws;
+  AddRandomTensor(&ws, "X", {2, 16, 3, 5}, &gen);
+  auto to_nchwc = OpDef("NCHW2NCHWc", {"X"}, "X_blocked", "");
+  AddArgument<int>("block", 8, &to_nchwc);
+  ASSERT_TRUE(ws.RunOperatorOnce(to_nchwc));
+  const auto& X = ws.GetBlob("X")->Get<TensorCPU>();
+  const auto& X_blocked = ws.GetBlob("X_blocked")->Get<TensorCPU>();
+  EXPECT_EQ(X_blocked.dims(), vector<TIndex>({2, 2, 3, 5, 8}));
+  // Channel 11 of image 1 at (2, 4) is at position 3 of block 1.
+  EXPECT_EQ(
+      X_blocked.data<float>()[(((1 * 2 + 1) * 3 + 2) * 5 + 4) * 8 + 3],
+      X.data<float>()[((1 * 16 + 11) * 3 + 2) * 5 + 4]);
+  ASSERT_TRUE(
+      ws.RunOperatorOnce(OpDef("NCHWc2NCHW", {"X_blocked"}, "X_back", "")));
+  const auto& X_back = ws.GetBlob("X_back")->Get<TensorCPU>();
+  ASSERT_EQ(X_back.dims(), X.dims());
+  for (int i = 0; i < X.size(); ++i) {
+    EXPECT_EQ(X_back.data<float>()[i], X.data<float>()[i]);
+  }
+}
+
+TEST(OrderSwitchOpsTest, ConvInNCHWc) {
+  const int N = 2, C = 16, M = 24, H = 7, W = 6;
+  std::mt19937 gen(0);
+  for (int block : {4, 8}) {
+    for (int stride : {1, 2}) {
+      for (int pad : {0, 1}) {
+        Workspace ws;
+        AddRandomTensor(&ws, "X", {N, C, H, W}, &gen);
+        AddRandomTensor(&ws, "W", {M, C, 3, 3}, &gen);
+        AddRandomTensor(&ws, "b", {M}, &gen);
+        auto def = OpDef("Conv", {"X", "W", "b"}, "Y", "NCHW");
+        AddArgument<int>("kernel", 3, &def);
+        AddArgument<int>("stride", stride, &def);
+        AddArgument<int>("pad", pad, &def);
+        ExpectSameInNCHWc(def, block, &ws);
+      }
+    }
+  }
+}
+
+TEST(OrderSwitchOpsTest, PoolAndSpatialBNInNCHWc) {
+  const int N = 2, C = 16, H = 7, W = 6;
+  std::mt19937 gen(0);
+  for (const string type : {"MaxPool", "AveragePool"}) {
+    Workspace ws;
+    AddRandomTensor(&ws, "X", {N, C, H, W}, &gen);
+    auto def = OpDef(type, {"X"}, "Y", "NCHW");
+    AddArgument<int>("kernel", 3, &def);
+    AddArgument<int>("stride", 2, &def);
+    AddArgument<int>("pad", 1, &def);
+    ExpectSameInNCHWc(def, 8, &ws);
+  }
+  for (bool is_test : {false, true}) {
+    Workspace ws;
+    AddRandomTensor(&ws, "X", {N, C, H, W}, &gen);
+    for (const string input : {"scale", "bias", "mean", "var"}) {
+      AddRandomTensor(&ws, input, {C}, &gen);
+    }
+    auto* var = ws.GetBlob("var")->GetMutable<TensorCPU>();
+    for (int c = 0; c < C; ++c) {
+      var->mutable_data<float>()[c] += 2;
+    }
+    auto def =
+        OpDef("SpatialBN", {"X", "scale", "bias", "mean", "var"}, "Y", "NCHW");
+    AddArgument<int>("is_test", is_test, &def);
+    if (!is_test) {
+      def.add_output("mean");
+      def.add_output("var");
+      def.add_output("saved_mean");
+      def.add_output("saved_var");
+    }
+    ExpectSameInNCHWc(def, 8, &ws);
+  }
+}
+
+TEST(OrderSwitchOpsTest, ReluInNCHWc) {
+  std::mt19937 gen(0);
+  Workspace ws;
+  AddRandomTensor(&ws, "X", {2, 16, 3, 5}, &gen);
+  ExpectSameInNCHWc(OpDef("Relu", {"X"}, "Y", ""), 8, &ws);
+}
+
+} // namespace caffe2
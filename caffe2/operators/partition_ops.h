@@ -1,6 +1,10 @@
 #ifndef CAFFE2_OPERATORS_PARTITION_OPS_H_
 #define CAFFE2_OPERATORS_PARTITION_OPS_H_
 
+#include <algorithm>
+#include <cstring>
+
+#include "caffe2/core/common_omp.h"
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
 
@@ -15,6 +19,12 @@ class PartitionOpBase : public Operator<CPUContext> {
         OP_SINGLE_ARG(int, "pack_first_input", pack_first_input_, 0) {}
 
  protected:
+  // Partitioning is done in two passes over contiguous chunks of the main
+  // input, one chunk per thread: the first computes the shard of every
+  // element and per-chunk shard counts, from which a prefix sum gives each
+  // chunk its write offset in every output; the second scatters the elements
+  // straight into the pre-sized outputs. The element order within a shard is
+  // the same as in the input.
   template <typename Index>
   void ApplyPartition(bool skipFirstArgument) {
     CAFFE_ENFORCE_EQ(
@@ -29,13 +39,28 @@ class PartitionOpBase : public Operator<CPUContext> {
     auto& main_input = Input(mainInputIndex);
     TIndex size = main_input.size();
     const Index* data = main_input.template data<Index>();
+    const int chunks = NumChunks(size);
+    shards_.resize(size);
+    chunk_offsets_.assign(chunks * partitions, 0);
+#pragma omp parallel for if (chunks > 1)
+    for (int c = 0; c < chunks; ++c) {
+      const TIndex begin = size * c / chunks;
+      const TIndex end = size * (c + 1) / chunks;
+      ComputeShards(
+          data + begin, end - begin, partitions, shards_.data() + begin);
+      TIndex* counts = chunk_offsets_.data() + c * partitions;
+      for (TIndex p = begin; p < end; ++p) {
+        ++counts[shards_[p]];
+      }
+    }
     counts_.assign(partitions, 0);
-    for (TIndex p = 0; p < size; p++) {
-      // TODO: support other partition functions
-      int shard = data[p] % partitions;
-      // equivalent to `if (shard < 0) shard += partitions;`
-      shard += partitions & (shard >> (sizeof(int) * 8 - 1));
-      ++counts_[shard];
+    for (int c = 0; c < chunks; ++c) {
+      for (int j = 0; j < partitions; ++j) {
+        TIndex* offset = &chunk_offsets_[c * partitions + j];
+        const TIndex count = *offset;
+        *offset = counts_[j];
+        counts_[j] += count;
+      }
     }
 
     raw_datas_.resize(inputSize);
@@ -81,30 +106,78 @@ class PartitionOpBase : public Operator<CPUContext> {
       }
     }
 
-    counts_.assign(partitions, 0);
-    for (TIndex p = 0; p < size; p++) {
-      // TODO: support other partition functions
+#pragma omp parallel for if (chunks > 1)
+    for (int c = 0; c < chunks; ++c) {
+      const TIndex begin = size * c / chunks;
+      const TIndex end = size * (c + 1) / chunks;
+      TIndex* offsets = chunk_offsets_.data() + c * partitions;
+      for (TIndex p = begin; p < end; ++p) {
+        const int shard = shards_[p];
+        const TIndex idx = offsets[shard]++;
+
+        // special case first input
+        static_cast<Index*>(
+            out_datas_[shard * inputSize + mainInputIndex])[idx] =
+            pack_first_input_ ? ((data[p] - shard) / partitions) : data[p];
+
+        int baseIndex = shard * inputSize;
+        for (int i = mainInputIndex + 1; i < inputSize; ++i) {
+          const size_t bytes = block_sizes_[i] * metas_[i].itemsize();
+          CopyBlock(
+              bytes,
+              static_cast<const char*>(raw_datas_[i]) + p * bytes,
+              static_cast<char*>(out_datas_[baseIndex + i]) + idx * bytes);
+        }
+      }
+    }
+  }
+
+  // Number of chunks to split n elements into, at most one per thread.
+  static int NumChunks(TIndex n) {
+#ifdef _OPENMP
+    const TIndex kMinChunkSize = 1 << 14;
+    return std::max<TIndex>(
+        1, std::min<TIndex>(omp_get_max_threads(), n / kMinChunkSize));
+#else
+    return 1;
+#endif
+  }
+
+  // TODO: support other partition functions
+  template <typename Index>
+  static void ComputeShards(
+      const Index* data,
+      TIndex n,
+      int partitions,
+      int32_t* shards) {
+    if ((partitions & (partitions - 1)) == 0) {
+      // For a power of two the non-negative modulo is a mask in two's
+      // complement, which the compiler vectorizes.
+      const Index mask = partitions - 1;
+      for (TIndex p = 0; p < n; ++p) {
+        shards[p] = static_cast<int32_t>(data[p] & mask);
+      }
+      return;
+    }
+    for (TIndex p = 0; p < n; ++p) {
       int shard = data[p] % partitions;
       // equivalent to `if (shard < 0) shard += partitions;`
       shard += partitions & (shard >> (sizeof(int) * 8 - 1));
-      TIndex idx = counts_[shard]++;
-
-      // special case first input
-      static_cast<Index*>(out_datas_[shard * inputSize + mainInputIndex])[idx] =
-          pack_first_input_ ? ((data[p] - shard) / partitions) : data[p];
-
-      int baseIndex = shard * inputSize;
-      for (int i = mainInputIndex + 1; i < inputSize; ++i) {
-        auto bs = block_sizes_[i];
-        auto meta = metas_[i];
-        // special case for small bs?
-        context_.template CopyItems<CPUContext, CPUContext>(
-            meta,
-            bs,
-            static_cast<const char*>(raw_datas_[i]) + p * bs * meta.itemsize(),
-            static_cast<char*>(out_datas_[baseIndex + i]) +
-                idx * bs * meta.itemsize());
-      }
+      shards[p] = shard;
+    }
+  }
+
+  // Fixed size copies for the common scalar cases are inlined.
+  static void CopyBlock(size_t bytes, const char* src, char* dst) {
+    switch (bytes) {
+      case 4:
+        memcpy(dst, src, 4);
+        break;
+      case 8:
+        memcpy(dst, src, 8);
+        break;
+      default:
+        memcpy(dst, src, bytes);
     }
   }
 
@@ -112,6 +185,8 @@ class PartitionOpBase : public Operator<CPUContext> {
 
   // use member fields to reuse memory
   vector<TIndex> counts_;
+  vector<TIndex> chunk_offsets_;
+  vector<int32_t> shards_; // shard of every element of the main input
   vector<TIndex> block_sizes_;
   vector<TypeMeta> metas_;
   vector<const void*> raw_datas_;
@@ -166,10 +241,9 @@ class LengthsPartitionOp : public PartitionOpBase {
     // Apply sharding to all parameters except lengths
     ApplyPartition<Index>(true /* skipFirstArgument */);
 
-    // Compute lengths after sharding
+    // Compute lengths after sharding, reusing the shards computed above
     auto& main_input = Input(1);
     TIndex size = main_input.size();
-    const Index* data = main_input.template data<Index>();
 
     auto& length_input = Input(0);
     TIndex elements = length_input.size();
@@ -181,25 +255,25 @@ class LengthsPartitionOp : public PartitionOpBase {
       out_length_[i] = output.template mutable_data<int32_t>();
     }
 
-    int total_length = 0;
+    starts_.resize(elements);
+    TIndex total_length = 0;
     for (int i = 0; i < elements; ++i) {
+      starts_[i] = total_length;
       total_length += lengths_data[i];
     }
     CAFFE_ENFORCE(
         total_length == size,
         "Total length is not matching to the number of elements");
 
-    int index = 0;
+    const int32_t* shards = shards_.data();
+#pragma omp parallel for if (NumChunks(size) > 1)
     for (int i = 0; i < elements; ++i) {
       for (int j = 0; j < partitions; ++j) {
         out_length_[j][i] = 0;
       }
-      for (int j = 0; j < lengths_data[i]; ++j, ++index) {
-        // TODO: support other partition functions
-        int shard = data[index] % partitions;
-        // equivalent to `if (shard < 0) shard += partitions;`
-        shard += partitions & (shard >> (sizeof(int) * 8 - 1));
-        ++out_length_[shard][i];
+      const TIndex end = starts_[i] + lengths_data[i];
+      for (TIndex index = starts_[i]; index < end; ++index) {
+        ++out_length_[shards[index]][i];
       }
     }
     return true;
@@ -208,6 +282,7 @@ class LengthsPartitionOp : public PartitionOpBase {
   DISABLE_COPY_AND_ASSIGN(LengthsPartitionOp);
 
   vector<int32_t*> out_length_;
+  vector<TIndex> starts_;
 };
 
 } // namespace caffe2
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "caffe2/operators/pool_op.h"
 
 namespace caffe2 {
@@ -33,28 +35,44 @@ bool PoolGradientOp<float, CPUContext, AveragePool>::
   ConvPoolOpBase<CPUContext>::ComputePads(height, width);
   int pooled_height = dY.dim32(2);
   int pooled_width = dY.dim32(3);
-  // The main loop
-  for (int n = 0; n < X.dim32(0); ++n) {
-    for (int c = 0; c < channels; ++c) {
+  // The main loop. The images are split across threads. The window of an
+  // output is separable: its gradient, divided by the columns of the window,
+  // is spread over a row, and the row, divided by the rows of the window, is
+  // added to each of them with vectorized loops.
+  const int num_images = X.dim32(0) * channels;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    vector<float> row(width);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (int i = 0; i < num_images; ++i) {
+      const float* dy = dYdata + i * pooled_height * pooled_width;
+      float* dx = dXdata + i * height * width;
       for (int ph = 0; ph < pooled_height; ++ph) {
+        int hstart = ph * stride_h_ - pad_t_;
+        int hend = min(hstart + kernel_h_, height);
+        hstart = max(hstart, 0);
+        std::fill(row.begin(), row.end(), 0);
         for (int pw = 0; pw < pooled_width; ++pw) {
-          int hstart = ph * stride_h_ - pad_t_;
           int wstart = pw * stride_w_ - pad_l_;
-          int hend = min(hstart + kernel_h_, height);
           int wend = min(wstart + kernel_w_, width);
-          hstart = max(hstart, 0);
           wstart = max(wstart, 0);
-          float scale = 1. / (hend - hstart) / (wend - wstart);
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              dXdata[h * width + w] += dYdata[ph * pooled_width + pw] * scale;
-            }
+          const float value = dy[ph * pooled_width + pw] / (wend - wstart);
+          for (int w = wstart; w < wend; ++w) {
+            row[w] += value;
+          }
+        }
+        const float scale = 1. / (hend - hstart);
+        for (int h = hstart; h < hend; ++h) {
+          float* dx_row = dx + h * width;
+          for (int w = 0; w < width; ++w) {
+            dx_row[w] += row[w] * scale;
           }
         }
       }
-      // offset
-      dXdata += height * width;
-      dYdata += pooled_height * pooled_width;
     }
   }
   return true;
@@ -82,7 +100,14 @@ bool PoolGradientOp<float, CPUContext, AveragePool>::
   int pooled_width = dY.dim32(2);
   int channels = X.dim32(3);
   CAFFE_ENFORCE_EQ(channels, dY.dim32(3));
+  // The windows of an image overlap, so only the images are split across
+  // threads. The loops over the channels are vectorized.
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
   for (int n = 0; n < X.dim32(0); ++n) {
+    const float* dy = dYdata + n * pooled_height * pooled_width * channels;
+    float* dx = dXdata + n * height * width * channels;
     for (int ph = 0; ph < pooled_height; ++ph) {
       for (int pw = 0; pw < pooled_width; ++pw) {
         int hstart = ph * stride_h_ - pad_t_;
@@ -92,19 +117,17 @@ bool PoolGradientOp<float, CPUContext, AveragePool>::
         hstart = max(hstart, 0);
         wstart = max(wstart, 0);
         float scale = 1. / (hend - hstart) / (wend - wstart);
+        const float* dy_pixel = dy + (ph * pooled_width + pw) * channels;
         for (int h = hstart; h < hend; ++h) {
           for (int w = wstart; w < wend; ++w) {
+            float* dx_pixel = dx + (h * width + w) * channels;
             for (int c = 0; c < channels; ++c) {
-              dXdata[(h * width + w) * channels + c] +=
-                  dYdata[(ph * pooled_width + pw) * channels + c] * scale;
+              dx_pixel[c] += dy_pixel[c] * scale;
             }
           }
         }
       }
     }
-    // offset
-    dXdata += X.size() / X.dim32(0);
-    dYdata += dY.size() / dY.dim32(0);
   }
   return true;
 }
@@ -130,34 +153,36 @@ bool PoolGradientOp<float, CPUContext, MaxPool>::RunOnDeviceWithOrderNCHW() {
   ConvPoolOpBase<CPUContext>::ComputePads(height, width);
   int pooled_height = dY.dim32(2);
   int pooled_width = dY.dim32(3);
-  for (int n = 0; n < X.dim32(0); ++n) {
-    for (int c = 0; c < channels; ++c) {
-      for (int ph = 0; ph < pooled_height; ++ph) {
-        for (int pw = 0; pw < pooled_width; ++pw) {
-          int hstart = ph * stride_h_ - pad_t_;
-          int wstart = pw * stride_w_ - pad_l_;
-          int hend = min(hstart + kernel_h_, height);
-          int wend = min(wstart + kernel_w_, width);
-          hstart = max(hstart, 0);
-          wstart = max(wstart, 0);
-          const int pool_index = ph * pooled_width + pw;
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              const int input_index = h * width + w;
-              // OK here is a trick: this may multi-assign gradients.
-              // which is not ideal.
-              if (Xdata[input_index] == Ydata[pool_index]) {
-                dXdata[input_index] += dYdata[pool_index];
-              }
+  // The images are split across threads.
+  const int num_images = X.dim32(0) * channels;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int i = 0; i < num_images; ++i) {
+    const float* x = Xdata + i * height * width;
+    float* dx = dXdata + i * height * width;
+    const float* y = Ydata + i * pooled_height * pooled_width;
+    const float* dy = dYdata + i * pooled_height * pooled_width;
+    for (int ph = 0; ph < pooled_height; ++ph) {
+      for (int pw = 0; pw < pooled_width; ++pw) {
+        int hstart = ph * stride_h_ - pad_t_;
+        int wstart = pw * stride_w_ - pad_l_;
+        int hend = min(hstart + kernel_h_, height);
+        int wend = min(wstart + kernel_w_, width);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        const int pool_index = ph * pooled_width + pw;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const int input_index = h * width + w;
+            // OK here is a trick: this may multi-assign gradients.
+            // which is not ideal.
+            if (x[input_index] == y[pool_index]) {
+              dx[input_index] += dy[pool_index];
             }
           }
         }
       }
-      // Do offset.
-      Xdata += height * width;
-      dXdata += height * width;
-      Ydata += pooled_height * pooled_width;
-      dYdata += pooled_height * pooled_width;
     }
   }
   return true;
@@ -190,9 +215,12 @@ bool PoolGradientOp<float, CPUContext, MaxPool>::RunOnDeviceWithOrderNHWC() {
   int pooled_width = dY.dim32(2);
 
   // The main loop
-  // Do not do openmp here: the following for loops are looping over the pooled
-  // output, so if one parallelizes the outer loops, race conditions could
-  // happen in the inner loops.
+  // Only the images are split across threads: the windows of an image
+  // overlap, so parallelizing the loops over the pooled output would race on
+  // the gradients of the inputs.
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
   for (int n = 0; n < X.dim32(0); ++n) {
     for (int ph = 0; ph < pooled_height; ++ph) {
       for (int pw = 0; pw < pooled_width; ++pw) {
@@ -1,4 +1,7 @@
 // TODO: reduce the apparent redundancy of all the code below.
+#include <cstring>
+
+#include "caffe2/core/parallel_for.h"
 #include "caffe2/operators/pool_op.h"
 #include "caffe2/utils/cpu_neon.h"
 
@@ -158,8 +161,226 @@ runNeonAveragePool4x4p0s0NCHW(int N, int C, int inputH, int inputW,
     }
   }
 }
+
+// Whether the 2x2 max pooling with stride 2 and no padding, the most common
+// one in mobile models, can use the kernel below.
+bool isNeonMaxPool2x2s2Eligible(
+    int kH,
+    int kW,
+    int strideH,
+    int strideW,
+    int padT,
+    int padL,
+    int padB,
+    int padR,
+    int dilationH,
+    int dilationW) {
+  return kH == 2 && kW == 2 && strideH == 2 && strideW == 2 && padT == 0 &&
+      padL == 0 && padB == 0 && padR == 0 && dilationH == 1 && dilationW == 1;
+}
+
+// Vectorizes 2x2s2p0 max pooling of one plane for ARM NEON. Each step takes
+// the maxima of 8 columns of two input rows, and then the pairwise maxima of
+// these, for 4 outputs. An odd last input row or column is dropped, as the
+// output size does.
+void maxPoolNeon2x2p0s2Plane(
+    int inputH,
+    int inputW,
+    int outputH,
+    int outputW,
+    const float* input,
+    float* output) {
+  for (int oh = 0; oh < outputH; ++oh) {
+    const float* row0 = input + 2 * oh * inputW;
+    const float* row1 = row0 + inputW;
+    float* out = output + oh * outputW;
+    int ow = 0;
+    for (; ow + 4 <= outputW; ow += 4) {
+      float32x4_t v0 = vmaxq_f32(vld1q_f32(row0), vld1q_f32(row1));
+      float32x4_t v1 = vmaxq_f32(vld1q_f32(row0 + 4), vld1q_f32(row1 + 4));
+      float32x2_t m0 = vpmax_f32(vget_low_f32(v0), vget_high_f32(v0));
+      float32x2_t m1 = vpmax_f32(vget_low_f32(v1), vget_high_f32(v1));
+      vst1q_f32(out + ow, vcombine_f32(m0, m1));
+      row0 += 8;
+      row1 += 8;
+    }
+    for (; ow < outputW; ++ow) {
+      out[ow] = max(max(row0[0], row0[1]), max(row1[0], row1[1]));
+      row0 += 2;
+      row1 += 2;
+    }
+  }
+}
 #endif // __ARM_NEON__
 
+// The reductions of average and max pooling, for the NCHW kernels below.
+struct AverageReducer {
+  static float Reduce(float a, float b) {
+    return a + b;
+  }
+  static float Finish(float value, int count) {
+    return value / count;
+  }
+};
+
+struct MaxReducer {
+  static float Reduce(float a, float b) {
+    return std::max(a, b);
+  }
+  static float Finish(float value, int /* unused */) {
+    return value;
+  }
+};
+
+// The outputs of columns [begin, end) of a row, whose windows are all within
+// the input row. kKernel and kStride are known at compile time for the common
+// 2x2 and 3x3 windows with stride 2, which the compiler vectorizes.
+template <class Reducer, int kKernel, int kStride>
+void PoolRowInterior(
+    const float* row,
+    int begin,
+    int end,
+    int pad,
+    int count,
+    float* y) {
+  for (int pw = begin; pw < end; ++pw) {
+    const float* x = row + pw * kStride - pad;
+    float value = x[0];
+    for (int w = 1; w < kKernel; ++w) {
+      value = Reducer::Reduce(value, x[w]);
+    }
+    y[pw] = Reducer::Finish(value, count);
+  }
+}
+
+template <class Reducer>
+void PoolRowInterior(
+    const float* row,
+    int begin,
+    int end,
+    int kernel,
+    int stride,
+    int pad,
+    int count,
+    float* y) {
+  if (kernel == 2 && stride == 2) {
+    PoolRowInterior<Reducer, 2, 2>(row, begin, end, pad, count, y);
+  } else if (kernel == 3 && stride == 2) {
+    PoolRowInterior<Reducer, 3, 2>(row, begin, end, pad, count, y);
+  } else {
+    for (int pw = begin; pw < end; ++pw) {
+      const float* x = row + pw * stride - pad;
+      float value = x[0];
+      for (int w = 1; w < kernel; ++w) {
+        value = Reducer::Reduce(value, x[w]);
+      }
+      y[pw] = Reducer::Finish(value, count);
+    }
+  }
+}
+
+// Pools one image in the NCHW order. Pooling is separable: each output row
+// reduces the input rows of its window element-wise into row, which is
+// vectorized, and then reduces the columns of each window of row.
+template <class Reducer>
+void PoolImageNCHW(
+    const float* X,
+    int height,
+    int width,
+    int pooled_height,
+    int pooled_width,
+    int kernel_h,
+    int kernel_w,
+    int stride_h,
+    int stride_w,
+    int pad_t,
+    int pad_l,
+    float* row,
+    float* Y) {
+  // The outputs whose windows do not need clipping to the input columns.
+  const int pw_begin = min(pooled_width, (pad_l + stride_w - 1) / stride_w);
+  const int pw_end = width + pad_l >= kernel_w
+      ? max(pw_begin,
+            min(pooled_width, (width + pad_l - kernel_w) / stride_w + 1))
+      : pw_begin;
+  for (int ph = 0; ph < pooled_height; ++ph) {
+    int hstart = ph * stride_h - pad_t;
+    int hend = min(hstart + kernel_h, height);
+    hstart = max(hstart, 0);
+    memcpy(row, X + hstart * width, width * sizeof(float));
+    for (int h = hstart + 1; h < hend; ++h) {
+      const float* x = X + h * width;
+      for (int w = 0; w < width; ++w) {
+        row[w] = Reducer::Reduce(row[w], x[w]);
+      }
+    }
+    float* y = Y + ph * pooled_width;
+    auto pool_clipped = [&](int pw) {
+      int wstart = pw * stride_w - pad_l;
+      int wend = min(wstart + kernel_w, width);
+      wstart = max(wstart, 0);
+      float value = row[wstart];
+      for (int w = wstart + 1; w < wend; ++w) {
+        value = Reducer::Reduce(value, row[w]);
+      }
+      y[pw] = Reducer::Finish(value, (hend - hstart) * (wend - wstart));
+    };
+    for (int pw = 0; pw < pw_begin; ++pw) {
+      pool_clipped(pw);
+    }
+    PoolRowInterior<Reducer>(
+        row,
+        pw_begin,
+        pw_end,
+        kernel_w,
+        stride_w,
+        pad_l,
+        (hend - hstart) * kernel_w,
+        y);
+    for (int pw = pw_end; pw < pooled_width; ++pw) {
+      pool_clipped(pw);
+    }
+  }
+}
+
+// The planes are split across threads with ParallelFor, which uses the thread
+// pool of the workspace on mobile.
+template <class Reducer>
+void PoolNCHW(
+    Workspace* ws,
+    const float* X,
+    int num_images,
+    int height,
+    int width,
+    int pooled_height,
+    int pooled_width,
+    int kernel_h,
+    int kernel_w,
+    int stride_h,
+    int stride_w,
+    int pad_t,
+    int pad_l,
+    float* Y) {
+  vector<vector<float>> rows(
+      ParallelForNumThreads(ws), vector<float>(width));
+  ParallelFor(ws, num_images, [&](int thread, size_t i) {
+    PoolImageNCHW<Reducer>(
+        X + i * height * width,
+        height,
+        width,
+        pooled_height,
+        pooled_width,
+        kernel_h,
+        kernel_w,
+        stride_h,
+        stride_w,
+        pad_t,
+        pad_l,
+        rows[thread].data(),
+        Y + i * pooled_height * pooled_width);
+  });
+}
+
 }  // namespace
 
 template <>
@@ -170,9 +391,6 @@ bool PoolOp<float, CPUContext, AveragePool>::RunOnDeviceWithOrderNCHW() {
 
   const float* Xdata = X.data<float>();
   float* Ydata = Y->mutable_data<float>();
-  math::Set<float, CPUContext>(
-      Y->size(), 0, Ydata, &context_);
-  // The main loop
   int channels = X.dim32(1);
   int height = X.dim32(2);
   int width = X.dim32(3);
@@ -195,31 +413,21 @@ bool PoolOp<float, CPUContext, AveragePool>::RunOnDeviceWithOrderNCHW() {
   }
 #endif // __ARM_NEON__
 
-  for (int n = 0; n < X.dim32(0); ++n) {
-    for (int c = 0; c < channels; ++c) {
-      for (int ph = 0; ph < pooled_height; ++ph) {
-        for (int pw = 0; pw < pooled_width; ++pw) {
-          int hstart = ph * stride_h_ - pad_t_;
-          int wstart = pw * stride_w_ - pad_l_;
-          int hend = min(hstart + kernel_h_, height);
-          int wend = min(wstart + kernel_w_, width);
-          hstart = max(hstart, 0);
-          wstart = max(wstart, 0);
-          const int pool_index = ph * pooled_width + pw;
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              const int input_index = h * width + w;
-              Ydata[pool_index] += Xdata[input_index];
-            }
-          }
-          Ydata[pool_index] /= (hend - hstart) * (wend - wstart);
-        }
-      }
-      // Do offset.
-      Xdata += height * width;
-      Ydata += pooled_height * pooled_width;
-    }
-  }
+  PoolNCHW<AverageReducer>(
+      ws_,
+      Xdata,
+      X.dim32(0) * channels,
+      height,
+      width,
+      pooled_height,
+      pooled_width,
+      kernel_h_,
+      kernel_w_,
+      stride_h_,
+      stride_w_,
+      pad_t_,
+      pad_l_,
+      Ydata);
   return true;
 }
 
@@ -233,38 +441,40 @@ bool PoolOp<float, CPUContext, AveragePool>::RunOnDeviceWithOrderNHWC() {
   ConvPoolOpBase::SetOutputSize(X, Y, channels);
   const float* Xdata = X.data<float>();
   float* Ydata = Y->mutable_data<float>();
-  math::Set<float, CPUContext>(Y->size(), 0, Ydata, &context_);
-  // The main loop
+  // The main loop. The loops over the channels are vectorized, and the rows
+  // of the output are split across threads with ParallelFor.
   int pooled_height = Y->dim32(1);
   int pooled_width = Y->dim32(2);
-  for (int n = 0; n < X.dim32(0); ++n) {
-    for (int ph = 0; ph < pooled_height; ++ph) {
-      for (int pw = 0; pw < pooled_width; ++pw) {
-        int hstart = ph * stride_h_ - pad_t_;
-        int wstart = pw * stride_w_ - pad_l_;
-        int hend = min(hstart + kernel_h_, height);
-        int wend = min(wstart + kernel_w_, width);
-        hstart = max(hstart, 0);
-        wstart = max(wstart, 0);
-        const int pool_index = (ph * pooled_width + pw) * channels;
-        for (int h = hstart; h < hend; ++h) {
-          for (int w = wstart; w < wend; ++w) {
-            const int input_index = (h * width + w) * channels;
-            for (int c = 0; c < channels; ++c) {
-              Ydata[pool_index + c] += Xdata[input_index + c];
-            }
+  const int num_rows = X.dim32(0) * pooled_height;
+  ParallelFor(ws_, num_rows, [&](int /* unused */, size_t row) {
+    const int n = row / pooled_height;
+    const int ph = row % pooled_height;
+    const float* x = Xdata + n * height * width * channels;
+    int hstart = ph * stride_h_ - pad_t_;
+    int hend = min(hstart + kernel_h_, height);
+    hstart = max(hstart, 0);
+    for (int pw = 0; pw < pooled_width; ++pw) {
+      int wstart = pw * stride_w_ - pad_l_;
+      int wend = min(wstart + kernel_w_, width);
+      wstart = max(wstart, 0);
+      float* y = Ydata + (row * pooled_width + pw) * channels;
+      for (int c = 0; c < channels; ++c) {
+        y[c] = 0;
+      }
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          const float* x_pixel = x + (h * width + w) * channels;
+          for (int c = 0; c < channels; ++c) {
+            y[c] += x_pixel[c];
           }
         }
-        float scale = 1. / (hend - hstart) / (wend - wstart);
-        for (int c = 0; c < channels; ++c) {
-          Ydata[pool_index + c] *= scale;
-        }
+      }
+      float scale = 1. / (hend - hstart) / (wend - wstart);
+      for (int c = 0; c < channels; ++c) {
+        y[c] *= scale;
       }
     }
-    // Do offset.
-    Xdata += X.size() / X.dim32(0);
-    Ydata += Y->size() / Y->dim32(0);
-  }
+  });
   return true;
 }
 
@@ -274,42 +484,52 @@ bool PoolOp<float, CPUContext, MaxPool>::RunOnDeviceWithOrderNCHW() {
   auto* Y = Output(0);
   ConvPoolOpBase::SetOutputSize(X, Y, X.dim32(1));
 
-  const float* Xdata = X.data<float>();
-  float* Ydata = Y->mutable_data<float>();
-  math::Set<float, CPUContext>(
-      Y->size(), std::numeric_limits<float>::lowest(), Ydata, &context_);
-  // The main loop
-  int channels = X.dim32(1);
-  int height = X.dim32(2);
-  int width = X.dim32(3);
-  int pooled_height = Y->dim32(2);
-  int pooled_width = Y->dim32(3);
-  for (int n = 0; n < X.dim32(0); ++n) {
-    for (int c = 0; c < channels; ++c) {
-      for (int ph = 0; ph < pooled_height; ++ph) {
-        for (int pw = 0; pw < pooled_width; ++pw) {
-          int hstart = ph * stride_h_ - pad_t_;
-          int wstart = pw * stride_w_ - pad_l_;
-          int hend = min(hstart + kernel_h_, height);
-          int wend = min(wstart + kernel_w_, width);
-          hstart = max(hstart, 0);
-          wstart = max(wstart, 0);
-          const int pool_index = ph * pooled_width + pw;
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              const int input_index = h * width + w;
-              if (Xdata[input_index] > Ydata[pool_index]) {
-                Ydata[pool_index] = Xdata[input_index];
-              }
-            }
-          }
-        }
-      }
-      // Do offset.
-      Xdata += height * width;
-      Ydata += pooled_height * pooled_width;
-    }
+#ifdef __ARM_NEON__
+  if (isNeonMaxPool2x2s2Eligible(
+          kernel_h_,
+          kernel_w_,
+          stride_h_,
+          stride_w_,
+          pad_t_,
+          pad_l_,
+          pad_b_,
+          pad_r_,
+          dilation_h_,
+          dilation_w_)) {
+    const int inputH = X.dim32(2);
+    const int inputW = X.dim32(3);
+    const int outputH = Y->dim32(2);
+    const int outputW = Y->dim32(3);
+    const float* Xdata = X.data<float>();
+    float* Ydata = Y->mutable_data<float>();
+    ParallelFor(ws_, X.dim32(0) * X.dim32(1), [&](int /* unused */, size_t i) {
+      maxPoolNeon2x2p0s2Plane(
+          inputH,
+          inputW,
+          outputH,
+          outputW,
+          Xdata + i * inputH * inputW,
+          Ydata + i * outputH * outputW);
+    });
+    return true;
   }
+#endif // __ARM_NEON__
+
+  PoolNCHW<MaxReducer>(
+      ws_,
+      X.data<float>(),
+      X.dim32(0) * X.dim32(1),
+      X.dim32(2),
+      X.dim32(3),
+      Y->dim32(2),
+      Y->dim32(3),
+      kernel_h_,
+      kernel_w_,
+      stride_h_,
+      stride_w_,
+      pad_t_,
+      pad_l_,
+      Y->mutable_data<float>());
   return true;
 }
 
@@ -329,9 +549,104 @@ bool PoolOp<float, CPUContext, MaxPool>::RunOnDeviceWithOrderNHWC() {
   int pooled_height = Y->dim32(1);
   int pooled_width = Y->dim32(2);
 
-  // The main loop
-  // TODO: proper vectorization with Eigen
-  for (int n = 0; n < X.dim32(0); ++n) {
+  // The main loop. Eigen vectorizes the maxima over the channels, and the
+  // rows of the output are split across threads with ParallelFor.
+  const int num_rows = X.dim32(0) * pooled_height;
+  ParallelFor(ws_, num_rows, [&](int /* unused */, size_t row) {
+    const int n = row / pooled_height;
+    const int ph = row % pooled_height;
+    int hstart = ph * stride_h_ - pad_t_;
+    int hend = min(hstart + kernel_h_, height);
+    hstart = max(hstart, 0);
+    for (int pw = 0; pw < pooled_width; ++pw) {
+      int wstart = pw * stride_w_ - pad_l_;
+      int wend = min(wstart + kernel_w_, width);
+      wstart = max(wstart, 0);
+      // compute max in range X[n, hstart:hend, wstart:wend, :]
+      auto Y_col = Ymat.col(row * pooled_width + pw);
+      Y_col.setConstant(std::numeric_limits<float>::lowest());
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          Y_col = Y_col.cwiseMax(Xmat.col((n * height + h) * width + w));
+        }
+      }
+    }
+  });
+  return true;
+}
+
+// In the NCHWc order, each block of channels is pooled like an NHWC image
+// with block channels.
+template <>
+bool PoolOp<float, CPUContext, AveragePool>::RunOnDeviceWithOrderNCHWc() {
+  auto& X = Input(0);
+  auto* Y = Output(0);
+  CAFFE_ENFORCE(5 == X.ndim());
+  int height = X.dim32(2);
+  int width = X.dim32(3);
+  int block = X.dim32(4);
+  ConvPoolOpBase::SetOutputSize(X, Y, X.dim32(1) * block);
+  const float* Xdata = X.data<float>();
+  float* Ydata = Y->mutable_data<float>();
+  int pooled_height = Y->dim32(2);
+  int pooled_width = Y->dim32(3);
+  const int num_images = X.dim32(0) * X.dim32(1);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int i = 0; i < num_images; ++i) {
+    const float* x = Xdata + i * height * width * block;
+    float* y = Ydata + i * pooled_height * pooled_width * block;
+    for (int ph = 0; ph < pooled_height; ++ph) {
+      int hstart = ph * stride_h_ - pad_t_;
+      int hend = min(hstart + kernel_h_, height);
+      hstart = max(hstart, 0);
+      for (int pw = 0; pw < pooled_width; ++pw) {
+        int wstart = pw * stride_w_ - pad_l_;
+        int wend = min(wstart + kernel_w_, width);
+        wstart = max(wstart, 0);
+        float* y_pool = y + (ph * pooled_width + pw) * block;
+        for (int c = 0; c < block; ++c) {
+          y_pool[c] = 0;
+        }
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const float* x_pool = x + (h * width + w) * block;
+            for (int c = 0; c < block; ++c) {
+              y_pool[c] += x_pool[c];
+            }
+          }
+        }
+        float scale = 1. / (hend - hstart) / (wend - wstart);
+        for (int c = 0; c < block; ++c) {
+          y_pool[c] *= scale;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+template <>
+bool PoolOp<float, CPUContext, MaxPool>::RunOnDeviceWithOrderNCHWc() {
+  auto& X = Input(0);
+  auto* Y = Output(0);
+  CAFFE_ENFORCE(5 == X.ndim());
+  int height = X.dim32(2);
+  int width = X.dim32(3);
+  int block = X.dim32(4);
+  ConvPoolOpBase::SetOutputSize(X, Y, X.dim32(1) * block);
+  const float* Xdata = X.data<float>();
+  float* Ydata = Y->mutable_data<float>();
+  int pooled_height = Y->dim32(2);
+  int pooled_width = Y->dim32(3);
+  const int num_images = X.dim32(0) * X.dim32(1);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int i = 0; i < num_images; ++i) {
+    const float* x = Xdata + i * height * width * block;
+    float* y = Ydata + i * pooled_height * pooled_width * block;
     for (int ph = 0; ph < pooled_height; ++ph) {
       int hstart = ph * stride_h_ - pad_t_;
       int hend = min(hstart + kernel_h_, height);
@@ -340,12 +655,16 @@ bool PoolOp<float, CPUContext, MaxPool>::RunOnDeviceWithOrderNHWC() {
         int wstart = pw * stride_w_ - pad_l_;
         int wend = min(wstart + kernel_w_, width);
         wstart = max(wstart, 0);
-        // compute max in range X[n, hstart:hend, wstart:wend, :]
-        auto Y_col = Ymat.col((n * pooled_height + ph) * pooled_width + pw);
-        Y_col.setConstant(std::numeric_limits<float>::lowest());
+        float* y_pool = y + (ph * pooled_width + pw) * block;
+        for (int c = 0; c < block; ++c) {
+          y_pool[c] = std::numeric_limits<float>::lowest();
+        }
         for (int h = hstart; h < hend; ++h) {
           for (int w = wstart; w < wend; ++w) {
-            Y_col = Y_col.cwiseMax(Xmat.col((n * height + h) * width + w));
+            const float* x_pool = x + (h * width + w) * block;
+            for (int c = 0; c < block; ++c) {
+              y_pool[c] = std::max(y_pool[c], x_pool[c]);
+            }
           }
         }
       }
@@ -361,6 +680,7 @@ OPERATOR_SCHEMA(AveragePool)
   .NumInputs(1)
   .NumOutputs(1)
   .TensorInferenceFunction(ConvPoolOpBase<CPUContext>::TensorInferenceForPool)
+  .CostInferenceFunction(ConvPoolOpBase<CPUContext>::CostInferenceForPool)
   .SetDoc(R"DOC(
 AveragePool consumes an input blob X and applies average pooling across the
 the blob according to kernel sizes, stride sizes, and pad lengths defined by the
@@ -385,6 +705,7 @@ OPERATOR_SCHEMA(MaxPool)
   .NumInputs(1)
   .NumOutputs(1)
   .TensorInferenceFunction(ConvPoolOpBase<CPUContext>::TensorInferenceForPool)
+  .CostInferenceFunction(ConvPoolOpBase<CPUContext>::CostInferenceForPool)
   .SetDoc(R"DOC(
 MaxPool consumes an input blob X and applies max pooling across the
 the blob according to kernel sizes, stride sizes, and pad lengths defined by the
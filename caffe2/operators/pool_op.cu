@@ -3,6 +3,7 @@
 
 #include "caffe2/core/context_gpu.h"
 #include "caffe2/operators/pool_op.h"
+#include "caffe2/utils/fixed_divisor.h"
 
 namespace caffe2 {
 namespace {
@@ -11,21 +12,36 @@ class MaxPool {};
 }  // namespace
 
 namespace {
+// The pooled rows [*start, *end) whose windows contain the padded row h, and
+// likewise for columns.
+inline __device__ void PooledRange(
+    const int h,
+    const int kernel,
+    const FixedDivisor<int32_t> stride,
+    const int pooled,
+    int* start,
+    int* end) {
+  *start = (h < kernel) ? 0 : stride.div(h - kernel) + 1;
+  *end = min(stride.div(h) + 1, pooled);
+}
+
+// The kernels split their indices with IndexDecomposer, over (N, C, H, W)
+// or (N, H, W, C) of the input or of the output.
 template <typename T>
 __global__ void AveragePoolForwardNCHW(
-    const int nthreads, const T* bottom_data,
+    const int nthreads, const IndexDecomposer<4> top_dims,
+    const T* bottom_data,
     const int num, const int channels, const int height,
     const int width, const int pooled_height, const int pooled_width,
     const int kernel_h, const int kernel_w, const int stride_h,
     const int stride_w, const int pad_t, const int pad_l, T* top_data) {
   CUDA_1D_KERNEL_LOOP(index, nthreads) {
-    int n = index;
-    int pw = n % pooled_width;
-    n /= pooled_width;
-    int ph = n % pooled_height;
-    n /= pooled_height;
-    int c = n % channels;
-    n /= channels;
+    int coords[4];
+    top_dims.decompose(index, coords);
+    const int n = coords[0];
+    const int c = coords[1];
+    const int ph = coords[2];
+    const int pw = coords[3];
     int hstart = ph * stride_h - pad_t;
     int wstart = pw * stride_w - pad_l;
     int hend = min(hstart + kernel_h, height);
@@ -45,16 +61,19 @@ __global__ void AveragePoolForwardNCHW(
 
 template <typename T>
 __global__ void AveragePoolForwardNHWC(
-    const int nthreads, const T* bottom_data,
+    const int nthreads, const IndexDecomposer<4> top_dims,
+    const T* bottom_data,
     const int num, const int height, const int width,
     const int channels, const int pooled_height, const int pooled_width,
     const int kernel_h, const int kernel_w, const int stride_h,
     const int stride_w, const int pad_t, const int pad_l, T* top_data) {
   CUDA_1D_KERNEL_LOOP(index, nthreads) {
-    int c = index % channels;
-    int pw = (index / channels) % pooled_width;
-    int ph = (index / channels / pooled_width) % pooled_height;
-    int n = index / channels / pooled_width / pooled_height;
+    int coords[4];
+    top_dims.decompose(index, coords);
+    const int n = coords[0];
+    const int ph = coords[1];
+    const int pw = coords[2];
+    const int c = coords[3];
     int hstart = ph * stride_h - pad_t;
     int wstart = pw * stride_w - pad_l;
     int hend = min(hstart + kernel_h, height);
@@ -75,30 +94,32 @@ __global__ void AveragePoolForwardNHWC(
 
 template <typename T>
 __global__ void AvePoolBackwardNCHW(const int nthreads,
-    const T* const top_diff, const int num, const int channels,
+    const IndexDecomposer<4> bottom_dims, const T* const top_diff,
+    const int num, const int channels,
     const int height, const int width, const int pooled_height,
     const int pooled_width, const int kernel_h, const int kernel_w,
-    const int stride_h, const int stride_w, const int pad_t,
-    const int pad_l, T* const bottom_diff) {
+    const FixedDivisor<int32_t> stride_h, const FixedDivisor<int32_t> stride_w,
+    const int pad_t, const int pad_l, T* const bottom_diff) {
   CUDA_1D_KERNEL_LOOP(index, nthreads) {
     // find out the local index
     // find out the local offset
-    const int w = index % width + pad_l;
-    const int h = (index / width) % height + pad_t;
-    const int c = (index / width / height) % channels;
-    const int n = index / width / height / channels;
-    const int phstart = (h < kernel_h) ? 0 : (h - kernel_h) / stride_h + 1;
-    const int phend = min(h / stride_h + 1, pooled_height);
-    const int pwstart = (w < kernel_w) ? 0 : (w - kernel_w) / stride_w + 1;
-    const int pwend = min(w / stride_w + 1, pooled_width);
+    int coords[4];
+    bottom_dims.decompose(index, coords);
+    const int n = coords[0];
+    const int c = coords[1];
+    const int h = coords[2] + pad_t;
+    const int w = coords[3] + pad_l;
+    int phstart, phend, pwstart, pwend;
+    PooledRange(h, kernel_h, stride_h, pooled_height, &phstart, &phend);
+    PooledRange(w, kernel_w, stride_w, pooled_width, &pwstart, &pwend);
     T gradient = 0;
     const T* const top_diff_slice =
         top_diff + (n * channels + c) * pooled_height * pooled_width;
     for (int ph = phstart; ph < phend; ++ph) {
       for (int pw = pwstart; pw < pwend; ++pw) {
         // figure out the pooling size
-        int hstart = ph * stride_h - pad_t;
-        int wstart = pw * stride_w - pad_l;
+        int hstart = ph * stride_h.d() - pad_t;
+        int wstart = pw * stride_w.d() - pad_l;
         int hend = min(hstart + kernel_h, height);
         int wend = min(wstart + kernel_w, width);
         hstart = max(hstart, 0);
@@ -113,30 +134,32 @@ __global__ void AvePoolBackwardNCHW(const int nthreads,
 
 template <typename T>
 __global__ void AvePoolBackwardNHWC(const int nthreads,
-    const T* const top_diff, const int num, const int height,
+    const IndexDecomposer<4> bottom_dims, const T* const top_diff,
+    const int num, const int height,
     const int width, const int channels, const int pooled_height,
     const int pooled_width, const int kernel_h, const int kernel_w,
-    const int stride_h, const int stride_w, const int pad_t,
-    const int pad_l, T* const bottom_diff) {
+    const FixedDivisor<int32_t> stride_h, const FixedDivisor<int32_t> stride_w,
+    const int pad_t, const int pad_l, T* const bottom_diff) {
   CUDA_1D_KERNEL_LOOP(index, nthreads) {
     // find out the local index
     // find out the local offset
-    const int c = index % channels;
-    const int w = index / channels % width + pad_l;
-    const int h = (index / channels / width) % height + pad_t;
-    const int n = index / channels / width / height;
-    const int phstart = (h < kernel_h) ? 0 : (h - kernel_h) / stride_h + 1;
-    const int phend = min(h / stride_h + 1, pooled_height);
-    const int pwstart = (w < kernel_w) ? 0 : (w - kernel_w) / stride_w + 1;
-    const int pwend = min(w / stride_w + 1, pooled_width);
+    int coords[4];
+    bottom_dims.decompose(index, coords);
+    const int n = coords[0];
+    const int h = coords[1] + pad_t;
+    const int w = coords[2] + pad_l;
+    const int c = coords[3];
+    int phstart, phend, pwstart, pwend;
+    PooledRange(h, kernel_h, stride_h, pooled_height, &phstart, &phend);
+    PooledRange(w, kernel_w, stride_w, pooled_width, &pwstart, &pwend);
     T gradient = 0;
     const T* const top_diff_slice =
         top_diff + n * pooled_height * pooled_width * channels + c;
     for (int ph = phstart; ph < phend; ++ph) {
       for (int pw = pwstart; pw < pwend; ++pw) {
         // figure out the pooling size
-        int hstart = ph * stride_h - pad_t;
-        int wstart = pw * stride_w - pad_l;
+        int hstart = ph * stride_h.d() - pad_t;
+        int wstart = pw * stride_w.d() - pad_l;
         int hend = min(hstart + kernel_h, height);
         int wend = min(wstart + kernel_w, width);
         hstart = max(hstart, 0);
@@ -161,7 +184,9 @@ bool PoolOp<float, CUDAContext, AveragePool>::RunOnDeviceWithOrderNCHW() {
   AveragePoolForwardNCHW<float><<<CAFFE_GET_BLOCKS(output_size),
                               CAFFE_CUDA_NUM_THREADS,
                               0, context_.cuda_stream()>>>(
-      output_size, X.data<float>(), X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3),
+      output_size,
+      IndexDecomposer<4>{X.dim32(0), X.dim32(1), Y->dim32(2), Y->dim32(3)},
+      X.data<float>(), X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3),
       Y->dim32(2), Y->dim32(3), kernel_h_, kernel_w_, stride_h_, stride_w_,
       pad_t_, pad_l_, Y->mutable_data<float>());
   return true;
@@ -176,7 +201,9 @@ bool PoolOp<float, CUDAContext, AveragePool>::RunOnDeviceWithOrderNHWC() {
   AveragePoolForwardNHWC<float><<<CAFFE_GET_BLOCKS(output_size),
                               CAFFE_CUDA_NUM_THREADS,
                               0, context_.cuda_stream()>>>(
-      output_size, X.data<float>(), X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3),
+      output_size,
+      IndexDecomposer<4>{X.dim32(0), Y->dim32(1), Y->dim32(2), X.dim32(3)},
+      X.data<float>(), X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3),
       Y->dim32(1), Y->dim32(2), kernel_h_, kernel_w_, stride_h_, stride_w_,
       pad_t_, pad_l_, Y->mutable_data<float>());
   return true;
@@ -193,8 +220,11 @@ bool PoolGradientOp<float, CUDAContext, AveragePool>::RunOnDeviceWithOrderNCHW()
   AvePoolBackwardNCHW<float><<<CAFFE_GET_BLOCKS(X.size()),
                                CAFFE_CUDA_NUM_THREADS,
                                0, context_.cuda_stream()>>>(
-      X.size(), dY.data<float>(), X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3),
-      dY.dim32(2), dY.dim32(3), kernel_h_, kernel_w_, stride_h_, stride_w_,
+      X.size(),
+      IndexDecomposer<4>{X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3)},
+      dY.data<float>(), X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3),
+      dY.dim32(2), dY.dim32(3), kernel_h_, kernel_w_,
+      FixedDivisor<int32_t>(stride_h_), FixedDivisor<int32_t>(stride_w_),
       pad_t_, pad_l_, dX->mutable_data<float>());
   return true;
 }
@@ -210,8 +240,11 @@ bool PoolGradientOp<float, CUDAContext, AveragePool>::RunOnDeviceWithOrderNHWC()
   AvePoolBackwardNHWC<float><<<CAFFE_GET_BLOCKS(X.size()),
                                CAFFE_CUDA_NUM_THREADS,
                                0, context_.cuda_stream()>>>(
-      X.size(), dY.data<float>(), X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3),
-      dY.dim32(1), dY.dim32(2), kernel_h_, kernel_w_, stride_h_, stride_w_,
+      X.size(),
+      IndexDecomposer<4>{X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3)},
+      dY.data<float>(), X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3),
+      dY.dim32(1), dY.dim32(2), kernel_h_, kernel_w_,
+      FixedDivisor<int32_t>(stride_h_), FixedDivisor<int32_t>(stride_w_),
       pad_t_, pad_l_, dX->mutable_data<float>());
   return true;
 }
@@ -219,16 +252,19 @@ bool PoolGradientOp<float, CUDAContext, AveragePool>::RunOnDeviceWithOrderNHWC()
 
 namespace {
 template <typename T>
-__global__ void MaxPoolForwardNCHW(const int nthreads, const T* bottom_data,
+__global__ void MaxPoolForwardNCHW(const int nthreads,
+    const IndexDecomposer<4> top_dims, const T* bottom_data,
     const int channels, const int height,
     const int width, const int pooled_height, const int pooled_width,
     const int kernel_h, const int kernel_w, const int stride_h,
     const int stride_w, const int pad_t, const int pad_l, T* top_data) {
   CUDA_1D_KERNEL_LOOP(index, nthreads) {
-    int pw = index % pooled_width;
-    int ph = (index / pooled_width) % pooled_height;
-    int c = (index / pooled_width / pooled_height) % channels;
-    int n = index / pooled_width / pooled_height / channels;
+    int coords[4];
+    top_dims.decompose(index, coords);
+    const int n = coords[0];
+    const int c = coords[1];
+    const int ph = coords[2];
+    const int pw = coords[3];
     int hstart = ph * stride_h - pad_t;
     int wstart = pw * stride_w - pad_l;
     int hend = min(hstart + kernel_h, height);
@@ -250,19 +286,19 @@ __global__ void MaxPoolForwardNCHW(const int nthreads, const T* bottom_data,
 }
 
 template <typename T>
-__global__ void MaxPoolForwardNHWC(const int nthreads, const T* bottom_data,
+__global__ void MaxPoolForwardNHWC(const int nthreads,
+    const IndexDecomposer<4> top_dims, const T* bottom_data,
     const int height, const int width,
     const int channels, const int pooled_height, const int pooled_width,
     const int kernel_h, const int kernel_w, const int stride_h,
     const int stride_w, const int pad_t, const int pad_l, T* top_data) {
   CUDA_1D_KERNEL_LOOP(index, nthreads) {
-    int n = index;
-    int c = n % channels;
-    n /= channels;
-    int wstart = (n % pooled_width) * stride_w - pad_l;
-    n /= pooled_width;
-    int hstart = (n % pooled_height) * stride_h - pad_t;
-    n /= pooled_height;
+    int coords[4];
+    top_dims.decompose(index, coords);
+    const int n = coords[0];
+    const int c = coords[3];
+    int hstart = coords[1] * stride_h - pad_t;
+    int wstart = coords[2] * stride_w - pad_l;
     int hend = min(hstart + kernel_h, height);
     int wend = min(wstart + kernel_w, width);
     hstart = max(hstart, 0);
@@ -283,23 +319,25 @@ __global__ void MaxPoolForwardNHWC(const int nthreads, const T* bottom_data,
 
 template <typename T>
 __global__ void MaxPoolBackwardNCHW(const int nthreads,
-    const T* const bottom_data, const T* const top_data,
-    const T* const top_diff, const int num, const int channels,
+    const IndexDecomposer<4> bottom_dims, const T* const bottom_data,
+    const T* const top_data, const T* const top_diff, const int num,
+    const int channels,
     const int height, const int width, const int pooled_height,
     const int pooled_width, const int kernel_h, const int kernel_w,
-    const int stride_h, const int stride_w, const int pad_t,
-    const int pad_l, T* const bottom_diff) {
+    const FixedDivisor<int32_t> stride_h, const FixedDivisor<int32_t> stride_w,
+    const int pad_t, const int pad_l, T* const bottom_diff) {
   CUDA_1D_KERNEL_LOOP(index, nthreads) {
     // find out the local index
     // find out the local offset
-    const int w = index % width + pad_l;
-    const int h = (index / width) % height + pad_t;
-    const int c = (index / width / height) % channels;
-    const int n = index / width / height / channels;
-    const int phstart = (h < kernel_h) ? 0 : (h - kernel_h) / stride_h + 1;
-    const int phend = min(h / stride_h + 1, pooled_height);
-    const int pwstart = (w < kernel_w) ? 0 : (w - kernel_w) / stride_w + 1;
-    const int pwend = min(w / stride_w + 1, pooled_width);
+    int coords[4];
+    bottom_dims.decompose(index, coords);
+    const int n = coords[0];
+    const int c = coords[1];
+    const int h = coords[2] + pad_t;
+    const int w = coords[3] + pad_l;
+    int phstart, phend, pwstart, pwend;
+    PooledRange(h, kernel_h, stride_h, pooled_height, &phstart, &phend);
+    PooledRange(w, kernel_w, stride_w, pooled_width, &pwstart, &pwend);
     const int top_offset =
         (n * channels + c) * pooled_height * pooled_width;
     bottom_diff[index] = 0;
@@ -316,23 +354,25 @@ __global__ void MaxPoolBackwardNCHW(const int nthreads,
 
 template <typename T>
 __global__ void MaxPoolBackwardNHWC(const int nthreads,
-    const T* const bottom_data, const T* const top_data,
-    const T* const top_diff, const int num, const int height,
+    const IndexDecomposer<4> bottom_dims, const T* const bottom_data,
+    const T* const top_data, const T* const top_diff, const int num,
+    const int height,
     const int width, const int channels, const int pooled_height,
     const int pooled_width, const int kernel_h, const int kernel_w,
-    const int stride_h, const int stride_w, const int pad_t,
-    const int pad_l, T* const bottom_diff) {
+    const FixedDivisor<int32_t> stride_h, const FixedDivisor<int32_t> stride_w,
+    const int pad_t, const int pad_l, T* const bottom_diff) {
   CUDA_1D_KERNEL_LOOP(index, nthreads) {
     // find out the local index
     // find out the local offset
-    const int c = index % channels;
-    const int w = index / channels % width + pad_l;
-    const int h = (index / channels / width) % height + pad_t;
-    const int n = index / channels / width / height;
-    const int phstart = (h < kernel_h) ? 0 : (h - kernel_h) / stride_h + 1;
-    const int phend = min(h / stride_h + 1, pooled_height);
-    const int pwstart = (w < kernel_w) ? 0 : (w - kernel_w) / stride_w + 1;
-    const int pwend = min(w / stride_w + 1, pooled_width);
+    int coords[4];
+    bottom_dims.decompose(index, coords);
+    const int n = coords[0];
+    const int h = coords[1] + pad_t;
+    const int w = coords[2] + pad_l;
+    const int c = coords[3];
+    int phstart, phend, pwstart, pwend;
+    PooledRange(h, kernel_h, stride_h, pooled_height, &phstart, &phend);
+    PooledRange(w, kernel_w, stride_w, pooled_width, &pwstart, &pwend);
     const int top_offset =
         n * pooled_height * pooled_width * channels + c;
     bottom_diff[index] = 0;
@@ -357,7 +397,9 @@ bool PoolOp<float, CUDAContext, MaxPool>::RunOnDeviceWithOrderNCHW() {
   MaxPoolForwardNCHW<float><<<CAFFE_GET_BLOCKS(output_size),
                               CAFFE_CUDA_NUM_THREADS,
                               0, context_.cuda_stream()>>>(
-      output_size, X.data<float>(), X.dim32(1), X.dim32(2), X.dim32(3),
+      output_size,
+      IndexDecomposer<4>{X.dim32(0), X.dim32(1), Y->dim32(2), Y->dim32(3)},
+      X.data<float>(), X.dim32(1), X.dim32(2), X.dim32(3),
       Y->dim32(2), Y->dim32(3), kernel_h_, kernel_w_, stride_h_, stride_w_,
       pad_t_, pad_l_, Y->mutable_data<float>());
   return true;
@@ -372,7 +414,9 @@ bool PoolOp<float, CUDAContext, MaxPool>::RunOnDeviceWithOrderNHWC() {
   MaxPoolForwardNHWC<float><<<CAFFE_GET_BLOCKS(output_size),
                               CAFFE_CUDA_NUM_THREADS,
                               0, context_.cuda_stream()>>>(
-      output_size, X.data<float>(), X.dim32(1), X.dim32(2), X.dim32(3),
+      output_size,
+      IndexDecomposer<4>{X.dim32(0), Y->dim32(1), Y->dim32(2), X.dim32(3)},
+      X.data<float>(), X.dim32(1), X.dim32(2), X.dim32(3),
       Y->dim32(1), Y->dim32(2), kernel_h_, kernel_w_, stride_h_, stride_w_,
       pad_t_, pad_l_, Y->mutable_data<float>());
   return true;
@@ -390,9 +434,12 @@ bool PoolGradientOp<float, CUDAContext, MaxPool>::RunOnDeviceWithOrderNCHW() {
   MaxPoolBackwardNCHW<float><<<CAFFE_GET_BLOCKS(X.size()),
                                CAFFE_CUDA_NUM_THREADS,
                                0, context_.cuda_stream()>>>(
-      X.size(), X.data<float>(), Y.data<float>(), dY.data<float>(),
+      X.size(),
+      IndexDecomposer<4>{X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3)},
+      X.data<float>(), Y.data<float>(), dY.data<float>(),
       X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3),
-      dY.dim32(2), dY.dim32(3), kernel_h_, kernel_w_, stride_h_, stride_w_,
+      dY.dim32(2), dY.dim32(3), kernel_h_, kernel_w_,
+      FixedDivisor<int32_t>(stride_h_), FixedDivisor<int32_t>(stride_w_),
       pad_t_, pad_l_, dX->mutable_data<float>());
   return true;
 }
@@ -409,9 +456,12 @@ bool PoolGradientOp<float, CUDAContext, MaxPool>::RunOnDeviceWithOrderNHWC() {
   MaxPoolBackwardNHWC<float><<<CAFFE_GET_BLOCKS(X.size()),
                                CAFFE_CUDA_NUM_THREADS,
                                0, context_.cuda_stream()>>>(
-      X.size(), X.data<float>(), Y.data<float>(), dY.data<float>(),
+      X.size(),
+      IndexDecomposer<4>{X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3)},
+      X.data<float>(), Y.data<float>(), dY.data<float>(),
       X.dim32(0), X.dim32(1), X.dim32(2), X.dim32(3),
-      dY.dim32(1), dY.dim32(2), kernel_h_, kernel_w_, stride_h_, stride_w_,
+      dY.dim32(1), dY.dim32(2), kernel_h_, kernel_w_,
+      FixedDivisor<int32_t>(stride_h_), FixedDivisor<int32_t>(stride_w_),
       pad_t_, pad_l_, dX->mutable_data<float>());
   return true;
 }
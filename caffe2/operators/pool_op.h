@@ -30,6 +30,10 @@ class PoolOp final : public ConvPoolOpBase<Context> {
 
   bool RunOnDeviceWithOrderNCHW() override;
   bool RunOnDeviceWithOrderNHWC() override;
+  // Only implemented on CPU.
+  bool RunOnDeviceWithOrderNCHWc() override {
+    return ConvPoolOpBase<Context>::RunOnDeviceWithOrderNCHWc();
+  }
 
   // Input: X
   // Output: Y
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <limits>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+struct PoolConfig {
+  int kernel;
+  int stride;
+  int pad;
+  bool global;
+};
+
+// X, Y and dY in the given order, with the shapes of the given config, and
+// dX as computed by the pooling gradient op.
+struct PoolRun {
+  const TensorCPU* X;
+  const TensorCPU* Y;
+  const TensorCPU* dY;
+  const TensorCPU* dX;
+};
+
+PoolRun RunPool(
+    const string& type,
+    const string& order,
+    const PoolConfig& config,
+    int N,
+    int C,
+    int H,
+    int W,
+    Workspace* ws) {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* X = ws->CreateBlob("X")->GetMutable<TensorCPU>();
+  if (order == "NCHW") {
+    X->Resize(N, C, H, W);
+  } else {
+    X->Resize(N, H, W, C);
+  }
+  for (int i = 0; i < X->size(); ++i) {
+    X->mutable_data<float>()[i] = value(gen);
+  }
+  OperatorDef def;
+  def.set_type(type);
+  def.add_input("X");
+  def.add_output("Y");
+  AddArgument<string>("order", order, &def);
+  if (config.global) {
+    AddArgument<int>("global_pooling", 1, &def);
+  } else {
+    AddArgument<int>("kernel", config.kernel, &def);
+    AddArgument<int>("stride", config.stride, &def);
+    AddArgument<int>("pad", config.pad, &def);
+  }
+  EXPECT_TRUE(ws->RunOperatorOnce(def));
+  const auto& Y = ws->GetBlob("Y")->Get<TensorCPU>();
+  auto* dY = ws->CreateBlob("dY")->GetMutable<TensorCPU>();
+  dY->ResizeLike(Y);
+  for (int i = 0; i < dY->size(); ++i) {
+    dY->mutable_data<float>()[i] = value(gen);
+  }
+  def.set_type(type + "Gradient");
+  def.add_input("Y");
+  def.add_input("dY");
+  def.set_output(0, "dX");
+  EXPECT_TRUE(ws->RunOperatorOnce(def));
+  return {X, &Y, dY, &ws->GetBlob("dX")->Get<TensorCPU>()};
+}
+
+} // namespace
+
+// Checks the pooling ops and their gradients against plain loops over the
+// windows, for the 2x2 and 3x3 windows that have kernels of their own, with
+// and without padding, and for global pooling.
+TEST(PoolOpTest, MatchesReference) {
+  const int N = 2, C = 3;
+  const vector<PoolConfig> configs = {{2, 2, 0, false},
+                                      {3, 2, 0, false},
+                                      {3, 2, 1, false},
+                                      {3, 1, 1, false},
+                                      {2, 1, 0, false},
+                                      {0, 0, 0, true}};
+  for (const string type : {"MaxPool", "AveragePool"}) {
+    for (const string order : {"NCHW", "NHWC"}) {
+      for (const auto& config : configs) {
+        for (int H : {7, 8}) {
+          const int W = H + 3;
+          Workspace ws;
+          const auto run = RunPool(type, order, config, N, C, H, W, &ws);
+          const bool nchw = order == "NCHW";
+          const int kernel_h = config.global ? H : config.kernel;
+          const int kernel_w = config.global ? W : config.kernel;
+          const int stride = config.global ? 1 : config.stride;
+          const int pad = config.pad;
+          const int OH = (H + 2 * pad - kernel_h) / stride + 1;
+          const int OW = (W + 2 * pad - kernel_w) / stride + 1;
+          ASSERT_EQ(
+              run.Y->dims(),
+              nchw ? vector<TIndex>({N, C, OH, OW})
+                   : vector<TIndex>({N, OH, OW, C}));
+          auto x_index = [&](int n, int c, int h, int w) {
+            return nchw ? ((n * C + c) * H + h) * W + w
+                        : ((n * H + h) * W + w) * C + c;
+          };
+          auto y_index = [&](int n, int c, int h, int w) {
+            return nchw ? ((n * C + c) * OH + h) * OW + w
+                        : ((n * OH + h) * OW + w) * C + c;
+          };
+          const float* x = run.X->data<float>();
+          const float* y = run.Y->data<float>();
+          const float* dy = run.dY->data<float>();
+          vector<float> expected_dx(run.X->size(), 0);
+          for (int n = 0; n < N; ++n) {
+            for (int c = 0; c < C; ++c) {
+              for (int oh = 0; oh < OH; ++oh) {
+                for (int ow = 0; ow < OW; ++ow) {
+                  const int hstart = std::max(oh * stride - pad, 0);
+                  const int hend = std::min(oh * stride - pad + kernel_h, H);
+                  const int wstart = std::max(ow * stride - pad, 0);
+                  const int wend = std::min(ow * stride - pad + kernel_w, W);
+                  const int count = (hend - hstart) * (wend - wstart);
+                  float max_value = std::numeric_limits<float>::lowest();
+                  float sum = 0;
+                  for (int h = hstart; h < hend; ++h) {
+                    for (int w = wstart; w < wend; ++w) {
+                      max_value = std::max(max_value, x[x_index(n, c, h, w)]);
+                      sum += x[x_index(n, c, h, w)];
+                    }
+                  }
+                  const int yi = y_index(n, c, oh, ow);
+                  if (type == "MaxPool") {
+                    EXPECT_EQ(y[yi], max_value);
+                  } else {
+                    EXPECT_NEAR(y[yi], sum / count, 1e-5);
+                  }
+                  for (int h = hstart; h < hend; ++h) {
+                    for (int w = wstart; w < wend; ++w) {
+                      const int xi = x_index(n, c, h, w);
+                      if (type == "AveragePool") {
+                        expected_dx[xi] += dy[yi] / count;
+                      } else if (x[xi] == max_value) {
+                        expected_dx[xi] += dy[yi];
+                      }
+                    }
+                  }
+                }
+              }
+            }
+          }
+          for (int i = 0; i < expected_dx.size(); ++i) {
+            EXPECT_NEAR(run.dX->data<float>()[i], expected_dx[i], 1e-5);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(PoolOpTest, Cost) {
+  vector<TensorShape> shapes(1);
+  for (auto d : {2, 3, 8, 8}) {
+    shapes[0].add_dims(d);
+  }
+  const OpSchema* schema = OpSchemaRegistry::Schema("MaxPool");
+  ASSERT_TRUE(schema->HasCostInferenceFunction());
+  OperatorDef def = CreateOperatorDef(
+      "MaxPool",
+      "",
+      vector<string>{"X"},
+      vector<string>{"Y"},
+      vector<Argument>{MakeArgument<int>("kernel", 2),
+                       MakeArgument<int>("stride", 2)});
+  auto cost = schema->InferCost(def, shapes);
+  EXPECT_EQ(cost.flops, 2 * 3 * 4 * 4 * 4);
+  EXPECT_EQ(cost.bytes_read, 2 * 3 * 8 * 8 * sizeof(float));
+  EXPECT_EQ(cost.bytes_written, 2 * 3 * 4 * 4 * sizeof(float));
+
+  def = CreateOperatorDef(
+      "AveragePool",
+      "",
+      vector<string>{"X"},
+      vector<string>{"Y"},
+      vector<Argument>{MakeArgument<int>("global_pooling", 1)});
+  cost = OpSchemaRegistry::Schema("AveragePool")->InferCost(def, shapes);
+  EXPECT_EQ(cost.flops, 2 * 3 * 8 * 8);
+  EXPECT_EQ(cost.bytes_written, 2 * 3 * sizeof(float));
+}
+
+} // namespace caffe2
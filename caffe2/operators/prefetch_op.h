@@ -1,12 +1,14 @@
 #ifndef CAFFE2_OPERATORS_PREFETCH_OP_H_
 #define CAFFE2_OPERATORS_PREFETCH_OP_H_
 
+#include <algorithm>
 #include <condition_variable>
 #include <mutex>
 #include <thread> // NOLINT
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
 
 namespace caffe2 {
 
@@ -17,6 +19,14 @@ namespace caffe2 {
 // For any operator that is derived from PrefetchOperator, it should
 // explicitly call the Finalize() function in its destructor, so that the
 // prefetching thread is properly destructed.
+//
+// With the prefetch_depth argument, up to that many batches are prefetched
+// ahead of the consumer, so that a batch that is slow to prefetch does not
+// stall it. The batches are then copied to the outputs in the prefetching
+// thread, by CopyPrefetched() writing to a ring of output buffers, and Run()
+// only copies the next buffer to the outputs. How long Run() waited for the
+// batches, and how long the batches took to fetch, are logged by Finalize(),
+// to tune the depth.
 
 // Note: We inherit from OperatorBase since we control the
 // synchronization properties of this operator ourselves (we inform
@@ -30,7 +40,19 @@ class PrefetchOperator : public OperatorBase {
         context_(operator_def.device_option()),
         prefetched_(false),
         prefetch_success_(true),
-        finalize_(false) {}
+        finalize_(false),
+        prefetch_depth_(GetSingleArgument<int>("prefetch_depth", 1)) {
+    CAFFE_ENFORCE_GT(prefetch_depth_, 0, "prefetch_depth must be positive.");
+    if (prefetch_depth_ > 1) {
+      output_blobs_ = Outputs();
+      buffers_.resize(prefetch_depth_);
+      for (auto& buffer : buffers_) {
+        for (int i = 0; i < OutputSize(); ++i) {
+          buffer.blobs.emplace_back(new Blob());
+        }
+      }
+    }
+  }
 
   virtual ~PrefetchOperator() {
     CAFFE_ENFORCE(
@@ -40,7 +62,27 @@ class PrefetchOperator : public OperatorBase {
   }
 
   void Finalize() {
-    if (prefetch_thread_.get()) {
+    if (num_runs_ > 0) {
+      LOG(INFO) << "Operator " << def().type() << " waited for " << num_waits_
+                << " of " << num_runs_ << " prefetched batches, for "
+                << wait_seconds_ * 1000 << " ms in total, with a prefetch depth "
+                << "of " << prefetch_depth_ << ".";
+    }
+    if (num_fetches_ > 0) {
+      LOG(INFO) << "Operator " << def().type() << " fetched " << num_fetches_
+                << " batches in " << fetch_seconds_ / num_fetches_ * 1000
+                << " ms on average, and " << max_fetch_seconds_ * 1000
+                << " ms at most.";
+    }
+    if (prefetch_thread_.get() && prefetch_depth_ > 1) {
+      {
+        std::lock_guard<std::mutex> lock(prefetch_access_mutex_);
+        finalize_ = true;
+      }
+      producer_.notify_one();
+      prefetch_thread_->join();
+      prefetch_thread_.reset();
+    } else if (prefetch_thread_.get()) {
       {
         std::unique_lock<std::mutex> lock(prefetch_access_mutex_);
         while (!prefetched_)
@@ -63,13 +105,20 @@ class PrefetchOperator : public OperatorBase {
     // instead of in the constructor, because the prefetch_thread needs to start
     // after all derived classes' constructors finish.
     if (!prefetch_thread_) {
-      prefetch_thread_.reset(
-          new std::thread([this] { this->PrefetchWorker(); }));
+      prefetch_thread_.reset(new std::thread([this] {
+        if (prefetch_depth_ > 1) {
+          this->BufferedPrefetchWorker();
+        } else {
+          this->PrefetchWorker();
+        }
+      }));
     }
     context_.SwitchToDevice();
+    if (prefetch_depth_ > 1) {
+      return RunBuffered();
+    }
     std::unique_lock<std::mutex> lock(prefetch_access_mutex_);
-    while (!prefetched_)
-      consumer_.wait(lock);
+    WaitForConsumer(&lock, [this] { return prefetched_.load(); });
     if (!prefetch_success_) {
       LOG(ERROR) << "Prefetching failed.";
       return false;
@@ -93,7 +142,9 @@ class PrefetchOperator : public OperatorBase {
       // We will need to run a FinishDeviceComputation() call because the
       // prefetcher thread and the main thread are potentially using different
       // streams (like on GPU).
+      Timer timer;
       prefetch_success_ = Prefetch() && context_.FinishDeviceComputation();
+      RecordFetch(timer.Seconds());
       prefetched_ = true;
       consumer_.notify_one();
       while (prefetched_)
@@ -101,10 +152,131 @@ class PrefetchOperator : public OperatorBase {
     }
   }
 
+  // The prefetching thread when prefetch_depth is more than one: it fills the
+  // empty buffers in order, without holding the lock while it prefetches.
+  void BufferedPrefetchWorker() {
+    context_.SwitchToDevice();
+    std::unique_lock<std::mutex> lock(prefetch_access_mutex_);
+    while (true) {
+      while (!finalize_ && num_buffered_ == prefetch_depth_) {
+        producer_.wait(lock);
+      }
+      if (finalize_) {
+        return;
+      }
+      Buffer& buffer = buffers_[next_to_fill_];
+      lock.unlock();
+      for (int i = 0; i < OutputSize(); ++i) {
+        SetOutputBlob(i, buffer.blobs[i].get());
+      }
+      Timer timer;
+      buffer.success = Prefetch() && CopyPrefetched() &&
+          context_.FinishDeviceComputation();
+      const float seconds = timer.Seconds();
+      lock.lock();
+      RecordFetch(seconds);
+      next_to_fill_ = (next_to_fill_ + 1) % prefetch_depth_;
+      ++num_buffered_;
+      consumer_.notify_one();
+    }
+  }
+
+  // The number of runs, and how many of them waited for the prefetching
+  // thread, for how long in total.
+  int64_t num_runs() const {
+    return num_runs_;
+  }
+  int64_t num_waits() const {
+    return num_waits_;
+  }
+  double wait_seconds() const {
+    return wait_seconds_;
+  }
+  // The number of batches prefetched, and how long they took to fetch in
+  // total and at most, including CopyPrefetched() when the prefetching thread
+  // calls it.
+  int64_t num_fetches() const {
+    return num_fetches_;
+  }
+  double fetch_seconds() const {
+    return fetch_seconds_;
+  }
+  double max_fetch_seconds() const {
+    return max_fetch_seconds_;
+  }
+
   // You will need to implement this instead of the Run function.
   virtual bool Prefetch() = 0;
   virtual bool CopyPrefetched() = 0;
 
+ private:
+  // A prefetched batch, as written to the outputs by CopyPrefetched().
+  struct Buffer {
+    vector<unique_ptr<Blob>> blobs;
+    bool success = true;
+  };
+
+  // Waits on the consumer condition until ready() holds, and keeps track of
+  // the time spent waiting.
+  template <typename Ready>
+  void WaitForConsumer(std::unique_lock<std::mutex>* lock, Ready ready) {
+    ++num_runs_;
+    if (ready()) {
+      return;
+    }
+    Timer timer;
+    while (!ready()) {
+      consumer_.wait(*lock);
+    }
+    ++num_waits_;
+    wait_seconds_ += timer.Seconds();
+  }
+
+  // Called with prefetch_access_mutex_ held.
+  void RecordFetch(double seconds) {
+    ++num_fetches_;
+    fetch_seconds_ += seconds;
+    max_fetch_seconds_ = std::max(max_fetch_seconds_, seconds);
+  }
+
+  bool RunBuffered() {
+    Buffer* buffer = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(prefetch_access_mutex_);
+      WaitForConsumer(&lock, [this] { return num_buffered_ > 0; });
+      buffer = &buffers_[next_to_consume_];
+    }
+    bool success = buffer->success;
+    if (!success) {
+      LOG(ERROR) << "Prefetching failed.";
+    } else {
+      for (int i = 0; i < output_blobs_.size(); ++i) {
+        MoveToOutput(buffer->blobs[i].get(), output_blobs_[i]);
+      }
+      success = context_.FinishDeviceComputation();
+    }
+    {
+      std::lock_guard<std::mutex> lock(prefetch_access_mutex_);
+      next_to_consume_ = (next_to_consume_ + 1) % prefetch_depth_;
+      --num_buffered_;
+    }
+    producer_.notify_one();
+    return success;
+  }
+
+  // Tensors are copied, as CopyPrefetched() would have, so that the buffer
+  // can be refilled while the outputs are still read. Other blobs are moved.
+  void MoveToOutput(Blob* buffer, Blob* output) {
+    if (buffer->IsType<Tensor<Context>>()) {
+      output->GetMutable<Tensor<Context>>()->CopyFrom(
+          buffer->Get<Tensor<Context>>(), &context_);
+    } else if (buffer->IsType<TensorCPU>()) {
+      output->GetMutable<TensorCPU>()->CopyFrom(buffer->Get<TensorCPU>());
+    } else {
+      output->swap(*buffer);
+    }
+  }
+
  protected:
   Context context_;
   std::mutex prefetch_access_mutex_;
@@ -116,6 +288,23 @@ class PrefetchOperator : public OperatorBase {
   // finalize_ is used to tell the prefetcher to quit.
   std::atomic<bool> finalize_;
   unique_ptr<std::thread> prefetch_thread_;
+
+ private:
+  const int prefetch_depth_;
+  // With a prefetch depth of more than one, the actual outputs, and the ring
+  // of buffers that the prefetching thread fills, guarded by
+  // prefetch_access_mutex_.
+  vector<Blob*> output_blobs_;
+  vector<Buffer> buffers_;
+  int num_buffered_ = 0;
+  int next_to_fill_ = 0;
+  int next_to_consume_ = 0;
+  int64_t num_runs_ = 0;
+  int64_t num_waits_ = 0;
+  double wait_seconds_ = 0;
+  int64_t num_fetches_ = 0;
+  double fetch_seconds_ = 0;
+  double max_fetch_seconds_ = 0;
 };
 
 } // namespace caffe2
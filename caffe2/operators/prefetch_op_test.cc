@@ -0,0 +1,95 @@
+#include <chrono>
+#include <thread>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/prefetch_op.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Outputs 0, 1, 2, ..., taking the given time to prefetch each number.
+class CountingPrefetchOp final : public PrefetchOperator<CPUContext> {
+ public:
+  CountingPrefetchOp(const OperatorDef& operator_def, Workspace* ws)
+      : PrefetchOperator<CPUContext>(operator_def, ws),
+        prefetch_ms_(GetSingleArgument<int>("prefetch_ms", 0)) {}
+  ~CountingPrefetchOp() {
+    PrefetchOperator<CPUContext>::Finalize();
+  }
+
+  bool Prefetch() override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(prefetch_ms_));
+    prefetched_value_ = next_value_++;
+    return prefetched_value_ != 5;
+  }
+
+  bool CopyPrefetched() override {
+    auto* output = Output<TensorCPU>(0);
+    output->Resize(1);
+    output->mutable_data<int>()[0] = prefetched_value_;
+    return true;
+  }
+
+ private:
+  const int prefetch_ms_;
+  int next_value_ = 0;
+  int prefetched_value_ = -1;
+};
+
+REGISTER_CPU_OPERATOR(CountingPrefetch, CountingPrefetchOp);
+OPERATOR_SCHEMA(CountingPrefetch).NumInputs(0).NumOutputs(1);
+
+} // namespace
+
+TEST(PrefetchOperatorTest, OutputsInOrder) {
+  for (int depth : {1, 3}) {
+    Workspace ws;
+    OperatorDef def;
+    def.set_type("CountingPrefetch");
+    def.add_output("count");
+    AddArgument<int>("prefetch_depth", depth, &def);
+    unique_ptr<OperatorBase> op(CreateOperator(def, &ws));
+    for (int i = 0; i < 5; ++i) {
+      ASSERT_TRUE(op->Run());
+      const auto& count = ws.GetBlob("count")->Get<TensorCPU>();
+      EXPECT_EQ(count.data<int>()[0], i);
+    }
+    // The prefetch of 5 fails. With buffers, only the run of that batch does.
+    EXPECT_FALSE(op->Run());
+    if (depth > 1) {
+      ASSERT_TRUE(op->Run());
+      EXPECT_EQ(ws.GetBlob("count")->Get<TensorCPU>().data<int>()[0], 6);
+    }
+  }
+}
+
+TEST(PrefetchOperatorTest, BuffersAbsorbJitter) {
+  Workspace ws;
+  OperatorDef def;
+  def.set_type("CountingPrefetch");
+  def.add_output("count");
+  AddArgument<int>("prefetch_depth", 4, &def);
+  AddArgument<int>("prefetch_ms", 10, &def);
+  unique_ptr<OperatorBase> op(CreateOperator(def, &ws));
+  auto* prefetch_op = static_cast<PrefetchOperator<CPUContext>*>(op.get());
+  ASSERT_TRUE(op->Run());
+  EXPECT_EQ(prefetch_op->num_waits(), 1);
+  // Once the buffers are full, runs take the batches without waiting.
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  for (int i = 1; i < 5; ++i) {
+    ASSERT_TRUE(op->Run());
+    EXPECT_EQ(ws.GetBlob("count")->Get<TensorCPU>().data<int>()[0], i);
+  }
+  EXPECT_EQ(prefetch_op->num_runs(), 5);
+  EXPECT_EQ(prefetch_op->num_waits(), 1);
+  EXPECT_GT(prefetch_op->wait_seconds(), 0);
+  // The prefetching thread updates the fetch times until it is joined.
+  prefetch_op->Finalize();
+  EXPECT_GE(prefetch_op->num_fetches(), 5);
+  EXPECT_GE(prefetch_op->max_fetch_seconds(), 0.009);
+  EXPECT_GE(prefetch_op->fetch_seconds(), 0.009 * prefetch_op->num_fetches());
+}
+
+} // namespace caffe2
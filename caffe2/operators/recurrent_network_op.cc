@@ -109,5 +109,24 @@ void extractLinks(
     links->push_back(l);
   }
 }
+
+NetBase* StepNetCache::get(
+    size_t t,
+    const std::shared_ptr<Workspace>& ws,
+    const NetDef& stepNetDef) {
+  if (nets_.size() <= t) {
+    workspaces_.resize(t + 1);
+    nets_.resize(t + 1);
+  }
+  if (workspaces_[t] != ws || !nets_[t]) {
+    // Drop the old net first, since its operators refer to the old
+    // workspace.
+    nets_[t].reset();
+    workspaces_[t] = ws;
+    nets_[t] = CreateNet(stepNetDef, ws.get());
+    CAFFE_ENFORCE(nets_[t], "Step Net construction failure");
+  }
+  return nets_[t].get();
+}
 } // namespace detail
 }
@@ -3,6 +3,7 @@
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
+#include "caffe2/core/net.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/core/tensor.h"
 #include "google/protobuf/text_format.h"
@@ -141,6 +142,24 @@ void extractLinks(
     const std::string& externalArg,
     const std::string offsetArg,
     std::vector<detail::Link>* links);
+
+/**
+ * Keeps the step net of each timestep across runs of the op. The net for
+ * timestep t is only built again when the step workspace at t has changed.
+ */
+class StepNetCache {
+ public:
+  NetBase* get(
+      size_t t,
+      const std::shared_ptr<Workspace>& ws,
+      const NetDef& stepNetDef);
+
+ private:
+  // Holding the workspaces keeps them alive as long as the nets built on
+  // them, so they are destroyed after the nets.
+  std::vector<std::shared_ptr<Workspace>> workspaces_;
+  std::vector<std::unique_ptr<NetBase>> nets_;
+};
 } // namespace detail
 
 template <typename T, class Context>
@@ -225,14 +244,18 @@ class RecurrentNetworkOp final : public Operator<Context> {
           ri, seqLen, batchSize, sharedWs_, &context_);
     }
 
+    // The step workspaces are kept across runs, and only added when the
+    // sequence is longer than any seen before. The links re-bind their blobs
+    // to the current inputs and outputs.
     std::vector<std::shared_ptr<Workspace>>* stepWorkspaces =
         OperatorBase::Output<std::vector<std::shared_ptr<Workspace>>>(
             OutputSize() - 1);
-    stepWorkspaces->clear();
+    while (stepWorkspaces->size() < seqLen) {
+      stepWorkspaces->push_back(std::make_shared<Workspace>(sharedWs_));
+    }
 
     for (auto t = 0; t < seqLen; ++t) {
-      stepWorkspaces->push_back(std::make_shared<Workspace>(sharedWs_));
-      auto& currentStepWorkspace = stepWorkspaces->back();
+      auto& currentStepWorkspace = (*stepWorkspaces)[t];
 
       for (const auto& link : links_) {
         detail::applyLink<T, Context>(link, t, currentStepWorkspace.get());
@@ -246,8 +269,8 @@ class RecurrentNetworkOp final : public Operator<Context> {
       timestepBlob->template GetMutable<TensorCPU>()
           ->template mutable_data<int32_t>()[0] = t;
 
-      NetBase* stepNet = currentStepWorkspace->CreateNet(stepNetDef_);
-      CAFFE_ENFORCE(stepNet, "Step Net construction failure");
+      NetBase* stepNet =
+          stepNets_.get(t, currentStepWorkspace, stepNetDef_);
       // Since we have a SimpleNet, there are no races here.
       stepNet->RunAsync();
     }
@@ -266,6 +289,7 @@ class RecurrentNetworkOp final : public Operator<Context> {
   std::vector<detail::OffsetAlias> aliases_;
   std::vector<detail::RecurrentInput> recurrentInputs_;
   std::string timestep_;
+  detail::StepNetCache stepNets_;
 };
 
 template <typename T, class Context>
@@ -513,9 +537,8 @@ class RecurrentNetworkGradientOp final : public Operator<Context> {
       for (const auto& link : links_) {
         detail::applyLink<T, Context>(link, t, stepWorkspaces[t].get());
       }
-      NetBase* stepNet_ = stepWorkspaces[t]->CreateNet(stepNetDef_);
-      CAFFE_ENFORCE(stepNet_);
-      stepNet_->RunAsync();
+      NetBase* stepNet = stepNets_.get(t, stepWorkspaces[t], stepNetDef_);
+      stepNet->RunAsync();
       accumulateParameterGradients();
     }
 
@@ -584,6 +607,7 @@ class RecurrentNetworkGradientOp final : public Operator<Context> {
   const int numSequences_{1};
   std::vector<int32_t> recurrentInputIds_;
   std::vector<int32_t> gradInputs_;
+  detail::StepNetCache stepNets_;
 };
 
 } // namespace caffe2
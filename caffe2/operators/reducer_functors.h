@@ -2,6 +2,7 @@
 #define CAFFE2_OPERATORS_RECUDER_FUNCTORS_H_
 
 #include <array>
+#include <cmath>
 
 #include "caffe2/core/context.h"
 #include "caffe2/utils/math.h"
@@ -320,11 +321,27 @@ struct MaxRangeReducerDef {
 // Incremental reducers: consume elements one by one
 ////////////////////////////////////////////////////////////////////////////////
 
+// The block sizes that the reducers below are compiled for, which makes the
+// per-slice Axpy and Scale inlined loops of a fixed trip count: 1 for scalar
+// slices and the common sizes of embeddings. Other sizes use the generic
+// version, picked by DispatchHelper for the block size of the input.
+using ReducerFixedSizes = FixedValues<1, 16, 32, 64, 128>;
+
 // Base implementation, everything can be overwritten
 class BaseReducer {
  public:
   static constexpr int kInputCount = 1;
 
+  // Whether the fused sparse ops can compute the reduction with
+  // EmbeddingLookup instead, with the weights it returns for the rows and
+  // dividing by the lengths of the segments to the given power.
+  static constexpr bool kFusedLookup = false;
+  static constexpr float kLengthsPower = 0;
+  template <class Meta>
+  static std::nullptr_t lookupWeights(const Meta& meta) {
+    return nullptr;
+  }
+
   struct Meta {
     TIndex block_size;
     vector<TIndex> block_shape;
@@ -398,7 +415,9 @@ class SumReducerGradient;
 template <typename T>
 class SumReducer<T, CPUContext> : public BaseReducer {
  public:
-  using FixedDispatch = FixedValues<1>;
+  using FixedDispatch = ReducerFixedSizes;
+
+  static constexpr bool kFusedLookup = true;
 
   SumReducer(const Meta& meta, T* out, CPUContext* context) : out_(out) {
     // add a wrapper in Context for it
@@ -417,7 +436,7 @@ class SumReducer<T, CPUContext> : public BaseReducer {
 template <typename T, class Context>
 class SumReducerGradient : public BaseReducerGradient {
  public:
-  using FixedDispatch = FixedValues<1>;
+  using FixedDispatch = ReducerFixedSizes;
 
   SumReducerGradient(const Meta& meta, const T* s_grad, CPUContext* context)
       : s_grad_(s_grad) {}
@@ -464,7 +483,7 @@ class WeightedSumReducer<T, CPUContext> : public BaseReducer {
  public:
   static constexpr int kInputCount = 2;
 
-  using FixedDispatch = FixedValues<1>;
+  using FixedDispatch = ReducerFixedSizes;
 
   struct Meta : BaseReducer::Meta {
     const T* scalars;
@@ -481,6 +500,11 @@ class WeightedSumReducer<T, CPUContext> : public BaseReducer {
     }
   };
 
+  static constexpr bool kFusedLookup = true;
+  static const T* lookupWeights(const Meta& meta) {
+    return meta.scalars;
+  }
+
   WeightedSumReducer(const Meta& meta, T* out, CPUContext* context)
       : out_(out) {
     // do we have a wrapper for it?
@@ -513,7 +537,7 @@ class WeightedSumReducerGradient : public BaseReducerGradient {
     return numAuxInputsWithGrads(def) > 0;
   }
 
-  using FixedDispatch = FixedValues<1>;
+  using FixedDispatch = ReducerFixedSizes;
 
   struct Meta : public BaseReducerGradient::Meta {
     const T* scalars;
@@ -603,7 +627,10 @@ class MeanReducerGradient;
 template <typename T>
 class MeanReducer<T, CPUContext> : public BaseReducer {
  public:
-  using FixedDispatch = FixedValues<1>;
+  using FixedDispatch = ReducerFixedSizes;
+
+  static constexpr bool kFusedLookup = true;
+  static constexpr float kLengthsPower = 1;
 
   MeanReducer(const Meta& meta, T* out, CPUContext* context)
       : out_(out), current_size_(0) {
@@ -637,7 +664,7 @@ class MeanReducerGradient : public BaseReducerGradient {
     return true;
   }
 
-  using FixedDispatch = FixedValues<1>;
+  using FixedDispatch = ReducerFixedSizes;
 
   MeanReducerGradient(const Meta& meta, const T* s_grad, CPUContext* context)
       : s_grad_(s_grad) {}
@@ -670,6 +697,91 @@ struct MeanReducerDef {
   static void PopulateSchema(OpSchema& schema) {}
 };
 
+// The weights of LengthsToWeights with its default power, computed while the
+// slices are summed rather than stored in a tensor.
+template <typename T, class Context>
+class SqrtMeanReducer;
+template <typename T, class Context>
+class SqrtMeanReducerGradient;
+
+template <typename T>
+class SqrtMeanReducer<T, CPUContext> : public BaseReducer {
+ public:
+  using FixedDispatch = ReducerFixedSizes;
+
+  static constexpr bool kFusedLookup = true;
+  static constexpr float kLengthsPower = 0.5;
+
+  SqrtMeanReducer(const Meta& meta, T* out, CPUContext* context)
+      : out_(out), current_size_(0) {
+    memset(out, 0, sizeof(T) * meta.block_size);
+  }
+
+  template <int FixedSize>
+  void
+  process(const Meta& meta, const T* in, TIndex offset, CPUContext* context) {
+    math::Axpy<T, CPUContext, FixedSize>(meta.block_size, 1, in, out_, context);
+    current_size_++;
+  }
+
+  template <int FixedSize>
+  void finish(const Meta& meta, CPUContext* context) {
+    if (current_size_ > 0) {
+      math::Scale<T, CPUContext, FixedSize>(
+          meta.block_size, 1.0 / std::sqrt(current_size_), out_, out_, context);
+    }
+  }
+
+ private:
+  T* out_;
+  int current_size_;
+};
+
+template <typename T, class Context>
+class SqrtMeanReducerGradient : public BaseReducerGradient {
+ public:
+  static constexpr bool computeLength() {
+    return true;
+  }
+
+  using FixedDispatch = ReducerFixedSizes;
+
+  SqrtMeanReducerGradient(
+      const Meta& meta,
+      const T* s_grad,
+      CPUContext* context)
+      : s_grad_(s_grad) {}
+
+  template <int FixedSize>
+  void fillGrad(
+      const Meta& meta,
+      T* data_grad,
+      TIndex offset,
+      Context* context,
+      const int length) {
+    CAFFE_ENFORCE_GT(length, 0, "Segment length must be > 0");
+    math::Scale<T, CPUContext, FixedSize>(
+        meta.block_size, 1.0 / std::sqrt(length), s_grad_, data_grad, context);
+  }
+
+ private:
+  const T* s_grad_;
+};
+
+struct SqrtMeanReducerDef {
+  template <typename T, class Context>
+  using Reducer = SqrtMeanReducer<T, Context>;
+  template <typename T, class Context>
+  using ReducerGradient = SqrtMeanReducerGradient<T, Context>;
+  static constexpr const char* name = "SqrtMean";
+  static constexpr const char* doc =
+      "SqrtMean sums the input slices element-wise and divides the sum by the "
+      "square root of the number of slices, as WeightedSum does with the "
+      "weights of LengthsToWeights. Operation doesn't change the shape of the "
+      "individual blocks.";
+  static void PopulateSchema(OpSchema& schema) {}
+};
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_RECUDER_FUNCTORS_H_
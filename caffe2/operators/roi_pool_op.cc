@@ -1,12 +1,275 @@
 #include "roi_pool_op.h"
 
+#include <algorithm>
 #include <cfloat>
 
+#include "caffe2/core/parallel_for.h"
+
 namespace caffe2 {
 
 using std::max;
 using std::min;
 
+namespace {
+
+// Checks that the RoIs, each of the form [batch_index x1 y1 x2 y2], are of
+// images of the batch. This is done up front, as the RoIs are then split
+// across threads, where an exception could not be thrown.
+void CheckRoIs(const TensorCPU& R, int batch_size) {
+  if (R.size() == 0) {
+    return;
+  }
+  CAFFE_ENFORCE_EQ(R.ndim(), 2);
+  CAFFE_ENFORCE_EQ(R.dim32(1), 5);
+  const float* rois = R.data<float>();
+  for (int n = 0; n < R.dim32(0); ++n) {
+    const int roi_batch_id = rois[n * 5];
+    CAFFE_ENFORCE_GE(roi_batch_id, 0);
+    CAFFE_ENFORCE_LT(roi_batch_id, batch_size);
+  }
+}
+
+// Runs fn(thread, n, roi_batch_id, roi) for every RoI n, where roi points to
+// its [x1 y1 x2 y2]. The RoIs are split across threads with ParallelFor, and
+// thread picks the scratch buffer of the thread that runs a RoI.
+template <typename F>
+void ForEachRoI(Workspace* ws, const TensorCPU& R, F fn) {
+  const float* rois = R.data<float>();
+  const int num_rois = R.size() == 0 ? 0 : R.dim32(0);
+  ParallelFor(ws, num_rois, [&](int thread, size_t n) {
+    const float* roi = rois + n * 5;
+    fn(thread, n, static_cast<int>(roi[0]), roi + 1);
+  });
+}
+
+// The pixels [*start, *end) of a dimension of size limit that bin p of a RoI
+// pools over, for a RoI from roi_start with bins of bin_size.
+void RoIPoolBin(
+    int p,
+    float bin_size,
+    int roi_start,
+    int limit,
+    int* start,
+    int* end) {
+  // Compute pooling region for this output unit:
+  //  start (included) = floor(p * roi_size / pooled_size)
+  //  end (excluded) = ceil((p + 1) * roi_size / pooled_size)
+  *start = static_cast<int>(floor(static_cast<float>(p) * bin_size));
+  *end = static_cast<int>(ceil(static_cast<float>(p + 1) * bin_size));
+  // Add roi offsets and clip to input boundaries
+  *start = min(max(*start + roi_start, 0), limit);
+  *end = min(max(*end + roi_start, 0), limit);
+}
+
+// The bins of a RoI, as the start and end of every row of bins followed by
+// the start and end of every column of bins.
+void RoIPoolBins(
+    const float* roi,
+    float spatial_scale,
+    int pooled_height,
+    int pooled_width,
+    int height,
+    int width,
+    int* bins) {
+  int roi_start_w = round(roi[0] * spatial_scale);
+  int roi_start_h = round(roi[1] * spatial_scale);
+  int roi_end_w = round(roi[2] * spatial_scale);
+  int roi_end_h = round(roi[3] * spatial_scale);
+
+  // Force malformed ROIs to be 1x1
+  int roi_height = max(roi_end_h - roi_start_h + 1, 1);
+  int roi_width = max(roi_end_w - roi_start_w + 1, 1);
+
+  const float bin_size_h =
+      static_cast<float>(roi_height) / static_cast<float>(pooled_height);
+  const float bin_size_w =
+      static_cast<float>(roi_width) / static_cast<float>(pooled_width);
+  for (int ph = 0; ph < pooled_height; ++ph) {
+    RoIPoolBin(
+        ph, bin_size_h, roi_start_h, height, &bins[2 * ph], &bins[2 * ph + 1]);
+  }
+  bins += 2 * pooled_height;
+  for (int pw = 0; pw < pooled_width; ++pw) {
+    RoIPoolBin(
+        pw, bin_size_w, roi_start_w, width, &bins[2 * pw], &bins[2 * pw + 1]);
+  }
+}
+
+// Max pools the planes of a RoI one by one. argmax may be null.
+void RoIPoolNCHW(
+    const float* X,
+    int channels,
+    int height,
+    int width,
+    int pooled_height,
+    int pooled_width,
+    const int* bins,
+    float* Y,
+    int* argmax) {
+  const int* w_bins = bins + 2 * pooled_height;
+  for (int c = 0; c < channels; ++c) {
+    for (int ph = 0; ph < pooled_height; ++ph) {
+      const int hstart = bins[2 * ph], hend = bins[2 * ph + 1];
+      for (int pw = 0; pw < pooled_width; ++pw) {
+        const int wstart = w_bins[2 * pw], wend = w_bins[2 * pw + 1];
+        const int pool_index = ph * pooled_width + pw;
+
+        // Define an empty pooling region to be zero
+        bool is_empty = (hend <= hstart) || (wend <= wstart);
+        Y[pool_index] = is_empty ? 0 : -FLT_MAX;
+        if (argmax) {
+          // If nothing is pooled, argmax = -1 causes nothing to be backprop'd
+          argmax[pool_index] = -1;
+        }
+
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const int index = h * width + w;
+            if (X[index] > Y[pool_index]) {
+              Y[pool_index] = X[index];
+              if (argmax) {
+                argmax[pool_index] = index;
+              }
+            }
+          }
+        }
+      }
+    }
+    // Increment all data pointers by one channel
+    X += height * width;
+    Y += pooled_height * pooled_width;
+    if (argmax) {
+      argmax += pooled_height * pooled_width;
+    }
+  }
+}
+
+// Max pools all the channels of a bin at once, over contiguous vectors of the
+// input. The argmaxes are, as in NCHW, the offsets h * width + w of the
+// pixels in the plane.
+void RoIPoolNHWC(
+    const float* X,
+    int channels,
+    int width,
+    int pooled_height,
+    int pooled_width,
+    const int* bins,
+    float* Y,
+    int* argmax) {
+  const int* w_bins = bins + 2 * pooled_height;
+  for (int ph = 0; ph < pooled_height; ++ph) {
+    const int hstart = bins[2 * ph], hend = bins[2 * ph + 1];
+    for (int pw = 0; pw < pooled_width; ++pw) {
+      const int wstart = w_bins[2 * pw], wend = w_bins[2 * pw + 1];
+      const bool is_empty = (hend <= hstart) || (wend <= wstart);
+      std::fill(Y, Y + channels, is_empty ? 0 : -FLT_MAX);
+      if (argmax) {
+        std::fill(argmax, argmax + channels, -1);
+      }
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          const int index = h * width + w;
+          const float* x = X + index * channels;
+          if (argmax) {
+            for (int c = 0; c < channels; ++c) {
+              if (x[c] > Y[c]) {
+                Y[c] = x[c];
+                argmax[c] = index;
+              }
+            }
+          } else {
+            for (int c = 0; c < channels; ++c) {
+              Y[c] = max(Y[c], x[c]);
+            }
+          }
+        }
+      }
+      Y += channels;
+      if (argmax) {
+        argmax += channels;
+      }
+    }
+  }
+}
+
+// The samples of the bins of a RoI, bin by bin, which all the channels share.
+void RoIAlignSamples(
+    const RoIAlignGrid& grid,
+    int height,
+    int width,
+    int pooled_height,
+    int pooled_width,
+    vector<RoIAlignSample>* samples) {
+  samples->clear();
+  for (int ph = 0; ph < pooled_height; ++ph) {
+    for (int pw = 0; pw < pooled_width; ++pw) {
+      for (int iy = 0; iy < grid.grid_h; ++iy) {
+        for (int ix = 0; ix < grid.grid_w; ++ix) {
+          samples->emplace_back(
+              grid.y(ph, iy), grid.x(pw, ix), height, width);
+        }
+      }
+    }
+  }
+}
+
+void RoIAlignNCHW(
+    const float* X,
+    int channels,
+    int height,
+    int width,
+    int pooled_size,
+    const vector<RoIAlignSample>& samples,
+    float* Y) {
+  const int bin_samples = samples.size() / pooled_size;
+  const float scale = 1.f / bin_samples;
+  for (int c = 0; c < channels; ++c) {
+    const RoIAlignSample* sample = samples.data();
+    for (int i = 0; i < pooled_size; ++i) {
+      float sum = 0;
+      for (int j = 0; j < bin_samples; ++j, ++sample) {
+        for (int k = 0; k < 4; ++k) {
+          sum += sample->weight[k] * X[sample->offset[k]];
+        }
+      }
+      Y[i] = sum * scale;
+    }
+    X += height * width;
+    Y += pooled_size;
+  }
+}
+
+// The channels of a bin are summed at once, over contiguous vectors of the
+// input.
+void RoIAlignNHWC(
+    const float* X,
+    int channels,
+    int pooled_size,
+    const vector<RoIAlignSample>& samples,
+    float* Y) {
+  const int bin_samples = samples.size() / pooled_size;
+  const float scale = 1.f / bin_samples;
+  const RoIAlignSample* sample = samples.data();
+  for (int i = 0; i < pooled_size; ++i) {
+    std::fill(Y, Y + channels, 0.f);
+    for (int j = 0; j < bin_samples; ++j, ++sample) {
+      for (int k = 0; k < 4; ++k) {
+        const float weight = sample->weight[k];
+        const float* x = X + sample->offset[k] * channels;
+        for (int c = 0; c < channels; ++c) {
+          Y[c] += weight * x[c];
+        }
+      }
+    }
+    for (int c = 0; c < channels; ++c) {
+      Y[c] *= scale;
+    }
+    Y += channels;
+  }
+}
+
+} // namespace
+
 template <>
 bool RoIPoolOp<float, CPUContext>::RunOnDevice() {
   const auto& X = Input(0); // Input data to pool
@@ -14,100 +277,116 @@ bool RoIPoolOp<float, CPUContext>::RunOnDevice() {
   auto* Y = Output(0); // RoI pooled data
   auto* A = is_test_ ? nullptr : Output(1); // argmaxes
 
-  // Each ROI is of the form [batch_index x1 y1 x2 y2]
-  CAFFE_ENFORCE_EQ(R.dim32(1), 5);
-
-  int batch_size = X.dim32(0);
-  int channels = X.dim32(1);
-  int height = X.dim32(2);
-  int width = X.dim32(3);
-  int num_rois = R.dim32(0);
+  const bool nchw = order_ == StorageOrder::NCHW;
+  const int batch_size = X.dim32(0);
+  const int channels = X.dim32(nchw ? 1 : 3);
+  const int height = X.dim32(nchw ? 2 : 1);
+  const int width = X.dim32(nchw ? 3 : 2);
+  CheckRoIs(R, batch_size);
+  const int num_rois = R.size() == 0 ? 0 : R.dim32(0);
 
-  Y->Resize(num_rois, channels, pooled_height_, pooled_width_);
+  if (nchw) {
+    Y->Resize(num_rois, channels, pooled_height_, pooled_width_);
+  } else {
+    Y->Resize(num_rois, pooled_height_, pooled_width_, channels);
+  }
   if (!is_test_) {
     A->Resize(Y->dims());
   }
 
   const float* Xdata = X.data<float>();
-  const float* rois = R.data<float>();
   float* Ydata = Y->mutable_data<float>();
   int* argmax_data = is_test_ ? nullptr : A->mutable_data<int>();
+  const int image_size = channels * height * width;
+  const int roi_size = channels * pooled_height_ * pooled_width_;
+  vector<vector<int>> bins(
+      ParallelForNumThreads(ws_),
+      vector<int>(2 * (pooled_height_ + pooled_width_)));
 
   // For each ROI R = [batch_index x1 y1 x2 y2]: max pool over R
-  for (int n = 0; n < num_rois; ++n) {
-    int roi_batch_id = rois[0];
-    int roi_start_w = round(rois[1] * spatial_scale_);
-    int roi_start_h = round(rois[2] * spatial_scale_);
-    int roi_end_w = round(rois[3] * spatial_scale_);
-    int roi_end_h = round(rois[4] * spatial_scale_);
-    CAFFE_ENFORCE_GE(roi_batch_id, 0);
-    CAFFE_ENFORCE_LT(roi_batch_id, batch_size);
+  ForEachRoI(ws_, R, [&](int thread, int n, int batch_id, const float* roi) {
+    RoIPoolBins(
+        roi,
+        spatial_scale_,
+        pooled_height_,
+        pooled_width_,
+        height,
+        width,
+        bins[thread].data());
+    const float* x = Xdata + batch_id * image_size;
+    int* argmax = argmax_data ? argmax_data + n * roi_size : nullptr;
+    if (nchw) {
+      RoIPoolNCHW(
+          x,
+          channels,
+          height,
+          width,
+          pooled_height_,
+          pooled_width_,
+          bins[thread].data(),
+          Ydata + n * roi_size,
+          argmax);
+    } else {
+      RoIPoolNHWC(
+          x,
+          channels,
+          width,
+          pooled_height_,
+          pooled_width_,
+          bins[thread].data(),
+          Ydata + n * roi_size,
+          argmax);
+    }
+  });
 
-    // Force malformed ROIs to be 1x1
-    int roi_height = max(roi_end_h - roi_start_h + 1, 1);
-    int roi_width = max(roi_end_w - roi_start_w + 1, 1);
+  return true;
+}
 
-    const float bin_size_h =
-        static_cast<float>(roi_height) / static_cast<float>(pooled_height_);
-    const float bin_size_w =
-        static_cast<float>(roi_width) / static_cast<float>(pooled_width_);
+template <>
+bool RoIAlignOp<float, CPUContext>::RunOnDevice() {
+  const auto& X = Input(0); // Input data to pool
+  const auto& R = Input(1); // RoIs
+  auto* Y = Output(0); // RoI pooled data
 
-    const float* batch_data = Xdata + roi_batch_id * X.size_from_dim(1);
+  const bool nchw = order_ == StorageOrder::NCHW;
+  const int batch_size = X.dim32(0);
+  const int channels = X.dim32(nchw ? 1 : 3);
+  const int height = X.dim32(nchw ? 2 : 1);
+  const int width = X.dim32(nchw ? 3 : 2);
+  CheckRoIs(R, batch_size);
+  const int num_rois = R.size() == 0 ? 0 : R.dim32(0);
 
-    for (int c = 0; c < channels; ++c) {
-      for (int ph = 0; ph < pooled_height_; ++ph) {
-        for (int pw = 0; pw < pooled_width_; ++pw) {
-          // Compute pooling region for this output unit:
-          //  start (included) = floor(ph * roi_height / pooled_height_)
-          //  end (excluded) = ceil((ph + 1) * roi_height / pooled_height_)
-          int hstart =
-              static_cast<int>(floor(static_cast<float>(ph) * bin_size_h));
-          int wstart =
-              static_cast<int>(floor(static_cast<float>(pw) * bin_size_w));
-          int hend =
-              static_cast<int>(ceil(static_cast<float>(ph + 1) * bin_size_h));
-          int wend =
-              static_cast<int>(ceil(static_cast<float>(pw + 1) * bin_size_w));
-
-          // Add roi offsets and clip to input boundaries
-          hstart = min(max(hstart + roi_start_h, 0), height);
-          hend = min(max(hend + roi_start_h, 0), height);
-          wstart = min(max(wstart + roi_start_w, 0), width);
-          wend = min(max(wend + roi_start_w, 0), width);
-
-          const int pool_index = ph * pooled_width_ + pw;
-
-          // Define an empty pooling region to be zero
-          bool is_empty = (hend <= hstart) || (wend <= wstart);
-          Ydata[pool_index] = is_empty ? 0 : -FLT_MAX;
-          if (!is_test_) {
-            // If nothing is pooled, argmax = -1 causes nothing to be backprop'd
-            argmax_data[pool_index] = -1;
-          }
+  if (nchw) {
+    Y->Resize(num_rois, channels, pooled_height_, pooled_width_);
+  } else {
+    Y->Resize(num_rois, pooled_height_, pooled_width_, channels);
+  }
 
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              const int index = h * width + w;
-              if (batch_data[index] > Ydata[pool_index]) {
-                Ydata[pool_index] = batch_data[index];
-                if (!is_test_) {
-                  argmax_data[pool_index] = index;
-                }
-              }
-            }
-          }
-        }
-      }
-      // Increment all data pointers by one channel
-      batch_data += X.size_from_dim(2);
-      Ydata += Y->size_from_dim(2);
-      if (!is_test_) {
-        argmax_data += A->size_from_dim(2);
-      }
+  const float* Xdata = X.data<float>();
+  float* Ydata = Y->mutable_data<float>();
+  const int image_size = channels * height * width;
+  const int pooled_size = pooled_height_ * pooled_width_;
+  vector<vector<RoIAlignSample>> samples(ParallelForNumThreads(ws_));
+
+  ForEachRoI(ws_, R, [&](int thread, int n, int batch_id, const float* roi) {
+    const RoIAlignGrid grid(
+        roi, spatial_scale_, pooled_height_, pooled_width_, sampling_ratio_);
+    RoIAlignSamples(
+        grid,
+        height,
+        width,
+        pooled_height_,
+        pooled_width_,
+        &samples[thread]);
+    const float* x = Xdata + batch_id * image_size;
+    float* y = Ydata + n * channels * pooled_size;
+    if (nchw) {
+      RoIAlignNCHW(
+          x, channels, height, width, pooled_size, samples[thread], y);
+    } else {
+      RoIAlignNHWC(x, channels, pooled_size, samples[thread], y);
     }
-    // Increment ROI data pointer
-    rois += R.size_from_dim(1);
-  }
+  });
 
   return true;
 }
@@ -116,6 +395,7 @@ namespace {
 
 REGISTER_CPU_OPERATOR(RoIPool, RoIPoolOp<float, CPUContext>);
 REGISTER_CPU_OPERATOR(RoIPoolGradient, RoIPoolGradientOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR(RoIAlign, RoIAlignOp<float, CPUContext>);
 
 // Input: X, rois
 // Output case #1: Y, argmaxes (train mode)
@@ -130,6 +410,8 @@ Depending on the mode, there are multiple output cases:
 
   Output case #1: Y, argmaxes (train mode)
   Output case #2: Y           (test mode)
+
+On the CPU, the RoIs are pooled in parallel.
 )DOC")
     .Arg(
         "is_test",
@@ -143,10 +425,7 @@ Depending on the mode, there are multiple output cases:
         "spatial_scale",
         "Multiplicative spatial scale factor to translate ROI coords from "
         "their input scale to the scale used when pooling (Default: 1.0).")
-    .Input(
-        0,
-        "X",
-        "The input 4-D tensor of data. Only NCHW order is currently supported.")
+    .Input(0, "X", "The input 4-D tensor of data, in NCHW or NHWC order.")
     .Input(
         1,
         "rois",
@@ -156,17 +435,56 @@ Depending on the mode, there are multiple output cases:
         0,
         "Y",
         "RoI pooled output 4-D tensor of shape "
-        "(num_rois, channels, pooled_h, pooled_w).")
+        "(num_rois, channels, pooled_h, pooled_w), or "
+        "(num_rois, pooled_h, pooled_w, channels) in NHWC.")
     .Output(
         1,
         "argmaxes",
-        "Argmaxes corresponding to indices in X used for gradient computation. "
+        "Argmaxes corresponding to indices in X used for gradient computation, "
+        "as the offsets h * width + w of the pixels in the image. "
         "Only output if arg \"is_test\" is false.");
 
 // Input: X, rois, argmaxes, dY (aka "gradOutput")
 // Output: dX (aka "gradInput")
 OPERATOR_SCHEMA(RoIPoolGradient).NumInputs(4).NumOutputs(1);
 
+// Input: X, rois
+// Output: Y
+OPERATOR_SCHEMA(RoIAlign)
+    .NumInputs(2)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Carries out RoIAlign for Mask R-CNN. Instead of the max over the pixels that
+a bin rounds to, as in RoIPool, the value of a bin is the average of a grid of
+samples in it, bilinearly interpolated from the input. RoIs are not rounded
+to the pixels either. On the CPU, the RoIs are pooled in parallel, and the
+sampling weights of a RoI are computed once for all of its channels.
+)DOC")
+    .Arg("order", "A StorageOrder string (Default: \"NCHW\").")
+    .Arg("pooled_h", "The pooled output height (Default: 1).")
+    .Arg("pooled_w", "The pooled output width (Default: 1).")
+    .Arg(
+        "spatial_scale",
+        "Multiplicative spatial scale factor to translate ROI coords from "
+        "their input scale to the scale used when pooling (Default: 1.0).")
+    .Arg(
+        "sampling_ratio",
+        "The number of samples along each dimension of a bin. If not "
+        "positive, about one per input pixel, ceil(roi_size / pooled_size) "
+        "(Default: -1).")
+    .Input(0, "X", "The input 4-D tensor of data, in NCHW or NHWC order.")
+    .Input(
+        1,
+        "rois",
+        "RoIs (Regions of Interest) to pool over. Should be a 2-D tensor of "
+        "shape (num_rois, 5) given as [[batch_id, x1, y1, x2, y2], ...].")
+    .Output(
+        0,
+        "Y",
+        "RoI pooled output 4-D tensor of shape "
+        "(num_rois, channels, pooled_h, pooled_w), or "
+        "(num_rois, pooled_h, pooled_w, channels) in NHWC.");
+
 class GetRoIPoolGradient : public GradientMakerBase {
   using GradientMakerBase::GradientMakerBase;
   vector<OperatorDef> GetGradientDefs() override {
@@ -15,6 +15,47 @@ inline __device__ float gpu_atomic_add(const float val, float* address) {
   return atomicAdd(address, val);
 }
 
+// The (n, c, ph, pw) of element index of a pooled output, which is
+// (num_rois, channels, pooled_height, pooled_width) in NCHW and
+// (num_rois, pooled_height, pooled_width, channels) in NHWC.
+inline __device__ void PooledCoords(
+    const int index,
+    const int channels,
+    const int pooled_height,
+    const int pooled_width,
+    const bool nhwc,
+    int* n,
+    int* c,
+    int* ph,
+    int* pw) {
+  if (nhwc) {
+    *c = index % channels;
+    *pw = (index / channels) % pooled_width;
+    *ph = (index / channels / pooled_width) % pooled_height;
+    *n = index / channels / pooled_width / pooled_height;
+  } else {
+    *pw = index % pooled_width;
+    *ph = (index / pooled_width) % pooled_height;
+    *c = (index / pooled_width / pooled_height) % channels;
+    *n = index / pooled_width / pooled_height / channels;
+  }
+}
+
+// The offset of plane c of image n of the input, and the *stride between the
+// pixels of the plane.
+inline __device__ int PlaneOffset(
+    const int n,
+    const int c,
+    const int channels,
+    const int height,
+    const int width,
+    const bool nhwc,
+    int* stride) {
+  *stride = nhwc ? channels : 1;
+  return nhwc ? n * height * width * channels + c
+              : (n * channels + c) * height * width;
+}
+
 template <typename T>
 __global__ void ROIPoolForward(
     const int nthreads,
@@ -25,15 +66,15 @@ __global__ void ROIPoolForward(
     const int width,
     const int pooled_height,
     const int pooled_width,
+    const bool nhwc,
     const T* bottom_rois,
     T* top_data,
     int* argmax_data) {
   CUDA_1D_KERNEL_LOOP(index, nthreads) {
     // (n, c, ph, pw) is an element in the pooled output
-    int pw = index % pooled_width;
-    int ph = (index / pooled_width) % pooled_height;
-    int c = (index / pooled_width / pooled_height) % channels;
-    int n = index / pooled_width / pooled_height / channels;
+    int n, c, ph, pw;
+    PooledCoords(
+        index, channels, pooled_height, pooled_width, nhwc, &n, &c, &ph, &pw);
 
     const T* offset_bottom_rois = bottom_rois + n * 5;
     int roi_batch_ind = offset_bottom_rois[0];
@@ -64,13 +105,14 @@ __global__ void ROIPoolForward(
     T maxval = is_empty ? 0 : -FLT_MAX;
     // If nothing is pooled, argmax = -1 causes nothing to be backprop'd
     int maxidx = -1;
-    const T* offset_bottom_data =
-        bottom_data + (roi_batch_ind * channels + c) * height * width;
+    int stride;
+    const T* offset_bottom_data = bottom_data +
+        PlaneOffset(roi_batch_ind, c, channels, height, width, nhwc, &stride);
     for (int h = hstart; h < hend; ++h) {
       for (int w = wstart; w < wend; ++w) {
         int bottom_index = h * width + w;
-        if (offset_bottom_data[bottom_index] > maxval) {
-          maxval = offset_bottom_data[bottom_index];
+        if (offset_bottom_data[bottom_index * stride] > maxval) {
+          maxval = offset_bottom_data[bottom_index * stride];
           maxidx = bottom_index;
         }
       }
@@ -94,29 +136,90 @@ __global__ void ROIPoolBackward(
     const int width,
     const int pooled_height,
     const int pooled_width,
+    const bool nhwc,
     T* bottom_diff,
     const T* bottom_rois) {
   CUDA_1D_KERNEL_LOOP(index, nthreads) {
     // (n, c, ph, pw) is an element in the pooled output
-    int pw = index % pooled_width;
-    int ph = (index / pooled_width) % pooled_height;
-    int c = (index / pooled_width / pooled_height) % channels;
-    int n = index / pooled_width / pooled_height / channels;
+    int n, c, ph, pw;
+    PooledCoords(
+        index, channels, pooled_height, pooled_width, nhwc, &n, &c, &ph, &pw);
 
     const T* offset_bottom_rois = bottom_rois + n * 5;
     int roi_batch_ind = offset_bottom_rois[0];
-    int bottom_offset = (roi_batch_ind * channels + c) * height * width;
-    int top_offset = (n * channels + c) * pooled_height * pooled_width;
-    const T* offset_top_diff = top_diff + top_offset;
-    T* offset_bottom_diff = bottom_diff + bottom_offset;
-    const int* offset_argmax_data = argmax_data + top_offset;
+    int stride;
+    T* offset_bottom_diff = bottom_diff +
+        PlaneOffset(roi_batch_ind, c, channels, height, width, nhwc, &stride);
 
-    int argmax = offset_argmax_data[ph * pooled_width + pw];
+    int argmax = argmax_data[index];
     if (argmax != -1) {
       gpu_atomic_add(
-          static_cast<T>(offset_top_diff[ph * pooled_width + pw]),
-          offset_bottom_diff + argmax);
+          static_cast<T>(top_diff[index]),
+          offset_bottom_diff + argmax * stride);
+    }
+  }
+}
+
+// The average of the bilinear samples of a bin, as RoIAlign on the CPU.
+template <typename T>
+__global__ void RoIAlignForward(
+    const int nthreads,
+    const T* bottom_data,
+    const T spatial_scale,
+    const int channels,
+    const int height,
+    const int width,
+    const int pooled_height,
+    const int pooled_width,
+    const int sampling_ratio,
+    const bool nhwc,
+    const T* bottom_rois,
+    T* top_data) {
+  CUDA_1D_KERNEL_LOOP(index, nthreads) {
+    // (n, c, ph, pw) is an element in the pooled output
+    int n, c, ph, pw;
+    PooledCoords(
+        index, channels, pooled_height, pooled_width, nhwc, &n, &c, &ph, &pw);
+
+    const T* offset_bottom_rois = bottom_rois + n * 5;
+    int roi_batch_ind = offset_bottom_rois[0];
+    const RoIAlignGrid grid(
+        offset_bottom_rois + 1,
+        spatial_scale,
+        pooled_height,
+        pooled_width,
+        sampling_ratio);
+    int stride;
+    const T* offset_bottom_data = bottom_data +
+        PlaneOffset(roi_batch_ind, c, channels, height, width, nhwc, &stride);
+    T sum = 0;
+    for (int iy = 0; iy < grid.grid_h; ++iy) {
+      for (int ix = 0; ix < grid.grid_w; ++ix) {
+        const RoIAlignSample sample(
+            grid.y(ph, iy), grid.x(pw, ix), height, width);
+        for (int k = 0; k < 4; ++k) {
+          sum += sample.weight[k] *
+              offset_bottom_data[sample.offset[k] * stride];
+        }
+      }
     }
+    top_data[index] = sum / (grid.grid_h * grid.grid_w);
+  }
+}
+
+// The output of shape (num_rois, channels, pooled_height, pooled_width), or
+// (num_rois, pooled_height, pooled_width, channels) in NHWC.
+void ResizePooled(
+    const StorageOrder order,
+    const int num_rois,
+    const int channels,
+    const int pooled_height,
+    const int pooled_width,
+    TensorCUDA* Y) {
+  if (order == StorageOrder::NCHW) {
+    Y->Resize(num_rois, channels, pooled_height, pooled_width);
+  } else {
+    Y->Resize(num_rois, pooled_height, pooled_width, channels);
   }
 }
 
@@ -128,10 +231,14 @@ bool RoIPoolOp<float, CUDAContext>::RunOnDevice() {
   auto& R = Input(1); // RoIs
   auto* Y = Output(0); // RoI pooled data
   auto* A = is_test_ ? nullptr : Output(1); // argmaxes
+  const bool nhwc = order_ == StorageOrder::NHWC;
+  const int channels = X.dim32(nhwc ? 3 : 1);
+  const int height = X.dim32(nhwc ? 1 : 2);
+  const int width = X.dim32(nhwc ? 2 : 3);
 
   // Handle empty rois
   if (R.size() == 0) {
-    Y->Resize(0, X.dim32(1), pooled_height_, pooled_width_);
+    ResizePooled(order_, 0, channels, pooled_height_, pooled_width_, Y);
     // mutable_data calls are needed to allocate the tensors
     Y->mutable_data<float>();
     if (!is_test_) {
@@ -141,7 +248,7 @@ bool RoIPoolOp<float, CUDAContext>::RunOnDevice() {
     return true;
   }
 
-  Y->Resize(R.dim32(0), X.dim32(1), pooled_height_, pooled_width_);
+  ResizePooled(order_, R.dim32(0), channels, pooled_height_, pooled_width_, Y);
   if (!is_test_) {
     A->Resize(Y->dims());
   }
@@ -155,11 +262,12 @@ bool RoIPoolOp<float, CUDAContext>::RunOnDevice() {
       output_size,
       X.data<float>(),
       spatial_scale_,
-      X.dim32(1),
-      X.dim32(2),
-      X.dim32(3),
+      channels,
+      height,
+      width,
       pooled_height_,
       pooled_width_,
+      nhwc,
       R.data<float>(),
       Y->mutable_data<float>(),
       argmax_data);
@@ -175,6 +283,7 @@ bool RoIPoolGradientOp<float, CUDAContext>::RunOnDevice() {
   // (aka "gradOutput")
   auto* dX = Output(0); // Gradient of net w.r.t. input to "forward" op
   // (aka "gradInput")
+  const bool nhwc = order_ == StorageOrder::NHWC;
 
   dX->ResizeLike(X);
   // Must zero-out dX before accumulating gradients
@@ -191,21 +300,59 @@ bool RoIPoolGradientOp<float, CUDAContext>::RunOnDevice() {
         A.data<int>(),
         R.dim32(0),
         spatial_scale_,
-        X.dim32(1),
-        X.dim32(2),
-        X.dim32(3),
+        X.dim32(nhwc ? 3 : 1),
+        X.dim32(nhwc ? 1 : 2),
+        X.dim32(nhwc ? 2 : 3),
         pooled_height_,
         pooled_width_,
+        nhwc,
         dX->mutable_data<float>(),
         R.data<float>());
   }
   return true;
 }
 
+template <>
+bool RoIAlignOp<float, CUDAContext>::RunOnDevice() {
+  auto& X = Input(0); // Input data to pool
+  auto& R = Input(1); // RoIs
+  auto* Y = Output(0); // RoI pooled data
+  const bool nhwc = order_ == StorageOrder::NHWC;
+  const int channels = X.dim32(nhwc ? 3 : 1);
+  const int num_rois = R.size() == 0 ? 0 : R.dim32(0);
+
+  ResizePooled(order_, num_rois, channels, pooled_height_, pooled_width_, Y);
+  // mutable_data calls are needed to allocate the tensors
+  float* Ydata = Y->mutable_data<float>();
+  if (num_rois == 0) {
+    return true;
+  }
+  int output_size = Y->size();
+  RoIAlignForward<float><<<
+      CAFFE_GET_BLOCKS(output_size),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context_.cuda_stream()>>>(
+      output_size,
+      X.data<float>(),
+      spatial_scale_,
+      channels,
+      X.dim32(nhwc ? 1 : 2),
+      X.dim32(nhwc ? 2 : 3),
+      pooled_height_,
+      pooled_width_,
+      sampling_ratio_,
+      nhwc,
+      R.data<float>(),
+      Ydata);
+  return true;
+}
+
 namespace {
 
 REGISTER_CUDA_OPERATOR(RoIPool, RoIPoolOp<float, CUDAContext>);
 REGISTER_CUDA_OPERATOR(RoIPoolGradient, RoIPoolGradientOp<float, CUDAContext>);
+REGISTER_CUDA_OPERATOR(RoIAlign, RoIAlignOp<float, CUDAContext>);
 
 } // namespace
 } // namespace caffe2
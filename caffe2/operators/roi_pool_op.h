@@ -1,11 +1,19 @@
 #ifndef ROI_POOL_OP_H_
 #define ROI_POOL_OP_H_
 
+#include <cmath>
+
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/utils/math.h"
 
+#ifdef __CUDACC__
+#define CAFFE2_ROI_HOST_DEVICE __host__ __device__
+#else
+#define CAFFE2_ROI_HOST_DEVICE
+#endif
+
 namespace caffe2 {
 
 template <typename T, class Context>
@@ -19,15 +27,14 @@ class RoIPoolOp final : public Operator<Context> {
         pooled_height_(OperatorBase::GetSingleArgument<int>("pooled_h", 1)),
         pooled_width_(OperatorBase::GetSingleArgument<int>("pooled_w", 1)),
         spatial_scale_(
-            OperatorBase::GetSingleArgument<float>("spatial_scale", 1.)) {
+            OperatorBase::GetSingleArgument<float>("spatial_scale", 1.)),
+        ws_(ws) {
     CAFFE_ENFORCE(
         (is_test_ && OutputSize() == 1) || (!is_test_ && OutputSize() == 2),
         "Output size mismatch.");
     CAFFE_ENFORCE_GT(spatial_scale_, 0);
     CAFFE_ENFORCE_GT(pooled_height_, 0);
     CAFFE_ENFORCE_GT(pooled_width_, 0);
-    CAFFE_ENFORCE_EQ(
-        order_, StorageOrder::NCHW, "Only NCHW order is supported right now.");
   }
   USE_OPERATOR_CONTEXT_FUNCTIONS;
 
@@ -39,6 +46,7 @@ class RoIPoolOp final : public Operator<Context> {
   int pooled_height_;
   int pooled_width_;
   float spatial_scale_;
+  Workspace* ws_;
 };
 
 template <typename T, class Context>
@@ -55,8 +63,6 @@ class RoIPoolGradientOp final : public Operator<Context> {
     CAFFE_ENFORCE_GT(spatial_scale_, 0);
     CAFFE_ENFORCE_GT(pooled_height_, 0);
     CAFFE_ENFORCE_GT(pooled_width_, 0);
-    CAFFE_ENFORCE_EQ(
-        order_, StorageOrder::NCHW, "Only NCHW order is supported right now.");
   }
   USE_OPERATOR_CONTEXT_FUNCTIONS;
 
@@ -72,6 +78,133 @@ class RoIPoolGradientOp final : public Operator<Context> {
   StorageOrder order_;
 };
 
+// The sampling grid of RoIAlign for a RoI [x1, y1, x2, y2], in the scale of
+// the input: the top left corner of the RoI, the size of its bins and the
+// number of samples along each dimension of a bin. The CPU and CUDA
+// implementations share it, so that they sample at the same points.
+struct RoIAlignGrid {
+  float start_h;
+  float start_w;
+  float bin_h;
+  float bin_w;
+  int grid_h;
+  int grid_w;
+
+  CAFFE2_ROI_HOST_DEVICE RoIAlignGrid(
+      const float* roi,
+      const float spatial_scale,
+      const int pooled_height,
+      const int pooled_width,
+      const int sampling_ratio) {
+    start_w = roi[0] * spatial_scale;
+    start_h = roi[1] * spatial_scale;
+    // Force malformed RoIs to be 1x1
+    const float roi_w = roi[2] * spatial_scale - start_w;
+    const float roi_h = roi[3] * spatial_scale - start_h;
+    bin_h = (roi_h > 1.f ? roi_h : 1.f) / pooled_height;
+    bin_w = (roi_w > 1.f ? roi_w : 1.f) / pooled_width;
+    // About one sample per input pixel by default.
+    grid_h = sampling_ratio > 0 ? sampling_ratio
+                                : static_cast<int>(ceilf(bin_h));
+    grid_w = sampling_ratio > 0 ? sampling_ratio
+                                : static_cast<int>(ceilf(bin_w));
+  }
+
+  // The position of sample (iy, ix) of bin (ph, pw).
+  CAFFE2_ROI_HOST_DEVICE float y(const int ph, const int iy) const {
+    return start_h + ph * bin_h + (iy + .5f) * bin_h / grid_h;
+  }
+  CAFFE2_ROI_HOST_DEVICE float x(const int pw, const int ix) const {
+    return start_w + pw * bin_w + (ix + .5f) * bin_w / grid_w;
+  }
+};
+
+// A bilinear sample of a height x width plane: the sum of the values at the
+// four offsets in the plane, times the four weights.
+struct RoIAlignSample {
+  int offset[4];
+  float weight[4];
+
+  // The sample at (y, x). Points more than a pixel out of the plane are 0,
+  // and the others are clamped to it.
+  CAFFE2_ROI_HOST_DEVICE RoIAlignSample(
+      float y,
+      float x,
+      const int height,
+      const int width) {
+    if (y < -1.f || y > height || x < -1.f || x > width) {
+      for (int i = 0; i < 4; ++i) {
+        offset[i] = 0;
+        weight[i] = 0;
+      }
+      return;
+    }
+    y = y > 0 ? y : 0;
+    x = x > 0 ? x : 0;
+    int y_low = y, x_low = x, y_high, x_high;
+    if (y_low >= height - 1) {
+      y_high = y_low = height - 1;
+      y = y_low;
+    } else {
+      y_high = y_low + 1;
+    }
+    if (x_low >= width - 1) {
+      x_high = x_low = width - 1;
+      x = x_low;
+    } else {
+      x_high = x_low + 1;
+    }
+    const float ly = y - y_low, lx = x - x_low;
+    const float hy = 1.f - ly, hx = 1.f - lx;
+    offset[0] = y_low * width + x_low;
+    offset[1] = y_low * width + x_high;
+    offset[2] = y_high * width + x_low;
+    offset[3] = y_high * width + x_high;
+    weight[0] = hy * hx;
+    weight[1] = hy * lx;
+    weight[2] = ly * hx;
+    weight[3] = ly * lx;
+  }
+
+  RoIAlignSample() = default;
+};
+
+// RoIAlign of Mask R-CNN: the value of a bin is the average of a grid of
+// samples in it, bilinearly interpolated from the input, instead of the max
+// over the pixels that the bin rounds to.
+template <typename T, class Context>
+class RoIAlignOp final : public Operator<Context> {
+ public:
+  RoIAlignOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        order_(StringToStorageOrder(
+            OperatorBase::GetSingleArgument<string>("order", "NCHW"))),
+        pooled_height_(OperatorBase::GetSingleArgument<int>("pooled_h", 1)),
+        pooled_width_(OperatorBase::GetSingleArgument<int>("pooled_w", 1)),
+        spatial_scale_(
+            OperatorBase::GetSingleArgument<float>("spatial_scale", 1.)),
+        sampling_ratio_(
+            OperatorBase::GetSingleArgument<int>("sampling_ratio", -1)),
+        ws_(ws) {
+    CAFFE_ENFORCE_GT(spatial_scale_, 0);
+    CAFFE_ENFORCE_GT(pooled_height_, 0);
+    CAFFE_ENFORCE_GT(pooled_width_, 0);
+  }
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+
+  bool RunOnDevice() override;
+
+ protected:
+  StorageOrder order_;
+  int pooled_height_;
+  int pooled_width_;
+  float spatial_scale_;
+  int sampling_ratio_;
+  Workspace* ws_;
+};
+
 } // namespace caffe2
 
+#undef CAFFE2_ROI_HOST_DEVICE
+
 #endif // ROI_POOL_OP_H_
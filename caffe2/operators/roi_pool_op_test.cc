@@ -0,0 +1,199 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+const int kBatchSize = 2, kChannels = 5, kHeight = 12, kWidth = 10;
+const int kNumRoIs = 40;
+
+OperatorDef RoIDef(
+    const string& type,
+    const string& order,
+    const vector<string>& outputs) {
+  OperatorDef def;
+  def.set_type(type);
+  def.add_input(order == "NCHW" ? "X" : "X_nhwc");
+  def.add_input("rois");
+  for (const auto& output : outputs) {
+    def.add_output(output);
+  }
+  AddArgument<string>("order", order, &def);
+  AddArgument<int>("pooled_h", 3, &def);
+  AddArgument<int>("pooled_w", 4, &def);
+  AddArgument<float>("spatial_scale", 0.5f, &def);
+  return def;
+}
+
+// X in NCHW and in NHWC, and RoIs of all sizes in an image twice as large,
+// some of them sticking out of it.
+void AddInputs(Workspace* ws) {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* X = ws->CreateBlob("X")->GetMutable<TensorCPU>();
+  X->Resize(kBatchSize, kChannels, kHeight, kWidth);
+  for (int i = 0; i < X->size(); ++i) {
+    X->mutable_data<float>()[i] = value(gen);
+  }
+  auto* X_nhwc = ws->CreateBlob("X_nhwc")->GetMutable<TensorCPU>();
+  X_nhwc->Resize(kBatchSize, kHeight, kWidth, kChannels);
+  const int plane = kHeight * kWidth;
+  for (int n = 0; n < kBatchSize; ++n) {
+    for (int c = 0; c < kChannels; ++c) {
+      for (int i = 0; i < plane; ++i) {
+        X_nhwc->mutable_data<float>()[(n * plane + i) * kChannels + c] =
+            X->data<float>()[(n * kChannels + c) * plane + i];
+      }
+    }
+  }
+  std::uniform_real_distribution<float> x(-4, 2 * kWidth + 4);
+  std::uniform_real_distribution<float> y(-4, 2 * kHeight + 4);
+  auto* rois = ws->CreateBlob("rois")->GetMutable<TensorCPU>();
+  rois->Resize(kNumRoIs, 5);
+  float* roi = rois->mutable_data<float>();
+  for (int n = 0; n < kNumRoIs; ++n, roi += 5) {
+    roi[0] = n % kBatchSize;
+    roi[1] = x(gen);
+    roi[2] = y(gen);
+    roi[3] = roi[1] + x(gen) / 2;
+    roi[4] = roi[2] + y(gen) / 2;
+  }
+}
+
+// Expects the NHWC output to be the NCHW one, transposed.
+template <typename T>
+void ExpectTransposed(const TensorCPU& nchw, const TensorCPU& nhwc) {
+  ASSERT_EQ(nchw.ndim(), 4);
+  const int N = nchw.dim32(0), C = nchw.dim32(1);
+  const int plane = nchw.dim32(2) * nchw.dim32(3);
+  ASSERT_EQ(
+      nhwc.dims(),
+      vector<TIndex>({N, nchw.dim32(2), nchw.dim32(3), C}));
+  for (int n = 0; n < N; ++n) {
+    for (int c = 0; c < C; ++c) {
+      for (int i = 0; i < plane; ++i) {
+        EXPECT_EQ(
+            nchw.data<T>()[(n * C + c) * plane + i],
+            nhwc.data<T>()[(n * plane + i) * C + c]);
+      }
+    }
+  }
+}
+
+} // namespace
+
+TEST(RoIPoolTest, NHWCMatchesNCHW) {
+  Workspace ws;
+  AddInputs(&ws);
+  ASSERT_TRUE(ws.RunOperatorOnce(RoIDef("RoIPool", "NCHW", {"Y", "A"})));
+  ASSERT_TRUE(
+      ws.RunOperatorOnce(RoIDef("RoIPool", "NHWC", {"Y_nhwc", "A_nhwc"})));
+  ExpectTransposed<float>(
+      ws.GetBlob("Y")->Get<TensorCPU>(), ws.GetBlob("Y_nhwc")->Get<TensorCPU>());
+  ExpectTransposed<int>(
+      ws.GetBlob("A")->Get<TensorCPU>(), ws.GetBlob("A_nhwc")->Get<TensorCPU>());
+  // The argmaxes point to the maxes.
+  const auto& X = ws.GetBlob("X")->Get<TensorCPU>();
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  const auto& A = ws.GetBlob("A")->Get<TensorCPU>();
+  const float* rois = ws.GetBlob("rois")->Get<TensorCPU>().data<float>();
+  const int pooled = Y.dim32(2) * Y.dim32(3);
+  for (int i = 0; i < Y.size(); ++i) {
+    const int n = i / pooled / kChannels, c = i / pooled % kChannels;
+    const int argmax = A.data<int>()[i];
+    if (argmax == -1) {
+      EXPECT_EQ(Y.data<float>()[i], 0);
+    } else {
+      const int batch_id = rois[n * 5];
+      EXPECT_EQ(
+          Y.data<float>()[i],
+          X.data<float>()
+              [(batch_id * kChannels + c) * kHeight * kWidth + argmax]);
+    }
+  }
+  // The test mode gives the same output without the argmaxes.
+  auto def = RoIDef("RoIPool", "NHWC", {"Y_test"});
+  AddArgument<int>("is_test", 1, &def);
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  ExpectTransposed<float>(
+      Y, ws.GetBlob("Y_test")->Get<TensorCPU>());
+}
+
+TEST(RoIPoolTest, RejectsRoIsOfOtherImages) {
+  Workspace ws;
+  AddInputs(&ws);
+  ws.GetBlob("rois")->GetMutable<TensorCPU>()->mutable_data<float>()[5] =
+      kBatchSize;
+  EXPECT_THROW(
+      ws.RunOperatorOnce(RoIDef("RoIPool", "NCHW", {"Y", "A"})), EnforceNotMet);
+}
+
+TEST(RoIAlignTest, NHWCMatchesNCHW) {
+  Workspace ws;
+  AddInputs(&ws);
+  ASSERT_TRUE(ws.RunOperatorOnce(RoIDef("RoIAlign", "NCHW", {"Y"})));
+  ASSERT_TRUE(ws.RunOperatorOnce(RoIDef("RoIAlign", "NHWC", {"Y_nhwc"})));
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  const auto& Y_nhwc = ws.GetBlob("Y_nhwc")->Get<TensorCPU>();
+  ASSERT_EQ(Y.dims(), vector<TIndex>({kNumRoIs, kChannels, 3, 4}));
+  const int pooled = 3 * 4;
+  for (int n = 0; n < kNumRoIs; ++n) {
+    for (int c = 0; c < kChannels; ++c) {
+      for (int i = 0; i < pooled; ++i) {
+        EXPECT_NEAR(
+            Y.data<float>()[(n * kChannels + c) * pooled + i],
+            Y_nhwc.data<float>()[(n * pooled + i) * kChannels + c],
+            1e-5);
+      }
+    }
+  }
+}
+
+// Bilinear interpolation is exact for a linear function of the position, so
+// the average of the samples of a bin in the image is its value at the
+// center of the bin.
+TEST(RoIAlignTest, InterpolatesLinearInputs) {
+  Workspace ws;
+  auto* X = ws.CreateBlob("X")->GetMutable<TensorCPU>();
+  X->Resize(1, 2, kHeight, kWidth);
+  for (int c = 0; c < 2; ++c) {
+    for (int h = 0; h < kHeight; ++h) {
+      for (int w = 0; w < kWidth; ++w) {
+        X->mutable_data<float>()[(c * kHeight + h) * kWidth + w] =
+            (c + 1) * h - 2 * w + 3;
+      }
+    }
+  }
+  auto* rois = ws.CreateBlob("rois")->GetMutable<TensorCPU>();
+  rois->Resize(2, 5);
+  const vector<float> boxes = {0, 1, 2, 15, 19, 0, 3.5, 0.5, 17.25, 21.5};
+  std::copy(boxes.begin(), boxes.end(), rois->mutable_data<float>());
+  for (int sampling_ratio : {-1, 2}) {
+    auto def = RoIDef("RoIAlign", "NCHW", {"Y"});
+    AddArgument<int>("sampling_ratio", sampling_ratio, &def);
+    ASSERT_TRUE(ws.RunOperatorOnce(def));
+    const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+    for (int n = 0; n < 2; ++n) {
+      const float* roi = boxes.data() + n * 5;
+      const float bin_h = (roi[4] - roi[2]) * 0.5f / 3;
+      const float bin_w = (roi[3] - roi[1]) * 0.5f / 4;
+      for (int c = 0; c < 2; ++c) {
+        for (int ph = 0; ph < 3; ++ph) {
+          for (int pw = 0; pw < 4; ++pw) {
+            const float y = roi[2] * 0.5f + (ph + 0.5f) * bin_h;
+            const float x = roi[1] * 0.5f + (pw + 0.5f) * bin_w;
+            EXPECT_NEAR(
+                Y.data<float>()[((n * 2 + c) * 3 + ph) * 4 + pw],
+                (c + 1) * y - 2 * x + 3,
+                1e-4);
+          }
+        }
+      }
+    }
+  }
+}
+
+} // namespace caffe2
@@ -0,0 +1,329 @@
+#include "caffe2/operators/sampled_softmax_op.h"
+
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace caffe2 {
+
+namespace {
+
+// Copies rows idx[0..n) of the (?, K) matrix src into dst.
+void GatherRows(
+    int n,
+    int K,
+    const int* idx,
+    const float* src,
+    float* dst,
+    CPUContext* context) {
+  for (int i = 0; i < n; ++i) {
+    context->Copy<float, CPUContext, CPUContext>(
+        K, src + static_cast<TIndex>(idx[i]) * K, dst + i * K);
+  }
+}
+
+} // namespace
+
+template <>
+bool SampledSoftmaxWithLossOp<float, CPUContext>::RunOnDevice() {
+  const auto& X = Input(INPUT);
+  const auto& W = Input(WEIGHT);
+  const auto& b = Input(BIAS);
+  const auto& label = Input(LABEL);
+  const auto& sampling_weights = Input(SAMPLING_WEIGHTS);
+  auto* loss = Output(LOSS);
+  auto* sampled = Output(SAMPLED);
+  auto* P = Output(PROBS);
+
+  const int N = X.ndim() > 1 ? X.dim32(0) : 1;
+  const int K = X.size() / N;
+  CAFFE_ENFORCE_EQ(W.ndim(), 2);
+  const int C = W.dim32(0);
+  CAFFE_ENFORCE_EQ(W.dim32(1), K);
+  CAFFE_ENFORCE_EQ(b.size(), C);
+  CAFFE_ENFORCE_EQ(label.size(), N);
+  CAFFE_ENFORCE_EQ(sampling_weights.size(), C);
+  const int S = num_sampled_;
+
+  if (sampler_.size() != C) {
+    sampler_.Build(C, sampling_weights.data<float>());
+  }
+
+  sampled->Resize(S);
+  int* sampled_data = sampled->mutable_data<int>();
+  auto& gen = context_.RandGenerator();
+  for (int j = 0; j < S; ++j) {
+    sampled_data[j] = sampler_.Sample(gen);
+  }
+
+  // Logits of the sampled classes for the whole batch in one GEMM.
+  sampled_weight_.Resize(S, K);
+  GatherRows(
+      S,
+      K,
+      sampled_data,
+      W.data<float>(),
+      sampled_weight_.mutable_data<float>(),
+      &context_);
+  sampled_logits_.Resize(N, S);
+  math::Gemm<float, CPUContext>(
+      CblasNoTrans,
+      CblasTrans,
+      N,
+      S,
+      K,
+      1,
+      X.data<float>(),
+      sampled_weight_.data<float>(),
+      0,
+      sampled_logits_.mutable_data<float>(),
+      &context_);
+
+  // Column 0 of P holds the true class, columns 1..S the sampled ones. All
+  // logits are corrected by the log of the expected number of draws.
+  std::vector<float> log_expected(S);
+  for (int j = 0; j < S; ++j) {
+    log_expected[j] = std::log(S * sampler_.prob(sampled_data[j]));
+  }
+  P->Resize(N, S + 1);
+  float* Pdata = P->mutable_data<float>();
+  const float* Xdata = X.data<float>();
+  const float* Wdata = W.data<float>();
+  const float* bdata = b.data<float>();
+  const int* label_data = label.data<int>();
+  const float* logits = sampled_logits_.data<float>();
+  std::vector<float> true_logit(N);
+  for (int i = 0; i < N; ++i) {
+    const int y = label_data[i];
+    CAFFE_ENFORCE(y >= 0 && y < C, "Label out of range: ", y);
+    CAFFE_ENFORCE_GT(
+        sampler_.prob(y), 0, "Label ", y, " has zero sampling weight.");
+    float* row = Pdata + i * (S + 1);
+    math::Dot<float, CPUContext>(
+        K,
+        Xdata + i * K,
+        Wdata + static_cast<TIndex>(y) * K,
+        row,
+        &context_);
+    row[0] += bdata[y] - std::log(S * sampler_.prob(y));
+    float m = row[0];
+    for (int j = 0; j < S; ++j) {
+      float v = logits[i * S + j] + bdata[sampled_data[j]] - log_expected[j];
+      if (remove_accidental_hits_ && sampled_data[j] == y) {
+        v = std::numeric_limits<float>::lowest();
+      }
+      row[j + 1] = v;
+      m = std::max(m, v);
+    }
+    for (int j = 0; j <= S; ++j) {
+      row[j] -= m;
+    }
+    true_logit[i] = row[0];
+  }
+  math::Exp<float, CPUContext>(N * (S + 1), Pdata, Pdata, &context_);
+
+  float total_loss = 0;
+  for (int i = 0; i < N; ++i) {
+    float* row = Pdata + i * (S + 1);
+    float sum = 0;
+    for (int j = 0; j <= S; ++j) {
+      sum += row[j];
+    }
+    // -log(softmax) of the true class, from the shifted logits so that it
+    // stays finite when the probability underflows.
+    total_loss += std::log(sum) - true_logit[i];
+    math::Scale<float, CPUContext>(S + 1, 1.f / sum, row, row, &context_);
+  }
+
+  loss->Resize(vector<TIndex>());
+  loss->mutable_data<float>()[0] = total_loss / N;
+  return true;
+}
+
+template <>
+bool SampledSoftmaxWithLossGradientOp<float, CPUContext>::RunOnDevice() {
+  const auto& X = Input(INPUT);
+  const auto& W = Input(WEIGHT);
+  const auto& label = Input(LABEL);
+  const auto& sampled = Input(SAMPLED);
+  const auto& P = Input(PROBS);
+  const auto& dLoss = Input(LOSS_GRAD);
+  auto* dX = Output(INPUT_GRAD);
+  auto* indices = Output(INDICES);
+  auto* dW = Output(WEIGHT_GRAD);
+  auto* db = Output(BIAS_GRAD);
+
+  const int N = X.ndim() > 1 ? X.dim32(0) : 1;
+  const int K = X.size() / N;
+  const int S = sampled.size();
+  CAFFE_ENFORCE_EQ(P.size(), N * (S + 1));
+  CAFFE_ENFORCE_EQ(dLoss.size(), 1);
+  const float scale = dLoss.data<float>()[0] / N;
+  const int* label_data = label.data<int>();
+  const int* sampled_data = sampled.data<int>();
+  const float* Pdata = P.data<float>();
+  const float* Xdata = X.data<float>();
+  const float* Wdata = W.data<float>();
+
+  // Only the rows of W and b touched by the labels or the negatives get a
+  // gradient, returned as a dense slice plus indices.
+  std::unordered_map<int, int> slot;
+  std::vector<int> touched;
+  auto slot_of = [&](int c) {
+    auto it = slot.find(c);
+    if (it != slot.end()) {
+      return it->second;
+    }
+    slot.emplace(c, touched.size());
+    touched.push_back(c);
+    return static_cast<int>(touched.size() - 1);
+  };
+  std::vector<int> label_slot(N), sampled_slot(S);
+  for (int i = 0; i < N; ++i) {
+    label_slot[i] = slot_of(label_data[i]);
+  }
+  for (int j = 0; j < S; ++j) {
+    sampled_slot[j] = slot_of(sampled_data[j]);
+  }
+  const int U = touched.size();
+  indices->Resize(U);
+  context_.Copy<int, CPUContext, CPUContext>(
+      U, touched.data(), indices->mutable_data<int>());
+  dW->Resize(U, K);
+  db->Resize(U);
+  float* dWdata = dW->mutable_data<float>();
+  float* dbdata = db->mutable_data<float>();
+  math::Set<float, CPUContext>(U * K, 0.f, dWdata, &context_);
+  math::Set<float, CPUContext>(U, 0.f, dbdata, &context_);
+
+  // dL/dlogit is (p - 1) for the true class and p for the negatives.
+  sampled_grad_.Resize(N, S);
+  float* dZ = sampled_grad_.mutable_data<float>();
+  std::vector<float> true_grad(N);
+  for (int i = 0; i < N; ++i) {
+    const float* row = Pdata + i * (S + 1);
+    true_grad[i] = (row[0] - 1) * scale;
+    for (int j = 0; j < S; ++j) {
+      dZ[i * S + j] = row[j + 1] * scale;
+    }
+  }
+
+  sampled_weight_.Resize(S, K);
+  GatherRows(
+      S,
+      K,
+      sampled_data,
+      Wdata,
+      sampled_weight_.mutable_data<float>(),
+      &context_);
+  dX->ResizeLike(X);
+  float* dXdata = dX->mutable_data<float>();
+  math::Gemm<float, CPUContext>(
+      CblasNoTrans,
+      CblasNoTrans,
+      N,
+      K,
+      S,
+      1,
+      dZ,
+      sampled_weight_.data<float>(),
+      0,
+      dXdata,
+      &context_);
+  sampled_weight_grad_.Resize(S, K);
+  float* dWs = sampled_weight_grad_.mutable_data<float>();
+  math::Gemm<float, CPUContext>(
+      CblasTrans, CblasNoTrans, S, K, N, 1, dZ, Xdata, 0, dWs, &context_);
+  for (int j = 0; j < S; ++j) {
+    const int u = sampled_slot[j];
+    math::Axpy<float, CPUContext>(
+        K, 1.f, dWs + j * K, dWdata + u * K, &context_);
+    for (int i = 0; i < N; ++i) {
+      dbdata[u] += dZ[i * S + j];
+    }
+  }
+
+  for (int i = 0; i < N; ++i) {
+    const int u = label_slot[i];
+    const float g = true_grad[i];
+    math::Axpy<float, CPUContext>(
+        K,
+        g,
+        Wdata + static_cast<TIndex>(label_data[i]) * K,
+        dXdata + i * K,
+        &context_);
+    math::Axpy<float, CPUContext>(
+        K, g, Xdata + i * K, dWdata + u * K, &context_);
+    dbdata[u] += g;
+  }
+  return true;
+}
+
+REGISTER_CPU_OPERATOR(
+    SampledSoftmaxWithLoss,
+    SampledSoftmaxWithLossOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR(
+    SampledSoftmaxWithLossGradient,
+    SampledSoftmaxWithLossGradientOp<float, CPUContext>);
+
+OPERATOR_SCHEMA(SampledSoftmaxWithLoss)
+    .NumInputs(5)
+    .NumOutputs(3)
+    .SetDoc(R"DOC(
+Fused fully connected layer and sampled softmax cross entropy loss, meant for
+training over very large output vocabularies where SoftmaxWithLoss would have
+to materialize the full batch_size x num_classes probability matrix.
+
+For every batch num_sampled negative classes are drawn (with replacement) from
+the distribution given by sampling_weights using an alias table, so each draw
+costs O(1). Logits X * W^T + b are then computed only for the true class of
+each example and for the shared negatives, corrected by the log of the
+expected number of draws of each class, and fed to a softmax over
+1 + num_sampled classes. The gradient only touches the rows of W and b that
+were used and is returned as a sparse (indices, values) slice that can be
+applied with the sparse optimizers.
+
+The alias table is built from sampling_weights on the first run; the weights
+are assumed not to change afterwards. This is a training op: at inference time
+use FC followed by Softmax.
+)DOC")
+    .Arg("num_sampled", "Number of negative classes drawn per batch.")
+    .Arg(
+        "remove_accidental_hits",
+        "If true (default), a negative that equals the true class of an "
+        "example is excluded from that example's softmax.")
+    .Input(0, "X", "Input features of shape (batch_size, K).")
+    .Input(1, "W", "Output weights of shape (num_classes, K).")
+    .Input(2, "b", "Output bias of shape (num_classes).")
+    .Input(3, "labels", "int32 true class of each example.")
+    .Input(
+        4,
+        "sampling_weights",
+        "Unnormalized non-negative weights of shape (num_classes) defining "
+        "the sampling distribution, e.g. unigram counts raised to 0.75.")
+    .Output(0, "loss", "Average sampled softmax loss (scalar).")
+    .Output(1, "sampled", "int32 negative classes drawn for this batch.")
+    .Output(
+        2,
+        "probs",
+        "Softmax over (true class, negatives) of shape "
+        "(batch_size, 1 + num_sampled); used by the gradient.");
+
+OPERATOR_SCHEMA(SampledSoftmaxWithLossGradient).NumInputs(6).NumOutputs(4);
+
+class GetSampledSoftmaxWithLossGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    auto defs = SingleGradientDef(
+        "SampledSoftmaxWithLossGradient",
+        "",
+        vector<string>{I(0), I(1), I(3), O(1), O(2), GO(0)},
+        vector<string>{GI(0), GI_I(1), GI_V(1), GI_V(2)});
+    // W and b share the same touched rows.
+    SetSparse(2, GI_I(1), GI_V(2));
+    return defs;
+  }
+};
+REGISTER_GRADIENT(SampledSoftmaxWithLoss, GetSampledSoftmaxWithLossGradient);
+
+} // namespace caffe2
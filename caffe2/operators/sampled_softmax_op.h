@@ -0,0 +1,64 @@
+#ifndef CAFFE2_OPERATORS_SAMPLED_SOFTMAX_OP_H_
+#define CAFFE2_OPERATORS_SAMPLED_SOFTMAX_OP_H_
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/alias_sampler.h"
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+
+// Fused FC + sampled softmax cross entropy for large output vocabularies.
+// Instead of the full N x C logit matrix only the logits of the true class
+// and of num_sampled shared negative classes are computed, so both compute
+// and memory scale with num_sampled rather than C. Negatives are drawn from
+// an alias table built over the sampling_weights input.
+template <typename T, class Context>
+class SampledSoftmaxWithLossOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  SampledSoftmaxWithLossOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        num_sampled_(OperatorBase::GetSingleArgument<int>("num_sampled", 0)),
+        remove_accidental_hits_(OperatorBase::GetSingleArgument<bool>(
+            "remove_accidental_hits",
+            true)) {
+    CAFFE_ENFORCE_GT(num_sampled_, 0, "num_sampled must be positive.");
+  }
+
+  bool RunOnDevice() override;
+
+ protected:
+  INPUT_TAGS(INPUT, WEIGHT, BIAS, LABEL, SAMPLING_WEIGHTS);
+  OUTPUT_TAGS(LOSS, SAMPLED, PROBS);
+
+  int num_sampled_;
+  bool remove_accidental_hits_;
+  // Built from SAMPLING_WEIGHTS on the first run, which is treated as
+  // constant afterwards.
+  AliasSampler sampler_;
+  Tensor<Context> sampled_weight_; // Gathered rows of W for the negatives
+  Tensor<Context> sampled_logits_;
+};
+
+template <typename T, class Context>
+class SampledSoftmaxWithLossGradientOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(SampledSoftmaxWithLossGradientOp);
+
+  bool RunOnDevice() override;
+
+ protected:
+  INPUT_TAGS(INPUT, WEIGHT, LABEL, SAMPLED, PROBS, LOSS_GRAD);
+  OUTPUT_TAGS(INPUT_GRAD, INDICES, WEIGHT_GRAD, BIAS_GRAD);
+
+  Tensor<Context> sampled_weight_;
+  Tensor<Context> sampled_grad_; // dL/dlogits for the negatives, N x S
+  Tensor<Context> sampled_weight_grad_; // S x K
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_SAMPLED_SOFTMAX_OP_H_
@@ -0,0 +1,148 @@
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+const TensorCPU& Get(Workspace* ws, const string& name) {
+  return ws->GetBlob(name)->Get<TensorCPU>();
+}
+
+} // namespace
+
+TEST(SampledSoftmaxWithLossTest, MatchesReference) {
+  const int N = 4, K = 3, C = 7, S = 6;
+  std::mt19937 gen(7);
+  Workspace ws;
+  AddRandomTensor(&ws, "X", {N, K}, &gen);
+  AddRandomTensor(&ws, "W", {C, K}, &gen);
+  AddRandomTensor(&ws, "b", {C}, &gen);
+  auto* labels = ws.CreateBlob("labels")->GetMutable<TensorCPU>();
+  labels->Resize(N);
+  for (int i = 0; i < N; ++i) {
+    labels->mutable_data<int>()[i] = (3 * i + 1) % C;
+  }
+  auto* weights = ws.CreateBlob("weights")->GetMutable<TensorCPU>();
+  weights->Resize(C);
+  float total = 0;
+  for (int c = 0; c < C; ++c) {
+    weights->mutable_data<float>()[c] = c + 1;
+    total += c + 1;
+  }
+  auto* dloss = ws.CreateBlob("dloss")->GetMutable<TensorCPU>();
+  dloss->Resize(vector<TIndex>());
+  dloss->mutable_data<float>()[0] = 2.f;
+
+  OperatorDef def;
+  def.set_type("SampledSoftmaxWithLoss");
+  for (const char* in : {"X", "W", "b", "labels", "weights"}) {
+    def.add_input(in);
+  }
+  for (const char* out : {"loss", "sampled", "probs"}) {
+    def.add_output(out);
+  }
+  auto* arg = def.add_arg();
+  arg->set_name("num_sampled");
+  arg->set_i(S);
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+
+  OperatorDef grad_def;
+  grad_def.set_type("SampledSoftmaxWithLossGradient");
+  for (const char* in : {"X", "W", "labels", "sampled", "probs", "dloss"}) {
+    grad_def.add_input(in);
+  }
+  for (const char* out : {"dX", "indices", "dW", "db"}) {
+    grad_def.add_output(out);
+  }
+  ASSERT_TRUE(ws.RunOperatorOnce(grad_def));
+
+  const float* X = Get(&ws, "X").data<float>();
+  const float* W = Get(&ws, "W").data<float>();
+  const float* b = Get(&ws, "b").data<float>();
+  const int* y = labels->data<int>();
+  const auto& sampled = Get(&ws, "sampled");
+  ASSERT_EQ(sampled.size(), S);
+  const int* s = sampled.data<int>();
+
+  // Dense reference over the drawn classes.
+  auto logit = [&](int i, int c) {
+    float v = b[c] - std::log(S * weights->data<float>()[c] / total);
+    for (int k = 0; k < K; ++k) {
+      v += X[i * K + k] * W[c * K + k];
+    }
+    return v;
+  };
+  float loss = 0;
+  vector<float> dX(N * K, 0), dW(C * K, 0), db(C, 0);
+  const float scale = 2.f / N;
+  for (int i = 0; i < N; ++i) {
+    vector<int> cls{y[i]};
+    vector<float> z{logit(i, y[i])};
+    for (int j = 0; j < S; ++j) {
+      if (s[j] != y[i]) {
+        cls.push_back(s[j]);
+        z.push_back(logit(i, s[j]));
+      }
+    }
+    float sum = 0;
+    for (float v : z) {
+      sum += std::exp(v);
+    }
+    loss -= std::log(std::exp(z[0]) / sum);
+    for (size_t j = 0; j < z.size(); ++j) {
+      const float g = (std::exp(z[j]) / sum - (j == 0)) * scale;
+      const int c = cls[j];
+      for (int k = 0; k < K; ++k) {
+        dX[i * K + k] += g * W[c * K + k];
+        dW[c * K + k] += g * X[i * K + k];
+      }
+      db[c] += g;
+    }
+  }
+  EXPECT_NEAR(Get(&ws, "loss").data<float>()[0], loss / N, 1e-4);
+  for (int i = 0; i < N * K; ++i) {
+    EXPECT_NEAR(Get(&ws, "dX").data<float>()[i], dX[i], 1e-4);
+  }
+
+  // The sparse gradient covers exactly the touched rows, each once.
+  const auto& indices = Get(&ws, "indices");
+  vector<float> sparse_dW(C * K, 0), sparse_db(C, 0);
+  vector<bool> touched(C, false);
+  for (int u = 0; u < indices.size(); ++u) {
+    const int c = indices.data<int>()[u];
+    EXPECT_FALSE(touched[c]);
+    touched[c] = true;
+    for (int k = 0; k < K; ++k) {
+      sparse_dW[c * K + k] = Get(&ws, "dW").data<float>()[u * K + k];
+    }
+    sparse_db[c] = Get(&ws, "db").data<float>()[u];
+  }
+  for (int i = 0; i < N; ++i) {
+    EXPECT_TRUE(touched[y[i]]);
+  }
+  for (int c = 0; c < C; ++c) {
+    EXPECT_NEAR(sparse_db[c], db[c], 1e-4);
+    for (int k = 0; k < K; ++k) {
+      EXPECT_NEAR(sparse_dW[c * K + k], dW[c * K + k], 1e-4);
+    }
+  }
+}
+
+} // namespace caffe2
@@ -8,6 +8,7 @@ OPERATOR_SCHEMA(Scale)
   .NumOutputs(1)
   .AllowInplace({{0, 0}})
   .IdenticalTypeAndShape()
+  .CostInferenceFunction(PointwiseCostInference<1>)
   .SetDoc(R"DOC(
 Scale takes one input data (Tensor<float>) and produces one output data
 (Tensor<float>) whose value is the input data tensor scaled element-wise.
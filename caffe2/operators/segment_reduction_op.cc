@@ -1,6 +1,7 @@
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/operators/embedding_lookup.h"
 #include "caffe2/operators/reducer_functors.h"
 
 namespace caffe2 {
@@ -514,6 +515,35 @@ class AbstractSortedSegmentOp : public Operator<Context> {
 
     // Assume the segments are sorted and there are no gaps
     CAFFE_ENFORCE_EQ(0, s_ids[0], "Indices must be sorted and not have gaps");
+    if (SparseFused && Reducer::kFusedLookup) { // static if
+      vector<TIndex> lengths(K, 0);
+      for (TIndex i = 0; i < N; ++i) {
+        CAFFE_ENFORCE(
+            0 <= idxs[i] && idxs[i] < M,
+            "Index out of bounds: ",
+            idxs[i],
+            ", range 0 to ",
+            M);
+        if (i > 0 && s_ids[i] != s_ids[i - 1]) {
+          CAFFE_ENFORCE_EQ(
+              s_ids[i - 1] + 1,
+              s_ids[i],
+              "Indices must be sorted and not have gaps");
+        }
+        ++lengths[s_ids[i]];
+      }
+      EmbeddingLookup(
+          in_block_size,
+          K,
+          N,
+          d,
+          idxs,
+          lengths.data(),
+          static_cast<const T*>(Reducer::lookupWeights(ctx)),
+          Reducer::kLengthsPower,
+          out);
+      return true;
+    }
     for (TIndex i = 0; i < N;) {
       TIndex start = i;
 
@@ -1252,7 +1282,6 @@ class AbstractLengthsOp : public Operator<Context> {
     }
 
     const TLengths* lengths = lengthsInput.template data<TLengths>();
-    const TData* data = dataInput.template data<TData>();
 
     vector<TIndex> shape{outputSize};
     ctx.appendOutputShape(&shape);
@@ -1262,6 +1291,57 @@ class AbstractLengthsOp : public Operator<Context> {
     TIndex out_block_size = output->size_from_dim(1);
     TData* out = output->template mutable_data<TData>();
 
+    if (SparseFused && Reducer::kFusedLookup) { // static if
+      TIndex totalLength = 0;
+      for (TIndex rangeIndex = 0; rangeIndex < outputSize; ++rangeIndex) {
+        totalLength += lengths[rangeIndex];
+      }
+      CAFFE_ENFORCE(
+          totalLength == dataToReduceSize,
+          totalLength,
+          " != ",
+          dataToReduceSize);
+      for (TIndex dataIndex = 0; dataIndex < dataToReduceSize; ++dataIndex) {
+        const TIndex idx = indicies[dataIndex];
+        CAFFE_ENFORCE(
+            0 <= idx && idx < dataSize,
+            "Index ",
+            dataIndex,
+            " is out of bounds: ",
+            idx,
+            ", range 0 to ",
+            dataSize);
+      }
+      const TData* weights =
+          static_cast<const TData*>(Reducer::lookupWeights(ctx));
+      // Tables stored as halves are converted in the reduction.
+      if (dataInput.template IsType<float16>()) {
+        EmbeddingLookup(
+            in_block_size,
+            outputSize,
+            dataToReduceSize,
+            dataInput.template data<float16>(),
+            indicies,
+            lengths,
+            weights,
+            Reducer::kLengthsPower,
+            out);
+      } else {
+        EmbeddingLookup(
+            in_block_size,
+            outputSize,
+            dataToReduceSize,
+            dataInput.template data<TData>(),
+            indicies,
+            lengths,
+            weights,
+            Reducer::kLengthsPower,
+            out);
+      }
+      return true;
+    }
+
+    const TData* data = dataInput.template data<TData>();
     TIndex dataIndex = 0;
     for (TIndex rangeIndex = 0; rangeIndex < outputSize; ++rangeIndex) {
       Reducer reducer(ctx, out + out_block_size * rangeIndex, &context_);
@@ -1541,6 +1621,32 @@ struct LengthsOpGetGradient : public GradientMakerBase {
   }
 };
 
+// The cost of the Lengths reductions: every slice of DATA that is aggregated,
+// which is one per index for the sparse ones, is read once and folded into
+// its segment, with a multiply more per element for the weighted reducers.
+template <int kDataInputs, bool Sparse>
+OpSchema::Cost LengthsReductionCost(
+    const OperatorDef& /* unused */,
+    const vector<TensorShape>& in) {
+  struct OpSchema::Cost c;
+  const TensorShape& data = in[0];
+  const uint64_t num_slices = data.dims_size() ? data.dims(0) : 1;
+  const uint64_t block_size =
+      num_slices ? GetNumElements(data) / num_slices : 0;
+  const uint64_t rows = Sparse ? GetNumElements(in[kDataInputs]) : num_slices;
+  const uint64_t num_segments = GetNumElements(in.back());
+  c.flops = rows * block_size * kDataInputs;
+  c.bytes_read =
+      rows * block_size * DataTypeToTypeMeta(data.data_type()).itemsize();
+  for (int i = 1; i < in.size(); ++i) {
+    c.bytes_read += GetNumElements(in[i]) *
+        DataTypeToTypeMeta(in[i].data_type()).itemsize();
+  }
+  c.bytes_written = num_segments * block_size * sizeof(float);
+  c.bytes_moved = c.bytes_read + c.bytes_written;
+  return c;
+}
+
 template <typename T, typename SIndex, typename Context, typename ReducerDef>
 struct AbstractLengthsDef {
   using OpDef = ReducerDef;
@@ -1570,6 +1676,8 @@ i.e. `len(LENGTHS)`. Other dimensions are inherited from the input tensor.
         0,
         "OUTPUT",
         "Aggregated output tensor. Has the first dimension of len(LENGTHS) ");
+    schema.CostInferenceFunction(
+        LengthsReductionCost<Reducer::kInputCount, false>);
     ReducerDef::PopulateSchema(schema);
   }
   using Reducer = typename ReducerDef::template Reducer<T, Context>;
@@ -1611,6 +1719,10 @@ to match INDICES size.
 The first dimension of the output is equal to the number of input segment,
 i.e. `len(LENGTHS)`. Other dimensions are inherited from the input tensor.
 
+With the Sum, WeightedSum, Mean and SqrtMean reducers, DATA can also be
+stored as float16: its slices are converted while they are aggregated, and
+the output is float.
+
 {op_doc}
   )DOC";
   static void PopulateSchema(OpSchema& schema) {
@@ -1629,6 +1741,8 @@ i.e. `len(LENGTHS)`. Other dimensions are inherited from the input tensor.
         "OUTPUT",
         "Aggregated output tensor. Has the first dimension of K "
         "(the number of segments).");
+    schema.CostInferenceFunction(
+        LengthsReductionCost<Reducer::kInputCount, true>);
     ReducerDef::PopulateSchema(schema);
   }
   using Reducer = typename ReducerDef::template Reducer<T, Context>;
@@ -1719,6 +1833,7 @@ REGISTER_SEGMENT_DEF(
 REGISTER_REDUCER_WITH_ALL_OPS(SumReducerDef);
 REGISTER_REDUCER_WITH_ALL_OPS(WeightedSumReducerDef);
 REGISTER_REDUCER_WITH_ALL_OPS(MeanReducerDef);
+REGISTER_REDUCER_WITH_ALL_OPS(SqrtMeanReducerDef);
 
 // Auxiliary output gradients are currently implemented only for Lengths version
 #define REGISTER_GRADIENT_WITH_MAIN_INPUT(...)                     \
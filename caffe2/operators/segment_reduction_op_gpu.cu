@@ -0,0 +1,491 @@
+#include "cub/block/block_reduce.cuh"
+#include "cub/device/device_scan.cuh"
+
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/core/operator.h"
+
+namespace caffe2 {
+
+// The CUDA implementations of the Sum, WeightedSum, Mean and SqrtMean reducers
+// of the Lengths, SparseLengths, SortedSegment and SparseSortedSegment
+// operators, and of their gradients. See segment_reduction_op.cc for the
+// operators.
+//
+// Segments are described on the device by the end of each of them in the
+// (gathered) rows of DATA, which is the inclusive prefix sum of LENGTHS, or is
+// found where sorted SEGMENT_IDS change. Each segment is then reduced by one
+// block, whose threads read consecutive columns of each row.
+
+namespace {
+
+enum class SegmentReducer { kSum, kWeightedSum, kMean, kSqrtMean };
+
+// The power of its length that the sum of a segment is divided by: 0, 1 or
+// 0.5.
+constexpr float LengthsPower(SegmentReducer reducer) {
+  return reducer == SegmentReducer::kMean
+      ? 1.f
+      : reducer == SegmentReducer::kSqrtMean ? 0.5f : 0.f;
+}
+
+inline __device__ float LengthsScale(int length, float lengths_power) {
+  if (lengths_power == 0.f || length == 0) {
+    return 1.f;
+  }
+  return lengths_power == 1.f ? 1.f / length : rsqrtf(length);
+}
+
+int SegmentThreads(TIndex block_size) {
+  return std::min<TIndex>(CAFFE_CUDA_NUM_THREADS, (block_size + 31) / 32 * 32);
+}
+
+__global__ void SortedSegmentEndsKernel(
+    const int num_rows,
+    const int num_segments,
+    const int* segment_ids,
+    int* ends) {
+  CUDA_1D_KERNEL_LOOP(i, num_rows) {
+    const int s = segment_ids[i];
+    CUDA_KERNEL_ASSERT(i > 0 || s == 0);
+    CUDA_KERNEL_ASSERT(s < num_segments);
+    if (i == num_rows - 1 || segment_ids[i + 1] != s) {
+      // Segments must be sorted and not have gaps.
+      CUDA_KERNEL_ASSERT(i == num_rows - 1 || segment_ids[i + 1] == s + 1);
+      ends[s] = i + 1;
+    }
+  }
+}
+
+template <typename Index>
+__global__ void SegmentReduceKernel(
+    const int num_segments,
+    const TIndex block_size,
+    const int num_rows,
+    const TIndex data_rows,
+    const float* data,
+    const Index* indices,
+    const float* weights,
+    const int* ends,
+    const float lengths_power,
+    float* out) {
+  for (int s = blockIdx.x; s < num_segments; s += gridDim.x) {
+    const int start = s == 0 ? 0 : ends[s - 1];
+    const int end = ends[s];
+    CUDA_KERNEL_ASSERT(start <= end && end <= num_rows);
+    const float scale = LengthsScale(end - start, lengths_power);
+    for (TIndex j = threadIdx.x; j < block_size; j += blockDim.x) {
+      float sum = 0;
+      for (int r = start; r < end; ++r) {
+        const TIndex row = indices ? indices[r] : r;
+        CUDA_KERNEL_ASSERT(0 <= row && row < data_rows);
+        const float x = data[row * block_size + j];
+        sum += weights ? weights[r] * x : x;
+      }
+      out[s * block_size + j] = sum * scale;
+    }
+  }
+}
+
+// Writes the gradient of every row of a segment, which is the gradient of the
+// segment, scaled by the weight of the row or divided by the power of the
+// segment length.
+__global__ void SegmentGradientKernel(
+    const int num_segments,
+    const TIndex block_size,
+    const float* segment_grads,
+    const float* weights,
+    const int* ends,
+    const float lengths_power,
+    float* data_grads) {
+  for (int s = blockIdx.x; s < num_segments; s += gridDim.x) {
+    const int start = s == 0 ? 0 : ends[s - 1];
+    const int end = ends[s];
+    const float scale = LengthsScale(end - start, lengths_power);
+    for (int r = start; r < end; ++r) {
+      const float w = weights ? weights[r] * scale : scale;
+      for (TIndex j = threadIdx.x; j < block_size; j += blockDim.x) {
+        data_grads[r * block_size + j] = w * segment_grads[s * block_size + j];
+      }
+    }
+  }
+}
+
+constexpr int kWeightGradientThreads = 128;
+
+// The WeightedSum gradient that also computes the gradient of the weights,
+// the dot product of the gradient of the segment with each row of DATA.
+template <typename Index>
+__global__ void WeightedSegmentGradientKernel(
+    const int num_segments,
+    const TIndex block_size,
+    const float* segment_grads,
+    const float* weights,
+    const int* ends,
+    const float* data,
+    const Index* indices,
+    float* data_grads,
+    float* weight_grads) {
+  typedef cub::BlockReduce<float, kWeightGradientThreads> BlockReduce;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  for (int s = blockIdx.x; s < num_segments; s += gridDim.x) {
+    const int start = s == 0 ? 0 : ends[s - 1];
+    const int end = ends[s];
+    const float* segment_grad = segment_grads + s * block_size;
+    for (int r = start; r < end; ++r) {
+      const TIndex row = indices ? indices[r] : r;
+      float dot = 0;
+      for (TIndex j = threadIdx.x; j < block_size; j += blockDim.x) {
+        data_grads[r * block_size + j] = weights[r] * segment_grad[j];
+        dot += segment_grad[j] * data[row * block_size + j];
+      }
+      dot = BlockReduce(temp_storage).Sum(dot);
+      if (threadIdx.x == 0) {
+        weight_grads[r] = dot;
+      }
+      __syncthreads();
+    }
+  }
+}
+
+// Fills ends with the end row of every segment, given either the LENGTHS of
+// the segments or their SEGMENT_IDS, and returns the number of segments. For
+// sorted segment ids, the number of segments is read from the last id when
+// num_segments is negative, which waits for the device.
+int ComputeSegmentEnds(
+    bool sorted,
+    const TensorCUDA& segments,
+    int num_segments,
+    TensorCUDA* ends,
+    TensorCUDA* scan_buffer,
+    CUDAContext* context) {
+  CAFFE_ENFORCE_EQ(1, segments.ndim(), "LENGTHS and SEGMENT_IDS must be 1-D");
+  if (!sorted) {
+    num_segments = segments.size();
+    ends->Resize(num_segments);
+    if (num_segments == 0) {
+      ends->mutable_data<int>();
+      return 0;
+    }
+    size_t scan_bytes = 0;
+    CUDA_CHECK(cub::DeviceScan::InclusiveSum(
+        nullptr,
+        scan_bytes,
+        segments.data<int>(),
+        ends->mutable_data<int>(),
+        num_segments,
+        context->cuda_stream()));
+    scan_buffer->Resize(scan_bytes);
+    CUDA_CHECK(cub::DeviceScan::InclusiveSum(
+        static_cast<void*>(scan_buffer->mutable_data<char>()),
+        scan_bytes,
+        segments.data<int>(),
+        ends->mutable_data<int>(),
+        num_segments,
+        context->cuda_stream()));
+    return num_segments;
+  }
+
+  const int num_rows = segments.size();
+  if (num_segments < 0) {
+    int last_id = -1;
+    if (num_rows > 0) {
+      context->Copy<int, CUDAContext, CPUContext>(
+          1, segments.data<int>() + num_rows - 1, &last_id);
+      context->FinishDeviceComputation();
+    }
+    num_segments = last_id + 1;
+  }
+  ends->Resize(num_segments);
+  int* ends_data = ends->mutable_data<int>();
+  if (num_rows > 0) {
+    SortedSegmentEndsKernel<<<
+        CAFFE_GET_BLOCKS(num_rows),
+        CAFFE_CUDA_NUM_THREADS,
+        0,
+        context->cuda_stream()>>>(
+        num_rows, num_segments, segments.data<int>(), ends_data);
+  }
+  return num_segments;
+}
+
+// Reads the total length of the segments, which waits for the device.
+int TotalSegmentLength(const TensorCUDA& ends, CUDAContext* context) {
+  int total = 0;
+  if (ends.size() > 0) {
+    context->Copy<int, CUDAContext, CPUContext>(
+        1, ends.data<int>() + ends.size() - 1, &total);
+    context->FinishDeviceComputation();
+  }
+  return total;
+}
+} // namespace
+
+// Input layout: DATA, [SCALARS if WeightedSum], [INDICES if Sparse], and
+// LENGTHS, or SEGMENT_IDS if Sorted.
+template <SegmentReducer kReducer, bool kSparse, bool kSorted>
+class CUDASegmentReduceOp final : public Operator<CUDAContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CUDAContext);
+  CUDASegmentReduceOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CUDAContext>(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    if (kSparse) { // static if
+      return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+          this, Input(INDICES));
+    }
+    return DoRunWithType<int>();
+  }
+
+  template <typename Index>
+  bool DoRunWithType() {
+    const auto& data = Input(0);
+    CAFFE_ENFORCE_GE(data.ndim(), 1, "DATA must be at least 1-D");
+    const Index* indices = nullptr;
+    int num_rows = data.dim32(0);
+    if (kSparse) { // static if
+      const auto& indices_input = Input(INDICES);
+      CAFFE_ENFORCE_EQ(1, indices_input.ndim(), "INDICES must be a vector");
+      indices = indices_input.template data<Index>();
+      num_rows = indices_input.dim32(0);
+    }
+    const auto& segments = Input(SEGMENTS);
+    if (kSorted) { // static if
+      CAFFE_ENFORCE_EQ(
+          num_rows,
+          segments.size(),
+          "SEGMENT_IDS must have one id for each row reduced");
+    }
+    const float* weights = nullptr;
+    if (kWeighted) { // static if
+      const auto& scalars = Input(1);
+      CAFFE_ENFORCE_EQ(1, scalars.ndim(), "SCALARS must be a vector");
+      CAFFE_ENFORCE_EQ(num_rows, scalars.dim32(0));
+      weights = scalars.template data<float>();
+    }
+
+    const int num_segments =
+        ComputeSegmentEnds(kSorted, segments, -1, &ends_, &scan_buffer_,
+                           &context_);
+    auto shape = data.dims();
+    shape[0] = num_segments;
+    auto* output = Output(0);
+    output->Resize(shape);
+    float* out = output->template mutable_data<float>();
+    const TIndex block_size = data.size_from_dim(1);
+    if (num_segments == 0 || block_size == 0) {
+      return true;
+    }
+    SegmentReduceKernel<Index><<<
+        std::min(num_segments, CAFFE_MAXIMUM_NUM_BLOCKS),
+        SegmentThreads(block_size),
+        0,
+        context_.cuda_stream()>>>(
+        num_segments,
+        block_size,
+        num_rows,
+        data.dim(0),
+        data.template data<float>(),
+        indices,
+        weights,
+        ends_.template data<int>(),
+        LengthsPower(kReducer),
+        out);
+    return true;
+  }
+
+ private:
+  static constexpr bool kWeighted = kReducer == SegmentReducer::kWeightedSum;
+  enum {
+    INDICES = kWeighted ? 2 : 1,
+    SEGMENTS = INDICES + (kSparse ? 1 : 0),
+  };
+
+  Tensor<CUDAContext> ends_;
+  Tensor<CUDAContext> scan_buffer_;
+};
+
+// Input layout: [SCALARS if WeightedSum], SEGMENT_GRADS, and LENGTHS, or
+// SEGMENT_IDS if Sorted.
+template <SegmentReducer kReducer, bool kSorted>
+class CUDASegmentReduceGradientOp final : public Operator<CUDAContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CUDAContext);
+  CUDASegmentReduceGradientOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CUDAContext>(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    const auto& segment_grads = Input(SEGMENT_GRADS);
+    const auto& segments = Input(SEGMENTS);
+    CAFFE_ENFORCE_GE(segment_grads.ndim(), 1);
+    const int num_segments = ComputeSegmentEnds(
+        kSorted,
+        segments,
+        segment_grads.dim32(0),
+        &ends_,
+        &scan_buffer_,
+        &context_);
+    CAFFE_ENFORCE_EQ(num_segments, segment_grads.dim32(0));
+
+    const float* weights = nullptr;
+    int num_rows;
+    if (kWeighted) { // static if
+      const auto& scalars = Input(0);
+      CAFFE_ENFORCE_EQ(1, scalars.ndim(), "SCALARS must be a vector");
+      weights = scalars.template data<float>();
+      num_rows = scalars.dim32(0);
+    } else if (kSorted) { // static if
+      num_rows = segments.size();
+    } else {
+      num_rows = TotalSegmentLength(ends_, &context_);
+    }
+
+    auto shape = segment_grads.dims();
+    shape[0] = num_rows;
+    auto* data_grads = Output(0);
+    data_grads->Resize(shape);
+    float* out = data_grads->template mutable_data<float>();
+    const TIndex block_size = segment_grads.size_from_dim(1);
+    if (num_rows == 0 || block_size == 0) {
+      return true;
+    }
+    SegmentGradientKernel<<<
+        std::min(num_segments, CAFFE_MAXIMUM_NUM_BLOCKS),
+        SegmentThreads(block_size),
+        0,
+        context_.cuda_stream()>>>(
+        num_segments,
+        block_size,
+        segment_grads.template data<float>(),
+        weights,
+        ends_.template data<int>(),
+        LengthsPower(kReducer),
+        out);
+    return true;
+  }
+
+ private:
+  static constexpr bool kWeighted = kReducer == SegmentReducer::kWeightedSum;
+  enum {
+    SEGMENT_GRADS = kWeighted ? 1 : 0,
+    SEGMENTS,
+  };
+
+  Tensor<CUDAContext> ends_;
+  Tensor<CUDAContext> scan_buffer_;
+};
+
+// The gradient of (Sparse)LengthsWeightedSum with grad_on_weights.
+// Input layout: SCALARS, SEGMENT_GRADS, LENGTHS, DATA, [INDICES if Sparse].
+template <bool kSparse>
+class CUDALengthsWeightedSumWithMainInputGradientOp final
+    : public Operator<CUDAContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CUDAContext);
+  CUDALengthsWeightedSumWithMainInputGradientOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CUDAContext>(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    if (kSparse) { // static if
+      return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+          this, Input(INDICES));
+    }
+    return DoRunWithType<int>();
+  }
+
+  template <typename Index>
+  bool DoRunWithType() {
+    const auto& scalars = Input(SCALARS);
+    const auto& segment_grads = Input(SEGMENT_GRADS);
+    const auto& data = Input(DATA);
+    CAFFE_ENFORCE_EQ(1, scalars.ndim(), "SCALARS must be a vector");
+    CAFFE_ENFORCE_GE(segment_grads.ndim(), 1);
+    const int num_rows = scalars.dim32(0);
+    const Index* indices = nullptr;
+    if (kSparse) { // static if
+      CAFFE_ENFORCE_EQ(num_rows, Input(INDICES).size());
+      indices = Input(INDICES).template data<Index>();
+    }
+    const int num_segments = ComputeSegmentEnds(
+        false, Input(LENGTHS), -1, &ends_, &scan_buffer_, &context_);
+    CAFFE_ENFORCE_EQ(num_segments, segment_grads.dim32(0));
+
+    auto shape = segment_grads.dims();
+    shape[0] = num_rows;
+    auto* data_grads = Output(0);
+    data_grads->Resize(shape);
+    auto* weight_grads = Output(1);
+    weight_grads->ResizeLike(scalars);
+    float* out = data_grads->template mutable_data<float>();
+    float* weight_out = weight_grads->template mutable_data<float>();
+    const TIndex block_size = segment_grads.size_from_dim(1);
+    CAFFE_ENFORCE_EQ(block_size, data.size_from_dim(1));
+    if (num_rows == 0) {
+      return true;
+    }
+    if (block_size == 0) {
+      math::Set<float, CUDAContext>(num_rows, 0.f, weight_out, &context_);
+      return true;
+    }
+    WeightedSegmentGradientKernel<Index><<<
+        std::min(num_segments, CAFFE_MAXIMUM_NUM_BLOCKS),
+        kWeightGradientThreads,
+        0,
+        context_.cuda_stream()>>>(
+        num_segments,
+        block_size,
+        segment_grads.template data<float>(),
+        scalars.template data<float>(),
+        ends_.template data<int>(),
+        data.template data<float>(),
+        indices,
+        out,
+        weight_out);
+    return true;
+  }
+
+ private:
+  enum { SCALARS, SEGMENT_GRADS, LENGTHS, DATA, INDICES };
+
+  Tensor<CUDAContext> ends_;
+  Tensor<CUDAContext> scan_buffer_;
+};
+
+namespace {
+
+#define REGISTER_CUDA_SEGMENT_OPS(reducer, name)                              \
+  REGISTER_CUDA_OPERATOR(                                                     \
+      Lengths##name, CUDASegmentReduceOp<reducer, false, false>);             \
+  REGISTER_CUDA_OPERATOR(                                                     \
+      SparseLengths##name, CUDASegmentReduceOp<reducer, true, false>);        \
+  REGISTER_CUDA_OPERATOR(                                                     \
+      SortedSegment##name, CUDASegmentReduceOp<reducer, false, true>);        \
+  REGISTER_CUDA_OPERATOR(                                                     \
+      SparseSortedSegment##name, CUDASegmentReduceOp<reducer, true, true>);   \
+  REGISTER_CUDA_OPERATOR(                                                     \
+      Lengths##name##Gradient, CUDASegmentReduceGradientOp<reducer, false>);  \
+  REGISTER_CUDA_OPERATOR(                                                     \
+      SparseLengths##name##Gradient,                                          \
+      CUDASegmentReduceGradientOp<reducer, false>);                           \
+  REGISTER_CUDA_OPERATOR(                                                     \
+      SortedSegment##name##Gradient,                                          \
+      CUDASegmentReduceGradientOp<reducer, true>);                            \
+  REGISTER_CUDA_OPERATOR(                                                     \
+      SparseSortedSegment##name##Gradient,                                    \
+      CUDASegmentReduceGradientOp<reducer, true>)
+
+REGISTER_CUDA_SEGMENT_OPS(SegmentReducer::kSum, Sum);
+REGISTER_CUDA_SEGMENT_OPS(SegmentReducer::kWeightedSum, WeightedSum);
+REGISTER_CUDA_SEGMENT_OPS(SegmentReducer::kMean, Mean);
+REGISTER_CUDA_SEGMENT_OPS(SegmentReducer::kSqrtMean, SqrtMean);
+
+REGISTER_CUDA_OPERATOR(
+    LengthsWeightedSumWithMainInputGradient,
+    CUDALengthsWeightedSumWithMainInputGradientOp<false>);
+REGISTER_CUDA_OPERATOR(
+    SparseLengthsWeightedSumWithMainInputGradient,
+    CUDALengthsWeightedSumWithMainInputGradientOp<true>);
+
+#undef REGISTER_CUDA_SEGMENT_OPS
+} // namespace
+} // namespace caffe2
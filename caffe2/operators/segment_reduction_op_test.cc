@@ -0,0 +1,239 @@
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+const int kNumRows = 50;
+const int kBlockSize = 13;
+
+void AddTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    const vector<float>& values) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  std::copy(values.begin(), values.end(), tensor->mutable_data<float>());
+}
+
+template <typename T>
+void AddTensor(Workspace* ws, const string& name, const vector<T>& values) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(values.size());
+  std::copy(values.begin(), values.end(), tensor->mutable_data<T>());
+}
+
+const TensorCPU& RunOp(
+    Workspace* ws,
+    const string& type,
+    const vector<string>& inputs) {
+  OperatorDef def;
+  def.set_type(type);
+  for (const auto& input : inputs) {
+    def.add_input(input);
+  }
+  def.add_output("out");
+  CAFFE_ENFORCE(ws->RunOperatorOnce(def));
+  return ws->GetBlob("out")->Get<TensorCPU>();
+}
+
+// Bags of random indices into a random table, long enough for the rows of the
+// bags to be prefetched, and with an empty bag.
+class SparseSegmentsTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> value(-1, 1);
+    std::uniform_int_distribution<TIndex> index(0, kNumRows - 1);
+    for (int i = 0; i < kNumRows * kBlockSize; ++i) {
+      data_.push_back(value(gen));
+    }
+    for (int length : {3, 0, 40, 1, 7}) {
+      for (int i = 0; i < length; ++i) {
+        segment_ids_.push_back(lengths_.size());
+        indices_.push_back(index(gen));
+        weights_.push_back(value(gen));
+      }
+      lengths_.push_back(length);
+    }
+    AddTensor(&ws_, "data", {kNumRows, kBlockSize}, data_);
+    AddTensor(&ws_, "indices", indices_);
+    AddTensor(&ws_, "lengths", lengths_);
+    AddTensor(&ws_, "weights", weights_);
+  }
+
+  // The bags are divided by their length to the power lengthsPower.
+  void ExpectBags(const TensorCPU& out, bool weighted, float lengthsPower) {
+    const TIndex numBags = lengths_.size();
+    ASSERT_EQ(out.dims(), vector<TIndex>({numBags, kBlockSize}));
+    int i = 0;
+    for (int s = 0; s < lengths_.size(); ++s) {
+      vector<float> expected(kBlockSize, 0);
+      for (int k = 0; k < lengths_[s]; ++k, ++i) {
+        for (int j = 0; j < kBlockSize; ++j) {
+          expected[j] += (weighted ? weights_[i] : 1) *
+              data_[indices_[i] * kBlockSize + j];
+        }
+      }
+      for (int j = 0; j < kBlockSize; ++j) {
+        if (lengths_[s] > 0) {
+          expected[j] /= std::pow(lengths_[s], lengthsPower);
+        }
+        EXPECT_NEAR(out.data<float>()[s * kBlockSize + j], expected[j], 1e-5);
+      }
+    }
+  }
+
+  Workspace ws_;
+  vector<float> data_;
+  vector<TIndex> indices_;
+  vector<int> lengths_;
+  vector<int> segment_ids_;
+  vector<float> weights_;
+};
+
+} // namespace
+
+TEST_F(SparseSegmentsTest, SparseLengthsSum) {
+  ExpectBags(
+      RunOp(&ws_, "SparseLengthsSum", {"data", "indices", "lengths"}),
+      false,
+      0);
+}
+
+TEST_F(SparseSegmentsTest, SparseLengthsWeightedSum) {
+  ExpectBags(
+      RunOp(
+          &ws_,
+          "SparseLengthsWeightedSum",
+          {"data", "weights", "indices", "lengths"}),
+      true,
+      0);
+}
+
+TEST_F(SparseSegmentsTest, SparseLengthsMean) {
+  ExpectBags(
+      RunOp(&ws_, "SparseLengthsMean", {"data", "indices", "lengths"}),
+      false,
+      1);
+}
+
+TEST_F(SparseSegmentsTest, SparseLengthsSqrtMean) {
+  ExpectBags(
+      RunOp(&ws_, "SparseLengthsSqrtMean", {"data", "indices", "lengths"}),
+      false,
+      0.5);
+  // The dense op reduces the rows one by one instead.
+  RunOp(&ws_, "Gather", {"data", "indices"});
+  ws_.CreateBlob("rows")->GetMutable<TensorCPU>()->CopyFrom(
+      ws_.GetBlob("out")->Get<TensorCPU>());
+  for (int i = 0; i < indices_.size(); ++i) {
+    indices_[i] = i;
+  }
+  data_ = vector<float>(
+      ws_.GetBlob("rows")->Get<TensorCPU>().data<float>(),
+      ws_.GetBlob("rows")->Get<TensorCPU>().data<float>() +
+          indices_.size() * kBlockSize);
+  ExpectBags(RunOp(&ws_, "LengthsSqrtMean", {"rows", "lengths"}), false, 0.5);
+}
+
+// The gradient is that of WeightedSum with the weights of LengthsToWeights.
+TEST_F(SparseSegmentsTest, SparseLengthsSqrtMeanGradient) {
+  RunOp(&ws_, "SparseLengthsSum", {"data", "indices", "lengths"});
+  ws_.CreateBlob("segment_grads")->GetMutable<TensorCPU>()->CopyFrom(
+      ws_.GetBlob("out")->Get<TensorCPU>());
+  RunOp(&ws_, "LengthsToWeights", {"lengths"});
+  ws_.CreateBlob("sqrt_weights")->GetMutable<TensorCPU>()->CopyFrom(
+      ws_.GetBlob("out")->Get<TensorCPU>());
+  RunOp(
+      &ws_,
+      "SparseLengthsWeightedSumGradient",
+      {"sqrt_weights", "segment_grads", "lengths"});
+  ws_.CreateBlob("expected")->GetMutable<TensorCPU>()->CopyFrom(
+      ws_.GetBlob("out")->Get<TensorCPU>());
+  const auto& expected = ws_.GetBlob("expected")->Get<TensorCPU>();
+  const auto& grads = RunOp(
+      &ws_, "SparseLengthsSqrtMeanGradient", {"segment_grads", "lengths"});
+  ASSERT_EQ(expected.dims(), grads.dims());
+  for (int i = 0; i < grads.size(); ++i) {
+    EXPECT_NEAR(expected.data<float>()[i], grads.data<float>()[i], 1e-5);
+  }
+}
+
+TEST_F(SparseSegmentsTest, HalfData) {
+  // Rounding the table to halves first gives the reference.
+  auto& data = ws_.GetBlob("data")->Get<TensorCPU>();
+  RunOp(&ws_, "FloatToHalf", {"data"});
+  ws_.CreateBlob("half_data")->GetMutable<TensorCPU>()->CopyFrom(
+      ws_.GetBlob("out")->Get<TensorCPU>());
+  RunOp(&ws_, "HalfToFloat", {"half_data"});
+  std::copy(
+      ws_.GetBlob("out")->Get<TensorCPU>().data<float>(),
+      ws_.GetBlob("out")->Get<TensorCPU>().data<float>() + data.size(),
+      data_.begin());
+  ExpectBags(
+      RunOp(
+          &ws_,
+          "SparseLengthsWeightedSum",
+          {"half_data", "weights", "indices", "lengths"}),
+      true,
+      0);
+  ExpectBags(
+      RunOp(&ws_, "SparseLengthsMean", {"half_data", "indices", "lengths"}),
+      false,
+      1);
+}
+
+TEST_F(SparseSegmentsTest, SparseSortedSegmentSum) {
+  // The empty bag can't be expressed with segment ids.
+  lengths_.erase(lengths_.begin() + 1);
+  for (auto& id : segment_ids_) {
+    id -= id > 1;
+  }
+  AddTensor(&ws_, "segment_ids", segment_ids_);
+  ExpectBags(
+      RunOp(&ws_, "SparseSortedSegmentSum", {"data", "indices", "segment_ids"}),
+      false,
+      0);
+}
+
+TEST_F(SparseSegmentsTest, OutOfBoundsIndex) {
+  indices_.back() = kNumRows;
+  AddTensor(&ws_, "indices", indices_);
+  OperatorDef def;
+  def.set_type("SparseLengthsSum");
+  def.add_input("data");
+  def.add_input("indices");
+  def.add_input("lengths");
+  def.add_output("out");
+  EXPECT_THROW(ws_.RunOperatorOnce(def), EnforceNotMet);
+}
+
+TEST(SegmentReductionCostTest, SparseLengthsWeightedSum) {
+  // 10 rows of 4 floats, 6 weighted indices into them in 2 segments.
+  vector<TensorShape> shapes(4);
+  shapes[0].add_dims(10);
+  shapes[0].add_dims(4);
+  shapes[1].add_dims(6);
+  shapes[2].add_dims(6);
+  shapes[2].set_data_type(TensorProto::INT64);
+  shapes[3].add_dims(2);
+  shapes[3].set_data_type(TensorProto::INT32);
+  const OpSchema* schema =
+      OpSchemaRegistry::Schema("SparseLengthsWeightedSum");
+  ASSERT_TRUE(schema->HasCostInferenceFunction());
+  OperatorDef def;
+  def.set_type("SparseLengthsWeightedSum");
+  auto cost = schema->InferCost(def, shapes);
+  EXPECT_EQ(cost.flops, 2 * 6 * 4);
+  EXPECT_EQ(cost.bytes_read, 6 * 4 * 4 + 6 * 4 + 6 * 8 + 2 * 4);
+  EXPECT_EQ(cost.bytes_written, 2 * 4 * sizeof(float));
+  EXPECT_EQ(cost.bytes_moved, cost.bytes_read + cost.bytes_written);
+}
+
+} // namespace caffe2
@@ -1,6 +1,7 @@
 #include <cmath>
 
 #include "caffe2/operators/elementwise_op.h"
+#include "caffe2/utils/math.h"
 
 namespace caffe2 {
 
@@ -8,9 +9,7 @@ struct SigmoidCPUFunctor {
   template <typename T>
   inline void operator()(const int n, const T* x,
                          T* y, CPUContext* device_context) {
-    for (int i = 0; i < n; ++i) {
-      y[i] = 1. / (1. + exp(-x[i]));
-    }
+    math::Sigmoid<T, CPUContext>(n, x, y, device_context);
   }
 };
 
@@ -41,6 +40,7 @@ OPERATOR_SCHEMA(Sigmoid)
   .NumOutputs(1)
   .AllowInplace({{0, 0}})
   .IdenticalTypeAndShape()
+  .CostInferenceFunction(PointwiseCostInference<4>)
   .SetDoc(R"DOC(
 Sigmoid takes one input data (Tensor<T>) and produces one output data
 (Tensor<T>) where the sigmoid function, y = 1 / (1 + exp(-x)), is applied to the
@@ -71,6 +71,8 @@ OPERATOR_SCHEMA(Softmax)
   .NumInputs(1)
   .NumOutputs(1)
   .IdenticalTypeAndShape()
+  // Max, exp, sum and scale of every element.
+  .CostInferenceFunction(PointwiseCostInference<4>)
   .SetDoc(R"DOC(
 The operator computes the softmax normalized values for each layer in the batch
  of the given input. The input is a 2-D tensor (Tensor<float>) of size
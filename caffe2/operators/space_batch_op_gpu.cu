@@ -1,22 +1,24 @@
 #include "caffe2/operators/space_batch_op.h"
 #include "caffe2/core/common_gpu.h"
 #include "caffe2/core/context_gpu.h"
+#include "caffe2/utils/fixed_divisor.h"
 
 namespace caffe2 {
 
 __global__ void SpaceToBatch(
     int N,
+    const IndexDecomposer<4> output_dims,
     int output_batch,
     int output_depth,
     int output_height,
     int output_width,
-    int input_batch,
+    const FixedDivisor<int32_t> input_batch,
     int input_depth,
     int input_height,
     int input_width,
     const int pad_l,
     const int pad_t,
-    int block_size,
+    const FixedDivisor<int32_t> block_size,
     const float* input,
     float* output) {
   CUDA_1D_KERNEL_LOOP(i, N) {
@@ -24,18 +26,18 @@ __global__ void SpaceToBatch(
     // const auto output_offset =
     //     ((out_b * output_depth + d) * output_height + out_h) * output_width +
     //     out_w;
-    const int out_w = i % output_width;
-    const int i_2 = i / output_width;
-    const int out_h = i_2 % output_height;
-    const int i_3 = i_2 / output_height;
-    const int d = i_3 % output_depth;
-    const int out_b = i_3 / output_depth;
+    int coords[4];
+    output_dims.decompose(i, coords);
+    const int out_b = coords[0];
+    const int d = coords[1];
+    const int out_h = coords[2];
+    const int out_w = coords[3];
 
-    const int in_b = out_b % input_batch;
-    const int offset_w = (out_b / input_batch) % block_size;
-    const int offset_h = (out_b / input_batch) / block_size;
-    const int in_h = out_h * block_size + offset_h - pad_t;
-    const int in_w = out_w * block_size + offset_w - pad_l;
+    int offset, in_b, offset_h, offset_w;
+    input_batch.divMod(out_b, offset, in_b);
+    block_size.divMod(offset, offset_h, offset_w);
+    const int in_h = out_h * block_size.d() + offset_h - pad_t;
+    const int in_w = out_w * block_size.d() + offset_w - pad_l;
 
     if (in_h >= 0 && in_w >= 0 && in_h < input_height && in_w < input_width) {
       const auto input_offset =
@@ -72,17 +74,19 @@ void spaceToBatch<CUDAContext>(
       0,
       context->cuda_stream()>>>(
       N,
+      IndexDecomposer<4>{
+          output_batch, output_depth, output_height, output_width},
       output_batch,
       output_depth,
       output_height,
       output_width,
-      input_batch,
+      FixedDivisor<int32_t>(input_batch),
       input_depth,
       input_height,
       input_width,
       pad_l,
       pad_t,
-      block_size,
+      FixedDivisor<int32_t>(block_size),
       input.data<float>(),
       output->mutable_data<float>());
 }
@@ -90,7 +94,8 @@ void spaceToBatch<CUDAContext>(
 
 __global__ void BatchToSpace(
     int N,
-    int output_batch,
+    const IndexDecomposer<4> input_dims,
+    const FixedDivisor<int32_t> output_batch,
     int output_depth,
     int output_height,
     int output_width,
@@ -100,25 +105,25 @@ __global__ void BatchToSpace(
     int input_width,
     const int pad_l,
     const int pad_t,
-    int block_size,
+    const FixedDivisor<int32_t> block_size,
     const float* input,
     float* output) {
   CUDA_1D_KERNEL_LOOP(i, N) {
     // Recall:
     // const auto input_offset = ((in_b * input_depth + d) *
     //   input_height + in_h) * input_width + in_w;
-    const int in_w = i  % input_width;
-    const int i_2 = i / input_width;
-    const int in_h = i_2 % input_height;
-    const int i_3 = i_2 / input_height;
-    const int d = i_3 % input_depth;
-    const int in_b = i_3 / input_depth;
+    int coords[4];
+    input_dims.decompose(i, coords);
+    const int in_b = coords[0];
+    const int d = coords[1];
+    const int in_h = coords[2];
+    const int in_w = coords[3];
 
-    const int out_b = in_b % output_batch;
-    const int offset_w = (in_b / output_batch) % block_size;
-    const int offset_h = (in_b / output_batch) / block_size;
-    const int out_h = in_h * block_size + offset_h - pad_t;
-    const int out_w = in_w * block_size + offset_w - pad_l;
+    int offset, out_b, offset_h, offset_w;
+    output_batch.divMod(in_b, offset, out_b);
+    block_size.divMod(offset, offset_h, offset_w);
+    const int out_h = in_h * block_size.d() + offset_h - pad_t;
+    const int out_w = in_w * block_size.d() + offset_w - pad_l;
 
     if (out_h >= 0 && out_w >= 0 && out_h < output_height &&
         out_w < output_width) {
@@ -158,7 +163,8 @@ void batchToSpace(
       0,
       context->cuda_stream()>>>(
       N,
-      output_batch,
+      IndexDecomposer<4>{input_batch, input_depth, input_height, input_width},
+      FixedDivisor<int32_t>(output_batch),
       output_depth,
       output_height,
       output_width,
@@ -168,7 +174,7 @@ void batchToSpace(
       input_width,
       pad_l,
       pad_t,
-      block_size,
+      FixedDivisor<int32_t>(block_size),
       input.data<float>(),
       output->mutable_data<float>());
 }
@@ -0,0 +1,27 @@
+#include "caffe2/operators/sparse_sum_op.h"
+
+namespace caffe2 {
+
+namespace {
+REGISTER_CPU_OPERATOR(SparseSum, SparseSumOp<CPUContext>);
+
+OPERATOR_SCHEMA(SparseSum)
+    .NumInputs([](int n) { return n >= 2 && n % 2 == 0; })
+    .NumOutputs(2)
+    .SetDoc(R"DOC(
+Sums sparse tensors, such as the sparse gradients of a parameter used by
+several operators, without densifying them. The inputs are pairs of indices
+and values, where the values of a pair have the shape of its indices followed
+by the shape of a row, the same for all the pairs. The output indices are the
+distinct input indices, in order of first occurrence, and the output values
+have one row per output index, the sum of the rows of that index in all the
+inputs.
+)DOC")
+    .Input(0, "indices_0", "int32/int64 tensor of the ids of the first input")
+    .Input(1, "values_0", "Float rows of the first input")
+    .Output(0, "indices", "1-D tensor of the distinct ids")
+    .Output(1, "values", "Sum of the rows of each of the distinct ids");
+
+NO_GRADIENT(SparseSum);
+} // namespace
+} // namespace caffe2
@@ -0,0 +1,98 @@
+#ifndef CAFFE2_OPERATORS_SPARSE_SUM_OP_H_
+#define CAFFE2_OPERATORS_SPARSE_SUM_OP_H_
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+
+namespace caffe2 {
+
+// Sums sparse gradients given as (indices, values) pairs into one with
+// distinct indices, in order of first occurrence, without densifying them.
+template <class Context>
+class SparseSumOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(SparseSumOp);
+  USE_DISPATCH_HELPER;
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(this, Input(0));
+  }
+
+  template <typename TInd>
+  bool DoRunWithType() {
+    const int pairs = InputSize() / 2;
+    // The values of a gradient have the shape of its indices, which may have
+    // several dimensions, followed by the shape of a row.
+    const auto& first_indices = Input(0);
+    const auto& first_values = Input(1);
+    CAFFE_ENFORCE_GE(first_values.ndim(), first_indices.ndim());
+    const TIndex block_size = first_values.size_from_dim(first_indices.ndim());
+    TIndex total = 0;
+    for (int p = 0; p < pairs; ++p) {
+      const auto& indices = Input(2 * p);
+      const auto& values = Input(2 * p + 1);
+      CAFFE_ENFORCE(
+          indices.template IsType<TInd>(),
+          "All the indices must be of the same type");
+      CAFFE_ENFORCE_EQ(values.size(), indices.size() * block_size);
+      total += indices.size();
+    }
+
+    // rows_[j] is the output row of the j-th index of all the inputs.
+    position_.clear();
+    unique_.clear();
+    rows_.resize(total);
+    TIndex j = 0;
+    for (int p = 0; p < pairs; ++p) {
+      const auto& indices = Input(2 * p);
+      const TInd* idx = indices.template data<TInd>();
+      for (TIndex i = 0; i < indices.size(); ++i, ++j) {
+        auto it = position_.emplace(idx[i], unique_.size()).first;
+        if (it->second == unique_.size()) {
+          unique_.push_back(idx[i]);
+        }
+        rows_[j] = it->second;
+      }
+    }
+
+    auto* output_indices = Output(0);
+    auto* output_values = Output(1);
+    output_indices->Resize(unique_.size());
+    auto shape = first_values.dims();
+    shape.erase(shape.begin(), shape.begin() + first_indices.ndim());
+    shape.insert(shape.begin(), unique_.size());
+    output_values->Resize(shape);
+    std::copy(
+        unique_.begin(),
+        unique_.end(),
+        output_indices->template mutable_data<TInd>());
+    float* out = output_values->template mutable_data<float>();
+    std::fill(out, out + output_values->size(), 0.f);
+    j = 0;
+    for (int p = 0; p < pairs; ++p) {
+      const TIndex n = Input(2 * p).size();
+      const float* values = Input(2 * p + 1).template data<float>();
+      for (TIndex i = 0; i < n; ++i, ++j) {
+        float* row = out + rows_[j] * block_size;
+        const float* value = values + i * block_size;
+        for (TIndex k = 0; k < block_size; ++k) {
+          row[k] += value[k];
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  std::unordered_map<int64_t, TIndex> position_;
+  vector<int64_t> unique_;
+  vector<TIndex> rows_;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_SPARSE_SUM_OP_H_
@@ -1,6 +1,7 @@
 #include <algorithm>
-#include <unordered_map>
+#include <cstring>
 #include <vector>
+#include "caffe2/core/common_omp.h"
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/core/tensor.h"
@@ -16,12 +17,30 @@ class SparseToDenseMaskOp : public Operator<CPUContext> {
     CAFFE_ENFORCE(!mask.empty(), "mask can't be empty");
     auto biggest = *std::max_element(mask.begin(), mask.end());
     dense_.assign(std::min(kMaxDenseSize, biggest + 1), -1);
+    int sparseCount = 0;
+    for (int id : mask) {
+      sparseCount += id >= kMaxDenseSize;
+    }
+    // Ids beyond the dense range go to a flat open addressing table kept at
+    // most half full.
+    size_t capacity = 1;
+    while (capacity < 2 * sparseCount) {
+      capacity <<= 1;
+    }
+    sparseKeys_.assign(capacity, -1);
+    sparseValues_.assign(capacity, -1);
+    sparseMask_ = capacity - 1;
     for (int i = 0; i < mask.size(); i++) {
       int id = mask[i];
       CAFFE_ENFORCE_GE(id, 0, "Only positive IDs are allowed.");
       if (id >= kMaxDenseSize) {
-        CAFFE_ENFORCE(sparse_.count(id) == 0, "Duplicated id: ", id);
-        sparse_[id] = i;
+        size_t slot = hashId(id) & sparseMask_;
+        while (sparseKeys_[slot] != -1) {
+          CAFFE_ENFORCE(sparseKeys_[slot] != id, "Duplicated id: ", id);
+          slot = (slot + 1) & sparseMask_;
+        }
+        sparseKeys_[slot] = id;
+        sparseValues_[slot] = i;
       } else {
         CAFFE_ENFORCE(dense_[id] == -1, "Duplicated id: ", id);
         dense_[id] = i;
@@ -79,30 +98,62 @@ class SparseToDenseMaskOp : public Operator<CPUContext> {
     output->Resize(shape);
 
     // init
-    // TODO: consider unrolling CopyItems to make elemental types copy faster
     char* output_data =
         static_cast<char*>(output->raw_mutable_data(sparse_values.meta()));
-    for (int i = 0; i < cols * rows; i++) {
-      context_.template CopyItems<CPUContext, CPUContext>(
-          default_value.meta(),
-          block_size,
-          default_val,
-          output_data + i * block_nbytes);
+    const bool primitive = sparse_values.meta().copy() == nullptr;
+    if (primitive && rows * cols > 0) {
+      // Fill the first block and then keep doubling the filled prefix.
+      memcpy(output_data, default_val, block_nbytes);
+      size_t filled = block_nbytes;
+      const size_t total = static_cast<size_t>(rows) * cols * block_nbytes;
+      while (filled < total) {
+        const size_t n = std::min(filled, total - filled);
+        memcpy(output_data + filled, output_data, n);
+        filled += n;
+      }
+    } else {
+      for (int i = 0; i < cols * rows; i++) {
+        context_.template CopyItems<CPUContext, CPUContext>(
+            default_value.meta(),
+            block_size,
+            default_val,
+            output_data + i * block_nbytes);
+      }
     }
 
-    int32_t offset = 0;
+    // Rows are independent, so they are processed in parallel once their
+    // offsets into indices/values are known.
+    offsets_.resize(rows);
+    TIndex offset = 0;
+    for (int r = 0; r < rows; r++) {
+      offsets_[r] = offset;
+      offset += lengths_vec[r];
+    }
+    CAFFE_ENFORCE_LE(offset, sparse_indices.size());
+#pragma omp parallel for if (rows > 1 && offset >= kMinParallelSize)
     for (int r = 0; r < rows; r++) {
-      for (int c = 0; c < lengths_vec[r]; c++) {
-        int idx = getFeatureIdx(sparse_indices_vec[offset + c]);
-        if (idx != -1) {
+      const TIndex begin = offsets_[r];
+      const TIndex end = begin + lengths_vec[r];
+      char* row_data =
+          output_data + static_cast<TIndex>(r) * cols * block_nbytes;
+      for (TIndex c = begin; c < end; c++) {
+        int idx = getFeatureIdx(sparse_indices_vec[c]);
+        if (idx == -1) {
+          continue;
+        }
+        if (primitive) {
+          memcpy(
+              row_data + idx * block_nbytes,
+              sparse_values_vec + c * block_nbytes,
+              block_nbytes);
+        } else {
           context_.template CopyItems<CPUContext, CPUContext>(
               sparse_values.meta(),
               block_size,
-              sparse_values_vec + (offset + c) * block_nbytes,
-              output_data + (r * cols + idx) * block_nbytes);
+              sparse_values_vec + c * block_nbytes,
+              row_data + idx * block_nbytes);
         }
       }
-      offset += lengths_vec[r];
     }
 
     return true;
@@ -110,21 +161,34 @@ class SparseToDenseMaskOp : public Operator<CPUContext> {
 
  private:
   const int kMaxDenseSize = 1024 * 128;
+  const TIndex kMinParallelSize = 1 << 14;
 
-  std::unordered_map<int, int> sparse_;
   std::vector<int> dense_;
+  // Flat hash table for ids >= kMaxDenseSize; -1 marks an empty slot.
+  std::vector<int64_t> sparseKeys_;
+  std::vector<int> sparseValues_;
+  size_t sparseMask_;
   int featuresCount_;
+  std::vector<TIndex> offsets_;
+
+  static size_t hashId(int64_t id) {
+    // Fibonacci hashing, the high bits are well mixed.
+    const uint64_t h = static_cast<uint64_t>(id) * 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 32);
+  }
 
-  inline int getFeatureIdx(int id) const {
-    if (id >= kMaxDenseSize) {
-      const auto& iter = sparse_.find(id);
-      if (iter == sparse_.end()) {
+  inline int getFeatureIdx(int64_t id) const {
+    if (id < kMaxDenseSize) {
+      return (id < 0 || id >= dense_.size()) ? -1 : dense_[id];
+    }
+    for (size_t slot = hashId(id) & sparseMask_;;
+         slot = (slot + 1) & sparseMask_) {
+      if (sparseKeys_[slot] == id) {
+        return sparseValues_[slot];
+      }
+      if (sparseKeys_[slot] == -1) {
         return -1;
-      } else {
-        return iter->second;
       }
-    } else {
-      return (id >= dense_.size()) ? -1 : dense_[id];
     }
   }
 
@@ -0,0 +1,86 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+// Mixes ids in the dense range, ids in the hashed range, unknown ids and
+// int64 ids that only match the mask when truncated to int32.
+TEST(SparseToDenseMaskTest, MatchesReference) {
+  std::mt19937 gen(3);
+  vector<int> mask;
+  for (int i = 0; i < 50; ++i) {
+    mask.push_back(i * 3);
+    mask.push_back(200000 + i * 7919);
+  }
+  const int cols = mask.size();
+  for (int rows : {1, 3, 5000}) {
+    Workspace ws;
+    vector<int> lengths(rows);
+    int total = 0;
+    for (auto& l : lengths) {
+      l = gen() % 10;
+      total += l;
+    }
+    auto* indices = ws.CreateBlob("indices")->GetMutable<TensorCPU>();
+    indices->Resize(total);
+    auto* values = ws.CreateBlob("values")->GetMutable<TensorCPU>();
+    values->Resize(total, 2);
+    for (int i = 0; i < total; ++i) {
+      int64_t id = gen() % 2 ? mask[gen() % cols] : gen() % 400000;
+      if (gen() % 10 == 0) {
+        id += int64_t(1) << 32;
+      }
+      indices->mutable_data<int64_t>()[i] = id;
+      values->mutable_data<float>()[2 * i] = i;
+      values->mutable_data<float>()[2 * i + 1] = -i;
+    }
+    auto* default_value = ws.CreateBlob("default")->GetMutable<TensorCPU>();
+    default_value->Resize(2);
+    default_value->mutable_data<float>()[0] = -1;
+    default_value->mutable_data<float>()[1] = -2;
+    auto* lengths_blob = ws.CreateBlob("lengths")->GetMutable<TensorCPU>();
+    lengths_blob->Resize(rows);
+    std::copy(
+        lengths.begin(), lengths.end(), lengths_blob->mutable_data<int>());
+
+    OperatorDef def;
+    def.set_type("SparseToDenseMask");
+    for (const char* in : {"indices", "values", "default", "lengths"}) {
+      def.add_input(in);
+    }
+    def.add_output("output");
+    auto* arg = def.add_arg();
+    arg->set_name("mask");
+    for (int id : mask) {
+      arg->add_ints(id);
+    }
+    ASSERT_TRUE(ws.RunOperatorOnce(def));
+
+    vector<float> expected(rows * cols * 2);
+    for (size_t i = 0; i < expected.size(); i += 2) {
+      expected[i] = -1;
+      expected[i + 1] = -2;
+    }
+    int offset = 0;
+    for (int r = 0; r < rows; ++r) {
+      for (int c = 0; c < lengths[r]; ++c, ++offset) {
+        const int64_t id = indices->data<int64_t>()[offset];
+        for (int j = 0; j < cols; ++j) {
+          if (mask[j] == id) {
+            expected[(r * cols + j) * 2] = offset;
+            expected[(r * cols + j) * 2 + 1] = -offset;
+          }
+        }
+      }
+    }
+    const auto& output = ws.GetBlob("output")->Get<TensorCPU>();
+    ASSERT_EQ(output.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      ASSERT_EQ(output.data<float>()[i], expected[i]) << i;
+    }
+  }
+}
+
+} // namespace caffe2
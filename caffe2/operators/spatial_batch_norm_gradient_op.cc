@@ -1,7 +1,20 @@
 #include "caffe2/operators/spatial_batch_norm_op.h"
 
+#include <algorithm>
+
+#include "caffe2/core/common_omp.h"
+
 namespace caffe2 {
 
+namespace {
+
+// Rows of an NHWC input that a thread reduces or differentiates at once.
+constexpr int kRowBlock = 64;
+// Inputs smaller than this are processed on one thread.
+constexpr int kMinParallelSize = 1 << 15;
+
+} // namespace
+
 template <>
 bool SpatialBNGradientOp<CPUContext>::RunOnDevice() {
   const auto& X = Input(INPUT);
@@ -36,50 +49,94 @@ bool SpatialBNGradientOp<CPUContext>::RunOnDevice() {
   EigenVectorArrayMap<float> dBias_arr(dBias->mutable_data<float>(), C);
   EigenVectorArrayMap<float> dScale_arr(dScale->mutable_data<float>(), C);
 
-  dBias_arr.setZero();
-  dScale_arr.setZero();
-
-  const auto scaleInvVarNHW = scale_arr * inv_var_arr / (N * H * W);
+  // Two passes over X and dY: the first reduces dBias and dScale, and the
+  // second computes dX from them.
+  const int M = N * H * W;
+  const int size = M * C;
+  const Eigen::Array<float, Eigen::Dynamic, 1> scaleInvVarNHW =
+      scale_arr * inv_var_arr / M;
+  const float* X_data = X.data<float>();
+  const float* dY_data = dY.data<float>();
+  float* dX_data = dX->mutable_data<float>();
 
   switch (order_) {
     case StorageOrder::NCHW: {
-      ConstEigenArrayMap<float> X_arr(X.data<float>(), H * W, N * C);
-      ConstEigenArrayMap<float> dY_arr(dY.data<float>(), H * W, N * C);
-      EigenArrayMap<float> dX_arr(dX->mutable_data<float>(), H * W, N * C);
-      dX_arr.setZero();
-
-      for (int nc = 0; nc < N * C; ++nc) {
-        int c = nc % C;
-        dBias_arr(c) += dY_arr.col(nc).sum();
-        dScale_arr(c) +=
-            ((X_arr.col(nc) - mean_arr(c)) * inv_var_arr(c) * dY_arr.col(nc))
-                .sum();
-      }
-      for (int nc = 0; nc < N * C; ++nc) {
-        int c = nc % C;
-        dX_arr.col(nc) += scaleInvVarNHW(c) *
-            (dY_arr.col(nc) * N * H * W - dBias_arr(c) -
-             (X_arr.col(nc) - mean_arr[c]) * dScale_arr(c) * inv_var_arr(c));
+      const int HxW = H * W;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (size > kMinParallelSize)
+#endif
+      for (int c = 0; c < C; ++c) {
+        float dBias_c = 0;
+        float dScale_c = 0;
+        for (int n = 0; n < N; ++n) {
+          const int offset = (n * C + c) * HxW;
+          ConstEigenVectorArrayMap<float> X_slice(X_data + offset, HxW);
+          ConstEigenVectorArrayMap<float> dY_slice(dY_data + offset, HxW);
+          dBias_c += dY_slice.sum();
+          dScale_c += ((X_slice - mean_arr(c)) * dY_slice).sum();
+        }
+        dScale_c *= inv_var_arr(c);
+        dBias_arr(c) = dBias_c;
+        dScale_arr(c) = dScale_c;
+        for (int n = 0; n < N; ++n) {
+          const int offset = (n * C + c) * HxW;
+          EigenVectorArrayMap<float>(dX_data + offset, HxW) =
+              scaleInvVarNHW(c) *
+              (ConstEigenVectorArrayMap<float>(dY_data + offset, HxW) * M -
+               dBias_c -
+               (ConstEigenVectorArrayMap<float>(X_data + offset, HxW) -
+                mean_arr(c)) *
+                   dScale_c * inv_var_arr(c));
+        }
       }
       break;
     }
     case StorageOrder::NHWC: {
-      ConstEigenArrayMap<float> X_arr(X.data<float>(), C, N * H * W);
-      ConstEigenArrayMap<float> dY_arr(dY.data<float>(), C, N * H * W);
-      EigenArrayMap<float> dX_arr(dX->mutable_data<float>(), C, N * H * W);
-      dX_arr.setZero();
-
-      const auto dYRowSum = dY_arr.rowwise().sum();
-      const auto XMinusMean = X_arr.colwise() - mean_arr;
-      const auto dYMulXMinusMeanRowSum = (dY_arr * XMinusMean).rowwise().sum();
-      const auto invVarSqr = inv_var_arr * inv_var_arr;
-      for (int nhw = 0; nhw < N * H * W; ++nhw) {
-        dBias_arr += dY_arr.col(nhw);
-        dScale_arr +=
-            (X_arr.col(nhw) - mean_arr) * inv_var_arr * dY_arr.col(nhw);
-        dX_arr.col(nhw) += scaleInvVarNHW *
-            (dY_arr.col(nhw) * N * H * W - dYRowSum -
-             XMinusMean.col(nhw) * invVarSqr * dYMulXMinusMeanRowSum);
+      // Each block of rows is reduced on its own, and the blocks are then
+      // summed in order, so that the result does not depend on the number
+      // of threads.
+      const int num_blocks = (M + kRowBlock - 1) / kRowBlock;
+      vector<float> block_dBias(num_blocks * C);
+      vector<float> block_dScale(num_blocks * C);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (size > kMinParallelSize)
+#endif
+      for (int b = 0; b < num_blocks; ++b) {
+        const int first = b * kRowBlock;
+        const int rows = std::min(kRowBlock, M - first);
+        ConstEigenArrayMap<float> X_block(X_data + first * C, C, rows);
+        ConstEigenArrayMap<float> dY_block(dY_data + first * C, C, rows);
+        EigenVectorArrayMap<float>(&block_dBias[b * C], C) =
+            dY_block.rowwise().sum();
+        EigenVectorArrayMap<float>(&block_dScale[b * C], C) =
+            ((X_block.colwise() - mean_arr) * dY_block).rowwise().sum();
+      }
+      dBias_arr.setZero();
+      dScale_arr.setZero();
+      for (int b = 0; b < num_blocks; ++b) {
+        dBias_arr += ConstEigenVectorArrayMap<float>(&block_dBias[b * C], C);
+        dScale_arr += ConstEigenVectorArrayMap<float>(&block_dScale[b * C], C);
+      }
+      dScale_arr *= inv_var_arr;
+      const Eigen::Array<float, Eigen::Dynamic, 1> dScaleInvVar =
+          dScale_arr * inv_var_arr;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (size > kMinParallelSize)
+#endif
+      for (int b = 0; b < num_blocks; ++b) {
+        const int first = b * kRowBlock;
+        const int rows = std::min(kRowBlock, M - first);
+        EigenArrayMap<float>(dX_data + first * C, C, rows) =
+            ((ConstEigenArrayMap<float>(dY_data + first * C, C, rows) * M)
+                 .colwise() -
+             dBias_arr -
+             (ConstEigenArrayMap<float>(X_data + first * C, C, rows)
+                  .colwise() -
+              mean_arr)
+                     .colwise() *
+                 dScaleInvVar)
+                .colwise() *
+            scaleInvVarNHW;
       }
       break;
     }
@@ -123,8 +180,9 @@ class GetSpatialBNGradient : public GradientMakerBase {
       grad_inputs = vector<string>{I(0), I(1), GO(0), O(3), O(4)};
     }
     return SingleGradientDef(
-        "SpatialBNGradient", "", grad_inputs, grad_outputs);
+        def_.type() + "Gradient", "", grad_inputs, grad_outputs);
   }
 };
 REGISTER_GRADIENT(SpatialBN, GetSpatialBNGradient);
+REGISTER_GRADIENT(SpatialBNFp16, GetSpatialBNGradient);
 }
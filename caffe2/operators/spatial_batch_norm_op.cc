@@ -1,18 +1,232 @@
 #include "caffe2/operators/spatial_batch_norm_op.h"
 
+#include <algorithm>
+
+#include "caffe2/core/common_omp.h"
+
 namespace caffe2 {
 
+namespace {
+
+// Rows of an NHWC input that a thread reduces or normalizes at once.
+constexpr int kRowBlock = 64;
+// Inputs smaller than this are processed on one thread.
+constexpr int kMinParallelSize = 1 << 15;
+
+// Merges the mean and M2 (the sum of squared deviations from the mean) of
+// count_b values into those of count_a values, channel by channel, with the
+// pairwise update of Chan et al. Unlike summing x and x^2, this does not
+// lose the variance to cancellation when the mean is large.
+void MergeMoments(
+    int size,
+    TIndex count_a,
+    TIndex count_b,
+    const float* mean_b,
+    const float* m2_b,
+    float* mean_a,
+    float* m2_a) {
+  const float total = count_a + count_b;
+  for (int i = 0; i < size; ++i) {
+    const float delta = mean_b[i] - mean_a[i];
+    mean_a[i] += delta * (count_b / total);
+    m2_a[i] += m2_b[i] + delta * delta * (count_a * (count_b / total));
+  }
+}
+
+// The mean and M2 of each row of the rows x cols array X.
+void RowMoments(
+    const ConstEigenArrayMap<float>& X,
+    float* mean,
+    float* m2) {
+  EigenVectorArrayMap<float> mean_arr(mean, X.rows());
+  mean_arr = X.rowwise().sum() / X.cols();
+  EigenVectorArrayMap<float>(m2, X.rows()) =
+      (X.colwise() - mean_arr).square().rowwise().sum();
+}
+
+// The mean and variance of each of the C channels of X, from one pass over
+// memory: each slice of X, such as the H * W values of a channel of an
+// image, is reduced to its mean and M2 while it is in cache, and the slices
+// are then merged in a fixed order, so that the result does not depend on
+// the number of threads.
+void ComputeMoments(
+    StorageOrder order,
+    int N,
+    int C,
+    int HxW,
+    int B,
+    const float* X,
+    float* mean,
+    float* var) {
+  const int size = N * C * HxW;
+  switch (order) {
+    case StorageOrder::NCHW: {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (size > kMinParallelSize)
+#endif
+      for (int c = 0; c < C; ++c) {
+        float m2 = 0;
+        mean[c] = 0;
+        for (int n = 0; n < N; ++n) {
+          ConstEigenVectorArrayMap<float> slice(X + (n * C + c) * HxW, HxW);
+          const float slice_mean = slice.sum() / HxW;
+          const float slice_m2 = (slice - slice_mean).square().sum();
+          MergeMoments(
+              1, n * HxW, HxW, &slice_mean, &slice_m2, &mean[c], &m2);
+        }
+        var[c] = m2 / (N * HxW);
+      }
+      break;
+    }
+    case StorageOrder::NHWC: {
+      const int rows = N * HxW;
+      const int num_blocks = (rows + kRowBlock - 1) / kRowBlock;
+      vector<float> block_mean(num_blocks * C);
+      vector<float> block_m2(num_blocks * C);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (size > kMinParallelSize)
+#endif
+      for (int b = 0; b < num_blocks; ++b) {
+        const int first = b * kRowBlock;
+        RowMoments(
+            ConstEigenArrayMap<float>(
+                X + first * C, C, std::min(kRowBlock, rows - first)),
+            &block_mean[b * C],
+            &block_m2[b * C]);
+      }
+      EigenVectorArrayMap<float> m2(var, C);
+      EigenVectorArrayMap<float>(mean, C).setZero();
+      m2.setZero();
+      for (int b = 0; b < num_blocks; ++b) {
+        const int first = b * kRowBlock;
+        MergeMoments(
+            C,
+            first,
+            std::min(kRowBlock, rows - first),
+            &block_mean[b * C],
+            &block_m2[b * C],
+            mean,
+            var);
+      }
+      m2 /= rows;
+      break;
+    }
+    case StorageOrder::NCHWc: {
+      const int Cb = C / B;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (size > kMinParallelSize)
+#endif
+      for (int cb = 0; cb < Cb; ++cb) {
+        vector<float> slice_mean(B);
+        vector<float> slice_m2(B);
+        float* block_mean = mean + cb * B;
+        float* block_m2 = var + cb * B;
+        std::fill(block_mean, block_mean + B, 0.f);
+        std::fill(block_m2, block_m2 + B, 0.f);
+        for (int n = 0; n < N; ++n) {
+          RowMoments(
+              ConstEigenArrayMap<float>(X + (n * Cb + cb) * HxW * B, B, HxW),
+              slice_mean.data(),
+              slice_m2.data());
+          MergeMoments(
+              B,
+              n * HxW,
+              HxW,
+              slice_mean.data(),
+              slice_m2.data(),
+              block_mean,
+              block_m2);
+        }
+        EigenVectorArrayMap<float>(block_m2, B) /= N * HxW;
+      }
+      break;
+    }
+    default:
+      CAFFE_THROW("Unknown storage order: ", order);
+  }
+}
+
+// Y = X * scale + bias, with a scale and bias per channel.
+void Normalize(
+    StorageOrder order,
+    int N,
+    int C,
+    int HxW,
+    int B,
+    const float* scale,
+    const float* bias,
+    const float* X,
+    float* Y) {
+  const int size = N * C * HxW;
+  switch (order) {
+    case StorageOrder::NCHW: {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (size > kMinParallelSize)
+#endif
+      for (int nc = 0; nc < N * C; ++nc) {
+        const int c = nc % C;
+        EigenVectorArrayMap<float>(Y + nc * HxW, HxW) =
+            ConstEigenVectorArrayMap<float>(X + nc * HxW, HxW) * scale[c] +
+            bias[c];
+      }
+      break;
+    }
+    case StorageOrder::NHWC: {
+      const int rows = N * HxW;
+      const int num_blocks = (rows + kRowBlock - 1) / kRowBlock;
+      ConstEigenVectorArrayMap<float> scale_arr(scale, C);
+      ConstEigenVectorArrayMap<float> bias_arr(bias, C);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (size > kMinParallelSize)
+#endif
+      for (int b = 0; b < num_blocks; ++b) {
+        const int first = b * kRowBlock;
+        const int block_rows = std::min(kRowBlock, rows - first);
+        EigenArrayMap<float>(Y + first * C, C, block_rows) =
+            (ConstEigenArrayMap<float>(X + first * C, C, block_rows)
+                 .colwise() *
+             scale_arr)
+                .colwise() +
+            bias_arr;
+      }
+      break;
+    }
+    case StorageOrder::NCHWc: {
+      const int Cb = C / B;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (size > kMinParallelSize)
+#endif
+      for (int i = 0; i < N * Cb; ++i) {
+        const int offset = i * HxW * B;
+        EigenArrayMap<float>(Y + offset, B, HxW) =
+            (ConstEigenArrayMap<float>(X + offset, B, HxW).colwise() *
+             ConstEigenVectorArrayMap<float>(scale + i % Cb * B, B))
+                .colwise() +
+            ConstEigenVectorArrayMap<float>(bias + i % Cb * B, B);
+      }
+      break;
+    }
+    default:
+      CAFFE_THROW("Unknown storage order: ", order);
+  }
+}
+
+} // namespace
+
 template <>
 bool SpatialBNOp<CPUContext>::RunOnDevice() {
   const auto& X = Input(INPUT);
   const auto& scale = Input(SCALE);
   const auto& bias = Input(BIAS);
 
-  DCHECK_EQ(X.ndim(), 4);
+  const bool blocked = order_ == StorageOrder::NCHWc;
+  DCHECK_EQ(X.ndim(), blocked ? 5 : 4);
   const int N = X.dim32(0);
-  const int C = (order_ == StorageOrder::NCHW ? X.dim32(1) : X.dim32(3));
-  const int H = (order_ == StorageOrder::NCHW ? X.dim32(2) : X.dim32(1));
-  const int W = (order_ == StorageOrder::NCHW ? X.dim32(3) : X.dim32(2));
+  // In the NCHWc order, channel c is in block c / B at position c % B.
+  const int B = blocked ? X.dim32(4) : 1;
+  const int C = (order_ == StorageOrder::NHWC ? X.dim32(3) : X.dim32(1) * B);
+  const int H = (order_ == StorageOrder::NHWC ? X.dim32(1) : X.dim32(2));
+  const int W = (order_ == StorageOrder::NHWC ? X.dim32(2) : X.dim32(3));
   DCHECK_EQ(scale.ndim(), 1);
   DCHECK_EQ(bias.ndim(), 1);
   DCHECK_EQ(scale.dim32(0), C);
@@ -38,36 +252,15 @@ bool SpatialBNOp<CPUContext>::RunOnDevice() {
     EigenVectorArrayMap<float> var(
         Output(SAVED_INV_VAR)->mutable_data<float>(), C);
 
-    mean.setZero();
-    var.setZero();
-    switch (order_) {
-      case StorageOrder::NCHW: {
-        ConstEigenArrayMap<float> X_arr(X.data<float>(), H * W, N * C);
-        for (int nc = 0; nc < N * C; ++nc) {
-          mean(nc % C) += X_arr.col(nc).sum();
-        }
-        mean /= N * H * W;
-        for (int nc = 0; nc < N * C; ++nc) {
-          var(nc % C) += (X_arr.col(nc) - mean(nc % C)).matrix().squaredNorm();
-        }
-        var /= N * H * W;
-        break;
-      }
-      case StorageOrder::NHWC: {
-        ConstEigenArrayMap<float> X_arr(X.data<float>(), C, N * H * W);
-        for (int i = 0; i < N * H * W; ++i) {
-          mean += X_arr.col(i);
-        }
-        mean /= N * H * W;
-        for (int i = 0; i < N * H * W; ++i) {
-          var += (X_arr.col(i) - mean) * (X_arr.col(i) - mean);
-        }
-        var /= N * H * W;
-        break;
-      }
-      default:
-        CAFFE_THROW("Unknown storage order: ", order_);
-    }
+    ComputeMoments(
+        order_,
+        N,
+        C,
+        H * W,
+        B,
+        X.data<float>(),
+        mean.data(),
+        var.data());
 
     // Compute the running mean and running inv variance.
     auto* running_mean = Output(RUNNING_MEAN);
@@ -116,26 +309,16 @@ bool SpatialBNOp<CPUContext>::RunOnDevice() {
   Eigen::Array<float, Eigen::Dynamic, 1> new_scale = inv_std * scale_arr;
   Eigen::Array<float, Eigen::Dynamic, 1> new_bias =
       bias_arr - mean_arr * inv_std * scale_arr;
-  switch (order_) {
-    case StorageOrder::NHWC: {
-      EigenArrayMap<float>(Y->mutable_data<float>(), C, N * H * W) =
-          (ConstEigenArrayMap<float>(X.data<float>(), C, N * H * W).colwise() *
-           new_scale)
-              .colwise() +
-          new_bias;
-      break;
-    }
-    case StorageOrder::NCHW: {
-      EigenArrayMap<float> Y_arr(Y->mutable_data<float>(), H * W, N * C);
-      ConstEigenArrayMap<float> X_arr(X.data<float>(), H * W, N * C);
-      for (int nc = 0; nc < N * C; ++nc) {
-        Y_arr.col(nc) = X_arr.col(nc) * new_scale(nc % C) + new_bias(nc % C);
-      }
-      break;
-    }
-    default:
-      CAFFE_THROW("Unknown storage order: ", order_);
-  }
+  Normalize(
+      order_,
+      N,
+      C,
+      H * W,
+      B,
+      new_scale.data(),
+      new_bias.data(),
+      X.data<float>(),
+      Y->mutable_data<float>());
   return true;
 }
 
@@ -157,7 +340,10 @@ OPERATOR_SCHEMA(SpatialBN)
                     helper.GetSingleArgument<string>("order", "NCHW"));
                 const TensorShape &X = in[0];
                 const int N =  X.dims(0);
-                const int C = (order == StorageOrder::NCHW ? X.dims(1) : X.dims(3));
+                const int C = order == StorageOrder::NHWC
+                    ? X.dims(3)
+                    : order == StorageOrder::NCHW ? X.dims(1)
+                                                  : X.dims(1) * X.dims(4);
 
                 out.push_back(in[0]);
                 TensorShape meanvar_tp =
@@ -171,6 +357,23 @@ OPERATOR_SCHEMA(SpatialBN)
                 return vector<TensorShape> {in[0]};
               }
           })
+    .CostInferenceFunction(
+        [](const OperatorDef& def, const vector<TensorShape>& in) {
+          struct OpSchema::Cost c;
+          ArgumentHelper helper(def);
+          const bool is_test = helper.GetSingleArgument<int>("is_test", 0);
+          const uint64_t size = GetNumElements(in[0]);
+          const uint64_t params_size = 4 * GetNumElements(in[1]);
+          // A scale and shift per element at test time; training computes the
+          // mean and variance over the batch first, and normalizes with them.
+          c.flops = (is_test ? 2 : 6) * size;
+          c.bytes_read =
+              ((is_test ? 1 : 2) * size + params_size) * sizeof(float);
+          c.bytes_written =
+              (size + (is_test ? 0 : params_size)) * sizeof(float);
+          c.bytes_moved = c.bytes_read + c.bytes_written;
+          return c;
+        })
     .SetDoc(R"DOC(
 Carries out spatial batch normalization as described in the paper
 https://arxiv.org/abs/1502.03167. Depending on the mode it is being run,
@@ -189,7 +392,8 @@ Output case #2: Y (test mode)
         0,
         "X",
         "The input 4-dimensional tensor of shape NCHW or NHWC depending "
-        "on the order parameter.")
+        "on the order parameter, or the 5-dimensional tensor of the blocked "
+        "NCHWc order.")
     .Input(
         1,
         "scale",
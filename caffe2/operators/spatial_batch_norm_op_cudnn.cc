@@ -82,6 +82,7 @@ class CudnnSpatialBNGradientOp final : public SpatialBNGradientOp<CUDAContext> {
 
 template <typename T>
 bool CudnnSpatialBNOp<T>::RunOnDevice() {
+  typedef typename cudnnTypeWrapper<T>::BNParamType BNParamType;
   const auto& X = Input(INPUT);
   const auto& scale = Input(SCALE);
   const auto& bias = Input(BIAS);
@@ -128,10 +129,10 @@ bool CudnnSpatialBNOp<T>::RunOnDevice() {
         data_desc_,
         Y->template mutable_data<T>(),
         bn_param_desc_,
-        scale.template data<T>(),
-        bias.template data<T>(),
-        est_mean.template data<T>(),
-        est_var.template data<T>(),
+        scale.template data<BNParamType>(),
+        bias.template data<BNParamType>(),
+        est_mean.template data<BNParamType>(),
+        est_var.template data<BNParamType>(),
         epsilon_));
   } else {
     // Run training mode.
@@ -142,8 +143,8 @@ bool CudnnSpatialBNOp<T>::RunOnDevice() {
     auto* running_mean = Output(RUNNING_MEAN);
     auto* running_var = Output(RUNNING_VAR);
     double this_factor = 1. - momentum_;
-    T* running_mean_data = nullptr;
-    T* running_var_data = nullptr;
+    BNParamType* running_mean_data = nullptr;
+    BNParamType* running_var_data = nullptr;
     if (!running_mean->size()) {
       // If the input mean and var are not initialized yet, this is the first
       // run and we will initialize the storage.
@@ -151,30 +152,31 @@ bool CudnnSpatialBNOp<T>::RunOnDevice() {
       // Need to do initialization
       running_mean->Resize(C);
       running_var->Resize(C);
-      running_mean_data = running_mean->template mutable_data<T>();
-      running_var_data = running_var->template mutable_data<T>();
+      running_mean_data = running_mean->template mutable_data<BNParamType>();
+      running_var_data = running_var->template mutable_data<BNParamType>();
       // In principle, setting this_momentum to 1 will wipe existing data.
       // This has a caveat that if cudnn does not deal with 0*NaN cases we
       // will be having an issue. Thus we choose a safe path by explicitly
       // setting zero.
-      math::Set<T, CUDAContext>(C, 0, running_mean_data, &context_);
-      math::Set<T, CUDAContext>(C, 0, running_var_data, &context_);
+      math::Set<BNParamType, CUDAContext>(
+          C, 0, running_mean_data, &context_);
+      math::Set<BNParamType, CUDAContext>(C, 0, running_var_data, &context_);
     } else {
       // Does not need to do initialization.
       DCHECK_EQ(running_mean->ndim(), 1);
       DCHECK_EQ(running_var->ndim(), 1);
       DCHECK_EQ(running_mean->dim32(0), C);
       DCHECK_EQ(running_var->dim32(0), C);
-      running_mean_data = running_mean->template mutable_data<T>();
-      running_var_data = running_var->template mutable_data<T>();
+      running_mean_data = running_mean->template mutable_data<BNParamType>();
+      running_var_data = running_var->template mutable_data<BNParamType>();
     }
     // Save the mean and inv var results.
     auto* save_mean = Output(SAVED_MEAN);
     auto* save_var = Output(SAVED_INV_VAR);
     save_mean->Resize(C);
     save_var->Resize(C);
-    void* save_mean_data = save_mean->template mutable_data<T>();
-    void* save_var_data = save_var->template mutable_data<T>();
+    void* save_mean_data = save_mean->template mutable_data<BNParamType>();
+    void* save_var_data = save_var->template mutable_data<BNParamType>();
 
     CUDNN_CHECK(cudnnBatchNormalizationForwardTraining(
         cudnn_wrapper_.inline_cudnn_handle(),
@@ -186,8 +188,8 @@ bool CudnnSpatialBNOp<T>::RunOnDevice() {
         data_desc_,
         Y->template mutable_data<T>(),
         bn_param_desc_,
-        scale.template data<T>(),
-        bias.template data<T>(),
+        scale.template data<BNParamType>(),
+        bias.template data<BNParamType>(),
         this_factor,
         running_mean_data,
         running_var_data,
@@ -201,6 +203,7 @@ bool CudnnSpatialBNOp<T>::RunOnDevice() {
 
 template <typename T>
 bool CudnnSpatialBNGradientOp<T>::RunOnDevice() {
+  typedef typename cudnnTypeWrapper<T>::BNParamType BNParamType;
   const auto& X = Input(INPUT);
   const auto& scale = Input(SCALE);
   const auto& dY = Input(OUTPUT_GRAD);
@@ -231,8 +234,8 @@ bool CudnnSpatialBNGradientOp<T>::RunOnDevice() {
 
   const auto& saved_mean = Input(SAVED_MEAN);
   const auto& saved_var = Input(SAVED_INV_VAR);
-  const void* saved_mean_data = saved_mean.template data<T>();
-  const void* saved_var_data = saved_var.template data<T>();
+  const void* saved_mean_data = saved_mean.template data<BNParamType>();
+  const void* saved_var_data = saved_var.template data<BNParamType>();
 
   CUDNN_CHECK(cudnnBatchNormalizationBackward(
       cudnn_wrapper_.inline_cudnn_handle(),
@@ -248,9 +251,9 @@ bool CudnnSpatialBNGradientOp<T>::RunOnDevice() {
       data_desc_,
       dX->template mutable_data<T>(),
       bn_param_desc_,
-      scale.template data<T>(),
-      dScale->template mutable_data<T>(),
-      dBias->template mutable_data<T>(),
+      scale.template data<BNParamType>(),
+      dScale->template mutable_data<BNParamType>(),
+      dBias->template mutable_data<BNParamType>(),
       epsilon_,
       saved_mean_data,
       saved_var_data));
@@ -265,5 +268,15 @@ REGISTER_CUDA_OPERATOR(SpatialBNGradient, CudnnSpatialBNGradientOp<float>);
 
 REGISTER_CUDNN_OPERATOR(SpatialBN, CudnnSpatialBNOp<float>);
 REGISTER_CUDNN_OPERATOR(SpatialBNGradient, CudnnSpatialBNGradientOp<float>);
+
+// Half data with float scale, bias and statistics, as cuDNN wants them.
+REGISTER_CUDA_OPERATOR(SpatialBNFp16, CudnnSpatialBNOp<float16>);
+REGISTER_CUDA_OPERATOR(
+    SpatialBNFp16Gradient,
+    CudnnSpatialBNGradientOp<float16>);
+REGISTER_CUDNN_OPERATOR(SpatialBNFp16, CudnnSpatialBNOp<float16>);
+REGISTER_CUDNN_OPERATOR(
+    SpatialBNFp16Gradient,
+    CudnnSpatialBNGradientOp<float16>);
 }  // namespace
 }  // namespace caffe2
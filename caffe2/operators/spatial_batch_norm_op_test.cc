@@ -0,0 +1,139 @@
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    float offset,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = offset + value(*gen);
+  }
+}
+
+const float* Data(Workspace* ws, const string& name) {
+  return ws->GetBlob(name)->Get<TensorCPU>().data<float>();
+}
+
+// The index in X of value i of channel c, in the given order.
+int Index(StorageOrder order, int N, int C, int HxW, int c, int i) {
+  const int n = i / HxW;
+  const int hw = i % HxW;
+  return order == StorageOrder::NCHW ? (n * C + c) * HxW + hw
+                                     : (n * HxW + hw) * C + c;
+}
+
+} // namespace
+
+// The forward and backward passes of training match a direct computation in
+// double, in both orders and for sizes that run on several threads. The
+// offset of the input checks that the variance does not suffer from
+// cancellation.
+TEST(SpatialBNTest, TrainingMatchesReference) {
+  std::mt19937 gen(0);
+  const float epsilon = 1e-5;
+  for (auto order : {StorageOrder::NCHW, StorageOrder::NHWC}) {
+    for (const auto& shape :
+         vector<vector<int>>{{2, 3, 5, 7}, {8, 16, 32, 32}}) {
+      const int N = shape[0];
+      const int C = shape[1];
+      const int HxW = shape[2] * shape[3];
+      const int M = N * HxW;
+      const vector<TIndex> dims = order == StorageOrder::NCHW
+          ? vector<TIndex>{N, C, shape[2], shape[3]}
+          : vector<TIndex>{N, shape[2], shape[3], C};
+      Workspace ws;
+      AddRandomTensor(&ws, "X", dims, 100, &gen);
+      AddRandomTensor(&ws, "dY", dims, 0, &gen);
+      AddRandomTensor(&ws, "scale", {C}, 0, &gen);
+      AddRandomTensor(&ws, "bias", {C}, 0, &gen);
+      AddRandomTensor(&ws, "running_mean", {C}, 0, &gen);
+      AddRandomTensor(&ws, "running_var", {C}, 1, &gen);
+
+      OperatorDef def;
+      def.set_type("SpatialBN");
+      for (const char* input :
+           {"X", "scale", "bias", "running_mean", "running_var"}) {
+        def.add_input(input);
+      }
+      for (const char* output :
+           {"Y",
+            "running_mean",
+            "running_var",
+            "saved_mean",
+            "saved_inv_std"}) {
+        def.add_output(output);
+      }
+      AddArgument<string>(
+          "order", order == StorageOrder::NCHW ? "NCHW" : "NHWC", &def);
+      AddArgument<float>("epsilon", epsilon, &def);
+      ASSERT_TRUE(ws.RunOperatorOnce(def));
+
+      OperatorDef grad_def;
+      grad_def.set_type("SpatialBNGradient");
+      for (const char* input :
+           {"X", "scale", "dY", "saved_mean", "saved_inv_std"}) {
+        grad_def.add_input(input);
+      }
+      for (const char* output : {"dX", "dscale", "dbias"}) {
+        grad_def.add_output(output);
+      }
+      AddArgument<string>(
+          "order", order == StorageOrder::NCHW ? "NCHW" : "NHWC", &grad_def);
+      ASSERT_TRUE(ws.RunOperatorOnce(grad_def));
+
+      const float* X = Data(&ws, "X");
+      const float* dY = Data(&ws, "dY");
+      const float* scale = Data(&ws, "scale");
+      const float* bias = Data(&ws, "bias");
+      for (int c = 0; c < C; ++c) {
+        double mean = 0;
+        for (int i = 0; i < M; ++i) {
+          mean += X[Index(order, N, C, HxW, c, i)];
+        }
+        mean /= M;
+        double var = 0;
+        for (int i = 0; i < M; ++i) {
+          const double d = X[Index(order, N, C, HxW, c, i)] - mean;
+          var += d * d;
+        }
+        var /= M;
+        const double inv_std = 1 / std::sqrt(var + epsilon);
+        EXPECT_NEAR(Data(&ws, "saved_mean")[c], mean, 1e-4);
+        EXPECT_NEAR(Data(&ws, "saved_inv_std")[c], inv_std, 1e-3 * inv_std);
+
+        double dBias = 0;
+        double dScale = 0;
+        for (int i = 0; i < M; ++i) {
+          const int j = Index(order, N, C, HxW, c, i);
+          const double x_hat = (X[j] - mean) * inv_std;
+          EXPECT_NEAR(Data(&ws, "Y")[j], x_hat * scale[c] + bias[c], 1e-3);
+          dBias += dY[j];
+          dScale += x_hat * dY[j];
+        }
+        EXPECT_NEAR(Data(&ws, "dbias")[c], dBias, 1e-3 * std::sqrt(M));
+        EXPECT_NEAR(Data(&ws, "dscale")[c], dScale, 1e-3 * std::sqrt(M));
+        for (int i = 0; i < M; ++i) {
+          const int j = Index(order, N, C, HxW, c, i);
+          const double x_hat = (X[j] - mean) * inv_std;
+          const double dX = scale[c] * inv_std / M *
+              (M * dY[j] - dBias - x_hat * dScale);
+          EXPECT_NEAR(Data(&ws, "dX")[j], dX, 1e-3);
+        }
+      }
+    }
+  }
+}
+
+} // namespace caffe2
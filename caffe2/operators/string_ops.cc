@@ -35,9 +35,8 @@ namespace {
 struct StartsWith {
   explicit StartsWith(OperatorBase& op)
       : prefix_(op.GetSingleArgument<std::string>("prefix", "")) {}
-  bool operator()(const std::string& str) {
-    return std::mismatch(prefix_.begin(), prefix_.end(), str.begin()).first ==
-        prefix_.end();
+  bool operator()(StringView str) {
+    return str.starts_with(prefix_);
   }
 
  private:
@@ -47,9 +46,8 @@ struct StartsWith {
 struct EndsWith {
   explicit EndsWith(OperatorBase& op)
       : suffix_(op.GetSingleArgument<std::string>("suffix", "")) {}
-  bool operator()(const std::string& str) {
-    return std::mismatch(suffix_.rbegin(), suffix_.rend(), str.rbegin())
-               .first == suffix_.rend();
+  bool operator()(StringView str) {
+    return str.ends_with(suffix_);
   }
 
  private:
@@ -59,8 +57,8 @@ struct EndsWith {
 struct Prefix {
   explicit Prefix(OperatorBase& op)
       : length_(op.GetSingleArgument<int>("length", 3)) {}
-  std::string operator()(const std::string& str) {
-    return std::string(str.begin(), std::min(str.end(), str.begin() + length_));
+  StringView operator()(StringView str) {
+    return str.prefix(length_);
   }
 
  private:
@@ -70,20 +68,33 @@ struct Prefix {
 struct Suffix {
   explicit Suffix(OperatorBase& op)
       : length_(op.GetSingleArgument<int>("length", 3)) {}
-  std::string operator()(const std::string& str) {
-    return std::string(std::max(str.begin(), str.end() - length_), str.end());
+  StringView operator()(StringView str) {
+    return str.suffix(length_);
   }
 
  private:
   int length_;
 };
 
-template <typename ScalarFunctor, typename TypeMap = FixedType<std::string>>
-using StringElementwiseOp = UnaryElementwiseWithArgsOp<
-    TensorTypes<std::string>,
-    CPUContext,
-    ForEach<ScalarFunctor>,
-    TypeMap>;
+class PackStringsOp final : public Operator<CPUContext> {
+ public:
+  using Operator<CPUContext>::Operator;
+
+  bool RunOnDevice() override {
+    OperatorBase::Output<PackedStrings>(0)->CopyFrom(Input(0));
+    return true;
+  }
+};
+
+class UnpackStringsOp final : public Operator<CPUContext> {
+ public:
+  using Operator<CPUContext>::Operator;
+
+  bool RunOnDevice() override {
+    OperatorBase::Input<PackedStrings>(0).CopyTo(Output(0));
+    return true;
+  }
+};
 
 REGISTER_CPU_OPERATOR(StringPrefix, StringElementwiseOp<Prefix>);
 REGISTER_CPU_OPERATOR(StringSuffix, StringElementwiseOp<Suffix>);
@@ -94,6 +105,8 @@ REGISTER_CPU_OPERATOR(
     StringEndsWith,
     StringElementwiseOp<EndsWith, FixedType<bool>>);
 REGISTER_CPU_OPERATOR(StringJoin, StringJoinOp<CPUContext>);
+REGISTER_CPU_OPERATOR(PackStrings, PackStringsOp);
+REGISTER_CPU_OPERATOR(UnpackStrings, UnpackStringsOp);
 
 OPERATOR_SCHEMA(StringPrefix)
     .NumInputs(1)
@@ -105,11 +118,12 @@ NOTE: Prefix is computed on number of bytes, which may lead to wrong behavior
 and potentially invalid strings for variable-length encodings such as utf-8.
 )DOC")
     .Arg("length", "Maximum size of the prefix, in bytes.")
-    .Input(0, "strings", "Tensor of std::string.")
+    .Input(0, "strings", "Tensor of std::string, or PackedStrings.")
     .Output(
         0,
         "prefixes",
-        "Tensor of std::string containing prefixes for each input.");
+        "Tensor of std::string containing prefixes for each input, or "
+        "PackedStrings if the input is.");
 
 OPERATOR_SCHEMA(StringSuffix)
     .NumInputs(1)
@@ -120,11 +134,12 @@ Input strings that are shorter than suffix length will be returned unchanged.
 NOTE: Prefix is computed on number of bytes, which may lead to wrong behavior
 and potentially invalid strings for variable-length encodings such as utf-8.
 )DOC")
-    .Input(0, "strings", "Tensor of std::string.")
+    .Input(0, "strings", "Tensor of std::string, or PackedStrings.")
     .Output(
         0,
         "suffixes",
-        "Tensor of std::string containing suffixes for each output.")
+        "Tensor of std::string containing suffixes for each output, or "
+        "PackedStrings if the input is.")
     .Arg("length", "Maximum size of the suffix, in bytes.");
 
 OPERATOR_SCHEMA(StringStartsWith)
@@ -135,7 +150,7 @@ Performs the starts-with check on each string in the input tensor.
 Returns tensor of boolean of the same dimension of input.
 )DOC")
     .Arg("prefix", "The prefix to check input strings against.")
-    .Input(0, "strings", "Tensor of std::string.")
+    .Input(0, "strings", "Tensor of std::string, or PackedStrings.")
     .Output(0, "bools", "Tensor of bools of same shape as input.");
 
 OPERATOR_SCHEMA(StringEndsWith)
@@ -146,7 +161,7 @@ Performs the ends-with check on each string in the input tensor.
 Returns tensor of boolean of the same dimension of input.
 )DOC")
     .Arg("suffix", "The suffix to check input strings against.")
-    .Input(0, "strings", "Tensor of std::string.")
+    .Input(0, "strings", "Tensor of std::string, or PackedStrings.")
     .Output(0, "bools", "Tensor of bools of same shape as input.");
 
 OPERATOR_SCHEMA(StringJoin)
@@ -167,10 +182,33 @@ element is treated as a row.
         "1-D tensor of strings created by joining row elements from the "
         "input tensor.");
 
+OPERATOR_SCHEMA(PackStrings)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Copies a tensor of std::string into PackedStrings of the same shape, which keep
+the bytes of all of the strings in a single buffer. The string ops, IndexGet
+and IndexLoad accept PackedStrings directly.
+)DOC")
+    .Input(0, "strings", "Tensor of std::string.")
+    .Output(0, "packed", "PackedStrings with the same strings.");
+
+OPERATOR_SCHEMA(UnpackStrings)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Copies PackedStrings into a tensor of std::string of the same shape, e.g. to
+fetch them from Python.
+)DOC")
+    .Input(0, "packed", "PackedStrings.")
+    .Output(0, "strings", "Tensor of std::string with the same strings.");
+
 SHOULD_NOT_DO_GRADIENT(StringPrefix);
 SHOULD_NOT_DO_GRADIENT(StringSuffix);
 SHOULD_NOT_DO_GRADIENT(StringStartsWith);
 SHOULD_NOT_DO_GRADIENT(StringEndsWith);
 SHOULD_NOT_DO_GRADIENT(StringJoin);
+SHOULD_NOT_DO_GRADIENT(PackStrings);
+SHOULD_NOT_DO_GRADIENT(UnpackStrings);
 }
 } // namespace caffe2
@@ -2,6 +2,7 @@
 #define CAFFE2_OPERATORS_STRING_OPS_H_
 
 #include "caffe2/core/operator.h"
+#include "caffe2/core/packed_strings.h"
 #include "caffe2/operators/elementwise_op.h"
 
 namespace caffe2 {
@@ -27,12 +28,72 @@ struct ForEach {
   Functor functor;
 };
 
+/**
+ * StringElementwiseOp applies ScalarFunctor, which takes a StringView and
+ * returns a StringView or a value of type TypeMap::type<std::string>, to each
+ * element of a tensor of strings, either a Tensor<std::string> or
+ * PackedStrings. The output is a tensor of the same shape, of strings packed
+ * the same way as the input's, or of the values.
+ */
 template <typename ScalarFunctor, typename TypeMap = FixedType<std::string>>
-using StringElementwiseOp = UnaryElementwiseWithArgsOp<
-    TensorTypes<std::string>,
-    CPUContext,
-    ForEach<ScalarFunctor>,
-    TypeMap>;
+class StringElementwiseOp final : public Operator<CPUContext> {
+ public:
+  using OutputType = typename TypeMap::template type<std::string>;
+
+  StringElementwiseOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws), functor_(*this) {}
+
+  bool RunOnDevice() override {
+    if (OperatorBase::InputIsType<PackedStrings>(0)) {
+      RunOnPacked(
+          OperatorBase::Input<PackedStrings>(0),
+          static_cast<OutputType*>(nullptr));
+      return true;
+    }
+    const auto& input = Input(0);
+    auto* output = Output(0);
+    output->ResizeLike(input);
+    const auto* in = input.data<std::string>();
+    auto* out = output->template mutable_data<OutputType>();
+    for (TIndex i = 0; i < input.size(); ++i) {
+      Assign(functor_(in[i]), &out[i]);
+    }
+    return true;
+  }
+
+ private:
+  void RunOnPacked(const PackedStrings& input, std::string* /* unused */) {
+    auto* output = OperatorBase::Output<PackedStrings>(0);
+    CAFFE_ENFORCE(
+        output != &input, "Packed strings cannot be transformed in place.");
+    output->Clear();
+    output->Reserve(input.size(), input.nbytes());
+    for (TIndex i = 0; i < input.size(); ++i) {
+      output->Append(functor_(input[i]));
+    }
+    output->Reshape(input.dims());
+  }
+
+  template <typename T>
+  void RunOnPacked(const PackedStrings& input, T* /* unused */) {
+    auto* output = Output(0);
+    output->Resize(input.dims());
+    auto* out = output->template mutable_data<T>();
+    for (TIndex i = 0; i < input.size(); ++i) {
+      out[i] = functor_(input[i]);
+    }
+  }
+
+  static void Assign(StringView from, std::string* to) {
+    to->assign(from.data(), from.size());
+  }
+  template <typename T>
+  static void Assign(const T& from, T* to) {
+    *to = from;
+  }
+
+  ScalarFunctor functor_;
+};
 
 template <class Context>
 class StringJoinOp final : public Operator<Context> {
@@ -97,4 +97,82 @@ TEST_F(StringJoinOpTest, testLong2DJoin) {
   EXPECT_EQ(outputData[0], "100,200,");
   EXPECT_EQ(outputData[1], "1000,2000,");
 }
+
+class StringElementwiseOpTest : public testing::Test {
+ protected:
+  void FeedStrings(const std::vector<std::string>& strings) {
+    auto* tensor = ws_.CreateBlob("X")->GetMutable<TensorCPU>();
+    tensor->Resize(2, strings.size() / 2);
+    std::copy(
+        strings.begin(), strings.end(), tensor->mutable_data<std::string>());
+  }
+
+  void RunOp(
+      const std::string& type,
+      const std::string& input,
+      const std::string& output,
+      const std::string& arg_name = "",
+      const std::string& arg_value = "") {
+    OperatorDef def;
+    def.set_type(type);
+    def.add_input(input);
+    def.add_output(output);
+    if (!arg_name.empty()) {
+      auto* arg = def.add_arg();
+      arg->set_name(arg_name);
+      if (arg_name == "length") {
+        arg->set_i(std::stoi(arg_value));
+      } else {
+        arg->set_s(arg_value);
+      }
+    }
+    ASSERT_TRUE(ws_.RunOperatorOnce(def));
+  }
+
+  Workspace ws_;
+};
+
+TEST_F(StringElementwiseOpTest, PackedMatchesUnpacked) {
+  FeedStrings({"apple", "", "banana", "ap"});
+  RunOp("PackStrings", "X", "P");
+  const auto& packed = ws_.GetBlob("P")->Get<PackedStrings>();
+  EXPECT_EQ(packed.dims(), (std::vector<TIndex>{2, 2}));
+  EXPECT_EQ(packed.nbytes(), 13);
+  EXPECT_EQ(packed[2].ToString(), "banana");
+  EXPECT_TRUE(packed[1].empty());
+
+  RunOp("StringPrefix", "X", "Y", "length", "3");
+  RunOp("StringPrefix", "P", "PY", "length", "3");
+  EXPECT_TRUE(ws_.GetBlob("PY")->IsType<PackedStrings>());
+  RunOp("UnpackStrings", "PY", "UY");
+  const auto& y = ws_.GetBlob("Y")->Get<TensorCPU>();
+  const auto& uy = ws_.GetBlob("UY")->Get<TensorCPU>();
+  EXPECT_EQ(uy.dims(), y.dims());
+  const std::vector<std::string> prefixes = {"app", "", "ban", "ap"};
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(y.data<std::string>()[i], prefixes[i]);
+    EXPECT_EQ(uy.data<std::string>()[i], prefixes[i]);
+  }
+
+  RunOp("StringSuffix", "P", "PS", "length", "2");
+  const auto& suffixes = ws_.GetBlob("PS")->Get<PackedStrings>();
+  EXPECT_EQ(suffixes[0].ToString(), "le");
+  EXPECT_EQ(suffixes[3].ToString(), "ap");
+
+  RunOp("StringStartsWith", "X", "B", "prefix", "app");
+  RunOp("StringStartsWith", "P", "PB", "prefix", "app");
+  const auto& b = ws_.GetBlob("B")->Get<TensorCPU>();
+  const auto& pb = ws_.GetBlob("PB")->Get<TensorCPU>();
+  EXPECT_EQ(pb.dims(), b.dims());
+  const std::vector<bool> starts = {true, false, false, false};
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(b.data<bool>()[i], starts[i]);
+    EXPECT_EQ(pb.data<bool>()[i], starts[i]);
+  }
+
+  RunOp("StringEndsWith", "P", "PE", "suffix", "na");
+  const auto& pe = ws_.GetBlob("PE")->Get<TensorCPU>();
+  EXPECT_FALSE(pe.data<bool>()[0]);
+  EXPECT_TRUE(pe.data<bool>()[2]);
+}
 }
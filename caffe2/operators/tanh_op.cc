@@ -12,8 +12,7 @@ struct TanhCPUFunctor {
 #ifdef CAFFE2_USE_ACCELERATE
     vvtanhf(y, x, &n);
 #else
-    ConstEigenVectorArrayMap<T> x_arr(x, n);
-    EigenVectorMap<T>(y, n) = 1 - 2 * ((x_arr * 2).exp() + 1).inverse();
+    math::Tanh<T, CPUContext>(n, x, y, device_context);
 #endif
   }
 };
@@ -43,6 +42,7 @@ OPERATOR_SCHEMA(Tanh)
   .NumOutputs(1)
   .AllowInplace({{0, 0}})
   .IdenticalTypeAndShape()
+  .CostInferenceFunction(PointwiseCostInference<4>)
   .SetDoc(R"DOC(
 Calculates the hyperbolic tangent of the given input tensor element-wise. This
 operation can be done in an in-place fashion too, by providing the same input
@@ -16,10 +16,23 @@ input to the operator and it returns as many output tensors as the size of the
 TensorProtos object. Each output will simply be a tensor containing a batch of
 data with size specified by the 'batch_size' argument containing data from the
 corresponding index in the TensorProtos objects in the DB.
+
+For datasets that do not fit in memory, which SortAndShuffle and
+ReadRandomBatch cannot shuffle, shuffle_window shuffles the records while
+still reading the db sequentially. The records are read in windows of that many
+records and each window is shuffled in memory. Once the first pass over the db
+has found where the windows start, every pass visits the windows in a new
+random order, if the reader has a single cursor and its db supports seeking.
+Memory is bounded by one window of serialized records.
 )DOC")
   .Arg("batch_size", "(int, default 0) the number of samples in a batch. The "
        "default value of 0 means that the operator will attempt to insert the "
        "entire data in a single output blob.")
+  .Arg("shuffle_window", "(int, default 0) if positive, the number of records "
+       "of the windows that the records are shuffled in, as described above. "
+       "Needs a batch_size.")
+  .Arg("prefetch_depth", "(int, default 1) the number of batches to prefetch "
+       "ahead of the consumer.")
   .Input(0, "data", "A pre-initialized DB reader. Typically, this is obtained "
          "by calling CreateDB operator with a db_name and a db_type. The "
          "resulting output blob is a DB Reader tensor")
@@ -1,8 +1,11 @@
 #ifndef CAFFE2_OPERATORS_TENSOR_PROTOS_DB_INPUT_H_
 #define CAFFE2_OPERATORS_TENSOR_PROTOS_DB_INPUT_H_
 
+#include <algorithm>
 #include <iostream>
 #include <mutex>
+#include <numeric>
+#include <random>
 
 #include "caffe2/core/db.h"
 #include "caffe2/operators/prefetch_op.h"
@@ -23,12 +26,48 @@ class TensorProtosDBInput final : public PrefetchOperator<Context> {
   bool CopyPrefetched() override;
 
  private:
+  // The batches are allocated from pinned memory when they are copied to a
+  // GPU, so that the copy does not need to be staged.
+  void* MutablePrefetchedData(TensorCPU* tensor, const TypeMeta& meta) {
+    if (std::is_same<Context, CPUContext>::value) {
+      return tensor->raw_mutable_data(meta);
+    }
+    return PinnedRawMutableData(tensor, meta);
+  }
+
+  // Reads the records of the next batch into values_: the next ones of the
+  // db, or of the shuffled window.
+  void ReadBatchValues(const db::DBReader& reader);
+  // Reads the next window of records into window_ and shuffles it.
+  void ReadWindow(const db::DBReader& reader);
+
   // Prefetch will always just happen on the CPU side.
   vector<Blob> prefetched_blobs_;
   int batch_size_;
   bool shape_inferred_ = false;
   string key_;
   string value_;
+  vector<string> values_;
+  // Parsing a record into the message of the previous one reuses the memory
+  // of its fields, instead of allocating them again for every record.
+  TensorProtos protos_;
+
+  // Block shuffling, with shuffle_window_ > 0. If the reader can seek, the
+  // first pass over the db reads it in windows of shuffle_window_ records and
+  // learns the first key and size of every window, until the reader wraps
+  // around to the first key. After that, each pass visits the windows in a
+  // new random order. Otherwise, the windows stay in the order of the db.
+  int shuffle_window_;
+  std::mt19937 rng_;
+  vector<string> window_;
+  vector<string> window_keys_;
+  size_t window_pos_ = 0;
+  bool learning_windows_ = true;
+  bool shuffle_windows_ = false;
+  vector<string> window_first_keys_;
+  vector<int> window_sizes_;
+  vector<int> window_order_;
+  size_t next_window_ = 0;
 };
 
 template <class Context>
@@ -38,7 +77,82 @@ TensorProtosDBInput<Context>::TensorProtosDBInput(
     : PrefetchOperator<Context>(operator_def, ws),
       prefetched_blobs_(operator_def.output_size()),
       batch_size_(
-          OperatorBase::template GetSingleArgument<int>("batch_size", 0)) {}
+          OperatorBase::template GetSingleArgument<int>("batch_size", 0)),
+      shuffle_window_(
+          OperatorBase::template GetSingleArgument<int>("shuffle_window", 0)),
+      rng_(
+          operator_def.device_option().has_random_seed()
+              ? operator_def.device_option().random_seed()
+              : math::randomNumberSeed()) {
+  CAFFE_ENFORCE_GE(shuffle_window_, 0);
+  CAFFE_ENFORCE(
+      shuffle_window_ == 0 || batch_size_ > 0,
+      "shuffle_window needs a batch_size.");
+}
+
+template <class Context>
+void TensorProtosDBInput<Context>::ReadBatchValues(
+    const db::DBReader& reader) {
+  if (shuffle_window_ == 0) {
+    // The whole batch is read at once, which only locks the reader once.
+    reader.ReadBatch(batch_size_, nullptr, &values_);
+    return;
+  }
+  values_.resize(batch_size_);
+  for (auto& value : values_) {
+    if (window_pos_ == window_.size()) {
+      ReadWindow(reader);
+    }
+    value.swap(window_[window_pos_++]);
+  }
+}
+
+template <class Context>
+void TensorProtosDBInput<Context>::ReadWindow(const db::DBReader& reader) {
+  if (learning_windows_ &&
+      (reader.num_cursors() > 1 || !reader.SupportsSeek())) {
+    // Only seeking can change the order of the windows.
+    learning_windows_ = false;
+  }
+  if (shuffle_windows_) {
+    if (next_window_ == window_order_.size()) {
+      std::shuffle(window_order_.begin(), window_order_.end(), rng_);
+      next_window_ = 0;
+    }
+    const int window = window_order_[next_window_++];
+    // Only the seek is random: the records of a window are read in order.
+    reader.Seek(window_first_keys_[window]);
+    reader.ReadBatch(window_sizes_[window], nullptr, &window_);
+  } else if (learning_windows_) {
+    reader.ReadBatch(shuffle_window_, &window_keys_, &window_);
+    // The window that wraps around ends before the first key, which is
+    // searched from the second record on in the first window.
+    const bool first = window_first_keys_.empty();
+    const string first_key = first ? window_keys_[0] : window_first_keys_[0];
+    const int size = std::find(
+                         window_keys_.begin() + (first ? 1 : 0),
+                         window_keys_.end(),
+                         first_key) -
+        window_keys_.begin();
+    if (size > 0) {
+      window_first_keys_.push_back(window_keys_[0]);
+      window_sizes_.push_back(size);
+      window_.resize(size);
+    }
+    if (size < shuffle_window_) {
+      learning_windows_ = false;
+      shuffle_windows_ = true;
+      window_order_.resize(window_sizes_.size());
+      std::iota(window_order_.begin(), window_order_.end(), 0);
+      next_window_ = window_order_.size();
+    }
+  } else {
+    // The windows stay in the order of the db.
+    reader.ReadBatch(shuffle_window_, nullptr, &window_);
+  }
+  std::shuffle(window_.begin(), window_.end(), rng_);
+  window_pos_ = 0;
+}
 
 template <class Context>
 bool TensorProtosDBInput<Context>::Prefetch() {
@@ -48,47 +162,55 @@ bool TensorProtosDBInput<Context>::Prefetch() {
     // We do not need to construct a batch. As a result, we will simply
     // deserialize everything into the target prefetched blob.
     reader.Read(&key_, &value_);
-    TensorProtos protos;
-    CAFFE_ENFORCE(protos.ParseFromString(value_));
-    CAFFE_ENFORCE(protos.protos_size() == OutputSize());
-    for (int i = 0; i < protos.protos_size(); ++i) {
-      if (protos.protos(i).has_device_detail()) {
-        protos.mutable_protos(i)->clear_device_detail();
+    CAFFE_ENFORCE(protos_.ParseFromString(value_));
+    CAFFE_ENFORCE(protos_.protos_size() == OutputSize());
+    for (int i = 0; i < protos_.protos_size(); ++i) {
+      if (protos_.protos(i).has_device_detail()) {
+        protos_.mutable_protos(i)->clear_device_detail();
       }
       deserializer.Deserialize(
-          protos.protos(i),
+          protos_.protos(i),
           prefetched_blobs_[i].template GetMutable<TensorCPU>());
     }
   } else {
     vector<TensorCPU> temp_tensors(OutputSize());
+    ReadBatchValues(reader);
     for (int item_id = 0; item_id < batch_size_; ++item_id) {
-      reader.Read(&key_, &value_);
-      TensorProtos protos;
-      CAFFE_ENFORCE(protos.ParseFromString(value_));
-      CAFFE_ENFORCE(protos.protos_size() == OutputSize());
+      CAFFE_ENFORCE(protos_.ParseFromString(values_[item_id]));
+      CAFFE_ENFORCE(protos_.protos_size() == OutputSize());
       if (!shape_inferred_) {
         // First, set the shape of all the blobs.
-        for (int i = 0; i < protos.protos_size(); ++i) {
+        for (int i = 0; i < protos_.protos_size(); ++i) {
           vector<int> dims(
-              protos.protos(i).dims().begin(), protos.protos(i).dims().end());
+              protos_.protos(i).dims().begin(), protos_.protos(i).dims().end());
           dims.insert(dims.begin(), batch_size_);
           prefetched_blobs_[i].template GetMutable<TensorCPU>()->Resize(dims);
         }
       }
-      for (int i = 0; i < protos.protos_size(); ++i) {
+      for (int i = 0; i < protos_.protos_size(); ++i) {
         TensorCPU* dst = prefetched_blobs_[i].template GetMutable<TensorCPU>();
         TensorCPU& src = temp_tensors[i];
-        if (protos.protos(i).has_device_detail()) {
-          protos.mutable_protos(i)->clear_device_detail();
+        if (protos_.protos(i).has_device_detail()) {
+          protos_.mutable_protos(i)->clear_device_detail();
+        }
+        const TensorProto& proto = protos_.protos(i);
+        const TypeMeta& meta = DataTypeToTypeMeta(proto.data_type());
+        char* item = static_cast<char*>(MutablePrefetchedData(dst, meta)) +
+            dst->nbytes() / batch_size_ * item_id;
+        if (!meta.ctor() && dst->size() > 0) {
+          // Fundamental types are deserialized in place, into the item of the
+          // batch, rather than into src and then copied.
+          src.Resize(dst->size() / batch_size_);
+          src.ShareExternalPointer(item, meta);
+          deserializer.Deserialize(proto, &src);
+          // Deserializing a record of the size of the item keeps it there.
+          CAFFE_ENFORCE_EQ(src.size() * batch_size_, dst->size());
+        } else {
+          deserializer.Deserialize(proto, &src);
+          CAFFE_ENFORCE_EQ(src.size() * batch_size_, dst->size());
+          this->context_.template CopyItems<CPUContext, CPUContext>(
+              src.meta(), src.size(), src.raw_data(), item);
         }
-        deserializer.Deserialize(protos.protos(i), &src);
-        DCHECK_EQ(src.size() * batch_size_, dst->size());
-        this->context_.template CopyItems<CPUContext, CPUContext>(
-            src.meta(),
-            src.size(),
-            src.raw_data(),
-            static_cast<char*>(dst->raw_mutable_data(src.meta())) +
-                src.nbytes() * item_id);
       }
     }
   }
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <numeric>
+#include <sstream>
+
+#include "caffe2/core/db.h"
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+const int kNumRecords = 100;
+const int kBatchSize = 10;
+const int kWindow = 32;
+
+// An in memory db of the records 0, 1, ..., kNumRecords - 1, which supports
+// seeking unless its source is "sequential".
+std::map<string, string>* Records() {
+  static std::map<string, string> records = [] {
+    std::map<string, string> records;
+    for (int i = 0; i < kNumRecords; ++i) {
+      TensorProtos protos;
+      auto* proto = protos.add_protos();
+      proto->set_data_type(TensorProto::INT32);
+      proto->add_dims(1);
+      proto->add_int32_data(i);
+      std::stringstream key;
+      key << std::setw(3) << std::setfill('0') << i;
+      records[key.str()] = protos.SerializeAsString();
+    }
+    return records;
+  }();
+  return &records;
+}
+
+} // namespace
+
+namespace db {
+namespace {
+
+class ShuffleTestCursor : public Cursor {
+ public:
+  explicit ShuffleTestCursor(bool seekable)
+      : seekable_(seekable), iter_(Records()->begin()) {}
+  void Seek(const string& key) override {
+    iter_ = Records()->lower_bound(key);
+  }
+  bool SupportsSeek() override {
+    return seekable_;
+  }
+  void SeekToFirst() override {
+    iter_ = Records()->begin();
+  }
+  void Next() override {
+    ++iter_;
+  }
+  string key() override {
+    return iter_->first;
+  }
+  string value() override {
+    return iter_->second;
+  }
+  bool Valid() override {
+    return iter_ != Records()->end();
+  }
+
+ private:
+  const bool seekable_;
+  std::map<string, string>::const_iterator iter_;
+};
+
+class ShuffleTestDB : public DB {
+ public:
+  ShuffleTestDB(const string& source, Mode mode)
+      : DB(source, mode), seekable_(source != "sequential") {}
+  void Close() override {}
+  unique_ptr<Cursor> NewCursor() override {
+    return make_unique<ShuffleTestCursor>(seekable_);
+  }
+  unique_ptr<Transaction> NewTransaction() override {
+    CAFFE_THROW("Read only.");
+  }
+
+ private:
+  const bool seekable_;
+};
+REGISTER_CAFFE2_DB(shuffle_test_db, ShuffleTestDB);
+
+} // namespace
+} // namespace db
+
+namespace {
+
+// The records of num_batches batches of a shuffled read of the db.
+vector<int> ReadShuffled(const string& source, int num_batches) {
+  Workspace ws;
+  ws.CreateBlob("reader")->Reset(
+      new db::DBReader("shuffle_test_db", source));
+  OperatorDef def;
+  def.set_type("TensorProtosDBInput");
+  def.add_input("reader");
+  def.add_output("data");
+  def.mutable_device_option()->set_random_seed(1);
+  AddArgument<int>("batch_size", kBatchSize, &def);
+  AddArgument<int>("shuffle_window", kWindow, &def);
+  unique_ptr<OperatorBase> op(CreateOperator(def, &ws));
+  vector<int> records;
+  for (int i = 0; i < num_batches; ++i) {
+    EXPECT_TRUE(op->Run());
+    const auto& data = ws.GetBlob("data")->Get<TensorCPU>();
+    EXPECT_EQ(data.size(), kBatchSize);
+    records.insert(
+        records.end(), data.data<int>(), data.data<int>() + kBatchSize);
+  }
+  return records;
+}
+
+// The windows of kWindow records that the records of a pass come from, in
+// the order in which the pass visits them. A window is visited at once.
+vector<int> Windows(vector<int>::const_iterator begin) {
+  vector<int> sorted(begin, begin + kNumRecords), expected(kNumRecords);
+  std::sort(sorted.begin(), sorted.end());
+  std::iota(expected.begin(), expected.end(), 0);
+  EXPECT_EQ(sorted, expected);
+  vector<int> windows;
+  for (auto it = begin; it != begin + kNumRecords; ++it) {
+    if (windows.empty() || windows.back() != *it / kWindow) {
+      windows.push_back(*it / kWindow);
+    }
+  }
+  return windows;
+}
+
+} // namespace
+
+TEST(TensorProtosDBInputTest, ShufflesWindowsAndTheirOrder) {
+  const int num_passes = 6;
+  const auto records =
+      ReadShuffled("", num_passes * kNumRecords / kBatchSize);
+  // The records of each window are shuffled, which is not much of a chance
+  // to keep them in order.
+  EXPECT_FALSE(std::is_sorted(records.begin(), records.begin() + kWindow));
+  // The first pass reads the windows in order, and the next ones in random
+  // orders.
+  EXPECT_EQ(Windows(records.begin()), (vector<int>{0, 1, 2, 3}));
+  int shuffled = 0;
+  for (int pass = 1; pass < num_passes; ++pass) {
+    auto windows = Windows(records.begin() + pass * kNumRecords);
+    ASSERT_EQ(windows.size(), 4);
+    shuffled += !std::is_sorted(windows.begin(), windows.end());
+  }
+  EXPECT_GT(shuffled, 0);
+}
+
+TEST(TensorProtosDBInputTest, KeepsTheOrderOfWindowsWithoutSeeking) {
+  const int num_windows = 5;
+  const auto records =
+      ReadShuffled("sequential", num_windows * kWindow / kBatchSize);
+  // The windows keep wrapping around the db.
+  for (int window = 0; window < num_windows; ++window) {
+    vector<int> expected(kWindow);
+    for (int i = 0; i < kWindow; ++i) {
+      expected[i] = (window * kWindow + i) % kNumRecords;
+    }
+    vector<int> actual(
+        records.begin() + window * kWindow,
+        records.begin() + (window + 1) * kWindow);
+    std::sort(expected.begin(), expected.end());
+    std::sort(actual.begin(), actual.end());
+    EXPECT_EQ(actual, expected);
+  }
+}
+
+} // namespace caffe2
@@ -1,8 +1,10 @@
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/packed_strings.h"
 #include "caffe2/core/tensor.h"
 #include "caffe2/operators/text_file_reader_utils.h"
 #include "caffe2/utils/string_utils.h"
+#include "caffe2/utils/thread_pool.h"
 
 namespace caffe2 {
 
@@ -12,9 +14,13 @@ struct TextFileReaderInstance {
       char escape,
       const std::string& filename,
       int numPasses,
-      const std::vector<int>& types)
-      : fileReader(filename),
-        tokenizer(Tokenizer(delims, escape), &fileReader, numPasses),
+      const std::vector<int>& types,
+      int queueDepth,
+      bool useMmap)
+      : fileReader(
+            useMmap ? static_cast<StringProvider*>(new MmapFileReader(filename))
+                    : new FileReader(filename, 65536, queueDepth)),
+        tokenizer(Tokenizer(delims, escape), fileReader.get(), numPasses),
         fieldTypes(types) {
     for (const auto dt : fieldTypes) {
       fieldMetas.push_back(
@@ -23,7 +29,7 @@ struct TextFileReaderInstance {
     }
   }
 
-  FileReader fileReader;
+  std::unique_ptr<StringProvider> fileReader;
   BufferedTokenizer tokenizer;
   std::vector<int> fieldTypes;
   std::vector<TypeMeta> fieldMetas;
@@ -41,14 +47,22 @@ class CreateTextFileReaderOp : public Operator<CPUContext> {
       : Operator<CPUContext>(operator_def, ws),
         filename_(GetSingleArgument<string>("filename", "")),
         numPasses_(GetSingleArgument<int>("num_passes", 1)),
-        fieldTypes_(GetRepeatedArgument<int>("field_types")) {
+        fieldTypes_(GetRepeatedArgument<int>("field_types")),
+        queueDepth_(GetSingleArgument<int>("queue_depth", 0)),
+        useMmap_(GetSingleArgument<bool>("use_mmap", false)) {
     CAFFE_ENFORCE(fieldTypes_.size() > 0, "field_types arg must be non-empty");
   }
 
   bool RunOnDevice() override {
     *OperatorBase::Output<std::unique_ptr<TextFileReaderInstance>>(0) =
         std::unique_ptr<TextFileReaderInstance>(new TextFileReaderInstance(
-            {'\n', '\t'}, '\0', filename_, numPasses_, fieldTypes_));
+            {'\n', '\t'},
+            '\0',
+            filename_,
+            numPasses_,
+            fieldTypes_,
+            queueDepth_,
+            useMmap_));
     return true;
   }
 
@@ -56,8 +70,41 @@ class CreateTextFileReaderOp : public Operator<CPUContext> {
   std::string filename_;
   int numPasses_;
   std::vector<int> fieldTypes_;
+  int queueDepth_;
+  bool useMmap_;
 };
 
+// Parses the number in [src_start, src_end) with the given strto* function.
+// The field is copied to a null-terminated buffer on the stack, unless it is
+// too long for it.
+template <typename T, typename Parse>
+inline void parseNumber(
+    const char* type_name,
+    const char* src_start,
+    const char* src_end,
+    T* dst,
+    Parse parse) {
+  char buffer[64];
+  std::string long_copy;
+  const size_t size = src_end - src_start;
+  const char* src_copy = buffer;
+  if (size < sizeof(buffer)) {
+    memcpy(buffer, src_start, size);
+    buffer[size] = '\0';
+  } else {
+    long_copy.assign(src_start, src_end);
+    src_copy = long_copy.c_str();
+  }
+  char* src_copy_end;
+  const auto val = parse(src_copy, &src_copy_end);
+  if (src_copy == src_copy_end) {
+    throw std::runtime_error(
+        std::string("Invalid ") + type_name + ": " +
+        std::string(src_start, src_end));
+  }
+  *dst = val;
+}
+
 inline void convert(
     TensorProto_DataType dst_type,
     const char* src_start,
@@ -68,15 +115,32 @@ inline void convert(
       static_cast<std::string*>(dst)->assign(src_start, src_end);
     } break;
     case TensorProto_DataType_FLOAT: {
-      // TODO(azzolini): avoid copy, use faster convertion
-      std::string str_copy(src_start, src_end);
-      const char* src_copy = str_copy.c_str();
-      char* src_copy_end;
-      float val = strtof(src_copy, &src_copy_end);
-      if (src_copy == src_copy_end) {
-        throw std::runtime_error("Invalid float: " + str_copy);
-      }
-      *static_cast<float*>(dst) = val;
+      parseNumber(
+          "float", src_start, src_end, static_cast<float*>(dst), strtof);
+    } break;
+    case TensorProto_DataType_DOUBLE: {
+      parseNumber(
+          "double", src_start, src_end, static_cast<double*>(dst), strtod);
+    } break;
+    case TensorProto_DataType_INT32: {
+      parseNumber(
+          "int32",
+          src_start,
+          src_end,
+          static_cast<int32_t*>(dst),
+          [](const char* str, char** str_end) {
+            return static_cast<int32_t>(strtol(str, str_end, 10));
+          });
+    } break;
+    case TensorProto_DataType_INT64: {
+      parseNumber(
+          "int64",
+          src_start,
+          src_end,
+          static_cast<int64_t*>(dst),
+          [](const char* str, char** str_end) {
+            return static_cast<int64_t>(strtoll(str, str_end, 10));
+          });
     } break;
     default:
       throw std::runtime_error("Unsupported type.");
@@ -87,7 +151,14 @@ class TextFileReaderReadOp : public Operator<CPUContext> {
  public:
   TextFileReaderReadOp(const OperatorDef& operator_def, Workspace* ws)
       : Operator<CPUContext>(operator_def, ws),
-        batchSize_(GetSingleArgument<int>("batch_size", 1)) {}
+        batchSize_(GetSingleArgument<int>("batch_size", 1)),
+        numThreads_(GetSingleArgument<int>("num_threads", 1)),
+        packedStrings_(GetSingleArgument<bool>("packed_strings", false)) {
+    CAFFE_ENFORCE_GT(numThreads_, 0);
+    if (numThreads_ > 1) {
+      pool_.reset(new ThreadPool(numThreads_));
+    }
+  }
 
   bool RunOnDevice() override {
     const int numFields = OutputSize();
@@ -106,7 +177,16 @@ class TextFileReaderReadOp : public Operator<CPUContext> {
     // MSVC does not allow using const int, so we will need to dynamically allocate
     // it.
     std::vector<char*> datas(numFields);
+    // The string fields that are read into PackedStrings, or null. Their
+    // tokens are appended as they are read, in order, rather than converted.
+    std::vector<PackedStrings*> packed(numFields);
     for (int i = 0; i < numFields; ++i) {
+      if (packedStrings_ &&
+          instance->fieldTypes[i] == TensorProto_DataType_STRING) {
+        packed[i] = OperatorBase::Output<PackedStrings>(i);
+        packed[i]->Clear();
+        continue;
+      }
       Output(i)->Resize(batchSize_);
       datas[i] = (char*)Output(i)->raw_mutable_data(instance->fieldMetas[i]);
     }
@@ -116,11 +196,16 @@ class TextFileReaderReadOp : public Operator<CPUContext> {
       // TODO(azzolini): support multi-threaded reading
       std::lock_guard<std::mutex> guard(instance->globalMutex_);
 
+      pending_.clear();
       bool finished = false;
       Token token;
       while (!finished && (rowsRead < batchSize_)) {
         int field;
         for (field = 0; field < numFields; ++field) {
+          if (pool_ && instance->tokenizer.atChunkEnd()) {
+            // Convert the fields of the chunk before their tokens go away.
+            convertPending(instance);
+          }
           finished = !instance->tokenizer.next(token);
           if (finished) {
             CAFFE_ENFORCE(
@@ -132,30 +217,97 @@ class TextFileReaderReadOp : public Operator<CPUContext> {
                   (field > 0 && token.startDelimId == 1),
               "Invalid number of columns at row ",
               instance->rowsRead + rowsRead + 1);
-          const auto& meta = instance->fieldMetas[field];
           char*& data = datas[field];
-          convert(
-              (TensorProto_DataType)instance->fieldTypes[field],
-              token.start,
-              token.end,
-              data);
+          if (packed[field]) {
+            packed[field]->Append(token.start, token.end - token.start);
+            continue;
+          }
+          if (pool_) {
+            pending_.push_back({token, field, data});
+          } else {
+            convert(
+                (TensorProto_DataType)instance->fieldTypes[field],
+                token.start,
+                token.end,
+                data);
+          }
           data += instance->fieldByteSizes[field];
         }
         if (!finished) {
           ++rowsRead;
         }
       }
+      if (pool_) {
+        convertPending(instance);
+      }
       instance->rowsRead += rowsRead;
     }
 
     for (int i = 0; i < numFields; ++i) {
-      Output(i)->Shrink(rowsRead);
+      if (!packed[i]) {
+        Output(i)->Shrink(rowsRead);
+      }
     }
     return true;
   }
 
  private:
+  // A field read from the file, and where it should be converted to.
+  struct PendingField {
+    Token token;
+    int field;
+    char* data;
+  };
+
+  // Converts the pending fields, split in contiguous ranges across threads.
+  void convertPending(TextFileReaderInstance* instance) {
+    // Below this, waking up threads costs more than it saves.
+    const int kMinFieldsPerThread = 256;
+    const int numTasks = std::min<int>(
+        numThreads_, pending_.size() / kMinFieldsPerThread);
+    auto convertRange = [this, instance](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        const auto& pending = pending_[i];
+        convert(
+            (TensorProto_DataType)instance->fieldTypes[pending.field],
+            pending.token.start,
+            pending.token.end,
+            pending.data);
+      }
+    };
+    if (numTasks <= 1) {
+      convertRange(0, pending_.size());
+      pending_.clear();
+      return;
+    }
+    std::mutex errorMutex;
+    std::string error;
+    for (int t = 0; t < numTasks; ++t) {
+      const size_t begin = pending_.size() * t / numTasks;
+      const size_t end = pending_.size() * (t + 1) / numTasks;
+      pool_->runTask([&, begin, end]() {
+        try {
+          convertRange(begin, end);
+        } catch (const std::exception& e) {
+          std::lock_guard<std::mutex> guard(errorMutex);
+          if (error.empty()) {
+            error = e.what();
+          }
+        }
+      });
+    }
+    pool_->waitWorkComplete();
+    pending_.clear();
+    if (!error.empty()) {
+      throw std::runtime_error(error);
+    }
+  }
+
   TIndex batchSize_;
+  const int numThreads_;
+  const bool packedStrings_;
+  std::unique_ptr<ThreadPool> pool_;
+  std::vector<PendingField> pending_;
 };
 
 CAFFE_KNOWN_TYPE(std::unique_ptr<TextFileReaderInstance>);
@@ -171,7 +323,18 @@ OPERATOR_SCHEMA(CreateTextFileReader)
     .Arg("num_pases", "Number of passes over the file.")
     .Arg(
         "field_types",
-        "List with type of each field. Type enum is found at core.DataType.")
+        "List with type of each field. Type enum is found at core.DataType. "
+        "Supported types are STRING, FLOAT, DOUBLE, INT32 and INT64.")
+    .Arg(
+        "queue_depth",
+        "If positive, the number of 64KB reads of the file to keep in flight "
+        "ahead of the reader, in the background (default 0).")
+    .Arg(
+        "use_mmap",
+        "If set, map the file into memory and tokenize it in place, instead "
+        "of reading it into a buffer. Only the fields that straddle two 1MB "
+        "chunks of the file are copied before conversion. queue_depth does "
+        "not apply then.")
     .Output(0, "handler", "Pointer to the created TextFileReaderInstance.");
 
 OPERATOR_SCHEMA(TextFileReaderRead)
@@ -183,7 +346,16 @@ OPERATOR_SCHEMA(TextFileReaderRead)
         "Each output is a 1D tensor containing the values for the given field "
         "for each row. When end of file is reached, returns empty tensors.")
     .Input(0, "handler", "Pointer to an existing TextFileReaderInstance.")
-    .Arg("batch_size", "Maximum number of rows to read.");
+    .Arg("batch_size", "Maximum number of rows to read.")
+    .Arg(
+        "num_threads",
+        "Number of threads converting the fields read from each chunk of the "
+        "file to the outputs (default 1).")
+    .Arg(
+        "packed_strings",
+        "If set, the STRING fields are output as PackedStrings, which keep "
+        "the bytes of all of the strings in a single buffer, instead of "
+        "tensors of std::string (default 0).");
 
 NO_GRADIENT(CreateTextFileReader);
 NO_GRADIENT(TextFileReaderRead);
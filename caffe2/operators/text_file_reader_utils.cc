@@ -1,9 +1,18 @@
 #include "caffe2/operators/text_file_reader_utils.h"
 
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
 #include <cstring>
 #include <sstream>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace caffe2 {
 
 Tokenizer::Tokenizer(const std::vector<char>& delims, char escape)
@@ -13,6 +22,82 @@ Tokenizer::Tokenizer(const std::vector<char>& delims, char escape)
   for (int i = 0; i < delims.size(); ++i) {
     delimTable_[(unsigned char)delims.at(i)] = i + 1;
   }
+  specialChars_ = delims;
+  specialChars_.push_back(escape);
+}
+
+namespace {
+#if defined(__AVX2__)
+#define CAFFE2_VECTORIZED_TOKENIZER
+using CharVector = __m256i;
+inline CharVector splat(char c) {
+  return _mm256_set1_epi8(c);
+}
+inline CharVector load(const char* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const CharVector*>(p));
+}
+inline CharVector equal(CharVector a, CharVector b) {
+  return _mm256_cmpeq_epi8(a, b);
+}
+inline CharVector either(CharVector a, CharVector b) {
+  return _mm256_or_si256(a, b);
+}
+inline unsigned mask(CharVector a) {
+  return _mm256_movemask_epi8(a);
+}
+#elif defined(__SSE2__)
+#define CAFFE2_VECTORIZED_TOKENIZER
+using CharVector = __m128i;
+inline CharVector splat(char c) {
+  return _mm_set1_epi8(c);
+}
+inline CharVector load(const char* p) {
+  return _mm_loadu_si128(reinterpret_cast<const CharVector*>(p));
+}
+inline CharVector equal(CharVector a, CharVector b) {
+  return _mm_cmpeq_epi8(a, b);
+}
+inline CharVector either(CharVector a, CharVector b) {
+  return _mm_or_si128(a, b);
+}
+inline unsigned mask(CharVector a) {
+  return _mm_movemask_epi8(a);
+}
+#endif
+
+// Beyond that many special characters, comparing each of them against a
+// vector of text is no faster than looking each character up in the table.
+constexpr int kMaxVectorizedChars = 4;
+} // namespace
+
+char* Tokenizer::findSpecialChar(char* start, char* end) const {
+  char* ch = start;
+#ifdef CAFFE2_VECTORIZED_TOKENIZER
+  const int numSpecialChars = specialChars_.size();
+  if (numSpecialChars <= kMaxVectorizedChars) {
+    CharVector splats[kMaxVectorizedChars];
+    for (int i = 0; i < numSpecialChars; ++i) {
+      splats[i] = splat(specialChars_[i]);
+    }
+    for (; end - ch >= sizeof(CharVector); ch += sizeof(CharVector)) {
+      const CharVector text = load(ch);
+      CharVector found = equal(text, splats[0]);
+      for (int i = 1; i < numSpecialChars; ++i) {
+        found = either(found, equal(text, splats[i]));
+      }
+      const unsigned foundMask = mask(found);
+      if (foundMask != 0) {
+        return ch + __builtin_ctz(foundMask);
+      }
+    }
+  }
+#endif
+  for (; ch < end; ++ch) {
+    if (*ch == escape_ || delimTable_[(unsigned char)*ch] > 0) {
+      return ch;
+    }
+  }
+  return end;
 }
 
 void Tokenizer::reset() {
@@ -35,6 +120,10 @@ void Tokenizer::next(char* start, char* end, TokenizedString& tokenized) {
 
   char* ch;
   for (ch = start + toBeSkipped_; ch < end; ++ch) {
+    ch = findSpecialChar(ch, end);
+    if (ch == end) {
+      break;
+    }
     if (*ch == escape_) {
       if (!copied) {
         tokenized.modifiedStrings_.emplace_back(new std::string());
@@ -77,16 +166,37 @@ void Tokenizer::next(char* start, char* end, TokenizedString& tokenized) {
   }
 }
 
-FileReader::FileReader(const std::string& path, size_t bufferSize)
-    : bufferSize_(bufferSize), buffer_(new char[bufferSize]) {
+FileReader::FileReader(
+    const std::string& path,
+    size_t bufferSize,
+    int queueDepth)
+    : bufferSize_(bufferSize), queueDepth_(queueDepth) {
   fd_ = open(path.c_str(), O_RDONLY, 0777);
   if (fd_ < 0) {
     throw std::runtime_error(
         "Error opening file for reading: " + std::string(std::strerror(errno)));
   }
+  if (queueDepth_ > 0) {
+    struct stat st;
+    if (fstat(fd_, &st) == -1) {
+      throw std::runtime_error(
+          "Error reading file size: " + std::string(std::strerror(errno)));
+    }
+    fileSize_ = st.st_size;
+    asyncReader_.reset(
+        new AsyncFileReader(fd_, 0, fileSize_, bufferSize_, queueDepth_));
+  } else {
+    buffer_.reset(new char[bufferSize]);
+  }
 }
 
 void FileReader::reset() {
+  if (asyncReader_) {
+    asyncReader_.reset();
+    asyncReader_.reset(
+        new AsyncFileReader(fd_, 0, fileSize_, bufferSize_, queueDepth_));
+    return;
+  }
   if (lseek(fd_, 0, SEEK_SET) == -1) {
     throw std::runtime_error(
         "Error reseting file cursor: " + std::string(std::strerror(errno)));
@@ -94,12 +204,21 @@ void FileReader::reset() {
 }
 
 FileReader::~FileReader() {
+  // The reads in flight are waited for before the file is closed.
+  asyncReader_.reset();
   if (fd_ >= 0) {
     close(fd_);
   }
 }
 
 void FileReader::operator()(CharRange& range) {
+  if (asyncReader_) {
+    char* data = nullptr;
+    const size_t numRead = asyncReader_->Next(&data);
+    range.start = numRead > 0 ? data : nullptr;
+    range.end = numRead > 0 ? data + numRead : nullptr;
+    return;
+  }
   char* buffer = buffer_.get();
   auto numRead = read(fd_, buffer, bufferSize_);
   if (numRead == -1) {
@@ -114,4 +233,54 @@ void FileReader::operator()(CharRange& range) {
   range.start = buffer;
   range.end = buffer + numRead;
 }
+
+MmapFileReader::MmapFileReader(const std::string& path, size_t chunkSize)
+    : chunkSize_(chunkSize) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error(
+        "Error opening file for reading: " + std::string(std::strerror(errno)));
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    throw std::runtime_error(
+        "Error reading file size: " + std::string(std::strerror(errno)));
+  }
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error(
+          "Error mapping file: " + std::string(std::strerror(errno)));
+    }
+    data_ = static_cast<char*>(data);
+    madvise(data_, size_, MADV_SEQUENTIAL);
+  }
+  // The mapping keeps the file open.
+  close(fd);
+}
+
+MmapFileReader::~MmapFileReader() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+}
+
+void MmapFileReader::reset() {
+  offset_ = 0;
+}
+
+void MmapFileReader::operator()(CharRange& range) {
+  if (offset_ >= size_) {
+    range.start = nullptr;
+    range.end = nullptr;
+    return;
+  }
+  // The tokenizer only reads the text, so the mapping can stay read-only.
+  range.start = data_ + offset_;
+  offset_ = std::min(size_, offset_ + chunkSize_);
+  range.end = data_ + offset_;
+}
 }
@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "caffe2/core/common.h"
+#include "caffe2/utils/async_file_reader.h"
 
 namespace caffe2 {
 
@@ -41,6 +42,11 @@ class Tokenizer {
   int toBeSkipped_;
   int delimTable_[256];
   const char escape_;
+  // The delimiters and the escape character, which stop the scan.
+  std::vector<char> specialChars_;
+
+  // Returns the first special character in [start, end), or end.
+  char* findSpecialChar(char* start, char* end) const;
 
  public:
   Tokenizer(const std::vector<char>& delimiters, char escape);
@@ -88,6 +94,13 @@ class BufferedTokenizer {
     return true;
   };
 
+  // Whether the tokens of the current chunk are all consumed. The next call
+  // to next() then reads another chunk, which invalidates the tokens returned
+  // so far.
+  bool atChunkEnd() const {
+    return tokenIndex_ >= tokenized_.tokens().size();
+  }
+
   int endDelim() const {
     if (tokenIndex_ + 1 < tokenized_.tokens().size()) {
       return tokenized_.tokens()[tokenIndex_ + 1].startDelimId;
@@ -104,17 +117,43 @@ class BufferedTokenizer {
   int pass_{0};
 };
 
+// Reads a file in chunks of bufferSize bytes. With a positive queueDepth, up
+// to queueDepth chunks are read ahead of the one returned, in the background.
 class FileReader : public StringProvider {
  public:
-  explicit FileReader(const std::string& path, size_t bufferSize = 65536);
+  explicit FileReader(
+      const std::string& path,
+      size_t bufferSize = 65536,
+      int queueDepth = 0);
   ~FileReader();
   void operator()(CharRange& range) override;
   void reset() override;
 
  private:
   const size_t bufferSize_;
+  const int queueDepth_;
   int fd_;
+  size_t fileSize_{0};
   std::unique_ptr<char[]> buffer_;
+  std::unique_ptr<AsyncFileReader> asyncReader_;
+};
+
+// Maps a file into memory, and returns it in chunks of chunkSize bytes that
+// point straight into the mapping: nothing is copied, and the tokens of a
+// chunk stay valid as long as the reader lives, except those straddling two
+// chunks.
+class MmapFileReader : public StringProvider {
+ public:
+  explicit MmapFileReader(const std::string& path, size_t chunkSize = 1 << 20);
+  ~MmapFileReader();
+  void operator()(CharRange& range) override;
+  void reset() override;
+
+ private:
+  const size_t chunkSize_;
+  char* data_{nullptr};
+  size_t size_{0};
+  size_t offset_{0};
 };
 
 } // namespace caffe2
@@ -1,6 +1,8 @@
 #include <fstream>
 #include "caffe2/core/blob.h"
 #include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/packed_strings.h"
 #include "caffe2/core/tensor.h"
 #include "caffe2/proto/caffe2.pb.h"
 #include "caffe2/utils/math.h"
@@ -102,8 +104,25 @@ TEST(TextFileReaderUtilsTest, TokenizeTest) {
   outFile.open(tmpname);
   outFile << ch;
   outFile.close();
+  // Reading synchronously, and with reads in flight.
+  for (int queueDepth = 0; queueDepth <= 2; queueDepth += 2) {
+    for (int numPasses = 1; numPasses <= 2; ++numPasses) {
+      FileReader fr(tmpname, 5, queueDepth);
+      BufferedTokenizer fileTokenizer(tokenizer, &fr, numPasses);
+      Token token;
+      int i;
+      for (i = 0; fileTokenizer.next(token); ++i) {
+        EXPECT_GT(expected.size() * numPasses, i);
+        const auto& expectedToken = expected.at(i % expected.size());
+        EXPECT_EQ(expectedToken.first, token.startDelimId);
+        EXPECT_EQ(expectedToken.second, std::string(token.start, token.end));
+      }
+      EXPECT_EQ(expected.size() * numPasses, i);
+      EXPECT_EQ(0, fileTokenizer.endDelim());
+    }
+  }
   for (int numPasses = 1; numPasses <= 2; ++numPasses) {
-    FileReader fr(tmpname, 5);
+    MmapFileReader fr(tmpname, 5);
     BufferedTokenizer fileTokenizer(tokenizer, &fr, numPasses);
     Token token;
     int i;
@@ -114,7 +133,111 @@ TEST(TextFileReaderUtilsTest, TokenizeTest) {
       EXPECT_EQ(expectedToken.second, std::string(token.start, token.end));
     }
     EXPECT_EQ(expected.size() * numPasses, i);
-    EXPECT_EQ(0, fileTokenizer.endDelim());
+  }
+  std::remove(tmpname);
+}
+
+TEST(TextFileReaderUtilsTest, TokenizeLongLinesTest) {
+  // Long enough fields to exercise the vectorized scan, with delimiters and
+  // escapes at every offset.
+  std::string ch;
+  std::vector<std::pair<int, std::string>> expected;
+  int delimId = 0;
+  for (int length = 0; length < 100; ++length) {
+    std::string field;
+    for (int i = 0; i < length; ++i) {
+      if (i % 37 == 36) {
+        ch += "\\\1";
+        field += '\1';
+      } else {
+        ch += 'a' + i % 26;
+        field += 'a' + i % 26;
+      }
+    }
+    expected.emplace_back(delimId, field);
+    delimId = length % 3 == 2 ? 0 : 1;
+    ch += delimId == 0 ? '\n' : '\1';
+  }
+
+  Tokenizer tokenizer({'\n', '\1'}, '\\');
+  for (int split : {0, 1, 31, 1000, 2000}) {
+    tokenizer.reset();
+    TokenizedString tokenized;
+    std::vector<std::pair<int, std::string>> tokens;
+    tokenizer.next(&ch.front(), &ch.front() + split, tokenized);
+    for (const auto& token : tokenized.tokens()) {
+      tokens.emplace_back(
+          token.startDelimId, std::string(token.start, token.end));
+    }
+    tokenizer.next(&ch.front() + split, &ch.back() + 1, tokenized);
+    for (const auto& token : tokenized.tokens()) {
+      tokens.emplace_back(
+          token.startDelimId, std::string(token.start, token.end));
+    }
+    EXPECT_EQ(expected, tokens);
+  }
+}
+
+TEST(TextFileReaderUtilsTest, ReadInParallelTest) {
+  const int kNumRows = 20000;
+  char* tmpname = std::tmpnam(nullptr);
+  std::ofstream outFile;
+  outFile.open(tmpname);
+  for (int i = 0; i < kNumRows; ++i) {
+    outFile << i << "\t" << i * 0.5 << "\trow" << i << "\n";
+  }
+  outFile.close();
+
+  // Each of 1 and 4 threads, reading into a buffer and from a mapping, and
+  // into tensors of std::string and PackedStrings.
+  for (int config = 0; config < 8; ++config) {
+    const int numThreads = config % 2 == 0 ? 1 : 4;
+    const bool useMmap = config % 4 >= 2;
+    const bool packed = config >= 4;
+    Workspace ws;
+    OperatorDef create;
+    create.set_type("CreateTextFileReader");
+    create.add_output("reader");
+    AddArgument<string>("filename", tmpname, &create);
+    AddArgument<int>("use_mmap", useMmap, &create);
+    auto* types = create.add_arg();
+    types->set_name("field_types");
+    types->add_ints(TensorProto_DataType_INT64);
+    types->add_ints(TensorProto_DataType_FLOAT);
+    types->add_ints(TensorProto_DataType_STRING);
+    ASSERT_TRUE(ws.RunOperatorOnce(create));
+
+    OperatorDef read;
+    read.set_type("TextFileReaderRead");
+    read.add_input("reader");
+    read.add_output("ints");
+    read.add_output("floats");
+    read.add_output("strings");
+    AddArgument<int>("batch_size", 7000, &read);
+    AddArgument<int>("num_threads", numThreads, &read);
+    AddArgument<int>("packed_strings", packed, &read);
+    unique_ptr<OperatorBase> op(CreateOperator(read, &ws));
+    int row = 0;
+    while (true) {
+      ASSERT_TRUE(op->Run());
+      const auto& ints = ws.GetBlob("ints")->Get<TensorCPU>();
+      const auto& floats = ws.GetBlob("floats")->Get<TensorCPU>();
+      const auto* strings = ws.GetBlob("strings");
+      if (ints.size() == 0) {
+        break;
+      }
+      for (int i = 0; i < ints.size(); ++i, ++row) {
+        EXPECT_EQ(ints.data<int64_t>()[i], row);
+        EXPECT_EQ(floats.data<float>()[i], row * 0.5f);
+        const std::string expected = "row" + to_string(row);
+        if (packed) {
+          EXPECT_EQ(strings->Get<PackedStrings>()[i].ToString(), expected);
+        } else {
+          EXPECT_EQ(strings->Get<TensorCPU>().data<std::string>()[i], expected);
+        }
+      }
+    }
+    EXPECT_EQ(row, kNumRows);
   }
   std::remove(tmpname);
 }
@@ -0,0 +1,198 @@
+#include "caffe2/operators/top_k_op.h"
+
+namespace caffe2 {
+
+namespace {
+
+// The scores of a block of items fit in the caches.
+constexpr int kMaxBlockScores = 1 << 16;
+constexpr int kMinItemBlock = 64;
+// Below that many scores in a block, threads cost more than they save.
+constexpr int kMinParallelScores = 1 << 14;
+
+} // namespace
+
+template <>
+bool TopKOp<float, CPUContext>::RunOnDevice() {
+  const auto& X = Input(0);
+  auto* values = Output(0);
+  auto* indices = Output(1);
+  CAFFE_ENFORCE_GE(X.ndim(), 1);
+  const int D = X.dim32(X.ndim() - 1);
+  CAFFE_ENFORCE_LE(k_, D, "k is larger than the last dimension of X.");
+  const TIndex N = X.size() / D;
+  auto dims = X.dims();
+  dims.back() = k_;
+  values->Resize(dims);
+  indices->Resize(dims);
+  const float* Xdata = X.data<float>();
+  float* valuesData = values->mutable_data<float>();
+  TIndex* indicesData = indices->mutable_data<TIndex>();
+
+#ifdef _OPENMP
+#pragma omp parallel if (X.size() >= kMinParallelScores)
+#endif
+  {
+    TopKHeap<float> heap(k_);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (TIndex n = 0; n < N; ++n) {
+      const float* row = Xdata + n * D;
+      for (int d = 0; d < D; ++d) {
+        heap.Push(row[d], d);
+      }
+      heap.Extract(valuesData + n * k_, indicesData + n * k_);
+    }
+  }
+  return true;
+}
+
+template <>
+bool TopKGradientOp<float, CPUContext>::RunOnDevice() {
+  const auto& dValues = Input(0);
+  const auto& indices = Input(1);
+  const auto& X = Input(2);
+  auto* dX = Output(0);
+  CAFFE_ENFORCE(dValues.dims() == indices.dims());
+  const int k = dValues.dim32(dValues.ndim() - 1);
+  const int D = X.dim32(X.ndim() - 1);
+  const TIndex N = X.size() / D;
+  CAFFE_ENFORCE_EQ(N * k, dValues.size());
+  dX->ResizeLike(X);
+  float* dXdata = dX->mutable_data<float>();
+  math::Set<float, CPUContext>(dX->size(), 0, dXdata, &context_);
+  const float* dValuesData = dValues.data<float>();
+  const TIndex* indicesData = indices.data<TIndex>();
+  for (TIndex n = 0; n < N; ++n) {
+    for (int i = 0; i < k; ++i) {
+      const TIndex d = indicesData[n * k + i];
+      CAFFE_ENFORCE(0 <= d && d < D, "Index out of range: ", d);
+      dXdata[n * D + d] = dValuesData[n * k + i];
+    }
+  }
+  return true;
+}
+
+template <>
+bool MatMulTopKOp<float, CPUContext>::RunOnDevice() {
+  const auto& X = Input(0);
+  const auto& W = Input(1);
+  auto* values = Output(0);
+  auto* indices = Output(1);
+  CAFFE_ENFORCE_EQ(X.ndim(), 2, "X must be (N, D).");
+  CAFFE_ENFORCE_EQ(W.ndim(), 2, "W must be (M, D).");
+  const int N = X.dim32(0);
+  const int D = X.dim32(1);
+  const int M = W.dim32(0);
+  CAFFE_ENFORCE_EQ(W.dim32(1), D, "X and W must have the same width.");
+  CAFFE_ENFORCE_LE(k_, M, "k is larger than the number of items.");
+  const float* b = nullptr;
+  if (InputSize() > 2) {
+    CAFFE_ENFORCE_EQ(Input(2).size(), M, "b must have one bias per item.");
+    b = Input(2).data<float>();
+  }
+  values->Resize(N, k_);
+  indices->Resize(N, k_);
+  if (N == 0) {
+    values->mutable_data<float>();
+    indices->mutable_data<TIndex>();
+    return true;
+  }
+
+  const int block =
+      std::min(M, std::max(kMinItemBlock, kMaxBlockScores / N));
+  scores_.Resize(N, block);
+  float* scores = scores_.mutable_data<float>();
+  std::vector<TopKHeap<float>> heaps(N, TopKHeap<float>(k_));
+  for (int start = 0; start < M; start += block) {
+    const int items = std::min(block, M - start);
+    math::GemmEx<float, CPUContext>(
+        CblasNoTrans,
+        CblasTrans,
+        N,
+        items,
+        D,
+        1,
+        X.data<float>(),
+        D,
+        W.data<float>() + static_cast<TIndex>(start) * D,
+        D,
+        0,
+        scores,
+        block,
+        &context_);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (N * items >= kMinParallelScores)
+#endif
+    for (int n = 0; n < N; ++n) {
+      const float* row = scores + static_cast<TIndex>(n) * block;
+      for (int i = 0; i < items; ++i) {
+        heaps[n].Push(b ? row[i] + b[start + i] : row[i], start + i);
+      }
+    }
+  }
+  float* valuesData = values->mutable_data<float>();
+  TIndex* indicesData = indices->mutable_data<TIndex>();
+  for (int n = 0; n < N; ++n) {
+    heaps[n].Extract(valuesData + n * k_, indicesData + n * k_);
+  }
+  return true;
+}
+
+REGISTER_CPU_OPERATOR(TopK, TopKOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR(TopKGradient, TopKGradientOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR(MatMulTopK, MatMulTopKOp<float, CPUContext>);
+
+OPERATOR_SCHEMA(TopK)
+    .NumInputs(1)
+    .NumOutputs(2)
+    .SetDoc(R"DOC(
+Retrieves the k largest values of the last dimension of X, and their indices,
+the largest first. Equal values are ordered by their indices. The values are
+kept in a heap of size k while each row is read, which costs a comparison for
+the values that are not among the k largest seen so far.
+)DOC")
+    .Arg("k", "Number of values to retrieve, at most the last dimension of X.")
+    .Input(0, "X", "Tensor of shape (..., D)")
+    .Output(0, "Values", "Tensor of shape (..., k) of the largest values")
+    .Output(1, "Indices", "Int64 tensor of shape (..., k) of their indices");
+
+OPERATOR_SCHEMA(TopKGradient).NumInputs(3).NumOutputs(1);
+
+OPERATOR_SCHEMA(MatMulTopK)
+    .NumInputs(2, 3)
+    .NumOutputs(2)
+    .SetDoc(R"DOC(
+Scores every row of X against every item of W, as FC does, and retrieves the k
+largest scores of each row and the items they belong to. This gives the same
+result as FC followed by TopK, but the scores are computed for blocks of items
+at a time, which stay in the caches and are reduced to the k best before the
+next block: the (N, M) matrix of all the scores is never stored.
+)DOC")
+    .Arg("k", "Number of items to retrieve for each row of X.")
+    .Input(0, "X", "Queries of shape (N, D)")
+    .Input(1, "W", "Items of shape (M, D)")
+    .Input(2, "b", "Optional bias of every item, of shape (M)")
+    .Output(0, "Values", "Scores of shape (N, k), the largest first")
+    .Output(1, "Indices", "Int64 items of shape (N, k) of the scores");
+
+namespace {
+
+class GetTopKGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    return SingleGradientDef(
+        "TopKGradient",
+        "",
+        vector<string>{GO(0), O(1), I(0)},
+        vector<string>{GI(0)});
+  }
+};
+
+} // namespace
+
+REGISTER_GRADIENT(TopK, GetTopKGradient);
+NO_GRADIENT(MatMulTopK);
+
+} // namespace caffe2
@@ -0,0 +1,240 @@
+#include <cfloat>
+
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/operators/top_k_op.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Each row is reduced by one block, which keeps the k best values seen so far
+// at the front of a buffer in shared memory, fills the rest of the buffer with
+// the next columns of the row and sorts the buffer with a bitonic network.
+constexpr int kSortSize = 1024;
+constexpr int kSortThreads = 512;
+// The index of the padding, which loses against the values of the row.
+constexpr TIndex kPadIndex = 0x7fffffffffffffffLL;
+// The scores of a block of items MatMulTopK computes at a time.
+constexpr int kMaxBlockScores = 1 << 22;
+
+inline __device__ bool
+Better(float value, TIndex index, float other_value, TIndex other_index) {
+  return value > other_value || (value == other_value && index < other_index);
+}
+
+// Sorts the kSortSize entries of values and indices, the best first.
+inline __device__ void BitonicSort(float* values, TIndex* indices) {
+  for (int size = 2; size <= kSortSize; size <<= 1) {
+    for (int stride = size >> 1; stride > 0; stride >>= 1) {
+      for (int i = threadIdx.x; i < kSortSize; i += blockDim.x) {
+        const int j = i ^ stride;
+        if (j > i) {
+          const bool best_first = (i & size) == 0;
+          if (Better(values[j], indices[j], values[i], indices[i]) ==
+              best_first) {
+            const float value = values[i];
+            values[i] = values[j];
+            values[j] = value;
+            const TIndex index = indices[i];
+            indices[i] = indices[j];
+            indices[j] = index;
+          }
+        }
+      }
+      __syncthreads();
+    }
+  }
+}
+
+// The k best of the cols scores of every row, plus bias if given, with the
+// indices of the columns offset by index_offset. With merge, the k best of
+// values and indices, from earlier columns, compete with the new ones.
+__global__ void TopKKernel(
+    const int rows,
+    const int cols,
+    const int k,
+    const float* scores,
+    const float* bias,
+    const TIndex index_offset,
+    const bool merge,
+    float* values,
+    TIndex* indices) {
+  __shared__ float buffer_values[kSortSize];
+  __shared__ TIndex buffer_indices[kSortSize];
+  const int chunk = kSortSize - k;
+  for (int row = blockIdx.x; row < rows; row += gridDim.x) {
+    for (int i = threadIdx.x; i < k; i += blockDim.x) {
+      buffer_values[i] = merge ? values[row * k + i] : -FLT_MAX;
+      buffer_indices[i] = merge ? indices[row * k + i] : kPadIndex;
+    }
+    const float* row_scores = scores + static_cast<TIndex>(row) * cols;
+    for (int start = 0; start < cols; start += chunk) {
+      for (int i = threadIdx.x; i < chunk; i += blockDim.x) {
+        const int col = start + i;
+        if (col < cols) {
+          buffer_values[k + i] =
+              bias ? row_scores[col] + bias[col] : row_scores[col];
+          buffer_indices[k + i] = index_offset + col;
+        } else {
+          buffer_values[k + i] = -FLT_MAX;
+          buffer_indices[k + i] = kPadIndex;
+        }
+      }
+      __syncthreads();
+      BitonicSort(buffer_values, buffer_indices);
+    }
+    for (int i = threadIdx.x; i < k; i += blockDim.x) {
+      values[row * k + i] = buffer_values[i];
+      indices[row * k + i] = buffer_indices[i];
+    }
+    __syncthreads();
+  }
+}
+
+__global__ void TopKGradientKernel(
+    const int size,
+    const int k,
+    const int D,
+    const float* dvalues,
+    const TIndex* indices,
+    float* dX) {
+  CUDA_1D_KERNEL_LOOP(i, size) {
+    dX[static_cast<TIndex>(i / k) * D + indices[i]] = dvalues[i];
+  }
+}
+
+} // namespace
+
+template <>
+bool TopKOp<float, CUDAContext>::RunOnDevice() {
+  const auto& X = Input(0);
+  auto* values = Output(0);
+  auto* indices = Output(1);
+  CAFFE_ENFORCE_GE(X.ndim(), 1);
+  const int D = X.dim32(X.ndim() - 1);
+  CAFFE_ENFORCE_LE(k_, D, "k is larger than the last dimension of X.");
+  CAFFE_ENFORCE_LE(k_, kSortSize / 2, "k is too large for the CUDA TopK.");
+  const int N = X.size() / D;
+  auto dims = X.dims();
+  dims.back() = k_;
+  values->Resize(dims);
+  indices->Resize(dims);
+  if (N == 0) {
+    values->mutable_data<float>();
+    indices->mutable_data<TIndex>();
+    return true;
+  }
+  TopKKernel<<<
+      std::min(N, CAFFE_MAXIMUM_NUM_BLOCKS),
+      kSortThreads,
+      0,
+      context_.cuda_stream()>>>(
+      N,
+      D,
+      k_,
+      X.data<float>(),
+      nullptr,
+      0,
+      false,
+      values->mutable_data<float>(),
+      indices->mutable_data<TIndex>());
+  return true;
+}
+
+template <>
+bool TopKGradientOp<float, CUDAContext>::RunOnDevice() {
+  const auto& dValues = Input(0);
+  const auto& indices = Input(1);
+  const auto& X = Input(2);
+  auto* dX = Output(0);
+  CAFFE_ENFORCE(dValues.dims() == indices.dims());
+  const int k = dValues.dim32(dValues.ndim() - 1);
+  const int D = X.dim32(X.ndim() - 1);
+  CAFFE_ENFORCE_EQ(X.size() / D * k, dValues.size());
+  dX->ResizeLike(X);
+  float* dXdata = dX->mutable_data<float>();
+  math::Set<float, CUDAContext>(dX->size(), 0.f, dXdata, &context_);
+  if (dValues.size() == 0) {
+    return true;
+  }
+  TopKGradientKernel<<<
+      CAFFE_GET_BLOCKS(dValues.size()),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context_.cuda_stream()>>>(
+      dValues.size(),
+      k,
+      D,
+      dValues.data<float>(),
+      indices.data<TIndex>(),
+      dXdata);
+  return true;
+}
+
+template <>
+bool MatMulTopKOp<float, CUDAContext>::RunOnDevice() {
+  const auto& X = Input(0);
+  const auto& W = Input(1);
+  auto* values = Output(0);
+  auto* indices = Output(1);
+  CAFFE_ENFORCE_EQ(X.ndim(), 2, "X must be (N, D).");
+  CAFFE_ENFORCE_EQ(W.ndim(), 2, "W must be (M, D).");
+  const int N = X.dim32(0);
+  const int D = X.dim32(1);
+  const int M = W.dim32(0);
+  CAFFE_ENFORCE_EQ(W.dim32(1), D, "X and W must have the same width.");
+  CAFFE_ENFORCE_LE(k_, M, "k is larger than the number of items.");
+  CAFFE_ENFORCE_LE(k_, kSortSize / 2, "k is too large for the CUDA TopK.");
+  const float* b = nullptr;
+  if (InputSize() > 2) {
+    CAFFE_ENFORCE_EQ(Input(2).size(), M, "b must have one bias per item.");
+    b = Input(2).data<float>();
+  }
+  values->Resize(N, k_);
+  indices->Resize(N, k_);
+  float* values_data = values->mutable_data<float>();
+  TIndex* indices_data = indices->mutable_data<TIndex>();
+  if (N == 0) {
+    return true;
+  }
+
+  const int block = std::min(M, std::max(kSortSize, kMaxBlockScores / N));
+  scores_.Resize(N, block);
+  float* scores = scores_.mutable_data<float>();
+  for (int start = 0; start < M; start += block) {
+    const int items = std::min(block, M - start);
+    math::Gemm<float, CUDAContext>(
+        CblasNoTrans,
+        CblasTrans,
+        N,
+        items,
+        D,
+        1,
+        X.data<float>(),
+        W.data<float>() + static_cast<TIndex>(start) * D,
+        0,
+        scores,
+        &context_);
+    TopKKernel<<<
+        std::min(N, CAFFE_MAXIMUM_NUM_BLOCKS),
+        kSortThreads,
+        0,
+        context_.cuda_stream()>>>(
+        N,
+        items,
+        k_,
+        scores,
+        b ? b + start : nullptr,
+        start,
+        start > 0,
+        values_data,
+        indices_data);
+  }
+  return true;
+}
+
+REGISTER_CUDA_OPERATOR(TopK, TopKOp<float, CUDAContext>);
+REGISTER_CUDA_OPERATOR(TopKGradient, TopKGradientOp<float, CUDAContext>);
+REGISTER_CUDA_OPERATOR(MatMulTopK, MatMulTopKOp<float, CUDAContext>);
+
+} // namespace caffe2
@@ -0,0 +1,111 @@
+#ifndef CAFFE2_OPERATORS_TOP_K_OP_H_
+#define CAFFE2_OPERATORS_TOP_K_OP_H_
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+
+/**
+ * Keeps the k largest of a stream of (value, index) pairs, in a min-heap of
+ * size k: a pair that is not larger than the smallest one kept costs a single
+ * comparison. Equal values are ordered by their indices, the smallest first,
+ * so the result does not depend on the order of the stream.
+ */
+template <typename T>
+class TopKHeap {
+ public:
+  explicit TopKHeap(int k) : k_(k) {
+    heap_.reserve(k);
+  }
+
+  void Clear() {
+    heap_.clear();
+  }
+
+  void Push(T value, TIndex index) {
+    if (static_cast<int>(heap_.size()) < k_) {
+      heap_.emplace_back(value, index);
+      std::push_heap(heap_.begin(), heap_.end(), Better);
+    } else if (k_ > 0 && Better(Entry(value, index), heap_.front())) {
+      std::pop_heap(heap_.begin(), heap_.end(), Better);
+      heap_.back() = Entry(value, index);
+      std::push_heap(heap_.begin(), heap_.end(), Better);
+    }
+  }
+
+  // Writes the pairs kept, the largest first, and empties the heap. If fewer
+  // than k pairs were pushed, the rest is padded with the lowest value and an
+  // index of -1.
+  void Extract(T* values, TIndex* indices) {
+    std::sort_heap(heap_.begin(), heap_.end(), Better);
+    for (int i = 0; i < k_; ++i) {
+      const bool kept = i < static_cast<int>(heap_.size());
+      values[i] = kept ? heap_[i].first : std::numeric_limits<T>::lowest();
+      indices[i] = kept ? heap_[i].second : -1;
+    }
+    heap_.clear();
+  }
+
+ private:
+  using Entry = std::pair<T, TIndex>;
+
+  static bool Better(const Entry& a, const Entry& b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  }
+
+  int k_;
+  std::vector<Entry> heap_;
+};
+
+template <typename T, class Context>
+class TopKOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  TopKOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        k_(OperatorBase::GetSingleArgument<int>("k", -1)) {
+    CAFFE_ENFORCE_GT(k_, 0, "k must be given and positive.");
+  }
+  bool RunOnDevice() override;
+
+ private:
+  int k_;
+};
+
+template <typename T, class Context>
+class TopKGradientOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(TopKGradientOp);
+  bool RunOnDevice() override;
+};
+
+// The k largest scores X * W^T + b of every row of X, computed for blocks of
+// rows of W at a time, so that the scores of all the items are never stored.
+template <typename T, class Context>
+class MatMulTopKOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  MatMulTopKOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        k_(OperatorBase::GetSingleArgument<int>("k", -1)) {
+    CAFFE_ENFORCE_GT(k_, 0, "k must be given and positive.");
+  }
+  bool RunOnDevice() override;
+
+ private:
+  int k_;
+  Tensor<Context> scores_;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_TOP_K_OP_H_
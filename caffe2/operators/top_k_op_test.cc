@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+TensorCPU* AddTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  // Few distinct values, so that there are ties.
+  std::uniform_int_distribution<int> value(-8, 8);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen) / 4.f;
+  }
+  return tensor;
+}
+
+OperatorDef Def(
+    const string& type,
+    const vector<string>& inputs,
+    const vector<string>& outputs,
+    int k) {
+  OperatorDef def;
+  def.set_type(type);
+  for (const auto& input : inputs) {
+    def.add_input(input);
+  }
+  for (const auto& output : outputs) {
+    def.add_output(output);
+  }
+  AddArgument<int>("k", k, &def);
+  return def;
+}
+
+const TensorCPU& Get(Workspace* ws, const string& name) {
+  return ws->GetBlob(name)->Get<TensorCPU>();
+}
+
+// The k largest values of every row of X, the smallest index first among
+// equal values.
+void ExpectTopK(
+    const TensorCPU& X,
+    int k,
+    const TensorCPU& values,
+    const TensorCPU& indices) {
+  const int D = X.dim32(X.ndim() - 1);
+  const int N = X.size() / D;
+  ASSERT_EQ(values.size(), N * k);
+  ASSERT_EQ(indices.size(), N * k);
+  for (int n = 0; n < N; ++n) {
+    vector<int> order(D);
+    for (int d = 0; d < D; ++d) {
+      order[d] = d;
+    }
+    const float* row = X.data<float>() + n * D;
+    std::stable_sort(order.begin(), order.end(), [row](int a, int b) {
+      return row[a] > row[b];
+    });
+    for (int i = 0; i < k; ++i) {
+      EXPECT_EQ(indices.data<TIndex>()[n * k + i], order[i]);
+      EXPECT_EQ(values.data<float>()[n * k + i], row[order[i]]);
+    }
+  }
+}
+
+} // namespace
+
+TEST(TopKTest, MatchesSort) {
+  std::mt19937 gen(0);
+  Workspace ws;
+  const auto& X = *AddTensor(&ws, "X", {3, 4, 37}, &gen);
+  for (int k : {1, 5, 37}) {
+    ASSERT_TRUE(ws.RunOperatorOnce(
+        Def("TopK", {"X"}, {"values", "indices"}, k)));
+    EXPECT_EQ(Get(&ws, "values").dims(), vector<TIndex>({3, 4, k}));
+    ExpectTopK(X, k, Get(&ws, "values"), Get(&ws, "indices"));
+  }
+}
+
+TEST(TopKTest, Gradient) {
+  std::mt19937 gen(0);
+  Workspace ws;
+  const auto& X = *AddTensor(&ws, "X", {6, 10}, &gen);
+  ASSERT_TRUE(
+      ws.RunOperatorOnce(Def("TopK", {"X"}, {"values", "indices"}, 3)));
+  const auto& dValues = *AddTensor(&ws, "dvalues", {6, 3}, &gen);
+  OperatorDef grad;
+  grad.set_type("TopKGradient");
+  for (const char* input : {"dvalues", "indices", "X"}) {
+    grad.add_input(input);
+  }
+  grad.add_output("dX");
+  ASSERT_TRUE(ws.RunOperatorOnce(grad));
+  const auto& dX = Get(&ws, "dX");
+  const TIndex* indices = Get(&ws, "indices").data<TIndex>();
+  ASSERT_EQ(dX.dims(), X.dims());
+  for (int n = 0; n < 6; ++n) {
+    vector<float> expected(10, 0);
+    for (int i = 0; i < 3; ++i) {
+      expected[indices[n * 3 + i]] = dValues.data<float>()[n * 3 + i];
+    }
+    for (int d = 0; d < 10; ++d) {
+      EXPECT_EQ(dX.data<float>()[n * 10 + d], expected[d]);
+    }
+  }
+}
+
+// With enough queries, the items are scored in several blocks.
+TEST(MatMulTopKTest, MatchesFCAndTopK) {
+  std::mt19937 gen(0);
+  for (int N : {1, 100}) {
+    Workspace ws;
+    AddTensor(&ws, "X", {N, 8}, &gen);
+    AddTensor(&ws, "W", {3000, 8}, &gen);
+    AddTensor(&ws, "b", {3000}, &gen);
+    OperatorDef fc;
+    fc.set_type("FC");
+    for (const char* input : {"X", "W", "b"}) {
+      fc.add_input(input);
+    }
+    fc.add_output("scores");
+    ASSERT_TRUE(ws.RunOperatorOnce(fc));
+    ASSERT_TRUE(ws.RunOperatorOnce(
+        Def("MatMulTopK", {"X", "W", "b"}, {"values", "indices"}, 10)));
+    EXPECT_EQ(Get(&ws, "values").dims(), vector<TIndex>({N, 10}));
+    ExpectTopK(
+        Get(&ws, "scores"), 10, Get(&ws, "values"), Get(&ws, "indices"));
+  }
+}
+
+} // namespace caffe2
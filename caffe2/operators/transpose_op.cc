@@ -2,31 +2,116 @@
 
 namespace caffe2 {
 
-#define COMPILE_TIME_MAX_TRANSPOSE_DIMS 10
+namespace {
+
+// Removes the axes of size 1, and merges the input axes that stay next to
+// each other in the output. dims and axes are then the smallest shape and
+// permutation that do the same transpose.
+void MergeAxes(
+    const vector<TIndex>& input_dims,
+    const vector<int>& input_axes,
+    vector<TIndex>* dims,
+    vector<int>* axes) {
+  vector<int> kept;
+  for (int axis : input_axes) {
+    if (input_dims[axis] != 1) {
+      kept.push_back(axis);
+    }
+  }
+  // Runs of input axes that are consecutive in the output, in output order.
+  vector<std::pair<int, int>> runs;
+  for (int axis : kept) {
+    if (!runs.empty() && runs.back().second == axis) {
+      ++runs.back().second;
+    } else {
+      runs.emplace_back(axis, axis + 1);
+    }
+  }
+  // The merged input axes are numbered by where their runs start.
+  vector<int> order(runs.size());
+  for (int i = 0; i < runs.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&runs](int a, int b) {
+    return runs[a].first < runs[b].first;
+  });
+  dims->assign(runs.size(), 1);
+  axes->assign(runs.size(), 0);
+  for (int i = 0; i < order.size(); ++i) {
+    const auto& run = runs[order[i]];
+    for (int axis = run.first; axis < run.second; ++axis) {
+      (*dims)[i] *= input_dims[axis];
+    }
+    (*axes)[order[i]] = i;
+  }
+}
+
+// Copies X into Y for any permutation. The innermost output axis is copied a
+// row at a time, and the rows are split across threads.
+template <typename T>
+void TransposeND(
+    const vector<TIndex>& dims,
+    const vector<int>& axes,
+    const T* X,
+    T* Y) {
+  const int num_axes = dims.size();
+  vector<TIndex> input_strides(num_axes, 1);
+  for (int i = num_axes - 2; i >= 0; --i) {
+    input_strides[i] = input_strides[i + 1] * dims[i + 1];
+  }
+  // Size and input stride of each output axis.
+  vector<TIndex> output_dims(num_axes);
+  vector<TIndex> strides(num_axes);
+  for (int i = 0; i < num_axes; ++i) {
+    output_dims[i] = dims[axes[i]];
+    strides[i] = input_strides[axes[i]];
+  }
+  const TIndex row_size = output_dims[num_axes - 1];
+  const TIndex row_stride = strides[num_axes - 1];
+  TIndex num_rows = 1;
+  for (int i = 0; i < num_axes - 1; ++i) {
+    num_rows *= output_dims[i];
+  }
+#pragma omp parallel for if (num_rows * row_size > 65536)
+  for (TIndex row = 0; row < num_rows; ++row) {
+    TIndex offset = 0;
+    TIndex index = row;
+    for (int i = num_axes - 2; i >= 0; --i) {
+      offset += index % output_dims[i] * strides[i];
+      index /= output_dims[i];
+    }
+    const T* x = X + offset;
+    T* y = Y + row * row_size;
+    for (TIndex j = 0; j < row_size; ++j) {
+      y[j] = x[j * row_stride];
+    }
+  }
+}
+
+} // namespace
 
 template <>
 template <typename T>
 bool TransposeOp<CPUContext>::DoRunWithType() {
-  int from_inds[COMPILE_TIME_MAX_TRANSPOSE_DIMS] = {0};
   const auto& input = Input(0);
   auto* output = Output(0);
-  size_t count = input.size();
-  const auto& from_counts = input.dims();
-  const auto& to_counts = output->dims();
-  int num_axes = from_counts.size();
   const T* from_data = input.template data<T>();
   T* to_data = output->template mutable_data<T>();
-  for (size_t index = 0; index < count; index++) {
-    size_t from_index = index, to_index = 0;
-    for (int i = num_axes - 1; i >= 0; --i) {
-      from_inds[i] = from_index % from_counts[i];
-      from_index = from_index / from_counts[i];
-    }
-    for (int i = 0; i < num_axes - 1; ++i) {
-      to_index = (to_index + from_inds[axes_[i]]) * to_counts[i + 1];
-    }
-    to_index += from_inds[axes_[num_axes - 1]];
-    *(to_data + to_index) = *(from_data + index);
+  vector<TIndex> dims;
+  vector<int> axes;
+  MergeAxes(input.dims(), axes_, &dims, &axes);
+  if (axes.size() <= 1) {
+    // Nothing moves.
+    context_.template Copy<T, CPUContext, CPUContext>(
+        input.size(), from_data, to_data);
+  } else if (axes.size() == 2) {
+    math::Transpose2D<T, CPUContext>(
+        1, dims[0], dims[1], from_data, to_data, &context_);
+  } else if (axes.size() == 3 && axes[0] == 0 && axes[1] == 2) {
+    math::Transpose2D<T, CPUContext>(
+        dims[0], dims[1], dims[2], from_data, to_data, &context_);
+  } else {
+    TransposeND(dims, axes, from_data, to_data);
   }
   return true;
 }
@@ -3,6 +3,7 @@
 #include <limits>
 
 #include "caffe2/core/context_gpu.h"
+#include "caffe2/utils/fixed_divisor.h"
 
 namespace caffe2 {
 
@@ -10,25 +11,27 @@ namespace caffe2 {
 #define COMPILE_TIME_CUDA_MAX_TRANSPOSE_DIMS 5
 
 namespace {
-// TODO(jiayq): one possible optimization is to copy the buffer into a shared
-// memory location to speed up access.
+// The strides of the output along the axes of the input, padded like the
+// dims of the input. They are passed to the kernel by value, with the
+// decomposer of the input dims, so that there is no buffer to copy to the
+// device before the launch.
+struct TransposeStrides {
+  int data[COMPILE_TIME_CUDA_MAX_TRANSPOSE_DIMS];
+};
+
 template <typename Dtype>
 __global__ void transpose_gpu(const int nthreads, const Dtype* from_data,
-  Dtype* to_data, const int* buffer, const int num_axes) {
-  int from_inds[COMPILE_TIME_CUDA_MAX_TRANSPOSE_DIMS];
-  const int* from_counts = buffer;
-  const int* to_counts = buffer + num_axes;
-  const int* axes = buffer + num_axes * 2;
+  Dtype* to_data,
+  const IndexDecomposer<COMPILE_TIME_CUDA_MAX_TRANSPOSE_DIMS> from_dims,
+  const TransposeStrides to_strides) {
   CUDA_1D_KERNEL_LOOP(index, nthreads) {
-    int from_index = index, to_index = 0;
-    for (int i = num_axes - 1; i >= 0; --i) {
-      from_inds[i] = from_index % from_counts[i];
-      from_index = from_index / from_counts[i];
-    }
-    for (int i = 0; i < num_axes - 1; i++) {
-      to_index = (to_index + from_inds[axes[i]]) * to_counts[i + 1];
+    int from_inds[COMPILE_TIME_CUDA_MAX_TRANSPOSE_DIMS];
+    from_dims.decompose(index, from_inds);
+    int to_index = 0;
+#pragma unroll
+    for (int i = 0; i < COMPILE_TIME_CUDA_MAX_TRANSPOSE_DIMS; ++i) {
+      to_index += from_inds[i] * to_strides.data[i];
     }
-    to_index += from_inds[axes[num_axes - 1]];
     to_data[to_index] = from_data[index];
   }
 }
@@ -42,30 +45,28 @@ bool TransposeOp<CUDAContext>::DoRunWithType() {
   int count = input.size();
   int ndim = input.ndim();
   CAFFE_ENFORCE(count < std::numeric_limits<int>::max(),
-                "Transpose op on GPU only supports int32"); 
+                "Transpose op on GPU only supports int32");
   CAFFE_ENFORCE(ndim < COMPILE_TIME_CUDA_MAX_TRANSPOSE_DIMS,
-                "Input ndim exceeds compile time max."); 
-  // Buffer contains the following data:
-  // (1) the dimenions of the inputs
-  // (2) the dimension of the outputs
-  // (3) the axis mapping from inputs to outputs
-  TensorCPU buffer_cpu(vector<int>{3 * ndim});
-  int* buffer_data = buffer_cpu.mutable_data<int>();
-  for (int i = 0; i < ndim; ++i) {
-    *(buffer_data++) = input.dim32(i);
-  }
-  for (int i = 0; i < ndim; ++i) {
-    *(buffer_data++) = output->dim32(i);
+                "Input ndim exceeds compile time max.");
+  // The leading dims are padded with ones, which the strides ignore.
+  const int pad = COMPILE_TIME_CUDA_MAX_TRANSPOSE_DIMS - ndim;
+  int32_t from_dims[COMPILE_TIME_CUDA_MAX_TRANSPOSE_DIMS];
+  TransposeStrides to_strides;
+  for (int i = 0; i < pad; ++i) {
+    from_dims[i] = 1;
+    to_strides.data[i] = 0;
   }
-  for (int i = 0; i < ndim; ++i) {
-    *(buffer_data++) = axes_[i];
+  int stride = 1;
+  for (int i = ndim - 1; i >= 0; --i) {
+    from_dims[pad + i] = input.dim32(i);
+    to_strides.data[pad + axes_[i]] = stride;
+    stride *= output->dim32(i);
   }
-  // Copy the dimension information to GPU.
-  buffer_.CopyFrom(buffer_cpu, &context_);
   transpose_gpu<T><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS,
                      0, context_.cuda_stream()>>>(
       count, input.template data<T>(), output->template mutable_data<T>(),
-      buffer_.data<int>(), ndim);
+      IndexDecomposer<COMPILE_TIME_CUDA_MAX_TRANSPOSE_DIMS>(from_dims),
+      to_strides);
   return true;
 }
 
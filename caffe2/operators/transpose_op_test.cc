@@ -0,0 +1,82 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Transposes one element at a time, as numpy.transpose does.
+vector<float> ReferenceTranspose(
+    const TensorCPU& X,
+    const vector<int>& axes) {
+  const int num_axes = X.ndim();
+  vector<TIndex> strides(num_axes, 1);
+  for (int i = num_axes - 2; i >= 0; --i) {
+    strides[i] = strides[i + 1] * X.dim(i + 1);
+  }
+  vector<float> Y(X.size());
+  vector<TIndex> index(num_axes, 0);
+  for (int i = 0; i < Y.size(); ++i) {
+    TIndex offset = 0;
+    for (int j = 0; j < num_axes; ++j) {
+      offset += index[j] * strides[axes[j]];
+    }
+    Y[i] = X.data<float>()[offset];
+    for (int j = num_axes - 1; j >= 0; --j) {
+      if (++index[j] < X.dim(axes[j])) {
+        break;
+      }
+      index[j] = 0;
+    }
+  }
+  return Y;
+}
+
+} // namespace
+
+TEST(TransposeTest, MatchesReference) {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> value(-1, 1);
+  const vector<std::pair<vector<TIndex>, vector<int>>> cases = {
+      // Plain 2D, with partial tiles and 8 x 8 blocks.
+      {{37, 70}, {1, 0}},
+      // NCHW to NHWC and back, which merge to batched 2D transposes.
+      {{2, 19, 5, 7}, {0, 2, 3, 1}},
+      {{2, 5, 7, 19}, {0, 3, 1, 2}},
+      // Axes of size 1 are dropped.
+      {{1, 9, 1, 11}, {3, 2, 1, 0}},
+      // The innermost axis stays.
+      {{4, 3, 6}, {1, 0, 2}},
+      // General permutations.
+      {{2, 3, 4, 5}, {2, 0, 3, 1}},
+      {{3, 4, 5}, {2, 1, 0}},
+      {{2, 3}, {0, 1}},
+  };
+  for (const auto& c : cases) {
+    Workspace ws;
+    auto* X = ws.CreateBlob("X")->GetMutable<TensorCPU>();
+    X->Resize(c.first);
+    for (int i = 0; i < X->size(); ++i) {
+      X->mutable_data<float>()[i] = value(gen);
+    }
+    OperatorDef def;
+    def.set_type("Transpose");
+    def.add_input("X");
+    def.add_output("Y");
+    AddArgument<vector<int>>("axes", c.second, &def);
+    ASSERT_TRUE(ws.RunOperatorOnce(def));
+    const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+    const auto expected = ReferenceTranspose(*X, c.second);
+    ASSERT_EQ(Y.size(), expected.size());
+    for (int i = 0; i < Y.dims().size(); ++i) {
+      EXPECT_EQ(Y.dim(i), X->dim(c.second[i]));
+    }
+    for (int i = 0; i < Y.size(); ++i) {
+      EXPECT_EQ(Y.data<float>()[i], expected[i]) << i;
+    }
+  }
+}
+
+} // namespace caffe2
@@ -1,12 +1,8 @@
 #ifndef CAFFE2_OPERATORS_TT_LINEAR_OP_H_
 #define CAFFE2_OPERATORS_TT_LINEAR_OP_H_
 
-#ifdef CAFFE2_USE_MKL
-#include <mkl.h>
-#endif // CAFFE2_USE_MKL
+#include <algorithm>
 
-#include "Eigen/Core"
-#include "Eigen/Dense"
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/utils/math.h"
@@ -21,8 +17,22 @@ class TTLinearOp final : public Operator<Context> {
       : Operator<Context>(operator_def, ws),
         inp_sizes_(OperatorBase::GetRepeatedArgument<int>("inp_sizes")),
         out_sizes_(OperatorBase::GetRepeatedArgument<int>("out_sizes")),
-        tt_ranks_(OperatorBase::GetRepeatedArgument<int>("tt_ranks")),
-        Y_temp_(unique_ptr<Blob>(new Blob())) {}
+        tt_ranks_(OperatorBase::GetRepeatedArgument<int>("tt_ranks")) {
+    CAFFE_ENFORCE(
+        inp_sizes_.size() == out_sizes_.size(),
+        "inp_sizes has size: ",
+        inp_sizes_.size(),
+        ", out_sizes has size: ",
+        out_sizes_.size());
+    CAFFE_ENFORCE(inp_sizes_.size() > 0, "There must be at least one core.");
+    CAFFE_ENFORCE(
+        tt_ranks_.size() == inp_sizes_.size() + 1,
+        "tt_ranks has size: ",
+        tt_ranks_.size(),
+        ", inp_sizes has size: ",
+        inp_sizes_.size());
+    PlanContraction();
+  }
   ~TTLinearOp() {}
 
   bool RunOnDevice() override {
@@ -33,137 +43,186 @@ class TTLinearOp final : public Operator<Context> {
 
     CAFFE_ENFORCE(X.ndim() > 1, "Number of dimensions in X: ", X.ndim());
     CAFFE_ENFORCE(b.ndim() == 1, "Number of dimensions in b: ", b.ndim());
-    CAFFE_ENFORCE(
-        inp_sizes_.size() == out_sizes_.size(),
-        "inp_sizes has size: ",
-        inp_sizes_.size(),
-        ", out_sizes has size: ",
-        out_sizes_.size());
     CAFFE_ENFORCE(
         cores.ndim() == 1, "Number of dimensions in cores: ", cores.ndim());
     // batch size
-    const int batch_size = X.ndim() > 1 ? X.dim32(0) : 1;
+    const int batch_size = X.dim32(0);
 
     // dimension d of tensors
     const int d = inp_sizes_.size();
 
+    int prod_inp_sizes = 1;
+    int prod_out_sizes = 1;
+    for (int i = 0; i < d; i++) {
+      prod_inp_sizes *= inp_sizes_[i];
+      prod_out_sizes *= out_sizes_[i];
+    }
+    CAFFE_ENFORCE(
+        X.size_from_dim(1) == prod_inp_sizes,
+        "Input dimension of X: ",
+        X.size_from_dim(1),
+        ", product of inp_sizes: ",
+        prod_inp_sizes);
+    CAFFE_ENFORCE(
+        b.dim32(0) == prod_out_sizes,
+        "Size of b: ",
+        b.dim32(0),
+        ", product of out_sizes: ",
+        prod_out_sizes);
+
     // Keep track of index of current core in multiplication
     int cores_idx = 0;
-
-    // Temporary buffer to facilitate multiplication of TT-cores with input
-    auto Y_buf = Y_temp_->GetMutable<Tensor<Context>>();
-    Y_buf->ResizeLike(X);
-    Y_buf->CopyFrom(X);
+    const T* input = X.template data<T>();
+    int size = X.size();
+    int buffer = 0;
 
     // The overall forward pass involves multiplication with each core, where
     // each core has sizes dictated by inp_sizes_ and out_sizes_. Each core thus
     // has size inp_sizes_[i] * tt_ranks_[i] * tt_ranks_[i + 1] * out_sizes_[i].
+    // The input of core i is laid out as [P][inp_sizes_[i]][tt_ranks_[i + 1]],
+    // and its output as [out_sizes_[i]][P][tt_ranks_[i]], so that the next
+    // core contracts the innermost dimensions again.
     for (int i = (d - 1); i >= 0; --i) {
-      int curr_rows = inp_sizes_[i] * tt_ranks_[i + 1];
-      int curr_cols = tt_ranks_[i] * out_sizes_[i];
-
-      // TODO Replace by Reshape(), once wrappers are written
-      Y_buf->Resize(Y_buf->size() / curr_rows, curr_rows);
-      Y->Resize(Y_buf->size() / curr_rows, curr_cols);
+      const int K = inp_sizes_[i] * tt_ranks_[i + 1];
+      const int R = tt_ranks_[i];
+      const int M = out_sizes_[i];
+      const int P = size / K;
 
       // Defensive checks
-      CAFFE_ENFORCE(Y_buf->size() % curr_rows == 0, Y_buf->size(), curr_rows);
+      CAFFE_ENFORCE(size % K == 0, size, K);
       CAFFE_ENFORCE(
-          cores_idx + curr_rows * curr_cols <= cores.size(),
-          cores_idx + curr_rows * curr_cols,
+          cores_idx + K * R * M <= cores.size(),
+          cores_idx + K * R * M,
           cores.size());
-
-      // Multiply ith core with the intermediate output
-      math::Gemm<float, Context, Engine>(
-          CblasNoTrans,
-          CblasNoTrans,
-          Y_buf->size() / curr_rows,
-          curr_cols,
-          curr_rows,
-          1,
-          Y_buf->template data<float>(),
-          cores.template data<float>() + cores_idx,
-          0,
-          Y->template mutable_data<float>(),
-          &context_);
-
-      CAFFE_ENFORCE(Y->size() % out_sizes_[i] == 0, Y->size(), out_sizes_[i]);
-
-      // TODO Add GPU support by writing a generic wrapper.
-      auto Y_mat = EigenMatrixMap<float>(
-          Y->template mutable_data<float>(),
-          Y->size() / out_sizes_[i],
-          out_sizes_[i]);
-      Y_mat = ConstEigenMatrixMap<float>(
-                  Y->template data<float>(),
-                  out_sizes_[i],
-                  Y->size() / out_sizes_[i])
-                  .transpose()
-                  .eval();
-
-      // Resize operation
-      Y_buf->Resize(Y->dim32(0), Y->dim32(1));
-      context_.template Copy<float, CPUContext, CPUContext>(
-          Y->size(),
-          Y->template data<float>(),
-          Y_buf->template mutable_data<float>());
-
-      cores_idx += curr_rows * curr_cols;
+      const T* core = cores.template data<T>() + cores_idx;
+
+      if (batched_[i]) {
+        // One product per output index, each with the R columns of the core
+        // for that index, so the core is laid out as [M][K][R] first.
+        core_buffer_.Resize(M * K * R);
+        T* core_data = core_buffer_.template mutable_data<T>();
+        for (int k = 0; k < K; ++k) {
+          for (int r = 0; r < R; ++r) {
+            for (int m = 0; m < M; ++m) {
+              core_data[(m * K + k) * R + r] = core[(k * R + r) * M + m];
+            }
+          }
+        }
+        auto* output = &buffers_[buffer];
+        buffer = 1 - buffer;
+        output->Resize(M * P * R);
+        math::GemmBatched<T, Context, Engine>(
+            CblasNoTrans,
+            CblasNoTrans,
+            M,
+            P,
+            R,
+            K,
+            1,
+            input,
+            0,
+            core_data,
+            K * R,
+            0,
+            output->template mutable_data<T>(),
+            P * R,
+            &context_);
+        input = output->template data<T>();
+      } else {
+        // One product to [P][R][M], then moving M to the front. The output
+        // of the last core is moved along with the batch below instead.
+        product_.Resize(P * R * M);
+        math::Gemm<T, Context, Engine>(
+            CblasNoTrans,
+            CblasNoTrans,
+            P,
+            R * M,
+            K,
+            1,
+            input,
+            core,
+            0,
+            product_.template mutable_data<T>(),
+            &context_);
+        input = product_.template data<T>();
+        if (i > 0) {
+          auto* output = &buffers_[buffer];
+          buffer = 1 - buffer;
+          output->Resize(M * P * R);
+          // TODO Add GPU support by writing a generic wrapper.
+          T* output_data = output->template mutable_data<T>();
+          for (int p = 0; p < P; ++p) {
+            for (int r = 0; r < R; ++r) {
+              for (int m = 0; m < M; ++m) {
+                output_data[(m * P + p) * R + r] = input[(p * R + r) * M + m];
+              }
+            }
+          }
+          input = output_data;
+        }
+      }
+
+      size = P * R * M;
+      cores_idx += K * R * M;
     }
 
+    // The output of the first core is [out_sizes_[0]][Q][batch_size] if it
+    // was moved, and [Q][batch_size][out_sizes_[0]] otherwise, with Q the
+    // product of the other out_sizes. Y takes the batch to the front, along
+    // with the bias.
     // TODO Add GPU support by writing a generic wrapper.
-    auto Y_mat = EigenMatrixMap<float>(
-        Y->template mutable_data<float>(), batch_size, Y->size() / batch_size);
-    Y_mat = ConstEigenMatrixMap<float>(
-                Y->template data<float>(), Y->size() / batch_size, batch_size)
-                .transpose()
-                .eval();
-    // TODO Replace by Reshape(), once wrappers are written
-    Y->Resize(batch_size, Y->size() / batch_size);
-
-    // Check that output size of Y is the element-wise product of out_sizes
-    int prod_out_sizes = 1;
-    for (int i = 0; i < out_sizes_.size(); i++) {
-      prod_out_sizes *= out_sizes_[i];
-    }
-    CAFFE_ENFORCE(
-        Y->dim32(1) == prod_out_sizes,
-        "Output dimension of Y: ",
-        Y->dim32(1),
-        ", product of out_sizes: ",
-        prod_out_sizes);
-
-    // Add bias term
-    if (bias_multiplier_.size() != batch_size) {
-      // If the helper bias multiplier is not M, reshape and fill it with one.
-      bias_multiplier_.Resize(batch_size);
-      math::Set<T, Context>(
-          batch_size,
-          static_cast<T>(1),
-          bias_multiplier_.template mutable_data<T>(),
-          &context_);
+    Y->Resize(batch_size, prod_out_sizes);
+    T* Y_data = Y->template mutable_data<T>();
+    const T* b_data = b.template data<T>();
+    const int M = out_sizes_[0];
+    const int Q = prod_out_sizes / M;
+    for (int n = 0; n < batch_size; ++n) {
+      T* Y_row = Y_data + n * prod_out_sizes;
+      for (int m = 0; m < M; ++m) {
+        for (int q = 0; q < Q; ++q) {
+          const int j = m * Q + q;
+          Y_row[j] = b_data[j] +
+              (batched_[0] ? input[j * batch_size + n]
+                           : input[(q * batch_size + n) * M + m]);
+        }
+      }
     }
-    math::Gemm<T, Context, Engine>(
-        CblasNoTrans,
-        CblasNoTrans,
-        Y->dim32(0),
-        Y->dim32(1),
-        1,
-        1,
-        bias_multiplier_.template data<T>(),
-        b.template data<T>(),
-        1,
-        Y->template mutable_data<T>(),
-        &context_);
     return true;
   }
 
  protected:
-  Tensor<Context> bias_multiplier_;
+  // For each core, the product either runs as one GEMM to
+  // [P][tt_ranks_[i]][out_sizes_[i]] followed by a pass that moves the
+  // output index to the front, or as a batch of one GEMM per output index,
+  // which writes that layout directly but reads the input out_sizes_[i]
+  // times with only tt_ranks_[i] columns per product. As P is proportional
+  // to the batch size, the choice is made once, on the cost per row of P:
+  // the multiply-adds, slowed down by products narrower than kFullWidth
+  // columns, plus the floats read and written.
+  void PlanContraction() {
+    const double kFullWidth = 16;
+    const int d = inp_sizes_.size();
+    batched_.resize(d);
+    for (int i = 0; i < d; ++i) {
+      const double K = inp_sizes_[i] * tt_ranks_[i + 1];
+      const double R = tt_ranks_[i];
+      const double M = out_sizes_[i];
+      auto multiply_adds = [&](double width) {
+        return K * R * M * std::max(1.0, kFullWidth / width);
+      };
+      const double batched_cost = multiply_adds(R) + M * K + M * R;
+      const double moved_cost = multiply_adds(R * M) + K + 3 * M * R;
+      batched_[i] = batched_cost < moved_cost;
+    }
+  }
+
   std::vector<int> inp_sizes_;
   std::vector<int> out_sizes_;
   std::vector<int> tt_ranks_;
-  std::unique_ptr<Blob> Y_temp_;
+  std::vector<bool> batched_;
+  Tensor<Context> buffers_[2];
+  Tensor<Context> product_;
+  Tensor<Context> core_buffer_;
 };
 
 // TODO: Complete after verifying utility of TT-layer's forward pass.
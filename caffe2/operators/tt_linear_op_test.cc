@@ -0,0 +1,90 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+void AddRandomTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+}
+
+OperatorDef TTDef(
+    const string& X,
+    const string& Y,
+    const vector<int>& inp_sizes,
+    const vector<int>& out_sizes,
+    const vector<int>& tt_ranks) {
+  OperatorDef def;
+  def.set_type("TT");
+  def.add_input(X);
+  def.add_input("b");
+  def.add_input("cores");
+  def.add_output(Y);
+  AddArgument<vector<int>>("inp_sizes", inp_sizes, &def);
+  AddArgument<vector<int>>("out_sizes", out_sizes, &def);
+  AddArgument<vector<int>>("tt_ranks", tt_ranks, &def);
+  return def;
+}
+
+} // namespace
+
+// Each row of a batch gives the same output as on its own. The large ranks
+// make some cores run as batched products.
+TEST(TTLinearTest, BatchMatchesSingleRows) {
+  std::mt19937 gen(0);
+  const vector<vector<vector<int>>> configs = {
+      {{2, 2, 2, 2}, {2, 2, 2, 2}, {1, 3, 3, 3, 1}},
+      {{3, 4}, {5, 2}, {1, 4, 1}},
+      {{2, 2, 2}, {3, 3, 3}, {1, 32, 32, 1}},
+      {{4}, {6}, {1, 1}}};
+  for (const auto& config : configs) {
+    const auto& inp_sizes = config[0];
+    const auto& out_sizes = config[1];
+    const auto& tt_ranks = config[2];
+    int K = 1;
+    int N = 1;
+    int cores_size = 0;
+    for (int i = 0; i < inp_sizes.size(); ++i) {
+      K *= inp_sizes[i];
+      N *= out_sizes[i];
+      cores_size +=
+          inp_sizes[i] * out_sizes[i] * tt_ranks[i] * tt_ranks[i + 1];
+    }
+    const int batch_size = 5;
+    Workspace ws;
+    AddRandomTensor(&ws, "X", {batch_size, K}, &gen);
+    AddRandomTensor(&ws, "b", {N}, &gen);
+    AddRandomTensor(&ws, "cores", {cores_size}, &gen);
+    ASSERT_TRUE(ws.RunOperatorOnce(
+        TTDef("X", "Y", inp_sizes, out_sizes, tt_ranks)));
+    const auto& X = ws.GetBlob("X")->Get<TensorCPU>();
+    const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+    ASSERT_EQ(Y.dims(), vector<TIndex>({batch_size, N}));
+    for (int n = 0; n < batch_size; ++n) {
+      auto* X_row = ws.CreateBlob("X_row")->GetMutable<TensorCPU>();
+      X_row->Resize(1, K);
+      X_row->ShareExternalPointer(
+          const_cast<float*>(X.data<float>()) + n * K);
+      ASSERT_TRUE(ws.RunOperatorOnce(
+          TTDef("X_row", "Y_row", inp_sizes, out_sizes, tt_ranks)));
+      const auto& Y_row = ws.GetBlob("Y_row")->Get<TensorCPU>();
+      for (int j = 0; j < N; ++j) {
+        EXPECT_NEAR(Y.data<float>()[n * N + j], Y_row.data<float>()[j], 1e-4);
+      }
+    }
+  }
+}
+
+} // namespace caffe2
@@ -1,6 +1,114 @@
 #include "caffe2/operators/utility_ops.h"
 
+#include <cstring>
+
 namespace caffe2 {
+
+namespace {
+
+// How many indices ahead of the row being copied to prefetch the rows of.
+constexpr TIndex kGatherPrefetchDistance = 8;
+// Below that many bytes to copy, threads cost more than they save.
+constexpr size_t kGatherMinParallelBytes = 1 << 18;
+
+inline void PrefetchRow(const char* row, size_t row_bytes) {
+#if defined(__GNUC__)
+  for (size_t offset = 0; offset < row_bytes; offset += 64) {
+    __builtin_prefetch(row + offset, 0 /* read */, 0 /* no reuse */);
+  }
+#endif
+}
+
+// Copies rows [begin, end) of the gather. With a compile time row size, the
+// memcpy of a row compiles to a few vector moves.
+template <size_t kRowBytes, typename Index>
+void GatherRowRange(
+    const char* src,
+    size_t row_bytes,
+    const Index* indices,
+    TIndex num_indices,
+    TIndex begin,
+    TIndex end,
+    char* out) {
+  const size_t bytes = kRowBytes ? kRowBytes : row_bytes;
+  for (TIndex i = begin; i < end; ++i) {
+    if (i + kGatherPrefetchDistance < num_indices) {
+      PrefetchRow(src + indices[i + kGatherPrefetchDistance] * bytes, bytes);
+    }
+    memcpy(out + i * bytes, src + indices[i] * bytes, bytes);
+  }
+}
+
+template <typename Index>
+void GatherRowRange(
+    const char* src,
+    size_t row_bytes,
+    const Index* indices,
+    TIndex num_indices,
+    TIndex begin,
+    TIndex end,
+    char* out) {
+  switch (row_bytes) {
+#define CAFFE2_GATHER_FIXED_ROW_CASE(bytes)                          \
+  case bytes:                                                        \
+    GatherRowRange<bytes>(                                           \
+        src, row_bytes, indices, num_indices, begin, end, out);      \
+    break;
+    CAFFE2_GATHER_FIXED_ROW_CASE(4)
+    CAFFE2_GATHER_FIXED_ROW_CASE(8)
+    CAFFE2_GATHER_FIXED_ROW_CASE(16)
+    CAFFE2_GATHER_FIXED_ROW_CASE(32)
+    CAFFE2_GATHER_FIXED_ROW_CASE(64)
+    CAFFE2_GATHER_FIXED_ROW_CASE(128)
+#undef CAFFE2_GATHER_FIXED_ROW_CASE
+    default:
+      GatherRowRange<0>(src, row_bytes, indices, num_indices, begin, end, out);
+  }
+}
+
+} // namespace
+
+template <typename Index>
+void GatherRowBytes(
+    const char* src,
+    size_t row_bytes,
+    const Index* indices,
+    TIndex num_indices,
+    char* out) {
+  if (num_indices == 0 || row_bytes == 0) {
+    return;
+  }
+#ifdef _OPENMP
+  if (num_indices * row_bytes >= kGatherMinParallelBytes &&
+      omp_get_max_threads() > 1) {
+#pragma omp parallel
+    {
+      // Contiguous ranges keep the writes of a thread sequential.
+      const TIndex threads = omp_get_num_threads();
+      const TIndex thread = omp_get_thread_num();
+      const TIndex begin = num_indices * thread / threads;
+      const TIndex end = num_indices * (thread + 1) / threads;
+      GatherRowRange(src, row_bytes, indices, num_indices, begin, end, out);
+    }
+    return;
+  }
+#endif
+  GatherRowRange(src, row_bytes, indices, num_indices, 0, num_indices, out);
+}
+
+template void GatherRowBytes<int32_t>(
+    const char* src,
+    size_t row_bytes,
+    const int32_t* indices,
+    TIndex num_indices,
+    char* out);
+template void GatherRowBytes<int64_t>(
+    const char* src,
+    size_t row_bytes,
+    const int64_t* indices,
+    TIndex num_indices,
+    char* out);
+
 namespace {
 
 REGISTER_CPU_OPERATOR(WallClockTime, WallClockTimeOp<CPUContext>);
@@ -252,7 +360,9 @@ consequences if the input tensor is accessed concurrently by different op
 on individual slice level, e.g. X_0 scaled by weight_0 but without any
 updates applied.
 
-Currently only works on CPU because of access to INDICES.
+On CUDA, the updates are applied with atomic additions, so the updates of
+duplicated indices are summed in an unspecified order, and weight_0 must be a
+float tensor on the device.
 )DOC")
     .Input(0, "X_0", "Tensor to be updated.")
     .Input(
@@ -301,7 +411,9 @@ assumed to be of shape K x (M / N) regardless of the real shape.
 Note: Each update in INDICES is applied independently which means that if
 duplicated elements are present in INDICES arbitrary one will win.
 
-Currently only works on CPU because of access to INDICES.
+On CUDA, the updates are applied with atomic additions, so the updates of
+duplicated indices are summed in an unspecified order, and weight_0 must be a
+float tensor on the device.
 )DOC")
     .Input(0, "DATA", "Tensor to be updated.")
     .Input(
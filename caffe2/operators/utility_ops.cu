@@ -0,0 +1,266 @@
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/operators/utility_ops.h"
+
+namespace caffe2 {
+
+namespace {
+// Copies rows of DATA to the output, one row per block at a time so that the
+// threads of a block read consecutive words of the row. Word is the widest
+// type that divides the row size, to load up to 16 bytes per thread.
+template <typename Word, typename Index>
+__global__ void GatherKernel(
+    const int num_indices,
+    const TIndex row_words,
+    const TIndex data_rows,
+    const Word* data,
+    const Index* indices,
+    Word* out) {
+  for (int i = blockIdx.x; i < num_indices; i += gridDim.x) {
+    const Index idx = indices[i];
+    CUDA_KERNEL_ASSERT(0 <= idx && idx < data_rows);
+    const Word* src = data + idx * row_words;
+    Word* dst = out + i * row_words;
+    for (TIndex j = threadIdx.x; j < row_words; j += blockDim.x) {
+      dst[j] = src[j];
+    }
+  }
+}
+
+template <typename Word, typename Index>
+void GatherRows(
+    const int num_indices,
+    const size_t row_bytes,
+    const TIndex data_rows,
+    const void* data,
+    const Index* indices,
+    void* out,
+    CUDAContext* context) {
+  const TIndex row_words = row_bytes / sizeof(Word);
+  const int threads = std::min<TIndex>(
+      CAFFE_CUDA_NUM_THREADS, (row_words + 31) / 32 * 32);
+  GatherKernel<Word, Index><<<
+      std::min(num_indices, CAFFE_MAXIMUM_NUM_BLOCKS),
+      threads,
+      0,
+      context->cuda_stream()>>>(
+      num_indices,
+      row_words,
+      data_rows,
+      static_cast<const Word*>(data),
+      indices,
+      static_cast<Word*>(out));
+}
+
+template <typename Index>
+bool GatherOnDevice(
+    const TensorCUDA& data,
+    const TensorCUDA& indices,
+    TensorCUDA* output,
+    CUDAContext* context) {
+  CAFFE_ENFORCE_GE(data.ndim(), 1, "DATA should be at least 1-D");
+  CAFFE_ENFORCE(
+      data.meta().copy() == nullptr,
+      "Gather on CUDA only supports types that can be copied bytewise");
+  auto shape = indices.dims();
+  shape.insert(shape.end(), data.dims().begin() + 1, data.dims().end());
+  output->Resize(shape);
+  void* out = output->raw_mutable_data(data.meta());
+  const size_t row_bytes = data.size_from_dim(1) * data.meta().itemsize();
+  const int num_indices = indices.size();
+  if (num_indices == 0 || row_bytes == 0) {
+    return true;
+  }
+  const Index* idxs = indices.template data<Index>();
+  // Device allocations are at least 16 byte aligned, so rows are aligned to
+  // any word size that divides the row size.
+  if (row_bytes % 16 == 0) {
+    GatherRows<int4>(
+        num_indices, row_bytes, data.dim(0), data.raw_data(), idxs, out,
+        context);
+  } else if (row_bytes % 8 == 0) {
+    GatherRows<int2>(
+        num_indices, row_bytes, data.dim(0), data.raw_data(), idxs, out,
+        context);
+  } else if (row_bytes % 4 == 0) {
+    GatherRows<int>(
+        num_indices, row_bytes, data.dim(0), data.raw_data(), idxs, out,
+        context);
+  } else if (row_bytes % 2 == 0) {
+    GatherRows<short>(
+        num_indices, row_bytes, data.dim(0), data.raw_data(), idxs, out,
+        context);
+  } else {
+    GatherRows<char>(
+        num_indices, row_bytes, data.dim(0), data.raw_data(), idxs, out,
+        context);
+  }
+  return true;
+}
+} // namespace
+
+template <>
+bool GatherOp<CUDAContext>::RunOnDevice() {
+  const auto& indices = Input(INDICES);
+  if (indices.IsType<int32_t>()) {
+    return GatherOnDevice<int32_t>(Input(DATA), indices, Output(0), &context_);
+  }
+  CAFFE_ENFORCE(
+      indices.IsType<int64_t>(),
+      "Unsupported type of INDICES: ",
+      indices.meta().name());
+  return GatherOnDevice<int64_t>(Input(DATA), indices, Output(0), &context_);
+}
+
+namespace {
+// Counts how many times each row of X_0 is indexed, if weight_0 is not 1.
+template <typename Index>
+__global__ void CountScatterRowsKernel(
+    const int num_indices,
+    const TIndex data_rows,
+    const Index* indices,
+    const float* weight0,
+    int* counts) {
+  if (*weight0 == 1.f) {
+    return;
+  }
+  CUDA_1D_KERNEL_LOOP(i, num_indices) {
+    CUDA_KERNEL_ASSERT(0 <= indices[i] && indices[i] < data_rows);
+    atomicAdd(counts + indices[i], 1);
+  }
+}
+
+// Scales each counted row once by weight_0 to the power of its count, which
+// is what scaling it for every index does, and resets the counts to 0.
+template <typename Index>
+__global__ void ScaleScatterRowsKernel(
+    const int num_indices,
+    const TIndex block_size,
+    const Index* indices,
+    const float* weight0,
+    int* counts,
+    float* data) {
+  if (*weight0 == 1.f) {
+    return;
+  }
+  __shared__ int count;
+  for (int i = blockIdx.x; i < num_indices; i += gridDim.x) {
+    const Index idx = indices[i];
+    if (threadIdx.x == 0) {
+      count = atomicExch(counts + idx, 0);
+    }
+    __syncthreads();
+    if (count > 0) {
+      const float scale = powf(*weight0, count);
+      for (TIndex j = threadIdx.x; j < block_size; j += blockDim.x) {
+        data[idx * block_size + j] *= scale;
+      }
+    }
+    __syncthreads();
+  }
+}
+
+template <typename Index>
+__global__ void ScatterAxpyKernel(
+    const int num_indices,
+    const TIndex block_size,
+    const TIndex data_rows,
+    const Index* indices,
+    const float* weight,
+    const float* x,
+    float* data) {
+  const float w = *weight;
+  for (int i = blockIdx.x; i < num_indices; i += gridDim.x) {
+    const Index idx = indices[i];
+    CUDA_KERNEL_ASSERT(0 <= idx && idx < data_rows);
+    for (TIndex j = threadIdx.x; j < block_size; j += blockDim.x) {
+      atomicAdd(data + idx * block_size + j, w * x[i * block_size + j]);
+    }
+  }
+}
+} // namespace
+
+// ScatterWeightedSum on CUDA. The slices of all the inputs are added at once
+// with atomics, so the updates of duplicated indices are summed in any order.
+// The weights are read on the device, so the op never waits for the GPU.
+class CUDAScatterWeightedSumOp final : public Operator<CUDAContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CUDAContext);
+  CUDAScatterWeightedSumOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CUDAContext>(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(this, Input(2));
+  }
+
+  template <typename Index>
+  bool DoRunWithType() {
+    CAFFE_ENFORCE_EQ(InputSize() % 2, 1);
+    auto& X0 = Input(0);
+    auto& weight0 = Input(1);
+    auto& indices = Input(2);
+    auto* output = Output(0);
+    CAFFE_ENFORCE_EQ(&X0, output, "In place operation is required");
+    CAFFE_ENFORCE_GT(X0.ndim(), 0, "X0 has to be at least the vector");
+    CAFFE_ENFORCE_EQ(weight0.size(), 1);
+    const TIndex N = X0.dim(0);
+    const int K = indices.size();
+    const TIndex block_size = N > 0 ? X0.size() / N : 0;
+    if (K == 0 || block_size == 0) {
+      return true;
+    }
+    float* data = output->template mutable_data<float>();
+    const Index* idxs = indices.template data<Index>();
+    const int threads = std::min<TIndex>(
+        CAFFE_CUDA_NUM_THREADS, (block_size + 31) / 32 * 32);
+    const int blocks = std::min(K, CAFFE_MAXIMUM_NUM_BLOCKS);
+
+    // The counts are all 0 between runs.
+    if (counts_.size() != N) {
+      counts_.Resize(N);
+      math::Set<int, CUDAContext>(
+          N, 0, counts_.template mutable_data<int>(), &context_);
+    }
+    CountScatterRowsKernel<Index><<<
+        CAFFE_GET_BLOCKS(K),
+        CAFFE_CUDA_NUM_THREADS,
+        0,
+        context_.cuda_stream()>>>(
+        K, N, idxs, weight0.template data<float>(),
+        counts_.template mutable_data<int>());
+    ScaleScatterRowsKernel<Index>
+        <<<blocks, threads, 0, context_.cuda_stream()>>>(
+            K,
+            block_size,
+            idxs,
+            weight0.template data<float>(),
+            counts_.template mutable_data<int>(),
+            data);
+
+    for (int inp = 3; inp < InputSize(); inp += 2) {
+      auto& X = Input(inp);
+      auto& weight = Input(inp + 1);
+      CAFFE_ENFORCE_EQ(X.size(), block_size * K);
+      CAFFE_ENFORCE_EQ(weight.size(), 1);
+      ScatterAxpyKernel<Index>
+          <<<blocks, threads, 0, context_.cuda_stream()>>>(
+              K,
+              block_size,
+              N,
+              idxs,
+              weight.template data<float>(),
+              X.template data<float>(),
+              data);
+    }
+    return true;
+  }
+
+ private:
+  // How many times each row of X_0 is indexed in the current run.
+  Tensor<CUDAContext> counts_;
+};
+
+namespace {
+REGISTER_CUDA_OPERATOR(Gather, GatherOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(ScatterWeightedSum, CUDAScatterWeightedSumOp);
+} // namespace
+} // namespace caffe2
@@ -3,9 +3,11 @@
 
 #include "caffe2/core/common_omp.h"
 #include "caffe2/core/context.h"
+#include "caffe2/core/dirty_rows.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/utils/math.h"
+#include "caffe2/utils/radix_sort.h"
 
 namespace caffe2 {
 
@@ -201,6 +203,11 @@ class SumOp : public Operator<Context> {
   USE_SIMPLE_CTOR_DTOR(SumOp);
 
   bool RunOnDevice() override {
+    return DoRunWithType<T>();
+  }
+
+  template <typename DstType>
+  bool DoRunWithType() {
     auto& input0 = Input(0);
     auto* output = Output(0);
     if (InputSize() == 1) {
@@ -208,7 +215,7 @@ class SumOp : public Operator<Context> {
       return true;
     }
     output->ResizeLike(input0);
-    T* output_data = output->template mutable_data<T>();
+    DstType* output_data = output->template mutable_data<DstType>();
     // Dimension checking
     for (int i = 1; i < InputSize(); ++i) {
       if (output->dims() != Input(i).dims()) {
@@ -226,8 +233,8 @@ class SumOp : public Operator<Context> {
     // Add the first two - works if in-place or not.
     math::Add(
         output->size(),
-        input0.template data<T>(),
-        Input(1).template data<T>(),
+        input0.template data<DstType>(),
+        Input(1).template data<DstType>(),
         output_data,
         &context_);
     // Add remaining.
@@ -235,7 +242,7 @@ class SumOp : public Operator<Context> {
       math::Add(
           output->size(),
           output_data,
-          Input(i).template data<T>(),
+          Input(i).template data<DstType>(),
           output_data,
           &context_);
     }
@@ -554,6 +561,7 @@ class ScatterAssignOp : public Operator<Context> {
       context_.template Copy<T, Context, Context>(
           block_size, slicesData + block_size * i, data + block_size * idx);
     }
+    DirtyRowTracker::Get()->MarkRows(OperatorBase::OutputBlob(0), idxs, K);
   }
 
   INPUT_TAGS(DATA, INDICES, SLICES);
@@ -569,11 +577,13 @@ class CopyOp : public Operator<Context> {
     auto& input = OperatorBase::Input<Tensor<SrcContext>>(0);
     auto* output = OperatorBase::Output<Tensor<DstContext>>(0);
     output->ResizeLike(input);
+    // CPU outputs of device copies are pinned, so that the copies can run
+    // asynchronously.
+    void* output_data = std::is_same<Context, CPUContext>::value
+        ? output->raw_mutable_data(input.meta())
+        : PinnedRawMutableData(output, input.meta());
     this->context_.template CopyItems<SrcContext, DstContext>(
-        input.meta(),
-        input.size(),
-        input.raw_data(),
-        output->raw_mutable_data(input.meta()));
+        input.meta(), input.size(), input.raw_data(), output_data);
     return true;
   }
 };
@@ -1231,6 +1241,19 @@ class ExpandDimsOp : public Operator<Context> {
   vector<int> dims_;
 };
 
+// Copies the rows of src picked by indices to consecutive rows of out, for
+// types without a copy function. Row ranges go to OpenMP threads when there
+// are enough bytes to copy, the rows of upcoming indices are prefetched, and
+// small power of two row sizes are copied with fixed size moves. The indices
+// must be in range.
+template <typename Index>
+void GatherRowBytes(
+    const char* src,
+    size_t row_bytes,
+    const Index* indices,
+    TIndex num_indices,
+    char* out);
+
 template <class Context>
 class GatherOp : public Operator<Context> {
  public:
@@ -1271,7 +1294,14 @@ class GatherOp : public Operator<Context> {
       CAFFE_ENFORCE(
           0 <= idx && idx < data.dim(0),
           "INDICES element is out of DATA bounds");
-      auto src = src_base + idx * block_bytesize;
+    }
+    if (std::is_same<Context, CPUContext>::value &&
+        data.meta().copy() == nullptr) {
+      GatherRowBytes(src_base, block_bytesize, idxs, N, out);
+      return true;
+    }
+    for (int i = 0; i < N; ++i) {
+      auto src = src_base + idxs[i] * block_bytesize;
       context_.template CopyItems<Context, Context>(
           data.meta(), block_size, src, out + block_bytesize * i);
     }
@@ -1388,6 +1418,9 @@ class UniqueOp : public Operator<Context> {
 
  private:
   vector<int> order_;
+  vector<int> orderTmp_;
+  vector<uint64_t> keys_;
+  vector<uint64_t> keysTmp_;
 
   template <typename T>
   void DoRun() {
@@ -1404,25 +1437,29 @@ class UniqueOp : public Operator<Context> {
       remapping = remappingTensor->template mutable_data<int>();
     }
 
+    // Radix sort (key, position) pairs; equal keys keep their input order.
     const T* input = inputTensor.template data<T>();
-    // TODO(dzhulgakov): if perf becomes an issue consider doing hash table
-    // instead of sorting
+    keys_.resize(N);
+    keysTmp_.resize(N);
     order_.resize(N);
-    std::iota(order_.begin(), order_.end(), 0);
-    std::sort(order_.begin(), order_.end(), [input](const int x, const int y) {
-      return input[x] < input[y];
-    });
+    orderTmp_.resize(N);
+    for (int i = 0; i < N; ++i) {
+      keys_[i] = RadixKey<int64_t>(input[i]);
+      order_[i] = i;
+    }
+    RadixSortPairs<uint64_t, int>(
+        N, keys_.data(), order_.data(), keysTmp_.data(), orderTmp_.data());
+
     int K = N;
     for (int i = 1; i < N; ++i) {
-      K -= input[order_[i]] == input[order_[i - 1]];
+      K -= keys_[i] == keys_[i - 1];
     }
     uniqueTensor->Resize(K);
     T* unique = uniqueTensor->template mutable_data<T>();
     K = 0;
-    T prev = -1;
     for (int i = 0; i < N; ++i) {
-      if (i == 0 || prev != input[order_[i]]) {
-        prev = unique[K++] = input[order_[i]];
+      if (i == 0 || keys_[i] != keys_[i - 1]) {
+        unique[K++] = static_cast<T>(FromRadixKey<int64_t>(keys_[i]));
       }
       if (remapping) {
         remapping[order_[i]] = K - 1;
@@ -25,6 +25,21 @@ class CopyOnDeviceLikeOp<CUDAContext, CUDAContext, CUDAContext>
   }
 };
 
+// On CUDA, Sum also accumulates the float16 gradients of mixed precision nets.
+class CUDASumOp final : public SumOp<float, CUDAContext> {
+ public:
+  CUDASumOp(const OperatorDef& operator_def, Workspace* ws)
+      : SumOp<float, CUDAContext>(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+#ifdef CAFFE_HAS_CUDA_FP16
+    return DispatchHelper<TensorTypes<float, float16>>::call(this, Input(0));
+#else
+    return DoRunWithType<float>();
+#endif
+  }
+};
+
 namespace {
 
 REGISTER_CUDA_OPERATOR(Print, PrintOp<CUDAContext>);
@@ -35,7 +50,7 @@ REGISTER_CUDA_OPERATOR(ExpandDims, ExpandDimsOp<CUDAContext>);
 REGISTER_CUDA_OPERATOR(Alias, AliasOp<CUDAContext>);
 REGISTER_CUDA_OPERATOR(ResizeLike, ResizeLikeOp<CUDAContext>);
 REGISTER_CUDA_OPERATOR(Reshape, ReshapeOp<float, CUDAContext>);
-REGISTER_CUDA_OPERATOR(Sum, SumOp<float, CUDAContext>);
+REGISTER_CUDA_OPERATOR(Sum, CUDASumOp);
 REGISTER_CUDA_OPERATOR(WeightedSum, WeightedSumOp<float, CUDAContext>);
 REGISTER_CUDA_OPERATOR(Shape, ShapeOp<CUDAContext>);
 // From whatever the current context, ensure the output is TensorCPU
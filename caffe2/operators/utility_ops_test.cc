@@ -51,4 +51,69 @@ TEST(UtilityOpTest, testEnsureCPUOutput) {
   }
 }
 
+template <typename Index>
+static void ExpectGatheredRows(int row_size, int num_indices) {
+  const int kNumRows = 1000;
+  Workspace ws;
+  auto* data = ws.CreateBlob("data")->GetMutable<TensorCPU>();
+  data->Resize(kNumRows, row_size);
+  for (int i = 0; i < data->size(); ++i) {
+    data->mutable_data<float>()[i] = i;
+  }
+  auto* indices = ws.CreateBlob("indices")->GetMutable<TensorCPU>();
+  indices->Resize(num_indices);
+  auto* index_data = indices->mutable_data<Index>();
+  for (int i = 0; i < num_indices; ++i) {
+    index_data[i] = (i * 7919) % kNumRows;
+  }
+  OperatorDef def;
+  def.set_type("Gather");
+  def.add_input("data");
+  def.add_input("indices");
+  def.add_output("output");
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& output = ws.GetBlob("output")->Get<TensorCPU>();
+  ASSERT_EQ(output.dims(), vector<TIndex>({num_indices, row_size}));
+  for (int i = 0; i < num_indices; ++i) {
+    const int row = (i * 7919) % kNumRows;
+    for (int j = 0; j < row_size; ++j) {
+      ASSERT_EQ(output.data<float>()[i * row_size + j], row * row_size + j);
+    }
+  }
+}
+
+TEST(UtilityOpTest, testGather) {
+  // Rows with fixed size copies and without, in batches small enough to be
+  // copied serially and large enough to be split across threads.
+  for (int row_size : {1, 3, 4, 16, 33}) {
+    for (int num_indices : {0, 10, 50000}) {
+      ExpectGatheredRows<int32_t>(row_size, num_indices);
+      ExpectGatheredRows<int64_t>(row_size, num_indices);
+    }
+  }
+}
+
+TEST(UtilityOpTest, testGatherStrings) {
+  Workspace ws;
+  auto* data = ws.CreateBlob("data")->GetMutable<TensorCPU>();
+  data->Resize(3);
+  auto* strings = data->mutable_data<std::string>();
+  strings[0] = "a";
+  strings[1] = "b";
+  strings[2] = "c";
+  auto* indices = ws.CreateBlob("indices")->GetMutable<TensorCPU>();
+  indices->Resize(2);
+  indices->mutable_data<int32_t>()[0] = 2;
+  indices->mutable_data<int32_t>()[1] = 0;
+  OperatorDef def;
+  def.set_type("Gather");
+  def.add_input("data");
+  def.add_input("indices");
+  def.add_output("output");
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& output = ws.GetBlob("output")->Get<TensorCPU>();
+  EXPECT_EQ(output.data<std::string>()[0], "c");
+  EXPECT_EQ(output.data<std::string>()[1], "a");
+}
+
 } // namespace caffe2
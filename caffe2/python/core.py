@@ -560,7 +560,7 @@ class IR(object):
 
         return input_name + '_grad'
 
-    def _SetSumOpsDeviceOption(self, sum_ops, generators):
+    def _GetSumOpsDeviceOption(self, generators):
         # we already checked that device options are consistent so we can just
         # use the first one we find
         for generator in generators:
@@ -568,9 +568,15 @@ class IR(object):
                 else generator.grad_op_values or generator.grad_op_indices
             if grad_op:
                 if grad_op.HasField('device_option'):
-                    for op in sum_ops:
-                        op.device_option.CopyFrom(grad_op.device_option)
+                    return grad_op.device_option
                 break
+        return None
+
+    def _SetSumOpsDeviceOption(self, sum_ops, generators):
+        device_option = self._GetSumOpsDeviceOption(generators)
+        if device_option is not None:
+            for op in sum_ops:
+                op.device_option.CopyFrom(device_option)
 
     def _DisambiguateGradOpOutput(self, grad_op, idx, cnt):
         grad_op.output[idx] = (
@@ -585,27 +591,51 @@ class IR(object):
                 'be the same as the normal name of the current '
                 'input gradient.')
 
+    def _AccumulationAllowed(self, grad_op, idx):
+        schema = C.OpSchema.get(grad_op.type)
+        return schema is not None and \
+            idx in schema.accumulation_allowed_outputs
+
     def _MakeDenseSumOps(self, generators, out_base_name):
         sum_op_input = []
         cnt = 0
 
+        # The generators are in the order of their gradient ops. If a later
+        # gradient op can add its gradient to the one of the first, it does
+        # so in place, and only the remaining gradients are summed.
+        writers = [g for g in generators if g.grad_op]
+        first = writers[0] if writers else None
+        accumulate = first is not None and any(
+            g.grad_op is not first.grad_op and
+            self._AccumulationAllowed(g.grad_op, g.idx)
+            for g in writers[1:])
+
         for generator in generators:
             grad_op, idx, g = generator
             assert(type(g) is not GradientSlice)
-            if grad_op:
+            if accumulate and generator is first:
+                sum_op_input.append(grad_op.output[idx])
+            elif accumulate and grad_op and \
+                    grad_op is not first.grad_op and \
+                    self._AccumulationAllowed(grad_op, idx):
+                grad_op.arg.extend([
+                    utils.MakeArgument('accumulate_outputs', [idx])])
+            elif grad_op:
                 out, cnt = self._DisambiguateGradOpOutput(grad_op, idx, cnt)
                 sum_op_input.append(out)
             else:
                 self._CheckSumOpsConflict(out_base_name, g)
                 sum_op_input.append(str(g))
 
+        if sum_op_input == [out_base_name]:
+            return [], out_base_name
         sum_ops = [CreateOperator(
             "Sum",
             map(BlobReference, sum_op_input),
             BlobReference(out_base_name))]
         return sum_ops, out_base_name
 
-    def _MakeSparseSumOps(self, generators, out_base_name):
+    def _GetSparseSumInputs(self, generators, out_base_name):
         indices_concat_input = []
         values_concat_input = []
         cnt_i = 0
@@ -626,15 +656,51 @@ class IR(object):
             else:
                 self._CheckSumOpsConflict(out_base_name, g.values)
                 values_concat_input.append(g.values)
+        return indices_concat_input, values_concat_input
+
+    def _SumOnCPU(self, input_name, input_version, generators):
+        # Without gradient ops, such as for Gather, the sum runs on the device
+        # of the forward ops.
+        device_option = self._GetSumOpsDeviceOption(generators)
+        if device_option is None:
+            for op_idx in self.input_usages[input_name][input_version]:
+                op = self.ssa[op_idx].op
+                if op.HasField('device_option'):
+                    device_option = op.device_option
+                    break
+        return device_option is None or \
+            device_option.device_type == caffe2_pb2.CPU
+
+    def _MakeSparseSumOps(self, generators, out_base_name, on_cpu):
+        indices_concat_input, values_concat_input = self._GetSparseSumInputs(
+            generators, out_base_name)
+        if on_cpu:
+            # Merge the rows of duplicate indices, so that the sum has no more
+            # rows than the parameter.
+            indices_sum_output = out_base_name + '_indices_sum'
+            values_sum_output = out_base_name + '_values_sum'
+            sum_ops = [CreateOperator(
+                "SparseSum",
+                map(BlobReference, [
+                    blob
+                    for pair in zip(indices_concat_input, values_concat_input)
+                    for blob in pair
+                ]),
+                map(BlobReference, [indices_sum_output, values_sum_output]),
+            )]
+            return sum_ops, GradientSlice(
+                indices=indices_sum_output,
+                values=values_sum_output,
+            )
 
         indices_concat_output = out_base_name + '_indices_concat'
         indices_concat_split = out_base_name + '_indices_concat_split'
         values_concat_output = out_base_name + '_values_concat'
         values_concat_split = out_base_name + '_values_concat_split'
-        # Sum the given sparse representations by simply concatenating the
-        # indices (resp. values) tensors together. We don't do any deduplication
-        # of indices at this point. This will be done as needed before the
-        # optimizer is called
+        # SparseSum only runs on CPU: on other devices, sum the given sparse
+        # representations by simply concatenating the indices (resp. values)
+        # tensors together. We don't do any deduplication of indices at this
+        # point. This will be done as needed before the optimizer is called
         sum_ops = [
             CreateOperator(
                 "Concat",
@@ -656,39 +722,57 @@ class IR(object):
         )
         return sum_ops, sum_op_output
 
+    def _MakeMixedSumOps(self, generators, out_base_name):
+        # The sum of dense and sparse gradients is dense: the sparse ones are
+        # added in place to the sum of the dense ones, without densifying them.
+        dense = [g for g in generators if type(g) is GradGenMeta]
+        sparse = [g for g in generators if type(g) is SparseGradGenMeta]
+        sum_ops, _ = self._MakeDenseSumOps(dense, out_base_name)
+        indices, values = self._GetSparseSumInputs(sparse, out_base_name)
+        one = out_base_name + '_sparse_sum_one'
+        sum_ops.append(CreateOperator(
+            "ConstantFill", [], BlobReference(one), shape=[1], value=1.0))
+        for i, v in zip(indices, values):
+            sum_ops.append(CreateOperator(
+                "ScatterWeightedSum",
+                map(BlobReference, [out_base_name, one, i, v, one]),
+                BlobReference(out_base_name)))
+        return sum_ops, out_base_name
+
     def _MakeSumOps(self, input_name, input_version):
         generators = self.gradient_generators[input_name][input_version]
-        out_base_name = self._GetSumOpOutputName(generators, input_name)
-        types = list(set(type(x) for x in generators))
-        assert(len(types) == 1)
-        if types[0] is GradGenMeta:
+        types = set(type(x) for x in generators)
+        if types == {GradGenMeta}:
+            out_base_name = self._GetSumOpOutputName(generators, input_name)
             sum_ops, g = self._MakeDenseSumOps(generators, out_base_name)
+        elif types == {SparseGradGenMeta}:
+            out_base_name = self._GetSumOpOutputName(generators, input_name)
+            sum_ops, g = self._MakeSparseSumOps(
+                generators, out_base_name,
+                self._SumOnCPU(input_name, input_version, generators))
         else:
-            assert(types[0] is SparseGradGenMeta)
-            sum_ops, g = self._MakeSparseSumOps(generators, out_base_name)
+            out_base_name = self._GetSumOpOutputName(
+                [x for x in generators if type(x) is GradGenMeta], input_name)
+            sum_ops, g = self._MakeMixedSumOps(generators, out_base_name)
         self._SetSumOpsDeviceOption(sum_ops, generators)
         return sum_ops, g
 
     def _VerifyGradientGenerators(self, generator):
-        # (1) check if all gradients are of the same type. Aggregating a mix of
-        # sparse and dense gradients is not supported yet
-        if len({type(g) for g in generator}) > 1:
-            raise RuntimeError(
-                'Automatic aggregation of a mix of sparse and dense gradients '
-                'is not supported yet')
-
         # If for all the operators that used the operator, none or only one
         # produced the gradient, then no additional sum needs to be carried
         # out.
         if len(generator) < 2:
             return False
 
-        all_gradient_names = []
+        # The dense and the sparse gradients are named apart, as a mix of them
+        # is summed into the dense one.
+        dense_gradient_names = []
+        sparse_gradient_names = []
         all_device_options = []
         for g in generator:
             if type(g) is GradGenMeta:
                 if g.grad_op:
-                    all_gradient_names.append(g.gradient)
+                    dense_gradient_names.append(g.gradient)
                     all_device_options.append(g.grad_op.device_option)
             else:
                 assert(type(g) is SparseGradGenMeta)
@@ -696,10 +780,11 @@ class IR(object):
                     all_device_options.append(g.grad_op_indices.device_option)
                 if g.grad_op_values:
                     all_device_options.append(g.grad_op_values.device_option)
-                    all_gradient_names.append(g.gradient.values)
+                    sparse_gradient_names.append(g.gradient.values)
 
         # Check if all grad names are the same.
-        if len(set(all_gradient_names)) > 1:
+        if len(set(dense_gradient_names)) > 1 or \
+                len(set(sparse_gradient_names)) > 1:
             raise RuntimeError('Unexpected behavior: not all grad output '
                                'names are the same.')
         # Check if all grad op device options are the same.
@@ -726,7 +811,10 @@ class IR(object):
         created gradients with an internal intermediate name, and then add a
         Sum() operator that adds up all the gradients. This may use more memory
         due to intermediate storage, but is usually the fastest approach as one
-        can do one single sum for multiple intermediate gradients.
+        can do one single sum for multiple intermediate gradients. The gradient
+        operators whose schema allows accumulating the gradient, such as
+        FCGradient, instead add it in place to the one of the first gradient
+        operator, without an intermediate blob.
         """
         forward_op, in_versions, out_versions = self.ssa[fwd_op_idx]
         additional_sum_ops = []
@@ -1833,6 +1921,21 @@ class ExecutionStep(object):
         assert not self.HasNets(), 'Cannot have both network and substeps.'
         self._step.concurrent_substeps = concurrent_substeps
 
+    def SetMaxConcurrentSubsteps(self, max_concurrent_substeps):
+        self._assert_can_mutate()
+        assert not self.HasNets(), 'Cannot have both network and substeps.'
+        self._step.max_concurrent_substeps = max_concurrent_substeps
+
+    def SetPinSubstepsToCores(self, pin_substeps_to_cores):
+        self._assert_can_mutate()
+        assert not self.HasNets(), 'Cannot have both network and substeps.'
+        self._step.pin_substeps_to_cores = pin_substeps_to_cores
+
+    def SetSubstepTimingBlob(self, substep_timing_blob):
+        self._assert_can_mutate()
+        assert not self.HasNets(), 'Cannot have both network and substeps.'
+        self._step.substep_timing_blob = str(substep_timing_blob)
+
     def AddNet(self, net):
         self._assert_can_mutate()
         assert not self.HasSubsteps(), 'Cannot have both network and substeps.'
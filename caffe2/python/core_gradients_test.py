@@ -290,6 +290,81 @@ class TestGradientCalculation(test_util.TestCase):
             operators, {"out": "out_grad"})
         self.assertEqual(gradients, desired_grad_operators)
 
+    def testMultiUseInputAccumulatesInPlace(self):
+        """The gradients of an input shared by FCs are accumulated in place
+        by FCGradient, whose schema allows it, instead of with a Sum.
+
+        in -> hidden1, in -> hidden2 (FC)
+        hidden1, hidden2, in -> out
+        """
+        operators = [
+            CreateOperator('FC', ['in', 'w1', 'b1'], 'hidden1'),
+            CreateOperator('FC', ['in', 'w2', 'b2'], 'hidden2'),
+            CreateOperator('Direct', ['hidden1', 'hidden2', 'in'], 'out'),
+        ]
+        desired_grad_operators = [
+            CreateOperator(
+                'DirectGradient',
+                'out_grad',
+                ['hidden1_grad', 'hidden2_grad', 'in_grad'],
+            ),
+            CreateOperator(
+                'FCGradient',
+                ['in', 'w2', 'hidden2_grad'],
+                ['w2_grad', 'b2_grad', 'in_grad'],
+                accumulate_outputs=[2],
+            ),
+            CreateOperator(
+                'FCGradient',
+                ['in', 'w1', 'hidden1_grad'],
+                ['w1_grad', 'b1_grad', 'in_grad'],
+                accumulate_outputs=[2],
+            ),
+        ]
+        gradients, _ = GradientRegistry.GetBackwardPass(
+            operators, {"out": "out_grad"})
+        self.assertEqual(gradients, desired_grad_operators)
+
+    def testMultiUseInputAccumulatesPartlyInPlace(self):
+        """The gradients that cannot be accumulated in place are summed with
+        the one that the others were accumulated into.
+
+        in -> hidden0 (Direct), in -> hidden1, in -> hidden2 (FC)
+        hidden0, hidden1, hidden2 -> out
+        """
+        operators = [
+            CreateOperator('Direct', 'in', 'hidden0'),
+            CreateOperator('FC', ['in', 'w1', 'b1'], 'hidden1'),
+            CreateOperator('FC', ['in', 'w2', 'b2'], 'hidden2'),
+            CreateOperator(
+                'Direct', ['hidden0', 'hidden1', 'hidden2'], 'out'),
+        ]
+        desired_grad_operators = [
+            CreateOperator(
+                'DirectGradient',
+                'out_grad',
+                ['hidden0_grad', 'hidden1_grad', 'hidden2_grad'],
+            ),
+            CreateOperator(
+                'FCGradient',
+                ['in', 'w2', 'hidden2_grad'],
+                ['w2_grad', 'b2_grad', 'in_grad'],
+            ),
+            CreateOperator(
+                'FCGradient',
+                ['in', 'w1', 'hidden1_grad'],
+                ['w1_grad', 'b1_grad', 'in_grad'],
+                accumulate_outputs=[2],
+            ),
+            CreateOperator(
+                'DirectGradient', 'hidden0_grad', '_in_grad_autosplit_0'),
+            CreateOperator(
+                'Sum', ['in_grad', '_in_grad_autosplit_0'], 'in_grad'),
+        ]
+        gradients, _ = GradientRegistry.GetBackwardPass(
+            operators, {"out": "out_grad"})
+        self.assertEqual(gradients, desired_grad_operators)
+
     def testMultiUseInputButWithNoGradient(self):
         """Test gradient for the following case:
 
@@ -525,14 +600,11 @@ class TestSparseGradientsAccumulation(test_util.TestCase):
         net.Gather(["x2", "x3"], "x5")
         net.DotProduct(["x4", "x5"], "x6")
         net.AddGradientOperators(["x6"])
-        sum_op_i = net.Proto().op[-2]
-        sum_op_v = net.Proto().op[-1]
-        self.assertEqual(sum_op_i.input[0], "x3")
-        self.assertEqual(sum_op_i.input[1], "x1")
-        self.assertEqual(sum_op_i.output[0], "x2_grad_indices_concat")
-        self.assertEqual(sum_op_v.input[0], "x5_grad")
-        self.assertEqual(sum_op_v.input[1], "x4_grad")
-        self.assertEqual(sum_op_v.output[0], "x2_grad_values_concat")
+        sum_op = net.Proto().op[-1]
+        self.assertEqual(sum_op.type, "SparseSum")
+        self.assertEqual(sum_op.input, ["x3", "x5_grad", "x1", "x4_grad"])
+        self.assertEqual(
+            sum_op.output, ["x2_grad_indices_sum", "x2_grad_values_sum"])
 
     def testSparseAccumulationWithIndicesAndValues(self):
         # The gradient for "SparseFunHash" computes both indices and values
@@ -555,14 +627,54 @@ class TestSparseGradientsAccumulation(test_util.TestCase):
         net.SparseFunHash(["x5", "x6", "x7", "x4"], "x9")
         net.DotProduct(["x8", "x9"], "x10")
         net.AddGradientOperators(["x10"])
+        sum_op = net.Proto().op[-1]
+        self.assertEqual(sum_op.type, "SparseSum")
+        self.assertEqual(sum_op.input, [
+            "_x4_grad_indices_autosplit_0", "_x4_grad_values_autosplit_0",
+            "_x4_grad_indices_autosplit_1", "_x4_grad_values_autosplit_1"])
+        self.assertEqual(
+            sum_op.output, ["x4_grad_indices_sum", "x4_grad_values_sum"])
+
+    def testSparseAccumulationOnGPU(self):
+        # SparseSum only runs on CPU, so the gradients are concatenated.
+        net = core.Net("test_net")
+        with core.DeviceScope(core.DeviceOption(caffe2_pb2.CUDA, 0)):
+            net.Gather(["x2", "x1"], "x4")
+            net.Gather(["x2", "x3"], "x5")
+            net.DotProduct(["x4", "x5"], "x6")
+            net.AddGradientOperators(["x6"])
         sum_op_i = net.Proto().op[-2]
         sum_op_v = net.Proto().op[-1]
-        self.assertEqual(sum_op_i.input[0], "_x4_grad_indices_autosplit_0")
-        self.assertEqual(sum_op_i.input[1], "_x4_grad_indices_autosplit_1")
-        self.assertEqual(sum_op_i.output[0], "x4_grad_indices_concat")
-        self.assertEqual(sum_op_v.input[0], "_x4_grad_values_autosplit_0")
-        self.assertEqual(sum_op_v.input[1], "_x4_grad_values_autosplit_1")
-        self.assertEqual(sum_op_v.output[0], "x4_grad_values_concat")
+        self.assertEqual(sum_op_i.type, "Concat")
+        self.assertEqual(sum_op_i.output[0], "x2_grad_indices_concat")
+        self.assertEqual(sum_op_v.type, "Concat")
+        self.assertEqual(sum_op_v.output[0], "x2_grad_values_concat")
+
+
+class TestMixedGradientsAccumulation(test_util.TestCase):
+    def testMixedAccumulation(self):
+        # The sparse gradient of Gather is added to the dense one of Relu.
+        #
+        # x1-->Gather-->x4-->
+        #        |          |
+        # x2-----+     DotProduct-->x6
+        #        |          |
+        #      Relu------>x5-->
+        net = core.Net("test_net")
+        net.Gather(["x2", "x1"], "x4")
+        net.Relu("x2", "x5")
+        net.DotProduct(["x4", "x5"], "x6")
+        grad_map = net.AddGradientOperators(["x6"])
+        sum_op, fill_op, scatter_op = net.Proto().op[-3:]
+        self.assertEqual(sum_op.type, "Sum")
+        self.assertEqual(sum_op.input, ["_x2_grad_autosplit_0"])
+        self.assertEqual(sum_op.output, ["x2_grad"])
+        self.assertEqual(fill_op.type, "ConstantFill")
+        self.assertEqual(scatter_op.type, "ScatterWeightedSum")
+        self.assertEqual(scatter_op.input, [
+            "x2_grad", fill_op.output[0], "x1", "x4_grad", fill_op.output[0]])
+        self.assertEqual(scatter_op.output, ["x2_grad"])
+        self.assertEqual(grad_map["x2"], "x2_grad")
 
 
 class TestGradientsAccumulationWithNoGradientOps(test_util.TestCase):
@@ -4,8 +4,10 @@ from __future__ import print_function
 
 from collections import OrderedDict
 import logging
+import numpy as np
 
 from caffe2.python import model_helper, dyndep, scope, workspace, core, memonger
+from caffe2.python import muji
 from caffe2.proto import caffe2_pb2
 
 dyndep.InitOpsLibrary("@/caffe2/caffe2/contrib/nccl:nccl_ops")
@@ -25,6 +27,7 @@ def Parallelize_GPU(
     net_type='dag',
     broadcast_computed_params=True,
     optimize_gradient_memory=False,
+    allreduce_bucket_bytes=0,
 ):
     '''
     Function to create a model that can run on many GPUs.
@@ -50,7 +53,17 @@ def Parallelize_GPU(
       rendezvous:       used for rendezvous in distributed computation, if None
                         then only one node is used. To create rendezvous,
                         use <TBD>.
-      net_type:         Network type
+      net_type:         Network type. With 'async_dag', the operators only
+                        wait for the device work that they depend on, and
+                        the all-reduces run on a communication stream of
+                        their own, in the order the backward pass produces
+                        the gradients, so they overlap with the rest of it.
+      allreduce_bucket_bytes:
+                        If positive, gradients are packed into buckets of up
+                        to this many bytes and each bucket is all-reduced at
+                        once, instead of issuing one all-reduce per gradient.
+                        A bucket is reduced as soon as all of its gradients
+                        have been computed.
 
     '''
     log.info("Parallelizing model for devices: {}".format(devices))
@@ -61,6 +74,7 @@ def Parallelize_GPU(
     # Store some information in the model -- a bit ugly
     model_helper_obj._devices = devices
     model_helper_obj._rendezvous = rendezvous
+    model_helper_obj._allreduce_bucket_bytes = allreduce_bucket_bytes
     model_helper_obj._grad_names = []
 
     assert isinstance(model_helper_obj, model_helper.ModelHelperBase)
@@ -237,14 +251,11 @@ def FinalizeAfterCheckpoint(model, blobs, sync_iter=True):
 def _Broadcast(devices, model, net, param):
     # TODO(akyrola): replace with NCCLBroadcast when it's working
     # Copy params from gpu_0 to other
-    master_gpu = devices[0]
-    for gpu_idx in devices[1:]:
-        device_opt = core.DeviceOption(caffe2_pb2.CUDA, gpu_idx)
-        with core.DeviceScope(device_opt):
-            net.Copy(
-                model._device_grouped_blobs[param][master_gpu],
-                model._device_grouped_blobs[param][gpu_idx]
-            )
+    muji.Broadcast(
+        net,
+        [model._device_grouped_blobs[param][gpu_idx] for gpu_idx in devices],
+        devices,
+    )
 
 
 def _SyncParams(devices, model, net, unique_param_names=None):
@@ -327,7 +338,8 @@ def _AllReduceGradientsDistributed(
     all_reduce_engine = rendezvous['engine']
 
     # Make list of gradients in reverse order
-    reverse_ordered_grads = _GetReverseOrderedGrads(model)
+    reverse_ordered_grads, buckets = _PackGradientBuckets(
+        devices, model, _GetGradsInProductionOrder(model))
 
     # Step 1: sum gradients from local GPUs to master GPU
     master_device_opt = core.DeviceOption(caffe2_pb2.CUDA, devices[0])
@@ -421,6 +433,8 @@ def _AllReduceGradientsDistributed(
         # Step 3: broadcast locally
         _Broadcast(devices, model, model.net, grad_name)
 
+    _UnpackGradientBuckets(devices, model, buckets)
+
 
 def _AllReduceGradientsSingleHost(devices, model):
     """Performs NCCL AllReduce to distribute gradients to all the GPUs."""
@@ -429,7 +443,8 @@ def _AllReduceGradientsSingleHost(devices, model):
         return
 
     # Gradients in reverse order
-    reverse_ordered_grads = _GetReverseOrderedGrads(model)
+    reverse_ordered_grads, buckets = _PackGradientBuckets(
+        devices, model, _GetGradsInProductionOrder(model))
 
     # Now we need to Allreduce gradients on all the GPUs.
     # Pick GPU #0 as a master GPU.
@@ -451,6 +466,8 @@ def _AllReduceGradientsSingleHost(devices, model):
             # last_out is used to serialize the execution of nccls
             last_out = grads_group[0]
 
+    _UnpackGradientBuckets(devices, model, buckets)
+
 
 def _BroadcastComputedParams(devices, model, rendezvous):
     if rendezvous is None:
@@ -481,12 +498,135 @@ def _BroadcastComputedParamsSingleHost(devices, model):
         _Broadcast(devices, model, model.net, param_name)
 
 
-def _GetReverseOrderedGrads(model):
+def _GetGradientBuckets(model, grad_names):
+    '''
+    Groups the gradients, in the given order, into buckets of at most
+    model._allreduce_bucket_bytes bytes. Sizes and types are inferred from
+    the parameters created by param_init_net. A gradient whose size is
+    unknown, that is not a dense tensor, or that is larger than a bucket is
+    left alone.
+    '''
+    bucket_bytes = model._allreduce_bucket_bytes
+    master_device = model._devices[0]
+    shapes, types = workspace.InferShapesAndTypes([model.param_init_net], {})
+    itemsizes = {
+        caffe2_pb2.TensorProto.FLOAT: 4,
+        caffe2_pb2.TensorProto.FLOAT16: 2,
+        caffe2_pb2.TensorProto.DOUBLE: 8,
+    }
+    grad_to_param = {}
+    for param, grad in model.param_to_grad.items():
+        if isinstance(grad, core.BlobReference):
+            grad_to_param[str(grad)] = str(param)
+
+    buckets = []
+    bucket, bucket_type, bucket_size = [], None, 0
+    for grad_name in grad_names:
+        grad = str(model._device_grouped_blobs[grad_name][master_device])
+        param = grad_to_param.get(grad)
+        dtype = types.get(param)
+        nbytes = None
+        if param in shapes and dtype in itemsizes:
+            nbytes = int(np.prod(shapes[param])) * itemsizes[dtype]
+        if nbytes is None or nbytes >= bucket_bytes:
+            buckets.append([grad_name])
+            continue
+        if bucket and (bucket_type != dtype or
+                       bucket_size + nbytes > bucket_bytes):
+            buckets.append(bucket)
+            bucket, bucket_size = [], 0
+        bucket.append(grad_name)
+        bucket_type = dtype
+        bucket_size += nbytes
+    if bucket:
+        buckets.append(bucket)
+    return buckets
+
+
+def _PackGradientBuckets(devices, model, grad_names):
+    '''
+    If bucketing is enabled, packs the gradients on each device into buckets
+    with PackBucket. Returns the names to all-reduce, which are gradients or
+    buckets registered in model._device_grouped_blobs, in the same order as
+    grad_names, and the buckets to unpack once they are reduced.
+    '''
+    if model._allreduce_bucket_bytes <= 0:
+        return grad_names, []
+    reduce_names = []
+    buckets = []
+    for bucket in _GetGradientBuckets(model, grad_names):
+        if len(bucket) == 1:
+            reduce_names.append(bucket[0])
+            continue
+        bucket_name = bucket[0] + "_bucket"
+        packed = {}
+        for device in devices:
+            device_opt = core.DeviceOption(caffe2_pb2.CUDA, device)
+            grads = [model._device_grouped_blobs[g][device] for g in bucket]
+            with core.DeviceScope(device_opt):
+                packed[device] = model.net.PackBucket(
+                    grads, str(grads[0]) + "_bucket")
+        rendezvous = model._rendezvous
+        if rendezvous is not None and rendezvous['engine'] == "FBCOLLECTIVE":
+            # The cpu scratch blob of FBCOLLECTIVE all-reduces is initialized
+            # from the parameters, which are packed the same way.
+            master_device = devices[0]
+            master_opt = core.DeviceOption(caffe2_pb2.CUDA, master_device)
+            with core.DeviceScope(master_opt):
+                model.param_init_net.PackBucket(
+                    [str(model._device_grouped_blobs[g][master_device])
+                     .replace("_grad", "") for g in bucket],
+                    str(packed[master_device]).replace("_grad", ""))
+        model._device_grouped_blobs[bucket_name] = packed
+        reduce_names.append(bucket_name)
+        buckets.append((bucket_name, bucket))
+    return reduce_names, buckets
+
+
+def _UnpackGradientBuckets(devices, model, buckets):
+    '''
+    Copies the reduced buckets back into their gradients.
+    '''
+    for bucket_name, grad_names in buckets:
+        for device in devices:
+            device_opt = core.DeviceOption(caffe2_pb2.CUDA, device)
+            grads = [model._device_grouped_blobs[g][device]
+                     for g in grad_names]
+            with core.DeviceScope(device_opt):
+                model.net.UnpackBucket(
+                    [model._device_grouped_blobs[bucket_name][device]] +
+                    grads,
+                    grads,
+                )
+
+
+def _GetGradsInProductionOrder(model):
     '''
-    Returns the gradients in reverse order (namespace stripped),
-    for the optimal synchronization order.
+    Returns the gradients (namespace stripped) in the order in which the
+    backward pass on the master device computes them, for the optimal
+    synchronization order: the all-reduce of a gradient, or of a bucket, can
+    then start as soon as the gradient is computed, and overlaps with the
+    rest of the backward pass, instead of waiting for the gradients that the
+    reductions before it are chained to. Gradients that are not computed by
+    the net keep their reverse parameter order.
     '''
-    return list(reversed(model._grad_names))
+    master_device = model._devices[0]
+    grad_names = list(reversed(model._grad_names))
+    blob_to_grad = {
+        str(model._device_grouped_blobs[g][master_device]): g
+        for g in grad_names
+    }
+    # The last operator that writes a gradient produces it, as gradients
+    # that are written several times are summed up.
+    produced_at = {}
+    for i, op in enumerate(model.net.Proto().op):
+        for output in op.output:
+            if output in blob_to_grad:
+                produced_at[blob_to_grad[output]] = i
+    return sorted(
+        grad_names,
+        key=lambda g: (produced_at.get(g, len(model.net.Proto().op)),
+                       grad_names.index(g)))
 
 
 # A helper function to extract a parameter's name
@@ -13,7 +13,8 @@ from caffe2.python.test_util import TestCase
 @unittest.skipIf(workspace.NumCudaDevices() < 2, "Need at least 2 GPUs.")
 class GPUDataParallelModelTest(TestCase):
 
-    def run_model(self, gpu_devices):
+    def run_model(self, gpu_devices, allreduce_bucket_bytes=0,
+                  net_type='dag'):
         '''
         Helper function for test_equiv
         '''
@@ -56,6 +57,8 @@ class GPUDataParallelModelTest(TestCase):
             forward_pass_builder_fun=model_build_fun,
             param_update_builder_fun=param_update_fun,
             devices=gpu_devices,
+            allreduce_bucket_bytes=allreduce_bucket_bytes,
+            net_type=net_type,
         )
 
         np.random.seed(2603)
@@ -101,3 +104,22 @@ class GPUDataParallelModelTest(TestCase):
         if workspace.NumCudaDevices() >= 8:
             result_8gpus = self.run_model(range(8))
             self.assertTrue(np.allclose(result_1gpus, result_8gpus))
+
+    def test_equiv_bucketed_allreduce(self):
+        '''
+        Test that packing the gradients into buckets for the all-reduce does
+        not change the results.
+        '''
+        result_1gpus = self.run_model([0])
+        result_2gpus = self.run_model([0, 1], allreduce_bucket_bytes=1 << 20)
+        self.assertTrue(np.allclose(result_1gpus, result_2gpus))
+
+    def test_equiv_async_dag(self):
+        '''
+        Test that running the all-reduces on their own stream with an
+        async_dag net does not change the results.
+        '''
+        result_1gpus = self.run_model([0])
+        result_2gpus = self.run_model(
+            [0, 1], allreduce_bucket_bytes=1 << 20, net_type='async_dag')
+        self.assertTrue(np.allclose(result_1gpus, result_2gpus))
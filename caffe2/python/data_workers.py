@@ -44,6 +44,12 @@ For a dummy example, see the data_workers_test unit test.
 Note that for data_parallel_models, init_data_input_workers will be called
 for each GPU. Note that the 'coordinator' returned by the function is same
 each time.
+
+With 'max_worker_threads' above 'num_worker_threads', fetcher threads are
+added while the net is input-bound, up to that many: every
+'scale_interval_secs', the stats of the Caffe2 queues tell whether the net
+waited for most of the batches it dequeued while the fetched data did not pile
+up, in which case one more fetcher is started.
 '''
 
 import Queue
@@ -67,6 +73,8 @@ def init_data_input_workers(
     num_worker_threads=2,
     input_source_name="train",
     max_buffered_batches=100,
+    max_worker_threads=None,
+    scale_interval_secs=10,
 ):
     global global_coordinator
     device_option = scope.CurrentDeviceScope()
@@ -85,19 +93,15 @@ def init_data_input_workers(
     )
 
     # Launch fetch worker threads
-    workers = [
-        threading.Thread(
-            target=fetcher,
-            args=[coordinator, global_coordinator._fetcher_id_seq + i,
-                  fetch_fun, batch_size, input_blob_names],
-        ) for i in range(num_worker_threads)
-    ]
-    global_coordinator._fetcher_id_seq += num_worker_threads
+    for _ in range(num_worker_threads):
+        coordinator._add_fetcher(fetch_fun)
+    coordinator._max_fetchers = max(
+        num_worker_threads, max_worker_threads or num_worker_threads)
+    coordinator._scale_interval_secs = scale_interval_secs
 
-    workers.append(threading.Thread(
+    coordinator._workers.append(threading.Thread(
         target=enqueuer,
         args=[coordinator]))
-    coordinator._workers = workers
     global_coordinator.add(coordinator)
 
     return global_coordinator
@@ -123,6 +127,12 @@ class DataInputCoordinator(object):
         self._create_caffe2_queues_and_ops()
         self._inputs = 0
         self._prev_seconds = 0
+        self._fetch_fun = None
+        self._num_fetchers = 0
+        self._max_fetchers = 0
+        self._scale_interval_secs = 10
+        self._prev_scale_seconds = 0
+        self._prev_queue_stats = None
 
     def is_active(self):
         return self._active
@@ -134,6 +144,8 @@ class DataInputCoordinator(object):
         self._started = True
         self._inputs = 0
         self._prev_seconds = time.time()
+        self._prev_scale_seconds = self._prev_seconds
+        self._prev_queue_stats = None
 
         for w in self._workers:
             w.daemon = True
@@ -216,10 +228,13 @@ class DataInputCoordinator(object):
         scratch_name = self._namescope + blob_name + \
             "_scratch_" + self._input_source_name
         blob = core.BlobReference(scratch_name)
+        # The batch arrays are not modified once built, so CPU blobs can use
+        # them in place.
         workspace.FeedBlob(
             blob,
             data_arr,
-            device_option=self._device_option
+            device_option=self._device_option,
+            zero_copy=True,
         )
 
         op = core.CreateOperator(
@@ -253,6 +268,53 @@ class DataInputCoordinator(object):
             # Add operator to the Caffe2 network to dequeue
             self._net.DequeueBlobs(q, blob_name)
 
+    def _add_fetcher(self, fetch_fun):
+        '''
+        Creates a fetcher thread, and starts it if the workers are running.
+        '''
+        self._fetch_fun = fetch_fun
+        w = threading.Thread(
+            target=fetcher,
+            args=[self, global_coordinator._fetcher_id_seq, fetch_fun,
+                  self._batch_size, self._input_blob_names],
+        )
+        global_coordinator._fetcher_id_seq += 1
+        self._num_fetchers += 1
+        self._workers.append(w)
+        if self._started:
+            w.daemon = True
+            w.start()
+
+    def _maybe_add_fetcher(self):
+        '''
+        Adds a fetcher if, since the last check, the net waited on the Caffe2
+        queue for most of its batches while the fetched data did not pile up
+        in the python-side queue, i.e. the fetchers are the bottleneck.
+        '''
+        if self._num_fetchers >= self._max_fetchers:
+            return
+        current_seconds = time.time()
+        if current_seconds - self._prev_scale_seconds < \
+                self._scale_interval_secs:
+            return
+        self._prev_scale_seconds = current_seconds
+        stats = workspace.QueueStats(self._queues[0])
+        prev = self._prev_queue_stats
+        self._prev_queue_stats = stats
+        if prev is None:
+            return
+        reads = stats['reads'] - prev['reads']
+        blocked_reads = stats['blocked_reads'] - prev['blocked_reads']
+        qsize = self._internal_queue.qsize()
+        if reads > 0 and blocked_reads > reads / 2 and \
+                qsize < self._internal_queue.maxsize / 2:
+            log.info(
+                "{}/{}: net waited for {} of {} batches, adding fetcher {} "
+                "of at most {}".format(
+                    self._input_source_name, self._namescope, blocked_reads,
+                    reads, self._num_fetchers + 1, self._max_fetchers))
+            self._add_fetcher(self._fetch_fun)
+
     def _log_inputs_per_minute(self):
         self._inputs += 1
         current_seconds = time.time()
@@ -324,3 +386,4 @@ def fetcher(coordinator, worker_id, fetch_fun, batch_size, input_blob_names):
 def enqueuer(coordinator):
     while coordinator.is_active():
         coordinator._enqueue_batch()
+        coordinator._maybe_add_fetcher()
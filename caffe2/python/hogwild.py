@@ -0,0 +1,109 @@
+"""
+Hogwild training: several copies of a training net run concurrently in one
+workspace, each on its own thread, and update a single set of parameters
+in place, without locks.
+
+build_hogwild() clones model.net once per trainer. The blobs created by
+model.param_init_net (the parameters and the optimizer state) are shared by
+all the trainers, while the inputs, activations and gradients get a
+'<name>/trainer_<i>/' prefix. Each trainer reads its inputs from its own
+queue, so that the trainers never contend on a single reader. The Iter ops
+of the net become AtomicIter ops on a shared mutex, so that the iteration
+count, and with it the learning rate, stays exact.
+
+Usage:
+
+    init_net, step, queues = hogwild.build_hogwild(
+        model, ["data", "label"], num_trainers=4)
+    workspace.RunNetOnce(model.param_init_net)
+    workspace.RunNetOnce(init_net)
+    # Feed each of the queues, e.g. with a reader or EnqueueBlobs, and close
+    # them once the data is exhausted.
+    plan = core.Plan("train")
+    plan.AddStep(step)
+    workspace.RunPlan(plan)
+
+The step returns once all the queues are closed and drained.
+"""
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+from caffe2.python import core
+
+
+def _shared_blobs(model):
+    shared = set()
+    for op in model.param_init_net.Proto().op:
+        shared.update(op.output)
+    return shared
+
+
+def build_hogwild(model, input_blobs, num_trainers, capacity=4,
+                  name="hogwild", pin_to_cores=True):
+    """
+    Builds the nets of num_trainers Hogwild trainers of model.
+
+    Args:
+        model: a model whose net holds the forward, backward and parameter
+            update ops of one training iteration, e.g. after sgd.build_sgd.
+        input_blobs: the blobs of model.net that each trainer reads from its
+            queue, e.g. ["data", "label"].
+        num_trainers: the number of concurrent trainers.
+        capacity: the number of entries each queue can hold.
+        name: the prefix of the blobs, nets and steps of the trainers.
+        pin_to_cores: if set, trainer i runs pinned to core i.
+
+    Returns:
+        init_net: the net to run once after model.param_init_net, which
+            creates the queues, the mutex of the iteration counter and the
+            stop blobs.
+        step: the execution step that runs the trainers concurrently, until
+            their queues are closed and empty.
+        queues: the queue of each trainer, with entries of input_blobs.
+    """
+    assert num_trainers > 0
+    input_blobs = [str(b) for b in input_blobs]
+    shared = _shared_blobs(model)
+    for blob in input_blobs:
+        assert blob not in shared, (
+            "Input {} is created by param_init_net".format(blob))
+
+    init_net = core.Net("{}/init".format(name))
+    iter_mutex = init_net.CreateMutex([], ["{}/iter_mutex".format(name)])
+    queues = []
+    trainer_steps = []
+    for i in range(num_trainers):
+        prefix = "{}/trainer_{}/".format(name, i)
+        queue = init_net.CreateBlobsQueue(
+            [], [prefix + "queue"],
+            capacity=capacity, num_blobs=len(input_blobs))
+        status = init_net.ConstantFill(
+            [], [prefix + "status"], shape=[], value=False,
+            dtype=core.DataType.BOOL)
+        queues.append(queue)
+
+        read_net = core.Net(prefix + "read")
+        read_net.SafeDequeueBlobs(
+            [queue], [prefix + b for b in input_blobs] + [status])
+
+        blob_remap = {b: b for b in shared}
+        blob_remap.update({b: prefix + b for b in input_blobs})
+        train_net, _ = core.clone_and_bind_net(
+            model.net, prefix + "train", prefix, blob_remap)
+        for op in train_net.Proto().op:
+            if op.type == "Iter":
+                op.type = "AtomicIter"
+                iter_blob = op.input[0] if op.input else op.output[0]
+                del op.input[:]
+                op.input.extend([str(iter_mutex), iter_blob])
+
+        trainer_steps.append(core.execution_step(
+            prefix + "step", [read_net, train_net], should_stop_blob=status))
+
+    step = core.execution_step(
+        name, trainer_steps, concurrent_substeps=True)
+    if pin_to_cores:
+        step.SetPinSubstepsToCores(True)
+    return init_net, step, queues
@@ -0,0 +1,70 @@
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import numpy as np
+import unittest
+
+from caffe2.python import cnn, core, hogwild, workspace
+from caffe2.python.sgd import build_sgd
+
+
+class TestHogwild(unittest.TestCase):
+    def testDense(self):
+        num_trainers = 4
+        num_examples = 500
+        perfect_model = np.array([2, 6, 5, 0, 1]).astype(np.float32)
+        np.random.seed(123)
+        data = np.random.randint(
+            2, size=(20, perfect_model.size)).astype(np.float32)
+        label = np.dot(data, perfect_model)[:, np.newaxis]
+
+        model = cnn.CNNModelHelper("NCHW", name="hogwild_test")
+        out = model.FC(
+            'data', 'fc', perfect_model.size, 1, ('ConstantFill', {}),
+            ('ConstantFill', {}), axis=0
+        )
+        sq = model.SquaredL2Distance([out, 'label'])
+        loss = model.AveragedLoss(sq, "avg_loss")
+        model.AddGradientOperators([loss])
+        build_sgd(model, base_learning_rate=0.1)
+
+        init_net, step, queues = hogwild.build_hogwild(
+            model, ['data', 'label'], num_trainers,
+            capacity=num_examples, pin_to_cores=False)
+        workspace.RunNetOnce(model.param_init_net)
+        workspace.FeedBlob('ITER', np.array([0], dtype=np.int64))
+        workspace.RunNetOnce(init_net)
+
+        for queue in queues:
+            enqueue_net = core.Net('enqueue')
+            enqueue_net.EnqueueBlobs(
+                [queue, 'feed_data', 'feed_label'],
+                ['feed_data', 'feed_label'])
+            workspace.CreateNet(enqueue_net)
+            for _ in range(num_examples):
+                idx = np.random.randint(data.shape[0])
+                workspace.FeedBlob('feed_data', data[idx])
+                workspace.FeedBlob('feed_label', label[idx])
+                workspace.RunNet(enqueue_net.Proto().name)
+            close_net = core.Net('close')
+            close_net.CloseBlobsQueue([queue], 0)
+            workspace.RunNetOnce(close_net)
+
+        plan = core.Plan('hogwild_train')
+        plan.AddStep(step)
+        workspace.RunPlan(plan)
+
+        # Every trainer ran an iteration per example, on the shared counter.
+        self.assertEqual(
+            workspace.FetchBlob('ITER')[0], num_trainers * num_examples)
+        np.testing.assert_allclose(
+            perfect_model[np.newaxis, :],
+            workspace.FetchBlob('fc_w'),
+            atol=1e-2
+        )
+
+
+if __name__ == '__main__':
+    unittest.main()
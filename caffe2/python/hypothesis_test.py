@@ -626,7 +626,7 @@ class TestOperators(hu.HypothesisTestCase):
            lr=st.floats(min_value=0.1, max_value=0.9),
            epsilon=st.floats(min_value=1e-5, max_value=1e-2),
            engine=st.sampled_from([None, "SIMD"]),
-           **hu.gcs_cpu_only)
+           **hu.gcs)
     def test_sparse_adagrad_sgd(self, inputs, lr, epsilon,
                                 engine, gc, dc):
         w, grad, h = inputs
@@ -653,6 +653,110 @@ class TestOperators(hu.HypothesisTestCase):
 
         self.assertReferenceChecks(gc, op, [w, h, indices, grad, lr], adagrad)
 
+    @unittest.skipIf(not workspace.has_gpu_support, "No gpu support")
+    @given(n=st.integers(1, 20),
+           block_size=st.integers(1, 40),
+           num_indices=st.integers(1, 60),
+           lr=st.floats(min_value=0.1, max_value=0.9),
+           epsilon=st.floats(min_value=1e-5, max_value=1e-2),
+           **hu.gcs_gpu_only)
+    def test_sparse_adagrad_sgd_duplicate_indices(
+            self, n, block_size, num_indices, lr, epsilon, gc, dc):
+        param = np.random.rand(n, block_size).astype(np.float32)
+        h = np.random.rand(n, block_size).astype(np.float32)
+        indices = np.random.randint(n, size=num_indices).astype(np.int32)
+        grad = np.random.randn(num_indices, block_size).astype(np.float32)
+        lr = np.asarray([lr], dtype=np.float32)
+        op = core.CreateOperator(
+            "SparseAdagrad",
+            ["param", "h", "indices", "grad", "lr"],
+            ["param", "h"],
+            epsilon=epsilon,
+            device_option=gc)
+
+        # The gradients of a duplicated index are summed into one update.
+        def adagrad(param, h, indices, grad, lr):
+            summed = np.zeros_like(param)
+            np.add.at(summed, indices, grad)
+            rows = np.unique(indices)
+            sw, sh = self._dense_adagrad(
+                epsilon, param[rows], h[rows], summed[rows], lr)
+            param[rows] = sw
+            h[rows] = sh
+            return (param, h)
+
+        self.assertReferenceChecks(
+            gc, op, [param, h, indices, grad, lr], adagrad)
+
+    @given(n=st.integers(1, 20),
+           block_size=st.integers(1, 40),
+           lr=st.floats(min_value=0.1, max_value=0.9),
+           epsilon=st.floats(min_value=1e-5, max_value=1e-2),
+           **hu.gcs)
+    def test_row_wise_sparse_adagrad_sgd(
+            self, n, block_size, lr, epsilon, gc, dc):
+        param = np.random.rand(n, block_size).astype(np.float32)
+        h = np.random.rand(n).astype(np.float32)
+        # Unique indices, on which CPU and CUDA agree.
+        indices = np.random.permutation(n)[:max(1, n // 2)].astype(np.int32)
+        grad = np.random.randn(
+            indices.size, block_size).astype(np.float32)
+        lr = np.asarray([lr], dtype=np.float32)
+        op = core.CreateOperator(
+            "RowWiseSparseAdagrad",
+            ["param", "h", "indices", "grad", "lr"],
+            ["param", "h"],
+            epsilon=epsilon,
+            device_option=gc)
+        self.assertDeviceChecks(
+            dc, op, [param, h, indices, grad, lr], [0, 1])
+
+        def adagrad(param, h, indices, grad, lr):
+            h[indices] += np.mean(np.square(grad), axis=1)
+            step = lr[0] / (np.sqrt(h[indices]) + epsilon)
+            param[indices] += step[:, np.newaxis] * grad
+            return (param, h)
+
+        self.assertReferenceChecks(
+            gc, op, [param, h, indices, grad, lr], adagrad)
+
+    @given(hogwild=st.booleans(),
+           block_size=st.sampled_from([1, 64]),
+           lr=st.floats(min_value=0.1, max_value=0.9),
+           epsilon=st.floats(min_value=1e-5, max_value=1e-2),
+           **hu.gcs_cpu_only)
+    def test_sparse_adagrad_sgd_parallel(
+            self, hogwild, block_size, lr, epsilon, gc, dc):
+        # Large enough to be split over threads. Hogwild is only exact with
+        # unique indices, while the ordered update applies every occurrence
+        # of a duplicated index in turn.
+        n = 1000
+        param = np.random.rand(n, block_size).astype(np.float32)
+        h = np.random.rand(n, block_size).astype(np.float32)
+        if hogwild:
+            indices = np.random.permutation(n).astype(np.int64)
+        else:
+            indices = np.random.randint(n, size=4 * n).astype(np.int64)
+        grad = np.random.randn(
+            indices.size, block_size).astype(np.float32)
+        lr = np.asarray([lr], dtype=np.float32)
+        op = core.CreateOperator(
+            "SparseAdagrad",
+            ["param", "h", "indices", "grad", "lr"],
+            ["param", "h"],
+            epsilon=epsilon,
+            hogwild=hogwild,
+            device_option=gc)
+
+        def adagrad(param, h, indices, grad, lr):
+            for i, row in enumerate(indices):
+                param[row], h[row] = self._dense_adagrad(
+                    epsilon, param[row], h[row], grad[i], lr)
+            return (param, h)
+
+        self.assertReferenceChecks(
+            gc, op, [param, h, indices, grad, lr], adagrad)
+
     @given(inputs=hu.tensors(n=4),
            in_place=st.booleans(),
            beta1=st.floats(min_value=0.1, max_value=0.9),
@@ -691,7 +795,7 @@ class TestOperators(hu.HypothesisTestCase):
            lr=st.floats(min_value=0.1, max_value=0.9),
            iters=st.integers(min_value=1, max_value=10000),
            epsilon=st.floats(min_value=1e-5, max_value=1e-2),
-           **hu.gcs_cpu_only)
+           **hu.gcs)
     def test_sparse_adam_sgd(self, inputs, beta1, beta2, lr, iters,
                              epsilon, gc, dc):
 
@@ -723,6 +827,56 @@ class TestOperators(hu.HypothesisTestCase):
 
         self.assertReferenceChecks(gc, op, inputs, adam)
 
+    @given(inputs=hu.tensors(n=4),
+           beta1=st.floats(min_value=0.1, max_value=0.9),
+           beta2=st.floats(min_value=0.1, max_value=0.9),
+           lr=st.floats(min_value=0.1, max_value=0.9),
+           iters=st.integers(min_value=10, max_value=10000),
+           epsilon=st.floats(min_value=1e-5, max_value=1e-2),
+           catch_up=st.booleans(),
+           **hu.gcs)
+    def test_lazy_sparse_adam_sgd(self, inputs, beta1, beta2, lr, iters,
+                                  epsilon, catch_up, gc, dc):
+        w, grad, m1, m2 = inputs
+        indices = np.arange(m1.shape[0])
+        indices = indices[indices % 2 == 0]
+        grad = grad[indices]
+        m2 += np.abs(m2) + 0.01
+        # Rows last updated up to 9 steps ago.
+        last_iter = iters - np.random.randint(
+            10, size=m1.shape[0]).astype(np.int64)
+        lr = np.asarray([lr], dtype=np.float32)
+        iters = np.asarray([iters], dtype=np.int64)
+        op = core.CreateOperator(
+            "LazySparseAdam",
+            ["w", "m1", "m2", "last_iter", "indices", "grad", "lr", "iters"],
+            ["w", "m1", "m2", "last_iter"],
+            beta1=beta1, beta2=beta2, epsilon=epsilon, catch_up=catch_up,
+            device_option=gc)
+        input_device_options = {"iters": hu.cpu_do}
+        inputs = [w, m1, m2, last_iter, indices, grad, lr, iters]
+
+        def adam(w, m1, m2, last_iter, i, grad, lr, iters):
+            t = iters[0] + 1
+            if catch_up:
+                skipped = (t - 1 - last_iter[i]).reshape(
+                    (-1,) + (1,) * (w.ndim - 1))
+                q = beta1 / np.sqrt(beta2)
+                steps = q * (1 - np.power(q, skipped)) / (1 - q)
+                correction = np.sqrt(1. - np.power(beta2, t)) / \
+                    (1. - np.power(beta1, t))
+                w[i] += lr[0] * correction * steps * m1[i] / \
+                    (np.sqrt(m2[i]) + epsilon)
+                m1[i] *= np.power(beta1, skipped)
+                m2[i] *= np.power(beta2, skipped)
+            w[i], m1[i], m2[i] = self._dense_adam(
+                epsilon, beta1, beta2, w[i], m1[i], m2[i], grad, lr, iters)
+            last_iter[i] = t
+            return (w, m1, m2, last_iter)
+
+        self.assertReferenceChecks(
+            gc, op, inputs, adam, input_device_options=input_device_options)
+
     # Reference
     @staticmethod
     def _dense_ftrl(alpha, beta, lambda1, lambda2, w, nz, g):
@@ -802,6 +956,132 @@ class TestOperators(hu.HypothesisTestCase):
 
         self.assertReferenceChecks(gc, op, [var, nz, indices, grad], ftrl)
 
+    @given(it=st.integers(min_value=0, max_value=300),
+           policy=st.sampled_from(
+               ["fixed", "step", "exp", "inv", "warmup", "cosine"]),
+           **hu.gcs)
+    def test_learning_rate(self, it, policy, gc, dc):
+        base_lr = -0.1
+        params = {
+            "fixed": {},
+            "step": {"stepsize": 20, "gamma": 0.9},
+            "exp": {"gamma": 0.99},
+            "inv": {"gamma": 0.01, "power": 0.5},
+            "warmup": {"warmup_iters": 50, "warmup_factor": 0.1},
+            "cosine": {"warmup_iters": 50, "warmup_factor": 0.1,
+                       "max_iter": 200, "min_ratio": 0.01},
+        }[policy]
+        op = core.CreateOperator(
+            "LearningRate", ["iter"], ["lr"],
+            base_lr=base_lr, policy=policy, device_option=gc, **params)
+
+        def warmup(it):
+            if it >= params["warmup_iters"]:
+                return 1.0
+            factor = params["warmup_factor"]
+            return factor + (1 - factor) * it / params["warmup_iters"]
+
+        def learning_rate(iter):
+            it = iter[0]
+            if policy == "step":
+                ratio = params["gamma"] ** (it // params["stepsize"])
+            elif policy == "exp":
+                ratio = params["gamma"] ** it
+            elif policy == "inv":
+                ratio = (1 + params["gamma"] * it) ** -params["power"]
+            elif policy == "warmup" or (
+                    policy == "cosine" and it < params["warmup_iters"]):
+                ratio = warmup(it)
+            elif policy == "cosine":
+                min_ratio = params["min_ratio"]
+                t = min(it, params["max_iter"]) - params["warmup_iters"]
+                span = params["max_iter"] - params["warmup_iters"]
+                ratio = min_ratio + (1 - min_ratio) * 0.5 * (
+                    1 + np.cos(np.pi * t / span))
+            else:
+                ratio = 1.0
+            return (np.array(base_lr * ratio, dtype=np.float32),)
+
+        # On GPU, the iter counter is fed to the device, and the policy is
+        # evaluated there.
+        self.assertReferenceChecks(
+            gc, op, [np.array([it], dtype=np.int64)], learning_rate)
+
+    @given(inputs=hu.tensors(n=4),
+           elastic=st.booleans(),
+           alpha=st.floats(min_value=0.01, max_value=0.5),
+           num_replicas=st.integers(min_value=1, max_value=8),
+           **hu.gcs_cpu_only)
+    def test_model_averaging_update(self, inputs, elastic, alpha,
+                                    num_replicas, gc, dc):
+        param, local, summed, center = inputs
+        if elastic:
+            op = core.CreateOperator(
+                "ModelAveragingUpdate",
+                ["param", "local", "sum", "center"],
+                ["param", "local", "center"],
+                alpha=alpha,
+                device_option=gc)
+
+            def easgd(param, local, summed, center):
+                center = center + alpha * summed
+                local = param - center
+                return (param - alpha * local, local, center)
+
+            self.assertReferenceChecks(
+                gc, op, [param, local, summed, center], easgd)
+        else:
+            op = core.CreateOperator(
+                "ModelAveragingUpdate",
+                ["param", "local", "sum"],
+                ["param", "local"],
+                num_replicas=num_replicas,
+                device_option=gc)
+
+            def model_averaging(param, local, summed):
+                param = param + summed / num_replicas - local
+                return (param, param)
+
+            self.assertReferenceChecks(
+                gc, op, [param, local, summed], model_averaging)
+
+    @given(hogwild=st.booleans(),
+           block_size=st.sampled_from([1, 16]),
+           alpha=st.floats(min_value=0.01, max_value=0.1),
+           beta=st.floats(min_value=0.1, max_value=0.9),
+           lambda1=st.floats(min_value=0.001, max_value=0.1),
+           lambda2=st.floats(min_value=0.001, max_value=0.1),
+           **hu.gcs_cpu_only)
+    def test_sparse_ftrl_sgd_parallel(self, hogwild, block_size, alpha, beta,
+                                      lambda1, lambda2, gc, dc):
+        # Large enough to be split over threads, as in
+        # test_sparse_adagrad_sgd_parallel.
+        n = 1000 if block_size > 1 else 40000
+        var = np.random.randn(n, block_size).astype(np.float32)
+        nz = np.stack(
+            [np.random.rand(n, block_size), np.random.randn(n, block_size)],
+            axis=-1).astype(np.float32)
+        if hogwild:
+            indices = np.random.permutation(n).astype(np.int64)
+        else:
+            indices = np.random.randint(n, size=4 * n).astype(np.int64)
+        grad = np.random.randn(indices.size, block_size).astype(np.float32)
+        op = core.CreateOperator(
+            "SparseFtrl",
+            ["var", "nz", "indices", "grad"],
+            ["var", "nz"],
+            alpha=alpha, beta=beta, lambda1=lambda1, lambda2=lambda2,
+            hogwild=hogwild,
+            device_option=gc)
+
+        def ftrl(w, nz, indices, g):
+            for i, row in enumerate(indices):
+                w[row], nz[row] = self._dense_ftrl(
+                    alpha, beta, lambda1, lambda2, w[row], nz[row], g[i])
+            return (w, nz)
+
+        self.assertReferenceChecks(gc, op, [var, nz, indices, grad], ftrl)
+
     @given(input=hu.tensor(max_value=20,
                            max_dim=1,
                            dtype=np.int32,
@@ -7,6 +7,7 @@ import networkx as nx
 import collections
 import time
 import copy
+from caffe2.proto import caffe2_pb2
 from caffe2.python import workspace
 
 import logging
@@ -135,6 +136,229 @@ def share_grad_blobs(net, losses, param_grads, namescope):
     return netproto
 
 
+# Operators whose outputs cannot be recomputed exactly.
+_RANDOM_OPS = set([
+    "Dropout", "UniformFill", "UniformIntFill", "GaussianFill", "XavierFill",
+    "MSRAFill",
+])
+
+
+def _num_forward_ops(ops):
+    # The forward pass ends at the first operator that outputs a gradient.
+    return next(
+        (i for i, op in enumerate(ops)
+         if any("_grad" in outp for outp in op.output)),
+        len(ops))
+
+
+def _make_op(op_type, inputs, outputs, like):
+    op = caffe2_pb2.OperatorDef()
+    op.type = op_type
+    op.input.extend(inputs)
+    op.output.extend(outputs)
+    if like.HasField("device_option"):
+        op.device_option.CopyFrom(like.device_option)
+    return op
+
+
+def _make_free(blobs, like):
+    return _make_op("Free", sorted(blobs), sorted(blobs), like)
+
+
+def _splice_ops(netproto, ops, before, after):
+    del netproto.op[:]
+    for i, op in enumerate(ops):
+        netproto.op.extend(before[i])
+        netproto.op.extend([op])
+        netproto.op.extend(after[i])
+
+
+def recompute_activations(net, num_segments, static_blobs=()):
+    '''
+    Gradient checkpointing: splits the forward operators of a net that already
+    has its gradient operators into num_segments segments of about the same
+    number of operators. The activations internal to a segment are freed once
+    it has run, and recomputed right before the first gradient operator that
+    reads them, except in the last segment, whose gradients run right after
+    it. Every segment frees them again once its gradients have run, so only
+    the blobs at the boundaries of the segments stay alive through the whole
+    backward pass. More segments keep fewer activations alive at once but
+    more boundaries; all but the last segment run twice.
+
+    The forward pass ends at the first operator that outputs a gradient blob.
+    The blobs that exist before the net runs, the external outputs of the net,
+    the outputs of random operators and static_blobs (e.g. the losses, if they
+    are fetched after the net) are never freed. A recomputed operator reads a
+    copy of any such input that is overwritten before it is recomputed.
+
+    Returns an optimized protobuf (assign to net._net)
+    '''
+    assert num_segments >= 1
+    start_time = time.time()
+    netproto = copy.deepcopy(net)
+    ops = list(netproto.op)
+    num_forward = _num_forward_ops(ops)
+    bounds = [num_forward * s // num_segments for s in range(num_segments + 1)]
+    segment_of = {}
+    for s in range(num_segments):
+        for i in range(bounds[s], bounds[s + 1]):
+            segment_of[i] = s
+
+    kept = set(static_blobs)
+    kept.update(netproto.external_input)
+    kept.update(netproto.external_output)
+    readers = collections.defaultdict(list)
+    writers = collections.defaultdict(list)
+    for i, op in enumerate(ops):
+        for inp in op.input:
+            if not writers[inp]:
+                kept.add(inp)
+            readers[inp].append(i)
+        for outp in op.output:
+            writers[outp].append(i)
+        if op.type in _RANDOM_OPS:
+            kept.update(op.output)
+
+    before = collections.defaultdict(list)
+    after = collections.defaultdict(list)
+    num_freed = 0
+    num_recomputed = 0
+    for s in range(num_segments):
+        segment = range(bounds[s], bounds[s + 1])
+        dropped = set()
+        for i in segment:
+            for outp in ops[i].output:
+                if outp not in kept and all(
+                        segment_of.get(j) == s
+                        for j in writers[outp] +
+                        [r for r in readers[outp] if r < num_forward]):
+                    dropped.add(outp)
+        if not dropped:
+            continue
+        num_freed += len(dropped)
+        grad_readers = [
+            j for b in dropped for j in readers[b] if j >= num_forward]
+        if s == num_segments - 1:
+            # The activations of the last segment are needed right away, so
+            # they are kept until their gradients have run.
+            last_use = max(grad_readers or segment)
+            after[last_use].append(_make_free(dropped, ops[last_use]))
+            continue
+        after[segment[-1]].append(_make_free(dropped, ops[segment[-1]]))
+        if not grad_readers:
+            continue
+        recompute_at = min(grad_readers)
+
+        # Only the operators that the gradients need are recomputed.
+        live = set(b for b in dropped if max(readers[b]) >= num_forward)
+        needed = []
+        for i in reversed(segment):
+            if live.intersection(ops[i].output):
+                needed.append(i)
+                live.difference_update(ops[i].output)
+                live.update(b for b in ops[i].input if b in dropped)
+        needed.reverse()
+
+        recompute_ops = []
+        recompute_blobs = set()
+        snapshots = {}
+        for i in needed:
+            op = copy.deepcopy(ops[i])
+            for k, inp in enumerate(op.input):
+                if inp in dropped or not any(
+                        i <= j < recompute_at for j in writers[inp]):
+                    continue
+                version = max([j for j in writers[inp] if j < i] or [-1])
+                if (inp, version) not in snapshots:
+                    snapshot = "{}_recompute{}".format(inp, len(snapshots))
+                    before[i].append(_make_op("Copy", [inp], [snapshot], op))
+                    snapshots[(inp, version)] = snapshot
+                op.input[k] = snapshots[(inp, version)]
+            for k, outp in enumerate(op.output):
+                if outp not in dropped:
+                    # The recomputed value is only needed in this segment.
+                    op.output[k] = "{}_recompute_scratch".format(outp)
+            recompute_blobs.update(op.output)
+            recompute_ops.append(op)
+        recompute_blobs.update(snapshots.values())
+        num_recomputed += len(recompute_ops)
+        before[recompute_at].extend(recompute_ops)
+        last_reader = max(grad_readers)
+        after[last_reader].append(
+            _make_free(recompute_blobs, ops[last_reader]))
+
+    _splice_ops(netproto, ops, before, after)
+    log.info("Freeing {} blobs, recomputing {} of {} forward ops".format(
+        num_freed, num_recomputed, num_forward,
+    ))
+    log.info("Activation recomputation took {} secs".format(
+        time.time() - start_time),
+    )
+    return netproto
+
+
+def offload_activations(net, blobs, prefetch_distance=2):
+    '''
+    Offloads the given activations of a GPU net that already has its gradient
+    operators to the host: each one is copied to pinned host memory (into
+    <blob>_host) as soon as it is written, freed on the device after its last
+    forward use, and copied back ahead of the first gradient operator that
+    reads it, as soon as the gradient operator prefetch_distance operators
+    before that one has run. The host copies are kept, so that the pinned
+    memory is reused by the next run. In an async_dag net the copies run on a
+    stream of their own and overlap with the compute.
+
+    Returns an optimized protobuf (assign to net._net)
+    '''
+    assert prefetch_distance >= 0
+    start_time = time.time()
+    netproto = copy.deepcopy(net)
+    ops = list(netproto.op)
+    num_forward = _num_forward_ops(ops)
+    before = collections.defaultdict(list)
+    after = collections.defaultdict(list)
+    num_offloaded = 0
+    for blob in blobs:
+        blob = str(blob)
+        # Freeing is not a use, e.g. after recompute_activations().
+        writers = [i for i, op in enumerate(ops)
+                   if blob in op.output and op.type != "Free"]
+        readers = [i for i, op in enumerate(ops)
+                   if blob in op.input and op.type != "Free"]
+        grad_readers = [i for i in readers if i >= num_forward]
+        if not writers or writers[-1] >= num_forward or not grad_readers:
+            log.warning(
+                "Not offloading {}: only the forward pass may write it, "
+                "and the gradients must read it".format(blob))
+            continue
+        written = writers[-1]
+        last_use = max([written] + [i for i in readers if i < num_forward])
+        host_blob = "{}_host".format(blob)
+        after[written].append(
+            _make_op("CopyGPUToCPU", [blob], [host_blob], ops[written]))
+        after[last_use].append(_make_free([blob], ops[last_use]))
+
+        first_grad = grad_readers[0]
+        prefetch = _make_op(
+            "CopyCPUToGPU", [host_blob], [blob], ops[first_grad])
+        trigger = max(num_forward, first_grad - prefetch_distance)
+        if trigger < first_grad and len(ops[trigger].output) > 0:
+            prefetch.control_input.extend([ops[trigger].output[0]])
+        before[first_grad].append(prefetch)
+        after[grad_readers[-1]].append(
+            _make_free([blob], ops[grad_readers[-1]]))
+        num_offloaded += 1
+
+    _splice_ops(netproto, ops, before, after)
+    log.info("Offloading {} of {} activations".format(
+        num_offloaded, len(blobs),
+    ))
+    log.info("Activation offloading took {} secs".format(
+        time.time() - start_time),
+    )
+    return netproto
+
+
 def topological_sort_traversal(g):
     return nx.topological_sort(g)
 
@@ -4,6 +4,7 @@ from __future__ import print_function
 from __future__ import unicode_literals
 
 import numpy as np
+import unittest
 
 from caffe2.python import workspace, cnn, memonger, core
 import caffe2.python.hypothesis_test_util as hu
@@ -164,3 +165,101 @@ class MemongerTest(hu.HypothesisTestCase):
         np.testing.assert_almost_equal(loss1, optimized_loss1)
         np.testing.assert_almost_equal(loss2, optimized_loss2)
         np.testing.assert_almost_equal(grad, optimized_grad)
+
+    @given(input_dim=st.integers(min_value=1, max_value=4),
+           output_dim=st.integers(min_value=1, max_value=4),
+           batch_size=st.integers(min_value=1, max_value=4),
+           num_segments=st.integers(min_value=1, max_value=4),
+           do=st.sampled_from(hu.device_options))
+    def test_recompute_activations(
+            self, input_dim, output_dim, batch_size, num_segments, do):
+        m = cnn.CNNModelHelper()
+        blob = "data"
+        dim_in = input_dim
+        for i in range(6):
+            blob = m.FC(blob, "fc{}".format(i), dim_in=dim_in,
+                        dim_out=output_dim)
+            blob = blob.Relu([], blob)
+            dim_in = output_dim
+        blob.Softmax([], "pred") \
+            .LabelCrossEntropy(["label"], ["xent"]) \
+            .AveragedLoss([], "loss")
+        input_to_grad = m.AddGradientOperators(["loss"])
+        m.net.Proto().device_option.CopyFrom(do)
+        m.param_init_net.Proto().device_option.CopyFrom(do)
+
+        optim_proto = memonger.recompute_activations(
+            m.net.Proto(), num_segments, ["loss"])
+        freed = [b for op in optim_proto.op if op.type == "Free"
+                 for b in op.output]
+        self.assertIn("fc0", freed)
+        self.assertNotIn("loss", freed)
+
+        # Test networks produce exactly same gradients
+        data = np.random.randn(batch_size, input_dim).astype(np.float32)
+        label = np.random.randint(
+            low=0, high=output_dim, size=(batch_size,)).astype(np.int32)
+        workspace.RunNetOnce(m.param_init_net)
+        workspace.FeedBlob("data", data, device_option=do)
+        workspace.FeedBlob("label", label, device_option=do)
+        workspace.RunNetOnce(m.net)
+        loss = workspace.FetchBlob("loss")
+        grads = [workspace.FetchBlob(str(input_to_grad[p]))
+                 for p in m.params]
+        workspace.RunNetOnce(optim_proto)
+        optimized_loss = workspace.FetchBlob("loss")
+        optimized_grads = [workspace.FetchBlob(str(input_to_grad[p]))
+                           for p in m.params]
+        np.testing.assert_almost_equal(loss, optimized_loss)
+        for grad, optimized_grad in zip(grads, optimized_grads):
+            np.testing.assert_almost_equal(grad, optimized_grad)
+
+    @unittest.skipIf(not workspace.has_gpu_support, "No gpu support.")
+    @given(input_dim=st.integers(min_value=1, max_value=4),
+           output_dim=st.integers(min_value=1, max_value=4),
+           batch_size=st.integers(min_value=1, max_value=4),
+           prefetch_distance=st.integers(min_value=0, max_value=4),
+           net_type=st.sampled_from(["simple", "async_dag"]))
+    def test_offload_activations(
+            self, input_dim, output_dim, batch_size, prefetch_distance,
+            net_type):
+        m = cnn.CNNModelHelper()
+        blob = "data"
+        dim_in = input_dim
+        for i in range(4):
+            blob = m.FC(blob, "fc{}".format(i), dim_in=dim_in,
+                        dim_out=output_dim)
+            blob = blob.Relu([], blob)
+            dim_in = output_dim
+        blob.Softmax([], "pred") \
+            .LabelCrossEntropy(["label"], ["xent"]) \
+            .AveragedLoss([], "loss")
+        input_to_grad = m.AddGradientOperators(["loss"])
+        m.net.Proto().device_option.CopyFrom(hu.gpu_do)
+        m.param_init_net.Proto().device_option.CopyFrom(hu.gpu_do)
+
+        optim_proto = memonger.offload_activations(
+            m.net.Proto(), ["fc0", "fc1", "fc2"], prefetch_distance)
+        optim_proto.type = net_type
+        optim_proto.num_workers = 4
+        self.assertEqual(
+            [op.type for op in optim_proto.op].count("CopyCPUToGPU"), 3)
+
+        # Test networks produce exactly same gradients
+        data = np.random.randn(batch_size, input_dim).astype(np.float32)
+        label = np.random.randint(
+            low=0, high=output_dim, size=(batch_size,)).astype(np.int32)
+        workspace.RunNetOnce(m.param_init_net)
+        workspace.FeedBlob("data", data, device_option=hu.gpu_do)
+        workspace.FeedBlob("label", label, device_option=hu.gpu_do)
+        workspace.RunNetOnce(m.net)
+        loss = workspace.FetchBlob("loss")
+        grads = [workspace.FetchBlob(str(input_to_grad[p]))
+                 for p in m.params]
+        workspace.RunNetOnce(optim_proto)
+        optimized_loss = workspace.FetchBlob("loss")
+        optimized_grads = [workspace.FetchBlob(str(input_to_grad[p]))
+                           for p in m.params]
+        np.testing.assert_almost_equal(loss, optimized_loss)
+        for grad, optimized_grad in zip(grads, optimized_grads):
+            np.testing.assert_almost_equal(grad, optimized_grad)
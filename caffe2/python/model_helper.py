@@ -299,6 +299,10 @@ class ModelHelperBase(object):
             "LearningRate",
             "MakeTwoClass",
             "MatMul",
+            "MomentumSGDUpdate",
+            "MultiAdagrad",
+            "MultiAdam",
+            "MultiMomentumSGDUpdate",
             "NCCLAllreduce",
             "NHWC2NCHW",
             "PackSegments",
@@ -1,14 +1,18 @@
 """muji.py does multi-gpu training for caffe2 with no need to change the c++
 side code. Everything is defined on the computation graph level.
 
-Currently, here are the assumptions: we only support the following use cases:
+Allreduce picks its algorithm from the peer access pattern of the gpus:
   - 2 gpus, where peer access is enabled between them.
   - 4 gpus, where peer access are enabled between all of them.
   - 8 gpus, where peer access are enabled in two groups,
     between {1, 2, 3, 4} and {5, 6, 7, 8}.
+Any other case uses a fallback that only moves data with Copy operators,
+which stage copies through the host between gpus without peer access.
 """
 
-from caffe2.python import core
+import numpy as np
+
+from caffe2.python import core, workspace
 from caffe2.proto import caffe2_pb2
 
 
@@ -38,16 +42,65 @@ def Allreduce(net, blobs, reduced_affix="_reduced", gpu_indices=None):
             "gpu_indices length and blobs length mismatch: %d vs %d" %
             (len(gpu_indices), len(blobs))
         )
-    if len(blobs) == 2:
+    # The Add operators of the tree algorithms read blobs from other gpus,
+    # which needs peer access.
+    pattern = _PeerAccessPattern(gpu_indices)
+    if len(blobs) == 2 and np.all(pattern):
         return Allreduce2(net, blobs, reduced_affix, gpu_indices)
-    elif len(blobs) == 4:
+    elif len(blobs) == 4 and np.all(pattern):
         return Allreduce4(net, blobs, reduced_affix, gpu_indices)
-    elif len(blobs) == 8:
+    elif (len(blobs) == 8 and np.all(pattern[:4, :4]) and
+          np.all(pattern[4:, 4:])):
         return Allreduce8(net, blobs, reduced_affix, gpu_indices)
     else:
         return AllreduceFallback(net, blobs, reduced_affix, gpu_indices)
 
 
+def _PeerAccessPattern(gpu_indices):
+    """Returns the peer access pattern between the given gpus, as a boolean
+  matrix indexed by position in gpu_indices.
+  """
+    gpu_indices = list(gpu_indices)
+    pattern = workspace.GetCudaPeerAccessPattern()
+    return pattern[np.ix_(gpu_indices, gpu_indices)]
+
+
+def Broadcast(net, blobs, gpu_indices=None):
+    """Copies blobs[0], which lives on gpu_indices[0], to blobs[1:] on the
+  other gpus.
+
+  Algorithm: a tree where every gpu that already has the blob copies it to
+  one more gpu per round, so it takes log2(n) rounds instead of n - 1 copies
+  out of the first gpu. Each copy is taken from a gpu with peer access to the
+  destination when there is one.
+  """
+    if gpu_indices is None:
+        gpu_indices = range(len(blobs))
+    gpu_indices = list(gpu_indices)
+    if len(gpu_indices) != len(blobs):
+        raise RuntimeError(
+            "gpu_indices length and blobs length mismatch: %d vs %d" %
+            (len(gpu_indices), len(blobs))
+        )
+    pattern = _PeerAccessPattern(gpu_indices)
+    have = [0]
+    missing = list(range(1, len(blobs)))
+    while missing:
+        for src in list(have):
+            if not missing:
+                break
+            peers = [dst for dst in missing if pattern[dst, src]]
+            dst = peers[0] if peers else missing[0]
+            missing.remove(dst)
+            net.Copy(
+                blobs[src],
+                blobs[dst],
+                device_option=OnGPU(gpu_indices[dst])
+            )
+            have.append(dst)
+    return blobs
+
+
 def Allreduce2(net, blobs, reduced_affix, gpu_indices):
     """Allreduce for 2 gpus.
 
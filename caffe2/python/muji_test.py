@@ -36,6 +36,25 @@ class TestMuji(test_util.TestCase):
                 err_msg="gpu id %d of %s" % (idx, str(gpu_ids))
             )
 
+    def testBroadcast(self):
+        gpu_ids = range(workspace.NumCudaDevices())
+        net = core.Net("mujibroadcast")
+        net.ConstantFill(
+            [],
+            "bcast_gpu_0",
+            shape=[1, 2, 3, 4],
+            value=42.,
+            device_option=muji.OnGPU(0)
+        )
+        muji.Broadcast(net, ["bcast_gpu_" + str(i) for i in gpu_ids], gpu_ids)
+        workspace.RunNetOnce(net)
+        for idx in gpu_ids:
+            np.testing.assert_array_equal(
+                workspace.FetchBlob("bcast_gpu_" + str(idx)),
+                42.,
+                err_msg="gpu id %d" % idx
+            )
+
     def testAllreduceFallback(self):
         self.RunningAllreduceWithGPUs(
             range(workspace.NumCudaDevices()), muji.AllreduceFallback
@@ -0,0 +1,45 @@
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+from caffe2.python import core
+from hypothesis import given
+import caffe2.python.hypothesis_test_util as hu
+import hypothesis.strategies as st
+import numpy as np
+
+import unittest
+
+
+class TestBucketOps(hu.HypothesisTestCase):
+
+    @given(shapes=st.lists(
+        st.lists(st.integers(0, 5), min_size=0, max_size=3),
+        min_size=1, max_size=5),
+        **hu.gcs)
+    def test_pack_unpack_bucket(self, shapes, gc, dc):
+        inputs = [np.random.rand(*shape).astype(np.float32)
+                  for shape in shapes]
+        names = ["X_{}".format(i) for i in range(len(inputs))]
+
+        pack = core.CreateOperator("PackBucket", names, ["bucket"])
+
+        def pack_ref(*inputs):
+            return [np.concatenate([x.flatten() for x in inputs])]
+
+        self.assertReferenceChecks(gc, pack, inputs, pack_ref)
+        self.assertDeviceChecks(dc, pack, inputs, [0])
+
+        bucket = pack_ref(*inputs)[0] * 2
+        unpack = core.CreateOperator(
+            "UnpackBucket", ["bucket"] + names, names)
+
+        def unpack_ref(bucket, *inputs):
+            return [x * 2 for x in inputs]
+
+        self.assertReferenceChecks(gc, unpack, [bucket] + inputs, unpack_ref)
+
+
+if __name__ == "__main__":
+    unittest.main()
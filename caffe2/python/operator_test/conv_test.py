@@ -7,7 +7,7 @@ from hypothesis import assume, given
 import hypothesis.strategies as st
 import collections
 
-from caffe2.python import core, workspace
+from caffe2.python import core, utils, workspace
 import caffe2.python.hypothesis_test_util as hu
 
 
@@ -261,8 +261,10 @@ class TestConvolution(hu.HypothesisTestCase):
                ["simple", "dag"] +
                (["async_dag"] if workspace.has_gpu_support else [])),
            do=st.sampled_from(hu.device_options),
-           engine=st.sampled_from(["CUDNN", ""]))
-    def test_convolution_sync(self, net_type, num_workers, do, engine):
+           engine=st.sampled_from(["CUDNN", ""]),
+           streams_per_gpu=st.integers(1, 3))
+    def test_convolution_sync(self, net_type, num_workers, do, engine,
+                              streams_per_gpu):
         from caffe2.python.cnn import CNNModelHelper
         m = CNNModelHelper()
         n = 1
@@ -315,6 +317,8 @@ class TestConvolution(hu.HypothesisTestCase):
         m.param_init_net.Proto().device_option.CopyFrom(do)
         m.Proto().type = net_type
         m.Proto().num_workers = num_workers
+        m.Proto().arg.extend(
+            [utils.MakeArgument("streams_per_gpu", streams_per_gpu)])
         self.ws.run(m.param_init_net)
 
         def run():
@@ -315,6 +315,35 @@ class TestDatasetOps(TestCase):
             actual = FetchRecord(batch)
             _assert_records_equal(actual, entry)
 
+    def test_sharded_read_next_batch(self):
+        fields = ['a', 'b:lengths', 'b:values']
+        a = np.arange(10).astype(np.int32)
+        b_lengths = (a % 3).astype(np.int32)
+        b_values = np.array(
+            [i * 100 + k for i in a for k in range(i % 3)]).astype(np.int32)
+        workspace.FeedBlob('a', a)
+        workspace.FeedBlob('b_lengths', b_lengths)
+        workspace.FeedBlob('b_values', b_values)
+        net = core.Net('init')
+        net.CreateTreeCursor([], ['cursor'], fields=fields, num_shards=3)
+        workspace.RunNetOnce(net)
+
+        # The shards cover contiguous and disjoint ranges of the entries.
+        shards = [[0, 1, 2], [3, 4, 5], [6, 7, 8, 9]]
+        for shard_id, expected in enumerate(shards):
+            net = core.Net('read_%d' % shard_id)
+            net.ReadNextBatch(
+                ['cursor', 'a', 'b_lengths', 'b_values'],
+                ['out_a', 'out_lengths', 'out_values'],
+                batch_size=10,
+                shard_id=shard_id)
+            workspace.RunNetOnce(net)
+            np.testing.assert_array_equal(
+                workspace.FetchBlob('out_a'), expected)
+            np.testing.assert_array_equal(
+                workspace.FetchBlob('out_values'),
+                [i * 100 + k for i in expected for k in range(i % 3)])
+
     def test_last_n_window_ops(self):
         collect_net = core.Net('collect_net')
         collect_net.GivenTensorFill(
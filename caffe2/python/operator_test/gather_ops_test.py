@@ -6,6 +6,9 @@ import numpy as np
 
 from caffe2.python import core, workspace
 from caffe2.python.test_util import TestCase
+from hypothesis import given
+import caffe2.python.hypothesis_test_util as hu
+import hypothesis.strategies as st
 
 
 class TestGatherOps(TestCase):
@@ -19,6 +22,26 @@ class TestGatherOps(TestCase):
         outdata = np.array(["hello", "world", "!"], dtype='|S')
         assert((workspace.FetchBlob('word') == outdata).all())
 
+
+class TestGatherNumericOps(hu.HypothesisTestCase):
+    @given(rows=st.integers(1, 20),
+           block=st.integers(1, 9),
+           num_indices=st.integers(0, 30),
+           dtype=st.sampled_from([np.float32, np.int64, np.uint8]),
+           index_type=st.sampled_from([np.int32, np.int64]),
+           **hu.gcs)
+    def test_gather(self, rows, block, num_indices, dtype, index_type,
+                    gc, dc):
+        data = (np.random.rand(rows, block) * 100).astype(dtype)
+        ind = np.random.randint(rows, size=num_indices).astype(index_type)
+        op = core.CreateOperator('Gather', ['data', 'ind'], ['output'])
+
+        def gather(data, ind):
+            return [data[ind]]
+
+        self.assertReferenceChecks(gc, op, [data, ind], gather)
+
+
 if __name__ == "__main__":
     import unittest
     unittest.main()
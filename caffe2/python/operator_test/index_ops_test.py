@@ -120,12 +120,55 @@ class TestIndexOps(TestCase):
             'new_entry2', 'miss1', 'miss2', 'miss3',
         ], str, 'StringIndexCreate')
 
+    def test_string_index_ops_with_packed_strings(self):
+        workspace.RunOperatorOnce(core.CreateOperator(
+            'StringIndexCreate', [], ['packed_index']))
+        workspace.FeedBlob(
+            'packed_entries', np.array(['a', 'bb', ''], dtype=str))
+        workspace.RunOperatorOnce(core.CreateOperator(
+            'PackStrings', ['packed_entries'], ['packed_entries']))
+        workspace.RunOperatorOnce(core.CreateOperator(
+            'IndexLoad', ['packed_index', 'packed_entries'], ['packed_index']))
+
+        query = np.array([['bb', 'c'], ['', 'a']], dtype=str)
+        workspace.FeedBlob('query', query)
+        workspace.RunOperatorOnce(core.CreateOperator(
+            'PackStrings', ['query'], ['packed_query']))
+        # Packed and unpacked keys share the index.
+        for keys in ['packed_query', 'query']:
+            workspace.RunOperatorOnce(core.CreateOperator(
+                'IndexGet', ['packed_index', keys], ['result']))
+            np.testing.assert_array_equal(
+                [[2, 4], [3, 1]], workspace.FetchBlob('result'))
+
     def test_int_index_ops(self):
         self._test_index_ops(range(8), np.int32, 'IntIndexCreate')
 
     def test_long_index_ops(self):
         self._test_index_ops(range(8), np.int64, 'LongIndexCreate')
 
+    def test_large_index(self):
+        # Large enough to grow the hash tables and use the parallel lookup.
+        workspace.RunOperatorOnce(core.CreateOperator(
+            'LongIndexCreate', [], ['large_index']))
+        keys = np.random.permutation(20000).astype(np.int64) * 7919
+        query = np.concatenate((keys, keys[::-1]))
+        workspace.FeedBlob('large_query', query)
+        workspace.RunOperatorOnce(core.CreateOperator(
+            'IndexGet', ['large_index', 'large_query'], ['large_result']))
+        result = workspace.FetchBlob('large_result')
+        np.testing.assert_array_equal(np.arange(1, 20001), result[:20000])
+        np.testing.assert_array_equal(result[:20000][::-1], result[20000:])
+
+        workspace.RunOperatorOnce(core.CreateOperator(
+            'IndexFreeze', ['large_index'], ['large_index']))
+        workspace.FeedBlob('large_query', np.concatenate((keys, [-1])))
+        workspace.RunOperatorOnce(core.CreateOperator(
+            'IndexGet', ['large_index', 'large_query'], ['large_result']))
+        result = workspace.FetchBlob('large_result')
+        np.testing.assert_array_equal(np.arange(1, 20001), result[:20000])
+        self.assertEqual(result[20000], 0)
+
 if __name__ == "__main__":
     import unittest
     unittest.main()
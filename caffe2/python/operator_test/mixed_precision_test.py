@@ -0,0 +1,178 @@
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+from caffe2.python import core, workspace
+from hypothesis import given
+import caffe2.python.hypothesis_test_util as hu
+import hypothesis.strategies as st
+import numpy as np
+
+import unittest
+
+
+class TestMixedPrecision(hu.HypothesisTestCase):
+
+    @given(n=st.integers(1, 100),
+           overflow=st.sampled_from([None, np.inf, -np.inf, np.nan]),
+           **hu.gcs)
+    def test_check_overflow(self, n, overflow, gc, dc):
+        X = np.random.randn(n).astype(np.float32)
+        Y = np.random.randn(n).astype(np.float16)
+        if overflow is not None:
+            Y[np.random.randint(n)] = overflow
+
+        op = core.CreateOperator("CheckOverflow", ["X", "Y"], ["found_inf"])
+
+        def check_overflow(X, Y):
+            found = not (np.isfinite(X).all() and np.isfinite(Y).all())
+            return [np.array([found], dtype=np.float32)]
+
+        self.assertReferenceChecks(gc, op, [X, Y], check_overflow)
+
+    @given(found_inf=st.booleans(),
+           good_steps=st.integers(0, 3),
+           **hu.gcs)
+    def test_update_loss_scale(self, found_inf, good_steps, gc, dc):
+        loss_scale = np.array([1024], dtype=np.float32)
+        found = np.array([found_inf], dtype=np.float32)
+        steps = np.array([good_steps], dtype=np.int32)
+
+        op = core.CreateOperator(
+            "UpdateLossScale",
+            ["loss_scale", "found_inf", "good_steps"],
+            ["loss_scale", "good_steps"],
+            growth_interval=3,
+        )
+
+        def update_loss_scale(loss_scale, found, steps):
+            if found[0]:
+                return [loss_scale / 2, np.zeros(1, dtype=np.int32)]
+            if steps[0] + 1 >= 3:
+                return [loss_scale * 2, np.zeros(1, dtype=np.int32)]
+            return [loss_scale, steps + 1]
+
+        self.assertReferenceChecks(
+            gc, op, [loss_scale, found, steps], update_loss_scale)
+
+    @given(n=st.integers(4, 64),
+           nesterov=st.booleans(),
+           found_inf=st.booleans(),
+           **hu.gcs)
+    def test_mixed_precision_momentum_sgd(
+            self, n, nesterov, found_inf, gc, dc):
+        loss_scale = np.array([128], dtype=np.float32)
+        grad = (np.random.randn(n) * loss_scale).astype(np.float16)
+        moment = np.random.rand(n).astype(np.float32)
+        lr = np.random.rand(1).astype(np.float32)
+        param = np.random.rand(n).astype(np.float32)
+        found = np.array([found_inf], dtype=np.float32)
+        momentum = 0.9
+
+        op = core.CreateOperator(
+            "MixedPrecisionMomentumSGDUpdate",
+            ["grad", "moment", "lr", "param", "loss_scale", "found_inf"],
+            ["moment", "param", "param_fp16"],
+            momentum=momentum,
+            nesterov=int(nesterov),
+        )
+
+        def mixed_precision_momentum_sgd(
+                grad, moment, lr, param, loss_scale, found):
+            if found[0]:
+                return [moment, param, param.astype(np.float16)]
+            g = grad.astype(np.float32) / loss_scale
+            moment_new = momentum * moment + lr * g
+            if nesterov:
+                param = param - ((1 + momentum) * moment_new -
+                                 momentum * moment)
+            else:
+                param = param - moment_new
+            return [moment_new, param, param.astype(np.float16)]
+
+        self.assertReferenceChecks(
+            gc,
+            op,
+            [grad, moment, lr, param, loss_scale, found],
+            mixed_precision_momentum_sgd,
+            threshold=1e-3,
+        )
+
+    @given(n=st.integers(4, 64),
+           found_inf=st.booleans(),
+           **hu.gcs)
+    def test_mixed_precision_adam(self, n, found_inf, gc, dc):
+        param = np.random.rand(n).astype(np.float32)
+        m1 = np.random.rand(n).astype(np.float32)
+        m2 = np.random.rand(n).astype(np.float32)
+        loss_scale = np.array([64], dtype=np.float32)
+        grad = (np.random.randn(n) * loss_scale).astype(np.float16)
+        lr = -np.random.rand(1).astype(np.float32)
+        iteration = np.array([5], dtype=np.int64)
+        found = np.array([found_inf], dtype=np.float32)
+        beta1, beta2, epsilon = 0.9, 0.999, 1e-5
+
+        op = core.CreateOperator(
+            "MixedPrecisionAdam",
+            ["param", "m1", "m2", "grad", "lr", "iter", "loss_scale",
+             "found_inf"],
+            ["param", "m1", "m2", "param_fp16"],
+            beta1=beta1,
+            beta2=beta2,
+            epsilon=epsilon,
+        )
+
+        def mixed_precision_adam(
+                param, m1, m2, grad, lr, iteration, loss_scale, found):
+            if found[0]:
+                return [param, m1, m2, param.astype(np.float16)]
+            g = grad.astype(np.float32) / loss_scale
+            t = iteration + 1
+            rate = lr * np.sqrt(1 - beta2 ** t) / (1 - beta1 ** t)
+            m1 = beta1 * m1 + (1 - beta1) * g
+            m2 = beta2 * m2 + (1 - beta2) * g * g
+            param = param + rate * m1 / (np.sqrt(m2) + epsilon)
+            return [param, m1, m2, param.astype(np.float16)]
+
+        self.assertReferenceChecks(
+            gc,
+            op,
+            [param, m1, m2, grad, lr, iteration, loss_scale, found],
+            mixed_precision_adam,
+            input_device_options={"iter": hu.cpu_do},
+            threshold=1e-3,
+        )
+
+    @unittest.skipIf(not workspace.has_gpu_support, "No gpu support.")
+    @given(n=st.integers(1, 16), m=st.integers(1, 16),
+           k=st.integers(1, 16), **hu.gcs_gpu_only)
+    def test_fc_fp16(self, n, m, k, gc, dc):
+        X = (np.random.rand(m, k) - 0.5).astype(np.float16)
+        W = (np.random.rand(n, k) - 0.5).astype(np.float16)
+        b = (np.random.rand(n) - 0.5).astype(np.float16)
+
+        op = core.CreateOperator("FCFp16", ["X", "W", "b"], ["Y"])
+
+        def fc(X, W, b):
+            Y = np.dot(X.astype(np.float32), W.astype(np.float32).T)
+            return [(Y + b.astype(np.float32)).astype(np.float16)]
+
+        self.assertReferenceChecks(gc, op, [X, W, b], fc, threshold=1e-2)
+
+    @unittest.skipIf(not workspace.has_gpu_support, "No gpu support.")
+    @given(n=st.integers(1, 100), **hu.gcs_gpu_only)
+    def test_add_and_sum_fp16(self, n, gc, dc):
+        X = np.random.randn(n).astype(np.float16)
+        Y = np.random.randn(n).astype(np.float16)
+
+        def add(X, Y):
+            return [(X.astype(np.float32) + Y.astype(np.float32)).astype(
+                np.float16)]
+
+        for op_type in ["Add", "Sum"]:
+            op = core.CreateOperator(op_type, ["X", "Y"], ["Z"])
+            self.assertReferenceChecks(gc, op, [X, Y], add, threshold=1e-3)
+
+
+if __name__ == "__main__":
+    unittest.main()
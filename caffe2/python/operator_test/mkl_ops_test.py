@@ -0,0 +1,99 @@
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import unittest
+
+import hypothesis.strategies as st
+from hypothesis import given, settings
+import numpy as np
+
+from caffe2.python import core, workspace
+import caffe2.python.hypothesis_test_util as hu
+import caffe2.python.mkl_test_util as mu
+
+
+def _rand(*shape):
+    return np.random.rand(*shape).astype(np.float32) - 0.5
+
+
+@unittest.skipIf(not workspace.C.has_mkldnn,
+                 "Skipping as we do not have mkldnn.")
+class MKLOpsTest(hu.HypothesisTestCase):
+    @given(batch_size=st.integers(1, 3),
+           input_channels=st.integers(1, 8),
+           output_channels=st.integers(1, 8),
+           spatial=st.booleans(),
+           **mu.gcs)
+    def test_fc(self, batch_size, input_channels, output_channels, spatial,
+                gc, dc):
+        X = (_rand(batch_size, input_channels, 3, 3) if spatial
+             else _rand(batch_size, input_channels))
+        K = X.size // batch_size
+        W = _rand(output_channels, K)
+        b = _rand(output_channels)
+        op = core.CreateOperator("FC", ["X", "W", "b"], "Y")
+        self.assertDeviceChecks(dc, op, [X, W, b], [0])
+
+    @given(op_type=st.sampled_from(["MaxPool", "AveragePool"]),
+           stride=st.integers(1, 2),
+           kernel=st.integers(1, 3),
+           size=st.integers(5, 8),
+           global_pooling=st.booleans(),
+           **mu.gcs)
+    def test_pool(self, op_type, stride, kernel, size, global_pooling,
+                  gc, dc):
+        if global_pooling:
+            op = core.CreateOperator(
+                op_type, ["X"], "Y", global_pooling=True, order="NCHW")
+        else:
+            op = core.CreateOperator(
+                op_type, ["X"], "Y",
+                stride=stride, kernel=kernel, order="NCHW")
+        self.assertDeviceChecks(dc, op, [_rand(2, 3, size, size)], [0])
+
+    @given(size=st.sampled_from([1, 3, 5]), **mu.gcs)
+    def test_lrn(self, size, gc, dc):
+        op = core.CreateOperator(
+            "LRN", ["X"], "Y",
+            size=size, alpha=0.001, beta=0.75, bias=2.0, order="NCHW")
+        self.assertDeviceChecks(dc, op, [_rand(2, 8, 4, 4)], [0])
+
+    @given(channels=st.integers(1, 8), **mu.gcs)
+    def test_spatial_bn_test_mode(self, channels, gc, dc):
+        X = _rand(2, channels, 4, 4)
+        scale = _rand(channels) + 1
+        bias = _rand(channels)
+        mean = _rand(channels)
+        var = np.random.rand(channels).astype(np.float32) + 0.5
+        op = core.CreateOperator(
+            "SpatialBN", ["X", "scale", "bias", "mean", "var"], "Y",
+            is_test=1, epsilon=1e-5, order="NCHW")
+        self.assertDeviceChecks(dc, op, [X, scale, bias, mean, var], [0])
+
+    @given(num_inputs=st.integers(1, 4), **mu.gcs)
+    def test_sum(self, num_inputs, gc, dc):
+        inputs = [_rand(2, 3, 4, 4) for _ in range(num_inputs)]
+        op = core.CreateOperator(
+            "Sum", ["X{}".format(i) for i in range(num_inputs)], "Y")
+        self.assertDeviceChecks(dc, op, inputs, [0])
+
+    @given(channels=st.lists(st.integers(1, 4), min_size=1, max_size=4),
+           **mu.gcs)
+    def test_concat(self, channels, gc, dc):
+        inputs = [_rand(2, c, 3, 3) for c in channels]
+        op = core.CreateOperator(
+            "Concat", ["X{}".format(i) for i in range(len(channels))],
+            ["Y", "split"], order="NCHW")
+        self.assertDeviceChecks(dc, op, inputs, [0, 1])
+
+    @given(batch_size=st.integers(1, 4), dim=st.integers(1, 32), **mu.gcs)
+    @settings(max_examples=10)
+    def test_softmax(self, batch_size, dim, gc, dc):
+        op = core.CreateOperator("Softmax", ["X"], "Y")
+        self.assertDeviceChecks(dc, op, [_rand(batch_size, dim)], [0])
+
+
+if __name__ == "__main__":
+    unittest.main()
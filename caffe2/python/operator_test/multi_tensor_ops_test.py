@@ -0,0 +1,190 @@
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+from caffe2.python import core
+from hypothesis import given
+import caffe2.python.hypothesis_test_util as hu
+import hypothesis.strategies as st
+import numpy as np
+
+import unittest
+
+
+def _tensors(n, count):
+    # Sizes around the chunk size of the operators, so that some tensors are
+    # split in several chunks.
+    sizes = np.random.choice([1, 7, 65535, 65537, 140000], size=n)
+    return [[np.random.rand(size).astype(np.float32) for _ in range(count)]
+            for size in sizes]
+
+
+def _names(n, prefixes):
+    return [prefix + str(i) for i in range(n) for prefix in prefixes]
+
+
+class TestMultiTensorOps(hu.HypothesisTestCase):
+
+    @given(n=st.integers(1, 4), **hu.gcs)
+    def test_multi_adagrad(self, n, gc, dc):
+        params = _tensors(n, 3)
+        lr = np.random.rand(1).astype(np.float32)
+        epsilon = 1e-4
+
+        def adagrad(*inputs):
+            outputs = []
+            for i in range(n):
+                w, h, g = inputs[3 * i:3 * i + 3]
+                h = h + np.square(g)
+                outputs += [w + lr * g / (np.sqrt(h) + epsilon), h]
+            return outputs
+
+        op = core.CreateOperator(
+            "MultiAdagrad",
+            _names(n, ["w", "h", "g"]) + ["lr"],
+            _names(n, ["w", "h"]),
+            epsilon=epsilon,
+        )
+        self.assertReferenceChecks(
+            device_option=gc,
+            op=op,
+            inputs=[x for tensors in params for x in tensors] + [lr],
+            reference=adagrad,
+        )
+
+    @given(n=st.integers(1, 4),
+           clip_norm=st.floats(min_value=0.01, max_value=1000.0),
+           **hu.gcs)
+    def test_multi_adagrad_clip_norm(self, n, clip_norm, gc, dc):
+        params = _tensors(n, 3)
+        lr = np.random.rand(1).astype(np.float32)
+        epsilon = 1e-4
+
+        def adagrad(*inputs):
+            grads = inputs[2:3 * n:3]
+            norm = np.sqrt(sum(np.sum(np.square(g)) for g in grads))
+            scale = min(1.0, clip_norm / norm)
+            outputs = []
+            for i in range(n):
+                w, h, g = inputs[3 * i:3 * i + 3]
+                g = g * scale
+                h = h + np.square(g)
+                outputs += [w + lr * g / (np.sqrt(h) + epsilon), h]
+            return outputs
+
+        op = core.CreateOperator(
+            "MultiAdagrad",
+            _names(n, ["w", "h", "g"]) + ["lr"],
+            _names(n, ["w", "h"]),
+            epsilon=epsilon,
+            clip_norm=clip_norm,
+        )
+        self.assertReferenceChecks(
+            device_option=gc,
+            op=op,
+            inputs=[x for tensors in params for x in tensors] + [lr],
+            reference=adagrad,
+        )
+
+    @given(n=st.integers(1, 4),
+           iters=st.integers(min_value=0, max_value=10000),
+           **hu.gcs)
+    def test_multi_adam(self, n, iters, gc, dc):
+        params = _tensors(n, 4)
+        lr = np.random.rand(1).astype(np.float32)
+        beta1, beta2, epsilon = 0.9, 0.999, 1e-4
+        iters = np.array([iters], dtype=np.int64)
+
+        def adam(*inputs):
+            t = iters[0] + 1
+            correction = np.sqrt(1 - np.power(beta2, t)) / \
+                (1 - np.power(beta1, t))
+            outputs = []
+            for i in range(n):
+                w, m1, m2, g = inputs[4 * i:4 * i + 4]
+                m1 = m1 * beta1 + g * (1 - beta1)
+                m2 = m2 * beta2 + np.square(g) * (1 - beta2)
+                w = w + lr * correction * m1 / (np.sqrt(m2) + epsilon)
+                outputs += [w, m1, m2]
+            return outputs
+
+        op = core.CreateOperator(
+            "MultiAdam",
+            _names(n, ["w", "m1_", "m2_", "g"]) + ["lr", "iters"],
+            _names(n, ["w", "m1_", "m2_"]),
+            beta1=beta1, beta2=beta2, epsilon=epsilon,
+        )
+        self.assertReferenceChecks(
+            device_option=gc,
+            op=op,
+            inputs=[x for tensors in params for x in tensors] + [lr, iters],
+            reference=adam,
+            input_device_options={"iters": hu.cpu_do},
+        )
+
+    @given(n=st.integers(1, 4), nesterov=st.booleans(), **hu.gcs)
+    def test_multi_momentum_sgd(self, n, nesterov, gc, dc):
+        params = _tensors(n, 3)
+        lr = np.random.rand(1).astype(np.float32)
+        momentum = 0.9
+
+        def momentum_sgd(*inputs):
+            outputs = []
+            for i in range(n):
+                g, m, w = inputs[3 * i:3 * i + 3]
+                if not nesterov:
+                    m = g = lr * g + momentum * m
+                else:
+                    m_new = momentum * m + lr * g
+                    g = (1 + momentum) * m_new - momentum * m
+                    m = m_new
+                outputs += [g, m, w - g]
+            return outputs
+
+        names = _names(n, ["g", "m", "w"])
+        op = core.CreateOperator(
+            "MultiMomentumSGDUpdate",
+            names + ["lr"],
+            names,
+            momentum=momentum,
+            nesterov=int(nesterov),
+        )
+        self.assertReferenceChecks(
+            device_option=gc,
+            op=op,
+            inputs=[x for tensors in params for x in tensors] + [lr],
+            reference=momentum_sgd,
+        )
+
+    @given(n=st.integers(1, 4), **hu.gcs)
+    def test_multi_rmsprop(self, n, gc, dc):
+        params = _tensors(n, 3)
+        lr = np.random.rand(1).astype(np.float32)
+        decay, momentum, epsilon = 0.9, 0.5, 1e-4
+
+        def rmsprop(*inputs):
+            outputs = []
+            for i in range(n):
+                g, ms, mom = inputs[3 * i:3 * i + 3]
+                ms = ms + (1 - decay) * (np.square(g) - ms)
+                mom = mom * momentum + lr * g / np.sqrt(epsilon + ms)
+                outputs += [mom, ms, mom]
+            return outputs
+
+        names = _names(n, ["g", "ms", "mom"])
+        op = core.CreateOperator(
+            "MultiRmsProp",
+            names + ["lr"],
+            names,
+            decay=decay, momentum=momentum, epsilon=epsilon,
+        )
+        self.assertReferenceChecks(
+            device_option=gc,
+            op=op,
+            inputs=[x for tensors in params for x in tensors] + [lr],
+            reference=rmsprop,
+        )
+
+
+if __name__ == "__main__":
+    unittest.main()
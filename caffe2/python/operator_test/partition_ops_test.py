@@ -19,6 +19,9 @@ class TestPartitionOps(TestCase):
             ((5, ), 1),
             ((1, ), 1),
             ((2, 10), 2),
+            # large enough to be split across threads
+            ((50000, ), 5),
+            ((40000, ), 8),
         ]
         suffixes = [
             [],
@@ -37,10 +37,10 @@ class TesterBase:
         ]
         return self.unsplit(data.shape[1:], segment_grads, segment_ids)
 
-    def test(self, prefix, input_strategy, refs):
+    def test(self, prefix, input_strategy, refs, gpu=False):
         tester = self
 
-        @given(X=input_strategy, **hu.gcs_cpu_only)
+        @given(X=input_strategy, **(hu.gcs if gpu else hu.gcs_cpu_only))
         def test_segment_ops(self, X, gc, dc):
             for op_name, ref, grad_ref in refs:
                 inputs = ['input%d' % i for i in range(0, len(X))]
@@ -267,7 +267,8 @@ class TestSegmentOps(hu.HypothesisTestCase):
                 is_sorted=True,
                 allow_empty=True
             ),
-            REFERENCES_ALL
+            REFERENCES_ALL,
+            gpu=True
         )(self)
 
     def test_sparse_unsorted_segment_ops(self):
@@ -290,7 +291,8 @@ class TestSegmentOps(hu.HypothesisTestCase):
                 max_value=10,
                 allow_empty=True
             ),
-            REFERENCES_ALL
+            REFERENCES_ALL,
+            gpu=True
         )(self)
 
     def test_sparse_lengths_ops(self):
@@ -302,7 +304,8 @@ class TestSegmentOps(hu.HypothesisTestCase):
                 max_value=10,
                 allow_empty=True
             ),
-            REFERENCES_ALL
+            REFERENCES_ALL,
+            gpu=True
         )(self)
 
 if __name__ == "__main__":
@@ -3,6 +3,7 @@ from __future__ import division
 from __future__ import print_function
 from __future__ import unicode_literals
 import numpy as np
+from caffe2.proto import caffe2_pb2
 from caffe2.python import core, workspace
 from caffe2.python.test_util import TestCase, rand_array
 
@@ -23,11 +24,19 @@ class TestScatterOps(TestCase):
         # TODO(dzhulgakov): add test cases for failure scenarios
 
     def testScatterWeightedSum(self):
+        device_options = [core.DeviceOption(caffe2_pb2.CPU)]
+        if workspace.has_gpu_support:
+            device_options.append(core.DeviceOption(caffe2_pb2.CUDA, 0))
+        for device_option in device_options:
+            self._testScatterWeightedSum(device_option)
+
+    def _testScatterWeightedSum(self, device_option):
         for num_args in [1, 2]:
             ins = ['data', 'w0', 'indices']
             for i in range(1, num_args + 1):
                 ins.extend(['x' + str(i), 'w' + str(i)])
-            op = core.CreateOperator('ScatterWeightedSum', ins, ['data'])
+            op = core.CreateOperator('ScatterWeightedSum', ins, ['data'],
+                                     device_option=device_option)
             for first_dim, index_dim, extra_dims in self.test_configs():
                 for dtype in [np.int32, np.int64]:
                     d = rand_array(first_dim, *extra_dims)
@@ -39,14 +48,14 @@ class TestScatterOps(TestCase):
                         r[i] *= w0
 
                     # forward
-                    workspace.FeedBlob('data', d)
-                    workspace.FeedBlob('w0', w0)
-                    workspace.FeedBlob('indices', ind)
+                    workspace.FeedBlob('data', d, device_option)
+                    workspace.FeedBlob('w0', w0, device_option)
+                    workspace.FeedBlob('indices', ind, device_option)
                     for inp in range(1, num_args + 1):
                         w = rand_array()
                         x = rand_array(index_dim, *extra_dims)
-                        workspace.FeedBlob('x' + str(inp), x)
-                        workspace.FeedBlob('w' + str(inp), w)
+                        workspace.FeedBlob('x' + str(inp), x, device_option)
+                        workspace.FeedBlob('w' + str(inp), w, device_option)
                         for i, j in enumerate(ind):
                             r[j] += w * x[i]
                     workspace.RunOperatorOnce(op)
@@ -77,6 +86,31 @@ class TestScatterOps(TestCase):
                 out = workspace.FetchBlob('data')
                 np.testing.assert_allclose(out, r, rtol=1e-3)
 
+
+class TestSparseSum(TestCase):
+    def testSparseSum(self):
+        for index_shape, extra_dims in [((5,), []), ((3, 2), [4])]:
+            for dtype in [np.int32, np.int64]:
+                ins, dense = [], np.zeros([10] + extra_dims, dtype=np.float32)
+                for i in range(3):
+                    ind = np.random.randint(0, 10, index_shape).astype(dtype)
+                    x = rand_array(*(index_shape + tuple(extra_dims)))
+                    np.add.at(dense, ind, x)
+                    workspace.FeedBlob('indices' + str(i), ind)
+                    workspace.FeedBlob('values' + str(i), x)
+                    ins += ['indices' + str(i), 'values' + str(i)]
+                op = core.CreateOperator(
+                    'SparseSum', ins, ['indices', 'values'])
+                workspace.RunOperatorOnce(op)
+                indices = workspace.FetchBlob('indices')
+                values = workspace.FetchBlob('values')
+                self.assertEqual(indices.dtype, dtype)
+                self.assertEqual(len(set(indices)), len(indices))
+                self.assertEqual(values.shape, (len(indices),) + dense.shape[1:])
+                out = np.zeros_like(dense)
+                out[indices] = values
+                np.testing.assert_allclose(out, dense, rtol=1e-5)
+
 if __name__ == "__main__":
     import unittest
     unittest.main()
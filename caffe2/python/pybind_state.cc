@@ -1,12 +1,18 @@
 #include "pybind_state.h"
 
+#include <atomic>
+#include <cstring>
+#include <thread>
+
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
 #include "caffe2/core/asan.h"
 #include "caffe2/core/db.h"
+#include "caffe2/core/one_hot_fc_rewrite.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/core/predictor.h"
+#include "caffe2/queue/blobs_queue.h"
 #include "caffe2/utils/mkl_utils.h"
 #include "google/protobuf/io/coded_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl_lite.h"
@@ -487,6 +493,9 @@ void addObjectMethods(py::module& m) {
       .def_property_readonly("arg_desc", &OpSchema::arg_desc)
       .def_property_readonly("input_desc", &OpSchema::input_desc)
       .def_property_readonly("output_desc", &OpSchema::output_desc)
+      .def_property_readonly(
+          "accumulation_allowed_outputs",
+          &OpSchema::accumulation_allowed_outputs)
       // Note: this does not work yet, we will need to figure out how to pass
       // protobuf objects.
       .def("infer_tensor", &OpSchema::InferTensor)
@@ -526,6 +535,111 @@ NumpyImportArrayHelper() {
   import_array();
 }
 
+static DeviceOption ParseDeviceOption(const py::object& device_option) {
+  DeviceOption option;
+  if (device_option != py::none()) {
+    // If we have a device option passed in, read it.
+    CAFFE_ENFORCE(ParseProtobufFromLargeString(
+        py::bytes(device_option).cast<std::string>(), &option));
+  }
+  return option;
+}
+
+static void FeedBlobImpl(
+    Blob* blob,
+    const py::object& arg,
+    const DeviceOption& option,
+    bool zero_copy) {
+  if (PyArray_Check(arg.ptr())) { // numpy array
+    PyArrayObject* array = reinterpret_cast<PyArrayObject*>(arg.ptr());
+    if (zero_copy && option.device_type() == CPU) {
+      TensorFeeder<CPUContext>().FeedTensor(
+          option, array, blob->GetMutable<TensorCPU>(), true);
+      return;
+    }
+    auto feeder = CreateFeeder(option.device_type());
+    CAFFE_ENFORCE(feeder, "Unknown device type encountered in FeedBlob.");
+    feeder->Feed(option, array, blob);
+    return;
+  }
+  if (PyString_Check(arg.ptr())) { // string
+    *blob->GetMutable<std::string>() = arg.cast<std::string>();
+    return;
+  }
+  CAFFE_THROW(
+      "Unexpected type of argument - only numpy array or string are "
+      "supported for feeding");
+}
+
+static py::object FetchBlobImpl(const std::string& name, bool zero_copy) {
+  CAFFE_ENFORCE(gWorkspace->HasBlob(name), "Can't find blob: ", name);
+  const caffe2::Blob& blob = *(gWorkspace->GetBlob(name));
+  if (zero_copy && blob.IsType<TensorCPU>()) {
+    return TensorFetcher<CPUContext>()
+        .FetchTensor(blob.Get<TensorCPU>(), false)
+        .obj;
+  }
+  auto fetcher = CreateFetcher(blob.meta().id());
+  if (fetcher) {
+    return fetcher->Fetch(blob);
+  } else {
+    // If there is no fetcher registered, return a metainfo string.
+    // If all branches failed, we will return a metainfo string.
+    std::stringstream ss;
+    ss << caffe2::string(name) << ", a C++ native class of type "
+       << blob.TypeName() << ".";
+    return py::str(ss.str());
+  }
+}
+
+namespace {
+
+// A copy between a numpy array and a CPU tensor that feed_blobs and
+// fetch_blobs run after all the arrays and tensors are set up.
+struct PendingCopy {
+  const char* src;
+  char* dst;
+  size_t nbytes;
+};
+
+// Copies are split into pieces of this size, which are run on several
+// threads if there are more than one.
+constexpr size_t kCopyPieceBytes = 1 << 20;
+
+// Runs the copies with the GIL released, so other Python threads, such as
+// data workers, go on meanwhile.
+void RunPendingCopies(const std::vector<PendingCopy>& copies) {
+  std::vector<PendingCopy> pieces;
+  for (const auto& copy : copies) {
+    for (size_t offset = 0; offset < copy.nbytes; offset += kCopyPieceBytes) {
+      pieces.push_back(PendingCopy{
+          copy.src + offset,
+          copy.dst + offset,
+          std::min(kCopyPieceBytes, copy.nbytes - offset)});
+    }
+  }
+  const size_t num_threads = std::max<size_t>(
+      1,
+      std::min<size_t>(std::thread::hardware_concurrency(), pieces.size()));
+  py::gil_scoped_release g;
+  std::atomic<size_t> next(0);
+  auto work = [&pieces, &next]() {
+    for (size_t i = next++; i < pieces.size(); i = next++) {
+      memcpy(pieces[i].dst, pieces[i].src, pieces[i].nbytes);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+} // namespace
+
 void addGlobalMethods(py::module& m) {
   m.attr("is_asan") = py::bool_(CAFFE2_ASAN_ENABLED);
 
@@ -618,6 +732,111 @@ void addGlobalMethods(py::module& m) {
     CAFFE_ENFORCE(gWorkspace);
     return gWorkspace->Blobs();
   });
+  m.def("blob_memory_usage", []() {
+    CAFFE_ENFORCE(gWorkspace);
+    return gWorkspace->BlobMemoryUsage();
+  });
+  m.def("memory_usage", []() {
+    CAFFE_ENFORCE(gWorkspace);
+    return gWorkspace->MemoryUsage();
+  });
+  m.def(
+      "memory_in_use",
+      [](int device_type, int gpu_id) {
+        return MemoryTracker::Get()->BytesInUse(device_type, gpu_id);
+      },
+      py::arg("device_type") = static_cast<int>(CPU),
+      py::arg("gpu_id") = 0);
+  m.def(
+      "memory_peak",
+      [](int device_type, int gpu_id) {
+        return MemoryTracker::Get()->PeakBytes(device_type, gpu_id);
+      },
+      py::arg("device_type") = static_cast<int>(CPU),
+      py::arg("gpu_id") = 0);
+  m.def("reset_memory_peaks", []() { MemoryTracker::Get()->ResetPeaks(); });
+  m.def("start_memory_timeline", []() {
+    return MemoryTimeline::Get()->Start();
+  });
+  m.def(
+      "stop_memory_timeline",
+      [](const std::string& path) { MemoryTimeline::Get()->Stop(path); },
+      py::arg("path") = "");
+  m.def(
+      "memory_timeline_peak",
+      [](int device_type, int gpu_id) {
+        auto* timeline = MemoryTimeline::Get();
+        py::list contributions;
+        for (const auto& contribution :
+             timeline->PeakContributions(device_type, gpu_id)) {
+          py::dict entry;
+          entry["blobs"] = contribution.blobs;
+          entry["op"] = contribution.op;
+          entry["bytes"] = contribution.bytes;
+          contributions.append(entry);
+        }
+        return std::make_pair(
+            timeline->PeakBytes(device_type, gpu_id), contributions);
+      },
+      py::arg("device_type") = static_cast<int>(CPU),
+      py::arg("gpu_id") = 0);
+  m.def("net_memory_usage", [](const std::string& name) {
+    CAFFE_ENFORCE(gWorkspace);
+    auto usage = gWorkspace->LastRunMemoryUsage(name);
+    return std::make_pair(usage.bytes_at_start, usage.peak_bytes);
+  });
+  m.def(
+      "net_operator_profiles",
+      [](const std::string& name, bool by_type) {
+        CAFFE_ENFORCE(gWorkspace);
+        py::list profiles;
+        for (const auto& profile :
+             gWorkspace->NetOperatorProfiles(name, by_type)) {
+          py::dict entry;
+          entry["name"] = profile.name;
+          entry["type"] = profile.type;
+          entry["samples"] = profile.samples;
+          entry["total_us"] = profile.total_us;
+          entry["p50_us"] = profile.p50_us;
+          entry["p99_us"] = profile.p99_us;
+          if (!profile.events.empty()) {
+            py::dict events;
+            for (const auto& event : profile.events) {
+              events[py::str(event.first)] = event.second;
+            }
+            entry["events"] = events;
+            entry["event_samples"] = profile.event_samples;
+          }
+          profiles.append(entry);
+        }
+        return profiles;
+      },
+      py::arg("name"),
+      py::arg("by_type") = false);
+  m.def("reset_net_operator_profiles", [](const std::string& name) {
+    CAFFE_ENFORCE(gWorkspace);
+    auto* net = gWorkspace->GetNet(name);
+    CAFFE_ENFORCE(net, "Network ", name, " does not exist.");
+    net->ResetOperatorProfiles();
+  });
+  m.def("queue_stats", [](const std::string& name) {
+    CAFFE_ENFORCE(gWorkspace->HasBlob(name), "Can't find blob: ", name);
+    const auto& queue =
+        gWorkspace->GetBlob(name)->Get<std::shared_ptr<BlobsQueue>>();
+    CAFFE_ENFORCE(queue, "Queue ", name, " was not created.");
+    const auto stats = queue->getStats();
+    py::dict entry;
+    entry["reads"] = stats.reads;
+    entry["writes"] = stats.writes;
+    entry["blocked_reads"] = stats.blockedReads;
+    entry["blocked_writes"] = stats.blockedWrites;
+    entry["read_blocked_seconds"] = stats.readBlockedSeconds;
+    entry["write_blocked_seconds"] = stats.writeBlockedSeconds;
+    entry["occupancy"] = stats.occupancy;
+    entry["size"] = queue->getSize();
+    entry["capacity"] = queue->getCapacity();
+    return entry;
+  });
   m.def("has_blob", [](const std::string& name) {
     CAFFE_ENFORCE(gWorkspace);
     return gWorkspace->HasBlob(name);
@@ -664,6 +883,16 @@ void addGlobalMethods(py::module& m) {
     return true;
   });
   m.def("nets", []() { return gWorkspace->Nets(); });
+  m.def("rewrite_one_hot_fc", [](const py::bytes& net_def) {
+    CAFFE_ENFORCE(gWorkspace);
+    NetDef def;
+    CAFFE_ENFORCE(
+        ParseProtobufFromLargeString(net_def.cast<std::string>(), &def));
+    std::string rewritten;
+    CAFFE_ENFORCE(RewriteOneHotFC(def, gWorkspace).SerializeToString(
+        &rewritten));
+    return py::bytes(rewritten);
+  });
   m.def("run_operator_once", [](const py::bytes& op_def) {
     CAFFE_ENFORCE(gWorkspace);
     OperatorDef def;
@@ -731,51 +960,117 @@ void addGlobalMethods(py::module& m) {
     CAFFE_ENFORCE(gWorkspace->CreateBlob(name));
     return true;
   });
-  m.def("fetch_blob", [](const std::string& name) -> py::object {
-    CAFFE_ENFORCE(gWorkspace->HasBlob(name), "Can't find blob: ", name);
-    const caffe2::Blob& blob = *(gWorkspace->GetBlob(name));
-    auto fetcher = CreateFetcher(blob.meta().id());
-    if (fetcher) {
-      return fetcher->Fetch(blob);
-    } else {
-      // If there is no fetcher registered, return a metainfo string.
-      // If all branches failed, we will return a metainfo string.
-      std::stringstream ss;
-      ss << caffe2::string(name) << ", a C++ native class of type "
-         << blob.TypeName() << ".";
-      return py::str(ss.str());
-    }
-  });
   m.def(
-      "feed_blob",
-      [](const std::string& name, py::object arg, py::object device_option) {
-        DeviceOption option;
-        if (device_option != py::none()) {
-          // If we have a device option passed in, read it.
-          CAFFE_ENFORCE(ParseProtobufFromLargeString(
-              py::bytes(device_option).cast<std::string>(), &option));
-        }
-        auto* blob = gWorkspace->CreateBlob(name);
-        if (PyArray_Check(arg.ptr())) { // numpy array
-          PyArrayObject* array = reinterpret_cast<PyArrayObject*>(arg.ptr());
-          auto feeder = CreateFeeder(option.device_type());
-          CAFFE_ENFORCE(feeder, "Unknown device type encountered in FeedBlob.");
-          feeder->Feed(option, array, blob);
-          return true;
-        }
-
-        if (PyString_Check(arg.ptr())) { // string
-          *blob->GetMutable<std::string>() = arg.cast<std::string>();
-          return true;
+      "fetch_blob",
+      &FetchBlobImpl,
+      "Fetch a blob. With zero_copy, CPU tensors are returned as arrays that "
+      "view their memory, see TensorFetcher::FetchTensor().",
+      py::arg("name"),
+      py::arg("zero_copy") = false);
+  m.def(
+      "fetch_blobs",
+      [](const std::vector<std::string>& names) {
+        CAFFE_ENFORCE(gWorkspace);
+        py::list fetched;
+        std::vector<PendingCopy> copies;
+        for (const auto& name : names) {
+          CAFFE_ENFORCE(gWorkspace->HasBlob(name), "Can't find blob: ", name);
+          const Blob& blob = *gWorkspace->GetBlob(name);
+          const int numpy_type = blob.IsType<TensorCPU>()
+              ? CaffeToNumpyType(blob.Get<TensorCPU>().meta())
+              : -1;
+          if (numpy_type == -1 || numpy_type == NPY_OBJECT) {
+            fetched.append(FetchBlobImpl(name, false));
+            continue;
+          }
+          const auto& tensor = blob.Get<TensorCPU>();
+          std::vector<npy_intp> npy_dims(
+              tensor.dims().begin(), tensor.dims().end());
+          py::object array(
+              PyArray_SimpleNew(tensor.ndim(), npy_dims.data(), numpy_type),
+              /* borrowed */ false);
+          if (tensor.nbytes() > 0) {
+            copies.push_back(PendingCopy{
+                static_cast<const char*>(tensor.raw_data()),
+                static_cast<char*>(PyArray_DATA(
+                    reinterpret_cast<PyArrayObject*>(array.ptr()))),
+                tensor.nbytes()});
+          }
+          fetched.append(array);
         }
-        CAFFE_THROW(
-            "Unexpected type of argument - only numpy array or string are "
-            "supported for feeding");
-        return false;
+        RunPendingCopies(copies);
+        return fetched;
       },
-      "",
+      "Fetch several blobs, copying the CPU tensors with the GIL released. "
+      "Other threads must not change the blobs meanwhile.");
+  m.def(
+      "feed_blob",
+      [](const std::string& name,
+         py::object arg,
+         py::object device_option,
+         bool zero_copy) {
+        FeedBlobImpl(
+            gWorkspace->CreateBlob(name),
+            arg,
+            ParseDeviceOption(device_option),
+            zero_copy);
+        return true;
+      },
+      "Feed a blob. With zero_copy, a numpy array fed to the CPU is aliased "
+      "instead of copied, see TensorFeeder::FeedTensor().",
       py::arg("name"),
       py::arg("arg"),
+      py::arg("device_option") = py::none(),
+      py::arg("zero_copy") = false);
+  m.def(
+      "feed_blobs",
+      [](const std::vector<std::string>& names,
+         const std::vector<py::object>& args,
+         py::object device_option) {
+        CAFFE_ENFORCE(gWorkspace);
+        CAFFE_ENFORCE_EQ(names.size(), args.size());
+        const DeviceOption option = ParseDeviceOption(device_option);
+        std::vector<PendingCopy> copies;
+        // The contiguous versions of the arrays, until they are copied.
+        std::vector<py::object> arrays;
+        for (int i = 0; i < names.size(); ++i) {
+          auto* blob = gWorkspace->CreateBlob(names[i]);
+          if (option.device_type() != CPU || !PyArray_Check(args[i].ptr()) ||
+              PyArray_TYPE(reinterpret_cast<PyArrayObject*>(args[i].ptr())) ==
+                  NPY_OBJECT) {
+            FeedBlobImpl(blob, args[i], option, false);
+            continue;
+          }
+          arrays.emplace_back(
+              reinterpret_cast<PyObject*>(PyArray_GETCONTIGUOUS(
+                  reinterpret_cast<PyArrayObject*>(args[i].ptr()))),
+              /* borrowed */ false);
+          auto* array = reinterpret_cast<PyArrayObject*>(arrays.back().ptr());
+          const TypeMeta& meta = NumpyTypeToCaffe(PyArray_TYPE(array));
+          CAFFE_ENFORCE(
+              meta.id() != 0,
+              "This numpy data type is not supported: ",
+              PyArray_TYPE(array),
+              ".");
+          auto* tensor = blob->GetMutable<TensorCPU>();
+          tensor->Resize(std::vector<TIndex>(
+              PyArray_DIMS(array), PyArray_DIMS(array) + PyArray_NDIM(array)));
+          char* data = static_cast<char*>(tensor->raw_mutable_data(meta));
+          if (tensor->nbytes() > 0) {
+            copies.push_back(PendingCopy{
+                static_cast<const char*>(PyArray_DATA(array)),
+                data,
+                tensor->nbytes()});
+          }
+        }
+        RunPendingCopies(copies);
+        return true;
+      },
+      "Feed several blobs, parsing the device option once. Numpy arrays fed "
+      "to the CPU are copied with the GIL released, so they, and the blobs, "
+      "must not be changed by other threads meanwhile.",
+      py::arg("names"),
+      py::arg("args"),
       py::arg("device_option") = py::none());
   m.def("serialize_blob", [](const std::string& name) {
     CAFFE_ENFORCE(gWorkspace);
@@ -89,6 +89,12 @@ class TensorFetcher : public BlobFetcherBase {
         CaffeToNumpyType(meta) == NPY_OBJECT;
   }
 
+  // Without force_copy, CPU tensors of numeric types are returned as arrays
+  // that view the memory of the tensor. Such an array keeps the memory alive
+  // even after the tensor is resized, freed or fed again, at which point it
+  // stops seeing the tensor's data. Until then, writes through either side
+  // are seen by the other, and running ops that write the tensor while the
+  // array is read is a race. Arrays of copy-on-write tensors are read-only.
   FetchedBlob FetchTensor(const Tensor<Context>& tensor, bool force_copy) {
     FetchedBlob result;
     CAFFE_ENFORCE_GE(tensor.size(), 0, "Trying to fetch unitilized tensor");
@@ -111,11 +117,32 @@ class TensorFetcher : public BlobFetcherBase {
       outPtr = static_cast<void*>(
           PyArray_DATA(reinterpret_cast<PyArrayObject*>(result.obj.ptr())));
     } else {
-      outPtr = const_cast<Tensor<Context>&>(tensor).raw_mutable_data();
+      // Making a copy-on-write tensor mutable would copy its data.
+      const bool read_only = tensor.is_copy_on_write();
+      outPtr = read_only
+          ? const_cast<void*>(tensor.raw_data())
+          : const_cast<Tensor<Context>&>(tensor).raw_mutable_data();
       result.obj = pybind11::object(
           PyArray_SimpleNewFromData(
               tensor.ndim(), npy_dims.data(), numpy_type, outPtr),
           /* borrowed */ false);
+      auto* array = reinterpret_cast<PyArrayObject*>(result.obj.ptr());
+      // The array holds a tensor that shares the memory, as its base object.
+      auto* holder = new Tensor<Context>();
+      holder->ResizeLike(tensor);
+      holder->ShareData(tensor);
+      PyObject* capsule = PyCapsule_New(holder, nullptr, [](PyObject* obj) {
+        delete static_cast<Tensor<Context>*>(
+            PyCapsule_GetPointer(obj, nullptr));
+      });
+      if (!capsule) {
+        delete holder;
+        CAFFE_THROW("Failed to create the base object of a fetched array.");
+      }
+      PyArray_SetBaseObject(array, capsule);
+      if (read_only) {
+        PyArray_CLEARFLAGS(array, NPY_ARRAY_WRITEABLE);
+      }
     }
 
     if (numpy_type == NPY_OBJECT) {
@@ -148,10 +175,17 @@ class TensorFetcher : public BlobFetcherBase {
 template <class Context>
 class TensorFeeder : public BlobFeederBase {
  public:
+  // With zero_copy, a CPU tensor is made to alias the memory of the array,
+  // or of a contiguous copy of it, instead of copying it, as long as it is
+  // writable and aligned, and not of strings. The tensor holds a reference to
+  // the array until no tensor uses the memory anymore, so the array must not
+  // be modified from Python meanwhile, and ops that write the tensor write
+  // the array. Other devices always copy.
   void FeedTensor(
       const DeviceOption& option,
       PyArrayObject* original_array,
-      Tensor<Context>* tensor) {
+      Tensor<Context>* tensor,
+      bool zero_copy = false) {
     PyArrayObject* array = PyArray_GETCONTIGUOUS(original_array);
     auto g = MakeGuard([&]() { Py_XDECREF(array); });
 
@@ -173,6 +207,26 @@ class TensorFeeder : public BlobFeederBase {
     }
     tensor->Resize(dims);
 
+    if (zero_copy && std::is_same<Context, CPUContext>::value &&
+        npy_type != NPY_OBJECT && tensor->size() > 0 &&
+        PyArray_ISWRITEABLE(array) && PyArray_ISALIGNED(array)) {
+      Py_INCREF(array);
+      tensor->ShareExternalPointer(
+          std::shared_ptr<void>(
+              PyArray_DATA(array),
+              [array](void*) {
+                // The last tensor may go away on any thread.
+                if (Py_IsInitialized()) {
+                  PyGILState_STATE state = PyGILState_Ensure();
+                  Py_DECREF(array);
+                  PyGILState_Release(state);
+                }
+              }),
+          meta,
+          PyArray_NBYTES(array));
+      return;
+    }
+
     // Now, copy the data to the tensor.
     switch (npy_type) {
       case NPY_OBJECT: {
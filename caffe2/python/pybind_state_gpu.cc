@@ -32,6 +32,30 @@ void addCUDAGlobalMethods(py::module& m) {
     CAFFE_ENFORCE(caffe2::GetCudaPeerAccessPattern(&pattern));
     return pattern;
   });
+  m.def("cuda_memory_pool_stats", [](int gpu_id) {
+    const CudaMemoryPoolStats stats = GetCudaMemoryPoolStats(gpu_id);
+    std::map<std::string, size_t> result;
+    result["bytes_in_use"] = stats.bytes_in_use;
+    result["bytes_requested"] = stats.bytes_requested;
+    result["bytes_cached"] = stats.bytes_cached;
+    result["peak_bytes_reserved"] = stats.peak_bytes_reserved;
+    result["num_allocations"] = stats.num_allocations;
+    result["num_cuda_mallocs"] = stats.num_cuda_mallocs;
+    return result;
+  });
+  m.def("empty_cuda_memory_pool_cache", &EmptyCudaMemoryPoolCache);
+  m.def("gpu_fallback_copy_stats", []() {
+    std::map<std::string, std::map<std::string, int64_t>> result;
+    for (const auto& it : GetGPUFallbackCopyStats()) {
+      auto& op_stats = result[it.first];
+      op_stats["runs"] = it.second.runs;
+      op_stats["bytes_to_cpu"] = it.second.bytes_to_cpu;
+      op_stats["bytes_to_gpu"] = it.second.bytes_to_gpu;
+      op_stats["bytes_reused"] = it.second.bytes_reused;
+    }
+    return result;
+  });
+  m.def("reset_gpu_fallback_copy_stats", &ResetGPUFallbackCopyStats);
 };
 
 PYBIND11_PLUGIN(caffe2_pybind11_state_gpu) {
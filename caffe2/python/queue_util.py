@@ -57,12 +57,13 @@ class QueueWrapper(dataio.Pipe):
 
 
 class Queue(QueueWrapper):
-    def __init__(self, capacity, schema=None, name='queue'):
+    def __init__(self, capacity, schema=None, name='queue', lock_free=False):
         # find a unique blob name for the queue
         net = core.Net(name)
         queue_blob = net.AddExternalInput(net.NextName('handler'))
         QueueWrapper.__init__(self, queue_blob, schema)
         self.capacity = capacity
+        self.lock_free = lock_free
         self._setup_done = False
 
     def setup(self, global_init_net):
@@ -72,7 +73,8 @@ class Queue(QueueWrapper):
             [],
             [self._queue],
             capacity=self.capacity,
-            num_blobs=len(self._schema.field_names()))
+            num_blobs=len(self._schema.field_names()),
+            lock_free=self.lock_free)
 
 
 def enqueue(net, queue, data_blobs, status=None):
@@ -7,13 +7,20 @@ from caffe2.proto import caffe2_pb2
 
 
 def _build_lr(model, base_learning_rate, policy="fixed", iter_val=0,
-              **other_lr_params):
+              iter_on_device=False, **other_lr_params):
 
     # Add training operators.
-    with core.DeviceScope(core.DeviceOption(caffe2_pb2.CPU)):
+    if iter_on_device:
+        # The counter and the learning rate stay on the device of the current
+        # scope, so that the training net never waits for the host.
         ITER = model.param_init_net.ConstantFill([], "ITER", shape=[1],
                                                  value=iter_val,
-                                                 dtype=core.DataType.INT32)
+                                                 dtype=core.DataType.INT64)
+    else:
+        with core.DeviceScope(core.DeviceOption(caffe2_pb2.CPU)):
+            ITER = model.param_init_net.ConstantFill(
+                [], "ITER", shape=[1], value=iter_val,
+                dtype=core.DataType.INT32)
 
     model.net.Iter(ITER, ITER)
 
@@ -38,18 +45,62 @@ def _dedup(model, dedup_indices, grad):
         return grad
 
 
-def build_sgd(model, base_learning_rate, policy="fixed", **other_lr_params):
+def _flatten(blob_lists):
+    return [blob for blobs in blob_lists for blob in blobs]
+
+
+def build_sgd(model, base_learning_rate, policy="fixed", momentum=0.0,
+              nesterov=False, fused=False, clip_norm=0.0, **other_lr_params):
+    """
+    With momentum, the dense parameters are updated with MomentumSGDUpdate,
+    or with a single MultiMomentumSGDUpdate for all of them if fused is set,
+    in which case they must all be on the device of the current scope. The
+    fused update can also scale the dense gradients so that their global L2
+    norm is at most clip_norm. With iter_on_device=True, the iteration counter
+    and the learning rate are kept on the device of the current scope.
+    """
+    assert clip_norm <= 0 or fused, "clip_norm needs fused"
     LR, _ = _build_lr(model, base_learning_rate, policy, **other_lr_params)
 
     ONE = model.param_init_net.ConstantFill([], "ONE", shape=[1], value=1.0)
+    dense = []
     for param, grad in model.GetOptimizationPairs().items():
         if isinstance(grad, core.GradientSlice):
             model.ScatterWeightedSum(
                 [param, ONE, grad.indices, grad.values, LR], param
             )
+        elif momentum > 0.0:
+            momentum_blob = model.param_init_net.ConstantFill(
+                [param],
+                param + "_momentum",
+                value=0.0
+            )
+            dense.append([grad, momentum_blob, param])
         else:
             model.WeightedSum([param, ONE, grad, LR], param)
 
+    if not dense:
+        return
+    # LR is negative, as WeightedSum adds it, while MomentumSGDUpdate
+    # subtracts the update.
+    NEG_LR = model.net.Negative(LR, "LR_negative")
+    if fused:
+        model.MultiMomentumSGDUpdate(
+            _flatten(dense) + [NEG_LR],
+            _flatten(dense),
+            momentum=momentum,
+            nesterov=nesterov,
+            clip_norm=clip_norm,
+        )
+        return
+    for grad, momentum_blob, param in dense:
+        model.MomentumSGDUpdate(
+            [grad, momentum_blob, NEG_LR, param],
+            [grad, momentum_blob, param],
+            momentum=momentum,
+            nesterov=nesterov,
+        )
+
 
 def build_ftrl(model, dedup_indices=False, engine="SIMD", **params):
     if engine == "SIMD":
@@ -72,10 +123,18 @@ def build_ftrl(model, dedup_indices=False, engine="SIMD", **params):
 
 
 def build_adagrad(model, base_learning_rate, dedup_indices=False,
-                  parameters=None, **params):
+                  parameters=None, fused=False, clip_norm=0.0, **params):
+    """
+    If fused is set, the dense parameters are all updated by a single
+    MultiAdagrad, and must be on the device of the current scope. The fused
+    update can also scale the dense gradients so that their global L2 norm is
+    at most clip_norm.
+    """
+    assert clip_norm <= 0 or fused, "clip_norm needs fused"
     LR, _ = _build_lr(model, base_learning_rate, policy="fixed")
     param_to_grad = model.GetOptimizationPairs(parameters)
 
+    dense = []
     for param, grad in param_to_grad.items():
         # allocate additional args of the same shape as main weights
         moment = model.param_init_net.ConstantFill(
@@ -90,14 +149,32 @@ def build_adagrad(model, base_learning_rate, dedup_indices=False,
                 **params
             )
 
+        elif fused:
+            dense.append([param, moment, grad])
         else:
             model.Adagrad([param, moment, grad, LR], [param, moment], **params)
 
+    if dense:
+        model.MultiAdagrad(
+            _flatten(dense) + [LR],
+            _flatten([param, moment] for param, moment, _ in dense),
+            clip_norm=clip_norm,
+            **params
+        )
+
 
 def build_adam(model, base_learning_rate, dedup_indices=False, iter_val=0,
-               **params):
+               fused=False, clip_norm=0.0, **params):
+    """
+    If fused is set, the dense parameters are all updated by a single
+    MultiAdam, and must be on the device of the current scope. The fused
+    update can also scale the dense gradients so that their global L2 norm is
+    at most clip_norm.
+    """
+    assert clip_norm <= 0 or fused, "clip_norm needs fused"
     LR, ITER = _build_lr(model, base_learning_rate, policy="fixed",
                          iter_val=iter_val)
+    dense = []
     for param, grad in model.GetOptimizationPairs().items():
         # allocate additional args of the same shape as main weights
         # TODO(nvivek): Fuse input moments if perf critical.
@@ -119,6 +196,67 @@ def build_adam(model, base_learning_rate, dedup_indices=False, iter_val=0,
                 **params
             )
 
+        elif fused:
+            dense.append([param, m1, m2, grad])
         else:
             model.Adam([param, m1, m2, grad, LR, ITER], [param, m1, m2],
                         **params)
+
+    if dense:
+        model.MultiAdam(
+            _flatten(dense) + [LR, ITER],
+            _flatten([param, m1, m2] for param, m1, m2, _ in dense),
+            clip_norm=clip_norm,
+            **params
+        )
+
+
+def build_model_averaging(model, comm_world, num_replicas=None, alpha=None,
+                          engine="MPI"):
+    """
+    Averages the dense parameters over the replicas of model asynchronously,
+    on top of the local updates of another builder. Returns a net to be run
+    by all the replicas every K iterations: it applies the allreduce started
+    by its previous run, or by param_init_net, and starts the next one in the
+    background, so that it overlaps with the next K iterations. param_init_net
+    must run once comm_world exists and the parameters are the same on all the
+    replicas, for instance after a Broadcast.
+
+    Without alpha, this is model averaging over num_replicas replicas. With
+    alpha, this is elastic averaging (EASGD) with moving rate alpha, with a
+    copy of the center variable on every replica instead of on a parameter
+    server.
+    """
+    assert alpha is not None or num_replicas, \
+        "num_replicas is required for model averaging"
+    net = core.Net(model.net.Proto().name + "_averaging")
+    for param, grad in model.GetOptimizationPairs().items():
+        if isinstance(grad, core.GradientSlice):
+            continue
+        if alpha is None:
+            local = model.param_init_net.Copy(
+                param, param + "_averaging_local")
+            update_inputs = [param, local]
+            update_outputs = [param, local]
+        else:
+            center = model.param_init_net.Copy(param, param + "_center")
+            local = model.param_init_net.ConstantFill(
+                [param], param + "_averaging_local", value=0.0)
+            update_inputs = [param, local]
+            update_outputs = [param, local, center]
+        summed = param + "_averaging_sum"
+        handle = param + "_averaging_handle"
+        model.param_init_net.AllreduceAsync(
+            [comm_world, local], [summed, handle], engine=engine)
+
+        net.WaitCollective([handle, summed], [summed, handle], engine=engine)
+        update_inputs.append(summed)
+        if alpha is None:
+            net.ModelAveragingUpdate(
+                update_inputs, update_outputs, num_replicas=num_replicas)
+        else:
+            net.ModelAveragingUpdate(
+                update_inputs + [center], update_outputs, alpha=alpha)
+        net.AllreduceAsync(
+            [comm_world, local], [summed, handle], engine=engine)
+    return net
@@ -25,3 +25,23 @@ class TestAdagrad(TestBase, TestCase):
 class TestAdam(TestBase, TestCase):
     def build_optimizer(self, model):
         build_adam(model, base_learning_rate=0.1)
+
+
+class TestMomentumSgd(TestBase, TestCase):
+    def build_optimizer(self, model):
+        build_sgd(model, base_learning_rate=0.1, momentum=0.9)
+
+
+class TestFusedMomentumSgd(TestBase, TestCase):
+    def build_optimizer(self, model):
+        build_sgd(model, base_learning_rate=0.1, momentum=0.9, fused=True)
+
+
+class TestFusedAdagrad(TestBase, TestCase):
+    def build_optimizer(self, model):
+        build_adagrad(model, base_learning_rate=1.0, fused=True)
+
+
+class TestFusedAdam(TestBase, TestCase):
+    def build_optimizer(self, model):
+        build_adam(model, base_learning_rate=0.1, fused=True)
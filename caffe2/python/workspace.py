@@ -27,6 +27,17 @@ SwitchWorkspace = C.switch_workspace
 RootFolder = C.root_folder
 Workspaces = C.workspaces
 BenchmarkNet = C.benchmark_net
+BlobMemoryUsage = C.blob_memory_usage
+MemoryUsage = C.memory_usage
+MemoryInUse = C.memory_in_use
+MemoryPeak = C.memory_peak
+ResetMemoryPeaks = C.reset_memory_peaks
+StartMemoryTimeline = C.start_memory_timeline
+StopMemoryTimeline = C.stop_memory_timeline
+MemoryTimelinePeak = C.memory_timeline_peak
+NetMemoryUsage = C.net_memory_usage
+NetOperatorProfiles = C.net_operator_profiles
+ResetNetOperatorProfiles = C.reset_net_operator_profiles
 
 is_asan = C.is_asan
 has_gpu_support = C.has_gpu_support
@@ -34,6 +45,8 @@ if has_gpu_support:
     NumCudaDevices = C.num_cuda_devices
     SetDefaultGPUID = C.set_default_gpu_id
     GetDefaultGPUID = C.get_default_gpu_id
+    CudaMemoryPoolStats = C.cuda_memory_pool_stats
+    EmptyCudaMemoryPoolCache = C.empty_cuda_memory_pool_cache
 
     def GetCudaPeerAccessPattern():
         return np.asarray(C.get_cuda_peer_access_pattern())
@@ -151,6 +164,24 @@ def RunNetOnce(net):
     return C.run_net_once(StringfyProto(net))
 
 
+def RewriteOneHotFC(net):
+    """Replaces the FC operators of net that read the output of a OneHot by
+    gathers of rows of the transposed weights, see core/one_hot_fc_rewrite.h.
+
+    The weights must be in the current workspace, so run the init net first.
+    The transposed weights are new blobs of the workspace; for training, call
+    this before adding the gradient operators and train those instead.
+
+    Inputs:
+      net: a NetDef.
+    Returns:
+      The rewritten NetDef.
+    """
+    rewritten = caffe2_pb2.NetDef()
+    rewritten.ParseFromString(C.rewrite_one_hot_fc(StringfyProto(net)))
+    return rewritten
+
+
 def RunNet(name, num_iter=1):
     """Runs a given net.
 
@@ -216,7 +247,7 @@ def StringifyNetName(name):
     return _StringifyName(name, "Net")
 
 
-def FeedBlob(name, arr, device_option=None):
+def FeedBlob(name, arr, device_option=None, zero_copy=False):
     """Feeds a blob into the workspace.
 
     Inputs:
@@ -224,6 +255,12 @@ def FeedBlob(name, arr, device_option=None):
       arr: either a TensorProto object or a numpy array object to be fed into
           the workspace.
       device_option (optional): the device option to feed the data with.
+      zero_copy (optional): if True, a numeric numpy array fed to the CPU is
+          not copied: the tensor uses its memory, and keeps a reference to it
+          until it no longer does. The array must then not be modified, and
+          whatever writes the blob in place, ops or a later feed of the same
+          shape, writes the array. Ignored for other
+          devices, or if the array is read-only or not aligned.
     Returns:
       True or False, stating whether the feed is successful.
     """
@@ -247,31 +284,88 @@ def FeedBlob(name, arr, device_option=None):
 
     name = StringifyBlobName(name)
     if device_option is not None:
-        return C.feed_blob(name, arr, StringfyProto(device_option))
+        return C.feed_blob(
+            name, arr, StringfyProto(device_option), zero_copy=zero_copy)
+    else:
+        return C.feed_blob(name, arr, zero_copy=zero_copy)
+
+
+def FeedBlobs(blobs, device_option=None):
+    """Feeds several blobs into the workspace in one call.
+
+    Unlike calling FeedBlob for each of them, the device option is parsed
+    once, and the numpy arrays fed to the CPU are copied with the GIL
+    released, on several threads if they are large.
+
+    Inputs:
+      blobs: a dict from blob names to TensorProto objects, numpy arrays or
+          strings, or a list of such pairs.
+      device_option (optional): the device option to feed the data with.
+    Returns:
+      True if the feed is successful.
+    """
+    if isinstance(blobs, dict):
+        blobs = blobs.items()
+    names = []
+    arrs = []
+    for name, arr in blobs:
+        if type(arr) is caffe2_pb2.TensorProto:
+            arr = utils.Caffe2TensorToNumpyArray(arr)
+        if type(arr) is np.ndarray and arr.dtype.kind == 'S':
+            # Plain NumPy strings are weird, let's use objects instead
+            arr = arr.astype(np.object)
+        names.append(StringifyBlobName(name))
+        arrs.append(arr)
+    if device_option is None:
+        device_option = scope.CurrentDeviceScope()
+    if device_option is not None:
+        return C.feed_blobs(names, arrs, StringfyProto(device_option))
     else:
-        return C.feed_blob(name, arr)
+        return C.feed_blobs(names, arrs)
 
 
 def FetchBlobs(names):
     """Fetches a list of blobs from the workspace.
 
+    The CPU tensors are copied with the GIL released, on several threads if
+    they are large.
+
     Inputs:
         names: list of names of blobs - strings or BlobReferences
     Returns:
         list of fetched blobs
     """
-    return [FetchBlob(name) for name in names]
+    return C.fetch_blobs([StringifyBlobName(name) for name in names])
 
 
-def FetchBlob(name):
+def FetchBlob(name, zero_copy=False):
     """Fetches a blob from the workspace.
 
     Inputs:
       name: the name of the blob - a string or a BlobReference
+      zero_copy (optional): if True, a numeric CPU tensor is returned as an
+          array that views its memory instead of a copy. The array keeps the
+          memory alive, but only sees the blob's data until the blob is
+          resized, freed or fed again; running ops that write the blob while
+          the array is in use is a race. It is read-only if the blob shares
+          its data copy-on-write.
     Returns:
       Fetched blob (numpy array or string) if successful
     """
-    return C.fetch_blob(StringifyBlobName(name))
+    return C.fetch_blob(StringifyBlobName(name), zero_copy=zero_copy)
+
+
+def QueueStats(name):
+    """Returns what the BlobsQueue in a blob went through since it was created.
+
+    Inputs:
+      name: the name of the queue blob - a string or a BlobReference
+    Returns:
+      A dict of the entries read and written, the reads and writes that
+      blocked and the seconds they spent blocked, the occupancy histogram, and
+      the current size and capacity of the queue.
+    """
+    return C.queue_stats(StringifyBlobName(name))
 
 
 def GetNameScope():
@@ -173,6 +173,40 @@ class TestWorkspace(unittest.TestCase):
         self.assertEqual(fetched_back.shape, (2, 0, 3))
         self.assertEqual(fetched_back.dtype, np.float32)
 
+    def testFetchFeedBlobZeroCopy(self):
+        data = np.arange(24, dtype=np.float32).reshape(2, 3, 4)
+        self.assertEqual(
+            workspace.FeedBlob("testblob_alias", data, zero_copy=True), True)
+        fetched = workspace.FetchBlob("testblob_alias", zero_copy=True)
+        np.testing.assert_array_equal(fetched, data)
+        # Both arrays view the memory of the blob.
+        data[0, 0, 0] = -1
+        self.assertEqual(fetched[0, 0, 0], -1)
+        self.assertEqual(workspace.FetchBlob("testblob_alias")[0, 0, 0], -1)
+        # The fetched array outlives the blob's data.
+        del data
+        workspace.ResetWorkspace()
+        self.assertEqual(fetched[0, 0, 1], 1)
+        # Strided arrays are fed through a contiguous copy.
+        strided = np.arange(10, dtype=np.int32)[::2]
+        workspace.FeedBlob("testblob_alias", strided, zero_copy=True)
+        strided[0] = 7
+        np.testing.assert_array_equal(
+            workspace.FetchBlob("testblob_alias"), [0, 2, 4, 6, 8])
+
+    def testFeedFetchBlobs(self):
+        blobs = {
+            "batch_float": np.random.rand(3, 300000).astype(np.float32),
+            "batch_int": np.arange(12, dtype=np.int64).reshape(3, 4)[:, ::2],
+            "batch_str": np.array(["a", "bc"]),
+            "batch_empty": np.empty((0, 2), dtype=np.float32),
+        }
+        self.assertEqual(workspace.FeedBlobs(blobs), True)
+        fetched = workspace.FetchBlobs(list(blobs.keys()))
+        for (name, arr), value in zip(blobs.items(), fetched):
+            self.assertEqual(value.shape, arr.shape)
+            np.testing.assert_array_equal(value, arr)
+
     def testFetchFeedLongStringTensor(self):
         # long strings trigger array of object creation
         strs = np.array([
@@ -287,6 +321,24 @@ class TestWorkspaceGPU(test_util.TestCase):
         self.assertEqual(workspace.SetDefaultGPUID(0), None)
         self.assertEqual(workspace.GetDefaultGPUID(), 0)
 
+    def testCudaGraphNet(self):
+        net = core.Net("cuda-graph-net")
+        net.Relu("x", "y")
+        net.Scale("y", "z", scale=2.0)
+        net.RunAllOnGPU()
+        net.Proto().type = "cuda_graph"
+        device_option = core.DeviceOption(caffe2_pb2.CUDA, 0)
+        workspace.FeedBlob(
+            "x", np.zeros((2, 3), dtype=np.float32), device_option)
+        workspace.CreateNet(net)
+        # Runs before and after the capture, and after a shape change.
+        for shape in [(2, 3)] * 5 + [(4, 5)] * 5:
+            x = np.random.randn(*shape).astype(np.float32)
+            workspace.FeedBlob("x", x, device_option)
+            workspace.RunNet(net.Proto().name)
+            np.testing.assert_allclose(
+                workspace.FetchBlob("z"), 2 * np.maximum(x, 0))
+
     def testGetCudaPeerAccessPattern(self):
         pattern = workspace.GetCudaPeerAccessPattern()
         self.assertEqual(type(pattern), np.ndarray)
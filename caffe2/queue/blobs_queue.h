@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <queue>
@@ -18,6 +21,24 @@ namespace caffe2 {
 // Containing blobs are owned by the workspace.
 // On read, we swap out the underlying data for the blob passed in for blobs
 
+// What a queue went through since it was created, to tell whether its readers
+// wait for the writers, as a net does for input it is starved of, or the
+// other way around.
+struct BlobsQueueStats {
+  // The entries read and written.
+  int64_t reads = 0;
+  int64_t writes = 0;
+  // The reads and writes that had to wait for the other side, and for how
+  // long in total. Waits that end with the queue closed count too.
+  int64_t blockedReads = 0;
+  int64_t blockedWrites = 0;
+  double readBlockedSeconds = 0;
+  double writeBlockedSeconds = 0;
+  // occupancy[i] is how many reads and writes found i entries in the queue,
+  // for i from 0 to the capacity. A batch counts once.
+  std::vector<int64_t> occupancy;
+};
+
 class BlobsQueue : public std::enable_shared_from_this<BlobsQueue> {
  public:
   BlobsQueue(
@@ -26,7 +47,11 @@ class BlobsQueue : public std::enable_shared_from_this<BlobsQueue> {
       size_t capacity,
       size_t numBlobs,
       bool enforceUniqueName)
-      : numBlobs_(numBlobs) {
+      : occupancy_(new std::atomic<int64_t>[capacity + 1]),
+        numBlobs_(numBlobs) {
+    for (size_t i = 0; i <= capacity; ++i) {
+      occupancy_[i].store(0, std::memory_order_relaxed);
+    }
     queue_.reserve(capacity);
     for (auto i = 0; i < capacity; ++i) {
       std::vector<Blob*> blobs;
@@ -47,22 +72,25 @@ class BlobsQueue : public std::enable_shared_from_this<BlobsQueue> {
     DCHECK_EQ(queue_.size(), capacity);
   }
 
-  ~BlobsQueue() {
+  virtual ~BlobsQueue() {
     close();
   }
 
-  bool blockingRead(const std::vector<Blob*>& inputs) {
+  virtual bool blockingRead(const std::vector<Blob*>& inputs) {
     auto keeper = this->shared_from_this();
     std::unique_lock<std::mutex> g(mutex_);
     auto canRead = [this]() {
       CAFFE_ENFORCE_LE(reader_, writer_);
       return reader_ != writer_;
     };
-    cv_.wait(g, [this, canRead]() { return closing_ || canRead(); });
+    const int64_t blockedNs = timedWait(
+        cv_, g, [this, canRead]() { return closing_ || canRead(); });
     if (!canRead()) {
+      record(kReadSide, 0, 0, blockedNs);
       return false;
     }
     DCHECK(canRead());
+    record(kReadSide, writer_ - reader_, 1, blockedNs);
     auto& result = queue_[reader_ % queue_.size()];
     CAFFE_ENFORCE(inputs.size() >= result.size());
     for (auto i = 0; i < result.size(); ++i) {
@@ -74,30 +102,86 @@ class BlobsQueue : public std::enable_shared_from_this<BlobsQueue> {
     return true;
   }
 
-  bool tryWrite(const std::vector<Blob*>& inputs) {
+  virtual bool tryWrite(const std::vector<Blob*>& inputs) {
     auto keeper = this->shared_from_this();
     std::unique_lock<std::mutex> g(mutex_);
     if (!canWrite()) {
       return false;
     }
     DCHECK(canWrite());
+    record(kWriteSide, writer_ - reader_, 1, 0);
     doWrite(inputs);
     return true;
   }
 
-  bool blockingWrite(const std::vector<Blob*>& inputs) {
+  virtual bool blockingWrite(const std::vector<Blob*>& inputs) {
     auto keeper = this->shared_from_this();
     std::unique_lock<std::mutex> g(mutex_);
-    cv_.wait(g, [this]() { return closing_ || canWrite(); });
+    const int64_t blockedNs =
+        timedWait(cv_, g, [this]() { return closing_ || canWrite(); });
     if (!canWrite()) {
+      record(kWriteSide, 0, 0, blockedNs);
       return false;
     }
     DCHECK(canWrite());
+    record(kWriteSide, writer_ - reader_, 1, blockedNs);
     doWrite(inputs);
     return true;
   }
 
-  void close() {
+  // Called by the batch operations with the entries they read or write, in
+  // queue order, while no other reader or writer can touch them.
+  using EntriesFunction =
+      std::function<void(const std::vector<std::vector<Blob*>*>& entries)>;
+
+  // Waits for maxCount entries, and passes them to fn before removing them
+  // from the queue. Once the queue is closed, passes the remaining entries
+  // even if there are fewer. Returns the number of entries read, which is 0
+  // only when the queue is closed and empty.
+  virtual size_t blockingReadBatch(size_t maxCount, const EntriesFunction& fn) {
+    auto keeper = this->shared_from_this();
+    CAFFE_ENFORCE(maxCount > 0 && maxCount <= queue_.size());
+    std::unique_lock<std::mutex> g(mutex_);
+    CAFFE_ENFORCE_LE(reader_, writer_);
+    const int64_t blockedNs = timedWait(cv_, g, [this, maxCount]() {
+      return closing_ || writer_ - reader_ >= static_cast<int64_t>(maxCount);
+    });
+    const size_t count = std::min<size_t>(maxCount, writer_ - reader_);
+    record(kReadSide, writer_ - reader_, count, blockedNs);
+    if (count == 0) {
+      return 0;
+    }
+    fn(entriesFrom(reader_, count));
+    reader_ += count;
+    cv_.notify_all();
+    return count;
+  }
+
+  // Waits for room for count entries, and passes them to fn to fill them in.
+  // Returns false if the queue gets closed without enough room.
+  virtual bool blockingWriteBatch(size_t count, const EntriesFunction& fn) {
+    auto keeper = this->shared_from_this();
+    CAFFE_ENFORCE(count > 0 && count <= queue_.size());
+    std::unique_lock<std::mutex> g(mutex_);
+    auto canWriteBatch = [this, count]() {
+      CAFFE_ENFORCE_LE(reader_, writer_);
+      return reader_ + queue_.size() - writer_ >= count;
+    };
+    const int64_t blockedNs = timedWait(cv_, g, [this, canWriteBatch]() {
+      return closing_ || canWriteBatch();
+    });
+    if (!canWriteBatch()) {
+      record(kWriteSide, 0, 0, blockedNs);
+      return false;
+    }
+    record(kWriteSide, writer_ - reader_, count, blockedNs);
+    fn(entriesFrom(writer_, count));
+    writer_ += count;
+    cv_.notify_all();
+    return true;
+  }
+
+  virtual void close() {
     closing_ = true;
 
     std::lock_guard<std::mutex> g(mutex_);
@@ -108,7 +192,89 @@ class BlobsQueue : public std::enable_shared_from_this<BlobsQueue> {
     return numBlobs_;
   }
 
+  size_t getCapacity() const {
+    return queue_.size();
+  }
+
+  // The number of entries in the queue.
+  virtual size_t getSize() {
+    std::lock_guard<std::mutex> g(mutex_);
+    return writer_ - reader_;
+  }
+
+  BlobsQueueStats getStats() const {
+    BlobsQueueStats stats;
+    stats.reads = readCounters_.entries.load(std::memory_order_relaxed);
+    stats.writes = writeCounters_.entries.load(std::memory_order_relaxed);
+    stats.blockedReads = readCounters_.blocked.load(std::memory_order_relaxed);
+    stats.blockedWrites =
+        writeCounters_.blocked.load(std::memory_order_relaxed);
+    stats.readBlockedSeconds =
+        readCounters_.blockedNs.load(std::memory_order_relaxed) / 1e9;
+    stats.writeBlockedSeconds =
+        writeCounters_.blockedNs.load(std::memory_order_relaxed) / 1e9;
+    for (size_t i = 0; i <= queue_.size(); ++i) {
+      stats.occupancy.push_back(occupancy_[i].load(std::memory_order_relaxed));
+    }
+    return stats;
+  }
+
+ protected:
+  enum StatsSide { kWriteSide = 0, kReadSide = 1 };
+
+  // Waits on cv until ready() holds, and returns how long that took in
+  // nanoseconds, 0 if it held right away.
+  template <typename Ready>
+  static int64_t timedWait(
+      std::condition_variable& cv,
+      std::unique_lock<std::mutex>& g,
+      Ready ready) {
+    if (ready()) {
+      return 0;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    cv.wait(g, ready);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+  // Counts count entries read or written by one operation that found size
+  // entries in the queue, after waiting for blockedNs.
+  void record(StatsSide side, int64_t size, size_t count, int64_t blockedNs) {
+    auto& counters = side == kReadSide ? readCounters_ : writeCounters_;
+    if (blockedNs > 0) {
+      counters.blocked.fetch_add(1, std::memory_order_relaxed);
+      counters.blockedNs.fetch_add(blockedNs, std::memory_order_relaxed);
+    }
+    if (count > 0) {
+      counters.entries.fetch_add(count, std::memory_order_relaxed);
+      size = std::max<int64_t>(
+          0, std::min<int64_t>(size, static_cast<int64_t>(queue_.size())));
+      occupancy_[size].fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+
+  std::atomic<bool> closing_{false};
+  // The blobs of each slot, indexed by position modulo the capacity.
+  std::vector<std::vector<Blob*>> queue_;
+
+  std::vector<std::vector<Blob*>*> entriesFrom(int64_t pos, size_t count) {
+    std::vector<std::vector<Blob*>*> entries(count);
+    for (size_t i = 0; i < count; ++i) {
+      entries[i] = &queue_[(pos + i) % queue_.size()];
+    }
+    return entries;
+  }
+
  private:
+  struct StatsCounters {
+    std::atomic<int64_t> entries{0};
+    std::atomic<int64_t> blocked{0};
+    std::atomic<int64_t> blockedNs{0};
+  };
+
   bool canWrite() {
     // writer is always within [reader, reader + size)
     // we can write if reader is within [reader, reader + size)
@@ -128,13 +294,313 @@ class BlobsQueue : public std::enable_shared_from_this<BlobsQueue> {
     cv_.notify_all();
   }
 
-  std::atomic<bool> closing_{false};
+  StatsCounters readCounters_;
+  StatsCounters writeCounters_;
+  std::unique_ptr<std::atomic<int64_t>[]> occupancy_;
 
   size_t numBlobs_;
   std::mutex mutex_; // protects all variables in the class.
   std::condition_variable cv_;
   int64_t reader_{0};
   int64_t writer_{0};
-  std::vector<std::vector<Blob*>> queue_;
+};
+
+// A BlobsQueue where readers and writers claim slots with atomic operations
+// instead of taking a lock, as a bounded multi-producer multi-consumer ring
+// buffer. Each slot carries a sequence number that tells whether it is ready
+// to be written or read in a given lap around the ring: it is 2 * lap when the
+// slot can be written, and 2 * lap + 1 when it can be read. Threads only take
+// a lock to sleep when the queue is empty or full, and each read or write wakes
+// up a single waiting writer or reader, and only if there is one.
+class LockFreeBlobsQueue final : public BlobsQueue {
+ public:
+  LockFreeBlobsQueue(
+      Workspace* ws,
+      const std::string& queueName,
+      size_t capacity,
+      size_t numBlobs,
+      bool enforceUniqueName)
+      : BlobsQueue(ws, queueName, capacity, numBlobs, enforceUniqueName),
+        sequences_(new Sequence[capacity]) {
+    CAFFE_ENFORCE_GT(capacity, 0);
+    for (int64_t i = 0; i < capacity; ++i) {
+      sequences_[i].value.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  ~LockFreeBlobsQueue() {
+    close();
+  }
+
+  bool blockingRead(const std::vector<Blob*>& inputs) override {
+    auto keeper = this->shared_from_this();
+    int64_t pos;
+    int64_t blockedNs = 0;
+    while (true) {
+      const bool closing = closing_;
+      if (reserve(kRead, 1, 1, &pos)) {
+        break;
+      }
+      if (closing) {
+        record(kReadSide, 0, 0, blockedNs);
+        return false;
+      }
+      blockedNs += wait(kRead, 1);
+    }
+    record(kReadSide, occupancy(kRead, pos), 1, blockedNs);
+    swapSlot(pos, inputs);
+    release(kRead, pos, 1);
+    return true;
+  }
+
+  bool tryWrite(const std::vector<Blob*>& inputs) override {
+    auto keeper = this->shared_from_this();
+    int64_t pos;
+    if (!reserve(kWrite, 1, 1, &pos)) {
+      return false;
+    }
+    record(kWriteSide, occupancy(kWrite, pos), 1, 0);
+    swapSlot(pos, inputs);
+    release(kWrite, pos, 1);
+    return true;
+  }
+
+  bool blockingWrite(const std::vector<Blob*>& inputs) override {
+    auto keeper = this->shared_from_this();
+    int64_t pos;
+    int64_t blockedNs = 0;
+    while (true) {
+      const bool closing = closing_;
+      if (reserve(kWrite, 1, 1, &pos)) {
+        break;
+      }
+      if (closing) {
+        record(kWriteSide, 0, 0, blockedNs);
+        return false;
+      }
+      blockedNs += wait(kWrite, 1);
+    }
+    record(kWriteSide, occupancy(kWrite, pos), 1, blockedNs);
+    swapSlot(pos, inputs);
+    release(kWrite, pos, 1);
+    return true;
+  }
+
+  size_t blockingReadBatch(size_t maxCount, const EntriesFunction& fn)
+      override {
+    auto keeper = this->shared_from_this();
+    CAFFE_ENFORCE(maxCount > 0 && maxCount <= queue_.size());
+    int64_t pos;
+    size_t count;
+    int64_t blockedNs = 0;
+    while (true) {
+      const bool closing = closing_;
+      count = reserve(kRead, closing ? 1 : maxCount, maxCount, &pos);
+      if (count > 0) {
+        break;
+      }
+      if (closing) {
+        record(kReadSide, 0, 0, blockedNs);
+        return 0;
+      }
+      blockedNs += wait(kRead, maxCount);
+    }
+    record(kReadSide, occupancy(kRead, pos), count, blockedNs);
+    runAndRelease(kRead, pos, count, fn);
+    return count;
+  }
+
+  bool blockingWriteBatch(size_t count, const EntriesFunction& fn) override {
+    auto keeper = this->shared_from_this();
+    CAFFE_ENFORCE(count > 0 && count <= queue_.size());
+    int64_t pos;
+    int64_t blockedNs = 0;
+    while (true) {
+      const bool closing = closing_;
+      if (reserve(kWrite, count, count, &pos)) {
+        break;
+      }
+      if (closing) {
+        record(kWriteSide, 0, 0, blockedNs);
+        return false;
+      }
+      blockedNs += wait(kWrite, count);
+    }
+    record(kWriteSide, occupancy(kWrite, pos), count, blockedNs);
+    runAndRelease(kWrite, pos, count, fn);
+    return true;
+  }
+
+  void close() override {
+    closing_ = true;
+
+    std::lock_guard<std::mutex> g(waitMutex_);
+    readers_.cv.notify_all();
+    writers_.cv.notify_all();
+  }
+
+  // Counts the entries reserved for writing and not yet read, so it is only
+  // exact while no reads or writes are in progress.
+  size_t getSize() override {
+    const int64_t size = writePos_.load() - readPos_.load();
+    return std::max<int64_t>(
+        0, std::min<int64_t>(size, static_cast<int64_t>(queue_.size())));
+  }
+
+ private:
+  // Also the offset of the sequence number of a slot that is ready for it.
+  enum Side { kWrite = 0, kRead = 1 };
+
+  // Padded to a cache line, so that threads working on neighbouring slots or
+  // on the two ends of the queue do not invalidate each other's caches.
+  static constexpr size_t kCacheLineSize = 64;
+  struct Sequence {
+    std::atomic<int64_t> value;
+    char padding[kCacheLineSize - sizeof(std::atomic<int64_t>)];
+  };
+
+  struct Waiters {
+    std::atomic<int> count{0};
+    // How many of them wait for more than one entry.
+    std::atomic<int> batches{0};
+    std::condition_variable cv;
+  };
+
+  int64_t lap(int64_t pos) {
+    return pos / queue_.size();
+  }
+  std::atomic<int64_t>& sequence(int64_t pos) {
+    return sequences_[pos % queue_.size()].value;
+  }
+  std::atomic<int64_t>& position(Side side) {
+    return side == kRead ? readPos_ : writePos_;
+  }
+
+  // Returns 0 if the slot at pos is ready for the side, a negative value if it
+  // is not yet, and a positive value if pos is behind the current position.
+  int64_t readiness(Side side, int64_t pos) {
+    return sequence(pos).load() - (2 * lap(pos) + side);
+  }
+
+  // Reserves up to maxCount consecutive entries that are ready for the side,
+  // starting at *pos, or none if fewer than minCount are. Returns how many.
+  size_t reserve(Side side, size_t minCount, size_t maxCount, int64_t* pos) {
+    int64_t start = position(side).load(std::memory_order_relaxed);
+    while (true) {
+      size_t count = 0;
+      int64_t diff = 0;
+      while (count < maxCount && (diff = readiness(side, start + count)) == 0) {
+        ++count;
+      }
+      if (diff > 0) {
+        // Other threads went past start since we loaded it.
+        start = position(side).load(std::memory_order_relaxed);
+        continue;
+      }
+      if (count < minCount) {
+        return 0;
+      }
+      if (position(side).compare_exchange_weak(
+              start, start + count, std::memory_order_relaxed)) {
+        *pos = start;
+        return count;
+      }
+    }
+  }
+
+  // Hands the reserved entries over to the other side, and wakes up the
+  // threads waiting for them.
+  void release(Side side, int64_t pos, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      sequence(pos + i).store(2 * lap(pos + i) + side + 1);
+    }
+    auto& waiters = side == kRead ? writers_ : readers_;
+    // A waiting thread counts itself before it checks whether it can go on,
+    // and the slots are released before the count is read here. With
+    // sequential consistency one of them sees the other, so no wakeup gets
+    // lost. Threads waiting for several entries may not be able to use the
+    // ones released, so they are all woken up, lest they swallow the wakeup.
+    if (waiters.count.load() > 0) {
+      std::lock_guard<std::mutex> g(waitMutex_);
+      if (count > 1 || waiters.batches.load() > 0) {
+        waiters.cv.notify_all();
+      } else {
+        waiters.cv.notify_one();
+      }
+    }
+  }
+
+  void runAndRelease(
+      Side side,
+      int64_t pos,
+      size_t count,
+      const EntriesFunction& fn) {
+    try {
+      fn(entriesFrom(pos, count));
+    } catch (...) {
+      release(side, pos, count);
+      throw;
+    }
+    release(side, pos, count);
+  }
+
+  // The entries that the side found in the queue when it reserved pos, as
+  // far as the other side had reserved them by then.
+  int64_t occupancy(Side side, int64_t pos) {
+    return side == kRead ? writePos_.load(std::memory_order_relaxed) - pos
+                         : pos - readPos_.load(std::memory_order_relaxed);
+  }
+
+  // Sleeps until count entries may be ready for the side, or the queue gets
+  // closed. This only gives a hint: the caller retries its reservation.
+  // Returns how long it slept, in nanoseconds.
+  int64_t wait(Side side, size_t count) {
+    auto& waiters = side == kRead ? readers_ : writers_;
+    const auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> g(waitMutex_);
+    if (count > 1) {
+      ++waiters.batches;
+    }
+    ++waiters.count;
+    waiters.cv.wait(g, [this, side, count]() {
+      if (closing_) {
+        return true;
+      }
+      const int64_t start = position(side).load();
+      for (size_t i = 0; i < count; ++i) {
+        const int64_t diff = readiness(side, start + i);
+        if (diff != 0) {
+          return diff > 0;
+        }
+      }
+      return true;
+    });
+    --waiters.count;
+    if (count > 1) {
+      --waiters.batches;
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+  void swapSlot(int64_t pos, const std::vector<Blob*>& inputs) {
+    auto& result = queue_[pos % queue_.size()];
+    CAFFE_ENFORCE(inputs.size() >= result.size());
+    for (auto i = 0; i < result.size(); ++i) {
+      using std::swap;
+      swap(*(inputs[i]), *(result[i]));
+    }
+  }
+
+  std::unique_ptr<Sequence[]> sequences_;
+  std::atomic<int64_t> readPos_{0};
+  char readPadding_[kCacheLineSize - sizeof(std::atomic<int64_t>)];
+  std::atomic<int64_t> writePos_{0};
+  char writePadding_[kCacheLineSize - sizeof(std::atomic<int64_t>)];
+
+  std::mutex waitMutex_; // only taken to sleep, or to wake up a sleeper.
+  Waiters readers_;
+  Waiters writers_;
 };
 }
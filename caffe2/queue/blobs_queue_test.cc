@@ -0,0 +1,268 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "caffe2/core/blob.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/queue/blobs_queue.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+std::shared_ptr<BlobsQueue>
+CreateQueue(Workspace* ws, const string& name, size_t capacity, bool lockFree) {
+  if (lockFree) {
+    return std::make_shared<LockFreeBlobsQueue>(ws, name, capacity, 1, true);
+  }
+  return std::make_shared<BlobsQueue>(ws, name, capacity, 1, true);
+}
+
+} // namespace
+
+TEST(BlobsQueueTest, ReadsWhatWasWritten) {
+  for (bool lockFree : {false, true}) {
+    Workspace ws;
+    auto queue = CreateQueue(&ws, "queue", 2, lockFree);
+    Blob blob;
+    for (int i = 0; i < 2; ++i) {
+      *blob.GetMutable<int>() = i;
+      EXPECT_TRUE(queue->tryWrite({&blob}));
+    }
+    *blob.GetMutable<int>() = 2;
+    EXPECT_FALSE(queue->tryWrite({&blob}));
+    for (int i = 0; i < 2; ++i) {
+      ASSERT_TRUE(queue->blockingRead({&blob}));
+      EXPECT_EQ(blob.Get<int>(), i);
+    }
+    // Entries written before the queue is closed can still be read.
+    *blob.GetMutable<int>() = 2;
+    EXPECT_TRUE(queue->tryWrite({&blob}));
+    queue->close();
+    ASSERT_TRUE(queue->blockingRead({&blob}));
+    EXPECT_EQ(blob.Get<int>(), 2);
+    EXPECT_FALSE(queue->blockingRead({&blob}));
+  }
+}
+
+TEST(BlobsQueueTest, ManyReadersAndWriters) {
+  const int kNumThreads = 4;
+  const int kNumItems = 2000;
+  for (bool lockFree : {false, true}) {
+    Workspace ws;
+    auto queue = CreateQueue(&ws, "queue", 3, lockFree);
+    std::vector<std::atomic<int>> counts(kNumThreads * kNumItems);
+    for (auto& count : counts) {
+      count = 0;
+    }
+    std::vector<std::thread> writers;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < kNumThreads; ++t) {
+      writers.emplace_back([&, t]() {
+        Blob blob;
+        for (int i = 0; i < kNumItems; ++i) {
+          *blob.GetMutable<int>() = t * kNumItems + i;
+          ASSERT_TRUE(queue->blockingWrite({&blob}));
+        }
+      });
+      readers.emplace_back([&]() {
+        Blob blob;
+        while (queue->blockingRead({&blob})) {
+          ++counts[blob.Get<int>()];
+        }
+      });
+    }
+    for (auto& writer : writers) {
+      writer.join();
+    }
+    queue->close();
+    for (auto& reader : readers) {
+      reader.join();
+    }
+    for (const auto& count : counts) {
+      EXPECT_EQ(count, 1);
+    }
+  }
+}
+
+TEST(BlobsQueueTest, CloseWakesUpBlockedThreads) {
+  for (bool lockFree : {false, true}) {
+    Workspace ws;
+    auto empty = CreateQueue(&ws, "empty", 1, lockFree);
+    auto full = CreateQueue(&ws, "full", 1, lockFree);
+    Blob blob;
+    blob.GetMutable<int>();
+    ASSERT_TRUE(full->tryWrite({&blob}));
+    std::thread reader([&]() {
+      Blob blob;
+      EXPECT_FALSE(empty->blockingRead({&blob}));
+    });
+    std::thread writer([&]() {
+      Blob blob;
+      blob.GetMutable<int>();
+      EXPECT_FALSE(full->blockingWrite({&blob}));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    empty->close();
+    full->close();
+    reader.join();
+    writer.join();
+  }
+}
+
+TEST(BlobsQueueTest, BatchesKeepTheOrder) {
+  const int kNumBatches = 500;
+  const int kBatchSize = 3;
+  for (bool lockFree : {false, true}) {
+    Workspace ws;
+    auto queue = CreateQueue(&ws, "queue", 4, lockFree);
+    std::thread writer([&]() {
+      for (int b = 0; b < kNumBatches; ++b) {
+        const int first = b * kBatchSize;
+        ASSERT_TRUE(queue->blockingWriteBatch(
+            kBatchSize,
+            [first](const std::vector<std::vector<Blob*>*>& entries) {
+              for (int i = 0; i < entries.size(); ++i) {
+                *(*entries[i])[0]->GetMutable<int>() = first + i;
+              }
+            }));
+      }
+      queue->close();
+    });
+    // Reads batches of a different size than the writes, with an incomplete
+    // batch at the end.
+    int next = 0;
+    while (true) {
+      const auto count = queue->blockingReadBatch(
+          2, [&next](const std::vector<std::vector<Blob*>*>& entries) {
+            for (const auto* entry : entries) {
+              EXPECT_EQ((*entry)[0]->Get<int>(), next++);
+            }
+          });
+      if (count == 0) {
+        break;
+      }
+    }
+    writer.join();
+    EXPECT_EQ(next, kNumBatches * kBatchSize);
+  }
+}
+
+TEST(BlobsQueueTest, BatchOps) {
+  for (bool lockFree : {false, true}) {
+    Workspace ws;
+    OperatorDef create;
+    create.set_type("CreateBlobsQueue");
+    create.add_output("queue");
+    AddArgument<int>("capacity", 4, &create);
+    AddArgument<int>("lock_free", lockFree, &create);
+    ASSERT_TRUE(ws.RunOperatorOnce(create));
+
+    auto* data = ws.CreateBlob("data")->GetMutable<TensorCPU>();
+    data->Resize(3, 2);
+    for (int i = 0; i < 6; ++i) {
+      data->mutable_data<float>()[i] = i;
+    }
+    OperatorDef enqueue;
+    enqueue.set_type("EnqueueBlobsBatch");
+    enqueue.add_input("queue");
+    enqueue.add_input("data");
+    ASSERT_TRUE(ws.RunOperatorOnce(enqueue));
+
+    OperatorDef dequeue;
+    dequeue.set_type("DequeueBlobsBatch");
+    dequeue.add_input("queue");
+    dequeue.add_output("batch");
+    dequeue.add_output("status");
+    AddArgument<int>("batch_size", 2, &dequeue);
+    unique_ptr<OperatorBase> op(CreateOperator(dequeue, &ws));
+    ASSERT_TRUE(op->Run());
+    const auto& batch = ws.GetBlob("batch")->Get<TensorCPU>();
+    EXPECT_EQ(batch.dims(), vector<TIndex>({2, 2}));
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_EQ(batch.data<float>()[i], i);
+    }
+    const auto& status = ws.GetBlob("status")->Get<TensorCPU>();
+    EXPECT_FALSE(status.data<bool>()[0]);
+
+    // Once the queue is closed, the last entry comes as a smaller batch.
+    ws.GetBlob("queue")->Get<std::shared_ptr<BlobsQueue>>()->close();
+    ASSERT_TRUE(op->Run());
+    EXPECT_EQ(batch.dims(), vector<TIndex>({1, 2}));
+    EXPECT_EQ(batch.data<float>()[0], 4);
+    EXPECT_EQ(batch.data<float>()[1], 5);
+    EXPECT_FALSE(status.data<bool>()[0]);
+    ASSERT_TRUE(op->Run());
+    EXPECT_TRUE(status.data<bool>()[0]);
+  }
+}
+
+
+TEST(BlobsQueueTest, CountsReadsWritesAndWaits) {
+  for (bool lockFree : {false, true}) {
+    Workspace ws;
+    auto queue = CreateQueue(&ws, "queue", 2, lockFree);
+    Blob blob;
+    blob.GetMutable<int>();
+    ASSERT_TRUE(queue->tryWrite({&blob}));
+    ASSERT_TRUE(queue->tryWrite({&blob}));
+    EXPECT_FALSE(queue->tryWrite({&blob}));
+    EXPECT_EQ(queue->getSize(), 2);
+    ASSERT_TRUE(queue->blockingRead({&blob}));
+    ASSERT_TRUE(queue->blockingRead({&blob}));
+    // The reader blocks until the writer comes.
+    std::thread writer([&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      Blob blob;
+      blob.GetMutable<int>();
+      ASSERT_TRUE(queue->blockingWrite({&blob}));
+    });
+    ASSERT_TRUE(queue->blockingRead({&blob}));
+    writer.join();
+
+    const auto stats = queue->getStats();
+    EXPECT_EQ(stats.reads, 3);
+    EXPECT_EQ(stats.writes, 3);
+    EXPECT_EQ(stats.blockedReads, 1);
+    EXPECT_EQ(stats.blockedWrites, 0);
+    EXPECT_GT(stats.readBlockedSeconds, 0.01);
+    EXPECT_EQ(stats.writeBlockedSeconds, 0);
+    // Writes found 0, 1 and 0 entries, reads 2, 1 and 1.
+    EXPECT_EQ(stats.occupancy, std::vector<int64_t>({2, 3, 1}));
+    EXPECT_EQ(queue->getSize(), 0);
+  }
+}
+
+TEST(BlobsQueueTest, GetQueueStatsOp) {
+  Workspace ws;
+  OperatorDef create;
+  create.set_type("CreateBlobsQueue");
+  create.add_output("queue");
+  AddArgument<int>("capacity", 3, &create);
+  ASSERT_TRUE(ws.RunOperatorOnce(create));
+  ws.CreateBlob("data")->GetMutable<TensorCPU>()->Resize(1);
+  ws.GetBlob("data")->GetMutable<TensorCPU>()->mutable_data<float>();
+  OperatorDef enqueue;
+  enqueue.set_type("EnqueueBlobs");
+  enqueue.add_input("queue");
+  enqueue.add_input("data");
+  enqueue.add_output("data");
+  ASSERT_TRUE(ws.RunOperatorOnce(enqueue));
+
+  OperatorDef stats;
+  stats.set_type("GetQueueStats");
+  stats.add_input("queue");
+  stats.add_output("stats");
+  stats.add_output("occupancy");
+  ASSERT_TRUE(ws.RunOperatorOnce(stats));
+  const auto& values = ws.GetBlob("stats")->Get<TensorCPU>();
+  EXPECT_EQ(
+      vector<int64_t>(values.data<int64_t>(), values.data<int64_t>() + 8),
+      vector<int64_t>({0, 1, 0, 0, 0, 0, 1, 3}));
+  const auto& occupancy = ws.GetBlob("occupancy")->Get<TensorCPU>();
+  EXPECT_EQ(occupancy.dims(), vector<TIndex>({4}));
+  EXPECT_EQ(occupancy.data<int64_t>()[0], 1);
+}
+
+} // namespace caffe2
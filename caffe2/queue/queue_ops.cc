@@ -11,11 +11,32 @@ REGISTER_CPU_OPERATOR(CreateBlobsQueue, CreateBlobsQueueOp<CPUContext>);
 REGISTER_CPU_OPERATOR(EnqueueBlobs, EnqueueBlobsOp<CPUContext>);
 REGISTER_CPU_OPERATOR(DequeueBlobs, DequeueBlobsOp<CPUContext>);
 REGISTER_CPU_OPERATOR(CloseBlobsQueue, CloseBlobsQueueOp<CPUContext>);
+REGISTER_CPU_OPERATOR(GetQueueStats, GetQueueStatsOp<CPUContext>);
 
 REGISTER_CPU_OPERATOR(SafeEnqueueBlobs, SafeEnqueueBlobsOp<CPUContext>);
 REGISTER_CPU_OPERATOR(SafeDequeueBlobs, SafeDequeueBlobsOp<CPUContext>);
+REGISTER_CPU_OPERATOR(EnqueueBlobsBatch, EnqueueBlobsBatchOp<CPUContext>);
+REGISTER_CPU_OPERATOR(DequeueBlobsBatch, DequeueBlobsBatchOp<CPUContext>);
 
-OPERATOR_SCHEMA(CreateBlobsQueue).NumInputs(0).NumOutputs(1);
+OPERATOR_SCHEMA(CreateBlobsQueue)
+    .NumInputs(0)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Create a bounded, blocking queue of blobs, which Enqueue and Dequeue ops running
+in different threads can share.
+)DOC")
+    .Arg("capacity", "The number of entries the queue can hold, 1 by default.")
+    .Arg("num_blobs", "The number of blobs in each entry, 1 by default.")
+    .Arg(
+        "enforce_unique_name",
+        "If set, fail when the internal blobs of the queue already exist in "
+        "the workspace.")
+    .Arg(
+        "lock_free",
+        "If set, readers and writers claim entries with atomic operations "
+        "instead of taking a lock, and only sleep when the queue is empty or "
+        "full. This scales better with many concurrent readers or writers.")
+    .Output(0, "queue", "The shared pointer for the BlobsQueue");
 OPERATOR_SCHEMA(EnqueueBlobs)
     .NumInputsOutputs([](int inputs, int outputs) {
       return inputs >= 2 && outputs >= 1 && inputs == outputs + 1;
@@ -25,6 +46,31 @@ OPERATOR_SCHEMA(DequeueBlobs).NumInputsOutputs([](int inputs, int outputs) {
   return inputs == 1 && outputs >= 1;
 });
 OPERATOR_SCHEMA(CloseBlobsQueue).NumInputs(1).NumOutputs(0);
+OPERATOR_SCHEMA(GetQueueStats)
+    .NumInputs(1)
+    .NumOutputs(1, 2)
+    .SetDoc(R"DOC(
+Get what the queue went through since it was created, to tell whether its
+readers, such as a net waiting for input, are starved by its writers, or the
+other way around. Reads and writes are counted in entries, and the blocked ones
+are those that had to wait for the other side. The occupancy histogram counts
+the reads and writes by the number of entries that they found in the queue, so
+a histogram weighted towards 0 means that readers drain the queue as fast as it
+is filled.
+)DOC")
+    .Input(0, "queue", "The shared pointer for the BlobsQueue")
+    .Output(
+        0,
+        "stats",
+        "An int64 tensor of the entries read and written, the reads and writes "
+        "that blocked, the microseconds that readers and writers spent "
+        "blocked, and the current size and the capacity of the queue, in this "
+        "order.")
+    .Output(
+        1,
+        "occupancy",
+        "Optional int64 tensor of capacity + 1 counts, of the reads and writes "
+        "that found 0 to capacity entries in the queue.");
 
 OPERATOR_SCHEMA(SafeEnqueueBlobs)
     .NumInputsOutputs([](int inputs, int outputs) {
@@ -53,13 +99,46 @@ data blobs.
 )DOC")
     .Input(0, "queue", "The shared pointer for the BlobsQueue");
 
+OPERATOR_SCHEMA(EnqueueBlobsBatch)
+    .NumInputs(2, INT_MAX)
+    .NumOutputs(0, 1)
+    .SetDoc(R"DOC(
+Enqueue a batch of entries into the queue at once. Each data input holds the
+entries along its first dimension, which must be the same for all of them, and
+entry i of the queue gets slice i of each input. The entries are written
+together, under a single synchronization with the queue, so the batch must fit
+in its capacity. Without the status output, the op fails when the queue is
+closed without room for the batch; with it, the status is set to true instead.
+)DOC")
+    .Input(0, "queue", "The shared pointer for the BlobsQueue")
+    .Output(0, "status", "Optional, whether the batch could not be enqueued");
+
+OPERATOR_SCHEMA(DequeueBlobsBatch)
+    .NumInputs(1)
+    .NumOutputs(1, INT_MAX)
+    .SetDoc(R"DOC(
+Dequeue batch_size entries from the queue at once, under a single
+synchronization with the queue, and concatenate them along a new first
+dimension. All the entries of a blob must have the same type and shape. Once
+the queue is closed, the remaining entries are dequeued even if there are fewer
+than batch_size of them. When the queue is closed and empty, the op fails, or
+if the last output is the status, sets it to true instead.
+)DOC")
+    .Arg(
+        "batch_size",
+        "The number of entries to dequeue, at most the capacity of the queue.")
+    .Input(0, "queue", "The shared pointer for the BlobsQueue");
+
 NO_GRADIENT(CreateBlobsQueue);
 NO_GRADIENT(EnqueueBlobs);
 NO_GRADIENT(DequeueBlobs);
 NO_GRADIENT(CloseBlobsQueue);
+NO_GRADIENT(GetQueueStats);
 
 NO_GRADIENT(SafeEnqueueBlobsQueue);
 NO_GRADIENT(SafeDequeueBlobsQueue);
+NO_GRADIENT(EnqueueBlobsBatch);
+NO_GRADIENT(DequeueBlobsBatch);
 }
 
 }
@@ -22,13 +22,20 @@ class CreateBlobsQueueOp final : public Operator<Context> {
     const auto enforceUniqueName =
         OperatorBase::template GetSingleArgument<int>(
             "enforce_unique_name", false);
+    const auto lockFree =
+        OperatorBase::template GetSingleArgument<int>("lock_free", false);
     CAFFE_ENFORCE_EQ(def().output().size(), 1);
     const auto name = def().output().Get(0);
     auto queuePtr = Operator<Context>::Outputs()[0]
                         ->template GetMutable<std::shared_ptr<BlobsQueue>>();
     CAFFE_ENFORCE(queuePtr);
-    *queuePtr = std::make_shared<BlobsQueue>(
-        ws_, name, capacity, numBlobs, enforceUniqueName);
+    if (lockFree) {
+      *queuePtr = std::make_shared<LockFreeBlobsQueue>(
+          ws_, name, capacity, numBlobs, enforceUniqueName);
+    } else {
+      *queuePtr = std::make_shared<BlobsQueue>(
+          ws_, name, capacity, numBlobs, enforceUniqueName);
+    }
     return true;
   }
 
@@ -85,6 +92,53 @@ class CloseBlobsQueueOp final : public Operator<Context> {
  private:
 };
 
+template <typename Context>
+class GetQueueStatsOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  using Operator<Context>::Operator;
+
+  // The order of the entries of the stats output.
+  enum {
+    kReads = 0,
+    kWrites,
+    kBlockedReads,
+    kBlockedWrites,
+    kReadBlockedUs,
+    kWriteBlockedUs,
+    kSize,
+    kCapacity,
+    kNumStats,
+  };
+
+  bool RunOnDevice() override {
+    auto queue =
+        OperatorBase::Inputs()[0]->template Get<std::shared_ptr<BlobsQueue>>();
+    CAFFE_ENFORCE(queue);
+    const auto stats = queue->getStats();
+    auto* output = Output(0);
+    output->Resize(kNumStats);
+    auto* data = output->template mutable_data<int64_t>();
+    data[kReads] = stats.reads;
+    data[kWrites] = stats.writes;
+    data[kBlockedReads] = stats.blockedReads;
+    data[kBlockedWrites] = stats.blockedWrites;
+    data[kReadBlockedUs] = stats.readBlockedSeconds * 1e6;
+    data[kWriteBlockedUs] = stats.writeBlockedSeconds * 1e6;
+    data[kSize] = queue->getSize();
+    data[kCapacity] = queue->getCapacity();
+    if (OutputSize() > 1) {
+      auto* occupancy = Output(1);
+      occupancy->Resize(stats.occupancy.size());
+      std::copy(
+          stats.occupancy.begin(),
+          stats.occupancy.end(),
+          occupancy->template mutable_data<int64_t>());
+    }
+    return true;
+  }
+};
+
 template <typename Context>
 class SafeEnqueueBlobsOp final : public Operator<Context> {
  public:
@@ -131,4 +185,130 @@ class SafeDequeueBlobsOp final : public Operator<Context> {
 
  private:
 };
+
+template <typename Context>
+class EnqueueBlobsBatchOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  using Operator<Context>::Operator;
+  bool RunOnDevice() override {
+    auto queue = OperatorBase::Inputs()[0]
+                     ->template Get<std::shared_ptr<BlobsQueue>>();
+    CAFFE_ENFORCE(queue);
+    const auto numBlobs = queue->getNumBlobs();
+    CAFFE_ENFORCE_EQ(InputSize(), numBlobs + 1);
+    CAFFE_ENFORCE_GT(Input(1).ndim(), 0);
+    const auto count = Input(1).dim(0);
+    for (int j = 1; j < InputSize(); ++j) {
+      CAFFE_ENFORCE_GT(Input(j).ndim(), 0);
+      CAFFE_ENFORCE_EQ(
+          Input(j).dim(0),
+          count,
+          "All the inputs must have the same number of entries.");
+    }
+    bool status = true;
+    if (count > 0) {
+      status = queue->blockingWriteBatch(
+          count,
+          [this, numBlobs](const std::vector<std::vector<Blob*>*>& entries) {
+            for (int j = 0; j < numBlobs; ++j) {
+              const auto& input = Input(j + 1);
+              const auto entrySize = input.size_from_dim(1);
+              auto dims = input.dims();
+              dims.erase(dims.begin());
+              for (int i = 0; i < entries.size(); ++i) {
+                auto* tensor =
+                    (*entries[i])[j]->template GetMutable<Tensor<Context>>();
+                tensor->Resize(dims);
+                context_.template CopyItems<Context, Context>(
+                    input.meta(),
+                    entrySize,
+                    static_cast<const char*>(input.raw_data()) +
+                        i * entrySize * input.itemsize(),
+                    tensor->raw_mutable_data(input.meta()));
+              }
+            }
+            // The entries must be complete when readers can see them.
+            context_.FinishDeviceComputation();
+          });
+    }
+    if (OutputSize() == 0) {
+      return status;
+    }
+    Output(0)->Resize();
+    math::Set<bool, Context>(
+        1, !status, Output(0)->template mutable_data<bool>(), &context_);
+    return true;
+  }
+};
+
+template <typename Context>
+class DequeueBlobsBatchOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  DequeueBlobsBatchOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        batchSize_(
+            OperatorBase::template GetSingleArgument<int>("batch_size", 1)) {
+    CAFFE_ENFORCE_GT(batchSize_, 0);
+  }
+
+  bool RunOnDevice() override {
+    CAFFE_ENFORCE(InputSize() == 1);
+    auto queue =
+        OperatorBase::Inputs()[0]->template Get<std::shared_ptr<BlobsQueue>>();
+    CAFFE_ENFORCE(queue);
+    const auto numBlobs = queue->getNumBlobs();
+    CAFFE_ENFORCE(
+        OutputSize() == numBlobs || OutputSize() == numBlobs + 1,
+        "Expected ",
+        numBlobs,
+        " outputs, and optionally the status, got: ",
+        OutputSize());
+    const auto count = queue->blockingReadBatch(
+        batchSize_,
+        [this, numBlobs](const std::vector<std::vector<Blob*>*>& entries) {
+          for (int j = 0; j < numBlobs; ++j) {
+            const auto& first =
+                (*entries[0])[j]->template Get<Tensor<Context>>();
+            auto dims = first.dims();
+            dims.insert(dims.begin(), entries.size());
+            // Sized once for the whole batch, then filled in place.
+            auto* output = Output(j);
+            output->Resize(dims);
+            auto* data =
+                static_cast<char*>(output->raw_mutable_data(first.meta()));
+            for (int i = 0; i < entries.size(); ++i) {
+              const auto& tensor =
+                  (*entries[i])[j]->template Get<Tensor<Context>>();
+              CAFFE_ENFORCE(
+                  tensor.meta() == first.meta() &&
+                      tensor.dims() == first.dims(),
+                  "The entries of a batch must have the same type and shape.");
+              context_.template CopyItems<Context, Context>(
+                  tensor.meta(),
+                  tensor.size(),
+                  tensor.raw_data(),
+                  data + i * first.nbytes());
+            }
+          }
+          // The entries may be overwritten as soon as they are released.
+          context_.FinishDeviceComputation();
+        });
+    const bool status = count > 0;
+    if (OutputSize() == numBlobs) {
+      return status;
+    }
+    Output(numBlobs)->Resize();
+    math::Set<bool, Context>(
+        1,
+        !status,
+        Output(numBlobs)->template mutable_data<bool>(),
+        &context_);
+    return true;
+  }
+
+ private:
+  const int batchSize_;
+};
 }
@@ -13,6 +13,8 @@ REGISTER_CUDA_OPERATOR(CloseBlobsQueue, CloseBlobsQueueOp<CUDAContext>);
 
 REGISTER_CUDA_OPERATOR(SafeEnqueueBlobs, SafeEnqueueBlobsOp<CUDAContext>);
 REGISTER_CUDA_OPERATOR(SafeDequeueBlobs, SafeDequeueBlobsOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(EnqueueBlobsBatch, EnqueueBlobsBatchOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(DequeueBlobsBatch, DequeueBlobsBatchOp<CUDAContext>);
 }
 
 }
@@ -39,6 +39,16 @@ Given inputs (param, history, indices, grad, lr), runs the dense AdaGrad
 update on (param, grad, history[indices], lr), and returns (new_param,
 new_history) as in the dense case.
 
+On CPU, an index that appears several times is updated once per occurrence.
+On CUDA, the gradients of all of its occurrences are summed and it is updated
+once, which is the same when the indices are unique.
+
+On CPU, large updates are split over the OpenMP threads by row: the
+occurrences of an index are applied in order by one thread. With hogwild set,
+the threads skip this grouping and update the rows of duplicate indices
+concurrently without locks, so that some of their updates can be lost; this
+is only exact when the indices are unique.
+
 )DOC")
     .Input(0, "param", "Parameters to be updated")
     .Input(1, "moment", "Moment history")
@@ -47,9 +57,49 @@ new_history) as in the dense case.
     .Input(4, "lr", "learning rate")
     .Output(0, "output_param", "Updated parameters")
     .Output(1, "output_moment_1", "Updated moment")
-    .Arg("epsilon", "Default 1e-5");
+    .Arg("epsilon", "Default 1e-5")
+    .Arg(
+        "hogwild",
+        "(bool, default 0) On CPU, update duplicate indices concurrently "
+        "without ordering their updates.");
+
+REGISTER_CPU_OPERATOR(
+    RowWiseSparseAdagrad,
+    RowWiseSparseAdagradOp<float, CPUContext>);
+OPERATOR_SCHEMA(RowWiseSparseAdagrad)
+    .NumInputs(5)
+    .NumOutputs(2)
+    .AllowInplace({{0, 0}, {1, 1}})
+    .SetDoc(R"DOC(
+
+Given inputs (param, moment, indices, grad, lr), runs a row-wise AdaGrad
+update, which keeps a single moment per row of param instead of one per
+element, halving the memory of the optimizer state of large embeddings.
+For every index i, with g the gradient of row i:
+
+    moment[i] = moment[i] + mean(square(g))
+    param[i] = param[i] + lr * g / (sqrt(moment[i]) + epsilon)
+
+The handling of duplicate indices, and the hogwild argument, are those of
+SparseAdagrad: on CPU every occurrence is applied in turn, on CUDA their
+gradients are summed and applied once.
+
+)DOC")
+    .Input(0, "param", "Parameters to be updated")
+    .Input(1, "moment", "Moment history, with one value per row of param")
+    .Input(2, "indices", "Sparse indices")
+    .Input(3, "grad", "Gradient computed")
+    .Input(4, "lr", "learning rate")
+    .Output(0, "output_param", "Updated parameters")
+    .Output(1, "output_moment_1", "Updated moment")
+    .Arg("epsilon", "Default 1e-5")
+    .Arg(
+        "hogwild",
+        "(bool, default 0) On CPU, update duplicate indices concurrently "
+        "without ordering their updates.");
 
 SHOULD_NOT_DO_GRADIENT(Adagrad);
 SHOULD_NOT_DO_GRADIENT(SparseAdagrad);
+SHOULD_NOT_DO_GRADIENT(RowWiseSparseAdagrad);
 }
 }
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "caffe2/core/dirty_rows.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/sgd/sparse_row_updates.h"
+#include "caffe2/utils/math.h"
 
 namespace caffe2 {
 
@@ -41,6 +44,25 @@ void adagrad_compute(
   }
 }
 
+// On CPU, a row is updated with Eigen arrays, which vectorizes it.
+template <>
+inline void adagrad_compute<CPUContext>(
+    int N,
+    const float* w,
+    const float* g,
+    const float* h,
+    float* nw,
+    float* nh,
+    float epsilon,
+    float lr,
+    CPUContext* /*context*/) {
+  ConstEigenVectorArrayMap<float> gi(g, N);
+  EigenVectorArrayMap<float>(nh, N) =
+      ConstEigenVectorArrayMap<float>(h, N) + gi.square();
+  EigenVectorArrayMap<float>(nw, N) = ConstEigenVectorArrayMap<float>(w, N) +
+      lr * gi / (ConstEigenVectorArrayMap<float>(nh, N).sqrt() + epsilon);
+}
+
 template <typename T, class Context>
 class AdagradOp final : public Operator<Context> {
  public:
@@ -78,7 +100,8 @@ class SparseAdagradOp final : public Operator<Context> {
   USE_OPERATOR_CONTEXT_FUNCTIONS;
   SparseAdagradOp(const OperatorDef& operator_def, Workspace* ws)
       : Operator<Context>(operator_def, ws),
-        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)) {}
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)),
+        hogwild_(OperatorBase::GetSingleArgument<int>("hogwild", 0)) {}
 
   bool RunOnDevice() override {
     return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
@@ -105,32 +128,98 @@ class SparseAdagradOp final : public Operator<Context> {
     }
 
     auto block_size = Input(GRAD).size_from_dim(1);
-    for (auto i = 0; i < n; ++i) {
-      auto idx = indices[i];
-      if (block_size == 1) {
-        float gi = gradIn[i];
-        float hi = momentOut[idx] = momentIn[idx] + gi * gi;
-        paramOut[idx] = paramIn[idx] + lr[0] * gi / (std::sqrt(hi) + epsilon_);
-      } else {
-        auto offsetI = i * block_size;
-        auto offsetIdx = idx * block_size;
-        adagrad_compute(
-            block_size,
-            paramIn + offsetIdx,
-            gradIn + offsetI,
-            momentIn + offsetIdx,
-            paramOut + offsetIdx,
-            momentOut + offsetIdx,
-            epsilon_,
-            lr[0],
-            &context_);
-      }
+    auto update = [&](TIndex i) {
+      auto offsetI = i * block_size;
+      auto offsetIdx = indices[i] * block_size;
+      adagrad_compute(
+          block_size,
+          paramIn + offsetIdx,
+          gradIn + offsetI,
+          momentIn + offsetIdx,
+          paramOut + offsetIdx,
+          momentOut + offsetIdx,
+          epsilon_,
+          lr[0],
+          &context_);
+    };
+
+    rows_.Run(indices, n, block_size, hogwild_, update);
+    auto* dirty_rows = DirtyRowTracker::Get();
+    dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_PARAM), indices, n);
+    dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_MOMENT_1), indices, n);
+    return true;
+  }
+
+ protected:
+  T epsilon_;
+  bool hogwild_;
+  SparseRowUpdates rows_;
+  INPUT_TAGS(PARAM, MOMENT_1, INDICES, GRAD, LR);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
+};
+
+// Adagrad with a single moment per row of param, which is the mean of the
+// squared gradients of the row, instead of one per element.
+template <typename T, class Context>
+class RowWiseSparseAdagradOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  RowWiseSparseAdagradOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)),
+        hogwild_(OperatorBase::GetSingleArgument<int>("hogwild", 0)) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    const auto& param = Input(PARAM);
+    const auto& moment = Input(MOMENT_1);
+    CAFFE_ENFORCE_GT(param.ndim(), 0);
+    CAFFE_ENFORCE_EQ(moment.size(), param.dim(0));
+    const auto* lr = Input(LR).template data<T>();
+    Output(OUTPUT_PARAM)->ResizeLike(param);
+    Output(OUTPUT_MOMENT_1)->ResizeLike(moment);
+
+    auto n = Input(GRAD).dim(0);
+
+    const auto* indices = Input(INDICES).template data<SIndex>();
+    const auto* gradIn = Input(GRAD).template data<T>();
+    const auto* paramIn = param.template data<T>();
+    const auto* momentIn = moment.template data<T>();
+    auto* paramOut = Output(OUTPUT_PARAM)->template mutable_data<T>();
+    auto* momentOut = Output(OUTPUT_MOMENT_1)->template mutable_data<T>();
+
+    if (n == 0) {
+      return true;
     }
+
+    auto block_size = Input(GRAD).size_from_dim(1);
+    CAFFE_ENFORCE_EQ(block_size, param.size_from_dim(1));
+    auto update = [&](TIndex i) {
+      auto idx = indices[i];
+      ConstEigenVectorArrayMap<T> g(gradIn + i * block_size, block_size);
+      const T hi = momentOut[idx] =
+          momentIn[idx] + g.square().sum() / block_size;
+      const T step = lr[0] / (std::sqrt(hi) + epsilon_);
+      EigenVectorArrayMap<T>(paramOut + idx * block_size, block_size) =
+          ConstEigenVectorArrayMap<T>(paramIn + idx * block_size, block_size) +
+          step * g;
+    };
+    rows_.Run(indices, n, block_size, hogwild_, update);
+    auto* dirty_rows = DirtyRowTracker::Get();
+    dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_PARAM), indices, n);
+    dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_MOMENT_1), indices, n);
     return true;
   }
 
  protected:
   T epsilon_;
+  bool hogwild_;
+  SparseRowUpdates rows_;
   INPUT_TAGS(PARAM, MOMENT_1, INDICES, GRAD, LR);
   OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
 };
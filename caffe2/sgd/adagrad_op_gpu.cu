@@ -1,6 +1,9 @@
+#include "cub/block/block_reduce.cuh"
+
 #include "adagrad_op.h"
 #include "caffe2/core/common_gpu.h"
 #include "caffe2/core/context_gpu.h"
+#include "caffe2/sgd/sparse_sort_gpu.h"
 
 namespace caffe2 {
 
@@ -36,7 +39,257 @@ void adagrad_update<CUDAContext>(
       context->cuda_stream()>>>(N, g, h, ng, nh, epsilon, lr);
 }
 
+namespace {
+// Each block updates the rows whose first occurrence in the sorted indices it
+// is given, after summing the gradients of all of their occurrences. Every
+// row is written by a single thread, so no atomics are needed.
+template <typename SIndex>
+__global__ void SparseAdagradKernel(
+    const int n,
+    const TIndex block_size,
+    const TIndex num_rows,
+    const SIndex* sorted_indices,
+    const int* sorted_positions,
+    const float* param,
+    const float* moment,
+    const float* grad,
+    float* param_out,
+    float* moment_out,
+    const float epsilon,
+    const float* lr) {
+  for (int i = blockIdx.x; i < n; i += gridDim.x) {
+    const SIndex idx = sorted_indices[i];
+    if (i > 0 && sorted_indices[i - 1] == idx) {
+      continue;
+    }
+    CUDA_KERNEL_ASSERT(0 <= idx && idx < num_rows);
+    int end = i + 1;
+    while (end < n && sorted_indices[end] == idx) {
+      ++end;
+    }
+    for (TIndex j = threadIdx.x; j < block_size; j += blockDim.x) {
+      float gj = 0;
+      for (int k = i; k < end; ++k) {
+        gj += grad[sorted_positions[k] * block_size + j];
+      }
+      const TIndex offset = idx * block_size + j;
+      const float hj = moment_out[offset] = moment[offset] + gj * gj;
+      param_out[offset] = param[offset] + lr[0] * gj / (sqrtf(hj) + epsilon);
+    }
+  }
+}
+} // namespace
+
+// SparseAdagrad on CUDA. The indices are sorted on the device and the
+// gradients of duplicated indices are summed before a single update, where
+// the CPU operator applies one update per occurrence.
+class CUDASparseAdagradOp final : public Operator<CUDAContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CUDAContext);
+  CUDASparseAdagradOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CUDAContext>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    const auto& param = Input(PARAM);
+    const auto& moment = Input(MOMENT_1);
+    const auto& indices = Input(INDICES);
+    const auto& grad = Input(GRAD);
+    CAFFE_ENFORCE_EQ(param.size(), moment.size());
+    CAFFE_ENFORCE_GT(param.ndim(), 0);
+    CAFFE_ENFORCE_EQ(indices.size(), grad.ndim() > 0 ? grad.dim(0) : 0);
+    auto* param_out = Output(OUTPUT_PARAM);
+    auto* moment_out = Output(OUTPUT_MOMENT_1);
+    if (param_out != &param) {
+      param_out->CopyFrom(param, &context_);
+    }
+    if (moment_out != &moment) {
+      moment_out->CopyFrom(moment, &context_);
+    }
+
+    const int n = indices.size();
+    const TIndex num_rows = param.dim(0);
+    const TIndex block_size = grad.size_from_dim(1);
+    CAFFE_ENFORCE_EQ(block_size, param.size_from_dim(1));
+    if (n == 0 || block_size == 0) {
+      return true;
+    }
+    const SIndex* idxs = indices.template data<SIndex>();
+    sorted_.Sort(n, num_rows, idxs, &context_);
+    SparseAdagradKernel<SIndex><<<
+        std::min(n, CAFFE_MAXIMUM_NUM_BLOCKS),
+        std::min<TIndex>(CAFFE_CUDA_NUM_THREADS, (block_size + 31) / 32 * 32),
+        0,
+        context_.cuda_stream()>>>(
+        n,
+        block_size,
+        num_rows,
+        sorted_.indices<SIndex>(),
+        sorted_.positions(),
+        param_out->template data<float>(),
+        moment_out->template data<float>(),
+        grad.template data<float>(),
+        param_out->template mutable_data<float>(),
+        moment_out->template mutable_data<float>(),
+        epsilon_,
+        Input(LR).template data<float>());
+    MarkDirtyRowsFromDevice(
+        {OperatorBase::OutputBlob(OUTPUT_PARAM),
+         OperatorBase::OutputBlob(OUTPUT_MOMENT_1)},
+        n,
+        idxs,
+        &context_);
+    return true;
+  }
+
+ protected:
+  float epsilon_;
+  SortedSparseIndices sorted_;
+  INPUT_TAGS(PARAM, MOMENT_1, INDICES, GRAD, LR);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
+};
+
+namespace {
+// As SparseAdagradKernel, with the mean of the squared summed gradients of a
+// row reduced over the block to update its single moment.
+template <typename SIndex>
+__global__ void RowWiseSparseAdagradKernel(
+    const int n,
+    const TIndex block_size,
+    const TIndex num_rows,
+    const SIndex* sorted_indices,
+    const int* sorted_positions,
+    const float* param,
+    const float* moment,
+    const float* grad,
+    float* param_out,
+    float* moment_out,
+    const float epsilon,
+    const float* lr) {
+  typedef cub::BlockReduce<float, CAFFE_CUDA_NUM_THREADS> BlockReduce;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  __shared__ float step;
+  for (int i = blockIdx.x; i < n; i += gridDim.x) {
+    const SIndex idx = sorted_indices[i];
+    if (i > 0 && sorted_indices[i - 1] == idx) {
+      continue;
+    }
+    CUDA_KERNEL_ASSERT(0 <= idx && idx < num_rows);
+    int end = i + 1;
+    while (end < n && sorted_indices[end] == idx) {
+      ++end;
+    }
+    float sum_squares = 0;
+    for (TIndex j = threadIdx.x; j < block_size; j += blockDim.x) {
+      float gj = 0;
+      for (int k = i; k < end; ++k) {
+        gj += grad[sorted_positions[k] * block_size + j];
+      }
+      sum_squares += gj * gj;
+    }
+    sum_squares = BlockReduce(temp_storage).Sum(sum_squares);
+    if (threadIdx.x == 0) {
+      const float hi = moment_out[idx] =
+          moment[idx] + sum_squares / block_size;
+      step = lr[0] / (sqrtf(hi) + epsilon);
+    }
+    __syncthreads();
+    for (TIndex j = threadIdx.x; j < block_size; j += blockDim.x) {
+      float gj = 0;
+      for (int k = i; k < end; ++k) {
+        gj += grad[sorted_positions[k] * block_size + j];
+      }
+      const TIndex offset = idx * block_size + j;
+      param_out[offset] = param[offset] + step * gj;
+    }
+    // temp_storage and step are reused by the next row.
+    __syncthreads();
+  }
+}
+} // namespace
+
+class CUDARowWiseSparseAdagradOp final : public Operator<CUDAContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CUDAContext);
+  CUDARowWiseSparseAdagradOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CUDAContext>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    const auto& param = Input(PARAM);
+    const auto& moment = Input(MOMENT_1);
+    const auto& indices = Input(INDICES);
+    const auto& grad = Input(GRAD);
+    CAFFE_ENFORCE_GT(param.ndim(), 0);
+    CAFFE_ENFORCE_EQ(moment.size(), param.dim(0));
+    CAFFE_ENFORCE_EQ(indices.size(), grad.ndim() > 0 ? grad.dim(0) : 0);
+    auto* param_out = Output(OUTPUT_PARAM);
+    auto* moment_out = Output(OUTPUT_MOMENT_1);
+    if (param_out != &param) {
+      param_out->CopyFrom(param, &context_);
+    }
+    if (moment_out != &moment) {
+      moment_out->CopyFrom(moment, &context_);
+    }
+
+    const int n = indices.size();
+    const TIndex num_rows = param.dim(0);
+    const TIndex block_size = grad.size_from_dim(1);
+    CAFFE_ENFORCE_EQ(block_size, param.size_from_dim(1));
+    if (n == 0 || block_size == 0) {
+      return true;
+    }
+    const SIndex* idxs = indices.template data<SIndex>();
+    sorted_.Sort(n, num_rows, idxs, &context_);
+    // The block reduction needs all of CAFFE_CUDA_NUM_THREADS threads.
+    RowWiseSparseAdagradKernel<SIndex><<<
+        std::min(n, CAFFE_MAXIMUM_NUM_BLOCKS),
+        CAFFE_CUDA_NUM_THREADS,
+        0,
+        context_.cuda_stream()>>>(
+        n,
+        block_size,
+        num_rows,
+        sorted_.indices<SIndex>(),
+        sorted_.positions(),
+        param_out->template data<float>(),
+        moment_out->template data<float>(),
+        grad.template data<float>(),
+        param_out->template mutable_data<float>(),
+        moment_out->template mutable_data<float>(),
+        epsilon_,
+        Input(LR).template data<float>());
+    MarkDirtyRowsFromDevice(
+        {OperatorBase::OutputBlob(OUTPUT_PARAM),
+         OperatorBase::OutputBlob(OUTPUT_MOMENT_1)},
+        n,
+        idxs,
+        &context_);
+    return true;
+  }
+
+ protected:
+  float epsilon_;
+  SortedSparseIndices sorted_;
+  INPUT_TAGS(PARAM, MOMENT_1, INDICES, GRAD, LR);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
+};
+
 namespace {
 REGISTER_CUDA_OPERATOR(Adagrad, AdagradOp<float, CUDAContext>);
+REGISTER_CUDA_OPERATOR(SparseAdagrad, CUDASparseAdagradOp);
+REGISTER_CUDA_OPERATOR(RowWiseSparseAdagrad, CUDARowWiseSparseAdagradOp);
 }
 }
@@ -51,6 +51,10 @@ Given inputs (param, moment1, moment2, indices, grad, lr, iter), runs the dense
 Adam on on (param, moment1[indices], momemnt2[indices], lr, iter) and returns
 (new_param, new_moment1, new_moment2) as in dense case
 
+On CPU, an index that appears several times is updated once per occurrence.
+On CUDA, the gradients of all of its occurrences are summed and it is updated
+once, which is the same when the indices are unique.
+
 )DOC")
     .Input(0, "param", "Parameters to be updated")
     .Input(1, "moment_1", "First moment history")
@@ -66,8 +70,54 @@ Adam on on (param, moment1[indices], momemnt2[indices], lr, iter) and returns
     .Arg("beta2", "Default 0.999")
     .Arg("epsilon", "Default 1e-5");
 
+REGISTER_CPU_OPERATOR(LazySparseAdam, LazySparseAdamOp<float, CPUContext>);
+OPERATOR_SCHEMA(LazySparseAdam)
+    .NumInputs(8)
+    .NumOutputs(4)
+    .EnforceInplace({{0, 0}, {1, 1}, {2, 2}, {3, 3}})
+    .SetDoc(R"DOC(
+
+SparseAdam that only touches the rows of the given indices, while keeping
+them close to what the dense Adam would compute on a gradient that is zero
+outside of these rows. Given inputs (param, moment1, moment2, last_iter,
+indices, grad, lr, iter), last_iter holds, for every row of param, the step
+(iter + 1) at which it was last updated, and starts at 0.
+
+When a row comes back after k steps without a gradient, the k steps are
+first applied in closed form: the moments decay by beta1^k and beta2^k, and
+the parameter takes the sum of the k updates, in which the first moment
+decays as beta1^j and the square root of the second as sqrt(beta2)^j. Over
+these steps, epsilon is taken relative to the second moment of the last
+update, and the bias correction of the current step is used. The update for
+the new gradient follows. With catch_up=0, the skipped steps are ignored, as
+in the usual lazy Adam.
+
+Every occurrence of a duplicate index is applied in turn, as for SparseAdam
+on CPU, and the outputs must be the inputs.
+
+)DOC")
+    .Input(0, "param", "Parameters to be updated")
+    .Input(1, "moment_1", "First moment history")
+    .Input(2, "moment_2", "Second moment history")
+    .Input(3, "last_iter", "int64 step of the last update of each row")
+    .Input(4, "indices", "Sparse indices")
+    .Input(5, "grad", "Gradient computed")
+    .Input(6, "lr", "learning rate")
+    .Input(7, "iter", "iteration number")
+    .Output(0, "output_param", "Updated parameters")
+    .Output(1, "output_moment_1", "Updated first moment")
+    .Output(2, "output_moment_2", "Updated second moment")
+    .Output(3, "output_last_iter", "Updated last_iter")
+    .Arg("beta1", "Default 0.9")
+    .Arg("beta2", "Default 0.999")
+    .Arg("epsilon", "Default 1e-5")
+    .Arg(
+        "catch_up",
+        "(bool, default 1) Apply the steps a row skipped before updating it.");
+
 SHOULD_NOT_DO_GRADIENT(Adam);
 SHOULD_NOT_DO_GRADIENT(SparseAdam);
+SHOULD_NOT_DO_GRADIENT(LazySparseAdam);
 }
 
 }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+
+#include "caffe2/core/dirty_rows.h"
 #include "caffe2/core/operator.h"
 
 namespace caffe2 {
@@ -176,6 +179,10 @@ class SparseAdamOp final : public Operator<Context> {
             &context_);
       }
     }
+    auto* dirty_rows = DirtyRowTracker::Get();
+    dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_PARAM), indices, n);
+    dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_MOMENT_1), indices, n);
+    dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_MOMENT_2), indices, n);
     return true;
   }
 
@@ -186,4 +193,138 @@ class SparseAdamOp final : public Operator<Context> {
   INPUT_TAGS(PARAM, MOMENT_1, MOMENT_2, INDICES, GRAD, LR, ITER);
   OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1, OUTPUT_MOMENT_2);
 };
+
+// The decays of the moments of a row over skipped steps with zero gradients,
+// and the sum of the factors of its first step to get the parameter updates
+// of the skipped steps, in closed form.
+struct LazyAdamCatchUp {
+  LazyAdamCatchUp(int64_t skipped, float beta1, float beta2) {
+    decay1 = std::pow(beta1, skipped);
+    decay2 = std::pow(beta2, skipped);
+    // Step j is mj / sqrt(vj) = q^j * m / sqrt(v), with q below.
+    const float q = beta1 / std::sqrt(beta2);
+    steps = q == 1.f ? skipped : q * (1.f - std::pow(q, skipped)) / (1.f - q);
+  }
+
+  float decay1;
+  float decay2;
+  float steps;
+};
+
+// SparseAdam that keeps the step at which each row was last updated, in
+// last_iter. When a row comes back after some steps without a gradient,
+// these steps are first applied at once, before the update for the new
+// gradient, so that the cost of a step only depends on the touched rows.
+template <typename T, class Context>
+class LazySparseAdamOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  LazySparseAdamOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        beta1_(OperatorBase::GetSingleArgument<float>("beta1", 0.9)),
+        beta2_(OperatorBase::GetSingleArgument<float>("beta2", 0.999)),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)),
+        catch_up_(OperatorBase::GetSingleArgument<int>("catch_up", 1)) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    const auto& param = Input(PARAM);
+    CAFFE_ENFORCE_GT(param.ndim(), 0);
+    CAFFE_ENFORCE_EQ(param.size(), Input(MOMENT_1).size());
+    CAFFE_ENFORCE_EQ(param.size(), Input(MOMENT_2).size());
+    CAFFE_ENFORCE_EQ(Input(LAST_ITER).size(), param.dim(0));
+    const auto* lr = Input(LR).template data<T>();
+    const auto iter =
+        OperatorBase::Input<TensorCPU>(ITER).template data<int64_t>()[0];
+
+    const auto t = iter + 1;
+    const auto correction =
+        std::sqrt(T(1.) - std::pow(beta2_, t)) / (T(1.) - std::pow(beta1_, t));
+
+    Output(OUTPUT_PARAM)->ResizeLike(param);
+    Output(OUTPUT_MOMENT_1)->ResizeLike(Input(MOMENT_1));
+    Output(OUTPUT_MOMENT_2)->ResizeLike(Input(MOMENT_2));
+    Output(OUTPUT_LAST_ITER)->ResizeLike(Input(LAST_ITER));
+
+    auto n = Input(GRAD).dim(0);
+    auto block_size = Input(GRAD).size_from_dim(1);
+    CAFFE_ENFORCE_EQ(block_size, param.size_from_dim(1));
+
+    const auto* paramIn = param.template data<T>();
+    const auto* indices = Input(INDICES).template data<SIndex>();
+    const auto* gradIn = Input(GRAD).template data<T>();
+    const auto* moment1In = Input(MOMENT_1).template data<T>();
+    const auto* moment2In = Input(MOMENT_2).template data<T>();
+    const auto* lastIterIn = Input(LAST_ITER).template data<int64_t>();
+    auto* paramOut = Output(OUTPUT_PARAM)->template mutable_data<T>();
+    auto* moment1Out = Output(OUTPUT_MOMENT_1)->template mutable_data<T>();
+    auto* moment2Out = Output(OUTPUT_MOMENT_2)->template mutable_data<T>();
+    auto* lastIterOut =
+        Output(OUTPUT_LAST_ITER)->template mutable_data<int64_t>();
+
+    for (auto i = 0; i < n; ++i) {
+      auto idx = indices[i];
+      auto offsetI = i * block_size;
+      auto offsetIdx = idx * block_size;
+      const T* w = paramIn + offsetIdx;
+      const T* m = moment1In + offsetIdx;
+      const T* v = moment2In + offsetIdx;
+      // A row that is updated again in the same step skips nothing.
+      const int64_t skipped = std::max<int64_t>(0, t - 1 - lastIterIn[idx]);
+      if (catch_up_ && skipped > 0) {
+        const LazyAdamCatchUp catch_up(skipped, beta1_, beta2_);
+        for (auto j = 0; j < block_size; ++j) {
+          paramOut[offsetIdx + j] = w[j] +
+              lr[0] * correction * catch_up.steps * m[j] /
+                  (std::sqrt(v[j]) + epsilon_);
+          moment1Out[offsetIdx + j] = m[j] * catch_up.decay1;
+          moment2Out[offsetIdx + j] = v[j] * catch_up.decay2;
+        }
+        w = paramOut + offsetIdx;
+        m = moment1Out + offsetIdx;
+        v = moment2Out + offsetIdx;
+      }
+      adam_compute(
+          block_size,
+          w,
+          gradIn + offsetI,
+          m,
+          v,
+          paramOut + offsetIdx,
+          moment1Out + offsetIdx,
+          moment2Out + offsetIdx,
+          beta1_,
+          beta2_,
+          epsilon_,
+          correction,
+          lr,
+          &context_);
+      lastIterOut[idx] = t;
+    }
+    auto* dirty_rows = DirtyRowTracker::Get();
+    dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_PARAM), indices, n);
+    dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_MOMENT_1), indices, n);
+    dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_MOMENT_2), indices, n);
+    dirty_rows->MarkRows(
+        OperatorBase::OutputBlob(OUTPUT_LAST_ITER), indices, n);
+    return true;
+  }
+
+ protected:
+  T beta1_;
+  T beta2_;
+  T epsilon_;
+  bool catch_up_;
+  INPUT_TAGS(PARAM, MOMENT_1, MOMENT_2, LAST_ITER, INDICES, GRAD, LR, ITER);
+  OUTPUT_TAGS(
+      OUTPUT_PARAM,
+      OUTPUT_MOMENT_1,
+      OUTPUT_MOMENT_2,
+      OUTPUT_LAST_ITER);
+};
 }
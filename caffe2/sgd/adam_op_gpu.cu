@@ -1,6 +1,7 @@
 #include "adam_op.h"
 #include "caffe2/core/common_gpu.h"
 #include "caffe2/core/context_gpu.h"
+#include "caffe2/sgd/sparse_sort_gpu.h"
 
 namespace caffe2 {
 
@@ -86,10 +87,312 @@ void adam_compute<CUDAContext>(
   AdamCompute<<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS, 0, context->cuda_stream()>>>(
       N, w, g, m, v, nw, nm, nv, beta1, beta2, eps_hat, correction, lr);
 }
+namespace {
+// Each block updates the rows whose first occurrence in the sorted indices it
+// is given, after summing the gradients of all of their occurrences. Every
+// row is written by a single thread, so no atomics are needed.
+template <typename SIndex>
+__global__ void SparseAdamKernel(
+    const int n,
+    const TIndex block_size,
+    const TIndex num_rows,
+    const SIndex* sorted_indices,
+    const int* sorted_positions,
+    const float* param,
+    const float* moment1,
+    const float* moment2,
+    const float* grad,
+    float* param_out,
+    float* moment1_out,
+    float* moment2_out,
+    const float beta1,
+    const float beta2,
+    const float epsilon,
+    const float correction,
+    const float* lr) {
+  for (int i = blockIdx.x; i < n; i += gridDim.x) {
+    const SIndex idx = sorted_indices[i];
+    if (i > 0 && sorted_indices[i - 1] == idx) {
+      continue;
+    }
+    CUDA_KERNEL_ASSERT(0 <= idx && idx < num_rows);
+    int end = i + 1;
+    while (end < n && sorted_indices[end] == idx) {
+      ++end;
+    }
+    for (TIndex j = threadIdx.x; j < block_size; j += blockDim.x) {
+      float gj = 0;
+      for (int k = i; k < end; ++k) {
+        gj += grad[sorted_positions[k] * block_size + j];
+      }
+      const TIndex offset = idx * block_size + j;
+      const float mj = moment1_out[offset] =
+          moment1[offset] * beta1 + gj * (1 - beta1);
+      const float vj = moment2_out[offset] =
+          moment2[offset] * beta2 + gj * gj * (1 - beta2);
+      param_out[offset] =
+          param[offset] + lr[0] * correction * mj / (sqrtf(vj) + epsilon);
+    }
+  }
+}
+} // namespace
+
+// SparseAdam on CUDA. The indices are sorted on the device and the gradients
+// of duplicated indices are summed before a single update, where the CPU
+// operator applies one update per occurrence.
+class CUDASparseAdamOp final : public Operator<CUDAContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CUDAContext);
+  CUDASparseAdamOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CUDAContext>(operator_def, ws),
+        beta1_(OperatorBase::GetSingleArgument<float>("beta1", 0.9)),
+        beta2_(OperatorBase::GetSingleArgument<float>("beta2", 0.999)),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    const auto& param = Input(PARAM);
+    const auto& moment1 = Input(MOMENT_1);
+    const auto& moment2 = Input(MOMENT_2);
+    const auto& indices = Input(INDICES);
+    const auto& grad = Input(GRAD);
+    CAFFE_ENFORCE_EQ(param.size(), moment1.size());
+    CAFFE_ENFORCE_EQ(param.size(), moment2.size());
+    CAFFE_ENFORCE_GT(param.ndim(), 0);
+    CAFFE_ENFORCE_EQ(indices.size(), grad.ndim() > 0 ? grad.dim(0) : 0);
+    const auto iter =
+        OperatorBase::Input<TensorCPU>(ITER).template data<int64_t>()[0];
+    const auto t = iter + 1;
+    const float correction = std::sqrt(1.f - std::pow(beta2_, t)) /
+        (1.f - std::pow(beta1_, t));
+
+    auto* param_out = Output(OUTPUT_PARAM);
+    auto* moment1_out = Output(OUTPUT_MOMENT_1);
+    auto* moment2_out = Output(OUTPUT_MOMENT_2);
+    if (param_out != &param) {
+      param_out->CopyFrom(param, &context_);
+    }
+    if (moment1_out != &moment1) {
+      moment1_out->CopyFrom(moment1, &context_);
+    }
+    if (moment2_out != &moment2) {
+      moment2_out->CopyFrom(moment2, &context_);
+    }
+
+    const int n = indices.size();
+    const TIndex num_rows = param.dim(0);
+    const TIndex block_size = grad.size_from_dim(1);
+    CAFFE_ENFORCE_EQ(block_size, param.size_from_dim(1));
+    if (n == 0 || block_size == 0) {
+      return true;
+    }
+    const SIndex* idxs = indices.template data<SIndex>();
+    sorted_.Sort(n, num_rows, idxs, &context_);
+    SparseAdamKernel<SIndex><<<
+        std::min(n, CAFFE_MAXIMUM_NUM_BLOCKS),
+        std::min<TIndex>(CAFFE_CUDA_NUM_THREADS, (block_size + 31) / 32 * 32),
+        0,
+        context_.cuda_stream()>>>(
+        n,
+        block_size,
+        num_rows,
+        sorted_.indices<SIndex>(),
+        sorted_.positions(),
+        param_out->template data<float>(),
+        moment1_out->template data<float>(),
+        moment2_out->template data<float>(),
+        grad.template data<float>(),
+        param_out->template mutable_data<float>(),
+        moment1_out->template mutable_data<float>(),
+        moment2_out->template mutable_data<float>(),
+        beta1_,
+        beta2_,
+        epsilon_,
+        correction,
+        Input(LR).template data<float>());
+    MarkDirtyRowsFromDevice(
+        {OperatorBase::OutputBlob(OUTPUT_PARAM),
+         OperatorBase::OutputBlob(OUTPUT_MOMENT_1),
+         OperatorBase::OutputBlob(OUTPUT_MOMENT_2)},
+        n,
+        idxs,
+        &context_);
+    return true;
+  }
+
+ protected:
+  float beta1_;
+  float beta2_;
+  float epsilon_;
+  SortedSparseIndices sorted_;
+  INPUT_TAGS(PARAM, MOMENT_1, MOMENT_2, INDICES, GRAD, LR, ITER);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1, OUTPUT_MOMENT_2);
+};
+
+namespace {
+// As SparseAdamKernel, first applying the steps that each row skipped since
+// last_iter in closed form, as LazyAdamCatchUp does on CPU.
+template <typename SIndex>
+__global__ void LazySparseAdamKernel(
+    const int n,
+    const TIndex block_size,
+    const TIndex num_rows,
+    const SIndex* sorted_indices,
+    const int* sorted_positions,
+    const float* grad,
+    float* param,
+    float* moment1,
+    float* moment2,
+    int64_t* last_iter,
+    const int64_t t,
+    const bool catch_up,
+    const float beta1,
+    const float beta2,
+    const float epsilon,
+    const float correction,
+    const float* lr) {
+  const float q = beta1 / sqrtf(beta2);
+  for (int i = blockIdx.x; i < n; i += gridDim.x) {
+    const SIndex idx = sorted_indices[i];
+    if (i > 0 && sorted_indices[i - 1] == idx) {
+      continue;
+    }
+    CUDA_KERNEL_ASSERT(0 <= idx && idx < num_rows);
+    int end = i + 1;
+    while (end < n && sorted_indices[end] == idx) {
+      ++end;
+    }
+    const int64_t skipped = catch_up ? max(int64_t(0), t - 1 - last_iter[idx])
+                                     : int64_t(0);
+    const float decay1 = powf(beta1, skipped);
+    const float decay2 = powf(beta2, skipped);
+    const float steps =
+        q == 1.f ? skipped : q * (1.f - powf(q, skipped)) / (1.f - q);
+    for (TIndex j = threadIdx.x; j < block_size; j += blockDim.x) {
+      float gj = 0;
+      for (int k = i; k < end; ++k) {
+        gj += grad[sorted_positions[k] * block_size + j];
+      }
+      const TIndex offset = idx * block_size + j;
+      float wj = param[offset];
+      float mj = moment1[offset];
+      float vj = moment2[offset];
+      if (skipped > 0) {
+        wj += lr[0] * correction * steps * mj / (sqrtf(vj) + epsilon);
+        mj *= decay1;
+        vj *= decay2;
+      }
+      mj = moment1[offset] = mj * beta1 + gj * (1 - beta1);
+      vj = moment2[offset] = vj * beta2 + gj * gj * (1 - beta2);
+      param[offset] = wj + lr[0] * correction * mj / (sqrtf(vj) + epsilon);
+    }
+    // All the threads have read last_iter[idx].
+    __syncthreads();
+    if (threadIdx.x == 0) {
+      last_iter[idx] = t;
+    }
+  }
+}
+} // namespace
+
+// LazySparseAdam on CUDA, which sums the gradients of duplicated indices as
+// CUDASparseAdamOp does.
+class CUDALazySparseAdamOp final : public Operator<CUDAContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CUDAContext);
+  CUDALazySparseAdamOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CUDAContext>(operator_def, ws),
+        beta1_(OperatorBase::GetSingleArgument<float>("beta1", 0.9)),
+        beta2_(OperatorBase::GetSingleArgument<float>("beta2", 0.999)),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)),
+        catch_up_(OperatorBase::GetSingleArgument<int>("catch_up", 1)) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    const auto& param = Input(PARAM);
+    const auto& indices = Input(INDICES);
+    const auto& grad = Input(GRAD);
+    CAFFE_ENFORCE_GT(param.ndim(), 0);
+    CAFFE_ENFORCE_EQ(param.size(), Input(MOMENT_1).size());
+    CAFFE_ENFORCE_EQ(param.size(), Input(MOMENT_2).size());
+    CAFFE_ENFORCE_EQ(Input(LAST_ITER).size(), param.dim(0));
+    CAFFE_ENFORCE_EQ(indices.size(), grad.ndim() > 0 ? grad.dim(0) : 0);
+    const auto iter =
+        OperatorBase::Input<TensorCPU>(ITER).template data<int64_t>()[0];
+    const auto t = iter + 1;
+    const float correction = std::sqrt(1.f - std::pow(beta2_, t)) /
+        (1.f - std::pow(beta1_, t));
+
+    const int n = indices.size();
+    const TIndex num_rows = param.dim(0);
+    const TIndex block_size = grad.size_from_dim(1);
+    CAFFE_ENFORCE_EQ(block_size, param.size_from_dim(1));
+    if (n == 0 || block_size == 0) {
+      return true;
+    }
+    const SIndex* idxs = indices.template data<SIndex>();
+    sorted_.Sort(n, num_rows, idxs, &context_);
+    LazySparseAdamKernel<SIndex><<<
+        std::min(n, CAFFE_MAXIMUM_NUM_BLOCKS),
+        std::min<TIndex>(CAFFE_CUDA_NUM_THREADS, (block_size + 31) / 32 * 32),
+        0,
+        context_.cuda_stream()>>>(
+        n,
+        block_size,
+        num_rows,
+        sorted_.indices<SIndex>(),
+        sorted_.positions(),
+        grad.template data<float>(),
+        Output(OUTPUT_PARAM)->template mutable_data<float>(),
+        Output(OUTPUT_MOMENT_1)->template mutable_data<float>(),
+        Output(OUTPUT_MOMENT_2)->template mutable_data<float>(),
+        Output(OUTPUT_LAST_ITER)->template mutable_data<int64_t>(),
+        t,
+        catch_up_,
+        beta1_,
+        beta2_,
+        epsilon_,
+        correction,
+        Input(LR).template data<float>());
+    MarkDirtyRowsFromDevice(
+        {OperatorBase::OutputBlob(OUTPUT_PARAM),
+         OperatorBase::OutputBlob(OUTPUT_MOMENT_1),
+         OperatorBase::OutputBlob(OUTPUT_MOMENT_2),
+         OperatorBase::OutputBlob(OUTPUT_LAST_ITER)},
+        n,
+        idxs,
+        &context_);
+    return true;
+  }
 
+ protected:
+  float beta1_;
+  float beta2_;
+  float epsilon_;
+  bool catch_up_;
+  SortedSparseIndices sorted_;
+  INPUT_TAGS(PARAM, MOMENT_1, MOMENT_2, LAST_ITER, INDICES, GRAD, LR, ITER);
+  OUTPUT_TAGS(
+      OUTPUT_PARAM,
+      OUTPUT_MOMENT_1,
+      OUTPUT_MOMENT_2,
+      OUTPUT_LAST_ITER);
+};
 
 namespace {
 REGISTER_CUDA_OPERATOR(Adam, AdamOp<float, CUDAContext>);
+REGISTER_CUDA_OPERATOR(SparseAdam, CUDASparseAdamOp);
+REGISTER_CUDA_OPERATOR(LazySparseAdam, CUDALazySparseAdamOp);
 }
 
 }
@@ -1,12 +1,11 @@
 #include "ftrl_op.h"
 
-namespace caffe2 {
+#include <cmath>
 
-template <class T>
-inline T sgn(const T x) {
-  return (x == 0 ? 0 : (x < 0 ? -1 : 1));
-}
+namespace caffe2 {
 
+// Branchless, with float square roots for float, so that the compiler can
+// turn the loop of ftrl_update into SIMD code.
 template <typename T>
 inline void ftrl_compute(
     const T w,
@@ -17,20 +16,19 @@ inline void ftrl_compute(
     T& nn,
     T& nz,
     const FtrlParams<T>& params) {
-  auto new_n = n + g * g;
-  auto sigma = (sqrt(new_n) - sqrt(n)) * params.alphaInv;
+  const T new_n = n + g * g;
+  const T sqrt_new_n = std::sqrt(new_n);
+  const T sigma = (sqrt_new_n - std::sqrt(n)) * params.alphaInv;
+  const T new_z = z + g - sigma * w;
   nn = new_n;
-  nz = z + g - sigma * w;
+  nz = new_z;
   // update the weight
-  if (std::abs(nz) > params.lambda1) {
-    nw = (params.lambda1 * sgn(nz) - nz) /
-        ((params.beta + sqrt(new_n)) * params.alphaInv + params.lambda2);
-  } else {
-    nw = 0.0;
-  }
+  const T sign = T(new_z > 0) - T(new_z < 0);
+  const T new_w = (params.lambda1 * sign - new_z) /
+      ((params.beta + sqrt_new_n) * params.alphaInv + params.lambda2);
+  nw = std::abs(new_z) > params.lambda1 ? new_w : T(0);
 }
 
-// TODO(dzhulgakov): implement SIMD-based version
 template <typename Context, typename T>
 void ftrl_update(
     int N,
@@ -41,8 +39,6 @@ void ftrl_update(
     T* new_nz,
     const FtrlParams<T>& params,
     Context* context) {
-  // TODO(cxj): use OMP when it is reliable
-  // #pragma omp parallel for
   for (auto i = 0; i < N; ++i) {
     ftrl_compute(
         w[i],
@@ -95,9 +91,7 @@ void SparseFtrlOp<T>::DoRun() {
   const SIndex* idxs = indices.template data<SIndex>();
   const T* g = grad.template data<T>();
 
-  // TODO(cxj): use OMP when it is reliable
-  // #pragma omp parallel for
-  for (TIndex i = 0; i < K; ++i) {
+  rows_.Run(idxs, K, block_size, hogwild_, [&](TIndex i) {
     SIndex idx = idxs[i];
     DCHECK(0 <= idx && idx < N) << "Index out of bounds: " << idx
                                 << ", range 0 to " << N;
@@ -123,19 +117,43 @@ void SparseFtrlOp<T>::DoRun() {
           params_,
           &context_);
     }
-  }
+  });
+  auto* dirty_rows = DirtyRowTracker::Get();
+  dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_VAR), idxs, K);
+  dirty_rows->MarkRows(OperatorBase::OutputBlob(OUTPUT_N_Z), idxs, K);
 }
 
 namespace {
 REGISTER_CPU_OPERATOR(Ftrl, FtrlOp<float, CPUContext>);
+// sgd.build_ftrl asks for the SIMD engine, which is the default
+// implementation.
+REGISTER_CPU_OPERATOR_WITH_ENGINE(Ftrl, SIMD, FtrlOp<float, CPUContext>);
 OPERATOR_SCHEMA(Ftrl).NumInputs(3).NumOutputs(2).AllowInplace({{0, 0}, {1, 1}});
 SHOULD_NOT_DO_GRADIENT(Ftrl);
 
 REGISTER_CPU_OPERATOR(SparseFtrl, SparseFtrlOp<float>);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(SparseFtrl, SIMD, SparseFtrlOp<float>);
 OPERATOR_SCHEMA(SparseFtrl)
     .NumInputs(4)
     .NumOutputs(2)
-    .EnforceInplace({{0, 0}, {1, 1}});
+    .EnforceInplace({{0, 0}, {1, 1}})
+    .SetDoc(R"DOC(
+
+Runs FTRL on the rows of var and n_z at indices, with the rows of grad. Large
+batches are split over the OpenMP threads by row, and the occurrences of a
+duplicate index are applied in order by one thread. With hogwild set, the
+occurrences are split over the threads regardless of their index, which is
+faster but can lose some of the updates of duplicate indices.
+
+)DOC")
+    .Arg("alpha", "Default 0.005")
+    .Arg("beta", "Default 1.0")
+    .Arg("lambda1", "Default 0.001")
+    .Arg("lambda2", "Default 0.001")
+    .Arg(
+        "hogwild",
+        "(bool, default false) Update the rows of duplicate indices "
+        "concurrently, without locks.");
 SHOULD_NOT_DO_GRADIENT(SparseFtrl);
 }
 
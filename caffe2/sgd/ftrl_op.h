@@ -1,6 +1,8 @@
 #pragma once
 
+#include "caffe2/core/dirty_rows.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/sgd/sparse_row_updates.h"
 
 namespace caffe2 {
 
@@ -36,7 +38,9 @@ template <typename T>
 class SparseFtrlOp final : public Operator<CPUContext> {
  public:
   SparseFtrlOp(const OperatorDef& operator_def, Workspace* ws)
-      : Operator<CPUContext>(operator_def, ws), params_(this) {}
+      : Operator<CPUContext>(operator_def, ws),
+        params_(this),
+        hogwild_(OperatorBase::GetSingleArgument<int>("hogwild", 0)) {}
 
   bool RunOnDevice() override {
     // Use run-time polymorphism
@@ -54,6 +58,8 @@ class SparseFtrlOp final : public Operator<CPUContext> {
 
  protected:
   FtrlParams<T> params_;
+  bool hogwild_;
+  SparseRowUpdates rows_;
   INPUT_TAGS(VAR, N_Z, INDICES, GRAD);
   OUTPUT_TAGS(OUTPUT_VAR, OUTPUT_N_Z);
 
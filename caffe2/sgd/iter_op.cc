@@ -11,7 +11,9 @@ OPERATOR_SCHEMA(Iter)
     .EnforceInplace({{0, 0}})
     .SetDoc(R"DOC(
 Stores a singe integer, that gets incremented on each call to Run().
-Useful for tracking the iteration count during SGD, for example.
+Useful for tracking the iteration count during SGD, for example. The counter
+is an int64 tensor on the CPU, unless the blob already holds a tensor on the
+device of the operator, in which case it is incremented there.
 )DOC");
 
 OPERATOR_SCHEMA(AtomicIter)
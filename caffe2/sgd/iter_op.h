@@ -21,11 +21,24 @@ inline void IncrementIter(TensorCPU* output) {
   (*iter)++;
 }
 
-// IterOp runs an iteration counter. I cannot think of a case where we would
-// need to access the iter variable on device, so this will always produce a
-// tensor on the CPU side. If the blob already exists and is a tensor<int64_t>
-// object, we will simply increment it (this emulates the case when we want to
-// resume training). Otherwise we will have the iter starting with 0.
+// Increments a counter of size 1 that lives on the device of Context, without
+// waiting for the device. The range checks of IncrementIter are skipped.
+template <class Context>
+void IncrementIterOnDevice(Tensor<Context>* output, Context* context);
+
+template <>
+inline void IncrementIterOnDevice<CPUContext>(
+    TensorCPU* output,
+    CPUContext* /*context*/) {
+  IncrementIter(output);
+}
+
+// IterOp runs an iteration counter. This will normally produce a tensor on the
+// CPU side. If the blob already exists and is a tensor<int64_t> object, we
+// will simply increment it (this emulates the case when we want to resume
+// training). Otherwise we will have the iter starting with 0. If the blob
+// already exists as a tensor on the device of the operator, it is incremented
+// there, so that LearningRate can read it on the device without a host sync.
 template <class Context>
 class IterOp final : public Operator<Context> {
  public:
@@ -48,6 +61,16 @@ class IterOp final : public Operator<Context> {
         output->template mutable_data<int64_t>()[0] = 0;
       }
     }
+    if (!OperatorBase::OutputIsType<TensorCPU>(0) &&
+        OperatorBase::OutputIsType<Tensor<Context>>(0)) {
+      auto* output = Output(0);
+      CAFFE_ENFORCE_EQ(
+          output->size(),
+          1,
+          "The output of IterOp exists, but not of the right size.");
+      IncrementIterOnDevice<Context>(output, &context_);
+      return true;
+    }
     IncrementIter(OperatorBase::Output<TensorCPU>(0));
     return true;
   }
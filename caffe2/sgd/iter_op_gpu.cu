@@ -0,0 +1,24 @@
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/sgd/iter_op.h"
+
+namespace caffe2 {
+
+namespace {
+__global__ void IncrementIterKernel(int64_t* iter) {
+  ++iter[0];
+}
+} // namespace
+
+template <>
+void IncrementIterOnDevice<CUDAContext>(
+    TensorCUDA* output,
+    CUDAContext* context) {
+  IncrementIterKernel<<<1, 1, 0, context->cuda_stream()>>>(
+      output->mutable_data<int64_t>());
+}
+
+namespace {
+REGISTER_CUDA_OPERATOR(Iter, IterOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(AtomicIter, AtomicIterOp<CUDAContext>);
+}
+} // namespace caffe2
@@ -1,66 +1,84 @@
 #ifndef CAFFE2_SGD_LEARNING_RATE_FUNCTORS_H_
 #define CAFFE2_SGD_LEARNING_RATE_FUNCTORS_H_
 
+#include <cmath>
+
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
 
-namespace caffe2 {
-
-// LearningRateFunctor is a functor that when fed with an iter number, produces
-// the learning rate for the corresponding iteration.
-template <typename T>
-class LearningRateFunctor {
- public:
-  virtual ~LearningRateFunctor() {}
-  virtual T operator()(const int64_t iter) const = 0;
-};
+#ifdef __CUDACC__
+#define CAFFE2_LR_HOST_DEVICE __host__ __device__
+#else
+#define CAFFE2_LR_HOST_DEVICE
+#endif
 
-// Fixed: not changing the learning rate at all.
-template <typename T>
-class FixedLearningRate : public LearningRateFunctor<T> {
- public:
-  T operator()(const int64_t iter) const override {
-    return 1.;
-  }
-};
+namespace caffe2 {
 
-// Step: return gamma ^ (floor(iter / step))
+// LearningRatePolicy is a plain struct that when fed with an iter number,
+// produces the learning rate multiplier for the corresponding iteration. It
+// holds no pointers, so that it can be passed by value to a CUDA kernel and
+// evaluated there from an iter counter that lives on the device.
 template <typename T>
-class StepLearningRate : public LearningRateFunctor<T> {
- public:
-  StepLearningRate(const int stepsize, const T gamma)
-      : stepsize_(stepsize), gamma_(gamma) {}
-  T operator()(const int64_t iter) const override {
-    return std::pow(gamma_, static_cast<T>(iter / stepsize_));
-  }
+struct LearningRatePolicy {
+  enum Kind {
+    // Fixed: not changing the learning rate at all.
+    FIXED,
+    // Step: return gamma ^ (floor(iter / step))
+    STEP,
+    // Exp: return gamma ^ iter
+    EXP,
+    // Inv: return (1 + gamma * iter) ^ (-power)
+    INV,
+    // Warmup: linear from warmup_factor at iter 0 to 1 at warmup_iters, then 1
+    WARMUP,
+    // Cosine: linear warmup as above, then from 1 at warmup_iters to
+    // min_ratio at max_iter along half a cosine, then min_ratio
+    COSINE,
+  };
 
-  int stepsize_;
-  T gamma_;
-};
+  Kind kind = FIXED;
+  int64_t stepsize = 0;
+  T gamma = 0;
+  T power = 0;
+  int64_t warmup_iters = 0;
+  T warmup_factor = 0;
+  int64_t max_iter = 0;
+  T min_ratio = 0;
 
-// Exp: return gamma ^ iter
-template <typename T>
-class ExpLearningRate : public LearningRateFunctor<T> {
- public:
-  explicit ExpLearningRate(const T gamma) : gamma_(gamma) {}
-  T operator()(const int64_t iter) const override {
-    return std::pow(gamma_, static_cast<T>(iter));
+  CAFFE2_LR_HOST_DEVICE T operator()(const int64_t iter) const {
+    switch (kind) {
+      case STEP:
+        return std::pow(gamma, static_cast<T>(iter / stepsize));
+      case EXP:
+        return std::pow(gamma, static_cast<T>(iter));
+      case INV:
+        return std::pow(T(1) + gamma * iter, -power);
+      case WARMUP:
+        return warmup(iter);
+      case COSINE:
+        if (iter < warmup_iters) {
+          return warmup(iter);
+        }
+        if (iter >= max_iter) {
+          return min_ratio;
+        }
+        return min_ratio +
+            (T(1) - min_ratio) * T(0.5) *
+            (T(1) +
+             std::cos(
+                 T(M_PI) * (iter - warmup_iters) / (max_iter - warmup_iters)));
+      default:
+        return T(1);
+    }
   }
 
-  T gamma_;
-};
-
-// Inv: return (1 + gamma * iter) ^ (-power)
-template <typename T>
-class InvLearningRate : public LearningRateFunctor<T> {
- public:
-  InvLearningRate(const T gamma, const T power)
-      : gamma_(gamma), power_(power) {}
-  T operator()(const int64_t iter) const override {
-    return std::pow(T(1) + gamma_ * iter, -power_);
+ private:
+  CAFFE2_LR_HOST_DEVICE T warmup(const int64_t iter) const {
+    if (iter >= warmup_iters) {
+      return T(1);
+    }
+    return warmup_factor + (T(1) - warmup_factor) * iter / warmup_iters;
   }
-  T gamma_;
-  T power_;
 };
 
 }  // namespace caffe2
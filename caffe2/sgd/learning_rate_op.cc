@@ -21,11 +21,21 @@ more exponential. Learning rate is controled by the following arguments:
   * `step`: uses `stepsize`, `gamma`
   * `exp`: uses `gamma`
   * `inv`: uses `gamma`, `power`
+  * `warmup`: uses `warmup_iters`, `warmup_factor`
+  * `cosine`: uses `warmup_iters`, `warmup_factor`, `max_iter`, `min_ratio`
 
 #### Optional:
 * `stepsize`: defaults to 0
 * `gamma`: defaults to 0
 * `power`: defaults to 0
+* `warmup_iters`: defaults to 0
+* `warmup_factor`: defaults to 0
+* `max_iter`: defaults to 0
+* `min_ratio`: defaults to 0
+
+The iterations may be an int64 tensor on the CPU, as produced by Iter, or on
+the device of the operator. In the latter case the policy is evaluated by a
+kernel on the device, and the operator never waits for the host.
 
 Usage:
 train_net.LearningRate(*iterations*, "*label*", base_lr=*float*,
@@ -39,6 +49,21 @@ train_net.LearningRate(200, "LR", base_lr=-0.1,
   .Arg("power", "(float, default 1.0) used only for inv policy type")
   .Arg("gamma", "(float, default 1.0) momentum of change")
   .Arg("stepsize", "(float, default 1.0) sampling rate on iterations")
+  .Arg(
+      "warmup_iters",
+      "(int, default 0) iterations over which the learning rate grows "
+      "linearly to base_lr, for the warmup and cosine policies")
+  .Arg(
+      "warmup_factor",
+      "(float, default 0) fraction of base_lr at the first iteration of the "
+      "warmup")
+  .Arg(
+      "max_iter",
+      "(int, default 0) iteration at which the cosine policy reaches "
+      "min_ratio")
+  .Arg(
+      "min_ratio",
+      "(float, default 0) fraction of base_lr the cosine policy decays to")
   .Input(0, "input", "description needed")
   .Output(0, "output", "description needed");
 
@@ -9,11 +9,23 @@
 
 namespace caffe2 {
 
+// Writes base_lr * policy(iter[0]) to lr[0], with iter and lr both on the
+// device of Context, so that nothing waits for the host in between.
+template <typename T, class Context>
+void LearningRateOnDevice(
+    const LearningRatePolicy<T>& policy,
+    T base_lr,
+    const int64_t* iter,
+    T* lr,
+    Context* /*context*/) {
+  lr[0] = base_lr * policy(iter[0]);
+}
+
 template <typename T, class Context>
 class LearningRateOp final : public Operator<Context> {
  public:
   LearningRateOp(const OperatorDef& operator_def, Workspace* ws)
-      : Operator<Context>(operator_def, ws), functor_(nullptr),
+      : Operator<Context>(operator_def, ws),
         base_lr_(
             OperatorBase::template GetSingleArgument<float>(
                 "base_lr", FLT_MAX)) {
@@ -21,24 +33,46 @@ class LearningRateOp final : public Operator<Context> {
     const string policy = OperatorBase::GetSingleArgument<string>("policy", "");
     CAFFE_ENFORCE(policy.size(), "Must specify a learning rate policy.");
     if (policy == "fixed") {
-      functor_.reset(new FixedLearningRate<T>());
+      policy_.kind = LearningRatePolicy<T>::FIXED;
     } else if (policy == "step") {
-      int stepsize =
+      policy_.kind = LearningRatePolicy<T>::STEP;
+      policy_.stepsize =
           OperatorBase::template GetSingleArgument<int>("stepsize", 0);
-      T gamma = OperatorBase::template GetSingleArgument<float>("gamma", 0);
-      DCHECK_GT(stepsize, 0);
-      DCHECK_GT(gamma, 0);
-      functor_.reset(new StepLearningRate<T>(stepsize, gamma));
+      policy_.gamma =
+          OperatorBase::template GetSingleArgument<float>("gamma", 0);
+      DCHECK_GT(policy_.stepsize, 0);
+      DCHECK_GT(policy_.gamma, 0);
     } else if (policy == "exp") {
-      T gamma = OperatorBase::template GetSingleArgument<float>("gamma", 0);
-      DCHECK_GT(gamma, 0);
-      functor_.reset(new ExpLearningRate<T>(gamma));
+      policy_.kind = LearningRatePolicy<T>::EXP;
+      policy_.gamma =
+          OperatorBase::template GetSingleArgument<float>("gamma", 0);
+      DCHECK_GT(policy_.gamma, 0);
     } else if (policy == "inv") {
-      T gamma = OperatorBase::template GetSingleArgument<float>("gamma", 0);
-      T power = OperatorBase::template GetSingleArgument<float>("power", 0);
-      DCHECK_GT(gamma, 0);
-      DCHECK_GT(power, 0);
-      functor_.reset(new InvLearningRate<T>(gamma, power));
+      policy_.kind = LearningRatePolicy<T>::INV;
+      policy_.gamma =
+          OperatorBase::template GetSingleArgument<float>("gamma", 0);
+      policy_.power =
+          OperatorBase::template GetSingleArgument<float>("power", 0);
+      DCHECK_GT(policy_.gamma, 0);
+      DCHECK_GT(policy_.power, 0);
+    } else if (policy == "warmup" || policy == "cosine") {
+      policy_.kind = policy == "warmup" ? LearningRatePolicy<T>::WARMUP
+                                        : LearningRatePolicy<T>::COSINE;
+      policy_.warmup_iters =
+          OperatorBase::template GetSingleArgument<int>("warmup_iters", 0);
+      policy_.warmup_factor =
+          OperatorBase::template GetSingleArgument<float>("warmup_factor", 0);
+      CAFFE_ENFORCE_GE(policy_.warmup_iters, 0);
+      if (policy_.kind == LearningRatePolicy<T>::COSINE) {
+        policy_.max_iter =
+            OperatorBase::template GetSingleArgument<int>("max_iter", 0);
+        policy_.min_ratio =
+            OperatorBase::template GetSingleArgument<float>("min_ratio", 0);
+        CAFFE_ENFORCE_GT(
+            policy_.max_iter,
+            policy_.warmup_iters,
+            "The cosine policy needs max_iter > warmup_iters.");
+      }
     } else {
       LOG(FATAL) << "Unknown learning rate policy: " << policy;
     }
@@ -46,21 +80,29 @@ class LearningRateOp final : public Operator<Context> {
   USE_OPERATOR_CONTEXT_FUNCTIONS;
 
   bool RunOnDevice() override {
-    int64_t iter =
-        OperatorBase::Input<TensorCPU>(0).template data<int64_t>()[0];
-    T learning_rate = base_lr_ * (*functor_)(iter);
-    // Write to output.
     auto* output = Output(0);
     output->Resize(vector<TIndex>());
-    context_.template Copy<T, CPUContext, Context>(
-        1, &learning_rate, Output(0)->template mutable_data<T>());
+    if (OperatorBase::InputIsType<TensorCPU>(0)) {
+      int64_t iter =
+          OperatorBase::Input<TensorCPU>(0).template data<int64_t>()[0];
+      T learning_rate = base_lr_ * policy_(iter);
+      context_.template Copy<T, CPUContext, Context>(
+          1, &learning_rate, output->template mutable_data<T>());
+    } else {
+      // The iter counter is on the device: evaluate the policy there.
+      LearningRateOnDevice<T, Context>(
+          policy_,
+          base_lr_,
+          Input(0).template data<int64_t>(),
+          output->template mutable_data<T>(),
+          &context_);
+    }
     return true;
   }
 
  private:
-  unique_ptr<LearningRateFunctor<T> > functor_;
+  LearningRatePolicy<T> policy_;
   T base_lr_;
-
 };
 
 }  // namespace caffe2
@@ -0,0 +1,31 @@
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/sgd/learning_rate_op.h"
+
+namespace caffe2 {
+
+namespace {
+template <typename T>
+__global__ void LearningRateKernel(
+    const LearningRatePolicy<T> policy,
+    const T base_lr,
+    const int64_t* iter,
+    T* lr) {
+  lr[0] = base_lr * policy(iter[0]);
+}
+} // namespace
+
+template <>
+void LearningRateOnDevice<float, CUDAContext>(
+    const LearningRatePolicy<float>& policy,
+    float base_lr,
+    const int64_t* iter,
+    float* lr,
+    CUDAContext* context) {
+  LearningRateKernel<float><<<1, 1, 0, context->cuda_stream()>>>(
+      policy, base_lr, iter, lr);
+}
+
+namespace {
+REGISTER_CUDA_OPERATOR(LearningRate, LearningRateOp<float, CUDAContext>);
+}  // namespace
+}  // namespace caffe2
@@ -0,0 +1,117 @@
+#include "loss_scale_op.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace caffe2 {
+
+template <>
+void check_overflow<float, CPUContext>(
+    int N,
+    const float* x,
+    float* found_inf,
+    CPUContext* /*context*/) {
+  for (int i = 0; i < N; ++i) {
+    if (!std::isfinite(x[i])) {
+      *found_inf = 1;
+      return;
+    }
+  }
+}
+
+template <>
+void check_overflow<float16, CPUContext>(
+    int N,
+    const float16* x,
+    float* found_inf,
+    CPUContext* /*context*/) {
+  // Infs and NaNs are the halves with all the exponent bits set.
+  for (int i = 0; i < N; ++i) {
+    if ((x[i].x & 0x7c00) == 0x7c00) {
+      *found_inf = 1;
+      return;
+    }
+  }
+}
+
+template <>
+void update_loss_scale<CPUContext>(
+    const float* loss_scale,
+    const float* found_inf,
+    const int* good_steps,
+    float* new_loss_scale,
+    int* new_good_steps,
+    float growth_factor,
+    float backoff_factor,
+    int growth_interval,
+    float min_loss_scale,
+    CPUContext* /*context*/) {
+  if (*found_inf != 0) {
+    *new_loss_scale = std::max(*loss_scale * backoff_factor, min_loss_scale);
+    *new_good_steps = 0;
+  } else if (*good_steps + 1 >= growth_interval) {
+    *new_loss_scale = *loss_scale * growth_factor;
+    *new_good_steps = 0;
+  } else {
+    *new_loss_scale = *loss_scale;
+    *new_good_steps = *good_steps + 1;
+  }
+}
+
+namespace {
+REGISTER_CPU_OPERATOR(CheckOverflow, CheckOverflowOp<CPUContext>);
+OPERATOR_SCHEMA(CheckOverflow)
+    .NumInputs(1, INT_MAX)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+
+Checks float or float16 tensors, typically the gradients of a step trained
+with a scaled loss, for infs and NaNs. The output is a float tensor of size 1,
+on the same device as the inputs, which is 1 if any element is not finite and
+0 otherwise. It is meant to feed UpdateLossScale and the found_inf input of
+the mixed precision optimizers, so that the step can be skipped without
+copying the flag to the host.
+
+)DOC")
+    .Input(0, "X", "Tensors to check; any number of them")
+    .Output(0, "found_inf", "1 if any element is an inf or a NaN, else 0");
+SHOULD_NOT_DO_GRADIENT(CheckOverflow);
+
+REGISTER_CPU_OPERATOR(UpdateLossScale, UpdateLossScaleOp<CPUContext>);
+OPERATOR_SCHEMA(UpdateLossScale)
+    .NumInputs(3)
+    .NumOutputs(2)
+    .AllowInplace({{0, 0}, {2, 1}})
+    .SetDoc(R"DOC(
+
+Dynamic loss scaling for mixed precision training. The loss is multiplied by
+loss_scale before the backward pass so that small float16 gradients do not
+flush to zero, and the gradients are divided by it again in the optimizer.
+Given inputs (loss_scale, found_inf, good_steps), computes:
+
+    if found_inf:
+        loss_scale = max(loss_scale * backoff_factor, min_loss_scale)
+        good_steps = 0
+    elif good_steps + 1 >= growth_interval:
+        loss_scale = loss_scale * growth_factor
+        good_steps = 0
+    else:
+        good_steps = good_steps + 1
+
+and returns (loss_scale, good_steps). Everything stays on the device of the
+operator.
+
+)DOC")
+    .Input(0, "loss_scale", "Current loss scale, float tensor of size 1")
+    .Input(1, "found_inf", "Output of CheckOverflow for this step")
+    .Input(2, "good_steps", "Steps since the last change, int tensor of size 1")
+    .Output(0, "output_loss_scale", "Updated loss scale")
+    .Output(1, "output_good_steps", "Updated step counter")
+    .Arg("growth_factor", "Default 2")
+    .Arg("backoff_factor", "Default 0.5")
+    .Arg("growth_interval", "Overflow free steps before growing, default 2000")
+    .Arg("min_loss_scale", "Default 1");
+SHOULD_NOT_DO_GRADIENT(UpdateLossScale);
+}
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+
+// Sets *found_inf to 1 if any of the N elements of x is an inf or a NaN, and
+// leaves it alone otherwise.
+template <typename T, class Context>
+void check_overflow(int N, const T* x, float* found_inf, Context* context);
+
+template <class Context>
+void update_loss_scale(
+    const float* loss_scale,
+    const float* found_inf,
+    const int* good_steps,
+    float* new_loss_scale,
+    int* new_good_steps,
+    float growth_factor,
+    float backoff_factor,
+    int growth_interval,
+    float min_loss_scale,
+    Context* context);
+
+template <class Context>
+class CheckOverflowOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(CheckOverflowOp);
+
+  bool RunOnDevice() override {
+    auto* found_inf = Output(0);
+    found_inf->Resize(1);
+    float* found_inf_data = found_inf->template mutable_data<float>();
+    math::Set<float, Context>(1, 0, found_inf_data, &context_);
+    for (int i = 0; i < InputSize(); ++i) {
+      const auto& X = Input(i);
+      if (X.template IsType<float>()) {
+        check_overflow<float, Context>(
+            X.size(), X.template data<float>(), found_inf_data, &context_);
+      } else if (X.template IsType<float16>()) {
+        check_overflow<float16, Context>(
+            X.size(), X.template data<float16>(), found_inf_data, &context_);
+      } else {
+        CAFFE_THROW(
+            "CheckOverflow only takes float and float16 tensors, input ",
+            i,
+            " is ",
+            X.meta().name());
+      }
+    }
+    return true;
+  }
+};
+
+// The loss scale, the overflow flag and the step counter all stay on the
+// device, so that a training step does not have to wait for the GPU to decide
+// whether its update is applied.
+template <class Context>
+class UpdateLossScaleOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  UpdateLossScaleOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        growth_factor_(
+            OperatorBase::GetSingleArgument<float>("growth_factor", 2)),
+        backoff_factor_(
+            OperatorBase::GetSingleArgument<float>("backoff_factor", 0.5)),
+        growth_interval_(
+            OperatorBase::GetSingleArgument<int>("growth_interval", 2000)),
+        min_loss_scale_(
+            OperatorBase::GetSingleArgument<float>("min_loss_scale", 1)) {
+    CAFFE_ENFORCE_GE(growth_factor_, 1);
+    CAFFE_ENFORCE(backoff_factor_ > 0 && backoff_factor_ <= 1);
+    CAFFE_ENFORCE_GT(growth_interval_, 0);
+  }
+
+  bool RunOnDevice() override {
+    CAFFE_ENFORCE_EQ(Input(LOSS_SCALE).size(), 1);
+    CAFFE_ENFORCE_EQ(Input(FOUND_INF).size(), 1);
+    CAFFE_ENFORCE_EQ(Input(GOOD_STEPS).size(), 1);
+    Output(OUTPUT_LOSS_SCALE)->Resize(1);
+    Output(OUTPUT_GOOD_STEPS)->Resize(1);
+    update_loss_scale<Context>(
+        Input(LOSS_SCALE).template data<float>(),
+        Input(FOUND_INF).template data<float>(),
+        Input(GOOD_STEPS).template data<int>(),
+        Output(OUTPUT_LOSS_SCALE)->template mutable_data<float>(),
+        Output(OUTPUT_GOOD_STEPS)->template mutable_data<int>(),
+        growth_factor_,
+        backoff_factor_,
+        growth_interval_,
+        min_loss_scale_,
+        &context_);
+    return true;
+  }
+
+ protected:
+  float growth_factor_;
+  float backoff_factor_;
+  int growth_interval_;
+  float min_loss_scale_;
+  INPUT_TAGS(LOSS_SCALE, FOUND_INF, GOOD_STEPS);
+  OUTPUT_TAGS(OUTPUT_LOSS_SCALE, OUTPUT_GOOD_STEPS);
+};
+}
@@ -0,0 +1,102 @@
+#include "loss_scale_op.h"
+#include "caffe2/core/common_gpu.h"
+#include "caffe2/core/context_gpu.h"
+
+namespace caffe2 {
+
+__global__ void CheckOverflowKernel(int N, const float* x, float* found_inf) {
+  CUDA_1D_KERNEL_LOOP(i, N) {
+    if (!isfinite(x[i])) {
+      *found_inf = 1;
+    }
+  }
+}
+
+__global__ void
+CheckOverflowHalfKernel(int N, const uint16_t* x, float* found_inf) {
+  CUDA_1D_KERNEL_LOOP(i, N) {
+    if ((x[i] & 0x7c00) == 0x7c00) {
+      *found_inf = 1;
+    }
+  }
+}
+
+__global__ void UpdateLossScaleKernel(
+    const float* loss_scale,
+    const float* found_inf,
+    const int* good_steps,
+    float* new_loss_scale,
+    int* new_good_steps,
+    float growth_factor,
+    float backoff_factor,
+    int growth_interval,
+    float min_loss_scale) {
+  if (*found_inf != 0) {
+    *new_loss_scale = fmaxf(*loss_scale * backoff_factor, min_loss_scale);
+    *new_good_steps = 0;
+  } else if (*good_steps + 1 >= growth_interval) {
+    *new_loss_scale = *loss_scale * growth_factor;
+    *new_good_steps = 0;
+  } else {
+    *new_loss_scale = *loss_scale;
+    *new_good_steps = *good_steps + 1;
+  }
+}
+
+template <>
+void check_overflow<float, CUDAContext>(
+    int N,
+    const float* x,
+    float* found_inf,
+    CUDAContext* context) {
+  CheckOverflowKernel<<<
+      CAFFE_GET_BLOCKS(N),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context->cuda_stream()>>>(N, x, found_inf);
+}
+
+template <>
+void check_overflow<float16, CUDAContext>(
+    int N,
+    const float16* x,
+    float* found_inf,
+    CUDAContext* context) {
+  CheckOverflowHalfKernel<<<
+      CAFFE_GET_BLOCKS(N),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context->cuda_stream()>>>(
+      N, reinterpret_cast<const uint16_t*>(x), found_inf);
+}
+
+template <>
+void update_loss_scale<CUDAContext>(
+    const float* loss_scale,
+    const float* found_inf,
+    const int* good_steps,
+    float* new_loss_scale,
+    int* new_good_steps,
+    float growth_factor,
+    float backoff_factor,
+    int growth_interval,
+    float min_loss_scale,
+    CUDAContext* context) {
+  UpdateLossScaleKernel<<<1, 1, 0, context->cuda_stream()>>>(
+      loss_scale,
+      found_inf,
+      good_steps,
+      new_loss_scale,
+      new_good_steps,
+      growth_factor,
+      backoff_factor,
+      growth_interval,
+      min_loss_scale);
+}
+
+namespace {
+REGISTER_CUDA_OPERATOR(CheckOverflow, CheckOverflowOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(UpdateLossScale, UpdateLossScaleOp<CUDAContext>);
+}
+
+}
@@ -0,0 +1,151 @@
+#include "mixed_precision_sgd_op.h"
+
+#include "caffe2/core/blob_serialization.h"
+
+namespace caffe2 {
+
+template <>
+void mixed_precision_momentum_sgd_update<CPUContext>(
+    int N,
+    const float16* g,
+    const float* m,
+    float* nm,
+    const float* lr,
+    float momentum,
+    bool nesterov,
+    const float* param,
+    float* nparam,
+    float16* param_fp16,
+    const float* loss_scale,
+    const float* found_inf,
+    CPUContext* /*context*/) {
+  const bool skip = found_inf && *found_inf != 0;
+  const float LR = lr[0];
+  const float inv_scale = loss_scale ? 1.f / *loss_scale : 1.f;
+  for (int i = 0; i < N; ++i) {
+    if (skip) {
+      nm[i] = m[i];
+      nparam[i] = param[i];
+    } else {
+      const float gi = detail::HalfBitsToFloat(g[i].x) * inv_scale;
+      const float mi = m[i];
+      const float mi_new = momentum * mi + LR * gi;
+      nm[i] = mi_new;
+      nparam[i] = param[i] -
+          (nesterov ? (1 + momentum) * mi_new - momentum * mi : mi_new);
+    }
+    param_fp16[i].x = detail::FloatToHalfBits(nparam[i]);
+  }
+}
+
+template <>
+void mixed_precision_adam_update<CPUContext>(
+    int N,
+    const float* w,
+    const float16* g,
+    const float* m,
+    const float* v,
+    float* nw,
+    float* nm,
+    float* nv,
+    float16* nw_fp16,
+    float beta1,
+    float beta2,
+    float eps_hat,
+    float correction,
+    const float* lr,
+    const float* loss_scale,
+    const float* found_inf,
+    CPUContext* /*context*/) {
+  const bool skip = found_inf && *found_inf != 0;
+  const float inv_scale = loss_scale ? 1.f / *loss_scale : 1.f;
+  for (int i = 0; i < N; ++i) {
+    if (skip) {
+      nm[i] = m[i];
+      nv[i] = v[i];
+      nw[i] = w[i];
+    } else {
+      const float gi = detail::HalfBitsToFloat(g[i].x) * inv_scale;
+      const float mi = nm[i] = m[i] * beta1 + gi * (1 - beta1);
+      const float vi = nv[i] = v[i] * beta2 + gi * gi * (1 - beta2);
+      nw[i] = w[i] + lr[0] * correction * mi / (std::sqrt(vi) + eps_hat);
+    }
+    nw_fp16[i].x = detail::FloatToHalfBits(nw[i]);
+  }
+}
+
+namespace {
+REGISTER_CPU_OPERATOR(
+    MixedPrecisionMomentumSGDUpdate,
+    MixedPrecisionMomentumSGDUpdateOp<CPUContext>);
+OPERATOR_SCHEMA(MixedPrecisionMomentumSGDUpdate)
+    .NumInputs({4, 6})
+    .NumOutputs(3)
+    .AllowInplace({{1, 0}, {3, 1}})
+    .SetDoc(R"DOC(
+
+MomentumSGDUpdate for mixed precision training, where the net computes with
+float16 parameters and gradients while the optimizer keeps float master
+weights. Given inputs (grad, m, lr, param) and optionally (loss_scale,
+found_inf), with grad in float16 and everything else in float, computes:
+
+    grad = grad / loss_scale
+    m_new = momentum * m + lr * grad
+    if not nesterov:
+        param = param - m_new
+    else:
+        param = param - ((1 + momentum) * m_new - momentum * m)
+    param_fp16 = float16(param)
+
+and returns (m_new, param, param_fp16). If found_inf, as produced by
+CheckOverflow, is nonzero the update is skipped and m and param are returned
+unchanged.
+
+)DOC")
+    .Input(0, "grad", "float16 gradient, computed with the scaled loss")
+    .Input(1, "moment", "Momentum history")
+    .Input(2, "lr", "Learning rate")
+    .Input(3, "param", "float master weights")
+    .Input(4, "loss_scale", "Loss scale the gradient was computed with")
+    .Input(5, "found_inf", "Nonzero to skip the update")
+    .Output(0, "output_moment", "Updated momentum")
+    .Output(1, "output_param", "Updated master weights")
+    .Output(2, "output_param_fp16", "float16 copy of the master weights")
+    .Arg("momentum", "Default 0")
+    .Arg("nesterov", "Default 0");
+SHOULD_NOT_DO_GRADIENT(MixedPrecisionMomentumSGDUpdate);
+
+REGISTER_CPU_OPERATOR(MixedPrecisionAdam, MixedPrecisionAdamOp<CPUContext>);
+OPERATOR_SCHEMA(MixedPrecisionAdam)
+    .NumInputs({6, 8})
+    .NumOutputs(4)
+    .AllowInplace({{0, 0}, {1, 1}, {2, 2}})
+    .SetDoc(R"DOC(
+
+Adam for mixed precision training. Takes (param, m1, m2, grad, lr, iter) and
+optionally (loss_scale, found_inf), where grad is float16 and param, m1 and
+m2 are float, and computes the same update as Adam on grad / loss_scale. It
+returns (param_o, m1_o, m2_o, param_fp16), where param_fp16 is the float16
+copy of param_o that the net runs with. If found_inf is nonzero the update is
+skipped.
+
+)DOC")
+    .Input(0, "param", "float master weights")
+    .Input(1, "moment_1", "First moment history")
+    .Input(2, "moment_2", "Second moment history")
+    .Input(3, "grad", "float16 gradient, computed with the scaled loss")
+    .Input(4, "lr", "learning rate")
+    .Input(5, "iter", "iteration number")
+    .Input(6, "loss_scale", "Loss scale the gradient was computed with")
+    .Input(7, "found_inf", "Nonzero to skip the update")
+    .Output(0, "output_param", "Updated master weights")
+    .Output(1, "output_moment_1", "Updated first moment")
+    .Output(2, "output_moment_2", "Updated second moment")
+    .Output(3, "output_param_fp16", "float16 copy of the master weights")
+    .Arg("beta1", "Default 0.9")
+    .Arg("beta2", "Default 0.999")
+    .Arg("epsilon", "Default 1e-5");
+SHOULD_NOT_DO_GRADIENT(MixedPrecisionAdam);
+}
+
+}
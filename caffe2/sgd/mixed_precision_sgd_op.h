@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cmath>
+
+#include "caffe2/core/operator.h"
+
+namespace caffe2 {
+
+// Mixed precision training runs the forward and backward passes on float16
+// copies of the parameters, while the optimizer keeps float master weights
+// and state. The updates below read float16 gradients, unscale them by
+// 1 / loss_scale, update the float master weights and write their float16
+// copy for the next step. When found_inf is set the step is skipped: state
+// and master weights are left as they were. loss_scale and found_inf are
+// device pointers and may both be null.
+
+template <class Context>
+void mixed_precision_momentum_sgd_update(
+    int N,
+    const float16* g,
+    const float* m,
+    float* nm,
+    const float* lr,
+    float momentum,
+    bool nesterov,
+    const float* param,
+    float* nparam,
+    float16* param_fp16,
+    const float* loss_scale,
+    const float* found_inf,
+    Context* context);
+
+template <class Context>
+void mixed_precision_adam_update(
+    int N,
+    const float* w,
+    const float16* g,
+    const float* m,
+    const float* v,
+    float* nw,
+    float* nm,
+    float* nv,
+    float16* nw_fp16,
+    float beta1,
+    float beta2,
+    float eps_hat,
+    float correction,
+    const float* lr,
+    const float* loss_scale,
+    const float* found_inf,
+    Context* context);
+
+template <class Context>
+class MixedPrecisionMomentumSGDUpdateOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  MixedPrecisionMomentumSGDUpdateOp(
+      const OperatorDef& operator_def,
+      Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        momentum_(OperatorBase::GetSingleArgument<float>("momentum", 0.0)),
+        nesterov_(OperatorBase::GetSingleArgument<int>("nesterov", 0)) {}
+
+  bool RunOnDevice() override {
+    CAFFE_ENFORCE(Input(LR).size() == 1);
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(MOMENTUM).size());
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(PARAM).size());
+    Output(OUTPUT_MOMENTUM)->ResizeLike(Input(MOMENTUM));
+    Output(OUTPUT_PARAM)->ResizeLike(Input(PARAM));
+    Output(OUTPUT_PARAM_FP16)->ResizeLike(Input(PARAM));
+
+    mixed_precision_momentum_sgd_update<Context>(
+        Input(GRAD).size(),
+        Input(GRAD).template data<float16>(),
+        Input(MOMENTUM).template data<float>(),
+        Output(OUTPUT_MOMENTUM)->template mutable_data<float>(),
+        Input(LR).template data<float>(),
+        momentum_,
+        nesterov_,
+        Input(PARAM).template data<float>(),
+        Output(OUTPUT_PARAM)->template mutable_data<float>(),
+        Output(OUTPUT_PARAM_FP16)->template mutable_data<float16>(),
+        InputSize() > LOSS_SCALE ? Input(LOSS_SCALE).template data<float>()
+                                 : nullptr,
+        InputSize() > FOUND_INF ? Input(FOUND_INF).template data<float>()
+                                : nullptr,
+        &context_);
+    return true;
+  }
+
+ protected:
+  float momentum_;
+  bool nesterov_;
+  INPUT_TAGS(GRAD, MOMENTUM, LR, PARAM, LOSS_SCALE, FOUND_INF);
+  OUTPUT_TAGS(OUTPUT_MOMENTUM, OUTPUT_PARAM, OUTPUT_PARAM_FP16);
+};
+
+template <class Context>
+class MixedPrecisionAdamOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  MixedPrecisionAdamOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        beta1_(OperatorBase::GetSingleArgument<float>("beta1", 0.9)),
+        beta2_(OperatorBase::GetSingleArgument<float>("beta2", 0.999)),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)) {}
+
+  bool RunOnDevice() override {
+    // Iter live on the CPU
+    CAFFE_ENFORCE(OperatorBase::InputIsType<TensorCPU>(ITER));
+    CAFFE_ENFORCE(Input(LR).size() == 1);
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(PARAM).size());
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(MOMENT_1).size());
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(MOMENT_2).size());
+    Output(OUTPUT_PARAM)->ResizeLike(Input(PARAM));
+    Output(OUTPUT_MOMENT_1)->ResizeLike(Input(MOMENT_1));
+    Output(OUTPUT_MOMENT_2)->ResizeLike(Input(MOMENT_2));
+    Output(OUTPUT_PARAM_FP16)->ResizeLike(Input(PARAM));
+
+    const auto iter =
+        OperatorBase::Input<TensorCPU>(ITER).template data<int64_t>()[0];
+    const auto t = iter + 1;
+    const auto correction =
+        std::sqrt(1.f - std::pow(beta2_, t)) / (1.f - std::pow(beta1_, t));
+    mixed_precision_adam_update<Context>(
+        Input(GRAD).size(),
+        Input(PARAM).template data<float>(),
+        Input(GRAD).template data<float16>(),
+        Input(MOMENT_1).template data<float>(),
+        Input(MOMENT_2).template data<float>(),
+        Output(OUTPUT_PARAM)->template mutable_data<float>(),
+        Output(OUTPUT_MOMENT_1)->template mutable_data<float>(),
+        Output(OUTPUT_MOMENT_2)->template mutable_data<float>(),
+        Output(OUTPUT_PARAM_FP16)->template mutable_data<float16>(),
+        beta1_,
+        beta2_,
+        epsilon_,
+        correction,
+        Input(LR).template data<float>(),
+        InputSize() > LOSS_SCALE ? Input(LOSS_SCALE).template data<float>()
+                                 : nullptr,
+        InputSize() > FOUND_INF ? Input(FOUND_INF).template data<float>()
+                                : nullptr,
+        &context_);
+    return true;
+  }
+
+ protected:
+  float beta1_;
+  float beta2_;
+  float epsilon_;
+  INPUT_TAGS(PARAM, MOMENT_1, MOMENT_2, GRAD, LR, ITER, LOSS_SCALE, FOUND_INF);
+  OUTPUT_TAGS(
+      OUTPUT_PARAM,
+      OUTPUT_MOMENT_1,
+      OUTPUT_MOMENT_2,
+      OUTPUT_PARAM_FP16);
+};
+}
@@ -0,0 +1,161 @@
+#include "mixed_precision_sgd_op.h"
+#include "caffe2/core/common_gpu.h"
+#include "caffe2/core/context_gpu.h"
+
+#ifdef CAFFE_HAS_CUDA_FP16
+
+namespace caffe2 {
+
+__global__ void MixedPrecisionMomentumSGDKernel(
+    int N,
+    const half* g,
+    const float* m,
+    float* nm,
+    const float* lr,
+    float momentum,
+    bool nesterov,
+    const float* param,
+    float* nparam,
+    half* param_fp16,
+    const float* loss_scale,
+    const float* found_inf) {
+  const bool skip = found_inf && *found_inf != 0;
+  const float LR = lr[0];
+  const float inv_scale = loss_scale ? 1.f / *loss_scale : 1.f;
+  CUDA_1D_KERNEL_LOOP(i, N) {
+    float pi = param[i];
+    if (skip) {
+      nm[i] = m[i];
+    } else {
+      const float gi = __half2float(g[i]) * inv_scale;
+      const float mi = m[i];
+      const float mi_new = momentum * mi + LR * gi;
+      nm[i] = mi_new;
+      pi -= nesterov ? (1 + momentum) * mi_new - momentum * mi : mi_new;
+    }
+    nparam[i] = pi;
+    param_fp16[i] = __float2half(pi);
+  }
+}
+
+__global__ void MixedPrecisionAdamKernel(
+    int N,
+    const float* w,
+    const half* g,
+    const float* m,
+    const float* v,
+    float* nw,
+    float* nm,
+    float* nv,
+    half* nw_fp16,
+    float beta1,
+    float beta2,
+    float eps_hat,
+    float correction,
+    const float* lr,
+    const float* loss_scale,
+    const float* found_inf) {
+  const bool skip = found_inf && *found_inf != 0;
+  const float inv_scale = loss_scale ? 1.f / *loss_scale : 1.f;
+  CUDA_1D_KERNEL_LOOP(i, N) {
+    float wi = w[i];
+    if (skip) {
+      nm[i] = m[i];
+      nv[i] = v[i];
+    } else {
+      const float gi = __half2float(g[i]) * inv_scale;
+      const float mi = nm[i] = m[i] * beta1 + gi * (1 - beta1);
+      const float vi = nv[i] = v[i] * beta2 + gi * gi * (1 - beta2);
+      wi += lr[0] * correction * mi / (sqrtf(vi) + eps_hat);
+    }
+    nw[i] = wi;
+    nw_fp16[i] = __float2half(wi);
+  }
+}
+
+template <>
+void mixed_precision_momentum_sgd_update<CUDAContext>(
+    int N,
+    const float16* g,
+    const float* m,
+    float* nm,
+    const float* lr,
+    float momentum,
+    bool nesterov,
+    const float* param,
+    float* nparam,
+    float16* param_fp16,
+    const float* loss_scale,
+    const float* found_inf,
+    CUDAContext* context) {
+  MixedPrecisionMomentumSGDKernel<<<
+      CAFFE_GET_BLOCKS(N),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context->cuda_stream()>>>(
+      N,
+      reinterpret_cast<const half*>(g),
+      m,
+      nm,
+      lr,
+      momentum,
+      nesterov,
+      param,
+      nparam,
+      reinterpret_cast<half*>(param_fp16),
+      loss_scale,
+      found_inf);
+}
+
+template <>
+void mixed_precision_adam_update<CUDAContext>(
+    int N,
+    const float* w,
+    const float16* g,
+    const float* m,
+    const float* v,
+    float* nw,
+    float* nm,
+    float* nv,
+    float16* nw_fp16,
+    float beta1,
+    float beta2,
+    float eps_hat,
+    float correction,
+    const float* lr,
+    const float* loss_scale,
+    const float* found_inf,
+    CUDAContext* context) {
+  MixedPrecisionAdamKernel<<<
+      CAFFE_GET_BLOCKS(N),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context->cuda_stream()>>>(
+      N,
+      w,
+      reinterpret_cast<const half*>(g),
+      m,
+      v,
+      nw,
+      nm,
+      nv,
+      reinterpret_cast<half*>(nw_fp16),
+      beta1,
+      beta2,
+      eps_hat,
+      correction,
+      lr,
+      loss_scale,
+      found_inf);
+}
+
+namespace {
+REGISTER_CUDA_OPERATOR(
+    MixedPrecisionMomentumSGDUpdate,
+    MixedPrecisionMomentumSGDUpdateOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(MixedPrecisionAdam, MixedPrecisionAdamOp<CUDAContext>);
+}
+
+}
+
+#endif // CAFFE_HAS_CUDA_FP16
@@ -0,0 +1,44 @@
+#include "model_averaging_op.h"
+
+namespace caffe2 {
+
+namespace {
+REGISTER_CPU_OPERATOR(
+    ModelAveragingUpdate,
+    ModelAveragingUpdateOp<float, CPUContext>);
+OPERATOR_SCHEMA(ModelAveragingUpdate)
+    .NumInputsOutputs([](int in, int out) {
+      return (in == 3 && out == 2) || (in == 4 && out == 3);
+    })
+    .EnforceInplace({{0, 0}, {1, 1}, {3, 2}})
+    .SetDoc(R"DOC(
+
+Applies a round of asynchronous averaging of the replicas of a parameter,
+where sum is the allreduced sum over the replicas of local, as left by the
+previous round, and prepares local for the next allreduce. The allreduce of a
+round overlaps with the training steps until the next one, and its result is
+only applied then, for instance with AllreduceAsync and WaitCollective.
+
+Given inputs (param, local, sum), this is model averaging:
+
+    param = param + sum / num_replicas - local
+    local = param
+
+Given inputs (param, local, sum, center), with center a copy of the center
+variable on every replica, this is elastic averaging (EASGD):
+
+    center = center + alpha * sum
+    local = param - center
+    param = param - alpha * local
+
+Output is (param, local) or (param, local, center), in place.
+)DOC")
+    .Arg(
+        "alpha",
+        "Moving rate of elastic averaging, required with a center. "
+        "alpha * num_replicas should stay below 1.")
+    .Arg("num_replicas", "Number of replicas, for model averaging");
+SHOULD_NOT_DO_GRADIENT(ModelAveragingUpdate);
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+
+// Applies a round of asynchronous averaging of the replicas of a parameter,
+// then prepares the next one, whose sum over the replicas is to be computed
+// from local while the replicas train. Without a center, this is model
+// averaging: param moves by the difference between the average and itself
+// at the start of the round, which keeps its progress since then, and local
+// becomes a snapshot of param. With a center, a copy of the center variable
+// on every replica, this is elastic averaging (EASGD): the center moves by
+// alpha times the sum of the differences of the last round, local becomes the
+// difference between param and the center, and param moves by alpha times
+// this difference towards the center.
+template <typename T, class Context>
+class ModelAveragingUpdateOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  ModelAveragingUpdateOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        alpha_(OperatorBase::GetSingleArgument<float>("alpha", 0)),
+        num_replicas_(
+            OperatorBase::GetSingleArgument<int>("num_replicas", 0)) {}
+
+  bool RunOnDevice() override {
+    const auto& param = Input(PARAM);
+    CAFFE_ENFORCE_EQ(Input(LOCAL).size(), param.size());
+    CAFFE_ENFORCE_EQ(Input(SUM).size(), param.size());
+    const int N = param.size();
+    EigenVectorArrayMap<T> w(
+        Output(OUTPUT_PARAM)->template mutable_data<T>(), N);
+    EigenVectorArrayMap<T> local(
+        Output(OUTPUT_LOCAL)->template mutable_data<T>(), N);
+    ConstEigenVectorArrayMap<T> sum(Input(SUM).template data<T>(), N);
+    if (InputSize() == 3) {
+      CAFFE_ENFORCE_GT(num_replicas_, 0, "num_replicas is required");
+      w += sum / T(num_replicas_) - local;
+      local = w;
+    } else {
+      CAFFE_ENFORCE_GT(alpha_, 0, "alpha is required");
+      CAFFE_ENFORCE_EQ(Input(CENTER).size(), param.size());
+      EigenVectorArrayMap<T> center(
+          Output(OUTPUT_CENTER)->template mutable_data<T>(), N);
+      center += T(alpha_) * sum;
+      local = w - center;
+      w -= T(alpha_) * local;
+    }
+    return true;
+  }
+
+ protected:
+  float alpha_;
+  int num_replicas_;
+  INPUT_TAGS(PARAM, LOCAL, SUM, CENTER);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_LOCAL, OUTPUT_CENTER);
+};
+
+} // namespace caffe2
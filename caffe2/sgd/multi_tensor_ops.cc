@@ -0,0 +1,105 @@
+#include "multi_tensor_ops.h"
+
+namespace caffe2 {
+
+namespace {
+REGISTER_CPU_OPERATOR(MultiAdagrad, MultiAdagradOp<CPUContext>);
+OPERATOR_SCHEMA(MultiAdagrad)
+    .NumInputs([](int n) { return n >= 4 && (n - 1) % 3 == 0; })
+    .NumInputsOutputs([](int in, int out) { return in - 1 == out / 2 * 3; })
+    .EnforceInplace([](int in, int out) {
+      return in % 3 < 2 && out == in / 3 * 2 + in % 3;
+    })
+    .SetDoc(R"DOC(
+
+Runs Adagrad on a list of parameters in one operator. The inputs are
+(param, moment, grad) for each parameter, followed by lr, and the outputs,
+which must be the inputs, are (param, moment) for each parameter. The
+update is the one of Adagrad, but all the parameters are updated in a
+single parallel loop, or a single CUDA kernel, instead of an operator each.
+
+)DOC")
+    .Arg("epsilon", "Default 1e-5")
+    .Arg(
+        "clip_norm",
+        "(float, default 0) If positive, the gradients are scaled by "
+        "min(1, clip_norm / norm), with norm the global L2 norm of all of "
+        "them, within the update.");
+SHOULD_NOT_DO_GRADIENT(MultiAdagrad);
+
+REGISTER_CPU_OPERATOR(MultiAdam, MultiAdamOp<CPUContext>);
+OPERATOR_SCHEMA(MultiAdam)
+    .NumInputs([](int n) { return n >= 6 && (n - 2) % 4 == 0; })
+    .NumInputsOutputs([](int in, int out) { return in - 2 == out / 3 * 4; })
+    .EnforceInplace([](int in, int out) {
+      return in % 4 < 3 && out == in / 4 * 3 + in % 4;
+    })
+    .SetDoc(R"DOC(
+
+Runs Adam on a list of parameters in one operator. The inputs are
+(param, moment_1, moment_2, grad) for each parameter, followed by lr and
+iter, and the outputs, which must be the inputs, are
+(param, moment_1, moment_2) for each parameter. The update is the one of
+Adam, in a single parallel loop, or a single CUDA kernel.
+
+)DOC")
+    .Arg("beta1", "Default 0.9")
+    .Arg("beta2", "Default 0.999")
+    .Arg("epsilon", "Default 1e-5")
+    .Arg(
+        "clip_norm",
+        "(float, default 0) If positive, the gradients are scaled by "
+        "min(1, clip_norm / norm), with norm the global L2 norm of all of "
+        "them, within the update.");
+SHOULD_NOT_DO_GRADIENT(MultiAdam);
+
+REGISTER_CPU_OPERATOR(
+    MultiMomentumSGDUpdate,
+    MultiMomentumSGDUpdateOp<CPUContext>);
+OPERATOR_SCHEMA(MultiMomentumSGDUpdate)
+    .NumInputs([](int n) { return n >= 4 && (n - 1) % 3 == 0; })
+    .NumInputsOutputs([](int in, int out) { return in - 1 == out; })
+    .EnforceInplace([](int in, int out) { return in == out; })
+    .SetDoc(R"DOC(
+
+Runs MomentumSGDUpdate on a list of parameters in one operator. The inputs
+are (grad, momentum, param) for each parameter, followed by lr, and the
+outputs, which must be the inputs, are (grad, momentum, param) for each
+parameter. The update is the one of MomentumSGDUpdate, in a single
+parallel loop, or a single CUDA kernel.
+
+)DOC")
+    .Arg("momentum", "Default 0.0")
+    .Arg("nesterov", "Default 0")
+    .Arg(
+        "clip_norm",
+        "(float, default 0) If positive, the gradients are scaled by "
+        "min(1, clip_norm / norm), with norm the global L2 norm of all of "
+        "them, within the update.");
+SHOULD_NOT_DO_GRADIENT(MultiMomentumSGDUpdate);
+
+REGISTER_CPU_OPERATOR(MultiRmsProp, MultiRmsPropOp<CPUContext>);
+OPERATOR_SCHEMA(MultiRmsProp)
+    .NumInputs([](int n) { return n >= 4 && (n - 1) % 3 == 0; })
+    .NumInputsOutputs([](int in, int out) { return in - 1 == out; })
+    .EnforceInplace([](int in, int out) { return in == out; })
+    .SetDoc(R"DOC(
+
+Runs RmsProp on a list of parameters in one operator. The inputs are
+(grad, mean_squares, momentum) for each parameter, followed by lr, and the
+outputs, which must be the inputs, are (grad, mean_squares, momentum) for
+each parameter. As with RmsProp, grad is replaced by the update, which is
+to be added to the parameter.
+
+)DOC")
+    .Arg("decay", "Default 0.9")
+    .Arg("momentum", "Default 0.0")
+    .Arg("epsilon", "Default 1e-5")
+    .Arg(
+        "clip_norm",
+        "(float, default 0) If positive, the gradients are scaled by "
+        "min(1, clip_norm / norm), with norm the global L2 norm of all of "
+        "them, within the update.");
+SHOULD_NOT_DO_GRADIENT(MultiRmsProp);
+}
+}
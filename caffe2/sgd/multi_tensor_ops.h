@@ -0,0 +1,455 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+
+#include "caffe2/core/common_omp.h"
+#include "caffe2/core/operator.h"
+
+namespace caffe2 {
+
+// The fused optimizer operators update a list of parameters in one go: the
+// tensors are cut in chunks of at most kMultiTensorChunkSize elements, and a
+// single loop, or a single CUDA kernel with one block per chunk, runs over
+// the chunks of all the tensors.
+constexpr int kMultiTensorChunkSize = 1 << 16;
+
+// A chunk of the Inputs read-only and Outputs updated tensors of a
+// parameter, all with size elements from the start of the chunk.
+template <int Inputs, int Outputs>
+struct TensorListChunk {
+  const float* in[Inputs > 0 ? Inputs : 1];
+  float* out[Outputs > 0 ? Outputs : 1];
+  int size;
+};
+
+template <int Inputs, int Outputs, class Context>
+class TensorListChunks {
+ public:
+  using Chunk = TensorListChunk<Inputs, Outputs>;
+
+  void Clear() {
+    chunks_.clear();
+  }
+
+  void Add(
+      const std::array<const float*, Inputs>& in,
+      const std::array<float*, Outputs>& out,
+      TIndex size) {
+    for (TIndex offset = 0; offset < size; offset += kMultiTensorChunkSize) {
+      Chunk chunk;
+      for (int i = 0; i < Inputs; ++i) {
+        chunk.in[i] = in[i] + offset;
+      }
+      for (int i = 0; i < Outputs; ++i) {
+        chunk.out[i] = out[i] + offset;
+      }
+      chunk.size = std::min<TIndex>(kMultiTensorChunkSize, size - offset);
+      chunks_.push_back(chunk);
+    }
+  }
+
+  int size() const {
+    return chunks_.size();
+  }
+
+  const Chunk* data() const {
+    return chunks_.data();
+  }
+
+  // Copies the chunks to the memory of Context, for the kernels to read
+  // them. The copy is kept until the next call.
+  const Chunk* CopyTo(Context* context) {
+    const size_t nbytes = chunks_.size() * sizeof(Chunk);
+    buffer_.Resize(nbytes);
+    auto* data = buffer_.template mutable_data<char>();
+    context->template CopyBytes<CPUContext, Context>(
+        nbytes, chunks_.data(), data);
+    return reinterpret_cast<const Chunk*>(data);
+  }
+
+ private:
+  std::vector<Chunk> chunks_;
+  Tensor<Context> buffer_;
+};
+
+// Returns, in buffer, the factor by which the gradients are scaled for their
+// global L2 norm to be at most clip_norm: min(1, clip_norm / norm). The CUDA
+// specialization reduces the norm in one kernel over all the chunks, and
+// leaves the factor on the device, for the update kernels to read it.
+template <class Context>
+const float* multi_tensor_clip_scale(
+    TensorListChunks<1, 0, Context>* grads,
+    float clip_norm,
+    Tensor<Context>* buffer,
+    Context* context) {
+  const auto* list = grads->data();
+  double sum_squares = 0;
+#pragma omp parallel for reduction(+ : sum_squares)
+  for (int c = 0; c < grads->size(); ++c) {
+    const auto& chunk = list[c];
+    float chunk_squares = 0;
+    for (int i = 0; i < chunk.size; ++i) {
+      chunk_squares += chunk.in[0][i] * chunk.in[0][i];
+    }
+    sum_squares += chunk_squares;
+  }
+  const float norm = std::sqrt(sum_squares);
+  buffer->Resize(1);
+  float* scale = buffer->template mutable_data<float>();
+  scale[0] = norm > clip_norm ? clip_norm / norm : 1.f;
+  return scale;
+}
+
+// The gradients of the parameters of a fused operator, when the operator
+// clips them by their global norm, with the clip_norm argument.
+template <class Context>
+class GlobalNormClip {
+ public:
+  explicit GlobalNormClip(float clip_norm) : clip_norm_(clip_norm) {}
+
+  void Clear() {
+    grads_.Clear();
+  }
+
+  void Add(const float* grad, TIndex size) {
+    if (clip_norm_ > 0) {
+      grads_.Add({grad}, {}, size);
+    }
+  }
+
+  // Returns the factor of the gradients, in the memory of Context, or
+  // nullptr when they are not clipped.
+  const float* Scale(Context* context) {
+    if (clip_norm_ <= 0) {
+      return nullptr;
+    }
+    return multi_tensor_clip_scale(&grads_, clip_norm_, &buffer_, context);
+  }
+
+ private:
+  const float clip_norm_;
+  TensorListChunks<1, 0, Context> grads_;
+  Tensor<Context> buffer_;
+};
+
+// The in place updates of the tensor lists, which the CUDA specializations
+// run in one kernel. The inputs and outputs of each chunk are those of the
+// single parameter operators. If scale is not null, the gradients are first
+// multiplied by scale[0], in the same pass.
+
+// in: grad; out: param, moment.
+template <typename Context>
+void multi_adagrad_update(
+    TensorListChunks<1, 2, Context>* chunks,
+    float epsilon,
+    const float* lr,
+    const float* scale,
+    Context* context) {
+  const float s = scale ? scale[0] : 1.f;
+  const auto* list = chunks->data();
+#pragma omp parallel for
+  for (int c = 0; c < chunks->size(); ++c) {
+    const auto& chunk = list[c];
+    const float* g = chunk.in[0];
+    float* w = chunk.out[0];
+    float* h = chunk.out[1];
+    for (int i = 0; i < chunk.size; ++i) {
+      const float gi = g[i] * s;
+      const float hi = h[i] = h[i] + gi * gi;
+      w[i] += lr[0] * gi / (std::sqrt(hi) + epsilon);
+    }
+  }
+}
+
+// in: grad; out: param, moment_1, moment_2.
+template <typename Context>
+void multi_adam_update(
+    TensorListChunks<1, 3, Context>* chunks,
+    float beta1,
+    float beta2,
+    float eps_hat,
+    float correction,
+    const float* lr,
+    const float* scale,
+    Context* context) {
+  const float s = scale ? scale[0] : 1.f;
+  const auto* list = chunks->data();
+#pragma omp parallel for
+  for (int c = 0; c < chunks->size(); ++c) {
+    const auto& chunk = list[c];
+    const float* g = chunk.in[0];
+    float* w = chunk.out[0];
+    float* m = chunk.out[1];
+    float* v = chunk.out[2];
+    for (int i = 0; i < chunk.size; ++i) {
+      const float gi = g[i] * s;
+      const float mi = m[i] = m[i] * beta1 + gi * (1 - beta1);
+      const float vi = v[i] = v[i] * beta2 + gi * gi * (1 - beta2);
+      w[i] += lr[0] * correction * mi / (std::sqrt(vi) + eps_hat);
+    }
+  }
+}
+
+// out: grad, momentum, param.
+template <typename Context>
+void multi_momentum_sgd_update(
+    TensorListChunks<0, 3, Context>* chunks,
+    float momentum,
+    bool nesterov,
+    const float* lr,
+    const float* scale,
+    Context* context) {
+  const float s = scale ? scale[0] : 1.f;
+  const auto* list = chunks->data();
+#pragma omp parallel for
+  for (int c = 0; c < chunks->size(); ++c) {
+    const auto& chunk = list[c];
+    float* g = chunk.out[0];
+    float* m = chunk.out[1];
+    float* w = chunk.out[2];
+    for (int i = 0; i < chunk.size; ++i) {
+      const float gi = g[i] * s;
+      if (!nesterov) {
+        m[i] = g[i] = lr[0] * gi + momentum * m[i];
+      } else {
+        const float mi = m[i];
+        const float mi_new = m[i] = momentum * mi + lr[0] * gi;
+        g[i] = (1 + momentum) * mi_new - momentum * mi;
+      }
+      w[i] -= g[i];
+    }
+  }
+}
+
+// out: grad, mean_squares, momentum.
+template <typename Context>
+void multi_rmsprop_update(
+    TensorListChunks<0, 3, Context>* chunks,
+    float decay,
+    float momentum,
+    float epsilon,
+    const float* lr,
+    const float* scale,
+    Context* context) {
+  const float s = scale ? scale[0] : 1.f;
+  const auto* list = chunks->data();
+#pragma omp parallel for
+  for (int c = 0; c < chunks->size(); ++c) {
+    const auto& chunk = list[c];
+    float* g = chunk.out[0];
+    float* ms = chunk.out[1];
+    float* mom = chunk.out[2];
+    for (int i = 0; i < chunk.size; ++i) {
+      const float gi = g[i] * s;
+      ms[i] += (1.0f - decay) * (gi * gi - ms[i]);
+      mom[i] = mom[i] * momentum + lr[0] * gi / std::sqrt(epsilon + ms[i]);
+      g[i] = mom[i];
+    }
+  }
+}
+
+// Inputs: (param, moment, grad) for each parameter, then lr.
+template <class Context>
+class MultiAdagradOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  MultiAdagradOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)),
+        clip_(OperatorBase::GetSingleArgument<float>("clip_norm", 0)) {}
+
+  bool RunOnDevice() override {
+    const auto& lr = Input(InputSize() - 1);
+    CAFFE_ENFORCE_EQ(lr.size(), 1);
+    chunks_.Clear();
+    clip_.Clear();
+    for (int i = 0; i < OutputSize() / 2; ++i) {
+      const auto& grad = Input(3 * i + 2);
+      auto* param = Output(2 * i);
+      auto* moment = Output(2 * i + 1);
+      CAFFE_ENFORCE_EQ(grad.size(), param->size());
+      CAFFE_ENFORCE_EQ(grad.size(), moment->size());
+      chunks_.Add(
+          {grad.template data<float>()},
+          {param->template mutable_data<float>(),
+           moment->template mutable_data<float>()},
+          grad.size());
+      clip_.Add(grad.template data<float>(), grad.size());
+    }
+    multi_adagrad_update<Context>(
+        &chunks_,
+        epsilon_,
+        lr.template data<float>(),
+        clip_.Scale(&context_),
+        &context_);
+    return true;
+  }
+
+ protected:
+  float epsilon_;
+  GlobalNormClip<Context> clip_;
+  TensorListChunks<1, 2, Context> chunks_;
+};
+
+// Inputs: (param, moment_1, moment_2, grad) for each parameter, then lr and
+// iter.
+template <class Context>
+class MultiAdamOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  MultiAdamOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        beta1_(OperatorBase::GetSingleArgument<float>("beta1", 0.9)),
+        beta2_(OperatorBase::GetSingleArgument<float>("beta2", 0.999)),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)),
+        clip_(OperatorBase::GetSingleArgument<float>("clip_norm", 0)) {}
+
+  bool RunOnDevice() override {
+    // Iter live on the CPU
+    const int iter_input = InputSize() - 1;
+    CAFFE_ENFORCE(OperatorBase::InputIsType<TensorCPU>(iter_input));
+    const auto& lr = Input(InputSize() - 2);
+    CAFFE_ENFORCE_EQ(lr.size(), 1);
+    const auto iter = OperatorBase::Input<TensorCPU>(iter_input)
+                          .template data<int64_t>()[0];
+    const auto t = iter + 1;
+    const float correction =
+        std::sqrt(1.f - std::pow(beta2_, t)) / (1.f - std::pow(beta1_, t));
+
+    chunks_.Clear();
+    clip_.Clear();
+    for (int i = 0; i < OutputSize() / 3; ++i) {
+      const auto& grad = Input(4 * i + 3);
+      auto* param = Output(3 * i);
+      auto* moment_1 = Output(3 * i + 1);
+      auto* moment_2 = Output(3 * i + 2);
+      CAFFE_ENFORCE_EQ(grad.size(), param->size());
+      CAFFE_ENFORCE_EQ(grad.size(), moment_1->size());
+      CAFFE_ENFORCE_EQ(grad.size(), moment_2->size());
+      chunks_.Add(
+          {grad.template data<float>()},
+          {param->template mutable_data<float>(),
+           moment_1->template mutable_data<float>(),
+           moment_2->template mutable_data<float>()},
+          grad.size());
+      clip_.Add(grad.template data<float>(), grad.size());
+    }
+    multi_adam_update<Context>(
+        &chunks_,
+        beta1_,
+        beta2_,
+        epsilon_,
+        correction,
+        lr.template data<float>(),
+        clip_.Scale(&context_),
+        &context_);
+    return true;
+  }
+
+ protected:
+  float beta1_;
+  float beta2_;
+  float epsilon_;
+  GlobalNormClip<Context> clip_;
+  TensorListChunks<1, 3, Context> chunks_;
+};
+
+// Inputs: (grad, momentum, param) for each parameter, then lr.
+template <class Context>
+class MultiMomentumSGDUpdateOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  MultiMomentumSGDUpdateOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        momentum_(OperatorBase::GetSingleArgument<float>("momentum", 0.0)),
+        nesterov_(OperatorBase::GetSingleArgument<int>("nesterov", 0)),
+        clip_(OperatorBase::GetSingleArgument<float>("clip_norm", 0)) {}
+
+  bool RunOnDevice() override {
+    const auto& lr = Input(InputSize() - 1);
+    CAFFE_ENFORCE_EQ(lr.size(), 1);
+    chunks_.Clear();
+    clip_.Clear();
+    for (int i = 0; i < OutputSize() / 3; ++i) {
+      auto* grad = Output(3 * i);
+      auto* momentum = Output(3 * i + 1);
+      auto* param = Output(3 * i + 2);
+      CAFFE_ENFORCE_EQ(grad->size(), momentum->size());
+      CAFFE_ENFORCE_EQ(grad->size(), param->size());
+      chunks_.Add(
+          {},
+          {grad->template mutable_data<float>(),
+           momentum->template mutable_data<float>(),
+           param->template mutable_data<float>()},
+          grad->size());
+      clip_.Add(grad->template data<float>(), grad->size());
+    }
+    multi_momentum_sgd_update<Context>(
+        &chunks_,
+        momentum_,
+        nesterov_,
+        lr.template data<float>(),
+        clip_.Scale(&context_),
+        &context_);
+    return true;
+  }
+
+ protected:
+  float momentum_;
+  bool nesterov_;
+  GlobalNormClip<Context> clip_;
+  TensorListChunks<0, 3, Context> chunks_;
+};
+
+// Inputs: (grad, mean_squares, momentum) for each parameter, then lr.
+template <class Context>
+class MultiRmsPropOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  MultiRmsPropOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        decay_(OperatorBase::GetSingleArgument<float>("decay", 0.9)),
+        momentum_(OperatorBase::GetSingleArgument<float>("momentum", 0.0)),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)),
+        clip_(OperatorBase::GetSingleArgument<float>("clip_norm", 0)) {}
+
+  bool RunOnDevice() override {
+    const auto& lr = Input(InputSize() - 1);
+    CAFFE_ENFORCE_EQ(lr.size(), 1);
+    chunks_.Clear();
+    clip_.Clear();
+    for (int i = 0; i < OutputSize() / 3; ++i) {
+      auto* grad = Output(3 * i);
+      auto* mean_squares = Output(3 * i + 1);
+      auto* momentum = Output(3 * i + 2);
+      CAFFE_ENFORCE_EQ(grad->size(), mean_squares->size());
+      CAFFE_ENFORCE_EQ(grad->size(), momentum->size());
+      chunks_.Add(
+          {},
+          {grad->template mutable_data<float>(),
+           mean_squares->template mutable_data<float>(),
+           momentum->template mutable_data<float>()},
+          grad->size());
+      clip_.Add(grad->template data<float>(), grad->size());
+    }
+    multi_rmsprop_update<Context>(
+        &chunks_,
+        decay_,
+        momentum_,
+        epsilon_,
+        lr.template data<float>(),
+        clip_.Scale(&context_),
+        &context_);
+    return true;
+  }
+
+ protected:
+  float decay_;
+  float momentum_;
+  float epsilon_;
+  GlobalNormClip<Context> clip_;
+  TensorListChunks<0, 3, Context> chunks_;
+};
+
+} // namespace caffe2
@@ -0,0 +1,277 @@
+#include "cub/block/block_reduce.cuh"
+
+#include "caffe2/core/common_gpu.h"
+#include "caffe2/core/context_gpu.h"
+#include "caffe2/sgd/multi_tensor_ops.h"
+
+namespace caffe2 {
+
+namespace {
+// Every kernel runs a block per chunk, over the chunks of all the tensors.
+inline int ChunkBlocks(int chunks) {
+  return std::min(chunks, CAFFE_MAXIMUM_NUM_BLOCKS);
+}
+
+__global__ void MultiAdagradKernel(
+    const int n,
+    const TensorListChunk<1, 2>* chunks,
+    const float epsilon,
+    const float* lr,
+    const float* scale) {
+  const float s = scale ? scale[0] : 1.f;
+  for (int c = blockIdx.x; c < n; c += gridDim.x) {
+    const auto& chunk = chunks[c];
+    const float* g = chunk.in[0];
+    float* w = chunk.out[0];
+    float* h = chunk.out[1];
+    for (int i = threadIdx.x; i < chunk.size; i += blockDim.x) {
+      const float gi = g[i] * s;
+      const float hi = h[i] = h[i] + gi * gi;
+      w[i] += lr[0] * gi / (sqrtf(hi) + epsilon);
+    }
+  }
+}
+
+__global__ void MultiAdamKernel(
+    const int n,
+    const TensorListChunk<1, 3>* chunks,
+    const float beta1,
+    const float beta2,
+    const float eps_hat,
+    const float correction,
+    const float* lr,
+    const float* scale) {
+  const float s = scale ? scale[0] : 1.f;
+  for (int c = blockIdx.x; c < n; c += gridDim.x) {
+    const auto& chunk = chunks[c];
+    const float* g = chunk.in[0];
+    float* w = chunk.out[0];
+    float* m = chunk.out[1];
+    float* v = chunk.out[2];
+    for (int i = threadIdx.x; i < chunk.size; i += blockDim.x) {
+      const float gi = g[i] * s;
+      const float mi = m[i] = m[i] * beta1 + gi * (1 - beta1);
+      const float vi = v[i] = v[i] * beta2 + gi * gi * (1 - beta2);
+      w[i] += lr[0] * correction * mi / (sqrtf(vi) + eps_hat);
+    }
+  }
+}
+
+__global__ void MultiMomentumSGDKernel(
+    const int n,
+    const TensorListChunk<0, 3>* chunks,
+    const float momentum,
+    const bool nesterov,
+    const float* lr,
+    const float* scale) {
+  const float s = scale ? scale[0] : 1.f;
+  for (int c = blockIdx.x; c < n; c += gridDim.x) {
+    const auto& chunk = chunks[c];
+    float* g = chunk.out[0];
+    float* m = chunk.out[1];
+    float* w = chunk.out[2];
+    for (int i = threadIdx.x; i < chunk.size; i += blockDim.x) {
+      const float gi = g[i] * s;
+      float ng;
+      if (!nesterov) {
+        ng = m[i] = lr[0] * gi + momentum * m[i];
+      } else {
+        const float mi = m[i];
+        const float mi_new = m[i] = momentum * mi + lr[0] * gi;
+        ng = (1 + momentum) * mi_new - momentum * mi;
+      }
+      g[i] = ng;
+      w[i] -= ng;
+    }
+  }
+}
+
+__global__ void MultiRmsPropKernel(
+    const int n,
+    const TensorListChunk<0, 3>* chunks,
+    const float decay,
+    const float momentum,
+    const float epsilon,
+    const float* lr,
+    const float* scale) {
+  const float s = scale ? scale[0] : 1.f;
+  for (int c = blockIdx.x; c < n; c += gridDim.x) {
+    const auto& chunk = chunks[c];
+    float* g = chunk.out[0];
+    float* ms = chunk.out[1];
+    float* mom = chunk.out[2];
+    for (int i = threadIdx.x; i < chunk.size; i += blockDim.x) {
+      const float gi = g[i] * s;
+      const float msi = ms[i] = ms[i] + (1.0f - decay) * (gi * gi - ms[i]);
+      g[i] = mom[i] = mom[i] * momentum + lr[0] * gi / sqrtf(epsilon + msi);
+    }
+  }
+}
+
+// Each block sums the squares of its chunks into partial[blockIdx.x].
+__global__ void SumSquaresKernel(
+    const int n,
+    const TensorListChunk<1, 0>* chunks,
+    float* partial) {
+  typedef cub::BlockReduce<float, CAFFE_CUDA_NUM_THREADS> BlockReduce;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  float sum = 0;
+  for (int c = blockIdx.x; c < n; c += gridDim.x) {
+    const auto& chunk = chunks[c];
+    for (int i = threadIdx.x; i < chunk.size; i += blockDim.x) {
+      sum += chunk.in[0][i] * chunk.in[0][i];
+    }
+  }
+  sum = BlockReduce(temp_storage).Sum(sum);
+  if (threadIdx.x == 0) {
+    partial[blockIdx.x] = sum;
+  }
+}
+
+__global__ void ClipScaleKernel(
+    const int blocks,
+    const float* partial,
+    const float clip_norm,
+    float* scale) {
+  typedef cub::BlockReduce<float, CAFFE_CUDA_NUM_THREADS> BlockReduce;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  float sum = 0;
+  for (int i = threadIdx.x; i < blocks; i += blockDim.x) {
+    sum += partial[i];
+  }
+  sum = BlockReduce(temp_storage).Sum(sum);
+  if (threadIdx.x == 0) {
+    const float norm = sqrtf(sum);
+    scale[0] = norm > clip_norm ? clip_norm / norm : 1.f;
+  }
+}
+} // namespace
+
+template <>
+const float* multi_tensor_clip_scale<CUDAContext>(
+    TensorListChunks<1, 0, CUDAContext>* grads,
+    float clip_norm,
+    Tensor<CUDAContext>* buffer,
+    CUDAContext* context) {
+  // The factor, then the partial sums of the blocks.
+  const int blocks = ChunkBlocks(grads->size());
+  buffer->Resize(1 + blocks);
+  float* scale = buffer->mutable_data<float>();
+  if (blocks > 0) {
+    SumSquaresKernel<<<
+        blocks,
+        CAFFE_CUDA_NUM_THREADS,
+        0,
+        context->cuda_stream()>>>(
+        grads->size(), grads->CopyTo(context), scale + 1);
+  }
+  ClipScaleKernel<<<1, CAFFE_CUDA_NUM_THREADS, 0, context->cuda_stream()>>>(
+      blocks, scale + 1, clip_norm, scale);
+  return scale;
+}
+
+template <>
+void multi_adagrad_update<CUDAContext>(
+    TensorListChunks<1, 2, CUDAContext>* chunks,
+    float epsilon,
+    const float* lr,
+    const float* scale,
+    CUDAContext* context) {
+  if (chunks->size() == 0) {
+    return;
+  }
+  MultiAdagradKernel<<<
+      ChunkBlocks(chunks->size()),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context->cuda_stream()>>>(
+      chunks->size(), chunks->CopyTo(context), epsilon, lr, scale);
+}
+
+template <>
+void multi_adam_update<CUDAContext>(
+    TensorListChunks<1, 3, CUDAContext>* chunks,
+    float beta1,
+    float beta2,
+    float eps_hat,
+    float correction,
+    const float* lr,
+    const float* scale,
+    CUDAContext* context) {
+  if (chunks->size() == 0) {
+    return;
+  }
+  MultiAdamKernel<<<
+      ChunkBlocks(chunks->size()),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context->cuda_stream()>>>(
+      chunks->size(),
+      chunks->CopyTo(context),
+      beta1,
+      beta2,
+      eps_hat,
+      correction,
+      lr,
+      scale);
+}
+
+template <>
+void multi_momentum_sgd_update<CUDAContext>(
+    TensorListChunks<0, 3, CUDAContext>* chunks,
+    float momentum,
+    bool nesterov,
+    const float* lr,
+    const float* scale,
+    CUDAContext* context) {
+  if (chunks->size() == 0) {
+    return;
+  }
+  MultiMomentumSGDKernel<<<
+      ChunkBlocks(chunks->size()),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context->cuda_stream()>>>(
+      chunks->size(),
+      chunks->CopyTo(context),
+      momentum,
+      nesterov,
+      lr,
+      scale);
+}
+
+template <>
+void multi_rmsprop_update<CUDAContext>(
+    TensorListChunks<0, 3, CUDAContext>* chunks,
+    float decay,
+    float momentum,
+    float epsilon,
+    const float* lr,
+    const float* scale,
+    CUDAContext* context) {
+  if (chunks->size() == 0) {
+    return;
+  }
+  MultiRmsPropKernel<<<
+      ChunkBlocks(chunks->size()),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context->cuda_stream()>>>(
+      chunks->size(),
+      chunks->CopyTo(context),
+      decay,
+      momentum,
+      epsilon,
+      lr,
+      scale);
+}
+
+namespace {
+REGISTER_CUDA_OPERATOR(MultiAdagrad, MultiAdagradOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(MultiAdam, MultiAdamOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(
+    MultiMomentumSGDUpdate,
+    MultiMomentumSGDUpdateOp<CUDAContext>);
+REGISTER_CUDA_OPERATOR(MultiRmsProp, MultiRmsPropOp<CUDAContext>);
+}
+}
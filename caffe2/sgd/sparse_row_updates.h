@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/common_omp.h"
+
+namespace caffe2 {
+
+// Below this many updated floats, the sparse updates run on a single thread.
+constexpr TIndex kMinParallelSparseUpdate = 1 << 15;
+
+// Runs update(i) for the n occurrences i of the rows in indices, split over
+// the OpenMP threads by row when they update enough floats.
+class SparseRowUpdates {
+ public:
+  template <typename SIndex, typename Update>
+  void Run(
+      const SIndex* indices,
+      TIndex n,
+      TIndex block_size,
+      bool hogwild,
+      const Update& update) {
+    bool parallel = n * block_size >= kMinParallelSparseUpdate;
+#ifdef _OPENMP
+    // With a single thread, sorting the indices is only overhead.
+    parallel = parallel && omp_get_max_threads() > 1;
+#else
+    parallel = false;
+#endif
+    if (!parallel || hogwild) {
+      // With hogwild, the threads update the rows of duplicate indices at the
+      // same time, without locks, so that some of their updates can be lost.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+      for (TIndex i = 0; i < n; ++i) {
+        update(i);
+      }
+    } else {
+      // The occurrences of a row are updated in order by a single thread, so
+      // that the result is the one of the serial loop. Sorting the indices
+      // also has the threads update the rows in memory order.
+      order_.resize(n);
+      for (int i = 0; i < n; ++i) {
+        order_[i] = i;
+      }
+      std::stable_sort(order_.begin(), order_.end(), [&](int a, int b) {
+        return indices[a] < indices[b];
+      });
+      starts_.clear();
+      for (int j = 0; j < n; ++j) {
+        if (j == 0 || indices[order_[j]] != indices[order_[j - 1]]) {
+          starts_.push_back(j);
+        }
+      }
+      starts_.push_back(n);
+      const int rows = starts_.size() - 1;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+      for (int r = 0; r < rows; ++r) {
+        for (int j = starts_[r]; j < starts_[r + 1]; ++j) {
+          update(order_[j]);
+        }
+      }
+    }
+  }
+
+ private:
+  vector<int> order_;
+  vector<int> starts_;
+};
+} // namespace caffe2
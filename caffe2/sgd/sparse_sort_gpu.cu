@@ -0,0 +1,112 @@
+#include "cub/device/device_radix_sort.cuh"
+
+#include "caffe2/core/dirty_rows.h"
+#include "caffe2/sgd/sparse_sort_gpu.h"
+
+namespace caffe2 {
+
+namespace {
+__global__ void IotaKernel(const int n, int* out) {
+  CUDA_1D_KERNEL_LOOP(i, n) {
+    out[i] = i;
+  }
+}
+} // namespace
+
+template <typename SIndex>
+void SortedSparseIndices::Sort(
+    int n,
+    TIndex num_rows,
+    const SIndex* indices,
+    CUDAContext* context) {
+  positions_.Resize(n);
+  sorted_indices_.Resize(n);
+  sorted_positions_.Resize(n);
+  int* positions = positions_.mutable_data<int>();
+  SIndex* sorted_indices = sorted_indices_.template mutable_data<SIndex>();
+  int* sorted_positions = sorted_positions_.mutable_data<int>();
+  if (n == 0) {
+    return;
+  }
+  IotaKernel<<<
+      CAFFE_GET_BLOCKS(n),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context->cuda_stream()>>>(n, positions);
+
+  // Only the bits that can be set in a valid index need to be sorted, which
+  // saves most of the passes for 64 bit indices.
+  int end_bit = 1;
+  while (end_bit < 8 * sizeof(SIndex) && (TIndex(1) << end_bit) < num_rows) {
+    ++end_bit;
+  }
+  size_t sort_bytes = 0;
+  CUDA_CHECK(cub::DeviceRadixSort::SortPairs(
+      nullptr,
+      sort_bytes,
+      indices,
+      sorted_indices,
+      positions,
+      sorted_positions,
+      n,
+      0,
+      end_bit,
+      context->cuda_stream()));
+  sort_buffer_.Resize(sort_bytes);
+  CUDA_CHECK(cub::DeviceRadixSort::SortPairs(
+      static_cast<void*>(sort_buffer_.mutable_data<char>()),
+      sort_bytes,
+      indices,
+      sorted_indices,
+      positions,
+      sorted_positions,
+      n,
+      0,
+      end_bit,
+      context->cuda_stream()));
+}
+
+template <typename SIndex>
+void MarkDirtyRowsFromDevice(
+    const vector<const Blob*>& blobs,
+    int n,
+    const SIndex* indices,
+    CUDAContext* context) {
+  auto* dirty_rows = DirtyRowTracker::Get();
+  bool tracked = false;
+  for (const Blob* blob : blobs) {
+    tracked = tracked || dirty_rows->IsTracked(blob);
+  }
+  if (!tracked || n == 0) {
+    return;
+  }
+  vector<SIndex> rows(n);
+  context->Copy<SIndex, CUDAContext, CPUContext>(n, indices, rows.data());
+  CAFFE_ENFORCE(context->FinishDeviceComputation());
+  for (const Blob* blob : blobs) {
+    dirty_rows->MarkRows(blob, rows.data(), n);
+  }
+}
+
+template void SortedSparseIndices::Sort<int32_t>(
+    int n,
+    TIndex num_rows,
+    const int32_t* indices,
+    CUDAContext* context);
+template void SortedSparseIndices::Sort<int64_t>(
+    int n,
+    TIndex num_rows,
+    const int64_t* indices,
+    CUDAContext* context);
+template void MarkDirtyRowsFromDevice<int32_t>(
+    const vector<const Blob*>& blobs,
+    int n,
+    const int32_t* indices,
+    CUDAContext* context);
+template void MarkDirtyRowsFromDevice<int64_t>(
+    const vector<const Blob*>& blobs,
+    int n,
+    const int64_t* indices,
+    CUDAContext* context);
+
+} // namespace caffe2
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "caffe2/core/context_gpu.h"
+
+namespace caffe2 {
+
+// Sorts the indices of a sparse gradient on the device, together with the
+// positions of the gradient rows they came from. The rows for each distinct
+// index are then contiguous, so that one thread block can sum them and update
+// the index without atomics. The buffers are kept across calls.
+class SortedSparseIndices {
+ public:
+  // Sorts the n indices, which must be in [0, num_rows).
+  template <typename SIndex>
+  void Sort(int n, TIndex num_rows, const SIndex* indices, CUDAContext* context);
+
+  template <typename SIndex>
+  const SIndex* indices() const {
+    return sorted_indices_.template data<SIndex>();
+  }
+
+  // positions()[i] is the gradient row of indices()[i].
+  const int* positions() const {
+    return sorted_positions_.data<int>();
+  }
+
+ private:
+  TensorCUDA positions_;
+  TensorCUDA sorted_indices_;
+  TensorCUDA sorted_positions_;
+  TensorCUDA sort_buffer_;
+};
+
+// Marks the n rows in the device array indices as dirty in the given blobs.
+// The indices are only copied to the host, which waits for the device, when
+// one of the blobs is tracked by the DirtyRowTracker.
+template <typename SIndex>
+void MarkDirtyRowsFromDevice(
+    const vector<const Blob*>& blobs,
+    int n,
+    const SIndex* indices,
+    CUDAContext* context);
+
+} // namespace caffe2
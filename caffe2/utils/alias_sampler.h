@@ -0,0 +1,89 @@
+#ifndef CAFFE2_UTILS_ALIAS_SAMPLER_H_
+#define CAFFE2_UTILS_ALIAS_SAMPLER_H_
+
+#include <random>
+#include <vector>
+
+#include "caffe2/core/logging.h"
+
+namespace caffe2 {
+
+// Draws from a fixed discrete distribution in O(1) per sample using Walker's
+// alias method (Vose's construction). Building the table is O(n), so it pays
+// off as soon as the same distribution is sampled more than a few times,
+// e.g. negative classes for sampled softmax over large vocabularies.
+class AliasSampler {
+ public:
+  AliasSampler() {}
+
+  // weights need not be normalized, but must be non-negative with a positive
+  // sum.
+  template <typename T>
+  void Build(int n, const T* weights) {
+    CAFFE_ENFORCE_GT(n, 0);
+    double total = 0;
+    for (int i = 0; i < n; ++i) {
+      CAFFE_ENFORCE_GE(weights[i], 0, "Negative sampling weight at ", i);
+      total += weights[i];
+    }
+    CAFFE_ENFORCE_GT(total, 0, "Sampling weights sum to zero.");
+
+    probs_.resize(n);
+    accept_.resize(n);
+    alias_.resize(n);
+    std::vector<double> scaled(n);
+    std::vector<int> small, large;
+    for (int i = 0; i < n; ++i) {
+      probs_[i] = weights[i] / total;
+      scaled[i] = probs_[i] * n;
+      (scaled[i] < 1. ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+      const int s = small.back();
+      const int l = large.back();
+      small.pop_back();
+      accept_[s] = scaled[s];
+      alias_[s] = l;
+      scaled[l] -= 1. - scaled[s];
+      if (scaled[l] < 1.) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+    // Whatever is left is 1 up to rounding error.
+    for (int i : large) {
+      accept_[i] = 1.;
+      alias_[i] = i;
+    }
+    for (int i : small) {
+      accept_[i] = 1.;
+      alias_[i] = i;
+    }
+  }
+
+  int size() const {
+    return probs_.size();
+  }
+
+  // Normalized probability of drawing class i.
+  double prob(int i) const {
+    return probs_[i];
+  }
+
+  template <class Generator>
+  int Sample(Generator& gen) const {
+    std::uniform_int_distribution<int> bucket(0, probs_.size() - 1);
+    std::uniform_real_distribution<double> coin(0., 1.);
+    const int i = bucket(gen);
+    return coin(gen) < accept_[i] ? i : alias_[i];
+  }
+
+ private:
+  std::vector<double> probs_;
+  std::vector<double> accept_;
+  std::vector<int> alias_;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_ALIAS_SAMPLER_H_
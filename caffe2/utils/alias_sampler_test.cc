@@ -0,0 +1,29 @@
+#include "caffe2/utils/alias_sampler.h"
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+TEST(AliasSamplerTest, MatchesDistribution) {
+  const std::vector<float> weights{0.f, 1.f, 2.f, 7.f, 0.5f, 9.5f};
+  AliasSampler sampler;
+  sampler.Build(weights.size(), weights.data());
+  ASSERT_EQ(sampler.size(), weights.size());
+  EXPECT_DOUBLE_EQ(sampler.prob(3), 0.35);
+
+  std::mt19937 gen(1);
+  const int kDraws = 200000;
+  std::vector<int> counts(weights.size(), 0);
+  for (int i = 0; i < kDraws; ++i) {
+    ++counts[sampler.Sample(gen)];
+  }
+  EXPECT_EQ(counts[0], 0);
+  for (int c = 0; c < weights.size(); ++c) {
+    EXPECT_NEAR(double(counts[c]) / kDraws, sampler.prob(c), 0.005);
+  }
+}
+
+} // namespace caffe2
@@ -0,0 +1,150 @@
+#include "caffe2/utils/async_file_reader.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/thread_pool.h"
+
+CAFFE2_DEFINE_int(
+    caffe2_async_io_threads,
+    16,
+    "The number of threads that AsyncFileReader issues its reads from.");
+
+namespace caffe2 {
+
+namespace {
+
+ThreadPool* IOThreads() {
+  // Leaked on purpose, so that the threads are never joined at exit.
+  static ThreadPool* pool = new ThreadPool(FLAGS_caffe2_async_io_threads);
+  return pool;
+}
+
+} // namespace
+
+constexpr size_t AsyncFileReader::kAlignment;
+
+struct AsyncFileReader::Chunk {
+  ~Chunk() {
+    free(data);
+  }
+
+  char* data = nullptr;
+  uint64_t offset = 0;
+  size_t size = 0;
+  bool ready = false;
+  int error = 0;
+};
+
+// Shared with the reads in flight, which may outlive the reader's wait for
+// them by the time it takes to notify it.
+struct AsyncFileReader::State {
+  std::mutex mutex;
+  std::condition_variable done;
+  int in_flight = 0;
+};
+
+AsyncFileReader::AsyncFileReader(
+    int fd,
+    uint64_t begin,
+    uint64_t end,
+    size_t chunk_size,
+    int queue_depth)
+    : fd_(fd),
+      end_(end),
+      chunk_size_(chunk_size),
+      next_offset_(begin),
+      state_(std::make_shared<State>()) {
+  CAFFE_ENFORCE_GT(chunk_size_, 0);
+  CAFFE_ENFORCE_GT(queue_depth, 0);
+  // One more chunk than the queue depth, for the one that the caller holds.
+  for (int i = 0; i <= queue_depth; ++i) {
+    chunks_.emplace_back(new Chunk());
+    void* data = nullptr;
+    CAFFE_ENFORCE_EQ(posix_memalign(&data, kAlignment, chunk_size_), 0);
+    chunks_.back()->data = static_cast<char*>(data);
+  }
+  for (int i = 0; i < queue_depth; ++i) {
+    Issue(chunks_[i].get());
+  }
+}
+
+AsyncFileReader::~AsyncFileReader() {
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  state_->done.wait(lock, [this]() { return state_->in_flight == 0; });
+}
+
+void AsyncFileReader::Issue(Chunk* chunk) {
+  if (next_offset_ >= end_) {
+    chunk->offset = end_;
+    chunk->size = 0;
+    chunk->ready = true;
+    return;
+  }
+  chunk->offset = next_offset_;
+  chunk->size = std::min<uint64_t>(chunk_size_, end_ - next_offset_);
+  chunk->ready = false;
+  chunk->error = 0;
+  next_offset_ += chunk->size;
+  {
+    std::lock_guard<std::mutex> guard(state_->mutex);
+    ++state_->in_flight;
+  }
+  const int fd = fd_;
+  const size_t capacity = chunk_size_;
+  std::shared_ptr<State> state = state_;
+  IOThreads()->runTask([fd, capacity, chunk, state]() {
+    // Direct io needs reads of whole blocks, so the last chunk asks for the
+    // whole capacity, and gets less at the end of the file.
+    size_t num_read = 0;
+    int error = 0;
+    while (num_read < chunk->size) {
+      const ssize_t n = pread(
+          fd,
+          chunk->data + num_read,
+          capacity - num_read,
+          chunk->offset + num_read);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        error = n < 0 ? errno : EIO;
+        break;
+      }
+      num_read += n;
+    }
+    std::lock_guard<std::mutex> guard(state->mutex);
+    chunk->error = error;
+    chunk->ready = true;
+    --state->in_flight;
+    state->done.notify_all();
+  });
+}
+
+size_t AsyncFileReader::Next(char** data) {
+  // The chunk before the head is the one returned by the previous call, which
+  // the caller is done with, or the spare one on the first call. It takes the
+  // read after the last one in flight.
+  Issue(chunks_[(head_ + chunks_.size() - 1) % chunks_.size()].get());
+  Chunk* chunk = chunks_[head_].get();
+  {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->done.wait(lock, [chunk]() { return chunk->ready; });
+  }
+  CAFFE_ENFORCE_EQ(
+      chunk->error,
+      0,
+      "Cannot read file at offset ",
+      chunk->offset,
+      ": ",
+      strerror(chunk->error));
+  head_ = (head_ + 1) % chunks_.size();
+  *data = chunk->data;
+  return chunk->size;
+}
+
+} // namespace caffe2
@@ -0,0 +1,72 @@
+#ifndef CAFFE2_UTILS_ASYNC_FILE_READER_H_
+#define CAFFE2_UTILS_ASYNC_FILE_READER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/flags.h"
+
+CAFFE2_DECLARE_int(caffe2_async_io_threads);
+
+namespace caffe2 {
+
+/**
+ * AsyncFileReader reads a range of a file front to back, in chunks, with up
+ * to queue_depth reads in flight at once, so that a slow read (e.g. on network
+ * storage) does not stall the reader as long as the reads after it still come
+ * back.
+ *
+ * The reads are blocking preads, issued from a pool of
+ * FLAGS_caffe2_async_io_threads threads shared by all the readers, which
+ * works on any file system and needs no kernel support.
+ *
+ * The chunk buffers are aligned to kAlignment, so that files opened with
+ * O_DIRECT can be read, as long as the offset and chunk size are aligned too.
+ */
+class AsyncFileReader {
+ public:
+  static constexpr size_t kAlignment = 4096;
+
+  // Reads the bytes of the file from begin to end. The file descriptor is not
+  // owned, and must stay open for the lifetime of the reader.
+  AsyncFileReader(
+      int fd,
+      uint64_t begin,
+      uint64_t end,
+      size_t chunk_size,
+      int queue_depth);
+  // Waits for the reads in flight.
+  ~AsyncFileReader();
+
+  // Returns the next chunk of the file, waiting for its read if needed, or 0
+  // at the end of the range. The data stays valid, and may be modified, until
+  // the next call.
+  size_t Next(char** data);
+
+ private:
+  struct Chunk;
+  struct State;
+
+  void Issue(Chunk* chunk);
+
+  const int fd_;
+  const uint64_t end_;
+  const size_t chunk_size_;
+  uint64_t next_offset_;
+  std::shared_ptr<State> state_;
+  std::vector<std::unique_ptr<Chunk>> chunks_;
+  // The chunks form a ring, read and returned in order, with one more chunk
+  // than the queue depth for the one that the caller holds. The head is the
+  // chunk returned next.
+  size_t head_ = 0;
+
+  DISABLE_COPY_AND_ASSIGN(AsyncFileReader);
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_ASYNC_FILE_READER_H_
@@ -0,0 +1,55 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/async_file_reader.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+TEST(AsyncFileReaderTest, ReadsInOrder) {
+  string content;
+  for (int i = 0; i < 10000; ++i) {
+    content += static_cast<char>('a' + i % 23);
+  }
+  string name = std::tmpnam(nullptr);
+  ASSERT_TRUE(WriteStringToFile(content, name.c_str()));
+  int fd = open(name.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  for (int queue_depth : {1, 4, 100}) {
+    for (size_t begin : {0, 1, 4096}) {
+      AsyncFileReader reader(fd, begin, content.size() - 3, 1000, queue_depth);
+      string read_back;
+      char* data = nullptr;
+      while (size_t size = reader.Next(&data)) {
+        EXPECT_LE(size, 1000);
+        read_back.append(data, size);
+      }
+      EXPECT_EQ(read_back, content.substr(begin, content.size() - 3 - begin));
+      EXPECT_EQ(reader.Next(&data), 0);
+    }
+  }
+  // The reader can be destroyed with reads in flight.
+  { AsyncFileReader reader(fd, 0, content.size(), 10, 8); }
+  close(fd);
+  std::remove(name.c_str());
+}
+
+TEST(AsyncFileReaderTest, ReadError) {
+  string name = std::tmpnam(nullptr);
+  ASSERT_TRUE(WriteStringToFile("short", name.c_str()));
+  int fd = open(name.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  // The file ends before the range does.
+  AsyncFileReader reader(fd, 0, 100, 4, 2);
+  char* data = nullptr;
+  EXPECT_EQ(reader.Next(&data), 4);
+  EXPECT_THROW(reader.Next(&data), EnforceNotMet);
+  close(fd);
+  std::remove(name.c_str());
+}
+
+} // namespace caffe2
@@ -46,6 +46,45 @@ inline void vst4_u8_aligned(uint8_t* p, uint8x8x4_t v) {
           __builtin_assume_aligned(p, sizeof(uint8x8x4_t)), v);
 }
 
+// Wrappers for the ARMv8 instructions that ARMv7 lacks
+
+// a / b. On ARMv7 this is a reciprocal estimate refined by two Newton steps,
+// which is within 1 ULP of the quotient.
+inline float32x4_t vdivq_f32_compat(float32x4_t a, float32x4_t b) {
+#ifdef __aarch64__
+  return vdivq_f32(a, b);
+#else
+  float32x4_t r = vrecpeq_f32(b);
+  r = vmulq_f32(vrecpsq_f32(b, r), r);
+  r = vmulq_f32(vrecpsq_f32(b, r), r);
+  return vmulq_f32(a, r);
+#endif
+}
+
+// c + a * b, fused on ARMv8.
+inline float32x4_t vfmaq_f32_compat(float32x4_t c,
+                                    float32x4_t a,
+                                    float32x4_t b) {
+#ifdef __aarch64__
+  return vfmaq_f32(c, a, b);
+#else
+  return vmlaq_f32(c, a, b);
+#endif
+}
+
+// Rounds toward -inf. On ARMv7 this is only valid for |a| < 2^31.
+inline float32x4_t vfloorq_f32_compat(float32x4_t a) {
+#ifdef __aarch64__
+  return vrndmq_f32(a);
+#else
+  float32x4_t t = vcvtq_f32_s32(vcvtq_s32_f32(a));
+  uint32x4_t greater = vcgtq_f32(t, a);
+  return vsubq_f32(
+      t, vreinterpretq_f32_u32(vandq_u32(
+             greater, vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+#endif
+}
+
 }  // namespace caffe2
 
 #endif // __ARM_NEON__
@@ -2,8 +2,15 @@
 #define CAFFE2_UTILS_FIXED_DIVISOR_H_
 
 #include <cstdlib>
+#include <initializer_list>
 #include <stdint.h>
 
+#ifdef __CUDACC__
+#define FIXED_DIVISOR_DECL inline __host__ __device__
+#else
+#define FIXED_DIVISOR_DECL inline
+#endif
+
 namespace caffe2 {
 
 // Utility class for quickly calculating quotients and remainders for
@@ -12,16 +19,24 @@ template <typename T>
 class FixedDivisor {
 };
 
-// Works for any positive divisor, 1 to INT_MAX. One 64-bit
-// multiplication and one 64-bit shift is used to calculate the
-// result.
+// Works for any positive divisor, 1 to INT_MAX, and non-negative
+// dividends. One 64-bit multiplication and one 64-bit shift is used to
+// calculate the result; on CUDA devices, the high half of a 32-bit
+// multiplication and a 32-bit shift. The divisor is computed on the host and
+// can be passed by value to kernels.
 template <>
 class FixedDivisor<int32_t> {
  public:
+  FixedDivisor() : FixedDivisor(1) {}
+
   FixedDivisor(int32_t d) : d_(d) {
     calcSignedMagic();
   }
 
+  FIXED_DIVISOR_DECL int32_t d() const {
+    return d_;
+  }
+
   uint64_t getMagic() const {
     return magic_;
   }
@@ -31,20 +46,28 @@ class FixedDivisor<int32_t> {
   }
 
   /// Calculates `q = n / d`.
-  inline int32_t div(int32_t n) const {
+  FIXED_DIVISOR_DECL int32_t div(int32_t n) const {
+#ifdef __CUDA_ARCH__
+    // The magic of a divisor above 1 fits in 32 bits, and its shift is at
+    // least 32.
+    return d_ == 1 ? n
+                   : (int32_t) (__umulhi((uint32_t) magic_, (uint32_t) n) >>
+                                (shift_ - 32));
+#else
     // In lieu of a mulhi instruction being available, perform the
     // work in uint64
     uint64_t mul64 = magic_ * (uint64_t) n;
     return (int32_t) (mul64 >> shift_);
+#endif
   }
 
   /// Calculates `r = n % d`.
-  inline int32_t mod(int32_t n) const {
+  FIXED_DIVISOR_DECL int32_t mod(int32_t n) const {
     return n - d_ * div(n);
   }
 
   /// Calculates `q = n / d` and `r = n % d` together.
-  inline void divMod(int32_t n, int32_t& q, int32_t& r) const {
+  FIXED_DIVISOR_DECL void divMod(int32_t n, int32_t& q, int32_t& r) const {
     const int32_t quotient = div(n);
     q = quotient;
     r = n - d_ * quotient;
@@ -108,6 +131,52 @@ class FixedDivisor<int32_t> {
   int shift_;
 };
 
+/**
+ * Splits the linear indices of a row-major array of kNumDims dims into their
+ * coordinates with a FixedDivisor per dim, which is what index-heavy kernels
+ * do for every element. The first dim is never divided by, so an index past
+ * the end of the array gets a first coordinate past its end: kernels can
+ * leave the outermost axes, such as the batch, folded into it.
+ *
+ * The divisors are computed on the host; the decomposer is passed by value
+ * to CUDA kernels.
+ */
+template <int kNumDims>
+class IndexDecomposer {
+ public:
+  IndexDecomposer(std::initializer_list<int32_t> dims) {
+    int i = 0;
+    for (int32_t d : dims) {
+      if (i < kNumDims) {
+        dims_[i++] = FixedDivisor<int32_t>(d);
+      }
+    }
+  }
+
+  // dims holds kNumDims dims.
+  explicit IndexDecomposer(const int32_t* dims) {
+    for (int i = 0; i < kNumDims; ++i) {
+      dims_[i] = FixedDivisor<int32_t>(dims[i]);
+    }
+  }
+
+  // coords[i] is the coordinate of index along dim i.
+  FIXED_DIVISOR_DECL void decompose(int32_t index, int32_t* coords) const {
+#ifdef __CUDA_ARCH__
+#pragma unroll
+#endif
+    for (int i = kNumDims - 1; i > 0; --i) {
+      dims_[i].divMod(index, index, coords[i]);
+    }
+    coords[0] = index;
+  }
+
+ private:
+  FixedDivisor<int32_t> dims_[kNumDims];
+};
+
 } // namespace caffe2
 
+#undef FIXED_DIVISOR_DECL
+
 #endif // CAFFE2_UTILS_FIXED_DIVISOR_H_
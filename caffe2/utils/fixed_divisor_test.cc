@@ -1,6 +1,7 @@
 #include "caffe2/utils/fixed_divisor.h"
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <random>
 
 namespace caffe2 {
@@ -76,4 +77,29 @@ TEST(FixedDivisorTest, Test) {
   }
 }
 
+TEST(IndexDecomposerTest, Test) {
+  const int32_t dims[] = {3, 5, 1, 7};
+  IndexDecomposer<4> decomposer{dims[0], dims[1], dims[2], dims[3]};
+  IndexDecomposer<4> fromPointer(dims);
+  int32_t index = 0;
+  // Past the end of the first dim, which isn't divided by.
+  for (int32_t a = 0; a < dims[0] + 2; ++a) {
+    for (int32_t b = 0; b < dims[1]; ++b) {
+      for (int32_t c = 0; c < dims[2]; ++c) {
+        for (int32_t d = 0; d < dims[3]; ++d, ++index) {
+          int32_t coords[4];
+          decomposer.decompose(index, coords);
+          EXPECT_EQ(coords[0], a) << index;
+          EXPECT_EQ(coords[1], b) << index;
+          EXPECT_EQ(coords[2], c) << index;
+          EXPECT_EQ(coords[3], d) << index;
+          int32_t other[4];
+          fromPointer.decompose(index, other);
+          EXPECT_TRUE(std::equal(coords, coords + 4, other)) << index;
+        }
+      }
+    }
+  }
+}
+
 }  // namespace caffe2
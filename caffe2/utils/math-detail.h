@@ -1,5 +1,14 @@
 #ifndef CAFFE2_UTILS_MATH_DETAIL_H_
 #define CAFFE2_UTILS_MATH_DETAIL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "Eigen/Core"
+
+#include "caffe2/core/common_omp.h"
+
 namespace caffe2 {
 
 class CPUContext;
@@ -33,17 +42,33 @@ struct ScaleImpl {
   }
 };
 
-// Put light-weight implementations in .h file to enable inlining
-template<typename T>
-struct ScaleImpl<T, CPUContext, 1> {
+// Put light-weight implementations in .h file to enable inlining. A fixed
+// size is a vector of that size to Eigen, which unrolls and vectorizes the
+// loop, rather than a call to Eigen or BLAS for a dynamic size, which costs
+// more than the work itself for small sizes like those of embeddings.
+template <typename T, int FixedSize>
+struct ScaleImpl<T, CPUContext, FixedSize> {
   inline void operator()(
       const int N,
       const T alpha,
       const T* x,
       T* y,
       CPUContext* context) {
-    DCHECK_EQ(N, 1);
-    *y = *x * alpha;
+    DCHECK_EQ(N, FixedSize);
+    Eigen::Map<Eigen::Matrix<T, FixedSize, 1>> y_vec(y);
+    y_vec = Eigen::Map<const Eigen::Matrix<T, FixedSize, 1>>(x) * alpha;
+  }
+};
+
+template <typename T>
+struct ScaleImpl<T, CPUContext, -1> {
+  inline void operator()(
+      const int N,
+      const T alpha,
+      const T* x,
+      T* y,
+      CPUContext* context) {
+    ScaleDynamic(N, alpha, x, y, context);
   }
 };
 
@@ -55,20 +80,83 @@ struct AxpyImpl {
   }
 };
 
-// Put light-weight implementations in .h file to enable inlining
-template<typename T>
-struct AxpyImpl<T, CPUContext, 1> {
+template <typename T, int FixedSize>
+struct AxpyImpl<T, CPUContext, FixedSize> {
   inline void operator()(
       const int N,
       const T alpha,
       const T* x,
       T* y,
       CPUContext* context) {
-    DCHECK_EQ(N, 1);
-    *y += *x * alpha;
+    DCHECK_EQ(N, FixedSize);
+    Eigen::Map<Eigen::Matrix<T, FixedSize, 1>> y_vec(y);
+    y_vec += Eigen::Map<const Eigen::Matrix<T, FixedSize, 1>>(x) * alpha;
   }
 };
 
+template <typename T>
+struct AxpyImpl<T, CPUContext, -1> {
+  inline void operator()(
+      const int N,
+      const T alpha,
+      const T* x,
+      T* y,
+      CPUContext* context) {
+    AxpyDynamic(N, alpha, x, y, context);
+  }
+};
+
+// Number of output elements handed to a single call of a broadcast kernel.
+// Inputs smaller than this stay on the calling thread.
+constexpr size_t kBroadcastGrainSize = 16384;
+
+// CPU engine for binary elementwise ops with suffix broadcasting. The input
+// a and the output y have shape (pre, n, post) and b has n elements that are
+// repeated along pre and post; plain elementwise ops are (1, N, 1) and a
+// scalar b is (1, 1, N). The shape is collapsed into contiguous runs that
+// either pair up with all of b (post == 1) or with a single element of b,
+// and the runs are split into grain sized chunks spread over OpenMP threads.
+// Kernel provides the two inner loops, which should be vectorizable:
+//
+//   template <typename T, typename R>
+//   static void Run(size_t n, const T* a, const T* b, R* y);
+//   template <typename T, typename R>
+//   static void RunScalar(size_t n, const T* a, T b, R* y);
+//
+// y may alias a, but not b.
+template <class Kernel, typename T, typename R>
+void BroadcastBinary(
+    size_t pre,
+    size_t n,
+    size_t post,
+    const T* a,
+    const T* b,
+    R* y) {
+  if (n == 1) {
+    post *= pre;
+    pre = 1;
+  }
+  const bool b_is_row = post == 1;
+  const size_t rows = b_is_row ? pre : pre * n;
+  const size_t len = b_is_row ? n : post;
+  if (rows == 0 || len == 0) {
+    return;
+  }
+  const size_t chunks = (len + kBroadcastGrainSize - 1) / kBroadcastGrainSize;
+  const int64_t tasks = static_cast<int64_t>(rows * chunks);
+#pragma omp parallel for if (rows * len > kBroadcastGrainSize)
+  for (int64_t t = 0; t < tasks; ++t) {
+    const size_t row = t / chunks;
+    const size_t begin = (t % chunks) * kBroadcastGrainSize;
+    const size_t count = std::min(kBroadcastGrainSize, len - begin);
+    const size_t offset = row * len + begin;
+    if (b_is_row) {
+      Kernel::Run(count, a + offset, b + begin, y + offset);
+    } else {
+      Kernel::RunScalar(count, a + offset, b[row % n], y + offset);
+    }
+  }
+}
 
 }  // namespace detail
 
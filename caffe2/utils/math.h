@@ -57,6 +57,12 @@ void Log(const int N, const T* x, T* y, Context* context);
 template <typename T, class Context>
 void Sqr(const int N, const T* x, T* y, Context* context);
 
+// Tanh and Sigmoid are only implemented for CPUContext.
+template <typename T, class Context>
+void Tanh(const int N, const T* x, T* y, Context* context);
+template <typename T, class Context>
+void Sigmoid(const int N, const T* x, T* y, Context* context);
+
 template <typename T, class Context>
 void Not(const int N, const T* x, T* y, Context* context);
 
@@ -149,6 +155,31 @@ void GemmEx(
     const int ldc,
     Context* context);
 
+// Runs the gemm above on batch_size independent sets of matrices:
+//
+//     C[i] = alpha * op(A[i]) * op(B[i]) + beta * C[i]
+//
+// where A[i] starts at A + i * A_stride, and likewise for B and C. All the
+// matrices have the same shapes. This is faster than calling Gemm in a loop
+// when the matrices are small.
+template <typename T, class Context, class Engine = DefaultEngine>
+void GemmBatched(
+    const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB,
+    const int batch_size,
+    const int M,
+    const int N,
+    const int K,
+    const T alpha,
+    const T* A,
+    const int A_stride,
+    const T* B,
+    const int B_stride,
+    const T beta,
+    T* C,
+    const int C_stride,
+    Context* context);
+
 // Gemv always takes in a M*N matrix A, and depending on whether we set TransA
 // to Trans, the output is:
 // CblasNoTrans: x is an N dim vector and y is an M dim vector.
@@ -158,6 +189,17 @@ void Gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
     const T alpha, const T* A, const T* x, const T beta,
     T* y, Context* context);
 
+// Transposes each of the batch_size rows x cols matrices in A into the
+// cols x rows matrix at the same place in B. The matrices are contiguous.
+template <typename T, class Context>
+void Transpose2D(
+    const int batch_size,
+    const int rows,
+    const int cols,
+    const T* A,
+    T* B,
+    Context* context);
+
 template <typename T, class Context>
 void Set(const TIndex N, const T alpha, T* X, Context* context);
 
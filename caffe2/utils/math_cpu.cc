@@ -11,10 +11,19 @@
 //     platforms, it allows one to quickly port Caffe2 to different platforms
 //     where BLAS may not be present.
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <random>
 #include <unordered_set>
+#include <vector>
+
+#if defined(__AVX__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 
 #ifdef CAFFE2_USE_MKL
 #include <mkl.h>
@@ -22,7 +31,9 @@
 
 #include "caffe2/utils/math.h"
 #include "caffe2/utils/cpu_neon.h"
+#include "caffe2/utils/philox_random.h"
 #include "caffe2/core/context.h"
+#include "caffe2/core/flags.h"
 #include "Eigen/Core"
 #include "Eigen/Dense"
 
@@ -392,6 +403,447 @@ CAFFE2_SPECIALIZED_AXPBY(double, d)
 #endif  // CAFFE2_USE_EIGEN_FOR_BLAS
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Batched gemm.
+// With MKL, this is one call to its batch gemm. Otherwise the items are split
+// across OpenMP threads. Eigen already takes a fast path for small products,
+// so each item is still a Gemm call.
+////////////////////////////////////////////////////////////////////////////////
+
+template <>
+void GemmBatched<float, CPUContext>(
+    const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB,
+    const int batch_size,
+    const int M,
+    const int N,
+    const int K,
+    const float alpha,
+    const float* A,
+    const int A_stride,
+    const float* B,
+    const int B_stride,
+    const float beta,
+    float* C,
+    const int C_stride,
+    CPUContext* context) {
+#ifdef CAFFE2_USE_MKL
+  std::vector<const float*> a_array(batch_size);
+  std::vector<const float*> b_array(batch_size);
+  std::vector<float*> c_array(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
+    a_array[i] = A + i * A_stride;
+    b_array[i] = B + i * B_stride;
+    c_array[i] = C + i * C_stride;
+  }
+  const MKL_INT m = M;
+  const MKL_INT n = N;
+  const MKL_INT k = K;
+  const MKL_INT lda = (TransA == CblasNoTrans) ? K : M;
+  const MKL_INT ldb = (TransB == CblasNoTrans) ? N : K;
+  const MKL_INT ldc = N;
+  const MKL_INT group_size = batch_size;
+  cblas_sgemm_batch(
+      CblasRowMajor,
+      &TransA,
+      &TransB,
+      &m,
+      &n,
+      &k,
+      &alpha,
+      a_array.data(),
+      &lda,
+      b_array.data(),
+      &ldb,
+      &beta,
+      c_array.data(),
+      &ldc,
+      1,
+      &group_size);
+#else
+#pragma omp parallel for if (batch_size > 1)
+  for (int i = 0; i < batch_size; ++i) {
+    Gemm<float, CPUContext>(
+        TransA,
+        TransB,
+        M,
+        N,
+        K,
+        alpha,
+        A + i * A_stride,
+        B + i * B_stride,
+        beta,
+        C + i * C_stride,
+        context);
+  }
+#endif // CAFFE2_USE_MKL
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Vectorized transcendental functions.
+// Exp, Log, Tanh and Sigmoid for float use the Cephes polynomial
+// approximations, evaluated on whole SIMD registers (AVX-512, AVX2 or NEON,
+// whichever the file is compiled for). The tail of each array goes through
+// the same code with a scalar "register", so a value gets the same result
+// wherever it sits in the array. The maximum errors, measured over all
+// floats, are:
+//   Exp      1.3 ULP
+//   Log      0.9 ULP
+//   Tanh     1.4 ULP
+//   Sigmoid  3.2 ULP (for x > -87; below that the result is under 1e-38)
+// Setting --caffe2_fast_transcendental=false goes back to Eigen. When we are
+// built with MKL, Exp and Log always use VML, which is vectorized already.
+////////////////////////////////////////////////////////////////////////////////
+
+}  // namespace math
+}  // namespace caffe2
+
+CAFFE2_DEFINE_bool(
+    caffe2_fast_transcendental,
+    true,
+    "If set, Exp, Log, Tanh and Sigmoid on float use the vectorized "
+    "approximations in math_cpu.cc, which are within 3.2 ULP of the exact "
+    "result. Otherwise they use Eigen.");
+
+namespace caffe2 {
+namespace math {
+
+namespace {
+
+// Each of the register types below provides the same set of operations, so
+// that the kernels can be written once as templates. F holds floats, I holds
+// int32s and M is the result of a comparison.
+struct ScalarRegister {
+  typedef float F;
+  typedef int32_t I;
+  typedef bool M;
+  static constexpr int kWidth = 1;
+
+  static F Load(const float* p) { return *p; }
+  static void Store(float* p, F v) { *p = v; }
+  static F Set(float v) { return v; }
+  static I SetI(int32_t v) { return v; }
+  static F Add(F a, F b) { return a + b; }
+  static F Sub(F a, F b) { return a - b; }
+  static F Mul(F a, F b) { return a * b; }
+  static F Div(F a, F b) { return a / b; }
+  // a * b + c
+  static F Fma(F a, F b, F c) { return a * b + c; }
+  static F Min(F a, F b) { return a < b ? a : b; }
+  static F Max(F a, F b) { return a > b ? a : b; }
+  static F Floor(F a) { return std::floor(a); }
+  static M Lt(F a, F b) { return a < b; }
+  static M Eq(F a, F b) { return a == b; }
+  static M IsNan(F a) { return a != a; }
+  static F Select(M m, F a, F b) { return m ? a : b; }
+  static I ToInt(F a) { return static_cast<int32_t>(a); }
+  static F ToFloat(I a) { return static_cast<float>(a); }
+  static I AsInt(F a) {
+    int32_t i;
+    memcpy(&i, &a, sizeof(i));
+    return i;
+  }
+  static F AsFloat(I a) {
+    float f;
+    memcpy(&f, &a, sizeof(f));
+    return f;
+  }
+  static I AddI(I a, I b) { return a + b; }
+  static I AndI(I a, I b) { return a & b; }
+  static I OrI(I a, I b) { return a | b; }
+  static I Shl23(I a) {
+    return static_cast<int32_t>(static_cast<uint32_t>(a) << 23);
+  }
+  static I Shr23(I a) {
+    return static_cast<int32_t>(static_cast<uint32_t>(a) >> 23);
+  }
+};
+
+#if defined(__AVX512F__)
+
+struct SimdRegister {
+  typedef __m512 F;
+  typedef __m512i I;
+  typedef __mmask16 M;
+  static constexpr int kWidth = 16;
+
+  static F Load(const float* p) { return _mm512_loadu_ps(p); }
+  static void Store(float* p, F v) { _mm512_storeu_ps(p, v); }
+  static F Set(float v) { return _mm512_set1_ps(v); }
+  static I SetI(int32_t v) { return _mm512_set1_epi32(v); }
+  static F Add(F a, F b) { return _mm512_add_ps(a, b); }
+  static F Sub(F a, F b) { return _mm512_sub_ps(a, b); }
+  static F Mul(F a, F b) { return _mm512_mul_ps(a, b); }
+  static F Div(F a, F b) { return _mm512_div_ps(a, b); }
+  static F Fma(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+  static F Min(F a, F b) { return _mm512_min_ps(a, b); }
+  static F Max(F a, F b) { return _mm512_max_ps(a, b); }
+  static F Floor(F a) {
+    return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+  }
+  static M Lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+  static M Eq(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+  static M IsNan(F a) { return _mm512_cmp_ps_mask(a, a, _CMP_UNORD_Q); }
+  static F Select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+  static I ToInt(F a) { return _mm512_cvttps_epi32(a); }
+  static F ToFloat(I a) { return _mm512_cvtepi32_ps(a); }
+  static I AsInt(F a) { return _mm512_castps_si512(a); }
+  static F AsFloat(I a) { return _mm512_castsi512_ps(a); }
+  static I AddI(I a, I b) { return _mm512_add_epi32(a, b); }
+  static I AndI(I a, I b) { return _mm512_and_si512(a, b); }
+  static I OrI(I a, I b) { return _mm512_or_si512(a, b); }
+  static I Shl23(I a) { return _mm512_slli_epi32(a, 23); }
+  static I Shr23(I a) { return _mm512_srli_epi32(a, 23); }
+};
+#define CAFFE2_MATH_HAS_SIMD_REGISTER
+
+#elif defined(__AVX2__)
+
+struct SimdRegister {
+  typedef __m256 F;
+  typedef __m256i I;
+  typedef __m256 M;
+  static constexpr int kWidth = 8;
+
+  static F Load(const float* p) { return _mm256_loadu_ps(p); }
+  static void Store(float* p, F v) { _mm256_storeu_ps(p, v); }
+  static F Set(float v) { return _mm256_set1_ps(v); }
+  static I SetI(int32_t v) { return _mm256_set1_epi32(v); }
+  static F Add(F a, F b) { return _mm256_add_ps(a, b); }
+  static F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+  static F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+  static F Div(F a, F b) { return _mm256_div_ps(a, b); }
+  static F Fma(F a, F b, F c) {
+#ifdef __FMA__
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+  }
+  static F Min(F a, F b) { return _mm256_min_ps(a, b); }
+  static F Max(F a, F b) { return _mm256_max_ps(a, b); }
+  static F Floor(F a) { return _mm256_floor_ps(a); }
+  static M Lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static M Eq(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+  static M IsNan(F a) { return _mm256_cmp_ps(a, a, _CMP_UNORD_Q); }
+  static F Select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+  static I ToInt(F a) { return _mm256_cvttps_epi32(a); }
+  static F ToFloat(I a) { return _mm256_cvtepi32_ps(a); }
+  static I AsInt(F a) { return _mm256_castps_si256(a); }
+  static F AsFloat(I a) { return _mm256_castsi256_ps(a); }
+  static I AddI(I a, I b) { return _mm256_add_epi32(a, b); }
+  static I AndI(I a, I b) { return _mm256_and_si256(a, b); }
+  static I OrI(I a, I b) { return _mm256_or_si256(a, b); }
+  static I Shl23(I a) { return _mm256_slli_epi32(a, 23); }
+  static I Shr23(I a) { return _mm256_srli_epi32(a, 23); }
+};
+#define CAFFE2_MATH_HAS_SIMD_REGISTER
+
+#elif defined(__ARM_NEON__)
+
+struct SimdRegister {
+  typedef float32x4_t F;
+  typedef int32x4_t I;
+  typedef uint32x4_t M;
+  static constexpr int kWidth = 4;
+
+  static F Load(const float* p) { return vld1q_f32(p); }
+  static void Store(float* p, F v) { vst1q_f32(p, v); }
+  static F Set(float v) { return vdupq_n_f32(v); }
+  static I SetI(int32_t v) { return vdupq_n_s32(v); }
+  static F Add(F a, F b) { return vaddq_f32(a, b); }
+  static F Sub(F a, F b) { return vsubq_f32(a, b); }
+  static F Mul(F a, F b) { return vmulq_f32(a, b); }
+  static F Div(F a, F b) { return vdivq_f32_compat(a, b); }
+  static F Fma(F a, F b, F c) { return vfmaq_f32_compat(c, a, b); }
+  static F Min(F a, F b) { return vminq_f32(a, b); }
+  static F Max(F a, F b) { return vmaxq_f32(a, b); }
+  static F Floor(F a) { return vfloorq_f32_compat(a); }
+  static M Lt(F a, F b) { return vcltq_f32(a, b); }
+  static M Eq(F a, F b) { return vceqq_f32(a, b); }
+  static M IsNan(F a) { return vmvnq_u32(vceqq_f32(a, a)); }
+  static F Select(M m, F a, F b) { return vbslq_f32(m, a, b); }
+  static I ToInt(F a) { return vcvtq_s32_f32(a); }
+  static F ToFloat(I a) { return vcvtq_f32_s32(a); }
+  static I AsInt(F a) { return vreinterpretq_s32_f32(a); }
+  static F AsFloat(I a) { return vreinterpretq_f32_s32(a); }
+  static I AddI(I a, I b) { return vaddq_s32(a, b); }
+  static I AndI(I a, I b) { return vandq_s32(a, b); }
+  static I OrI(I a, I b) { return vorrq_s32(a, b); }
+  static I Shl23(I a) { return vshlq_n_s32(a, 23); }
+  static I Shr23(I a) {
+    return vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(a), 23));
+  }
+};
+#define CAFFE2_MATH_HAS_SIMD_REGISTER
+
+#endif
+
+// exp(x) = 2^n * exp(r), with n = round(x / ln(2)) and |r| <= ln(2) / 2.
+// ln(2) is split in two parts so that n * ln(2) is exact enough, and 2^n is
+// applied in two halves so that neither factor leaves the normal range.
+struct ExpKernel {
+  template <class R>
+  static typename R::F Run(typename R::F x) {
+    typedef typename R::F F;
+    const F nan_mask_src = x;
+    x = R::Min(R::Max(x, R::Set(-104.f)), R::Set(89.f));
+    F fx = R::Floor(R::Fma(x, R::Set(1.44269504088896341f), R::Set(0.5f)));
+    x = R::Fma(fx, R::Set(-0.693359375f), x);
+    x = R::Fma(fx, R::Set(2.12194440e-4f), x);
+    const F z = R::Mul(x, x);
+    F y = R::Set(1.9875691500E-4f);
+    y = R::Fma(y, x, R::Set(1.3981999507E-3f));
+    y = R::Fma(y, x, R::Set(8.3334519073E-3f));
+    y = R::Fma(y, x, R::Set(4.1665795894E-2f));
+    y = R::Fma(y, x, R::Set(1.6666665459E-1f));
+    y = R::Fma(y, x, R::Set(5.0000001201E-1f));
+    y = R::Fma(y, z, R::Add(x, R::Set(1.f)));
+    const F fx1 = R::Floor(R::Mul(fx, R::Set(0.5f)));
+    const F fx2 = R::Sub(fx, fx1);
+    const typename R::I bias = R::SetI(127);
+    y = R::Mul(y, R::AsFloat(R::Shl23(R::AddI(R::ToInt(fx1), bias))));
+    y = R::Mul(y, R::AsFloat(R::Shl23(R::AddI(R::ToInt(fx2), bias))));
+    return R::Select(R::IsNan(nan_mask_src), nan_mask_src, y);
+  }
+};
+
+// log(x) = e * ln(2) + log(m), with the mantissa m moved into
+// [sqrt(1/2), sqrt(2)) so that the polynomial only sees |m - 1| < 0.42.
+struct LogKernel {
+  template <class R>
+  static typename R::F Run(typename R::F x) {
+    typedef typename R::F F;
+    typedef typename R::I I;
+    const F input = x;
+    // Denormals are scaled up by 2^23 first.
+    const typename R::M denormal = R::Lt(x, R::Set(1.17549435e-38f));
+    x = R::Select(denormal, R::Mul(x, R::Set(8388608.f)), x);
+    const I bits = R::AsInt(x);
+    F e = R::ToFloat(R::AddI(R::Shr23(bits), R::SetI(-126)));
+    e = R::Sub(e, R::Select(denormal, R::Set(23.f), R::Set(0.f)));
+    F m = R::AsFloat(R::OrI(R::AndI(bits, R::SetI(0x007fffff)),
+                            R::SetI(0x3f000000)));
+    const typename R::M small = R::Lt(m, R::Set(0.707106781186547524f));
+    e = R::Sub(e, R::Select(small, R::Set(1.f), R::Set(0.f)));
+    m = R::Add(R::Sub(m, R::Set(1.f)), R::Select(small, m, R::Set(0.f)));
+    const F z = R::Mul(m, m);
+    F y = R::Set(7.0376836292E-2f);
+    y = R::Fma(y, m, R::Set(-1.1514610310E-1f));
+    y = R::Fma(y, m, R::Set(1.1676998740E-1f));
+    y = R::Fma(y, m, R::Set(-1.2420140846E-1f));
+    y = R::Fma(y, m, R::Set(1.4249322787E-1f));
+    y = R::Fma(y, m, R::Set(-1.6668057665E-1f));
+    y = R::Fma(y, m, R::Set(2.0000714765E-1f));
+    y = R::Fma(y, m, R::Set(-2.4999993993E-1f));
+    y = R::Fma(y, m, R::Set(3.3333331174E-1f));
+    y = R::Mul(R::Mul(y, m), z);
+    y = R::Fma(e, R::Set(-2.12194440e-4f), y);
+    y = R::Fma(z, R::Set(-0.5f), y);
+    y = R::Add(m, y);
+    y = R::Fma(e, R::Set(0.693359375f), y);
+    // log(+inf) = +inf, log(0) = -inf, log(x < 0) = NaN, NaN stays NaN.
+    const F inf = R::Set(std::numeric_limits<float>::infinity());
+    y = R::Select(R::Eq(input, inf), inf, y);
+    y = R::Select(R::Eq(input, R::Set(0.f)), R::Sub(R::Set(0.f), inf), y);
+    y = R::Select(
+        R::Lt(input, R::Set(0.f)),
+        R::Set(std::numeric_limits<float>::quiet_NaN()),
+        y);
+    return R::Select(R::IsNan(input), input, y);
+  }
+};
+
+// Small inputs use a polynomial, since 1 - 2 / (exp(2x) + 1) loses precision
+// to cancellation there.
+struct TanhKernel {
+  template <class R>
+  static typename R::F Run(typename R::F x) {
+    typedef typename R::F F;
+    typedef typename R::I I;
+    const I sign = R::AndI(R::AsInt(x), R::SetI(0x80000000));
+    const F ax = R::AsFloat(R::AndI(R::AsInt(x), R::SetI(0x7fffffff)));
+    const F large = R::Sub(
+        R::Set(1.f),
+        R::Div(
+            R::Set(2.f),
+            R::Add(ExpKernel::Run<R>(R::Add(ax, ax)), R::Set(1.f))));
+    const F z = R::Mul(ax, ax);
+    F y = R::Set(-5.70498872745E-3f);
+    y = R::Fma(y, z, R::Set(2.06390887954E-2f));
+    y = R::Fma(y, z, R::Set(-5.37397155531E-2f));
+    y = R::Fma(y, z, R::Set(1.33314422036E-1f));
+    y = R::Fma(y, z, R::Set(-3.33332819422E-1f));
+    y = R::Fma(R::Mul(y, z), ax, ax);
+    y = R::Select(R::Lt(R::Set(0.625f), ax), large, y);
+    return R::AsFloat(R::OrI(R::AsInt(y), sign));
+  }
+};
+
+struct SigmoidKernel {
+  template <class R>
+  static typename R::F Run(typename R::F x) {
+    const typename R::F one = R::Set(1.f);
+    return R::Div(
+        one, R::Add(one, ExpKernel::Run<R>(R::Sub(R::Set(0.f), x))));
+  }
+};
+
+// Applies the kernel to x[0:N], a register at a time.
+template <class Kernel>
+void VectorizedApply(const int N, const float* x, float* y) {
+  int i = 0;
+#ifdef CAFFE2_MATH_HAS_SIMD_REGISTER
+  for (; i + SimdRegister::kWidth <= N; i += SimdRegister::kWidth) {
+    SimdRegister::Store(
+        y + i, Kernel::template Run<SimdRegister>(SimdRegister::Load(x + i)));
+  }
+#endif
+  for (; i < N; ++i) {
+    y[i] = Kernel::template Run<ScalarRegister>(x[i]);
+  }
+}
+#undef CAFFE2_MATH_HAS_SIMD_REGISTER
+
+} // namespace
+
+template <>
+void Tanh<float, CPUContext>(
+    const int N, const float* x, float* y, CPUContext* context) {
+  if (FLAGS_caffe2_fast_transcendental) {
+    VectorizedApply<TanhKernel>(N, x, y);
+    return;
+  }
+  ConstEigenVectorArrayMap<float> x_arr(x, N);
+  EigenVectorMap<float>(y, N) = 1 - 2 * ((x_arr * 2).exp() + 1).inverse();
+}
+
+template <>
+void Tanh<double, CPUContext>(
+    const int N, const double* x, double* y, CPUContext* context) {
+  ConstEigenVectorArrayMap<double> x_arr(x, N);
+  EigenVectorMap<double>(y, N) = 1 - 2 * ((x_arr * 2).exp() + 1).inverse();
+}
+
+template <>
+void Sigmoid<float, CPUContext>(
+    const int N, const float* x, float* y, CPUContext* context) {
+  if (FLAGS_caffe2_fast_transcendental) {
+    VectorizedApply<SigmoidKernel>(N, x, y);
+    return;
+  }
+  EigenVectorMap<float>(y, N) =
+      ((-ConstEigenVectorArrayMap<float>(x, N)).exp() + 1).inverse();
+}
+
+template <>
+void Sigmoid<double, CPUContext>(
+    const int N, const double* x, double* y, CPUContext* context) {
+  EigenVectorMap<double>(y, N) =
+      ((-ConstEigenVectorArrayMap<double>(x, N)).exp() + 1).inverse();
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // MKL VML alternatives.
 // Depending on whether we are using MKL, we will delegate the Caffe math
@@ -459,14 +911,32 @@ void Funcname<T, CPUContext>(const int N, const T* x, T* y,                    \
                              CPUContext* context) {                            \
   EigenVectorMap<T>(y, N) = ConstEigenVectorMap<T>(x, N).array().expr();       \
 }
-DELEGATE_SIMPLE_UNARY_FUNCTION(float, Exp, exp)
 DELEGATE_SIMPLE_UNARY_FUNCTION(double, Exp, exp)
-DELEGATE_SIMPLE_UNARY_FUNCTION(float, Log, log)
 DELEGATE_SIMPLE_UNARY_FUNCTION(double, Log, log)
 DELEGATE_SIMPLE_UNARY_FUNCTION(float, Sqr, square)
 DELEGATE_SIMPLE_UNARY_FUNCTION(double, Sqr, square)
 #undef DELEGATE_SIMPLE_UNARY_FUNCTION
 
+template <>
+void Exp<float, CPUContext>(
+    const int N, const float* x, float* y, CPUContext* context) {
+  if (FLAGS_caffe2_fast_transcendental) {
+    VectorizedApply<ExpKernel>(N, x, y);
+    return;
+  }
+  EigenVectorMap<float>(y, N) = ConstEigenVectorMap<float>(x, N).array().exp();
+}
+
+template <>
+void Log<float, CPUContext>(
+    const int N, const float* x, float* y, CPUContext* context) {
+  if (FLAGS_caffe2_fast_transcendental) {
+    VectorizedApply<LogKernel>(N, x, y);
+    return;
+  }
+  EigenVectorMap<float>(y, N) = ConstEigenVectorMap<float>(x, N).array().log();
+}
+
 #define DELEGATE_POWX_FUNCTION(T)                                              \
 template <>                                                                    \
 void Powx<T, CPUContext>(                                                      \
@@ -600,13 +1070,29 @@ CAFFE2_SPECIALIZED_SET(char);
 CAFFE2_SPECIALIZED_SET(uint8_t);
 #undef CAFFE2_SPECIALIZED_SET
 
-#define CAFFE2_INSTANTIATE_BINARY_OP(name, op, T)                          \
+// The comparison and logical ops share the broadcast engine with the
+// corresponding operators, see math::detail::BroadcastBinary.
+#define CAFFE2_BINARY_OP_KERNEL(name, op)                       \
+  struct name##Kernel {                                         \
+    template <typename T, typename R>                           \
+    static void Run(size_t n, const T* a, const T* b, R* y) {   \
+      for (size_t i = 0; i < n; ++i) {                          \
+        y[i] = a[i] op b[i];                                    \
+      }                                                         \
+    }                                                           \
+    template <typename T, typename R>                           \
+    static void RunScalar(size_t n, const T* a, T b, R* y) {    \
+      for (size_t i = 0; i < n; ++i) {                          \
+        y[i] = a[i] op b;                                       \
+      }                                                         \
+    }                                                           \
+  };
+
+#define CAFFE2_INSTANTIATE_BINARY_OP(name, T)                              \
   template <>                                                              \
   void name<T, CPUContext>(                                                \
       const int n, const T* a, const T* b, bool* y, CPUContext* context) { \
-    for (int i = 0; i < n; ++i) {                                          \
-      y[i] = a[i] op b[i];                                                 \
-    }                                                                      \
+    detail::BroadcastBinary<name##Kernel>(1, n, 1, a, b, y);               \
   }                                                                        \
   template <>                                                              \
   void name##ToRow<T, CPUContext>(                                         \
@@ -616,25 +1102,27 @@ CAFFE2_SPECIALIZED_SET(uint8_t);
       const T* b,                                                          \
       bool* y,                                                             \
       CPUContext* context) {                                               \
-    for (int i = 0; i < n * m; ++i) {                                      \
-      y[i] = a[i] op b[i % n];                                             \
-    }                                                                      \
+    detail::BroadcastBinary<name##Kernel>(m, n, 1, a, b, y);               \
   }
 
-#define CAFFE2_DEFINE_BINARY_OP(name, op)         \
-  CAFFE2_INSTANTIATE_BINARY_OP(name, op, float)   \
-  CAFFE2_INSTANTIATE_BINARY_OP(name, op, double)  \
-  CAFFE2_INSTANTIATE_BINARY_OP(name, op, int32_t) \
-  CAFFE2_INSTANTIATE_BINARY_OP(name, op, int64_t)
+#define CAFFE2_DEFINE_BINARY_OP(name, op)     \
+  CAFFE2_BINARY_OP_KERNEL(name, op)           \
+  CAFFE2_INSTANTIATE_BINARY_OP(name, float)   \
+  CAFFE2_INSTANTIATE_BINARY_OP(name, double)  \
+  CAFFE2_INSTANTIATE_BINARY_OP(name, int32_t) \
+  CAFFE2_INSTANTIATE_BINARY_OP(name, int64_t)
 
 CAFFE2_DEFINE_BINARY_OP(LT, <);
 CAFFE2_DEFINE_BINARY_OP(LE, <=);
 CAFFE2_DEFINE_BINARY_OP(GT, >);
 CAFFE2_DEFINE_BINARY_OP(GE, >=);
 
-CAFFE2_INSTANTIATE_BINARY_OP(Or, |, bool);
-CAFFE2_INSTANTIATE_BINARY_OP(And, &, bool);
-CAFFE2_INSTANTIATE_BINARY_OP(Xor, ^, bool);
+CAFFE2_BINARY_OP_KERNEL(Or, |)
+CAFFE2_INSTANTIATE_BINARY_OP(Or, bool);
+CAFFE2_BINARY_OP_KERNEL(And, &)
+CAFFE2_INSTANTIATE_BINARY_OP(And, bool);
+CAFFE2_BINARY_OP_KERNEL(Xor, ^)
+CAFFE2_INSTANTIATE_BINARY_OP(Xor, bool);
 
 template <>
 void Not<bool, CPUContext>(
@@ -649,15 +1137,26 @@ void Not<bool, CPUContext>(
 
 #undef CAFFE2_DEFINE_BINARY_OP
 #undef CAFFE2_INSTANTIATE_BINARY_OP
+#undef CAFFE2_BINARY_OP_KERNEL
 
+// The floats are drawn from the Philox stream of the context, four per
+// block, in parallel. Integers and unique samples still come from the
+// sequential generator of the context.
 template <>
 void RandUniform<float, CPUContext>(
     const int n, const float a, const float b, float* r,
     CPUContext* context) {
-  std::uniform_real_distribution<float> distribution(a, b);
-  for (int i = 0; i < n; ++i) {
-    r[i] = distribution(context->RandGenerator());
-  }
+  const int64_t num_blocks = (static_cast<int64_t>(n) + 3) / 4;
+  const float scale = b - a;
+  philox::ForEachBlock(
+      context->PhiloxKey(),
+      context->ReservePhiloxBlocks(num_blocks),
+      num_blocks,
+      [=](int64_t block, const uint32_t* x) {
+        for (int j = 0; j < 4 && block * 4 + j < n; ++j) {
+          r[block * 4 + j] = a + scale * philox::ToUniform(x[j]);
+        }
+      });
 }
 
 template <>
@@ -701,14 +1200,28 @@ CAFFE2_SPECIALIZED_RAND_UNIFORM_UNIQUE(int32_t);
 CAFFE2_SPECIALIZED_RAND_UNIFORM_UNIQUE(int64_t);
 #undef CAFFE2_SPECIALIZED_RAND_UNIFORM_UNIQUE
 
+// Box-Muller on the two pairs of numbers of each block of the Philox stream.
 template <>
 void RandGaussian<float, CPUContext>(
     const int n, const float mean, const float std, float* r,
     CPUContext* context) {
-  std::normal_distribution<float> distribution(mean, std);
-  for (int i = 0; i < n; ++i) {
-    r[i] = distribution(context->RandGenerator());
-  }
+  const int64_t num_blocks = (static_cast<int64_t>(n) + 3) / 4;
+  philox::ForEachBlock(
+      context->PhiloxKey(),
+      context->ReservePhiloxBlocks(num_blocks),
+      num_blocks,
+      [=](int64_t block, const uint32_t* x) {
+        for (int j = 0; j < 4 && block * 4 + j < n; j += 2) {
+          const float radius =
+              std * std::sqrt(-2 * std::log(philox::ToUniformNonZero(x[j])));
+          const float angle =
+              static_cast<float>(2 * M_PI) * philox::ToUniform(x[j + 1]);
+          r[block * 4 + j] = mean + radius * std::cos(angle);
+          if (block * 4 + j + 1 < n) {
+            r[block * 4 + j + 1] = mean + radius * std::sin(angle);
+          }
+        }
+      });
 }
 
 template<>
@@ -1143,6 +1656,141 @@ void BiasCHW<float, CPUContext>(
   }
 }
 
+namespace {
+
+// Transpose2D goes through the matrices in square tiles of kTransposeTile,
+// so that the rows read and the rows written both stay in the cache.
+constexpr int kTransposeTile = 32;
+
+// B[j][i] = A[i][j] for the tile of A at rows [i0, i1) and columns [j0, j1).
+template <typename T>
+inline void TransposeTile(
+    const int rows,
+    const int cols,
+    const int i0,
+    const int i1,
+    const int j0,
+    const int j1,
+    const T* A,
+    T* B) {
+  for (int i = i0; i < i1; ++i) {
+    for (int j = j0; j < j1; ++j) {
+      B[j * rows + i] = A[i * cols + j];
+    }
+  }
+}
+
+#ifdef __AVX__
+// Transposes the 8 x 8 block at A, with rows lda apart, into B.
+inline void Transpose8x8(const float* A, const int lda, float* B,
+                         const int ldb) {
+  __m256 r0 = _mm256_loadu_ps(A + 0 * lda);
+  __m256 r1 = _mm256_loadu_ps(A + 1 * lda);
+  __m256 r2 = _mm256_loadu_ps(A + 2 * lda);
+  __m256 r3 = _mm256_loadu_ps(A + 3 * lda);
+  __m256 r4 = _mm256_loadu_ps(A + 4 * lda);
+  __m256 r5 = _mm256_loadu_ps(A + 5 * lda);
+  __m256 r6 = _mm256_loadu_ps(A + 6 * lda);
+  __m256 r7 = _mm256_loadu_ps(A + 7 * lda);
+  const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+  const __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+  const __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+  const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+  const __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+  const __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+  const __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+  const __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+  const __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  const __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  const __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+  const __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+  _mm256_storeu_ps(B + 0 * ldb, _mm256_permute2f128_ps(s0, s4, 0x20));
+  _mm256_storeu_ps(B + 1 * ldb, _mm256_permute2f128_ps(s1, s5, 0x20));
+  _mm256_storeu_ps(B + 2 * ldb, _mm256_permute2f128_ps(s2, s6, 0x20));
+  _mm256_storeu_ps(B + 3 * ldb, _mm256_permute2f128_ps(s3, s7, 0x20));
+  _mm256_storeu_ps(B + 4 * ldb, _mm256_permute2f128_ps(s0, s4, 0x31));
+  _mm256_storeu_ps(B + 5 * ldb, _mm256_permute2f128_ps(s1, s5, 0x31));
+  _mm256_storeu_ps(B + 6 * ldb, _mm256_permute2f128_ps(s2, s6, 0x31));
+  _mm256_storeu_ps(B + 7 * ldb, _mm256_permute2f128_ps(s3, s7, 0x31));
+}
+
+template <>
+inline void TransposeTile<float>(
+    const int rows,
+    const int cols,
+    const int i0,
+    const int i1,
+    const int j0,
+    const int j1,
+    const float* A,
+    float* B) {
+  // Whole 8 x 8 blocks, then the rest of the tile one element at a time.
+  const int i8 = i0 + (i1 - i0) / 8 * 8;
+  const int j8 = j0 + (j1 - j0) / 8 * 8;
+  for (int i = i0; i < i8; i += 8) {
+    for (int j = j0; j < j8; j += 8) {
+      Transpose8x8(A + i * cols + j, cols, B + j * rows + i, rows);
+    }
+  }
+  for (int i = i0; i < i1; ++i) {
+    for (int j = (i < i8 ? j8 : j0); j < j1; ++j) {
+      B[j * rows + i] = A[i * cols + j];
+    }
+  }
+}
+#endif // __AVX__
+
+template <typename T>
+void Transpose2DImpl(
+    const int batch_size,
+    const int rows,
+    const int cols,
+    const T* A,
+    T* B) {
+  const int row_tiles = (rows + kTransposeTile - 1) / kTransposeTile;
+  const int col_tiles = (cols + kTransposeTile - 1) / kTransposeTile;
+  const int tiles = batch_size * row_tiles * col_tiles;
+  const int size = rows * cols;
+#pragma omp parallel for if (static_cast<int64_t>(batch_size) * size > 65536)
+  for (int tile = 0; tile < tiles; ++tile) {
+    const int b = tile / (row_tiles * col_tiles);
+    const int i0 = tile / col_tiles % row_tiles * kTransposeTile;
+    const int j0 = tile % col_tiles * kTransposeTile;
+    TransposeTile(
+        rows,
+        cols,
+        i0,
+        std::min(i0 + kTransposeTile, rows),
+        j0,
+        std::min(j0 + kTransposeTile, cols),
+        A + b * size,
+        B + b * size);
+  }
+}
+
+} // namespace
+
+#define CAFFE2_SPECIALIZED_TRANSPOSE_2D(T)                              \
+  template <>                                                          \
+  void Transpose2D<T, CPUContext>(                                     \
+      const int batch_size,                                            \
+      const int rows,                                                  \
+      const int cols,                                                  \
+      const T* A,                                                      \
+      T* B,                                                            \
+      CPUContext* context) {                                           \
+    Transpose2DImpl<T>(batch_size, rows, cols, A, B);                  \
+  }
+CAFFE2_SPECIALIZED_TRANSPOSE_2D(float)
+CAFFE2_SPECIALIZED_TRANSPOSE_2D(double)
+CAFFE2_SPECIALIZED_TRANSPOSE_2D(int)
+CAFFE2_SPECIALIZED_TRANSPOSE_2D(long)
+#undef CAFFE2_SPECIALIZED_TRANSPOSE_2D
+
 template <>
 void CopyMatrix<CPUContext>(
     const size_t itemsize, const int M, const int N, const void* A,
@@ -7,6 +7,7 @@
 
 #include "caffe2/utils/math.h"
 #include "caffe2/core/context_gpu.h"
+#include "caffe2/utils/fixed_divisor.h"
 
 #if THRUST_VERSION >= 100800
 #define THRUST_SUPPORTS_PER_THREAD
@@ -66,6 +67,33 @@ DELEGATE_SIMPLE_CUDA_BINARY_FUNCTION(float, Sub, -);
 DELEGATE_SIMPLE_CUDA_BINARY_FUNCTION(float, Mul, *);
 DELEGATE_SIMPLE_CUDA_BINARY_FUNCTION(float, Div, /);
 
+#ifdef CAFFE_HAS_CUDA_FP16
+__global__ void AddHalfKernel(
+    const int N, const half* a, const half* b, half* y) {
+  CUDA_1D_KERNEL_LOOP(i, N) {
+    y[i] = __float2half(__half2float(a[i]) + __half2float(b[i]));
+  }
+}
+
+template <>
+void Add<float16, CUDAContext>(
+    const int N,
+    const float16* a,
+    const float16* b,
+    float16* y,
+    CUDAContext* context) {
+  AddHalfKernel<<<
+      CAFFE_GET_BLOCKS(N),
+      CAFFE_CUDA_NUM_THREADS,
+      0,
+      context->cuda_stream()>>>(
+      N,
+      reinterpret_cast<const half*>(a),
+      reinterpret_cast<const half*>(b),
+      reinterpret_cast<half*>(y));
+}
+#endif // CAFFE_HAS_CUDA_FP16
+
 // Caffe2 gemm provides a simpler interface to the gemm functions, with the
 // limitation that the data has to be contiguous in memory.
 template <>
@@ -101,6 +129,70 @@ void GemmEx<float, CUDAContext>(
       N, M, K, &alpha, B, ldb, A, lda, &beta, C, ldc));
 }
 
+template <>
+void GemmBatched<float, CUDAContext>(
+    const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB,
+    const int batch_size,
+    const int M,
+    const int N,
+    const int K,
+    const float alpha,
+    const float* A,
+    const int A_stride,
+    const float* B,
+    const int B_stride,
+    const float beta,
+    float* C,
+    const int C_stride,
+    CUDAContext* context) {
+#if CUDA_VERSION >= 8000
+  // Note that cublas follows fortran order, so the order is different from
+  // the cblas convention.
+  int lda = (TransA == CblasNoTrans) ? K : M;
+  int ldb = (TransB == CblasNoTrans) ? N : K;
+  cublasOperation_t cuTransA =
+      (TransA == CblasNoTrans) ? CUBLAS_OP_N : CUBLAS_OP_T;
+  cublasOperation_t cuTransB =
+      (TransB == CblasNoTrans) ? CUBLAS_OP_N : CUBLAS_OP_T;
+  CUBLAS_CHECK(cublasSgemmStridedBatched(
+      context->cublas_handle(),
+      cuTransB,
+      cuTransA,
+      N,
+      M,
+      K,
+      &alpha,
+      B,
+      ldb,
+      B_stride,
+      A,
+      lda,
+      A_stride,
+      &beta,
+      C,
+      N,
+      C_stride,
+      batch_size));
+#else
+  // Strided batched gemm needs cublas 8.
+  for (int i = 0; i < batch_size; ++i) {
+    Gemm<float, CUDAContext>(
+        TransA,
+        TransB,
+        M,
+        N,
+        K,
+        alpha,
+        A + i * A_stride,
+        B + i * B_stride,
+        beta,
+        C + i * C_stride,
+        context);
+  }
+#endif
+}
+
 template <>
 void Gemv<float, CUDAContext>(
     const CBLAS_TRANSPOSE TransA, const int M, const int N, const float alpha,
@@ -428,8 +520,12 @@ void Axpby<double, CUDAContext>(
 
 namespace {
 
+// The image to column kernels split their indices with IndexDecomposer, and
+// the column to image kernels also divide by the strides and dilations with
+// FixedDivisor.
 template <typename T>
-__global__ void im2col_gpu_kernel_nchw(const int n, const T* data_im,
+__global__ void im2col_gpu_kernel_nchw(const int n,
+    const IndexDecomposer<3> col_dims, const T* data_im,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int dilation_h, const int dilation_w,
     const int pad_t, const int pad_l,
@@ -438,10 +534,11 @@ __global__ void im2col_gpu_kernel_nchw(const int n, const T* data_im,
     T* data_col) {
 
   CUDA_1D_KERNEL_LOOP(index, n) {
-    int w_out = index % width_col;
-    int h_index = index / width_col;
-    int h_out = h_index % height_col;
-    int channel_in = h_index / height_col;
+    int coords[3];
+    col_dims.decompose(index, coords);
+    int channel_in = coords[0];
+    int h_out = coords[1];
+    int w_out = coords[2];
     int channel_out = channel_in * kernel_h * kernel_w;
     int h_in = h_out * stride_h - pad_t;
     int w_in = w_out * stride_w - pad_l;
@@ -462,7 +559,8 @@ __global__ void im2col_gpu_kernel_nchw(const int n, const T* data_im,
 }
 
 template <typename T>
-__global__ void im2col_gpu_kernel_nhwc(const int n, const T* data_im,
+__global__ void im2col_gpu_kernel_nhwc(const int n,
+    const IndexDecomposer<3> col_dims, const T* data_im,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int dilation_h, const int dilation_w,
     const int pad_t, const int pad_l,
@@ -474,9 +572,11 @@ __global__ void im2col_gpu_kernel_nhwc(const int n, const T* data_im,
   const int dkernel_w = dilation_w * (kernel_w - 1) + 1;
 
   CUDA_1D_KERNEL_LOOP(index, n) {
-    int channel_in = index % channels;
-    int w_out = index / channels % width_col;
-    int h_out = index / channels / width_col;
+    int coords[3];
+    col_dims.decompose(index, coords);
+    int h_out = coords[0];
+    int w_out = coords[1];
+    int channel_in = coords[2];
     int h_in = h_out * stride_h - pad_t;
     int w_in = w_out * stride_w - pad_l;
     T* local_data_col = data_col +
@@ -495,37 +595,42 @@ __global__ void im2col_gpu_kernel_nhwc(const int n, const T* data_im,
 }
 
 template <typename T>
-__global__ void col2im_gpu_kernel_nchw(const int n, const T* data_col,
+__global__ void col2im_gpu_kernel_nchw(const int n,
+    const IndexDecomposer<3> im_dims, const T* data_col,
     const int height, const int width,
     const int patch_h, const int patch_w,
-    const int dilation_h, const int dilation_w,
+    const FixedDivisor<int32_t> dilation_h,
+    const FixedDivisor<int32_t> dilation_w,
     const int pad_t, const int pad_l,
-    const int stride_h, const int stride_w,
+    const FixedDivisor<int32_t> stride_h, const FixedDivisor<int32_t> stride_w,
     const int height_col, const int width_col,
     T* data_im) {
 
-  const int dpatch_h = dilation_h * (patch_h - 1) + 1;
-  const int dpatch_w = dilation_w * (patch_w - 1) + 1;
+  const int dpatch_h = dilation_h.d() * (patch_h - 1) + 1;
+  const int dpatch_w = dilation_w.d() * (patch_w - 1) + 1;
 
   CUDA_1D_KERNEL_LOOP(index, n) {
     T val = 0;
-    int w = index % width + pad_l;
-    int h = (index / width) % height + pad_t;
-    int c = index / (width * height);
+    int coords[3];
+    im_dims.decompose(index, coords);
+    int c = coords[0];
+    int h = coords[1] + pad_t;
+    int w = coords[2] + pad_l;
 
     // compute the start and end of the output
-    int w_col_start = (w < dpatch_w) ? 0 : (w - dpatch_w) / stride_w + 1;
-    int w_col_end = min(w / stride_w + 1, width_col);
-    int h_col_start = (h < dpatch_h) ? 0 : (h - dpatch_h) / stride_h + 1;
-    int h_col_end = min(h / stride_h + 1, height_col);
+    int w_col_start =
+        (w < dpatch_w) ? 0 : stride_w.div(w - dpatch_w) + 1;
+    int w_col_end = min(stride_w.div(w) + 1, width_col);
+    int h_col_start =
+        (h < dpatch_h) ? 0 : stride_h.div(h - dpatch_h) + 1;
+    int h_col_end = min(stride_h.div(h) + 1, height_col);
 
     for (int h_col = h_col_start; h_col < h_col_end; ++h_col) {
       for (int w_col = w_col_start; w_col < w_col_end; ++w_col) {
-        int h_k = (h - h_col * stride_h);
-        int w_k = (w - w_col * stride_w);
-        if (h_k % dilation_h == 0 && w_k % dilation_w == 0) {
-          h_k /= dilation_h;
-          w_k /= dilation_w;
+        int h_k, h_k_rem, w_k, w_k_rem;
+        dilation_h.divMod(h - h_col * stride_h.d(), h_k, h_k_rem);
+        dilation_w.divMod(w - w_col * stride_w.d(), w_k, w_k_rem);
+        if (h_k_rem == 0 && w_k_rem == 0) {
           int data_col_index =
             (((c * patch_h + h_k) * patch_w + w_k) * height_col + h_col) * width_col + w_col;
           val += data_col[data_col_index];
@@ -537,37 +642,42 @@ __global__ void col2im_gpu_kernel_nchw(const int n, const T* data_col,
 }
 
 template <typename T>
-__global__ void col2im_gpu_kernel_nhwc(const int n, const T* data_col,
+__global__ void col2im_gpu_kernel_nhwc(const int n,
+    const IndexDecomposer<3> im_dims, const T* data_col,
     const int width, const int channels,
     const int patch_h, const int patch_w,
-    const int dilation_h, const int dilation_w,
+    const FixedDivisor<int32_t> dilation_h,
+    const FixedDivisor<int32_t> dilation_w,
     const int pad_t, const int pad_l,
-    const int stride_h, const int stride_w,
+    const FixedDivisor<int32_t> stride_h, const FixedDivisor<int32_t> stride_w,
     const int height_col, const int width_col,
     T* data_im) {
 
-  const int dpatch_h = dilation_h * (patch_h - 1) + 1;
-  const int dpatch_w = dilation_w * (patch_w - 1) + 1;
+  const int dpatch_h = dilation_h.d() * (patch_h - 1) + 1;
+  const int dpatch_w = dilation_w.d() * (patch_w - 1) + 1;
 
   CUDA_1D_KERNEL_LOOP(index, n) {
     T val = 0;
-    int c = index % channels;
-    int w = index / channels % width + pad_l;
-    int h = index / channels / width + pad_t;
+    int coords[3];
+    im_dims.decompose(index, coords);
+    int h = coords[0] + pad_t;
+    int w = coords[1] + pad_l;
+    int c = coords[2];
     // compute the start and end of the output
-    int w_col_start = (w < dpatch_w) ? 0 : (w - dpatch_w) / stride_w + 1;
-    int w_col_end = min(w / stride_w + 1, width_col);
-    int h_col_start = (h < dpatch_h) ? 0 : (h - dpatch_h) / stride_h + 1;
-    int h_col_end = min(h / stride_h + 1, height_col);
+    int w_col_start =
+        (w < dpatch_w) ? 0 : stride_w.div(w - dpatch_w) + 1;
+    int w_col_end = min(stride_w.div(w) + 1, width_col);
+    int h_col_start =
+        (h < dpatch_h) ? 0 : stride_h.div(h - dpatch_h) + 1;
+    int h_col_end = min(stride_h.div(h) + 1, height_col);
     int channels_col = patch_h * patch_w * channels;
 
     for (int h_col = h_col_start; h_col < h_col_end; ++h_col) {
       for (int w_col = w_col_start; w_col < w_col_end; ++w_col) {
-        int h_k = h - h_col * stride_h;
-        int w_k = w - w_col * stride_w;
-        if (h_k % dilation_h == 0 && w_k % dilation_w == 0) {
-          h_k /= dilation_h;
-          w_k /= dilation_w;
+        int h_k, h_k_rem, w_k, w_k_rem;
+        dilation_h.divMod(h - h_col * stride_h.d(), h_k, h_k_rem);
+        dilation_w.divMod(w - w_col * stride_w.d(), w_k, w_k_rem);
+        if (h_k_rem == 0 && w_k_rem == 0) {
           int c_col = (h_k * patch_w + w_k) * channels + c;
           val += data_col[(h_col * width_col + w_col) * channels_col + c_col];
         }
@@ -600,7 +710,9 @@ void Im2col<float, CUDAContext, StorageOrder::NCHW>(
   im2col_gpu_kernel_nchw<float><<<CAFFE_GET_BLOCKS(num_kernels),
                                   CAFFE_CUDA_NUM_THREADS, 0,
                                   context->cuda_stream()>>>(
-      num_kernels, data_im, height, width, kernel_h, kernel_w,
+      num_kernels,
+      IndexDecomposer<3>{channels, height_col, width_col},
+      data_im, height, width, kernel_h, kernel_w,
       dilation_h, dilation_w, pad_t, pad_l, stride_h, stride_w,
       height_col, width_col, data_col);
 }
@@ -626,7 +738,9 @@ void Im2col<float, CUDAContext, StorageOrder::NHWC>(
   im2col_gpu_kernel_nhwc<float><<<CAFFE_GET_BLOCKS(num_kernels),
                                   CAFFE_CUDA_NUM_THREADS, 0,
                                   context->cuda_stream()>>>(
-      num_kernels, data_im, height, width, kernel_h, kernel_w,
+      num_kernels,
+      IndexDecomposer<3>{height_col, width_col, channels},
+      data_im, height, width, kernel_h, kernel_w,
       dilation_h, dilation_w, pad_t, pad_l, stride_h, stride_w,
       width_col, channels, data_col);
 }
@@ -652,9 +766,11 @@ void Col2im<float, CUDAContext, StorageOrder::NCHW>(
   col2im_gpu_kernel_nchw<float><<<CAFFE_GET_BLOCKS(num_kernels),
                                   CAFFE_CUDA_NUM_THREADS, 0,
                                   context->cuda_stream()>>>(
-      num_kernels, data_col, height, width, kernel_h, kernel_w,
-      dilation_h, dilation_w,
-      pad_t, pad_l, stride_h, stride_w,
+      num_kernels, IndexDecomposer<3>{channels, height, width},
+      data_col, height, width, kernel_h, kernel_w,
+      FixedDivisor<int32_t>(dilation_h), FixedDivisor<int32_t>(dilation_w),
+      pad_t, pad_l,
+      FixedDivisor<int32_t>(stride_h), FixedDivisor<int32_t>(stride_w),
       height_col, width_col, data_im);
 }
 
@@ -678,9 +794,12 @@ void Col2im<float, CUDAContext, StorageOrder::NHWC>(
   col2im_gpu_kernel_nhwc<float><<<CAFFE_GET_BLOCKS(num_kernels),
                                   CAFFE_CUDA_NUM_THREADS, 0,
                                   context->cuda_stream()>>>(
-      num_kernels, data_col, width, channels, kernel_h, kernel_w,
-      dilation_h, dilation_w,
-      pad_t, pad_l, stride_h, stride_w, height_col, width_col, data_im);
+      num_kernels, IndexDecomposer<3>{height, width, channels},
+      data_col, width, channels, kernel_h, kernel_w,
+      FixedDivisor<int32_t>(dilation_h), FixedDivisor<int32_t>(dilation_w),
+      pad_t, pad_l,
+      FixedDivisor<int32_t>(stride_h), FixedDivisor<int32_t>(stride_w),
+      height_col, width_col, data_im);
 }
 
 template <>
@@ -691,5 +810,48 @@ void CopyMatrix<CUDAContext>(
                     cudaMemcpyDeviceToDevice, context->cuda_stream());
 }
 
+namespace {
+
+// One thread per element, reading A in order.
+template <typename T>
+__global__ void Transpose2DKernel(
+    const int n,
+    const IndexDecomposer<3> dims,
+    const int rows,
+    const int cols,
+    const T* A,
+    T* B) {
+  CUDA_1D_KERNEL_LOOP(index, n) {
+    int coords[3];
+    dims.decompose(index, coords);
+    B[(coords[0] * cols + coords[2]) * rows + coords[1]] = A[index];
+  }
+}
+
+}  // namespace
+
+#define CAFFE2_SPECIALIZED_CUDA_TRANSPOSE_2D(T)                           \
+  template <>                                                             \
+  void Transpose2D<T, CUDAContext>(                                       \
+      const int batch_size,                                               \
+      const int rows,                                                     \
+      const int cols,                                                     \
+      const T* A,                                                         \
+      T* B,                                                               \
+      CUDAContext* context) {                                             \
+    const int n = batch_size * rows * cols;                               \
+    if (n == 0) {                                                         \
+      return;                                                             \
+    }                                                                     \
+    Transpose2DKernel<T><<<CAFFE_GET_BLOCKS(n), CAFFE_CUDA_NUM_THREADS,   \
+                           0, context->cuda_stream()>>>(                  \
+        n, IndexDecomposer<3>{batch_size, rows, cols}, rows, cols, A, B); \
+  }
+CAFFE2_SPECIALIZED_CUDA_TRANSPOSE_2D(float)
+CAFFE2_SPECIALIZED_CUDA_TRANSPOSE_2D(double)
+CAFFE2_SPECIALIZED_CUDA_TRANSPOSE_2D(int)
+CAFFE2_SPECIALIZED_CUDA_TRANSPOSE_2D(long)
+#undef CAFFE2_SPECIALIZED_CUDA_TRANSPOSE_2D
+
 }  // namespace math
 }  // namespace caffe2
@@ -1,6 +1,11 @@
+#include <cmath>
+#include <random>
+#include <vector>
+
 #include "caffe2/core/blob.h"
 #include "caffe2/core/tensor.h"
 #include "caffe2/utils/math.h"
+#include "caffe2/utils/philox_random.h"
 #include "caffe2/core/context.h"
 #include "caffe2/proto/caffe2.pb.h"
 #include "gtest/gtest.h"
@@ -181,6 +186,123 @@ TEST(MathTest, GemvTrans) {
   }
 }
 
-}  // namespace caffe2
 
+TEST(MathTest, Transcendental) {
+  DeviceOption option;
+  CPUContext cpu_context(option);
+  // 103 values is enough for full registers and a scalar tail.
+  const int N = 103;
+  std::vector<float> x(N);
+  std::vector<float> y(N);
+  for (int i = 0; i < N; ++i) {
+    x[i] = -20.0f + 0.4f * i;
+  }
+  math::Exp<float, CPUContext>(N, x.data(), y.data(), &cpu_context);
+  for (int i = 0; i < N; ++i) {
+    EXPECT_NEAR(y[i], std::exp(x[i]), 1e-6 * std::exp(x[i])) << x[i];
+  }
+  math::Tanh<float, CPUContext>(N, x.data(), y.data(), &cpu_context);
+  for (int i = 0; i < N; ++i) {
+    EXPECT_NEAR(y[i], std::tanh(x[i]), 1e-6) << x[i];
+  }
+  math::Sigmoid<float, CPUContext>(N, x.data(), y.data(), &cpu_context);
+  for (int i = 0; i < N; ++i) {
+    const float expected = 1.0f / (1.0f + std::exp(-x[i]));
+    EXPECT_NEAR(y[i], expected, 1e-6 * expected) << x[i];
+  }
+  for (int i = 0; i < N; ++i) {
+    x[i] = 1e-3f + 0.37f * i;
+  }
+  math::Log<float, CPUContext>(N, x.data(), y.data(), &cpu_context);
+  for (int i = 0; i < N; ++i) {
+    EXPECT_NEAR(y[i], std::log(x[i]), 1e-6 * std::abs(std::log(x[i])))
+        << x[i];
+  }
+}
+
+
+TEST(MathTest, GemmBatched) {
+  DeviceOption option;
+  CPUContext cpu_context(option);
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> value(-1, 1);
+  const int kBatchSize = 5;
+  // A small and a larger size.
+  for (int size : {3, 40}) {
+    const int M = size;
+    const int N = size + 1;
+    const int K = size + 2;
+    for (auto trans_a : {CblasNoTrans, CblasTrans}) {
+      for (auto trans_b : {CblasNoTrans, CblasTrans}) {
+        std::vector<float> A(kBatchSize * M * K);
+        std::vector<float> B(kBatchSize * K * N);
+        std::vector<float> C(kBatchSize * M * N);
+        for (auto* v : {&A, &B, &C}) {
+          for (auto& x : *v) {
+            x = value(gen);
+          }
+        }
+        std::vector<float> expected = C;
+        for (int i = 0; i < kBatchSize; ++i) {
+          math::Gemm<float, CPUContext>(
+              trans_a, trans_b, M, N, K, 0.5, A.data() + i * M * K,
+              B.data() + i * K * N, 2, expected.data() + i * M * N,
+              &cpu_context);
+        }
+        math::GemmBatched<float, CPUContext>(
+            trans_a, trans_b, kBatchSize, M, N, K, 0.5, A.data(), M * K,
+            B.data(), K * N, 2, C.data(), M * N, &cpu_context);
+        for (int i = 0; i < C.size(); ++i) {
+          EXPECT_NEAR(C[i], expected[i], 1e-4) << size << " " << i;
+        }
+      }
+    }
+  }
+}
 
+TEST(MathTest, PhiloxKnownAnswer) {
+  // From the known-answer tests of Random123.
+  uint32_t x[4];
+  math::philox::Block(0, 0, x);
+  EXPECT_EQ(x[0], 0x6627e8d5);
+  EXPECT_EQ(x[1], 0xe169c58d);
+  EXPECT_EQ(x[2], 0xbc57ac4c);
+  EXPECT_EQ(x[3], 0x9b00dbd8);
+}
+
+TEST(MathTest, RandIsReproducible) {
+  DeviceOption option;
+  option.set_random_seed(1234);
+  const int n = 100003;
+  std::vector<float> first(n);
+  std::vector<float> second(n);
+  {
+    CPUContext context(option);
+    math::RandUniform<float, CPUContext>(n, -2, 3, first.data(), &context);
+    math::RandGaussian<float, CPUContext>(n, 1, 2, second.data(), &context);
+  }
+  // A context with the same seed gives the same numbers, and the calls
+  // draw from different parts of the stream.
+  CPUContext context(option);
+  std::vector<float> uniform(n);
+  std::vector<float> gaussian(n);
+  math::RandUniform<float, CPUContext>(n, -2, 3, uniform.data(), &context);
+  math::RandGaussian<float, CPUContext>(n, 1, 2, gaussian.data(), &context);
+  EXPECT_EQ(first, uniform);
+  EXPECT_EQ(second, gaussian);
+
+  double sum = 0;
+  double sum_squares = 0;
+  for (int i = 0; i < n; ++i) {
+    EXPECT_GE(uniform[i], -2);
+    EXPECT_LT(uniform[i], 3);
+    EXPECT_TRUE(std::isfinite(gaussian[i]));
+    sum += gaussian[i];
+    sum_squares += gaussian[i] * gaussian[i];
+  }
+  const double mean = sum / n;
+  EXPECT_NEAR(mean, 1, 0.05);
+  EXPECT_NEAR(std::sqrt(sum_squares / n - mean * mean), 2, 0.05);
+}
+
+}  // namespace caffe2
@@ -745,6 +745,31 @@ C2_MKL_SPEC_PREFIX dnnError_t dnnGroupsConvolutionCreateBackwardBias<double>(
       pConvolution, attributes, algorithm, groups, dimension, dstSize);
 }
 
+C2_MKL_TEMPLATE_PREFIX dnnError_t dnnInnerProductCreateForwardBias(
+    dnnPrimitive_t* pInnerProduct,
+    dnnPrimitiveAttributes_t attributes,
+    size_t dimensions,
+    const size_t srcSize[],
+    size_t outputChannels);
+C2_MKL_SPEC_PREFIX dnnError_t dnnInnerProductCreateForwardBias<float>(
+    dnnPrimitive_t* pInnerProduct,
+    dnnPrimitiveAttributes_t attributes,
+    size_t dimensions,
+    const size_t srcSize[],
+    size_t outputChannels) {
+  return dnnInnerProductCreateForwardBias_F32(
+      pInnerProduct, attributes, dimensions, srcSize, outputChannels);
+}
+C2_MKL_SPEC_PREFIX dnnError_t dnnInnerProductCreateForwardBias<double>(
+    dnnPrimitive_t* pInnerProduct,
+    dnnPrimitiveAttributes_t attributes,
+    size_t dimensions,
+    const size_t srcSize[],
+    size_t outputChannels) {
+  return dnnInnerProductCreateForwardBias_F64(
+      pInnerProduct, attributes, dimensions, srcSize, outputChannels);
+}
+
 C2_MKL_TEMPLATE_PREFIX dnnError_t dnnReLUCreateForward(
     dnnPrimitive_t* pRelu,
     dnnPrimitiveAttributes_t attributes,
@@ -0,0 +1,45 @@
+#ifndef CAFFE2_UTILS_MKL_LAYOUT_PLANNER_H_
+#define CAFFE2_UTILS_MKL_LAYOUT_PLANNER_H_
+
+#include "caffe2/core/common.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+namespace mkl {
+
+// The suffix of the blobs that PlanMKLLayouts() adds to hold the TensorCPU
+// version of a blob.
+constexpr char kMKLPlannerCPUSuffix[] = "_cpu";
+
+/**
+ * @brief Plans where the blobs of an MKLDNN net live, so that blobs are only
+ * converted between MKLMemory and TensorCPU where the net actually crosses
+ * from MKL operators to CPU ones.
+ *
+ * Wrapping every CPU operator in MKLFallbackOp converts all its inputs out of
+ * MKLMemory and all its outputs back on every run, even between two CPU
+ * operators, and even if the same blob was converted by the operator before.
+ * PlanMKLLayouts() instead returns a copy of the net in which:
+ *
+ *  - the MKLDNN operators that have no MKL implementation run on CPU, and
+ *    read and write the TensorCPU version of their blobs, named with
+ *    kMKLPlannerCPUSuffix;
+ *  - a CopyMKLToCPU or CopyCPUToMKL operator is inserted in front of an
+ *    operator only if the version of an input it needs is out of date, so a
+ *    blob read by several CPU operators is converted once per write;
+ *  - the external outputs are converted back to MKLMemory at the end, if the
+ *    last operator that wrote them ran on CPU.
+ *
+ * The MKLMemory that CopyCPUToMKL writes keeps the conversion primitive
+ * between its plain and internal layouts, so steady-state runs of the
+ * planned net create no primitives. Operators on devices other than MKLDNN
+ * are left alone, and read the TensorCPU version of a blob if that is the
+ * only one up to date. External inputs may be fed either as MKLMemory or as
+ * TensorCPU: the inserted copies share inputs of the right type.
+ */
+NetDef PlanMKLLayouts(const NetDef& net);
+
+} // namespace mkl
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_MKL_LAYOUT_PLANNER_H_
@@ -254,13 +254,13 @@ class MKLMemory {
   }
 
   void CopyFrom(const MKLMemory<T>& other) {
-    if (share_mem_if_possible_ && dnnLayoutCompare(other.layout_, layout_)) {
+    if (share_mem_if_possible_ && dnnLayoutCompare<T>(other.layout_, layout_)) {
       buffer_ = other.buffer_;
     } else {
       PrimitiveWrapper<T> convert(
           dnnConversionCreate<T>, other.layout_, layout_);
       MKLDNN_SAFE_CALL(
-          dnnConversionExecute<T>(convert, other.buffer_, buffer()));
+          dnnConversionExecute<T>(convert, other.buffer_.get(), buffer()));
     }
   }
 
@@ -310,13 +310,14 @@ class MKLMemory {
   }
 
   void CopyTo(TensorCPU* tensor) const {
+    // Resized first, as mutable_data() throws on an uninitialized tensor.
+    tensor->Resize(dims_);
     if (buffer_.get() == tensor->mutable_data<T>()) {
       // This is already mapping to the same memory region. Skip copy.
       VLOG(2) << "CopyTo does not need actual copying, as we are sharing "
                  "memory with the output.";
       return;
     }
-    tensor->Resize(dims_);
     CopyTo(tensor->mutable_data<T>());
   }
 
@@ -39,6 +39,7 @@
 #ifdef CAFFE2_HAS_MKL_DNN
 #include "caffe2/utils/mkl/mkl_context.h"
 #include "caffe2/utils/mkl/mkl_dnn_cppwrapper.h"
+#include "caffe2/utils/mkl/mkl_layout_planner.h"
 #include "caffe2/utils/mkl/mkl_memory.h"
 #include "caffe2/utils/mkl/mkl_operator.h"
 #endif // CAFFE2_HAS_MKL_DNN
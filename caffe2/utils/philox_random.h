@@ -0,0 +1,139 @@
+#ifndef CAFFE2_UTILS_PHILOX_RANDOM_H_
+#define CAFFE2_UTILS_PHILOX_RANDOM_H_
+
+#include <algorithm>
+#include <cstdint>
+
+#ifdef __CUDACC__
+#define PHILOX_HOST_DEVICE __host__ __device__ inline
+#else
+#define PHILOX_HOST_DEVICE inline
+#endif
+
+namespace caffe2 {
+namespace math {
+
+// Philox4x32-10, the counter-based generator of Salmon et al., "Parallel
+// Random Numbers: As Easy as 1, 2, 3". Block c of the stream of a 64-bit key
+// is four 32-bit numbers that only depend on the key and c, so any part of
+// the stream can be generated on its own: threads split a range of blocks
+// and still give the same numbers as one thread, and so does a CUDA kernel,
+// as these functions also compile for the device.
+namespace philox {
+
+constexpr uint32_t kMultiplier0 = 0xD2511F53;
+constexpr uint32_t kMultiplier1 = 0xCD9E8D57;
+constexpr uint32_t kWeyl0 = 0x9E3779B9;
+constexpr uint32_t kWeyl1 = 0xBB67AE85;
+constexpr int kRounds = 10;
+
+// The numbers of block counter under key, in out[0..3].
+PHILOX_HOST_DEVICE void Block(uint64_t key, uint64_t counter, uint32_t* out) {
+  uint32_t c0 = static_cast<uint32_t>(counter);
+  uint32_t c1 = static_cast<uint32_t>(counter >> 32);
+  uint32_t c2 = 0;
+  uint32_t c3 = 0;
+  uint32_t k0 = static_cast<uint32_t>(key);
+  uint32_t k1 = static_cast<uint32_t>(key >> 32);
+  for (int round = 0; round < kRounds; ++round) {
+    const uint64_t product0 = static_cast<uint64_t>(kMultiplier0) * c0;
+    const uint64_t product1 = static_cast<uint64_t>(kMultiplier1) * c2;
+    const uint32_t hi0 = static_cast<uint32_t>(product0 >> 32);
+    const uint32_t hi1 = static_cast<uint32_t>(product1 >> 32);
+    c0 = hi1 ^ c1 ^ k0;
+    c1 = static_cast<uint32_t>(product1);
+    c2 = hi0 ^ c3 ^ k1;
+    c3 = static_cast<uint32_t>(product0);
+    k0 += kWeyl0;
+    k1 += kWeyl1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+// A float in [0, 1) from the top 24 bits of x.
+PHILOX_HOST_DEVICE float ToUniform(uint32_t x) {
+  return (x >> 8) * (1.0f / (1 << 24));
+}
+
+// A float in (0, 1] from the top 24 bits of x, for taking logarithms.
+PHILOX_HOST_DEVICE float ToUniformNonZero(uint32_t x) {
+  return ((x >> 8) + 1) * (1.0f / (1 << 24));
+}
+
+#ifndef __CUDACC__
+
+// Blocks are generated kLanes at a time on the CPU, with each word of the
+// lanes in its own array, so that the rounds run on vector registers.
+constexpr int kLanes = 16;
+
+// The blocks counter, ..., counter + kLanes - 1, in out[lane][0..3].
+inline void Lanes(uint64_t key, uint64_t counter, uint32_t out[kLanes][4]) {
+  uint32_t c0[kLanes], c1[kLanes], c2[kLanes], c3[kLanes];
+  for (int l = 0; l < kLanes; ++l) {
+    c0[l] = static_cast<uint32_t>(counter + l);
+    c1[l] = static_cast<uint32_t>((counter + l) >> 32);
+    c2[l] = 0;
+    c3[l] = 0;
+  }
+  uint32_t k0 = static_cast<uint32_t>(key);
+  uint32_t k1 = static_cast<uint32_t>(key >> 32);
+  for (int round = 0; round < kRounds; ++round) {
+    for (int l = 0; l < kLanes; ++l) {
+      const uint64_t product0 = static_cast<uint64_t>(kMultiplier0) * c0[l];
+      const uint64_t product1 = static_cast<uint64_t>(kMultiplier1) * c2[l];
+      const uint32_t hi0 = static_cast<uint32_t>(product0 >> 32);
+      const uint32_t hi1 = static_cast<uint32_t>(product1 >> 32);
+      c0[l] = hi1 ^ c1[l] ^ k0;
+      c1[l] = static_cast<uint32_t>(product1);
+      c2[l] = hi0 ^ c3[l] ^ k1;
+      c3[l] = static_cast<uint32_t>(product0);
+    }
+    k0 += kWeyl0;
+    k1 += kWeyl1;
+  }
+  for (int l = 0; l < kLanes; ++l) {
+    out[l][0] = c0[l];
+    out[l][1] = c1[l];
+    out[l][2] = c2[l];
+    out[l][3] = c3[l];
+  }
+}
+
+// Calls f(i, x) for the blocks i = 0, ..., num_blocks - 1 of the stream
+// that starts at block counter, with x the four numbers of block i. The
+// blocks are split across OpenMP threads, so f must only write to the data
+// of i; the numbers do not depend on the number of threads.
+template <typename F>
+void ForEachBlock(
+    uint64_t key,
+    uint64_t counter,
+    int64_t num_blocks,
+    const F& f) {
+  const int64_t num_chunks = (num_blocks + kLanes - 1) / kLanes;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (num_chunks > 64)
+#endif
+  for (int64_t chunk = 0; chunk < num_chunks; ++chunk) {
+    uint32_t blocks[kLanes][4];
+    const int64_t first = chunk * kLanes;
+    Lanes(key, counter + first, blocks);
+    const int lanes =
+        static_cast<int>(std::min<int64_t>(kLanes, num_blocks - first));
+    for (int l = 0; l < lanes; ++l) {
+      f(first + l, blocks[l]);
+    }
+  }
+}
+
+#endif // __CUDACC__
+
+} // namespace philox
+} // namespace math
+} // namespace caffe2
+
+#undef PHILOX_HOST_DEVICE
+
+#endif // CAFFE2_UTILS_PHILOX_RANDOM_H_
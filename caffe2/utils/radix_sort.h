@@ -0,0 +1,107 @@
+#ifndef CAFFE2_UTILS_RADIX_SORT_H_
+#define CAFFE2_UTILS_RADIX_SORT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "caffe2/core/common_omp.h"
+
+namespace caffe2 {
+
+// Maps a signed or unsigned integer to an unsigned one with the same order,
+// which is what the radix sort works on.
+template <typename T>
+inline typename std::make_unsigned<T>::type RadixKey(T x) {
+  using U = typename std::make_unsigned<T>::type;
+  return std::is_signed<T>::value
+      ? static_cast<U>(x) ^ (U(1) << (8 * sizeof(T) - 1))
+      : static_cast<U>(x);
+}
+
+template <typename T>
+inline T FromRadixKey(typename std::make_unsigned<T>::type x) {
+  using U = typename std::make_unsigned<T>::type;
+  return std::is_signed<T>::value
+      ? static_cast<T>(x ^ (U(1) << (8 * sizeof(T) - 1)))
+      : static_cast<T>(x);
+}
+
+/**
+ * Stable LSD radix sort of n unsigned integer keys, carrying values along.
+ * Each pass over a byte of the key is split into contiguous chunks, one per
+ * OpenMP thread: chunks build their histograms in parallel, a prefix sum in
+ * (digit, chunk) order gives every chunk its stable write offsets and the
+ * chunks then scatter in parallel. Passes where all keys share the same digit
+ * are skipped, so ids from a small range only pay for their significant
+ * bytes. keys_tmp and values_tmp are scratch space of n elements; the result
+ * is always left in keys and values.
+ */
+template <typename K, typename V>
+void RadixSortPairs(
+    int64_t n,
+    K* keys,
+    V* values,
+    K* keys_tmp,
+    V* values_tmp) {
+  static_assert(std::is_unsigned<K>::value, "Radix sort keys are unsigned");
+  constexpr int kRadix = 256;
+  constexpr int64_t kMinChunkSize = 1 << 14;
+  int chunks = 1;
+#ifdef _OPENMP
+  chunks = std::max<int64_t>(
+      1, std::min<int64_t>(omp_get_max_threads(), n / kMinChunkSize));
+#endif
+  std::vector<int64_t> offsets(chunks * kRadix);
+  K* src_keys = keys;
+  V* src_values = values;
+  K* dst_keys = keys_tmp;
+  V* dst_values = values_tmp;
+  for (int shift = 0; shift < 8 * sizeof(K); shift += 8) {
+    std::fill(offsets.begin(), offsets.end(), 0);
+#pragma omp parallel for if (chunks > 1)
+    for (int c = 0; c < chunks; ++c) {
+      int64_t* hist = offsets.data() + c * kRadix;
+      const int64_t end = n * (c + 1) / chunks;
+      for (int64_t i = n * c / chunks; i < end; ++i) {
+        ++hist[(src_keys[i] >> shift) & (kRadix - 1)];
+      }
+    }
+    int64_t total = 0;
+    bool trivial = false;
+    for (int d = 0; d < kRadix; ++d) {
+      int64_t digit_count = 0;
+      for (int c = 0; c < chunks; ++c) {
+        const int64_t count = offsets[c * kRadix + d];
+        offsets[c * kRadix + d] = total;
+        total += count;
+        digit_count += count;
+      }
+      trivial |= digit_count == n;
+    }
+    if (trivial) {
+      continue;
+    }
+#pragma omp parallel for if (chunks > 1)
+    for (int c = 0; c < chunks; ++c) {
+      int64_t* offset = offsets.data() + c * kRadix;
+      const int64_t end = n * (c + 1) / chunks;
+      for (int64_t i = n * c / chunks; i < end; ++i) {
+        const int64_t pos = offset[(src_keys[i] >> shift) & (kRadix - 1)]++;
+        dst_keys[pos] = src_keys[i];
+        dst_values[pos] = src_values[i];
+      }
+    }
+    std::swap(src_keys, dst_keys);
+    std::swap(src_values, dst_values);
+  }
+  if (src_keys != keys) {
+    std::copy(src_keys, src_keys + n, keys);
+    std::copy(src_values, src_values + n, values);
+  }
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_RADIX_SORT_H_
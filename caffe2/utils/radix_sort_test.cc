@@ -0,0 +1,61 @@
+#include "caffe2/utils/radix_sort.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace caffe2 {
+
+namespace {
+
+template <typename T>
+void CheckSort(const std::vector<T>& data) {
+  using U = typename std::make_unsigned<T>::type;
+  const int64_t n = data.size();
+  std::vector<U> keys(n), keys_tmp(n);
+  std::vector<int> positions(n), positions_tmp(n);
+  for (int64_t i = 0; i < n; ++i) {
+    keys[i] = RadixKey(data[i]);
+    positions[i] = i;
+  }
+  RadixSortPairs(
+      n, keys.data(), positions.data(), keys_tmp.data(), positions_tmp.data());
+
+  std::vector<int> expected(n);
+  for (int64_t i = 0; i < n; ++i) {
+    expected[i] = i;
+  }
+  std::stable_sort(expected.begin(), expected.end(), [&data](int x, int y) {
+    return data[x] < data[y];
+  });
+  for (int64_t i = 0; i < n; ++i) {
+    ASSERT_EQ(positions[i], expected[i]) << i;
+    ASSERT_EQ(FromRadixKey<T>(keys[i]), data[expected[i]]) << i;
+  }
+}
+
+} // namespace
+
+TEST(RadixSortTest, SignedAndStable) {
+  CheckSort<int32_t>({});
+  CheckSort<int32_t>({5, -3, 5, 0, -3, 2147483647, -2147483647 - 1, 7});
+  CheckSort<int64_t>({3, 3, 3});
+}
+
+TEST(RadixSortTest, Large) {
+  std::mt19937_64 gen(0);
+  // Many duplicates from a small range, so that most passes are skipped, and
+  // the full int64 range.
+  std::vector<int64_t> small(100000), wide(100000);
+  for (auto& x : small) {
+    x = static_cast<int64_t>(gen() % 1000) - 500;
+  }
+  for (auto& x : wide) {
+    x = static_cast<int64_t>(gen());
+  }
+  CheckSort(small);
+  CheckSort(wide);
+}
+
+} // namespace caffe2
@@ -2,6 +2,7 @@
 #define CAFFE2_UTILS_SIMPLE_QUEUE_H_
 
 #include <condition_variable>  // NOLINT
+#include <cstdint>
 #include <mutex>  // NOLINT
 #include <queue>
 
@@ -69,6 +70,60 @@ class SimpleQueue {
   SimpleQueue(const SimpleQueue& src) {}
 };
 
+// SimplePriorityQueue works like SimpleQueue, except that Pop() returns the
+// value pushed with the highest priority first, and values pushed with the
+// same priority in the order in which they were pushed.
+template <typename T>
+class SimplePriorityQueue {
+ public:
+  SimplePriorityQueue() : no_more_jobs_(false), num_pushed_(0) {}
+
+  bool Pop(T* value) {
+    std::unique_lock<std::mutex> mutex_lock(mutex_);
+    while (queue_.size() == 0 && !no_more_jobs_) cv_.wait(mutex_lock);
+    if (queue_.size() == 0 && no_more_jobs_) return false;
+    *value = queue_.top().value;
+    queue_.pop();
+    return true;
+  }
+
+  void Push(const T& value, int priority) {
+    {
+      std::lock_guard<std::mutex> mutex_lock(mutex_);
+      CAFFE_ENFORCE(!no_more_jobs_, "Cannot push to a closed queue.");
+      queue_.push(Entry{value, priority, num_pushed_++});
+    }
+    cv_.notify_one();
+  }
+
+  void NoMoreJobs() {
+    {
+      std::lock_guard<std::mutex> mutex_lock(mutex_);
+      no_more_jobs_ = true;
+    }
+    cv_.notify_all();
+  }
+
+ private:
+  struct Entry {
+    T value;
+    int priority;
+    uint64_t sequence;
+
+    bool operator<(const Entry& other) const {
+      return priority < other.priority ||
+          (priority == other.priority && sequence > other.sequence);
+    }
+  };
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::priority_queue<Entry> queue_;
+  bool no_more_jobs_;
+  uint64_t num_pushed_;
+  SimplePriorityQueue(const SimplePriorityQueue& src) {}
+};
+
 }  // namespace caffe2
 
 #endif  // CAFFE2_UTILS_SIMPLE_QUEUE_H_
@@ -0,0 +1,155 @@
+#ifndef CAFFE2_UTILS_WORK_STEALING_QUEUE_H_
+#define CAFFE2_UTILS_WORK_STEALING_QUEUE_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/logging.h"
+
+namespace caffe2 {
+
+// A job queue made of one deque per worker. It has the same usage pattern as
+// SimpleQueue, except that every Push() and Pop() names the worker that is
+// calling it:
+//
+// - A worker pushes new jobs to the back of its own deque and pops from the
+//   back of its own deque, so the job it just made ready (which most likely
+//   touches the data it just produced) runs next on the same thread.
+// - When its own deque is empty, a worker steals from the front of the other
+//   workers' deques, which holds the oldest jobs.
+// - Only when there is nothing to steal anywhere does a worker go to sleep.
+//
+// Each deque has its own mutex, so in the common case workers only contend
+// with the occasional thief instead of all fighting over a single lock.
+template <typename T>
+class WorkStealingQueue {
+ public:
+  explicit WorkStealingQueue(int num_workers)
+      : deques_(num_workers), num_jobs_(0), num_sleepers_(0),
+        no_more_jobs_(false) {
+    CAFFE_ENFORCE(num_workers > 0, "Must have a positive number of workers.");
+    for (auto& d : deques_) {
+      d.reset(new LockedDeque());
+    }
+  }
+
+  int num_workers() const {
+    return deques_.size();
+  }
+
+  // Pops a value for the given worker and writes it to the value pointer. The
+  // worker's own deque is tried first, then the other deques are tried in
+  // round robin order. If nothing is available anywhere, this will wait till a
+  // value is pushed. If there are no more jobs to pop, the function returns
+  // false. Otherwise, it returns true.
+  bool Pop(int worker, T* value) {
+    while (true) {
+      if (TryPop(worker, value)) {
+        return true;
+      }
+      std::unique_lock<std::mutex> sleep_lock(sleep_mutex_);
+      ++num_sleepers_;
+      sleep_cv_.wait(
+          sleep_lock, [this]() { return num_jobs_ > 0 || no_more_jobs_; });
+      --num_sleepers_;
+      if (num_jobs_ == 0 && no_more_jobs_) {
+        return false;
+      }
+    }
+  }
+
+  // Same as Pop(), but never waits: returns false right away if there is
+  // nothing in any of the deques.
+  bool TryPop(int worker, T* value) {
+    DCHECK_GE(worker, 0);
+    DCHECK_LT(worker, deques_.size());
+    if (TryPopBack(worker, value)) {
+      return true;
+    }
+    for (int i = 1; i < deques_.size(); ++i) {
+      if (TryPopFront((worker + i) % deques_.size(), value)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Pushes a value to the back of the given worker's deque.
+  void Push(int worker, const T& value) {
+    DCHECK_GE(worker, 0);
+    DCHECK_LT(worker, deques_.size());
+    {
+      auto& d = *deques_[worker];
+      std::lock_guard<std::mutex> lock(d.mutex);
+      CAFFE_ENFORCE(!no_more_jobs_, "Cannot push to a closed queue.");
+      d.jobs.push_back(value);
+    }
+    ++num_jobs_;
+    // Only touch the sleep mutex if somebody may actually be waiting. Both
+    // counters are sequentially consistent, so either we see the sleeper here
+    // or the sleeper sees the job we just added before it waits.
+    if (num_sleepers_ > 0) {
+      { std::lock_guard<std::mutex> sleep_lock(sleep_mutex_); }
+      sleep_cv_.notify_one();
+    }
+  }
+
+  // NoMoreJobs() marks the close of this queue, with the same semantics as
+  // SimpleQueue::NoMoreJobs(): remaining jobs can still be checked out, after
+  // which Pop() returns false.
+  void NoMoreJobs() {
+    {
+      std::lock_guard<std::mutex> sleep_lock(sleep_mutex_);
+      no_more_jobs_ = true;
+    }
+    sleep_cv_.notify_all();
+  }
+
+ private:
+  struct LockedDeque {
+    std::mutex mutex;
+    std::deque<T> jobs;
+  };
+
+  bool TryPopBack(int worker, T* value) {
+    auto& d = *deques_[worker];
+    std::lock_guard<std::mutex> lock(d.mutex);
+    if (d.jobs.empty()) {
+      return false;
+    }
+    *value = d.jobs.back();
+    d.jobs.pop_back();
+    --num_jobs_;
+    return true;
+  }
+
+  bool TryPopFront(int victim, T* value) {
+    auto& d = *deques_[victim];
+    std::lock_guard<std::mutex> lock(d.mutex);
+    if (d.jobs.empty()) {
+      return false;
+    }
+    *value = d.jobs.front();
+    d.jobs.pop_front();
+    --num_jobs_;
+    return true;
+  }
+
+  std::vector<std::unique_ptr<LockedDeque>> deques_;
+  std::atomic<int> num_jobs_;
+  std::atomic<int> num_sleepers_;
+  std::atomic<bool> no_more_jobs_;
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+
+  DISABLE_COPY_AND_ASSIGN(WorkStealingQueue);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_UTILS_WORK_STEALING_QUEUE_H_
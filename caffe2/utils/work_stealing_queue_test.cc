@@ -0,0 +1,66 @@
+#include <atomic>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "caffe2/utils/work_stealing_queue.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+static std::unique_ptr<WorkStealingQueue<int> > gQueue;
+
+static void ConsumerFunction(int worker, std::atomic<int>* sum) {
+  int value;
+  while (true) {
+    if (!gQueue->Pop(worker, &value)) return;
+    *sum += value;
+  }
+}
+
+TEST(WorkStealingQueueTest, OwnerPopsLastPushedFirst) {
+  gQueue.reset(new WorkStealingQueue<int>(2));
+  gQueue->Push(0, 1);
+  gQueue->Push(0, 2);
+  gQueue->Push(0, 3);
+  int value;
+  EXPECT_TRUE(gQueue->Pop(0, &value));
+  EXPECT_EQ(value, 3);
+  // A thief takes the oldest job.
+  EXPECT_TRUE(gQueue->Pop(1, &value));
+  EXPECT_EQ(value, 1);
+  EXPECT_TRUE(gQueue->Pop(0, &value));
+  EXPECT_EQ(value, 2);
+  gQueue->NoMoreJobs();
+  EXPECT_FALSE(gQueue->Pop(0, &value));
+  EXPECT_FALSE(gQueue->Pop(1, &value));
+}
+
+TEST(WorkStealingQueueTest, IdleWorkersStealEverything) {
+  const int kNumWorkers = 4;
+  gQueue.reset(new WorkStealingQueue<int>(kNumWorkers));
+  std::atomic<int> sum{0};
+  std::vector<std::thread> consumers;
+  for (int i = 0; i < kNumWorkers; ++i) {
+    consumers.emplace_back(ConsumerFunction, i, &sum);
+  }
+  // Everything goes to worker 0; the other workers have to steal.
+  int expected = 0;
+  for (int i = 0; i < 1000; ++i) {
+    gQueue->Push(0, i);
+    expected += i;
+  }
+  gQueue->NoMoreJobs();
+  for (auto& consumer : consumers) {
+    consumer.join();
+  }
+  EXPECT_EQ(sum, expected);
+}
+
+TEST(WorkStealingQueueDeathTest, CannotAddAfterQueueFinished) {
+  gQueue.reset(new WorkStealingQueue<int>(1));
+  gQueue->Push(0, 0);
+  gQueue->NoMoreJobs();
+  ASSERT_THROW(gQueue->Push(0, 0), EnforceNotMet);
+}
+
+}  // namespace caffe2
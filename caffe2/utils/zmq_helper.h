@@ -3,6 +3,12 @@
 
 #include <zmq.h>
 
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "caffe2/core/logging.h"
 
 namespace caffe2 {
@@ -36,6 +42,19 @@ class ZmqMessage {
     CAFFE_ENFORCE_EQ(rc, 0);
   }
 
+  // Takes over data, which zmq frees once the message has been sent, so that
+  // the bytes are never copied.
+  explicit ZmqMessage(std::unique_ptr<string> data) {
+    string* ptr = data.release();
+    int rc = zmq_msg_init_data(
+        &msg_,
+        &(*ptr)[0],
+        ptr->size(),
+        [](void* /*data*/, void* hint) { delete static_cast<string*>(hint); },
+        ptr);
+    CAFFE_ENFORCE_EQ(rc, 0);
+  }
+
   ~ZmqMessage() {
     int rc = zmq_msg_close(&msg_);
     CAFFE_ENFORCE_EQ(rc, 0);
@@ -45,6 +64,8 @@ class ZmqMessage {
 
   void* data() { return zmq_msg_data(&msg_); }
   size_t size() { return zmq_msg_size(&msg_); }
+  // Whether more frames of the same multipart message follow this one.
+  bool more() { return zmq_msg_more(&msg_); }
 
  private:
   zmq_msg_t msg_;
@@ -105,6 +126,27 @@ class ZmqSocket {
     return nbytes;
   }
 
+  // Sends msg without copying it. On success zmq owns the content, and msg is
+  // left empty.
+  int SendTillSuccess(ZmqMessage* msg, int flags) {
+    CAFFE_ENFORCE(msg->size(), "You cannot send an empty message.");
+    while (true) {
+      int nbytes = zmq_msg_send(msg->msg(), ptr_, flags);
+      if (nbytes >= 0) {
+        return nbytes;
+      }
+      CAFFE_ENFORCE(
+          zmq_errno() == EAGAIN || zmq_errno() == EINTR,
+          "Cannot send zmq message. Error number: ",
+          zmq_errno());
+    }
+  }
+
+  void SetOption(int option, int value) {
+    int rc = zmq_setsockopt(ptr_, option, &value, sizeof(value));
+    CAFFE_ENFORCE_EQ(rc, 0);
+  }
+
   int Recv(ZmqMessage* msg) {
     int nbytes = zmq_msg_recv(msg->msg(), ptr_, 0);
     if (nbytes >= 0) {
@@ -131,6 +173,98 @@ class ZmqSocket {
   void* ptr_;
 };
 
+// A batch of records goes as one multipart message of two frames, a header
+// and a payload with all the keys and values back to back:
+//
+//   header:  kZmqBatchMagic | uint32 count | count x (uint32 key size,
+//            uint32 value size)
+//   payload: key 0 | value 0 | key 1 | value 1 | ...
+//
+// A single record goes as two frames, its key and its value, which is told
+// apart from a batch by the header not checking out.
+constexpr char kZmqBatchMagic[8] = {'C', '2', 'Z', 'M', 'Q', 'B', '0', '1'};
+
+class ZmqBatchWriter {
+ public:
+  ZmqBatchWriter() {
+    Clear();
+  }
+
+  void Clear() {
+    header_.reset(new string(kZmqBatchMagic, sizeof(kZmqBatchMagic)));
+    header_->append(sizeof(uint32_t), '\0');
+    payload_.reset(new string());
+    count_ = 0;
+  }
+
+  void Add(const char* key, size_t key_size, const char* value,
+           size_t value_size) {
+    const uint32_t sizes[2] = {static_cast<uint32_t>(key_size),
+                               static_cast<uint32_t>(value_size)};
+    CAFFE_ENFORCE(sizes[0] == key_size && sizes[1] == value_size);
+    header_->append(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+    payload_->append(key, key_size);
+    payload_->append(value, value_size);
+    ++count_;
+  }
+
+  uint32_t size() const {
+    return count_;
+  }
+
+  size_t payload_bytes() const {
+    return payload_->size();
+  }
+
+  // Sends the batch without copying it, and starts a new one.
+  void Send(ZmqSocket* socket) {
+    CAFFE_ENFORCE_GT(count_, 0, "You cannot send an empty batch.");
+    std::memcpy(&(*header_)[sizeof(kZmqBatchMagic)], &count_, sizeof(count_));
+    if (payload_->empty()) {
+      // zmq frames cannot be empty here, see SendTillSuccess.
+      payload_->push_back('\0');
+    }
+    ZmqMessage header(std::move(header_));
+    ZmqMessage payload(std::move(payload_));
+    socket->SendTillSuccess(&header, ZMQ_SNDMORE);
+    socket->SendTillSuccess(&payload, 0);
+    Clear();
+  }
+
+ private:
+  std::unique_ptr<string> header_;
+  std::unique_ptr<string> payload_;
+  uint32_t count_;
+};
+
+// Reads the record sizes of a batch from its header frame into sizes, as
+// key size, value size pairs. Returns false if header is not the header of a
+// batch whose payload has payload_size bytes.
+inline bool ParseZmqBatchHeader(
+    const char* header,
+    size_t header_size,
+    size_t payload_size,
+    std::vector<uint32_t>* sizes) {
+  const size_t prefix = sizeof(kZmqBatchMagic) + sizeof(uint32_t);
+  if (header_size < prefix ||
+      std::memcmp(header, kZmqBatchMagic, sizeof(kZmqBatchMagic)) != 0) {
+    return false;
+  }
+  uint32_t count;
+  std::memcpy(&count, header + sizeof(kZmqBatchMagic), sizeof(count));
+  if (count == 0 || header_size != prefix + 2 * count * sizeof(uint32_t)) {
+    return false;
+  }
+  sizes->resize(2 * count);
+  std::memcpy(sizes->data(), header + prefix, header_size - prefix);
+  size_t total = 0;
+  for (const uint32_t size : *sizes) {
+    total += size;
+  }
+  // A batch of empty records carries one padding byte.
+  return total == payload_size || (total == 0 && payload_size == 1);
+}
+
 }  // namespace caffe2
 
 
@@ -128,6 +128,50 @@ if(USE_ZMQ)
   endif()
 endif()
 
+# ---[ Numa
+if(USE_NUMA)
+  if(NOT ${CMAKE_SYSTEM_NAME} STREQUAL "Linux")
+    message(WARNING "NUMA is currently only supported under Linux.")
+    set(USE_NUMA OFF)
+  else()
+    find_package(Numa)
+    if(NUMA_FOUND)
+      include_directories(SYSTEM ${Numa_INCLUDE_DIR})
+      list(APPEND Caffe2_DEPENDENCY_LIBS ${Numa_LIBRARIES})
+      add_definitions(-DCAFFE2_USE_NUMA)
+    else()
+      message(WARNING "Not compiling with NUMA. Suppress this warning with -DUSE_NUMA=OFF")
+      set(USE_NUMA OFF)
+    endif()
+  endif()
+endif()
+
+# ---[ LZ4
+if(USE_LZ4)
+  find_package(LZ4)
+  if(LZ4_FOUND)
+    include_directories(SYSTEM ${LZ4_INCLUDE_DIR})
+    list(APPEND Caffe2_DEPENDENCY_LIBS ${LZ4_LIBRARIES})
+    add_definitions(-DCAFFE2_USE_LZ4)
+  else()
+    message(WARNING "Not compiling with LZ4. Suppress this warning with -DUSE_LZ4=OFF")
+    set(USE_LZ4 OFF)
+  endif()
+endif()
+
+# ---[ Zstd
+if(USE_ZSTD)
+  find_package(Zstd)
+  if(ZSTD_FOUND)
+    include_directories(SYSTEM ${Zstd_INCLUDE_DIR})
+    list(APPEND Caffe2_DEPENDENCY_LIBS ${Zstd_LIBRARIES})
+    add_definitions(-DCAFFE2_USE_ZSTD)
+  else()
+    message(WARNING "Not compiling with Zstd. Suppress this warning with -DUSE_ZSTD=OFF")
+    set(USE_ZSTD OFF)
+  endif()
+endif()
+
 # ---[ Redis
 if(USE_REDIS)
   find_package(Hiredis)
@@ -247,6 +291,24 @@ if (USE_CUDA)
   endif()
 endif()
 
+# ---[ nvJPEG
+if(USE_NVJPEG)
+  if (NOT USE_CUDA)
+    message(WARNING "If not using cuda, one should not use nvJPEG either.")
+    set(USE_NVJPEG OFF)
+  else()
+    find_package(NVJPEG)
+    if(NVJPEG_FOUND)
+      include_directories(SYSTEM ${NVJPEG_INCLUDE_DIR})
+      list(APPEND Caffe2_DEPENDENCY_LIBS ${NVJPEG_LIBRARIES})
+      add_definitions(-DCAFFE2_USE_NVJPEG)
+    else()
+      message(WARNING "Not compiling with nvJPEG. Suppress this warning with -DUSE_NVJPEG=OFF")
+      set(USE_NVJPEG OFF)
+    endif()
+  endif()
+endif()
+
 # ---[ NCCL
 if(USE_NCCL)
   if (NOT USE_CUDA)
@@ -70,7 +70,11 @@ function (Caffe2_print_configuration_summary)
   message(STATUS "  USE_ROCKSDB           : ${USE_ROCKSDB}")
   message(STATUS "  USE_MPI               : ${USE_MPI}")
   message(STATUS "  USE_NCCL              : ${USE_NCCL}")
+  message(STATUS "  USE_NVJPEG            : ${USE_NVJPEG}")
   message(STATUS "  USE_OPENMP            : ${USE_OPENMP}")
   message(STATUS "  USE_REDIS             : ${USE_REDIS}")
+  message(STATUS "  USE_NUMA              : ${USE_NUMA}")
+  message(STATUS "  USE_LZ4               : ${USE_LZ4}")
+  message(STATUS "  USE_ZSTD              : ${USE_ZSTD}")
 
 endfunction()